@@ -0,0 +1,121 @@
+#ifndef LSC_PLANNER_AGENT_EXCHANGE_HPP
+#define LSC_PLANNER_AGENT_EXCHANGE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sp_const.hpp>
+#include <trajectory.hpp>
+
+namespace DynamicPlanning {
+    enum class AgentExchangeMode {
+        SHARED_MEMORY, // the processes on one host, a ring of the blocks in a POSIX shared memory segment
+        SOCKET, // the processes on several hosts, the blocks are gathered and sent back by the process 0 over TCP
+    };
+
+    // The plan of an agent at the end of a step, sent by the process that plans the agent
+    struct ExchangedAgent {
+        int id = 0;
+        State current_state;
+        point3d current_goal_point;
+        point3d desired_goal_point;
+        bool collision_alert = false;
+        traj_t traj;
+    };
+
+    // Block of a process at a step: the failure flag of its planning, then its agents.
+    // All fields in the host byte order, the trajectories are copied exactly so that every process simulates the
+    // same agents.
+    namespace AgentExchangeBlock {
+        // The bytes of a block of n_agents agents with M segments of degree n
+        [[nodiscard]] size_t getCapacity(size_t n_agents, size_t M, size_t n);
+
+        void write(bool has_failed, const std::vector<ExchangedAgent> &agents, std::vector<uint8_t> &block);
+
+        // Append the agents of the block. False if the block is malformed.
+        bool read(const std::vector<uint8_t> &block, bool &has_failed, std::vector<ExchangedAgent> &agents);
+    }
+
+    // All-to-all exchange of a block per process at every step of the distributed simulation. exchange() returns
+    // after the blocks of all processes of the step are received, so it is the barrier that keeps the steps of the
+    // processes synchronous.
+    class AgentExchange {
+    public:
+        static constexpr double TIMEOUT = 120.0; // [s], a process that does not arrive in time is lost
+
+        virtual ~AgentExchange() = default;
+
+        // blocks[pi] is the block of the process pi at this step, blocks[process_index] is block.
+        // False if a process is lost or a block exceeds the capacity, the simulation can not continue.
+        virtual bool exchange(const std::vector<uint8_t> &block, std::vector<std::vector<uint8_t>> &blocks) = 0;
+
+        // nullptr if the exchange can not be set up in TIMEOUT, the process 0 is started first.
+        // address: the name of the segment for SHARED_MEMORY, host:port of the process 0 for SOCKET.
+        // block_capacity: the max bytes of a block.
+        [[nodiscard]] static std::unique_ptr<AgentExchange> create(AgentExchangeMode mode, const std::string &address,
+                                                                   int num_processes, int process_index,
+                                                                   size_t block_capacity);
+
+        static bool parseMode(const std::string &str, AgentExchangeMode &mode);
+
+        static std::string getModeStr(AgentExchangeMode mode);
+    };
+
+    // Two slots per process, the blocks of even and odd steps. A process writes its slot of the step and waits at
+    // the barrier, then reads the other slots. The next step writes the other slots, and no process writes them
+    // again before all have passed the next barrier, so one barrier per step is enough.
+    class SharedMemoryAgentExchange : public AgentExchange {
+    public:
+        SharedMemoryAgentExchange(const std::string &_name, int _num_processes, int _process_index,
+                                  size_t _block_capacity);
+
+        ~SharedMemoryAgentExchange() override;
+
+        bool exchange(const std::vector<uint8_t> &block, std::vector<std::vector<uint8_t>> &blocks) override;
+
+        [[nodiscard]] bool isOpen() const { return header != nullptr; }
+
+    private:
+        struct Header;
+
+        std::string name;
+        int num_processes;
+        int process_index;
+        size_t block_capacity;
+        size_t segment_size = 0;
+        Header *header = nullptr;
+        uint8_t *slots = nullptr; // [parity][process], a size (uint64) and block_capacity bytes
+        uint64_t step = 0;
+
+        [[nodiscard]] uint8_t *getSlot(uint64_t parity, int pi) const;
+
+        bool waitBarrier();
+    };
+
+    // A star on the process 0, which receives the blocks of the others and sends all blocks back to each of them
+    class SocketAgentExchange : public AgentExchange {
+    public:
+        SocketAgentExchange(const std::string &_address, int _num_processes, int _process_index,
+                            size_t _block_capacity);
+
+        ~SocketAgentExchange() override;
+
+        bool exchange(const std::vector<uint8_t> &block, std::vector<std::vector<uint8_t>> &blocks) override;
+
+        [[nodiscard]] bool isOpen() const { return is_open; }
+
+    private:
+        int num_processes;
+        int process_index;
+        size_t block_capacity;
+        bool is_open = false;
+        std::vector<int> peer_fds; // [process], the sockets of the others at the process 0, [0] at the others
+
+        bool sendBlock(int fd, const std::vector<uint8_t> &block) const;
+
+        bool receiveBlock(int fd, std::vector<uint8_t> &block) const;
+    };
+}
+
+#endif //LSC_PLANNER_AGENT_EXCHANGE_HPP
@@ -4,25 +4,71 @@
 #include <trajectory.hpp>
 #include <traj_planner.hpp>
 #include <map_manager.hpp>
+#include <planning_capture.hpp>
+#include <agent_exchange.hpp>
 #include <util.hpp>
 
 namespace DynamicPlanning {
     class AgentManager {
     public:
-        AgentManager(const ros::NodeHandle &nh, const Param &param, const Mission &mission, int agent_id);
+        // The planning state before a cycle, see TrajPlanner::Checkpoint
+        struct Checkpoint {
+            Agent agent;
+            PlannerState planner_state;
+            traj_t desired_traj;
+            bool collision_alert;
+            TrajPlanner::Checkpoint planner;
+        };
+
+        AgentManager(const ros::NodeHandle &nh, const Param &param, const std::shared_ptr<const Mission> &mission,
+                     int agent_id);
 
         void doStep(double time_step);
 
+        // Two stages of doStep, the sensor input and the distmap update of the local map
+        void moveAndSense(double time_step);
+
+        void updateLocalMap();
+
         PlanningReport plan(ros::Time sim_current_time);
 
+        // Two stages of plan() for the batched optimization
+        PlanningReport planBeforeOptimization(ros::Time sim_current_time);
+
+        PlanningReport planOptimization();
+
+        // ADMM iteration after planOptimization, see TrajPlanner::planConsensusIteration
+        double planConsensusIteration(const std::vector<ConsensusMessage>& messages);
+
+        [[nodiscard]] ConsensusMessage getConsensusMessage() const;
+
+        // Batched QP between planBeforeOptimization and planOptimization, see TrajPlanner::prepareBatchQP
+        QPProblem prepareBatchQP();
+
+        void setBatchQPSolution(const QPSolution& solution);
+
+        // A cycle planned after saveCheckpoint is discarded by restoreCheckpoint, the inputs are given again
+        void saveCheckpoint(Checkpoint &checkpoint) const;
+
+        void restoreCheckpoint(const Checkpoint &checkpoint);
+
+        // Follow the previous trajectory during a simulation step without replanning
+        PlanningReport hold();
+
         void publish();
 
         void publishMap();
 
-        void obstacleCallback(const std::vector<Obstacle> &msg_obstacles);
+        void obstacleCallback(std::vector<Obstacle> msg_obstacles);
 
         void mergeMapCallback(const octomap_msgs::Octomap& msg_merge_map);
 
+        void mergeMapDelta(int peer_id, const MapDelta& delta);
+
+        void mergeMapDeltaAsync(int peer_id, MapDelta delta);
+
+        void commitMapMerges();
+
         bool isInitialStateValid();
 
         // Setter
@@ -36,10 +82,33 @@ namespace DynamicPlanning {
 
         void setGlobalMap();
 
-        void setGlobalMap(const sensor_msgs::PointCloud2& global_map);
+        void setGlobalMap(const std::shared_ptr<const GlobalPointCloud>& global_cloud);
 
         void setNextWaypoint(const point3d& next_waypoint);
 
+        void setObstaclePredictionTable(std::shared_ptr<const ObstaclePredictionTable> table);
+
+        void setProgressStalled(bool is_stalled);
+
+        // Start the next mission in the same world as the constructor does, the global map, the caches and the
+        // solver models are kept. The global octomap must be used, see MultiSyncSimulator::resetMission.
+        void resetMission(const std::shared_ptr<const Mission>& mission);
+
+        // The map manager keeps its parameters, see Param::isRestartRequired
+        void updateParam(const Param& param);
+
+        // Append the inputs and the output of every planning to the capture, nullptr to stop. The capture must
+        // outlive the agent.
+        void setCapture(PlanningCaptureWriter* capture);
+
+        // The agent is planned by another process of the distributed simulation. It does not sense the map, and its
+        // plan is set by setExchangedAgent after every step.
+        void setRemote(bool _is_remote);
+
+        void setExchangedAgent(const ExchangedAgent& exchanged_agent);
+
+        [[nodiscard]] ExchangedAgent getExchangedAgent() const;
+
         // Getter
         [[nodiscard]] point3d getCurrentPosition() const;
 
@@ -49,21 +118,39 @@ namespace DynamicPlanning {
 
         [[nodiscard]] PlanningStatistics getPlanningStatistics() const;
 
-        [[nodiscard]] traj_t getTraj() const;
+        [[nodiscard]] const traj_t &getTraj() const;
 
         [[nodiscard]] int getPlannerSeq() const;
 
+        // The agent can skip replanning if it has a trajectory to follow
+        [[nodiscard]] bool canHold() const;
+
+        // The agent can skip replanning even if it is due, see TrajPlanner::isHoverCertified. It has to replan if
+        // the planning state transition would change its desired goal.
+        [[nodiscard]] bool canHover() const;
+
         [[nodiscard]] point3d getCurrentGoalPoint() const;
 
         [[nodiscard]] point3d getDesiredGoalPoint() const;
 
-        [[nodiscard]] Obstacle getAgent() const;
+        // The agent as an obstacle of the others, prev_traj is left empty if not with_traj
+        [[nodiscard]] Obstacle getAgent(bool with_traj = true) const;
 
         [[nodiscard]] octomap_msgs::Octomap getOctomapMsg() const;
 
+        [[nodiscard]] MapDelta getMapDelta(uint64_t since_seq) const;
+
+        [[nodiscard]] uint64_t getPeerMapSeq(int peer_id) const;
+
         [[nodiscard]] point3d getNextWaypoint() const;
 
-        [[nodiscard]] std::shared_ptr<DynamicEDTOctomap> getDistmap() const;
+        [[nodiscard]] std::shared_ptr<DistanceMap> getDistmap() const;
+
+        [[nodiscard]] std::shared_ptr<MapChangeLog> getMapChangeLog() const;
+
+        [[nodiscard]] std::shared_ptr<OccupancyIndex> getOccupancyIndex() const;
+
+        [[nodiscard]] SensorStatistics getSensorStatistics() const;
 
         [[nodiscard]] point3d getStartPoint() const;
 
@@ -73,11 +160,12 @@ namespace DynamicPlanning {
 
     private:
         Param param;
-        Mission mission;
+        std::shared_ptr<const Mission> mission; // shared by all components of all agents
 
         // Flags, states
         PlannerState planner_state;
         bool has_current_state, has_obstacles, has_local_map, is_disturbed;
+        bool is_remote = false;
 
         // Agent
         Agent agent;
@@ -87,6 +175,23 @@ namespace DynamicPlanning {
         //Traj Planner
         std::unique_ptr<TrajPlanner> traj_planner;
         std::unique_ptr<MapManager> map_manager;
+        std::shared_ptr<const MapSnapshot> planning_map; // pinned from planBeforeOptimization to planOptimization
+
+        // Capture, the obstacles are copied before they are moved to the planner
+        PlanningCaptureWriter* capture = nullptr;
+        std::vector<Obstacle> captured_obstacles;
+        ros::Time captured_sim_time;
+        Agent captured_agent;
+        bool captured_is_disturbed = false;
+
+        // Flight recorder, dumped to log/ after a failed or slow planning
+        PlanningFlightRecorder flight_recorder;
+        int n_recorder_dumps = 0;
+        int n_recorded_failures = 0;
+
+        [[nodiscard]] bool isCaptured() const { return capture != nullptr or flight_recorder.isEnabled(); }
+
+        void dumpFlightRecorder();
 
         void planningStateTransition();
     };
@@ -0,0 +1,96 @@
+#ifndef LSC_PLANNER_AGENT_STORE_HPP
+#define LSC_PLANNER_AGENT_STORE_HPP
+
+#include <memory>
+#include <vector>
+#include <sp_const.hpp>
+#include <agent_manager.hpp>
+
+namespace DynamicPlanning {
+    // The state of the agents after the last step in the structure-of-arrays layout, which the Python bindings
+    // expose without a copy. The buffers are resized only when the mission changes the number of agents or the
+    // trajectory structure, so a view of them stays valid over the steps of a mission.
+    struct AgentStateBuffers {
+        size_t n_agents = 0;
+        size_t n_control_points = 0; // per agent, M * (n + 1)
+        std::vector<double> positions, velocities, accelerations; // [agent * 3 + axis]
+        std::vector<double> goal_points; // [agent * 3 + axis], the current goals
+        std::vector<double> control_points; // [(agent * n_control_points + point) * 3 + axis], the desired trajectories
+        std::vector<int> planner_seqs; // [agent], the number of the planning cycles
+    };
+
+    // The agents of the simulator by index. The managers own the planners and the maps of the agents, and the state
+    // read by the loops over all agents is copied from the managers into contiguous arrays once per phase of the
+    // step, so the grouping, the broadcast, the statistics and the publishing read the arrays instead of calling
+    // every manager. The arrays are valid from the sync to the next change of the agents:
+    //   syncStates after the agents move, which happens in doStep, and after the states are set,
+    //   syncPlans after the agents plan, which changes the trajectories, the goals and the waypoints.
+    class AgentStore {
+    public:
+        // The managers, in the same way as a vector of them
+        [[nodiscard]] std::unique_ptr<AgentManager> &operator[](size_t qi) { return managers[qi]; }
+
+        [[nodiscard]] const std::unique_ptr<AgentManager> &operator[](size_t qi) const { return managers[qi]; }
+
+        [[nodiscard]] size_t size() const { return managers.size(); }
+
+        [[nodiscard]] bool empty() const { return managers.empty(); }
+
+        // The new managers are nullptr, the arrays are resized by the next sync
+        void resize(size_t n_agents) { managers.resize(n_agents); }
+
+        [[nodiscard]] auto begin() const { return managers.begin(); }
+
+        [[nodiscard]] auto end() const { return managers.end(); }
+
+        // The current states and the desired goals
+        void syncStates();
+
+        // The current goals, the next waypoints, the planner sequences and the trajectories. The control points of
+        // the trajectories are exported to the state buffers if export_buffers is true, see getStateBuffers.
+        void syncPlans(int M, int n, bool export_buffers);
+
+        [[nodiscard]] const points_t &getPositions() const { return positions; }
+
+        [[nodiscard]] const point3d &getPosition(size_t qi) const { return positions[qi]; }
+
+        [[nodiscard]] const vector3d &getVelocity(size_t qi) const { return velocities[qi]; }
+
+        [[nodiscard]] const vector3d &getAcceleration(size_t qi) const { return accelerations[qi]; }
+
+        [[nodiscard]] State getState(size_t qi) const;
+
+        [[nodiscard]] const point3d &getDesiredGoalPoint(size_t qi) const { return desired_goal_points[qi]; }
+
+        [[nodiscard]] const point3d &getCurrentGoalPoint(size_t qi) const { return current_goal_points[qi]; }
+
+        [[nodiscard]] const point3d &getNextWaypoint(size_t qi) const { return next_waypoints[qi]; }
+
+        [[nodiscard]] int getPlannerSeq(size_t qi) const { return planner_seqs[qi]; }
+
+        // The desired trajectory of the manager at the last syncPlans, by reference
+        [[nodiscard]] const traj_t &getTraj(size_t qi) const { return *trajs[qi]; }
+
+        // The arrays in the layout of the Python bindings after the last syncPlans with export_buffers
+        [[nodiscard]] const AgentStateBuffers &getStateBuffers() const { return buffers; }
+
+    private:
+        std::vector<std::unique_ptr<AgentManager>> managers; // [agent]
+
+        // [agent], syncStates
+        points_t positions;
+        std::vector<vector3d> velocities, accelerations;
+        points_t desired_goal_points;
+
+        // [agent], syncPlans
+        points_t current_goal_points, next_waypoints;
+        std::vector<int> planner_seqs;
+        std::vector<const traj_t *> trajs; // into the managers, valid until the agents plan again
+
+        AgentStateBuffers buffers;
+
+        void exportBuffers(int M, int n);
+    };
+}
+
+#endif //LSC_PLANNER_AGENT_STORE_HPP
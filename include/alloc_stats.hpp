@@ -0,0 +1,81 @@
+#ifndef LSC_PLANNER_ALLOC_STATS_HPP
+#define LSC_PLANNER_ALLOC_STATS_HPP
+
+#include <cstdint>
+
+namespace DynamicPlanning {
+    // Heap allocations on the calling thread, since the thread started or in a scope
+    struct AllocCounts {
+        uint64_t n_allocations = 0;
+        uint64_t bytes = 0; // allocated, including the ones freed later
+        int64_t live_bytes = 0; // allocated and not freed
+        int64_t peak_live_bytes = 0; // the maximum of live_bytes
+    };
+
+    // Counting allocator of the process, built with ENABLE_ALLOC_STATS only.
+    // malloc and its family forward to the glibc allocator and count the calls, so operator new, Eigen and the solvers
+    // are all counted. The counts are per thread without any lock, so the allocations of an agent are the ones of the
+    // thread planning it, and the memory freed by another thread is subtracted from the live bytes of that thread.
+    class AllocStats {
+    public:
+        [[nodiscard]] static constexpr bool isCompiled() {
+#ifdef LSC_PLANNER_ALLOC_STATS
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        // The peak is the one since the innermost AllocScope of the thread started
+        [[nodiscard]] static AllocCounts getThreadCounts();
+
+    private:
+        friend class AllocScope;
+
+        // Restart the peak of the thread and return the previous one
+        static int64_t beginScope();
+
+        static void endScope(int64_t prev_peak_live_bytes);
+    };
+
+    // The allocations on the calling thread from the construction. The scopes of a thread are nested local variables,
+    // and each of them has its own peak, which also counts for the outer scopes.
+    class AllocScope {
+    public:
+        AllocScope() {
+#ifdef LSC_PLANNER_ALLOC_STATS
+            start = AllocStats::getThreadCounts();
+            prev_peak_live_bytes = AllocStats::beginScope();
+#endif
+        }
+
+        ~AllocScope() {
+#ifdef LSC_PLANNER_ALLOC_STATS
+            AllocStats::endScope(prev_peak_live_bytes);
+#endif
+        }
+
+        AllocScope(const AllocScope &) = delete;
+
+        AllocScope &operator=(const AllocScope &) = delete;
+
+        // The peak and the live bytes are relative to the live bytes at the start, all zero if not compiled
+        [[nodiscard]] AllocCounts getCounts() const {
+            AllocCounts counts;
+#ifdef LSC_PLANNER_ALLOC_STATS
+            AllocCounts current = AllocStats::getThreadCounts();
+            counts.n_allocations = current.n_allocations - start.n_allocations;
+            counts.bytes = current.bytes - start.bytes;
+            counts.live_bytes = current.live_bytes - start.live_bytes;
+            counts.peak_live_bytes = current.peak_live_bytes - start.live_bytes;
+#endif
+            return counts;
+        }
+
+    private:
+        AllocCounts start;
+        int64_t prev_peak_live_bytes = 0;
+    };
+}
+
+#endif //LSC_PLANNER_ALLOC_STATS_HPP
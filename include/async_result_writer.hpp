@@ -0,0 +1,69 @@
+#ifndef LSC_PLANNER_ASYNC_RESULT_WRITER_HPP
+#define LSC_PLANNER_ASYNC_RESULT_WRITER_HPP
+
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <spsc_queue.hpp>
+#include <trajectory_log.hpp>
+
+namespace DynamicPlanning {
+    // Writes the frames of the simulation result in a background thread.
+    // The simulation thread only moves the sampled frames into a bounded lock-free queue, the writer thread formats
+    // them and writes the file in large chunks. The frame buffers are recycled through a second queue, so pushing
+    // does not allocate in the steady state. If the writer falls behind, push waits until a slot is free, so the
+    // memory stays bounded by the queue capacity.
+    class AsyncResultWriter {
+    public:
+        enum class Format {
+            CSV, // csv format of the simulator
+            BINARY, // binary trajectory log, see trajectory_log.hpp
+        };
+
+        // capacity: the maximum number of frames waiting for the writer thread
+        explicit AsyncResultWriter(size_t capacity = 1024);
+
+        // Flushes the remaining frames, so the result is kept when the simulation stops by failure
+        ~AsyncResultWriter();
+
+        AsyncResultWriter(const AsyncResultWriter &) = delete;
+
+        AsyncResultWriter &operator=(const AsyncResultWriter &) = delete;
+
+        // Create the file and start the writer thread, throws std::invalid_argument if the file can not be created
+        void open(const std::string &file_name, Format format, size_t qn, size_t on, double time_step);
+
+        // Write all pushed frames, then stop the writer thread and close the file
+        void close();
+
+        [[nodiscard]] bool isOpen() const { return writer.joinable(); }
+
+        // A buffer with the frame stride of the log, reused from the written frames if possible
+        [[nodiscard]] std::vector<float> acquireFrame();
+
+        // The frame in the layout of TrajectoryLog, waits while the queue is full
+        void push(std::vector<float> &&frame);
+
+        // The number of pushes that waited for the writer thread
+        [[nodiscard]] size_t getNumStalls() const { return n_stalls; }
+
+        // The frames waiting for the writer thread
+        [[nodiscard]] size_t getQueueSize() const { return frame_queue.sizeApprox(); }
+
+    private:
+        SPSCQueue<std::vector<float>> frame_queue; // simulation thread -> writer thread
+        SPSCQueue<std::vector<float>> free_queue; // writer thread -> simulation thread
+        std::thread writer;
+        std::atomic<bool> closing{false};
+        std::ofstream file;
+        Format format = Format::CSV;
+        size_t qn = 0, on = 0;
+        size_t n_stalls = 0;
+
+        void writerLoop();
+    };
+}
+
+#endif //LSC_PLANNER_ASYNC_RESULT_WRITER_HPP
@@ -0,0 +1,54 @@
+#ifndef LSC_PLANNER_BATCH_DISTMAP_HPP
+#define LSC_PLANNER_BATCH_DISTMAP_HPP
+
+#include <octomap/octomap.h>
+#include <dynamicEDT3D/dynamicEDTOctomap.h>
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <distance_map.hpp>
+
+namespace DynamicPlanning {
+    // DynamicEDTOctomap with a batch query. The keys of all points are computed in one vectorized loop, and the cells
+    // are gathered without the per-point key conversion and the bounds checks of getDistanceAndClosestObstacle.
+    // The distance from the point to the closest obstacle cell, which the callers compute on the closest obstacle,
+    // is computed in the batch as well.
+    class BatchDistmap : public DynamicEDTOctomap, public DistanceMap {
+    public:
+        BatchDistmap(float max_dist, octomap::OcTree *octree, const octomap::point3d &bbx_min,
+                     const octomap::point3d &bbx_max, bool treat_unknown_as_occupied)
+                : DynamicEDTOctomap(max_dist, octree, bbx_min, bbx_max, treat_unknown_as_occupied) {}
+
+        // Fill the results of the batch. Unlike getDistanceAndClosestObstacle, a point without an obstacle within
+        // the maximum distance has no closest obstacle instead of an unchanged output.
+        void query(DistmapQueryBatch &batch) const override;
+
+        // Replaces update() by the exact separable distance transform on the worker pool, the cells hold the same
+        // fields as after update() (the brushfire of update() is approximate, so a few cells may get a closer
+        // obstacle). The first call transforms the whole grid with one parallel pass per axis, the later calls
+        // recompute the slabs around the voxels changed in the octree in parallel. Once it is called, the map
+        // must be updated by this function only.
+        void updateParallel();
+
+        // [byte], the cells and the occupancy of updateParallel()
+        [[nodiscard]] size_t getMemoryUsage() const;
+
+    private:
+        typedef std::array<int, 3> Index; // cell indices
+
+        std::vector<uint8_t> occupancy; // the obstacle cells, empty before the first updateParallel()
+
+        [[nodiscard]] size_t occupancyIndex(int x, int y, int z) const;
+
+        // Transform the whole grid in the cells, the cells are the buffers of the passes
+        void transformAll();
+
+        // Recompute the cells in [region_min, region_max] from the obstacles within the maximum distance of it
+        void transformRegion(const Index &region_min, const Index &region_max);
+
+        // Convert the squared distances and the obstacles of the passes to the cells of DynamicEDT3D
+        void finalizeCell(dataCell &cell, int sq_dist) const;
+    };
+}
+
+#endif //LSC_PLANNER_BATCH_DISTMAP_HPP
@@ -0,0 +1,45 @@
+#ifndef LSC_PLANNER_BATCH_QP_SOLVER_HPP
+#define LSC_PLANNER_BATCH_QP_SOLVER_HPP
+
+#include <vector>
+#include <qp_problem.hpp>
+#include <qp_solver.hpp>
+
+namespace DynamicPlanning {
+    struct BatchQPSettings {
+        int max_iter = 4000;
+        int check_interval = 25; // iterations between the residual checks
+        int scaling_iter = 10; // Ruiz equilibration
+        double eps_abs = 1e-6, eps_rel = 1e-6;
+        double rho = 0.1, sigma = 1e-6, alpha = 1.6;
+    };
+
+    // Batched first-order QP solver (OSQP-style ADMM) for many small problems of the same structure, e.g. the
+    // trajectory QPs of all agents at a simulation step. The problems with the same sizes and sparsity patterns
+    // are packed into lanes of LANE_WIDTH, and the data of a pack are stored as structure of arrays, [entry][lane],
+    // so that every kernel of an iteration (the sparse products, the dense Cholesky solves of the KKT systems, the
+    // projections) runs over all lanes at once. The packs are solved in parallel by the shared worker pool.
+    // A problem is reported as unsolved if it does not converge within max_iter, the caller solves it again by
+    // the reference backend.
+    class BatchQPSolver {
+    public:
+        static constexpr int LANE_WIDTH = 16;
+
+        explicit BatchQPSolver(const BatchQPSettings &settings = BatchQPSettings());
+
+        // solutions[k] and successes[k] are for problems[k]
+        void solve(const std::vector<const QPProblem *> &problems, std::vector<QPSolution> &solutions,
+                   std::vector<uint8_t> &successes) const;
+
+    private:
+        BatchQPSettings settings;
+
+        // Problems with the same structure in the lanes of a pack
+        void solvePack(const std::vector<const QPProblem *> &problems, const std::vector<size_t> &pack,
+                       std::vector<QPSolution> &solutions, std::vector<uint8_t> &successes) const;
+
+        [[nodiscard]] static bool isStructureEqual(const QPProblem &a, const QPProblem &b);
+    };
+}
+
+#endif //LSC_PLANNER_BATCH_QP_SOLVER_HPP
@@ -0,0 +1,242 @@
+#ifndef LSC_PLANNER_CAPTURE_ARCHIVE_HPP
+#define LSC_PLANNER_CAPTURE_ARCHIVE_HPP
+
+#include <istream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <planning_capture.hpp>
+#include <random_stream.hpp>
+
+namespace DynamicPlanning {
+    // The binary archives of the planning capture and the simulation checkpoint. The values are written in the
+    // host byte order, so the files are read on a host of the same architecture.
+    namespace CaptureArchive {
+        // The paths in the package are saved relative to it, so the corpus is replayed in another checkout
+        inline std::string getPackageRelativePath(const std::string &package_path, const std::string &file_name) {
+            std::string prefix = package_path + "/";
+            if (file_name.compare(0, prefix.size(), prefix) == 0) {
+                return file_name.substr(prefix.size());
+            }
+            return file_name;
+        }
+
+        // The composite types are written and read by the same field list, P is T or const T
+        template<typename Archive, typename P>
+        void serializeState(Archive &ar, P &state) {
+            ar(state.position);
+            ar(state.velocity);
+            ar(state.acceleration);
+        }
+
+        template<typename Archive, typename P>
+        void serializeAgent(Archive &ar, P &agent) {
+            ar(agent.id);
+            ar(agent.cid);
+            ar(agent.current_state);
+            ar(agent.start_point);
+            ar(agent.desired_goal_point);
+            ar(agent.current_goal_point);
+            ar(agent.next_waypoint);
+            ar(agent.max_vel);
+            ar(agent.max_acc);
+            ar(agent.radius);
+            ar(agent.downwash);
+            ar(agent.nominal_velocity);
+            ar(agent.replanning_period);
+            ar(agent.collision_alert);
+        }
+
+        template<typename Archive, typename P>
+        void serializeObstacle(Archive &ar, P &obstacle) {
+            ar(obstacle.start_time);
+            ar(obstacle.update_time);
+            ar(obstacle.type);
+            ar(obstacle.id);
+            ar(obstacle.radius);
+            ar(obstacle.downwash);
+            ar(obstacle.max_acc);
+            ar(obstacle.position);
+            ar(obstacle.velocity);
+            ar(obstacle.goal_point);
+            ar(obstacle.collision_alert);
+            ar(obstacle.observed_position);
+            ar(obstacle.prev_traj);
+        }
+
+        template<typename Archive, typename P>
+        void serializeStageTimes(Archive &ar, P &stage_times) {
+            ar(stage_times.initial_traj_planning);
+            ar(stage_times.obstacle_prediction);
+            ar(stage_times.goal_planning);
+            ar(stage_times.lsc_generation);
+            ar(stage_times.sfc_generation);
+            ar(stage_times.traj_optimization);
+        }
+
+        // Appends to a buffer, the sink of the flight recorder
+        struct ByteSink {
+            std::vector<char> &bytes;
+
+            void write(const char *data, size_t size) {
+                bytes.insert(bytes.end(), data, data + size);
+            }
+        };
+
+        // Sink is std::ostream or ByteSink
+        template<typename Sink>
+        class CaptureOut {
+        public:
+            explicit CaptureOut(Sink &_out) : out(_out) {}
+
+            template<typename T>
+            void operator()(const T &value) {
+                if constexpr (std::is_enum<T>::value) {
+                    (*this)(static_cast<std::underlying_type_t<T>>(value));
+                } else {
+                    static_assert(std::is_arithmetic<T>::value, "not serializable");
+                    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+                }
+            }
+
+            void operator()(const std::string &value) {
+                (*this)(static_cast<uint32_t>(value.size()));
+                out.write(value.data(), static_cast<std::streamsize>(value.size()));
+            }
+
+            template<typename T>
+            void operator()(const std::vector<T> &values) {
+                (*this)(static_cast<uint32_t>(values.size()));
+                for (const auto &value: values) {
+                    (*this)(value);
+                }
+            }
+
+            void operator()(const point3d &point) {
+                out.write(reinterpret_cast<const char *>(&point(0)), 3 * sizeof(float));
+            }
+
+            void operator()(const ros::Time &time) {
+                (*this)(time.sec);
+                (*this)(time.nsec);
+            }
+
+            void operator()(const traj_t &traj) {
+                int M = traj.size();
+                uint32_t n_points = M > 0 ? traj[0].control_points.size() : 0;
+                (*this)(static_cast<uint32_t>(M));
+                (*this)(n_points);
+                for (int m = 0; m < M; m++) {
+                    (*this)(traj[m].segment_time);
+                    for (const auto &point: traj[m].control_points) {
+                        (*this)(point);
+                    }
+                }
+            }
+
+            void operator()(const State &state) { serializeState(*this, state); }
+
+            void operator()(const Agent &agent) { serializeAgent(*this, agent); }
+
+            void operator()(const Obstacle &obstacle) { serializeObstacle(*this, obstacle); }
+
+            void operator()(const PlanningCapture::StageTimes &stage_times) { serializeStageTimes(*this, stage_times); }
+
+            void operator()(const RandomStream &stream) {
+                out.write(reinterpret_cast<const char *>(&stream), sizeof(RandomStream));
+            }
+
+        private:
+            Sink &out;
+        };
+
+        class CaptureIn {
+        public:
+            explicit CaptureIn(std::istream &_in) : in(_in) {}
+
+            template<typename T>
+            void operator()(T &value) {
+                if constexpr (std::is_enum<T>::value) {
+                    std::underlying_type_t<T> raw{};
+                    (*this)(raw);
+                    value = static_cast<T>(raw);
+                } else {
+                    static_assert(std::is_arithmetic<T>::value, "not serializable");
+                    in.read(reinterpret_cast<char *>(&value), sizeof(T));
+                }
+            }
+
+            void operator()(std::string &value) {
+                uint32_t size = 0;
+                (*this)(size);
+                if (not in) {
+                    return;
+                }
+                value.resize(size);
+                in.read(&value[0], static_cast<std::streamsize>(size));
+            }
+
+            template<typename T>
+            void operator()(std::vector<T> &values) {
+                uint32_t size = 0;
+                (*this)(size);
+                values.clear();
+                // A truncated file stops at the first failed read instead of at a garbage size
+                for (uint32_t i = 0; i < size and in; i++) {
+                    values.emplace_back();
+                    (*this)(values.back());
+                }
+            }
+
+            void operator()(point3d &point) {
+                in.read(reinterpret_cast<char *>(&point(0)), 3 * sizeof(float));
+            }
+
+            void operator()(ros::Time &time) {
+                (*this)(time.sec);
+                (*this)(time.nsec);
+            }
+
+            void operator()(traj_t &traj) {
+                uint32_t M = 0, n_points = 0;
+                (*this)(M);
+                (*this)(n_points);
+                if (not in or n_points > ControlPoints<point3d>::CAPACITY or (M > 0 and n_points == 0)) {
+                    in.setstate(std::ios::failbit);
+                    return;
+                }
+                if (M == 0) {
+                    traj.clear();
+                    return;
+                }
+                traj.reset(M, n_points - 1, 0);
+                for (uint32_t m = 0; m < M and in; m++) {
+                    (*this)(traj[m].segment_time);
+                    for (auto &point: traj[m].control_points) {
+                        (*this)(point);
+                    }
+                }
+            }
+
+            void operator()(State &state) { serializeState(*this, state); }
+
+            void operator()(Agent &agent) { serializeAgent(*this, agent); }
+
+            void operator()(Obstacle &obstacle) { serializeObstacle(*this, obstacle); }
+
+            void operator()(PlanningCapture::StageTimes &stage_times) { serializeStageTimes(*this, stage_times); }
+
+            void operator()(RandomStream &stream) {
+                in.read(reinterpret_cast<char *>(&stream), sizeof(RandomStream));
+            }
+
+        private:
+            std::istream &in;
+        };
+
+        // The state of a stream is its key and counter, so a restored stream continues with the same numbers
+        static_assert(std::is_trivially_copyable<RandomStream>::value, "RandomStream is written as bytes");
+    }
+}
+
+#endif //LSC_PLANNER_CAPTURE_ARCHIVE_HPP
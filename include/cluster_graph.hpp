@@ -0,0 +1,52 @@
+#ifndef LSC_PLANNER_CLUSTER_GRAPH_HPP
+#define LSC_PLANNER_CLUSTER_GRAPH_HPP
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <graph.hpp>
+
+namespace DynamicPlanning {
+    // Abstraction of the bit-packed occupancy grid of GridBasedPlanner in the style of HPA* (Botea et al., 2004).
+    // The grid is partitioned into cubic clusters, and two face-adjacent clusters are connected if a free cell of one
+    // is face-adjacent to a free cell of the other. The distance tables to the goals are computed on the clusters,
+    // and the corridor of the agents is the union of the clusters along their abstract paths, so the MAPF graph and
+    // its distance tables only cover the corridor instead of the whole grid.
+    // The free cells of a cluster are assumed to be connected, so the corridor may miss a path the full grid has.
+    class ClusterGraph {
+    public:
+        // cluster_size: cells per axis of a cluster
+        void build(const MAPF::GridView &grid, int cluster_size);
+
+        // Distance in clusters from each cluster to the cluster of goal, -1 if unreachable. The table is computed
+        // once per goal cluster and kept until the next build.
+        const std::vector<int> &getDistanceTable(const std::array<int, 3> &goal);
+
+        // cell_mask[cell] = 1 for the cells in the clusters on an abstract path from the current point to the goal
+        // of each agent, and the clusters within dilation of them. The cells are indexed as the bits of the grid.
+        // False if a goal is not reachable from the current point in the abstract graph.
+        bool getCorridor(const std::vector<std::array<int, 3>> &current_points,
+                         const std::vector<std::array<int, 3>> &goal_points,
+                         int dilation, std::vector<uint8_t> &cell_mask);
+
+        [[nodiscard]] size_t getNumClusters() const { return cluster_free.size(); }
+
+    private:
+        MAPF::GridView grid;
+        int cluster_size = 1;
+        std::array<int, 3> cluster_dim{0, 0, 0};
+        std::vector<uint8_t> cluster_free; // [cluster], the cluster has a free cell
+        std::vector<uint8_t> open_faces; // [cluster], bit a: connected to the next cluster along the axis a
+        std::map<int, std::vector<int>> distance_tables; // goal cluster -> [cluster]
+
+        [[nodiscard]] int getClusterIndex(const std::array<int, 3> &cell) const;
+
+        [[nodiscard]] std::array<int, 3> getClusterCoord(int cluster) const;
+
+        // face-adjacent clusters connected to the cluster
+        void getNeighbors(int cluster, std::vector<int> &neighbors) const;
+    };
+}
+
+#endif //LSC_PLANNER_CLUSTER_GRAPH_HPP
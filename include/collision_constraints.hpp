@@ -1,7 +1,11 @@
 #ifndef LSC_PLANNER_COLLISION_CONSTRAINTS_HPP
 #define LSC_PLANNER_COLLISION_CONSTRAINTS_HPP
 
+#include <array>
+#include <atomic>
 #include <vector>
+#include <Eigen/Core>
+#include <Eigen/StdVector>
 #include <octomap/octomap_types.h>
 #include <visualization_msgs/MarkerArray.h>
 #include <sp_const.hpp>
@@ -10,8 +14,13 @@
 #include <util.hpp>
 #include <geometry.hpp>
 #include <utility>
+#include <queue>
+#include <functional>
 #include <trajectory.hpp>
-#include <convhull_3d/convhull_3d.h>
+#include <feasible_region.hpp>
+#include <occupancy_index.hpp>
+#include <distance_map.hpp>
+#include <primitive_world.hpp>
 
 namespace DynamicPlanning {
     // Linear Safe Corridor
@@ -92,12 +101,92 @@ namespace DynamicPlanning {
         bool operator==(Box &other_sfc) const;
     };
 
-    typedef std::vector<std::vector<std::vector<LSC>>> RSFCs; // [obs_idx][segment_idx][control_point_idx]
+    // LSCs of all obstacles, [obs_idx][segment_idx][control_point_idx] flattened in a structure-of-arrays layout.
+    // Each component of the normal vectors, the obstacle control points and d is stored in a separate aligned array,
+    // so the optimizer and the solution validation can read them as dense blocks.
+    // The arrays are allocated once and their capacity is reused when the number of obstacles changes.
+    class RSFCs {
+    public:
+        typedef std::vector<double, Eigen::aligned_allocator<double>> AlignedArray;
+
+        void resize(size_t N_obs, int M, int n_points);
+
+        void clear();
+
+        [[nodiscard]] bool empty() const { return N_obs == 0; }
+
+        // The number of obstacles
+        [[nodiscard]] size_t size() const { return N_obs; }
+
+        // The number of LSCs, the length of each array
+        [[nodiscard]] size_t getNumLSCs() const { return N_obs * M * n_points; }
+
+        [[nodiscard]] size_t index(size_t oi, int m, int i) const { return (oi * M + m) * n_points + i; }
+
+        void set(size_t oi, int m, int i, const point3d &obs_control_point, const point3d &normal_vector, double d);
+
+        [[nodiscard]] LSC get(size_t oi, int m, int i) const;
+
+        // k-th component of the normal vectors
+        [[nodiscard]] const double *getNormals(int k) const { return normals[k].data(); }
+
+        // k-th component of the obstacle control points
+        [[nodiscard]] const double *getPoints(int k) const { return points[k].data(); }
+
+        [[nodiscard]] const double *getOffsets() const { return offsets.data(); }
+
+        // Lower bound of normal^T c in the first dim components, normal^T c_obs + d
+        [[nodiscard]] double getLowerBound(size_t idx, int dim) const;
+
+        [[nodiscard]] double getNormalNorm(size_t idx) const;
+
+    private:
+        size_t N_obs = 0;
+        int M = 0;
+        int n_points = 0;
+        std::array<AlignedArray, 3> normals;
+        std::array<AlignedArray, 3> points;
+        AlignedArray offsets;
+    };
     typedef std::vector<Box> SFCs; // [segment_idx]
 
+    // Enumerate the sequences of SFCs, one box per segment where the boxes of adjacent segments intersect,
+    // lazily in the increasing order of the total cost.
+    // The cost-to-go of each box is computed by DP over the box-intersection graph, and the search expands
+    // partial sequences best-first, so each call of next() costs O(output length x branching x log).
+    class SFCsCandidateEnumerator {
+    public:
+        typedef std::function<double(int m, const Box &sfc)> CostFunction;
+
+        // valid_sfcs must outlive the enumerator
+        SFCsCandidateEnumerator(const std::vector<SFCs> &valid_sfcs, const CostFunction &cost);
+
+        // Returns false if there is no more candidate
+        bool next(SFCs &sfcs_cand);
+
+    private:
+        struct Node {
+            int m;
+            size_t box_idx;
+            int parent; // index of the parent node in the nodes, -1 if m == 0
+            double cost; // cost of the sequence from the segment 0 to the segment m
+        };
+
+        const std::vector<SFCs> &valid_sfcs;
+        std::vector<std::vector<double>> box_costs; // [segment_idx][box_idx]
+        std::vector<std::vector<double>> cost_to_go; // [segment_idx][box_idx], SP_INFINITY if it is a dead end
+        std::vector<std::vector<std::vector<size_t>>> successors; // [segment_idx][box_idx][successor_idx]
+        std::vector<Node> nodes;
+
+        typedef std::pair<double, int> QueueItem; // (cost + cost-to-go, node_idx)
+        std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<>> queue;
+
+        void push(int m, size_t box_idx, int parent, double parent_cost);
+    };
+
     class CollisionConstraints {
     public:
-        CollisionConstraints(const Param &param, const Mission &mission);
+        CollisionConstraints(const Param &param, const std::shared_ptr<const Mission> &mission);
 
         void initializeSFC(const point3d &agent_position, double agent_radius);
 
@@ -111,17 +200,36 @@ namespace DynamicPlanning {
 
         void constructCommunicationRange(const point3d &next_waypoint);
 
+        // Shift the SFCs by a segment and reuse the last one without the expansion, the time shifted previous
+        // trajectory stays in them. The SFCs are fitted to param.M if the horizon has changed.
+        void shiftSFC();
+
+        // All candidates, larger boxes first
         std::vector<SFCs> findSFCsCandidates(const std::vector<SFCs> &sfcs_valid);
 
-        std::vector<SFCs> findSFCsCandidates(const std::vector<SFCs> &sfcs_valid,
-                                             const Box &sfc_prev,
-                                             int m);
+        // Find the lowest cost candidate that is feasible, candidates after it are not enumerated
+        static bool findFeasibleSFCsCandidate(const std::vector<SFCs> &sfcs_valid,
+                                              const SFCsCandidateEnumerator::CostFunction &cost,
+                                              const std::function<bool(const SFCs &)> &is_feasible,
+                                              SFCs &sfcs_cand);
+
+        // Mark the LSCs implied by the bounds of the control point (world boundary and SFC) or by one of the other
+        // LSCs at the same control point, TrajOptimizer leaves them out of the QP. LSCs with slack variables are
+        // never used to imply the others. If use_lp is true, the remaining LSCs are also checked by a small LP
+        // over the bounds and all the other LSCs. Returns the number of the redundant LSCs.
+        int reduceLSCs(int dim, bool use_slack_for_all, bool use_lp);
 
         // Getter
         [[nodiscard]] LSC getLSC(int oi, int m, int i) const;
 
+        [[nodiscard]] const RSFCs &getLSCs() const;
+
+        [[nodiscard]] bool isLSCRedundant(size_t lsc_idx) const;
+
         [[nodiscard]] Box getSFC(int m) const;
 
+        [[nodiscard]] const SFCs &getSFCs() const { return sfcs; }
+
         [[nodiscard]] size_t getObsSize() const;
 
         [[nodiscard]] std::set<int> getDynamicObstacles() const;
@@ -131,17 +239,23 @@ namespace DynamicPlanning {
         [[nodiscard]] bool slackObstaclesEmpty() const;
 
         // Setter
-        void setDistmap(std::shared_ptr<DynamicEDTOctomap> distmap_ptr);
+        void setDistmap(std::shared_ptr<DistanceMap> distmap_ptr);
 
         void setOctomap(std::shared_ptr<octomap::OcTree> octree_ptr);
 
+        // If it is set, isObstacleInSFC uses the index instead of the distance map
+        void setOccupancyIndex(std::shared_ptr<OccupancyIndex> occupancy_index_ptr);
+
+        // The SFCs must be initialized again if the number of segments is changed
+        void setParam(const Param &param);
+
         void setLSC(int oi, int m,
-                    const points_t &obs_control_points,
+                    const ControlPoints<point3d> &obs_control_points,
                     const point3d &normal_vector,
                     const std::vector<double> &ds);
 
         void setLSC(int oi, int m,
-                    const points_t &obs_control_points,
+                    const ControlPoints<point3d> &obs_control_points,
                     const point3d &normal_vector,
                     double d);
 
@@ -152,6 +266,9 @@ namespace DynamicPlanning {
 
         void setSFC(int m, const Box &sfc);
 
+        // The SFCs of all segments, e.g. restored from a checkpoint file
+        void setSFCs(const SFCs &_sfcs) { sfcs = _sfcs; }
+
         // Converter
         [[nodiscard]] visualization_msgs::MarkerArray convertLSCsToMarkerArrayMsg(
                 const std::vector<Obstacle> &obstacles,
@@ -165,19 +282,63 @@ namespace DynamicPlanning {
         feasibleRegionToMarkerArrayMsg(int agent_id, const std_msgs::ColorRGBA &color) const;
 
     private:
-        std::shared_ptr<DynamicEDTOctomap> distmap_ptr;
+        std::shared_ptr<DistanceMap> distmap_ptr;
         std::shared_ptr<octomap::OcTree> octree_ptr;
-        Mission mission;
+        std::shared_ptr<OccupancyIndex> occupancy_index_ptr;
+        const PrimitiveWorld *primitive_world = nullptr; // distmap_ptr if it is a PrimitiveWorld
+        std::shared_ptr<const Mission> mission; // shared by all components of all agents
         Param param;
 
         RSFCs lscs; // Safe corridor to avoid agents and dynamic obstacles
+        std::vector<bool> lsc_redundant; // [lscs.index(oi, m, i)], LSCs removed by reduceLSCs
         SFCs sfcs; // Safe corridor to avoid static obstacles
         Box communication_range;
         std::set<int> dynamic_obstacle_indices; // Set of indices of dynamic obstacles
 
+        // A box expanded by expandSFC, inserted in the SFC library by commitSFCExpansion
+        struct SFCExpansion {
+            Box sfc; // with the margin compensation
+            Box grown_sfc; // the box of the SFC library
+            double grow_time = -1; // [s], negative if the box is found in the SFC library
+        };
+
+        // An initial box and an axis order expanded concurrently with the others, see world/sfc_parallel_candidates
+        struct SFCCandidate {
+            int rank; // the successful candidates of the lowest rank are preferred
+            Box initial_sfc;
+            std::vector<int> axis_cand;
+            const points_t *required_hull = nullptr; // the expanded box must contain it, nullptr: no requirement
+            bool success = false;
+            SFCExpansion expansion;
+        };
+
         bool expandSFCFromPoint(const point3d &point, const point3d &goal_point,
                                 const Box &prev_sfc, double agent_radius, Box &expanded_sfc);
 
+        // The candidates of expandSFCFromPoint and of the two expandSFCFromConvexHull in order
+        bool expandSFCCandidatesFromPoint(const point3d &point, const point3d &goal_point, const Box &prev_sfc,
+                                          double agent_radius, Box &expanded_sfc);
+
+        bool expandSFCCandidatesFromConvexHull(const points_t &convex_hull_greedy, const points_t &convex_hull,
+                                               const point3d &next_waypoint, const Box &prev_sfc,
+                                               double agent_radius, Box &expanded_sfc);
+
+        // Expand the candidates concurrently and take the successful one of the lowest rank, then the closest to the
+        // goal, then the largest, then the first. The candidates of a rank are cancelled once a candidate of a lower
+        // rank succeeds, so the choice does not depend on the order in which the candidates finish.
+        bool expandSFCCandidates(std::vector<SFCCandidate> &candidates, const point3d &goal_point, double margin,
+                                 Box &expanded_sfc);
+
+        // Grid-aligned initial boxes of expandSFCFromPoint and of the two expandSFCFromConvexHull
+        [[nodiscard]] Box computeInitialSFC(const point3d &point, const Box &prev_sfc) const;
+
+        [[nodiscard]] Box computeInitialSFC(const points_t &convex_hull) const;
+
+        [[nodiscard]] Box computeInitialSFC(const points_t &convex_hull, const Box &prev_sfc) const;
+
+        // Shrink the initial box to the grid cells inside prev_sfc if it is not included in prev_sfc
+        [[nodiscard]] Box clipInitialSFC(const Box &initial_sfc, const Box &prev_sfc) const;
+
         bool expandSFCFromConvexHull(const points_t &convex_hull, double agent_radius, Box &expanded_sfc);
 
         bool expandSFCFromConvexHull(const points_t &convex_hull, const Box &prev_sfc,
@@ -185,17 +346,47 @@ namespace DynamicPlanning {
 
         bool isObstacleInSFC(const Box &initial_sfc, double margin);
 
+        // clearance: if there is no obstacle, the box inflated by clearance is also collision-free
+        bool isObstacleInSFC(const Box &initial_sfc, double margin, double &clearance);
+
         bool isSFCInBoundary(const Box &sfc, double margin);
 
         bool expandSFC(const Box &initial_sfc, double margin, Box &expanded_sfc);
 
         bool expandSFC(const Box &initial_sfc, const point3d &goal_point, double margin, Box &expanded_sfc);
 
-        [[nodiscard]] points_t findFeasibleVertices(int m, int control_point_idx) const;
+        // Expand along the axes in axis_cand, -x, -y, -z, +x, +y, +z = 0, 1, 2, 3, 4, 5
+        bool expandSFC(const Box &initial_sfc, std::vector<int> axis_cand, double margin, Box &expanded_sfc);
+
+        // expandSFC without the insertion in the SFC library, false if cancelled
+        bool expandSFC(const Box &initial_sfc, std::vector<int> axis_cand, double margin,
+                       const std::atomic<bool> *cancel, SFCExpansion &expansion);
+
+        void commitSFCExpansion(const SFCExpansion &expansion, double margin);
+
+        // initial_clearance: clearance of the initial SFC given by isObstacleInSFC. The box grows on the faces of the
+        // axes below DIM only, so in 2D it keeps the z extent of the initial SFC.
+        // cancel: checked before each slab, the growth stops early if it is set, nullptr: never cancelled.
+        template<int DIM>
+        Box growSFC(const Box &initial_sfc, std::vector<int> axis_cand, double margin, double initial_clearance,
+                    const std::atomic<bool> *cancel);
+
+        // growSFC of the world dimension, chosen once by the parameters
+        typedef Box (CollisionConstraints::*GrowSFCFunction)(const Box &, std::vector<int>, double, double,
+                                                             const std::atomic<bool> *);
+        GrowSFCFunction grow_sfc;
+
+        static GrowSFCFunction selectGrowSFC(int world_dimension);
+
+        // Find a cached box covering the initial SFC in the process-wide SFC library
+        bool findSFCInLibrary(const Box &initial_sfc, double margin, Box &sfc);
+
+        // Intersection of the SFC (or the world boundary), the communication range and the LSCs of the static obstacles
+        [[nodiscard]] FeasibleRegion findFeasibleRegion(int m, int control_point_idx) const;
 
-        static visualization_msgs::Marker convexHullToMarkerMsg(const points_t &convex_hull,
-                                                                const std_msgs::ColorRGBA &color,
-                                                                const std::string &world_frame_id);
+        static visualization_msgs::Marker feasibleRegionToMarkerMsg(const FeasibleRegion &feasible_region,
+                                                                    const std_msgs::ColorRGBA &color,
+                                                                    const std::string &world_frame_id);
 
         static std::vector<int> setAxisCand(const Box &box, const octomap::point3d &goal_point);
     };
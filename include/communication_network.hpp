@@ -0,0 +1,72 @@
+#ifndef LSC_PLANNER_COMMUNICATION_NETWORK_HPP
+#define LSC_PLANNER_COMMUNICATION_NETWORK_HPP
+
+#include <cstdint>
+#include <vector>
+#include <param.hpp>
+#include <map_merge.hpp>
+#include <random_stream.hpp>
+
+namespace DynamicPlanning {
+    // Links between the agents of the simulator with latency, jitter, bandwidth and packet loss, see
+    // communication/latency. The packets are sent and delivered at the simulation steps. A packet is queued on the
+    // uplink of its sender, transmitted at the bandwidth, and arrives after the latency plus a uniform jitter. It
+    // is delivered at the first step after its arrival. The packets are kept in a ring of buckets by the delivery
+    // step, so a step touches only the packets delivered at it, and the buckets and the inboxes keep their buffers.
+    class CommunicationNetwork {
+    public:
+        struct Packet {
+            uint32_t sender = 0;
+            uint32_t receiver = 0;
+            uint64_t version = 0; // the step of the sender at the send, identifies the payload kept by the sender
+            bool is_key_frame = true; // the frame of the quantized trajectory
+            size_t bytes = 0; // the payload on the link
+            int send_step = 0;
+            bool has_map_delta = false;
+            MapDelta map_delta; // the voxels are in compressed_map_delta if communication/map_delta_compression
+            std::vector<uint8_t> compressed_map_delta;
+        };
+
+        struct Statistics {
+            uint64_t n_sent = 0;
+            uint64_t n_delivered = 0;
+            uint64_t n_lost = 0; // dropped by communication/packet_loss
+            uint64_t n_congested = 0; // dropped since the uplink was busy for more than a step
+            uint64_t delivered_bytes = 0;
+            uint64_t delivered_delay_steps = 0; // the sum of the steps from the send to the delivery
+        };
+
+        CommunicationNetwork(const Param &param, size_t n_agents, uint64_t seed);
+
+        // The largest number of steps from the send to the delivery of a packet
+        [[nodiscard]] int getMaxDelaySteps() const { return static_cast<int>(buckets.size()) - 1; }
+
+        // Queue the packet at the step, false if it is lost or the uplink of the sender is congested. The steps of
+        // the calls are non-decreasing.
+        bool send(int step, Packet &&packet);
+
+        // Move the packets delivered at the step to the inboxes of the receivers, the previous inboxes are cleared.
+        // Call once per step after the packets of the step are sent.
+        void deliver(int step);
+
+        // The packets delivered by the last deliver, a packet may be older than the one delivered before it
+        [[nodiscard]] std::vector<Packet> &getInbox(size_t receiver) { return inboxes[receiver]; }
+
+        [[nodiscard]] const Statistics &getStatistics() const { return statistics; }
+
+    private:
+        double time_step; // [s]
+        double latency, latency_jitter; // [s]
+        double bandwidth; // [bytes/s], 0: unlimited
+        double packet_loss;
+
+        std::vector<RandomStream> random_streams; // [sender]
+        std::vector<double> uplink_free_times; // [sender], [s] since the first step
+        std::vector<std::vector<Packet>> buckets; // [delivery step % buckets.size()]
+        std::vector<std::vector<Packet>> inboxes; // [receiver]
+        std::vector<uint32_t> delivered_receivers; // the receivers with a non-empty inbox
+        Statistics statistics;
+    };
+}
+
+#endif //LSC_PLANNER_COMMUNICATION_NETWORK_HPP
@@ -0,0 +1,49 @@
+#ifndef LSC_PLANNER_CPU_TOPOLOGY_HPP
+#define LSC_PLANNER_CPU_TOPOLOGY_HPP
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace DynamicPlanning {
+    enum class ThreadPlacementMode {
+        NONE, // the workers are not pinned, the OS schedules them
+        COMPACT, // the workers fill the CPUs of a NUMA node before the next node, for the shared cache of a node
+        SPREAD, // the workers go round the NUMA nodes, for the memory bandwidth of all nodes
+    };
+
+    // The CPUs allowed to the process, grouped by their NUMA nodes.
+    // The nodes are read from /sys/devices/system/node, a machine without them or other than Linux is a single node.
+    class CPUTopology {
+    public:
+        static const CPUTopology &getInstance();
+
+        [[nodiscard]] size_t getNumNodes() const { return node_cpus.size(); }
+
+        [[nodiscard]] size_t getNumCPUs() const;
+
+        [[nodiscard]] const std::vector<int> &getCPUs(size_t node) const { return node_cpus[node]; }
+
+        // -1 if the CPU is not allowed to the process
+        [[nodiscard]] int getNodeOfCPU(int cpu) const;
+
+        // The CPU of each of n_threads threads by the mode, the CPUs are reused if there are more threads than CPUs.
+        // Empty if the mode is NONE.
+        [[nodiscard]] std::vector<int> getPlacement(ThreadPlacementMode mode, size_t n_threads) const;
+
+        // Pin the thread to the CPU, cpu < 0 allows all CPUs of the process again. False if it is not supported.
+        static bool pinThread(std::thread::native_handle_type thread, int cpu);
+
+        static bool parsePlacementMode(const std::string &str, ThreadPlacementMode &mode);
+
+        static std::string getPlacementModeStr(ThreadPlacementMode mode);
+
+    private:
+        std::vector<std::vector<int>> node_cpus; // [node], not empty
+        std::vector<int> allowed_cpus;
+
+        CPUTopology();
+    };
+}
+
+#endif //LSC_PLANNER_CPU_TOPOLOGY_HPP
@@ -0,0 +1,57 @@
+#ifndef LSC_PLANNER_DISTANCE_MAP_HPP
+#define LSC_PLANNER_DISTANCE_MAP_HPP
+
+#include <cstdint>
+#include <vector>
+#include <octomap/octomap.h>
+
+namespace DynamicPlanning {
+    // Points queried at once and the results, in the structure of arrays
+    struct DistmapQueryBatch {
+        std::vector<float> x, y, z; // query points
+
+        std::vector<float> distance; // [m], DynamicEDTOctomap::distanceValue_Error if the point is outside the map
+        // The center of the closest obstacle cell, infinity if there is no obstacle within the maximum distance
+        std::vector<float> obstacle_x, obstacle_y, obstacle_z;
+        // [m], the L-infinity distance from the point to the closest obstacle cell, a cube of the map resolution
+        std::vector<float> obstacle_l_inf_distance;
+
+        std::vector<int> idx_x, idx_y, idx_z; // cell indices, internal
+
+        void clear() {
+            x.clear();
+            y.clear();
+            z.clear();
+        }
+
+        void reserve(size_t n) {
+            x.reserve(n);
+            y.reserve(n);
+            z.reserve(n);
+        }
+
+        void push(const octomap::point3d &point) {
+            x.emplace_back(point.x());
+            y.emplace_back(point.y());
+            z.emplace_back(point.z());
+        }
+
+        [[nodiscard]] size_t size() const { return x.size(); }
+
+        [[nodiscard]] octomap::point3d getObstacle(size_t i) const {
+            return {obstacle_x[i], obstacle_y[i], obstacle_z[i]};
+        }
+    };
+
+    // Distance field queried by the planners. The distance maps of the whole world (BatchDistmap) and of a window
+    // around the agent (RollingDistmap) are used through this interface.
+    class DistanceMap {
+    public:
+        virtual ~DistanceMap() = default;
+
+        // Fill the results of the batch, see DistmapQueryBatch
+        virtual void query(DistmapQueryBatch &batch) const = 0;
+    };
+}
+
+#endif //LSC_PLANNER_DISTANCE_MAP_HPP
@@ -0,0 +1,30 @@
+#ifndef LSC_PLANNER_DISTANCE_TRANSFORM_HPP
+#define LSC_PLANNER_DISTANCE_TRANSFORM_HPP
+
+#include <limits>
+#include <vector>
+
+namespace DynamicPlanning {
+    // 1D squared distance transform of Felzenszwalb and Huttenlocher, the passes of the separable transforms of
+    // the distance maps along each axis. The buffers are reused by the lines of a pass.
+    class DistanceTransformLine {
+    public:
+        static constexpr int INFINITE_SQ_DIST = std::numeric_limits<int>::max();
+
+        std::vector<int> f; // [voxel^2], the input, INFINITE_SQ_DIST if there is no obstacle
+        std::vector<int> sq_dists; // [voxel^2], the output
+        std::vector<int> args; // the input entry of each output, -1 if the line has no obstacle
+
+        // Reserve the buffers for lines of up to n entries
+        void resize(int n);
+
+        // Transform the first n entries, f to sq_dists and args
+        void transform(int n);
+
+    private:
+        std::vector<int> envelope_v;
+        std::vector<double> envelope_z;
+    };
+}
+
+#endif //LSC_PLANNER_DISTANCE_TRANSFORM_HPP
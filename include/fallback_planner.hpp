@@ -0,0 +1,46 @@
+#ifndef LSC_PLANNER_FALLBACK_PLANNER_HPP
+#define LSC_PLANNER_FALLBACK_PLANNER_HPP
+
+#include <param.hpp>
+#include <collision_constraints.hpp>
+#include <trajectory.hpp>
+
+namespace DynamicPlanning {
+    struct FallbackResult {
+        bool is_feasible = false; // a candidate satisfies all constraints
+        int n_checked = 0; // the candidates checked within the budget
+        double cost = SP_INFINITY;
+    };
+
+    // Replaces the trajectory of a failed QP with the best of the sampled candidates. The candidates are the
+    // initial trajectory and the rest-to-rest primitives from the current state, which stop at a segment boundary
+    // with a lateral offset of the stopping point to escape the obstacles. They are checked in the shared worker
+    // pool by FeasibilityChecker against the SFCs and the LSCs, and by the control points of the derivatives
+    // against the dynamical limits. The feasible candidate that ends closest to the current goal is chosen.
+    class FallbackPlanner {
+    public:
+        explicit FallbackPlanner(const Param &param);
+
+        void updateParam(const Param &param);
+
+        // The candidates have the segments of initial_traj. The candidates are not checked after the budget [s]
+        // runs out, 0: unbounded. fallback_traj is unchanged if no candidate is feasible.
+        FallbackResult plan(const Agent &agent, const CollisionConstraints &constraints, const traj_t &initial_traj,
+                            double budget, traj_t &fallback_traj);
+
+    private:
+        Param param;
+        std::vector<traj_t> candidates;
+        std::vector<double> costs; // [candidate], SP_INFINITY if infeasible or not checked
+
+        void sampleCandidates(const Agent &agent, const traj_t &initial_traj);
+
+        // Cubic Hermite curve from the current state to rest at goal_point after n_stop_segments, then held
+        void buildRestToRest(const Agent &agent, const point3d &goal_point, int M, int n_stop_segments,
+                             traj_t &traj) const;
+
+        [[nodiscard]] bool isDynamicallyFeasible(const Agent &agent, const traj_t &traj) const;
+    };
+}
+
+#endif //LSC_PLANNER_FALLBACK_PLANNER_HPP
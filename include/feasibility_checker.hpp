@@ -0,0 +1,54 @@
+#ifndef LSC_PLANNER_FEASIBILITY_CHECKER_HPP
+#define LSC_PLANNER_FEASIBILITY_CHECKER_HPP
+
+#include <collision_constraints.hpp>
+#include <trajectory.hpp>
+
+namespace DynamicPlanning {
+    enum class ConstraintType {
+        NONE,
+        SFC,
+        LSC,
+    };
+
+    struct ConstraintViolation {
+        ConstraintType type = ConstraintType::NONE;
+        int oi = -1; // obstacle index, LSC only
+        int m = -1; // segment index
+        int i = -1; // control point index
+
+        [[nodiscard]] bool isViolated() const { return type != ConstraintType::NONE; }
+    };
+
+    // Checks all control points of a trajectory against the SFCs and LSCs at once.
+    // The control points are copied to a structure-of-arrays layout that matches RSFCs, and the kernels
+    // run on 4 control points per instruction with AVX2 if the CPU supports it, otherwise in scalar.
+    // Candidate trajectories can be checked one after another with the same checker.
+    class FeasibilityChecker {
+    public:
+        FeasibilityChecker(int M, int n);
+
+        void setTrajectory(const traj_t &traj);
+
+        // Sets the control points from the QP solution x, [k * M * (n + 1) + m * (n + 1) + i], without the rounding to
+        // the float trajectory. The axes k >= dim are set to z_2d.
+        void setSolution(const Eigen::VectorXd &x, int dim, double z_2d);
+
+        // The first n_skip control points of the segment 0 are not checked, since they are fixed by the initial state.
+        // Returns the first violated box in the order of (m, i)
+        [[nodiscard]] ConstraintViolation checkSFCs(const CollisionConstraints &constraints, int n_skip) const;
+
+        // Returns the first violated LSC in the order of (oi, m, i), the LSCs with zero normal vectors are ignored.
+        // If skip_dynamic_obstacles is true, the LSCs relaxed by slack variables are not checked.
+        [[nodiscard]] ConstraintViolation checkLSCs(const CollisionConstraints &constraints, int dim, int n_skip,
+                                                    bool skip_dynamic_obstacles, double tolerance) const;
+
+        [[nodiscard]] static bool isAVX2Available();
+
+    private:
+        int M, n;
+        std::array<RSFCs::AlignedArray, 3> control_points; // [k][m * (n + 1) + i]
+    };
+}
+
+#endif //LSC_PLANNER_FEASIBILITY_CHECKER_HPP
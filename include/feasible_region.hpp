@@ -0,0 +1,54 @@
+#ifndef LSC_PLANNER_FEASIBLE_REGION_HPP
+#define LSC_PLANNER_FEASIBLE_REGION_HPP
+
+#include <array>
+#include <vector>
+#include <sp_const.hpp>
+
+namespace DynamicPlanning {
+    // Convex polytope {x \in R^3 | normal_i.dot(x) >= offset_i} built incrementally from a box (double description).
+    // Each vertex keeps the planes it lies on, so a half-space only cuts the edges between the kept and the removed
+    // vertices, O(V^2) per half-space instead of testing every triple of planes. The vertices and the faces are
+    // available after each half-space, and the faces need no convex hull of the vertices.
+    class FeasibleRegion {
+    public:
+        typedef std::array<point3d, 3> Triangle;
+
+        FeasibleRegion() = default;
+
+        FeasibleRegion(const point3d &box_min, const point3d &box_max);
+
+        void reset(const point3d &box_min, const point3d &box_max);
+
+        // Returns false if the region is empty after the half-space
+        bool addHalfSpace(const point3d &normal, double offset);
+
+        [[nodiscard]] bool isEmpty() const;
+
+        [[nodiscard]] size_t getNumHalfSpaces() const;
+
+        [[nodiscard]] points_t getVertices() const;
+
+        // Boundary of the region, counter-clockwise seen from the outside
+        [[nodiscard]] std::vector<Triangle> getTriangles() const;
+
+    private:
+        struct Plane {
+            point3d normal;
+            double offset;
+        };
+
+        struct Vertex {
+            point3d point;
+            std::vector<int> planes; // sorted indices of the planes the vertex lies on
+        };
+
+        std::vector<Plane> planes;
+        std::vector<Vertex> vertices;
+
+        // u and w are the ends of an edge, i.e. their common planes define a line and no other vertex is on it
+        [[nodiscard]] bool isEdge(size_t u, size_t w, std::vector<int> &common_planes) const;
+    };
+}
+
+#endif //LSC_PLANNER_FEASIBLE_REGION_HPP
@@ -263,36 +263,64 @@ namespace DynamicPlanning{
         return closest_points;
     }
 
-    static ClosestPoints closestPointsBetweenPointAndConvexHull(const point3d& point,
-                                                                const points_t& convex_hull){
-        /* Squared distance computed by openGJK.                                 */
-        double dd;
-        /* Structure of simplex used by openGJK.                                 */
-        struct simplex  s;
-        double v[3];
-        /* Number of vertices defining body 1 and body 2, respectively.          */
-        int nvrtx1, nvrtx2;
-        /* Structures of body 1 and body 2, respectively.                        */
-        struct bd bd1;
-        struct bd bd2;
-
-        bd1.numpoints = static_cast<int>(convex_hull.size());
-        bd1.coord = point3DsToArray(convex_hull);
-
-        points_t point_vector;
-        point_vector.emplace_back(point);
-        bd2.numpoints = 1;
-        bd2.coord = point3DsToArray(point_vector);
-
-        // Run GJK algorithm
-        dd = gjk (bd1, bd2, &s, v);
+    // GJK distance queries from points to a convex hull without allocation. The coordinates of the bodies are kept
+    // between the queries, and a query can start from the closest direction of a previous one, which takes a few
+    // iterations if the hull moves a little, e.g. the same segment of the previous step.
+    class GJKQuery {
+    public:
+        GJKQuery() {
+            hull_body.numpoints = 0;
+            point_body.numpoints = 1;
+            point_body.coord.resize(1);
+        }
 
-        ClosestPoints closest_points;
-        closest_points.closest_point1 = point;
-        closest_points.closest_point2 = point + point3d(v[0], v[1], v[2]);
-        closest_points.dist = dd;
+        // Load the hull, it is kept for the queries until the next call
+        void setConvexHull(const points_t& convex_hull) {
+            hull_body.numpoints = static_cast<int>(convex_hull.size());
+            hull_body.coord.resize(convex_hull.size()); // the capacity is kept
+            for (size_t i = 0; i < convex_hull.size(); i++) {
+                hull_body.coord[i] = {convex_hull[i].x(), convex_hull[i].y(), convex_hull[i].z()};
+            }
+        }
 
-        return closest_points;
+        // closest_point2 is on the hull. warm_start: a direction from the point to the hull, e.g. of the last query,
+        // the search starts from the vertex of the hull in that direction if it is not zero.
+        ClosestPoints closestPointsToConvexHull(const point3d& point, const point3d& warm_start = point3d(0, 0, 0)) {
+            point_body.coord[0] = {point.x(), point.y(), point.z()};
+            double v[3];
+            double v_init[3] = {warm_start.x(), warm_start.y(), warm_start.z()};
+            double dist = gjk(&hull_body, &point_body, &s, v, v_init);
+
+            ClosestPoints closest_points;
+            closest_points.closest_point1 = point;
+            closest_points.closest_point2 = point + point3d(v[0], v[1], v[2]);
+            closest_points.dist = dist;
+            return closest_points;
+        }
+
+        // Many points to the hull, each query starts from the direction of the previous one
+        void closestPointsToConvexHull(const points_t& points, std::vector<ClosestPoints>& results) {
+            results.resize(points.size());
+            point3d warm_start(0, 0, 0);
+            for (size_t i = 0; i < points.size(); i++) {
+                results[i] = closestPointsToConvexHull(points[i], warm_start);
+                warm_start = results[i].closest_point2 - results[i].closest_point1;
+            }
+        }
+
+    private:
+        struct bd hull_body;
+        struct bd point_body; // a single point, its support is the point itself
+        struct simplex s;
+    };
+
+    // The buffers are per thread, so that the tasks of the worker pool query concurrently
+    static ClosestPoints closestPointsBetweenPointAndConvexHull(const point3d& point,
+                                                                const points_t& convex_hull,
+                                                                const point3d& warm_start = point3d(0, 0, 0)){
+        static thread_local GJKQuery gjk_query;
+        gjk_query.setConvexHull(convex_hull);
+        return gjk_query.closestPointsToConvexHull(point, warm_start);
     }
 
     static double computeCollisionTime(const Line &obs_path, const Line &agent_path,
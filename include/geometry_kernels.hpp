@@ -0,0 +1,87 @@
+#ifndef LSC_PLANNER_GEOMETRY_KERNELS_HPP
+#define LSC_PLANNER_GEOMETRY_KERNELS_HPP
+
+#include <array>
+#include <vector>
+#include <sp_const.hpp>
+
+namespace DynamicPlanning {
+    // Points in the structure-of-arrays layout of the batch geometry kernels
+    class PointsSoA {
+    public:
+        void clear() {
+            for (auto &coords_k: coords) {
+                coords_k.clear();
+            }
+        }
+
+        void reserve(size_t n) {
+            for (auto &coords_k: coords) {
+                coords_k.reserve(n);
+            }
+        }
+
+        void emplace_back(const point3d &point) {
+            for (int k = 0; k < 3; k++) {
+                coords[k].emplace_back(point(k));
+            }
+        }
+
+        void assign(const points_t &points) {
+            clear();
+            reserve(points.size());
+            for (const auto &point: points) {
+                emplace_back(point);
+            }
+        }
+
+        void resize(size_t n) {
+            for (auto &coords_k: coords) {
+                coords_k.resize(n);
+            }
+        }
+
+        [[nodiscard]] size_t size() const { return coords[0].size(); }
+
+        [[nodiscard]] bool empty() const { return coords[0].empty(); }
+
+        [[nodiscard]] const double *data(int k) const { return coords[k].data(); }
+
+        [[nodiscard]] double *data(int k) { return coords[k].data(); }
+
+        [[nodiscard]] point3d operator[](size_t j) const {
+            return {static_cast<float>(coords[0][j]), static_cast<float>(coords[1][j]),
+                    static_cast<float>(coords[2][j])};
+        }
+
+    private:
+        std::array<std::vector<double>, 3> coords; // [k][point]
+    };
+
+    // Batch versions of the distance helpers of util.hpp, geometry.hpp and Box, from one query to all points of a
+    // PointsSoA. The kernels run on 4 points per instruction with AVX2 if the CPU supports it, otherwise in scalar,
+    // and both paths give the same results. They compute in double, so they differ from the scalar helpers only by
+    // the float rounding of point3d. out has points.size() elements.
+    namespace GeometryKernels {
+        // out[j] = LInfinityDistance(point, points[j])
+        void lInfinityDistances(const point3d &point, const PointsSoA &points, double *out);
+
+        // out[j] = ellipsoidalDistance(point, points[j], downwash[j]), the downwash of each pair
+        void ellipsoidalDistances(const point3d &point, const PointsSoA &points, const double *downwash, double *out);
+
+        // out[j] = Box(box_min, box_max).distanceToPoint(points[j])
+        void boxDistances(const point3d &box_min, const point3d &box_max, const PointsSoA &points, double *out);
+
+        // out[j] = Box(box_min, box_max).closestPoint(points[j])
+        void boxClosestPoints(const point3d &box_min, const point3d &box_max, const PointsSoA &points,
+                              PointsSoA &out);
+
+        // out[j] = closestPointsBetweenPointAndLineSegment(point, Line(starts[j], ends[j])).dist, starts and ends
+        // have the same size
+        void lineSegmentDistances(const point3d &point, const PointsSoA &starts, const PointsSoA &ends, double *out);
+
+        [[nodiscard]] bool isAVX2Available();
+    }
+}
+
+#endif //LSC_PLANNER_GEOMETRY_KERNELS_HPP
@@ -0,0 +1,56 @@
+#ifndef LSC_PLANNER_GLOBAL_MAP_REGISTRY_HPP
+#define LSC_PLANNER_GLOBAL_MAP_REGISTRY_HPP
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <octomap/octomap.h>
+#include <occupancy_index.hpp>
+#include <primitive_world.hpp>
+#include <serializable_distmap.hpp>
+
+namespace DynamicPlanning {
+    static constexpr float GLOBAL_DISTMAP_MAX_DIST = 1.0; // the maximum distance of the distance field of a global map
+
+    // Global map loaded from the world file. It is not modified after loading, so the agents read it concurrently.
+    struct GlobalMap {
+        std::unique_ptr<octomap::OcTree> octree;
+        // refers to octree, so it is declared after octree. nullptr if primitive_world is used instead.
+        std::unique_ptr<SerializableDistmap> distmap;
+        // nullptr if param.world_occupancy_index is false or primitive_world is used instead
+        std::unique_ptr<OccupancyIndex> occupancy_index;
+        std::unique_ptr<PrimitiveWorld> primitive_world; // nullptr if the world is not a csv file of primitives
+    };
+
+    // Load the world file (.bt or .csv) and build the distance field over the world boundary, nullptr if the file
+    // can not be read. With use_distmap_cache, the distance field is loaded from <world file>.edt if it matches
+    // the map, otherwise it is computed and saved there. With use_primitive_world, the primitives of a csv world
+    // answer the queries instead of the distance field and the occupancy index, which are not built.
+    std::shared_ptr<GlobalMap> loadGlobalMap(const std::string &world_file_name, double resolution,
+                                             const octomap::point3d &world_min, const octomap::point3d &world_max,
+                                             bool build_occupancy_index, bool use_distmap_cache,
+                                             bool use_primitive_world = false);
+
+    // Process-wide registry of the global maps shared by all agents.
+    // A map is loaded once per key and kept while an agent holds it, so the time and the memory to load the
+    // maps do not grow with the number of agents.
+    class GlobalMapRegistry {
+    public:
+        typedef std::function<std::shared_ptr<GlobalMap>()> Loader;
+
+        static GlobalMapRegistry &getInstance();
+
+        // Returns the map of the key, or loads it by the loader if no one holds it. nullptr if the loader fails.
+        std::shared_ptr<const GlobalMap> acquire(const std::string &key, const Loader &loader);
+
+    private:
+        GlobalMapRegistry() = default;
+
+        std::mutex mtx;
+        std::map<std::string, std::weak_ptr<const GlobalMap>> maps;
+    };
+}
+
+#endif //LSC_PLANNER_GLOBAL_MAP_REGISTRY_HPP
@@ -0,0 +1,45 @@
+#ifndef LSC_PLANNER_GLOBAL_POINT_CLOUD_HPP
+#define LSC_PLANNER_GLOBAL_POINT_CLOUD_HPP
+
+#include <memory>
+#include <vector>
+#include <octomap/OcTree.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/search/kdtree.h>
+#include <pcl/search/impl/kdtree.hpp>
+#include <point_cloud_ingestion.hpp>
+
+namespace DynamicPlanning {
+    // Global point cloud of the world downsampled on the voxel grid, and the kd-tree over it. It is built once for all
+    // agents and not modified after that, so the virtual sensors of the agents query it concurrently.
+    class GlobalPointCloud {
+    public:
+        // Downsampled on the grid of the resolution, so a point is the center of a voxel. nullptr if the message can
+        // not be parsed.
+        static std::shared_ptr<const GlobalPointCloud> build(const sensor_msgs::PointCloud2 &msg, double resolution,
+                                                             PointCloudIngestionReport &report);
+
+        // The indices of the points within the radius of the center. The result is a buffer of the calling thread,
+        // valid until the next query of the thread, so the queries of different threads do not share any state.
+        [[nodiscard]] const std::vector<int> &radiusSearch(const octomap::point3d &center, double radius) const;
+
+        [[nodiscard]] const pcl::PointXYZ &getPoint(int idx) const { return cloud->points[idx]; }
+
+        [[nodiscard]] const pcl::PointCloud<pcl::PointXYZ> &getCloud() const { return *cloud; }
+
+        [[nodiscard]] size_t size() const { return cloud->points.size(); }
+
+        [[nodiscard]] double getBuildTime() const { return build_time; }
+
+    private:
+        pcl::PointCloud<pcl::PointXYZ>::Ptr cloud;
+        pcl::search::KdTree<pcl::PointXYZ> kdtree;
+        double build_time = 0; // [s], the kd-tree only, the ingestion is in the report
+
+        GlobalPointCloud() = default;
+    };
+}
+
+#endif //LSC_PLANNER_GLOBAL_POINT_CLOUD_HPP
@@ -5,6 +5,11 @@
 #include <param.hpp>
 #include <mission.hpp>
 #include <collision_constraints.hpp>
+#include <qp_solver.hpp>
+#include <solver_thread_scheduler.hpp>
+#include <qp_failure_diagnoser.hpp>
+#include <sstream>
+#include <memory>
 
 // Eigen
 #include <Eigen/Dense>
@@ -14,18 +19,67 @@
 #include <ilcplex/ilocplex.h>
 
 namespace DynamicPlanning {
+    // LP model that is kept alive between replanning steps, only the rows are rebuilt
+    struct PersistentLPModel {
+        PersistentLPModel() : model(env), cplex(env), var(env), con(env) {}
+
+        ~PersistentLPModel() {
+            env.end();
+        }
+
+        IloEnv env;
+        IloModel model;
+        IloCplex cplex;
+        IloNumVarArray var;
+        IloRangeArray con;
+    };
+
+    // coef * t >= lower
+    struct GoalConstraint {
+        double coef;
+        double lower;
+    };
+
     class GoalOptimizer {
     public:
-        GoalOptimizer(const Param& param, const Mission& mission);
+        GoalOptimizer(const Param& param, const std::shared_ptr<const Mission>& mission);
 
         point3d solve(const Agent& agent,
                       const CollisionConstraints& constraints,
                       const point3d &current_goal_point,
                       const point3d &next_waypoint);
 
+        void updateParam(const Param& param);
+
+        // Next mission in the same world, the LP model is kept and the warm start is dropped
+        void resetMission(const std::shared_ptr<const Mission>& mission);
+
     private:
         Param param;
-        Mission mission;
+        std::shared_ptr<const Mission> mission; // shared by all components of all agents
+        std::unique_ptr<PersistentLPModel> lp_model;
+        std::unique_ptr<QPSolver> qp_solver; // backend other than CPLEX Concert
+        double prev_t; // solution of the previous step, used for the warm start
+
+        // goal = (current_goal_point - next_waypoint) * t + next_waypoint
+        [[nodiscard]] std::vector<GoalConstraint> buildConstraints(const CollisionConstraints& constraints,
+                                                                   const point3d &current_goal_point,
+                                                                   const point3d &next_waypoint) const;
+
+        // The feasible set of t is an interval, so the LP is solved without the solver
+        static bool solveAnalytic(const std::vector<GoalConstraint>& goal_constraints, double& t);
+
+        // Return false if the solver failed
+        bool solveWithQPSolver(const std::vector<GoalConstraint>& goal_constraints, int threads, double& t);
+
+        bool solvePersistent(const std::vector<GoalConstraint>& goal_constraints, int threads, double& t,
+                             std::string& status);
+
+        [[nodiscard]] QPProblem buildQPProblem(const std::vector<GoalConstraint>& goal_constraints) const;
+
+        void reportQPFailure(const Agent& agent,
+                             const std::vector<GoalConstraint>& goal_constraints,
+                             const std::string &status) const;
 
         void populatebyrow(IloModel model, IloNumVarArray x, IloRangeArray c,
                            const Agent& agent, const CollisionConstraints& constraints,
@@ -3,13 +3,39 @@
 
 #include <mapf/pibt.hpp>
 #include <mapf/ecbs.hpp>
-#include <dynamicEDT3D/dynamicEDTOctomap.h>
+#include <mapf/cbs.hpp>
+#include <mapf/icbs.hpp>
+#include <mapf/hca.hpp>
+#include <mapf/whca.hpp>
+#include <mapf/winpibt.hpp>
+#include <mapf/pibt_complete.hpp>
+#include <mapf/push_and_swap.hpp>
+#include <mapf/revisit_pp.hpp>
+#include <mapf/ir.hpp>
+#include <mapf/portfolio.hpp>
+#include <distance_map.hpp>
+#include <primitive_world.hpp>
 #include <mission.hpp>
 #include <param.hpp>
 #include <util.hpp>
 #include <geometry.hpp>
 #include <utility>
+#include <atomic>
+#include <deque>
+#include <future>
+#include <map>
+#include <unordered_map>
+#include <tuple>
+#include <memory>
+#include <mutex>
+#include <functional>
 #include <collision_constraints.hpp>
+#include <map_change_log.hpp>
+#include <worker_pool.hpp>
+#include <obstacle_prediction.hpp>
+#include <planning_deadline.hpp>
+#include <incremental_path_planner.hpp>
+#include <cluster_graph.hpp>
 
 #define GP_OCCUPIED 1
 #define GP_EMPTY 0
@@ -69,16 +95,213 @@ namespace DynamicPlanning {
         std::array<int, 3> dim;
     };
 
-    struct GridMap {
-        std::vector<std::vector<std::vector<int>>> grid;
+    // Occupancy grid with one bit per cell, the cell (i, j, k) is the bit (i * dim[1] + j) * dim[2] + k
+    class GridMap {
+    public:
+        // Resize the grid and clear all cells, the memory is reused if the grid is not larger than before
+        void reset(const std::array<int, 3> &dim);
+
+        [[nodiscard]] int getValue(const GridNode &grid_node) const {
+            return isOccupied(grid_node[0], grid_node[1], grid_node[2]) ? GP_OCCUPIED : GP_EMPTY;
+        }
+
+        void setValue(const GridNode &grid_node, int value) {
+            size_t bit = index(grid_node[0], grid_node[1], grid_node[2]);
+            if (value == GP_OCCUPIED) {
+                words[bit >> 6] |= uint64_t(1) << (bit & 63);
+            } else {
+                words[bit >> 6] &= ~(uint64_t(1) << (bit & 63));
+            }
+        }
+
+        [[nodiscard]] bool isOccupied(int i, int j, int k) const {
+            size_t bit = index(i, j, k);
+            return (words[bit >> 6] >> (bit & 63)) & 1;
+        }
+
+        void setOccupied(int i, int j, int k) {
+            size_t bit = index(i, j, k);
+            words[bit >> 6] |= uint64_t(1) << (bit & 63);
+        }
+
+        // Occupy the cells (i, j, k_min...k_max), the cells along z are contiguous so whole words are set at once
+        void setOccupiedRun(int i, int j, int k_min, int k_max);
+
+        [[nodiscard]] size_t countOccupied() const;
+
+        // Are the occupied cells occupied in map as well? The grids have the same size.
+        [[nodiscard]] bool isSubsetOf(const GridMap &map) const;
+
+        bool operator==(const GridMap &other) const { return dim == other.dim and words == other.words; }
+
+        // View of the whole grid for the MAPF graph, valid until the next reset
+        [[nodiscard]] MAPF::GridView getView() const;
+
+        // f(cell index) of the cells set in word ^ mask, only the nonzero words are decoded, e.g. mask = ~0 for the
+        // free cells
+        template<typename F>
+        void forEachCell(uint64_t mask, F &&f) const {
+            size_t n_cells = static_cast<size_t>(dim[0]) * dim[1] * dim[2];
+            for (size_t wi = 0; wi < words.size(); wi++) {
+                uint64_t word = words[wi] ^ mask;
+                while (word != 0) {
+                    size_t cell = (wi << 6) + __builtin_ctzll(word);
+                    if (cell >= n_cells) {
+                        break;
+                    }
+                    f(cell);
+                    word &= word - 1;
+                }
+            }
+        }
+
+        [[nodiscard]] GridNode cellToNode(size_t cell) const {
+            return GridNode(static_cast<int>(cell / (static_cast<size_t>(dim[1]) * dim[2])),
+                            static_cast<int>(cell / dim[2] % dim[1]),
+                            static_cast<int>(cell % dim[2]));
+        }
+
+        [[nodiscard]] const std::vector<uint64_t> &getWords() const { return words; }
+
+        [[nodiscard]] const std::array<int, 3> &getDim() const { return dim; }
+
+    private:
+        std::array<int, 3> dim{0, 0, 0};
+        std::vector<uint64_t> words;
+
+        [[nodiscard]] size_t index(int i, int j, int k) const {
+            return (static_cast<size_t>(i) * dim[1] + j) * dim[2] + k;
+        }
+    };
+
+    // Footprints of the predicted dynamic obstacles with one grid map per time slice, the slice t is the MAPF
+    // timestep t. The MAPF solvers query it as time-dependent obstacles, so a cell is blocked only while the
+    // obstacle is predicted there. The cells are free after the last slice.
+    class SpaceTimeOccupancy : public MAPF::SpaceTimeObstacles {
+    public:
+        // Resize to n_slices slices and clear all cells, the memory of the slices is reused
+        void reset(const std::array<int, 3> &dim, size_t n_slices);
+
+        [[nodiscard]] bool isBlocked(const MAPF::Pos &pos, int timestep) const override {
+            return timestep >= 0 and static_cast<size_t>(timestep) < n_slices and
+                   slices[timestep].isOccupied(pos.x, pos.y, pos.z);
+        }
+
+        [[nodiscard]] GridMap &getSlice(size_t slice) { return slices[slice]; }
+
+        [[nodiscard]] size_t getNumSlices() const { return n_slices; }
 
-        int getValue(GridNode grid_node) const {
-            return grid[grid_node[0]][grid_node[1]][grid_node[2]];
+    private:
+        std::vector<GridMap> slices; // [slice], may be longer than n_slices
+        size_t n_slices = 0;
+    };
+
+    // Result of the last update of the static layer of the grid map
+    struct GridMapUpdateReport {
+        bool full_rebuild = false;
+        size_t n_cells = 0;
+        size_t n_dirty_cells = 0; // the number of cells thresholded again
+        double update_time = 0; // [s]
+        double time_saved = 0; // [s], estimated by the time per cell of the last full rebuild
+
+        [[nodiscard]] double getDirtyRatio() const {
+            return n_cells > 0 ? static_cast<double>(n_dirty_cells) / n_cells : 0;
         }
+    };
+
+    // Offsets of the rows along z that the footprint of an obstacle may touch, relative to the cell of the obstacle.
+    // The obstacle is anywhere within half a cell of the center of its cell, so a row is kept if any position of the
+    // obstacle may reach it.
+    struct FootprintStencil {
+        std::vector<std::array<int, 2>> rows; // [di, dj]
+    };
 
-        void setValue(GridNode grid_node, int value) {
-            grid[grid_node[0]][grid_node[1]][grid_node[2]] = value;
+    // Grid and agent radius of a static layer over a distmap
+    struct StaticLayerKey {
+        const DistanceMap *distmap = nullptr;
+        std::array<int, 3> dim{};
+        std::array<double, 3> grid_min{};
+        double grid_resolution = 0;
+        double agent_radius = 0;
+
+        bool operator<(const StaticLayerKey &other) const {
+            return std::tie(distmap, dim, grid_min, grid_resolution, agent_radius) <
+                   std::tie(other.distmap, other.dim, other.grid_min, other.grid_resolution, other.agent_radius);
         }
+
+        bool operator==(const StaticLayerKey &other) const {
+            return not(*this < other) and not(other < *this);
+        }
+    };
+
+    // Static layer of a distmap that is not modified, e.g. the global map, shared by the grid planners
+    struct SharedStaticLayer {
+        StaticLayerKey key;
+        GridMap layer;
+        std::shared_ptr<const DistanceMap> distmap; // the distmap of the key is kept while the layer is alive
+    };
+
+    // Process-wide registry of the shared static layers, one per agent radius. The planners of the agents of the same
+    // radius reference one layer and stamp the obstacles on their own copy, so the memory and the time to threshold
+    // the static layer do not grow with the number of agents. A layer is kept while a planner holds it.
+    class StaticLayerRegistry {
+    public:
+        typedef std::function<void(GridMap &)> Builder;
+
+        static StaticLayerRegistry &getInstance();
+
+        // Returns the layer of the key, or builds it by the builder if no one holds it. The planners waiting for
+        // the same key wait for one build. is_built is true if the builder was called by this call.
+        std::shared_ptr<const SharedStaticLayer> acquire(const StaticLayerKey &key,
+                                                         const std::shared_ptr<const DistanceMap> &distmap,
+                                                         const Builder &builder, bool &is_built);
+
+    private:
+        struct Slot {
+            std::mutex mtx;
+            std::weak_ptr<const SharedStaticLayer> layer;
+        };
+
+        StaticLayerRegistry() = default;
+
+        std::mutex mtx;
+        std::map<StaticLayerKey, std::shared_ptr<Slot>> slots;
+    };
+
+    // The cells of the footprints of a grid obstacle over its positions, as the runs (i, j, k_min, k_max) along z
+    struct ObstacleFootprint {
+        std::vector<std::array<int, 4>> runs;
+    };
+
+    // The grid, the agent radius and downwash, and the exact state of the obstacle, which determine its footprint
+    struct ObstacleFootprintKey {
+        static constexpr size_t N_VALUES = 21;
+        std::array<double, N_VALUES> values{};
+
+        bool operator<(const ObstacleFootprintKey &other) const { return values < other.values; }
+    };
+
+    // Process-wide cache of the footprints of the grid obstacles of planSAPF. The agents of a step receive the same
+    // states of the dynamic obstacles and of the higher priority agents, so the planners of the agents of the same
+    // radius stamp a footprint computed once per step. The key is the exact state, so the entries of the older steps
+    // are not reused, and the cache is cleared when it is full.
+    class ObstacleFootprintCache {
+    public:
+        typedef std::function<void(ObstacleFootprint &)> Builder;
+
+        static ObstacleFootprintCache &getInstance();
+
+        // Returns the footprint of the key, or builds it by the builder. The builder runs without the lock, so two
+        // planners may build the same footprint, and the first one is kept.
+        std::shared_ptr<const ObstacleFootprint> acquire(const ObstacleFootprintKey &key, const Builder &builder);
+
+    private:
+        static constexpr size_t MAX_FOOTPRINTS = 4096;
+
+        ObstacleFootprintCache() = default;
+
+        std::mutex mtx;
+        std::map<ObstacleFootprintKey, std::shared_ptr<const ObstacleFootprint>> footprints;
     };
 
     typedef std::vector<GridNode> gridpath_t;
@@ -91,62 +314,235 @@ namespace DynamicPlanning {
         GridNodes goal_points;
     };
 
+    // Plan of a MAPF slot kept between the steps for the rolling horizon, see grid_mapf_window
+    struct RollingMAPFPlan {
+        GridNodes goal_points;
+        std::vector<gridpath_t> paths; // [agent], aligned, empty if there is no plan
+
+        // Anytime MAPF, see grid_mapf_refine_time_limit: the refinement of the last plan solved in the background,
+        // invalid if no refinement is running or its result is taken
+        std::future<std::vector<gridpath_t>> refinement;
+        GridNodes refinement_goal_points;
+        std::shared_ptr<std::atomic<bool>> refinement_cancel_flag;
+    };
+
+    // MAPF graph of the static layer kept between the problems of a slot. The nodes are built when the static
+    // layer changes, and the obstacles of each problem are applied by blocking the nodes.
+    struct MAPFGraph {
+        GridMap static_layer; // the grid of the nodes, empty if the layer is shared
+        std::shared_ptr<const SharedStaticLayer> shared_static_layer;
+        int connectivity = 0;
+        std::unique_ptr<MAPF::Grid> grid;
+        std::mt19937 mt; // reseeded for each problem, so the solvers are deterministic as with a new problem
+    };
+
     struct PlanResult {
         size_t n_agents;
         std::vector<points_t> paths;
     };
 
+    // Agents of a communication group, planned independently of the other groups
+    struct MAPFGroupMission {
+        points_t start_points;
+        points_t current_points;
+        points_t goal_points;
+        bool is_stalled = false; // the rolling plan is dropped and the group is solved again, see ProgressMonitor
+    };
+
+    struct MAPFGroupResult {
+        bool success = false;
+        bool skipped = false; // not started before the deadline, the agents keep their next waypoints
+        bool reused = false; // the rolling plan of the previous step is reused, no solver ran
+        std::vector<points_t> paths; // [agent in the group]
+        double planning_time = 0; // [s], time of the group only, excluding the grid map update
+    };
+
     class GridBasedPlanner {
     public:
-        GridBasedPlanner(const DynamicPlanning::Param &param, const DynamicPlanning::Mission &mission);
+        GridBasedPlanner(const DynamicPlanning::Param &param,
+                         const std::shared_ptr<const DynamicPlanning::Mission> &mission);
+
+        // The refinements in the background are canceled
+        ~GridBasedPlanner();
 
         // single agent path planning
+        // If map_change_log_ptr is not nullptr, the static layer of the grid map is updated only in the changed regions
+        // The search is incremental, it repairs the previous path of the same goal where the grid map is changed.
+        // grid_obstacles: the indices of the obstacles stamped on the grid map, ascending
         bool planSAPF(const Agent &agent,
-                      const std::shared_ptr<DynamicEDTOctomap> &_distmap_ptr,
+                      const std::shared_ptr<DistanceMap> &_distmap_ptr,
+                      const std::shared_ptr<MapChangeLog> &_map_change_log_ptr,
                       const std::vector<Obstacle> &obstacles = {},
-                      const std::set<int> &grid_obstacles = {});
+                      const std::vector<size_t> &grid_obstacles = {});
 
         // multi agent path planning
         bool planMAPF(const points_t &start_points,
                       const points_t &current_points,
                       const points_t &goal_points,
-                      const std::shared_ptr<DynamicEDTOctomap> &_distmap_ptr,
+                      const std::shared_ptr<DistanceMap> &_distmap_ptr,
+                      const std::shared_ptr<MapChangeLog> &_map_change_log_ptr,
                       double agent_radius, double agent_downwash);
 
+        // multi agent path planning of independent groups on the same grid map
+        // The grid map is updated once, and then the groups are solved concurrently in the worker pool if parallel.
+        // The results are in the order of group_missions regardless of the schedule.
+        // The solvers stop at the rest of the deadline, and the groups not started before it are skipped.
+        std::vector<MAPFGroupResult> planMAPFGroups(const std::vector<MAPFGroupMission> &group_missions,
+                                                    const std::shared_ptr<DistanceMap> &_distmap_ptr,
+                                                    const std::shared_ptr<MapChangeLog> &_map_change_log_ptr,
+                                                    double agent_radius, double agent_downwash,
+                                                    bool parallel,
+                                                    const PlanningDeadline &deadline = PlanningDeadline());
+
+        // If it is set, the blocks of the grid and the rays without an obstacle nearby are cleared by O(1) box queries
+        // of the index, and the distmap is queried only close to the obstacles. It must index the map of the distmap.
+        void setOccupancyIndex(const std::shared_ptr<OccupancyIndex> &_occupancy_index_ptr);
+
+        // If it is set and grid_space_time_step is positive, the MAPF avoids the predicted dynamic obstacles of the
+        // table at the timesteps they occupy the cells. The table must be predicted at the current time.
+        void setObstaclePredictionTable(std::shared_ptr<const ObstaclePredictionTable> table);
+
+        // The static layer and the distance tables are dropped if the grid is changed
+        void updateParam(const Param &param);
+
+        // Next mission in the same world. The static layer and the distance tables are kept, the rolling plans,
+        // the refinements and the searches of the previous mission are dropped.
+        void resetMission(const std::shared_ptr<const Mission> &mission);
+
+        // Update the grid map of the agent size without planning, e.g. to measure it. The static layer is rebuilt
+        // as a whole if map_change_log_ptr is nullptr.
+        void updateGridMap(const std::shared_ptr<DistanceMap> &_distmap_ptr,
+                           const std::shared_ptr<MapChangeLog> &_map_change_log_ptr,
+                           double agent_radius, double agent_downwash);
+
         // Getter
+        // Empty if the agent has no path
         [[nodiscard]] points_t getPath(size_t i) const;
 
+        [[nodiscard]] const GridMapUpdateReport &getGridMapUpdateReport() const { return grid_map_update_report; }
+
+        // Empty if the distance table cache is disabled
+        [[nodiscard]] MAPF::DistanceTableStatistics getDistanceTableStatistics() const;
+
         [[nodiscard]] points_t getFreePoints() const;
 
         [[nodiscard]] points_t getOccupiedPoints() const;
 
+        // One marker of the cubes of the occupied cells. The cubes are updated from the words of the grid changed
+        // since the previous call, so an unchanged grid costs a comparison of the words.
         [[nodiscard]] visualization_msgs::MarkerArray occupiedPointsToMsg(std::string frame_id) const;
 
         [[nodiscard]] visualization_msgs::MarkerArray pathToMarkerMsg(int agent_id,
                                                                       std::string frame_id,
                                                                       std_msgs::ColorRGBA color) const;
 
+        // The markers of a path copied from getPath, e.g. to build them in the visualization worker
+        [[nodiscard]] static visualization_msgs::MarkerArray pathToMarkerMsg(const points_t &path,
+                                                                             int agent_id,
+                                                                             std::string frame_id,
+                                                                             std_msgs::ColorRGBA color);
+
         // Goal
         point3d findLOSFreeGoal(const point3d &current_position,
                                 const point3d &goal_position,
                                 double agent_radius);
 
     private:
-        Mission mission;
+        std::shared_ptr<const Mission> mission; // shared by all components of all agents
         Param param;
-        std::shared_ptr<DynamicEDTOctomap> distmap_ptr;
+        std::shared_ptr<DistanceMap> distmap_ptr;
+        std::shared_ptr<MapChangeLog> map_change_log_ptr;
+        std::shared_ptr<OccupancyIndex> occupancy_index_ptr;
+        std::shared_ptr<const ObstaclePredictionTable> obstacle_prediction_table;
 
         GridInfo grid_info;
-        GridMap grid_map;
+        GridMap grid_map; // static layer + footprints of the obstacles
+
+        // grid_map at the last occupiedPointsToMsg and its cubes, removed by swapping with the last cube
+        struct OccupancyExport {
+            std::array<int, 3> dim{0, 0, 0};
+            std::vector<uint64_t> words;
+            std::vector<geometry_msgs::Point> points;
+            std::vector<size_t> point_cells; // [point]
+            std::unordered_map<size_t, size_t> cell_points; // cell -> point
+        };
+        mutable OccupancyExport occupancy_export;
+        SpaceTimeOccupancy space_time_occupancy; // footprints of the predicted dynamic obstacles, for the MAPF
+
+        // Static layer: the cells close to the distmap obstacles, cached between the plans. The layer of a distmap
+        // that is not modified is shared with the other planners instead, see StaticLayerRegistry.
+        GridMap static_layer;
+        std::shared_ptr<const SharedStaticLayer> shared_static_layer;
+        GridMap dirty_mask; // cells already thresholded in the current update
+        DistmapQueryBatch static_layer_batch;
+        GridNodes static_layer_batch_nodes;
+        bool has_static_layer = false;
+        const DistanceMap *static_layer_distmap = nullptr;
+        uint64_t static_layer_version = 0;
+        double static_layer_agent_radius = 0;
+        double full_rebuild_time_per_cell = 0; // [s]
+        GridMapUpdateReport grid_map_update_report;
+
+        // Footprint stencils by (the sum of the radii, downwash, the grid resolution), built on the first use
+        mutable std::map<std::tuple<double, double, double>, FootprintStencil> footprint_stencils;
+        mutable std::vector<std::array<int, 4>> footprint_runs; // the buffer of stampFootprint
+
+        // Distance tables to the MAPF goals, kept between the calls of planMAPF
+        // [slot], planMAPF uses the slot 0 and planMAPFGroups uses one slot per group, so that the groups
+        // solved concurrently do not share a cache. Empty if the cache is disabled.
+        std::vector<std::unique_ptr<MAPF::DistanceTableCache>> distance_table_caches;
+        std::deque<RollingMAPFPlan> rolling_plans; // [slot], the slots of distance_table_caches, deque keeps the addresses
+        std::deque<MAPFGraph> mapf_graphs; // [slot]
         GridMission grid_mission;
         PlanResult plan_result;
 
+        // D* Lite searches of planSAPF kept between the calls, [0]: without the grid obstacles, [1]: with them
+        std::array<IncrementalPathPlanner, 2> sapf_planners;
+
         void updateGridInfo();
 
         void updateGridMap(double agent_radius,
                            double agent_downwash,
                            const std::vector<Obstacle> &obstacles = {},
-                           const std::set<int> &grid_obstacles = {});
+                           const std::vector<size_t> &grid_obstacles = {});
+
+        // The footprints of the obstacle for the agent in updateGridMap
+        void buildObstacleFootprint(double agent_radius, double agent_downwash, const Obstacle &obstacle,
+                                    ObstacleFootprint &footprint) const;
+
+        [[nodiscard]] ObstacleFootprintKey getObstacleFootprintKey(double agent_radius, double agent_downwash,
+                                                                   const Obstacle &obstacle) const;
+
+        // Stamp the slices of the dynamic obstacles in the prediction table, no slice if it is disabled
+        void updateSpaceTimeOccupancy(double agent_radius, double agent_downwash);
+
+        // Occupy the cells closer than agent_radius + obstacle_radius to the obstacle by the ellipsoidal distance
+        void stampFootprint(GridMap &map, const point3d &obs_position, double agent_radius, double obstacle_radius,
+                            double downwash, int size_z) const;
+
+        // The runs of the cells of stampFootprint, appended to runs
+        void appendFootprintRuns(const point3d &obs_position, double agent_radius, double obstacle_radius,
+                                 double downwash, int size_z, std::vector<std::array<int, 4>> &runs) const;
+
+        [[nodiscard]] const FootprintStencil &getFootprintStencil(double radius, double downwash) const;
+
+        void updateStaticLayer(double agent_radius);
+
+        // Is the distmap the global map, which is not modified after loading? Without the change log, the layer is
+        // rebuilt at every update instead.
+        [[nodiscard]] bool isStaticLayerShareable() const;
+
+        // The shared layer if the planner holds one, its own layer otherwise
+        [[nodiscard]] const GridMap &getStaticLayer() const {
+            return shared_static_layer != nullptr ? shared_static_layer->layer : static_layer;
+        }
+
+        // distmap_ptr if it is a PrimitiveWorld, nullptr otherwise
+        [[nodiscard]] const PrimitiveWorld *getPrimitiveWorld() const;
+
+        // Threshold the cells in [index_min, index_max], is_incremental: mark the cells in dirty_mask
+        void thresholdStaticLayer(const std::array<int, 3> &index_min, const std::array<int, 3> &index_max,
+                                  double agent_radius, bool is_incremental, GridMapUpdateReport &report);
 
         void updateGridMission(const point3d &start_point,
                                const point3d &goal_point);
@@ -155,13 +551,81 @@ namespace DynamicPlanning {
                                const points_t &current_points,
                                const points_t &goal_points);
 
-        bool isValid(const GridNode &grid_node);
+        // The start and goal cells occupied in the grid map are returned in occluded_nodes
+        [[nodiscard]] GridMission getGridMission(const points_t &start_points,
+                                                 const points_t &current_points,
+                                                 const points_t &goal_points,
+                                                 GridNodes &occluded_nodes) const;
+
+        [[nodiscard]] bool isValid(const GridNode &grid_node) const;
 
         bool isOccupied(const GridMap &map, const GridNode &grid_node);
 
-        bool planImpl(bool is_mapf);
+        // sapf_planner: the search of the single agent, used if not is_mapf
+        bool planImpl(bool is_mapf, IncrementalPathPlanner *sapf_planner = nullptr);
+
+        bool runSAPF(IncrementalPathPlanner &sapf_planner, gridpath_t &grid_path) const;
+
+        // Reads the members only, so that the groups can be solved concurrently with their own caches.
+        // Hierarchical MAPF: solved on the corridor map first, and on the full grid map if it fails.
+        // time_limit [ms]
+        std::vector<gridpath_t> runMAPF(const GridMap &grid_map, const GridMission &grid_mission,
+                                        MAPF::DistanceTableCache *distance_table_cache, MAPFGraph *mapf_graph,
+                                        int time_limit, MAPFMode mode) const;
+
+        // The problem is built over mapf_graph if grid_map blocks the static layer only, otherwise over a new graph
+        std::vector<gridpath_t> solveMAPF(const GridMap &grid_map, const GridMission &grid_mission,
+                                          MAPF::DistanceTableCache *distance_table_cache, MAPFGraph *mapf_graph,
+                                          int time_limit, MAPFMode mode) const;
+
+        // The graph of mapf_graph with the occupied cells of grid_map blocked, rebuilt if the static layer changed.
+        // nullptr if grid_map frees a cell of the static layer.
+        MAPF::Grid *prepareMAPFGraph(MAPFGraph &mapf_graph, const GridMap &grid_map) const;
+
+        // The grid map with the cells outside the clusters along the abstract paths of the agents occupied,
+        // false if an agent has no abstract path
+        bool getCorridorMap(const GridMap &grid_map, const GridMission &grid_mission, GridMap &corridor_map) const;
+
+        // Rolling horizon: the plan of the previous step shifted to the current points while it is valid, otherwise
+        // runMAPF with the plan truncated to grid_mapf_window steps. Only runMAPF if the window is 0.
+        // Anytime MAPF: a finished refinement is used before the rolling plan if it is valid, otherwise the plan
+        // is solved by PIBT and a refinement of it is started in the background.
+        // Reads the members only except rolling_plan, which is owned by the slot of the caller.
+        std::vector<gridpath_t> runWindowedMAPF(const GridMap &grid_map, const GridMission &grid_mission,
+                                                RollingMAPFPlan &rolling_plan,
+                                                MAPF::DistanceTableCache *distance_table_cache,
+                                                MAPFGraph *mapf_graph, int time_limit, bool &reused) const;
+
+        // The agents must be at the same step of the plan with the same goals, and the rest of the plan must be
+        // free in the grid map and the space-time occupancy
+        bool shiftRollingPlan(const GridMap &grid_map, const GridMission &grid_mission,
+                              const RollingMAPFPlan &rolling_plan, std::vector<gridpath_t> &grid_paths) const;
+
+        // The refinement is started if none is running. It solves IR (refined by ICBS) on copies of the grid map
+        // and the space-time occupancy, from grid_paths if they reach the goals.
+        void startRefinement(const GridMap &grid_map, const GridMission &grid_mission,
+                             const std::vector<gridpath_t> &grid_paths, RollingMAPFPlan &rolling_plan) const;
+
+        // The finished refinement shifted to the current points as the rolling plan, false if it is not finished
+        // or not valid anymore
+        bool takeRefinement(const GridMap &grid_map, const GridMission &grid_mission,
+                            RollingMAPFPlan &rolling_plan, std::vector<gridpath_t> &grid_paths) const;
+
+        void cancelRefinements();
+
+        // Aligned paths of the plan, without the repeated configurations at the start to prevent deadlock
+        static std::vector<gridpath_t> planToGridPaths(const MAPF::Plan &plan, size_t n_agents);
+
+        // nullptr if the cache is disabled, not thread-safe
+        MAPF::DistanceTableCache *getDistanceTableCache(size_t slot);
+
+        // not thread-safe
+        RollingMAPFPlan &getRollingPlan(size_t slot);
+
+        // not thread-safe
+        MAPFGraph &getMAPFGraph(size_t slot);
 
-        std::vector<gridpath_t> runMAPF(const GridMap &grid_map, const GridMission &grid_mission);
+        [[nodiscard]] std::unique_ptr<MAPF::Solver> createMAPFSolver(MAPFMode mode, MAPF::Problem *P) const;
 
         [[nodiscard]] points_t gridPathToPath(const gridpath_t &grid_path) const;
 
@@ -173,7 +637,11 @@ namespace DynamicPlanning {
 
         [[nodiscard]] GridNode point3DToGridVector(const point3d &point) const;
 
-        bool castRay(const point3d &current_position, const point3d &goal_position, double agent_radius);
+        // is_safe[i]: the segment from current_position to goal_positions[i] keeps agent_radius + 0.5 * resolution
+        // from the obstacles. The rays after the first unsafe one are not traced and are reported unsafe.
+        [[nodiscard]] std::vector<bool> castRays(const point3d &current_position,
+                                                 const points_t &goal_positions,
+                                                 double agent_radius) const;
     };
 }
 
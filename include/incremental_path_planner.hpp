@@ -0,0 +1,100 @@
+#ifndef LSC_PLANNER_INCREMENTAL_PATH_PLANNER_HPP
+#define LSC_PLANNER_INCREMENTAL_PATH_PLANNER_HPP
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <vector>
+#include <graph.hpp>
+
+namespace DynamicPlanning {
+    struct IncrementalPathStatistics {
+        long n_plans = 0;
+        long n_resets = 0; // searches from scratch, at the first plan or after the goal or the grid is changed
+        long n_changed_cells = 0; // cells whose occupancy is changed between the plans
+        long n_expanded = 0; // cells expanded over all plans
+    };
+
+    // D* Lite (Koenig and Likhachev, 2002) on the bit-packed occupancy grid of GridBasedPlanner.
+    // The search runs backward from the goal, so its tree stays valid while the start moves between the plans, and
+    // only the cells whose occupancy is changed since the previous plan and their neighbors are repaired.
+    // The grid is 6- or 26-connected, or 4- or 8-connected in the plane if the grid has a single layer.
+    class IncrementalPathPlanner {
+    public:
+        // connectivity: 6 or 26
+        explicit IncrementalPathPlanner(int _connectivity = 6);
+
+        // The cells from start to goal, both included. False if the goal is not reachable or out of the grid.
+        // A new goal, a new grid size or a new connectivity starts the search again.
+        bool plan(const MAPF::GridView &grid, const std::array<int, 3> &start, const std::array<int, 3> &goal,
+                  std::vector<std::array<int, 3>> &path);
+
+        void setConnectivity(int _connectivity);
+
+        // The next plan searches from scratch
+        void reset();
+
+        [[nodiscard]] const IncrementalPathStatistics &getStatistics() const { return statistics; }
+
+    private:
+        using Key = std::pair<float, float>;
+
+        struct Neighbor {
+            std::array<int, 3> offset;
+            float cost;
+        };
+
+        struct OpenNode {
+            Key key;
+            int cell;
+
+            bool operator>(const OpenNode &other) const { return key > other.key; }
+        };
+
+        int connectivity;
+        std::array<int, 3> dim{0, 0, 0};
+        std::vector<Neighbor> neighbors;
+        std::vector<uint8_t> occupancy; // [cell], the grid of the previous plan
+        std::vector<float> g, rhs; // [cell], cost to the goal
+        std::vector<Key> open_keys; // [cell], valid if in_open
+        std::vector<uint8_t> in_open; // [cell], the entries of open with the other keys are stale
+        std::priority_queue<OpenNode, std::vector<OpenNode>, std::greater<>> open;
+        int start_cell = -1, goal_cell = -1, last_start_cell = -1;
+        float km = 0;
+        bool is_initialized = false;
+        std::vector<int> changed_cells;
+        IncrementalPathStatistics statistics;
+
+        [[nodiscard]] int toCell(const std::array<int, 3> &node) const;
+
+        [[nodiscard]] std::array<int, 3> toNode(int cell) const;
+
+        [[nodiscard]] bool isInside(const std::array<int, 3> &node) const;
+
+        [[nodiscard]] float heuristic(int cell_a, int cell_b) const;
+
+        [[nodiscard]] Key calculateKey(int cell) const;
+
+        // Calls visit(neighbor cell) for the neighbors in the grid, free or not
+        template<typename Visit>
+        void forEachAdjacent(int cell, const Visit &visit) const;
+
+        // Calls visit(neighbor cell, cost) for the free neighbors of a free cell
+        template<typename Visit>
+        void forEachNeighbor(int cell, const Visit &visit) const;
+
+        void initialize(const MAPF::GridView &grid);
+
+        // Load the grid and collect the cells changed from the previous plan
+        void loadOccupancy(const MAPF::GridView &grid);
+
+        void push(int cell);
+
+        void updateVertex(int cell);
+
+        void computeShortestPath();
+    };
+}
+
+#endif //LSC_PLANNER_INCREMENTAL_PATH_PLANNER_HPP
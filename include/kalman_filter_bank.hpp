@@ -0,0 +1,53 @@
+#ifndef LSC_PLANNER_KALMAN_FILTER_BANK_HPP
+#define LSC_PLANNER_KALMAN_FILTER_BANK_HPP
+
+#include <map>
+#include <vector>
+#include <Eigen/Dense>
+#include <sp_const.hpp>
+#include <obstacle.hpp>
+
+namespace DynamicPlanning {
+    // Constant velocity Kalman filters of all tracked obstacles, the same model as LinearKalmanFilter.
+    // F, H, Q and R act on each axis separately and the initial covariance is the same for all axes, so the
+    // covariance of a track is one 2x2 (position, velocity) block shared by the axes. The states and the blocks are
+    // stored as structure of arrays, [field][track], and the filters of all tracks run in one pass of array
+    // operations.
+    class KalmanFilterBank {
+    public:
+        enum Field {
+            PX, PY, PZ,
+            VX, VY, VZ,
+            P_PP, P_PV, P_VV, // the covariance block shared by the axes
+            N_FIELDS,
+        };
+
+        void initialize(double sigma_y_sq, double sigma_a_sq);
+
+        // Filter the observed positions. The tracks are keyed by (type, id), a new obstacle starts a track at its
+        // position with zero velocity, and the tracks of the obstacles not in the list are removed. A track is kept
+        // as it is if the update time of its obstacle has not changed.
+        // filtered[oi] is obstacles[oi] with the estimated position and velocity.
+        void filter(const std::vector<Obstacle> &obstacles, std::vector<Obstacle> &filtered);
+
+        [[nodiscard]] size_t getNumTracks() const { return n_tracks; }
+
+        // 1.33 * sqrt(2 * trace) of the predicted position covariance after t_delta, same as LinearKalmanFilter
+        [[nodiscard]] double getUncertaintyRadius(size_t oi, double t_delta) const;
+
+    private:
+        typedef Eigen::Array<double, Eigen::Dynamic, N_FIELDS> TrackArray;
+
+        double sigma_y_sq = 0, sigma_a_sq = 0;
+        size_t n_tracks = 0;
+        TrackArray tracks, tracks_next; // [track][field], column major, so each field is contiguous
+        TrackArray stale_rows; // the tracks without a new measurement, restored after the update
+        std::vector<ros::Time> update_times; // [track]
+        std::map<std::pair<int, int>, size_t> track_indices, track_indices_next; // key: (obstacle type, id)
+        std::vector<bool> is_new_track;
+        Eigen::ArrayXd dt;
+        Eigen::Array<double, Eigen::Dynamic, 3> measurements;
+    };
+}
+
+#endif //LSC_PLANNER_KALMAN_FILTER_BANK_HPP
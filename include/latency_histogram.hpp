@@ -0,0 +1,49 @@
+#ifndef LSC_PLANNER_LATENCY_HISTOGRAM_HPP
+#define LSC_PLANNER_LATENCY_HISTOGRAM_HPP
+
+#include <cstdint>
+#include <vector>
+
+namespace DynamicPlanning {
+    // Log-linear histogram of the latency in seconds, in the manner of the HDR histogram.
+    // The values below 64 us are counted per microsecond, and every power of two above it is split into 64 linear
+    // sub-buckets, so a percentile is within 1.6% of the recorded value up to 1000 s and the memory is constant.
+    // The buckets are allocated at the first record, so an empty histogram is cheap to copy. Histograms with the
+    // same layout are merged by adding the counts, e.g. over the agents or the missions.
+    class LatencyHistogram {
+    public:
+        void record(double value);
+
+        void merge(const LatencyHistogram &other);
+
+        void clear();
+
+        // The value at the percentile in [0, 100], 0 if nothing is recorded
+        [[nodiscard]] double getPercentile(double percentile) const;
+
+        [[nodiscard]] uint64_t getCount() const { return count; }
+
+        [[nodiscard]] double getMin() const { return min; }
+
+        [[nodiscard]] double getMax() const { return max; }
+
+    private:
+        static constexpr double UNIT = 1e-6; // resolution of the linear buckets [s]
+        static constexpr int SUB_BUCKET_BITS = 6;
+        static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+        static constexpr int MAX_EXPONENT = 30; // 2^30 us > 1000 s, the larger values are put in the last bucket
+        static constexpr int N_BUCKETS = SUB_BUCKETS * (MAX_EXPONENT - SUB_BUCKET_BITS + 1);
+
+        std::vector<uint64_t> counts; // [bucket], empty until the first record
+        uint64_t count = 0;
+        double min = 0;
+        double max = 0;
+
+        [[nodiscard]] static int getBucketIndex(uint64_t units);
+
+        // The middle of the bucket in seconds
+        [[nodiscard]] static double getBucketValue(int bucket_idx);
+    };
+}
+
+#endif //LSC_PLANNER_LATENCY_HISTOGRAM_HPP
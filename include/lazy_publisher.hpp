@@ -0,0 +1,76 @@
+#ifndef LSC_PLANNER_LAZY_PUBLISHER_HPP
+#define LSC_PLANNER_LAZY_PUBLISHER_HPP
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <ros/ros.h>
+
+namespace DynamicPlanning {
+    // The topics with a subscriber, from the system state of the master. It is refreshed at most once per period for
+    // all lazy publishers of the process, so the master is called once per period instead of once per topic.
+    class TopicInterestMonitor {
+    public:
+        static constexpr double REFRESH_PERIOD = 1.0; // [s], wall time
+
+        static TopicInterestMonitor &getInstance();
+
+        // The topic must be resolved, see ros::NodeHandle::resolveName
+        [[nodiscard]] bool isSubscribed(const std::string &topic);
+
+    private:
+        std::mutex mtx;
+        ros::WallTime last_refresh_time;
+        bool has_refreshed = false;
+        std::unordered_set<std::string> subscribed_topics;
+
+        TopicInterestMonitor() = default;
+
+        void refresh();
+    };
+
+    // Publisher advertised when a node subscribes to its topic, see multisim/lazy_publishers. The advertisements of
+    // thousands of agents are registered to the master one by one at the startup, and most of the topics are never
+    // subscribed. A lazy publisher is not advertised, so a subscriber is found by the system state of the master.
+    class LazyPublisher {
+    public:
+        LazyPublisher() = default;
+
+        // Advertise now unless lazy
+        template<typename M>
+        void initialize(ros::NodeHandle nh, const std::string &topic, uint32_t queue_size, bool lazy) {
+            topic_name = nh.resolveName(topic);
+            advertise = [nh, topic, queue_size]() mutable {
+                return nh.advertise<M>(topic, queue_size);
+            };
+            if (not lazy) {
+                publisher = advertise();
+            }
+        }
+
+        // The subscribers of the publisher, it is advertised if a subscriber waits for the topic. The connections
+        // of the subscribers follow the advertisement, so they are counted from the next call or so.
+        uint32_t getNumSubscribers();
+
+        // Invalid until advertised, getNumSubscribers() > 0 means it is advertised
+        [[nodiscard]] const ros::Publisher &getPublisher() const { return publisher; }
+
+        [[nodiscard]] const std::string &getTopic() const { return topic_name; }
+
+        // The message is dropped if the publisher is not advertised
+        template<typename M>
+        void publish(const M &msg) const {
+            if (publisher) {
+                publisher.publish(msg);
+            }
+        }
+
+    private:
+        std::string topic_name;
+        std::function<ros::Publisher()> advertise;
+        ros::Publisher publisher;
+    };
+}
+
+#endif //LSC_PLANNER_LAZY_PUBLISHER_HPP
@@ -0,0 +1,46 @@
+#ifndef LSC_PLANNER_MAP_CHANGE_LOG_HPP
+#define LSC_PLANNER_MAP_CHANGE_LOG_HPP
+
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <cstdint>
+#include <octomap/octomap_types.h>
+
+namespace DynamicPlanning {
+    // Log of the regions where the map has changed, so that the users of the map can update their caches
+    // only in the changed regions. Every change increases the version of the map.
+    // Only the latest changes are kept, a user that is too far behind has to rebuild its cache.
+    class MapChangeLog {
+    public:
+        typedef std::pair<octomap::point3d, octomap::point3d> Region; // (region_min, region_max)
+
+        explicit MapChangeLog(size_t capacity = 64);
+
+        // The whole map is changed, e.g. the distmap is recreated
+        void markAll();
+
+        void markRegion(const octomap::point3d &region_min, const octomap::point3d &region_max);
+
+        [[nodiscard]] uint64_t getVersion() const;
+
+        // Returns false if the changes since the version are not available, then the whole map must be rebuilt.
+        // Otherwise, the regions changed after the version are appended to regions.
+        bool getChangesSince(uint64_t version, std::vector<Region> &regions) const;
+
+    private:
+        struct Entry {
+            uint64_t version;
+            Region region;
+        };
+
+        mutable std::mutex mtx;
+        std::deque<Entry> entries; // ordered by version
+        uint64_t version;
+        uint64_t full_change_version; // the version of the last markAll
+        size_t capacity;
+    };
+}
+
+#endif //LSC_PLANNER_MAP_CHANGE_LOG_HPP
@@ -9,63 +9,226 @@
 #include <pcl/filters/voxel_grid.h>
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
-#include <pcl/search/kdtree.h>
 #include <pcl_conversions/pcl_conversions.h>
-#include <pcl/search/impl/kdtree.hpp>
 #include <pcl/common/transforms.h>
 #include <tf/transform_broadcaster.h>
 #include <util.hpp>
 #include <octomap_msgs/Octomap.h>
 #include <octomap_msgs/conversions.h>
 #include <octomap_msgs/GetOctomap.h>
+#include <batch_distmap.hpp>
+#include <rolling_distmap.hpp>
+#include <sparse_voxel_map.hpp>
+#include <primitive_world.hpp>
+#include <occupancy_index.hpp>
+#include <map_change_log.hpp>
+#include <map_merge.hpp>
+#include <global_map_registry.hpp>
+#include <raycast_sensor.hpp>
+#include <point_cloud_ingestion.hpp>
+#include <global_point_cloud.hpp>
+#include <lazy_publisher.hpp>
+#include <worker_pool.hpp>
+#include <timer.hpp>
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
 
 
 namespace DynamicPlanning {
+    struct SensorStatistics {
+        int n_updates = 0;
+        size_t n_free_voxels = 0; // the number of voxels updated as free
+        size_t n_occupied_voxels = 0; // the number of voxels updated as occupied
+        double total_time = 0; // [s], the sensor input and its insertion into the octree
+        LatencyHistogram time_histogram; // [s], the time of each update of an agent
+
+        void merge(const SensorStatistics &other) {
+            n_updates += other.n_updates;
+            n_free_voxels += other.n_free_voxels;
+            n_occupied_voxels += other.n_occupied_voxels;
+            total_time += other.total_time;
+            time_histogram.merge(other.time_histogram);
+        }
+
+        [[nodiscard]] double getAverageTime() const {
+            return n_updates > 0 ? total_time / n_updates : 0;
+        }
+
+        [[nodiscard]] double getAverageVoxels() const {
+            return n_updates > 0 ? static_cast<double>(n_free_voxels + n_occupied_voxels) / n_updates : 0;
+        }
+    };
+
+    // Version of the map of an agent, a reader pins it by holding the pointer, e.g. a planner for its whole cycle.
+    // The components of a published snapshot are not modified: the writer copies a component that is still pinned
+    // before changing it, and the components that are not changed are shared with the next version. The change log
+    // is append-only, so it is shared by all versions.
+    struct MapSnapshot {
+        uint64_t version = 0;
+        std::shared_ptr<octomap::OcTree> octree;
+        std::shared_ptr<DistanceMap> distmap;
+        std::shared_ptr<OccupancyIndex> occupancy_index; // nullptr if param.world_occupancy_index is false
+        std::shared_ptr<MapChangeLog> map_change_log;
+    };
+
     class MapManager {
     public:
-        MapManager(const ros::NodeHandle& nh, const Param& param, const Mission& mission, int agent_id);
+        MapManager(const ros::NodeHandle& nh, const Param& param, const std::shared_ptr<const Mission>& mission,
+                   int agent_id);
 
         void publish();
 
+        // Insert the sensor input, then update the distmap in the region of the changed voxels
         void updateVirtualLocalMap(const point3d& agent_position);
 
+        // The two stages of updateVirtualLocalMap, so that the stages of different agents can run concurrently
+        void insertVirtualSensorInput(const point3d& agent_position);
+
+        void updateLocalDistmap();
+
         void mergeMapCallback(const octomap_msgs::Octomap& msg_merge_map);
 
+        // Map sharing between agents without octomap messages
+        // The voxels changed after since_seq, including the voxels merged from the other agents
+        [[nodiscard]] MapDelta getMapDelta(uint64_t since_seq) const;
+
+        // The sequence number of the last delta merged from the peer, 0 if none
+        [[nodiscard]] uint64_t getPeerMapSeq(int peer_id) const;
+
+        // Merge the voxels into the octree, the distmap and the occupancy index
+        void mergeMapDelta(int peer_id, const MapDelta& delta);
+
+        // Prepare the merge on MapMergeWorker, the map is not changed until commitMapMerges.
+        // The octree must not be changed until commitMapMerges.
+        void mergeMapDeltaAsync(int peer_id, MapDelta delta);
+
+        // Wait for the prepared merges, then apply them with one update of the distmap and the occupancy index
+        void commitMapMerges();
+
         void setGlobalMap();
 
-        void setGlobalMap(const sensor_msgs::PointCloud2& global_map);
+        // Next mission in the same world, the global map is kept. Only the global octomap is known before the
+        // mission, so the other maps can not be reset.
+        void resetMission(const std::shared_ptr<const Mission>& mission);
+
+        // The point cloud is shared by all agents, the virtual sensor queries it
+        void setGlobalMap(const std::shared_ptr<const GlobalPointCloud>& global_cloud);
 
+        // The sensor input in the agent frame as a ROS message, the map update does not use it
         sensor_msgs::PointCloud2 getVirtualSensorInput(const point3d& agent_position);
 
+        // The octree of the last published version, serialized once per version
         [[nodiscard]] octomap_msgs::Octomap getLocalOctomapMsg() const;
 
+        // The last published version, it can be taken concurrently with the map updates
+        [[nodiscard]] std::shared_ptr<const MapSnapshot> getSnapshot() const;
+
+        // The components of the last published version
         [[nodiscard]] std::shared_ptr<octomap::OcTree> getOctomap() const;
 
-        [[nodiscard]] std::shared_ptr<DynamicEDTOctomap> getDistmap() const;
+        [[nodiscard]] std::shared_ptr<DistanceMap> getDistmap() const;
+
+        [[nodiscard]] std::shared_ptr<OccupancyIndex> getOccupancyIndex() const;
+
+        [[nodiscard]] std::shared_ptr<MapChangeLog> getMapChangeLog() const;
+
+        [[nodiscard]] const SensorStatistics &getSensorStatistics() const { return sensor_statistics; }
 
     private:
         Param param;
-        Mission mission;
+        std::shared_ptr<const Mission> mission; // shared by all components of all agents
 
-        pcl::PointCloud<pcl::PointXYZ> cloud_all_map;
-        pcl::search::KdTree<pcl::PointXYZ> kdtreeGlobalMap;
+        std::shared_ptr<const GlobalPointCloud> global_cloud; // nullptr if the global octomap is used
         bool has_global_map;
+
+        // Buffers of the virtual sensor, reused at every step
+        octomap::Pointcloud sensor_octomap;
+        // The keys of a batch of the points, split into the buckets of the key hash
+        struct SensorRayBatch {
+            octomap::KeyRay key_ray;
+            std::vector<std::vector<octomap::OcTreeKey>> free_keys, occupied_keys; // [bucket]
+        };
+        std::vector<SensorRayBatch> sensor_ray_batches;
+        std::vector<std::vector<octomap::OcTreeKey>> sensor_free_buckets, sensor_occupied_buckets; // [bucket]
+
+        // Ray-cast sensor, nullptr if param.sensor_mode is not RAYCAST
+        std::unique_ptr<RaycastSensor> raycast_sensor;
+        std::vector<octomap::OcTreeKey> sensor_free_keys, sensor_occupied_keys;
+        point3d last_sensor_position;
+        bool has_sensor_position;
+        double sensor_yaw; // [rad], the moving direction of the agent
+        SensorStatistics sensor_statistics;
+
         int count_global_map_publish;
 
         std::string agent_frame_id, world_frame_id;
 
         ros::NodeHandle nh;
-        ros::Publisher pub_sensor_map;
+        LazyPublisher pub_sensor_map;
         ros::ServiceServer service_get_octomap;
 
+        std::shared_ptr<const GlobalMap> global_map; // shared by the agents if the global octomap is used
         std::shared_ptr<octomap::OcTree> octree_ptr;
-        std::shared_ptr<DynamicEDTOctomap> distmap_ptr;
+        std::shared_ptr<BatchDistmap> distmap_ptr; // nullptr if the rolling window or the sparse map is used
+        std::shared_ptr<RollingDistmap> rolling_distmap_ptr; // nullptr if param.world_rolling_window_size is 0
+        std::shared_ptr<SparseVoxelMap> sparse_distmap_ptr; // nullptr if param.world_sparse_distmap is false
+        std::shared_ptr<OccupancyIndex> occupancy_index_ptr; // nullptr if param.world_occupancy_index is false
+        std::shared_ptr<PrimitiveWorld> primitive_world_ptr; // nullptr if param.world_analytic is false
+        std::shared_ptr<MapChangeLog> map_change_log_ptr;
+        std::shared_ptr<const MapSnapshot> snapshot; // the last published version, loaded and stored atomically
+
+        // The full serialization of a version, reused by the publisher and the service until the map changes
+        struct OctomapMsgCache {
+            std::mutex mtx;
+            bool is_valid = false;
+            uint64_t version = 0;
+            octomap_msgs::Octomap msg; // without the header
+        };
+        mutable OctomapMsgCache octomap_msg_cache;
+
+        // Map sharing: the sequence number of the last change of each voxel whose occupancy changed
+        uint64_t map_seq;
+        std::unordered_map<octomap::OcTreeKey, uint64_t, octomap::OcTreeKey::KeyHash> voxel_seqs;
+        std::deque<std::pair<uint64_t, octomap::OcTreeKey>> voxel_journal; // ordered by seq, stale entries are skipped
+        std::map<int, uint64_t> peer_map_seqs; // peer id -> the sender seq of the last merged delta
+        std::vector<std::shared_ptr<PreparedMapMerge>> pending_map_merges; // filled by MapMergeWorker
 
         void updateGlobalMap(const sensor_msgs::PointCloud2& msg_global_map);
 
+        // Called before the map is changed, copies the components of the published version if a reader pins it
+        void prepareMapWrite();
+
+        // Publish the current components as the next version
+        void publishSnapshot();
+
         void updateVirtualSensorInput(const point3d& agent_position);
 
-        void updateOctreeFromCSV();
+        // Same as OcTree::insertPointCloud without the discretization, the rays are traced in parallel. A key is in
+        // one bucket of all batches, so the buckets are deduplicated in parallel and a voxel hit by any point is not
+        // free. Returns the number of the free and the occupied voxels updated.
+        std::pair<size_t, size_t> insertSensorPoints(const point3d& sensor_origin);
+
+        // Scroll the rolling window to the agent, then drop the voxels of the octree that left the window
+        void moveRollingWindow(const point3d& agent_position);
+
+        void buildOccupancyIndex();
+
+        // Record the changed voxels of the octree, then update the distmap which resets the change detection
+        void updateDistmap();
+
+        // Apply the merges to the octree, then update the distmap, the occupancy index and the change log once
+        void applyMapMerges(const std::vector<PreparedMapMerge>& merges);
+
+        void recordMapChanges();
+
+        // The message of the snapshot from the cache, the snapshot is pinned while it is serialized
+        [[nodiscard]] octomap_msgs::Octomap getSnapshotOctomapMsg() const;
 
         bool getOctomapCallback(octomap_msgs::GetOctomapRequest &req,
                                 octomap_msgs::GetOctomapResponse &res);
@@ -0,0 +1,92 @@
+#ifndef LSC_PLANNER_MAP_MERGE_HPP
+#define LSC_PLANNER_MAP_MERGE_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <octomap/OcTree.h>
+
+namespace DynamicPlanning {
+    // Voxels of a map whose occupancy changed after a sequence number of the sender.
+    // Each voxel is encoded as the key (3 x uint16) and the log-odds (float32), 10 bytes in the host byte order.
+    struct MapDelta {
+        static constexpr size_t VOXEL_SIZE = 3 * sizeof(uint16_t) + sizeof(float);
+
+        uint64_t seq = 0; // the sequence number of the sender when the delta is made
+        std::vector<uint8_t> data;
+
+        [[nodiscard]] size_t size() const { return data.size() / VOXEL_SIZE; }
+
+        void append(const octomap::OcTreeKey &key, float log_odds);
+
+        void get(size_t i, octomap::OcTreeKey &key, float &log_odds) const;
+    };
+
+    // Lossless encoding of the voxels of a delta for the links, see communication/map_delta_compression. The voxels
+    // are sorted by the Morton code of the keys, and the gaps between the codes are varints, which are short since the
+    // changed voxels are clustered around the sensor. The log-odds are the indices of a table of the distinct values
+    // built while encoding, which stays small since the log-odds are clamped and updated by the same steps; a value
+    // not in the table is written once as float32. The order of the voxels is not kept, the merge sorts them anyway.
+    namespace MapDeltaCodec {
+        // The voxels of the delta, the seq is not encoded
+        void compress(const MapDelta &delta, std::vector<uint8_t> &out);
+
+        // Append the voxels to the delta, false if the data is not a valid encoding
+        bool decompress(const uint8_t *data, size_t size, MapDelta &delta);
+    }
+
+    // Voxels of a delta that change the local map, in the order of the octree traversal
+    struct PreparedMapMerge {
+        std::vector<octomap::OcTreeKey> keys;
+        std::vector<float> log_odds;
+        size_t n_skipped_voxels = 0; // voxels whose log-odds are already the same as the local voxels
+        octomap::point3d region_min, region_max; // the bounding box of the voxel centers, valid if keys is not empty
+    };
+
+    // The voxels of the delta are sorted by the Morton code of the keys, which is the depth-first order of the
+    // octree, so consecutive voxels share the path from the root and the descent restarts from the deepest common
+    // node. A voxel is skipped if the local voxel, or the pruned leaf that covers it, has the same log-odds.
+    // The octree is only read, so the merge can be prepared while the planners read the map.
+    PreparedMapMerge prepareMapMerge(const octomap::OcTree &octree, const MapDelta &delta);
+
+    // Add the log-odds of the peer to the local voxels, the unknown voxels take the log-odds of the peer.
+    // The inner nodes are updated once after all voxels.
+    void applyMapMerge(octomap::OcTree &octree, const PreparedMapMerge &merge);
+
+    // Background thread that prepares the merges of the peer maps while the agents plan
+    class MapMergeWorker {
+    public:
+        typedef std::function<void()> Job;
+
+        static MapMergeWorker &getInstance();
+
+        ~MapMergeWorker();
+
+        MapMergeWorker(const MapMergeWorker &) = delete;
+
+        MapMergeWorker &operator=(const MapMergeWorker &) = delete;
+
+        void submit(Job job);
+
+        // Block until all submitted jobs are finished
+        void wait();
+
+    private:
+        std::thread worker;
+        std::mutex mtx;
+        std::condition_variable cv_job, cv_idle;
+        std::deque<Job> pending_jobs;
+        bool is_running_job;
+        bool stop;
+
+        MapMergeWorker();
+
+        void workerLoop();
+    };
+}
+
+#endif //LSC_PLANNER_MAP_MERGE_HPP
@@ -11,6 +11,7 @@
 #include "lib_cbs.hpp"
 #include "solver.hpp"
 
+namespace MAPF {
 class CBS : public Solver
 {
 public:
@@ -21,6 +22,7 @@ protected:
   struct HighLevelNode {
     int id;  // id
     Paths paths;
+    LibCBS::ConflictIndex conflicts;  // conflicts of the paths, updated with them
     LibCBS::Constraints constraints;
     int makespan;  // makespan
     int soc;       // sum of cost
@@ -28,10 +30,11 @@ protected:
     bool valid;
 
     HighLevelNode() {}
-    HighLevelNode(int _id, Paths _paths, LibCBS::Constraints _c, int _m,
-                  int _soc, int _f, bool _valid)
+    HighLevelNode(int _id, Paths _paths, LibCBS::ConflictIndex _conflicts,
+                  LibCBS::Constraints _c, int _m, int _soc, int _f, bool _valid)
         : id(_id),
           paths(_paths),
+          conflicts(std::move(_conflicts)),
           constraints(_c),
           makespan(_m),
           soc(_soc),
@@ -66,3 +69,4 @@ public:
 
   static void printHelp();
 };
+}
@@ -6,6 +6,7 @@
 #pragma once
 #include "cbs.hpp"
 
+namespace MAPF {
 class CBS_REFINE : public virtual CBS
 {
 protected:
@@ -32,3 +33,4 @@ public:
 
   void setParams(int argc, char* argv[]);
 };
+}
@@ -0,0 +1,108 @@
+/*
+ * Cache of the distance tables to the goals, shared by the solvers of consecutive problems on the same grid.
+ *
+ * - A table is computed lazily, the backward search from the goal stops as soon as the queried node is settled.
+ * - The tables are keyed by (grid version, goal cell). The cells are indexed by position, not by node id,
+ *   so that the tables stay valid when the graph is rebuilt from the same grid.
+ * - If cells become blocked, the tables are repaired incrementally: only the settled cells that lose
+ *   their shortest path are reopened. If cells become free, the distances can decrease, so the tables are dropped.
+ */
+
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <queue>
+#include <vector>
+#include <graph.hpp>
+
+namespace MAPF {
+    struct DistanceTableStatistics {
+        int n_query = 0;        // the number of table requests
+        int n_hit = 0;          // requests served by a cached table
+        int n_repaired = 0;     // tables repaired after cells are blocked
+        int n_invalidated = 0;  // tables dropped after cells are freed
+        long n_expanded = 0;    // the number of settled cells over all tables
+
+        double getHitRate() const { return n_query > 0 ? static_cast<double>(n_hit) / n_query : 0; }
+    };
+
+    class DistanceTableCache {
+    public:
+        class Table {
+        public:
+            // Distance from v to the goal, -1 if v can not reach the goal
+            // Read-only after expandAll, so the solvers can query the table concurrently.
+            int getDistance(const Node *const v);
+
+            // Settle all reachable cells, the tables of different goals can be expanded concurrently
+            void expandAll();
+
+        private:
+            friend class DistanceTableCache;
+
+            using OpenNode = std::pair<int, int>;  // (distance, cell)
+            using Open = std::priority_queue<OpenNode, std::vector<OpenNode>, std::greater<OpenNode>>;
+
+            DistanceTableCache *const cache;
+            const int goal_cell;
+            uint64_t last_used_round;
+            long n_expanded;               // counted in the table, so that the tables can be expanded concurrently
+            std::vector<int> dist;         // settled: exact distance, otherwise tentative distance
+            std::vector<uint8_t> settled;
+            Open open;
+
+            Table(DistanceTableCache *_cache, int _goal_cell);
+
+            void expand();
+
+            // Returns false if the goal is blocked
+            bool repair(const std::vector<int> &blocked_cells);
+
+            bool hasSupport(int cell) const;
+
+            // tentative distance of an open cell from its settled neighbors
+            void reopen(int cell);
+        };
+
+        // capacity: the maximum number of tables, the tables in use by the current problem are never evicted
+        explicit DistanceTableCache(size_t _capacity);
+
+        // Sync with the grid of a new problem, must be called before the solvers of the problem use the tables
+        void update(const GridView &grid, Graph *_G);
+
+        // The table is valid until the next update
+        Table *getTable(const Node *const goal);
+
+        void clear();
+
+        DistanceTableStatistics getStatistics() const;
+
+    private:
+        static constexpr int INF = std::numeric_limits<int>::max();
+
+        size_t capacity;
+        Graph *G;
+        int width, height, depth;
+        std::vector<uint8_t> occupied;  // [cell], the grid of the last update
+        uint64_t version;               // increased whenever the grid changes
+        uint64_t round;                 // increased in every update
+        std::map<int, std::unique_ptr<Table>> tables;  // goal cell -> table of the current version
+        DistanceTableStatistics statistics;  // n_expanded: the expanded cells of the dropped tables
+
+        int getCellIndex(const Pos &pos) const { return (pos.z * height + pos.y) * width + pos.x; }
+
+        Node *getNode(int cell) const;
+
+        // cells within Chebyshev distance 1 that are in the grid
+        void getAdjacentCells(int cell, std::vector<int> &cells) const;
+
+        void evict();
+
+        void eraseTable(std::map<int, std::unique_ptr<Table>>::iterator it);
+
+        void clearTables();
+    };
+}
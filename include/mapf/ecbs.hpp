@@ -9,6 +9,9 @@
  */
 
 #pragma once
+#include <algorithm>
+#include <cstdint>
+#include <deque>
 #include <memory>
 #include <tuple>
 
@@ -21,10 +24,23 @@ namespace MAPF {
         static const std::string SOLVER_NAME;
 
     protected:
+        // path of one agent, shared by the high-level nodes until the agent is replanned
+        using SharedPath = std::shared_ptr<const Path>;
+
+        // constraints of a high-level node, a chain of its own constraint and the parent's chain
+        struct ConstraintChain;
+        using ConstraintChain_p = std::shared_ptr<const ConstraintChain>;
+        struct ConstraintChain {
+            LibCBS::Constraint_p constraint;
+            ConstraintChain_p parent;
+            int size;  // the number of constraints in the chain
+        };
+
         // high-level node, see CBS for details
+        // The paths and the constraints are shared with the parent, a child only holds the replanned path.
         struct HighLevelNode {
-            Paths paths;
-            LibCBS::Constraints constraints;
+            std::vector<SharedPath> paths;  // paths without alignment, use getPaths
+            ConstraintChain_p constraints;  // nullptr if no constraints
             int makespan;
             int soc;
             int f;
@@ -34,20 +50,23 @@ namespace MAPF {
 
             HighLevelNode() {}
 
-            HighLevelNode(Paths _paths, LibCBS::Constraints _c, int _m, int _soc,
-                          int _f, int _LB, std::vector<int> _f_mins, bool _valid)
-                    : paths(_paths),
-                      constraints(_c),
+            HighLevelNode(std::vector<SharedPath> _paths, ConstraintChain_p _c, int _m,
+                          int _soc, int _f, int _LB, std::vector<int> _f_mins, bool _valid)
+                    : paths(std::move(_paths)),
+                      constraints(std::move(_c)),
                       makespan(_m),
                       soc(_soc),
                       f(_f),
                       LB(_LB),
-                      f_mins(_f_mins),
+                      f_mins(std::move(_f_mins)),
                       valid(_valid) {
             }
+
+            int getConstraintsSize() const { return constraints == nullptr ? 0 : constraints->size; }
         };
 
-        using HighLevelNode_p = std::shared_ptr<HighLevelNode>;
+        // the nodes are allocated in an arena owned by run, so the lists hold raw pointers
+        using HighLevelNode_p = HighLevelNode *;
         using CompareHighLevelNode =
         std::function<bool(HighLevelNode_p, HighLevelNode_p)>;
 
@@ -68,6 +87,9 @@ namespace MAPF {
         float sub_optimality;
         static const float DEFAULT_SUB_OPTIMALITY;
 
+        // the number of focal nodes expanded at once, their low-level searches run in parallel_for
+        int batch_size;
+
         void setInitialHighLevelNode(HighLevelNode_p n);
 
         Path getInitialPath(int id, const Paths &paths);
@@ -78,10 +100,15 @@ namespace MAPF {
         // objective for focal list
         CompareHighLevelNode getFocalObjective();
 
-        void invoke(HighLevelNode_p h_node, int id);
+        // aligned paths of the node
+        Paths getPaths(HighLevelNode_p h_node) const;
+
+        // paths, conflicts: aligned paths of h_node before the replanning and their conflicts, shared by the children
+        // invoked concurrently
+        void invoke(HighLevelNode_p h_node, const Paths &paths, const LibCBS::ConflictIndex &conflicts, int id);
 
-        // return path and f-min value
-        std::tuple<Path, int> getFocalPath(HighLevelNode_p h_node, int id);
+        // return path and f-min value, the conflict heuristic is given by the conflict index
+        std::tuple<Path, int> getFocalPath(HighLevelNode_p h_node, const LibCBS::ConflictIndex &conflicts, int id);
 
         std::tuple<Path, int> getTimedPathByFocalSearch(
                 Node *const s, Node *const g, float w,  // sub-optimality
@@ -103,6 +130,8 @@ namespace MAPF {
 
         void setParams(int argc, char *argv[]);
 
+        void setBatchSize(int _batch_size) { batch_size = std::max(1, _batch_size); }
+
         static void printHelp();
     };
 }
\ No newline at end of file
@@ -20,6 +20,7 @@
 #pragma once
 #include "solver.hpp"
 
+namespace MAPF {
 class HCA : public Solver
 {
 public:
@@ -44,3 +45,4 @@ public:
   void setParams(int argc, char* argv[]);
   static void printHelp();
 };
+}
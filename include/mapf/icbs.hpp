@@ -12,6 +12,7 @@
 #include "cbs.hpp"
 #include "solver.hpp"
 
+namespace MAPF {
 class ICBS : public virtual CBS
 {
 public:
@@ -35,6 +36,10 @@ protected:
 protected:
   // store MDD_c^i
   std::unordered_map<int, LibCBS::MDDs> MDDTable;
+  // MDDs shared by the high-level nodes
+  LibCBS::MDDCache MDD_CACHE;
+  // cached or new MDD_c^i with constraints
+  LibCBS::MDD_p getMDD(int c, int i, const LibCBS::Constraints& constraints);
 
   virtual void setInitialHighLevelNode(HighLevelNode_p n);
   virtual Path getConstrainedPath(HighLevelNode_p h_node, int id);
@@ -54,3 +59,4 @@ public:
 
   static void printHelp();
 };
+}
@@ -7,6 +7,7 @@
 #include "cbs_refine.hpp"
 #include "icbs.hpp"
 
+namespace MAPF {
 class ICBS_REFINE : public ICBS, CBS_REFINE
 {
 private:
@@ -19,3 +20,4 @@ public:
               const std::vector<int>& _modif_list);
   ~ICBS_REFINE(){};
 };
+}
@@ -6,6 +6,7 @@
 
 #include "solver.hpp"
 
+namespace MAPF {
 class IR : public Solver
 {
 public:
@@ -198,3 +199,4 @@ public:
   IR_HYBRID(Problem* _P) : IR(_P) { solver_name = SOLVER_NAME; }
   static void printHelp() { printHelpWithoutOption(SOLVER_NAME); }
 };
+}
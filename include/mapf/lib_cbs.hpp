@@ -3,7 +3,12 @@
  */
 
 #pragma once
+#include <array>
+#include <list>
+#include <map>
 #include <memory>
+#include <tuple>
+#include <unordered_map>
 
 #include "solver.hpp"
 
@@ -15,6 +20,7 @@ namespace LibCBS
   struct Constraint;
   using Constraint_p = std::shared_ptr<Constraint>;
   using Constraints = std::vector<Constraint_p>;
+  class ConflictIndex;
 
   // ======================================
   // MDD
@@ -23,6 +29,7 @@ namespace LibCBS
   struct MDD;
   using MDD_p = std::shared_ptr<MDD>;
   using MDDs = std::vector<MDD_p>;
+  class MDDCache;
 
   // ======================================
   // conflict
@@ -40,6 +47,63 @@ namespace LibCBS
     void println();
   };
 
+  // Space-time reservation of the paths and their conflicts. Replacing the path of an agent updates the index in
+  // O(path length), so the high-level searches do not scan every pair of paths at every timestep.
+  // A conflict is counted once per pair of agents and timestep as Paths::conflicted, and an agent stays at its
+  // last node after its path. Two agents staying at the same node conflict once, when the later one arrives.
+  class ConflictIndex
+  {
+  public:
+    ConflictIndex() {}
+    explicit ConflictIndex(const Paths& paths);
+
+    // replace the path of the agent, O(path length) with few agents at a node
+    void update(int id, const Path& path);
+
+    // no conflict
+    bool empty() const { return conflicts.empty(); }
+    int countConflict() const { return conflicts.size(); }
+    // conflicts of the agent
+    int countConflict(int id) const { return n_conflicts[id]; }
+    // conflicts within a subset of agents
+    int countConflict(const std::vector<int>& sample) const;
+    // conflicts of the path if it replaced the path of the agent, the index is not changed
+    int countConflict(int id, const Path& path) const;
+
+    // an agent other than id at v at t, -1 if there is none
+    int getAgent(const MAPF::Node* v, int t, int id) const;
+    // location of the agent at t
+    MAPF::Node* get(int i, int t) const;
+
+    // the first conflict by the timestep and then the agents, as the scan of all pairs, {} if there is none
+    Constraints getFirstConstraints() const;
+
+    // (t, i, j) with i < j -> a swap conflict, false if it is a vertex conflict
+    using Conflicts = std::map<std::tuple<int, int, int>, bool>;
+    const Conflicts& getConflicts() const { return conflicts; }
+
+  private:
+    struct Visit {
+      int agent;
+      int t;
+      bool stay;  // from t to the end
+    };
+
+    std::vector<Path> paths;  // [agent], without the repeated last nodes
+    std::unordered_map<int, std::vector<Visit>> visits;  // node id -> visits
+    Conflicts conflicts;
+    std::vector<int> n_conflicts;  // [agent]
+
+    void insertVisits(int id);
+    void eraseVisits(int id);
+    void insertConflict(int t, int i, int j, bool is_swap);
+    void eraseConflicts(int id);
+
+    // fn(t, other agent, is_swap) for each conflict of the path as the path of id
+    template <typename F>
+    void forEachConflict(int id, const Path& path, F fn) const;
+  };
+
   // for CBS-style solvers
   Constraints getFirstConstraints(const Paths& paths);
 
@@ -50,9 +114,17 @@ namespace LibCBS
                               Constraints& semi_cardinal_constraints,
                               Constraints& non_cardinal_constraints);
   Constraints getPrioritizedConflict(const Paths& paths, const MDDs& mdds);
+  // only the pairs in the conflict index of the paths are checked
+  Constraints getPrioritizedConflict(const Paths& paths,
+                                     const ConflictIndex& conflicts,
+                                     const MDDs& mdds);
   // for limited agents, used in refine-solvers
   Constraints getPrioritizedConflict(const Paths& paths, const MDDs& mdds,
                                      const std::vector<int>& sample);
+  Constraints getPrioritizedConflict(const Paths& paths,
+                                     const ConflictIndex& conflicts,
+                                     const MDDs& mdds,
+                                     const std::vector<int>& sample);
 
   // used in refine-solvers
   // create constraints by fixed paths for CBS-style solvers
@@ -83,7 +155,8 @@ namespace LibCBS
     Solver* solver;              // solver
 
     // cache, MDD without any constraints
-    static std::unordered_map<std::string, MDD_p> PURE_MDD_TABLE;
+    // thread local, the solvers of a portfolio build their MDDs concurrently
+    static thread_local std::unordered_map<std::string, MDD_p> PURE_MDD_TABLE;
 
     MDD(int _c, int _i, Solver* _solver, Constraints constraints = {}, int time_limit = -1);
     ~MDD();
@@ -124,4 +197,41 @@ namespace LibCBS
     // emergency
     void halt(const std::string& msg) const;
   };
+
+  // MDDs of one solver keyed by (agent, cost, constraints on the agent).
+  // Many branches of the high-level tree reach the same constraints of an agent,
+  // and a child shares the MDDs of its parent except the replanned agent.
+  // The cached MDDs must not be modified, copy them before update.
+  // The least recently used MDDs are dropped beyond the limit of MDD nodes.
+  class MDDCache
+  {
+  public:
+    static constexpr size_t DEFAULT_MAX_NODES = 1000000;
+
+    explicit MDDCache(size_t _max_nodes = DEFAULT_MAX_NODES);
+
+    // nullptr -> not cached
+    MDD_p find(int i, int c, const Constraints& constraints);
+    // MDD of mdd->i and mdd->c with the constraints
+    void insert(const Constraints& constraints, const MDD_p& mdd);
+    void clear();
+
+    size_t size() const { return table.size(); }
+    size_t getNodeNum() const { return n_nodes; }
+
+  private:
+    // agent, cost, sorted constraints on the agent {t, v, u or -1, stay}
+    using Key = std::tuple<int, int, std::vector<std::array<int, 4>>>;
+    struct Entry {
+      MDD_p mdd;
+      std::list<Key>::iterator lru;  // position in LRU
+    };
+
+    std::map<Key, Entry> table;
+    std::list<Key> LRU;  // most recently used first
+    size_t n_nodes;      // sum of MDD nodes in the table
+    size_t max_nodes;
+
+    static Key getKey(int i, int c, const Constraints& constraints);
+  };
 };  // namespace LibCBS
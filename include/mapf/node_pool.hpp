@@ -0,0 +1,68 @@
+/*
+ * memory of the low-level searches, reused between the searches
+ */
+
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+namespace MAPF {
+    // Arena of search nodes. reset() is O(1), the nodes are overwritten from the front by the next search,
+    // so the storage grows to the largest search only once. The addresses are kept until the next reset.
+    template<typename T>
+    class NodePool {
+    public:
+        template<typename... Args>
+        T *create(Args &&... args) {
+            if (n_used < nodes.size()) {
+                nodes[n_used] = T{std::forward<Args>(args)...};
+            } else {
+                nodes.push_back(T{std::forward<Args>(args)...});
+            }
+            return &nodes[n_used++];
+        }
+
+        void reset() { n_used = 0; }
+
+        [[nodiscard]] size_t size() const { return n_used; }
+
+    private:
+        std::deque<T> nodes; // deque keeps the addresses when it grows
+        size_t n_used = 0;
+    };
+
+    // Closed list of (node id, timestep), a layer of generation stamps per timestep indexed by the node id.
+    // reset() is O(1) by bumping the generation, the layers are allocated when a timestep is reached first.
+    class SpaceTimeClosedList {
+    public:
+        void reset(size_t n_nodes) {
+            if (n_nodes != layer_size) {
+                layers.clear();
+                layer_size = n_nodes;
+            }
+            if (++generation == 0) { // wrap around, the old stamps would be valid again
+                for (auto &layer: layers) std::fill(layer.begin(), layer.end(), 0);
+                generation = 1;
+            }
+        }
+
+        [[nodiscard]] bool contains(int id, int t) const {
+            return static_cast<size_t>(t) < layers.size() and layers[t][id] == generation;
+        }
+
+        void insert(int id, int t) {
+            if (static_cast<size_t>(t) >= layers.size()) {
+                layers.resize(t + 1, std::vector<uint32_t>(layer_size, 0));
+            }
+            layers[t][id] = generation;
+        }
+
+    private:
+        std::vector<std::vector<uint32_t>> layers;
+        size_t layer_size = 0;
+        uint32_t generation = 0;
+    };
+}
@@ -16,6 +16,9 @@ namespace MAPF {
 
         Paths(int num_agents);
 
+        // the paths are aligned to the makespan
+        Paths(std::vector<Path> _paths);
+
         ~Paths() {}
 
         // agent -> path
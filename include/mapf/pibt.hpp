@@ -29,13 +29,22 @@ namespace MAPF {
         };
         using Agents = std::vector<Agent *>;
 
+        // storage of the agents, allocated once per run, the queues and the tables point into it
+        std::vector<Agent> agents;
+
         // <node-id, agent>, whether the node is occupied or not
         // work as reservation table
         Agents occupied_now;
         Agents occupied_next;
 
+        // candidates of chooseNode
+        Nodes candidates;
+
         // option
         bool disable_dist_init = false;
+        int window = -1;  // stop after this timestep with the partial plan, -1: until the goals
+
+        int timestep = 0;  // timestep of the current locations
 
         // result of priority inheritance: true -> valid, false -> invalid
         bool funcPIBT(Agent *ai);
@@ -54,6 +63,9 @@ namespace MAPF {
 
         ~PIBT() {}
 
+        // rolling horizon, the plan is not complete if the goals are farther than the window
+        void setWindow(int _window) { window = _window; }
+
         void setParams(int argc, char *argv[]);
 
         static void printHelp();
@@ -5,6 +5,7 @@
 #pragma once
 #include "solver.hpp"
 
+namespace MAPF {
 class PIBT_COMPLETE : public Solver
 {
 private:
@@ -29,3 +30,4 @@ public:
   void setParams(int argc, char* argv[]);
   static void printHelp();
 };
+}
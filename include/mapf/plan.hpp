@@ -57,7 +57,7 @@ namespace MAPF {
         // check the plan is valid or not
         bool validate(Problem *P) const;
 
-        bool validate(const Config &starts, const Config &goals) const;
+        bool validate(const Config &starts, const Config &goals, Graph *G) const;
 
         // when updating a single path,
         // the path should be longer than this value to avoid conflicts
@@ -0,0 +1,57 @@
+/*
+ * Portfolio of MAPF solvers
+ *
+ * The solvers run concurrently on copies of the problem that share the graph and the distance table.
+ * - first solution mode: the first valid plan is returned, and the other solvers are canceled.
+ * - anytime mode: the solvers run until they finish or reach the deadline, and the plan with the minimum SOC
+ *   is returned.
+ * The solvers are canceled cooperatively through overCompTime, so a solver that stalls
+ * can not delay the portfolio beyond its next check of the time limit.
+ */
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+#include "solver.hpp"
+
+namespace MAPF {
+    class Portfolio : public Solver {
+    public:
+        static const std::string SOLVER_NAME;
+
+        // creates a solver of the problem, the problem outlives the solver
+        using SolverFactory = std::function<std::unique_ptr<Solver>(Problem *)>;
+
+    private:
+        struct Member {
+            std::unique_ptr<Problem> problem;  // copy of P with its own seed
+            std::mt19937 mt;
+            std::unique_ptr<Solver> solver;
+            bool finished = false;
+            bool valid = false;  // finished with a valid plan
+        };
+
+        std::vector<SolverFactory> factories;
+        bool anytime;
+        std::string winner_name;  // the solver of the returned plan
+
+        std::atomic<bool> cancel;
+        std::mutex mtx;
+        std::condition_variable cv;
+
+        void run();
+
+    public:
+        // _anytime: false -> return the first valid plan, true -> return the best plan at the deadline
+        Portfolio(Problem *_P, std::vector<SolverFactory> _factories, bool _anytime = false);
+
+        ~Portfolio() {};
+
+        std::string getWinnerName() const { return winner_name; }
+
+        static void printHelp();
+    };
+}
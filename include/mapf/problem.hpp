@@ -1,8 +1,11 @@
 #pragma once
+#include <array>
+#include <atomic>
 #include <random>
 #include <graph.hpp>
 
 #include "default_params.hpp"
+#include "distance_table_cache.hpp"
 #include "util.hpp"
 
 namespace MAPF {
@@ -30,6 +33,15 @@ namespace MAPF {
         return cost;
     }
 
+    // Time-dependent obstacles of the graph, e.g. the predicted dynamic obstacles.
+    // The timestep is counted from the current configuration, as the g-value of the space-time search.
+    class SpaceTimeObstacles {
+    public:
+        virtual ~SpaceTimeObstacles() = default;
+
+        virtual bool isBlocked(const Pos &pos, int timestep) const = 0;
+    };
+
     class Problem {
     private:
         std::string instance;  // instance name
@@ -43,6 +55,10 @@ namespace MAPF {
         int max_comp_time;     // comp_time limit, ms
 
         const bool instance_initialized;  // for memory manage
+        const bool owns_graph;            // G and MT are deleted with the problem
+        DistanceTableCache *distance_table_cache = nullptr;  // not owned, the solvers run BFS per agent if nullptr
+        const std::atomic<bool> *cancel_flag = nullptr;      // not owned, the solvers stop when it is set
+        const SpaceTimeObstacles *space_time_obstacles = nullptr;  // not owned, no time-dependent obstacle if nullptr
 
         // set starts and goals randomly
         void setRandomStartsGoals();
@@ -50,6 +66,11 @@ namespace MAPF {
         // set well-formed instance
         void setWellFormedInstance();
 
+        // the configurations of the points, which must be nodes of G
+        void setConfigs(const std::vector<std::array<int, 3>> &start_points,
+                        const std::vector<std::array<int, 3>> &current_points,
+                        const std::vector<std::array<int, 3>> &goal_points);
+
         // utilities
         void halt(const std::string &msg) const;
 
@@ -63,7 +84,18 @@ namespace MAPF {
 
         Problem(Problem *P, int _max_comp_time);
 
-        Problem(const std::vector<std::vector<std::vector<int>>> &grid,
+        // connectivity: 6 or 26, see Grid
+        Problem(const GridView &grid,
+                int connectivity,
+                int _num_agents,
+                const std::vector<std::array<int, 3>> &start_points,
+                const std::vector<std::array<int, 3>> &current_points,
+                const std::vector<std::array<int, 3>> &goal_points);
+
+        // Problem over a graph kept by the caller between the problems, e.g. a Grid blocked by setBlocked.
+        // G and MT are not owned, so only the configurations are built.
+        Problem(Graph *_G,
+                std::mt19937 *_MT,
                 int _num_agents,
                 const std::vector<std::array<int, 3>> &start_points,
                 const std::vector<std::array<int, 3>> &current_points,
@@ -92,6 +124,26 @@ namespace MAPF {
 
         void setMaxCompTime(const int t) { max_comp_time = t; }
 
+        // The cache must be updated with the grid of this problem
+        void setDistanceTableCache(DistanceTableCache *cache) { distance_table_cache = cache; }
+
+        DistanceTableCache *getDistanceTableCache() const { return distance_table_cache; }
+
+        // The copied problems share the flag, so that the nested solvers are canceled together
+        void setCancelFlag(const std::atomic<bool> *flag) { cancel_flag = flag; }
+
+        bool isCanceled() const { return cancel_flag != nullptr && cancel_flag->load(std::memory_order_relaxed); }
+
+        // The copied problems share the obstacles, it must not change while the solvers run
+        void setSpaceTimeObstacles(const SpaceTimeObstacles *obstacles) { space_time_obstacles = obstacles; }
+
+        bool isBlocked(const Node *v, int timestep) const {
+            return space_time_obstacles != nullptr && space_time_obstacles->isBlocked(v->pos, timestep);
+        }
+
+        // not owned, used when the solvers of copied problems run concurrently
+        void setMT(std::mt19937 *_MT) { MT = _MT; }
+
         bool isInitializedInstance() const { return instance_initialized; }
 
         // used when making new instance file
@@ -10,6 +10,7 @@
 #pragma once
 #include "solver.hpp"
 
+namespace MAPF {
 class PushAndSwap : public Solver
 {
 public:
@@ -86,3 +87,4 @@ public:
   void setParams(int argc, char* argv[]);
   static void printHelp();
 };
+}
@@ -12,6 +12,7 @@
 #pragma once
 #include "solver.hpp"
 
+namespace MAPF {
 class RevisitPP : public Solver
 {
 public:
@@ -34,3 +35,4 @@ public:
   void setParams(int argc, char* argv[]);
   static void printHelp();
 };
+}
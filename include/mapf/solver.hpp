@@ -11,6 +11,7 @@
 #include "paths.hpp"
 #include "plan.hpp"
 #include "problem.hpp"
+#include "node_pool.hpp"
 #include "util.hpp"
 
 namespace MAPF {
@@ -73,6 +74,21 @@ namespace MAPF {
         using DistanceTable = std::vector<std::vector<int>>;  // [agent][node_id]
         DistanceTable distance_table;     // distance table
         DistanceTable *distance_table_p;  // pointer, used in nested solvers
+        std::vector<DistanceTableCache::Table *> goal_tables;  // [agent], used instead if the problem has a cache
+
+        // -------------------------------
+        // parallelism
+    public:
+        // runs task(0), ..., task(n_tasks - 1) and blocks until all of them are finished
+        using ParallelFor = std::function<void(size_t n_tasks, const std::function<void(size_t)> &task)>;
+
+        // The distance tables are built concurrently, and the solvers may run their searches concurrently.
+        void setParallelFor(ParallelFor _parallel_for) { parallel_for = std::move(_parallel_for); }
+
+    protected:
+        ParallelFor parallel_for;  // serial if empty
+
+        void parallelFor(size_t n_tasks, const std::function<void(size_t)> &task) const;
 
 
         // -------------------------------
@@ -172,10 +188,7 @@ namespace MAPF {
             int g;             // time
             int f;             // f-value
             AstarNode *p;      // parent
-            std::string name;  // name
             AstarNode(Node *_v, int _g, int _f, AstarNode *_p);
-
-            static std::string getName(Node *_v, int _g);
         };
 
         using CompareAstarNode = std::function<bool(AstarNode *, AstarNode *)>;
@@ -186,6 +199,7 @@ namespace MAPF {
 
         /*
          * Template of Space-Time A*.
+         * The nodes and the closed list are thread local pools, reset for each search.
          * See the following reference.
          *
          * Cooperative Pathﬁnding.
@@ -193,7 +207,8 @@ namespace MAPF {
          * AI Game Programming Wisdom 3, pages 99–111, 2006.
          */
         static Path getPathBySpaceTimeAstar
-                (Node *const s,                                 // start
+                (Graph *const G,                                // graph, generates the neighbors
+                 Node *const s,                                 // start
                  Node *const g,                                 // goal
                  AstarHeuristics &fValue,                       // func: f-value
                  CompareAstarNode &compare,                     // func: compare two nodes
@@ -218,16 +233,29 @@ namespace MAPF {
                 true  // manage path table automatically, conflict check
         );
 
+        // whether the path enters a time-dependent obstacle of the problem
+        bool isBlockedPath(const Path &path) const;
+
+        // shortest path avoiding the time-dependent obstacles only, empty if not found
+        Path getSpaceTimeObstacleFreePath(const int id, const int time_limit = -1) const;
+
     protected:
+        using PathTable = std::vector<std::vector<int>>;  // [t][node_id] -> agent
+
         // used for checking conflicts
         void updatePathTable(const Paths &paths, const int id);
 
         void clearPathTable(const Paths &paths);
 
+        // with a path table of the caller, used by the searches running concurrently
+        void updatePathTable(PathTable &path_table, const Paths &paths, const int id) const;
+
+        static void clearPathTable(PathTable &path_table, const Paths &paths);
+
         void updatePathTableWithoutClear(const int id, const Path &p, const Paths &paths);
 
         static constexpr int NIL = -1;
-        std::vector<std::vector<int>> PATH_TABLE;
+        PathTable PATH_TABLE;
 
     public:
         Solver(Problem *_P);
@@ -236,5 +264,7 @@ namespace MAPF {
 
         // other getter
         Problem *getP() { return P; }
+
+        Graph *getG() const { return G; }
     };
 }
\ No newline at end of file
@@ -12,6 +12,7 @@
 #pragma once
 #include "solver.hpp"
 
+namespace MAPF {
 class WHCA : public Solver
 {
 public:
@@ -35,6 +36,13 @@ public:
   WHCA(Problem* _P);
   ~WHCA(){};
 
+  void setWindow(int _window)
+  {
+    window = _window;
+    solver_name = SOLVER_NAME + "-" + std::to_string(window);
+  }
+
   void setParams(int argc, char* argv[]);
   static void printHelp();
 };
+}
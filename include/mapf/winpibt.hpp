@@ -11,6 +11,7 @@
 #pragma once
 #include "solver.hpp"
 
+namespace MAPF {
 class winPIBT : public Solver
 {
 public:
@@ -38,6 +39,13 @@ public:
   winPIBT(Problem* _P);
   ~winPIBT() {}
 
+  void setWindow(int _window)
+  {
+    window = _window;
+    solver_name = SOLVER_NAME + "-" + std::to_string(window);
+  }
+
   void setParams(int argc, char* argv[]);
   static void printHelp();
 };
+}
@@ -0,0 +1,43 @@
+#ifndef LSC_PLANNER_METRICS_PUBLISHER_HPP
+#define LSC_PLANNER_METRICS_PUBLISHER_HPP
+
+#include <metrics_registry.hpp>
+#include <ros/ros.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace DynamicPlanning {
+    // Background thread that exposes the metrics registry at a fixed wall-clock rate, independent of the planning
+    // loop. The metrics are published as diagnostic_msgs/DiagnosticArray on /diagnostics, and written to a file in the
+    // Prometheus text format if the file name is given, e.g. for the textfile collector of node_exporter.
+    class MetricsPublisher {
+    public:
+        // rate: [Hz], file_name: empty for no file
+        MetricsPublisher(const ros::NodeHandle &nh, double rate, std::string file_name);
+
+        ~MetricsPublisher();
+
+        MetricsPublisher(const MetricsPublisher &) = delete;
+
+        MetricsPublisher &operator=(const MetricsPublisher &) = delete;
+
+    private:
+        ros::NodeHandle nh;
+        ros::Publisher pub_diagnostics;
+        std::chrono::duration<double> period;
+        std::string file_name;
+        std::thread worker;
+        std::mutex mtx;
+        std::condition_variable cv;
+        bool stop = false;
+
+        void workerLoop();
+
+        void publish();
+    };
+}
+
+#endif //LSC_PLANNER_METRICS_PUBLISHER_HPP
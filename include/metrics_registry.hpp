@@ -0,0 +1,113 @@
+#ifndef LSC_PLANNER_METRICS_REGISTRY_HPP
+#define LSC_PLANNER_METRICS_REGISTRY_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace DynamicPlanning {
+    // Monotonic count of events, e.g. the QP failures
+    class MetricCounter {
+    public:
+        void increment(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+
+        [[nodiscard]] uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<uint64_t> value{0};
+    };
+
+    // The last value set, e.g. a queue depth
+    class MetricGauge {
+    public:
+        void set(double new_value) { value.store(new_value, std::memory_order_relaxed); }
+
+        [[nodiscard]] double get() const { return value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<double> value{0};
+    };
+
+    // Latency in seconds counted in the fixed buckets of a Prometheus histogram, 10 us to 10 s in powers of two
+    class MetricHistogram {
+    public:
+        static constexpr int N_BOUNDS = 21;
+
+        void record(double seconds);
+
+        // The upper bound of the bucket, the last one is +Inf
+        [[nodiscard]] static double getBound(int bucket_idx);
+
+        [[nodiscard]] uint64_t getBucketCount(int bucket_idx) const {
+            return buckets[bucket_idx].load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] uint64_t getCount() const { return count.load(std::memory_order_relaxed); }
+
+        [[nodiscard]] double getSum() const;
+
+        // The upper bound of the bucket of the percentile in [0, 100], 0 if nothing is recorded
+        [[nodiscard]] double getPercentileBound(double percentile) const;
+
+    private:
+        static constexpr double MIN_BOUND = 1e-5; // [s]
+
+        std::array<std::atomic<uint64_t>, N_BOUNDS + 1> buckets{}; // not cumulative, the last one is above the bounds
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum_ns{0};
+    };
+
+    // Process-wide registry of the metrics for the health monitoring of a long run.
+    // A metric is registered once by its name, and the returned reference stays valid until the process exits, so the
+    // hot path keeps it, e.g. in a function-local static, and updates it by a relaxed atomic operation without a lock.
+    // The readers take a snapshot at their own rate, the values of the metrics are not consistent with each other.
+    class MetricsRegistry {
+    public:
+        static MetricsRegistry &getInstance();
+
+        MetricsRegistry(const MetricsRegistry &) = delete;
+
+        MetricsRegistry &operator=(const MetricsRegistry &) = delete;
+
+        // The name follows Prometheus, e.g. lsc_qp_failures_total. The same name returns the same metric.
+        MetricCounter &getCounter(const std::string &name, const std::string &help);
+
+        MetricGauge &getGauge(const std::string &name, const std::string &help);
+
+        MetricHistogram &getHistogram(const std::string &name, const std::string &help);
+
+        // The text exposition format of Prometheus
+        [[nodiscard]] std::string toPrometheusText() const;
+
+        // The values by name, the histograms as the count, the mean and the bound of the 99th percentile
+        [[nodiscard]] std::vector<std::pair<std::string, std::string>> getKeyValues() const;
+
+    private:
+        template<typename Metric>
+        struct Entry {
+            std::string name;
+            std::string help;
+            Metric metric;
+
+            Entry(std::string _name, std::string _help) : name(std::move(_name)), help(std::move(_help)) {}
+        };
+
+        MetricsRegistry() = default;
+
+        // The deques do not move the metrics when they grow
+        mutable std::mutex mtx;
+        std::deque<Entry<MetricCounter>> counters;
+        std::deque<Entry<MetricGauge>> gauges;
+        std::deque<Entry<MetricHistogram>> histograms;
+
+        template<typename Metric>
+        Metric &getMetric(std::deque<Entry<Metric>> &entries, const std::string &name, const std::string &help);
+    };
+}
+
+#endif //LSC_PLANNER_METRICS_REGISTRY_HPP
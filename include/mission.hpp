@@ -32,12 +32,20 @@ namespace DynamicPlanning {
         std::vector<std::string> world_file_names;
         std::string current_mission_file_name;
         std::string current_world_file_name;
+        uint64_t random_seed = 0; // "random_seed" of the mission file, seed of the obstacle and noise streams
 
         explicit Mission(const ros::NodeHandle &nh);
+        // mission_file_name: a json file or a directory in missions/, world_file_name: a file or a directory in world/
+        Mission(const std::string &mission_file_name, const std::string &world_file_name);
+        // The file is memory-mapped and parsed from the mapping, throws std::invalid_argument if it is invalid
         static Document parseMissionFile(const std::string& file_name);
         bool loadMission(double max_noise, int world_dimension, double world_z_2d = 1.0, int mission_idx = 0);
+        // Same as loadMission, with the document of mission_file_names[mission_idx] parsed in advance
+        bool loadMission(const Document& document, double max_noise, int world_dimension, double world_z_2d,
+                         int mission_idx);
         bool changeMission(const std::string& mission_file_name, double max_noise, int world_dimension, double world_z_2d = 1.0);
         bool readMissionFile(double max_noise, int world_dimension, double world_z_2d);
+        bool readMission(const Document& document, double max_noise, int world_dimension, double world_z_2d);
         void addAgent(const Agent& agent);
         void addObstacle(const std::shared_ptr<ObstacleBase>& obstacle_ptr);
         void addNoise(double max_noise, int dimension);
@@ -0,0 +1,47 @@
+#ifndef LSC_PLANNER_MISSION_PRELOADER_HPP
+#define LSC_PLANNER_MISSION_PRELOADER_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <mission.hpp>
+
+namespace DynamicPlanning {
+    // Parses the mission files of a sweep in a background thread, at most n_ahead files ahead of the mission that
+    // is running, so that the next mission is ready when the current one finishes.
+    class MissionPreloader {
+    public:
+        // n_ahead = 0: parse each file when it is requested, without the thread
+        MissionPreloader(std::vector<std::string> file_names, size_t n_ahead);
+
+        ~MissionPreloader();
+
+        MissionPreloader(const MissionPreloader &) = delete;
+
+        MissionPreloader &operator=(const MissionPreloader &) = delete;
+
+        // The document of the next file in the order of the file names, waits until it is parsed.
+        // nullptr if the file is invalid or all files are taken.
+        std::unique_ptr<Document> next();
+
+    private:
+        std::vector<std::string> file_names;
+        size_t n_ahead;
+        std::thread thread;
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::deque<std::unique_ptr<Document>> documents; // parsed, not taken yet
+        size_t n_parsed = 0, n_taken = 0;
+        bool stop = false;
+
+        void preloadLoop();
+
+        [[nodiscard]] static std::unique_ptr<Document> parse(const std::string &file_name);
+    };
+}
+
+#endif //LSC_PLANNER_MISSION_PRELOADER_HPP
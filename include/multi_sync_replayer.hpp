@@ -1,4 +1,5 @@
 #pragma once
+#include <functional>
 #include <ros/ros.h>
 #include <param.hpp>
 #include <mission.hpp>
@@ -8,6 +9,7 @@
 #include <std_msgs/Float64MultiArray.h>
 #include <util.hpp>
 #include <agent_manager.hpp>
+#include <trajectory_log.hpp>
 
 namespace DynamicPlanning {
     class MultiSyncReplayer {
@@ -16,10 +18,25 @@ namespace DynamicPlanning {
 
         void initializeReplay();
 
+        // Start the playback clock at the beginning of the log
+        void startReplay();
+
+        // Replay the time of the playback clock, multisim/replay_speed times the wall time since the last start or seek
+        void replay();
+
+        // Replay any time of the log, the trajectory history is cut or extended from the previous time
         void replay(double t);
 
+        // Move the playback clock to t, also by a std_msgs/Float64 [s] on /replay_seek
+        void seek(double t);
+
+        // Read a binary log (.lsclog) or a csv file in the log directory
+        void readResultFile(const std::string& file_name);
+
         void readCSVFile(const std::string& file_name);
 
+        void readBinaryFile(const std::string& file_name);
+
         void setOctomap(std::string file_name);
 
     private:
@@ -41,29 +58,44 @@ namespace DynamicPlanning {
         ros::Publisher pub_world_boundary;
         ros::Publisher pub_collision_alert;
         ros::Publisher pub_communication_group;
+        ros::Subscriber sub_seek;
 
         Param param;
         Mission mission;
-        std::shared_ptr<DynamicEDTOctomap> distmap_obj;
+        std::shared_ptr<BatchDistmap> distmap_obj;
         ObstacleGenerator obstacle_generator;
         visualization_msgs::MarkerArray msg_agent_trajectories_replay;
         visualization_msgs::MarkerArray msg_obstacle_trajectories_replay;
-        std::vector<std::vector<State>> agent_state_history;
-        std::vector<std::vector<State>> obstacle_state_history;
+        TrajectoryLogReader trajectory_log; // memory-mapped binary log, or the frames parsed from a csv file
 //        std_msgs::Float64MultiArray safety_margin_to_agents_replay;
 //        std_msgs::Float64MultiArray safety_margin_to_obstacles_replay;
 //        std::vector<std::vector<double>> safety_margin_to_agents_history;
 //        std::vector<std::vector<double>> safety_margin_to_obstacles_history;
 
         double timeStep, makeSpan;
+        ros::Time playback_start_time;
+        double playback_start = 0; // [s], the log time at playback_start_time
+        size_t n_history_frames = 0; // the frames of the log in the trajectory history, before its interpolated head
         std::unique_ptr<AgentManager> fake_agent;
         bool has_global_map = false;
 
         void doReplay(double t);
 
-        void publish_agent_trajectories(double t);
+        // Set the mission from the log
+        void loadTrajectoryLog();
+
+        [[nodiscard]] State getAgentState(size_t frame_idx, size_t qi) const;
+
+        [[nodiscard]] point3d getObstaclePosition(size_t frame_idx, size_t oi) const;
+
+        // Keep the frames [0, frame_idx] of the log in the LINE_STRIP and replace its last point by head
+        void updateTrajectoryHistory(visualization_msgs::Marker &marker, size_t frame_idx,
+                                     const std::function<point3d(size_t)> &position, const point3d &head) const;
+
+        // alpha: the interpolation ratio between the frame and the next frame
+        void publish_agent_trajectories(size_t frame_idx, double alpha);
 
-        void publish_obstacle_trajectories(double t);
+        void publish_obstacle_trajectories(size_t frame_idx, double alpha);
 
         void publish_collision_model();
 
@@ -73,7 +105,7 @@ namespace DynamicPlanning {
 
         void publish_collision_alert();
 
-        void publish_agent_vel_acc(double t);
+        void publish_agent_vel_acc(size_t frame_idx, double alpha, double t);
 
         void publish_communication_group();
 
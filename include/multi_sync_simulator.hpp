@@ -12,10 +12,34 @@
 #include <mission.hpp>
 #include <util.hpp>
 #include <agent_manager.hpp>
+#include <agent_store.hpp>
 #include <obstacle_generator.hpp>
-
+#include <worker_pool.hpp>
+#include <task_graph.hpp>
+#include <batch_qp_solver.hpp>
+#include <sfc_library.hpp>
+#include <neighbor_grid.hpp>
+#include <timer.hpp>
+#include <async_result_writer.hpp>
+#include <replan_scheduler.hpp>
+#include <progress_monitor.hpp>
+#include <sampled_states.hpp>
+#include <trajectory_bundle.hpp>
+#include <trajectory_codec.hpp>
+#include <trajectory_mailbox.hpp>
+#include <communication_network.hpp>
+#include <trace.hpp>
+#include <metrics_publisher.hpp>
+#include <planning_capture.hpp>
+#include <simulation_checkpoint.hpp>
+#include <trajectory_history_markers.hpp>
+#include <summary_log.hpp>
+
+#include <map>
 #include <utility>
 #include <fstream>
+#include <sstream>
+#include <numeric>
 #include <istream>
 
 #include <mapf/pibt.hpp>
@@ -27,7 +51,59 @@ namespace DynamicPlanning {
 
         void run();
 
+        // Replace the parameters of the simulator and the planners, it must be called between the steps.
+        // It returns false without any change if a parameter fixed for the simulator is changed or a planner
+        // rejects the parameters. The structures depending on the changed parameters are rebuilt in place, so the
+        // maps and the distance fields are kept.
+        bool updateParam(const Param &new_param);
+
+        // Replace the mission between the runs, so the next run() simulates it in this process. The agents, the
+        // global map, the grid and distance table caches, the SFC library, the solver models and the thread pools
+        // are kept, and only the state of the mission is initialized again. It returns false without any change if
+        // the world or the number of agents differs, or if the maps are sensed during the mission, then a new
+        // simulator is needed.
+        bool resetMission(Mission new_mission);
+
+        // One iteration of the main loop of run() for a headless simulator driven from outside, e.g. the Python
+        // bindings. It returns false when the mission ends, then the summary is saved, or if the planning fails.
+        // The trace and the capture of run() are not recorded.
+        bool step();
+
+        // The state of the simulation between the steps, see SimulationCheckpoint. It returns false with the reason
+        // logged if the mission can not be checkpointed, e.g. if the maps are sensed.
+        bool saveCheckpoint(SimulationCheckpoint &checkpoint) const;
+
+        // Resume the mission from a checkpoint of the same mission, world and trajectory structure, before the
+        // first step or between the steps. The parameters may differ from the ones at the save, so the simulators
+        // restoring the same checkpoint are the branches of the mission. The statistics start again.
+        bool restoreCheckpoint(const SimulationCheckpoint &checkpoint);
+
+        // All agents reached their goals without a collision, call it after run()
+        [[nodiscard]] bool isMissionSucceeded() const;
+
+        [[nodiscard]] int getSimStep() const { return sim_step; }
+
+        // Updated by step()
+        [[nodiscard]] const AgentStateBuffers &getAgentStateBuffers() const { return agents.getStateBuffers(); }
+
+        // The planning time of the agents and the MAPF recorded so far, with the latency histograms
+        [[nodiscard]] const PlanningTimeStatistics &getPlanningTimeStatistics() const { return planning_time; }
+
     private:
+        static constexpr size_t TRACE_CAPACITY_PER_THREAD = 1 << 18; // the newest events of each thread in the trace
+        static constexpr double ADMM_TOLERANCE = 1e-3; // [m], the ADMM iterations stop if no control point moves more
+
+        // The state drawn at a publishing step, shared by the jobs of the visualization worker and never modified
+        struct VisualizationSnapshot {
+            std::shared_ptr<const Mission> mission;
+            std::shared_ptr<const Param> param;
+            std::vector<State> current_states; // [agent]
+            points_t desired_goal_points, current_goal_points, next_waypoints; // [agent]
+            std::vector<traj_t> desired_trajs; // [agent], empty if the agents land
+            std::vector<std::pair<size_t, size_t>> communication_links; // (qi, qj), qi < qj in communication range
+            bool is_collided = false;
+        };
+
         ros::NodeHandle nh;
         ros::Publisher pub_agent_trajectories;
         ros::Publisher pub_obstacle_trajectories;
@@ -42,7 +118,7 @@ namespace DynamicPlanning {
         ros::Publisher pub_agent_accelerations_z;
         ros::Publisher pub_agent_vel_limits;
         ros::Publisher pub_agent_acc_limits;
-        ros::Publisher pub_world_boundary;
+        ros::Publisher pub_world_boundary; // latched
         ros::Publisher pub_collision_alert;
 //        ros::Publisher pub_desired_trajs_raw;
         ros::Publisher pub_desired_trajs_vis;
@@ -54,56 +130,185 @@ namespace DynamicPlanning {
         ros::ServiceServer service_land;
         ros::ServiceServer service_patrol;
         ros::ServiceServer service_stop_patrol;
+        ros::ServiceServer service_update_param;
 
-        const Param param;
-        Mission mission;
-        std::vector<std::unique_ptr<AgentManager>> agents;
+        Param param;
+        std::shared_ptr<const Mission> mission; // shared by the agents, the obstacles and the snapshots, immutable
+        AgentStore agents;
+        std::unique_ptr<WorkerPool> batch_worker_pool;
+        BatchQPSolver batch_qp_solver;
         std::unique_ptr<GridBasedPlanner> grid_based_planner;
+        std::unique_ptr<ros::Rate> planning_rate; // nullptr if the steps are not paced
+        std::unique_ptr<MetricsPublisher> metrics_publisher; // nullptr if multisim/metrics_rate is 0
+        std::unique_ptr<PlanningCaptureWriter> capture; // nullptr if multisim/capture is false
+        std::unique_ptr<AgentExchange> agent_exchange; // nullptr if multisim/num_processes is 1
+        std::vector<uint8_t> exchange_block; // the agents of this process at the current step
+        std::vector<std::vector<uint8_t>> exchange_blocks; // [process]
         ObstacleGenerator obstacle_generator;
-        visualization_msgs::MarkerArray msg_agent_trajectories;
-        visualization_msgs::MarkerArray msg_obstacle_trajectories;
+        ProgressMonitor progress_monitor; // the stalled communication groups, see deadlock/progress_window
+        // Published by the visualization worker, nullptr if headless
+        std::shared_ptr<TrajectoryHistoryMarkers> agent_trajectory_history;
+        std::shared_ptr<TrajectoryHistoryMarkers> obstacle_trajectory_history;
+        // [topic], the message of the last job, only touched by the visualization worker after the first submit
+        std::map<std::string, std::shared_ptr<visualization_msgs::MarkerArray>> marker_pools;
+        AsyncResultWriter result_writer; // trajectory log of the agents and obstacles, opened at the first save
 
         PlannerState planner_state;
         std::string mission_start_time, file_name_param;
         ros::Time sim_start_time, sim_current_time;
         bool is_collided, has_global_map, initial_update, mission_changed;
+        bool param_update_requested; // the parameters are read again from the server before the next step
+        bool is_finished; // run() ended since all agents are at the goals
+        int n_iterations; // the iterations of the main loop run by step()
         double total_flight_time, total_distance;
+        Timer wall_timer; // wall time since the first step
+        double real_time_factor; // the simulated time over the wall time, computed at the summary
+        PlannerState finish_check_state; // the planner state of finish_check_idx
+        size_t finish_check_idx; // the first agent not at the goal at the last finish check
+        points_t last_sampled_positions; // the positions of the agents at the last sample, for the total distance
         PlanningTimeStatistics planning_time;
+        AllocStatistics alloc_statistics; // per agent per planning cycle, merged over the agents by summarizeResult
+        int n_mapf_skipped = 0; // communication groups skipped by deadline/mapf_budget
+        int n_mapf_reused = 0; // communication groups reusing the rolling plan, see grid/mapf_window
         double safety_ratio_agent, safety_ratio_obs;
         point3d vel_excess_ratio, acc_excess_ratio;
         std::vector<std::set<size_t>> groups; // Communication group
+        NeighborGrid communication_grid; // current positions of the agents, built once per step
+        ReplanScheduler replan_scheduler; // replanning events of the agents with their own replanning periods
+        int sim_step; // the number of planning steps
+        std::vector<size_t> replanning_agents; // the agents replanning at the current step, in ascending order
+        size_t n_replanned, n_held; // the number of agent steps with and without replanning
+        size_t n_hovered; // the held agent steps of the converged agents that were due
+        SampledStates step_states; // the states of the agents at the save time steps of the current step
+        // Quantized trajectory broadcast, empty if communication_quantization_step is 0
+        std::vector<TrajectoryEncoder> trajectory_encoders; // [sender]
+        std::vector<std::unordered_map<size_t, TrajectoryDecoder>> trajectory_decoders; // [receiver][sender]
+        std::vector<std::vector<uint8_t>> key_frames, delta_frames; // [sender], the frames of the current step
+        TrajectoryMailbox trajectory_mailbox; // [agent], the trajectories of the current step
+        TrajectoryMailbox shifted_traj_mailbox; // [agent], the trajectories shifted to the next step
+        traj_t shifted_traj;
+        // Simulated links, nullptr if the messages are exchanged instantly, see Param::isNetworkSimulated
+        std::unique_ptr<CommunicationNetwork> network;
+        struct SentAgent {
+            Obstacle agent; // with the trajectory
+            std::vector<uint8_t> key_frame, delta_frame;
+            uint16_t frame_seq = 0;
+        };
+        // [sender][version % (max delay + 1)], the payloads of the packets in flight, a packet refers to them
+        std::vector<std::vector<SentAgent>> sent_agents;
+        struct ReceivedAgent {
+            size_t sender;
+            uint64_t version;
+            Obstacle agent;
+        };
+        std::vector<std::vector<ReceivedAgent>> received_agents; // [receiver], the newest packet of each neighbor
+        std::vector<Obstacle> obstacle_snapshot; // the dynamic obstacles at the current step
+        std::shared_ptr<const ObstaclePredictionTable> obstacle_prediction_table; // nullptr if no dynamic obstacle
 
         //mapping
-        std::shared_ptr<DynamicEDTOctomap> distmap_ptr;
+        std::shared_ptr<DistanceMap> distmap_ptr;
 
         bool isPlannerReady();
 
         bool plan();
 
+        void scheduleReplanning();
+
+        PlanningReport planSequential();
+
+        PlanningReport planBatch();
+
+        // The QPs prepared by the agents are solved together, see multisim_batch_qp
+        void solveBatchQPs(const std::vector<PlanningReport> &results);
+
+        PlanningReport planParallel();
+
+        // ADMM iterations of the replanning agents on their shared LSCs, see multisim_admm_iterations. The agents
+        // exchange their iterates and prices, then solve again concurrently from the messages of the last iteration.
+        void planConsensus();
+
+        // task(i) for replanning_agents[i] in batch_worker_pool, by multisim/sticky_agents
+        void runAgents(const std::function<void(size_t)> &task);
+
         void publish();
 
         bool isFinished();
 
+        // Empty if the state of the mission is in a checkpoint
+        [[nodiscard]] std::string getCheckpointUnsupportedReason() const;
+
+        // multisim/restore_file before the first step and multisim/checkpoint_step after the step, false if the
+        // restore fails
+        bool restoreCheckpointFile();
+
+        void saveCheckpointFile();
+
+        // The body of the main loop after the planners are ready, false if the loop ends
+        bool runIteration(bool is_last_iteration);
+
+        // Copy the states and the plans of the agents to the store, see AgentStore
+        void syncAgents();
+
         void doStep();
 
+        // doStep, updateCommunicationGrid, predictObstacles and decentralizedMAPP as a task graph, the agents are
+        // not moved at the initial step
+        void runStepGraph(bool move_agents);
+
+        void updateCommunicationGrid();
+
+        void predictObstacles();
+
+        // Update the progress of the groups and mark the agents of the stalled groups, see ProgressMonitor
+        void monitorProgress();
+
         void decentralizedMAPP();
 
         void broadcastMsgs();
 
+        // Send the agents planned by this process and set the agents of the others, the barrier of the step.
+        // False if a process failed to plan or the exchange is lost.
+        bool exchangeAgents(bool has_failed);
+
+        // Decode the frame of the sender into the trajectory received by the receiver, the delta frame if the
+        // receiver has its reference. Returns the bytes of the frame, 0 if not decoded.
+        size_t receiveTrajectory(size_t receiver, size_t sender, traj_t &traj);
+
+        // Send the agents of this step to the receivers in the communication range over the network
+        void sendMsgs(const std::vector<Obstacle> &agent_snapshot, bool use_trajectory_codec);
+
+        // The neighbors and the map deltas of the packets delivered at this step, returns the delivered bytes
+        size_t receiveMsgs(bool use_trajectory_codec);
+
         void summarizeResult();
 
+        void updateMetrics(PlanningReport result);
+
         void initializeSimTime();
 
+        // The state of the mission, called by the constructor and resetMission
+        void initializeMission();
+
+        // Sample the trajectories of the agents once per step for the result and the statistics
+        void sampleStates();
+
+        // Sample the trajectories of all agents at t = k * time_step, k < n_samples, concurrently if possible
+        void sampleTrajectories(double time_step, size_t n_samples, SampledStates &sampled_states) const;
+
         void saveSimulationResult();
 
-        void saveSimulationResultAsCSV();
+        // Safety ratios over the whole step from the certified minimum distances between the trajectories
+        void certifySafetyRatios(const std::vector<Obstacle> &sim_obstacles);
+
+        // The L-infinity range in which a pair can lower the safety ratio or collide, -1: unlimited
+        static double getCollisionRange(double safety_ratio, double radius_sum, double downwash);
+
+        void saveSimulationResultAsLog();
 
         void saveSummarizedResultAsCSV();
 
 //        void saveNormalVectorAsCSV();
 
-        double getTotalDistance();
-
         void globalMapCallback(const sensor_msgs::PointCloud2& pointcloud_map);
 
         bool startPlanningCallback(std_srvs::Empty::Request& req, std_srvs::Empty::Response& res);
@@ -114,26 +319,43 @@ namespace DynamicPlanning {
 
         bool stopPatrolCallback(std_srvs::Empty::Request& req, std_srvs::Empty::Response& res);
 
-        void publishCollisionModel();
+        bool updateParamCallback(std_srvs::Empty::Request& req, std_srvs::Empty::Response& res);
+
+        // Fill the message of the previous job of the topic, the markers are overwritten in place so that their
+        // strings and points keep the capacity
+        typedef void (*MarkerBuilder)(const VisualizationSnapshot &snapshot, visualization_msgs::MarkerArray &msg);
+
+        // Copy the state drawn by the markers, the agents are not read by the visualization worker
+        [[nodiscard]] VisualizationSnapshot makeVisualizationSnapshot() const;
+
+        // Build the markers of the snapshot and publish them in the visualization worker, a pending job of the same
+        // topic is dropped. The message of a topic is reused by the next job, see marker_pools
+        void submitVisualization(const ros::Publisher &pub, const std::shared_ptr<const VisualizationSnapshot> &snapshot,
+                                 MarkerBuilder build);
+
+        // The markers that change only with the mission, published once to the latched topics
+        void publishStaticMarkers();
+
+        static void collisionModelToMsg(const VisualizationSnapshot &snapshot, visualization_msgs::MarkerArray &msg);
 
-        void publishStartGoalPoints();
+        static void startGoalPointsToMsg(const VisualizationSnapshot &snapshot, visualization_msgs::MarkerArray &msg);
 
-        void publishWorldBoundary();
+        static void worldBoundaryToMsg(const VisualizationSnapshot &snapshot, visualization_msgs::MarkerArray &msg);
 
         void publishAgentTrajectories();
 
         void publishObstacleTrajectories();
 
-        void publishCollisionAlert();
+        static void collisionAlertToMsg(const VisualizationSnapshot &snapshot, visualization_msgs::MarkerArray &msg);
 
-        void publishAgentState();
+        void publishAgentState(const std::shared_ptr<const VisualizationSnapshot> &snapshot);
 
-        void publishDesiredTrajs();
+        static void desiredTrajsToMsg(const VisualizationSnapshot &snapshot, visualization_msgs::MarkerArray &msg);
 
 //        void publishGridMap();
 
-        void publishCommunicationRange();
+        static void communicationRangeToMsg(const VisualizationSnapshot &snapshot, visualization_msgs::MarkerArray &msg);
 
-        void publishCommunicationGroup();
+        static void communicationGroupToMsg(const VisualizationSnapshot &snapshot, visualization_msgs::MarkerArray &msg);
     };
 }
\ No newline at end of file
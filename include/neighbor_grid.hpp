@@ -0,0 +1,58 @@
+#ifndef LSC_PLANNER_NEIGHBOR_GRID_HPP
+#define LSC_PLANNER_NEIGHBOR_GRID_HPP
+
+#include <array>
+#include <cstdint>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include <sp_const.hpp>
+#include <geometry_kernels.hpp>
+
+namespace DynamicPlanning {
+    // Uniform spatial hash of points for the neighbor queries within an L-infinity range.
+    // The cell size is the range, so the neighbors of a point are in the 27 cells around it. The points of a cell
+    // are kept in the structure-of-arrays layout, so the distances to a cell are computed by one batch kernel.
+    // A range <= 0 is unlimited: every pair of points is a neighbor.
+    class NeighborGrid {
+    public:
+        void build(const points_t &points, double range);
+
+        [[nodiscard]] size_t size() const { return points.size(); }
+
+        [[nodiscard]] double getRange() const { return range; }
+
+        // Indices j != i in ascending order with LInfinityDistance(points[i], points[j]) < range,
+        // or <= range if inclusive
+        void getNeighbors(size_t i, bool inclusive, std::vector<size_t> &neighbors) const;
+
+        // Indices j in ascending order with LInfinityDistance(point, points[j]) < range, or <= range if inclusive
+        void getNeighbors(const point3d &point, bool inclusive, std::vector<size_t> &neighbors) const;
+
+        // Connected components of the strict neighbors, ordered by the smallest member
+        [[nodiscard]] std::vector<std::set<size_t>> getComponents() const;
+
+    private:
+        points_t points;
+        double range = 0;
+        double cell_size = 0;
+        struct Cell {
+            std::vector<size_t> indices; // ascending order
+            PointsSoA points; // [index in the cell]
+        };
+
+        std::unordered_map<uint64_t, Cell> cells; // cell key
+        std::vector<std::array<int, 3>> point_cells; // [point]
+
+        [[nodiscard]] std::array<int, 3> getCell(const point3d &point) const;
+
+        [[nodiscard]] static uint64_t getCellKey(int i, int j, int k);
+
+        // f(j) for the points j within the range of the point in the 27 cells around its cell in no particular
+        // order, or for all points if the range is unlimited
+        template<typename F>
+        void forEachNeighbor(const point3d &point, const std::array<int, 3> &cell, bool inclusive, F &&f) const;
+    };
+}
+
+#endif //LSC_PLANNER_NEIGHBOR_GRID_HPP
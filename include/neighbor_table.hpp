@@ -0,0 +1,58 @@
+#ifndef LSC_PLANNER_NEIGHBOR_TABLE_HPP
+#define LSC_PLANNER_NEIGHBOR_TABLE_HPP
+
+#include <vector>
+#include <obstacle.hpp>
+
+namespace DynamicPlanning {
+    // The obstacles of a planning step as structure of arrays, [field][obstacle], so that the loops over the
+    // neighbors read only the geometric fields they use. The previous trajectories are kept apart in a pool whose
+    // slots are reused between the steps. Obstacle stays the input of the planner and of the predictions.
+    class NeighborTable {
+    public:
+        // The trajectories owned by the obstacles are moved to the pool, and the obstacles refer to them by
+        // shared_prev_traj, so Obstacle::getPrevTraj is unchanged while the table holds them
+        void assign(std::vector<Obstacle> &obstacles);
+
+        // Keep the obstacles at the ascending indices, in the same order as the compaction of the obstacles
+        void select(const std::vector<size_t> &indices);
+
+        [[nodiscard]] size_t size() const { return ids.size(); }
+
+        [[nodiscard]] int getId(size_t oi) const { return ids[oi]; }
+
+        [[nodiscard]] ObstacleType getType(size_t oi) const { return types[oi]; }
+
+        [[nodiscard]] double getRadius(size_t oi) const { return radii[oi]; }
+
+        [[nodiscard]] double getDownwash(size_t oi) const { return downwashes[oi]; }
+
+        [[nodiscard]] double getMaxAcc(size_t oi) const { return max_accs[oi]; }
+
+        [[nodiscard]] const point3d &getPosition(size_t oi) const { return positions[oi]; }
+
+        [[nodiscard]] const vector3d &getVelocity(size_t oi) const { return velocities[oi]; }
+
+        [[nodiscard]] const point3d &getGoalPoint(size_t oi) const { return goal_points[oi]; }
+
+        [[nodiscard]] const traj_t &getPrevTraj(size_t oi) const { return *prev_trajs[oi]; }
+
+        // The prediction shifted by the sender, nullptr if the receiver predicts it, see Obstacle::shared_shifted_traj
+        [[nodiscard]] const traj_t *getShiftedTraj(size_t oi) const { return shifted_trajs[oi]; }
+
+    private:
+        std::vector<int> ids;
+        std::vector<ObstacleType> types;
+        std::vector<double> radii, downwashes, max_accs;
+        points_t positions, goal_points;
+        std::vector<vector3d> velocities;
+        std::vector<const traj_t *> prev_trajs; // into traj_pool or the mailbox of the trajectories
+        std::vector<const traj_t *> shifted_trajs; // into the mailbox of the predictions, nullptr if not shared
+        std::vector<traj_t> traj_pool; // [slot], not shrunk so that the slots are reused
+
+        template<typename T>
+        static void compact(std::vector<T> &values, const std::vector<size_t> &indices);
+    };
+}
+
+#endif //LSC_PLANNER_NEIGHBOR_TABLE_HPP
@@ -6,8 +6,10 @@
 #include <sp_const.hpp>
 #include <trajectory.hpp>
 #include <polynomial.hpp>
+#include <random_stream.hpp>
 #include <utility>
 #include <random>
+#include <algorithm>
 
 namespace DynamicPlanning {
     struct Obstacle {
@@ -24,6 +26,13 @@ namespace DynamicPlanning {
         bool collision_alert;
         point3d observed_position;
         Trajectory <point3d> prev_traj; //trajectory of obstacles planned at the previous step
+        const traj_t *shared_prev_traj = nullptr; // the trajectory in a TrajectoryMailbox, used instead of prev_traj
+        // shared_prev_traj shifted by one step by the sender, see predictShiftedTraj. nullptr if it is not shared.
+        const traj_t *shared_shifted_traj = nullptr;
+
+        [[nodiscard]] const traj_t &getPrevTraj() const {
+            return shared_prev_traj != nullptr ? *shared_prev_traj : prev_traj;
+        }
     };
 
     class ObstacleBase {
@@ -86,6 +95,20 @@ namespace DynamicPlanning {
                      double _max_acc, double _downwash)
                 : ObstacleBase(_radius, _max_acc, _downwash), axis(std::move(_axis)), start(_start), speed(_speed) {
             type = "spin";
+
+            // The rotation axis, the arm and the angular speed do not change with time
+            axis_position = Eigen::Vector3d(axis.pose.position.x, axis.pose.position.y, axis.pose.position.z);
+            arm = Eigen::Vector3d(start.x, start.y, start.z) - axis_position;
+            axis_direction = Eigen::Vector3d(axis.pose.orientation.x, axis.pose.orientation.y,
+                                             axis.pose.orientation.z).normalized();
+            Eigen::Vector3d r = arm - arm.dot(axis_direction) * axis_direction;
+            double spin_radius = r.norm();
+            angular_speed = speed / spin_radius;
+            velocity_rotation = Eigen::AngleAxisd(M_PI / 2, axis_direction).toRotationMatrix();
+
+            if (max_acc < speed * speed / spin_radius) {
+                ROS_WARN("[Obstacle] max_acc is smaller than real acc!");
+            }
         }
 
         Obstacle getObstacle_impl(double t) override {
@@ -96,40 +119,25 @@ namespace DynamicPlanning {
         geometry_msgs::PoseStamped axis;
         geometry_msgs::Point start;
         double speed;
+        Eigen::Vector3d axis_position, axis_direction, arm; // arm: from the axis position to the start
+        double angular_speed;
+        Eigen::Matrix3d velocity_rotation; // the rotation by pi/2 around the axis
 
         Obstacle getSpinObstacle(double t) {
             Obstacle spinObstacle;
-            Eigen::Vector3d a(start.x - axis.pose.position.x, start.y - axis.pose.position.y,
-                              start.z - axis.pose.position.z);
-            Eigen::Vector3d n(axis.pose.orientation.x, axis.pose.orientation.y, axis.pose.orientation.z);
-            n.normalize();
-            Eigen::Vector3d r = a - a.dot(n) * n;
-            double spin_radius = r.norm();
-            double w = speed / spin_radius;
-            double theta = w * t;
-
-            if (max_acc < speed * speed / spin_radius) {
-                ROS_WARN("[Obstacle] max_acc is smaller than real acc!");
-//                throw(PlanningReport::INVALIDARGS);
-            }
 
-            // position
-            Eigen::Quaterniond q(cos(theta / 2), sin(theta / 2) * n.x(), sin(theta / 2) * n.y(),
-                                 sin(theta / 2) * n.z());
-            Eigen::Quaterniond p(0, a.x(), a.y(), a.z());
-            p = q * p * q.inverse();
-            spinObstacle.position.x() = axis.pose.position.x + p.x();
-            spinObstacle.position.y() = axis.pose.position.y + p.y();
-            spinObstacle.position.z() = axis.pose.position.z + p.z();
+            // position, the arm rotated by theta around the axis
+            double theta = angular_speed * t;
+            Eigen::Vector3d p = Eigen::AngleAxisd(theta, axis_direction) * arm;
+            spinObstacle.position.x() = axis_position.x() + p.x();
+            spinObstacle.position.y() = axis_position.y() + p.y();
+            spinObstacle.position.z() = axis_position.z() + p.z();
 
             // velocity
-            theta = M_PI / 2;
-            Eigen::Quaterniond q_vel(cos(theta / 2), sin(theta / 2) * n.x(), sin(theta / 2) * n.y(),
-                                     sin(theta / 2) * n.z());
-            p = q_vel * p * q_vel.inverse();
-            spinObstacle.velocity.x() = w * p.x();
-            spinObstacle.velocity.y() = w * p.y();
-            spinObstacle.velocity.z() = w * p.z();
+            Eigen::Vector3d v = angular_speed * (velocity_rotation * p);
+            spinObstacle.velocity.x() = v.x();
+            spinObstacle.velocity.y() = v.y();
+            spinObstacle.velocity.z() = v.z();
 
             return spinObstacle;
         }
@@ -220,6 +228,7 @@ namespace DynamicPlanning {
                 : ObstacleBase(_radius, _max_acc, _downwash), waypoints(std::move(_waypoints)), speed(_speed) {
             type = "patrol";
             flight_time.resize(waypoints.size());
+            cumulative_flight_time.resize(waypoints.size());
             straightObstacles.resize(waypoints.size());
             for (size_t i = 0; i < waypoints.size(); i++) {
                 if (i == waypoints.size() - 1) {
@@ -230,6 +239,7 @@ namespace DynamicPlanning {
                                                             radius, speed, max_acc, downwash);
                 }
                 flight_time[i] = straightObstacles[i].getFlightTime();
+                cumulative_flight_time[i] = (i == 0 ? 0 : cumulative_flight_time[i - 1]) + flight_time[i];
             }
         }
 
@@ -240,24 +250,23 @@ namespace DynamicPlanning {
     private:
         std::vector<geometry_msgs::Point> waypoints;
         std::vector<double> flight_time;
+        std::vector<double> cumulative_flight_time; // the end time of each segment in a cycle
         std::vector<StraightObstacle> straightObstacles;
         double speed;
 
         Obstacle getPatrolObstacle(double t) {
             Obstacle patrolObstacle;
 
-            double current_time = t;
-            int current_idx = 0;
-            while (current_time >= flight_time[current_idx]) {
-                current_time -= flight_time[current_idx];
-                if (current_idx == waypoints.size() - 1) {
-                    current_idx = 0;
-                } else {
-                    current_idx++;
-                }
+            // The time in the current cycle, and the first segment that ends after it
+            double cycle_time = cumulative_flight_time.back();
+            double current_time = cycle_time > 0 ? std::fmod(std::max(t, 0.0), cycle_time) : 0;
+            size_t current_idx = std::upper_bound(cumulative_flight_time.begin(), cumulative_flight_time.end(),
+                                                  current_time) - cumulative_flight_time.begin();
+            current_idx = std::min(current_idx, waypoints.size() - 1);
+            if (current_idx > 0) {
+                current_time -= cumulative_flight_time[current_idx - 1];
             }
 
-
             patrolObstacle = straightObstacles[current_idx].getObstacle(current_time);
             return patrolObstacle;
         }
@@ -295,8 +304,30 @@ namespace DynamicPlanning {
             goal_point = _goal_point;
         }
 
+        // The obstacles of the previous step that repulse this obstacle. The states are copied, so the update does not
+        // depend on the order in which the other obstacles are updated.
         void setObstacles(const std::vector<Obstacle> &_obstacles) {
-            obstacles = _obstacles;
+            obstacle_positions.clear();
+            obstacle_radii.clear();
+            for (const auto &obstacle: _obstacles) {
+                obstacle_positions.emplace_back(obstacle.position);
+                obstacle_radii.emplace_back(obstacle.radius);
+            }
+        }
+
+        // Only the obstacles of the indices, the candidates within the repulsion range
+        void setObstacles(const std::vector<Obstacle> &_obstacles, const std::vector<size_t> &indices) {
+            obstacle_positions.clear();
+            obstacle_radii.clear();
+            for (size_t idx: indices) {
+                obstacle_positions.emplace_back(_obstacles[idx].position);
+                obstacle_radii.emplace_back(_obstacles[idx].radius);
+            }
+        }
+
+        // The obstacles farther than this are not repulsive
+        [[nodiscard]] double getRepulsionRange(double obstacle_radius) const {
+            return 2 * (radius + obstacle_radius);
         }
 
         Obstacle getObstacle_impl(double t) override {
@@ -307,7 +338,8 @@ namespace DynamicPlanning {
         Obstacle current_state;
         double t_last_called, max_vel, gamma_target, gamma_obs;
         point3d goal_point;
-        std::vector<Obstacle> obstacles;
+        points_t obstacle_positions;
+        std::vector<double> obstacle_radii;
         int chasing_target_id;
 
         Obstacle getChasingObstacle(double t) {
@@ -322,15 +354,16 @@ namespace DynamicPlanning {
                               current_state.velocity.z());
             double dt = t - t_last_called;
 
-            for (const auto &obstacle: obstacles) {
-                Eigen::Vector3d delta_obstacle(obstacle.position.x() - current_state.position.x(),
-                                               obstacle.position.y() - current_state.position.y(),
-                                               obstacle.position.z() - current_state.position.z());
+            for (size_t oi = 0; oi < obstacle_positions.size(); oi++) {
+                const point3d &obstacle_position = obstacle_positions[oi];
+                Eigen::Vector3d delta_obstacle(obstacle_position.x() - current_state.position.x(),
+                                               obstacle_position.y() - current_state.position.y(),
+                                               obstacle_position.z() - current_state.position.z());
                 double dist_to_obs = delta_obstacle.norm();
                 if (dist_to_obs < SP_EPSILON_FLOAT) {
                     continue;
                 }
-                double Q_star = 2 * (radius + obstacle.radius);
+                double Q_star = getRepulsionRange(obstacle_radii[oi]);
                 if (dist_to_obs < Q_star) {
 //                    a += gamma_obs * (1/Q_star - 1/dist_to_obs) / (1/(dist_to_obs * dist_to_obs)) * delta_obstacle.normalized();
                     a += gamma_obs * (1 - dist_to_obs / Q_star) * (1 / (dist_to_obs * Q_star)) *
@@ -373,10 +406,11 @@ namespace DynamicPlanning {
         GaussianObstacle(point3d _start, double _radius,
                          point3d _initial_vel, double _max_vel,
                          double _stddev_acc, double _max_acc, double _acc_update_cycle,
-                         double _downwash)
+                         double _downwash, const RandomStream &_random_stream)
                 : ObstacleBase(_radius, _max_acc, _downwash),
                   start(_start), initial_vel(_initial_vel), max_vel(_max_vel),
-                  stddev_acc(_stddev_acc), max_acc(_max_acc), acc_update_cycle(_acc_update_cycle)
+                  stddev_acc(_stddev_acc), max_acc(_max_acc), acc_update_cycle(_acc_update_cycle),
+                  random_stream(_random_stream)
         {
             type = "gaussian";
             acc_history_horizon = 0;
@@ -398,20 +432,18 @@ namespace DynamicPlanning {
         double max_vel;
         double stddev_acc, max_acc, acc_update_cycle;
         double acc_history_horizon;
+        RandomStream random_stream; // seeded by the mission and the obstacle index, for the reproducible runs
+        std::vector<double> acc_samples;
 
         void update_acc_history(double desired_horizon) {
             if (acc_history_horizon < desired_horizon) {
-                std::random_device rd;
-                std::mt19937 generator(rd());
-                std::normal_distribution<double> distribution(0.0, stddev_acc);
                 int n = ceil((desired_horizon - acc_history_horizon) / acc_update_cycle);
                 acc_history_horizon += n * acc_update_cycle;
 
+                acc_samples.resize(3 * n);
+                random_stream.fillNormal(0.0, stddev_acc, acc_samples.data(), acc_samples.size());
                 for (int i = 0; i < n; i++) {
-                    Eigen::Vector3d acc;
-                    for (int j = 0; j < 3; j++) {
-                        acc(j) = distribution(generator);
-                    }
+                    Eigen::Vector3d acc(acc_samples[3 * i], acc_samples[3 * i + 1], acc_samples[3 * i + 2]);
                     if (acc.norm() > max_acc) {
                         acc = acc.normalized() * max_acc;
                     }
@@ -474,8 +506,10 @@ namespace DynamicPlanning {
             type = "real";
         }
 
-        RealObstacle(double _radius, double _max_acc, double _downwash)
-            : ObstacleBase(_radius, _max_acc, _downwash)
+        // frame_id: tf frame of the obstacle, ingestion_idx: index of the frame in the ObstacleIngestion
+        RealObstacle(double _radius, double _max_acc, double _downwash, std::string _frame_id, size_t _ingestion_idx)
+            : ObstacleBase(_radius, _max_acc, _downwash), frame_id(std::move(_frame_id)),
+              ingestion_idx(_ingestion_idx)
         {
             type = "real";
         }
@@ -484,9 +518,34 @@ namespace DynamicPlanning {
             return getRealObstacle();
         }
 
+        // The newest filtered state of the obstacle, set by the obstacle generator before the update
+        void setState(const Obstacle &_state) {
+            state = _state;
+            has_state = true;
+        }
+
+        [[nodiscard]] const std::string &getFrameId() const {
+            return frame_id;
+        }
+
+        [[nodiscard]] size_t getIngestionIdx() const {
+            return ingestion_idx;
+        }
+
     private:
+        std::string frame_id;
+        size_t ingestion_idx = 0;
+        Obstacle state;
+        bool has_state = false;
+
         Obstacle getRealObstacle() {
             Obstacle realObstacle;
+            if (has_state) {
+                realObstacle.update_time = state.update_time;
+                realObstacle.position = state.position;
+                realObstacle.velocity = state.velocity;
+                realObstacle.observed_position = state.observed_position;
+            }
             return realObstacle;
         }
     };
@@ -6,6 +6,9 @@
 #include <sp_const.hpp>
 #include <mission.hpp>
 #include <obstacle.hpp>
+#include <neighbor_grid.hpp>
+#include <worker_pool.hpp>
+#include <obstacle_ingestion.hpp>
 #include <random>
 
 
@@ -17,28 +20,43 @@
 namespace DynamicPlanning {
     class ObstacleGenerator {
     public:
-        ObstacleGenerator(const ros::NodeHandle &_nh, const Mission& _mission)
-            : nh(_nh), mission(_mission) {
-            pub_obstacle_collision_model = nh.advertise<visualization_msgs::MarkerArray>("/obstacle_collision_model",
-                                                                                         1);
+        // headless: do not advertise the collision model, publish must not be called
+        ObstacleGenerator(const ros::NodeHandle &_nh, const std::shared_ptr<const Mission> &_mission, bool headless)
+            : nh(_nh), mission(_mission),
+              observer_noise_stream(mission->random_seed, RandomStream::OBSERVER_NOISE, 0) {
+            if (not headless) {
+                pub_obstacle_collision_model = nh.advertise<visualization_msgs::MarkerArray>(
+                        "/obstacle_collision_model", 1);
+            }
             start_time = ros::Time::now();
-            obstacles.resize(mission.on);
+            obstacles.resize(mission->on);
+            for (size_t oi = 0; oi < mission->on; oi++) {
+                has_real_obstacle = has_real_obstacle or mission->obstacles[oi]->getType() == "real";
+            }
         }
 
+        // The snapshot of the obstacles is computed once per time, the queries of the step are served from it
         void update(double t, double observer_stddev){
+            if (has_snapshot and snapshot_time == t and snapshot_observer_stddev == observer_stddev) {
+                return;
+            }
+
             std::vector<point3d> empty_vector;
-            empty_vector.resize(mission.on);
+            empty_vector.resize(mission->on);
             updateObstacles(t, observer_stddev, empty_vector);
 
             //update obstacle msg and add measurement error
             updateObstacles(t, observer_stddev);
+            setSnapshot(t, observer_stddev);
         }
 
+        // The chasing goal points may change at the same time, always computed
         void update(double t, double observer_stddev, const std::vector<point3d>& chasing_goal_points){
             updateObstacles(t, observer_stddev, chasing_goal_points);
 
             //update obstacle msg and add measurement error
             updateObstacles(t, observer_stddev);
+            setSnapshot(t, observer_stddev);
         }
 
         void update(double t, double observer_stddev, const std::vector<Obstacle>& _obstacles){
@@ -46,6 +64,7 @@ namespace DynamicPlanning {
 
             //update obstacle msg and add measurement error
             updateObstacles(t, observer_stddev);
+            has_snapshot = false;
         }
 
         void publish(const std::string& frame_id) {
@@ -53,7 +72,7 @@ namespace DynamicPlanning {
         }
 
         [[nodiscard]] int getNumObs() const {
-            return mission.on;
+            return mission->on;
         }
 
         // get obstacle states which contain measurement error
@@ -61,49 +80,127 @@ namespace DynamicPlanning {
             return obstacles[oi];
         }
 
+        // Next mission, the obstacles of the mission replace the current ones
+        void resetMission(const std::shared_ptr<const Mission> &_mission) {
+            mission = _mission;
+            observer_noise_stream = RandomStream(mission->random_seed, RandomStream::OBSERVER_NOISE, 0);
+            start_time = ros::Time::now();
+            obstacles.assign(mission->on, Obstacle());
+            has_real_obstacle = false;
+            for (size_t oi = 0; oi < mission->on; oi++) {
+                has_real_obstacle = has_real_obstacle or mission->obstacles[oi]->getType() == "real";
+            }
+            has_snapshot = false;
+            obstacle_grid = NeighborGrid();
+        }
+
         void resetStartTime(ros::Time _start_time){
             start_time = _start_time;
+            has_snapshot = false;
+        }
+
+        // The noise of the observations continues from the stream, e.g. of a checkpoint
+        [[nodiscard]] const RandomStream &getObserverNoiseStream() const {
+            return observer_noise_stream;
+        }
+
+        void setObserverNoiseStream(const RandomStream &stream) {
+            observer_noise_stream = stream;
+            has_snapshot = false;
         }
 
     private:
         ros::NodeHandle nh;
         ros::Publisher pub_obstacle_collision_model;
 
-        Mission mission;
+        // Update the obstacles in the shared worker pool if there are at least this many obstacles
+        static constexpr size_t PARALLEL_UPDATE_THRESHOLD = 16;
+
+        std::shared_ptr<const Mission> mission; // shared by all components of all agents
         ros::Time start_time;
         std::vector<Obstacle> obstacles;
+        bool has_real_obstacle = false;
+        bool has_snapshot = false; // obstacles is the snapshot of the obstacles of the mission at snapshot_time
+        double snapshot_time = 0, snapshot_observer_stddev = 0;
+        RandomStream observer_noise_stream;
+        std::vector<double> observer_noise; // [obstacle][axis]
+        NeighborGrid obstacle_grid; // the obstacles of the previous step, for the repulsion of the chasing obstacles
+        points_t obstacle_positions;
+        std::vector<size_t> neighbors;
+
+        void setSnapshot(double t, double observer_stddev) {
+            has_snapshot = true;
+            snapshot_time = t;
+            snapshot_observer_stddev = observer_stddev;
+        }
 
         void updateObstacles(double t, double observer_stddev, const std::vector<point3d>& chasing_points){
             // if obstacle is chasing then update target and other obstacles information
-            for (size_t oi = 0; oi < mission.on; oi++) {
-                if(mission.obstacles[oi]->getType() == "chasing"){
-                    std::shared_ptr<ChasingObstacle> chasing_obstacle_ptr = std::static_pointer_cast<ChasingObstacle>(mission.obstacles[oi]);
-                    chasing_obstacle_ptr->setGoalPoint(chasing_points[oi]);
-                    std::vector<Obstacle> obstacles_prev_step = obstacles;
-                    obstacles_prev_step.erase(obstacles_prev_step.begin() + oi);
-                    chasing_obstacle_ptr->setObstacles(obstacles_prev_step);
+            // Only the obstacles of the previous step within the largest repulsion range, found by the spatial hash
+            bool has_chasing_obstacle = false;
+            double max_radius = 0;
+            obstacle_positions.resize(mission->on);
+            for (size_t oi = 0; oi < mission->on; oi++) {
+                has_chasing_obstacle = has_chasing_obstacle or mission->obstacles[oi]->getType() == "chasing";
+                max_radius = std::max(max_radius, mission->obstacles[oi]->getRadius());
+                obstacle_positions[oi] = obstacles[oi].position;
+            }
+            if (has_chasing_obstacle) {
+                obstacle_grid.build(obstacle_positions, 4 * max_radius);
+                for (size_t oi = 0; oi < mission->on; oi++) {
+                    if(mission->obstacles[oi]->getType() == "chasing"){
+                        std::shared_ptr<ChasingObstacle> chasing_obstacle_ptr =
+                                std::static_pointer_cast<ChasingObstacle>(mission->obstacles[oi]);
+                        chasing_obstacle_ptr->setGoalPoint(chasing_points[oi]);
+                        obstacle_grid.getNeighbors(oi, false, neighbors);
+                        chasing_obstacle_ptr->setObstacles(obstacles, neighbors);
+                    }
                 }
             }
 
-            //update obstacles
-            for(size_t oi = 0; oi < mission.on; oi++){
-                obstacles[oi] = mission.obstacles[oi]->getObstacle(t);
+            // The real obstacles take the newest filtered states of the ingestion thread, without waiting for it
+            if (has_real_obstacle and ObstacleIngestion::getInstance().update()) {
+                const ObstacleIngestion::Snapshot &snapshot = ObstacleIngestion::getInstance().getSnapshot();
+                for (size_t oi = 0; oi < mission->on; oi++) {
+                    if (mission->obstacles[oi]->getType() != "real") {
+                        continue;
+                    }
+                    auto real_obstacle_ptr = std::static_pointer_cast<RealObstacle>(mission->obstacles[oi]);
+                    size_t fi = real_obstacle_ptr->getIngestionIdx();
+                    if (fi < snapshot.obstacles.size() and snapshot.is_observed[fi]) {
+                        real_obstacle_ptr->setState(snapshot.obstacles[fi]);
+                    }
+                }
+            }
+
+            //update obstacles, each obstacle only depends on the states copied above
+            auto task = [this, t](size_t oi) {
+                obstacles[oi] = mission->obstacles[oi]->getObstacle(t);
                 obstacles[oi].id = oi;
+            };
+            if (mission->on >= PARALLEL_UPDATE_THRESHOLD) {
+                WorkerPool::getInstance().run(mission->on, task);
+            } else {
+                for (size_t oi = 0; oi < mission->on; oi++) {
+                    task(oi);
+                }
             }
         }
 
         void updateObstacles(double t, double observer_stddev){
-            obstacles.resize(mission.on);
+            obstacles.resize(mission->on);
 
-            std::random_device rd;
-            std::mt19937 generator(rd());
-            std::normal_distribution<double> distribution(0, observer_stddev);
-            for (size_t oi = 0; oi < mission.on; oi++) {
+            // The noise of all obstacles in one bulk draw, no draw if there is no noise
+            observer_noise.assign(3 * mission->on, 0);
+            if (observer_stddev > 0) {
+                observer_noise_stream.fillNormal(0, observer_stddev, observer_noise.data(), observer_noise.size());
+            }
+            for (size_t oi = 0; oi < mission->on; oi++) {
                 obstacles[oi].start_time = start_time;
                 obstacles[oi] = obstacles[oi];
-                obstacles[oi].observed_position.x() += distribution(generator);
-                obstacles[oi].observed_position.y() += distribution(generator);
-                obstacles[oi].observed_position.z() += distribution(generator);
+                obstacles[oi].observed_position.x() += observer_noise[3 * oi];
+                obstacles[oi].observed_position.y() += observer_noise[3 * oi + 1];
+                obstacles[oi].observed_position.z() += observer_noise[3 * oi + 2];
             }
         }
 
@@ -111,8 +208,8 @@ namespace DynamicPlanning {
             visualization_msgs::MarkerArray msg_obstacle_collision_model;
             msg_obstacle_collision_model.markers.clear();
 
-            for (size_t oi = 0; oi < mission.on; oi++) {
-                if(mission.obstacles[oi]->getType() == "real"){
+            for (size_t oi = 0; oi < mission->on; oi++) {
+                if(mission->obstacles[oi]->getType() == "real"){
                     continue;
                 }
 
@@ -0,0 +1,68 @@
+#ifndef LSC_PLANNER_OBSTACLE_INGESTION_HPP
+#define LSC_PLANNER_OBSTACLE_INGESTION_HPP
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sp_const.hpp>
+#include <obstacle.hpp>
+#include <kalman_filter_bank.hpp>
+#include <triple_buffer.hpp>
+
+namespace DynamicPlanning {
+    // Poses of the real obstacles, e.g. from the motion capture, received and filtered in a dedicated thread.
+    // The thread looks up the tf frames of the obstacles without blocking, runs the Kalman filter bank on the new
+    // measurements and publishes the newest states to a triple buffer, so the planning loop never waits for tf.
+    // There is one ingestion per process, shared by the real obstacles of the mission.
+    class ObstacleIngestion {
+    public:
+        struct Snapshot {
+            std::vector<Obstacle> obstacles; // [frame], filtered, update_time is the time of the measurement
+            std::vector<bool> is_observed; // [frame], false until the first measurement of the frame
+        };
+
+        static ObstacleIngestion &getInstance();
+
+        ObstacleIngestion(const ObstacleIngestion &) = delete;
+
+        ObstacleIngestion &operator=(const ObstacleIngestion &) = delete;
+
+        // Start the thread for the frames, it is restarted if it runs for other frames.
+        // The radii are used for the size of the obstacles in the snapshot.
+        void start(const std::string &world_frame_id, const std::vector<std::string> &frame_ids,
+                   const std::vector<double> &radii, double rate, double sigma_y_sq, double sigma_a_sq);
+
+        void stop();
+
+        // Consumer: take the newest snapshot if there is one, and record the latency from its newest measurement.
+        // It does not block. It must be called from one thread only, the one reading the snapshot.
+        bool update();
+
+        // Consumer: the snapshot taken by the last update, empty before the first one
+        [[nodiscard]] const Snapshot &getSnapshot() const { return snapshot_buffer.getFrontBuffer(); }
+
+        // Consumer: the time from the measurement to the update that took it [s]
+        [[nodiscard]] PlanningTime getLatency() const { return latency; }
+
+    private:
+        ObstacleIngestion() = default;
+
+        ~ObstacleIngestion();
+
+        std::string world_frame_id;
+        std::vector<std::string> frame_ids;
+        std::vector<double> radii;
+        double rate = 0;
+        double sigma_y_sq = 0, sigma_a_sq = 0;
+
+        std::thread thread;
+        std::atomic<bool> is_running{false};
+        TripleBuffer<Snapshot> snapshot_buffer;
+        PlanningTime latency;
+
+        void ingestionLoop();
+    };
+}
+
+#endif //LSC_PLANNER_OBSTACLE_INGESTION_HPP
@@ -0,0 +1,57 @@
+#ifndef LSC_PLANNER_OBSTACLE_PREDICTION_HPP
+#define LSC_PLANNER_OBSTACLE_PREDICTION_HPP
+
+#include <unordered_map>
+#include <vector>
+#include <param.hpp>
+#include <trajectory.hpp>
+#include <obstacle.hpp>
+
+namespace DynamicPlanning {
+    // Constant velocity prediction of the obstacle, at the current position if use_velocity is false
+    void predictObstacleTraj(const Param &param, const Obstacle &obstacle, bool use_velocity, traj_t &obs_pred_traj);
+
+    // Predict the obstacle size using the constant acceleration model if grow_size is true. The size grows by
+    // max_acc * t^2 / 2 until the uncertainty horizon and remains the same after it.
+    void predictObstacleSize(const Param &param, const Obstacle &obstacle, double velocity_guard, bool grow_size,
+                             Trajectory<double> &obs_pred_size);
+
+    // The previous trajectory of an agent shifted by one simulation step, its prediction at the next step. The
+    // segments move up by one if multisim_time_step == dt and the last one is held at its end point, otherwise only
+    // the first segment is cut at multisim_time_step.
+    void predictShiftedTraj(const Param &param, const traj_t &prev_traj, traj_t &pred_traj);
+
+    // Predictions of the dynamic obstacles at one simulation step, shared by all agents.
+    // Every agent receives the same states of the dynamic obstacles, so the predicted trajectories and the sizes
+    // without the velocity guard are computed once here instead of once per agent. An agent reads the prediction
+    // of its obstacle by the obstacle id, and predicts the obstacle itself if its state differs from the table.
+    class ObstaclePredictionTable {
+    public:
+        // Predict the dynamic obstacles in the list, the other types are skipped
+        void update(const Param &param, const std::vector<Obstacle> &obstacles);
+
+        // nullptr if the obstacle is not in the table or its state is not the one predicted
+        [[nodiscard]] const traj_t *findTraj(const Obstacle &obstacle) const;
+
+        [[nodiscard]] const Trajectory<double> *findSize(const Obstacle &obstacle) const;
+
+        // The predicted obstacles in the order of the list given to update
+        [[nodiscard]] size_t size() const { return states.size(); }
+
+        [[nodiscard]] const Obstacle &getState(size_t idx) const { return states[idx]; }
+
+        [[nodiscard]] const traj_t &getTraj(size_t idx) const { return obs_pred_trajs[idx]; }
+
+        [[nodiscard]] const Trajectory<double> &getSize(size_t idx) const { return obs_pred_sizes[idx]; }
+
+    private:
+        std::vector<Obstacle> states;
+        std::vector<traj_t> obs_pred_trajs;
+        std::vector<Trajectory<double>> obs_pred_sizes;
+        std::unordered_map<int, size_t> indices; // key: obstacle id
+
+        [[nodiscard]] bool findIndex(const Obstacle &obstacle, size_t &idx) const;
+    };
+}
+
+#endif //LSC_PLANNER_OBSTACLE_PREDICTION_HPP
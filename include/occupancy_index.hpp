@@ -0,0 +1,70 @@
+#ifndef LSC_PLANNER_OCCUPANCY_INDEX_HPP
+#define LSC_PLANNER_OCCUPANCY_INDEX_HPP
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <octomap/OcTree.h>
+
+namespace DynamicPlanning {
+    // Occupied leaf of an octree, a pruned leaf covers several voxels
+    struct OccupiedLeaf {
+        octomap::point3d center;
+        double size; // [m]
+    };
+
+    // The occupied leaves of the octree in the order of the leaf iterator. The pruned nodes are not expanded, and
+    // the subtrees are traversed on the worker pool.
+    void collectOccupiedLeaves(const octomap::OcTree &octree, std::vector<OccupiedLeaf> &leaves);
+
+    // Summed-volume table of the occupied voxels of an octomap.
+    // The number of occupied voxels in a box is obtained in O(1) by inclusion-exclusion of 8 entries.
+    class OccupancyIndex {
+    public:
+        OccupancyIndex(const octomap::point3d &world_min, const octomap::point3d &world_max, double resolution);
+
+        // Rebuild the whole table from the octree
+        void build(const octomap::OcTree &octree);
+
+        // Rebuild the whole table from the occupied leaves, the voxels of the leaves are marked in parallel
+        void build(const std::vector<OccupiedLeaf> &leaves);
+
+        [[nodiscard]] size_t getMemoryUsage() const;
+
+        // Refresh the voxels in the region, the table is recomputed only from the region onward
+        void update(const octomap::OcTree &octree,
+                    const octomap::point3d &region_min,
+                    const octomap::point3d &region_max);
+
+        // The number of occupied voxels whose center is in [box_min, box_max]
+        [[nodiscard]] uint32_t countOccupied(const octomap::point3d &box_min, const octomap::point3d &box_max) const;
+
+        // Is there any occupied voxel whose center is in [box_min - margin, box_max + margin]?
+        [[nodiscard]] bool isOccupied(const octomap::point3d &box_min, const octomap::point3d &box_max,
+                                      double margin) const;
+
+    private:
+        octomap::point3d origin; // minimum corner of the voxel (0, 0, 0), aligned with the octomap grid
+        double resolution;
+        std::array<int, 3> size; // the number of voxels along each axis
+
+        std::vector<uint8_t> occupancy;
+        // table[(i, j, k)] = the number of occupied voxels in [0, i) x [0, j) x [0, k), modulo 2^32.
+        // Unsigned overflow wraps around, so the box counts are exact as long as they fit in 32 bits.
+        std::vector<uint32_t> table;
+
+        [[nodiscard]] size_t voxelIndex(int i, int j, int k) const;
+
+        [[nodiscard]] size_t tableIndex(int i, int j, int k) const;
+
+        // Range of the voxels whose center is in [lower, upper] along the axis, returns false if empty
+        [[nodiscard]] bool voxelRange(int axis, double lower, double upper, int &start, int &end) const;
+
+        void updateOccupancy(const octomap::OcTree &octree, const std::array<int, 3> &start,
+                             const std::array<int, 3> &end);
+
+        void updateTable(const std::array<int, 3> &start);
+    };
+}
+
+#endif //LSC_PLANNER_OCCUPANCY_INDEX_HPP
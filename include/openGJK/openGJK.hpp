@@ -47,8 +47,10 @@ struct simplex {
 
 /**
  * @brief The GJK algorithm which returns the minimum distance between
- * two bodies.
+ * two bodies. The bodies are not copied, their support points are updated.
+ * v is the closest point of the Minkowski difference bd1 - bd2. If v_init is
+ * given, e.g. v of a previous query, the search starts from that direction.
  */
-extern double gjk(struct bd, struct bd, struct simplex *, double *);
+extern double gjk(struct bd *, struct bd *, struct simplex *, double *, const double *v_init = nullptr);
 
 #endif
\ No newline at end of file
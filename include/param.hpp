@@ -2,13 +2,17 @@
 #include <ros/ros.h>
 #include <ros/package.h>
 #include <sp_const.hpp>
+#include <cpu_topology.hpp>
+#include <agent_exchange.hpp>
 #include <string>
+#include <vector>
 
 namespace DynamicPlanning{
     class Param {
     public:
         bool log_solver;
         bool log_vis;
+        bool log_qp_failure; // diagnose failed QPs in the background and save them to log/qp_failure
         std::string package_path;
 
         // World
@@ -19,6 +23,21 @@ namespace DynamicPlanning{
         double world_z_2d;
         bool world_use_global_map;
         double world_max_dist;
+        bool world_occupancy_index; // use a summed-volume table of the octomap for the SFC collision check
+        bool world_sfc_library; // reuse the SFC boxes expanded by all agents in the process
+        int world_sfc_library_size; // the maximum number of cached SFC boxes, 0: unbounded
+        bool world_sfc_parallel_candidates; // expand the SFC from several initial boxes and axis orders concurrently
+        bool world_swept_clearance_check; // validate the solution by the clearance of the swept agent to the distmap
+        bool world_distmap_cache; // load the distance field of the global map from <world file>.edt, save it if stale
+        bool world_analytic; // query the boxes and the cylinders of a csv world exactly instead of its voxels
+        // [m], the local map covers a window of this size around the agent instead of the world, 0: the whole world.
+        // The occupancy index is not used with the window.
+        double world_rolling_window_size;
+        // store the distance field of the local map in sparse 8^3 voxel blocks instead of a world-sized grid,
+        // unused with the rolling window
+        bool world_sparse_distmap;
+        // merge the peer maps on a background thread during the planning, the merged voxels are used from the next step
+        bool world_async_map_merge;
 
         // Multisim setting
         bool multisim_patrol;
@@ -26,15 +45,53 @@ namespace DynamicPlanning{
 
         double multisim_time_step;
         int multisim_planning_rate;
+        bool multisim_fast_forward; // run the steps as fast as possible, multisim_planning_rate is ignored
+        int multisim_publish_period; // publish the visualization every multisim_publish_period steps
+        int multisim_history_downsample; // keep every n-th point of the trajectory history older than a marker chunk
+        double multisim_visualization_rate; // [Hz], the max rate of each topic of the visualization worker, 0: no limit
         double multisim_max_noise;
         int multisim_max_planner_iteration;
 
         bool multisim_save_result;
+        bool multisim_save_binary; // save the result as a binary trajectory log instead of csv
         bool multisim_save_mission;
         double multisim_save_time_step;
+        bool multisim_continuous_collision_check; // certify the safety ratios between the samples of the step
+        bool multisim_offline_metrics; // only alert the collisions, the statistics come from trajectory_log_metrics
         bool multisim_replay;
         std::string multisim_replay_file_name;
         double multisim_replay_time_limit;
+        double multisim_replay_speed; // the log time per wall time of the replay
+        bool multisim_batch_optimization; // solve the QPs of all agents in a worker pool at each step
+        int multisim_batch_workers; // the number of workers for the batched optimization, 0: the number of cores
+        bool multisim_batch_qp; // solve the QPs of the batched optimization together by BatchQPSolver, then the unsolved ones by the QP solver
+        bool multisim_parallel_planning; // run the whole planning of all agents in a worker pool at each step
+        bool multisim_parallel_mapf; // solve the MAPF of the communication groups concurrently in the worker pool
+        bool multisim_pipelined_step; // overlap the map updates, the obstacle prediction and the MAPF of a step
+        ThreadPlacementMode multisim_thread_placement; // the CPUs of the workers, see CPUTopology
+        bool multisim_sticky_agents; // plan an agent on the same worker at every step, for the cache locality
+        int multisim_admm_iterations; // consensus iterations of the replanning agents on their shared LSCs per step, 0: off
+        double multisim_admm_rho; // [m], the step of the LSC margin offsets per the price difference of a pair
+        bool multisim_headless; // run without publishers, services and the trajectory markers, always save the summary
+        bool multisim_lazy_publishers; // advertise the topics of the agents when a node subscribes to them
+        int multisim_shard_index; // run only the missions with index % multisim_num_shards == multisim_shard_index
+        int multisim_num_shards; // the number of processes that share the missions
+        int multisim_num_processes; // the number of processes that plan the agents of a mission together
+        int multisim_process_index; // plan only the agents with index % multisim_num_processes == this
+        AgentExchangeMode multisim_exchange_mode; // the transport of the agents between the processes
+        std::string multisim_exchange_address; // the shared memory name, or host:port of the process 0 for socket
+        int multisim_preload_missions; // the batch node parses this many next mission files in the background
+        std::vector<double> multisim_latency_percentiles; // the percentiles of the planning time in the summary
+        bool multisim_trace; // save the Chrome trace of the planning pipeline in log/, needs the ENABLE_TRACE build
+        double multisim_metrics_rate; // [Hz], publish the planner metrics on /diagnostics, 0: off
+        std::string multisim_metrics_file; // also write the metrics in the Prometheus text format here if not empty
+        bool multisim_capture; // save the inputs of the planners in log/ for planning_replay
+        std::string multisim_capture_file; // the capture file if not empty, otherwise log/capture_<mode>_<time>.bin
+        int multisim_recorder_size; // the last planning records kept by each agent, dumped to log/ on a spike, 0: off
+        double multisim_recorder_threshold; // [s], dump the records after a cycle slower than this, 0: failures only
+        int multisim_checkpoint_step; // save the state of the simulation in log/ after this step, -1: off
+        std::string multisim_restore_file; // start the mission from this checkpoint if not empty
+        int multisim_batch_tenants; // the batch node runs this many missions at the same time in one process
 
         // Planner mode
         PlannerMode planner_mode;
@@ -43,6 +100,9 @@ namespace DynamicPlanning{
         SlackMode slack_mode;
         GoalMode goal_mode;
         MAPFMode mapf_mode;
+        std::vector<MAPFMode> mapf_portfolio_modes; // the solvers of the MAPF portfolio
+        bool mapf_portfolio_anytime; // true: the best plan at the deadline, false: the first valid plan
+        QPSolverMode qp_solver_mode;
 
         // Obstacle prediction
         bool obs_size_prediction;
@@ -63,15 +123,35 @@ namespace DynamicPlanning{
         double terminal_weight;
         double slack_collision_weight;
         double slack_dynamic_weight;
+        bool opt_persistent_model; // reuse the QP model between replanning steps
+        bool opt_sparse_assembly; // build the QP model from sparse matrices
+        bool opt_condensed_qp; // eliminate the equality rows of the sparse QP by the null space of the continuity
+        bool opt_axis_decoupled_qp; // solve the axes as independent QPs if no collision constraint couples them
+        bool opt_record_qp; // save QP problems for the solver benchmark
+        bool opt_warm_start; // start the solver from the time-shifted previous solution
+        bool opt_goal_analytic; // solve the goal LP in closed form instead of the solver
+        bool opt_prune_constraints; // leave out LSCs that are inactive for every reachable trajectory
+        bool opt_reduce_constraints; // leave out LSCs implied by the SFC or the other LSCs
+        bool opt_reduce_constraints_lp; // also check the redundancy of LSCs by a small LP per control point
+        int opt_solver_threads; // the number of solver threads shared by all agents, 0: the number of cores
+        bool opt_soft_collision; // relax the LSCs of all obstacles by slack variables with an exact penalty
+        double opt_soft_collision_weight; // L1 penalty of the slack, larger than the multipliers of the hard LSCs
+
+        // Deadline, see PlanningDeadline for the degraded mode of each stage
+        double deadline_budget; // [s], the time budget of the planning of an agent per cycle, 0: unbounded
+        double deadline_mapf_budget; // [s], the time budget of the MAPF of all groups per step, 0: unbounded
 
         // Deadlock
         double deadlock_velocity_threshold;
         int deadlock_seq_threshold;
+        int deadlock_progress_window; // the steps of the progress rate of the communication groups, 0: off
+        double deadlock_progress_rate_threshold; // [m/s], a group approaching the goals slower than this is stalled
 
         // Filter
         double filter_sigma_y_sq;
         double filter_sigma_v_sq;
         double filter_sigma_a_sq;
+        double filter_ingestion_rate; // [Hz], the rate of the tf lookups of the real obstacles
 
         // ORCA
         double orca_horizon;
@@ -81,6 +161,15 @@ namespace DynamicPlanning{
         // Grid-based planner
         double grid_resolution;
         double grid_margin;
+        int grid_connectivity; // 6 or 26, the MAPF graph is 4- or 8-connected in 2D
+        int grid_distance_table_capacity; // the number of cached MAPF distance tables, 0 to disable the cache
+        int grid_mapf_time_limit; // [ms], the MAPF solvers stop at this time limit
+        bool grid_mapf_parallel; // run the independent searches of the MAPF solvers in the shared worker pool
+        int grid_mapf_window; // rolling horizon of the MAPF, a plan of this many steps is reused while valid, 0: full plans
+        int grid_mapf_refine_time_limit; // [ms], anytime MAPF: a PIBT plan is refined in the background, 0: disabled
+        int grid_mapf_cluster_size; // hierarchical MAPF: cells per axis of a cluster, the MAPF only covers the corridor of the agents, 0: disabled
+        int grid_ecbs_batch_size; // the number of ECBS focal nodes expanded at once
+        double grid_space_time_step; // [s], the time of a MAPF timestep for the dynamic obstacles, 0 to ignore them
 
         // Goal
         double goal_threshold;
@@ -94,26 +183,71 @@ namespace DynamicPlanning{
         double collision_alert_threshold;
         double density_alert_threshold;
         double closest_agent_threshold;
+        int parallel_lsc_threshold; // generate LSCs in the shared worker pool if #obstacles >= this, 0: serial
+        double lsc_cache_tolerance; // [m], reuse the normal vector if the relative control points move less, 0: off
+        double lsc_lod_near_range; // [m], one half-space over the horizon for the agents farther than this, 0: off
+        double lsc_lod_far_range; // [m], one half-space for each group of the agents farther than this, 0: off
+        bool neighbor_pruning; // leave out the obstacles that can not reach the agent within the horizon
+        int max_neighbors; // keep the obstacles closest to contact if more remain, 0: unbounded
+        bool adaptive_horizon; // plan fewer segments than M in open space, the rest is held at the last point
+        int adaptive_horizon_min_M; // the segments planned without neighbors away from the goal
+        int adaptive_horizon_neighbors; // the dynamic obstacles at which all M segments are planned, or any agent
+        bool hover_mode; // skip replanning of the converged agents while no obstacle can reach them
+        double hover_tolerance; // [m], the control points of a hovering trajectory are within this of its start
+        bool fallback_planner; // replace the trajectory of a failed QP by the best feasible sampled trajectory
+        double fallback_budget; // [s], the time to check the sampled trajectories, 0: unbounded
 
         // SFC
         double numerical_error_threshold;
 
         // Communication
         double communication_range;
+        double communication_quantization_step; // [m], send the trajectories in the quantized wire format, 0: off
+        // Simulated links, the messages are exchanged instantly if all of them are 0
+        double communication_latency; // [s]
+        double communication_latency_jitter; // [s], uniform in [0, jitter] added to the latency
+        double communication_bandwidth; // [bytes/s], the uplink of each agent, 0: unlimited
+        double communication_packet_loss; // the probability to drop a packet
+        double communication_timeout; // [s], a neighbor is forgotten if no packet of it is delivered for this time
+        bool communication_map_delta_compression; // send the map deltas in the encoding of MapDeltaCodec
 
         // Exploration
         double sensor_range;
+        SensorMode sensor_mode;
+        double sensor_horizontal_fov; // [deg], >= 360: omnidirectional, the sensor faces the moving direction
+        double sensor_vertical_fov; // [deg]
+        double sensor_angular_resolution; // [deg], the angle between the adjacent beams
 
         // Debug
         int debug_planner_seq;
 
 
         bool initialize(const ros::NodeHandle &nh);
+        // validate the shard and the headless setting, call it again after changing them
+        [[nodiscard]] bool validateMultisim();
+        [[nodiscard]] bool isMissionInShard(size_t mission_idx) const;
+        // the agent is planned by this process of the distributed simulation
+        [[nodiscard]] bool isAgentInProcess(size_t agent_idx) const;
+        // the messages of the simulator go through CommunicationNetwork
+        [[nodiscard]] bool isNetworkSimulated() const;
+        // the trajectory representation differs, the planners rebuild their basis and matrices
+        [[nodiscard]] bool isTrajectoryStructureChanged(const Param &other) const;
+        // the parameters fixed for the lifetime of a simulator differ, e.g. the world, the agents or the threads
+        [[nodiscard]] bool isRestartRequired(const Param &other) const;
         [[nodiscard]] std::string getPlannerModeStr() const;
         [[nodiscard]] std::string getPredictionModeStr() const;
         [[nodiscard]] std::string getInitialTrajModeStr() const;
         [[nodiscard]] std::string getSlackModeStr() const;
         [[nodiscard]] std::string getGoalModeStr() const;
         [[nodiscard]] std::string getMAPFModeStr() const;
+        [[nodiscard]] static std::string getMAPFModeStr(MAPFMode mode);
+        [[nodiscard]] std::string getQPSolverModeStr() const;
+        [[nodiscard]] std::string getSensorModeStr() const;
+
+        [[nodiscard]] std::string getThreadPlacementModeStr() const;
+        [[nodiscard]] std::string getExchangeModeStr() const;
+
+    private:
+        static bool getMAPFMode(const std::string &mapf_mode_str, MAPFMode &mode);
     };
 }
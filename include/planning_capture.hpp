@@ -0,0 +1,143 @@
+#ifndef LSC_PLANNER_PLANNING_CAPTURE_HPP
+#define LSC_PLANNER_PLANNING_CAPTURE_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sp_const.hpp>
+#include <param.hpp>
+#include <mission.hpp>
+#include <obstacle.hpp>
+
+namespace DynamicPlanning {
+    // Binary corpus of the planning problems of a simulation, replayed offline by planning_replay.
+    // The file is a header followed by the records in the order the planners finished them:
+    //   header: MAGIC, VERSION, the mission and the world file names, the parameters
+    //   record: type, then the parameters (PARAM), or the sim time, the disturbance flag, the agent, the obstacles with
+    //           their previous trajectories, the output trajectory, the planning time and the stage times (PLAN, HOLD)
+    // The map is referred to by the world file of the mission. The records of an agent are in its planning order, so
+    // a replay of them in order rebuilds the state of its planner.
+    namespace PlanningCapture {
+        enum class RecordType : uint8_t {
+            PARAM, // the parameters were updated between the planning steps, for all agents
+            PLAN, // TrajPlanner::planBeforeOptimization + planOptimization
+            HOLD, // TrajPlanner::planHold
+        };
+
+        extern const char MAGIC[8];
+        constexpr uint32_t VERSION = 33; // incremented when the records or the fields of Param are changed
+
+        // [s], the stages of a PLAN record during the capture, 0 for HOLD
+        struct StageTimes {
+            double initial_traj_planning = 0;
+            double obstacle_prediction = 0;
+            double goal_planning = 0;
+            double lsc_generation = 0;
+            double sfc_generation = 0;
+            double traj_optimization = 0;
+        };
+
+        struct Record {
+            RecordType type = RecordType::PLAN;
+            Param param; // PARAM only
+            ros::Time sim_time;
+            bool is_disturbed = false;
+            Agent agent;
+            std::vector<Obstacle> obstacles;
+            traj_t traj; // the output of the planner during the capture
+            double planning_time = 0; // [s], the total planning time during the capture, 0 for HOLD
+            StageTimes stage_times;
+        };
+    }
+
+    // The records are appended by the agents concurrently, each of them is written under a lock
+    class PlanningCaptureWriter {
+    public:
+        PlanningCaptureWriter() = default;
+
+        PlanningCaptureWriter(const PlanningCaptureWriter &) = delete;
+
+        PlanningCaptureWriter &operator=(const PlanningCaptureWriter &) = delete;
+
+        // Create the file and write the header, false if the file can not be created
+        bool open(const std::string &file_name, const Mission &mission, const Param &param);
+
+        void close();
+
+        [[nodiscard]] bool isOpen() const { return out.is_open(); }
+
+        void writeParam(const Param &param);
+
+        // The times of the cycle are the current times of planning_time
+        void writePlan(const ros::Time &sim_time, bool is_disturbed, const Agent &agent,
+                       const std::vector<Obstacle> &obstacles, const traj_t &traj,
+                       const PlanningTimeStatistics &planning_time);
+
+        // The sim time of a HOLD record is zero, the held trajectory does not depend on it
+        void writeHold(const Agent &agent, const std::vector<Obstacle> &obstacles, const traj_t &traj);
+
+        [[nodiscard]] size_t getNumRecords() const;
+
+    private:
+        mutable std::mutex mtx;
+        std::ofstream out;
+        size_t n_records = 0;
+    };
+
+    // Flight recorder of an agent, the last records of its planner in memory, see multisim/recorder_size.
+    // The records are serialized as in the capture into the buffers of a ring, which are reused, so a cycle costs a
+    // copy of its inputs. dump writes the ring as a capture, oldest first, which planning_replay replays like any
+    // other capture. The planner of the replay starts at the oldest record, so the first records warm it up.
+    class PlanningFlightRecorder {
+    public:
+        // capacity 0 disables the recorder
+        void initialize(size_t capacity);
+
+        [[nodiscard]] bool isEnabled() const { return not records.empty(); }
+
+        void recordPlan(const ros::Time &sim_time, bool is_disturbed, const Agent &agent,
+                        const std::vector<Obstacle> &obstacles, const traj_t &traj,
+                        const PlanningTimeStatistics &planning_time);
+
+        void recordHold(const Agent &agent, const std::vector<Obstacle> &obstacles, const traj_t &traj);
+
+        // The records since the last dump fill the ring, so the consecutive slow cycles give one dump per ring
+        [[nodiscard]] bool canDump() const { return n_records_since_dump >= records.size(); }
+
+        // Write the ring to the file with the header of the mission and the parameters, false if it fails
+        bool dump(const std::string &file_name, const Mission &mission, const Param &param);
+
+    private:
+        std::vector<std::vector<char>> records; // [record index % capacity], serialized records
+        size_t n_records = 0;
+        size_t n_records_since_dump = 0;
+
+        std::vector<char> &nextRecord();
+    };
+
+    class PlanningCaptureReader {
+    public:
+        // Read the header, false if the file is not a capture of this version
+        bool open(const std::string &file_name);
+
+        // The next record, false at the end of the file or if the record is truncated
+        bool readRecord(PlanningCapture::Record &record);
+
+        [[nodiscard]] const std::string &getMissionFileName() const { return mission_file_name; }
+
+        [[nodiscard]] const std::string &getWorldFileName() const { return world_file_name; }
+
+        // The parameters at the start of the capture
+        [[nodiscard]] const Param &getParam() const { return param; }
+
+    private:
+        std::ifstream in;
+        std::string mission_file_name; // the absolute path of the mission saved with the capture
+        std::string world_file_name; // the absolute path of the world file
+        Param param;
+    };
+}
+
+#endif //LSC_PLANNER_PLANNING_CAPTURE_HPP
@@ -0,0 +1,58 @@
+#ifndef LSC_PLANNER_PLANNING_DEADLINE_HPP
+#define LSC_PLANNER_PLANNING_DEADLINE_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+namespace DynamicPlanning {
+    // Time budget of a planning cycle from its start. The stages check it when they start, and run their degraded
+    // mode instead if their share of the budget is spent:
+    //   SFC: the previous SFCs are shifted and the last one is reused instead of the expansion
+    //   MAPF: the groups after the budget are skipped and keep their next_waypoint, the others get the rest as the
+    //         time limit of the solver
+    //   QP: the solver gets the rest as its time limit, the incumbent at the limit is used if it is valid, otherwise
+    //       the shifted previous trajectory
+    class PlanningDeadline {
+    public:
+        static constexpr double SFC_SHARE = 0.5; // the SFCs are expanded only before this share of the budget
+        static constexpr double MIN_QP_TIME = 1e-3; // [s], the QP is not started with less time than this
+
+        // Unbounded
+        PlanningDeadline() = default;
+
+        // budget <= 0: unbounded. elapsed: the time already spent in the cycle, e.g. before a wait for the batch.
+        explicit PlanningDeadline(double _budget, double _elapsed = 0)
+                : budget(_budget > 0 ? _budget : 0),
+                  start(std::chrono::steady_clock::now() -
+                        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                std::chrono::duration<double>(_elapsed))) {}
+
+        [[nodiscard]] bool isBounded() const { return budget > 0; }
+
+        [[nodiscard]] double getBudget() const { return budget; }
+
+        [[nodiscard]] double getElapsedSeconds() const {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        // Infinity if unbounded, 0 if the budget is spent
+        [[nodiscard]] double getRemainingSeconds() const {
+            if (not isBounded()) {
+                return std::numeric_limits<double>::infinity();
+            }
+            return std::max(budget - getElapsedSeconds(), 0.0);
+        }
+
+        // The elapsed time is over the share in [0, 1] of the budget, never if unbounded
+        [[nodiscard]] bool isExpired(double share = 1.0) const {
+            return isBounded() and getElapsedSeconds() >= share * budget;
+        }
+
+    private:
+        double budget = 0; // [s]
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    };
+}
+
+#endif //LSC_PLANNER_PLANNING_DEADLINE_HPP
@@ -0,0 +1,39 @@
+#ifndef LSC_PLANNER_POINT_CLOUD_INGESTION_HPP
+#define LSC_PLANNER_POINT_CLOUD_INGESTION_HPP
+
+#include <vector>
+#include <octomap/OcTree.h>
+#include <sensor_msgs/PointCloud2.h>
+
+namespace DynamicPlanning {
+    struct PointCloudIngestionReport {
+        size_t n_input_points = 0;
+        size_t n_valid_points = 0; // finite points
+        size_t n_voxels = 0; // voxels after the downsampling
+        double parse_time = 0; // [s]
+        double hash_time = 0; // [s]
+        double insert_time = 0; // [s], 0 if the voxels are not inserted into an octree
+
+        [[nodiscard]] double getTotalTime() const { return parse_time + hash_time + insert_time; }
+    };
+
+    // Read the x, y and z fields of all points in chunks on the worker pool, the NaN points are dropped.
+    // Returns false if the message has no x, y and z fields of float32 or float64 in the host byte order.
+    bool parsePointCloud2(const sensor_msgs::PointCloud2 &msg, std::vector<octomap::point3d> &points);
+
+    // Voxel grid downsampling on the grid of the octree: the keys of the voxels that contain the points,
+    // sorted and without duplicates. The points are hashed in parallel, and each worker deduplicates a range of
+    // the keys, so the keys are sorted without a serial merge.
+    void computeVoxelKeys(const octomap::OcTree &octree, const std::vector<octomap::point3d> &points,
+                          std::vector<octomap::OcTreeKey> &keys);
+
+    // Mark the voxels occupied at the key level. Unlike OcTree::insertPointCloud, no ray is traced from a sensor
+    // origin, so the free space of a known global map stays unknown, which the distmap treats as free.
+    void insertOccupiedVoxels(octomap::OcTree &octree, const std::vector<octomap::OcTreeKey> &keys);
+
+    // parsePointCloud2 and computeVoxelKeys with the timing of the stages, false if the message can not be parsed
+    bool ingestPointCloud2(const sensor_msgs::PointCloud2 &msg, const octomap::OcTree &octree,
+                           std::vector<octomap::OcTreeKey> &keys, PointCloudIngestionReport &report);
+}
+
+#endif //LSC_PLANNER_POINT_CLOUD_INGESTION_HPP
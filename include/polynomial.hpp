@@ -1,12 +1,12 @@
 #ifndef LSC_PLANNER_BERNSTEIN_TRAJECTORY_HPP
 #define LSC_PLANNER_BERNSTEIN_TRAJECTORY_HPP
 
-#include <queue>
+#include <array>
 #include <sp_const.hpp>
 #include <Eigen/Dense>
 
 namespace DynamicPlanning{
-    static int nChoosek(int n, int k){
+    static constexpr int nChoosek(int n, int k){
         if(k > n) return 0;
         if(k * 2 > n) k = n-k;
         if(k == 0) return 1;
@@ -19,66 +19,161 @@ namespace DynamicPlanning{
         return result;
     }
 
+    // The largest degree evaluated with the precomputed binomials and the fixed-size buffers
+    static constexpr int MAX_BERNSTEIN_DEGREE = 15;
+
+    // Binomials up to the degree of the product of two polynomials of MAX_BERNSTEIN_DEGREE
+    static constexpr int MAX_BINOMIAL_N = 2 * MAX_BERNSTEIN_DEGREE;
+
+    struct BinomialTable {
+        int values[MAX_BINOMIAL_N + 1][MAX_BINOMIAL_N + 1];
+
+        constexpr BinomialTable() : values() {
+            for (int n = 0; n <= MAX_BINOMIAL_N; n++) {
+                values[n][0] = 1;
+                values[n][n] = 1;
+                for (int k = 1; k < n; k++) {
+                    values[n][k] = values[n - 1][k - 1] + values[n - 1][k];
+                }
+            }
+        }
+    };
+
+    static constexpr BinomialTable BINOMIAL_TABLE;
+
+    static inline int binomial(int n, int k){
+        return (n <= MAX_BINOMIAL_N and k >= 0 and k <= n) ? BINOMIAL_TABLE.values[n][k] : nChoosek(n, k);
+    }
+
     static double getBernsteinBasis(int n, int i, double t_normalized){
-        return nChoosek(n, i) * pow(t_normalized, i) * pow(1-t_normalized, n - i);
+        return binomial(n, i) * pow(t_normalized, i) * pow(1-t_normalized, n - i);
+    }
+
+    // All n + 1 basis functions at t_normalized without pow, bases must hold n + 1 values
+    static void getBernsteinBases(int n, double t_normalized, double* bases){
+        bases[0] = 1;
+        for(int i = 1; i < n + 1; i++){
+            bases[i] = bases[i - 1] * t_normalized;
+        }
+        double s = 1;
+        for(int i = n; i >= 0; i--){
+            bases[i] *= binomial(n, i) * s;
+            s *= 1 - t_normalized;
+        }
+    }
+
+    // Sum of control_points[i] * bases[i], i <= n
+    template<typename T>
+    static T combineControlPoints(const T* control_points, int n, const double* bases){
+        T point = control_points[0] * bases[0];
+        for(int i = 1; i < n + 1; i++){
+            point = point + control_points[i] * bases[i];
+        }
+        return point;
+    }
+
+    // Evaluate the Bernstein polynomial of degree n by de Casteljau's algorithm
+    template<typename T>
+    static T deCasteljau(const T* control_points, int n, double t_normalized){
+        if(n < 0){
+            return T();
+        }
+        if(n > MAX_BINOMIAL_N){
+            std::vector<double> bases(n + 1);
+            getBernsteinBases(n, t_normalized, bases.data());
+            return combineControlPoints(control_points, n, bases.data());
+        }
+
+        std::array<T, MAX_BINOMIAL_N + 1> points;
+        std::copy(control_points, control_points + n + 1, points.begin());
+        for(int r = 1; r < n + 1; r++){
+            for(int i = 0; i < n - r + 1; i++){
+                points[i] = points[i] * (1 - t_normalized) + points[i + 1] * t_normalized;
+            }
+        }
+        return points[0];
     }
 
     //TODO: MINVO basis
 
-    static point3d getPointFromControlPoints(points_t control_points,
+    static point3d getPointFromControlPoints(const points_t& control_points,
                                              double t_normalized){
-        point3d point;
         double t = t_normalized;
         if(t < 0 - SP_EPSILON || t > 1 + SP_EPSILON){
             throw std::invalid_argument("[Polynomial] Input of getPointFromControlPoints is out of bound");
         }
 
         int n_ctrl = (int)control_points.size() - 1;
-        double x = 0, y = 0, z = 0;
-        for(int i = 0; i < n_ctrl + 1; i++){
-            double b_i_n = getBernsteinBasis(n_ctrl, i, t_normalized);
-            x += control_points[i].x() * b_i_n;
-            y += control_points[i].y() * b_i_n;
-            z += control_points[i].z() * b_i_n;
-        }
-
-        point = point3d((float)x, (float)y, (float)z);
-        return point;
+        return deCasteljau(control_points.data(), n_ctrl, t_normalized);
     }
 
-    static double getPointFromControlPoints(std::vector<double> control_points, double t_normalized){
+    static double getPointFromControlPoints(const std::vector<double>& control_points, double t_normalized){
         double t = t_normalized;
         if(t < 0 - SP_EPSILON || t > 1 + SP_EPSILON){
             throw std::invalid_argument("[Polynomial] Input of getPointFromControlPoints is out of bound");
         }
 
         int n_ctrl = (int)control_points.size() - 1;
-        double x = 0;
-        for(int i = 0; i < n_ctrl + 1; i++){
-            double b_i_n = getBernsteinBasis(n_ctrl, i, t_normalized);
-            x += control_points[i] * b_i_n;
+        return deCasteljau(control_points.data(), n_ctrl, t_normalized);
+    }
+
+    // LU factorization of the Bernstein basis matrix B(i, j) = B_j^n(ts_normalized[i]) in fixed-capacity matrices.
+    // The fitting usually uses the same degree and time grid, so the last factorization of each thread is reused.
+    class BernsteinFittingSolver {
+    public:
+        typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, 0,
+                              MAX_BERNSTEIN_DEGREE + 1, MAX_BERNSTEIN_DEGREE + 1> BasisMatrix;
+
+        static const BernsteinFittingSolver &get(int n, const std::vector<double> &ts_normalized){
+            static thread_local BernsteinFittingSolver solver;
+            if(solver.n != n or solver.ts_normalized != ts_normalized){
+                solver.factorize(n, ts_normalized);
+            }
+            return solver;
         }
 
-        return x;
-    }
+        // Solve B * C = X, X has one row per sample time
+        template<typename Derived>
+        void solve(const Eigen::MatrixBase<Derived> &X, Eigen::MatrixXd &C) const {
+            C = lu.solve(X);
+        }
 
-    static points_t bernsteinFitting(points_t target_points, std::vector<double> ts_normalized){
-        int n = (int)target_points.size() - 1;
-        Eigen::MatrixXd B = Eigen::MatrixXd(n+1, n+1);
-        for(int i = 0; i < n + 1; i++){
-            for(int j = 0; j < n + 1; j++){
-                B(i, j) = getBernsteinBasis(n, j, ts_normalized[i]);
+    private:
+        int n = -1;
+        std::vector<double> ts_normalized;
+        Eigen::PartialPivLU<BasisMatrix> lu;
+
+        void factorize(int _n, const std::vector<double> &_ts_normalized){
+            if(_n > MAX_BERNSTEIN_DEGREE or (int)_ts_normalized.size() < _n + 1){
+                throw std::invalid_argument("[Polynomial] invalid degree or time grid of the Bernstein fitting");
+            }
+            n = _n;
+            ts_normalized = _ts_normalized;
+            BasisMatrix B(n + 1, n + 1);
+            std::array<double, MAX_BERNSTEIN_DEGREE + 1> bases;
+            for(int i = 0; i < n + 1; i++){
+                getBernsteinBases(n, ts_normalized[i], bases.data());
+                for(int j = 0; j < n + 1; j++){
+                    B(i, j) = bases[j];
+                }
             }
+            lu.compute(B);
         }
+    };
+
+    static points_t bernsteinFitting(const points_t& target_points, const std::vector<double>& ts_normalized){
+        int n = (int)target_points.size() - 1;
+        const BernsteinFittingSolver& solver = BernsteinFittingSolver::get(n, ts_normalized);
 
-        Eigen::MatrixXd X = Eigen::MatrixXd(n+1, 3);
+        Eigen::Matrix<double, Eigen::Dynamic, 3, 0, MAX_BERNSTEIN_DEGREE + 1, 3> X(n + 1, 3);
         for(int i = 0; i < n + 1; i++){
             X(i, 0) = target_points[i].x();
             X(i, 1) = target_points[i].y();
             X(i, 2) = target_points[i].z();
         }
 
-        Eigen::MatrixXd C = B.inverse() * X;
+        Eigen::MatrixXd C;
+        solver.solve(X, C);
         points_t control_points;
         control_points.resize(n+1);
         for(int i = 0; i < n + 1; i++){
@@ -87,7 +182,41 @@ namespace DynamicPlanning{
         return control_points;
     }
 
-    static int coef_derivative(int n, int phi){
+    // Fit the target points of many trajectories at the same sample times by one solve with 3 columns per trajectory
+    static void bernsteinFitting(const std::vector<points_t>& target_points_list,
+                                 const std::vector<double>& ts_normalized,
+                                 std::vector<points_t>& control_points_list){
+        control_points_list.resize(target_points_list.size());
+        if(target_points_list.empty()){
+            return;
+        }
+        int n = (int)target_points_list[0].size() - 1;
+        const BernsteinFittingSolver& solver = BernsteinFittingSolver::get(n, ts_normalized);
+
+        size_t K = target_points_list.size();
+        static thread_local Eigen::MatrixXd X, C;
+        X.resize(n + 1, 3 * K);
+        for(size_t k = 0; k < K; k++){
+            if((int)target_points_list[k].size() != n + 1){
+                throw std::invalid_argument("[Polynomial] degree of the fitted trajectories are not same.");
+            }
+            for(int i = 0; i < n + 1; i++){
+                X(i, 3 * k) = target_points_list[k][i].x();
+                X(i, 3 * k + 1) = target_points_list[k][i].y();
+                X(i, 3 * k + 2) = target_points_list[k][i].z();
+            }
+        }
+
+        solver.solve(X, C);
+        for(size_t k = 0; k < K; k++){
+            control_points_list[k].resize(n + 1);
+            for(int i = 0; i < n + 1; i++){
+                control_points_list[k][i] = point3d(C(i, 3 * k), C(i, 3 * k + 1), C(i, 3 * k + 2));
+            }
+        }
+    }
+
+    static constexpr int coef_derivative(int n, int phi){
         if(n < phi){
             return 0;
         }
@@ -99,198 +228,344 @@ namespace DynamicPlanning{
         return coef;
     }
 
-    struct BisectionElement{
-        double c;
-        int k;
-        Eigen::VectorXd coef;
+    // Bernstein coefficients of g(t) = p(t).p'(t) on an interval, degree 2n - 1
+    struct BernsteinInterval {
+        double a, b;
+        std::array<double, 2 * MAX_BERNSTEIN_DEGREE> coef;
     };
 
-    // return list of [a,b] includes one real root of polynomial which coefficient is coef
-    static std::vector<std::pair<double, double>> realRootIsolation(const Eigen::VectorXd& coef, int n) {
-        std::queue<BisectionElement> L;
-        L.push(BisectionElement{0, 0, coef});
-        std::vector<std::pair<double, double>> Isol;
-        int n_poly = 2 * n - 1;
-
-        while (not L.empty()) {
-            BisectionElement current_element = L.front();
-            L.pop();
-//                std::cout << "current_coef: " << std::endl << current_element.coef << std::endl;
-            if (current_element.coef(0) == 0) {
-                for (int i = 0; i < n_poly; i++) {
-                    current_element.coef(i) = current_element.coef(0, i + 1);
-                }
-                current_element.coef(n_poly) = 0;
-                n_poly--;
-                Isol.emplace_back(std::make_pair(current_element.c / pow(2, current_element.k),
-                                                 current_element.c / pow(2, current_element.k)));
+    // Split the coefficients of degree d on [0, 1] into those on [0, 1/2] (left) and [1/2, 1] (right)
+    template<typename T>
+    static void subdivideBernstein(const T* coef, int d, T* left, T* right){
+        std::array<T, 2 * MAX_BERNSTEIN_DEGREE> work;
+        std::copy(coef, coef + d + 1, work.begin());
+        left[0] = work[0];
+        right[d] = work[d];
+        for(int r = 1; r < d + 1; r++){
+            for(int i = 0; i < d - r + 1; i++){
+                work[i] = (work[i] + work[i + 1]) * 0.5;
             }
+            left[r] = work[0];
+            right[d - r] = work[d - r];
+        }
+    }
 
-            Eigen::VectorXd coef_test = Eigen::VectorXd::Zero(n_poly + 1);
-            for (int i = 0; i < n_poly + 1; i++) {
-                for (int j = 0; j < n_poly + 1 - i; j++) {
-                    coef_test(j) += current_element.coef(i) * nChoosek(n_poly - i, j);
-                }
+    // Closest point of the relative trajectory p(t) = agent(t) - obs(t), t in [0, 1], to the origin.
+    // The local minima of |p| are the roots of g = p.p' where g goes from negative to positive. g is kept in the
+    // Bernstein basis and subdivided on fixed-size arrays: by Descartes' rule of signs an interval without a sign
+    // change of the coefficients has no root, and an interval with one sign change has exactly one root, which is
+    // found by Newton's method safeguarded by bisection. Both end points are also candidates.
+    static double distanceBetweenPolys(const point3d* control_points_agent,
+                                       const point3d* control_points_obs,
+                                       int n,
+                                       double poly_root_tolerance,
+                                       point3d& closest_point) {
+        if(n > MAX_BERNSTEIN_DEGREE){
+            throw std::invalid_argument("[Polynomial] degree of the polynomials is larger than MAX_BERNSTEIN_DEGREE");
+        }
+
+        std::array<point3d, MAX_BERNSTEIN_DEGREE + 1> control_points_rel;
+        for(int i = 0; i < n + 1; i++){
+            control_points_rel[i] = control_points_agent[i] - control_points_obs[i];
+        }
+
+        double dist_closest = control_points_rel[0].norm();
+        closest_point = control_points_rel[0];
+        if(control_points_rel[n].norm() < dist_closest){
+            dist_closest = control_points_rel[n].norm();
+            closest_point = control_points_rel[n];
+        }
+        if(n == 0){
+            return dist_closest;
+        }
+
+        auto updateCandidate = [&](double t_cand){
+            point3d p_cand = deCasteljau(control_points_rel.data(), n, t_cand);
+            double dist_cand = p_cand.norm();
+            if(dist_cand < dist_closest){
+                closest_point = p_cand;
+                dist_closest = dist_cand;
             }
-//                std::cout << "coef_test: " << std::endl << coef_test << std::endl;
+        };
+
+        // B_i^n * B_j^(n-1) = C(n,i) C(n-1,j) / C(2n-1,i+j) B_(i+j)^(2n-1)
+        // The depth-first subdivision keeps at most one sibling per level
+        int d = 2 * n - 1;
+        std::array<BernsteinInterval, 64> stack;
+        int stack_size = 1;
+        stack[0].a = 0;
+        stack[0].b = 1;
+        std::fill(stack[0].coef.begin(), stack[0].coef.begin() + d + 1, 0.0);
+        std::array<point3d, MAX_BERNSTEIN_DEGREE> derivatives;
+        for(int j = 0; j < n; j++){
+            derivatives[j] = (control_points_rel[j + 1] - control_points_rel[j]) * n;
+        }
+        for(int i = 0; i < n + 1; i++){
+            for(int j = 0; j < n; j++){
+                stack[0].coef[i + j] += binomial(n, i) * binomial(n - 1, j) * control_points_rel[i].dot(derivatives[j]);
+            }
+        }
+        for(int k = 0; k < d + 1; k++){
+            stack[0].coef[k] /= binomial(d, k);
+        }
+
+        while(stack_size > 0){
+            BernsteinInterval interval = stack[--stack_size];
+            const double* coef = interval.coef.data();
+
             int var = 0;
-            for (int i = 0; i < n_poly; i++) {
-                if (coef_test(i) * coef_test(i + 1) < 0) {
-                    var++;
+            double first_sign = 0, last_sign = 0;
+            for(int i = 0; i < d + 1; i++){
+                if(coef[i] != 0){
+                    if(last_sign * coef[i] < 0){
+                        var++;
+                    }
+                    if(first_sign == 0){
+                        first_sign = coef[i];
+                    }
+                    last_sign = coef[i];
                 }
             }
-            if (var == 1) {
-                Isol.emplace_back(std::make_pair(current_element.c / pow(2, current_element.k),
-                                                 (current_element.c + 1) / pow(2, current_element.k)));
+            if(var == 0){
+                continue;
+            }
+
+            double t_mid = 0.5 * (interval.a + interval.b);
+            if(var > 1 and (interval.b - interval.a < poly_root_tolerance or stack_size + 2 > (int)stack.size())){
+                updateCandidate(t_mid);
+                continue;
             }
-            if (var > 1) {
-                Eigen::VectorXd coef1 = current_element.coef;
-                for (int i = 0; i < n_poly + 1; i++) {
-                    coef1(i) *= pow(2, n_poly - i);
+
+            if(var == 1){
+                // One root, a local minimum of |p| if g goes up
+                if(not (first_sign < 0 and last_sign > 0)){
+                    continue;
+                }
+                // Newton's method on the power basis of the interval, safeguarded by bisection of the bracket
+                std::array<double, 2 * MAX_BERNSTEIN_DEGREE> power_coef;
+                for(int j = 0; j < d + 1; j++){
+                    power_coef[j] = 0;
+                    for(int i = 0; i < j + 1; i++){
+                        power_coef[j] += binomial(j, i) * ((j - i) % 2 == 0 ? coef[i] : -coef[i]);
+                    }
+                    power_coef[j] *= binomial(d, j);
+                }
+                double s_tolerance = poly_root_tolerance / (interval.b - interval.a);
+                double s_a = 0, s_b = 1;
+                double t_cand = coef[0] / (coef[0] - coef[d]);
+                if(not (t_cand > 0 and t_cand < 1)){
+                    t_cand = 0.5;
                 }
-//                    std::cout << "coef1: " << std::endl << coef1 << std::endl;
-                L.push(BisectionElement{2 * current_element.c, current_element.k + 1, coef1});
+                while(s_b - s_a >= s_tolerance){
+                    double g = power_coef[d], dg = 0;
+                    for(int j = d - 1; j >= 0; j--){
+                        dg = dg * t_cand + g;
+                        g = g * t_cand + power_coef[j];
+                    }
+                    if(g == 0){
+                        break;
+                    } else if(g < 0){
+                        s_a = t_cand;
+                    } else {
+                        s_b = t_cand;
+                    }
 
-                Eigen::VectorXd coef2 = Eigen::VectorXd::Zero(n_poly + 1);
-                for (int i = 0; i < n_poly + 1; i++) {
-                    for (int j = 0; j < i + 1; j++) {
-                        coef2(j) += current_element.coef(i) * pow(2, n_poly - i) * nChoosek(i, j);
+                    double s_next = dg != 0 ? t_cand - g / dg : s_a - 1;
+                    if(s_next <= s_a or s_next >= s_b){
+                        s_next = 0.5 * (s_a + s_b);
+                    } else if(std::abs(s_next - t_cand) < 0.5 * s_tolerance){
+                        t_cand = s_next;
+                        break;
                     }
+                    t_cand = s_next;
                 }
-//                    std::cout << "coef2: " << std::endl << coef2 << std::endl;
-                L.push(BisectionElement{2 * current_element.c + 1, current_element.k + 1, coef2});
+                updateCandidate(interval.a + t_cand * (interval.b - interval.a));
+                continue;
             }
-        }
-        return Isol;
-    }
 
-    static double evalPoly(const Eigen::VectorXd& coef, double t){
-        double ret = 0;
-        for(int i = 0; i < coef.size(); i++){
-            ret += coef(i) * pow(t, i);
+            BernsteinInterval &right = stack[stack_size];
+            BernsteinInterval &left = stack[stack_size + 1];
+            subdivideBernstein(coef, d, left.coef.data(), right.coef.data());
+            if(left.coef[d] == 0){
+                updateCandidate(t_mid);
+            }
+            right.a = t_mid;
+            right.b = interval.b;
+            left.a = interval.a;
+            left.b = t_mid;
+            stack_size += 2;
         }
-        return ret;
+
+        return dist_closest;
     }
 
-    // pi_i = obstacle position, pi_j = agent_position
     static double distanceBetweenPolys(const points_t& control_points_agent,
                                        const points_t& control_points_obs,
-                                       const Eigen::MatrixXd& B,
                                        double poly_root_tolerance,
                                        point3d& closest_point) {
         if(control_points_agent.size() != control_points_obs.size()){
             throw std::invalid_argument("[Polynomial] degree of two polynomials are not same.");
         }
 
-        int n = (int)control_points_agent.size() - 1;
-        int dim = 3;
-
-        //get control points of relative trajectory
-        points_t control_points_rel;
-        control_points_rel.resize(n + 1);
-        for(int i = 0; i < n + 1; i++){
-            control_points_rel[i].x() = control_points_agent[i].x() - control_points_obs[i].x();
-            control_points_rel[i].y() = control_points_agent[i].y() - control_points_obs[i].y();
-            control_points_rel[i].z() = control_points_agent[i].z() - control_points_obs[i].z();
-        }
-
-        Eigen::MatrixXd control_points_rel_mtx = Eigen::MatrixXd::Zero(dim, n + 1);
-        for(int j = 0; j < n + 1; j++){
-            control_points_rel_mtx(0, j) = control_points_rel[j].x();
-            control_points_rel_mtx(1, j) = control_points_rel[j].y();
-            control_points_rel_mtx(2, j) = control_points_rel[j].z();
-        }
-
-        // convert to coef of standard basis
-        Eigen::MatrixXd coef = control_points_rel_mtx * B;
+        return distanceBetweenPolys(control_points_agent.data(), control_points_obs.data(),
+                                    (int)control_points_agent.size() - 1, poly_root_tolerance, closest_point);
+    }
 
-        // get derivative of coef
-        Eigen::MatrixXd coef_derivative = Eigen::MatrixXd::Zero(dim, n + 1);
-        for(int j = 0; j < n; j++){
-            coef_derivative(0, j) = (j + 1) * coef(0, j + 1);
-            coef_derivative(1, j) = (j + 1) * coef(1, j + 1);
-            coef_derivative(2, j) = (j + 1) * coef(2, j + 1);
+    // Certified bounds of the minimum distance of the Bernstein curve p(t), t in [0, 1], to the origin:
+    // lower <= min |p(t)| <= upper. By the convex hull property, |p| on a piece is at least the distance to the
+    // bounding box of its control points and at least min_i c_i.u for the unit vector u towards the piece.
+    // The end points of the pieces are on the curve and give the upper bound. The pieces are subdivided
+    // depth-first, nearer half first, and a piece is pruned once its lower bound is within the tolerance of the
+    // upper bound, so upper - lower <= tolerance unless the depth of the subdivision is exhausted.
+    // The pieces farther than the cutoff are also pruned, then only cutoff <= lower <= min |p(t)| is certified.
+    static void minimumDistanceBounds(const point3d* control_points,
+                                      int n,
+                                      double tolerance,
+                                      double cutoff,
+                                      double& lower,
+                                      double& upper) {
+        if(n > MAX_BERNSTEIN_DEGREE){
+            throw std::invalid_argument("[Polynomial] degree of the polynomial is larger than MAX_BERNSTEIN_DEGREE");
         }
 
-        // coef dot coef_derivative
-        Eigen::VectorXd coef_g = Eigen::VectorXd::Zero(2 * n);
-        for(int j0 = 0; j0 < n + 1; j0++){
-            for(int j1 = 0; j1 < n; j1++){
-                for(int k = 0; k < dim; k++) {
-                    coef_g(j0 + j1) += coef(k, j0) * coef_derivative(k, j1);
+        struct BernsteinPiece {
+            int depth;
+            double lower;
+            std::array<point3d, MAX_BERNSTEIN_DEGREE + 1> control_points;
+        };
+        static constexpr int MAX_DEPTH = 30;
+
+        auto getLowerBound = [n](const point3d* c){
+            point3d box_min = c[0], box_max = c[0];
+            point3d direction = c[0] + c[n];
+            for(int i = 1; i < n + 1; i++){
+                for(int k = 0; k < 3; k++){
+                    box_min(k) = std::min(box_min(k), c[i](k));
+                    box_max(k) = std::max(box_max(k), c[i](k));
                 }
             }
-        }
+            point3d box_dist(0, 0, 0);
+            for(int k = 0; k < 3; k++){
+                box_dist(k) = std::max(0.0f, std::max(box_min(k), -box_max(k)));
+            }
+            double bound = box_dist.norm();
 
-        // real root isolation
-        std::vector<std::pair<double, double>> Isol = realRootIsolation(coef_g, n);
-
-        // compute closest point by Newton method
-        bool isClosestPointInSection = false;
-        double a, b, m, g_m, t_cand, dist_cand;
-        double dist_closest = SP_INFINITY;
-        point3d p_cand;
-        for(auto section : Isol){
-            a = section.first;
-            b = section.second;
-            if(evalPoly(coef_g, a) < 0 and evalPoly(coef_g, b) > 0) {
-                while (true) {
-                    if (b - a < poly_root_tolerance) {
-                        t_cand = (a + b) / 2;
-                        break;
-                    }
-                    m = (a + b) / 2;
-                    g_m = evalPoly(coef_g, m);
-                    if (g_m == 0) {
-                        t_cand = m;
-                        break;
-                    } else if (g_m < 0) {
-                        a = m;
-                    } else {
-                        b = m;
-                    }
-                }
-                p_cand = getPointFromControlPoints(control_points_rel, t_cand);
-                dist_cand = p_cand.norm();
-                if(dist_cand < dist_closest){
-                    closest_point = p_cand;
-                    dist_closest = dist_cand;
-//                        t_normalized_closest = t_cand;
-                    isClosestPointInSection = true;
+            double direction_norm = direction.norm();
+            if(direction_norm > SP_EPSILON_FLOAT){
+                double projection_min = SP_INFINITY;
+                for(int i = 0; i < n + 1; i++){
+                    projection_min = std::min(projection_min, c[i].dot(direction) / direction_norm);
                 }
+                bound = std::max(bound, projection_min);
             }
+            return bound;
+        };
+
+        upper = std::min(control_points[0].norm(), control_points[n].norm());
+        lower = upper;
+        if(n == 0){
+            return;
         }
-        if(not isClosestPointInSection){
-            if(control_points_rel[0].norm() < control_points_rel[n].norm()){
-                closest_point = control_points_rel[0];
-//                    t_normalized_closest = 0;
+
+        // Depth-first with the farther half pushed first keeps at most one sibling per level
+        std::array<BernsteinPiece, MAX_DEPTH + 2> stack;
+        int stack_size = 1;
+        stack[0].depth = 0;
+        std::copy(control_points, control_points + n + 1, stack[0].control_points.begin());
+        stack[0].lower = getLowerBound(control_points);
+        while(stack_size > 0){
+            BernsteinPiece piece = stack[--stack_size];
+            if(piece.lower >= std::min(upper - tolerance, cutoff) or piece.depth >= MAX_DEPTH){
+                lower = std::min(lower, piece.lower);
+                continue;
             }
-            else{
-                closest_point = control_points_rel[n];
-//                    t_normalized_closest = 1;
+
+            BernsteinPiece left, right;
+            subdivideBernstein(piece.control_points.data(), n, left.control_points.data(),
+                               right.control_points.data());
+            upper = std::min(upper, (double)left.control_points[n].norm());
+            left.depth = right.depth = piece.depth + 1;
+            left.lower = getLowerBound(left.control_points.data());
+            right.lower = getLowerBound(right.control_points.data());
+            if(left.lower < right.lower){
+                std::swap(left, right);
             }
+            stack[stack_size++] = left;
+            stack[stack_size++] = right;
         }
-
-        return closest_point.norm();
-//            // Exception handle for first segment
-//            if(m == 0 && p_closest.norm() < d[0] - SP_EPSILON_FLOAT){
-//                p_closest = control_points_rel[0];
-//            }
+        lower = std::min(lower, upper);
     }
 
-    static void buildBernsteinBasis(int n, Eigen::MatrixXd& B, Eigen::MatrixXd& B_inv) {
-        B = Eigen::MatrixXd::Zero(n + 1, n + 1);
+    // B(i,j): coefficient of t^j in the i-th Bernstein basis polynomial of degree n
+    template<typename MatrixType>
+    static void fillBernsteinBasis(int n, MatrixType& B) {
+        B.setZero(n + 1, n + 1);
         for(int i = 0; i < n + 1; i++){
-            for(int j = 0; j < n + 1; j++){
-                if(j >= i){
-                    B(i,j) = nChoosek(n, i) * nChoosek(n-i, n-j) * pow(-1, j-i);
-                }
-                else{
-                    B(i,j) = 0;
-                }
+            for(int j = i; j < n + 1; j++){
+                B(i,j) = nChoosek(n, i) * nChoosek(n-i, n-j) * ((j - i) % 2 == 0 ? 1 : -1);
+            }
+        }
+    }
+
+    // Derivatives of a Bernstein polynomial at the end points in terms of control points c
+    // p^(j)(0) = n!/(n-j)! * A_0.row(j) * c, p^(j)(1) = n!/(n-j)! * A_T.row(j) * c
+    template<typename MatrixType>
+    static void fillEndpointDerivativeMatrices(int n, MatrixType& A_0, MatrixType& A_T) {
+        A_0.setZero(n + 1, n + 1);
+        A_T.setZero(n + 1, n + 1);
+        for(int j = 0; j < n + 1; j++){
+            for(int i = 0; i < j + 1; i++){
+                A_0(j, i) = nChoosek(j, i) * ((j - i) % 2 == 0 ? 1 : -1);
+                A_T(j, n - i) = nChoosek(j, i) * (i % 2 == 0 ? 1 : -1);
             }
         }
+    }
+
+    static void buildBernsteinBasis(int n, Eigen::MatrixXd& B, Eigen::MatrixXd& B_inv) {
+        fillBernsteinBasis(n, B);
         B_inv = B.inverse();
     }
+
+    static void buildEndpointDerivativeMatrices(int n, Eigen::MatrixXd& A_0, Eigen::MatrixXd& A_T) {
+        fillEndpointDerivativeMatrices(n, A_0, A_T);
+    }
+
+    // Fixed size matrices for the degree known at compile time, computed once
+    template<int N>
+    struct BernsteinMatrices {
+        typedef Eigen::Matrix<double, N + 1, N + 1> Matrix;
+
+        static const Matrix& basis() {
+            static const Matrix B = [] {
+                Matrix B_tmp;
+                fillBernsteinBasis(N, B_tmp);
+                return B_tmp;
+            }();
+            return B;
+        }
+
+        static const Matrix& basisInverse() {
+            static const Matrix B_inv = basis().inverse();
+            return B_inv;
+        }
+
+        static const Matrix& startDerivative() {
+            return endpointDerivatives().first;
+        }
+
+        static const Matrix& endDerivative() {
+            return endpointDerivatives().second;
+        }
+
+    private:
+        static const std::pair<Matrix, Matrix>& endpointDerivatives() {
+            static const std::pair<Matrix, Matrix> A = [] {
+                std::pair<Matrix, Matrix> A_tmp;
+                fillEndpointDerivativeMatrices(N, A_tmp.first, A_tmp.second);
+                return A_tmp;
+            }();
+            return A;
+        }
+    };
 }
 #endif //LSC_PLANNER_BERNSTEIN_TRAJECTORY_HPP
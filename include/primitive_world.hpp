@@ -0,0 +1,103 @@
+#ifndef LSC_PLANNER_PRIMITIVE_WORLD_HPP
+#define LSC_PLANNER_PRIMITIVE_WORLD_HPP
+
+#include <string>
+#include <vector>
+#include <octomap/octomap.h>
+#include <distance_map.hpp>
+
+namespace DynamicPlanning {
+    enum class PrimitiveShape {
+        BOX,
+        CYLINDER, // vertical, size.x() is the diameter
+    };
+
+    // Obstacle of a world file, the center and the size of its bounding box
+    struct WorldPrimitive {
+        PrimitiveShape shape = PrimitiveShape::BOX;
+        octomap::point3d center, size;
+
+        [[nodiscard]] octomap::point3d getMin() const { return center - size * 0.5; }
+
+        [[nodiscard]] octomap::point3d getMax() const { return center + size * 0.5; }
+
+        // [m], the Euclidean distance from the point, 0 inside. closest is the closest point of the primitive.
+        [[nodiscard]] double distance(const octomap::point3d &point, octomap::point3d &closest) const;
+
+        [[nodiscard]] double distance(const octomap::point3d &point) const;
+
+        // [m], the L-infinity distance from the box [box_min, box_max], 0 if they intersect
+        [[nodiscard]] double lInfDistance(const octomap::point3d &box_min, const octomap::point3d &box_max) const;
+
+        // The distance along the ray to the surface, 0 if the origin is inside. direction is a unit vector.
+        [[nodiscard]] bool raycast(const octomap::point3d &origin, const octomap::point3d &direction,
+                                   double max_range, double &range) const;
+    };
+
+    // Each row of the csv file is the center and the size of an obstacle, the optional 7th column "cylinder" makes
+    // it a vertical cylinder instead of a box. Returns false if the file can not be opened or a row is invalid.
+    bool readWorldPrimitives(const std::string &file_name, std::vector<WorldPrimitive> &primitives);
+
+    bool saveWorldPrimitives(const std::string &file_name, const std::vector<WorldPrimitive> &primitives);
+
+    // World made of analytic primitives in a bounding volume hierarchy, for the procedurally generated worlds of
+    // boxes and cylinders. The queries are exact instead of the voxels of the octomap, so it replaces the distance
+    // field and the occupancy index of the global map, and the distances are computed without building a grid.
+    // The BVH is not modified after the construction, so the queries run concurrently.
+    class PrimitiveWorld : public DistanceMap {
+    public:
+        // The primitives outside the world are dropped, max_dist truncates the distances like the distance field
+        PrimitiveWorld(const std::vector<WorldPrimitive> &primitives, const octomap::point3d &world_min,
+                       const octomap::point3d &world_max, double max_dist);
+
+        // Same as BatchDistmap::query, but the obstacle is the closest point of the closest primitive and the
+        // L-infinity distance is the exact one to the primitives, infinity if none is within max_dist
+        void query(DistmapQueryBatch &batch) const override;
+
+        // [m], the L-infinity distance from the box to the closest primitive, max_dist if none is closer
+        [[nodiscard]] double computeLInfDistance(const octomap::point3d &box_min,
+                                                 const octomap::point3d &box_max) const;
+
+        // Is there any primitive within the L-infinity distance margin of [box_min, box_max]?
+        [[nodiscard]] bool isOccupied(const octomap::point3d &box_min, const octomap::point3d &box_max,
+                                      double margin) const;
+
+        // [m], how far the face of [box_min, box_max] on the axis sweeps before the box is within the L-infinity
+        // distance margin of a primitive, in the positive or the negative direction and at most max_range. The
+        // cylinders are bounded by their boxes, so the sweep is exact for the boxes and conservative for them.
+        [[nodiscard]] double computeSweepDistance(const octomap::point3d &box_min, const octomap::point3d &box_max,
+                                                  int axis, bool positive, double margin, double max_range) const;
+
+        // The first hit of the ray within max_range, direction is a unit vector
+        [[nodiscard]] bool raycast(const octomap::point3d &origin, const octomap::point3d &direction,
+                                   double max_range, octomap::point3d &hit) const;
+
+        [[nodiscard]] size_t getNumPrimitives() const { return primitives.size(); }
+
+        [[nodiscard]] size_t getMemoryUsage() const;
+
+    private:
+        static constexpr int LEAF_SIZE = 4; // the maximum number of primitives in a leaf
+        static constexpr int MAX_DEPTH = 64; // the traversal stack, the median split halves the primitives
+
+        // The nodes are in the depth-first order, the left child of an inner node is the next node
+        struct Node {
+            octomap::point3d box_min, box_max;
+            int start = 0, count = 0; // the primitives of a leaf, count is 0 for an inner node
+            int right = 0; // the right child of an inner node
+        };
+
+        std::vector<WorldPrimitive> primitives; // in the order of the leaves
+        std::vector<Node> nodes;
+        octomap::point3d world_min, world_max;
+        double max_dist;
+
+        // Split [start, end) at the median of the centers along the longest axis, returns the id of the node
+        int build(int start, int end, int depth);
+
+        // Returns max_dist if no primitive is within max_dist
+        [[nodiscard]] double findClosest(const octomap::point3d &point, octomap::point3d &closest) const;
+    };
+}
+
+#endif //LSC_PLANNER_PRIMITIVE_WORLD_HPP
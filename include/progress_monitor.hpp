@@ -0,0 +1,40 @@
+#ifndef LSC_PLANNER_PROGRESS_MONITOR_HPP
+#define LSC_PLANNER_PROGRESS_MONITOR_HPP
+
+#include <set>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace DynamicPlanning {
+    // Progress of the communication groups toward their goals over a sliding window of steps.
+    // A group is stalled if the average rate at which its agents approach their goals over the window is below the
+    // threshold, which is detected before the agents slow down enough for TrajPlanner::isDeadlock. The agents at
+    // their goals are not counted, and a group of agents at their goals is never stalled.
+    class ProgressMonitor {
+    public:
+        // window: the number of steps of the rate, 0: off
+        void reset(size_t n_agents, int window);
+
+        // dists_to_goal: [agent] after the step, groups: the connected components of the communication range
+        void update(const std::vector<double> &dists_to_goal, const std::vector<std::set<size_t>> &groups,
+                    double time_step, double rate_threshold, double goal_threshold);
+
+        [[nodiscard]] bool isEnabled() const { return window > 0; }
+
+        [[nodiscard]] bool isStalled(size_t qi) const { return qi < stalled.size() and stalled[qi]; }
+
+        // The groups of the last update that are stalled
+        [[nodiscard]] size_t getNumStalledGroups() const { return n_stalled_groups; }
+
+    private:
+        int window = 0;
+        size_t n_agents = 0;
+        size_t n_updates = 0;
+        std::vector<double> dist_history; // [step % (window + 1) * n_agents + agent], the ring of the window
+        std::vector<uint8_t> stalled; // [agent]
+        size_t n_stalled_groups = 0;
+    };
+}
+
+#endif //LSC_PLANNER_PROGRESS_MONITOR_HPP
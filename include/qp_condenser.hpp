@@ -0,0 +1,48 @@
+#ifndef LSC_PLANNER_QP_CONDENSER_HPP
+#define LSC_PLANNER_QP_CONDENSER_HPP
+
+#include <vector>
+#include <qp_problem.hpp>
+
+namespace DynamicPlanning {
+    // Condensed form of a QPProblem in the null space of its equality rows (l == u).
+    // The equality rows are eliminated by substitution, x_D = T e - F x_F, where D are the dependent variables, F
+    // the free ones and e the right-hand side of the equality rows, so x = N z + x_0(e) with z = x_F.
+    // The basis depends only on the coefficients of the equality rows, e.g. the continuity and the initial state
+    // rows of the trajectory, so it is built once for a structure and reused for any right-hand side. The reduced
+    // Hessian N^T P N is kept while P is unchanged.
+    class QPCondenser {
+    public:
+        // preferred: variables to eliminate first, e.g. the control points fixed by the initial state or
+        // determined by the continuity. The other variables are eliminated only if needed.
+        void build(const QPProblem &problem, const std::vector<int> &preferred);
+
+        // The problem has the equality rows of the build
+        [[nodiscard]] bool isCompatible(const QPProblem &problem) const;
+
+        // Problem in z without equality rows. The finite bounds of the dependent variables become rows.
+        // x_0 is the offset for expand.
+        [[nodiscard]] QPProblem condense(const QPProblem &problem, Eigen::VectorXd &x_0);
+
+        [[nodiscard]] Eigen::VectorXd expand(const Eigen::VectorXd &z, const Eigen::VectorXd &x_0) const;
+
+        [[nodiscard]] bool isBuilt() const { return n_var > 0; }
+
+        [[nodiscard]] int getNumFreeVariables() const { return static_cast<int>(free_vars.size()); }
+
+    private:
+        int n_var = 0;
+        std::vector<int> eq_rows, ineq_rows; // rows of the problem
+        SparseMatrix E; // equality rows of the build, for isCompatible
+        std::vector<int> dep_vars, free_vars;
+        Eigen::MatrixXd T; // [dep_var][eq_row]
+        SparseMatrix N; // n_var x free_vars
+
+        // Reduced Hessian of the last P
+        SparseMatrix P_last, P_reduced;
+
+        [[nodiscard]] SparseMatrix selectRows(const SparseMatrix &A, const std::vector<int> &rows) const;
+    };
+}
+
+#endif //LSC_PLANNER_QP_CONDENSER_HPP
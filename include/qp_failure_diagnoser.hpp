@@ -0,0 +1,64 @@
+#ifndef LSC_PLANNER_QP_FAILURE_DIAGNOSER_HPP
+#define LSC_PLANNER_QP_FAILURE_DIAGNOSER_HPP
+
+#include <qp_problem.hpp>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace DynamicPlanning {
+    // Snapshot of a failed QP
+    struct QPFailureReport {
+        std::string problem_name; // e.g. trajOpt, goalOpt
+        int agent_id = -1;
+        std::string status; // solver status at the failure
+        std::string log_dir; // the model, the conflict and report.txt are saved here
+        QPProblem problem;
+    };
+
+    // Exports the failed model and refines the conflict on a background thread,
+    // so that a failure of one agent does not block the planning step of the others.
+    class QPFailureDiagnoser {
+    public:
+        static QPFailureDiagnoser &getInstance();
+
+        QPFailureDiagnoser(const QPFailureDiagnoser &) = delete;
+
+        QPFailureDiagnoser &operator=(const QPFailureDiagnoser &) = delete;
+
+        // Non-blocking, the report is dropped if the queue is full
+        void submit(QPFailureReport report);
+
+        // Block until all submitted reports are diagnosed
+        void flush();
+
+        [[nodiscard]] int getNumDropped() const;
+
+        // The reports waiting for the diagnosis
+        [[nodiscard]] size_t getQueueSize() const;
+
+    private:
+        QPFailureDiagnoser() = default;
+
+        ~QPFailureDiagnoser();
+
+        static constexpr size_t MAX_QUEUE_SIZE = 16;
+
+        mutable std::mutex mtx;
+        std::condition_variable cv_submit, cv_done;
+        std::deque<QPFailureReport> queue;
+        std::thread worker;
+        bool is_busy = false;
+        bool stop = false;
+        int n_diagnosed = 0;
+        int n_dropped = 0;
+
+        void workerLoop();
+
+        void diagnose(const QPFailureReport &report, int seq) const;
+    };
+}
+
+#endif //LSC_PLANNER_QP_FAILURE_DIAGNOSER_HPP
@@ -0,0 +1,82 @@
+#ifndef LSC_PLANNER_QP_PROBLEM_HPP
+#define LSC_PLANNER_QP_PROBLEM_HPP
+
+#include <vector>
+#include <utility>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <string>
+
+namespace DynamicPlanning {
+    const double QP_INFINITY = 1e20; // same as IloInfinity
+
+    typedef Eigen::SparseMatrix<double> SparseMatrix; // column major, i.e. CSC
+    typedef Eigen::Triplet<double> Triplet;
+
+    // QP in the sparse form
+    // min 0.5 * x^T P x + q^T x + constant
+    // s.t. l <= A x <= u, x_min <= x <= x_max
+    struct QPProblem {
+        SparseMatrix P; // upper triangular part of the hessian
+        Eigen::VectorXd q;
+        double constant = 0;
+        SparseMatrix A;
+        Eigen::VectorXd l, u;
+        Eigen::VectorXd x_min, x_max;
+        std::vector<std::string> var_names;
+        Eigen::VectorXd x_start; // initial guess for the warm start, empty if not given
+
+        [[nodiscard]] int getNumVariables() const { return static_cast<int>(q.size()); }
+
+        [[nodiscard]] bool hasStart() const { return x_start.size() == q.size() and q.size() > 0; }
+
+        [[nodiscard]] int getNumConstraints() const { return static_cast<int>(l.size()); }
+
+        [[nodiscard]] double getCost(const Eigen::VectorXd &x) const;
+    };
+
+    // Accumulates the cost and the constraints of QPProblem as triplets
+    class QPBuilder {
+    public:
+        QPBuilder() = default;
+
+        int addVariable(double lower_bound, double upper_bound, const std::string &name = "");
+
+        // Add value * x_i * x_j to the cost
+        void addQuadCost(int i, int j, double value);
+
+        void addLinearCost(int i, double value);
+
+        void addConstant(double value);
+
+        // Add weight * (x_i - target)^2 to the cost
+        void addSquaredError(int i, double target, double weight);
+
+        // Add lower <= sum(coef * x) <= upper and return the row index
+        int addRow(const std::vector<std::pair<int, double>> &coefs, double lower, double upper);
+
+        [[nodiscard]] int getNumVariables() const { return static_cast<int>(x_min.size()); }
+
+        [[nodiscard]] int getNumConstraints() const { return static_cast<int>(l.size()); }
+
+        [[nodiscard]] QPProblem build() const;
+
+    private:
+        std::vector<Triplet> P_triplets, A_triplets;
+        std::vector<double> q, l, u, x_min, x_max;
+        std::vector<std::string> var_names;
+        double constant = 0;
+    };
+
+    // Independent blocks of the problem, the variables of different blocks share no row and no cost term.
+    // block_vars[b][j] is the variable of the problem for the variable j of the block b. The constant is in the
+    // first block. A single block if the problem is coupled.
+    std::vector<QPProblem> splitQPProblem(const QPProblem &problem, std::vector<std::vector<int>> &block_vars);
+
+    // Text format for recording problems, used by qp_benchmark
+    bool writeQPProblem(const std::string &file_name, const QPProblem &problem);
+
+    bool readQPProblem(const std::string &file_name, QPProblem &problem);
+}
+
+#endif //LSC_PLANNER_QP_PROBLEM_HPP
@@ -0,0 +1,108 @@
+#ifndef LSC_PLANNER_QP_SOLVER_HPP
+#define LSC_PLANNER_QP_SOLVER_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <sp_const.hpp>
+#include <qp_problem.hpp>
+
+// CPLEX
+#include <ilcplex/ilocplex.h>
+
+// OSQP
+#ifdef USE_OSQP
+#include <osqp.h>
+#endif
+
+namespace DynamicPlanning {
+    struct QPSolution {
+        Eigen::VectorXd x;
+        double cost = 0;
+        double solve_time = 0; // [s], including model setup
+        int n_iteration = 0;
+        bool time_limit_reached = false; // the solver stopped at the time limit, x is the incumbent if any
+    };
+
+    // Interface of QP backends
+    class QPSolver {
+    public:
+        virtual ~QPSolver() = default;
+
+        // Return false if the problem is infeasible or the solver failed
+        virtual bool solve(const QPProblem &problem, QPSolution &solution) = 0;
+
+        // Drop cached factorization and warm start
+        virtual void reset() {}
+
+        virtual void setThreads(int _threads) {}
+
+        // [s], 0: unbounded. At the limit, solve returns the incumbent if the backend has one.
+        virtual void setTimeLimit(double _time_limit) {}
+
+        [[nodiscard]] virtual std::string getName() const = 0;
+    };
+
+    // Load QPProblem into Concert model
+    void loadQPProblemToCplex(IloModel model, IloNumVarArray x, IloRangeArray c, const QPProblem &problem);
+
+    class CplexQPSolver : public QPSolver {
+    public:
+        explicit CplexQPSolver(int threads = 6);
+
+        bool solve(const QPProblem &problem, QPSolution &solution) override;
+
+        void setThreads(int _threads) override { threads = _threads; }
+
+        void setTimeLimit(double _time_limit) override { time_limit = _time_limit; }
+
+        [[nodiscard]] std::string getName() const override { return "cplex"; }
+
+    private:
+        int threads;
+        double time_limit = 0;
+    };
+
+#ifdef USE_OSQP
+    // OSQP keeps the KKT factorization when the sparsity pattern is not changed
+    class OSQPSolver : public QPSolver {
+    public:
+        OSQPSolver();
+
+        ~OSQPSolver() override;
+
+        bool solve(const QPProblem &problem, QPSolution &solution) override;
+
+        void reset() override;
+
+        // Needs OSQP built with the profiling, otherwise it is unbounded
+        void setTimeLimit(double _time_limit) override { time_limit = _time_limit; }
+
+        [[nodiscard]] std::string getName() const override { return "osqp"; }
+
+    private:
+        struct CSC {
+            std::vector<c_int> p, i;
+            std::vector<c_float> x;
+        };
+
+        OSQPWorkspace *work = nullptr;
+        OSQPSettings settings{};
+        double time_limit = 0;
+
+        // Data of the previous problem, variable bounds are appended to A as identity rows
+        CSC P_cache, A_cache;
+        std::vector<c_float> q, l, u;
+
+        static CSC toCSC(const SparseMatrix &matrix);
+
+        static bool isPatternEqual(const CSC &a, const CSC &b);
+
+        bool setup(const QPProblem &problem);
+    };
+#endif
+
+    std::unique_ptr<QPSolver> createQPSolver(QPSolverMode mode);
+}
+
+#endif //LSC_PLANNER_QP_SOLVER_HPP
@@ -0,0 +1,53 @@
+#ifndef LSC_PLANNER_RANDOM_STREAM_HPP
+#define LSC_PLANNER_RANDOM_STREAM_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace DynamicPlanning {
+    // Counter-based random numbers (Philox4x32-10). The k-th number of a stream depends only on the seed, the
+    // stream and k, so the runs are bit-reproducible regardless of the order in which the streams are sampled.
+    // The normal numbers use Box-Muller instead of std::normal_distribution, whose output depends on the library.
+    class RandomStream {
+    public:
+        // The users of the streams, so that the streams of the same index do not overlap
+        enum Domain : uint32_t {
+            GAUSSIAN_OBSTACLE = 1,
+            OBSERVER_NOISE = 2,
+            GOAL_NOISE = 3,
+            MISSION_GENERATOR = 4,
+            NETWORK = 5,
+        };
+
+        RandomStream() = default;
+
+        RandomStream(uint64_t seed, Domain domain, uint32_t index);
+
+        uint32_t nextUInt();
+
+        // Uniform in [0, 1) with 53 random bits
+        double nextUniform();
+
+        double nextNormal(double mean, double stddev);
+
+        // Fill the buffer in bulk, the same numbers as size calls of nextUniform or nextNormal
+        void fillUniform(double *values, size_t size);
+
+        void fillNormal(double mean, double stddev, double *values, size_t size);
+
+        // Philox4x32-10 of the counter with the key
+        static std::array<uint32_t, 4> philox(std::array<uint32_t, 4> counter, std::array<uint32_t, 2> key);
+
+    private:
+        std::array<uint32_t, 2> key = {0, 0};
+        uint64_t stream = 0; // the upper half of the counter
+        uint64_t block_counter = 0; // the lower half of the counter
+        std::array<uint32_t, 4> block{};
+        size_t block_idx = 4; // the next unused word of the block, 4: empty
+        bool has_spare_normal = false;
+        double spare_normal = 0; // the second number of the last Box-Muller pair, standard normal
+    };
+}
+
+#endif //LSC_PLANNER_RANDOM_STREAM_HPP
@@ -0,0 +1,66 @@
+#ifndef LSC_PLANNER_RAYCAST_SENSOR_HPP
+#define LSC_PLANNER_RAYCAST_SENSOR_HPP
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <octomap/OcTree.h>
+
+namespace DynamicPlanning {
+    // Virtual depth sensor that traverses the voxels of each beam until the first occupied voxel of the ground truth.
+    // The occluded space behind an obstacle is not observed, unlike the points of the global map in a sphere.
+    // The ground truth is a bit grid aligned with the octomap grid, so a beam steps voxel by voxel (3D DDA) like
+    // OcTree::computeRayKeys, and the voxels are converted to octree keys by an offset without searching the tree.
+    // The beams are traversed in batches in the worker pool, the results are merged without duplicates.
+    class RaycastSensor {
+    public:
+        // horizontal_fov, vertical_fov, angular_resolution: [deg], horizontal_fov >= 360 is an omnidirectional LiDAR
+        RaycastSensor(const octomap::point3d &world_min, const octomap::point3d &world_max, double resolution,
+                      double range, double horizontal_fov, double vertical_fov, double angular_resolution);
+
+        // Ground truth
+        void markOccupied(const octomap::point3d &point);
+
+        // Cast the beams from the origin, the sensor faces the yaw [rad].
+        // free_keys and occupied_keys are disjoint and have no duplicates, the octree gives the key of the grid.
+        void sense(const octomap::OcTree &octree, const octomap::point3d &origin, double yaw,
+                   std::vector<octomap::OcTreeKey> &free_keys, std::vector<octomap::OcTreeKey> &occupied_keys);
+
+        [[nodiscard]] size_t getNumBeams() const { return beam_x.size(); }
+
+    private:
+        struct BeamBatch {
+            std::vector<std::array<int, 3>> free_voxels;
+            std::vector<std::array<int, 3>> hit_voxels;
+        };
+
+        octomap::point3d origin; // minimum corner of the voxel (0, 0, 0), aligned with the octomap grid
+        double resolution;
+        double range;
+        std::array<int, 3> size{}; // the number of voxels along each axis
+        std::vector<uint64_t> occupancy; // bit grid
+
+        // Unit directions of the beams in the sensor frame, x is the forward direction
+        std::vector<float> beam_x, beam_y, beam_z;
+        std::vector<float> rotated_x, rotated_y; // directions in the world frame, z is not changed by the yaw
+        std::vector<BeamBatch> batches;
+
+        // Deduplication of the merged voxels in the cube of the sensor range
+        int stamp_half_size;
+        std::vector<uint32_t> stamps;
+        uint32_t stamp;
+
+        [[nodiscard]] size_t voxelIndex(int i, int j, int k) const;
+
+        [[nodiscard]] bool isInside(const std::array<int, 3> &voxel) const;
+
+        [[nodiscard]] bool isOccupied(const std::array<int, 3> &voxel) const;
+
+        void castBeam(size_t beam_idx, const std::array<double, 3> &start, BeamBatch &batch) const;
+
+        // Returns true if the voxel is not merged yet in this sense, center is the voxel of the sensor origin
+        bool markMerged(const std::array<int, 3> &voxel, const std::array<int, 3> &center);
+    };
+}
+
+#endif //LSC_PLANNER_RAYCAST_SENSOR_HPP
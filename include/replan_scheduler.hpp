@@ -0,0 +1,52 @@
+#ifndef LSC_PLANNER_REPLAN_SCHEDULER_HPP
+#define LSC_PLANNER_REPLAN_SCHEDULER_HPP
+
+#include <functional>
+#include <queue>
+#include <vector>
+
+namespace DynamicPlanning {
+    // Replanning events of the agents with heterogeneous replanning rates.
+    // The period of an agent is an integer number of simulation steps, because the LSC requires the agents to plan
+    // on the same time grid. The events are kept in a priority queue ordered by their step, so a step pops only the
+    // agents that are due instead of scanning all agents.
+    class ReplanScheduler {
+    public:
+        // All agents are due at step 0, periods[qi] >= 1. A schedule resumed at first_step has the events of the
+        // same schedule from step 0 that are not before first_step.
+        void reset(const std::vector<int> &_periods, int first_step = 0) {
+            periods = _periods;
+            events = {};
+            for (size_t qi = 0; qi < periods.size(); qi++) {
+                int next_step = (first_step + periods[qi] - 1) / periods[qi] * periods[qi];
+                events.push({next_step, qi});
+            }
+        }
+
+        // Pop the agents due at the step in the ascending order of the index, and schedule their next events
+        void popDueAgents(int step, std::vector<size_t> &due_agents) {
+            due_agents.clear();
+            while (not events.empty() and events.top().step <= step) {
+                Event event = events.top();
+                events.pop();
+                due_agents.emplace_back(event.qi);
+                events.push({event.step + periods[event.qi], event.qi});
+            }
+        }
+
+    private:
+        struct Event {
+            int step;
+            size_t qi;
+
+            bool operator>(const Event &other) const {
+                return step > other.step or (step == other.step and qi > other.qi);
+            }
+        };
+
+        std::vector<int> periods;
+        std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+    };
+}
+
+#endif //LSC_PLANNER_REPLAN_SCHEDULER_HPP
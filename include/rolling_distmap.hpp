@@ -0,0 +1,89 @@
+#ifndef LSC_PLANNER_ROLLING_DISTMAP_HPP
+#define LSC_PLANNER_ROLLING_DISTMAP_HPP
+
+#include <array>
+#include <utility>
+#include <vector>
+#include <octomap/OcTree.h>
+#include <distance_map.hpp>
+#include <distance_transform.hpp>
+
+namespace DynamicPlanning {
+    // Distance map of a fixed-size window that follows the agent, so the memory and the update cost depend on the
+    // window size instead of the world size. The voxels are stored in a circular buffer indexed by the octree key
+    // modulo the window size, so scrolling the window reuses the cells that leave it without moving the others.
+    // The distances are truncated at max_dist, so a change of the occupancy affects the cells within max_dist only,
+    // and only those cells are recomputed by an exact separable distance transform (Felzenszwalb and Huttenlocher).
+    class RollingDistmap : public DistanceMap {
+    public:
+        typedef std::pair<octomap::point3d, octomap::point3d> Region;
+
+        // window_size [m] is clamped to the world boundary along each axis, the octree gives the grid
+        RollingDistmap(const octomap::OcTree &octree, const octomap::point3d &world_min,
+                       const octomap::point3d &world_max, double window_size, double max_dist);
+
+        // Scroll the window if the center is far from the window center, the voxels scrolled in are read from the
+        // octree. Returns true if the window moved, changed_regions are the boxes [m] whose distances changed,
+        // including the area that left the window.
+        bool moveTo(const octomap::OcTree &octree, const octomap::point3d &center,
+                    std::vector<Region> &changed_regions);
+
+        // The voxels outside the window are ignored
+        void setOccupied(const octomap::OcTreeKey &key, bool occupied);
+
+        // Recompute the distances around the voxels changed after the last update
+        void update();
+
+        // Same as BatchDistmap::query, the points outside the window are outside the map
+        void query(DistmapQueryBatch &batch) const override;
+
+        [[nodiscard]] bool isInWindow(const octomap::OcTreeKey &key) const;
+
+        // Does the box [m] intersect the window?
+        [[nodiscard]] bool intersectsWindow(const octomap::point3d &box_min, const octomap::point3d &box_max) const;
+
+        [[nodiscard]] octomap::point3d getWindowMin() const;
+
+        [[nodiscard]] octomap::point3d getWindowMax() const;
+
+        [[nodiscard]] size_t getNumCells() const { return occupancy.size(); }
+
+    private:
+        typedef std::array<int, 3> Index; // octree key as integers
+
+        double resolution;
+        Index origin_key; // the key of the coordinate (0, 0, 0)
+        Index world_min_key, world_max_key; // the window stays in [world_min_key, world_max_key]
+        Index size; // the number of voxels of the window along each axis
+        Index window_min; // the key of the minimum voxel of the window
+        Index shift_threshold; // the window scrolls if the center is off by this number of voxels
+        int max_sq_dist; // [voxel^2]
+        int max_dist_voxels; // [voxel], the range of influence of a voxel
+
+        std::vector<uint8_t> occupancy;
+        std::vector<int> sq_dists; // [voxel^2], INFINITE_SQ_DIST if there is no obstacle within max_dist
+        std::vector<Index> closest_keys; // the key of the closest obstacle
+
+        bool has_dirty_region;
+        Index dirty_min, dirty_max;
+
+        // Buffers of the distance transform in a box
+        std::vector<int> box_sq_dists, box_features;
+        DistanceTransformLine line;
+        std::vector<int> line_features;
+
+        [[nodiscard]] size_t cellIndex(const Index &key) const;
+
+        [[nodiscard]] Index toIndex(const octomap::OcTreeKey &key) const;
+
+        [[nodiscard]] octomap::point3d keyToCoord(const Index &key, double offset) const;
+
+        // Clear the voxels in [box_min, box_max], then read the occupied voxels from the octree
+        void resetBox(const octomap::OcTree &octree, const Index &box_min, const Index &box_max);
+
+        // Recompute the cells in [region_min, region_max] from the obstacles within max_dist of the region
+        void recompute(Index region_min, Index region_max);
+    };
+}
+
+#endif //LSC_PLANNER_ROLLING_DISTMAP_HPP
@@ -0,0 +1,57 @@
+#ifndef LSC_PLANNER_SAMPLED_STATES_HPP
+#define LSC_PLANNER_SAMPLED_STATES_HPP
+
+#include <vector>
+#include <sp_const.hpp>
+#include <trajectory.hpp>
+
+namespace DynamicPlanning {
+    // States of the agents sampled once per simulation step at t = k * time_step, k < n_samples.
+    // The fields are stored as structure of arrays, each field is [agent][sample] in one float array,
+    // so the samples of an agent are contiguous and the agents can be sampled concurrently.
+    class SampledStates {
+    public:
+        enum Field {
+            PX, PY, PZ,
+            VX, VY, VZ,
+            AX, AY, AZ,
+            N_FIELDS,
+        };
+
+        // Reuses the buffer if the size is the same
+        void resize(size_t qn, double time_step, size_t n_samples);
+
+        // Sample the trajectory of the agent. Thread-safe for different agents.
+        void sampleAgent(size_t qi, const traj_t &traj);
+
+        [[nodiscard]] size_t getNumAgents() const { return qn; }
+
+        [[nodiscard]] size_t getNumSamples() const { return n_samples; }
+
+        [[nodiscard]] double getTimeStep() const { return time_step; }
+
+        // n_samples values of the field of the agent
+        [[nodiscard]] const float *getField(Field field, size_t qi) const {
+            return data.data() + (field * qn + qi) * n_samples;
+        }
+
+        [[nodiscard]] point3d getPosition(size_t sample, size_t qi) const { return getPoint(PX, sample, qi); }
+
+        [[nodiscard]] State getState(size_t sample, size_t qi) const;
+
+    private:
+        friend class TrajectoryBundle;
+
+        size_t qn = 0, n_samples = 0;
+        double time_step = 0;
+        std::vector<float> data; // [field][agent][sample]
+
+        [[nodiscard]] float *getMutableField(Field field, size_t qi) {
+            return data.data() + (field * qn + qi) * n_samples;
+        }
+
+        [[nodiscard]] point3d getPoint(Field field_x, size_t sample, size_t qi) const;
+    };
+}
+
+#endif //LSC_PLANNER_SAMPLED_STATES_HPP
@@ -0,0 +1,33 @@
+#ifndef LSC_PLANNER_SERIALIZABLE_DISTMAP_HPP
+#define LSC_PLANNER_SERIALIZABLE_DISTMAP_HPP
+
+#include <cstdint>
+#include <string>
+#include <octomap/octomap.h>
+#include <batch_distmap.hpp>
+
+namespace DynamicPlanning {
+    // DynamicEDTOctomap whose distance field is saved to a file, so the distance transform of a static world
+    // is computed once. The file stores the cells of the distance field (the distance and the closest obstacle)
+    // after update(), with a hash of the map to invalidate it if the world file or the grid changes.
+    class SerializableDistmap : public BatchDistmap {
+    public:
+        SerializableDistmap(float max_dist, octomap::OcTree *octree, const octomap::point3d &bbx_min,
+                            const octomap::point3d &bbx_max, bool treat_unknown_as_occupied)
+                : BatchDistmap(max_dist, octree, bbx_min, bbx_max, treat_unknown_as_occupied) {}
+
+        // Replace update() by the cells in the file. Returns false if the file is missing, broken or made for
+        // another map, then the distance field is not changed.
+        bool load(const std::string &file_name, uint64_t map_hash);
+
+        // Save the cells, call after update()
+        bool save(const std::string &file_name, uint64_t map_hash) const;
+
+        // Hash of the world file and the parameters of the distance field
+        [[nodiscard]] static uint64_t computeMapHash(const std::string &world_file_name, double resolution,
+                                                     const octomap::point3d &bbx_min,
+                                                     const octomap::point3d &bbx_max, float max_dist);
+    };
+}
+
+#endif //LSC_PLANNER_SERIALIZABLE_DISTMAP_HPP
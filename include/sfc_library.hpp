@@ -0,0 +1,101 @@
+#ifndef LSC_PLANNER_SFC_LIBRARY_HPP
+#define LSC_PLANNER_SFC_LIBRARY_HPP
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+#include <functional>
+#include <octomap/octomap_types.h>
+#include <boost/geometry.hpp>
+#include <boost/geometry/index/rtree.hpp>
+
+namespace DynamicPlanning {
+    struct SFCLibraryStatistics {
+        int n_query = 0;
+        int n_hit = 0;
+        int n_invalidated = 0; // cached boxes removed because they collide with the current map
+        int n_expansion = 0;
+        double expansion_time = 0; // [s], total time of the expansions after a miss
+        double hit_time = 0; // [s], total time of the queries that hit
+
+        [[nodiscard]] double getHitRate() const {
+            return n_query > 0 ? static_cast<double>(n_hit) / n_query : 0;
+        }
+
+        // Estimated by the average expansion time
+        [[nodiscard]] double getTimeSaved() const {
+            return n_expansion > 0 ? n_hit * expansion_time / n_expansion - hit_time : 0;
+        }
+    };
+
+    // Process-wide library of expanded SFC boxes shared by all agents.
+    // Boxes are indexed by an R-tree, and a query returns the largest cached box that covers the seed box.
+    // Boxes are validated against the map of the caller in every query, so the entries in the region
+    // where the map has changed are removed lazily.
+    // In the deferred mode, insertions and removals are applied at commit in a fixed order, so that the agents
+    // planning concurrently in a step see the same library regardless of the schedule.
+    class SFCLibrary {
+    public:
+        // Returns true if the box is still collision-free for the caller
+        typedef std::function<bool(const octomap::point3d &, const octomap::point3d &)> Validator;
+
+        static SFCLibrary &getInstance();
+
+        // If capacity <= 0, the library is not bounded
+        void setCapacity(int capacity);
+
+        bool find(const octomap::point3d &seed_min, const octomap::point3d &seed_max, double margin,
+                  const Validator &is_valid, octomap::point3d &box_min, octomap::point3d &box_max);
+
+        // expansion_time: time to expand the box after the miss, used to estimate the time saved
+        void insert(const octomap::point3d &box_min, const octomap::point3d &box_max, double margin,
+                    double expansion_time);
+
+        // Deferred mode: the changes are pending until commit. Disabling the deferred mode commits the changes.
+        void setDeferred(bool deferred);
+
+        void commit();
+
+        void clear();
+
+        [[nodiscard]] size_t size() const;
+
+        [[nodiscard]] SFCLibraryStatistics getStatistics() const;
+
+        void resetStatistics();
+
+    private:
+        typedef boost::geometry::model::point<double, 3, boost::geometry::cs::cartesian> IndexPoint;
+        typedef boost::geometry::model::box<IndexPoint> IndexBox;
+        typedef std::pair<IndexBox, uint64_t> IndexValue;
+
+        struct Entry {
+            IndexBox box;
+            double margin;
+        };
+
+        SFCLibrary();
+
+        void insertImpl(const IndexBox &index_box, double margin);
+
+        void commitImpl();
+
+        void remove(uint64_t id);
+
+        static IndexBox toIndexBox(const octomap::point3d &box_min, const octomap::point3d &box_max);
+
+        mutable std::mutex mtx;
+        boost::geometry::index::rtree<IndexValue, boost::geometry::index::quadratic<16>> rtree;
+        std::map<uint64_t, Entry> entries; // the oldest entry is evicted first
+        uint64_t next_id;
+        int capacity;
+        SFCLibraryStatistics statistics;
+
+        bool is_deferred;
+        std::vector<Entry> pending_inserts;
+        std::set<uint64_t> pending_removals;
+    };
+}
+
+#endif //LSC_PLANNER_SFC_LIBRARY_HPP
@@ -0,0 +1,53 @@
+#ifndef LSC_PLANNER_SIMULATION_CHECKPOINT_HPP
+#define LSC_PLANNER_SIMULATION_CHECKPOINT_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sp_const.hpp>
+#include <agent_manager.hpp>
+#include <random_stream.hpp>
+
+namespace DynamicPlanning {
+    // The state of a simulation between two steps, saved by MultiSyncSimulator::saveCheckpoint. A mission resumed
+    // from it continues from the step instead of from the start, and several simulators restore the same checkpoint
+    // with different parameters to branch the mission.
+    // The maps are referred to by the world file, so only the missions with a static global map are checkpointed.
+    // The caches of the planners, the warm starts and the rolling MAPF plans are not included, they are rebuilt by
+    // the next step. The file is MAGIC, VERSION, then the fields in the order of the declaration.
+    struct SimulationCheckpoint {
+        static const char MAGIC[8];
+        static constexpr uint32_t VERSION = 1; // incremented when the fields are changed
+
+        // Checked against the simulator at the restore
+        std::string mission_file_name, world_file_name; // relative to the package
+        uint32_t n_agents = 0;
+        int M = 0, n = 0;
+        double dt = 0;
+
+        // Simulator
+        int sim_step = 0;
+        double sim_time = 0; // [s] since the start of the mission
+        PlannerState planner_state = PlannerState::GOTO;
+        PlannerState finish_check_state = PlannerState::GOTO;
+        uint64_t finish_check_idx = 0;
+        bool is_collided = false;
+        double safety_ratio_agent = 0, safety_ratio_obs = 0;
+        double total_distance = 0;
+        point3d vel_excess_ratio, acc_excess_ratio;
+        points_t last_sampled_positions; // [agent]
+        uint64_t n_replanned = 0, n_held = 0, n_hovered = 0;
+        RandomStream observer_noise_stream;
+
+        // [agent], the statistics and the caches of the planners are not saved to the file
+        std::vector<AgentManager::Checkpoint> agents;
+
+        // Write and read with the planning capture archive, false if the file can not be written or is not a
+        // checkpoint of this version
+        [[nodiscard]] bool save(const std::string &file_name) const;
+
+        bool load(const std::string &file_name);
+    };
+}
+
+#endif //LSC_PLANNER_SIMULATION_CHECKPOINT_HPP
@@ -0,0 +1,94 @@
+#ifndef LSC_PLANNER_SOLVER_THREAD_SCHEDULER_HPP
+#define LSC_PLANNER_SOLVER_THREAD_SCHEDULER_HPP
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+
+namespace DynamicPlanning {
+    struct SolverThreadStatistics {
+        int n_request = 0;
+        double total_wait_time = 0; // [s]
+        double max_wait_time = 0; // [s]
+        double total_threads = 0; // sum of granted threads
+
+        [[nodiscard]] double getAverageWaitTime() const {
+            return n_request > 0 ? total_wait_time / n_request : 0;
+        }
+
+        [[nodiscard]] double getAverageThreads() const {
+            return n_request > 0 ? total_threads / n_request : 0;
+        }
+    };
+
+    class SolverThreadScheduler;
+
+    // Solver threads granted to one solve, returned to the scheduler when destroyed
+    class SolverThreadLease {
+    public:
+        SolverThreadLease(const SolverThreadLease &) = delete;
+
+        SolverThreadLease &operator=(const SolverThreadLease &) = delete;
+
+        SolverThreadLease(SolverThreadLease &&other) noexcept;
+
+        ~SolverThreadLease();
+
+        [[nodiscard]] int getThreads() const { return threads; }
+
+    private:
+        friend class SolverThreadScheduler;
+
+        SolverThreadLease(SolverThreadScheduler *scheduler, size_t problem_size, int threads);
+
+        SolverThreadScheduler *scheduler;
+        size_t problem_size;
+        int threads;
+        std::chrono::steady_clock::time_point start_time;
+    };
+
+    // Process-wide budget of solver threads shared by all agents.
+    // Threads are distributed by the number of agents planning now and the size of their problems.
+    class SolverThreadScheduler {
+    public:
+        static SolverThreadScheduler &getInstance();
+
+        // If total_threads <= 0, use the number of cores
+        void setTotalThreads(int total_threads);
+
+        // Block until at least one thread is available
+        SolverThreadLease acquire(int agent_id, size_t problem_size);
+
+        [[nodiscard]] int getTotalThreads() const;
+
+        [[nodiscard]] SolverThreadStatistics getStatistics(int agent_id) const;
+
+        [[nodiscard]] SolverThreadStatistics getTotalStatistics() const;
+
+        // Busy thread time / (total threads * elapsed time)
+        [[nodiscard]] double getUtilization() const;
+
+        void resetStatistics();
+
+    private:
+        SolverThreadScheduler();
+
+        void release(size_t problem_size, int threads, double busy_time);
+
+        friend class SolverThreadLease;
+
+        mutable std::mutex mtx;
+        std::condition_variable cv;
+        int total_threads;
+        int available_threads;
+        int n_waiting, n_running;
+        size_t waiting_size_sum, running_size_sum;
+
+        std::map<int, SolverThreadStatistics> statistics;
+        double busy_thread_time;
+        std::chrono::steady_clock::time_point statistics_start_time;
+    };
+}
+
+#endif //LSC_PLANNER_SOLVER_THREAD_SCHEDULER_HPP
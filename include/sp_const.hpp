@@ -6,10 +6,14 @@
 #define PI 3.1415
 
 #include <stdexcept>
+#include <algorithm>
+#include <tuple>
 #include <ros/ros.h>
 #include <octomap/OcTree.h>
 #include <std_msgs/Float64MultiArray.h>
 #include <std_msgs/MultiArrayDimension.h>
+#include <latency_histogram.hpp>
+#include <alloc_stats.hpp>
 
 namespace DynamicPlanning {
     typedef octomap::point3d point3d;
@@ -59,6 +63,26 @@ namespace DynamicPlanning {
     enum class MAPFMode {
         PIBT,
         ECBS,
+        CBS,
+        ICBS,
+        HCA,
+        WHCA,
+        WINPIBT,
+        PIBT_COMPLETE,
+        PUSH_AND_SWAP,
+        REVISIT_PP,
+        IR,
+        PORTFOLIO, // runs the solvers of mode/mapf_portfolio concurrently
+    };
+
+    enum class QPSolverMode {
+        CPLEX,
+        OSQP,
+    };
+
+    enum class SensorMode {
+        SPHERE, // all points of the global map within the sensor range
+        RAYCAST, // beams stop at the first obstacle
     };
 
     enum PlannerState {
@@ -74,6 +98,7 @@ namespace DynamicPlanning {
         INITTRAJGENERATIONFAILED,
         CONSTRAINTGENERATIONFAILED,
         QPFAILED,
+        QPTIMEOUT, // the QP solver stopped at the time limit without a solution
         WAITFORROSMSG,
         SUCCESS,
     };
@@ -98,6 +123,16 @@ namespace DynamicPlanning {
             average = (average * (N_sample - 1) + time) / N_sample;
         }
 
+        void merge(const PlanningTime& other){
+            if(other.N_sample == 0){
+                return;
+            }
+            min = std::min(min, other.min);
+            max = std::max(max, other.max);
+            average = (average * N_sample + other.average * other.N_sample) / (N_sample + other.N_sample);
+            N_sample += other.N_sample;
+        }
+
         double current = 0;
         double min = SP_INFINITY;
         double max = 0;
@@ -105,31 +140,367 @@ namespace DynamicPlanning {
         int N_sample = 0;
     };
 
+    // CPU time of a stage including the workers of the pool, and the wall time the planning thread did not run
+    struct StageCPUTime {
+        void update(double cpu, double wait){
+            cpu_time.update(cpu);
+            wait_time.update(wait);
+        }
+
+        // The current times of other, e.g. the last planning cycle of an agent
+        void update(const StageCPUTime& other){
+            update(other.cpu_time.current, other.wait_time.current);
+        }
+
+        PlanningTime cpu_time;
+        PlanningTime wait_time;
+    };
+
     struct PlanningTimeStatistics {
-        void update(PlanningTimeStatistics new_planning_time){
+        void update(const PlanningTimeStatistics& new_planning_time){
             mapf_time.update(new_planning_time.mapf_time.current);
             initial_traj_planning_time.update(new_planning_time.initial_traj_planning_time.current);
             obstacle_prediction_time.update(new_planning_time.obstacle_prediction_time.current);
+            obstacle_traj_prediction_time.update(new_planning_time.obstacle_traj_prediction_time.current);
+            obstacle_size_prediction_time.update(new_planning_time.obstacle_size_prediction_time.current);
             goal_planning_time.update(new_planning_time.goal_planning_time.current);
             lsc_generation_time.update(new_planning_time.lsc_generation_time.current);
             sfc_generation_time.update(new_planning_time.sfc_generation_time.current);
             traj_optimization_time.update(new_planning_time.traj_optimization_time.current);
             total_planning_time.update(new_planning_time.total_planning_time.current);
+            initial_traj_planning_cpu.update(new_planning_time.initial_traj_planning_cpu);
+            obstacle_prediction_cpu.update(new_planning_time.obstacle_prediction_cpu);
+            goal_planning_cpu.update(new_planning_time.goal_planning_cpu);
+            lsc_generation_cpu.update(new_planning_time.lsc_generation_cpu);
+            sfc_generation_cpu.update(new_planning_time.sfc_generation_cpu);
+            traj_optimization_cpu.update(new_planning_time.traj_optimization_cpu);
+            total_planning_cpu.update(new_planning_time.total_planning_cpu);
+
+            initial_traj_planning_histogram.record(new_planning_time.initial_traj_planning_time.current);
+            obstacle_prediction_histogram.record(new_planning_time.obstacle_prediction_time.current);
+            goal_planning_histogram.record(new_planning_time.goal_planning_time.current);
+            lsc_generation_histogram.record(new_planning_time.lsc_generation_time.current);
+            sfc_generation_histogram.record(new_planning_time.sfc_generation_time.current);
+            traj_optimization_histogram.record(new_planning_time.traj_optimization_time.current);
+            total_planning_histogram.record(new_planning_time.total_planning_time.current);
+        }
+
+        // Merge the histograms only, e.g. the statistics of several missions
+        void mergeHistograms(const PlanningTimeStatistics& other){
+            step_wall_histogram.merge(other.step_wall_histogram);
+            mapf_histogram.merge(other.mapf_histogram);
+            initial_traj_planning_histogram.merge(other.initial_traj_planning_histogram);
+            obstacle_prediction_histogram.merge(other.obstacle_prediction_histogram);
+            goal_planning_histogram.merge(other.goal_planning_histogram);
+            lsc_generation_histogram.merge(other.lsc_generation_histogram);
+            sfc_generation_histogram.merge(other.sfc_generation_histogram);
+            traj_optimization_histogram.merge(other.traj_optimization_histogram);
+            total_planning_histogram.merge(other.total_planning_histogram);
+        }
+
+        // The histograms of the stages with their names in the summary
+        [[nodiscard]] std::vector<std::pair<std::string, const LatencyHistogram*>> getHistograms() const{
+            return {{"step_wall_time", &step_wall_histogram},
+                    {"mapf_time", &mapf_histogram},
+                    {"initial_traj_planning_time", &initial_traj_planning_histogram},
+                    {"obstacle_prediction_time", &obstacle_prediction_histogram},
+                    {"goal_planning_time", &goal_planning_histogram},
+                    {"lsc_generation_time", &lsc_generation_histogram},
+                    {"sfc_generation_time", &sfc_generation_histogram},
+                    {"traj_optimization_time", &traj_optimization_histogram},
+                    {"planning_time", &total_planning_histogram}};
+        }
+
+        // The CPU times and the wall times of the stages with the prefixes of their names in the summary
+        [[nodiscard]] std::vector<std::tuple<std::string, const StageCPUTime*, const PlanningTime*>>
+        getCPUStages() const{
+            return {{"initial_traj_planning", &initial_traj_planning_cpu, &initial_traj_planning_time},
+                    {"obstacle_prediction", &obstacle_prediction_cpu, &obstacle_prediction_time},
+                    {"goal_planning", &goal_planning_cpu, &goal_planning_time},
+                    {"lsc_generation", &lsc_generation_cpu, &lsc_generation_time},
+                    {"sfc_generation", &sfc_generation_cpu, &sfc_generation_time},
+                    {"traj_optimization", &traj_optimization_cpu, &traj_optimization_time},
+                    {"planning", &total_planning_cpu, &total_planning_time}};
         }
 
         PlanningTime mapf_time;
+        // Static layer of the MAPF grid map, recorded by the simulator only, so they are not in update()
+        PlanningTime mapf_grid_update_time;
+        PlanningTime mapf_grid_time_saved; // estimated by the time per cell of the last full rebuild
+        PlanningTime mapf_grid_dirty_ratio; // the ratio of the cells thresholded again, 1 for a full rebuild
+        PlanningTime mapf_round_time; // all groups of a step including the grid map update
+        PlanningTime mapf_group_imbalance; // the slowest group over the average group, steps with several groups
+        // Planning of all agents in a simulation step, recorded by the simulator only
+        PlanningTime step_wall_time;
+        PlanningTime step_cpu_time; // the sum of the CPU time of the threads planning the agents
+        // Quantized trajectory broadcast, recorded by the simulator only
+        PlanningTime trajectory_encode_time; // per agent
+        PlanningTime trajectory_decode_time; // per received frame
+        PlanningTime trajectory_broadcast_bytes; // the frames received per agent per step
+        PlanningTime network_delay; // [s], from the send to the delivery of the simulated packets of a step
+        // Distributed simulation, recorded by the simulator only
+        PlanningTime agent_exchange_time; // the exchange of the agents including the wait for the other processes
+        PlanningTime agent_exchange_bytes; // the blocks received per step
+        // Batched QP solver of a step, recorded by the simulator only
+        PlanningTime batch_qp_time;
         PlanningTime initial_traj_planning_time;
         PlanningTime obstacle_prediction_time;
+        PlanningTime obstacle_traj_prediction_time; // the trajectory model of the prediction mode
+        PlanningTime obstacle_size_prediction_time; // the constant acceleration model of the size
         PlanningTime goal_planning_time;
         PlanningTime lsc_generation_time;
         PlanningTime sfc_generation_time;
         PlanningTime traj_optimization_time;
         PlanningTime total_planning_time;
+        // CPU and wait time of the stages above, measured on the thread planning the agent
+        StageCPUTime initial_traj_planning_cpu;
+        StageCPUTime obstacle_prediction_cpu;
+        StageCPUTime goal_planning_cpu;
+        StageCPUTime lsc_generation_cpu;
+        StageCPUTime sfc_generation_cpu;
+        StageCPUTime traj_optimization_cpu;
+        StageCPUTime total_planning_cpu;
+        // Latency of the stages for the percentiles, recorded by update() from the agents and by the simulator for the
+        // MAPF groups and the steps. The planners of the agents do not record them, so their statistics are cheap to
+        // copy.
+        LatencyHistogram step_wall_histogram;
+        LatencyHistogram mapf_histogram;
+        LatencyHistogram initial_traj_planning_histogram;
+        LatencyHistogram obstacle_prediction_histogram;
+        LatencyHistogram goal_planning_histogram;
+        LatencyHistogram lsc_generation_histogram;
+        LatencyHistogram sfc_generation_histogram;
+        LatencyHistogram traj_optimization_histogram;
+        LatencyHistogram total_planning_histogram;
+    };
+
+    // QP solves split by whether they are warm started from the previous solution
+    struct QPStatistics {
+        void update(int n_iteration, double solve_time, bool warm_started){
+            if(warm_started){
+                warm_iterations.update(n_iteration);
+                warm_solve_time.update(solve_time);
+            }
+            else{
+                cold_iterations.update(n_iteration);
+                cold_solve_time.update(solve_time);
+            }
+        }
+
+        void updatePruning(int n_collision_rows, int n_pruned_rows, int n_redundant_rows){
+            collision_rows.update(n_collision_rows);
+            pruned_rows.update(n_pruned_rows);
+            redundant_rows.update(n_redundant_rows);
+        }
+
+        void merge(const QPStatistics& other){
+            warm_iterations.merge(other.warm_iterations);
+            cold_iterations.merge(other.cold_iterations);
+            warm_solve_time.merge(other.warm_solve_time);
+            cold_solve_time.merge(other.cold_solve_time);
+            collision_rows.merge(other.collision_rows);
+            pruned_rows.merge(other.pruned_rows);
+            redundant_rows.merge(other.redundant_rows);
+        }
+
+        // 1 - warm / cold, 0 if there is no sample to compare
+        [[nodiscard]] double getIterationReduction() const {
+            return getReduction(warm_iterations, cold_iterations);
+        }
+
+        [[nodiscard]] double getLatencyReduction() const {
+            return getReduction(warm_solve_time, cold_solve_time);
+        }
+
+        // Ratio of the LSC rows left out of the QP
+        [[nodiscard]] double getPruningRatio() const {
+            return collision_rows.average > 0 ? pruned_rows.average / collision_rows.average : 0;
+        }
+
+        PlanningTime warm_iterations; // the number of iterations, not time
+        PlanningTime cold_iterations;
+        PlanningTime warm_solve_time;
+        PlanningTime cold_solve_time;
+        PlanningTime collision_rows; // the number of LSC rows, not time
+        PlanningTime pruned_rows; // including the redundant rows
+        PlanningTime redundant_rows; // rows removed by CollisionConstraints::reduceLSCs
+
+    private:
+        static double getReduction(const PlanningTime& warm, const PlanningTime& cold){
+            if(warm.N_sample == 0 or cold.N_sample == 0 or cold.average <= 0){
+                return 0;
+            }
+            return 1 - warm.average / cold.average;
+        }
+    };
+
+    // Normal vectors of LSCs reused from the previous step
+    struct LSCCacheStatistics {
+        void update(int n_query_new, int n_hit_new){
+            n_query += n_query_new;
+            n_hit += n_hit_new;
+        }
+
+        void merge(const LSCCacheStatistics& other){
+            update(other.n_query, other.n_hit);
+        }
+
+        [[nodiscard]] double getHitRate() const {
+            return n_query > 0 ? static_cast<double>(n_hit) / n_query : 0;
+        }
+
+        int n_query = 0;
+        int n_hit = 0;
+    };
+
+    // Obstacles left out by the neighbor selection of the planner
+    struct NeighborStatistics {
+        void update(int n_candidates, int n_unreachable, int n_capped){
+            candidates.update(n_candidates);
+            unreachable.update(n_unreachable);
+            capped.update(n_capped);
+        }
+
+        void merge(const NeighborStatistics& other){
+            candidates.merge(other.candidates);
+            unreachable.merge(other.unreachable);
+            capped.merge(other.capped);
+        }
+
+        // Ratio of the obstacles left out of the constraint generation
+        [[nodiscard]] double getPruningRatio() const {
+            return candidates.average > 0 ? (unreachable.average + capped.average) / candidates.average : 0;
+        }
+
+        PlanningTime candidates; // the number of obstacles received, not time
+        PlanningTime unreachable; // no contact is possible within the horizon
+        PlanningTime capped; // reachable, but over max_neighbors
+    };
+
+    // Segments planned by the adaptive horizon
+    struct HorizonStatistics {
+        void update(int n_segments, bool is_switched){
+            segments.update(n_segments);
+            if(is_switched){
+                n_switches++;
+            }
+        }
+
+        void merge(const HorizonStatistics& other){
+            segments.merge(other.segments);
+            n_switches += other.n_switches;
+        }
+
+        PlanningTime segments; // the number of segments, not time
+        int n_switches = 0; // the cycles that changed the number of segments
+    };
+
+    // Sampled trajectories used after the QP failures
+    struct FallbackStatistics {
+        void update(bool is_feasible, int n_checked, double time){
+            n_fallbacks++;
+            if(is_feasible){
+                n_feasible++;
+            }
+            candidates.update(n_checked);
+            planning_time.update(time);
+        }
+
+        void merge(const FallbackStatistics& other){
+            n_fallbacks += other.n_fallbacks;
+            n_feasible += other.n_feasible;
+            candidates.merge(other.candidates);
+            planning_time.merge(other.planning_time);
+        }
+
+        int n_fallbacks = 0; // the QPs failed
+        int n_feasible = 0; // a feasible candidate replaced the initial trajectory
+        PlanningTime candidates; // the candidates checked, not time
+        PlanningTime planning_time;
+    };
+
+    // Planning cycles that ran short of deadline/budget, counted by the degraded mode of the stage
+    struct DeadlineStatistics {
+        void merge(const DeadlineStatistics& other){
+            n_cycles += other.n_cycles;
+            n_cycles_over_budget += other.n_cycles_over_budget;
+            n_sfc_reused += other.n_sfc_reused;
+            n_qp_anytime += other.n_qp_anytime;
+            n_qp_fallback += other.n_qp_fallback;
+        }
+
+        [[nodiscard]] int getNumMisses() const {
+            return n_sfc_reused + n_qp_anytime + n_qp_fallback;
+        }
+
+        int n_cycles = 0; // cycles with a deadline
+        int n_cycles_over_budget = 0; // the total planning time is over the budget despite the degraded modes
+        int n_sfc_reused = 0; // the previous SFCs are reused instead of the expansion
+        int n_qp_anytime = 0; // the QP stopped at the time limit and its incumbent is used
+        int n_qp_fallback = 0; // the QP had no valid solution in time, the shifted previous trajectory is used
+    };
+
+    // Heap allocations of a stage per planning cycle, recorded if the package is built with ENABLE_ALLOC_STATS
+    struct AllocStageStatistics {
+        void update(const AllocCounts& counts){
+            n_allocations.update(static_cast<double>(counts.n_allocations));
+            bytes.update(static_cast<double>(counts.bytes));
+            peak_live_bytes.update(static_cast<double>(counts.peak_live_bytes));
+        }
+
+        void merge(const AllocStageStatistics& other){
+            n_allocations.merge(other.n_allocations);
+            bytes.merge(other.bytes);
+            peak_live_bytes.merge(other.peak_live_bytes);
+        }
+
+        PlanningTime n_allocations;
+        PlanningTime bytes;
+        PlanningTime peak_live_bytes; // over the live bytes at the start of the stage
+    };
+
+    // The stages of PlanningTimeStatistics, measured on the thread planning the agent
+    struct AllocStatistics {
+        void merge(const AllocStatistics& other){
+            initial_traj_planning.merge(other.initial_traj_planning);
+            obstacle_prediction.merge(other.obstacle_prediction);
+            goal_planning.merge(other.goal_planning);
+            lsc_generation.merge(other.lsc_generation);
+            sfc_generation.merge(other.sfc_generation);
+            traj_optimization.merge(other.traj_optimization);
+            total_planning.merge(other.total_planning);
+        }
+
+        // The stages with the prefixes of their names in the summary
+        [[nodiscard]] std::vector<std::pair<std::string, const AllocStageStatistics*>> getStages() const{
+            return {{"initial_traj_planning", &initial_traj_planning},
+                    {"obstacle_prediction", &obstacle_prediction},
+                    {"goal_planning", &goal_planning},
+                    {"lsc_generation", &lsc_generation},
+                    {"sfc_generation", &sfc_generation},
+                    {"traj_optimization", &traj_optimization},
+                    {"planning", &total_planning}};
+        }
+
+        AllocStageStatistics initial_traj_planning;
+        AllocStageStatistics obstacle_prediction;
+        AllocStageStatistics goal_planning;
+        AllocStageStatistics lsc_generation;
+        AllocStageStatistics sfc_generation;
+        AllocStageStatistics traj_optimization;
+        AllocStageStatistics total_planning;
     };
 
     struct PlanningStatistics {
         int planning_seq = 0;
         PlanningTimeStatistics planning_time;
+        QPStatistics qp;
+        LSCCacheStatistics lsc_cache;
+        NeighborStatistics neighbor;
+        HorizonStatistics horizon;
+        FallbackStatistics fallback;
+        AllocStatistics alloc;
+        DeadlineStatistics deadline;
     };
 
     enum ObstacleType {
@@ -156,6 +527,7 @@ namespace DynamicPlanning {
         double radius;
         double downwash;
         double nominal_velocity;
+        int replanning_period = 1; // the number of simulation steps between the replanning of the agent
         bool collision_alert;
     };
 
@@ -0,0 +1,116 @@
+#ifndef LSC_PLANNER_SPARSE_VOXEL_MAP_HPP
+#define LSC_PLANNER_SPARSE_VOXEL_MAP_HPP
+
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <octomap/OcTree.h>
+#include <distance_map.hpp>
+
+namespace DynamicPlanning {
+    // Occupancy and distance field of the world in sparse leaf blocks of 8^3 voxels, like the leaf level of VDB.
+    // Only the blocks that hold an occupied voxel or a voxel within max_dist of one are allocated, so the memory
+    // depends on the obstacles instead of the world size. A voxel of a missing block has no obstacle within max_dist.
+    // The distances are truncated at max_dist, so a block depends on the blocks within max_dist only, and the dirty
+    // blocks are recomputed independently on the worker pool by the separable distance transform of RollingDistmap.
+    class SparseVoxelMap : public DistanceMap {
+    public:
+        static constexpr int BLOCK_BITS = 3;
+        static constexpr int BLOCK_SIZE = 1 << BLOCK_BITS; // voxels along each axis of a block
+        static constexpr int BLOCK_VOLUME = BLOCK_SIZE * BLOCK_SIZE * BLOCK_SIZE;
+
+        typedef std::array<int, 3> Index; // octree key as integers
+
+        struct Block {
+            Index origin; // the key of the minimum voxel
+            int n_occupied = 0;
+            std::array<uint8_t, BLOCK_VOLUME> occupancy{};
+            std::array<int, BLOCK_VOLUME> sq_dists{}; // [voxel^2], INFINITE_SQ_DIST if no obstacle within max_dist
+            std::array<Index, BLOCK_VOLUME> closest_keys{}; // the key of the closest obstacle
+        };
+
+        // Caches the last block, so the queries of nearby voxels skip the hash lookup. An accessor is used by one
+        // thread, and it is invalidated by the update of the map.
+        class Accessor {
+        public:
+            explicit Accessor(const SparseVoxelMap &map) : map(map) {}
+
+            // nullptr if the block of the key is not allocated
+            const Block *getBlock(const Index &key);
+
+            [[nodiscard]] bool isOccupied(const Index &key);
+
+        private:
+            const SparseVoxelMap &map;
+            uint64_t cached_block_key = UINT64_MAX;
+            const Block *cached_block = nullptr;
+        };
+
+        // The octree gives the grid, only the voxels of the world are stored
+        SparseVoxelMap(const octomap::OcTree &octree, const octomap::point3d &world_min,
+                       const octomap::point3d &world_max, double max_dist);
+
+        // The voxels outside the world are ignored
+        void setOccupied(const octomap::OcTreeKey &key, bool occupied);
+
+        // Mark the voxels occupied in bulk, the keys are grouped by block and the blocks are filled in parallel
+        void insertOccupied(const std::vector<octomap::OcTreeKey> &keys);
+
+        // Recompute the distances of the blocks within max_dist of the voxels changed after the last update
+        void update();
+
+        // Same as BatchDistmap::query, the points outside the world are outside the map
+        void query(DistmapQueryBatch &batch) const override;
+
+        [[nodiscard]] bool isOccupied(const octomap::point3d &point) const;
+
+        // The number of occupied voxels whose center is in [box_min, box_max]
+        [[nodiscard]] uint32_t countOccupied(const octomap::point3d &box_min, const octomap::point3d &box_max) const;
+
+        // Is there any occupied voxel whose center is in [box_min - margin, box_max + margin]?
+        [[nodiscard]] bool isOccupied(const octomap::point3d &box_min, const octomap::point3d &box_max,
+                                      double margin) const;
+
+        [[nodiscard]] size_t getNumBlocks() const { return block_ids.size(); }
+
+    private:
+        double resolution;
+        Index origin_key; // the key of the coordinate (0, 0, 0)
+        Index world_min_key, world_max_key;
+        int max_sq_dist; // [voxel^2]
+        int max_dist_voxels; // [voxel], the range of influence of a voxel
+        int block_radius; // [block], the blocks within max_dist of a block
+
+        // The blocks are stored by value, so the map is copied with the default copy constructor
+        std::vector<Block> blocks;
+        std::vector<int> free_block_ids;
+        std::unordered_map<uint64_t, int> block_ids;
+        std::vector<uint64_t> dirty_block_keys; // the blocks whose occupancy changed after the last update
+
+        [[nodiscard]] static uint64_t blockKey(const Index &key);
+
+        [[nodiscard]] static Index blockOrigin(uint64_t block_key);
+
+        [[nodiscard]] static int voxelIndex(const Index &key);
+
+        [[nodiscard]] bool isInWorld(const Index &key) const;
+
+        [[nodiscard]] Index toIndex(const octomap::point3d &point) const;
+
+        [[nodiscard]] const Block *findBlock(uint64_t block_key) const;
+
+        Block &getOrCreateBlock(uint64_t block_key);
+
+        void markDirty(uint64_t block_key);
+
+        // Distance transform of the block from the obstacles within max_dist of it
+        void recomputeBlock(Block &block) const;
+
+        // Range of the keys of the voxels whose center is in [box_min, box_max], returns false if empty
+        [[nodiscard]] bool voxelRange(const octomap::point3d &box_min, const octomap::point3d &box_max,
+                                      Index &range_min, Index &range_max) const;
+    };
+}
+
+#endif //LSC_PLANNER_SPARSE_VOXEL_MAP_HPP
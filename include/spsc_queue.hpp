@@ -0,0 +1,65 @@
+#ifndef LSC_PLANNER_SPSC_QUEUE_HPP
+#define LSC_PLANNER_SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <vector>
+
+namespace DynamicPlanning {
+    // Bounded lock-free queue between one producer thread and one consumer thread.
+    // The producer only writes tail and the consumer only writes head, so no operation waits for the other thread.
+    template<typename T>
+    class SPSCQueue {
+    public:
+        explicit SPSCQueue(size_t capacity) : buffer(capacity + 1) {}
+
+        SPSCQueue(const SPSCQueue &) = delete;
+
+        SPSCQueue &operator=(const SPSCQueue &) = delete;
+
+        // Producer only, returns false if the queue is full
+        bool tryPush(T &&value) {
+            size_t current_tail = tail.load(std::memory_order_relaxed);
+            size_t next_tail = next(current_tail);
+            if (next_tail == head.load(std::memory_order_acquire)) {
+                return false;
+            }
+            buffer[current_tail] = std::move(value);
+            tail.store(next_tail, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer only, returns false if the queue is empty
+        bool tryPop(T &value) {
+            size_t current_head = head.load(std::memory_order_relaxed);
+            if (current_head == tail.load(std::memory_order_acquire)) {
+                return false;
+            }
+            value = std::move(buffer[current_head]);
+            head.store(next(current_head), std::memory_order_release);
+            return true;
+        }
+
+        [[nodiscard]] bool empty() const {
+            return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+        }
+
+        [[nodiscard]] size_t capacity() const { return buffer.size() - 1; }
+
+        // Either thread, the size at some moment during the call
+        [[nodiscard]] size_t sizeApprox() const {
+            size_t current_head = head.load(std::memory_order_acquire);
+            size_t current_tail = tail.load(std::memory_order_acquire);
+            return current_tail >= current_head ? current_tail - current_head
+                                                : current_tail + buffer.size() - current_head;
+        }
+
+    private:
+        std::vector<T> buffer; // one slot is kept empty to distinguish a full queue from an empty one
+        alignas(64) std::atomic<size_t> head{0}; // next slot to pop
+        alignas(64) std::atomic<size_t> tail{0}; // next slot to push
+
+        [[nodiscard]] size_t next(size_t idx) const { return idx + 1 == buffer.size() ? 0 : idx + 1; }
+    };
+}
+
+#endif //LSC_PLANNER_SPSC_QUEUE_HPP
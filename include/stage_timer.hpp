@@ -0,0 +1,46 @@
+#ifndef LSC_PLANNER_STAGE_TIMER_HPP
+#define LSC_PLANNER_STAGE_TIMER_HPP
+
+#include <algorithm>
+#include <timer.hpp>
+#include <worker_pool.hpp>
+
+namespace DynamicPlanning {
+    // Wall time and CPU time of a planning stage on the calling thread. The CPU time adds the CPU time of the other
+    // workers on the batches that the stage runs on the worker pool. The wait time is the wall time when the calling
+    // thread does not run, e.g. it is blocked on the workers or a lock, or it is preempted. A stage limited by the
+    // contention has a large wait time, a stage limited by the compute has a CPU time close to the wall time times
+    // the number of threads.
+    class StageTimer {
+    public:
+        StageTimer() : helper_cpu_start(WorkerPool::getHelperCPUSeconds()) {}
+
+        void reset() {
+            wall_timer.reset();
+            cpu_timer.reset();
+            helper_cpu_start = WorkerPool::getHelperCPUSeconds();
+        }
+
+        void stop() {
+            wall_timer.stop();
+            cpu_timer.stop();
+            helper_cpu = WorkerPool::getHelperCPUSeconds() - helper_cpu_start;
+        }
+
+        [[nodiscard]] double getWallSeconds() const { return wall_timer.elapsedSeconds(); }
+
+        [[nodiscard]] double getCPUSeconds() const { return cpu_timer.elapsedSeconds() + helper_cpu; }
+
+        [[nodiscard]] double getWaitSeconds() const {
+            return std::max(wall_timer.elapsedSeconds() - cpu_timer.elapsedSeconds(), 0.0);
+        }
+
+    private:
+        Timer wall_timer;
+        ThreadCPUTimer cpu_timer;
+        double helper_cpu_start;
+        double helper_cpu = 0;
+    };
+}
+
+#endif //LSC_PLANNER_STAGE_TIMER_HPP
@@ -0,0 +1,19 @@
+#ifndef LSC_PLANNER_SUMMARY_LOG_HPP
+#define LSC_PLANNER_SUMMARY_LOG_HPP
+
+#include <string>
+
+namespace DynamicPlanning {
+    // One row per run in a csv file shared by the processes of a sweep.
+    // The row is appended by a single write under a POSIX record lock of the whole file, which also works on the
+    // network filesystems with lockd, so the rows of concurrent processes do not interleave. The header is written
+    // with the first row, by the writer that finds the file empty under the lock, and the file is never read
+    // except for the header.
+    namespace SummaryLog {
+        // header and row without the newline, false if the file can not be written. A header different from the
+        // one of the file is reported, and the row is appended anyway.
+        bool append(const std::string &file_name, const std::string &header, const std::string &row);
+    }
+}
+
+#endif //LSC_PLANNER_SUMMARY_LOG_HPP
@@ -0,0 +1,57 @@
+#ifndef LSC_PLANNER_SWEPT_CLEARANCE_HPP
+#define LSC_PLANNER_SWEPT_CLEARANCE_HPP
+
+#include <vector>
+#include <sp_const.hpp>
+#include <trajectory.hpp>
+#include <distance_map.hpp>
+
+namespace DynamicPlanning {
+    // Clearance of a ball swept along a Bernstein segment against a distance field, with a few queries per segment
+    // instead of dense sampling. The distance field is 1-Lipschitz, so every point of a ball of the center c and the
+    // radius r is at least distance(c) - r away from the obstacles. The segment lies in the convex hull of its control
+    // points, which is in their bounding ball, and only the pieces whose bound does not decide the query are split by
+    // de Casteljau subdivision. The bounds are as accurate as the point queries of the map: the distances saturated at
+    // the maximum distance are lower bounds, and the points outside of the map have a negative distance.
+    class SweptClearance {
+    public:
+        // max_depth: the pieces are split at most max_depth times, 2^max_depth pieces per segment
+        explicit SweptClearance(const DistanceMap &distmap, int max_depth = 8);
+
+        // A lower bound of min_t distance(p(t)) - radius, within tolerance of the minimum unless max_depth is reached
+        [[nodiscard]] double computeClearance(const Segment<point3d> &segment, double radius, double tolerance) const;
+
+        // True if the distance of every point of the segment is at least radius, false if it can not be proven
+        [[nodiscard]] bool isSegmentFree(const Segment<point3d> &segment, double radius) const;
+
+        // The earliest time in [0, segment_time] at which the ball may touch an obstacle, at most time_resolution before
+        // the first contact, SP_INFINITY if the segment is free
+        [[nodiscard]] double computeCollisionTime(const Segment<point3d> &segment, double radius,
+                                                  double time_resolution) const;
+
+    private:
+        const DistanceMap &distmap;
+        int max_depth;
+
+        // A part of the segment for t in [t0, t1] of the normalized time and the bounding ball of its control points,
+        // the segment has at least one control point
+        struct Piece {
+            Segment<point3d> segment;
+            double t0, t1;
+            int depth;
+            point3d center;
+            double bound_radius;
+        };
+
+        [[nodiscard]] static Piece makePiece(const Segment<point3d> &segment, double t0, double t1, int depth);
+
+        // The two halves of the piece
+        static void splitPiece(const Piece &piece, std::vector<Piece> &pieces);
+
+        // The distances of the centers and of the start points of the pieces in one batch
+        void queryPieces(const std::vector<Piece> &pieces, DistmapQueryBatch &batch,
+                         std::vector<double> &center_distances, std::vector<double> &start_distances) const;
+    };
+}
+
+#endif //LSC_PLANNER_SWEPT_CLEARANCE_HPP
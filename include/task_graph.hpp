@@ -0,0 +1,36 @@
+#ifndef LSC_PLANNER_TASK_GRAPH_HPP
+#define LSC_PLANNER_TASK_GRAPH_HPP
+
+#include <functional>
+#include <vector>
+#include <worker_pool.hpp>
+
+namespace DynamicPlanning {
+    // Tasks with explicit dependencies, run on a worker pool. A task is queued as a task of one TaskGroup when all
+    // of its dependencies are finished, so no worker blocks on a dependency and the independent tasks run
+    // concurrently. The dependencies of a task are added before it, so the order of addTask is a topological order.
+    // The tasks must write disjoint data unless one depends on the other, then the results do not depend on the
+    // schedule. A task runs inside the parallel region of the pool, so its own parallel loops run serially.
+    class TaskGraph {
+    public:
+        // Returns the id of the task. name must be a string literal, it is the name of the trace scope.
+        int addTask(const char *name, std::function<void()> task, const std::vector<int> &dependencies = {});
+
+        // Run all tasks and block until they are finished, the calling thread runs the ready tasks meanwhile.
+        // Tasks must not throw.
+        void run(WorkerPool &pool, TaskPriority priority = TaskPriority::HIGH) const;
+
+        [[nodiscard]] size_t size() const { return nodes.size(); }
+
+    private:
+        struct Node {
+            const char *name;
+            std::function<void()> task;
+            std::vector<int> dependencies;
+        };
+
+        std::vector<Node> nodes;
+    };
+}
+
+#endif //LSC_PLANNER_TASK_GRAPH_HPP
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <chrono>
+#include <ctime>
 #include <iostream>
 
 class Timer {
@@ -24,6 +25,28 @@ class Timer {
   std::chrono::high_resolution_clock::time_point end_;
 };
 
+// CPU time of the calling thread, the time the thread is blocked is not counted
+class ThreadCPUTimer {
+ public:
+  ThreadCPUTimer() : start_(now()), end_(start_) {}
+
+  void reset() { start_ = now(); }
+
+  void stop() { end_ = now(); }
+
+  double elapsedSeconds() const { return end_ - start_; }
+
+ private:
+  double start_;
+  double end_;
+
+  static double now() {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + 1e-9 * static_cast<double>(ts.tv_nsec);
+  }
+};
+
 class ScopedTimer : public Timer {
  public:
   ScopedTimer() {}
@@ -0,0 +1,144 @@
+#ifndef LSC_PLANNER_TRACE_HPP
+#define LSC_PLANNER_TRACE_HPP
+
+#include <alloc_stats.hpp>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace DynamicPlanning {
+    // Scoped tracing of the planning pipeline in the Chrome trace format, which Perfetto and chrome://tracing open.
+    // Each thread records the scopes to its own ring buffer, so recording takes no shared lock, and the oldest
+    // events are overwritten when the buffer is full. The scopes are put on the track of the agent set by
+    // TRACE_TRACK, or on the track of the thread if there is none.
+    // The macros are compiled out unless the package is built with ENABLE_TRACE, and they record nothing until the
+    // tracer is enabled at runtime. With ENABLE_ALLOC_STATS as well, the heap allocations of the scopes are written as
+    // the arguments of the events. The CPU time of the thread in the scope is written as the thread duration, so
+    // a scope that waits on a lock or on the workers has a thread duration shorter than its duration.
+    class Tracer {
+    public:
+        static constexpr int THREAD_TRACK = -1;
+
+        static Tracer &getInstance();
+
+        Tracer(const Tracer &) = delete;
+
+        Tracer &operator=(const Tracer &) = delete;
+
+        [[nodiscard]] static constexpr bool isCompiled() {
+#ifdef LSC_PLANNER_TRACE
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        // Start recording with the given number of events per thread, the events recorded before are removed
+        void enable(size_t capacity_per_thread);
+
+        void disable();
+
+        [[nodiscard]] bool isEnabled() const { return is_enabled; }
+
+        // The name must be a string literal, it is stored as a pointer and written to the trace without escaping
+        void record(const char *name, int64_t start_ns, int64_t end_ns, int64_t cpu_duration_ns = 0,
+                    const AllocCounts &alloc_counts = {});
+
+        // Write the events of all threads as Chrome trace JSON. The threads must not record while it is saved, e.g.
+        // call it between the simulation steps.
+        bool save(const std::string &file_name) const;
+
+        [[nodiscard]] static int64_t now();
+
+        // [ns], the CPU time of the calling thread
+        [[nodiscard]] static int64_t threadCPUNow();
+
+        [[nodiscard]] static int getTrack();
+
+        static void setTrack(int track);
+
+    private:
+        struct Event {
+            const char *name;
+            int64_t start_ns;
+            int64_t duration_ns;
+            int64_t cpu_duration_ns;
+            int track;
+            AllocCounts alloc_counts;
+        };
+
+        struct ThreadBuffer {
+            std::mutex mtx; // locked by the owner thread only while recording, so it is not contended
+            std::vector<Event> events; // ring buffer
+            size_t next = 0;
+            bool is_full = false;
+            int thread_idx = 0;
+            uint64_t generation = 0; // the enable() that allocated the buffer
+        };
+
+        Tracer() = default;
+
+        std::atomic<bool> is_enabled{false};
+        std::atomic<uint64_t> generation{0};
+        size_t capacity = 0;
+        int64_t origin_ns = 0;
+        mutable std::mutex buffers_mtx;
+        std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+
+        ThreadBuffer &getThreadBuffer();
+    };
+
+    class TraceScope {
+    public:
+        explicit TraceScope(const char *_name)
+                : name(_name), start_ns(Tracer::getInstance().isEnabled() ? Tracer::now() : -1),
+                  cpu_start_ns(start_ns >= 0 ? Tracer::threadCPUNow() : 0) {}
+
+        ~TraceScope() {
+            if (start_ns >= 0) {
+                Tracer::getInstance().record(name, start_ns, Tracer::now(), Tracer::threadCPUNow() - cpu_start_ns,
+                                             alloc_scope.getCounts());
+            }
+        }
+
+        TraceScope(const TraceScope &) = delete;
+
+        TraceScope &operator=(const TraceScope &) = delete;
+
+    private:
+        const char *name;
+        int64_t start_ns;
+        int64_t cpu_start_ns;
+        AllocScope alloc_scope;
+    };
+
+    // The scopes of the current thread go to the track of the agent until it is destroyed
+    class TraceTrack {
+    public:
+        explicit TraceTrack(int track) : prev_track(Tracer::getTrack()) { Tracer::setTrack(track); }
+
+        ~TraceTrack() { Tracer::setTrack(prev_track); }
+
+        TraceTrack(const TraceTrack &) = delete;
+
+        TraceTrack &operator=(const TraceTrack &) = delete;
+
+    private:
+        int prev_track;
+    };
+}
+
+#define LSC_TRACE_CONCAT_IMPL(a, b) a##b
+#define LSC_TRACE_CONCAT(a, b) LSC_TRACE_CONCAT_IMPL(a, b)
+#ifdef LSC_PLANNER_TRACE
+#define TRACE_SCOPE(name) DynamicPlanning::TraceScope LSC_TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_TRACK(track) DynamicPlanning::TraceTrack LSC_TRACE_CONCAT(trace_track_, __LINE__)(track)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_TRACK(track) ((void)0)
+#endif
+
+#endif //LSC_PLANNER_TRACE_HPP
@@ -6,6 +6,15 @@
 #include <param.hpp>
 #include <mission.hpp>
 #include <collision_constraints.hpp>
+#include <qp_problem.hpp>
+#include <qp_solver.hpp>
+#include <qp_condenser.hpp>
+#include <trajectory_algebra.hpp>
+#include <solver_thread_scheduler.hpp>
+#include <qp_failure_diagnoser.hpp>
+#include <map>
+#include <memory>
+#include <sstream>
 
 // Eigen
 #include <Eigen/Dense>
@@ -17,38 +26,204 @@
 namespace DynamicPlanning {
     struct TrajOptResult{
         traj_t desired_traj;
+        Eigen::VectorXd solution; // QP solution in double, desired_traj is its float copy
         double total_qp_cost = 0;
+        int n_iteration = 0;
+        bool warm_started = false; // solver started from initial_traj
+        int n_collision_rows = 0; // LSC rows before the pruning
+        int n_pruned_rows = 0; // LSC rows certified to be inactive and left out of the QP
+        int n_redundant_rows = 0; // pruned rows implied by the SFC or the other LSCs
+        bool time_limit_reached = false; // desired_traj is the incumbent at the time limit, not the optimum
+    };
+
+    // QP model that is kept alive between replanning steps.
+    // Rows that depend on the current state or the collision constraints are updated in place.
+    struct PersistentQPModel {
+        PersistentQPModel()
+                : model(env), cplex(env), var(env), objective(env),
+                  con_init(env), con_static(env), con_dynamic(env) {}
+
+        ~PersistentQPModel() {
+            env.end();
+        }
+
+        IloEnv env;
+        IloModel model;
+        IloCplex cplex;
+        IloNumVarArray var;
+        IloObjective objective;
+        IloRangeArray con_init;     // initial state, only bounds are updated
+        IloRangeArray con_static;   // continuity, dynamical limits
+        IloRangeArray con_dynamic;  // SFC, LSC, waypoint, rebuilt at every step
+
+        // Structure of the model
+        std::vector<bool> obs_slack;
+        std::vector<double> max_vel, max_acc;
+        double radius = 0;
     };
 
     class TrajOptimizer {
     public:
-        TrajOptimizer(const Param& param, const Mission& mission, const Eigen::MatrixXd& B);
+        TrajOptimizer(const Param& param, const std::shared_ptr<const Mission>& mission);
 
+        // If use_warm_start is true, initial_traj is given to the solver as the starting point.
+        // time_limit [s], 0: unbounded. PlanningReport::QPTIMEOUT is thrown if there is no incumbent at the limit.
         TrajOptResult solve(const Agent& agent, const CollisionConstraints& constraints,
-                            const traj_t& initial_traj, bool use_primal_algorithm);
+                            const traj_t& initial_traj, bool use_primal_algorithm, bool use_warm_start = false,
+                            double time_limit = 0);
 
+        // The cost and constraint matrices are reloaded only if the trajectory structure is changed.
+        // The parameters are checked before any change, std::invalid_argument is thrown if they are invalid.
         void updateParam(const Param& param);
 
+        // Next mission in the same world, the QP models and the constraint bases are kept
+        void resetMission(const std::shared_ptr<const Mission>& mission);
+
+        // The number of segments of the next solves. The constraint bases of the horizons are cached, so a switch
+        // rebuilds only the QP model.
+        void setHorizon(int _M);
+
+        // Batched QP of the step, see multisim_batch_qp. The problem of the next solve is built with the pruning,
+        // and if its solution is set by setBatchSolution, the next solve returns it instead of solving again.
+        QPProblem prepareBatchProblem(const Agent& agent, const CollisionConstraints& constraints,
+                                      const traj_t& initial_traj, bool use_warm_start);
+
+        void setBatchSolution(const QPSolution& solution);
+
     private:
         Param param;
-        Mission mission;
-        Eigen::MatrixXd Q_base, Aeq_base, B;
+        std::shared_ptr<const Mission> mission; // shared by all components of all agents
+        std::shared_ptr<const SegmentAlgebra> algebra; // B, A_0, A_T, Q_base, see TrajectoryAlgebraCache
+        std::shared_ptr<const Eigen::MatrixXd> Aeq_base; // continuity constraints of the current horizon
+        std::map<int, QPCondenser> qp_condensers; // [M], null space of the equality rows, see opt_condensed_qp
+        std::unique_ptr<PersistentQPModel> qp_model;
+        std::unique_ptr<QPSolver> qp_solver; // backend other than CPLEX Concert
+        std::vector<std::unique_ptr<QPSolver>> block_solvers; // [axis block], see opt_axis_decoupled_qp
+        int qp_record_seq = 0;
+
+        // The problem given to the batch of the step and its solution
+        struct BatchEntry {
+            bool is_solved = false;
+            bool use_warm_start = false;
+            QPCondenser *condenser = nullptr;
+            Eigen::VectorXd x_0;
+            QPSolution solution;
+        };
+        BatchEntry batch_entry;
+
+        // LSCs certified to be inactive at the current step, indexed by RSFCs::index
+        std::vector<bool> lsc_pruned;
+        int n_collision_rows = 0, n_pruned_rows = 0, n_redundant_rows = 0;
 
         // Frequently used constants
         int M, n, phi, dim;
         double dt;
 
-        // Cost matrix Q
-        void buildQBase();
-
-        // Constraint matrix A_eq x > d_eq
-        void buildAeqBase();
+        // Cost matrix Q and constraint matrix A_eq x = d_eq of the current structure from the shared cache
+        void loadAlgebra();
 
 //        void buildDeq(const Agent& agent);
 
+        // Sparse model with the warm start, condensed if opt_condensed_qp. condenser and x_0 are for the expansion.
+        QPProblem buildSolverProblem(const Agent& agent, const CollisionConstraints& constraints,
+                                     const traj_t& initial_traj, bool use_warm_start,
+                                     QPCondenser*& condenser, Eigen::VectorXd& x_0);
+
+        TrajOptResult solveWithQPSolver(const Agent& agent, const CollisionConstraints& constraints,
+                                        const traj_t& initial_traj, bool use_warm_start, double time_limit);
+
+        // Axis-decoupled model, the blocks of the sparse QP solved concurrently by block_solvers.
+        // False if the problem does not split, then the caller solves the coupled model.
+        bool solveDecoupled(const Agent& agent, const CollisionConstraints& constraints, const traj_t& initial_traj,
+                            bool use_warm_start, int threads, double time_limit, TrajOptResult& result);
+
+        // An LSC row that is not pruned has a normal with more than one nonzero component
+        [[nodiscard]] bool hasCoupledCollisionConstraints(const CollisionConstraints& constraints) const;
+
+        void recordQPProblem(const Agent& agent, const CollisionConstraints& constraints);
+
+        TrajOptResult solvePersistent(const Agent& agent, const CollisionConstraints& constraints,
+                                      const traj_t& initial_traj, bool use_primal_algorithm,
+                                      bool use_warm_start, int threads, double time_limit);
+
         void populatebyrow(IloModel model, IloNumVarArray x, IloRangeArray c,
                            const Agent& agent, const CollisionConstraints& constraints, const traj_t& initial_traj);
 
+        // Sparse model
+        [[nodiscard]] QPProblem buildQPProblem(const Agent& agent, const CollisionConstraints& constraints) const;
+
+        // Condensed model, see opt_condensed_qp. The condenser of the horizon is built again only if the equality
+        // rows of the problem are changed.
+        QPCondenser& getQPCondenser(const QPProblem& problem);
+
+        // Persistent model
+        [[nodiscard]] bool isModelReusable(const Agent& agent, const CollisionConstraints& constraints) const;
+
+        void buildPersistentModel(const Agent& agent, const CollisionConstraints& constraints);
+
+        void updatePersistentModel(const Agent& agent, const CollisionConstraints& constraints);
+
+        // Building blocks of the QP model
+        void addVariables(IloEnv env, IloNumVarArray x, const CollisionConstraints& constraints);
+
+        IloNumExpr buildJerkCost(IloEnv env, IloNumVarArray x) const;
+
+        // L1 penalty of the slack variables of the LSCs if opt_soft_collision
+        void addSlackPenalty(IloNumVarArray x, IloNumExpr& cost) const;
+
+        void addInitialStateConstraints(IloNumVarArray x, IloRangeArray c, const Agent& agent) const;
+
+        void addContinuityConstraints(IloEnv env, IloNumVarArray x, IloRangeArray c) const;
+
+        void addCollisionConstraints(IloEnv env, IloNumVarArray x, IloRangeArray c,
+                                     const CollisionConstraints& constraints) const;
+
+        void addDynamicalLimitConstraints(IloNumVarArray x, IloRangeArray c, const Agent& agent) const;
+
+        void addCommunicationRangeConstraints(IloNumVarArray x, IloRangeArray c, const Agent& agent) const;
+
+        void addWaypointConstraints(IloNumVarArray x, IloRangeArray c, const Agent& agent) const;
+
+        void addStopConstraints(IloNumVarArray x, IloRangeArray c) const;
+
+        [[nodiscard]] static Eigen::VectorXd valuesToVector(const IloNumArray& vals);
+
+        [[nodiscard]] traj_t valuesToTraj(const Eigen::VectorXd& vals) const;
+
+        // Keep the double solution and convert it to the float control points of desired_traj once
+        void setSolution(Eigen::VectorXd x, TrajOptResult& result) const;
+
+        // Control points of initial_traj followed by the slack variables that make them satisfy the relaxed LSCs
+        [[nodiscard]] Eigen::VectorXd getStartValues(const CollisionConstraints& constraints,
+                                                     const traj_t& initial_traj, int n_var) const;
+
+        void setStart(IloCplex cplex, IloNumVarArray var, const CollisionConstraints& constraints,
+                      const traj_t& initial_traj) const;
+
+        // Log the failure and queue the problem to QPFailureDiagnoser
+        void reportQPFailure(const Agent& agent, const CollisionConstraints& constraints,
+                             const std::string& status) const;
+
+        // Constraint pruning
+        // Boxes that contain the control points of every feasible solution, [m][i]
+        [[nodiscard]] std::vector<std::vector<Box>> computeReachableBoxes(const Agent& agent,
+                                                                          const CollisionConstraints& constraints) const;
+
+        void pruneCollisionConstraints(const Agent& agent, const CollisionConstraints& constraints);
+
+        [[nodiscard]] bool isLSCPruned(size_t lsc_idx) const;
+
+        // True if every point in the box satisfies the LSC
+        [[nodiscard]] bool isLSCSatisfiedInBox(const RSFCs& lscs, size_t lsc_idx, const Box& box) const;
+
+        [[nodiscard]] int getSlackOffset() const;
+
+        // The LSCs of the obstacle are relaxed by a slack variable per segment
+        [[nodiscard]] bool hasSlack(const CollisionConstraints& constraints, int oi) const;
+
+        // The number of collision constraint rows
+        [[nodiscard]] size_t getProblemSize(const CollisionConstraints& constraints) const;
+
         [[nodiscard]] int getTerminalSegments(const Agent& agent, const traj_t& initial_traj) const;
 
         [[nodiscard]] int getTerminalSegments_old(const Agent& agent) const;
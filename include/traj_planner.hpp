@@ -1,4 +1,5 @@
 #pragma once
+#include <map>
 #include <sp_const.hpp>
 #include <param.hpp>
 #include <mission.hpp>
@@ -6,9 +7,13 @@
 #include <geometry.hpp>
 #include <polynomial.hpp>
 #include <timer.hpp>
+#include <stage_timer.hpp>
+#include <planning_deadline.hpp>
 #include <trajectory.hpp>
 #include <obstacle_generator.hpp>
-#include <kalman_filter.hpp>
+#include <kalman_filter_bank.hpp>
+#include <obstacle_prediction.hpp>
+#include <neighbor_table.hpp>
 
 // ROS
 #include <ros/ros.h>
@@ -29,28 +34,131 @@
 // Goal Optimizer
 #include <goal_optimizer.hpp>
 
+// Parallel LSC generation
+#include <worker_pool.hpp>
+
+// Solution validation
+#include <feasibility_checker.hpp>
+
+// Sampled trajectories after the QP failures
+#include <fallback_planner.hpp>
+#include <lazy_publisher.hpp>
+
+// Background visualization
+#include <visualization_worker.hpp>
+
 // Octomap
 #include <octomap_msgs/Octomap.h>
 #include <octomap_msgs/conversions.h>
 #include <octomap/OcTree.h>
-#include <dynamicEDT3D/dynamicEDTOctomap.h>
+#include <distance_map.hpp>
+#include <swept_clearance.hpp>
 
 
 namespace DynamicPlanning {
+    // What an agent sends to its neighbors in an ADMM iteration, see multisim_admm_iterations
+    struct ConsensusMessage {
+        traj_t traj; // control-point estimate, the latest iterate of the agent, empty if it does not iterate
+        // [neighbor id][m * (n + 1) + i], the price of the shared LSC in [0, 1], 1 if the constraint binds
+        std::map<int, std::vector<double>> prices;
+    };
+
     class TrajPlanner {
     public:
-        TrajPlanner(const ros::NodeHandle &nh, const Param &param, const Mission &mission, const Agent &agent);
+        // The state carried from a planning cycle to the next, to discard a cycle planned from a speculative input.
+        // The warm starts and the caches validated by their inputs are not included.
+        struct Checkpoint {
+            Agent agent;
+            int planner_seq;
+            PlanningStatistics statistics;
+            bool initialize_sfc, is_sol_converged_by_sfc, is_hover_ready;
+            GoalPlannerState goal_planner_state;
+            int desired_segment_idx;
+            int full_M;
+            Box sfc_converged;
+            uint64_t planned_map_version;
+            traj_t initial_traj, prev_traj;
+            std::shared_ptr<const CollisionConstraints> constraints;
+            KalmanFilterBank obstacle_filter_bank;
+            // The SFCs of constraints. A checkpoint read from a file has only these, then the constraints are kept
+            // as they are except the SFCs, and the tracks of the obstacles start again.
+            SFCs sfcs;
+        };
+
+        TrajPlanner(const ros::NodeHandle &nh, const Param &param, const std::shared_ptr<const Mission> &mission,
+                    const Agent &agent);
 
         traj_t plan(const Agent &agent,
                     const std::shared_ptr<octomap::OcTree> &octree_ptr,
-                    const std::shared_ptr<DynamicEDTOctomap> &distmap_ptr,
+                    const std::shared_ptr<DistanceMap> &distmap_ptr,
+                    const std::shared_ptr<OccupancyIndex> &occupancy_index_ptr,
+                    const std::shared_ptr<MapChangeLog> &map_change_log_ptr,
                     ros::Time sim_current_time,
                     bool is_disturbed);
 
+        // plan() split into two stages, so that the QPs of all agents can be solved in a batch
+        void planBeforeOptimization(const Agent &agent,
+                                    const std::shared_ptr<octomap::OcTree> &octree_ptr,
+                                    const std::shared_ptr<DistanceMap> &distmap_ptr,
+                                    const std::shared_ptr<OccupancyIndex> &occupancy_index_ptr,
+                                    const std::shared_ptr<MapChangeLog> &map_change_log_ptr,
+                                    ros::Time sim_current_time,
+                                    bool is_disturbed);
+
+        traj_t planOptimization();
+
+        // ADMM iteration of the replanning agents after planOptimization. The margins of the shared LSCs are moved
+        // by the prices of both agents, the LSCs are built again between the latest iterates of the agent and its
+        // neighbors in messages [agent id], and the QP is warm-started from the iterate of the agent. The pair of
+        // LSCs still sums to the collision distance, so the iterates of a pair stay collision-free.
+        // max_change is the largest change of the control points.
+        traj_t planConsensusIteration(const std::vector<ConsensusMessage> &messages, double &max_change);
+
+        [[nodiscard]] ConsensusMessage getConsensusMessage() const;
+
+        // The QP of planOptimization for the batched solver, see multisim_batch_qp. If the solution is set, the next
+        // planOptimization uses it instead of solving the QP.
+        QPProblem prepareBatchQP();
+
+        void setBatchQPSolution(const QPSolution &solution);
+
+        void saveCheckpoint(Checkpoint &checkpoint) const;
+
+        // Go back to the state of saveCheckpoint, the cycles planned after it are discarded
+        void restoreCheckpoint(const Checkpoint &checkpoint);
+
+        // Follow the previous trajectory instead of replanning. The trajectory is shifted by one time step as the
+        // initial trajectory of the LSC, so it still satisfies the LSCs of the other agents.
+        traj_t planHold(const Agent &agent);
+
+        // The agent converged to a stationary trajectory can hover without replanning while no obstacle can come
+        // within the collision distance over the horizon, and the map is unchanged since the last planning. It is
+        // checked by the bounding boxes of the predictions, so the agent wakes up before the obstacles reach it.
+        [[nodiscard]] bool isHoverCertified(const Agent &agent, uint64_t map_version) const;
+
         void publish();
 
         // Setter
-        void setObstacles(const std::vector<Obstacle> &obstacles);
+        void setObstacles(std::vector<Obstacle> obstacles);
+
+        // Predictions of the dynamic obstacles shared by the agents, nullptr to predict all obstacles by itself
+        void setObstaclePredictionTable(std::shared_ptr<const ObstaclePredictionTable> table);
+
+        // The communication group of the agent is stalled, see ProgressMonitor. The deadlock is then resolved
+        // without waiting for deadlock/seq_threshold and deadlock/velocity_threshold
+        void setProgressStalled(bool is_stalled);
+
+        // Replace the parameters between the planning cycles, std::invalid_argument is thrown without any change if
+        // they are invalid. Only the structures depending on the changed parameters are rebuilt. If the trajectory
+        // structure is changed, the planner starts again from the current state as at the first step.
+        void updateParam(const Param &param);
+
+        // Start the next mission in the same world as the constructor does, the state of the previous mission is
+        // dropped. The caches of the world and the models of the solvers are kept.
+        void resetMission(const std::shared_ptr<const Mission> &mission, const Agent &agent);
+
+        // Check the modes are valid for the planner mode, and fix them automatically
+        static void validatePlannerMode(Param &param);
 
         // Getter
         [[nodiscard]] int getPlannerSeq() const;
@@ -63,30 +171,39 @@ namespace DynamicPlanning {
 
     private:
         Param param;
-        Mission mission;
+        std::shared_ptr<const Mission> mission; // shared by all components of all agents
 
         // ROS
         ros::NodeHandle nh;
-        ros::Publisher pub_sfc;
-        ros::Publisher pub_lsc;
-        ros::Publisher pub_feasible_region;
-        ros::Publisher pub_initial_traj_vis;
-        ros::Publisher pub_obs_pred_traj_vis;
-        ros::Publisher pub_grid_path;
-        ros::Publisher pub_grid_occupied_points;
+        LazyPublisher pub_sfc;
+        LazyPublisher pub_lsc;
+        LazyPublisher pub_feasible_region;
+        LazyPublisher pub_initial_traj_vis;
+        LazyPublisher pub_obs_pred_traj_vis;
+        LazyPublisher pub_grid_path;
+        LazyPublisher pub_grid_occupied_points;
         ros::Time sim_current_time;
 
         // Agent state, report
         Agent agent;
         int planner_seq;
         PlanningStatistics statistics;
+        double preparation_time; // [s], planning time before the trajectory optimization
+        double preparation_cpu_time, preparation_wait_time; // [s], CPU and wait time before the trajectory optimization
+        AllocCounts preparation_alloc; // heap allocations before the trajectory optimization
+        PlanningDeadline deadline; // deadline/budget of the current cycle
         bool initialize_sfc, is_disturbed, is_sol_converged_by_sfc;
         GoalPlannerState goal_planner_state;
         int desired_segment_idx;
+        int full_M; // the segments of the published trajectory, param.M is the horizon planned in this cycle
         Box sfc_converged;
+        bool is_hover_ready; // the previous trajectory is stationary, and the agent converged
+        uint64_t planned_map_version; // the version of the map change log at the last planning
+        bool is_consensus_iteration = false; // the QP is warm-started from the iterate of the ADMM iteration
 
-        // Bernstein Matrix
-        Eigen::MatrixXd B, B_inv;
+        // Margin offsets of the shared LSCs of the ADMM iterations, [neighbor id][m * (n + 1) + i], reset at every
+        // step. A positive offset tightens the LSC of this agent, and the neighbor has the opposite offset.
+        std::map<int, std::vector<double>> consensus_offsets;
 
         // Trajectories
         traj_t initial_traj; // [segment_idx][control_pts_idx], initial trajectory
@@ -94,12 +211,46 @@ namespace DynamicPlanning {
 
         // Obstacle
         std::shared_ptr<octomap::OcTree> octree_ptr; // octomap
-        std::shared_ptr<DynamicEDTOctomap> distmap_ptr; // Euclidean distance field map
+        std::shared_ptr<DistanceMap> distmap_ptr; // Euclidean distance field map
+        std::shared_ptr<MapChangeLog> map_change_log_ptr; // changed regions of the map, for the grid map cache
         std::vector<Obstacle> obstacles; // obstacles
+        NeighborTable neighbors; // fields of the obstacles in the same order, read by the loops over the obstacles
+        std::vector<double> neighbor_gaps; // [obstacle], the clearance left at the closest possible contact
+        std::vector<size_t> neighbor_indices; // the obstacles kept by selectNeighbors
         std::vector<traj_t> obs_pred_trajs; // predicted trajectory of obstacles
         std::vector<Trajectory<double>> obs_pred_sizes; // predicted obstacle size
+        // The predictions used in the planning, to obs_pred_trajs and obs_pred_sizes or to the shared table
+        std::vector<const traj_t *> obs_pred_traj_ptrs;
+        std::vector<const Trajectory<double> *> obs_pred_size_ptrs;
+        std::shared_ptr<const ObstaclePredictionTable> obstacle_prediction_table, next_obstacle_prediction_table;
+        bool is_progress_stalled;
         std::set<int> col_pred_obs_indices; // collision predicted obstacle indices
 
+        // Normal vectors between the relative control points, reused in the next step if they are unchanged
+        struct LSCNormalCache {
+            std::vector<points_t> control_points_rel, control_points_rel_next; // [m][i]
+            std::vector<point3d> normal_vectors, normal_vectors_next; // [m]
+            int n_query = 0, n_hit = 0;
+        };
+        std::map<std::pair<int, int>, LSCNormalCache> lsc_normal_caches; // key: (obstacle type, obstacle id)
+
+        // Level of detail of the LSCs of an obstacle, chosen by the distance between the initial trajectories
+        enum class LSCLevel {
+            EXACT, // a normal vector per segment between the closest points of the polynomials
+            PLANE, // one reciprocal half-space over the whole horizon
+            MERGED, // one half-space for a group of far agents, set on the first agent of the group
+            MERGED_MEMBER, // covered by the half-space of its group, no LSC
+        };
+        struct LSCDetail {
+            LSCLevel level = LSCLevel::EXACT;
+            point3d obs_point, normal_vector; // the half-space of PLANE and MERGED in the original coordinates
+            double d = 0;
+        };
+        std::vector<LSCDetail> lsc_details; // [obstacle]
+
+        // The initial trajectory transformed by the downwash of each obstacle type, shared by the obstacles
+        TrajectoryMemo traj_memo;
+
         // Collision constraints
         CollisionConstraints constraints;
 
@@ -109,14 +260,20 @@ namespace DynamicPlanning {
         // Trajectory optimizer
         std::unique_ptr<TrajOptimizer> traj_optimizer;
 
-        // Kalman filter
-        std::vector<LinearKalmanFilter> linear_kalman_filters;
+        // Goal optimizer
+        std::unique_ptr<GoalOptimizer> goal_optimizer;
+
+        // Fallback planner
+        FallbackPlanner fallback_planner;
+
+        // Kalman filters of the obstacles
+        KalmanFilterBank obstacle_filter_bank;
 
         // ROS
         void initializeROS();
 
-        // Planner module
-        traj_t planImpl();
+        // Planner module, until the goal planning
+        void planImpl();
 
         // Functions for checking agent state
         void checkPlannerMode(); // Check modes in launch file are valid, and fix them automatically
@@ -131,18 +288,49 @@ namespace DynamicPlanning {
 
         [[nodiscard]] bool isSolValid(const TrajOptResult& result) const;
 
+        // The previous trajectory stays at its start, and the agent is at its goal or converged
+        [[nodiscard]] bool isHoverReady() const;
+
+        // The incumbent at the time limit of the solver is also checked against the LSCs
+        [[nodiscard]] bool isAnytimeSolValid(const TrajOptResult& result) const;
+
         // Obstacle prediction
+        // Leave out the obstacles that can not come into contact with the agent within the horizon, then the
+        // obstacles farthest from contact over max_neighbors
+        void selectNeighbors();
+
+        // Choose the segments planned in this cycle by the neighbors and the distance to the goal
+        void adaptHorizon();
+
+        void setHorizon(int horizon_M);
+
+        // Hold the last point of the trajectory until the end of the full horizon
+        [[nodiscard]] traj_t extendToFullHorizon(const traj_t &traj) const;
+
+        // The farthest the trajectory gets from the position in the coordinates scaled by the downwash
+        [[nodiscard]] static double getTrajectoryExtent(const traj_t &traj, const point3d &position, double downwash);
+
+        // The farthest the obstacle can get from its position within the horizon in the coordinates scaled by the
+        // downwash, by its velocity and max acceleration or its previous trajectory
+        [[nodiscard]] double getObstacleReach(size_t oi, double horizon) const;
+
         void obstaclePrediction();
 
-        void obstaclePredictionWithCurrPos(); // Need the position of obstacles
+        [[nodiscard]] const traj_t &obsPredTraj(size_t oi) const { return *obs_pred_traj_ptrs[oi]; }
+
+        [[nodiscard]] const Trajectory<double> &obsPredSize(size_t oi) const { return *obs_pred_size_ptrs[oi]; }
 
-        void obstaclePredictionWithCurrVel(); // Need the position and velocity of obstacles
+        // The predictions of the obstacle oi, written in place to obs_pred_trajs[oi] and obs_pred_sizes[oi]
+        void obstaclePredictionWithCurrPos(size_t oi); // Need the position of obstacles
 
-        void obstaclePredictionWithPrevSol(); // Need trajectory of other agents planned in the previous step.
+        void obstaclePredictionWithCurrVel(size_t oi); // Need the position and velocity of obstacles
+
+        void obstaclePredictionWithPrevSol(size_t oi); // Need trajectory of other agents planned in the previous step.
         // Dynamic obstacle -> current velocity, Agent -> prev sol
-        void checkObstacleDisturbance(); // Check obstacle is at the start point of predicted trajectory
+        void checkObstacleDisturbance(size_t oi); // Check obstacle is at the start point of predicted trajectory
         // If not, correct predicted trajectory using obstacle position.
-        void obstacleSizePredictionWithConstAcc(); // Predict obstacle size using constant acceleration model
+        // Predict obstacle size using constant acceleration model
+        void obstacleSizePredictionWithConstAcc(size_t oi, double velocity_guard);
 
         // Initial trajectory planning
         void initialTrajPlanning();
@@ -172,12 +360,52 @@ namespace DynamicPlanning {
 
         void constructSFC();
 
+        void reduceCollisionConstraints();
+
         void generateReciprocalRSFC(); // used in RAL2021 submission
 
+        // Run task(oi) for all obstacles, in the shared worker pool if there are many obstacles
+        void runObstacleTasks(const std::function<void(size_t)> &task);
+
+        // Transform the initial trajectory for the downwashes of the obstacles before the parallel LSC generation
+        void prepareInitialTrajTransforms();
+
+        // The memoized transformation of the initial trajectory, or the transformation in the thread buffer
+        [[nodiscard]] const traj_t &transformedInitialTraj(double downwash) const;
+
         void generateLSC();
 
+        void generateLSC(size_t oi);
+
+        // Make a cache for each obstacle before the parallel LSC generation, and remove the caches of lost obstacles
+        void prepareLSCNormalCaches();
+
+        // Keep the normal vectors of this step, and update the hit rate
+        void updateLSCNormalCaches();
+
         void generateCLSC();
 
+        void generateCLSC(size_t oi);
+
+        // Choose the level of detail of the LSCs of each obstacle before the parallel LSC generation, by
+        // param.lsc_lod_near_range and param.lsc_lod_far_range
+        void assignLSCDetails();
+
+        // The half-space over the whole horizon between the initial trajectories, false if they are not separated
+        // by the collision distance along the direction between their centroids
+        bool computeLSCPlane(size_t oi, LSCDetail &detail) const;
+
+        // The half-space that keeps the agent away from everywhere the obstacles can reach within the horizon,
+        // false if the initial trajectory is not in it. The obstacles share the downwash.
+        bool computeMergedLSC(const std::vector<size_t> &group, LSCDetail &detail) const;
+
+        // Set the LSCs of the obstacle by its level of detail, false if it is EXACT
+        bool setLSCDetail(size_t oi);
+
+        // The margin offset of the LSC of the agent obstacle oi, clipped so that the current iterates stay
+        // feasible. excess is the clearance over the collision distance between the initial trajectories.
+        [[nodiscard]] double getConsensusOffset(size_t oi, int m, int i, double excess) const;
+
         void generateBVC();
 
         void generateSFC();
@@ -188,11 +416,24 @@ namespace DynamicPlanning {
                                          const traj_t& initial_traj_trans,
                                          const traj_t& obs_pred_traj_trans);
 
-        point3d normalVectorDynamicObs(int oi, int m, double downwash);
+        // Return true if the relative control points are within the tolerance of the previous step
+        bool findCachedNormalVector(const LSCNormalCache &cache, const points_t &control_points_rel,
+                                    points_t &control_points_rel_cached, point3d &normal_vector) const;
+
+        [[nodiscard]] point3d normalVectorDynamicObs(int oi, int m, double downwash) const;
 
         // Trajectory Optimization
         traj_t trajOptimization();
 
+        // The initial trajectory is given to the solver as the starting point
+        [[nodiscard]] bool isWarmStartUsed() const;
+
+        // Count the failure and log the constraints violated by the initial trajectory
+        void reportQPFailure();
+
+        // The best feasible sampled trajectory, or the initial trajectory if there is none
+        traj_t planFallback();
+
         // Publish
 //        void publishCollisionConstraints();
 
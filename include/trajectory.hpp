@@ -1,20 +1,65 @@
 #ifndef DYNAMIC_PLANNER_TRAJECTORY_H
 #define DYNAMIC_PLANNER_TRAJECTORY_H
 
+#include <atomic>
+#include <deque>
 #include <sp_const.hpp>
 #include <polynomial.hpp>
 #include <util.hpp>
 
 namespace DynamicPlanning {
+    // Control points of a segment in a fixed-capacity array, so copying a segment does not allocate
+    template<typename T>
+    class ControlPoints {
+    public:
+        static constexpr size_t CAPACITY = MAX_BERNSTEIN_DEGREE + 1;
+
+        // The new control points are T()
+        void resize(size_t size) {
+            if (size > CAPACITY) {
+                throw std::invalid_argument("[ControlPoints] The degree is larger than MAX_BERNSTEIN_DEGREE");
+            }
+            std::fill(points.begin() + std::min(n_points, size), points.begin() + size, T());
+            n_points = size;
+        }
+
+        [[nodiscard]] size_t size() const { return n_points; }
+
+        [[nodiscard]] bool empty() const { return n_points == 0; }
+
+        [[nodiscard]] const T *data() const { return points.data(); }
+
+        T *data() { return points.data(); }
+
+        [[nodiscard]] const T *begin() const { return points.data(); }
+
+        [[nodiscard]] const T *end() const { return points.data() + n_points; }
+
+        T *begin() { return points.data(); }
+
+        T *end() { return points.data() + n_points; }
+
+        [[nodiscard]] const T &back() const { return points[n_points - 1]; }
+
+        T &back() { return points[n_points - 1]; }
+
+        const T &operator[](size_t idx) const { return points[idx]; }
+
+        T &operator[](size_t idx) { return points[idx]; }
+
+    private:
+        std::array<T, CAPACITY> points{};
+        size_t n_points = 0;
+    };
+
     template<typename T>
     class Segment {
     public:
-        std::vector<T> control_points;
+        ControlPoints<T> control_points;
         double segment_time;
 
-        // Find subsegment that t \in [t_normalized_0, t_normalized_f] * segment_time
-        Segment<T> subSegment(double t_normalized_0, double t_normalized_f,
-                              const Eigen::MatrixXd& B, const Eigen::MatrixXd& B_inv);
+        // Find subsegment that t \in [t_normalized_0, t_normalized_f] * segment_time, by two de Casteljau splits
+        [[nodiscard]] Segment<T> subSegment(double t_normalized_0, double t_normalized_f) const;
 
         [[nodiscard]] T startPoint() const;
 
@@ -33,31 +78,53 @@ namespace DynamicPlanning {
 
         Trajectory(size_t M, size_t n, double dt);
 
+        // Same as assigning Trajectory(M, n, dt), but reuses the segment buffer
+        void reset(size_t M, size_t n, double dt);
+
+        // Closed-form control points of the constant velocity motion from the current state at t = 0
         void planConstVelTraj(T current_state, T velocity);
 
+        // Closed-form control points of the constant acceleration motion, n >= 2
+        void planConstAccTraj(T current_state, T velocity, T acceleration);
+
         [[nodiscard]] int size() const;
 
         [[nodiscard]] T getPointAt(double time) const;
 
         [[nodiscard]] State getStateAt(double time) const;
 
+        // Sample the trajectory at t = k * time_step, k < n_samples. If the segments have the same duration which
+        // is a multiple of time_step, the basis functions of the samples in a segment are computed once.
+        void samplePoints(double time_step, size_t n_samples, std::vector<T> &points) const;
+
         [[nodiscard]] T startPoint() const;
 
         [[nodiscard]] T lastPoint() const;
 
         [[nodiscard]] Trajectory<T> derivative() const;
 
+        // Write to dtraj to reuse its buffers
+        void derivative(Trajectory<T> &dtraj) const;
+
         Trajectory<T> coordinateTransform(double downwash);
 
+        // Write to traj_trans to reuse its buffers
+        void coordinateTransform(double downwash, Trajectory<T> &traj_trans) const;
+
         [[nodiscard]] bool empty() const;
 
         void clear();
 
+        // Token of the control points, the trajectories with the same revision have the same control points.
+        // Any non-const access gives a new revision at the next call. The first call after a modification is not
+        // thread-safe.
+        [[nodiscard]] uint64_t getRevision() const;
+
         [[nodiscard]] visualization_msgs::Marker toMarkerMsg(int agent_id,
                                                const std::string &frame_id,
                                                std_msgs::ColorRGBA color) const; // Only for point3d
 
-        Segment<T> operator[](int idx) const;
+        const Segment<T> &operator[](int idx) const;
 
         Segment<T> &operator[](int idx);
 
@@ -65,10 +132,51 @@ namespace DynamicPlanning {
         size_t M; // The number of segments
         size_t n; // degree of the polynomial
         std::vector<Segment<T>> segments;
+        mutable uint64_t revision = 0; // 0: unknown, assigned by getRevision
+
+        // The segment of the time and the normalized time in the segment, false if the time is out of bound
+        bool findSegment(double time, int &m, double &t_normalized) const;
     };
 
     typedef Trajectory<point3d> traj_t;
 
+    // Memo of the trajectories derived in a planning cycle, keyed by the revision of the source trajectory, so an
+    // entry is never returned after the source is modified
+    class TrajectoryMemo {
+    public:
+        // Remove the entries, keeping their buffers
+        void clear();
+
+        // traj.coordinateTransform(downwash), computed at the first query
+        const traj_t &coordinateTransform(const traj_t &traj, double downwash);
+
+        // The derivative of the order, computed at the first query
+        const traj_t &derivative(const traj_t &traj, int order);
+
+        // Lookup only, nullptr if absent. Thread-safe if no entry is added concurrently and the revision of traj
+        // was already assigned.
+        [[nodiscard]] const traj_t *findCoordinateTransform(const traj_t &traj, double downwash) const;
+
+    private:
+        enum Kind {
+            TRANSFORM,
+            DERIVATIVE,
+        };
+
+        struct Entry {
+            uint64_t revision;
+            Kind kind;
+            double parameter; // downwash or derivative order
+            traj_t traj;
+        };
+        std::deque<Entry> entries; // deque keeps the returned references valid
+        size_t n_entries = 0;
+
+        [[nodiscard]] const Entry *find(uint64_t revision, Kind kind, double parameter) const;
+
+        Entry &addEntry(uint64_t revision, Kind kind, double parameter);
+    };
+
     template class Segment<point3d>;
     template class Segment<double>;
     template class Trajectory<point3d>;
@@ -0,0 +1,52 @@
+#ifndef LSC_PLANNER_TRAJECTORY_ALGEBRA_HPP
+#define LSC_PLANNER_TRAJECTORY_ALGEBRA_HPP
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <polynomial.hpp>
+
+namespace DynamicPlanning {
+    // Matrices of a segment of degree n, in fixed-capacity layouts without heap allocation
+    struct SegmentAlgebra {
+        typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, 0,
+                              MAX_BERNSTEIN_DEGREE + 1, MAX_BERNSTEIN_DEGREE + 1> Matrix;
+
+        int n, phi, phi_n;
+        double dt;
+        Matrix B, B_inv; // Bernstein basis, B(i,j): coefficient of t^j in the i-th basis polynomial
+        Matrix A_0, A_T; // derivatives at the start and the end of a segment
+        Matrix Q_base; // cost of the derivatives phi - phi_n + 1, ..., phi of a segment
+    };
+
+    // Process-wide cache of the trajectory algebra. All agents usually have the same (n, phi, phi_n, M, dt), so the
+    // matrices are built once and shared by all planners and optimizers. The entries are immutable and never evicted,
+    // a holder of an entry keeps it valid after a parameter change. Thread-safe.
+    class TrajectoryAlgebraCache {
+    public:
+        static TrajectoryAlgebraCache &getInstance();
+
+        // std::invalid_argument is thrown if phi > n or n > MAX_BERNSTEIN_DEGREE
+        std::shared_ptr<const SegmentAlgebra> getSegmentAlgebra(int n, int phi, int phi_n, double dt);
+
+        // Continuity constraints of the derivatives 0, ..., phi - 1 between the M segments, Aeq_base x = 0
+        std::shared_ptr<const Eigen::MatrixXd> getContinuityMatrix(int n, int phi, int M, double dt);
+
+    private:
+        typedef std::tuple<int, int, int, double> Key;
+
+        std::mutex mtx;
+        std::map<Key, std::shared_ptr<const SegmentAlgebra>> segment_algebras; // [n, phi, phi_n, dt]
+        std::map<Key, std::shared_ptr<const Eigen::MatrixXd>> continuity_matrices; // [n, phi, M, dt]
+
+        TrajectoryAlgebraCache() = default;
+
+        static std::shared_ptr<const SegmentAlgebra> buildSegmentAlgebra(int n, int phi, int phi_n, double dt);
+
+        static std::shared_ptr<const Eigen::MatrixXd> buildContinuityMatrix(const SegmentAlgebra &segment_algebra,
+                                                                            int M);
+    };
+}
+
+#endif //LSC_PLANNER_TRAJECTORY_ALGEBRA_HPP
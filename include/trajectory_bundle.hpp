@@ -0,0 +1,48 @@
+#ifndef LSC_PLANNER_TRAJECTORY_BUNDLE_HPP
+#define LSC_PLANNER_TRAJECTORY_BUNDLE_HPP
+
+#include <trajectory.hpp>
+#include <sampled_states.hpp>
+
+namespace DynamicPlanning {
+    // Control points of the trajectories of all agents in a structure of arrays, [m][i][k][agent] with the agents
+    // padded to a multiple of 4. The basis functions at a time are shared by all agents, so the states of 4 agents
+    // are evaluated per instruction with AVX2 if the CPU supports it, otherwise in scalar.
+    // The trajectories must have the same number of segments, degree and segment times.
+    class TrajectoryBundle {
+    public:
+        // Returns false if the trajectories do not share the layout, then the bundle is empty
+        bool build(const std::vector<const traj_t *> &trajs);
+
+        // The states of all agents at the time, the same as traj_t::getStateAt
+        void evaluate(double time, std::vector<State> &states) const;
+
+        // Sample all agents at t = k * time_step, k < n_samples, the same as SampledStates::sampleAgent
+        void sample(double time_step, size_t n_samples, SampledStates &sampled_states) const;
+
+        [[nodiscard]] size_t getNumAgents() const { return qn; }
+
+        [[nodiscard]] static bool isAVX2Available();
+
+    private:
+        typedef std::vector<double, Eigen::aligned_allocator<double>> AlignedArray;
+
+        size_t qn = 0, n_lanes = 0; // n_lanes: qn padded to a multiple of 4
+        size_t M = 0, n = 0;
+        std::vector<double> segment_times;
+        AlignedArray coef; // [m][i][k][lane]
+
+        // Buffers of the evaluation, reused by the calls
+        mutable std::vector<double> weights; // [order][i]
+        mutable AlignedArray fields; // [SampledStates::Field][lane]
+
+        // The weights of the control points of the segment for the position, velocity and acceleration at the time,
+        // returns the segment or -1 if the time is out of bound
+        int computeWeights(double time) const;
+
+        // fields of all lanes from the weights
+        void evaluateFields(int m) const;
+    };
+}
+
+#endif //LSC_PLANNER_TRAJECTORY_BUNDLE_HPP
@@ -0,0 +1,73 @@
+#ifndef LSC_PLANNER_TRAJECTORY_CODEC_HPP
+#define LSC_PLANNER_TRAJECTORY_CODEC_HPP
+
+#include <cstdint>
+#include <vector>
+#include <trajectory.hpp>
+
+namespace DynamicPlanning {
+    // Wire format of the trajectory broadcast of an agent, all fields in the host byte order.
+    // Header (30 bytes): version (uint8), type (uint8), M (uint8), n (uint8), seq (uint16), reference_seq (uint16),
+    // reference_shift (uint8), reserved (uint8), quantization step (float32), segment time (float32),
+    // start point (3 x float32).
+    // The control points are quantized as integer offsets q from the start point in units of the step, [m][i][k].
+    // KEY: q as int16.
+    // DELTA: q - q_ref as zigzag varints, where q_ref is q of the frame reference_seq of the sender, shifted by
+    // reference_shift segments and taken relative to its new first control point. The replanned trajectory is close
+    // to the previous one shifted by the segments already executed, so the differences are small.
+    // Both frames of a trajectory decode to the same control points, start point + q * step.
+    namespace TrajectoryFrame {
+        static constexpr uint8_t VERSION = 1;
+        static constexpr size_t HEADER_SIZE = 4 * sizeof(uint8_t) + 2 * sizeof(uint16_t) + 2 * sizeof(uint8_t) +
+                                              5 * sizeof(float);
+
+        enum Type : uint8_t {
+            KEY = 0,
+            DELTA = 1,
+        };
+    }
+
+    class TrajectoryEncoder {
+    public:
+        // The quantization step is enlarged if the offsets of a trajectory do not fit int16
+        explicit TrajectoryEncoder(double quantization_step);
+
+        // Encode the trajectory as a key frame, and as a delta frame against the previous trajectory.
+        // delta_frame is empty if the previous trajectory has another layout or step.
+        // Returns false, with both frames empty, if the segment times are not uniform or the layout is too large.
+        bool encode(const traj_t &traj, std::vector<uint8_t> &key_frame, std::vector<uint8_t> &delta_frame);
+
+        [[nodiscard]] uint16_t getSeq() const { return seq; }
+
+    private:
+        double quantization_step;
+        uint16_t seq = 0;
+        bool has_reference = false;
+        size_t M = 0, n = 0;
+        float step = 0;
+        std::vector<int32_t> reference; // q of the previous trajectory [m][i][k]
+        std::vector<int32_t> offsets; // buffer of the current trajectory
+        std::vector<uint8_t> delta_candidate; // buffer of the delta frame of the other shift
+    };
+
+    // The decoder of one sender at one receiver
+    class TrajectoryDecoder {
+    public:
+        // Decode into traj, reusing its buffers. Returns false, with traj unchanged, if the version is unknown,
+        // the frame is malformed, or the reference of a delta frame is not the last decoded frame.
+        bool decode(const uint8_t *data, size_t size, traj_t &traj);
+
+        // The delta frames against seq can be decoded
+        [[nodiscard]] bool hasReference(uint16_t seq) const { return has_reference and reference_seq == seq; }
+
+    private:
+        bool has_reference = false;
+        uint16_t reference_seq = 0;
+        size_t M = 0, n = 0;
+        float step = 0;
+        std::vector<int32_t> reference; // q of the last decoded frame [m][i][k]
+        std::vector<int32_t> offsets; // buffer of the current frame
+    };
+}
+
+#endif //LSC_PLANNER_TRAJECTORY_CODEC_HPP
@@ -0,0 +1,51 @@
+#ifndef LSC_PLANNER_TRAJECTORY_HISTORY_MARKERS_HPP
+#define LSC_PLANNER_TRAJECTORY_HISTORY_MARKERS_HPP
+
+#include <mutex>
+#include <vector>
+#include <visualization_msgs/MarkerArray.h>
+
+namespace DynamicPlanning {
+    // Trajectory histories as LINE_STRIP chunks of fixed ids, so that a publication carries only the points added
+    // since the previous one instead of the whole history.
+    // A chunk is sealed when it has CHUNK_SIZE points, then it is downsampled and sent once. The open chunk is sent
+    // whenever it is changed. The chunks of a track have the namespace of its style and the ids 0, 1, ..., and each
+    // chunk starts at the last point of the previous one. The points are added by the simulator and the markers are
+    // taken by the visualization worker, concurrently.
+    class TrajectoryHistoryMarkers {
+    public:
+        static constexpr size_t CHUNK_SIZE = 200;
+
+        // downsample: a sealed chunk keeps every downsample-th point and its last point, 1 keeps all
+        explicit TrajectoryHistoryMarkers(int _downsample = 1);
+
+        // style: header, ns, scale and color of the chunks, the ns must be unique per track. Returns the track index.
+        size_t addTrack(const visualization_msgs::Marker &style);
+
+        void addPoint(size_t track, const geometry_msgs::Point &point);
+
+        // The chunks sealed since the last call and the changed open chunks. All chunks are returned again if a
+        // subscriber joined since the last call, and the first call clears the markers of the previous mission.
+        [[nodiscard]] visualization_msgs::MarkerArray takeMarkers(size_t n_subscribers);
+
+    private:
+        struct Track {
+            visualization_msgs::Marker style;
+            std::vector<visualization_msgs::Marker> sealed_chunks;
+            std::vector<geometry_msgs::Point> open_points;
+            size_t n_sent_chunks = 0;
+            bool is_open_changed = false;
+        };
+
+        mutable std::mutex mtx;
+        int downsample;
+        std::vector<Track> tracks;
+        size_t last_n_subscribers = 0;
+        bool is_first_take = true;
+
+        [[nodiscard]] visualization_msgs::Marker makeChunk(const Track &track, size_t chunk_id,
+                                                           const std::vector<geometry_msgs::Point> &points) const;
+    };
+}
+
+#endif //LSC_PLANNER_TRAJECTORY_HISTORY_MARKERS_HPP
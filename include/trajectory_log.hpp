@@ -0,0 +1,135 @@
+#ifndef LSC_PLANNER_TRAJECTORY_LOG_HPP
+#define LSC_PLANNER_TRAJECTORY_LOG_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace DynamicPlanning {
+    // Binary log of the simulation result.
+    // The file is a header followed by fixed-stride frames of float32, one frame per save step:
+    //   t, [px, py, pz, vx, vy, vz, ax, ay, az, planning_time] x qn, [px, py, pz, radius] x on
+    // The header carries qn, on, the strides and the field names, so a frame of any time is found without parsing.
+    namespace TrajectoryLog {
+        enum AgentField {
+            AGENT_PX, AGENT_PY, AGENT_PZ,
+            AGENT_VX, AGENT_VY, AGENT_VZ,
+            AGENT_AX, AGENT_AY, AGENT_AZ,
+            AGENT_PLANNING_TIME,
+            AGENT_STRIDE,
+        };
+
+        enum ObstacleField {
+            OBSTACLE_PX, OBSTACLE_PY, OBSTACLE_PZ,
+            OBSTACLE_RADIUS,
+            OBSTACLE_STRIDE,
+        };
+
+        // field names of the schema, in the order of the fields
+        extern const char *const SCHEMA;
+        extern const char MAGIC[8];
+        constexpr uint32_t VERSION = 1;
+
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            uint32_t qn;
+            uint32_t on;
+            uint32_t agent_stride; // the number of floats per agent
+            uint32_t obstacle_stride; // the number of floats per obstacle
+            uint32_t data_offset; // bytes from the beginning of the file to the first frame, aligned to 8 bytes
+            double time_step; // save time step
+        };
+        // the schema string of data_offset - sizeof(Header) bytes follows the header, null terminated
+
+        [[nodiscard]] inline size_t getFrameStride(size_t qn, size_t on) {
+            return 1 + qn * AGENT_STRIDE + on * OBSTACLE_STRIDE;
+        }
+
+        // offset of the agent in a frame
+        [[nodiscard]] inline size_t getAgentOffset(size_t qi) {
+            return 1 + qi * AGENT_STRIDE;
+        }
+
+        // offset of the obstacle in a frame
+        [[nodiscard]] inline size_t getObstacleOffset(size_t qn, size_t oi) {
+            return 1 + qn * AGENT_STRIDE + oi * OBSTACLE_STRIDE;
+        }
+
+        // Write the header and the schema, the frames follow them
+        void writeHeader(std::ostream &out, size_t qn, size_t on, double time_step);
+
+        // Append the header row or a frame in the csv format of the simulator
+        void appendCSVHeader(std::string &out, size_t qn, size_t on);
+
+        void appendCSVFrame(std::string &out, const float *frame, size_t qn, size_t on);
+    }
+
+    // Read-only view of a binary log. The file is memory-mapped, so opening is O(1) and the frame of any time is
+    // accessed in O(1) without loading the frames before it.
+    // The frames are indexed by their time stamps in buckets of the save time step, so that findFrame is O(1) for
+    // the logs saved at a constant rate and stays O(1) on average if some save steps are dropped or repeated.
+    class TrajectoryLogReader {
+    public:
+        TrajectoryLogReader() = default;
+
+        ~TrajectoryLogReader();
+
+        TrajectoryLogReader(const TrajectoryLogReader &) = delete;
+
+        TrajectoryLogReader &operator=(const TrajectoryLogReader &) = delete;
+
+        // Map the file, throws std::invalid_argument if it is not a valid log. A truncated last frame is ignored.
+        void open(const std::string &file_name);
+
+        // Use the frames in memory instead of a file, e.g. the frames parsed from a csv file
+        void assign(size_t qn, size_t on, double time_step, std::vector<float> frames);
+
+        void close();
+
+        [[nodiscard]] size_t getNumAgents() const { return qn; }
+
+        [[nodiscard]] size_t getNumObstacles() const { return on; }
+
+        [[nodiscard]] double getTimeStep() const { return time_step; }
+
+        [[nodiscard]] size_t size() const { return n_frames; }
+
+        [[nodiscard]] bool empty() const { return n_frames == 0; }
+
+        [[nodiscard]] double getTime(size_t frame_idx) const { return getFrame(frame_idx)[0]; }
+
+        // The last frame at or before t, 0 if t is before the first frame. The log must not be empty.
+        [[nodiscard]] size_t findFrame(double t) const;
+
+        // AGENT_STRIDE floats of the agent, indexed by TrajectoryLog::AgentField
+        [[nodiscard]] const float *getAgent(size_t frame_idx, size_t qi) const {
+            return getFrame(frame_idx) + TrajectoryLog::getAgentOffset(qi);
+        }
+
+        // OBSTACLE_STRIDE floats of the obstacle, indexed by TrajectoryLog::ObstacleField
+        [[nodiscard]] const float *getObstacle(size_t frame_idx, size_t oi) const {
+            return getFrame(frame_idx) + TrajectoryLog::getObstacleOffset(qn, oi);
+        }
+
+        // Write the log in the csv format of the simulator
+        void exportCSV(const std::string &file_name) const;
+
+    private:
+        void *mapped = nullptr;
+        size_t mapped_size = 0;
+        std::vector<float> owned_frames;
+        const float *frames = nullptr;
+        size_t qn = 0, on = 0, frame_stride = 0, n_frames = 0;
+        double time_step = 0;
+        std::vector<uint32_t> time_index; // [bucket], the last frame at or before the start of the bucket
+        double bucket_width = 0; // [s]
+
+        void buildTimeIndex();
+
+        [[nodiscard]] const float *getFrame(size_t frame_idx) const { return frames + frame_idx * frame_stride; }
+    };
+}
+
+#endif //LSC_PLANNER_TRAJECTORY_LOG_HPP
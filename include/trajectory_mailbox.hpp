@@ -0,0 +1,46 @@
+#ifndef LSC_PLANNER_TRAJECTORY_MAILBOX_HPP
+#define LSC_PLANNER_TRAJECTORY_MAILBOX_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <trajectory.hpp>
+
+namespace DynamicPlanning {
+    // The newest trajectory of each agent, read by the neighbours by reference instead of a copy per receiver.
+    // A slot keeps SLOT_DEPTH versions in a ring. The owner writes the next version into the buffer after the newest
+    // one, which reuses its allocation, and then advances the version with a release store. A reader acquires the
+    // version and refers to its buffer, which is not written again before the owner publishes SLOT_DEPTH - 1 more
+    // versions.
+    class TrajectoryMailbox {
+    public:
+        static constexpr size_t SLOT_DEPTH = 3;
+
+        // Not thread-safe, all slots are reset to the empty trajectory
+        void resize(size_t _n_slots);
+
+        [[nodiscard]] size_t size() const { return n_slots; }
+
+        // Only one thread publishes to a slot
+        void publish(size_t slot_idx, const traj_t &traj);
+
+        // The newest version, the empty trajectory if nothing is published. The reference is valid until the owner
+        // publishes SLOT_DEPTH - 1 more versions.
+        [[nodiscard]] const traj_t &read(size_t slot_idx) const;
+
+        // The number of versions published to the slot
+        [[nodiscard]] uint64_t getVersion(size_t slot_idx) const;
+
+    private:
+        struct alignas(64) Slot {
+            std::array<traj_t, SLOT_DEPTH> trajs; // [version % SLOT_DEPTH]
+            std::atomic<uint64_t> version{0};
+        };
+
+        std::unique_ptr<Slot[]> slots;
+        size_t n_slots = 0;
+    };
+}
+
+#endif //LSC_PLANNER_TRAJECTORY_MAILBOX_HPP
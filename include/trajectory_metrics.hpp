@@ -0,0 +1,68 @@
+#ifndef LSC_PLANNER_TRAJECTORY_METRICS_HPP
+#define LSC_PLANNER_TRAJECTORY_METRICS_HPP
+
+#include <vector>
+#include <sp_const.hpp>
+#include <mission.hpp>
+#include <trajectory_log.hpp>
+#include <worker_pool.hpp>
+
+namespace DynamicPlanning {
+    // The statistics of the summary of the simulator computed from a trajectory log, see saveSummarizedResultAsCSV.
+    // The metrics of the parts of a log are merged in the order of the parts, so the result does not depend on the
+    // number of the tasks.
+    struct TrajectoryMetrics {
+        double total_flight_time = 0; // [s], the time of the last frame
+        double total_distance = 0; // [m], the sum over the agents
+        double safety_ratio_agent = SP_INFINITY;
+        double safety_ratio_obs = SP_INFINITY;
+        vector3d vel_excess_ratio = vector3d(0, 0, 0);
+        vector3d acc_excess_ratio = vector3d(0, 0, 0);
+        size_t n_agent_collisions = 0; // the frame intervals and the pairs of agents with a safety ratio below 1
+        size_t n_obstacle_collisions = 0; // the frame intervals and the pairs of an agent and an obstacle
+        double first_collision_time = SP_INFINITY; // [s], the start of the first interval with a collision
+        PlanningTime planning_time; // [s], the planning times of the frames in which they changed
+
+        [[nodiscard]] bool isCollided() const { return n_agent_collisions + n_obstacle_collisions > 0; }
+
+        void merge(const TrajectoryMetrics &other);
+    };
+
+    // The metrics of the summary from a log without the simulator, e.g. of a headless run whose online statistics were
+    // skipped by multisim/offline_metrics. The frames are split into windows, and the windows and the agents are
+    // computed in parallel in the pool, one task per window and agent.
+    // The samples of the log are joined by straight lines, and the minimum distance of two linear motions on the same
+    // interval is exact in the coordinates scaled by the downwash, so the contacts between the frames are found, unlike
+    // the checks of the samples in the simulator. With continuous false, only the frames are checked as the simulator
+    // does. The radii and the downwashes are the ones of the mission, and its real obstacles are skipped.
+    class TrajectoryMetricsEngine {
+    public:
+        TrajectoryMetricsEngine(const TrajectoryLogReader &log, const Mission &mission, int world_dimension);
+
+        // n_windows <= 0: four windows per worker of the pool
+        [[nodiscard]] TrajectoryMetrics compute(WorkerPool &pool, int n_windows, bool continuous) const;
+
+    private:
+        const TrajectoryLogReader &log;
+        const Mission &mission;
+        int world_dimension;
+        std::vector<size_t> sim_obstacles; // the obstacles of the log except the real obstacles
+
+        // The metrics of the agent qi on the frames [frame_begin, frame_end) and the intervals to the next frames,
+        // with the agents qj > qi and the obstacles
+        void computeAgentWindow(size_t qi, size_t frame_begin, size_t frame_end, bool continuous,
+                                TrajectoryMetrics &metrics) const;
+
+        [[nodiscard]] point3d getAgentPosition(size_t frame_idx, size_t qi) const;
+
+        [[nodiscard]] point3d getObstaclePosition(size_t frame_idx, size_t oi) const;
+
+        // The safety ratio of the ellipsoids of the radius sum and the downwash, over the interval if continuous,
+        // otherwise at the start of the interval
+        [[nodiscard]] static double computeSafetyRatio(const point3d &start1, const point3d &end1,
+                                                       const point3d &start2, const point3d &end2,
+                                                       double radius_sum, double downwash, bool continuous);
+    };
+}
+
+#endif //LSC_PLANNER_TRAJECTORY_METRICS_HPP
@@ -0,0 +1,48 @@
+#ifndef LSC_PLANNER_TRAJECTORY_SERVER_HPP
+#define LSC_PLANNER_TRAJECTORY_SERVER_HPP
+
+#include <array>
+#include <vector>
+#include <trajectory.hpp>
+#include <triple_buffer.hpp>
+
+namespace DynamicPlanning {
+    // Desired state of the newest trajectory for a controller running faster than the planner.
+    // When a trajectory arrives, the Bernstein control points of each segment are converted once to the power basis
+    // in the time since the start of the segment, with the coefficients of the velocity and the acceleration. A query
+    // finds the segment and evaluates the three polynomials by Horner's method, a few multiply-adds per axis.
+    // The tables are handed over by a triple buffer, so the planner thread (one producer) and the control thread (one
+    // consumer) never wait for each other.
+    class TrajectoryServer {
+    public:
+        // Producer: serve traj from start_time, the time of both arguments is in the clock of getState
+        void setTrajectory(const traj_t &traj, double start_time);
+
+        // Consumer: the desired state at the time, false if no trajectory is served. The time is clamped to the
+        // duration of the trajectory, so the vehicle holds the end state after the trajectory.
+        bool getState(double time, State &state);
+
+    private:
+        static constexpr size_t CAPACITY = MAX_BERNSTEIN_DEGREE + 1;
+
+        typedef std::array<std::array<double, 3>, CAPACITY> Coefficients; // [power][axis]
+
+        struct SegmentTable {
+            double start_time; // [s], since the start of the trajectory
+            int degree;
+            Coefficients position, velocity, acceleration;
+        };
+
+        // The segment buffer of a table is reused by the next trajectory written to it
+        struct Table {
+            bool is_valid = false;
+            double start_time = 0;
+            double duration = 0;
+            std::vector<SegmentTable> segments;
+        };
+
+        TripleBuffer<Table> tables;
+    };
+}
+
+#endif //LSC_PLANNER_TRAJECTORY_SERVER_HPP
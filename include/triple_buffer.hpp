@@ -0,0 +1,49 @@
+#ifndef LSC_PLANNER_TRIPLE_BUFFER_HPP
+#define LSC_PLANNER_TRIPLE_BUFFER_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace DynamicPlanning {
+    // Lock-free handoff of the newest value from one producer thread to one consumer thread.
+    // The producer writes to its back buffer and publishes it by swapping it with the middle buffer, and the consumer
+    // takes the middle buffer by swapping it with its front buffer. Neither side waits for the other, and a value
+    // that is not taken before the next publish is dropped.
+    template<typename T>
+    class TripleBuffer {
+    public:
+        // Producer: the buffer to write the next value to, it holds an older value to be overwritten
+        T &getBackBuffer() { return buffers[back]; }
+
+        // Producer: make the back buffer the newest value
+        void publish() {
+            uint8_t prev_middle = middle.exchange(static_cast<uint8_t>(back | NEW_VALUE), std::memory_order_acq_rel);
+            back = prev_middle & INDEX_MASK;
+        }
+
+        // Consumer: take the newest value if there is one published after the last take, false otherwise
+        bool update() {
+            if ((middle.load(std::memory_order_relaxed) & NEW_VALUE) == 0) {
+                return false;
+            }
+            uint8_t prev_middle = middle.exchange(front, std::memory_order_acq_rel);
+            front = prev_middle & INDEX_MASK;
+            return true;
+        }
+
+        // Consumer: the value taken by the last update
+        [[nodiscard]] const T &getFrontBuffer() const { return buffers[front]; }
+
+    private:
+        static constexpr uint8_t INDEX_MASK = 0x3;
+        static constexpr uint8_t NEW_VALUE = 0x4;
+
+        std::array<T, 3> buffers;
+        uint8_t back = 0; // producer only
+        std::atomic<uint8_t> middle{1}; // the index of the middle buffer and NEW_VALUE if it is not taken
+        uint8_t front = 2; // consumer only
+    };
+}
+
+#endif //LSC_PLANNER_TRIPLE_BUFFER_HPP
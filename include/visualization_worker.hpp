@@ -0,0 +1,56 @@
+#ifndef LSC_PLANNER_VISUALIZATION_WORKER_HPP
+#define LSC_PLANNER_VISUALIZATION_WORKER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace DynamicPlanning {
+    // Low priority background thread that builds and publishes visualization messages,
+    // so that the marker generation does not block the planning loop.
+    // Only the latest job of each key is kept, older pending jobs are dropped. The jobs capture immutable snapshots
+    // of the state they draw, so the planner never waits for them. A key runs at most at the rate of setMaxRate.
+    class VisualizationWorker {
+    public:
+        typedef std::function<void()> Job;
+
+        static VisualizationWorker &getInstance();
+
+        ~VisualizationWorker();
+
+        VisualizationWorker(const VisualizationWorker &) = delete;
+
+        VisualizationWorker &operator=(const VisualizationWorker &) = delete;
+
+        // key: usually the topic name, a new job replaces the pending job with the same key
+        void submit(const std::string &key, Job job);
+
+        // The jobs of a key run at most max_rate times per second, a job submitted in between replaces the pending
+        // one. 0: as soon as they are submitted
+        void setMaxRate(double max_rate);
+
+        [[nodiscard]] size_t getNumDroppedJobs() const;
+
+        [[nodiscard]] size_t getNumPendingJobs() const;
+
+    private:
+        std::thread worker;
+        mutable std::mutex mtx;
+        std::condition_variable cv;
+        std::map<std::string, Job> pending_jobs;
+        std::map<std::string, std::chrono::steady_clock::time_point> last_run_times; // [key]
+        std::chrono::steady_clock::duration min_interval{0};
+        size_t n_dropped_jobs;
+        bool stop;
+
+        VisualizationWorker();
+
+        void workerLoop();
+    };
+}
+
+#endif //LSC_PLANNER_VISUALIZATION_WORKER_HPP
@@ -0,0 +1,176 @@
+#ifndef LSC_PLANNER_WORKER_POOL_HPP
+#define LSC_PLANNER_WORKER_POOL_HPP
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cpu_topology.hpp>
+
+namespace DynamicPlanning {
+    // Priority of the queued tasks of a TaskGroup. The idle workers take the HIGH tasks before the LOW ones, e.g. the
+    // planning before the logging, and the batches of run and runAffine before both. A running task is not preempted.
+    enum class TaskPriority {
+        HIGH = 0,
+        LOW = 1,
+    };
+
+    class WorkerPool;
+
+    // Tasks queued on a worker pool without blocking the caller, e.g. the tasks of a TaskGraph as they become ready.
+    // wait() blocks until all tasks of the group are finished, and the waiting thread runs the queued tasks of the
+    // group meanwhile, so the group also finishes on a pool without idle workers. cancel() drops the tasks that have
+    // not started yet, and the running tasks poll isCancelled() to stop early.
+    // A task may add tasks to its own group. The destructor waits for the tasks.
+    class TaskGroup {
+    public:
+        explicit TaskGroup(WorkerPool &pool, TaskPriority priority = TaskPriority::HIGH);
+
+        ~TaskGroup();
+
+        TaskGroup(const TaskGroup &) = delete;
+
+        TaskGroup &operator=(const TaskGroup &) = delete;
+
+        // Tasks must not throw. A task runs inside the parallel region of the pool, so its own parallel loops run
+        // serially.
+        void run(std::function<void()> task);
+
+        void wait();
+
+        void cancel();
+
+        [[nodiscard]] bool isCancelled() const;
+
+    private:
+        friend class WorkerPool;
+
+        struct QueuedTask {
+            std::function<void()> task;
+            int64_t queued_ns; // steady clock
+        };
+
+        // Shared with the queues of the pool, which may refer to the group after its tasks are taken by wait()
+        struct State {
+            TaskPriority priority;
+            std::mutex mtx;
+            std::condition_variable cv;
+            std::deque<QueuedTask> tasks; // not started, in the order of run
+            size_t n_unfinished = 0; // queued or running
+            std::atomic<bool> is_cancelled{false};
+        };
+
+        WorkerPool &pool;
+        std::shared_ptr<State> state;
+
+        // Run the first queued task of the group, false if there is none
+        static bool runQueuedTask(State &state);
+    };
+
+    // Fixed set of threads kept alive between batches to avoid thread spin-up at every step.
+    // Idle workers take the next task from a shared counter, so uneven tasks are balanced dynamically.
+    // The pool is the one scheduler of the process: the parallel loops of the planners, the simulator and the maps run
+    // as batches, and the independent jobs as the queued tasks of task groups. Each worker queues the tasks it adds
+    // on its own deque and takes the latest one first, and an idle worker steals the oldest task of the others.
+    // The batches, the waits and the queued tasks of each priority are counted in the metrics registry as
+    // lsc_worker_pool_*, and the queued tasks are trace scopes.
+    class WorkerPool {
+    public:
+        // Pool with one worker per core, shared by the parallel loops inside the planner
+        static WorkerPool &getInstance();
+
+        // If n_workers <= 0, use the number of cores
+        explicit WorkerPool(int n_workers);
+
+        ~WorkerPool();
+
+        WorkerPool(const WorkerPool &) = delete;
+
+        WorkerPool &operator=(const WorkerPool &) = delete;
+
+        // Run task(0), ..., task(n_tasks - 1) and block until all of them are finished.
+        // The calling thread also runs tasks. Tasks must not throw.
+        // If it is called inside a task of any pool, or while the pool runs another batch,
+        // the tasks run serially on the calling thread so that nested parallelism does not oversubscribe.
+        void run(size_t n_tasks, const std::function<void(size_t)> &task);
+
+        // Same as run, but task(i) runs on the worker keys[i] % getNumWorkers() first, so that the tasks of a key
+        // run on the same worker at every batch and find their data in its cache and its NUMA node.
+        // The worker 0 is the calling thread. An idle worker takes the tasks of the others after its own.
+        void runAffine(const std::vector<size_t> &keys, const std::function<void(size_t)> &task);
+
+        // Pin the workers other than the calling thread to the CPUs of CPUTopology::getPlacement,
+        // NONE unpins them. False if the OS does not support it.
+        bool setPlacement(ThreadPlacementMode mode);
+
+        [[nodiscard]] int getNumWorkers() const { return static_cast<int>(workers.size()) + 1; }
+
+        // map(i) for i < n_tasks in parallel, then the results are combined in the order of i on the calling thread,
+        // so the result, e.g. a floating-point sum, does not depend on the number of workers or the schedule
+        template<typename T, typename Map, typename Combine>
+        T reduce(size_t n_tasks, T identity, Map &&map, Combine &&combine) {
+            std::vector<T> results(n_tasks, identity);
+            run(n_tasks, [&](size_t i) { results[i] = map(i); });
+            T result = std::move(identity);
+            for (auto &task_result: results) {
+                result = combine(std::move(result), std::move(task_result));
+            }
+            return result;
+        }
+
+        // [s], the CPU time that the other workers of any pool spent on the batches of the calling thread, summed
+        // since the thread started. The tasks run by the calling thread itself are in its own CPU time.
+        [[nodiscard]] static double getHelperCPUSeconds();
+
+    private:
+        friend class TaskGroup;
+
+        static constexpr int N_PRIORITIES = 2;
+
+        // The groups with a queued task, one entry per task. The slot 0 is for the threads outside of the pool,
+        // the slot i for the worker i.
+        struct TaskQueue {
+            std::mutex mtx;
+            std::deque<std::shared_ptr<TaskGroup::State>> groups;
+        };
+
+        std::vector<std::thread> workers;
+        std::mutex run_mtx; // one batch at a time
+        std::mutex mtx;
+        std::condition_variable cv_start, cv_finish;
+
+        // Current batch
+        const std::function<void(size_t)> *current_task = nullptr;
+        size_t n_tasks_total = 0;
+        std::atomic<size_t> next_task{0};
+        std::vector<std::vector<size_t>> affine_tasks; // [worker], the tasks of runAffine, empty in run
+        std::unique_ptr<std::atomic<size_t>[]> affine_next_tasks; // [worker], the next index in affine_tasks
+        size_t n_tasks_finished = 0;
+        std::atomic<int64_t> batch_helper_cpu_ns{0}; // the CPU time of the other workers on the current batch
+        int n_busy_workers = 0;
+        int batch_seq = 0;
+        bool stop = false;
+
+        std::array<std::unique_ptr<TaskQueue[]>, N_PRIORITIES> task_queues; // [priority][slot]
+        int64_t n_queued = 0; // entries of task_queues, guarded by mtx
+
+        void runBatch(size_t n_tasks, const std::function<void(size_t)> &task, const std::vector<size_t> *keys);
+
+        void workerLoop(int worker_idx);
+
+        void runTasks(const std::function<void(size_t)> &task, size_t n_tasks, int worker_idx);
+
+        void enqueue(const std::shared_ptr<TaskGroup::State> &group);
+
+        // The entry of the own slot queued last, or the one of another slot queued first, in the order of priority
+        std::shared_ptr<TaskGroup::State> dequeue(int slot);
+    };
+}
+
+#endif //LSC_PLANNER_WORKER_POOL_HPP
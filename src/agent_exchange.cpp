@@ -0,0 +1,547 @@
+#include <agent_exchange.hpp>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+namespace DynamicPlanning {
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        Clock::time_point getDeadline() {
+            return Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(AgentExchange::TIMEOUT));
+        }
+
+        class BlockOut {
+        public:
+            explicit BlockOut(std::vector<uint8_t> &_block) : block(_block) {}
+
+            template<typename T>
+            void operator()(const T &value) {
+                static_assert(std::is_arithmetic<T>::value, "not serializable");
+                size_t offset = block.size();
+                block.resize(offset + sizeof(T));
+                std::memcpy(block.data() + offset, &value, sizeof(T));
+            }
+
+            void operator()(const point3d &point) {
+                for (int k = 0; k < 3; k++) {
+                    (*this)(point(k));
+                }
+            }
+
+            void operator()(const State &state) {
+                (*this)(state.position);
+                (*this)(state.velocity);
+                (*this)(state.acceleration);
+            }
+
+            void operator()(const traj_t &traj) {
+                int M = traj.size();
+                uint32_t n_points = M > 0 ? traj[0].control_points.size() : 0;
+                (*this)(static_cast<uint32_t>(M));
+                (*this)(n_points);
+                for (int m = 0; m < M; m++) {
+                    (*this)(traj[m].segment_time);
+                    for (const auto &point: traj[m].control_points) {
+                        (*this)(point);
+                    }
+                }
+            }
+
+        private:
+            std::vector<uint8_t> &block;
+        };
+
+        class BlockIn {
+        public:
+            BlockIn(const uint8_t *_ptr, const uint8_t *_end) : ptr(_ptr), end(_end) {}
+
+            template<typename T>
+            void operator()(T &value) {
+                static_assert(std::is_arithmetic<T>::value, "not serializable");
+                if (not ok or static_cast<size_t>(end - ptr) < sizeof(T)) {
+                    ok = false;
+                    return;
+                }
+                std::memcpy(&value, ptr, sizeof(T));
+                ptr += sizeof(T);
+            }
+
+            void operator()(point3d &point) {
+                for (int k = 0; k < 3; k++) {
+                    (*this)(point(k));
+                }
+            }
+
+            void operator()(State &state) {
+                (*this)(state.position);
+                (*this)(state.velocity);
+                (*this)(state.acceleration);
+            }
+
+            void operator()(traj_t &traj) {
+                uint32_t M = 0, n_points = 0;
+                (*this)(M);
+                (*this)(n_points);
+                if (not ok or n_points > ControlPoints<point3d>::CAPACITY or (M > 0 and n_points == 0) or
+                    static_cast<size_t>(M) * n_points * 3 * sizeof(float) > static_cast<size_t>(end - ptr)) {
+                    ok = false;
+                    return;
+                }
+                if (M == 0) {
+                    traj.clear();
+                    return;
+                }
+                traj.reset(M, n_points - 1, 0);
+                for (uint32_t m = 0; m < M and ok; m++) {
+                    (*this)(traj[m].segment_time);
+                    for (auto &point: traj[m].control_points) {
+                        (*this)(point);
+                    }
+                }
+            }
+
+            [[nodiscard]] bool isOk() const { return ok; }
+
+        private:
+            const uint8_t *ptr;
+            const uint8_t *end;
+            bool ok = true;
+        };
+    }
+
+    size_t AgentExchangeBlock::getCapacity(size_t n_agents, size_t M, size_t n) {
+        size_t traj_size = 2 * sizeof(uint32_t) + M * (sizeof(double) + (n + 1) * 3 * sizeof(float));
+        size_t agent_size = sizeof(int32_t) + 15 * sizeof(float) + sizeof(uint8_t) + traj_size;
+        return sizeof(uint8_t) + sizeof(uint32_t) + n_agents * agent_size;
+    }
+
+    void AgentExchangeBlock::write(bool has_failed, const std::vector<ExchangedAgent> &agents,
+                                   std::vector<uint8_t> &block) {
+        block.clear();
+        BlockOut out(block);
+        out(static_cast<uint8_t>(has_failed ? 1 : 0));
+        out(static_cast<uint32_t>(agents.size()));
+        for (const auto &agent: agents) {
+            out(static_cast<int32_t>(agent.id));
+            out(agent.current_state);
+            out(agent.current_goal_point);
+            out(agent.desired_goal_point);
+            out(static_cast<uint8_t>(agent.collision_alert ? 1 : 0));
+            out(agent.traj);
+        }
+    }
+
+    bool AgentExchangeBlock::read(const std::vector<uint8_t> &block, bool &has_failed,
+                                  std::vector<ExchangedAgent> &agents) {
+        BlockIn in(block.data(), block.data() + block.size());
+        uint8_t failed_flag = 0;
+        uint32_t n_agents = 0;
+        in(failed_flag);
+        in(n_agents);
+        has_failed = failed_flag != 0;
+        for (uint32_t i = 0; i < n_agents and in.isOk(); i++) {
+            ExchangedAgent agent;
+            int32_t id = 0;
+            uint8_t collision_alert = 0;
+            in(id);
+            in(agent.current_state);
+            in(agent.current_goal_point);
+            in(agent.desired_goal_point);
+            in(collision_alert);
+            in(agent.traj);
+            agent.id = id;
+            agent.collision_alert = collision_alert != 0;
+            if (in.isOk()) {
+                agents.emplace_back(std::move(agent));
+            }
+        }
+        return in.isOk();
+    }
+
+    std::unique_ptr<AgentExchange> AgentExchange::create(AgentExchangeMode mode, const std::string &address,
+                                                         int num_processes, int process_index,
+                                                         size_t block_capacity) {
+        if (mode == AgentExchangeMode::SHARED_MEMORY) {
+            auto exchange = std::make_unique<SharedMemoryAgentExchange>(address, num_processes, process_index,
+                                                                        block_capacity);
+            if (exchange->isOpen()) {
+                return exchange;
+            }
+        } else {
+            auto exchange = std::make_unique<SocketAgentExchange>(address, num_processes, process_index,
+                                                                  block_capacity);
+            if (exchange->isOpen()) {
+                return exchange;
+            }
+        }
+        return nullptr;
+    }
+
+    bool AgentExchange::parseMode(const std::string &str, AgentExchangeMode &mode) {
+        if (str == "shared_memory") {
+            mode = AgentExchangeMode::SHARED_MEMORY;
+        } else if (str == "socket") {
+            mode = AgentExchangeMode::SOCKET;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    std::string AgentExchange::getModeStr(AgentExchangeMode mode) {
+        const std::string mode_strs[] = {"shared_memory", "socket"};
+        return mode_strs[static_cast<int>(mode)];
+    }
+
+    // The atomics are lock-free, so they work across the processes that map the segment
+    struct SharedMemoryAgentExchange::Header {
+        static constexpr uint64_t MAGIC = 0x4c53434147455843; // set by the process 0 when the segment is ready
+
+        std::atomic<uint64_t> magic;
+        uint64_t num_processes;
+        uint64_t block_capacity;
+        std::atomic<uint32_t> n_arrived; // at the barrier of the current generation
+        std::atomic<uint32_t> generation;
+    };
+
+    SharedMemoryAgentExchange::SharedMemoryAgentExchange(const std::string &_name, int _num_processes,
+                                                         int _process_index, size_t _block_capacity)
+            : name(_name.empty() or _name[0] != '/' ? "/" + _name : _name), num_processes(_num_processes),
+              process_index(_process_index), block_capacity(_block_capacity) {
+        static_assert(std::atomic<uint64_t>::is_always_lock_free and std::atomic<uint32_t>::is_always_lock_free,
+                      "the barrier needs lock-free atomics");
+        // A slot per cache line, so the processes do not write the same line
+        block_capacity = (block_capacity + 63) / 64 * 64;
+        segment_size = 64 + 2 * num_processes * (sizeof(uint64_t) + block_capacity);
+
+        void *segment = MAP_FAILED;
+        if (process_index == 0) {
+            // A segment of a crashed run is removed, so the process 0 is started before the others
+            shm_unlink(name.c_str());
+            int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+            if (fd < 0 or ftruncate(fd, static_cast<off_t>(segment_size)) != 0) {
+                ROS_ERROR_STREAM("[AgentExchange] Failed to create the shared memory " << name << ": "
+                                 << std::strerror(errno));
+                if (fd >= 0) {
+                    close(fd);
+                }
+                return;
+            }
+            segment = mmap(nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+            if (segment == MAP_FAILED) {
+                ROS_ERROR_STREAM("[AgentExchange] Failed to map the shared memory " << name);
+                return;
+            }
+
+            // The segment is zero-filled by ftruncate
+            auto *new_header = static_cast<Header *>(segment);
+            new_header->num_processes = num_processes;
+            new_header->block_capacity = block_capacity;
+            new_header->n_arrived.store(0, std::memory_order_relaxed);
+            new_header->generation.store(0, std::memory_order_relaxed);
+            new_header->magic.store(Header::MAGIC, std::memory_order_release);
+        } else {
+            Clock::time_point deadline = getDeadline();
+            while (segment == MAP_FAILED and Clock::now() < deadline) {
+                int fd = shm_open(name.c_str(), O_RDWR, 0600);
+                struct stat segment_stat{};
+                if (fd >= 0 and fstat(fd, &segment_stat) == 0 and
+                    static_cast<size_t>(segment_stat.st_size) == segment_size) {
+                    segment = mmap(nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                }
+                if (fd >= 0) {
+                    close(fd);
+                }
+
+                auto *ready_header = static_cast<Header *>(segment);
+                if (segment != MAP_FAILED and
+                    (ready_header->magic.load(std::memory_order_acquire) != Header::MAGIC or
+                     ready_header->num_processes != static_cast<uint64_t>(num_processes) or
+                     ready_header->block_capacity != block_capacity)) {
+                    munmap(segment, segment_size);
+                    segment = MAP_FAILED;
+                }
+                if (segment == MAP_FAILED) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                }
+            }
+            if (segment == MAP_FAILED) {
+                ROS_ERROR_STREAM("[AgentExchange] The shared memory " << name << " of the process 0 is not ready");
+                return;
+            }
+        }
+
+        header = static_cast<Header *>(segment);
+        slots = static_cast<uint8_t *>(segment) + 64;
+    }
+
+    SharedMemoryAgentExchange::~SharedMemoryAgentExchange() {
+        if (header == nullptr) {
+            return;
+        }
+        munmap(header, segment_size);
+        if (process_index == 0) {
+            // The others keep their mappings until they exit
+            shm_unlink(name.c_str());
+        }
+    }
+
+    uint8_t *SharedMemoryAgentExchange::getSlot(uint64_t parity, int pi) const {
+        return slots + (parity * num_processes + pi) * (sizeof(uint64_t) + block_capacity);
+    }
+
+    bool SharedMemoryAgentExchange::waitBarrier() {
+        uint32_t generation = header->generation.load(std::memory_order_acquire);
+        if (header->n_arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == static_cast<uint32_t>(num_processes)) {
+            header->n_arrived.store(0, std::memory_order_relaxed);
+            header->generation.store(generation + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Spin for the short steps, then sleep for a process that plans longer
+        Clock::time_point deadline = getDeadline();
+        for (int spin = 0; header->generation.load(std::memory_order_acquire) == generation; spin++) {
+            if (spin < 1000) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+                if (Clock::now() > deadline) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    bool SharedMemoryAgentExchange::exchange(const std::vector<uint8_t> &block,
+                                             std::vector<std::vector<uint8_t>> &blocks) {
+        if (block.size() > block_capacity) {
+            ROS_ERROR_STREAM("[AgentExchange] The block of " << block.size() << " bytes exceeds the capacity "
+                             << block_capacity);
+            return false;
+        }
+
+        uint64_t parity = step % 2;
+        uint8_t *slot = getSlot(parity, process_index);
+        uint64_t size = block.size();
+        std::memcpy(slot, &size, sizeof(uint64_t));
+        std::memcpy(slot + sizeof(uint64_t), block.data(), block.size());
+        if (not waitBarrier()) {
+            ROS_ERROR_STREAM("[AgentExchange] Lost a process at the step " << step);
+            return false;
+        }
+
+        blocks.resize(num_processes);
+        for (int pi = 0; pi < num_processes; pi++) {
+            const uint8_t *other_slot = getSlot(parity, pi);
+            std::memcpy(&size, other_slot, sizeof(uint64_t));
+            if (size > block_capacity) {
+                ROS_ERROR_STREAM("[AgentExchange] Invalid block of the process " << pi);
+                return false;
+            }
+            blocks[pi].assign(other_slot + sizeof(uint64_t), other_slot + sizeof(uint64_t) + size);
+        }
+        step++;
+        return true;
+    }
+
+    SocketAgentExchange::SocketAgentExchange(const std::string &_address, int _num_processes, int _process_index,
+                                             size_t _block_capacity)
+            : num_processes(_num_processes), process_index(_process_index), block_capacity(_block_capacity) {
+        size_t colon = _address.rfind(':');
+        if (colon == std::string::npos) {
+            ROS_ERROR_STREAM("[AgentExchange] Invalid address " << _address << ", use host:port");
+            return;
+        }
+        std::string host = _address.substr(0, colon);
+        std::string port = _address.substr(colon + 1);
+
+        addrinfo hints{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = process_index == 0 ? AI_PASSIVE : 0;
+        addrinfo *address_info = nullptr;
+        if (getaddrinfo(process_index == 0 ? nullptr : host.c_str(), port.c_str(), &hints, &address_info) != 0) {
+            ROS_ERROR_STREAM("[AgentExchange] Invalid address " << _address);
+            return;
+        }
+
+        Clock::time_point deadline = getDeadline();
+        peer_fds.assign(num_processes, -1);
+        if (process_index == 0) {
+            // The others connect in any order and tell their process index first
+            int listen_fd = socket(address_info->ai_family, address_info->ai_socktype, address_info->ai_protocol);
+            int reuse = 1;
+            setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+            if (listen_fd < 0 or bind(listen_fd, address_info->ai_addr, address_info->ai_addrlen) != 0 or
+                listen(listen_fd, num_processes) != 0) {
+                ROS_ERROR_STREAM("[AgentExchange] Failed to listen at the port " << port << ": "
+                                 << std::strerror(errno));
+                if (listen_fd >= 0) {
+                    close(listen_fd);
+                }
+                freeaddrinfo(address_info);
+                return;
+            }
+
+            int n_connected = 0;
+            while (n_connected < num_processes - 1 and Clock::now() < deadline) {
+                pollfd listen_poll{listen_fd, POLLIN, 0};
+                if (poll(&listen_poll, 1, 100) <= 0) {
+                    continue;
+                }
+                int fd = accept(listen_fd, nullptr, nullptr);
+                uint32_t pi = 0;
+                if (fd < 0 or recv(fd, &pi, sizeof(pi), MSG_WAITALL) != sizeof(pi) or pi == 0 or
+                    pi >= static_cast<uint32_t>(num_processes) or peer_fds[pi] >= 0) {
+                    ROS_WARN("[AgentExchange] Rejected a connection with an invalid process index");
+                    if (fd >= 0) {
+                        close(fd);
+                    }
+                    continue;
+                }
+                peer_fds[pi] = fd;
+                n_connected++;
+            }
+            close(listen_fd);
+            if (n_connected < num_processes - 1) {
+                ROS_ERROR_STREAM("[AgentExchange] Only " << n_connected << " of " << num_processes - 1
+                                 << " processes connected");
+                freeaddrinfo(address_info);
+                return;
+            }
+        } else {
+            int fd = -1;
+            while (fd < 0 and Clock::now() < deadline) {
+                fd = socket(address_info->ai_family, address_info->ai_socktype, address_info->ai_protocol);
+                if (fd >= 0 and connect(fd, address_info->ai_addr, address_info->ai_addrlen) != 0) {
+                    close(fd);
+                    fd = -1;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                }
+            }
+            uint32_t pi = process_index;
+            if (fd < 0 or send(fd, &pi, sizeof(pi), MSG_NOSIGNAL) != sizeof(pi)) {
+                ROS_ERROR_STREAM("[AgentExchange] Failed to connect to the process 0 at " << _address);
+                if (fd >= 0) {
+                    close(fd);
+                }
+                freeaddrinfo(address_info);
+                return;
+            }
+            peer_fds[0] = fd;
+        }
+        freeaddrinfo(address_info);
+
+        // Small blocks are sent at once, and a lost process stops the others in TIMEOUT
+        timeval timeout{};
+        timeout.tv_sec = static_cast<time_t>(TIMEOUT);
+        for (int fd: peer_fds) {
+            if (fd < 0) {
+                continue;
+            }
+            int no_delay = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        }
+        is_open = true;
+    }
+
+    SocketAgentExchange::~SocketAgentExchange() {
+        for (int fd: peer_fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    bool SocketAgentExchange::sendBlock(int fd, const std::vector<uint8_t> &block) const {
+        uint64_t size = block.size();
+        std::vector<uint8_t> message(sizeof(uint64_t) + block.size());
+        std::memcpy(message.data(), &size, sizeof(uint64_t));
+        std::memcpy(message.data() + sizeof(uint64_t), block.data(), block.size());
+        size_t n_sent = 0;
+        while (n_sent < message.size()) {
+            ssize_t n = send(fd, message.data() + n_sent, message.size() - n_sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                return false;
+            }
+            n_sent += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    bool SocketAgentExchange::receiveBlock(int fd, std::vector<uint8_t> &block) const {
+        uint64_t size = 0;
+        if (recv(fd, &size, sizeof(uint64_t), MSG_WAITALL) != sizeof(uint64_t) or size > block_capacity) {
+            return false;
+        }
+        block.resize(size);
+        size_t n_received = 0;
+        while (n_received < size) {
+            ssize_t n = recv(fd, block.data() + n_received, size - n_received, 0);
+            if (n <= 0) {
+                return false;
+            }
+            n_received += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    bool SocketAgentExchange::exchange(const std::vector<uint8_t> &block, std::vector<std::vector<uint8_t>> &blocks) {
+        if (block.size() > block_capacity) {
+            ROS_ERROR_STREAM("[AgentExchange] The block of " << block.size() << " bytes exceeds the capacity "
+                             << block_capacity);
+            return false;
+        }
+
+        blocks.resize(num_processes);
+        if (process_index == 0) {
+            blocks[0] = block;
+            for (int pi = 1; pi < num_processes; pi++) {
+                if (not receiveBlock(peer_fds[pi], blocks[pi])) {
+                    ROS_ERROR_STREAM("[AgentExchange] Lost the process " << pi);
+                    return false;
+                }
+            }
+            for (int pi = 1; pi < num_processes; pi++) {
+                for (int qi = 0; qi < num_processes; qi++) {
+                    if (not sendBlock(peer_fds[pi], blocks[qi])) {
+                        ROS_ERROR_STREAM("[AgentExchange] Lost the process " << pi);
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+
+        if (not sendBlock(peer_fds[0], block)) {
+            ROS_ERROR("[AgentExchange] Lost the process 0");
+            return false;
+        }
+        for (int pi = 0; pi < num_processes; pi++) {
+            if (not receiveBlock(peer_fds[0], blocks[pi])) {
+                ROS_ERROR("[AgentExchange] Lost the process 0");
+                return false;
+            }
+        }
+        return true;
+    }
+}
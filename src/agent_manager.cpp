@@ -1,11 +1,13 @@
 #include "agent_manager.hpp"
+#include <trace.hpp>
 
 namespace DynamicPlanning {
-    AgentManager::AgentManager(const ros::NodeHandle &nh, const Param &_param, const Mission &_mission, int agent_id)
+    AgentManager::AgentManager(const ros::NodeHandle &nh, const Param &_param,
+                               const std::shared_ptr<const Mission> &_mission, int agent_id)
             : param(_param), mission(_mission) {
         // Initialize agent
-        agent = mission.agents[agent_id];
-        agent.current_state.position = mission.agents[agent_id].start_point;
+        agent = mission->agents[agent_id];
+        agent.current_state.position = mission->agents[agent_id].start_point;
         agent.current_goal_point = agent.current_state.position;
         agent.next_waypoint = agent.current_state.position;
 
@@ -24,9 +26,41 @@ namespace DynamicPlanning {
 
         //Map manager
         map_manager = std::make_unique<MapManager>(nh, param, mission, agent_id);
+
+        flight_recorder.initialize(param.multisim_recorder_size);
+    }
+
+    void AgentManager::resetMission(const std::shared_ptr<const Mission> &_mission) {
+        map_manager->resetMission(_mission);
+        mission = _mission;
+
+        agent = mission->agents[agent.id];
+        agent.current_state.position = mission->agents[agent.id].start_point;
+        agent.current_goal_point = agent.current_state.position;
+        agent.next_waypoint = agent.current_state.position;
+
+        planner_state = PlannerState::WAIT;
+        has_current_state = false;
+        has_obstacles = false;
+        has_local_map = false;
+        is_disturbed = false;
+        collision_alert = false;
+        desired_traj = traj_t();
+        planning_map.reset();
+
+        captured_obstacles.clear();
+        flight_recorder.initialize(param.multisim_recorder_size);
+        n_recorded_failures = 0;
+
+        traj_planner->resetMission(mission, agent);
     }
 
     void AgentManager::doStep(double time_step) {
+        moveAndSense(time_step);
+        updateLocalMap();
+    }
+
+    void AgentManager::moveAndSense(double time_step) {
         bool do_step_ideal = true;
 
         if (do_step_ideal) {
@@ -42,14 +76,32 @@ namespace DynamicPlanning {
         }
 
         // update local map
-        if (not param.world_use_global_map) {
-            map_manager->updateVirtualLocalMap(agent.current_state.position);
+        if (not param.world_use_global_map and not is_remote) {
+            map_manager->insertVirtualSensorInput(agent.current_state.position);
         }
 
         has_current_state = true;
     }
 
+    void AgentManager::updateLocalMap() {
+        TRACE_TRACK(agent.id);
+        if (not param.world_use_global_map and not is_remote) {
+            map_manager->updateLocalDistmap();
+        }
+    }
+
     PlanningReport AgentManager::plan(ros::Time sim_current_time) {
+        TRACE_TRACK(agent.id);
+        PlanningReport result = planBeforeOptimization(sim_current_time);
+        if (result != PlanningReport::SUCCESS) {
+            return result;
+        }
+
+        return planOptimization();
+    }
+
+    PlanningReport AgentManager::planBeforeOptimization(ros::Time sim_current_time) {
+        TRACE_TRACK(agent.id);
         // Input check
         if (!has_obstacles || !has_current_state) {
             return PlanningReport::WAITFORROSMSG;
@@ -62,14 +114,110 @@ namespace DynamicPlanning {
             ROS_WARN_STREAM("[AgentManager] agent " << agent.id << " disturbance detected");
         }
 
-        // Start planning
-        desired_traj = traj_planner->plan(agent,
-                                          map_manager->getOctomap(),
-                                          map_manager->getDistmap(),
-                                          sim_current_time,
-                                          is_disturbed);
+        // Start planning, the map updates during the planning cycle go to the next version
+        planning_map = map_manager->getSnapshot();
+        traj_planner->planBeforeOptimization(agent,
+                                             planning_map->octree,
+                                             planning_map->distmap,
+                                             planning_map->occupancy_index,
+                                             planning_map->map_change_log,
+                                             sim_current_time,
+                                             is_disturbed);
+        if (isCaptured()) {
+            captured_agent = agent;
+            captured_sim_time = sim_current_time;
+            captured_is_disturbed = is_disturbed;
+        }
+
+        return PlanningReport::SUCCESS;
+    }
+
+    PlanningReport AgentManager::planOptimization() {
+        TRACE_TRACK(agent.id);
+        desired_traj = traj_planner->planOptimization();
         agent.current_goal_point = traj_planner->getCurrentGoalPosition();
         collision_alert = traj_planner->getCollisionAlert();
+        const PlanningStatistics &statistics = traj_planner->getPlanningStatistics();
+        if (capture != nullptr) {
+            capture->writePlan(captured_sim_time, captured_is_disturbed, captured_agent, captured_obstacles,
+                               desired_traj, statistics.planning_time);
+        }
+        if (flight_recorder.isEnabled()) {
+            flight_recorder.recordPlan(captured_sim_time, captured_is_disturbed, captured_agent, captured_obstacles,
+                                       desired_traj, statistics.planning_time);
+
+            // The statistics are accumulated, so a failure of this cycle increases the counts
+            int n_failures = statistics.fallback.n_fallbacks + statistics.deadline.n_qp_fallback;
+            bool is_failed = n_failures > n_recorded_failures;
+            n_recorded_failures = n_failures;
+            bool is_slow = param.multisim_recorder_threshold > 0 and
+                           statistics.planning_time.total_planning_time.current > param.multisim_recorder_threshold;
+            if ((is_failed or is_slow) and flight_recorder.canDump()) {
+                dumpFlightRecorder();
+            }
+        }
+
+        // Re-initialization for replanning
+        has_obstacles = false;
+        has_current_state = false;
+        planning_map.reset();
+
+        return PlanningReport::SUCCESS;
+    }
+
+    double AgentManager::planConsensusIteration(const std::vector<ConsensusMessage>& messages) {
+        TRACE_TRACK(agent.id);
+        double max_change = 0;
+        desired_traj = traj_planner->planConsensusIteration(messages, max_change);
+        collision_alert = traj_planner->getCollisionAlert();
+        return max_change;
+    }
+
+    ConsensusMessage AgentManager::getConsensusMessage() const {
+        return traj_planner->getConsensusMessage();
+    }
+
+    QPProblem AgentManager::prepareBatchQP() {
+        TRACE_TRACK(agent.id);
+        return traj_planner->prepareBatchQP();
+    }
+
+    void AgentManager::setBatchQPSolution(const QPSolution& solution) {
+        traj_planner->setBatchQPSolution(solution);
+    }
+
+    void AgentManager::saveCheckpoint(Checkpoint &checkpoint) const {
+        checkpoint.agent = agent;
+        checkpoint.planner_state = planner_state;
+        checkpoint.desired_traj = desired_traj;
+        checkpoint.collision_alert = collision_alert;
+        traj_planner->saveCheckpoint(checkpoint.planner);
+    }
+
+    void AgentManager::restoreCheckpoint(const Checkpoint &checkpoint) {
+        agent = checkpoint.agent;
+        planner_state = checkpoint.planner_state;
+        desired_traj = checkpoint.desired_traj;
+        collision_alert = checkpoint.collision_alert;
+        traj_planner->restoreCheckpoint(checkpoint.planner);
+        has_obstacles = false;
+        has_current_state = false;
+        planning_map.reset();
+    }
+
+    PlanningReport AgentManager::hold() {
+        TRACE_TRACK(agent.id);
+        if (!has_obstacles || !has_current_state) {
+            return PlanningReport::WAITFORROSMSG;
+        }
+
+        desired_traj = traj_planner->planHold(agent);
+        if (capture != nullptr) {
+            capture->writeHold(agent, captured_obstacles, desired_traj);
+        }
+        if (flight_recorder.isEnabled()) {
+            flight_recorder.recordHold(agent, captured_obstacles, desired_traj);
+        }
 
         // Re-initialization for replanning
         has_obstacles = false;
@@ -87,9 +235,19 @@ namespace DynamicPlanning {
         map_manager->publish();
     }
 
-    void AgentManager::obstacleCallback(const std::vector<Obstacle> &_msg_obstacles) {
-        std::vector<Obstacle> msg_obstacles = _msg_obstacles;
-        traj_planner->setObstacles(msg_obstacles);
+    void AgentManager::obstacleCallback(std::vector<Obstacle> msg_obstacles) {
+        if (isCaptured()) {
+            // The capture is written after the mailbox moves on, so the shared trajectories are copied
+            captured_obstacles = msg_obstacles;
+            for (auto &obstacle: captured_obstacles) {
+                if (obstacle.shared_prev_traj != nullptr) {
+                    obstacle.prev_traj = *obstacle.shared_prev_traj;
+                    obstacle.shared_prev_traj = nullptr;
+                    obstacle.shared_shifted_traj = nullptr;
+                }
+            }
+        }
+        traj_planner->setObstacles(std::move(msg_obstacles));
         has_obstacles = true;
     }
 
@@ -97,6 +255,18 @@ namespace DynamicPlanning {
         map_manager->mergeMapCallback(msg_merge_map);
     }
 
+    void AgentManager::mergeMapDelta(int peer_id, const MapDelta &delta) {
+        map_manager->mergeMapDelta(peer_id, delta);
+    }
+
+    void AgentManager::mergeMapDeltaAsync(int peer_id, MapDelta delta) {
+        map_manager->mergeMapDeltaAsync(peer_id, std::move(delta));
+    }
+
+    void AgentManager::commitMapMerges() {
+        map_manager->commitMapMerges();
+    }
+
     bool AgentManager::isInitialStateValid() {
         bool is_valid;
         point3d observed_position;
@@ -123,12 +293,12 @@ namespace DynamicPlanning {
     }
 
     void AgentManager::setStartPosition(const point3d &_start_position) {
-        mission.agents[agent.id].start_point = _start_position;
+        mission->agents[agent.id].start_point = _start_position;
         agent.start_point = _start_position;
     }
 
     void AgentManager::setDesiredGoal(const point3d &new_desired_goal_position) {
-        mission.agents[agent.id].desired_goal_point = new_desired_goal_position;
+        mission->agents[agent.id].desired_goal_point = new_desired_goal_position;
         agent.desired_goal_point = new_desired_goal_position;
     }
 
@@ -136,14 +306,67 @@ namespace DynamicPlanning {
         map_manager->setGlobalMap();
     }
 
-    void AgentManager::setGlobalMap(const sensor_msgs::PointCloud2 &global_map) {
-        map_manager->setGlobalMap(global_map);
+    void AgentManager::setGlobalMap(const std::shared_ptr<const GlobalPointCloud> &global_cloud) {
+        map_manager->setGlobalMap(global_cloud);
     }
 
     void AgentManager::setNextWaypoint(const point3d& next_waypoint) {
         agent.next_waypoint = next_waypoint;
     }
 
+    void AgentManager::setObstaclePredictionTable(std::shared_ptr<const ObstaclePredictionTable> table) {
+        traj_planner->setObstaclePredictionTable(std::move(table));
+    }
+
+    void AgentManager::setProgressStalled(bool is_stalled) {
+        traj_planner->setProgressStalled(is_stalled);
+    }
+
+    void AgentManager::setRemote(bool _is_remote) {
+        is_remote = _is_remote;
+    }
+
+    void AgentManager::setExchangedAgent(const ExchangedAgent &exchanged_agent) {
+        agent.current_state = exchanged_agent.current_state;
+        agent.current_goal_point = exchanged_agent.current_goal_point;
+        agent.desired_goal_point = exchanged_agent.desired_goal_point;
+        collision_alert = exchanged_agent.collision_alert;
+        desired_traj = exchanged_agent.traj;
+        has_current_state = true;
+    }
+
+    ExchangedAgent AgentManager::getExchangedAgent() const {
+        ExchangedAgent exchanged_agent;
+        exchanged_agent.id = agent.id;
+        exchanged_agent.current_state = agent.current_state;
+        exchanged_agent.current_goal_point = agent.current_goal_point;
+        exchanged_agent.desired_goal_point = agent.desired_goal_point;
+        exchanged_agent.collision_alert = collision_alert;
+        exchanged_agent.traj = desired_traj;
+        return exchanged_agent;
+    }
+
+    void AgentManager::updateParam(const Param& _param) {
+        traj_planner->updateParam(_param);
+        param = _param;
+    }
+
+    void AgentManager::dumpFlightRecorder() {
+        std::string file_name = param.package_path + "/log/recorder_agent" + std::to_string(agent.id) + "_" +
+                                std::to_string(n_recorder_dumps++) + ".capture";
+        if (flight_recorder.dump(file_name, *mission, param)) {
+            ROS_WARN_STREAM("[AgentManager] agent " << agent.id << " planning failed or slow, the last "
+                                                    << param.multisim_recorder_size << " plannings are saved in "
+                                                    << file_name);
+        } else {
+            ROS_ERROR_STREAM("[AgentManager] Failed to save the flight recorder to " << file_name);
+        }
+    }
+
+    void AgentManager::setCapture(PlanningCaptureWriter* _capture) {
+        capture = _capture;
+    }
+
     point3d AgentManager::getCurrentPosition() const {
         return agent.current_state.position;
     }
@@ -165,7 +388,7 @@ namespace DynamicPlanning {
         return traj_planner->getPlanningStatistics();
     }
 
-    traj_t AgentManager::getTraj() const {
+    const traj_t &AgentManager::getTraj() const {
         return desired_traj;
     }
 
@@ -173,6 +396,32 @@ namespace DynamicPlanning {
         return traj_planner->getPlannerSeq();
     }
 
+    bool AgentManager::canHold() const {
+        return not desired_traj.empty() and traj_planner->getPlannerSeq() > 0;
+    }
+
+    bool AgentManager::canHover() const {
+        if (not param.hover_mode or not canHold() or not has_obstacles or not has_current_state) {
+            return false;
+        }
+
+        point3d desired_goal_point = agent.desired_goal_point;
+        if (planner_state == PlannerState::GOTO) {
+            desired_goal_point = mission->agents[agent.id].desired_goal_point;
+        } else if (planner_state == PlannerState::GOBACK) {
+            desired_goal_point = mission->agents[agent.id].start_point;
+        } else if (planner_state == PlannerState::PATROL) {
+            return false;
+        }
+        if (desired_goal_point.distance(agent.desired_goal_point) > SP_EPSILON_FLOAT) {
+            return false;
+        }
+
+        std::shared_ptr<MapChangeLog> map_change_log_ptr = map_manager->getMapChangeLog();
+        uint64_t map_version = map_change_log_ptr != nullptr ? map_change_log_ptr->getVersion() : 0;
+        return traj_planner->isHoverCertified(agent, map_version);
+    }
+
     point3d AgentManager::getCurrentGoalPoint() const {
         return traj_planner->getCurrentGoalPosition();
     }
@@ -181,7 +430,7 @@ namespace DynamicPlanning {
         return agent.desired_goal_point;
     }
 
-    Obstacle AgentManager::getAgent() const {
+    Obstacle AgentManager::getAgent(bool with_traj) const {
         Obstacle msg_obstacle;
         msg_obstacle.id = agent.id;
         msg_obstacle.type = ObstacleType::AGENT;
@@ -192,7 +441,7 @@ namespace DynamicPlanning {
         msg_obstacle.downwash = (float) agent.downwash;
         msg_obstacle.max_acc = (float) agent.max_acc[0];
         msg_obstacle.collision_alert = collision_alert;
-        if (not desired_traj.empty()) {
+        if (with_traj and not desired_traj.empty()) {
             msg_obstacle.prev_traj = desired_traj;
         }
         return msg_obstacle;
@@ -202,14 +451,34 @@ namespace DynamicPlanning {
         return map_manager->getLocalOctomapMsg();
     }
 
+    MapDelta AgentManager::getMapDelta(uint64_t since_seq) const {
+        return map_manager->getMapDelta(since_seq);
+    }
+
+    uint64_t AgentManager::getPeerMapSeq(int peer_id) const {
+        return map_manager->getPeerMapSeq(peer_id);
+    }
+
     point3d AgentManager::getNextWaypoint() const {
         return agent.next_waypoint;
     }
 
-    std::shared_ptr<DynamicEDTOctomap> AgentManager::getDistmap() const {
+    std::shared_ptr<DistanceMap> AgentManager::getDistmap() const {
         return map_manager->getDistmap();
     }
 
+    std::shared_ptr<MapChangeLog> AgentManager::getMapChangeLog() const {
+        return map_manager->getMapChangeLog();
+    }
+
+    std::shared_ptr<OccupancyIndex> AgentManager::getOccupancyIndex() const {
+        return map_manager->getOccupancyIndex();
+    }
+
+    SensorStatistics AgentManager::getSensorStatistics() const {
+        return map_manager->getSensorStatistics();
+    }
+
     point3d AgentManager::getStartPoint() const {
         return agent.start_point;
     }
@@ -224,7 +493,7 @@ namespace DynamicPlanning {
 
     void AgentManager::planningStateTransition() {
         if (planner_state == PlannerState::GOTO) {
-            agent.desired_goal_point = mission.agents[agent.id].desired_goal_point;
+            agent.desired_goal_point = mission->agents[agent.id].desired_goal_point;
         } else if (planner_state == PlannerState::PATROL and
                    agent.desired_goal_point.distance(agent.current_state.position) < param.goal_threshold) {
             // Swap start and goal position
@@ -233,7 +502,7 @@ namespace DynamicPlanning {
             agent.start_point = temp;
         } else if (planner_state == PlannerState::GOBACK) {
             // Go back to start position
-            agent.desired_goal_point = mission.agents[agent.id].start_point;
+            agent.desired_goal_point = mission->agents[agent.id].start_point;
         }
 
         // if planner_state == PlannerState::WAIT, use previous desired goal position
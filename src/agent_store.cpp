@@ -0,0 +1,83 @@
+#include <agent_store.hpp>
+
+namespace DynamicPlanning {
+    void AgentStore::syncStates() {
+        size_t n_agents = managers.size();
+        positions.resize(n_agents);
+        velocities.resize(n_agents);
+        accelerations.resize(n_agents);
+        desired_goal_points.resize(n_agents);
+        for (size_t qi = 0; qi < n_agents; qi++) {
+            State state = managers[qi]->getCurrentState();
+            positions[qi] = state.position;
+            velocities[qi] = state.velocity;
+            accelerations[qi] = state.acceleration;
+            desired_goal_points[qi] = managers[qi]->getDesiredGoalPoint();
+        }
+    }
+
+    void AgentStore::syncPlans(int M, int n, bool export_buffers) {
+        size_t n_agents = managers.size();
+        current_goal_points.resize(n_agents);
+        next_waypoints.resize(n_agents);
+        planner_seqs.resize(n_agents);
+        trajs.resize(n_agents);
+        for (size_t qi = 0; qi < n_agents; qi++) {
+            current_goal_points[qi] = managers[qi]->getCurrentGoalPoint();
+            next_waypoints[qi] = managers[qi]->getNextWaypoint();
+            planner_seqs[qi] = managers[qi]->getPlannerSeq();
+            trajs[qi] = &managers[qi]->getTraj();
+        }
+        if (export_buffers) {
+            exportBuffers(M, n);
+        }
+    }
+
+    State AgentStore::getState(size_t qi) const {
+        State state;
+        state.position = positions[qi];
+        state.velocity = velocities[qi];
+        state.acceleration = accelerations[qi];
+        return state;
+    }
+
+    void AgentStore::exportBuffers(int M, int n) {
+        size_t n_agents = managers.size();
+        size_t n_control_points = static_cast<size_t>(M) * (n + 1);
+        if (buffers.n_agents != n_agents or buffers.n_control_points != n_control_points) {
+            buffers.n_agents = n_agents;
+            buffers.n_control_points = n_control_points;
+            buffers.positions.assign(3 * n_agents, 0);
+            buffers.velocities.assign(3 * n_agents, 0);
+            buffers.accelerations.assign(3 * n_agents, 0);
+            buffers.goal_points.assign(3 * n_agents, 0);
+            buffers.control_points.assign(3 * n_control_points * n_agents, 0);
+            buffers.planner_seqs.assign(n_agents, 0);
+        }
+
+        for (size_t qi = 0; qi < n_agents; qi++) {
+            for (int k = 0; k < 3; k++) {
+                buffers.positions[3 * qi + k] = positions[qi](k);
+                buffers.velocities[3 * qi + k] = velocities[qi](k);
+                buffers.accelerations[3 * qi + k] = accelerations[qi](k);
+                buffers.goal_points[3 * qi + k] = current_goal_points[qi](k);
+            }
+            buffers.planner_seqs[qi] = planner_seqs[qi];
+
+            // The trajectory is empty before the first planning or after landing, then the points are kept
+            const traj_t &traj = *trajs[qi];
+            if (traj.size() != M) {
+                continue;
+            }
+            double *control_points = &buffers.control_points[3 * n_control_points * qi];
+            for (int m = 0; m < M; m++) {
+                for (int i = 0; i < n + 1; i++) {
+                    const point3d &control_point = traj[m][i];
+                    for (int k = 0; k < 3; k++) {
+                        control_points[3 * (m * (n + 1) + i) + k] = control_point(k);
+                    }
+                }
+            }
+        }
+    }
+}
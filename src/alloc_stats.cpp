@@ -0,0 +1,130 @@
+#include <alloc_stats.hpp>
+#include <algorithm>
+
+#ifdef LSC_PLANNER_ALLOC_STATS
+#include <cerrno>
+#include <cstddef>
+#include <malloc.h>
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void *__libc_valloc(size_t size);
+void *__libc_pvalloc(size_t size);
+void __libc_free(void *ptr);
+}
+
+namespace {
+    // Zero initialized without a constructor, and in the static TLS block, so the first access of a thread does not
+    // allocate from inside malloc
+    __attribute__((tls_model("initial-exec"))) thread_local DynamicPlanning::AllocCounts thread_counts;
+
+    // The usable size of the chunk, so the size freed is the same as the one allocated
+    inline void countAllocation(void *ptr) {
+        if (ptr == nullptr) {
+            return;
+        }
+        auto size = malloc_usable_size(ptr);
+        thread_counts.n_allocations++;
+        thread_counts.bytes += size;
+        thread_counts.live_bytes += static_cast<int64_t>(size);
+        thread_counts.peak_live_bytes = std::max(thread_counts.peak_live_bytes, thread_counts.live_bytes);
+    }
+
+    inline void countFree(void *ptr) {
+        if (ptr == nullptr) {
+            return;
+        }
+        thread_counts.live_bytes -= static_cast<int64_t>(malloc_usable_size(ptr));
+    }
+}
+
+extern "C" {
+void *malloc(size_t size) {
+    void *ptr = __libc_malloc(size);
+    countAllocation(ptr);
+    return ptr;
+}
+
+void *calloc(size_t n, size_t size) {
+    void *ptr = __libc_calloc(n, size);
+    countAllocation(ptr);
+    return ptr;
+}
+
+void *realloc(void *ptr, size_t size) {
+    size_t prev_size = ptr == nullptr ? 0 : malloc_usable_size(ptr);
+    void *new_ptr = __libc_realloc(ptr, size);
+    if (new_ptr != nullptr or size == 0) {
+        // The previous chunk is freed, unless the reallocation failed
+        thread_counts.live_bytes -= static_cast<int64_t>(prev_size);
+    }
+    countAllocation(new_ptr);
+    return new_ptr;
+}
+
+void *memalign(size_t alignment, size_t size) {
+    void *ptr = __libc_memalign(alignment, size);
+    countAllocation(ptr);
+    return ptr;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    if (alignment % sizeof(void *) != 0 or (alignment & (alignment - 1)) != 0 or alignment == 0) {
+        return EINVAL;
+    }
+    void *ptr = memalign(alignment, size);
+    if (ptr == nullptr) {
+        return ENOMEM;
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+void *valloc(size_t size) {
+    void *ptr = __libc_valloc(size);
+    countAllocation(ptr);
+    return ptr;
+}
+
+void *pvalloc(size_t size) {
+    void *ptr = __libc_pvalloc(size);
+    countAllocation(ptr);
+    return ptr;
+}
+
+void free(void *ptr) {
+    countFree(ptr);
+    __libc_free(ptr);
+}
+}
+#endif
+
+namespace DynamicPlanning {
+    AllocCounts AllocStats::getThreadCounts() {
+#ifdef LSC_PLANNER_ALLOC_STATS
+        return thread_counts;
+#else
+        return {};
+#endif
+    }
+
+#ifdef LSC_PLANNER_ALLOC_STATS
+    // The scopes exist only if the counting is compiled
+    int64_t AllocStats::beginScope() {
+        int64_t prev_peak_live_bytes = thread_counts.peak_live_bytes;
+        thread_counts.peak_live_bytes = thread_counts.live_bytes;
+        return prev_peak_live_bytes;
+    }
+
+    void AllocStats::endScope(int64_t prev_peak_live_bytes) {
+        thread_counts.peak_live_bytes = std::max(thread_counts.peak_live_bytes, prev_peak_live_bytes);
+    }
+#endif
+}
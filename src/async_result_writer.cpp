@@ -0,0 +1,107 @@
+#include <async_result_writer.hpp>
+
+#include <chrono>
+#include <stdexcept>
+
+namespace DynamicPlanning {
+    namespace {
+        constexpr size_t CHUNK_SIZE = 1 << 20; // bytes written at once
+        constexpr auto IDLE_SLEEP = std::chrono::milliseconds(1);
+        constexpr auto MAX_PENDING_TIME = std::chrono::seconds(1); // a partial chunk is written after this time
+    }
+
+    AsyncResultWriter::AsyncResultWriter(size_t capacity) : frame_queue(capacity), free_queue(capacity) {}
+
+    AsyncResultWriter::~AsyncResultWriter() {
+        close();
+    }
+
+    void AsyncResultWriter::open(const std::string &file_name, Format _format, size_t _qn, size_t _on,
+                                 double time_step) {
+        close();
+        file.open(file_name, std::ios_base::binary | std::ios_base::trunc);
+        if (not file) {
+            throw std::invalid_argument("[AsyncResultWriter] Failed to create the result file " + file_name);
+        }
+        format = _format;
+        qn = _qn;
+        on = _on;
+        if (format == Format::BINARY) {
+            TrajectoryLog::writeHeader(file, qn, on, time_step);
+        } else {
+            std::string header;
+            TrajectoryLog::appendCSVHeader(header, qn, on);
+            file << header;
+        }
+
+        closing = false;
+        writer = std::thread(&AsyncResultWriter::writerLoop, this);
+    }
+
+    void AsyncResultWriter::close() {
+        if (writer.joinable()) {
+            closing = true;
+            writer.join();
+        }
+        if (file.is_open()) {
+            file.close();
+        }
+    }
+
+    std::vector<float> AsyncResultWriter::acquireFrame() {
+        std::vector<float> frame;
+        free_queue.tryPop(frame);
+        frame.resize(TrajectoryLog::getFrameStride(qn, on)); // the stride changes if the writer is reopened
+        return frame;
+    }
+
+    void AsyncResultWriter::push(std::vector<float> &&frame) {
+        if (frame_queue.tryPush(std::move(frame))) {
+            return;
+        }
+
+        // Backpressure, the writer thread frees a slot after formatting one frame
+        n_stalls++;
+        while (not frame_queue.tryPush(std::move(frame))) {
+            std::this_thread::yield();
+        }
+    }
+
+    void AsyncResultWriter::writerLoop() {
+        std::string buffer;
+        buffer.reserve(CHUNK_SIZE + (1 << 16));
+        auto pending_start = std::chrono::steady_clock::now();
+        std::vector<float> frame;
+        while (true) {
+            // Read closing before the queue, so the frames pushed before close are written
+            bool is_closing = closing.load();
+            bool popped = false;
+            while (buffer.size() < CHUNK_SIZE and frame_queue.tryPop(frame)) {
+                if (buffer.empty()) {
+                    pending_start = std::chrono::steady_clock::now();
+                }
+                if (format == Format::BINARY) {
+                    buffer.append(reinterpret_cast<const char *>(frame.data()), frame.size() * sizeof(float));
+                } else {
+                    TrajectoryLog::appendCSVFrame(buffer, frame.data(), qn, on);
+                }
+                free_queue.tryPush(std::move(frame)); // drop the buffer if the free queue is full
+                popped = true;
+            }
+
+            bool queue_drained = not popped and frame_queue.empty();
+            if (buffer.size() >= CHUNK_SIZE or (is_closing and queue_drained) or
+                (not buffer.empty() and std::chrono::steady_clock::now() - pending_start > MAX_PENDING_TIME)) {
+                file.write(buffer.data(), (std::streamsize) buffer.size());
+                buffer.clear();
+            }
+            if (is_closing and queue_drained) {
+                file.flush();
+                return;
+            }
+            if (not popped) {
+                std::this_thread::sleep_for(IDLE_SLEEP);
+            }
+        }
+    }
+}
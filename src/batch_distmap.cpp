@@ -0,0 +1,316 @@
+#include <batch_distmap.hpp>
+#include <distance_transform.hpp>
+#include <worker_pool.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace DynamicPlanning {
+    static constexpr int INFINITE_SQ_DIST = DistanceTransformLine::INFINITE_SQ_DIST;
+    static constexpr int EDT_SLAB_SIZE = 16; // cells along x recomputed by a task of the incremental update
+
+    void BatchDistmap::query(DistmapQueryBatch &batch) const {
+        size_t n = batch.size();
+        batch.distance.resize(n);
+        batch.obstacle_x.resize(n);
+        batch.obstacle_y.resize(n);
+        batch.obstacle_z.resize(n);
+        batch.obstacle_l_inf_distance.resize(n);
+        batch.idx_x.resize(n);
+        batch.idx_y.resize(n);
+        batch.idx_z.resize(n);
+        if (n == 0) {
+            return;
+        }
+
+        // Same as worldToMap, the key of a coordinate is floor(coordinate / resolution) + the key of the origin
+        octomap::OcTreeKey origin_key = octree->coordToKey(octomap::point3d(0, 0, 0));
+        const int base_x = origin_key[0] + offsetX, base_y = origin_key[1] + offsetY, base_z = origin_key[2] + offsetZ;
+        const double inv_resolution = 1.0 / treeResolution;
+        const float *x = batch.x.data(), *y = batch.y.data(), *z = batch.z.data();
+        int *idx_x = batch.idx_x.data(), *idx_y = batch.idx_y.data(), *idx_z = batch.idx_z.data();
+        for (size_t i = 0; i < n; i++) {
+            idx_x[i] = static_cast<int>(std::floor(x[i] * inv_resolution)) + base_x;
+            idx_y[i] = static_cast<int>(std::floor(y[i] * inv_resolution)) + base_y;
+            idx_z[i] = static_cast<int>(std::floor(z[i] * inv_resolution)) + base_z;
+        }
+
+        // Gather, mapToWorld is the cell center
+        const float resolution = static_cast<float>(treeResolution);
+        const float infinity = std::numeric_limits<float>::infinity();
+        float *distance = batch.distance.data();
+        float *obstacle_x = batch.obstacle_x.data(), *obstacle_y = batch.obstacle_y.data();
+        float *obstacle_z = batch.obstacle_z.data();
+        for (size_t i = 0; i < n; i++) {
+            int cx = idx_x[i], cy = idx_y[i], cz = idx_z[i];
+            if (cx < 0 or cx >= sizeX or cy < 0 or cy >= sizeY or cz < 0 or cz >= sizeZ) {
+                distance[i] = distanceValue_Error;
+                obstacle_x[i] = obstacle_y[i] = obstacle_z[i] = infinity;
+                continue;
+            }
+
+            const dataCell &cell = data[cx][cy][cz];
+            distance[i] = cell.dist * resolution;
+            if (cell.obstX == invalidObstData) {
+                obstacle_x[i] = obstacle_y[i] = obstacle_z[i] = infinity;
+            } else {
+                obstacle_x[i] = (static_cast<float>(cell.obstX - base_x) + 0.5f) * resolution;
+                obstacle_y[i] = (static_cast<float>(cell.obstY - base_y) + 0.5f) * resolution;
+                obstacle_z[i] = (static_cast<float>(cell.obstZ - base_z) + 0.5f) * resolution;
+            }
+        }
+
+        // The L-infinity distance to the cube of the cell, infinity if there is no obstacle
+        const float half_resolution = 0.5f * resolution;
+        float *l_inf = batch.obstacle_l_inf_distance.data();
+        for (size_t i = 0; i < n; i++) {
+            float dx = std::max(std::abs(x[i] - obstacle_x[i]) - half_resolution, 0.0f);
+            float dy = std::max(std::abs(y[i] - obstacle_y[i]) - half_resolution, 0.0f);
+            float dz = std::max(std::abs(z[i] - obstacle_z[i]) - half_resolution, 0.0f);
+            l_inf[i] = std::max(std::max(dx, dy), dz);
+        }
+    }
+
+    void BatchDistmap::updateParallel() {
+        bool is_initial = occupancy.empty();
+        if (is_initial) {
+            // The obstacles committed by update() point to themselves, the others are in the lists of DynamicEDT3D
+            occupancy.assign(static_cast<size_t>(sizeX) * sizeY * sizeZ, 0);
+            WorkerPool::getInstance().run(sizeX, [&](size_t x) {
+                for (int y = 0; y < sizeY; y++) {
+                    for (int z = 0; z < sizeZ; z++) {
+                        const dataCell &cell = data[x][y][z];
+                        occupancy[occupancyIndex(x, y, z)] = cell.obstX == static_cast<int>(x) and
+                                                             cell.obstY == y and cell.obstZ == z;
+                    }
+                }
+            });
+            for (const auto &point: addList) {
+                occupancy[occupancyIndex(point.x, point.y, point.z)] = 1;
+            }
+            for (const auto &point: removeList) {
+                occupancy[occupancyIndex(point.x, point.y, point.z)] = 0;
+            }
+        }
+
+        // Same as DynamicEDTOctomap::update, the changed keys are at the lowest level
+        Index dirty_min = {sizeX, sizeY, sizeZ}, dirty_max = {-1, -1, -1};
+        for (auto it = octree->changedKeysBegin(), end = octree->changedKeysEnd(); it != end; ++it) {
+            Index cell = {it->first[0] + offsetX, it->first[1] + offsetY, it->first[2] + offsetZ};
+            if (cell[0] < 0 or cell[0] >= sizeX or cell[1] < 0 or cell[1] >= sizeY or cell[2] < 0 or
+                cell[2] >= sizeZ) {
+                continue;
+            }
+            const octomap::OcTreeNode *node = octree->search(it->first);
+            uint8_t occupied = node != nullptr and octree->isNodeOccupied(node);
+            uint8_t &cell_occupancy = occupancy[occupancyIndex(cell[0], cell[1], cell[2])];
+            if (cell_occupancy == occupied) {
+                continue;
+            }
+            cell_occupancy = occupied;
+            for (int k = 0; k < 3; k++) {
+                dirty_min[k] = std::min(dirty_min[k], cell[k]);
+                dirty_max[k] = std::max(dirty_max[k], cell[k]);
+            }
+        }
+        octree->resetChangeDetection();
+
+        // The queued obstacles are committed by the transform
+        addList.clear();
+        removeList.clear();
+        while (not open_queue.empty()) {
+            open_queue.pop();
+        }
+
+        if (is_initial) {
+            transformAll();
+            return;
+        }
+        if (dirty_max[0] < 0) {
+            return;
+        }
+
+        int max_dist_cells = static_cast<int>(std::ceil(maxDist));
+        for (int k = 0; k < 3; k++) {
+            dirty_min[k] = std::max(dirty_min[k] - max_dist_cells, 0);
+        }
+        dirty_max = {std::min(dirty_max[0] + max_dist_cells, sizeX - 1),
+                     std::min(dirty_max[1] + max_dist_cells, sizeY - 1),
+                     std::min(dirty_max[2] + max_dist_cells, sizeZ - 1)};
+
+        // A slab reads the occupancy of the cells within the maximum distance and writes its own cells only
+        int n_slabs = (dirty_max[0] - dirty_min[0]) / EDT_SLAB_SIZE + 1;
+        WorkerPool::getInstance().run(n_slabs, [&](size_t slab_idx) {
+            Index slab_min = dirty_min, slab_max = dirty_max;
+            slab_min[0] = dirty_min[0] + static_cast<int>(slab_idx) * EDT_SLAB_SIZE;
+            slab_max[0] = std::min(slab_min[0] + EDT_SLAB_SIZE - 1, dirty_max[0]);
+            transformRegion(slab_min, slab_max);
+        });
+    }
+
+    size_t BatchDistmap::getMemoryUsage() const {
+        return static_cast<size_t>(sizeX) * sizeY * sizeZ * sizeof(dataCell) + occupancy.size() * sizeof(uint8_t);
+    }
+
+    size_t BatchDistmap::occupancyIndex(int x, int y, int z) const {
+        return (static_cast<size_t>(x) * sizeY + y) * sizeZ + z;
+    }
+
+    void BatchDistmap::transformAll() {
+        // The passes along z and y run on the planes of x, the pass along x on the planes of y, so the tasks
+        // write disjoint cells. The features are the obstacles of the cells.
+        auto transformAxis = [&](int axis, size_t plane) {
+            static thread_local DistanceTransformLine line;
+            static thread_local std::vector<Index> line_obstacles;
+            Index dims = {sizeX, sizeY, sizeZ};
+            line.resize(dims[axis]);
+            line_obstacles.resize(dims[axis]);
+            int axis_a = axis == 0 ? 1 : 0; // the normal of the plane
+            int axis_b = axis == 2 ? 1 : 2;
+            Index index{};
+            index[axis_a] = static_cast<int>(plane);
+            for (index[axis_b] = 0; index[axis_b] < dims[axis_b]; index[axis_b]++) {
+                for (index[axis] = 0; index[axis] < dims[axis]; index[axis]++) {
+                    const dataCell &cell = data[index[0]][index[1]][index[2]];
+                    line.f[index[axis]] = cell.sqdist;
+                    line_obstacles[index[axis]] = {cell.obstX, cell.obstY, cell.obstZ};
+                }
+                line.transform(dims[axis]);
+                for (index[axis] = 0; index[axis] < dims[axis]; index[axis]++) {
+                    dataCell &cell = data[index[0]][index[1]][index[2]];
+                    int arg = line.args[index[axis]];
+                    if (arg < 0) {
+                        cell.sqdist = INFINITE_SQ_DIST;
+                        cell.obstX = cell.obstY = cell.obstZ = invalidObstData;
+                        continue;
+                    }
+                    cell.sqdist = line.sq_dists[index[axis]];
+                    cell.obstX = line_obstacles[arg][0];
+                    cell.obstY = line_obstacles[arg][1];
+                    cell.obstZ = line_obstacles[arg][2];
+                }
+            }
+        };
+
+        WorkerPool &pool = WorkerPool::getInstance();
+        pool.run(sizeX, [&](size_t x) {
+            for (int y = 0; y < sizeY; y++) {
+                for (int z = 0; z < sizeZ; z++) {
+                    dataCell &cell = data[x][y][z];
+                    bool occupied = occupancy[occupancyIndex(x, y, z)];
+                    cell.sqdist = occupied ? 0 : INFINITE_SQ_DIST;
+                    cell.obstX = occupied ? static_cast<int>(x) : invalidObstData;
+                    cell.obstY = occupied ? y : invalidObstData;
+                    cell.obstZ = occupied ? z : invalidObstData;
+                }
+            }
+            transformAxis(2, x);
+            transformAxis(1, x);
+        });
+        pool.run(sizeY, [&](size_t y) {
+            transformAxis(0, y);
+        });
+        pool.run(sizeX, [&](size_t x) {
+            for (int y = 0; y < sizeY; y++) {
+                for (int z = 0; z < sizeZ; z++) {
+                    dataCell &cell = data[x][y][z];
+                    finalizeCell(cell, cell.sqdist);
+                }
+            }
+        });
+    }
+
+    void BatchDistmap::transformRegion(const Index &region_min, const Index &region_max) {
+        struct RegionBuffers {
+            std::vector<int> box_sq_dists, box_features;
+            DistanceTransformLine line;
+            std::vector<int> line_features;
+        };
+        static thread_local RegionBuffers buffers;
+
+        // A cell of the region depends on the obstacles within the maximum distance, so the transform runs on the
+        // inflated box
+        int max_dist_cells = static_cast<int>(std::ceil(maxDist));
+        Index grid_size = {sizeX, sizeY, sizeZ};
+        Index box_min{}, dims{};
+        size_t n_box_cells = 1;
+        int max_dim = 0;
+        for (int k = 0; k < 3; k++) {
+            box_min[k] = std::max(region_min[k] - max_dist_cells, 0);
+            dims[k] = std::min(region_max[k] + max_dist_cells, grid_size[k] - 1) - box_min[k] + 1;
+            n_box_cells *= dims[k];
+            max_dim = std::max(max_dim, dims[k]);
+        }
+        auto boxIndex = [&](int i, int j, int l) {
+            return (static_cast<size_t>(i) * dims[1] + j) * dims[2] + l;
+        };
+
+        buffers.box_sq_dists.resize(n_box_cells);
+        buffers.box_features.resize(n_box_cells);
+        buffers.line.resize(max_dim);
+        buffers.line_features.resize(max_dim);
+        for (int i = 0; i < dims[0]; i++) {
+            for (int j = 0; j < dims[1]; j++) {
+                for (int l = 0; l < dims[2]; l++) {
+                    size_t b = boxIndex(i, j, l);
+                    bool occupied = occupancy[occupancyIndex(box_min[0] + i, box_min[1] + j, box_min[2] + l)];
+                    buffers.box_sq_dists[b] = occupied ? 0 : INFINITE_SQ_DIST;
+                    buffers.box_features[b] = occupied ? static_cast<int>(b) : -1;
+                }
+            }
+        }
+
+        // One pass of the 1D transform per axis, the feature is the box index of the closest obstacle
+        for (int axis = 2; axis >= 0; axis--) {
+            int axis_a = (axis + 1) % 3, axis_b = (axis + 2) % 3;
+            Index index{};
+            for (index[axis_a] = 0; index[axis_a] < dims[axis_a]; index[axis_a]++) {
+                for (index[axis_b] = 0; index[axis_b] < dims[axis_b]; index[axis_b]++) {
+                    for (index[axis] = 0; index[axis] < dims[axis]; index[axis]++) {
+                        size_t b = boxIndex(index[0], index[1], index[2]);
+                        buffers.line.f[index[axis]] = buffers.box_sq_dists[b];
+                        buffers.line_features[index[axis]] = buffers.box_features[b];
+                    }
+                    buffers.line.transform(dims[axis]);
+                    for (index[axis] = 0; index[axis] < dims[axis]; index[axis]++) {
+                        size_t b = boxIndex(index[0], index[1], index[2]);
+                        int arg = buffers.line.args[index[axis]];
+                        buffers.box_sq_dists[b] = arg < 0 ? INFINITE_SQ_DIST : buffers.line.sq_dists[index[axis]];
+                        buffers.box_features[b] = arg < 0 ? -1 : buffers.line_features[arg];
+                    }
+                }
+            }
+        }
+
+        for (int x = region_min[0]; x <= region_max[0]; x++) {
+            for (int y = region_min[1]; y <= region_max[1]; y++) {
+                for (int z = region_min[2]; z <= region_max[2]; z++) {
+                    size_t b = boxIndex(x - box_min[0], y - box_min[1], z - box_min[2]);
+                    dataCell &cell = data[x][y][z];
+                    int feature = buffers.box_features[b];
+                    if (feature >= 0) {
+                        auto f = static_cast<size_t>(feature);
+                        cell.obstX = box_min[0] + static_cast<int>(f / (dims[1] * dims[2]));
+                        cell.obstY = box_min[1] + static_cast<int>((f / dims[2]) % dims[1]);
+                        cell.obstZ = box_min[2] + static_cast<int>(f % dims[2]);
+                    }
+                    finalizeCell(cell, buffers.box_sq_dists[b]);
+                }
+            }
+        }
+    }
+
+    void BatchDistmap::finalizeCell(dataCell &cell, int sq_dist) const {
+        // Same truncation as the brushfire, a cell at the maximum distance or farther keeps no obstacle
+        if (sq_dist >= maxDist_squared) {
+            cell.dist = static_cast<float>(maxDist);
+            cell.sqdist = maxDist_squared;
+            cell.obstX = cell.obstY = cell.obstZ = invalidObstData;
+        } else {
+            cell.dist = std::sqrt(static_cast<float>(sq_dist));
+            cell.sqdist = sq_dist;
+        }
+        cell.needsRaise = false;
+        cell.queueing = fwNotQueued;
+    }
+}
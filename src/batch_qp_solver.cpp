@@ -0,0 +1,476 @@
+#include <batch_qp_solver.hpp>
+#include <worker_pool.hpp>
+#include <timer.hpp>
+#include <trace.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace DynamicPlanning {
+    static constexpr double MIN_SCALING = 1e-4;
+    static constexpr double MAX_SCALING = 1e4;
+    static constexpr double RHO_MIN = 1e-6; // free rows
+    static constexpr double RHO_EQ_OVER_RHO_INEQ = 1e3;
+    static constexpr double RHO_TOL = 1e-4; // rows with u - l below this are equality rows
+
+    static double limitScaling(double norm) {
+        if (norm < MIN_SCALING) {
+            return 1;
+        }
+        return std::min(norm, MAX_SCALING);
+    }
+
+    static bool isPatternEqual(const SparseMatrix &a, const SparseMatrix &b) {
+        if (a.rows() != b.rows() or a.cols() != b.cols() or a.nonZeros() != b.nonZeros()) {
+            return false;
+        }
+        for (int col = 0; col < a.outerSize(); col++) {
+            SparseMatrix::InnerIterator it_a(a, col), it_b(b, col);
+            for (; it_a and it_b; ++it_a, ++it_b) {
+                if (it_a.row() != it_b.row()) {
+                    return false;
+                }
+            }
+            if (it_a or it_b) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    BatchQPSolver::BatchQPSolver(const BatchQPSettings &_settings) : settings(_settings) {}
+
+    void BatchQPSolver::solve(const std::vector<const QPProblem *> &problems, std::vector<QPSolution> &solutions,
+                              std::vector<uint8_t> &successes) const {
+        TRACE_SCOPE("BatchQPSolver::solve");
+        solutions.assign(problems.size(), QPSolution());
+        successes.assign(problems.size(), 0);
+
+        // Group the problems by the structure, then cut the groups into packs of the lanes
+        std::vector<std::vector<size_t>> groups;
+        for (size_t k = 0; k < problems.size(); k++) {
+            if (problems[k] == nullptr or problems[k]->getNumVariables() == 0) {
+                continue;
+            }
+            auto group = std::find_if(groups.begin(), groups.end(), [&](const std::vector<size_t> &group) {
+                return isStructureEqual(*problems[group.front()], *problems[k]);
+            });
+            if (group == groups.end()) {
+                groups.emplace_back(1, k);
+            } else {
+                group->emplace_back(k);
+            }
+        }
+        std::vector<std::vector<size_t>> packs;
+        for (const auto &group: groups) {
+            for (size_t begin = 0; begin < group.size(); begin += LANE_WIDTH) {
+                size_t end = std::min(begin + LANE_WIDTH, group.size());
+                packs.emplace_back(group.begin() + static_cast<long>(begin), group.begin() + static_cast<long>(end));
+            }
+        }
+
+        // A pack writes only to the solutions of its problems
+        WorkerPool::getInstance().run(packs.size(), [&](size_t pi) {
+            solvePack(problems, packs[pi], solutions, successes);
+        });
+    }
+
+    void BatchQPSolver::solvePack(const std::vector<const QPProblem *> &problems, const std::vector<size_t> &pack,
+                                  std::vector<QPSolution> &solutions, std::vector<uint8_t> &successes) const {
+        TRACE_SCOPE("BatchQPSolver::solvePack");
+        Timer timer;
+        timer.reset();
+
+        const QPProblem &head = *problems[pack.front()];
+        const int L = static_cast<int>(pack.size());
+        const int n = head.getNumVariables();
+        const int m_con = head.getNumConstraints();
+        const int m = m_con + n; // the variable bounds are appended to A as identity rows
+        const double inf = std::numeric_limits<double>::infinity();
+
+        // Pattern of the extended A (CSC) and of the upper P, shared by the lanes
+        std::vector<int> a_col_start(n + 1, 0), a_row;
+        for (int col = 0; col < n; col++) {
+            for (SparseMatrix::InnerIterator it(head.A, col); it; ++it) {
+                a_row.emplace_back(static_cast<int>(it.row()));
+            }
+            a_row.emplace_back(m_con + col);
+            a_col_start[col + 1] = static_cast<int>(a_row.size());
+        }
+        std::vector<int> p_col_start(n + 1, 0), p_row;
+        for (int col = 0; col < n; col++) {
+            for (SparseMatrix::InnerIterator it(head.P, col); it; ++it) {
+                p_row.emplace_back(static_cast<int>(it.row()));
+            }
+            p_col_start[col + 1] = static_cast<int>(p_row.size());
+        }
+        const int nnz_a = static_cast<int>(a_row.size());
+        const int nnz_p = static_cast<int>(p_row.size());
+
+        // Rows of the extended A, for the KKT matrix
+        std::vector<int> a_row_start(m + 1, 0), a_row_entries(nnz_a), a_entry_col(nnz_a);
+        for (int k = 0; k < nnz_a; k++) {
+            a_row_start[a_row[k] + 1]++;
+        }
+        for (int r = 0; r < m; r++) {
+            a_row_start[r + 1] += a_row_start[r];
+        }
+        {
+            std::vector<int> fill(a_row_start.begin(), a_row_start.end() - 1);
+            for (int col = 0; col < n; col++) {
+                for (int k = a_col_start[col]; k < a_col_start[col + 1]; k++) {
+                    a_entry_col[k] = col;
+                    a_row_entries[fill[a_row[k]]++] = k;
+                }
+            }
+        }
+
+        // Data of the lanes, [entry][lane]
+        std::vector<double> Av(nnz_a * L), Pv(nnz_p * L), q(n * L), l(m * L), u(m * L);
+        for (int b = 0; b < L; b++) {
+            const QPProblem &problem = *problems[pack[b]];
+            for (int col = 0; col < n; col++) {
+                int k = a_col_start[col];
+                for (SparseMatrix::InnerIterator it(problem.A, col); it; ++it, ++k) {
+                    Av[k * L + b] = it.value();
+                }
+                Av[k * L + b] = 1;
+                k = p_col_start[col];
+                for (SparseMatrix::InnerIterator it(problem.P, col); it; ++it, ++k) {
+                    Pv[k * L + b] = it.value();
+                }
+                q[col * L + b] = problem.q(col);
+                l[(m_con + col) * L + b] = problem.x_min(col) <= -QP_INFINITY ? -inf : problem.x_min(col);
+                u[(m_con + col) * L + b] = problem.x_max(col) >= QP_INFINITY ? inf : problem.x_max(col);
+            }
+            for (int r = 0; r < m_con; r++) {
+                l[r * L + b] = problem.l(r) <= -QP_INFINITY ? -inf : problem.l(r);
+                u[r * L + b] = problem.u(r) >= QP_INFINITY ? inf : problem.u(r);
+            }
+        }
+
+        // Ruiz equilibration of the KKT matrix and the cost scaling, as OSQP
+        std::vector<double> D(n * L, 1), E(m * L, 1), c(L, 1);
+        std::vector<double> D_iter(n * L), E_iter(m * L);
+        for (int iter = 0; iter < settings.scaling_iter; iter++) {
+            std::fill(D_iter.begin(), D_iter.end(), 0);
+            std::fill(E_iter.begin(), E_iter.end(), 0);
+            for (int col = 0; col < n; col++) {
+                for (int k = p_col_start[col]; k < p_col_start[col + 1]; k++) {
+                    int row = p_row[k];
+                    for (int b = 0; b < L; b++) {
+                        double value = std::abs(Pv[k * L + b]);
+                        D_iter[col * L + b] = std::max(D_iter[col * L + b], value);
+                        D_iter[row * L + b] = std::max(D_iter[row * L + b], value);
+                    }
+                }
+                for (int k = a_col_start[col]; k < a_col_start[col + 1]; k++) {
+                    int row = a_row[k];
+                    for (int b = 0; b < L; b++) {
+                        double value = std::abs(Av[k * L + b]);
+                        D_iter[col * L + b] = std::max(D_iter[col * L + b], value);
+                        E_iter[row * L + b] = std::max(E_iter[row * L + b], value);
+                    }
+                }
+            }
+            for (double &value: D_iter) {
+                value = 1 / std::sqrt(limitScaling(value));
+            }
+            for (double &value: E_iter) {
+                value = 1 / std::sqrt(limitScaling(value));
+            }
+
+            for (int col = 0; col < n; col++) {
+                for (int k = p_col_start[col]; k < p_col_start[col + 1]; k++) {
+                    int row = p_row[k];
+                    for (int b = 0; b < L; b++) {
+                        Pv[k * L + b] *= D_iter[row * L + b] * D_iter[col * L + b];
+                    }
+                }
+                for (int k = a_col_start[col]; k < a_col_start[col + 1]; k++) {
+                    int row = a_row[k];
+                    for (int b = 0; b < L; b++) {
+                        Av[k * L + b] *= E_iter[row * L + b] * D_iter[col * L + b];
+                    }
+                }
+            }
+            for (int e = 0; e < n * L; e++) {
+                q[e] *= D_iter[e];
+                D[e] *= D_iter[e];
+            }
+            for (int e = 0; e < m * L; e++) {
+                E[e] *= E_iter[e];
+            }
+
+            // Cost scaling by the mean column norm of P and the norm of q
+            std::vector<double> p_col_norm_sum(L, 0), q_norm(L, 0);
+            std::fill(D_iter.begin(), D_iter.end(), 0);
+            for (int col = 0; col < n; col++) {
+                for (int k = p_col_start[col]; k < p_col_start[col + 1]; k++) {
+                    int row = p_row[k];
+                    for (int b = 0; b < L; b++) {
+                        double value = std::abs(Pv[k * L + b]);
+                        D_iter[col * L + b] = std::max(D_iter[col * L + b], value);
+                        D_iter[row * L + b] = std::max(D_iter[row * L + b], value);
+                    }
+                }
+            }
+            for (int col = 0; col < n; col++) {
+                for (int b = 0; b < L; b++) {
+                    p_col_norm_sum[b] += D_iter[col * L + b];
+                    q_norm[b] = std::max(q_norm[b], std::abs(q[col * L + b]));
+                }
+            }
+            std::vector<double> gamma(L);
+            for (int b = 0; b < L; b++) {
+                gamma[b] = 1 / limitScaling(std::max(limitScaling(p_col_norm_sum[b] / n), limitScaling(q_norm[b])));
+                c[b] *= gamma[b];
+            }
+            for (int k = 0; k < nnz_p; k++) {
+                for (int b = 0; b < L; b++) {
+                    Pv[k * L + b] *= gamma[b];
+                }
+            }
+            for (int col = 0; col < n; col++) {
+                for (int b = 0; b < L; b++) {
+                    q[col * L + b] *= gamma[b];
+                }
+            }
+        }
+        for (int e = 0; e < m * L; e++) {
+            l[e] *= E[e];
+            u[e] *= E[e];
+        }
+
+        std::vector<double> rho(m * L);
+        for (int e = 0; e < m * L; e++) {
+            if (l[e] == -inf and u[e] == inf) {
+                rho[e] = RHO_MIN;
+            } else if (u[e] - l[e] < RHO_TOL) {
+                rho[e] = RHO_EQ_OVER_RHO_INEQ * settings.rho;
+            } else {
+                rho[e] = settings.rho;
+            }
+        }
+
+        // KKT matrix P + sigma I + A^T diag(rho) A of the lanes, dense and factorized in place, [i * n + j][lane]
+        std::vector<double> K(static_cast<size_t>(n) * n * L, 0);
+        auto K_at = [&](int i, int j, int b) -> double & {
+            return K[(static_cast<size_t>(i) * n + j) * L + b];
+        };
+        for (int col = 0; col < n; col++) {
+            for (int k = p_col_start[col]; k < p_col_start[col + 1]; k++) {
+                int row = p_row[k];
+                for (int b = 0; b < L; b++) {
+                    K_at(row, col, b) += Pv[k * L + b];
+                    if (row != col) {
+                        K_at(col, row, b) += Pv[k * L + b];
+                    }
+                }
+            }
+            for (int b = 0; b < L; b++) {
+                K_at(col, col, b) += settings.sigma;
+            }
+        }
+        for (int r = 0; r < m; r++) {
+            for (int ka = a_row_start[r]; ka < a_row_start[r + 1]; ka++) {
+                int k1 = a_row_entries[ka];
+                for (int kb = a_row_start[r]; kb < a_row_start[r + 1]; kb++) {
+                    int k2 = a_row_entries[kb];
+                    for (int b = 0; b < L; b++) {
+                        K_at(a_entry_col[k1], a_entry_col[k2], b) +=
+                                rho[r * L + b] * Av[k1 * L + b] * Av[k2 * L + b];
+                    }
+                }
+            }
+        }
+
+        // Cholesky, the lower triangle is overwritten by the factor
+        std::vector<uint8_t> is_failed(L, 0);
+        for (int j = 0; j < n; j++) {
+            for (int k = 0; k < j; k++) {
+                for (int b = 0; b < L; b++) {
+                    K_at(j, j, b) -= K_at(j, k, b) * K_at(j, k, b);
+                }
+            }
+            for (int b = 0; b < L; b++) {
+                if (K_at(j, j, b) <= 0 or not std::isfinite(K_at(j, j, b))) {
+                    is_failed[b] = 1;
+                    K_at(j, j, b) = 1;
+                }
+                K_at(j, j, b) = std::sqrt(K_at(j, j, b));
+            }
+            for (int i = j + 1; i < n; i++) {
+                for (int k = 0; k < j; k++) {
+                    for (int b = 0; b < L; b++) {
+                        K_at(i, j, b) -= K_at(i, k, b) * K_at(j, k, b);
+                    }
+                }
+                for (int b = 0; b < L; b++) {
+                    K_at(i, j, b) /= K_at(j, j, b);
+                }
+            }
+        }
+
+        // Kernels over the lanes
+        auto multiplyA = [&](const std::vector<double> &x_in, std::vector<double> &out) {
+            std::fill(out.begin(), out.end(), 0);
+            for (int col = 0; col < n; col++) {
+                for (int k = a_col_start[col]; k < a_col_start[col + 1]; k++) {
+                    int row = a_row[k];
+                    for (int b = 0; b < L; b++) {
+                        out[row * L + b] += Av[k * L + b] * x_in[col * L + b];
+                    }
+                }
+            }
+        };
+        auto multiplyAT = [&](const std::vector<double> &y_in, std::vector<double> &out) {
+            std::fill(out.begin(), out.end(), 0);
+            for (int col = 0; col < n; col++) {
+                for (int k = a_col_start[col]; k < a_col_start[col + 1]; k++) {
+                    int row = a_row[k];
+                    for (int b = 0; b < L; b++) {
+                        out[col * L + b] += Av[k * L + b] * y_in[row * L + b];
+                    }
+                }
+            }
+        };
+        auto multiplyP = [&](const std::vector<double> &x_in, std::vector<double> &out) {
+            std::fill(out.begin(), out.end(), 0);
+            for (int col = 0; col < n; col++) {
+                for (int k = p_col_start[col]; k < p_col_start[col + 1]; k++) {
+                    int row = p_row[k];
+                    for (int b = 0; b < L; b++) {
+                        out[row * L + b] += Pv[k * L + b] * x_in[col * L + b];
+                        if (row != col) {
+                            out[col * L + b] += Pv[k * L + b] * x_in[row * L + b];
+                        }
+                    }
+                }
+            }
+        };
+        auto solveKKT = [&](std::vector<double> &v) {
+            for (int i = 0; i < n; i++) {
+                for (int k = 0; k < i; k++) {
+                    for (int b = 0; b < L; b++) {
+                        v[i * L + b] -= K_at(i, k, b) * v[k * L + b];
+                    }
+                }
+                for (int b = 0; b < L; b++) {
+                    v[i * L + b] /= K_at(i, i, b);
+                }
+            }
+            for (int i = n - 1; i >= 0; i--) {
+                for (int k = i + 1; k < n; k++) {
+                    for (int b = 0; b < L; b++) {
+                        v[i * L + b] -= K_at(k, i, b) * v[k * L + b];
+                    }
+                }
+                for (int b = 0; b < L; b++) {
+                    v[i * L + b] /= K_at(i, i, b);
+                }
+            }
+        };
+
+        // Initial iterate, the warm start is given in the unscaled variables
+        std::vector<double> x(n * L, 0), z(m * L), y(m * L, 0);
+        std::vector<double> x_tilde(n * L), z_tilde(m * L), buffer_n(n * L), buffer_m(m * L), buffer_n2(n * L);
+        for (int b = 0; b < L; b++) {
+            const QPProblem &problem = *problems[pack[b]];
+            if (problem.hasStart()) {
+                for (int col = 0; col < n; col++) {
+                    x[col * L + b] = problem.x_start(col) / D[col * L + b];
+                }
+            }
+        }
+        multiplyA(x, z);
+        for (int e = 0; e < m * L; e++) {
+            z[e] = std::min(std::max(z[e], l[e]), u[e]);
+        }
+
+        std::vector<uint8_t> is_done(is_failed);
+        int n_done = static_cast<int>(std::count(is_done.begin(), is_done.end(), 1));
+        const double alpha = settings.alpha;
+        for (int iter = 1; iter <= settings.max_iter and n_done < L; iter++) {
+            // x_tilde = K^-1 (sigma x - q + A^T (rho z - y))
+            for (int e = 0; e < m * L; e++) {
+                buffer_m[e] = rho[e] * z[e] - y[e];
+            }
+            multiplyAT(buffer_m, x_tilde);
+            for (int e = 0; e < n * L; e++) {
+                x_tilde[e] += settings.sigma * x[e] - q[e];
+            }
+            solveKKT(x_tilde);
+            multiplyA(x_tilde, z_tilde);
+
+            for (int e = 0; e < n * L; e++) {
+                x[e] = alpha * x_tilde[e] + (1 - alpha) * x[e];
+            }
+            for (int e = 0; e < m * L; e++) {
+                double z_relaxed = alpha * z_tilde[e] + (1 - alpha) * z[e];
+                double z_next = std::min(std::max(z_relaxed + y[e] / rho[e], l[e]), u[e]);
+                y[e] += rho[e] * (z_relaxed - z_next);
+                z[e] = z_next;
+            }
+
+            if (iter % settings.check_interval != 0 and iter != settings.max_iter) {
+                continue;
+            }
+
+            // Residuals of the unscaled problem
+            multiplyA(x, buffer_m);
+            multiplyP(x, buffer_n);
+            multiplyAT(y, buffer_n2);
+            for (int b = 0; b < L; b++) {
+                if (is_done[b]) {
+                    continue;
+                }
+                double prim_res = 0, prim_norm = 0;
+                for (int r = 0; r < m; r++) {
+                    double e_inv = 1 / E[r * L + b];
+                    prim_res = std::max(prim_res, std::abs(buffer_m[r * L + b] - z[r * L + b]) * e_inv);
+                    prim_norm = std::max({prim_norm, std::abs(buffer_m[r * L + b]) * e_inv,
+                                          std::abs(z[r * L + b]) * e_inv});
+                }
+                double dual_res = 0, dual_norm = 0;
+                for (int col = 0; col < n; col++) {
+                    double scale = 1 / (D[col * L + b] * c[b]);
+                    int e = col * L + b;
+                    dual_res = std::max(dual_res, std::abs(buffer_n[e] + q[e] + buffer_n2[e]) * scale);
+                    dual_norm = std::max({dual_norm, std::abs(buffer_n[e]) * scale, std::abs(buffer_n2[e]) * scale,
+                                          std::abs(q[e]) * scale});
+                }
+                if (prim_res > settings.eps_abs + settings.eps_rel * prim_norm or
+                    dual_res > settings.eps_abs + settings.eps_rel * dual_norm) {
+                    continue;
+                }
+
+                const QPProblem &problem = *problems[pack[b]];
+                QPSolution &solution = solutions[pack[b]];
+                solution.x.resize(n);
+                for (int col = 0; col < n; col++) {
+                    solution.x(col) = D[col * L + b] * x[col * L + b];
+                }
+                solution.cost = problem.getCost(solution.x);
+                solution.n_iteration = iter;
+                successes[pack[b]] = 1;
+                is_done[b] = 1;
+                n_done++;
+            }
+        }
+
+        timer.stop();
+        for (int b = 0; b < L; b++) {
+            QPSolution &solution = solutions[pack[b]];
+            solution.solve_time = timer.elapsedSeconds();
+            if (not successes[pack[b]]) {
+                solution.n_iteration = settings.max_iter;
+            }
+        }
+    }
+
+    bool BatchQPSolver::isStructureEqual(const QPProblem &a, const QPProblem &b) {
+        return a.getNumVariables() == b.getNumVariables() and a.getNumConstraints() == b.getNumConstraints() and
+               isPatternEqual(a.P, b.P) and isPatternEqual(a.A, b.A);
+    }
+}
@@ -0,0 +1,45 @@
+// Precompute the distance fields of the global maps, so the simulator loads them instead of the distance transform.
+// The cache is <world file>.edt next to the world file, and it is rebuilt if the world file or the grid changes.
+// rosrun lsc_dr_planner build_distmap_cache <mission file or directory> <world file or directory> [resolution]
+#include <global_map_registry.hpp>
+#include <mission.hpp>
+#include <timer.hpp>
+#include <iostream>
+#include <set>
+
+using namespace DynamicPlanning;
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        std::cout << "Usage: build_distmap_cache <mission file or directory> <world file or directory> [resolution]"
+                  << std::endl;
+        return -1;
+    }
+
+    double resolution = argc > 3 ? std::stod(argv[3]) : 0.1;
+    Mission mission(argv[1], argv[2]);
+    std::set<std::string> built_maps;
+    for (size_t mission_idx = 0; mission_idx < mission.mission_file_names.size(); mission_idx++) {
+        // The world boundary is defined in the mission, 3D to use the whole boundary
+        if (not mission.loadMission(0, 3, 1.0, (int) mission_idx)) {
+            std::cout << "Invalid mission: " << mission.mission_file_names[mission_idx] << std::endl;
+            continue;
+        }
+
+        std::ostringstream key;
+        key << mission.current_world_file_name << "," << mission.world_min << "," << mission.world_max;
+        if (not built_maps.insert(key.str()).second) {
+            continue;
+        }
+
+        Timer timer;
+        std::shared_ptr<GlobalMap> global_map = loadGlobalMap(mission.current_world_file_name, resolution,
+                                                              mission.world_min, mission.world_max, false, true);
+        timer.stop();
+        if (global_map == nullptr) {
+            return -1;
+        }
+        std::cout << mission.current_world_file_name << ".edt: " << timer.elapsedSeconds() << " s" << std::endl;
+    }
+    return 0;
+}
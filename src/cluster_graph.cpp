@@ -0,0 +1,163 @@
+#include <cluster_graph.hpp>
+#include <algorithm>
+#include <queue>
+
+namespace DynamicPlanning {
+    void ClusterGraph::build(const MAPF::GridView &_grid, int _cluster_size) {
+        grid = _grid;
+        cluster_size = std::max(_cluster_size, 1);
+        const std::array<int, 3> dim = {grid.width, grid.height, grid.depth};
+        for (int a = 0; a < 3; a++) {
+            cluster_dim[a] = (dim[a] + cluster_size - 1) / cluster_size;
+        }
+        size_t n_clusters = static_cast<size_t>(cluster_dim[0]) * cluster_dim[1] * cluster_dim[2];
+        cluster_free.assign(n_clusters, 0);
+        open_faces.assign(n_clusters, 0);
+        distance_tables.clear();
+
+        std::array<int, 3> cell{};
+        for (cell[0] = 0; cell[0] < dim[0]; cell[0]++) {
+            for (cell[1] = 0; cell[1] < dim[1]; cell[1]++) {
+                for (cell[2] = 0; cell[2] < dim[2]; cell[2]++) {
+                    if (grid.isOccupied(cell[0], cell[1], cell[2])) {
+                        continue;
+                    }
+                    int cluster = getClusterIndex(cell);
+                    cluster_free[cluster] = 1;
+
+                    // Entrance to the next cluster, the cell is at the border and its neighbor across it is free
+                    for (int a = 0; a < 3; a++) {
+                        if ((cell[a] + 1) % cluster_size != 0 or cell[a] + 1 >= dim[a]) {
+                            continue;
+                        }
+                        std::array<int, 3> next_cell = cell;
+                        next_cell[a]++;
+                        if (not grid.isOccupied(next_cell[0], next_cell[1], next_cell[2])) {
+                            open_faces[cluster] |= 1 << a;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    const std::vector<int> &ClusterGraph::getDistanceTable(const std::array<int, 3> &goal) {
+        int goal_cluster = getClusterIndex(goal);
+        auto it = distance_tables.find(goal_cluster);
+        if (it != distance_tables.end()) {
+            return it->second;
+        }
+
+        std::vector<int> &dist = distance_tables[goal_cluster];
+        dist.assign(cluster_free.size(), -1);
+        if (not cluster_free[goal_cluster]) {
+            return dist;
+        }
+
+        // Breadth first search, the abstract edges have the same cost
+        std::queue<int> open;
+        std::vector<int> neighbors;
+        dist[goal_cluster] = 0;
+        open.push(goal_cluster);
+        while (not open.empty()) {
+            int cluster = open.front();
+            open.pop();
+            getNeighbors(cluster, neighbors);
+            for (int neighbor: neighbors) {
+                if (dist[neighbor] >= 0) {
+                    continue;
+                }
+                dist[neighbor] = dist[cluster] + 1;
+                open.push(neighbor);
+            }
+        }
+        return dist;
+    }
+
+    bool ClusterGraph::getCorridor(const std::vector<std::array<int, 3>> &current_points,
+                                   const std::vector<std::array<int, 3>> &goal_points,
+                                   int dilation, std::vector<uint8_t> &cell_mask) {
+        std::vector<uint8_t> on_path(cluster_free.size(), 0);
+        std::vector<int> neighbors;
+        for (size_t i = 0; i < current_points.size() and i < goal_points.size(); i++) {
+            const std::vector<int> &dist = getDistanceTable(goal_points[i]);
+            int cluster = getClusterIndex(current_points[i]);
+            if (dist[cluster] < 0) {
+                return false;
+            }
+
+            // Descend the distance table, one of the neighbors is closer by one cluster
+            on_path[cluster] = 1;
+            while (dist[cluster] > 0) {
+                getNeighbors(cluster, neighbors);
+                for (int neighbor: neighbors) {
+                    if (dist[neighbor] == dist[cluster] - 1) {
+                        cluster = neighbor;
+                        break;
+                    }
+                }
+                on_path[cluster] = 1;
+            }
+        }
+
+        std::vector<uint8_t> in_corridor(cluster_free.size(), 0);
+        for (size_t cluster = 0; cluster < on_path.size(); cluster++) {
+            if (not on_path[cluster]) {
+                continue;
+            }
+            std::array<int, 3> coord = getClusterCoord(static_cast<int>(cluster));
+            std::array<int, 3> lb{}, ub{}, c{};
+            for (int a = 0; a < 3; a++) {
+                lb[a] = std::max(coord[a] - dilation, 0);
+                ub[a] = std::min(coord[a] + dilation, cluster_dim[a] - 1);
+            }
+            for (c[0] = lb[0]; c[0] <= ub[0]; c[0]++) {
+                for (c[1] = lb[1]; c[1] <= ub[1]; c[1]++) {
+                    for (c[2] = lb[2]; c[2] <= ub[2]; c[2]++) {
+                        in_corridor[(c[0] * cluster_dim[1] + c[1]) * cluster_dim[2] + c[2]] = 1;
+                    }
+                }
+            }
+        }
+
+        cell_mask.assign(static_cast<size_t>(grid.width) * grid.height * grid.depth, 0);
+        std::array<int, 3> cell{};
+        for (cell[0] = 0; cell[0] < grid.width; cell[0]++) {
+            for (cell[1] = 0; cell[1] < grid.height; cell[1]++) {
+                for (cell[2] = 0; cell[2] < grid.depth; cell[2]++) {
+                    if (in_corridor[getClusterIndex(cell)]) {
+                        size_t bit = grid.offset + cell[0] * grid.stride_x + cell[1] * grid.stride_y +
+                                     cell[2] * grid.stride_z;
+                        cell_mask[bit] = 1;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    int ClusterGraph::getClusterIndex(const std::array<int, 3> &cell) const {
+        return ((cell[0] / cluster_size) * cluster_dim[1] + cell[1] / cluster_size) * cluster_dim[2] +
+               cell[2] / cluster_size;
+    }
+
+    std::array<int, 3> ClusterGraph::getClusterCoord(int cluster) const {
+        return {cluster / (cluster_dim[1] * cluster_dim[2]),
+                (cluster / cluster_dim[2]) % cluster_dim[1],
+                cluster % cluster_dim[2]};
+    }
+
+    void ClusterGraph::getNeighbors(int cluster, std::vector<int> &neighbors) const {
+        neighbors.clear();
+        std::array<int, 3> coord = getClusterCoord(cluster);
+        const std::array<int, 3> strides = {cluster_dim[1] * cluster_dim[2], cluster_dim[2], 1};
+        for (int a = 0; a < 3; a++) {
+            if (coord[a] > 0 and (open_faces[cluster - strides[a]] >> a) & 1) {
+                neighbors.emplace_back(cluster - strides[a]);
+            }
+            if (coord[a] + 1 < cluster_dim[a] and (open_faces[cluster] >> a) & 1) {
+                neighbors.emplace_back(cluster + strides[a]);
+            }
+        }
+    }
+}
@@ -1,7 +1,89 @@
-#define CONVHULL_3D_ENABLE
 #include <collision_constraints.hpp>
+#include <sfc_library.hpp>
+#include <metrics_registry.hpp>
+#include <worker_pool.hpp>
+#include <timer.hpp>
+#include <algorithm>
 
 namespace DynamicPlanning {
+    SFCsCandidateEnumerator::SFCsCandidateEnumerator(const std::vector<SFCs> &_valid_sfcs,
+                                                     const CostFunction &cost)
+            : valid_sfcs(_valid_sfcs) {
+        int M = static_cast<int>(valid_sfcs.size());
+        box_costs.resize(M);
+        cost_to_go.resize(M);
+        successors.resize(M);
+        for (int m = 0; m < M; m++) {
+            box_costs[m].resize(valid_sfcs[m].size());
+            for (size_t j = 0; j < valid_sfcs[m].size(); j++) {
+                box_costs[m][j] = cost(m, valid_sfcs[m][j]);
+            }
+        }
+
+        // Cost-to-go by DP from the last segment
+        for (int m = M - 1; m >= 0; m--) {
+            cost_to_go[m].assign(valid_sfcs[m].size(), SP_INFINITY);
+            successors[m].resize(valid_sfcs[m].size());
+            for (size_t j = 0; j < valid_sfcs[m].size(); j++) {
+                if (m == M - 1) {
+                    cost_to_go[m][j] = box_costs[m][j];
+                    continue;
+                }
+
+                double min_cost_to_go = SP_INFINITY;
+                for (size_t k = 0; k < valid_sfcs[m + 1].size(); k++) {
+                    if (cost_to_go[m + 1][k] < SP_INFINITY and valid_sfcs[m][j].intersectWith(valid_sfcs[m + 1][k])) {
+                        successors[m][j].emplace_back(k);
+                        min_cost_to_go = std::min(min_cost_to_go, cost_to_go[m + 1][k]);
+                    }
+                }
+                if (min_cost_to_go < SP_INFINITY) {
+                    cost_to_go[m][j] = box_costs[m][j] + min_cost_to_go;
+                }
+            }
+        }
+
+        if (M > 0) {
+            for (size_t j = 0; j < valid_sfcs[0].size(); j++) {
+                push(0, j, -1, 0);
+            }
+        }
+    }
+
+    bool SFCsCandidateEnumerator::next(SFCs &sfcs_cand) {
+        int M = static_cast<int>(valid_sfcs.size());
+        while (not queue.empty()) {
+            int node_idx = queue.top().second;
+            queue.pop();
+
+            Node node = nodes[node_idx];
+            if (node.m == M - 1) {
+                sfcs_cand.resize(M);
+                for (int idx = node_idx; idx >= 0; idx = nodes[idx].parent) {
+                    sfcs_cand[nodes[idx].m] = valid_sfcs[nodes[idx].m][nodes[idx].box_idx];
+                }
+                return true;
+            }
+
+            for (size_t k: successors[node.m][node.box_idx]) {
+                push(node.m + 1, k, node_idx, node.cost);
+            }
+        }
+
+        return false;
+    }
+
+    void SFCsCandidateEnumerator::push(int m, size_t box_idx, int parent, double parent_cost) {
+        // The cost-to-go is exact, so complete sequences are popped in the order of the cost
+        if (cost_to_go[m][box_idx] >= SP_INFINITY) {
+            return;
+        }
+
+        int node_idx = static_cast<int>(nodes.size());
+        nodes.push_back({m, box_idx, parent, parent_cost + box_costs[m][box_idx]});
+        queue.emplace(parent_cost + cost_to_go[m][box_idx], node_idx);
+    }
+
     LSC::LSC(const point3d &_obs_control_point,
              const point3d &_normal_vector,
              double _d)
@@ -29,6 +111,56 @@ namespace DynamicPlanning {
         return msg_marker;
     }
 
+    void RSFCs::resize(size_t _N_obs, int _M, int _n_points) {
+        N_obs = _N_obs;
+        M = _M;
+        n_points = _n_points;
+
+        // std::vector keeps its capacity when it shrinks
+        size_t N_lscs = getNumLSCs();
+        for (int k = 0; k < 3; k++) {
+            normals[k].assign(N_lscs, 0);
+            points[k].assign(N_lscs, 0);
+        }
+        offsets.assign(N_lscs, 0);
+    }
+
+    void RSFCs::clear() {
+        resize(0, M, n_points);
+    }
+
+    void RSFCs::set(size_t oi, int m, int i, const point3d &obs_control_point, const point3d &normal_vector,
+                    double d) {
+        size_t idx = index(oi, m, i);
+        for (int k = 0; k < 3; k++) {
+            normals[k][idx] = normal_vector(k);
+            points[k][idx] = obs_control_point(k);
+        }
+        offsets[idx] = d;
+    }
+
+    LSC RSFCs::get(size_t oi, int m, int i) const {
+        size_t idx = index(oi, m, i);
+        return {point3d(static_cast<float>(points[0][idx]), static_cast<float>(points[1][idx]),
+                        static_cast<float>(points[2][idx])),
+                point3d(static_cast<float>(normals[0][idx]), static_cast<float>(normals[1][idx]),
+                        static_cast<float>(normals[2][idx])),
+                offsets[idx]};
+    }
+
+    double RSFCs::getLowerBound(size_t idx, int dim) const {
+        double lower = offsets[idx];
+        for (int k = 0; k < dim; k++) {
+            lower += normals[k][idx] * points[k][idx];
+        }
+        return lower;
+    }
+
+    double RSFCs::getNormalNorm(size_t idx) const {
+        return std::sqrt(normals[0][idx] * normals[0][idx] + normals[1][idx] * normals[1][idx] +
+                         normals[2][idx] * normals[2][idx]);
+    }
+
     Box::Box(const point3d &_box_min, const point3d &_box_max) {
         box_min = _box_min;
         box_max = _box_max;
@@ -360,8 +492,8 @@ namespace DynamicPlanning {
                box_max.distance(other_sfc.box_max) < SP_EPSILON_FLOAT;
     }
 
-    CollisionConstraints::CollisionConstraints(const Param &param_, const Mission &mission_)
-            : param(param_), mission(mission_) {}
+    CollisionConstraints::CollisionConstraints(const Param &param_, const std::shared_ptr<const Mission> &mission_)
+            : param(param_), mission(mission_), grow_sfc(selectGrowSFC(param_.world_dimension)) {}
 
     void CollisionConstraints::initializeSFC(const point3d &agent_position, double agent_radius) {
         sfcs.resize(param.M);
@@ -383,26 +515,20 @@ namespace DynamicPlanning {
     }
 
     void CollisionConstraints::initializeLSC(size_t N_obs) {
-        lscs.clear();
-        lscs.resize(N_obs);
-        for (size_t oi = 0; oi < N_obs; oi++) {
-            lscs[oi].resize(param.M);
-            for (int m = 0; m < param.M; m++) {
-                lscs[oi][m].resize(param.n + 1);
-            }
-        }
+        lscs.resize(N_obs, param.M, param.n + 1);
+        lsc_redundant.clear();
     }
 
     void CollisionConstraints::constructSFCFromPoint(const point3d &point,
                                                      const point3d &goal_point,
                                                      double agent_radius) {
         // Update sfc for segments m < M-1 from previous sfc
-        for (int m = 0; m < param.M - 1; m++) {
-            sfcs[m] = sfcs[m + 1];
-        }
+        shiftSFC();
 
         Box sfc_update;
-        bool success = expandSFCFromPoint(point, goal_point, sfcs[param.M - 1], agent_radius, sfc_update);
+        bool success = param.world_sfc_parallel_candidates
+                       ? expandSFCCandidatesFromPoint(point, goal_point, sfcs[param.M - 1], agent_radius, sfc_update)
+                       : expandSFCFromPoint(point, goal_point, sfcs[param.M - 1], agent_radius, sfc_update);
         if (not success) {
             ROS_WARN("[CollisionConstraints] Cannot find proper SFC, use previous one");
             sfc_update = sfcs[param.M - 1]; // Reuse previous one
@@ -415,26 +541,41 @@ namespace DynamicPlanning {
                                                           const point3d &next_waypoint,
                                                           double agent_radius) {
         // Update sfc for segments m < M-1 from previous sfc
-        for (int m = 0; m < param.M - 1; m++) {
-            sfcs[m] = sfcs[m + 1];
-        }
+        shiftSFC();
 
         Box sfc_update;
         points_t convex_hull_greedy = convex_hull;
         convex_hull_greedy.emplace_back(next_waypoint);
-        bool success = expandSFCFromConvexHull(convex_hull_greedy, agent_radius, sfc_update);
-        if (not success) {
-            success = expandSFCFromConvexHull(convex_hull, sfcs[param.M - 1],
-                                              agent_radius, sfc_update);
+        bool success;
+        if (param.world_sfc_parallel_candidates) {
+            success = expandSFCCandidatesFromConvexHull(convex_hull_greedy, convex_hull, next_waypoint,
+                                                        sfcs[param.M - 1], agent_radius, sfc_update);
+        } else {
+            success = expandSFCFromConvexHull(convex_hull_greedy, agent_radius, sfc_update);
             if (not success) {
-                ROS_WARN("[CollisionConstraints] Cannot find proper SFC, use previous one");
-                sfc_update = sfcs[param.M - 1]; // Reuse previous one
+                success = expandSFCFromConvexHull(convex_hull, sfcs[param.M - 1], agent_radius, sfc_update);
             }
         }
+        if (not success) {
+            ROS_WARN("[CollisionConstraints] Cannot find proper SFC, use previous one");
+            sfc_update = sfcs[param.M - 1]; // Reuse previous one
+        }
 
         sfcs[param.M - 1] = sfc_update;
     }
 
+    void CollisionConstraints::shiftSFC() {
+        for (size_t m = 0; m + 1 < sfcs.size(); m++) {
+            sfcs[m] = sfcs[m + 1];
+        }
+
+        // The horizon of the previous step may differ, the last SFC is repeated to the new one
+        if (not sfcs.empty()) {
+            Box last_sfc = sfcs.back();
+            sfcs.resize(param.M, last_sfc);
+        }
+    }
+
     void CollisionConstraints::constructCommunicationRange(const point3d &next_waypoint) {
         if(param.communication_range > 0){
             point3d delta(0.5 * param.communication_range,
@@ -446,41 +587,261 @@ namespace DynamicPlanning {
     }
 
     std::vector<SFCs> CollisionConstraints::findSFCsCandidates(const std::vector<SFCs> &valid_sfcs) {
-        Box temp;
-        std::vector<SFCs> sfc_candidates = findSFCsCandidates(valid_sfcs, temp, 0);
-        for (auto &sfc_cand: sfc_candidates) {
-            std::reverse(sfc_cand.begin(), sfc_cand.end());
+        auto negative_volume = [](int m, const Box &sfc) {
+            point3d size = sfc.box_max - sfc.box_min;
+            return -static_cast<double>(size.x() * size.y() * size.z());
+        };
+
+        std::vector<SFCs> sfc_candidates;
+        SFCsCandidateEnumerator enumerator(valid_sfcs, negative_volume);
+        SFCs sfc_cand;
+        while (enumerator.next(sfc_cand)) {
+            sfc_candidates.emplace_back(sfc_cand);
         }
 
         return sfc_candidates;
     }
 
-    std::vector<SFCs> CollisionConstraints::findSFCsCandidates(const std::vector<SFCs> &valid_sfcs,
-                                                               const Box &sfc_prev,
-                                                               int m) {
-        std::vector<SFCs> sfcs_candidates;
-        if (m == param.M) {
-            SFCs sfcs_cand;
-            sfcs_candidates.emplace_back(sfcs_cand);
-            return sfcs_candidates;
+    bool CollisionConstraints::findFeasibleSFCsCandidate(const std::vector<SFCs> &valid_sfcs,
+                                                         const SFCsCandidateEnumerator::CostFunction &cost,
+                                                         const std::function<bool(const SFCs &)> &is_feasible,
+                                                         SFCs &sfcs_cand) {
+        SFCsCandidateEnumerator enumerator(valid_sfcs, cost);
+        while (enumerator.next(sfcs_cand)) {
+            if (is_feasible(sfcs_cand)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Half-space a^T x >= b of the control point
+    struct HalfSpace {
+        std::array<double, 3> a;
+        double b;
+    };
+
+    static constexpr double LP_EPSILON = 1e-9;
+
+    // Minimize c^T x subject to lower <= x <= upper and the half-spaces with Seidel's incremental algorithm.
+    // Only the first dim entries are used. Returns false if the problem is infeasible.
+    static bool solveSmallLP(int dim, const std::array<double, 3> &c,
+                             const std::array<double, 3> &lower, const std::array<double, 3> &upper,
+                             const std::vector<HalfSpace> &half_spaces, std::array<double, 3> &x) {
+        for (int k = 0; k < dim; k++) {
+            x[k] = c[k] > 0 ? lower[k] : upper[k];
         }
 
-        for (const auto &sfc_curr: valid_sfcs[m]) {
-            if (m == 0 or sfc_curr.intersectWith(sfc_prev)) {
-                std::vector<SFCs> sfcs_candidates_child = findSFCsCandidates(valid_sfcs, sfc_curr, m + 1);
-                for (const auto &sfcs_cand_child: sfcs_candidates_child) {
-                    SFCs sfcs_cand_curr = sfcs_cand_child;
-                    sfcs_cand_curr.emplace_back(sfc_curr);
-                    sfcs_candidates.emplace_back(sfcs_cand_curr);
+        for (size_t t = 0; t < half_spaces.size(); t++) {
+            const HalfSpace &h = half_spaces[t];
+            double value = 0;
+            for (int k = 0; k < dim; k++) {
+                value += h.a[k] * x[k];
+            }
+            if (value >= h.b - LP_EPSILON) {
+                continue;
+            }
+
+            // The optimum is on the boundary of h, eliminate the axis p by x_p = beta + gamma^T x
+            int p = -1;
+            for (int k = 0; k < dim; k++) {
+                if (std::abs(h.a[k]) > LP_EPSILON and (p < 0 or std::abs(h.a[k]) > std::abs(h.a[p]))) {
+                    p = k;
                 }
             }
+            if (p < 0) {
+                return false;
+            }
+
+            std::array<double, 3> gamma{}, c_sub{}, lower_sub{}, upper_sub{}, x_sub{};
+            double beta = h.b / h.a[p];
+            int dim_sub = 0;
+            std::array<int, 3> axes{};
+            for (int k = 0; k < dim; k++) {
+                if (k == p) {
+                    continue;
+                }
+                gamma[dim_sub] = -h.a[k] / h.a[p];
+                c_sub[dim_sub] = c[k] + c[p] * gamma[dim_sub];
+                lower_sub[dim_sub] = lower[k];
+                upper_sub[dim_sub] = upper[k];
+                axes[dim_sub] = k;
+                dim_sub++;
+            }
+
+            std::vector<HalfSpace> half_spaces_sub;
+            half_spaces_sub.reserve(t + 2);
+            auto add_half_space = [&](const std::array<double, 3> &a, double a_p, double b) {
+                HalfSpace h_sub{{0, 0, 0}, b - a_p * beta};
+                for (int j = 0; j < dim_sub; j++) {
+                    h_sub.a[j] = a[axes[j]] + a_p * gamma[j];
+                }
+                half_spaces_sub.emplace_back(h_sub);
+            };
+            std::array<double, 3> zero{0, 0, 0};
+            add_half_space(zero, 1, lower[p]); // x_p >= lower_p
+            add_half_space(zero, -1, -upper[p]); // x_p <= upper_p
+            for (size_t s = 0; s < t; s++) {
+                add_half_space(half_spaces[s].a, half_spaces[s].a[p], half_spaces[s].b);
+            }
+
+            if (dim_sub == 0) {
+                for (const auto &h_sub: half_spaces_sub) {
+                    if (h_sub.b > LP_EPSILON) {
+                        return false;
+                    }
+                }
+            } else if (not solveSmallLP(dim_sub, c_sub, lower_sub, upper_sub, half_spaces_sub, x_sub)) {
+                return false;
+            }
+
+            x[p] = beta;
+            for (int j = 0; j < dim_sub; j++) {
+                x[axes[j]] = x_sub[j];
+                x[p] += gamma[j] * x_sub[j];
+            }
         }
 
-        return sfcs_candidates;
+        return true;
+    }
+
+    int CollisionConstraints::reduceLSCs(int dim, bool use_slack_for_all, bool use_lp) {
+        lsc_redundant.assign(lscs.getNumLSCs(), false);
+        int n_redundant = 0;
+
+        std::vector<size_t> lsc_indices;
+        std::vector<HalfSpace> half_spaces;
+        std::vector<bool> is_hard;
+        for (int m = 0; m < param.M; m++) {
+            for (int i = 0; i < param.n + 1; i++) {
+                // Bounds of the control point, same as the variable bounds and the SFC rows of TrajOptimizer
+                std::array<double, 3> lower{}, upper{};
+                bool is_bounded = true;
+                for (int k = 0; k < dim; k++) {
+                    lower[k] = mission->world_min(k);
+                    upper[k] = mission->world_max(k);
+                    if ((m == 0 and i < 3) or
+                        (k == 2 and m == 0 and param.planner_mode == PlannerMode::RECIPROCALRSFC)) {
+                        lower[k] = -SP_INFINITY;
+                        upper[k] = SP_INFINITY;
+                    }
+                    if (param.world_use_octomap and static_cast<int>(sfcs.size()) == param.M and
+                        not(m == 0 and i < param.phi)) {
+                        lower[k] = std::max(lower[k], static_cast<double>(sfcs[m].box_min(k)));
+                        upper[k] = std::min(upper[k], static_cast<double>(sfcs[m].box_max(k)));
+                    }
+                    is_bounded = is_bounded and lower[k] > -SP_INFINITY and upper[k] < SP_INFINITY;
+                }
+
+                // LSCs with slack variables can be removed, but they cannot imply the other LSCs
+                lsc_indices.clear();
+                half_spaces.clear();
+                is_hard.clear();
+                for (size_t oi = 0; oi < lscs.size(); oi++) {
+                    size_t lsc_idx = lscs.index(oi, m, i);
+                    if (lscs.getNormalNorm(lsc_idx) < SP_EPSILON_FLOAT) {
+                        continue;
+                    }
+                    HalfSpace h{{0, 0, 0}, lscs.getLowerBound(lsc_idx, dim)};
+                    for (int k = 0; k < dim; k++) {
+                        h.a[k] = lscs.getNormals(k)[lsc_idx];
+                    }
+                    lsc_indices.emplace_back(lsc_idx);
+                    half_spaces.emplace_back(h);
+                    is_hard.emplace_back(not use_slack_for_all and not isDynamicObstacle(static_cast<int>(oi)));
+                }
+
+                // Minimum of a_j^T x - b_j - s (a_k^T x - b_k) in the bounds, a valid lower bound of a_j^T x - b_j
+                // if x satisfies the LSC k and s >= 0. s = 0 gives the dominance by the bounds only.
+                auto implied_margin = [&](const HalfSpace &h_j, const HalfSpace *h_k, double s) {
+                    double margin = -h_j.b + (h_k != nullptr ? s * h_k->b : 0);
+                    for (int k = 0; k < dim; k++) {
+                        double coef = h_j.a[k] - (h_k != nullptr ? s * h_k->a[k] : 0);
+                        if (std::abs(coef) < LP_EPSILON) {
+                            continue;
+                        }
+                        if (lower[k] <= -SP_INFINITY or upper[k] >= SP_INFINITY) {
+                            return -SP_INFINITY;
+                        }
+                        margin += coef * (coef > 0 ? lower[k] : upper[k]);
+                    }
+                    return margin;
+                };
+
+                std::vector<bool> is_removed(lsc_indices.size(), false);
+
+                // Dominance by the bounds or by another LSC with a similar normal vector
+                for (size_t j = 0; j < lsc_indices.size(); j++) {
+                    const HalfSpace &h_j = half_spaces[j];
+                    bool redundant = implied_margin(h_j, nullptr, 0) > SP_EPSILON_FLOAT;
+                    double norm_j = lscs.getNormalNorm(lsc_indices[j]);
+                    for (size_t k = 0; k < lsc_indices.size() and not redundant; k++) {
+                        if (k == j or not is_hard[k] or is_removed[k]) {
+                            continue;
+                        }
+                        const HalfSpace &h_k = half_spaces[k];
+                        double norm_k = lscs.getNormalNorm(lsc_indices[k]);
+                        double cos_angle = 0;
+                        for (int l = 0; l < dim; l++) {
+                            cos_angle += h_j.a[l] * h_k.a[l];
+                        }
+                        cos_angle /= norm_j * norm_k;
+                        if (cos_angle < 0.9) {
+                            continue;
+                        }
+                        redundant = implied_margin(h_j, &h_k, norm_j / norm_k) > SP_EPSILON_FLOAT;
+                    }
+                    is_removed[j] = redundant;
+                }
+
+                // Minimize a_j^T x over the bounds and the other hard LSCs
+                if (use_lp and is_bounded) {
+                    std::vector<HalfSpace> others;
+                    for (size_t j = 0; j < lsc_indices.size(); j++) {
+                        if (is_removed[j]) {
+                            continue;
+                        }
+                        others.clear();
+                        for (size_t k = 0; k < lsc_indices.size(); k++) {
+                            if (k != j and is_hard[k] and not is_removed[k]) {
+                                others.emplace_back(half_spaces[k]);
+                            }
+                        }
+                        std::array<double, 3> x{};
+                        if (others.empty() or not solveSmallLP(dim, half_spaces[j].a, lower, upper, others, x)) {
+                            continue;
+                        }
+                        double margin = -half_spaces[j].b;
+                        for (int k = 0; k < dim; k++) {
+                            margin += half_spaces[j].a[k] * x[k];
+                        }
+                        is_removed[j] = margin > SP_EPSILON_FLOAT;
+                    }
+                }
+
+                for (size_t j = 0; j < lsc_indices.size(); j++) {
+                    if (is_removed[j]) {
+                        lsc_redundant[lsc_indices[j]] = true;
+                        n_redundant++;
+                    }
+                }
+            }
+        }
+
+        return n_redundant;
     }
 
     LSC CollisionConstraints::getLSC(int oi, int m, int i) const {
-        return lscs[oi][m][i];
+        return lscs.get(oi, m, i);
+    }
+
+    const RSFCs &CollisionConstraints::getLSCs() const {
+        return lscs;
+    }
+
+    bool CollisionConstraints::isLSCRedundant(size_t lsc_idx) const {
+        return lsc_idx < lsc_redundant.size() and lsc_redundant[lsc_idx];
     }
 
     Box CollisionConstraints::getSFC(int m) const {
@@ -503,29 +864,39 @@ namespace DynamicPlanning {
         return dynamic_obstacle_indices.empty();
     }
 
-    void CollisionConstraints::setDistmap(std::shared_ptr<DynamicEDTOctomap> distmap_ptr_) {
+    void CollisionConstraints::setDistmap(std::shared_ptr<DistanceMap> distmap_ptr_) {
         distmap_ptr = distmap_ptr_;
+        primitive_world = dynamic_cast<const PrimitiveWorld *>(distmap_ptr.get());
     }
 
     void CollisionConstraints::setOctomap(std::shared_ptr<octomap::OcTree> octree_ptr_) {
         octree_ptr = octree_ptr_;
     }
 
+    void CollisionConstraints::setOccupancyIndex(std::shared_ptr<OccupancyIndex> occupancy_index_ptr_) {
+        occupancy_index_ptr = occupancy_index_ptr_;
+    }
+
+    void CollisionConstraints::setParam(const Param &param_) {
+        param = param_;
+        grow_sfc = selectGrowSFC(param.world_dimension);
+    }
+
     void CollisionConstraints::setLSC(int oi, int m,
-                                      const points_t &obs_control_points,
+                                      const ControlPoints<point3d> &obs_control_points,
                                       const vector3d &normal_vector,
                                       const std::vector<double> &ds) {
         for (int i = 0; i < param.n + 1; i++) {
-            lscs[oi][m][i] = LSC(obs_control_points[i], normal_vector, ds[i]);
+            lscs.set(oi, m, i, obs_control_points[i], normal_vector, ds[i]);
         }
     }
 
     void CollisionConstraints::setLSC(int oi, int m,
-                                      const points_t &obs_control_points,
+                                      const ControlPoints<point3d> &obs_control_points,
                                       const vector3d &normal_vector,
                                       double d) {
         for (int i = 0; i < param.n + 1; i++) {
-            lscs[oi][m][i] = LSC(obs_control_points[i], normal_vector, d);
+            lscs.set(oi, m, i, obs_control_points[i], normal_vector, d);
         }
     }
 
@@ -534,7 +905,7 @@ namespace DynamicPlanning {
                                       const vector3d &normal_vector,
                                       double d) {
         for (int i = 0; i < param.n + 1; i++) {
-            lscs[oi][m][i] = LSC(obs_point, normal_vector, d);
+            lscs.set(oi, m, i, obs_point, normal_vector, d);
         }
     }
 
@@ -576,9 +947,12 @@ namespace DynamicPlanning {
                 marker_color.a = 0.1;
             }
 
-            for (size_t m = 0; m < lscs[oi].size(); m++) {
+            for (int m = 0; m < param.M; m++) {
 //                visualization_msgs::Marker msg_marker = lscs[oi][m][0].convertToMarker(agent_radius);
-                visualization_msgs::Marker msg_marker = lscs[oi][m][0].convertToMarker(0, param.world_frame_id);
+                visualization_msgs::Marker msg_marker = lscs.get(oi, m, 0).convertToMarker(0, param.world_frame_id);
+                if (lscs.getNormalNorm(lscs.index(oi, m, 0)) < SP_EPSILON_FLOAT) {
+                    msg_marker.action = visualization_msgs::Marker::DELETE; // no LSC, e.g. merged into a group
+                }
                 if (obstacles[oi].type == AGENT) {
                     msg_marker.ns = "agent" + std::to_string(m);
                 } else if (obstacles[oi].type == DYNAMICOBSTACLE) {
@@ -626,14 +1000,15 @@ namespace DynamicPlanning {
         }
 
         for (int m = 0; m < param.M + 1; m++) {
-            points_t vertices;
+            FeasibleRegion feasible_region;
             if(m < param.M){
-                vertices = findFeasibleVertices(m, 0);
+                feasible_region = findFeasibleRegion(m, 0);
             } else {
-                vertices = findFeasibleVertices(param.M - 1, param.n);
+                feasible_region = findFeasibleRegion(param.M - 1, param.n);
             }
 
-            visualization_msgs::Marker msg_marker = convexHullToMarkerMsg(vertices, color, param.world_frame_id);
+            visualization_msgs::Marker msg_marker = feasibleRegionToMarkerMsg(feasible_region, color,
+                                                                              param.world_frame_id);
 
             msg_marker.id = agent_id;
             msg_marker.ns = std::to_string(m);
@@ -669,22 +1044,7 @@ namespace DynamicPlanning {
     bool CollisionConstraints::expandSFCFromPoint(const point3d &point, const point3d &goal_point,
                                                   const Box &prev_sfc, double agent_radius,
                                                   Box &expanded_sfc) {
-        // Initialize initial_box
-        Box initial_sfc;
-        for (size_t k = 0; k < 3; k++) {
-            initial_sfc.box_min(k) = floor(point(k) / param.world_resolution) * param.world_resolution;
-            initial_sfc.box_max(k) = ceil(point(k) / param.world_resolution) * param.world_resolution;
-        }
-        if (not prev_sfc.include(initial_sfc)) {
-            initial_sfc = prev_sfc.intersection(initial_sfc);
-            for (size_t k = 0; k < 3; k++) {
-                initial_sfc.box_min(k) = ceil((initial_sfc.box_min(k) - SP_EPSILON_FLOAT) / param.world_resolution) *
-                                         param.world_resolution;
-                initial_sfc.box_max(k) = floor((initial_sfc.box_max(k) + SP_EPSILON_FLOAT) / param.world_resolution) *
-                                         param.world_resolution;
-            }
-        }
-
+        Box initial_sfc = computeInitialSFC(point, prev_sfc);
         bool success = expandSFC(initial_sfc, goal_point, agent_radius, expanded_sfc);
         if (not success or not expanded_sfc.isPointInBox(point)) {
             ROS_ERROR("????");
@@ -701,27 +1061,7 @@ namespace DynamicPlanning {
             return false;
         }
 
-        // Initialize initial_box
-        Box initial_sfc;
-        initial_sfc.box_min = convex_hull[0];
-        initial_sfc.box_max = convex_hull[0];
-        for (const auto &point: convex_hull) {
-            for (int k = 0; k < 3; k++) {
-                if (point(k) < initial_sfc.box_min(k)) {
-                    initial_sfc.box_min(k) = point(k);
-                }
-                if (point(k) > initial_sfc.box_max(k)) {
-                    initial_sfc.box_max(k) = point(k);
-                }
-            }
-        }
-
-        // Align initial SFC to grid
-        for (int k = 0; k < 3; k++) {
-            initial_sfc.box_min(k) = round(initial_sfc.box_min(k) / param.world_resolution) * param.world_resolution;
-            initial_sfc.box_max(k) = round(initial_sfc.box_max(k) / param.world_resolution) * param.world_resolution;
-        }
-
+        Box initial_sfc = computeInitialSFC(convex_hull);
         bool success = expandSFC(initial_sfc, agent_radius, expanded_sfc);
         if (success and not expanded_sfc.isSuperSetOfConvexHull(convex_hull)) {
             success = false;
@@ -738,283 +1078,462 @@ namespace DynamicPlanning {
             return false;
         }
 
-        // Initialize initial_box
-        Box initial_sfc;
-        initial_sfc.box_min = convex_hull[0];
-        initial_sfc.box_max = convex_hull[0];
+        Box initial_sfc = computeInitialSFC(convex_hull, prev_sfc);
+        bool success = expandSFC(initial_sfc, agent_radius, expanded_sfc);
+        if (not success or not expanded_sfc.isSuperSetOfConvexHull(convex_hull)) {
+            ROS_ERROR("????");
+        }
+
+        return success;
+    }
+
+    bool CollisionConstraints::expandSFCCandidatesFromPoint(const point3d &point, const point3d &goal_point,
+                                                            const Box &prev_sfc, double agent_radius,
+                                                            Box &expanded_sfc) {
+        // The axis order toward the goal of expandSFCFromPoint and the default order
+        Box initial_sfc = computeInitialSFC(point, prev_sfc);
+        std::vector<SFCCandidate> candidates(2);
+        candidates[0].rank = 0;
+        candidates[0].initial_sfc = initial_sfc;
+        candidates[0].axis_cand = setAxisCand(initial_sfc, goal_point);
+        candidates[1].rank = 0;
+        candidates[1].initial_sfc = initial_sfc;
+        candidates[1].axis_cand = {0, 1, 2, 3, 4, 5};
+
+        bool success = expandSFCCandidates(candidates, goal_point, agent_radius, expanded_sfc);
+        if (not success or not expanded_sfc.isPointInBox(point)) {
+            ROS_ERROR("????");
+        }
+
+        return success;
+    }
+
+    bool CollisionConstraints::expandSFCCandidatesFromConvexHull(const points_t &convex_hull_greedy,
+                                                                 const points_t &convex_hull,
+                                                                 const point3d &next_waypoint, const Box &prev_sfc,
+                                                                 double agent_radius, Box &expanded_sfc) {
+        if (convex_hull.empty()) {
+            return false;
+        }
+
+        // The greedy hull must be covered as in expandSFCFromConvexHull, the hull in the previous SFC is the fallback.
+        // Each initial box grows in the default axis order and in the order toward the next waypoint.
+        std::vector<SFCCandidate> candidates;
+        auto add_candidates = [&](int rank, const Box &initial_sfc, const points_t *required_hull) {
+            for (int order = 0; order < 2; order++) {
+                SFCCandidate candidate;
+                candidate.rank = rank;
+                candidate.initial_sfc = initial_sfc;
+                candidate.axis_cand = order == 0 ? std::vector<int>{0, 1, 2, 3, 4, 5}
+                                                 : setAxisCand(initial_sfc, next_waypoint);
+                candidate.required_hull = required_hull;
+                candidates.emplace_back(std::move(candidate));
+            }
+        };
+        add_candidates(0, computeInitialSFC(convex_hull_greedy), &convex_hull_greedy);
+        add_candidates(1, computeInitialSFC(convex_hull, prev_sfc), nullptr);
+
+        bool success = expandSFCCandidates(candidates, next_waypoint, agent_radius, expanded_sfc);
+        if (not success or not expanded_sfc.isSuperSetOfConvexHull(convex_hull)) {
+            ROS_ERROR("????");
+        }
+
+        return success;
+    }
+
+    bool CollisionConstraints::expandSFCCandidates(std::vector<SFCCandidate> &candidates, const point3d &goal_point,
+                                                   double margin, Box &expanded_sfc) {
+        static MetricCounter &candidate_expansions = MetricsRegistry::getInstance().getCounter(
+                "lsc_sfc_candidate_expansions_total", "SFC candidates expanded concurrently");
+        static MetricCounter &candidate_cancels = MetricsRegistry::getInstance().getCounter(
+                "lsc_sfc_candidate_cancels_total", "SFC candidates failed or cancelled after a candidate of a lower rank succeeded");
+
+        int n_ranks = 0;
+        for (const auto &candidate: candidates) {
+            n_ranks = std::max(n_ranks, candidate.rank + 1);
+        }
+        // [rank], set if a candidate of a lower rank succeeded
+        std::unique_ptr<std::atomic<bool>[]> cancelled(new std::atomic<bool>[n_ranks]);
+        for (int rank = 0; rank < n_ranks; rank++) {
+            cancelled[rank].store(false);
+        }
+
+        TaskGroup group(WorkerPool::getInstance());
+        for (auto &candidate: candidates) {
+            group.run([&, candidate_ptr = &candidate] {
+                SFCCandidate &cand = *candidate_ptr;
+                const std::atomic<bool> &cancel = cancelled[cand.rank];
+                cand.success = not cancel.load(std::memory_order_relaxed) and
+                               expandSFC(cand.initial_sfc, cand.axis_cand, margin, &cancel, cand.expansion) and
+                               (cand.required_hull == nullptr or
+                                cand.expansion.sfc.isSuperSetOfConvexHull(*cand.required_hull));
+                if (cand.success) {
+                    for (int rank = cand.rank + 1; rank < n_ranks; rank++) {
+                        cancelled[rank].store(true, std::memory_order_relaxed);
+                    }
+                }
+            });
+        }
+        group.wait();
+        candidate_expansions.increment(candidates.size());
+
+        // The candidates of the lowest successful rank are never cancelled, so all of them are compared
+        const SFCCandidate *best = nullptr;
+        double best_dist = SP_INFINITY, best_volume = 0;
+        for (const auto &candidate: candidates) {
+            if (not candidate.success) {
+                if (cancelled[candidate.rank].load(std::memory_order_relaxed)) {
+                    candidate_cancels.increment();
+                }
+                continue;
+            }
+
+            const Box &sfc = candidate.expansion.sfc;
+            double dist = sfc.distanceToPoint(goal_point);
+            point3d size = sfc.box_max - sfc.box_min;
+            double volume = size.x() * size.y() * size.z();
+            if (best == nullptr or candidate.rank < best->rank or
+                (candidate.rank == best->rank and
+                 (dist < best_dist - SP_EPSILON_FLOAT or
+                  (dist < best_dist + SP_EPSILON_FLOAT and volume > best_volume + SP_EPSILON_FLOAT)))) {
+                best = &candidate;
+                best_dist = dist;
+                best_volume = volume;
+            }
+        }
+        if (best == nullptr) {
+            return false;
+        }
+
+        // Only the chosen box is cached, the library does not depend on the candidates which lost
+        commitSFCExpansion(best->expansion, margin);
+        expanded_sfc = best->expansion.sfc;
+        return true;
+    }
+
+    // The bounding box of the convex hull, which is not empty
+    static Box boundingBoxOfConvexHull(const points_t &convex_hull) {
+        Box box;
+        box.box_min = convex_hull[0];
+        box.box_max = convex_hull[0];
         for (const auto &point: convex_hull) {
             for (int k = 0; k < 3; k++) {
-                if (point(k) < initial_sfc.box_min(k)) {
-                    initial_sfc.box_min(k) = point(k);
+                if (point(k) < box.box_min(k)) {
+                    box.box_min(k) = point(k);
                 }
-                if (point(k) > initial_sfc.box_max(k)) {
-                    initial_sfc.box_max(k) = point(k);
+                if (point(k) > box.box_max(k)) {
+                    box.box_max(k) = point(k);
                 }
             }
         }
+        return box;
+    }
+
+    Box CollisionConstraints::computeInitialSFC(const point3d &point, const Box &prev_sfc) const {
+        Box initial_sfc;
+        for (size_t k = 0; k < 3; k++) {
+            initial_sfc.box_min(k) = floor(point(k) / param.world_resolution) * param.world_resolution;
+            initial_sfc.box_max(k) = ceil(point(k) / param.world_resolution) * param.world_resolution;
+        }
+        return clipInitialSFC(initial_sfc, prev_sfc);
+    }
+
+    Box CollisionConstraints::computeInitialSFC(const points_t &convex_hull) const {
+        // Align initial SFC to grid
+        Box initial_sfc = boundingBoxOfConvexHull(convex_hull);
+        for (int k = 0; k < 3; k++) {
+            initial_sfc.box_min(k) = round(initial_sfc.box_min(k) / param.world_resolution) * param.world_resolution;
+            initial_sfc.box_max(k) = round(initial_sfc.box_max(k) / param.world_resolution) * param.world_resolution;
+        }
+        return initial_sfc;
+    }
 
+    Box CollisionConstraints::computeInitialSFC(const points_t &convex_hull, const Box &prev_sfc) const {
         // Align initial SFC to grid
+        Box initial_sfc = boundingBoxOfConvexHull(convex_hull);
         for (int k = 0; k < 3; k++) {
             initial_sfc.box_min(k) = floor(initial_sfc.box_min(k) / param.world_resolution) * param.world_resolution;
             initial_sfc.box_max(k) = ceil(initial_sfc.box_max(k) / param.world_resolution) * param.world_resolution;
         }
-        if (not prev_sfc.include(initial_sfc)) {
-            initial_sfc = prev_sfc.intersection(initial_sfc);
-            for (size_t k = 0; k < 3; k++) {
-                initial_sfc.box_min(k) = ceil((initial_sfc.box_min(k) - SP_EPSILON_FLOAT) / param.world_resolution) *
-                                         param.world_resolution;
-                initial_sfc.box_max(k) = floor((initial_sfc.box_max(k) + SP_EPSILON_FLOAT) / param.world_resolution) *
-                                         param.world_resolution;
-            }
-        }
+        return clipInitialSFC(initial_sfc, prev_sfc);
+    }
 
-        bool success = expandSFC(initial_sfc, agent_radius, expanded_sfc);
-        if (not success or not expanded_sfc.isSuperSetOfConvexHull(convex_hull)) {
-            ROS_ERROR("????");
+    Box CollisionConstraints::clipInitialSFC(const Box &initial_sfc, const Box &prev_sfc) const {
+        if (prev_sfc.include(initial_sfc)) {
+            return initial_sfc;
         }
 
-        return success;
+        Box clipped_sfc = prev_sfc.intersection(initial_sfc);
+        for (size_t k = 0; k < 3; k++) {
+            clipped_sfc.box_min(k) = ceil((clipped_sfc.box_min(k) - SP_EPSILON_FLOAT) / param.world_resolution) *
+                                     param.world_resolution;
+            clipped_sfc.box_max(k) = floor((clipped_sfc.box_max(k) + SP_EPSILON_FLOAT) / param.world_resolution) *
+                                     param.world_resolution;
+        }
+        return clipped_sfc;
     }
 
     bool CollisionConstraints::isObstacleInSFC(const Box &sfc, double margin) {
-        point3d delta(0.5 * param.world_resolution, 0.5 * param.world_resolution, 0.5 * param.world_resolution);
+        double clearance;
+        return isObstacleInSFC(sfc, margin, clearance);
+    }
+
+    bool CollisionConstraints::isObstacleInSFC(const Box &sfc, double margin, double &clearance) {
+        clearance = 0;
+
+        // The primitives give the exact L-infinity distance, which is also the clearance of the box
+        if (primitive_world != nullptr) {
+            double dist = primitive_world->computeLInfDistance(sfc.box_min, sfc.box_max);
+            clearance = std::max(dist - margin - SP_EPSILON_FLOAT, 0.0);
+            return dist < margin + SP_EPSILON_FLOAT;
+        }
+
+        // The L-infinity distance between the box and an obstacle cell is less than the margin
+        // iff the cell center is in the box inflated by margin + 0.5 * resolution
+        if (occupancy_index_ptr != nullptr) {
+            return occupancy_index_ptr->isOccupied(sfc.box_min, sfc.box_max,
+                                                   margin + 0.5 * param.world_resolution + SP_EPSILON_FLOAT);
+        }
+
         std::array<int, 3> sfc_size = {0, 0, 0};
         for (int i = 0; i < 3; i++) {
             sfc_size[i] =
                     (int) floor((sfc.box_max(i) - sfc.box_min(i) + SP_EPSILON_FLOAT) / param.world_resolution) + 1;
         }
 
+        DistmapQueryBatch batch;
+        batch.reserve(static_cast<size_t>(sfc_size[0]) * sfc_size[1] * sfc_size[2]);
         std::array<size_t, 3> iter = {0, 0, 0};
         for (iter[0] = 0; iter[0] < sfc_size[0]; iter[0]++) {
             for (iter[1] = 0; iter[1] < sfc_size[1]; iter[1]++) {
                 for (iter[2] = 0; iter[2] < sfc_size[2]; iter[2]++) {
-                    float dist;
-                    point3d search_point, closest_point;
+                    point3d search_point;
                     for (int i = 0; i < 3; i++) {
                         search_point(i) = sfc.box_min(i) + iter[i] * param.world_resolution;
                     }
-
-                    distmap_ptr->getDistanceAndClosestObstacle(search_point, dist, closest_point);
-                    Box closest_cell(closest_point - delta, closest_point + delta);
-                    closest_point = closest_cell.closestPoint(search_point);
-                    double dist_to_obs = LInfinityDistance(closest_point, search_point);
-                    if (dist_to_obs < margin + SP_EPSILON_FLOAT) {
-                        return true;
-                    }
+                    batch.push(search_point);
                 }
             }
         }
+        distmap_ptr->query(batch);
 
+        double min_dist = SP_INFINITY;
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (batch.obstacle_l_inf_distance[i] < margin + SP_EPSILON_FLOAT) {
+                return true;
+            }
+            min_dist = std::min(min_dist, static_cast<double>(batch.distance[i]));
+        }
+
+        // The L-infinity distance to any obstacle cell is at least dist / sqrt(3) - 0.5 * resolution.
+        // One more resolution is subtracted since the closest point of the box may not be a sampled point.
+        clearance = std::max(min_dist / sqrt(3) - 1.5 * param.world_resolution - margin - SP_EPSILON_FLOAT, 0.0);
         return false;
     }
 
     bool CollisionConstraints::isSFCInBoundary(const Box &sfc, double margin) {
-        return sfc.box_min.x() > mission.world_min.x() + margin - SP_EPSILON_FLOAT &&
-               sfc.box_min.y() > mission.world_min.y() + margin - SP_EPSILON_FLOAT &&
-               sfc.box_min.z() > mission.world_min.z() + margin - SP_EPSILON_FLOAT &&
-               sfc.box_max.x() < mission.world_max.x() - margin + SP_EPSILON_FLOAT &&
-               sfc.box_max.y() < mission.world_max.y() - margin + SP_EPSILON_FLOAT &&
-               sfc.box_max.z() < mission.world_max.z() - margin + SP_EPSILON_FLOAT;
+        return sfc.box_min.x() > mission->world_min.x() + margin - SP_EPSILON_FLOAT &&
+               sfc.box_min.y() > mission->world_min.y() + margin - SP_EPSILON_FLOAT &&
+               sfc.box_min.z() > mission->world_min.z() + margin - SP_EPSILON_FLOAT &&
+               sfc.box_max.x() < mission->world_max.x() - margin + SP_EPSILON_FLOAT &&
+               sfc.box_max.y() < mission->world_max.y() - margin + SP_EPSILON_FLOAT &&
+               sfc.box_max.z() < mission->world_max.z() - margin + SP_EPSILON_FLOAT;
     }
 
     bool CollisionConstraints::expandSFC(const Box &initial_sfc, double margin, Box &expanded_sfc) {
-        if (isObstacleInSFC(initial_sfc, margin)) {
+        return expandSFC(initial_sfc, std::vector<int>{0, 1, 2, 3, 4, 5}, margin, expanded_sfc);
+    }
+
+    bool CollisionConstraints::expandSFC(const Box &initial_sfc, const point3d &goal_point, double margin,
+                                         Box &expanded_sfc) {
+        return expandSFC(initial_sfc, setAxisCand(initial_sfc, goal_point), margin, expanded_sfc);
+    }
+
+    bool CollisionConstraints::expandSFC(const Box &initial_sfc, std::vector<int> axis_cand, double margin,
+                                         Box &expanded_sfc) {
+        SFCExpansion expansion;
+        if (not expandSFC(initial_sfc, std::move(axis_cand), margin, nullptr, expansion)) {
             return false;
         }
 
-        Box sfc, sfc_cand, sfc_update;
-        std::vector<int> axis_cand = {0, 1, 2, 3, 4, 5}; // -x, -y, -z, +x, +y, +z
+        commitSFCExpansion(expansion, margin);
+        expanded_sfc = expansion.sfc;
+        return true;
+    }
 
-        int i = -1;
-        int axis;
-        sfc = initial_sfc;
-        while (!axis_cand.empty()) {
-            // initialize boxes
-            sfc_cand = sfc;
-            sfc_update = sfc;
-
-            //check collision update_box only! box_current + box_update = box_cand
-            while (isSFCInBoundary(sfc_update, 0) && !isObstacleInSFC(sfc_update, margin)) {
-                i++;
-                if (i >= axis_cand.size()) {
-                    i = 0;
-                }
-                axis = axis_cand[i];
+    bool CollisionConstraints::expandSFC(const Box &initial_sfc, std::vector<int> axis_cand, double margin,
+                                         const std::atomic<bool> *cancel, SFCExpansion &expansion) {
+        double clearance;
+        if (isObstacleInSFC(initial_sfc, margin, clearance)) {
+            return false;
+        }
 
-                //update current box
-                sfc = sfc_cand;
-                sfc_update = sfc_cand;
-
-                //expand box_cand and get updated part of box (box_update)
-                if (axis < 3) {
-                    sfc_update.box_max(axis) = sfc_cand.box_min(axis);
-                    sfc_cand.box_min(axis) = sfc_cand.box_min(axis) - param.world_resolution;
-                    sfc_update.box_min(axis) = sfc_cand.box_min(axis);
-                } else {
-                    sfc_update.box_min(axis - 3) = sfc_cand.box_max(axis - 3);
-                    sfc_cand.box_max(axis - 3) = sfc_cand.box_max(axis - 3) + param.world_resolution;
-                    sfc_update.box_max(axis - 3) = sfc_cand.box_max(axis - 3);
-                }
-            }
-            // if obstacle is in box then do not expand box to the current axis direction
-            axis_cand.erase(axis_cand.begin() + i);
-            if (i > 0) {
-                i--;
-            } else {
-                i = axis_cand.size() - 1;
+        Box sfc;
+        expansion.grow_time = -1;
+        if (not findSFCInLibrary(initial_sfc, margin, sfc)) {
+            Timer timer;
+            timer.reset();
+            sfc = (this->*grow_sfc)(initial_sfc, std::move(axis_cand), margin, clearance, cancel);
+            timer.stop();
+            if (cancel != nullptr and cancel->load(std::memory_order_relaxed)) {
+                return false;
             }
+            expansion.grow_time = timer.elapsedSeconds();
         }
+        expansion.grown_sfc = sfc;
 
         //SFC margin compensation
         double delta = margin - ((int) (margin / param.world_resolution) * param.world_resolution);
         for (int k = 0; k < 3; k++) {
-            if (sfc.box_min(k) > mission.world_min(k) + SP_EPSILON_FLOAT) {
+            if (sfc.box_min(k) > mission->world_min(k) + SP_EPSILON_FLOAT) {
                 sfc.box_min(k) = sfc.box_min(k) - delta;
             }
-            if (sfc.box_max(k) < mission.world_max(k) - SP_EPSILON_FLOAT) {
+            if (sfc.box_max(k) < mission->world_max(k) - SP_EPSILON_FLOAT) {
                 sfc.box_max(k) = sfc.box_max(k) + delta;
             }
         }
 
-        expanded_sfc = sfc;
+        expansion.sfc = sfc;
         return true;
     }
 
-    bool CollisionConstraints::expandSFC(const Box &initial_sfc, const point3d &goal_point, double margin,
-                                         Box &expanded_sfc) {
-        if (isObstacleInSFC(initial_sfc, margin)) {
-            return false;
+    void CollisionConstraints::commitSFCExpansion(const SFCExpansion &expansion, double margin) {
+        if (param.world_sfc_library and expansion.grow_time >= 0) {
+            SFCLibrary::getInstance().insert(expansion.grown_sfc.box_min, expansion.grown_sfc.box_max, margin,
+                                             expansion.grow_time);
         }
+    }
 
-        Box sfc, sfc_cand, sfc_update;
-        std::vector<int> axis_cand = setAxisCand(initial_sfc, goal_point);  // -x, -y, -z, +x, +y, +z
-        // {0, 1, 2, 3, 4, 5};
+    CollisionConstraints::GrowSFCFunction CollisionConstraints::selectGrowSFC(int world_dimension) {
+        return world_dimension == 2 ? &CollisionConstraints::growSFC<2> : &CollisionConstraints::growSFC<3>;
+    }
 
-        int i = -1;
-        int axis;
-        sfc = initial_sfc;
-        while (!axis_cand.empty()) {
-            // initialize boxes
-            sfc_cand = sfc;
-            sfc_update = sfc;
-
-            //check collision update_box only! box_current + box_update = box_cand
-            while (isSFCInBoundary(sfc_update, 0) && !isObstacleInSFC(sfc_update, margin)) {
-                i++;
-                if (i >= axis_cand.size()) {
-                    i = 0;
+    template<int DIM>
+    Box CollisionConstraints::growSFC(const Box &initial_sfc, std::vector<int> axis_cand, double margin,
+                                      double initial_clearance, const std::atomic<bool> *cancel) {
+        // The axes of the planned dimensions only, z is not planned in 2D
+        if (DIM < 3) {
+            axis_cand.erase(std::remove_if(axis_cand.begin(), axis_cand.end(),
+                                           [](int axis) { return axis % 3 >= DIM; }), axis_cand.end());
+        }
+
+        // Boxes known to be collision-free, the last checked slab of each face inflated by its clearance.
+        // A slab inside one of them is not checked again, so the box jumps several voxels in free space.
+        point3d inflation(initial_clearance, initial_clearance, initial_clearance);
+        std::array<Box, 6> free_boxes;
+        free_boxes.fill(Box(initial_sfc.box_min - inflation, initial_sfc.box_max + inflation));
+        auto is_slab_free = [&](const Box &slab, int axis) {
+            for (const auto &free_box: free_boxes) {
+                if (free_box.include(slab)) {
+                    return true;
                 }
-                axis = axis_cand[i];
+            }
 
-                //update current box
-                sfc = sfc_cand;
-                sfc_update = sfc_cand;
-
-                //expand box_cand and get updated part of box (box_update)
-                if (axis < 3) {
-                    sfc_update.box_max(axis) = sfc_cand.box_min(axis);
-                    sfc_cand.box_min(axis) = sfc_cand.box_min(axis) - param.world_resolution;
-                    sfc_update.box_min(axis) = sfc_cand.box_min(axis);
-                } else {
-                    sfc_update.box_min(axis - 3) = sfc_cand.box_max(axis - 3);
-                    sfc_cand.box_max(axis - 3) = sfc_cand.box_max(axis - 3) + param.world_resolution;
-                    sfc_update.box_max(axis - 3) = sfc_cand.box_max(axis - 3);
+            double clearance;
+            if (isObstacleInSFC(slab, margin, clearance)) {
+                return false;
+            }
+            point3d slab_inflation(clearance, clearance, clearance);
+            free_boxes[axis] = Box(slab.box_min - slab_inflation, slab.box_max + slab_inflation);
+
+            // The primitives give the free sweep of the face up to the closest primitive ahead of it, so the
+            // face moves without a query until the other faces grow
+            if (primitive_world != nullptr) {
+                int k = axis % 3;
+                bool positive = axis >= 3;
+                double max_range = positive ? mission->world_max(k) - slab.box_max(k)
+                                            : slab.box_min(k) - mission->world_min(k);
+                double sweep = primitive_world->computeSweepDistance(slab.box_min, slab.box_max, k, positive,
+                                                                     margin + SP_EPSILON_FLOAT,
+                                                                     std::max(max_range, 0.0));
+                if (sweep > clearance) {
+                    Box swept_box = slab;
+                    if (positive) {
+                        swept_box.box_max(k) += sweep;
+                    } else {
+                        swept_box.box_min(k) -= sweep;
+                    }
+                    free_boxes[axis] = swept_box;
                 }
             }
-            // if obstacle is in box then do not expand box to the current axis direction
-            axis_cand.erase(axis_cand.begin() + i);
-            if (i > 0) {
-                i--;
+            return true;
+        };
+
+        // Grow one voxel at a time in the round-robin order of the axes, and check the new slab only.
+        // The axis is removed if its slab is blocked.
+        Box sfc = initial_sfc;
+        int i = -1;
+        while (not axis_cand.empty()) {
+            if (cancel != nullptr and cancel->load(std::memory_order_relaxed)) {
+                break;
+            }
+            i = (i + 1) % static_cast<int>(axis_cand.size());
+            int axis = axis_cand[i];
+
+            Box sfc_cand = sfc;
+            Box sfc_update = sfc;
+            if (axis < 3) {
+                sfc_update.box_max(axis) = sfc_cand.box_min(axis);
+                sfc_cand.box_min(axis) = sfc_cand.box_min(axis) - param.world_resolution;
+                sfc_update.box_min(axis) = sfc_cand.box_min(axis);
             } else {
-                i = axis_cand.size() - 1;
+                sfc_update.box_min(axis - 3) = sfc_cand.box_max(axis - 3);
+                sfc_cand.box_max(axis - 3) = sfc_cand.box_max(axis - 3) + param.world_resolution;
+                sfc_update.box_max(axis - 3) = sfc_cand.box_max(axis - 3);
             }
-        }
 
-        //SFC margin compensation
-        double delta = margin - ((int) (margin / param.world_resolution) * param.world_resolution);
-        for (int k = 0; k < 3; k++) {
-            if (sfc.box_min(k) > mission.world_min(k) + SP_EPSILON_FLOAT) {
-                sfc.box_min(k) = sfc.box_min(k) - delta;
-            }
-            if (sfc.box_max(k) < mission.world_max(k) - SP_EPSILON_FLOAT) {
-                sfc.box_max(k) = sfc.box_max(k) + delta;
+            if (isSFCInBoundary(sfc_update, 0) and is_slab_free(sfc_update, axis)) {
+                sfc = sfc_cand;
+            } else {
+                axis_cand.erase(axis_cand.begin() + i);
+                i--;
             }
         }
 
-        expanded_sfc = sfc;
-        return true;
+        return sfc;
     }
 
-    points_t CollisionConstraints::findFeasibleVertices(int m, int control_point_idx) const {
-        // Use brute force method to find vertices of feasible region
-        LSCs lc;
-
-        // LSC
-        for (size_t oi = 0; oi < lscs.size(); oi++) {
-            if (isDynamicObstacle(oi)) {
-                continue;
-            }
-            lc.emplace_back(lscs[oi][m][control_point_idx]);
+    bool CollisionConstraints::findSFCInLibrary(const Box &initial_sfc, double margin, Box &sfc) {
+        if (not param.world_sfc_library) {
+            return false;
         }
 
-        // SFC
+        // The cached box may be grown by another agent, validate it with the map of this agent
+        auto is_valid = [this, margin](const point3d &box_min, const point3d &box_max) {
+            Box box(box_min, box_max);
+            return isSFCInBoundary(box, 0) and not isObstacleInSFC(box, margin);
+        };
+        return SFCLibrary::getInstance().find(initial_sfc.box_min, initial_sfc.box_max, margin, is_valid,
+                                              sfc.box_min, sfc.box_max);
+    }
+
+    FeasibleRegion CollisionConstraints::findFeasibleRegion(int m, int control_point_idx) const {
+        // Clip the bounding box by the half-spaces one by one, the box of the SFC is the initial polytope
+        FeasibleRegion feasible_region;
         if (param.world_use_octomap) {
-            LSCs lsc_sfc = sfcs[m].convertToLSCs(3);
-            for (const auto &lsc: lsc_sfc) {
-                lc.emplace_back(lsc);
-            }
+            feasible_region.reset(sfcs[m].box_min, sfcs[m].box_max);
         } else {
-            Box sfc_world_boundary(mission.world_min, mission.world_max);
-            LSCs lscs_world_boundary = sfc_world_boundary.convertToLSCs(3);
-            for (const auto &lsc: lscs_world_boundary) {
-                lc.emplace_back(lsc);
-            }
+            feasible_region.reset(mission->world_min, mission->world_max);
         }
 
         // Communication range
         if(param.communication_range > 0){
             LSCs lscs_communication_range = communication_range.convertToLSCs(3);
             for (const auto &lsc: lscs_communication_range) {
-                lc.emplace_back(lsc);
+                feasible_region.addHalfSpace(lsc.normal_vector, lsc.obs_control_point.dot(lsc.normal_vector) + lsc.d);
             }
         }
 
-        points_t vertices;
-        size_t N = lc.size();
-        for (size_t i = 0; i < N; i++) {
-            for (size_t j = i + 1; j < N; j++) {
-                for (size_t k = j + 1; k < N; k++) {
-                    Eigen::Matrix3f A;
-                    A << lc[i].normal_vector(0), lc[i].normal_vector(1), lc[i].normal_vector(2),
-                         lc[j].normal_vector(0), lc[j].normal_vector(1), lc[j].normal_vector(2),
-                         lc[k].normal_vector(0), lc[k].normal_vector(1), lc[k].normal_vector(2);
-                    Eigen::Vector3f b;
-                    b << lc[i].obs_control_point.dot(lc[i].normal_vector) + lc[i].d,
-                         lc[j].obs_control_point.dot(lc[j].normal_vector) + lc[j].d,
-                         lc[k].obs_control_point.dot(lc[k].normal_vector) + lc[k].d;
-
-                    Eigen::Vector3f x = A.householderQr().solve(b);
-                    double relative_error = (A * x - b).norm() / b.norm();
-                    if (relative_error < SP_EPSILON_FLOAT) {
-                        point3d point(x(0), x(1), x(2));
-                        bool feasible_point = true;
-                        for (size_t ci = 0; ci < N; ci++) {
-                            if ((point - lc[ci].obs_control_point).dot(lc[ci].normal_vector) - lc[ci].d <
-                                -SP_EPSILON_FLOAT) {
-                                feasible_point = false;
-                                continue;
-                            }
-                        }
-
-                        if (feasible_point) {
-                            vertices.emplace_back(point);
-                        }
-                    }
-                }
+        // LSC
+        for (size_t oi = 0; oi < lscs.size() and not feasible_region.isEmpty(); oi++) {
+            if (isDynamicObstacle(oi)) {
+                continue;
             }
+            LSC lsc = lscs.get(oi, m, control_point_idx);
+            feasible_region.addHalfSpace(lsc.normal_vector, lsc.obs_control_point.dot(lsc.normal_vector) + lsc.d);
         }
 
-        return vertices;
+        return feasible_region;
     }
 
 //    visualization_msgs::Marker CollisionConstraints::convexHullToMarkerMsg(const points_t& convex_hull,
@@ -1073,9 +1592,9 @@ namespace DynamicPlanning {
 //        return msg_marker;
 //    }
 
-    visualization_msgs::Marker CollisionConstraints::convexHullToMarkerMsg(const points_t &convex_hull,
-                                                                           const std_msgs::ColorRGBA &color,
-                                                                           const std::string &world_frame_id) {
+    visualization_msgs::Marker CollisionConstraints::feasibleRegionToMarkerMsg(const FeasibleRegion &feasible_region,
+                                                                               const std_msgs::ColorRGBA &color,
+                                                                               const std::string &world_frame_id) {
         visualization_msgs::Marker msg_marker;
         msg_marker.header.frame_id = world_frame_id;
         msg_marker.type = visualization_msgs::Marker::TRIANGLE_LIST;
@@ -1088,46 +1607,14 @@ namespace DynamicPlanning {
         std_msgs::ColorRGBA mesh_color = color;
         mesh_color.a = 0.2;
 
-
-        if (convex_hull.empty()) {
-            return msg_marker;
-        }
-
-        size_t nVertices = convex_hull.size();
-        ch_vertex *vertices;
-        vertices = (ch_vertex *) malloc(nVertices * sizeof(ch_vertex));
-        for (size_t i = 0; i < nVertices; i++) {
-            vertices[i].x = convex_hull[i].x();
-            vertices[i].y = convex_hull[i].y();
-            vertices[i].z = convex_hull[i].z();
-        }
-
-        int *faceIndices = NULL;
-        int nFaces;
-        convhull_3d_build(vertices, nVertices, &faceIndices, &nFaces);
-        /* Where 'faceIndices' is a flat 2D matrix [nFaces x 3] */
-
-        for (int i = 0; i < nFaces; i++) {
-            auto vertex1 = vertices[faceIndices[i * 3]];
-            auto vertex2 = vertices[faceIndices[i * 3 + 1]];
-            auto vertex3 = vertices[faceIndices[i * 3 + 2]];
-
-            point3d point1(vertex1.x, vertex1.y, vertex1.z);
-            point3d point2(vertex2.x, vertex2.y, vertex2.z);
-            point3d point3(vertex3.x, vertex3.y, vertex3.z);
-
-            geometry_msgs::Point pointmsg1 = point3DToPointMsg(point1);
-            geometry_msgs::Point pointmsg2 = point3DToPointMsg(point2);
-            geometry_msgs::Point pointmsg3 = point3DToPointMsg(point3);
-
-            msg_marker.points.emplace_back(pointmsg1);
-            msg_marker.points.emplace_back(pointmsg2);
-            msg_marker.points.emplace_back(pointmsg3);
+        // The faces are given by the planes of the vertices, no convex hull is needed
+        for (const auto &triangle: feasible_region.getTriangles()) {
+            for (const auto &point: triangle) {
+                msg_marker.points.emplace_back(point3DToPointMsg(point));
+            }
             msg_marker.colors.emplace_back(mesh_color);
         }
 
-        free(vertices);
-        free(faceIndices);
         return msg_marker;
     }
 
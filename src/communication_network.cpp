@@ -0,0 +1,82 @@
+#include <communication_network.hpp>
+#include <algorithm>
+#include <cmath>
+#include <metrics_registry.hpp>
+
+namespace DynamicPlanning {
+    CommunicationNetwork::CommunicationNetwork(const Param &param, size_t n_agents, uint64_t seed)
+            : time_step(param.multisim_time_step), latency(param.communication_latency),
+              latency_jitter(param.communication_latency_jitter), bandwidth(param.communication_bandwidth),
+              packet_loss(param.communication_packet_loss) {
+        random_streams.reserve(n_agents);
+        for (size_t qi = 0; qi < n_agents; qi++) {
+            random_streams.emplace_back(seed, RandomStream::NETWORK, static_cast<uint32_t>(qi));
+        }
+        uplink_free_times.assign(n_agents, 0);
+
+        // A packet waits at most a step on the uplink, the transmission of one packet is not bounded
+        int max_delay_steps = static_cast<int>(std::ceil((latency + latency_jitter) / time_step)) + 2;
+        buckets.resize(max_delay_steps + 1);
+        inboxes.resize(n_agents);
+    }
+
+    bool CommunicationNetwork::send(int step, Packet &&packet) {
+        statistics.n_sent++;
+        RandomStream &random_stream = random_streams[packet.sender];
+        if (packet_loss > 0 and random_stream.nextUniform() < packet_loss) {
+            static MetricCounter &packets_lost = MetricsRegistry::getInstance().getCounter(
+                    "lsc_network_packets_lost_total", "Simulated packets dropped by communication/packet_loss");
+            packets_lost.increment();
+            statistics.n_lost++;
+            return false;
+        }
+
+        double send_time = step * time_step;
+        double arrival_time = send_time;
+        if (bandwidth > 0) {
+            double &uplink_free_time = uplink_free_times[packet.sender];
+            double transmission_start_time = std::max(uplink_free_time, send_time);
+            if (transmission_start_time - send_time > time_step) {
+                static MetricCounter &packets_congested = MetricsRegistry::getInstance().getCounter(
+                        "lsc_network_packets_congested_total",
+                        "Simulated packets dropped since the uplink of the sender was busy for more than a step");
+                packets_congested.increment();
+                statistics.n_congested++;
+                return false;
+            }
+            uplink_free_time = transmission_start_time + static_cast<double>(packet.bytes) / bandwidth;
+            arrival_time = uplink_free_time;
+        }
+        arrival_time += latency;
+        if (latency_jitter > 0) {
+            arrival_time += latency_jitter * random_stream.nextUniform();
+        }
+
+        // The first step at or after the arrival, the bandwidth may postpone a long packet beyond the buckets
+        int delivery_step = std::max(step, static_cast<int>(std::ceil(arrival_time / time_step - SP_EPSILON)));
+        delivery_step = std::min(delivery_step, step + getMaxDelaySteps());
+        packet.send_step = step;
+        buckets[delivery_step % buckets.size()].emplace_back(std::move(packet));
+        return true;
+    }
+
+    void CommunicationNetwork::deliver(int step) {
+        for (uint32_t receiver: delivered_receivers) {
+            inboxes[receiver].clear();
+        }
+        delivered_receivers.clear();
+
+        std::vector<Packet> &bucket = buckets[step % buckets.size()];
+        for (Packet &packet: bucket) {
+            statistics.n_delivered++;
+            statistics.delivered_bytes += packet.bytes;
+            statistics.delivered_delay_steps += step - packet.send_step;
+            std::vector<Packet> &inbox = inboxes[packet.receiver];
+            if (inbox.empty()) {
+                delivered_receivers.emplace_back(packet.receiver);
+            }
+            inbox.emplace_back(std::move(packet));
+        }
+        bucket.clear();
+    }
+}
@@ -0,0 +1,152 @@
+#include <cpu_topology.hpp>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace DynamicPlanning {
+    // The list format of the kernel, e.g. "0-3,8-11"
+    static std::vector<int> parseCPUList(const std::string &cpu_list) {
+        std::vector<int> cpus;
+        std::stringstream ss(cpu_list);
+        std::string range;
+        while (std::getline(ss, range, ',')) {
+            try {
+                size_t dash = range.find('-');
+                int first = std::stoi(range.substr(0, dash));
+                int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                for (int cpu = first; cpu <= last; cpu++) {
+                    cpus.emplace_back(cpu);
+                }
+            } catch (const std::exception &) {
+                continue;
+            }
+        }
+        return cpus;
+    }
+
+    const CPUTopology &CPUTopology::getInstance() {
+        static CPUTopology topology;
+        return topology;
+    }
+
+    CPUTopology::CPUTopology() {
+        // The mask of the thread at the first use, before the workers are pinned
+#ifdef __linux__
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &cpu_set)) {
+                    allowed_cpus.emplace_back(cpu);
+                }
+            }
+        }
+#endif
+        if (allowed_cpus.empty()) {
+            int n_cpus = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+            for (int cpu = 0; cpu < n_cpus; cpu++) {
+                allowed_cpus.emplace_back(cpu);
+            }
+        }
+
+        // The nodes without an allowed CPU are left out
+        for (int node = 0;; node++) {
+            std::ifstream ifs("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            if (not ifs) {
+                break;
+            }
+            std::string cpu_list;
+            std::getline(ifs, cpu_list);
+            std::vector<int> cpus;
+            for (int cpu: parseCPUList(cpu_list)) {
+                if (std::binary_search(allowed_cpus.begin(), allowed_cpus.end(), cpu)) {
+                    cpus.emplace_back(cpu);
+                }
+            }
+            if (not cpus.empty()) {
+                node_cpus.emplace_back(cpus);
+            }
+        }
+        if (node_cpus.empty()) {
+            node_cpus.emplace_back(allowed_cpus);
+        }
+    }
+
+    size_t CPUTopology::getNumCPUs() const {
+        return allowed_cpus.size();
+    }
+
+    int CPUTopology::getNodeOfCPU(int cpu) const {
+        for (size_t node = 0; node < node_cpus.size(); node++) {
+            if (std::find(node_cpus[node].begin(), node_cpus[node].end(), cpu) != node_cpus[node].end()) {
+                return static_cast<int>(node);
+            }
+        }
+        return -1;
+    }
+
+    std::vector<int> CPUTopology::getPlacement(ThreadPlacementMode mode, size_t n_threads) const {
+        std::vector<int> placement;
+        if (mode == ThreadPlacementMode::NONE) {
+            return placement;
+        }
+
+        placement.resize(n_threads);
+        if (mode == ThreadPlacementMode::COMPACT) {
+            std::vector<int> cpus;
+            for (const auto &node: node_cpus) {
+                cpus.insert(cpus.end(), node.begin(), node.end());
+            }
+            for (size_t i = 0; i < n_threads; i++) {
+                placement[i] = cpus[i % cpus.size()];
+            }
+        } else {
+            size_t n_nodes = node_cpus.size();
+            for (size_t i = 0; i < n_threads; i++) {
+                const std::vector<int> &cpus = node_cpus[i % n_nodes];
+                placement[i] = cpus[(i / n_nodes) % cpus.size()];
+            }
+        }
+        return placement;
+    }
+
+    bool CPUTopology::pinThread(std::thread::native_handle_type thread, int cpu) {
+#ifdef __linux__
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        if (cpu >= 0) {
+            CPU_SET(cpu, &cpu_set);
+        } else {
+            for (int allowed_cpu: getInstance().allowed_cpus) {
+                CPU_SET(allowed_cpu, &cpu_set);
+            }
+        }
+        return pthread_setaffinity_np(thread, sizeof(cpu_set), &cpu_set) == 0;
+#else
+        return false;
+#endif
+    }
+
+    bool CPUTopology::parsePlacementMode(const std::string &str, ThreadPlacementMode &mode) {
+        if (str == "none") {
+            mode = ThreadPlacementMode::NONE;
+        } else if (str == "compact") {
+            mode = ThreadPlacementMode::COMPACT;
+        } else if (str == "spread") {
+            mode = ThreadPlacementMode::SPREAD;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    std::string CPUTopology::getPlacementModeStr(ThreadPlacementMode mode) {
+        const std::string placement_mode_strs[] = {"none", "compact", "spread"};
+        return placement_mode_strs[static_cast<int>(mode)];
+    }
+}
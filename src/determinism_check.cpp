@@ -0,0 +1,343 @@
+#include <multi_sync_simulator.hpp>
+#include <planning_capture.hpp>
+#include <boost/program_options.hpp>
+#include <iostream>
+
+using namespace DynamicPlanning;
+namespace po = boost::program_options;
+
+// Verification of the parallel execution paths of the simulator.
+// The mission runs twice in lockstep in this process, once with the serial engine and once with the parameters as
+// given, e.g. with the parallel planning, the pipelined step, the batched QPs or the concurrent MAPF. After each step
+// the states, the goals, the planner sequences and the trajectories of the agents are compared, and the runs stop at
+// the first step where they differ by more than the tolerance. Both runs are captured as for planning_replay, and the
+// cycles of each agent are compared in its planning order to find the first divergent cycle and its stage: the
+// decision to plan or hold, the state of the agent, the goal and the waypoint of the MAPF, the obstacles given by the
+// exchange, or the output of the planner if all inputs are the same.
+// The SFC library is disabled in both runs, since the second run would reuse the boxes of the first one.
+// rosrun lsc_dr_planner determinism_check --param_ns /multi_sync_simulator_node --mission default.json
+struct Divergence {
+    bool found = false;
+    int sim_step = -1; // the step after which the lockstep comparison failed, -1 if it did not fail
+    int agent = -1;
+    int cycle = -1; // the index of the planning cycle of the agent in the captures, -1 if the captures are the same
+    double sim_time = -1; // [s], the sim time of the cycle
+    std::string stage;
+    double deviation = 0; // [m], infinity if the structures or the decisions differ
+};
+
+// The parallel options of the simulator and the planners are off, the solver threads are the same in both runs
+static void setSerialParam(Param &param) {
+    param.multisim_batch_optimization = false;
+    param.multisim_batch_qp = false;
+    param.multisim_parallel_planning = false;
+    param.multisim_parallel_mapf = false;
+    param.multisim_pipelined_step = false;
+    param.multisim_sticky_agents = false;
+    param.grid_mapf_parallel = false;
+    param.parallel_lsc_threshold = 0;
+    param.world_sfc_parallel_candidates = false;
+    param.world_async_map_merge = false;
+}
+
+// The largest distance between the control points, infinity if the structures differ
+static double getTrajDeviation(const traj_t &traj, const traj_t &other_traj) {
+    if (traj.size() != other_traj.size()) {
+        return SP_INFINITY;
+    }
+    double deviation = 0;
+    for (int m = 0; m < traj.size(); m++) {
+        if (traj[m].control_points.size() != other_traj[m].control_points.size()) {
+            return SP_INFINITY;
+        }
+        for (size_t i = 0; i < traj[m].control_points.size(); i++) {
+            deviation = std::max(deviation, static_cast<double>((traj[m][i] - other_traj[m][i]).norm()));
+        }
+    }
+    return deviation;
+}
+
+static double getMaxDifference(const std::vector<double> &values, const std::vector<double> &other_values,
+                               size_t begin, size_t size) {
+    double difference = 0;
+    for (size_t i = begin; i < begin + size; i++) {
+        difference = std::max(difference, std::abs(values[i] - other_values[i]));
+    }
+    return difference;
+}
+
+// The first agent whose buffers differ by more than the tolerance, with the field, false if none
+static bool compareStateBuffers(const AgentStateBuffers &buffers, const AgentStateBuffers &other_buffers,
+                                double tolerance, Divergence &divergence) {
+    if (buffers.n_agents != other_buffers.n_agents or buffers.n_control_points != other_buffers.n_control_points) {
+        divergence.stage = "simulator: the structure of the agents";
+        divergence.deviation = SP_INFINITY;
+        return true;
+    }
+
+    const std::vector<std::pair<const std::vector<double> AgentStateBuffers::*, const char *>> fields = {
+            {&AgentStateBuffers::positions,     "simulator: position"},
+            {&AgentStateBuffers::velocities,    "simulator: velocity"},
+            {&AgentStateBuffers::accelerations, "simulator: acceleration"},
+            {&AgentStateBuffers::goal_points,   "simulator: goal"},
+    };
+    for (size_t qi = 0; qi < buffers.n_agents; qi++) {
+        divergence.agent = static_cast<int>(qi);
+        if (buffers.planner_seqs[qi] != other_buffers.planner_seqs[qi]) {
+            divergence.stage = "simulator: planner sequence";
+            divergence.deviation = SP_INFINITY;
+            return true;
+        }
+        for (const auto &field: fields) {
+            divergence.deviation = getMaxDifference(buffers.*field.first, other_buffers.*field.first, 3 * qi, 3);
+            if (divergence.deviation > tolerance) {
+                divergence.stage = field.second;
+                return true;
+            }
+        }
+        size_t n_values = 3 * buffers.n_control_points;
+        divergence.deviation = getMaxDifference(buffers.control_points, other_buffers.control_points,
+                                                n_values * qi, n_values);
+        if (divergence.deviation > tolerance) {
+            divergence.stage = "simulator: trajectory";
+            return true;
+        }
+    }
+    divergence.agent = -1;
+    divergence.deviation = 0;
+    return false;
+}
+
+// The PLAN and HOLD records of each agent in its planning order
+static bool readCycles(const std::string &file_name, size_t n_agents,
+                       std::vector<std::vector<PlanningCapture::Record>> &cycles) {
+    PlanningCaptureReader reader;
+    if (not reader.open(file_name)) {
+        return false;
+    }
+    cycles.assign(n_agents, {});
+    PlanningCapture::Record record;
+    while (reader.readRecord(record)) {
+        if (record.type != PlanningCapture::RecordType::PARAM and record.agent.id >= 0 and
+            static_cast<size_t>(record.agent.id) < n_agents) {
+            cycles[record.agent.id].emplace_back(record);
+        }
+    }
+    return true;
+}
+
+// The first stage of the cycle whose inputs or output differ by more than the tolerance, false if none
+static bool compareCycles(const PlanningCapture::Record &record, const PlanningCapture::Record &other_record,
+                          double tolerance, std::string &stage, double &deviation) {
+    deviation = SP_INFINITY;
+    if (record.type != other_record.type) {
+        stage = "planning decision: plan or hold";
+        return true;
+    }
+    if (std::abs((record.sim_time - other_record.sim_time).toSec()) > SP_EPSILON_FLOAT or
+        record.is_disturbed != other_record.is_disturbed) {
+        stage = "input: sim time or disturbance";
+        return true;
+    }
+
+    const State &state = record.agent.current_state;
+    const State &other_state = other_record.agent.current_state;
+    deviation = std::max({(state.position - other_state.position).norm(),
+                          (state.velocity - other_state.velocity).norm(),
+                          (state.acceleration - other_state.acceleration).norm()});
+    if (deviation > tolerance) {
+        stage = "input: agent state";
+        return true;
+    }
+    deviation = std::max((record.agent.current_goal_point - other_record.agent.current_goal_point).norm(),
+                         (record.agent.next_waypoint - other_record.agent.next_waypoint).norm());
+    if (deviation > tolerance) {
+        stage = "input: goal and waypoint";
+        return true;
+    }
+
+    deviation = SP_INFINITY;
+    if (record.obstacles.size() != other_record.obstacles.size()) {
+        stage = "input: number of obstacles";
+        return true;
+    }
+    for (size_t oi = 0; oi < record.obstacles.size(); oi++) {
+        const Obstacle &obstacle = record.obstacles[oi];
+        const Obstacle &other_obstacle = other_record.obstacles[oi];
+        if (obstacle.id != other_obstacle.id or obstacle.type != other_obstacle.type) {
+            stage = "input: obstacle " + std::to_string(oi) + " identity";
+            deviation = SP_INFINITY;
+            return true;
+        }
+        deviation = std::max({static_cast<double>((obstacle.position - other_obstacle.position).norm()),
+                              static_cast<double>((obstacle.velocity - other_obstacle.velocity).norm()),
+                              getTrajDeviation(obstacle.getPrevTraj(), other_obstacle.getPrevTraj())});
+        if (deviation > tolerance) {
+            stage = "input: obstacle " + std::to_string(obstacle.id);
+            return true;
+        }
+    }
+
+    deviation = getTrajDeviation(record.traj, other_record.traj);
+    if (deviation > tolerance) {
+        stage = "planner: output trajectory";
+        return true;
+    }
+    return false;
+}
+
+// The earliest divergent cycle over the agents, the lowest agent first at the same sim time
+static bool compareCaptures(const std::string &file_name, const std::string &other_file_name, size_t n_agents,
+                            double tolerance, Divergence &divergence) {
+    std::vector<std::vector<PlanningCapture::Record>> cycles, other_cycles;
+    if (not readCycles(file_name, n_agents, cycles) or not readCycles(other_file_name, n_agents, other_cycles)) {
+        ROS_ERROR("[DeterminismCheck] Fail to read the captures");
+        return false;
+    }
+
+    bool found = false;
+    for (size_t qi = 0; qi < n_agents; qi++) {
+        size_t n_cycles = std::min(cycles[qi].size(), other_cycles[qi].size());
+        for (size_t ci = 0; ci < n_cycles; ci++) {
+            std::string stage;
+            double deviation;
+            if (not compareCycles(cycles[qi][ci], other_cycles[qi][ci], tolerance, stage, deviation)) {
+                continue;
+            }
+            double sim_time = cycles[qi][ci].sim_time.toSec();
+            if (not found or sim_time < divergence.sim_time) {
+                found = true;
+                divergence.agent = static_cast<int>(qi);
+                divergence.cycle = static_cast<int>(ci);
+                divergence.sim_time = sim_time;
+                divergence.stage = stage;
+                divergence.deviation = deviation;
+            }
+            break;
+        }
+    }
+    return found;
+}
+
+int main(int argc, char *argv[]) {
+    ros::init(argc, argv, "determinism_check", ros::init_options::AnonymousName);
+    ros::NodeHandle nh("~");
+
+    po::options_description desc("Options");
+    desc.add_options()
+            ("help,h", "print this message")
+            ("param_ns,p", po::value<std::string>()->default_value("~"), "namespace of the parameters")
+            ("mission,m", po::value<std::string>(), "mission file in missions/, overrides mission")
+            ("world,w", po::value<std::string>(), "world file in world/, overrides world/file_name")
+            ("tolerance,t", po::value<double>()->default_value(1e-6),
+             "[m], the largest difference of the states and the control points taken as the same")
+            ("max_steps,s", po::value<int>()->default_value(0), "compare at most this many steps, 0: the mission");
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+    } catch (const po::error &e) {
+        ROS_ERROR_STREAM("[DeterminismCheck] " << e.what());
+        return -1;
+    }
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    double tolerance = vm["tolerance"].as<double>();
+    int max_steps = vm["max_steps"].as<int>();
+
+    ros::NodeHandle nh_param(vm["param_ns"].as<std::string>());
+    Param param;
+    if (not param.initialize(nh_param)) {
+        ROS_ERROR("[DeterminismCheck] Invalid parameter");
+        return -1;
+    }
+    param.multisim_headless = true;
+    param.multisim_trace = false;
+    param.multisim_capture = true;
+    param.world_sfc_library = false;
+    if (not param.validateMultisim()) {
+        ROS_ERROR("[DeterminismCheck] Invalid multisim parameter");
+        return -1;
+    }
+    if (param.multisim_replay or param.multisim_num_processes > 1) {
+        ROS_ERROR("[DeterminismCheck] The replay and the distributed simulation are not supported");
+        return -1;
+    }
+    Param serial_param = param;
+    setSerialParam(serial_param);
+    serial_param.multisim_capture_file = param.package_path + "/log/determinism_serial.bin";
+    param.multisim_capture_file = param.package_path + "/log/determinism_parallel.bin";
+
+    Mission mission(vm.count("mission") ? vm["mission"].as<std::string>() :
+                    nh_param.param<std::string>("mission", "default.json"),
+                    vm.count("world") ? vm["world"].as<std::string>() :
+                    nh_param.param<std::string>("world/file_name", "default.bt"));
+    if (not mission.loadMission(param.multisim_max_noise, param.world_dimension, param.world_z_2d) or
+        mission.qn == 0) {
+        ROS_ERROR("[DeterminismCheck] Invalid mission");
+        return -1;
+    }
+
+    // The captures are closed with the simulators at the end of the scope
+    Divergence divergence;
+    int n_steps = 0;
+    {
+        MultiSyncSimulator serial_simulator(nh, serial_param, mission);
+        MultiSyncSimulator parallel_simulator(nh, param, mission);
+        while (ros::ok() and (max_steps == 0 or n_steps < max_steps)) {
+            bool is_serial_running = serial_simulator.step();
+            bool is_parallel_running = parallel_simulator.step();
+            n_steps++;
+
+            if (compareStateBuffers(serial_simulator.getAgentStateBuffers(),
+                                    parallel_simulator.getAgentStateBuffers(), tolerance, divergence)) {
+                divergence.found = true;
+            } else if (is_serial_running != is_parallel_running or
+                       serial_simulator.getSimStep() != parallel_simulator.getSimStep()) {
+                divergence.found = true;
+                divergence.stage = "simulator: end of the mission";
+                divergence.deviation = SP_INFINITY;
+            } else if (not is_serial_running and
+                       serial_simulator.isMissionSucceeded() != parallel_simulator.isMissionSucceeded()) {
+                divergence.found = true;
+                divergence.stage = "simulator: result of the mission";
+                divergence.deviation = SP_INFINITY;
+            }
+            if (divergence.found) {
+                divergence.sim_step = serial_simulator.getSimStep();
+                break;
+            }
+            if (not is_serial_running) {
+                break;
+            }
+        }
+    }
+
+    // The cycles give the stage of the divergence, if it is in the inputs or the outputs of a planner
+    if (compareCaptures(serial_param.multisim_capture_file, param.multisim_capture_file, mission.qn, tolerance,
+                        divergence)) {
+        divergence.found = true;
+    }
+
+    if (not divergence.found) {
+        std::cout << "Deterministic: " << n_steps << " steps of " << mission.qn << " agents are the same within "
+                  << tolerance << " m" << std::endl;
+        return 0;
+    }
+    std::cout << "First divergence";
+    if (divergence.sim_step >= 0) {
+        std::cout << " after the step " << divergence.sim_step;
+    }
+    if (divergence.agent >= 0) {
+        std::cout << ", agent " << divergence.agent;
+    }
+    if (divergence.cycle >= 0) {
+        std::cout << ", planning cycle " << divergence.cycle << " at " << divergence.sim_time << " s";
+    }
+    std::cout << ", stage: " << divergence.stage << ", deviation [m]: " << divergence.deviation << std::endl;
+    std::cout << "Captures: " << serial_param.multisim_capture_file << " (serial), " << param.multisim_capture_file
+              << " (parallel), replay them by planning_replay" << std::endl;
+    return 1;
+}
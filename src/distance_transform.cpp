@@ -0,0 +1,54 @@
+#include <distance_transform.hpp>
+#include <algorithm>
+
+namespace DynamicPlanning {
+    void DistanceTransformLine::resize(int n) {
+        if (static_cast<int>(f.size()) >= n) {
+            return;
+        }
+        f.resize(n);
+        sq_dists.resize(n);
+        args.resize(n);
+        envelope_v.resize(n);
+        envelope_z.resize(n + 1);
+    }
+
+    // Lower envelope of the parabolas f[p] + (q - p)^2 of the finite entries
+    void DistanceTransformLine::transform(int n) {
+        int k = -1;
+        for (int q = 0; q < n; q++) {
+            if (f[q] == INFINITE_SQ_DIST) {
+                continue;
+            }
+
+            double s = 0;
+            while (k >= 0) {
+                int p = envelope_v[k];
+                s = (static_cast<double>(f[q]) + q * q - f[p] - p * p) / (2.0 * (q - p));
+                if (s > envelope_z[k]) {
+                    break;
+                }
+                k--;
+            }
+            k++;
+            envelope_v[k] = q;
+            envelope_z[k] = k == 0 ? -std::numeric_limits<double>::infinity() : s;
+            envelope_z[k + 1] = std::numeric_limits<double>::infinity();
+        }
+
+        if (k < 0) {
+            std::fill(args.begin(), args.begin() + n, -1);
+            return;
+        }
+
+        k = 0;
+        for (int q = 0; q < n; q++) {
+            while (envelope_z[k + 1] < q) {
+                k++;
+            }
+            int p = envelope_v[k];
+            sq_dists[q] = f[p] + (q - p) * (q - p);
+            args[q] = p;
+        }
+    }
+}
@@ -0,0 +1,158 @@
+#include <fallback_planner.hpp>
+#include <feasibility_checker.hpp>
+#include <planning_deadline.hpp>
+#include <worker_pool.hpp>
+#include <algorithm>
+#include <atomic>
+
+namespace DynamicPlanning {
+    FallbackPlanner::FallbackPlanner(const Param &_param) : param(_param) {}
+
+    void FallbackPlanner::updateParam(const Param &_param) {
+        param = _param;
+    }
+
+    FallbackResult FallbackPlanner::plan(const Agent &agent, const CollisionConstraints &constraints,
+                                         const traj_t &initial_traj, double budget, traj_t &fallback_traj) {
+        PlanningDeadline deadline(budget);
+        sampleCandidates(agent, initial_traj);
+
+        // The first control point is the current position, which the candidates can not change
+        int M = initial_traj.size();
+        costs.assign(candidates.size(), SP_INFINITY);
+        std::atomic<int> n_checked{0};
+        WorkerPool::getInstance().run(candidates.size(), [&](size_t ci) {
+            if (deadline.isExpired()) {
+                return;
+            }
+            n_checked++;
+
+            const traj_t &candidate = candidates[ci];
+            if (not isDynamicallyFeasible(agent, candidate)) {
+                return;
+            }
+            FeasibilityChecker feasibility_checker(M, param.n);
+            feasibility_checker.setTrajectory(candidate);
+            if (param.world_use_octomap and feasibility_checker.checkSFCs(constraints, 1).isViolated()) {
+                return;
+            }
+            if (feasibility_checker.checkLSCs(constraints, param.world_dimension, 1, false,
+                                              SP_EPSILON_FLOAT).isViolated()) {
+                return;
+            }
+            costs[ci] = candidate.lastPoint().distance(agent.current_goal_point);
+        });
+
+        FallbackResult result;
+        result.n_checked = n_checked.load();
+        auto best_it = std::min_element(costs.begin(), costs.end());
+        if (best_it != costs.end() and *best_it < SP_INFINITY) {
+            result.is_feasible = true;
+            result.cost = *best_it;
+            fallback_traj = candidates[best_it - costs.begin()];
+        }
+        return result;
+    }
+
+    void FallbackPlanner::sampleCandidates(const Agent &agent, const traj_t &initial_traj) {
+        int M = initial_traj.size();
+        candidates.clear();
+        candidates.emplace_back(initial_traj);
+        if (param.n < 3) {
+            // The primitives are cubic
+            return;
+        }
+
+        // Escape directions, the world axes and the perpendiculars of the velocity in the xy-plane
+        std::vector<point3d> directions = {point3d(0, 0, 0),
+                                           point3d(1, 0, 0), point3d(-1, 0, 0),
+                                           point3d(0, 1, 0), point3d(0, -1, 0)};
+        if (param.world_dimension == 3) {
+            directions.emplace_back(0, 0, 1);
+            directions.emplace_back(0, 0, -1);
+        }
+        point3d velocity = agent.current_state.velocity;
+        velocity.z() = 0;
+        if (velocity.norm() > SP_EPSILON_FLOAT) {
+            point3d perpendicular = velocity.cross(point3d(0, 0, 1)).normalized();
+            directions.emplace_back(perpendicular);
+            directions.emplace_back(-perpendicular);
+        }
+
+        // The stopping point of the constant deceleration, moved by the offsets
+        traj_t candidate;
+        for (int n_stop_segments = 1; n_stop_segments <= M; n_stop_segments++) {
+            double stop_time = n_stop_segments * param.dt;
+            point3d stop_point = agent.current_state.position + agent.current_state.velocity * (0.5 * stop_time);
+            for (const auto &direction: directions) {
+                for (double offset: {agent.radius, 2 * agent.radius}) {
+                    buildRestToRest(agent, stop_point + direction * offset, M, n_stop_segments, candidate);
+                    candidates.emplace_back(candidate);
+                    if (direction.norm() < SP_EPSILON_FLOAT) {
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    void FallbackPlanner::buildRestToRest(const Agent &agent, const point3d &goal_point, int M, int n_stop_segments,
+                                          traj_t &traj) const {
+        // Bernstein control points of the cubic Hermite curve with p(0) = p_0, p'(0) = v_0, p(T) = p_T, p'(T) = 0,
+        // elevated to the degree n
+        double stop_time = n_stop_segments * param.dt;
+        Segment<point3d> curve;
+        curve.segment_time = stop_time;
+        curve.control_points.resize(4);
+        curve.control_points[0] = agent.current_state.position;
+        curve.control_points[1] = agent.current_state.position + agent.current_state.velocity * (stop_time / 3);
+        curve.control_points[2] = goal_point;
+        curve.control_points[3] = goal_point;
+        for (int degree = 3; degree < param.n; degree++) {
+            ControlPoints<point3d> elevated;
+            elevated.resize(degree + 2);
+            elevated[0] = curve.control_points[0];
+            elevated[degree + 1] = curve.control_points[degree];
+            for (int i = 1; i < degree + 1; i++) {
+                double alpha = static_cast<double>(i) / (degree + 1);
+                elevated[i] = curve.control_points[i - 1] * alpha + curve.control_points[i] * (1 - alpha);
+            }
+            curve.control_points = elevated;
+        }
+
+        // Split into the segments of the trajectory, the rest is held at the goal point
+        traj.reset(M, param.n, param.dt);
+        for (int m = 0; m < M; m++) {
+            if (m < n_stop_segments) {
+                traj[m] = curve.subSegment(static_cast<double>(m) / n_stop_segments,
+                                           static_cast<double>(m + 1) / n_stop_segments);
+                traj[m].segment_time = param.dt;
+            } else {
+                for (int i = 0; i < param.n + 1; i++) {
+                    traj[m][i] = goal_point;
+                }
+            }
+        }
+    }
+
+    bool FallbackPlanner::isDynamicallyFeasible(const Agent &agent, const traj_t &traj) const {
+        // The derivatives are in the convex hulls of their control points
+        traj_t velocity = traj.derivative();
+        traj_t acceleration = velocity.derivative();
+        for (int m = 0; m < traj.size(); m++) {
+            for (int k = 0; k < param.world_dimension; k++) {
+                for (const auto &control_point: velocity[m].control_points) {
+                    if (std::abs(control_point(k)) > agent.max_vel[0] + SP_EPSILON_FLOAT) {
+                        return false;
+                    }
+                }
+                for (const auto &control_point: acceleration[m].control_points) {
+                    if (std::abs(control_point(k)) > agent.max_acc[0] + SP_EPSILON_FLOAT) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+}
@@ -0,0 +1,205 @@
+#include <feasibility_checker.hpp>
+
+#if defined(__GNUC__) and (defined(__x86_64__) or defined(__i386__))
+#define LSC_PLANNER_AVX2_KERNEL
+#include <immintrin.h>
+#endif
+
+namespace DynamicPlanning {
+    // Arrays of one block of the kernel, c: control points, normal, point, d: LSCs
+    struct LSCBlock {
+        const double *c[3];
+        const double *normal[3];
+        const double *point[3];
+        const double *d;
+    };
+
+    // Returns the first index in [begin, end) outside of the box, or end if every point is in the box
+    static size_t firstOutsideBoxScalar(const double *const c[3], size_t begin, size_t end,
+                                        const double lower[3], const double upper[3]) {
+        for (size_t j = begin; j < end; j++) {
+            for (int k = 0; k < 3; k++) {
+                if (not(c[k][j] > lower[k] and c[k][j] < upper[k])) {
+                    return j;
+                }
+            }
+        }
+        return end;
+    }
+
+    // Returns the first index in [begin, end) that violates the LSC, or end if there is no violation
+    static size_t firstViolatedLSCScalar(const LSCBlock &block, size_t begin, size_t end, int dim, double tolerance) {
+        for (size_t j = begin; j < end; j++) {
+            double norm_sq = 0, margin = -block.d[j];
+            for (int k = 0; k < 3; k++) {
+                norm_sq += block.normal[k][j] * block.normal[k][j];
+            }
+            for (int k = 0; k < dim; k++) {
+                margin += block.normal[k][j] * (block.c[k][j] - block.point[k][j]);
+            }
+            if (norm_sq >= SP_EPSILON_FLOAT * SP_EPSILON_FLOAT and margin < -tolerance) {
+                return j;
+            }
+        }
+        return end;
+    }
+
+#ifdef LSC_PLANNER_AVX2_KERNEL
+    __attribute__((target("avx2")))
+    static size_t firstOutsideBoxAVX2(const double *const c[3], size_t begin, size_t end,
+                                      const double lower[3], const double upper[3]) {
+        size_t j = begin;
+        for (; j + 4 <= end; j += 4) {
+            __m256d inside = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+            for (int k = 0; k < 3; k++) {
+                __m256d value = _mm256_loadu_pd(c[k] + j);
+                inside = _mm256_and_pd(inside, _mm256_cmp_pd(value, _mm256_set1_pd(lower[k]), _CMP_GT_OQ));
+                inside = _mm256_and_pd(inside, _mm256_cmp_pd(value, _mm256_set1_pd(upper[k]), _CMP_LT_OQ));
+            }
+            int outside_mask = ~_mm256_movemask_pd(inside) & 0xF;
+            if (outside_mask != 0) {
+                return j + __builtin_ctz(outside_mask);
+            }
+        }
+        return firstOutsideBoxScalar(c, j, end, lower, upper);
+    }
+
+    __attribute__((target("avx2")))
+    static size_t firstViolatedLSCAVX2(const LSCBlock &block, size_t begin, size_t end, int dim, double tolerance) {
+        const __m256d epsilon_sq = _mm256_set1_pd(SP_EPSILON_FLOAT * SP_EPSILON_FLOAT);
+        const __m256d negative_tolerance = _mm256_set1_pd(-tolerance);
+        size_t j = begin;
+        for (; j + 4 <= end; j += 4) {
+            __m256d norm_sq = _mm256_setzero_pd();
+            __m256d margin = _mm256_sub_pd(_mm256_setzero_pd(), _mm256_loadu_pd(block.d + j));
+            for (int k = 0; k < 3; k++) {
+                __m256d normal = _mm256_loadu_pd(block.normal[k] + j);
+                norm_sq = _mm256_add_pd(norm_sq, _mm256_mul_pd(normal, normal));
+                if (k < dim) {
+                    __m256d diff = _mm256_sub_pd(_mm256_loadu_pd(block.c[k] + j), _mm256_loadu_pd(block.point[k] + j));
+                    margin = _mm256_add_pd(margin, _mm256_mul_pd(normal, diff));
+                }
+            }
+            __m256d violated = _mm256_and_pd(_mm256_cmp_pd(norm_sq, epsilon_sq, _CMP_GE_OQ),
+                                             _mm256_cmp_pd(margin, negative_tolerance, _CMP_LT_OQ));
+            int violated_mask = _mm256_movemask_pd(violated);
+            if (violated_mask != 0) {
+                return j + __builtin_ctz(violated_mask);
+            }
+        }
+        return firstViolatedLSCScalar(block, j, end, dim, tolerance);
+    }
+#endif
+
+    static size_t firstOutsideBox(const double *const c[3], size_t begin, size_t end,
+                                  const double lower[3], const double upper[3]) {
+#ifdef LSC_PLANNER_AVX2_KERNEL
+        if (FeasibilityChecker::isAVX2Available()) {
+            return firstOutsideBoxAVX2(c, begin, end, lower, upper);
+        }
+#endif
+        return firstOutsideBoxScalar(c, begin, end, lower, upper);
+    }
+
+    static size_t firstViolatedLSC(const LSCBlock &block, size_t begin, size_t end, int dim, double tolerance) {
+#ifdef LSC_PLANNER_AVX2_KERNEL
+        if (FeasibilityChecker::isAVX2Available()) {
+            return firstViolatedLSCAVX2(block, begin, end, dim, tolerance);
+        }
+#endif
+        return firstViolatedLSCScalar(block, begin, end, dim, tolerance);
+    }
+
+    FeasibilityChecker::FeasibilityChecker(int _M, int _n) : M(_M), n(_n) {
+        for (auto &control_points_k: control_points) {
+            control_points_k.resize(M * (n + 1));
+        }
+    }
+
+    void FeasibilityChecker::setTrajectory(const traj_t &traj) {
+        for (int m = 0; m < M; m++) {
+            for (int i = 0; i < n + 1; i++) {
+                const point3d &control_point = traj[m].control_points[i];
+                for (int k = 0; k < 3; k++) {
+                    control_points[k][m * (n + 1) + i] = control_point(k);
+                }
+            }
+        }
+    }
+
+    void FeasibilityChecker::setSolution(const Eigen::VectorXd &x, int dim, double z_2d) {
+        int offset_dim = M * (n + 1);
+        for (int k = 0; k < 3; k++) {
+            for (int j = 0; j < offset_dim; j++) {
+                control_points[k][j] = k < dim ? x(k * offset_dim + j) : z_2d;
+            }
+        }
+    }
+
+    ConstraintViolation FeasibilityChecker::checkSFCs(const CollisionConstraints &constraints, int n_skip) const {
+        ConstraintViolation violation;
+        const double *c[3] = {control_points[0].data(), control_points[1].data(), control_points[2].data()};
+        for (int m = 0; m < M; m++) {
+            Box sfc = constraints.getSFC(m);
+            double lower[3], upper[3];
+            for (int k = 0; k < 3; k++) {
+                lower[k] = sfc.box_min(k) - SP_EPSILON_FLOAT;
+                upper[k] = sfc.box_max(k) + SP_EPSILON_FLOAT;
+            }
+
+            size_t begin = m * (n + 1) + (m == 0 ? n_skip : 0);
+            size_t end = (m + 1) * (n + 1);
+            size_t j = firstOutsideBox(c, begin, end, lower, upper);
+            if (j < end) {
+                violation.type = ConstraintType::SFC;
+                violation.m = m;
+                violation.i = static_cast<int>(j - m * (n + 1));
+                return violation;
+            }
+        }
+
+        return violation;
+    }
+
+    ConstraintViolation FeasibilityChecker::checkLSCs(const CollisionConstraints &constraints, int dim, int n_skip,
+                                                      bool skip_dynamic_obstacles, double tolerance) const {
+        ConstraintViolation violation;
+        const RSFCs &lscs = constraints.getLSCs();
+        size_t n_points = M * (n + 1);
+        for (size_t oi = 0; oi < lscs.size(); oi++) {
+            if (skip_dynamic_obstacles and constraints.isDynamicObstacle(static_cast<int>(oi))) {
+                continue;
+            }
+
+            // The LSCs of one obstacle have the same layout as the control points
+            size_t base = lscs.index(oi, 0, 0);
+            LSCBlock block{};
+            for (int k = 0; k < 3; k++) {
+                block.c[k] = control_points[k].data();
+                block.normal[k] = lscs.getNormals(k) + base;
+                block.point[k] = lscs.getPoints(k) + base;
+            }
+            block.d = lscs.getOffsets() + base;
+
+            size_t j = firstViolatedLSC(block, n_skip, n_points, dim, tolerance);
+            if (j < n_points) {
+                violation.type = ConstraintType::LSC;
+                violation.oi = static_cast<int>(oi);
+                violation.m = static_cast<int>(j / (n + 1));
+                violation.i = static_cast<int>(j % (n + 1));
+                return violation;
+            }
+        }
+
+        return violation;
+    }
+
+    bool FeasibilityChecker::isAVX2Available() {
+#ifdef LSC_PLANNER_AVX2_KERNEL
+        static const bool avx2_available = __builtin_cpu_supports("avx2");
+        return avx2_available;
+#else
+        return false;
+#endif
+    }
+}
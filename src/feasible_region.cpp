@@ -0,0 +1,192 @@
+#include <feasible_region.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <utility>
+
+namespace DynamicPlanning {
+    FeasibleRegion::FeasibleRegion(const point3d &box_min, const point3d &box_max) {
+        reset(box_min, box_max);
+    }
+
+    void FeasibleRegion::reset(const point3d &box_min, const point3d &box_max) {
+        planes.clear();
+        vertices.clear();
+        if (box_min.x() > box_max.x() or box_min.y() > box_max.y() or box_min.z() > box_max.z()) {
+            return;
+        }
+
+        // Plane 2 * i: x(i) >= box_min(i), plane 2 * i + 1: -x(i) >= -box_max(i)
+        for (int i = 0; i < 3; i++) {
+            point3d normal(0, 0, 0);
+            normal(i) = 1;
+            planes.emplace_back(Plane{normal, box_min(i)});
+            normal(i) = -1;
+            planes.emplace_back(Plane{normal, -box_max(i)});
+        }
+
+        for (int corner = 0; corner < 8; corner++) {
+            Vertex vertex;
+            for (int i = 0; i < 3; i++) {
+                bool is_max = (corner >> i) & 1;
+                vertex.point(i) = is_max ? box_max(i) : box_min(i);
+                vertex.planes.emplace_back(2 * i + is_max);
+            }
+            vertices.emplace_back(vertex);
+        }
+    }
+
+    bool FeasibleRegion::addHalfSpace(const point3d &normal, double offset) {
+        if (isEmpty()) {
+            return false;
+        }
+
+        double norm = normal.norm();
+        if (norm < SP_EPSILON_FLOAT) {
+            return true;
+        }
+        int k = static_cast<int>(planes.size());
+        planes.emplace_back(Plane{normal * (1 / norm), offset / norm});
+        const Plane &plane = planes.back();
+
+        std::vector<double> dists(vertices.size());
+        size_t n_removed = 0;
+        for (size_t vi = 0; vi < vertices.size(); vi++) {
+            dists[vi] = plane.normal.dot(vertices[vi].point) - plane.offset;
+            if (dists[vi] < -SP_EPSILON_FLOAT) {
+                n_removed++;
+            } else if (dists[vi] < SP_EPSILON_FLOAT) {
+                vertices[vi].planes.emplace_back(k); // k is the largest index, the planes stay sorted
+            }
+        }
+        if (n_removed == 0) {
+            return true;
+        }
+        if (n_removed == vertices.size()) {
+            vertices.clear();
+            return false;
+        }
+
+        // New vertices where the plane cuts the edges from a kept vertex to a removed one
+        std::vector<Vertex> new_vertices;
+        std::vector<int> common_planes;
+        for (size_t u = 0; u < vertices.size(); u++) {
+            if (dists[u] < SP_EPSILON_FLOAT) {
+                continue;
+            }
+            for (size_t w = 0; w < vertices.size(); w++) {
+                if (dists[w] >= -SP_EPSILON_FLOAT or not isEdge(u, w, common_planes)) {
+                    continue;
+                }
+                double alpha = dists[u] / (dists[u] - dists[w]);
+                Vertex vertex;
+                vertex.point = vertices[u].point + (vertices[w].point - vertices[u].point) * alpha;
+                vertex.planes = common_planes;
+                vertex.planes.emplace_back(k);
+                new_vertices.emplace_back(vertex);
+            }
+        }
+
+        size_t n_kept = 0;
+        for (size_t vi = 0; vi < vertices.size(); vi++) {
+            if (dists[vi] < -SP_EPSILON_FLOAT) {
+                continue;
+            }
+            if (n_kept != vi) {
+                vertices[n_kept] = std::move(vertices[vi]);
+            }
+            n_kept++;
+        }
+        vertices.resize(n_kept);
+        vertices.insert(vertices.end(),
+                        std::make_move_iterator(new_vertices.begin()),
+                        std::make_move_iterator(new_vertices.end()));
+
+        return true;
+    }
+
+    bool FeasibleRegion::isEmpty() const {
+        return vertices.empty();
+    }
+
+    size_t FeasibleRegion::getNumHalfSpaces() const {
+        return planes.size();
+    }
+
+    points_t FeasibleRegion::getVertices() const {
+        points_t points;
+        points.reserve(vertices.size());
+        for (const auto &vertex: vertices) {
+            points.emplace_back(vertex.point);
+        }
+        return points;
+    }
+
+    std::vector<FeasibleRegion::Triangle> FeasibleRegion::getTriangles() const {
+        std::vector<Triangle> triangles;
+        std::vector<std::pair<double, point3d>> face;
+        for (size_t k = 0; k < planes.size(); k++) {
+            face.clear();
+            point3d center(0, 0, 0);
+            for (const auto &vertex: vertices) {
+                if (std::binary_search(vertex.planes.begin(), vertex.planes.end(), static_cast<int>(k))) {
+                    face.emplace_back(0, vertex.point);
+                    center += vertex.point;
+                }
+            }
+            if (face.size() < 3) {
+                continue; // redundant plane, or it only touches an edge or a vertex
+            }
+            center *= 1.0 / face.size();
+
+            // Sort the vertices of the face counter-clockwise around the outward normal
+            point3d outward_normal = planes[k].normal * -1;
+            point3d axis_u = (face[0].second - center).normalized();
+            point3d axis_v = outward_normal.cross(axis_u);
+            for (auto &[angle, point]: face) {
+                point3d delta = point - center;
+                angle = std::atan2(delta.dot(axis_v), delta.dot(axis_u));
+            }
+            std::sort(face.begin(), face.end(),
+                      [](const auto &a, const auto &b) { return a.first < b.first; });
+
+            for (size_t i = 1; i + 1 < face.size(); i++) {
+                triangles.emplace_back(Triangle{face[0].second, face[i].second, face[i + 1].second});
+            }
+        }
+        return triangles;
+    }
+
+    bool FeasibleRegion::isEdge(size_t u, size_t w, std::vector<int> &common_planes) const {
+        common_planes.clear();
+        std::set_intersection(vertices[u].planes.begin(), vertices[u].planes.end(),
+                              vertices[w].planes.begin(), vertices[w].planes.end(),
+                              std::back_inserter(common_planes));
+        if (common_planes.size() < 2) {
+            return false;
+        }
+
+        // The common planes must define a line, not only a plane
+        bool is_line = false;
+        for (size_t i = 0; i < common_planes.size() and not is_line; i++) {
+            for (size_t j = i + 1; j < common_planes.size() and not is_line; j++) {
+                is_line = planes[common_planes[i]].normal.cross(planes[common_planes[j]].normal).norm() >
+                          SP_EPSILON_FLOAT;
+            }
+        }
+        if (not is_line) {
+            return false;
+        }
+
+        for (size_t vi = 0; vi < vertices.size(); vi++) {
+            if (vi == u or vi == w) {
+                continue;
+            }
+            if (std::includes(vertices[vi].planes.begin(), vertices[vi].planes.end(),
+                              common_planes.begin(), common_planes.end())) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
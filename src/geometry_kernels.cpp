@@ -0,0 +1,254 @@
+#include <geometry_kernels.hpp>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__GNUC__) and (defined(__x86_64__) or defined(__i386__))
+#define LSC_PLANNER_AVX2_KERNEL
+#include <immintrin.h>
+#endif
+
+namespace DynamicPlanning::GeometryKernels {
+    // Arrays of the points and the query of one kernel call
+    struct KernelInput {
+        const double *c[3];
+        double q[3];
+        size_t size;
+    };
+
+    static KernelInput makeInput(const point3d &point, const PointsSoA &points) {
+        return {{points.data(0), points.data(1), points.data(2)}, {point.x(), point.y(), point.z()}, points.size()};
+    }
+
+    static void lInfinityDistancesScalar(const KernelInput &input, size_t begin, double *out) {
+        for (size_t j = begin; j < input.size; j++) {
+            double dist = 0;
+            for (int k = 0; k < 3; k++) {
+                dist = std::max(dist, std::abs(input.q[k] - input.c[k][j]));
+            }
+            out[j] = dist;
+        }
+    }
+
+    static void ellipsoidalDistancesScalar(const KernelInput &input, const double *downwash, size_t begin,
+                                           double *out) {
+        for (size_t j = begin; j < input.size; j++) {
+            double dx = input.q[0] - input.c[0][j];
+            double dy = input.q[1] - input.c[1][j];
+            double dz = (input.q[2] - input.c[2][j]) / downwash[j];
+            out[j] = std::sqrt(dx * dx + dy * dy + dz * dz);
+        }
+    }
+
+    // The excess outside [lower, upper] is zero in the box, so the points in the box have the distance 0
+    static void boxDistancesScalar(const KernelInput &input, const double lower[3], const double upper[3],
+                                   size_t begin, double *out) {
+        for (size_t j = begin; j < input.size; j++) {
+            double dist_sq = 0;
+            for (int k = 0; k < 3; k++) {
+                double excess = std::max({lower[k] - input.c[k][j], input.c[k][j] - upper[k], 0.0});
+                dist_sq += excess * excess;
+            }
+            out[j] = std::sqrt(dist_sq);
+        }
+    }
+
+    static void boxClosestPointsScalar(const KernelInput &input, const double lower[3], const double upper[3],
+                                       size_t begin, double *const out[3]) {
+        for (size_t j = begin; j < input.size; j++) {
+            for (int k = 0; k < 3; k++) {
+                out[k][j] = std::min(std::max(input.c[k][j], lower[k]), upper[k]);
+            }
+        }
+    }
+
+    // The projection of the point onto the line is clamped to the segment, which is the minimum of the distances
+    // to the end points and to the line in closestPointsBetweenPointAndLineSegment
+    static void lineSegmentDistancesScalar(const KernelInput &starts, const double *const ends[3], size_t begin,
+                                           double *out) {
+        for (size_t j = begin; j < starts.size; j++) {
+            double v[3], w[3], vv = 0, wv = 0;
+            for (int k = 0; k < 3; k++) {
+                v[k] = ends[k][j] - starts.c[k][j];
+                w[k] = starts.q[k] - starts.c[k][j];
+                vv += v[k] * v[k];
+                wv += w[k] * v[k];
+            }
+            double t = vv > 0 ? std::min(std::max(wv / vv, 0.0), 1.0) : 0.0;
+            double dist_sq = 0;
+            for (int k = 0; k < 3; k++) {
+                double delta = w[k] - t * v[k];
+                dist_sq += delta * delta;
+            }
+            out[j] = std::sqrt(dist_sq);
+        }
+    }
+
+#ifdef LSC_PLANNER_AVX2_KERNEL
+    __attribute__((target("avx2")))
+    static inline __m256d abs256(__m256d value) {
+        return _mm256_andnot_pd(_mm256_set1_pd(-0.0), value);
+    }
+
+    // The kernels return the first index left to the scalar tail
+    __attribute__((target("avx2")))
+    static size_t lInfinityDistancesAVX2(const KernelInput &input, double *out) {
+        size_t j = 0;
+        for (; j + 4 <= input.size; j += 4) {
+            __m256d dist = _mm256_setzero_pd();
+            for (int k = 0; k < 3; k++) {
+                __m256d delta = _mm256_sub_pd(_mm256_set1_pd(input.q[k]), _mm256_loadu_pd(input.c[k] + j));
+                dist = _mm256_max_pd(dist, abs256(delta));
+            }
+            _mm256_storeu_pd(out + j, dist);
+        }
+        return j;
+    }
+
+    __attribute__((target("avx2")))
+    static size_t ellipsoidalDistancesAVX2(const KernelInput &input, const double *downwash, double *out) {
+        size_t j = 0;
+        for (; j + 4 <= input.size; j += 4) {
+            __m256d dx = _mm256_sub_pd(_mm256_set1_pd(input.q[0]), _mm256_loadu_pd(input.c[0] + j));
+            __m256d dy = _mm256_sub_pd(_mm256_set1_pd(input.q[1]), _mm256_loadu_pd(input.c[1] + j));
+            __m256d dz = _mm256_div_pd(_mm256_sub_pd(_mm256_set1_pd(input.q[2]), _mm256_loadu_pd(input.c[2] + j)),
+                                       _mm256_loadu_pd(downwash + j));
+            __m256d dist_sq = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)),
+                                            _mm256_mul_pd(dz, dz));
+            _mm256_storeu_pd(out + j, _mm256_sqrt_pd(dist_sq));
+        }
+        return j;
+    }
+
+    __attribute__((target("avx2")))
+    static size_t boxDistancesAVX2(const KernelInput &input, const double lower[3], const double upper[3],
+                                   double *out) {
+        size_t j = 0;
+        for (; j + 4 <= input.size; j += 4) {
+            __m256d dist_sq = _mm256_setzero_pd();
+            for (int k = 0; k < 3; k++) {
+                __m256d value = _mm256_loadu_pd(input.c[k] + j);
+                __m256d excess = _mm256_max_pd(_mm256_sub_pd(_mm256_set1_pd(lower[k]), value),
+                                               _mm256_sub_pd(value, _mm256_set1_pd(upper[k])));
+                excess = _mm256_max_pd(excess, _mm256_setzero_pd());
+                dist_sq = _mm256_add_pd(dist_sq, _mm256_mul_pd(excess, excess));
+            }
+            _mm256_storeu_pd(out + j, _mm256_sqrt_pd(dist_sq));
+        }
+        return j;
+    }
+
+    __attribute__((target("avx2")))
+    static size_t boxClosestPointsAVX2(const KernelInput &input, const double lower[3], const double upper[3],
+                                       double *const out[3]) {
+        size_t j = 0;
+        for (; j + 4 <= input.size; j += 4) {
+            for (int k = 0; k < 3; k++) {
+                __m256d value = _mm256_max_pd(_mm256_loadu_pd(input.c[k] + j), _mm256_set1_pd(lower[k]));
+                _mm256_storeu_pd(out[k] + j, _mm256_min_pd(value, _mm256_set1_pd(upper[k])));
+            }
+        }
+        return j;
+    }
+
+    __attribute__((target("avx2")))
+    static size_t lineSegmentDistancesAVX2(const KernelInput &starts, const double *const ends[3], double *out) {
+        const __m256d zero = _mm256_setzero_pd();
+        const __m256d one = _mm256_set1_pd(1.0);
+        size_t j = 0;
+        for (; j + 4 <= starts.size; j += 4) {
+            __m256d v[3], w[3];
+            __m256d vv = zero, wv = zero;
+            for (int k = 0; k < 3; k++) {
+                __m256d start = _mm256_loadu_pd(starts.c[k] + j);
+                v[k] = _mm256_sub_pd(_mm256_loadu_pd(ends[k] + j), start);
+                w[k] = _mm256_sub_pd(_mm256_set1_pd(starts.q[k]), start);
+                vv = _mm256_add_pd(vv, _mm256_mul_pd(v[k], v[k]));
+                wv = _mm256_add_pd(wv, _mm256_mul_pd(w[k], v[k]));
+            }
+            // t = 0 for the degenerate segments, the division by zero is masked out
+            __m256d nondegenerate = _mm256_cmp_pd(vv, zero, _CMP_GT_OQ);
+            __m256d t = _mm256_min_pd(_mm256_max_pd(_mm256_div_pd(wv, vv), zero), one);
+            t = _mm256_and_pd(t, nondegenerate);
+            __m256d dist_sq = zero;
+            for (int k = 0; k < 3; k++) {
+                __m256d delta = _mm256_sub_pd(w[k], _mm256_mul_pd(t, v[k]));
+                dist_sq = _mm256_add_pd(dist_sq, _mm256_mul_pd(delta, delta));
+            }
+            _mm256_storeu_pd(out + j, _mm256_sqrt_pd(dist_sq));
+        }
+        return j;
+    }
+#endif
+
+    void lInfinityDistances(const point3d &point, const PointsSoA &points, double *out) {
+        KernelInput input = makeInput(point, points);
+        size_t begin = 0;
+#ifdef LSC_PLANNER_AVX2_KERNEL
+        if (isAVX2Available()) {
+            begin = lInfinityDistancesAVX2(input, out);
+        }
+#endif
+        lInfinityDistancesScalar(input, begin, out);
+    }
+
+    void ellipsoidalDistances(const point3d &point, const PointsSoA &points, const double *downwash, double *out) {
+        KernelInput input = makeInput(point, points);
+        size_t begin = 0;
+#ifdef LSC_PLANNER_AVX2_KERNEL
+        if (isAVX2Available()) {
+            begin = ellipsoidalDistancesAVX2(input, downwash, out);
+        }
+#endif
+        ellipsoidalDistancesScalar(input, downwash, begin, out);
+    }
+
+    void boxDistances(const point3d &box_min, const point3d &box_max, const PointsSoA &points, double *out) {
+        KernelInput input = makeInput(point3d(0, 0, 0), points);
+        double lower[3] = {box_min.x(), box_min.y(), box_min.z()};
+        double upper[3] = {box_max.x(), box_max.y(), box_max.z()};
+        size_t begin = 0;
+#ifdef LSC_PLANNER_AVX2_KERNEL
+        if (isAVX2Available()) {
+            begin = boxDistancesAVX2(input, lower, upper, out);
+        }
+#endif
+        boxDistancesScalar(input, lower, upper, begin, out);
+    }
+
+    void boxClosestPoints(const point3d &box_min, const point3d &box_max, const PointsSoA &points,
+                          PointsSoA &out) {
+        KernelInput input = makeInput(point3d(0, 0, 0), points);
+        double lower[3] = {box_min.x(), box_min.y(), box_min.z()};
+        double upper[3] = {box_max.x(), box_max.y(), box_max.z()};
+        out.resize(points.size());
+        double *const out_c[3] = {out.data(0), out.data(1), out.data(2)};
+        size_t begin = 0;
+#ifdef LSC_PLANNER_AVX2_KERNEL
+        if (isAVX2Available()) {
+            begin = boxClosestPointsAVX2(input, lower, upper, out_c);
+        }
+#endif
+        boxClosestPointsScalar(input, lower, upper, begin, out_c);
+    }
+
+    void lineSegmentDistances(const point3d &point, const PointsSoA &starts, const PointsSoA &ends, double *out) {
+        KernelInput input = makeInput(point, starts);
+        const double *const ends_c[3] = {ends.data(0), ends.data(1), ends.data(2)};
+        size_t begin = 0;
+#ifdef LSC_PLANNER_AVX2_KERNEL
+        if (isAVX2Available()) {
+            begin = lineSegmentDistancesAVX2(input, ends_c, out);
+        }
+#endif
+        lineSegmentDistancesScalar(input, ends_c, begin, out);
+    }
+
+    bool isAVX2Available() {
+#ifdef LSC_PLANNER_AVX2_KERNEL
+        static const bool avx2_available = __builtin_cpu_supports("avx2");
+        return avx2_available;
+#else
+        return false;
+#endif
+    }
+}
@@ -0,0 +1,198 @@
+#include <global_map_registry.hpp>
+#include <point_cloud_ingestion.hpp>
+#include <sp_const.hpp>
+#include <timer.hpp>
+#include <worker_pool.hpp>
+#include <ros/ros.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <tuple>
+
+namespace DynamicPlanning {
+    namespace {
+        constexpr double BYTES_PER_MB = 1024.0 * 1024.0;
+
+        // [byte], the resident set size of the process, 0 if it can not be read
+        size_t getResidentMemory() {
+            std::ifstream statm("/proc/self/statm");
+            size_t n_total_pages = 0, n_resident_pages = 0;
+            if (not(statm >> n_total_pages >> n_resident_pages)) {
+                return 0;
+            }
+            return n_resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        }
+
+        // The voxels whose center is in a primitive of the world file. The keys of each primitive are computed
+        // directly from its voxel range on the worker pool, without the points of the voxel centers, then the keys
+        // of the overlapping primitives are merged.
+        void voxelizePrimitives(const std::vector<WorldPrimitive> &primitives, double resolution,
+                                octomap::OcTree &octree) {
+            std::vector<std::vector<octomap::OcTreeKey>> primitive_keys(primitives.size());
+            WorkerPool::getInstance().run(primitives.size(), [&](size_t pi) {
+                const WorldPrimitive &primitive = primitives[pi];
+                octomap::point3d com = primitive.center; // center of mass
+                octomap::point3d size = primitive.size;
+
+                int i_start = (int) round((com.x() - 0.5 * size.x()) / resolution);
+                int i_end = (int) round((com.x() + 0.5 * size.x()) / resolution);
+                int j_start = (int) round((com.y() - 0.5 * size.y()) / resolution);
+                int j_end = (int) round((com.y() + 0.5 * size.y()) / resolution);
+                int k_start = (int) round((com.z() - 0.5 * size.z()) / resolution);
+                int k_end = (int) round((com.z() + 0.5 * size.z()) / resolution);
+                if (i_start >= i_end or j_start >= j_end or k_start >= k_end) {
+                    return;
+                }
+
+                // The centers of the rounded z range are within the primitive, so a column of a vertical
+                // cylinder is either inside or outside
+                std::vector<octomap::OcTreeKey> &keys = primitive_keys[pi];
+                keys.reserve(static_cast<size_t>(i_end - i_start) * (j_end - j_start) * (k_end - k_start));
+                for (int i = i_start; i < i_end; i++) {
+                    for (int j = j_start; j < j_end; j++) {
+                        if (primitive.shape == PrimitiveShape::CYLINDER) {
+                            octomap::point3d column_point((i + 0.5) * resolution, (j + 0.5) * resolution,
+                                                          (k_start + 0.5) * resolution);
+                            if (primitive.distance(column_point) > SP_EPSILON_FLOAT) {
+                                continue;
+                            }
+                        }
+
+                        for (int k = k_start; k < k_end; k++) {
+                            octomap::OcTreeKey key;
+                            if (octree.coordToKeyChecked((i + 0.5) * resolution, (j + 0.5) * resolution,
+                                                         (k + 0.5) * resolution, key)) {
+                                keys.emplace_back(key);
+                            }
+                        }
+                    }
+                }
+            });
+
+            size_t n_keys = 0;
+            for (const auto &keys: primitive_keys) {
+                n_keys += keys.size();
+            }
+            std::vector<octomap::OcTreeKey> keys;
+            keys.reserve(n_keys);
+            for (auto &primitive_key: primitive_keys) {
+                keys.insert(keys.end(), primitive_key.begin(), primitive_key.end());
+                std::vector<octomap::OcTreeKey>().swap(primitive_key);
+            }
+            auto key_less = [](const octomap::OcTreeKey &a, const octomap::OcTreeKey &b) {
+                return std::tie(a[0], a[1], a[2]) < std::tie(b[0], b[1], b[2]);
+            };
+            std::sort(keys.begin(), keys.end(), key_less);
+            keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+            // The primitives are known, so the voxels are marked occupied without tracing the rays from the origin
+            insertOccupiedVoxels(octree, keys);
+        }
+    }
+
+    std::shared_ptr<GlobalMap> loadGlobalMap(const std::string &world_file_name, double resolution,
+                                             const octomap::point3d &world_min, const octomap::point3d &world_max,
+                                             bool build_occupancy_index, bool use_distmap_cache,
+                                             bool use_primitive_world) {
+        size_t resident_memory_before = getResidentMemory();
+        Timer timer;
+        auto global_map = std::make_shared<GlobalMap>();
+        global_map->octree = std::make_unique<octomap::OcTree>(resolution);
+
+        std::string world_extension = world_file_name.substr(world_file_name.find_last_of('.') + 1);
+        if (world_extension == "csv") {
+            std::vector<WorldPrimitive> primitives;
+            if (not readWorldPrimitives(world_file_name, primitives)) {
+                ROS_ERROR_STREAM("[MapManager] Fail to read world file: " << world_file_name);
+                return nullptr;
+            }
+            voxelizePrimitives(primitives, resolution, *global_map->octree);
+            if (use_primitive_world) {
+                global_map->primitive_world = std::make_unique<PrimitiveWorld>(primitives, world_min, world_max,
+                                                                               GLOBAL_DISTMAP_MAX_DIST);
+            }
+        } else if (not global_map->octree->readBinary(world_file_name)) {
+            ROS_ERROR_STREAM("[MapManager] Fail to read world file: " << world_file_name);
+            return nullptr;
+        }
+
+        // The pruned nodes are kept, the distance field and the occupied leaves cover the voxels of a pruned node
+        timer.stop();
+        double read_time = timer.elapsedSeconds();
+        timer.reset();
+        size_t distmap_memory = 0;
+        if (global_map->primitive_world != nullptr) {
+            // The queries are answered by the primitives, the octree is kept for the sensors and the visualization
+            distmap_memory = global_map->primitive_world->getMemoryUsage();
+            build_occupancy_index = false;
+        } else {
+            global_map->distmap = std::make_unique<SerializableDistmap>(GLOBAL_DISTMAP_MAX_DIST,
+                                                                        global_map->octree.get(),
+                                                                        world_min, world_max, false);
+            if (use_distmap_cache) {
+                std::string cache_file_name = world_file_name + ".edt";
+                uint64_t map_hash = SerializableDistmap::computeMapHash(world_file_name, resolution,
+                                                                        world_min, world_max, GLOBAL_DISTMAP_MAX_DIST);
+                if (not global_map->distmap->load(cache_file_name, map_hash)) {
+                    global_map->distmap->updateParallel();
+                    if (not global_map->distmap->save(cache_file_name, map_hash)) {
+                        ROS_WARN_STREAM("[MapManager] Fail to save the distmap cache: " << cache_file_name);
+                    }
+                }
+            } else {
+                global_map->distmap->updateParallel();
+            }
+            distmap_memory = global_map->distmap->getMemoryUsage();
+        }
+        timer.stop();
+        double distmap_time = timer.elapsedSeconds();
+
+        timer.reset();
+        size_t occupancy_index_memory = 0;
+        if (build_occupancy_index) {
+            global_map->occupancy_index = std::make_unique<OccupancyIndex>(world_min, world_max, resolution);
+            global_map->occupancy_index->build(*global_map->octree);
+            occupancy_index_memory = global_map->occupancy_index->getMemoryUsage();
+        }
+        timer.stop();
+
+        size_t resident_memory = getResidentMemory();
+        ROS_INFO_STREAM("[MapManager] World " << world_file_name << ": read " << read_time << " s, distmap "
+                        << distmap_time << " s, occupancy index " << timer.elapsedSeconds() << " s, octree "
+                        << global_map->octree->memoryUsage() / BYTES_PER_MB << " MB, distmap "
+                        << distmap_memory / BYTES_PER_MB << " MB, occupancy index "
+                        << occupancy_index_memory / BYTES_PER_MB << " MB, resident "
+                        << resident_memory / BYTES_PER_MB << " MB (+"
+                        << (resident_memory - std::min(resident_memory, resident_memory_before)) / BYTES_PER_MB
+                        << " MB)");
+        return global_map;
+    }
+
+    GlobalMapRegistry &GlobalMapRegistry::getInstance() {
+        static GlobalMapRegistry registry;
+        return registry;
+    }
+
+    std::shared_ptr<const GlobalMap> GlobalMapRegistry::acquire(const std::string &key, const Loader &loader) {
+        // Load under the lock, so the agents waiting for the same map do not load it again
+        std::lock_guard<std::mutex> lock(mtx);
+        std::shared_ptr<const GlobalMap> global_map = maps[key].lock();
+        if (global_map != nullptr) {
+            return global_map;
+        }
+
+        global_map = loader();
+        if (global_map == nullptr) {
+            maps.erase(key);
+            return nullptr;
+        }
+        maps[key] = global_map;
+
+        // Drop the keys of the released maps
+        for (auto it = maps.begin(); it != maps.end();) {
+            it = it->second.expired() ? maps.erase(it) : std::next(it);
+        }
+        return global_map;
+    }
+}
@@ -0,0 +1,58 @@
+#include <global_point_cloud.hpp>
+#include <worker_pool.hpp>
+#include <timer.hpp>
+#include <algorithm>
+
+namespace DynamicPlanning {
+    static constexpr size_t GLOBAL_CLOUD_CHUNK_SIZE = 65536; // points of the global map per task of the worker pool
+
+    std::shared_ptr<const GlobalPointCloud> GlobalPointCloud::build(const sensor_msgs::PointCloud2 &msg,
+                                                                    double resolution,
+                                                                    PointCloudIngestionReport &report) {
+        // The octree gives the voxel grid only, the voxels are not inserted
+        octomap::OcTree grid(resolution);
+        std::vector<octomap::OcTreeKey> keys;
+        if (not ingestPointCloud2(msg, grid, keys, report)) {
+            return nullptr;
+        }
+
+        std::shared_ptr<GlobalPointCloud> global_cloud(new GlobalPointCloud());
+        global_cloud->cloud = pcl::PointCloud<pcl::PointXYZ>::Ptr(new pcl::PointCloud<pcl::PointXYZ>());
+        auto &points = global_cloud->cloud->points;
+        points.resize(keys.size());
+        WorkerPool::getInstance().run((keys.size() + GLOBAL_CLOUD_CHUNK_SIZE - 1) / GLOBAL_CLOUD_CHUNK_SIZE,
+                                      [&](size_t chunk_idx) {
+            size_t end = std::min((chunk_idx + 1) * GLOBAL_CLOUD_CHUNK_SIZE, keys.size());
+            for (size_t i = chunk_idx * GLOBAL_CLOUD_CHUNK_SIZE; i < end; i++) {
+                octomap::point3d point = grid.keyToCoord(keys[i]);
+                points[i] = pcl::PointXYZ(point.x(), point.y(), point.z());
+            }
+        });
+        global_cloud->cloud->width = points.size();
+        global_cloud->cloud->height = 1;
+
+        Timer timer;
+        if (not points.empty()) {
+            global_cloud->kdtree.setInputCloud(global_cloud->cloud);
+        }
+        timer.stop();
+        global_cloud->build_time = timer.elapsedSeconds();
+        return global_cloud;
+    }
+
+    const std::vector<int> &GlobalPointCloud::radiusSearch(const octomap::point3d &center, double radius) const {
+        // The search of the kd-tree is const, the results go to the buffers of the thread which are reused
+        thread_local std::vector<int> indices;
+        thread_local std::vector<float> sq_dists;
+        indices.clear();
+        if (cloud->points.empty()) {
+            return indices;
+        }
+
+        pcl::PointXYZ search_point(center.x(), center.y(), center.z());
+        if (kdtree.radiusSearch(search_point, radius, indices, sq_dists) <= 0) {
+            indices.clear();
+        }
+        return indices;
+    }
+}
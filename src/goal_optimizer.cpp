@@ -1,18 +1,78 @@
 #include "goal_optimizer.hpp"
+#include <trace.hpp>
 
 namespace DynamicPlanning {
-    GoalOptimizer::GoalOptimizer(const Param &_param, const Mission &_mission)
-            : param(_param), mission(_mission) {}
+    GoalOptimizer::GoalOptimizer(const Param &_param, const std::shared_ptr<const Mission> &_mission)
+            : param(_param), mission(_mission), prev_t(0) {
+        if (param.qp_solver_mode != QPSolverMode::CPLEX) {
+            qp_solver = createQPSolver(param.qp_solver_mode);
+        }
+    }
+
+    void GoalOptimizer::resetMission(const std::shared_ptr<const Mission> &_mission) {
+        mission = _mission;
+        prev_t = 0;
+    }
+
+    void GoalOptimizer::updateParam(const Param &_param) {
+        bool is_solver_changed = param.qp_solver_mode != _param.qp_solver_mode;
+        param = _param;
+        if (is_solver_changed) {
+            lp_model.reset();
+            if (param.qp_solver_mode != QPSolverMode::CPLEX) {
+                qp_solver = createQPSolver(param.qp_solver_mode);
+            } else {
+                qp_solver.reset();
+            }
+        }
+    }
 
     point3d GoalOptimizer::solve(const Agent& agent,
                                  const CollisionConstraints& constraints,
                                  const point3d &current_goal_point,
                                  const point3d &next_waypoint) {
-
+        TRACE_SCOPE("GoalOptimizer::solve");
         if(current_goal_point.distance(next_waypoint) < SP_EPSILON_FLOAT){
             return next_waypoint;
         }
 
+        std::vector<GoalConstraint> goal_constraints = buildConstraints(constraints, current_goal_point,
+                                                                        next_waypoint);
+
+        // Fast path
+        if (param.opt_goal_analytic) {
+            double t;
+            if (not solveAnalytic(goal_constraints, t)) {
+                reportQPFailure(agent, goal_constraints, "infeasible interval");
+                throw PlanningReport::QPFAILED;
+            }
+            prev_t = t;
+            return (current_goal_point - next_waypoint) * t + next_waypoint;
+        }
+
+        SolverThreadLease lease = SolverThreadScheduler::getInstance().acquire(agent.id,
+                                                                               goal_constraints.size() + 1);
+
+        // QP backend other than CPLEX Concert
+        if (qp_solver != nullptr) {
+            double t;
+            if (not solveWithQPSolver(goal_constraints, lease.getThreads(), t)) {
+                reportQPFailure(agent, goal_constraints, qp_solver->getName() + " failed");
+                throw PlanningReport::QPFAILED;
+            }
+            return (current_goal_point - next_waypoint) * t + next_waypoint;
+        }
+
+        if (param.opt_persistent_model) {
+            double t;
+            std::string status;
+            if (not solvePersistent(goal_constraints, lease.getThreads(), t, status)) {
+                reportQPFailure(agent, goal_constraints, status);
+                throw PlanningReport::QPFAILED;
+            }
+            return (current_goal_point - next_waypoint) * t + next_waypoint;
+        }
+
         point3d goal;
         IloEnv env;
         IloCplex cplex(env);
@@ -21,7 +81,7 @@ namespace DynamicPlanning {
         IloRangeArray con(env);
 
         // Set CPLEX parameters
-        cplex.setParam(IloCplex::Param::Threads, 6);
+        cplex.setParam(IloCplex::Param::Threads, lease.getThreads());
 //        cplex.setParam(IloCplex::Param::TimeLimit, 0.1); // For time limit
 
         // Set CPLEX algorithm
@@ -33,7 +93,6 @@ namespace DynamicPlanning {
         cplex.extract(model);
 
         std::string QPmodel_path = param.package_path + "/log/QPmodel_goalOpt.lp";
-        std::string conflict_path = param.package_path + "/log/conflict_goalOpt.lp";
         if (param.log_solver) {
             cplex.exportModel(QPmodel_path.c_str());
         } else {
@@ -49,55 +108,21 @@ namespace DynamicPlanning {
             IloNumArray vals(env);
             cplex.getValues(vals, var);
             goal = (current_goal_point - next_waypoint) * vals[0] + next_waypoint;
+            prev_t = vals[0];
             env.end();
         }
         catch (IloException &e) {
-            cplex.exportModel(QPmodel_path.c_str());
-            if ((cplex.getStatus() == IloAlgorithm::Infeasible) ||
-                (cplex.getStatus() == IloAlgorithm::InfeasibleOrUnbounded)) {
-                ROS_ERROR_STREAM(
-                        "[GoalOptimizer] CPLEX No solution at mav " << agent.id << ", starting Conflict refinement");
-                IloConstraintArray infeas(env);
-                IloNumArray preferences(env);
-
-                infeas.add(con);
-                for (IloInt i = 0; i < var.getSize(); i++) {
-                    if (var[i].getType() != IloNumVar::Bool) {
-                        infeas.add(IloBound(var[i], IloBound::Lower));
-                        infeas.add(IloBound(var[i], IloBound::Upper));
-                    }
-                }
-
-                for (IloInt i = 0; i < infeas.getSize(); i++) {
-                    preferences.add(1.0);  // User may wish to assign unique preferences
-                }
-
-                if (cplex.refineConflict(infeas, preferences)) {
-                    IloCplex::ConflictStatusArray conflict = cplex.getConflict(infeas);
-                    env.getImpl()->useDetailedDisplay(IloTrue);
-                    std::cout << "Conflict :" << std::endl;
-                    for (IloInt i = 0; i < infeas.getSize(); i++) {
-                        if (conflict[i] == IloCplex::ConflictMember)
-                            std::cout << "Proved  : c" << i << infeas[i] << std::endl;
-                        if (conflict[i] == IloCplex::ConflictPossibleMember)
-                            std::cout << "Possible: c" << i << infeas[i] << std::endl;
-                    }
-                    cplex.writeConflict(conflict_path.c_str());
-                } else {
-                    ROS_ERROR_STREAM("[TrajOptimizer] CPLEX Conflict could not be refined");
-                }
-            } else {
-                ROS_ERROR_STREAM("[TrajOptimizer] CPLEX Concert exception caught: " << e);
-            }
+            std::ostringstream status;
+            status << cplex.getStatus() << ": " << e;
+            env.end();
+            reportQPFailure(agent, goal_constraints, status.str());
 
             //TODO: find better exception
             throw PlanningReport::QPFAILED;
         }
         catch (...) {
-            ROS_ERROR_STREAM("[GoalOptimizer] CPLEX Unknown exception caught at iteration ");
-            if (not param.log_solver) {
-                cplex.exportModel(QPmodel_path.c_str());
-            }
+            env.end();
+            reportQPFailure(agent, goal_constraints, "unknown exception");
 
             //TODO: find better exception
             throw PlanningReport::QPFAILED;
@@ -106,6 +131,173 @@ namespace DynamicPlanning {
         return goal;
     }
 
+    // The cost is t, so the solution is the lower bound of the feasible interval
+    bool GoalOptimizer::solveAnalytic(const std::vector<GoalConstraint> &goal_constraints, double &t) {
+        double t_min = 0;
+        double t_max = 1 + SP_EPSILON_FLOAT;
+        for (const auto &goal_constraint: goal_constraints) {
+            if (goal_constraint.coef > SP_EPSILON) {
+                t_min = std::max(t_min, goal_constraint.lower / goal_constraint.coef);
+            } else if (goal_constraint.coef < -SP_EPSILON) {
+                t_max = std::min(t_max, goal_constraint.lower / goal_constraint.coef);
+            } else if (goal_constraint.lower > SP_EPSILON_FLOAT) {
+                return false; // 0 >= lower
+            }
+        }
+
+        if (t_min > t_max + SP_EPSILON_FLOAT) {
+            return false;
+        }
+
+        t = std::min(t_min, t_max);
+        return true;
+    }
+
+    bool GoalOptimizer::solveWithQPSolver(const std::vector<GoalConstraint> &goal_constraints, int threads,
+                                          double &t) {
+        TRACE_SCOPE("GoalOptimizer::solveWithQPSolver");
+        QPProblem problem = buildQPProblem(goal_constraints);
+        problem.x_start = Eigen::VectorXd::Constant(1, prev_t);
+
+        qp_solver->setThreads(threads);
+        QPSolution solution;
+        if (not qp_solver->solve(problem, solution)) {
+            return false;
+        }
+
+        t = solution.x(0);
+        prev_t = t;
+        return true;
+    }
+
+    bool GoalOptimizer::solvePersistent(const std::vector<GoalConstraint> &goal_constraints, int threads,
+                                        double &t, std::string &status) {
+        TRACE_SCOPE("GoalOptimizer::solvePersistent");
+        // Variable and cost do not change between steps
+        if (lp_model == nullptr) {
+            lp_model = std::make_unique<PersistentLPModel>();
+            IloEnv env = lp_model->env;
+            lp_model->var.add(IloNumVar(env, 0, 1 + SP_EPSILON_FLOAT));
+            lp_model->var[0].setName("t");
+            lp_model->model.add(IloMinimize(env, lp_model->var[0]));
+            lp_model->cplex.setParam(IloCplex::Param::Advance, 1);
+            if (not param.log_solver) {
+                lp_model->cplex.setOut(env.getNullStream());
+                lp_model->cplex.setWarning(env.getNullStream());
+            }
+            lp_model->cplex.extract(lp_model->model);
+        }
+
+        // Rows are rebuilt
+        IloEnv env = lp_model->env;
+        if (lp_model->con.getSize() > 0) {
+            lp_model->model.remove(lp_model->con);
+            lp_model->con.endElements();
+            lp_model->con.clear();
+        }
+        for (const auto &goal_constraint: goal_constraints) {
+            lp_model->con.add(IloRange(env, goal_constraint.lower, goal_constraint.coef * lp_model->var[0],
+                                       IloInfinity));
+        }
+        lp_model->model.add(lp_model->con);
+
+        IloCplex cplex = lp_model->cplex;
+        cplex.setParam(IloCplex::Param::Threads, threads);
+
+        // Warm start from the previous goal
+        IloNumArray start_vals(env, 1);
+        start_vals[0] = prev_t;
+        cplex.setStart(start_vals, 0, lp_model->var, 0, 0, 0);
+        start_vals.end();
+
+        if (param.log_solver) {
+            std::string QPmodel_path = param.package_path + "/log/QPmodel_goalOpt.lp";
+            cplex.exportModel(QPmodel_path.c_str());
+        }
+
+        try {
+            if (not cplex.solve()) {
+                std::ostringstream status_stream;
+                status_stream << cplex.getStatus();
+                status = status_stream.str();
+                lp_model.reset();
+                return false;
+            }
+            t = cplex.getValue(lp_model->var[0]);
+        }
+        catch (IloException &e) {
+            std::ostringstream status_stream;
+            status_stream << cplex.getStatus() << ": " << e;
+            status = status_stream.str();
+            lp_model.reset();
+            return false;
+        }
+
+        prev_t = t;
+        return true;
+    }
+
+    void GoalOptimizer::reportQPFailure(const Agent &agent,
+                                        const std::vector<GoalConstraint> &goal_constraints,
+                                        const std::string &status) const {
+        ROS_ERROR_STREAM("[GoalOptimizer] LP failed at mav " << agent.id << ", " << status);
+        if (not param.log_qp_failure) {
+            return;
+        }
+
+        QPFailureReport report;
+        report.problem_name = "goalOpt";
+        report.agent_id = agent.id;
+        report.status = status;
+        report.log_dir = param.package_path + "/log/qp_failure";
+        report.problem = buildQPProblem(goal_constraints);
+        QPFailureDiagnoser::getInstance().submit(std::move(report));
+    }
+
+    // n^T((g - w)t + w - c) - d >= 0  ->  n^T(g - w)t >= n^T(c - w) + d
+    std::vector<GoalConstraint> GoalOptimizer::buildConstraints(const CollisionConstraints &constraints,
+                                                                const point3d &current_goal_point,
+                                                                const point3d &next_waypoint) const {
+        std::vector<GoalConstraint> goal_constraints;
+        auto addLSC = [&](const LSC &lsc) {
+            GoalConstraint goal_constraint{0, lsc.d};
+            for (int k = 0; k < param.world_dimension; k++) {
+                goal_constraint.coef += lsc.normal_vector(k) * (current_goal_point(k) - next_waypoint(k));
+                goal_constraint.lower += lsc.normal_vector(k) * (lsc.obs_control_point(k) - next_waypoint(k));
+            }
+            goal_constraints.emplace_back(goal_constraint);
+        };
+
+        // SFC
+        if (param.world_use_octomap) {
+            for (const auto &lsc: constraints.getSFC(param.M - 1).convertToLSCs(param.world_dimension)) {
+                addLSC(lsc);
+            }
+        }
+
+        // LSC or BVC
+        for (size_t oi = 0; oi < constraints.getObsSize(); oi++) {
+            LSC lsc = constraints.getLSC(oi, param.M - 1, param.n);
+            if (lsc.normal_vector.norm() < SP_EPSILON_FLOAT) {
+                continue;
+            }
+            addLSC(lsc);
+        }
+
+        return goal_constraints;
+    }
+
+    QPProblem GoalOptimizer::buildQPProblem(const std::vector<GoalConstraint> &goal_constraints) const {
+        QPBuilder builder;
+        int t = builder.addVariable(0, 1 + SP_EPSILON_FLOAT, "t");
+        builder.addLinearCost(t, 1);
+        for (const auto &goal_constraint: goal_constraints) {
+            builder.addRow({{t, goal_constraint.coef}}, goal_constraint.lower, QP_INFINITY);
+        }
+
+        return builder.build();
+    }
+
     void GoalOptimizer::populatebyrow(IloModel model, IloNumVarArray x, IloRangeArray c,
                                       const Agent &agent, const CollisionConstraints &constraints,
                                       const point3d &current_goal_point,
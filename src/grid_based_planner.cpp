@@ -1,6 +1,11 @@
 #include <grid_based_planner.hpp>
+#include <timer.hpp>
+#include <trace.hpp>
+#include <metrics_registry.hpp>
 
 namespace DynamicPlanning {
+    static constexpr size_t STATIC_LAYER_BATCH_SIZE = 64; // cells thresholded by a batch query of the distmap
+
     GridNode GridNode::operator+(const GridNode &other_node) const {
         return {i() + other_node.i(), j() + other_node.j(), k() + other_node.k()};
     }
@@ -52,42 +57,248 @@ namespace DynamicPlanning {
         return sqrt(i() * i() + j() * j() + k() * k());
     }
 
+    void GridMap::reset(const std::array<int, 3> &_dim) {
+        dim = _dim;
+        size_t n_cells = static_cast<size_t>(dim[0]) * dim[1] * dim[2];
+        words.assign((n_cells + 63) / 64, 0);
+    }
+
+    void GridMap::setOccupiedRun(int i, int j, int k_min, int k_max) {
+        size_t begin = index(i, j, k_min);
+        size_t end = index(i, j, k_max) + 1;
+        while (begin < end) {
+            size_t offset = begin & 63;
+            size_t n_bits = std::min<size_t>(64 - offset, end - begin);
+            uint64_t mask = n_bits == 64 ? ~uint64_t(0) : ((uint64_t(1) << n_bits) - 1) << offset;
+            words[begin >> 6] |= mask;
+            begin += n_bits;
+        }
+    }
+
+    size_t GridMap::countOccupied() const {
+        size_t count = 0;
+        for (uint64_t word: words) {
+            count += __builtin_popcountll(word);
+        }
+        return count;
+    }
+
+    bool GridMap::isSubsetOf(const GridMap &map) const {
+        for (size_t wi = 0; wi < words.size(); wi++) {
+            if (words[wi] & ~map.words[wi]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    MAPF::GridView GridMap::getView() const {
+        MAPF::GridView view;
+        view.words = words.data();
+        view.width = dim[0];
+        view.height = dim[1];
+        view.depth = dim[2];
+        view.stride_x = static_cast<size_t>(dim[1]) * dim[2];
+        view.stride_y = dim[2];
+        view.stride_z = 1;
+        return view;
+    }
+
+    void SpaceTimeOccupancy::reset(const std::array<int, 3> &dim, size_t _n_slices) {
+        n_slices = _n_slices;
+        if (slices.size() < n_slices) {
+            slices.resize(n_slices);
+        }
+        for (size_t slice = 0; slice < n_slices; slice++) {
+            slices[slice].reset(dim);
+        }
+    }
+
     GridBasedPlanner::GridBasedPlanner(const DynamicPlanning::Param &_param,
-                                       const DynamicPlanning::Mission &_mission)
+                                       const std::shared_ptr<const DynamicPlanning::Mission> &_mission)
             : param(_param), mission(_mission) {
         updateGridInfo();
+        for (auto &sapf_planner: sapf_planners) {
+            sapf_planner.setConnectivity(param.grid_connectivity);
+        }
+    }
+
+    GridBasedPlanner::~GridBasedPlanner() {
+        cancelRefinements();
     }
 
     bool GridBasedPlanner::planSAPF(const Agent &agent,
-                                    const std::shared_ptr<DynamicEDTOctomap> &_distmap_ptr,
+                                    const std::shared_ptr<DistanceMap> &_distmap_ptr,
+                                    const std::shared_ptr<MapChangeLog> &_map_change_log_ptr,
                                     const std::vector<Obstacle> &obstacles,
-                                    const std::set<int> &grid_obstacles) {
+                                    const std::vector<size_t> &grid_obstacles) {
+        TRACE_SCOPE("GridBasedPlanner::planSAPF");
         distmap_ptr = _distmap_ptr;
+        map_change_log_ptr = _map_change_log_ptr;
         updateGridMap(agent.radius, agent.downwash, obstacles, grid_obstacles);
         updateGridMission(agent.current_state.position, agent.desired_goal_point);
 
-        bool success = planImpl(false);
+        // The grid maps with and without the priority obstacles differ every call, so each of them has its own search
+        IncrementalPathPlanner &sapf_planner = sapf_planners[grid_obstacles.empty() ? 0 : 1];
+        bool success = planImpl(false, &sapf_planner);
         return success;
     }
 
+    void GridBasedPlanner::setOccupancyIndex(const std::shared_ptr<OccupancyIndex> &_occupancy_index_ptr) {
+        occupancy_index_ptr = _occupancy_index_ptr;
+    }
+
+    const PrimitiveWorld *GridBasedPlanner::getPrimitiveWorld() const {
+        return dynamic_cast<const PrimitiveWorld *>(distmap_ptr.get());
+    }
+
+    void GridBasedPlanner::setObstaclePredictionTable(std::shared_ptr<const ObstaclePredictionTable> table) {
+        obstacle_prediction_table = std::move(table);
+    }
+
+    void GridBasedPlanner::resetMission(const std::shared_ptr<const Mission> &_mission) {
+        cancelRefinements();
+        rolling_plans.clear();
+        mission = _mission;
+        obstacle_prediction_table.reset();
+        plan_result = PlanResult();
+        for (auto &sapf_planner: sapf_planners) {
+            sapf_planner.reset();
+        }
+    }
+
+    void GridBasedPlanner::updateParam(const Param &_param) {
+        bool is_grid_changed = param.grid_resolution != _param.grid_resolution or
+                               param.grid_connectivity != _param.grid_connectivity or
+                               param.grid_distance_table_capacity != _param.grid_distance_table_capacity;
+        param = _param;
+        cancelRefinements();
+        rolling_plans.clear(); // the window or the solver may be changed
+        if (is_grid_changed) {
+            updateGridInfo();
+            has_static_layer = false;
+            shared_static_layer.reset();
+            distance_table_caches.clear();
+            mapf_graphs.clear();
+            for (auto &sapf_planner: sapf_planners) {
+                sapf_planner.setConnectivity(param.grid_connectivity);
+                sapf_planner.reset();
+            }
+        }
+    }
+
+    void GridBasedPlanner::updateGridMap(const std::shared_ptr<DistanceMap> &_distmap_ptr,
+                                         const std::shared_ptr<MapChangeLog> &_map_change_log_ptr,
+                                         double agent_radius, double agent_downwash) {
+        distmap_ptr = _distmap_ptr;
+        map_change_log_ptr = _map_change_log_ptr;
+        updateGridMap(agent_radius, agent_downwash);
+    }
+
     bool GridBasedPlanner::planMAPF(const points_t &start_points,
                                     const points_t &current_points,
                                     const points_t &goal_points,
-                                    const std::shared_ptr<DynamicEDTOctomap> &_distmap_ptr,
+                                    const std::shared_ptr<DistanceMap> &_distmap_ptr,
+                                    const std::shared_ptr<MapChangeLog> &_map_change_log_ptr,
                                     double agent_radius, double agent_downwash) {
         distmap_ptr = _distmap_ptr;
+        map_change_log_ptr = _map_change_log_ptr;
         updateGridMap(agent_radius, agent_downwash);
+        updateSpaceTimeOccupancy(agent_radius, agent_downwash);
         updateGridMission(start_points, current_points, goal_points);
 
         bool success = planImpl(true);
         return success;
     }
 
+    std::vector<MAPFGroupResult> GridBasedPlanner::planMAPFGroups(
+            const std::vector<MAPFGroupMission> &group_missions,
+            const std::shared_ptr<DistanceMap> &_distmap_ptr,
+            const std::shared_ptr<MapChangeLog> &_map_change_log_ptr,
+            double agent_radius, double agent_downwash,
+            bool parallel,
+            const PlanningDeadline &deadline) {
+        TRACE_SCOPE("GridBasedPlanner::planMAPFGroups");
+        distmap_ptr = _distmap_ptr;
+        map_change_log_ptr = _map_change_log_ptr;
+        updateGridMap(agent_radius, agent_downwash);
+        updateSpaceTimeOccupancy(agent_radius, agent_downwash);
+
+        // The caches and the rolling plans are created before the groups run
+        std::vector<MAPF::DistanceTableCache *> group_caches(group_missions.size());
+        std::vector<RollingMAPFPlan *> group_rolling_plans(group_missions.size());
+        std::vector<MAPFGraph *> group_graphs(group_missions.size());
+        for (size_t gi = 0; gi < group_missions.size(); gi++) {
+            group_caches[gi] = getDistanceTableCache(gi);
+            group_rolling_plans[gi] = &getRollingPlan(gi);
+            group_graphs[gi] = &getMAPFGraph(gi);
+        }
+
+        std::vector<MAPFGroupResult> results(group_missions.size());
+        auto task = [&](size_t gi) {
+            Timer timer;
+            MAPFGroupResult &result = results[gi];
+            if (deadline.isExpired()) {
+                result.skipped = true;
+                return;
+            }
+            int time_limit = param.grid_mapf_time_limit;
+            if (deadline.isBounded()) {
+                auto remaining_time_limit = static_cast<int>(std::ceil(deadline.getRemainingSeconds() * 1e3));
+                time_limit = std::max(std::min(time_limit, remaining_time_limit), 1);
+            }
+
+            const MAPFGroupMission &group_mission = group_missions[gi];
+            if (group_mission.is_stalled) {
+                group_rolling_plans[gi]->paths.clear();
+            }
+            GridNodes occluded_nodes;
+            GridMission group_grid_mission = getGridMission(group_mission.start_points,
+                                                            group_mission.current_points,
+                                                            group_mission.goal_points,
+                                                            occluded_nodes);
+
+            // The grid map is shared by the groups, so a group with occluded points frees them on its own copy
+            const GridMap *group_grid_map = &grid_map;
+            GridMap occlusion_free_grid_map;
+            if (not occluded_nodes.empty()) {
+                occlusion_free_grid_map = grid_map;
+                for (const auto &occluded_node: occluded_nodes) {
+                    occlusion_free_grid_map.setValue(occluded_node, GP_EMPTY);
+                }
+                group_grid_map = &occlusion_free_grid_map;
+            }
+
+            std::vector<gridpath_t> grid_paths = runWindowedMAPF(*group_grid_map, group_grid_mission,
+                                                                 *group_rolling_plans[gi], group_caches[gi],
+                                                                 group_graphs[gi], time_limit, result.reused);
+            result.success = not grid_paths.empty();
+            if (result.success) {
+                result.paths.resize(group_grid_mission.n_agents);
+                for (size_t i = 0; i < group_grid_mission.n_agents; i++) {
+                    result.paths[i] = gridPathToPath(grid_paths[i]);
+                }
+            }
+            timer.stop();
+            result.planning_time = timer.elapsedSeconds();
+        };
+
+        if (parallel and group_missions.size() > 1) {
+            WorkerPool::getInstance().run(group_missions.size(), task);
+        } else {
+            for (size_t gi = 0; gi < group_missions.size(); gi++) {
+                task(gi);
+            }
+        }
+
+        return results;
+    }
+
     void GridBasedPlanner::updateGridInfo() {
         double grid_resolution = param.grid_resolution;
         for (int i = 0; i < 3; i++) {
-            grid_info.grid_min[i] = -floor((-mission.world_min(i) + SP_EPSILON) / grid_resolution) * grid_resolution;
-            grid_info.grid_max[i] = floor((mission.world_max(i) + SP_EPSILON) / grid_resolution) * grid_resolution;
+            grid_info.grid_min[i] = -floor((-mission->world_min(i) + SP_EPSILON) / grid_resolution) * grid_resolution;
+            grid_info.grid_max[i] = floor((mission->world_max(i) + SP_EPSILON) / grid_resolution) * grid_resolution;
         }
         if (param.world_dimension == 2) {
             grid_info.grid_min[2] = param.world_z_2d;
@@ -102,106 +313,441 @@ namespace DynamicPlanning {
     void GridBasedPlanner::updateGridMap(double agent_radius,
                                          double agent_downwash,
                                          const std::vector<Obstacle> &obstacles,
-                                         const std::set<int> &grid_obstacles) {
-        // Initialize gridmap
-        grid_map.grid.resize(grid_info.dim[0]);
-        for (int i = 0; i < grid_info.dim[0]; i++) {
-            grid_map.grid[i].resize(grid_info.dim[1]);
-            for (int j = 0; j < grid_info.dim[1]; j++) {
-                grid_map.grid[i][j].resize(grid_info.dim[2]);
-                for (int k = 0; k < grid_info.dim[2]; k++) {
-                    grid_map.grid[i][j][k] = GP_EMPTY;
-                }
+                                         const std::vector<size_t> &grid_obstacles) {
+        TRACE_SCOPE("GridBasedPlanner::updateGridMap");
+        // The footprints of the obstacles are stamped on a copy of the static layer
+        updateStaticLayer(agent_radius);
+        grid_map = getStaticLayer();
+
+        for (size_t oi: grid_obstacles) {
+            std::shared_ptr<const ObstacleFootprint> footprint = ObstacleFootprintCache::getInstance().acquire(
+                    getObstacleFootprintKey(agent_radius, agent_downwash, obstacles[oi]),
+                    [&](ObstacleFootprint &new_footprint) {
+                        buildObstacleFootprint(agent_radius, agent_downwash, obstacles[oi], new_footprint);
+                    });
+            for (const auto &run: footprint->runs) {
+                grid_map.setOccupiedRun(run[0], run[1], run[2], run[3]);
             }
         }
+    }
 
-        // Update distmap to gridmap
-        if (distmap_ptr != nullptr) {
-            point3d delta(0.5 * param.world_resolution, 0.5 * param.world_resolution, 0.5 * param.world_resolution);
-            for (int i = 0; i < grid_info.dim[0]; i++) {
-                for (int j = 0; j < grid_info.dim[1]; j++) {
-                    for (int k = 0; k < grid_info.dim[2]; k++) {
-                        float dist;
-                        point3d search_point, closest_point;
-                        search_point = gridNodeToPoint3D(GridNode(i, j, k));
-                        distmap_ptr->getDistanceAndClosestObstacle(search_point, dist, closest_point);
-                        Box closest_cell(closest_point - delta, closest_point + delta);
-                        closest_point = closest_cell.closestPoint(search_point);
-
-                        // Due to numerical error of getDistance function, explicitly compute distance to obstacle
-                        double dist_to_obs = LInfinityDistance(search_point, closest_point);
-                        if (dist_to_obs < agent_radius - SP_EPSILON_FLOAT) {
-                            grid_map.grid[i][j][k] = GP_OCCUPIED;
-                        }
-                    }
-                }
+    void GridBasedPlanner::buildObstacleFootprint(double agent_radius, double agent_downwash,
+                                                  const Obstacle &obstacle, ObstacleFootprint &footprint) const {
+        std::vector<point3d> grid_obstacle_positions;
+        if (obstacle.type == ObstacleType::AGENT) {
+            grid_obstacle_positions.emplace_back(obstacle.position);
+        } else {
+            double sample_dt = 0.1;
+            size_t total_sample = floor(param.obs_uncertainty_horizon / sample_dt) + 1;
+            for (size_t i = 0; i < total_sample; i++) {
+                point3d obs_position = obstacle.position + obstacle.velocity * i * sample_dt;
+                grid_obstacle_positions.emplace_back(obs_position);
             }
         }
 
+        for (const auto &obs_position: grid_obstacle_positions) {
+            // Update higher priority agent as an obstacle to gridmap
+            double obstacle_radius, downwash;
+            if (obstacle.type == ObstacleType::AGENT) {
+                obstacle_radius = obstacle.radius;
+                downwash = (agent_radius * agent_downwash + obstacle.radius * obstacle.downwash) /
+                           (agent_radius + obstacle.radius);
+            } else {
+                obstacle_radius = obstacle.radius +
+                                  0.5 * obstacle.max_acc * param.obs_uncertainty_horizon *
+                                  param.obs_uncertainty_horizon;
+                // obstacle_radius = obstacle.radius;
+                downwash = (agent_radius + obstacle.radius * obstacle.downwash) / (agent_radius + obstacle.radius);
+            }
+
+            int size_z = ceil((agent_radius * agent_downwash + obstacle.radius * obstacle.downwash) /
+                              param.grid_resolution);
+            appendFootprintRuns(obs_position, agent_radius, obstacle_radius, downwash, size_z, footprint.runs);
+        }
+    }
+
+    ObstacleFootprintKey GridBasedPlanner::getObstacleFootprintKey(double agent_radius, double agent_downwash,
+                                                                   const Obstacle &obstacle) const {
+        ObstacleFootprintKey key;
+        key.values = {grid_info.grid_min[0], grid_info.grid_min[1], grid_info.grid_min[2],
+                      static_cast<double>(grid_info.dim[0]), static_cast<double>(grid_info.dim[1]),
+                      static_cast<double>(grid_info.dim[2]), param.grid_resolution,
+                      static_cast<double>(param.world_dimension), param.obs_uncertainty_horizon,
+                      agent_radius, agent_downwash,
+                      static_cast<double>(obstacle.type),
+                      obstacle.position.x(), obstacle.position.y(), obstacle.position.z(),
+                      obstacle.velocity.x(), obstacle.velocity.y(), obstacle.velocity.z(),
+                      obstacle.radius, obstacle.downwash, obstacle.max_acc};
+        return key;
+    }
+
+    void GridBasedPlanner::updateSpaceTimeOccupancy(double agent_radius, double agent_downwash) {
+        // The slices cover the prediction horizon, a slice per MAPF timestep
+        double space_time_step = param.grid_space_time_step;
+        if (space_time_step <= 0 or obstacle_prediction_table == nullptr or obstacle_prediction_table->size() == 0) {
+            space_time_occupancy.reset(grid_info.dim, 0);
+            return;
+        }
+        double horizon = param.M * param.dt;
+        auto n_slices = static_cast<size_t>(floor((horizon + SP_EPSILON) / space_time_step)) + 1;
+        space_time_occupancy.reset(grid_info.dim, n_slices);
 
         double grid_resolution = param.grid_resolution;
-        for (int oi: grid_obstacles) {
-            std::vector<point3d> grid_obstacle_positions;
-            if (obstacles[oi].type == ObstacleType::AGENT) {
-                grid_obstacle_positions.emplace_back(obstacles[oi].position);
-            } else {
-                double sample_dt = 0.1;
-                size_t total_sample = floor(param.obs_uncertainty_horizon / sample_dt) + 1;
-                for (size_t i = 0; i < total_sample; i++) {
-                    point3d obs_position = obstacles[oi].position + obstacles[oi].velocity * i * sample_dt;
-                    grid_obstacle_positions.emplace_back(obs_position);
+        for (size_t idx = 0; idx < obstacle_prediction_table->size(); idx++) {
+            const Obstacle &obstacle = obstacle_prediction_table->getState(idx);
+            const traj_t &obs_pred_traj = obstacle_prediction_table->getTraj(idx);
+            const Trajectory<double> &obs_pred_size = obstacle_prediction_table->getSize(idx);
+            double downwash = (agent_radius + obstacle.radius * obstacle.downwash) / (agent_radius + obstacle.radius);
+            int size_z = ceil((agent_radius * agent_downwash + obstacle.radius * obstacle.downwash) / grid_resolution);
+            for (size_t slice = 0; slice < n_slices; slice++) {
+                double t = std::min(slice * space_time_step, horizon);
+                stampFootprint(space_time_occupancy.getSlice(slice), obs_pred_traj.getPointAt(t), agent_radius,
+                               obs_pred_size.getPointAt(t), downwash, size_z);
+            }
+        }
+    }
+
+    void GridBasedPlanner::stampFootprint(GridMap &map, const point3d &obs_position, double agent_radius,
+                                          double obstacle_radius, double downwash, int size_z) const {
+        footprint_runs.clear();
+        appendFootprintRuns(obs_position, agent_radius, obstacle_radius, downwash, size_z, footprint_runs);
+        for (const auto &run: footprint_runs) {
+            map.setOccupiedRun(run[0], run[1], run[2], run[3]);
+        }
+    }
+
+    void GridBasedPlanner::appendFootprintRuns(const point3d &obs_position, double agent_radius,
+                                               double obstacle_radius, double downwash, int size_z,
+                                               std::vector<std::array<int, 4>> &runs) const {
+        double grid_resolution = param.grid_resolution;
+        int obs_i, obs_j, obs_k = 0;
+        obs_i = (int) round((obs_position.x() - grid_info.grid_min[0] + SP_EPSILON) / grid_resolution);
+        obs_j = (int) round((obs_position.y() - grid_info.grid_min[1] + SP_EPSILON) / grid_resolution);
+        if (param.world_dimension != 2) {
+            obs_k = (int) round((obs_position.z() - grid_info.grid_min[2] + SP_EPSILON) / grid_resolution);
+        }
+
+        // The cells of a row within the ellipsoid are contiguous along z, so each row of the stencil is solved for
+        // its run of cells instead of testing the cells one by one
+        double radius = agent_radius + obstacle_radius;
+        double sq_radius = radius * radius;
+        int k_lower = std::max(obs_k - size_z, 0);
+        int k_upper = std::min(obs_k + size_z, grid_info.dim[2] - 1);
+        if (k_lower > k_upper) {
+            return;
+        }
+        for (const auto &row: getFootprintStencil(radius, downwash).rows) {
+            int i = obs_i + row[0];
+            int j = obs_j + row[1];
+            if (i < 0 or i >= grid_info.dim[0] or j < 0 or j >= grid_info.dim[1]) {
+                continue;
+            }
+
+            point3d point = gridNodeToPoint3D(GridNode(i, j, k_lower));
+            double dx = point.x() - obs_position.x();
+            double dy = point.y() - obs_position.y();
+            double sq_rem = sq_radius - dx * dx - dy * dy;
+            if (sq_rem <= 0) {
+                continue;
+            }
+
+            // |z - obs_z| < downwash * sqrt(sq_rem)
+            double half_height = downwash * sqrt(sq_rem);
+            int k_min = k_lower, k_max = k_upper;
+            if (param.world_dimension != 2) {
+                double z_min = obs_position.z() - half_height - grid_info.grid_min[2];
+                double z_max = obs_position.z() + half_height - grid_info.grid_min[2];
+                k_min = std::max(k_lower, (int) floor(z_min / grid_resolution) + 1);
+                k_max = std::min(k_upper, (int) ceil(z_max / grid_resolution) - 1);
+            } else if (std::abs(point.z() - obs_position.z()) >= half_height) {
+                continue;
+            }
+            if (k_min <= k_max) {
+                runs.push_back({i, j, k_min, k_max});
+            }
+        }
+    }
+
+    const FootprintStencil &GridBasedPlanner::getFootprintStencil(double radius, double downwash) const {
+        double grid_resolution = param.grid_resolution;
+        auto key = std::make_tuple(radius, downwash, grid_resolution);
+        auto it = footprint_stencils.find(key);
+        if (it != footprint_stencils.end()) {
+            return it->second;
+        }
+
+        // The predicted sizes of the dynamic obstacles change continuously, so the cache is bounded
+        static constexpr size_t MAX_STENCILS = 256;
+        if (footprint_stencils.size() >= MAX_STENCILS) {
+            footprint_stencils.clear();
+        }
+
+        FootprintStencil stencil;
+        int size_xy = ceil(radius / grid_resolution);
+        double sq_radius = radius * radius;
+        for (int di = -size_xy; di <= size_xy; di++) {
+            for (int dj = -size_xy; dj <= size_xy; dj++) {
+                double dx = std::max((std::abs(di) - 0.5) * grid_resolution - SP_EPSILON_FLOAT, 0.0);
+                double dy = std::max((std::abs(dj) - 0.5) * grid_resolution - SP_EPSILON_FLOAT, 0.0);
+                if (dx * dx + dy * dy < sq_radius) {
+                    stencil.rows.push_back({di, dj});
                 }
             }
+        }
+        return footprint_stencils.emplace(key, std::move(stencil)).first->second;
+    }
 
-            for (const auto &obs_position: grid_obstacle_positions) {
-                int obs_i, obs_j, obs_k = 0;
-                // Update higher priority agent as an obstacle to gridmap
-                obs_i = (int) round(
-                        (obs_position.x() - grid_info.grid_min[0] + SP_EPSILON) / grid_resolution);
-                obs_j = (int) round(
-                        (obs_position.y() - grid_info.grid_min[1] + SP_EPSILON) / grid_resolution);
-                if (param.world_dimension != 2) {
-                    obs_k = (int) round(
-                            (obs_position.z() - grid_info.grid_min[2] + SP_EPSILON) / grid_resolution);
+    void GridBasedPlanner::updateStaticLayer(double agent_radius) {
+        Timer timer;
+        GridMapUpdateReport report;
+        report.n_cells = static_cast<size_t>(grid_info.dim[0]) * grid_info.dim[1] * grid_info.dim[2];
+
+        if (isStaticLayerShareable()) {
+            StaticLayerKey key{distmap_ptr.get(), grid_info.dim, grid_info.grid_min, param.grid_resolution,
+                               agent_radius};
+            if (shared_static_layer == nullptr or not(shared_static_layer->key == key)) {
+                // The own layer is thresholded once by the first planner of the key and moved to the shared one
+                shared_static_layer = StaticLayerRegistry::getInstance().acquire(
+                        key, distmap_ptr, [this, agent_radius, &report](GridMap &layer) {
+                            static_layer.reset(grid_info.dim);
+                            thresholdStaticLayer({0, 0, 0},
+                                                 {grid_info.dim[0] - 1, grid_info.dim[1] - 1, grid_info.dim[2] - 1},
+                                                 agent_radius, false, report);
+                            layer = std::move(static_layer);
+                            static_layer = GridMap();
+                        }, report.full_rebuild);
+                has_static_layer = false;
+            }
+            report.n_dirty_cells = report.full_rebuild ? report.n_cells : 0;
+
+            timer.stop();
+            report.update_time = timer.elapsedSeconds();
+            if (report.full_rebuild) {
+                full_rebuild_time_per_cell = report.n_cells > 0 ? report.update_time / report.n_cells : 0;
+            } else if (full_rebuild_time_per_cell > 0) {
+                report.time_saved = full_rebuild_time_per_cell * report.n_cells - report.update_time;
+            }
+            grid_map_update_report = report;
+            return;
+        }
+        shared_static_layer.reset();
+
+        // Read the version first, the changes after this version are applied again in the next update
+        uint64_t version = map_change_log_ptr != nullptr ? map_change_log_ptr->getVersion() : 0;
+        std::vector<MapChangeLog::Region> regions;
+        report.full_rebuild = not has_static_layer or map_change_log_ptr == nullptr or
+                              distmap_ptr.get() != static_layer_distmap or
+                              std::abs(agent_radius - static_layer_agent_radius) > SP_EPSILON or
+                              not map_change_log_ptr->getChangesSince(static_layer_version, regions);
+
+        if (report.full_rebuild) {
+            static_layer.reset(grid_info.dim);
+            if (distmap_ptr != nullptr) {
+                thresholdStaticLayer({0, 0, 0}, {grid_info.dim[0] - 1, grid_info.dim[1] - 1, grid_info.dim[2] - 1},
+                                     agent_radius, false, report);
+            }
+            report.n_dirty_cells = report.n_cells;
+        } else if (not regions.empty() and distmap_ptr != nullptr) {
+            // A cell depends on the voxels within agent_radius, so the regions are inflated by agent_radius
+            double grid_resolution = param.grid_resolution;
+            double inflation = agent_radius + grid_resolution;
+            dirty_mask.reset(grid_info.dim);
+            for (const auto &region: regions) {
+                std::array<int, 3> index_min{}, index_max{};
+                for (int axis = 0; axis < 3; axis++) {
+                    index_min[axis] = std::max(
+                            (int) ceil((region.first(axis) - inflation - grid_info.grid_min[axis]) / grid_resolution),
+                            0);
+                    index_max[axis] = std::min(
+                            (int) floor((region.second(axis) + inflation - grid_info.grid_min[axis]) / grid_resolution),
+                            grid_info.dim[axis] - 1);
+                }
+                if (param.world_dimension == 2) {
+                    index_min[2] = 0;
+                    index_max[2] = 0;
                 }
 
-                double obstacle_radius, downwash, dist;
-                if (obstacles[oi].type == ObstacleType::AGENT) {
-                    obstacle_radius = obstacles[oi].radius;
-                    downwash = (agent_radius * agent_downwash + obstacles[oi].radius * obstacles[oi].downwash) /
-                               (agent_radius + obstacles[oi].radius);
-                } else {
-                    obstacle_radius = obstacles[oi].radius +
-                                      0.5 * obstacles[oi].max_acc * param.obs_uncertainty_horizon *
-                                      param.obs_uncertainty_horizon;
-                    // obstacle_radius = obstacles[oi].radius;
-                    downwash = (agent_radius + obstacles[oi].radius * obstacles[oi].downwash) /
-                               (agent_radius + obstacles[oi].radius);
+                if (index_min[0] <= index_max[0] and index_min[1] <= index_max[1] and index_min[2] <= index_max[2]) {
+                    thresholdStaticLayer(index_min, index_max, agent_radius, true, report);
                 }
+            }
+        }
 
-                int size_xy, size_z;
-                size_xy = ceil((agent_radius + obstacle_radius) / grid_resolution);
-                size_z = ceil((agent_radius * agent_downwash + obstacles[oi].radius * obstacles[oi].downwash) /
-                              grid_resolution);
-
-                for (int i = std::max(obs_i - size_xy, 0);
-                     i <= std::min(obs_i + size_xy, grid_info.dim[0] - 1); i++) {
-                    for (int j = std::max(obs_j - size_xy, 0);
-                         j <= std::min(obs_j + size_xy, grid_info.dim[1] - 1); j++) {
-                        for (int k = std::max(obs_k - size_z, 0);
-                             k <= std::min(obs_k + size_z, grid_info.dim[2] - 1); k++) {
-                            if (grid_map.grid[i][j][k] != GP_OCCUPIED) {
-                                point3d point = gridNodeToPoint3D(GridNode(i, j, k));
-                                dist = ellipsoidalDistance(point, obs_position, downwash);
-                                if (dist < agent_radius + obstacle_radius) {
-                                    grid_map.grid[i][j][k] = GP_OCCUPIED;
-                                }
-                            }
+        has_static_layer = true;
+        static_layer_distmap = distmap_ptr.get();
+        static_layer_version = version;
+        static_layer_agent_radius = agent_radius;
+
+        timer.stop();
+        report.update_time = timer.elapsedSeconds();
+        if (report.full_rebuild) {
+            if (report.n_cells > 0 and distmap_ptr != nullptr) {
+                full_rebuild_time_per_cell = report.update_time / report.n_cells;
+            }
+        } else if (full_rebuild_time_per_cell > 0) {
+            report.time_saved = full_rebuild_time_per_cell * report.n_cells - report.update_time;
+        }
+        grid_map_update_report = report;
+    }
+
+    bool GridBasedPlanner::isStaticLayerShareable() const {
+        return param.world_use_octomap and param.world_use_global_map and distmap_ptr != nullptr and
+               map_change_log_ptr != nullptr;
+    }
+
+    ObstacleFootprintCache &ObstacleFootprintCache::getInstance() {
+        static ObstacleFootprintCache cache;
+        return cache;
+    }
+
+    std::shared_ptr<const ObstacleFootprint> ObstacleFootprintCache::acquire(const ObstacleFootprintKey &key,
+                                                                           const Builder &builder) {
+        static MetricCounter &footprint_builds = MetricsRegistry::getInstance().getCounter(
+                "lsc_obstacle_footprint_builds_total", "Footprints of the grid obstacles built");
+        static MetricCounter &footprint_reuses = MetricsRegistry::getInstance().getCounter(
+                "lsc_obstacle_footprint_reuses_total", "Footprints of the grid obstacles built by another planner");
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            auto it = footprints.find(key);
+            if (it != footprints.end()) {
+                footprint_reuses.increment();
+                return it->second;
+            }
+        }
+
+        auto footprint = std::make_shared<ObstacleFootprint>();
+        builder(*footprint);
+        footprint_builds.increment();
+        std::lock_guard<std::mutex> lock(mtx);
+        if (footprints.size() >= MAX_FOOTPRINTS) {
+            footprints.clear();
+        }
+        return footprints.emplace(key, std::move(footprint)).first->second;
+    }
+
+    StaticLayerRegistry &StaticLayerRegistry::getInstance() {
+        static StaticLayerRegistry registry;
+        return registry;
+    }
+
+    std::shared_ptr<const SharedStaticLayer> StaticLayerRegistry::acquire(
+            const StaticLayerKey &key, const std::shared_ptr<const DistanceMap> &distmap, const Builder &builder,
+            bool &is_built) {
+        static MetricCounter &layer_builds = MetricsRegistry::getInstance().getCounter(
+                "lsc_shared_static_layer_builds_total", "Shared static layers of the grid planners built");
+        static MetricCounter &layer_reuses = MetricsRegistry::getInstance().getCounter(
+                "lsc_shared_static_layer_reuses_total", "Grid planners that took a shared static layer already built");
+        std::shared_ptr<Slot> slot;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            // Drop the slots of the released layers, a slot is held only by the map while no one acquires it
+            for (auto it = slots.begin(); it != slots.end();) {
+                it = it->second.use_count() == 1 and it->second->layer.expired() ? slots.erase(it) : std::next(it);
+            }
+            auto &slot_of_key = slots[key];
+            if (slot_of_key == nullptr) {
+                slot_of_key = std::make_shared<Slot>();
+            }
+            slot = slot_of_key;
+        }
+
+        // Build under the lock of the slot, so the planners of the other keys do not wait for it
+        std::lock_guard<std::mutex> lock(slot->mtx);
+        std::shared_ptr<const SharedStaticLayer> layer = slot->layer.lock();
+        is_built = layer == nullptr;
+        if (is_built) {
+            auto new_layer = std::make_shared<SharedStaticLayer>();
+            new_layer->key = key;
+            new_layer->distmap = distmap;
+            builder(new_layer->layer);
+            layer = std::move(new_layer);
+            slot->layer = layer;
+            layer_builds.increment();
+        } else {
+            layer_reuses.increment();
+        }
+        return layer;
+    }
+
+    // A block without an obstacle voxel within agent_radius in the occupancy index is empty as a whole. The other
+    // blocks are split in half until a few cells are left, which are thresholded by a batch query of the distmap, so
+    // the large open regions cost a few box queries instead of a distmap query per cell.
+    void GridBasedPlanner::thresholdStaticLayer(const std::array<int, 3> &index_min,
+                                                const std::array<int, 3> &index_max,
+                                                double agent_radius, bool is_incremental,
+                                                GridMapUpdateReport &report) {
+        bool is_empty_block = false;
+        const PrimitiveWorld *primitive_world = getPrimitiveWorld();
+        if (primitive_world != nullptr or occupancy_index_ptr != nullptr) {
+            point3d block_min = gridNodeToPoint3D(GridNode(index_min[0], index_min[1], index_min[2]));
+            point3d block_max = gridNodeToPoint3D(GridNode(index_max[0], index_max[1], index_max[2]));
+            if (primitive_world != nullptr) {
+                // The same threshold as the cells, the L-infinity distance to the primitives is exact
+                is_empty_block = not primitive_world->isOccupied(block_min, block_max,
+                                                                 agent_radius - SP_EPSILON_FLOAT);
+            } else {
+                // The L-infinity distance from a cell to an obstacle voxel is less than agent_radius
+                // only if the voxel center is within agent_radius + 0.5 * resolution
+                double margin = agent_radius + 0.5 * param.world_resolution + SP_EPSILON_FLOAT;
+                is_empty_block = not occupancy_index_ptr->isOccupied(block_min, block_max, margin);
+            }
+
+            int split_axis = 0;
+            for (int axis = 1; axis < 3; axis++) {
+                if (index_max[axis] - index_min[axis] > index_max[split_axis] - index_min[split_axis]) {
+                    split_axis = axis;
+                }
+            }
+            size_t n_block_cells = static_cast<size_t>(index_max[0] - index_min[0] + 1) *
+                                   (index_max[1] - index_min[1] + 1) * (index_max[2] - index_min[2] + 1);
+            if (not is_empty_block and n_block_cells > STATIC_LAYER_BATCH_SIZE) {
+                int mid = (index_min[split_axis] + index_max[split_axis]) / 2;
+                std::array<int, 3> lower_max = index_max, upper_min = index_min;
+                lower_max[split_axis] = mid;
+                upper_min[split_axis] = mid + 1;
+                thresholdStaticLayer(index_min, lower_max, agent_radius, is_incremental, report);
+                thresholdStaticLayer(upper_min, index_max, agent_radius, is_incremental, report);
+                return;
+            }
+        }
+
+        // The static layer is reset before a full rebuild
+        if (is_empty_block and not is_incremental) {
+            return;
+        }
+        static_layer_batch.clear();
+        static_layer_batch_nodes.clear();
+        for (int i = index_min[0]; i <= index_max[0]; i++) {
+            for (int j = index_min[1]; j <= index_max[1]; j++) {
+                for (int k = index_min[2]; k <= index_max[2]; k++) {
+                    if (is_incremental) {
+                        if (dirty_mask.isOccupied(i, j, k)) {
+                            continue;
                         }
+                        dirty_mask.setOccupied(i, j, k);
+                        report.n_dirty_cells++;
+                    }
+
+                    GridNode grid_node(i, j, k);
+                    if (is_empty_block) {
+                        static_layer.setValue(grid_node, GP_EMPTY);
+                    } else {
+                        static_layer_batch.push(gridNodeToPoint3D(grid_node));
+                        static_layer_batch_nodes.emplace_back(grid_node);
                     }
                 }
             }
         }
+        if (static_layer_batch_nodes.empty()) {
+            return;
+        }
+
+        // A cell is occupied if the L-infinity distance to the closest obstacle cell is less than agent_radius
+        distmap_ptr->query(static_layer_batch);
+        for (size_t i = 0; i < static_layer_batch_nodes.size(); i++) {
+            bool is_occupied = static_layer_batch.obstacle_l_inf_distance[i] < agent_radius - SP_EPSILON_FLOAT;
+            static_layer.setValue(static_layer_batch_nodes[i], is_occupied ? GP_OCCUPIED : GP_EMPTY);
+        }
     }
 
     void GridBasedPlanner::updateGridMission(const point3d &start_point,
@@ -255,35 +801,50 @@ namespace DynamicPlanning {
     void GridBasedPlanner::updateGridMission(const points_t &start_points,
                                              const points_t &current_points,
                                              const points_t &goal_points) {
-        grid_mission.n_agents = current_points.size();
-        grid_mission.start_points.resize(grid_mission.n_agents);
-        grid_mission.current_points.resize(grid_mission.n_agents);
-        grid_mission.goal_points.resize(grid_mission.n_agents);
-        for (size_t i = 0; i < grid_mission.n_agents; i++) {
-            grid_mission.start_points[i] = point3DToGridVector(start_points[i]);
-            grid_mission.current_points[i] = point3DToGridVector(current_points[i]);
-            grid_mission.goal_points[i] = point3DToGridVector(goal_points[i]);
+        GridNodes occluded_nodes;
+        grid_mission = getGridMission(start_points, current_points, goal_points, occluded_nodes);
+        for (const auto &occluded_node: occluded_nodes) {
+            grid_map.setValue(occluded_node, GP_EMPTY);
+        }
+    }
+
+    GridMission GridBasedPlanner::getGridMission(const points_t &start_points,
+                                                 const points_t &current_points,
+                                                 const points_t &goal_points,
+                                                 GridNodes &occluded_nodes) const {
+        GridMission new_grid_mission;
+        new_grid_mission.n_agents = current_points.size();
+        new_grid_mission.start_points.resize(new_grid_mission.n_agents);
+        new_grid_mission.current_points.resize(new_grid_mission.n_agents);
+        new_grid_mission.goal_points.resize(new_grid_mission.n_agents);
+        occluded_nodes.clear();
+        for (size_t i = 0; i < new_grid_mission.n_agents; i++) {
+            new_grid_mission.start_points[i] = point3DToGridVector(start_points[i]);
+            new_grid_mission.current_points[i] = point3DToGridVector(current_points[i]);
+            new_grid_mission.goal_points[i] = point3DToGridVector(goal_points[i]);
 
             if (param.world_dimension == 2) {
-                grid_mission.current_points[i][2] = 0;
-                grid_mission.goal_points[i][2] = 0;
+                new_grid_mission.current_points[i][2] = 0;
+                new_grid_mission.goal_points[i][2] = 0;
             }
 
-            if (isValid(grid_mission.current_points[i]) and
-                grid_map.getValue(grid_mission.current_points[i]) == GP_OCCUPIED) {
+            if (isValid(new_grid_mission.current_points[i]) and
+                grid_map.getValue(new_grid_mission.current_points[i]) == GP_OCCUPIED) {
                 ROS_WARN_STREAM("[GridBasedPlanner] Start point (" << current_points[i] << ") is occluded");
-                grid_map.setValue(grid_mission.current_points[i], GP_EMPTY);
+                occluded_nodes.emplace_back(new_grid_mission.current_points[i]);
             }
 
-            if (isValid(grid_mission.goal_points[i]) and
-                grid_map.getValue(grid_mission.goal_points[i]) == GP_OCCUPIED) {
+            if (isValid(new_grid_mission.goal_points[i]) and
+                grid_map.getValue(new_grid_mission.goal_points[i]) == GP_OCCUPIED) {
                 ROS_WARN_STREAM("[GridBasedPlanner] Goal point (" << goal_points[i] << ") is occluded");
-                grid_map.setValue(grid_mission.goal_points[i], GP_EMPTY);
+                occluded_nodes.emplace_back(new_grid_mission.goal_points[i]);
             }
         }
+
+        return new_grid_mission;
     }
 
-    bool GridBasedPlanner::isValid(const GridNode &grid_node) {
+    bool GridBasedPlanner::isValid(const GridNode &grid_node) const {
         for (int i = 0; i < 3; i++) {
             if (grid_node[i] < 0 or grid_node[i] >= grid_info.dim[i]) {
                 return false;
@@ -302,13 +863,19 @@ namespace DynamicPlanning {
         return map.getValue(grid_node) == GP_OCCUPIED;
     }
 
-    bool GridBasedPlanner::planImpl(bool is_mapf) {
+    bool GridBasedPlanner::planImpl(bool is_mapf, IncrementalPathPlanner *sapf_planner) {
         std::vector<gridpath_t> grid_paths;
         bool success;
         if (is_mapf) {
-            grid_paths = runMAPF(grid_map, grid_mission);
+            bool reused;
+            grid_paths = runWindowedMAPF(grid_map, grid_mission, getRollingPlan(0), getDistanceTableCache(0),
+                                         &getMAPFGraph(0), param.grid_mapf_time_limit, reused);
             success = !grid_paths.empty();
             plan_result.n_agents = grid_mission.n_agents;
+        } else {
+            grid_paths.resize(1);
+            success = runSAPF(*sapf_planner, grid_paths[0]);
+            plan_result.n_agents = 1;
         }
 
         if (success) {
@@ -316,41 +883,183 @@ namespace DynamicPlanning {
             for (size_t i = 0; i < plan_result.n_agents; i++) {
                 plan_result.paths[i] = gridPathToPath(grid_paths[i]);
             }
+        } else {
+            // No path, findLOSFreeGoal falls back to the ray to the goal
+            plan_result.paths.assign(plan_result.n_agents, points_t());
         }
 
         return success;
     }
 
-    std::vector<gridpath_t> GridBasedPlanner::runMAPF(const GridMap &grid_map, const GridMission &grid_mission) {
-        MAPF::Problem P = MAPF::Problem(grid_map.grid,
-                                        grid_mission.n_agents,
-                                        gridNodesToArrays(grid_mission.start_points),
-                                        gridNodesToArrays(grid_mission.current_points),
-                                        gridNodesToArrays(grid_mission.goal_points));
-        std::unique_ptr<MAPF::Solver> solver;
-        if (param.mapf_mode == MAPFMode::PIBT) {
-            solver = std::make_unique<MAPF::PIBT>(&P);
-        } else if (param.mapf_mode == MAPFMode::ECBS) {
-            solver = std::make_unique<MAPF::ECBS>(&P);
+    bool GridBasedPlanner::runSAPF(IncrementalPathPlanner &sapf_planner, gridpath_t &grid_path) const {
+        TRACE_SCOPE("GridBasedPlanner::runSAPF");
+        static MetricCounter &sapf_plans = MetricsRegistry::getInstance().getCounter(
+                "lsc_sapf_plans_total", "Single-agent grid paths planned by D* Lite");
+        static MetricCounter &sapf_expanded = MetricsRegistry::getInstance().getCounter(
+                "lsc_sapf_expanded_total", "Cells expanded by the single-agent grid search");
+        long n_expanded = sapf_planner.getStatistics().n_expanded;
+
+        const GridNode &start = grid_mission.current_points[0];
+        const GridNode &goal = grid_mission.goal_points[0];
+        std::vector<std::array<int, 3>> path;
+        bool success = sapf_planner.plan(grid_map.getView(), {start[0], start[1], start[2]},
+                                         {goal[0], goal[1], goal[2]}, path);
+        sapf_plans.increment();
+        sapf_expanded.increment(static_cast<uint64_t>(sapf_planner.getStatistics().n_expanded - n_expanded));
+
+        grid_path.clear();
+        for (const auto &node: path) {
+            grid_path.emplace_back(node[0], node[1], node[2]);
+        }
+        return success;
+    }
+
+    std::vector<gridpath_t> GridBasedPlanner::runMAPF(const GridMap &grid_map, const GridMission &grid_mission,
+                                                      MAPF::DistanceTableCache *distance_table_cache,
+                                                      MAPFGraph *mapf_graph, int time_limit, MAPFMode mode) const {
+        TRACE_SCOPE("GridBasedPlanner::runMAPF");
+        static MetricCounter &corridor_fallbacks = MetricsRegistry::getInstance().getCounter(
+                "lsc_mapf_corridor_fallbacks_total", "Hierarchical MAPF plans solved again on the full grid");
+        if (param.grid_mapf_cluster_size <= 0) {
+            return solveMAPF(grid_map, grid_mission, distance_table_cache, mapf_graph, time_limit, mode);
+        }
+
+        Timer timer;
+        GridMap corridor_map;
+        if (getCorridorMap(grid_map, grid_mission, corridor_map)) {
+            // The corridor changes between the calls, so its distance tables are not cached
+            std::vector<gridpath_t> grid_paths = solveMAPF(corridor_map, grid_mission, nullptr, mapf_graph, time_limit,
+                                                           mode);
+            if (not grid_paths.empty()) {
+                return grid_paths;
+            }
+        }
+        corridor_fallbacks.increment();
+
+        timer.stop();
+        int remaining_time = time_limit - static_cast<int>(timer.elapsedSeconds() * 1000);
+        if (remaining_time <= 0) {
+            return {};
+        }
+        return solveMAPF(grid_map, grid_mission, distance_table_cache, mapf_graph, remaining_time, mode);
+    }
+
+    std::vector<gridpath_t> GridBasedPlanner::solveMAPF(const GridMap &grid_map, const GridMission &grid_mission,
+                                                        MAPF::DistanceTableCache *distance_table_cache,
+                                                        MAPFGraph *mapf_graph, int time_limit, MAPFMode mode) const {
+        MAPF::Grid *graph = mapf_graph != nullptr ? prepareMAPFGraph(*mapf_graph, grid_map) : nullptr;
+        std::unique_ptr<MAPF::Problem> problem;
+        if (graph != nullptr) {
+            mapf_graph->mt.seed(DEFAULT_SEED);
+            problem = std::make_unique<MAPF::Problem>(graph, &mapf_graph->mt, grid_mission.n_agents,
+                                                      gridNodesToArrays(grid_mission.start_points),
+                                                      gridNodesToArrays(grid_mission.current_points),
+                                                      gridNodesToArrays(grid_mission.goal_points));
         } else {
-            throw std::invalid_argument("[GridBasedPlanner] Invalid MAPF mode");
+            problem = std::make_unique<MAPF::Problem>(grid_map.getView(),
+                                                      param.grid_connectivity,
+                                                      grid_mission.n_agents,
+                                                      gridNodesToArrays(grid_mission.start_points),
+                                                      gridNodesToArrays(grid_mission.current_points),
+                                                      gridNodesToArrays(grid_mission.goal_points));
+        }
+        MAPF::Problem &P = *problem;
+        P.setMaxCompTime(time_limit);
+        if (space_time_occupancy.getNumSlices() > 0) {
+            P.setSpaceTimeObstacles(&space_time_occupancy);
+        }
+        if (distance_table_cache != nullptr) {
+            distance_table_cache->update(grid_map.getView(), P.getG());
+            P.setDistanceTableCache(distance_table_cache);
         }
 
+        std::unique_ptr<MAPF::Solver> solver = createMAPFSolver(mode, &P);
+        if (param.grid_mapf_parallel) {
+            solver->setParallelFor([](size_t n_tasks, const std::function<void(size_t)> &task) {
+                WorkerPool::getInstance().run(n_tasks, task);
+            });
+        }
         solver->solve();
 
-        MAPF::Plan plan = solver->getSolution();
-        std::vector<gridpath_t> grid_paths;
-        if (not plan.empty()) {
-            grid_paths.resize(grid_mission.n_agents);
-            for (size_t t = 0; t < plan.size(); t++) {
-                for (size_t i = 0; i < grid_mission.n_agents; i++) {
-                    GridNode grid_node(plan.get(t, i)->pos.x,
-                                       plan.get(t, i)->pos.y,
-                                       0);
-                    grid_paths[i].emplace_back(grid_node);
+        return planToGridPaths(solver->getSolution(), grid_mission.n_agents);
+    }
+
+    MAPF::Grid *GridBasedPlanner::prepareMAPFGraph(MAPFGraph &mapf_graph, const GridMap &grid_map) const {
+        static MetricCounter &graph_builds = MetricsRegistry::getInstance().getCounter(
+                "lsc_mapf_graph_builds_total", "MAPF graphs built for a new static layer");
+        static MetricCounter &graph_reuses = MetricsRegistry::getInstance().getCounter(
+                "lsc_mapf_graph_reuses_total", "MAPF problems built over the graph of the previous problems");
+        const GridMap &static_layer_of_graph = getStaticLayer();
+        if (not static_layer_of_graph.isSubsetOf(grid_map)) {
+            return nullptr;
+        }
+
+        // A shared layer is not modified, so it is compared by the pointer
+        bool is_same_layer = shared_static_layer != nullptr ?
+                             mapf_graph.shared_static_layer == shared_static_layer :
+                             mapf_graph.shared_static_layer == nullptr and mapf_graph.static_layer == static_layer;
+        if (mapf_graph.grid == nullptr or mapf_graph.connectivity != param.grid_connectivity or not is_same_layer) {
+            mapf_graph.static_layer = shared_static_layer != nullptr ? GridMap() : static_layer;
+            mapf_graph.shared_static_layer = shared_static_layer;
+            mapf_graph.connectivity = param.grid_connectivity;
+            mapf_graph.grid = std::make_unique<MAPF::Grid>(static_layer_of_graph.getView(), param.grid_connectivity);
+            graph_builds.increment();
+        } else {
+            graph_reuses.increment();
+        }
+        mapf_graph.grid->setBlocked(grid_map.getView());
+        return mapf_graph.grid.get();
+    }
+
+    bool GridBasedPlanner::getCorridorMap(const GridMap &grid_map, const GridMission &grid_mission,
+                                          GridMap &corridor_map) const {
+        ClusterGraph cluster_graph;
+        cluster_graph.build(grid_map.getView(), param.grid_mapf_cluster_size);
+
+        // The start points are nodes of the MAPF problem too
+        std::vector<std::array<int, 3>> source_points = gridNodesToArrays(grid_mission.current_points);
+        std::vector<std::array<int, 3>> start_points = gridNodesToArrays(grid_mission.start_points);
+        source_points.insert(source_points.end(), start_points.begin(), start_points.end());
+        std::vector<std::array<int, 3>> goal_points = gridNodesToArrays(grid_mission.goal_points);
+        goal_points.reserve(2 * goal_points.size());
+        for (size_t i = 0; i < start_points.size(); i++) {
+            goal_points.emplace_back(goal_points[i]);
+        }
+
+        // The clusters next to the abstract paths leave room for the agents to pass each other
+        std::vector<uint8_t> cell_mask;
+        if (not cluster_graph.getCorridor(source_points, goal_points, 1, cell_mask)) {
+            return false;
+        }
+
+        corridor_map = grid_map;
+        const std::array<int, 3> &dim = grid_map.getDim();
+        size_t bit = 0;
+        for (int i = 0; i < dim[0]; i++) {
+            for (int j = 0; j < dim[1]; j++) {
+                for (int k = 0; k < dim[2]; k++) {
+                    if (not cell_mask[bit++]) {
+                        corridor_map.setOccupied(i, j, k);
+                    }
                 }
             }
         }
+        return true;
+    }
+
+    std::vector<gridpath_t> GridBasedPlanner::planToGridPaths(const MAPF::Plan &plan, size_t n_agents) {
+        std::vector<gridpath_t> grid_paths;
+        if (plan.empty()) {
+            return grid_paths;
+        }
+        grid_paths.resize(n_agents);
+        for (size_t t = 0; t < plan.size(); t++) {
+            for (size_t i = 0; i < n_agents; i++) {
+                const MAPF::Pos &pos = plan.get(t, i)->pos;
+                GridNode grid_node(pos.x, pos.y, pos.z);
+                grid_paths[i].emplace_back(grid_node);
+            }
+        }
 
         // Delete repeated path to prevent deadlock
         size_t repeated_interval = 0;
@@ -367,7 +1076,7 @@ namespace DynamicPlanning {
             }
         }
         for(size_t ri = 0; ri < repeated_interval; ri++){
-            for(size_t i = 0; i < grid_mission.n_agents; i++){
+            for(size_t i = 0; i < n_agents; i++){
                 grid_paths[i].erase(grid_paths[i].begin());
             }
         }
@@ -375,6 +1084,245 @@ namespace DynamicPlanning {
         return grid_paths;
     }
 
+    std::vector<gridpath_t> GridBasedPlanner::runWindowedMAPF(const GridMap &grid_map,
+                                                              const GridMission &grid_mission,
+                                                              RollingMAPFPlan &rolling_plan,
+                                                              MAPF::DistanceTableCache *distance_table_cache,
+                                                              MAPFGraph *mapf_graph, int time_limit,
+                                                              bool &reused) const {
+        static MetricCounter &mapf_reused = MetricsRegistry::getInstance().getCounter(
+                "lsc_mapf_plans_reused_total", "MAPF plans of the rolling horizon reused without a solver");
+        static MetricCounter &mapf_refined = MetricsRegistry::getInstance().getCounter(
+                "lsc_mapf_plans_refined_total", "MAPF plans refined in the background and used by a later call");
+        reused = false;
+        bool is_anytime = param.grid_mapf_refine_time_limit > 0;
+        std::vector<gridpath_t> grid_paths;
+        if (is_anytime and takeRefinement(grid_map, grid_mission, rolling_plan, grid_paths)) {
+            mapf_refined.increment();
+        } else if (param.grid_mapf_window > 0 and shiftRollingPlan(grid_map, grid_mission, rolling_plan, grid_paths)) {
+            reused = true;
+            mapf_reused.increment();
+        } else {
+            grid_paths = runMAPF(grid_map, grid_mission, distance_table_cache, mapf_graph, time_limit,
+                                 is_anytime ? MAPFMode::PIBT : param.mapf_mode);
+            if (is_anytime) {
+                startRefinement(grid_map, grid_mission, grid_paths, rolling_plan);
+            }
+        }
+        if (param.grid_mapf_window <= 0) {
+            return grid_paths;
+        }
+
+        if (not reused) {
+            auto max_length = static_cast<size_t>(param.grid_mapf_window) + 1;
+            for (auto &grid_path: grid_paths) {
+                if (grid_path.size() > max_length) {
+                    grid_path.resize(max_length);
+                }
+            }
+        }
+
+        rolling_plan.goal_points = grid_mission.goal_points;
+        rolling_plan.paths = grid_paths;
+        return grid_paths;
+    }
+
+    void GridBasedPlanner::startRefinement(const GridMap &grid_map, const GridMission &grid_mission,
+                                           const std::vector<gridpath_t> &grid_paths,
+                                           RollingMAPFPlan &rolling_plan) const {
+        if (rolling_plan.refinement.valid()) {
+            return;
+        }
+
+        // The initial plan of IR must reach the goals, e.g. not a plan of PIBT stopped at the window
+        bool is_initial_plan_valid = grid_paths.size() == grid_mission.n_agents;
+        for (size_t i = 0; i < grid_paths.size() and is_initial_plan_valid; i++) {
+            is_initial_plan_valid = grid_paths[i].back() == grid_mission.goal_points[i];
+        }
+
+        rolling_plan.refinement_goal_points = grid_mission.goal_points;
+        rolling_plan.refinement_cancel_flag = std::make_shared<std::atomic<bool>>(false);
+        rolling_plan.refinement = std::async(
+                std::launch::async,
+                [grid_map, space_time_occupancy = space_time_occupancy,
+                 connectivity = param.grid_connectivity, time_limit = param.grid_mapf_refine_time_limit,
+                 n_agents = grid_mission.n_agents,
+                 start_points = gridNodesToArrays(grid_mission.start_points),
+                 current_points = gridNodesToArrays(grid_mission.current_points),
+                 goal_points = gridNodesToArrays(grid_mission.goal_points),
+                 initial_paths = is_initial_plan_valid ? grid_paths : std::vector<gridpath_t>(),
+                 cancel_flag = rolling_plan.refinement_cancel_flag]() {
+                    TRACE_SCOPE("GridBasedPlanner::refinement");
+                    MAPF::Problem P = MAPF::Problem(grid_map.getView(), connectivity, n_agents,
+                                                    start_points, current_points, goal_points);
+                    P.setMaxCompTime(time_limit);
+                    P.setCancelFlag(cancel_flag.get());
+                    if (space_time_occupancy.getNumSlices() > 0) {
+                        P.setSpaceTimeObstacles(&space_time_occupancy);
+                    }
+
+                    MAPF::IR solver(&P);
+                    if (not initial_paths.empty()) {
+                        MAPF::Plan initial_plan;
+                        for (size_t t = 0; t < initial_paths[0].size(); t++) {
+                            MAPF::Config config;
+                            for (const auto &initial_path: initial_paths) {
+                                const GridNode &grid_node = initial_path[t];
+                                config.emplace_back(P.getG()->getNode(grid_node[0], grid_node[1], grid_node[2]));
+                            }
+                            initial_plan.add(config);
+                        }
+                        solver.setInitialPlan(initial_plan);
+                    }
+                    solver.solve();
+
+                    return planToGridPaths(solver.getSolution(), n_agents);
+                });
+    }
+
+    bool GridBasedPlanner::takeRefinement(const GridMap &grid_map, const GridMission &grid_mission,
+                                          RollingMAPFPlan &rolling_plan, std::vector<gridpath_t> &grid_paths) const {
+        std::future<std::vector<gridpath_t>> &refinement = rolling_plan.refinement;
+        if (not refinement.valid() or
+            refinement.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return false;
+        }
+
+        // The refined plan is valid as the rolling plan of its mission
+        RollingMAPFPlan refined_plan;
+        refined_plan.goal_points = rolling_plan.refinement_goal_points;
+        refined_plan.paths = refinement.get();
+        return shiftRollingPlan(grid_map, grid_mission, refined_plan, grid_paths);
+    }
+
+    void GridBasedPlanner::cancelRefinements() {
+        // The futures of std::async wait for the refinements when they are destroyed
+        for (auto &rolling_plan: rolling_plans) {
+            if (rolling_plan.refinement_cancel_flag != nullptr) {
+                rolling_plan.refinement_cancel_flag->store(true);
+            }
+        }
+        for (auto &rolling_plan: rolling_plans) {
+            if (rolling_plan.refinement.valid()) {
+                rolling_plan.refinement.wait();
+            }
+            rolling_plan.refinement = std::future<std::vector<gridpath_t>>();
+        }
+    }
+
+    bool GridBasedPlanner::shiftRollingPlan(const GridMap &grid_map, const GridMission &grid_mission,
+                                            const RollingMAPFPlan &rolling_plan,
+                                            std::vector<gridpath_t> &grid_paths) const {
+        const std::vector<gridpath_t> &paths = rolling_plan.paths;
+        size_t n_agents = grid_mission.n_agents;
+        if (paths.empty() or paths.size() != n_agents or rolling_plan.goal_points != grid_mission.goal_points) {
+            return false;
+        }
+
+        // The plan is conflict-free only if the agents advance together, at the same step of the plan
+        size_t length = paths[0].size();
+        size_t step = 0;
+        for (; step < length; step++) {
+            bool is_at_step = true;
+            for (size_t i = 0; i < n_agents; i++) {
+                if (paths[i].size() != length or paths[i][step] != grid_mission.current_points[i]) {
+                    is_at_step = false;
+                    break;
+                }
+            }
+            if (is_at_step) {
+                break;
+            }
+        }
+        if (step == length) {
+            return false;
+        }
+
+        // The end of a truncated plan is not a goal, a new window is planned from there
+        if (step + 1 == length) {
+            for (size_t i = 0; i < n_agents; i++) {
+                if (paths[i][step] != grid_mission.goal_points[i]) {
+                    return false;
+                }
+            }
+        }
+
+        // The grid map and the predicted obstacles may be changed after the plan
+        for (size_t t = step; t < length; t++) {
+            for (size_t i = 0; i < n_agents; i++) {
+                const GridNode &grid_node = paths[i][t];
+                if (grid_map.getValue(grid_node) == GP_OCCUPIED or
+                    space_time_occupancy.isBlocked(MAPF::Pos(grid_node[0], grid_node[1], grid_node[2]),
+                                                   static_cast<int>(t - step))) {
+                    return false;
+                }
+            }
+        }
+
+        grid_paths.resize(n_agents);
+        for (size_t i = 0; i < n_agents; i++) {
+            grid_paths[i].assign(paths[i].begin() + static_cast<long>(step), paths[i].end());
+        }
+        return true;
+    }
+
+    std::unique_ptr<MAPF::Solver> GridBasedPlanner::createMAPFSolver(MAPFMode mode, MAPF::Problem *P) const {
+        switch (mode) {
+            case MAPFMode::PIBT: {
+                // PIBT plans a step at a time, so it stops at the window
+                auto pibt = std::make_unique<MAPF::PIBT>(P);
+                if (param.grid_mapf_window > 0) {
+                    pibt->setWindow(param.grid_mapf_window);
+                }
+                return pibt;
+            }
+            case MAPFMode::ECBS: {
+                auto ecbs = std::make_unique<MAPF::ECBS>(P);
+                ecbs->setBatchSize(param.grid_ecbs_batch_size);
+                return ecbs;
+            }
+            case MAPFMode::CBS:
+                return std::make_unique<MAPF::CBS>(P);
+            case MAPFMode::ICBS:
+                return std::make_unique<MAPF::ICBS>(P);
+            case MAPFMode::HCA:
+                return std::make_unique<MAPF::HCA>(P);
+            case MAPFMode::WHCA: {
+                auto whca = std::make_unique<MAPF::WHCA>(P);
+                if (param.grid_mapf_window > 0) {
+                    whca->setWindow(param.grid_mapf_window);
+                }
+                return whca;
+            }
+            case MAPFMode::WINPIBT: {
+                auto winpibt = std::make_unique<MAPF::winPIBT>(P);
+                if (param.grid_mapf_window > 0) {
+                    winpibt->setWindow(param.grid_mapf_window);
+                }
+                return winpibt;
+            }
+            case MAPFMode::PIBT_COMPLETE:
+                return std::make_unique<MAPF::PIBT_COMPLETE>(P);
+            case MAPFMode::PUSH_AND_SWAP:
+                return std::make_unique<MAPF::PushAndSwap>(P);
+            case MAPFMode::REVISIT_PP:
+                return std::make_unique<MAPF::RevisitPP>(P);
+            case MAPFMode::IR:
+                return std::make_unique<MAPF::IR>(P);
+            case MAPFMode::PORTFOLIO: {
+                std::vector<MAPF::Portfolio::SolverFactory> factories;
+                for (const auto &member_mode: param.mapf_portfolio_modes) {
+                    factories.emplace_back([this, member_mode](MAPF::Problem *member_P) {
+                        return createMAPFSolver(member_mode, member_P);
+                    });
+                }
+                return std::make_unique<MAPF::Portfolio>(P, factories, param.mapf_portfolio_anytime);
+            }
+            default:
+                throw std::invalid_argument("[GridBasedPlanner] Invalid MAPF mode");
+        }
+    }
+
     points_t GridBasedPlanner::gridPathToPath(const gridpath_t &grid_path) const {
         points_t path;
         for (auto &grid_point: grid_path) {
@@ -440,74 +1388,135 @@ namespace DynamicPlanning {
         return grid_vector;
     }
 
+    MAPF::DistanceTableCache *GridBasedPlanner::getDistanceTableCache(size_t slot) {
+        if (param.grid_distance_table_capacity <= 0) {
+            return nullptr;
+        }
+        while (distance_table_caches.size() <= slot) {
+            distance_table_caches.emplace_back(
+                    std::make_unique<MAPF::DistanceTableCache>(param.grid_distance_table_capacity));
+        }
+        return distance_table_caches[slot].get();
+    }
+
+    RollingMAPFPlan &GridBasedPlanner::getRollingPlan(size_t slot) {
+        if (rolling_plans.size() <= slot) {
+            rolling_plans.resize(slot + 1);
+        }
+        return rolling_plans[slot];
+    }
+
+    MAPFGraph &GridBasedPlanner::getMAPFGraph(size_t slot) {
+        if (mapf_graphs.size() <= slot) {
+            mapf_graphs.resize(slot + 1);
+        }
+        return mapf_graphs[slot];
+    }
+
+    MAPF::DistanceTableStatistics GridBasedPlanner::getDistanceTableStatistics() const {
+        MAPF::DistanceTableStatistics total;
+        for (const auto &distance_table_cache: distance_table_caches) {
+            MAPF::DistanceTableStatistics statistics = distance_table_cache->getStatistics();
+            total.n_query += statistics.n_query;
+            total.n_hit += statistics.n_hit;
+            total.n_repaired += statistics.n_repaired;
+            total.n_invalidated += statistics.n_invalidated;
+            total.n_expanded += statistics.n_expanded;
+        }
+        return total;
+    }
+
     points_t GridBasedPlanner::getPath(size_t i) const {
-        return plan_result.paths[i];
+        return i < plan_result.paths.size() ? plan_result.paths[i] : points_t();
     }
 
     points_t GridBasedPlanner::getFreePoints() const {
-        //TODO: too naive, save them when generate map?
         points_t free_points;
-        for (int i = 0; i < grid_info.dim[0]; i++) {
-            for (int j = 0; j < grid_info.dim[1]; j++) {
-                for (int k = 0; k < grid_info.dim[2]; k++) {
-                    if (grid_map.grid[i][j][k] == GP_EMPTY) {
-                        free_points.emplace_back(gridNodeToPoint3D(GridNode(i, j, k)));
-                    }
-                }
-            }
-        }
-
+        grid_map.forEachCell(~uint64_t(0), [&](size_t cell) {
+            free_points.emplace_back(gridNodeToPoint3D(grid_map.cellToNode(cell)));
+        });
         return free_points;
     }
 
     points_t GridBasedPlanner::getOccupiedPoints() const {
         points_t occupied_points;
-        for (int i = 0; i < grid_info.dim[0]; i++) {
-            for (int j = 0; j < grid_info.dim[1]; j++) {
-                for (int k = 0; k < grid_info.dim[2]; k++) {
-                    if (grid_map.grid[i][j][k] == GP_OCCUPIED) {
-                        occupied_points.emplace_back(gridNodeToPoint3D(GridNode(i, j, k)));
-                    }
-                }
-            }
-        }
-
+        grid_map.forEachCell(0, [&](size_t cell) {
+            occupied_points.emplace_back(gridNodeToPoint3D(grid_map.cellToNode(cell)));
+        });
         return occupied_points;
     }
 
     visualization_msgs::MarkerArray GridBasedPlanner::occupiedPointsToMsg(std::string frame_id) const {
-        points_t occupied_points = getOccupiedPoints();
+        OccupancyExport &e = occupancy_export;
+        const std::vector<uint64_t> &words = grid_map.getWords();
+        if (e.dim != grid_map.getDim()) {
+            e.dim = grid_map.getDim();
+            e.words.assign(words.size(), 0);
+            e.points.clear();
+            e.point_cells.clear();
+            e.cell_points.clear();
+        }
+
+        size_t n_cells = static_cast<size_t>(e.dim[0]) * e.dim[1] * e.dim[2];
+        for (size_t wi = 0; wi < words.size(); wi++) {
+            uint64_t changed = words[wi] ^ e.words[wi];
+            while (changed != 0) {
+                size_t cell = (wi << 6) + __builtin_ctzll(changed);
+                changed &= changed - 1;
+                if (cell >= n_cells) {
+                    continue;
+                }
+                auto it = e.cell_points.find(cell);
+                if (it == e.cell_points.end()) {
+                    e.cell_points.emplace(cell, e.points.size());
+                    e.points.emplace_back(point3DToPointMsg(gridNodeToPoint3D(grid_map.cellToNode(cell))));
+                    e.point_cells.emplace_back(cell);
+                } else {
+                    size_t pi = it->second;
+                    e.cell_points.erase(it);
+                    if (pi + 1 != e.points.size()) {
+                        e.points[pi] = e.points.back();
+                        e.point_cells[pi] = e.point_cells.back();
+                        e.cell_points[e.point_cells[pi]] = pi;
+                    }
+                    e.points.pop_back();
+                    e.point_cells.pop_back();
+                }
+            }
+            e.words[wi] = words[wi];
+        }
 
         visualization_msgs::MarkerArray msg_grid_occupied_points;
         visualization_msgs::Marker marker;
-        marker.header.frame_id = frame_id;
-        marker.type = visualization_msgs::Marker::SPHERE;
+        marker.header.frame_id = std::move(frame_id);
+        marker.ns = "grid_occupied_points";
+        marker.id = 0;
+        marker.type = visualization_msgs::Marker::CUBE_LIST;
         marker.action = visualization_msgs::Marker::ADD;
         marker.color.r = 0.0;
         marker.color.g = 0.0;
         marker.color.b = 0.0;
         marker.color.a = 0.5;
 
-        marker.scale.x = 0.05;
-        marker.scale.y = 0.05;
-        marker.scale.z = 0.05;
-
-        int marker_id = 0;
-        for (const auto &point: occupied_points) {
-            marker.id = marker_id++;
-            marker.pose.position = point3DToPointMsg(point);
-            marker.pose.orientation = defaultQuaternion();
-            msg_grid_occupied_points.markers.emplace_back(marker);
-        }
-
+        marker.scale.x = param.grid_resolution;
+        marker.scale.y = param.grid_resolution;
+        marker.scale.z = param.grid_resolution;
+        marker.pose.orientation = defaultQuaternion();
+        marker.points = e.points;
+        msg_grid_occupied_points.markers.emplace_back(std::move(marker));
         return msg_grid_occupied_points;
     }
 
     visualization_msgs::MarkerArray GridBasedPlanner::pathToMarkerMsg(int agent_id,
                                                                       std::string frame_id,
                                                                       std_msgs::ColorRGBA color) const {
+        return pathToMarkerMsg(getPath(0), agent_id, std::move(frame_id), color);
+    }
 
-
+    visualization_msgs::MarkerArray GridBasedPlanner::pathToMarkerMsg(const points_t &path,
+                                                                      int agent_id,
+                                                                      std::string frame_id,
+                                                                      std_msgs::ColorRGBA color) {
         visualization_msgs::MarkerArray msg_grid_path_vis;
         visualization_msgs::Marker marker;
         marker.header.frame_id = frame_id;
@@ -520,12 +1529,8 @@ namespace DynamicPlanning {
         marker.scale.y = 0.05;
         marker.scale.z = 0.05;
 
-        if (plan_result.paths.empty()) {
-            return msg_grid_path_vis;
-        }
-
         int marker_id = 0;
-        for (const auto &point: plan_result.paths[0]) {
+        for (const auto &point: path) {
             marker.ns = std::to_string(agent_id);
             marker.id = marker_id++;
             marker.pose.position = point3DToPointMsg(point);
@@ -541,16 +1546,15 @@ namespace DynamicPlanning {
         point3d los_free_goal = current_position;
 
         if (distmap_ptr != nullptr) {
-            points_t path = plan_result.paths[0];
+            points_t path = plan_result.paths.empty() ? points_t() : plan_result.paths[0];
             path.emplace_back(goal_position);
 
-            for (const auto &point: path) {
-                bool is_safe = castRay(current_position, point, agent_radius + 0.5 *
-                                                                               param.world_resolution); // add 0.5 * param.grid_resolution to avoid numerical error.
-//                bool is_safe = castRay(current_position, point, agent_radius);
-
-                if (is_safe) {
-                    los_free_goal = point;
+            // add 0.5 * param.grid_resolution to avoid numerical error.
+            std::vector<bool> is_safe = castRays(current_position, path,
+                                                 agent_radius + 0.5 * param.world_resolution);
+            for (size_t i = 0; i < path.size(); i++) {
+                if (is_safe[i]) {
+                    los_free_goal = path[i];
                 } else {
                     break;
                 }
@@ -566,37 +1570,85 @@ namespace DynamicPlanning {
         return los_free_goal;
     }
 
-    bool GridBasedPlanner::castRay(const point3d &current_position,
-                                   const point3d &goal_position,
-                                   double agent_radius) {
-        double safe_dist_curr, safe_dist_goal, dist_to_goal, dist_threshold;
-        dist_to_goal = (current_position - goal_position).norm();
-        dist_threshold = sqrt(0.25 * dist_to_goal * dist_to_goal + agent_radius * agent_radius);
+    std::vector<bool> GridBasedPlanner::castRays(const point3d &current_position,
+                                                 const points_t &goal_positions,
+                                                 double agent_radius) const {
+        // Sphere tracing: a point with the clearance c is the center of a free ball of radius c, so the ray advances
+        // by c - clearance. The step is bounded below near the obstacles, where the margin of 0.5 * resolution
+        // covers the discretization of the map.
+        double clearance = agent_radius + 0.5 * param.world_resolution - SP_EPSILON_FLOAT;
+        double min_step = 0.1 * param.world_resolution;
+
+        const PrimitiveWorld *primitive_world = getPrimitiveWorld();
+        size_t n_rays = goal_positions.size();
+        std::vector<bool> is_safe(n_rays, true);
+        std::vector<double> lengths(n_rays), progresses(n_rays, 0);
+        std::vector<size_t> active_rays;
+        active_rays.reserve(n_rays);
+        for (size_t i = 0; i < n_rays; i++) {
+            lengths[i] = current_position.distance(goal_positions[i]);
+
+            // No obstacle within agent_radius + 0.5 * resolution of the bounding box of the segment
+            if (primitive_world != nullptr or occupancy_index_ptr != nullptr) {
+                point3d box_min, box_max;
+                for (int k = 0; k < 3; k++) {
+                    box_min(k) = std::min(current_position(k), goal_positions[i](k));
+                    box_max(k) = std::max(current_position(k), goal_positions[i](k));
+                }
+                double margin = agent_radius + 0.5 * param.world_resolution;
+                bool is_occupied = primitive_world != nullptr ?
+                                   primitive_world->isOccupied(box_min, box_max, margin) :
+                                   occupancy_index_ptr->isOccupied(box_min, box_max, margin);
+                if (not is_occupied) {
+                    continue;
+                }
+            }
+            active_rays.emplace_back(i);
+        }
 
-//        safe_dist_curr = distmap_ptr->getDistance(current_position);
-//        safe_dist_goal = distmap_ptr->getDistance(goal_position);
+        // The rays advance together, one distmap query per step for all the active rays
+        size_t first_unsafe_ray = n_rays;
+        DistmapQueryBatch batch;
+        batch.reserve(active_rays.size());
+        while (not active_rays.empty()) {
+            batch.clear();
+            for (size_t i: active_rays) {
+                double alpha = lengths[i] > SP_EPSILON_FLOAT ? progresses[i] / lengths[i] : 0;
+                batch.push(current_position + (goal_positions[i] - current_position) * alpha);
+            }
+            distmap_ptr->query(batch);
 
-        float dist;
-        point3d closest_point;
-        distmap_ptr->getDistanceAndClosestObstacle(current_position, dist, closest_point);
-        safe_dist_curr = current_position.distance(closest_point);
+            size_t n_active_rays = 0;
+            for (size_t k = 0; k < active_rays.size(); k++) {
+                size_t i = active_rays[k];
+                if (i > first_unsafe_ray) {
+                    continue;
+                }
 
-        distmap_ptr->getDistanceAndClosestObstacle(goal_position, dist, closest_point);
-        safe_dist_goal = goal_position.distance(closest_point);
+                point3d point(batch.x[k], batch.y[k], batch.z[k]);
+                double dist = point.distance(batch.getObstacle(k));
+                if (dist < clearance) {
+                    is_safe[i] = false;
+                    first_unsafe_ray = std::min(first_unsafe_ray, i);
+                    continue;
+                }
+                if (progresses[i] >= lengths[i]) {
+                    continue;
+                }
 
-        if (safe_dist_curr < agent_radius + 0.5 * param.world_resolution - SP_EPSILON_FLOAT) {
-            return false;
-        }
-        if (safe_dist_goal < agent_radius + 0.5 * param.world_resolution - SP_EPSILON_FLOAT) {
-            return false;
+                // The clearance is not known beyond the maximum distance of the distmap
+                double step = std::max(std::min(dist, param.world_max_dist) - clearance, min_step);
+                progresses[i] = std::min(progresses[i] + step, lengths[i]);
+                active_rays[n_active_rays++] = i;
+            }
+            active_rays.resize(n_active_rays);
         }
-        if (dist_threshold < param.world_max_dist and
-            safe_dist_curr > dist_threshold and safe_dist_goal > dist_threshold) {
-            return true;
+
+        // The rays after the first unsafe one are not traced
+        for (size_t i = first_unsafe_ray + 1; i < n_rays; i++) {
+            is_safe[i] = false;
         }
 
-        point3d mid_position = (current_position + goal_position) * 0.5;
-        return castRay(current_position, mid_position, agent_radius)
-               && castRay(mid_position, goal_position, agent_radius);
+        return is_safe;
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,263 @@
+#include <incremental_path_planner.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace DynamicPlanning {
+    static constexpr float INF_COST = std::numeric_limits<float>::infinity();
+
+    IncrementalPathPlanner::IncrementalPathPlanner(int _connectivity) : connectivity(_connectivity) {}
+
+    void IncrementalPathPlanner::setConnectivity(int _connectivity) {
+        if (connectivity != _connectivity) {
+            connectivity = _connectivity;
+            reset();
+        }
+    }
+
+    void IncrementalPathPlanner::reset() {
+        is_initialized = false;
+    }
+
+    bool IncrementalPathPlanner::plan(const MAPF::GridView &grid, const std::array<int, 3> &start,
+                                      const std::array<int, 3> &goal, std::vector<std::array<int, 3>> &path) {
+        path.clear();
+        statistics.n_plans++;
+
+        std::array<int, 3> grid_dim = {grid.width, grid.height, grid.depth};
+        if (grid_dim != dim) {
+            dim = grid_dim;
+            is_initialized = false;
+        }
+        if (not isInside(start) or not isInside(goal)) {
+            return false;
+        }
+
+        start_cell = toCell(start);
+        int new_goal_cell = toCell(goal);
+        if (not is_initialized or new_goal_cell != goal_cell) {
+            goal_cell = new_goal_cell;
+            initialize(grid);
+        } else {
+            // The heuristic is measured from the start, the keys in the queue stay lower bounds by km once it moves
+            km += heuristic(last_start_cell, start_cell);
+            loadOccupancy(grid);
+        }
+        last_start_cell = start_cell;
+
+        for (int cell: changed_cells) {
+            updateVertex(cell);
+            forEachAdjacent(cell, [this](int neighbor) { updateVertex(neighbor); });
+        }
+        statistics.n_changed_cells += static_cast<long>(changed_cells.size());
+        changed_cells.clear();
+
+        computeShortestPath();
+        if (occupancy[start_cell] or g[start_cell] == INF_COST) {
+            return false;
+        }
+
+        // Descend g from the start, every step decreases g so the loop ends at the goal
+        int cell = start_cell;
+        path.emplace_back(toNode(cell));
+        while (cell != goal_cell) {
+            int next_cell = -1;
+            float min_cost = INF_COST;
+            forEachNeighbor(cell, [&](int neighbor, float cost) {
+                if (cost + g[neighbor] < min_cost) {
+                    min_cost = cost + g[neighbor];
+                    next_cell = neighbor;
+                }
+            });
+            if (next_cell < 0 or g[next_cell] >= g[cell]) {
+                path.clear();
+                return false;
+            }
+            cell = next_cell;
+            path.emplace_back(toNode(cell));
+        }
+
+        return true;
+    }
+
+    int IncrementalPathPlanner::toCell(const std::array<int, 3> &node) const {
+        return (node[2] * dim[1] + node[1]) * dim[0] + node[0];
+    }
+
+    std::array<int, 3> IncrementalPathPlanner::toNode(int cell) const {
+        return {cell % dim[0], (cell / dim[0]) % dim[1], cell / (dim[0] * dim[1])};
+    }
+
+    bool IncrementalPathPlanner::isInside(const std::array<int, 3> &node) const {
+        for (int k = 0; k < 3; k++) {
+            if (node[k] < 0 or node[k] >= dim[k]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    float IncrementalPathPlanner::heuristic(int cell_a, int cell_b) const {
+        std::array<int, 3> node_a = toNode(cell_a);
+        std::array<int, 3> node_b = toNode(cell_b);
+        float dx = static_cast<float>(node_a[0] - node_b[0]);
+        float dy = static_cast<float>(node_a[1] - node_b[1]);
+        float dz = static_cast<float>(node_a[2] - node_b[2]);
+        return std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
+
+    IncrementalPathPlanner::Key IncrementalPathPlanner::calculateKey(int cell) const {
+        float min_g = std::min(g[cell], rhs[cell]);
+        return {min_g + heuristic(start_cell, cell) + km, min_g};
+    }
+
+    template<typename Visit>
+    void IncrementalPathPlanner::forEachAdjacent(int cell, const Visit &visit) const {
+        std::array<int, 3> node = toNode(cell);
+        for (const auto &neighbor: neighbors) {
+            std::array<int, 3> next = {node[0] + neighbor.offset[0], node[1] + neighbor.offset[1],
+                                       node[2] + neighbor.offset[2]};
+            if (isInside(next)) {
+                visit(toCell(next));
+            }
+        }
+    }
+
+    template<typename Visit>
+    void IncrementalPathPlanner::forEachNeighbor(int cell, const Visit &visit) const {
+        if (occupancy[cell]) {
+            return;
+        }
+        std::array<int, 3> node = toNode(cell);
+        for (const auto &neighbor: neighbors) {
+            std::array<int, 3> next = {node[0] + neighbor.offset[0], node[1] + neighbor.offset[1],
+                                       node[2] + neighbor.offset[2]};
+            if (not isInside(next)) {
+                continue;
+            }
+            int next_cell = toCell(next);
+            if (not occupancy[next_cell]) {
+                visit(next_cell, neighbor.cost);
+            }
+        }
+    }
+
+    void IncrementalPathPlanner::initialize(const MAPF::GridView &grid) {
+        statistics.n_resets++;
+
+        neighbors.clear();
+        int dz_max = dim[2] > 1 ? 1 : 0;
+        for (int dz = -dz_max; dz <= dz_max; dz++) {
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    int n_axes = std::abs(dx) + std::abs(dy) + std::abs(dz);
+                    if (n_axes == 0 or (connectivity != 26 and n_axes > 1)) {
+                        continue;
+                    }
+                    neighbors.push_back({{dx, dy, dz}, std::sqrt(static_cast<float>(n_axes))});
+                }
+            }
+        }
+
+        size_t n_cells = static_cast<size_t>(dim[0]) * dim[1] * dim[2];
+        occupancy.assign(n_cells, 0);
+        for (int z = 0; z < dim[2]; z++) {
+            for (int y = 0; y < dim[1]; y++) {
+                for (int x = 0; x < dim[0]; x++) {
+                    occupancy[toCell({x, y, z})] = grid.isOccupied(x, y, z);
+                }
+            }
+        }
+        g.assign(n_cells, INF_COST);
+        rhs.assign(n_cells, INF_COST);
+        open_keys.assign(n_cells, Key(INF_COST, INF_COST));
+        in_open.assign(n_cells, 0);
+        open = decltype(open)();
+        changed_cells.clear();
+        km = 0;
+
+        // The goal is freed by GridBasedPlanner::updateGridMission, an occupied goal is not reachable
+        updateVertex(goal_cell);
+        is_initialized = true;
+    }
+
+    void IncrementalPathPlanner::loadOccupancy(const MAPF::GridView &grid) {
+        for (int z = 0; z < dim[2]; z++) {
+            for (int y = 0; y < dim[1]; y++) {
+                for (int x = 0; x < dim[0]; x++) {
+                    int cell = toCell({x, y, z});
+                    uint8_t is_occupied = grid.isOccupied(x, y, z);
+                    if (occupancy[cell] != is_occupied) {
+                        occupancy[cell] = is_occupied;
+                        changed_cells.emplace_back(cell);
+                    }
+                }
+            }
+        }
+    }
+
+    void IncrementalPathPlanner::push(int cell) {
+        open_keys[cell] = calculateKey(cell);
+        in_open[cell] = 1;
+        open.push({open_keys[cell], cell});
+
+        // The stale entries are dropped when they outnumber the cells
+        if (open.size() > 4 * occupancy.size() + 64) {
+            std::vector<OpenNode> nodes;
+            for (size_t i = 0; i < in_open.size(); i++) {
+                if (in_open[i]) {
+                    nodes.push_back({open_keys[i], static_cast<int>(i)});
+                }
+            }
+            open = decltype(open)(std::greater<>(), std::move(nodes));
+        }
+    }
+
+    void IncrementalPathPlanner::updateVertex(int cell) {
+        if (cell == goal_cell) {
+            rhs[cell] = occupancy[cell] ? INF_COST : 0;
+        } else {
+            float min_rhs = INF_COST;
+            forEachNeighbor(cell, [&](int neighbor, float cost) {
+                min_rhs = std::min(min_rhs, cost + g[neighbor]);
+            });
+            rhs[cell] = min_rhs;
+        }
+
+        in_open[cell] = 0;
+        if (g[cell] != rhs[cell]) {
+            push(cell);
+        }
+    }
+
+    void IncrementalPathPlanner::computeShortestPath() {
+        while (not open.empty()) {
+            OpenNode top = open.top();
+            if (not in_open[top.cell] or top.key != open_keys[top.cell]) {
+                open.pop();
+                continue;
+            }
+            if (top.key >= calculateKey(start_cell) and rhs[start_cell] == g[start_cell]) {
+                break;
+            }
+
+            open.pop();
+            in_open[top.cell] = 0;
+            statistics.n_expanded++;
+
+            int cell = top.cell;
+            Key new_key = calculateKey(cell);
+            if (top.key < new_key) {
+                push(cell);
+            } else if (g[cell] > rhs[cell]) {
+                g[cell] = rhs[cell];
+                forEachNeighbor(cell, [this](int neighbor, float) { updateVertex(neighbor); });
+            } else {
+                // The cell may be occupied since its g was set, its old neighbors are updated as well
+                g[cell] = INF_COST;
+                updateVertex(cell);
+                forEachAdjacent(cell, [this](int neighbor) { updateVertex(neighbor); });
+            }
+        }
+    }
+}
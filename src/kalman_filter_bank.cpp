@@ -0,0 +1,108 @@
+#include <kalman_filter_bank.hpp>
+
+namespace DynamicPlanning {
+    void KalmanFilterBank::initialize(double _sigma_y_sq, double _sigma_a_sq) {
+        sigma_y_sq = _sigma_y_sq;
+        sigma_a_sq = _sigma_a_sq;
+        n_tracks = 0;
+        track_indices.clear();
+        update_times.clear();
+    }
+
+    void KalmanFilterBank::filter(const std::vector<Obstacle> &obstacles, std::vector<Obstacle> &filtered) {
+        // Gather the tracks in the order of the obstacles
+        size_t n_obs = obstacles.size();
+        tracks_next.resize((Eigen::Index)n_obs, N_FIELDS);
+        track_indices_next.clear();
+        is_new_track.assign(n_obs, false);
+        dt.resize((Eigen::Index)n_obs);
+        measurements.resize((Eigen::Index)n_obs, 3);
+        std::vector<ros::Time> update_times_next(n_obs);
+        for (size_t oi = 0; oi < n_obs; oi++) {
+            const Obstacle &obstacle = obstacles[oi];
+            std::pair<int, int> key(obstacle.type, obstacle.id);
+            track_indices_next[key] = oi;
+            for (int k = 0; k < 3; k++) {
+                measurements((Eigen::Index)oi, k) = obstacle.position(k);
+            }
+            update_times_next[oi] = obstacle.update_time;
+
+            auto it = track_indices.find(key);
+            if (it == track_indices.end()) {
+                is_new_track[oi] = true;
+                dt((Eigen::Index)oi) = 0;
+                tracks_next.row((Eigen::Index)oi).setZero();
+            } else {
+                dt((Eigen::Index)oi) = (obstacle.update_time - update_times[it->second]).toSec();
+                tracks_next.row((Eigen::Index)oi) = tracks.row((Eigen::Index)it->second);
+            }
+        }
+        std::swap(tracks, tracks_next);
+        std::swap(track_indices, track_indices_next);
+        std::swap(update_times, update_times_next);
+        n_tracks = n_obs;
+
+        // The measurement of a track whose update time has not changed is already applied
+        std::vector<size_t> stale_tracks;
+        for (size_t oi = 0; oi < n_obs; oi++) {
+            if (not is_new_track[oi] and dt((Eigen::Index)oi) == 0) {
+                stale_tracks.emplace_back(oi);
+            }
+        }
+        stale_rows.resize((Eigen::Index)stale_tracks.size(), N_FIELDS);
+        for (size_t si = 0; si < stale_tracks.size(); si++) {
+            stale_rows.row((Eigen::Index)si) = tracks.row((Eigen::Index)stale_tracks[si]);
+        }
+
+        // Predict: F = [1 dt; 0 1] per axis, Q = sigma_a_sq * B * B^T with B = [0; dt]
+        auto p_pp = tracks.col(P_PP), p_pv = tracks.col(P_PV), p_vv = tracks.col(P_VV);
+        Eigen::ArrayXd p_pp_pred = p_pp + 2 * dt * p_pv + dt * dt * p_vv;
+        Eigen::ArrayXd p_pv_pred = p_pv + dt * p_vv;
+        Eigen::ArrayXd p_vv_pred = p_vv + sigma_a_sq * dt * dt;
+
+        // Kalman gain of the position measurement, the same for all axes
+        Eigen::ArrayXd innovation_inv = (p_pp_pred + sigma_y_sq).inverse();
+        Eigen::ArrayXd gain_p = p_pp_pred * innovation_inv;
+        Eigen::ArrayXd gain_v = p_pv_pred * innovation_inv;
+
+        // Update
+        for (int k = 0; k < 3; k++) {
+            auto position = tracks.col(PX + k), velocity = tracks.col(VX + k);
+            Eigen::ArrayXd residual = measurements.col(k) - (position + dt * velocity);
+            position += dt * velocity + gain_p * residual;
+            velocity += gain_v * residual;
+        }
+        p_pp = p_pp_pred - gain_p * p_pp_pred;
+        p_pv = p_pv_pred - gain_p * p_pv_pred;
+        p_vv = p_vv_pred - gain_v * p_pv_pred;
+
+        for (size_t si = 0; si < stale_tracks.size(); si++) {
+            tracks.row((Eigen::Index)stale_tracks[si]) = stale_rows.row((Eigen::Index)si);
+        }
+
+        // A new track starts at the observation with zero velocity
+        for (size_t oi = 0; oi < n_obs; oi++) {
+            if (is_new_track[oi]) {
+                auto track = tracks.row((Eigen::Index)oi);
+                track.setZero();
+                track.segment<3>(PX) = measurements.row((Eigen::Index)oi);
+                track(P_PP) = 10;
+                track(P_VV) = 10;
+            }
+        }
+
+        filtered.resize(n_obs);
+        for (size_t oi = 0; oi < n_obs; oi++) {
+            filtered[oi] = obstacles[oi];
+            auto track = tracks.row((Eigen::Index)oi);
+            filtered[oi].position = point3d(track(PX), track(PY), track(PZ));
+            filtered[oi].velocity = point3d(track(VX), track(VY), track(VZ));
+        }
+    }
+
+    double KalmanFilterBank::getUncertaintyRadius(size_t oi, double t_delta) const {
+        auto track = tracks.row((Eigen::Index)oi);
+        double p_pp_pred = track(P_PP) + 2 * t_delta * track(P_PV) + t_delta * t_delta * track(P_VV);
+        return 1.33 * sqrt(2.0 * 3 * p_pp_pred);
+    }
+}
@@ -0,0 +1,95 @@
+#include <latency_histogram.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace DynamicPlanning {
+    void LatencyHistogram::record(double value) {
+        if (not std::isfinite(value)) {
+            return;
+        }
+        value = std::max(value, 0.0);
+        if (counts.empty()) {
+            counts.assign(N_BUCKETS, 0);
+        }
+
+        uint64_t max_units = (uint64_t(1) << MAX_EXPONENT) - 1;
+        double units = std::min(value / UNIT, static_cast<double>(max_units));
+        counts[getBucketIndex(static_cast<uint64_t>(units))]++;
+        if (count == 0 or value < min) {
+            min = value;
+        }
+        if (count == 0 or value > max) {
+            max = value;
+        }
+        count++;
+    }
+
+    void LatencyHistogram::merge(const LatencyHistogram &other) {
+        if (other.count == 0) {
+            return;
+        }
+        if (counts.empty()) {
+            counts.assign(N_BUCKETS, 0);
+        }
+
+        for (int bi = 0; bi < N_BUCKETS; bi++) {
+            counts[bi] += other.counts[bi];
+        }
+        min = count == 0 ? other.min : std::min(min, other.min);
+        max = count == 0 ? other.max : std::max(max, other.max);
+        count += other.count;
+    }
+
+    void LatencyHistogram::clear() {
+        counts.clear();
+        count = 0;
+        min = 0;
+        max = 0;
+    }
+
+    double LatencyHistogram::getPercentile(double percentile) const {
+        if (count == 0) {
+            return 0;
+        }
+
+        // The nearest rank, the first sample is the 0th percentile
+        percentile = std::min(std::max(percentile, 0.0), 100.0);
+        auto rank = static_cast<uint64_t>(std::ceil(percentile / 100.0 * static_cast<double>(count)));
+        rank = std::max(rank, uint64_t(1));
+        if (rank >= count) {
+            return max;
+        }
+
+        uint64_t cumulative_count = 0;
+        for (int bi = 0; bi < N_BUCKETS; bi++) {
+            cumulative_count += counts[bi];
+            if (cumulative_count >= rank) {
+                // The recorded extremes are exact, the buckets between them are not
+                return std::min(std::max(getBucketValue(bi), min), max);
+            }
+        }
+        return max;
+    }
+
+    int LatencyHistogram::getBucketIndex(uint64_t units) {
+        if (units < SUB_BUCKETS) {
+            return static_cast<int>(units);
+        }
+
+        int exponent = 63 - __builtin_clzll(units);
+        int shift = exponent - SUB_BUCKET_BITS;
+        return SUB_BUCKETS * shift + static_cast<int>(units >> shift);
+    }
+
+    double LatencyHistogram::getBucketValue(int bucket_idx) {
+        if (bucket_idx < SUB_BUCKETS) {
+            return (bucket_idx + 0.5) * UNIT;
+        }
+
+        int shift = bucket_idx / SUB_BUCKETS - 1;
+        uint64_t sub_bucket = bucket_idx % SUB_BUCKETS + SUB_BUCKETS;
+        double lower = static_cast<double>(sub_bucket << shift);
+        double width = static_cast<double>(uint64_t(1) << shift);
+        return (lower + 0.5 * width) * UNIT;
+    }
+}
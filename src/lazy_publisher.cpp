@@ -0,0 +1,54 @@
+#include <lazy_publisher.hpp>
+#include <ros/master.h>
+
+namespace DynamicPlanning {
+    TopicInterestMonitor &TopicInterestMonitor::getInstance() {
+        static TopicInterestMonitor topic_interest_monitor;
+        return topic_interest_monitor;
+    }
+
+    bool TopicInterestMonitor::isSubscribed(const std::string &topic) {
+        std::lock_guard<std::mutex> lock(mtx);
+        ros::WallTime current_time = ros::WallTime::now();
+        if (not has_refreshed or (current_time - last_refresh_time).toSec() > REFRESH_PERIOD) {
+            refresh();
+            last_refresh_time = current_time;
+            has_refreshed = true;
+        }
+        return subscribed_topics.find(topic) != subscribed_topics.end();
+    }
+
+    void TopicInterestMonitor::refresh() {
+        // getSystemState returns [publishers, subscribers, services], each of them a list of [topic, [nodes]]
+        XmlRpc::XmlRpcValue args, result, payload;
+        args[0] = ros::this_node::getName();
+        if (not ros::master::execute("getSystemState", args, result, payload, false)) {
+            return; // the last state is kept
+        }
+        if (payload.getType() != XmlRpc::XmlRpcValue::TypeArray or payload.size() < 2 or
+            payload[1].getType() != XmlRpc::XmlRpcValue::TypeArray) {
+            return;
+        }
+
+        subscribed_topics.clear();
+        XmlRpc::XmlRpcValue &subscribers = payload[1];
+        for (int i = 0; i < subscribers.size(); i++) {
+            XmlRpc::XmlRpcValue &entry = subscribers[i];
+            if (entry.getType() == XmlRpc::XmlRpcValue::TypeArray and entry.size() >= 2 and
+                entry[0].getType() == XmlRpc::XmlRpcValue::TypeString and
+                entry[1].getType() == XmlRpc::XmlRpcValue::TypeArray and entry[1].size() > 0) {
+                subscribed_topics.insert(static_cast<std::string>(entry[0]));
+            }
+        }
+    }
+
+    uint32_t LazyPublisher::getNumSubscribers() {
+        if (not publisher) {
+            if (not advertise or not TopicInterestMonitor::getInstance().isSubscribed(topic_name)) {
+                return 0;
+            }
+            publisher = advertise();
+        }
+        return publisher.getNumSubscribers();
+    }
+}
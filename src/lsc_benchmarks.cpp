@@ -0,0 +1,400 @@
+// Micro-benchmarks of the planner components with Google Benchmark: the QP solves of recorded trajectory
+// optimizations, the SFC expansion on the world map, the closest points of the LSC normal vectors, the Bernstein
+// evaluation, the batch distance kernels against the scalar helpers, the MAPF grid map update, PIBT and ECBS on the
+// mission and the distance transform of the world.
+// The random inputs use fixed seeds, so the runs are comparable. The results are written to
+// <package_path>/log/lsc_benchmarks.json unless --benchmark_out is given.
+// The parameters are read like the simulator, e.g. from the namespace of a launch file, or their defaults.
+// rosrun lsc_dr_planner lsc_benchmarks <mission file> <world file or directory> [qp directory] [benchmark flags]
+// Record the QP problems with <param name="opt/record_qp" value="true" />, the QP cases are skipped without them.
+#include <benchmark/benchmark.h>
+#include <collision_constraints.hpp>
+#include <geometry.hpp>
+#include <geometry_kernels.hpp>
+#include <global_map_registry.hpp>
+#include <grid_based_planner.hpp>
+#include <mission.hpp>
+#include <param.hpp>
+#include <polynomial.hpp>
+#include <qp_solver.hpp>
+#include <experimental/filesystem>
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+namespace fs = std::experimental::filesystem;
+using namespace DynamicPlanning;
+
+static constexpr unsigned int BENCHMARK_SEED = 0;
+
+// Inputs shared by the cases, loaded once before the benchmarks run
+struct BenchmarkInput {
+    std::unique_ptr<Param> param;
+    std::shared_ptr<Mission> mission;
+    std::shared_ptr<GlobalMap> global_map;
+    std::vector<QPProblem> qp_problems;
+
+    [[nodiscard]] std::shared_ptr<DistanceMap> getDistmap() const {
+        // Aliasing pointer, the global map owns the distmap
+        return {global_map, global_map->distmap.get()};
+    }
+
+    [[nodiscard]] std::shared_ptr<octomap::OcTree> getOctomap() const {
+        return {global_map, global_map->octree.get()};
+    }
+};
+
+static BenchmarkInput input;
+
+static void BM_QPSolve(benchmark::State &state) {
+    if (input.qp_problems.empty()) {
+        state.SkipWithError("no recorded QP problem");
+        return;
+    }
+    std::unique_ptr<QPSolver> solver = createQPSolver(static_cast<QPSolverMode>(state.range(0)));
+    state.SetLabel(solver->getName());
+
+    size_t pi = 0;
+    for (auto _: state) {
+        QPSolution solution;
+        bool success = solver->solve(input.qp_problems[pi], solution);
+        benchmark::DoNotOptimize(success);
+        pi = (pi + 1) % input.qp_problems.size();
+    }
+}
+
+// expandSFC with isObstacleInSFC from the start points of the mission
+static void BM_InitializeSFC(benchmark::State &state) {
+    CollisionConstraints constraints(*input.param, input.mission);
+    constraints.setDistmap(input.getDistmap());
+    constraints.setOctomap(input.getOctomap());
+
+    size_t qi = 0;
+    for (auto _: state) {
+        const Agent &agent = input.mission->agents[qi];
+        constraints.initializeSFC(agent.start_point, agent.radius);
+        benchmark::DoNotOptimize(constraints.getSFC(0));
+        qi = (qi + 1) % input.mission->qn;
+    }
+}
+
+// The SFC toward the goal used by the grid-based goal planner
+static void BM_ConstructSFCFromPoint(benchmark::State &state) {
+    CollisionConstraints constraints(*input.param, input.mission);
+    constraints.setDistmap(input.getDistmap());
+    constraints.setOctomap(input.getOctomap());
+
+    size_t qi = 0;
+    for (auto _: state) {
+        const Agent &agent = input.mission->agents[qi];
+        constraints.initializeSFC(agent.start_point, agent.radius);
+        constraints.constructSFCFromPoint(agent.start_point, agent.desired_goal_point, agent.radius);
+        benchmark::DoNotOptimize(constraints.getSFC(0));
+        qi = (qi + 1) % input.mission->qn;
+    }
+}
+
+// The closest point of the relative control points to the origin, the uncached part of normalVectorBetweenPolys
+static void BM_ClosestPointsBetweenPointAndConvexHull(benchmark::State &state) {
+    auto n_control_points = static_cast<size_t>(state.range(0));
+    std::mt19937 generator(BENCHMARK_SEED);
+    std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+    std::vector<points_t> control_points_rel_list(256, points_t(n_control_points));
+    for (auto &control_points_rel: control_points_rel_list) {
+        // Offset from the origin, the agents do not collide
+        point3d offset(2.0 + distribution(generator), distribution(generator), distribution(generator));
+        for (auto &control_point: control_points_rel) {
+            control_point = offset + point3d(distribution(generator), distribution(generator),
+                                             distribution(generator)) * 0.5;
+        }
+    }
+
+    size_t ci = 0;
+    for (auto _: state) {
+        ClosestPoints closest_points = closestPointsBetweenPointAndConvexHull(point3d(0, 0, 0),
+                                                                              control_points_rel_list[ci]);
+        benchmark::DoNotOptimize(closest_points);
+        ci = (ci + 1) % control_points_rel_list.size();
+    }
+}
+
+static void BM_BernsteinDeCasteljau(benchmark::State &state) {
+    auto n = static_cast<int>(state.range(0));
+    std::mt19937 generator(BENCHMARK_SEED);
+    std::uniform_real_distribution<double> distribution(0.0, 1.0);
+    points_t control_points(n + 1);
+    for (auto &control_point: control_points) {
+        control_point = point3d(distribution(generator), distribution(generator), distribution(generator));
+    }
+
+    double t_normalized = 0;
+    for (auto _: state) {
+        point3d point = deCasteljau(control_points.data(), n, t_normalized);
+        benchmark::DoNotOptimize(point);
+        t_normalized = t_normalized < 1 ? t_normalized + 0.01 : 0;
+    }
+}
+
+static void BM_BernsteinBases(benchmark::State &state) {
+    auto n = static_cast<int>(state.range(0));
+    std::mt19937 generator(BENCHMARK_SEED);
+    std::uniform_real_distribution<double> distribution(0.0, 1.0);
+    points_t control_points(n + 1);
+    for (auto &control_point: control_points) {
+        control_point = point3d(distribution(generator), distribution(generator), distribution(generator));
+    }
+
+    std::vector<double> bases(n + 1);
+    double t_normalized = 0;
+    for (auto _: state) {
+        getBernsteinBases(n, t_normalized, bases.data());
+        point3d point = combineControlPoints(control_points.data(), n, bases.data());
+        benchmark::DoNotOptimize(point);
+        t_normalized = t_normalized < 1 ? t_normalized + 0.01 : 0;
+    }
+}
+
+// Random points around the origin for the distance kernels
+static points_t randomPoints(size_t n_points, unsigned int seed) {
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<double> distribution(-5.0, 5.0);
+    points_t points(n_points);
+    for (auto &point: points) {
+        point = point3d(distribution(generator), distribution(generator), distribution(generator));
+    }
+    return points;
+}
+
+// range(0): number of points, range(1) = 1: batch kernel, 0: scalar helper in a loop
+static void BM_LInfinityDistances(benchmark::State &state) {
+    auto n_points = static_cast<size_t>(state.range(0));
+    bool batch = state.range(1) == 1;
+    points_t points = randomPoints(n_points, BENCHMARK_SEED);
+    PointsSoA points_soa;
+    points_soa.assign(points);
+    std::vector<double> dists(n_points);
+    point3d query(0.5, -0.5, 1.0);
+    for (auto _: state) {
+        if (batch) {
+            GeometryKernels::lInfinityDistances(query, points_soa, dists.data());
+        } else {
+            for (size_t j = 0; j < n_points; j++) {
+                dists[j] = LInfinityDistance(query, points[j]);
+            }
+        }
+        benchmark::DoNotOptimize(dists.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * n_points));
+}
+
+static void BM_EllipsoidalDistances(benchmark::State &state) {
+    auto n_points = static_cast<size_t>(state.range(0));
+    bool batch = state.range(1) == 1;
+    points_t points = randomPoints(n_points, BENCHMARK_SEED);
+    PointsSoA points_soa;
+    points_soa.assign(points);
+    std::vector<double> downwashes(n_points, 2.0), dists(n_points);
+    point3d query(0.5, -0.5, 1.0);
+    for (auto _: state) {
+        if (batch) {
+            GeometryKernels::ellipsoidalDistances(query, points_soa, downwashes.data(), dists.data());
+        } else {
+            for (size_t j = 0; j < n_points; j++) {
+                dists[j] = ellipsoidalDistance(query, points[j], downwashes[j]);
+            }
+        }
+        benchmark::DoNotOptimize(dists.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * n_points));
+}
+
+static void BM_BoxDistances(benchmark::State &state) {
+    auto n_points = static_cast<size_t>(state.range(0));
+    bool batch = state.range(1) == 1;
+    points_t points = randomPoints(n_points, BENCHMARK_SEED);
+    PointsSoA points_soa;
+    points_soa.assign(points);
+    std::vector<double> dists(n_points);
+    Box box(point3d(-1, -2, -1), point3d(2, 1, 1));
+    for (auto _: state) {
+        if (batch) {
+            GeometryKernels::boxDistances(box.box_min, box.box_max, points_soa, dists.data());
+        } else {
+            for (size_t j = 0; j < n_points; j++) {
+                dists[j] = box.distanceToPoint(points[j]);
+            }
+        }
+        benchmark::DoNotOptimize(dists.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * n_points));
+}
+
+static void BM_LineSegmentDistances(benchmark::State &state) {
+    auto n_points = static_cast<size_t>(state.range(0));
+    bool batch = state.range(1) == 1;
+    points_t starts = randomPoints(n_points, BENCHMARK_SEED);
+    points_t ends = randomPoints(n_points, BENCHMARK_SEED + 1);
+    PointsSoA starts_soa, ends_soa;
+    starts_soa.assign(starts);
+    ends_soa.assign(ends);
+    std::vector<double> dists(n_points);
+    point3d query(0.5, -0.5, 1.0);
+    for (auto _: state) {
+        if (batch) {
+            GeometryKernels::lineSegmentDistances(query, starts_soa, ends_soa, dists.data());
+        } else {
+            for (size_t j = 0; j < n_points; j++) {
+                dists[j] = closestPointsBetweenPointAndLineSegment(query, Line(starts[j], ends[j])).dist;
+            }
+        }
+        benchmark::DoNotOptimize(dists.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * n_points));
+}
+
+// range(0) = 1: the static layer is rebuilt at every call, 0: it is kept since the map does not change
+static void BM_UpdateGridMap(benchmark::State &state) {
+    bool full_rebuild = state.range(0) == 1;
+    GridBasedPlanner grid_based_planner(*input.param, input.mission);
+    std::shared_ptr<MapChangeLog> map_change_log = full_rebuild ? nullptr : std::make_shared<MapChangeLog>();
+    const Agent &agent = input.mission->agents[0];
+    grid_based_planner.updateGridMap(input.getDistmap(), map_change_log, agent.radius, agent.downwash);
+
+    for (auto _: state) {
+        grid_based_planner.updateGridMap(input.getDistmap(), map_change_log, agent.radius, agent.downwash);
+    }
+    state.counters["dirty_ratio"] = grid_based_planner.getGridMapUpdateReport().getDirtyRatio();
+}
+
+// The whole mission from the start points, the grid map is cached after the first call
+static void BM_MAPF(benchmark::State &state) {
+    Param param = *input.param;
+    param.mapf_mode = static_cast<MAPFMode>(state.range(0));
+    state.SetLabel(param.getMAPFModeStr());
+
+    points_t start_points, goal_points;
+    for (const auto &agent: input.mission->agents) {
+        start_points.emplace_back(agent.start_point);
+        goal_points.emplace_back(agent.desired_goal_point);
+    }
+    GridBasedPlanner grid_based_planner(param, input.mission);
+    auto map_change_log = std::make_shared<MapChangeLog>();
+    const Agent &agent = input.mission->agents[0];
+
+    bool success = true;
+    for (auto _: state) {
+        success = grid_based_planner.planMAPF(start_points, start_points, goal_points, input.getDistmap(),
+                                              map_change_log, agent.radius, agent.downwash);
+        benchmark::DoNotOptimize(success);
+    }
+    if (not success) {
+        state.SkipWithError("MAPF failed");
+    }
+}
+
+// The distance transform of the whole world, the cost of a global map without the distmap cache
+static void BM_DistmapUpdate(benchmark::State &state) {
+    for (auto _: state) {
+        state.PauseTiming();
+        SerializableDistmap distmap(GLOBAL_DISTMAP_MAX_DIST, input.global_map->octree.get(), input.mission->world_min,
+                                    input.mission->world_max, false);
+        state.ResumeTiming();
+        distmap.update();
+    }
+}
+
+// The same transform by the exact separable distance transform on the worker pool
+static void BM_DistmapUpdateParallel(benchmark::State &state) {
+    for (auto _: state) {
+        state.PauseTiming();
+        SerializableDistmap distmap(GLOBAL_DISTMAP_MAX_DIST, input.global_map->octree.get(), input.mission->world_min,
+                                    input.mission->world_max, false);
+        state.ResumeTiming();
+        distmap.updateParallel();
+    }
+}
+
+BENCHMARK(BM_QPSolve)->Arg(static_cast<int>(QPSolverMode::CPLEX))
+#ifdef USE_OSQP
+        ->Arg(static_cast<int>(QPSolverMode::OSQP))
+#endif
+        ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_InitializeSFC)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ConstructSFCFromPoint)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ClosestPointsBetweenPointAndConvexHull)->Arg(4)->Arg(6)->Arg(8);
+BENCHMARK(BM_BernsteinDeCasteljau)->Arg(3)->Arg(5)->Arg(7);
+BENCHMARK(BM_BernsteinBases)->Arg(3)->Arg(5)->Arg(7);
+BENCHMARK(BM_LInfinityDistances)->Args({16, 0})->Args({16, 1})->Args({256, 0})->Args({256, 1});
+BENCHMARK(BM_EllipsoidalDistances)->Args({16, 0})->Args({16, 1})->Args({256, 0})->Args({256, 1});
+BENCHMARK(BM_BoxDistances)->Args({16, 0})->Args({16, 1})->Args({256, 0})->Args({256, 1});
+BENCHMARK(BM_LineSegmentDistances)->Args({16, 0})->Args({16, 1})->Args({256, 0})->Args({256, 1});
+BENCHMARK(BM_UpdateGridMap)->Arg(1)->Arg(0)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_MAPF)->Arg(static_cast<int>(MAPFMode::PIBT))->Arg(static_cast<int>(MAPFMode::ECBS))
+        ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_DistmapUpdate)->Unit(benchmark::kMillisecond)->Iterations(3);
+BENCHMARK(BM_DistmapUpdateParallel)->Unit(benchmark::kMillisecond)->Iterations(3);
+
+int main(int argc, char *argv[]) {
+    ros::init(argc, argv, "lsc_benchmarks", ros::init_options::AnonymousName);
+    ros::NodeHandle nh("~");
+
+    // The results are saved as JSON by default
+    std::vector<char *> benchmark_argv(argv, argv + argc);
+    bool has_out = false;
+    for (int i = 1; i < argc; i++) {
+        has_out = has_out or std::string(argv[i]).rfind("--benchmark_out=", 0) == 0;
+    }
+    std::string out_arg = "--benchmark_out=" + ros::package::getPath("lsc_dr_planner") + "/log/lsc_benchmarks.json";
+    std::string out_format_arg = "--benchmark_out_format=json";
+    if (not has_out) {
+        benchmark_argv.emplace_back(&out_arg[0]);
+        benchmark_argv.emplace_back(&out_format_arg[0]);
+    }
+    auto benchmark_argc = static_cast<int>(benchmark_argv.size());
+    benchmark::Initialize(&benchmark_argc, benchmark_argv.data());
+    if (benchmark_argc < 3) {
+        std::cout << "Usage: lsc_benchmarks <mission file> <world file or directory> [qp directory] "
+                  << "[benchmark flags]" << std::endl;
+        return -1;
+    }
+
+    input.param = std::make_unique<Param>();
+    if (not input.param->initialize(nh)) {
+        std::cout << "Invalid parameter" << std::endl;
+        return -1;
+    }
+    input.mission = std::make_shared<Mission>(benchmark_argv[1], benchmark_argv[2]);
+    if (not input.mission->loadMission(0, input.param->world_dimension, input.param->world_z_2d, 0) or
+        input.mission->qn == 0) {
+        std::cout << "Invalid mission: " << benchmark_argv[1] << std::endl;
+        return -1;
+    }
+    input.global_map = loadGlobalMap(input.mission->current_world_file_name, input.param->world_resolution,
+                                     input.mission->world_min, input.mission->world_max, false, true);
+    if (input.global_map == nullptr) {
+        return -1;
+    }
+    if (benchmark_argc > 3 and fs::is_directory(benchmark_argv[3])) {
+        std::vector<std::string> file_names;
+        for (const auto &entry: fs::directory_iterator(benchmark_argv[3])) {
+            if (entry.path().extension() == ".qp") {
+                file_names.emplace_back(entry.path().string());
+            }
+        }
+        std::sort(file_names.begin(), file_names.end());
+        for (const auto &file_name: file_names) {
+            QPProblem problem;
+            if (readQPProblem(file_name, problem)) {
+                input.qp_problems.emplace_back(problem);
+            }
+        }
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,49 @@
+#include <map_change_log.hpp>
+
+namespace DynamicPlanning {
+    MapChangeLog::MapChangeLog(size_t _capacity) : version(0), full_change_version(0), capacity(_capacity) {}
+
+    void MapChangeLog::markAll() {
+        std::lock_guard<std::mutex> lock(mtx);
+        version++;
+        full_change_version = version;
+        entries.clear();
+    }
+
+    void MapChangeLog::markRegion(const octomap::point3d &region_min, const octomap::point3d &region_max) {
+        std::lock_guard<std::mutex> lock(mtx);
+        version++;
+        entries.emplace_back(Entry{version, Region(region_min, region_max)});
+        if (entries.size() > capacity) {
+            entries.pop_front();
+        }
+    }
+
+    uint64_t MapChangeLog::getVersion() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return version;
+    }
+
+    bool MapChangeLog::getChangesSince(uint64_t _version, std::vector<Region> &regions) const {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (_version > version or _version < full_change_version) {
+            return false;
+        }
+        if (_version == version) {
+            return true;
+        }
+
+        // The entries after the version must be all in the log
+        uint64_t oldest_version = entries.empty() ? version + 1 : entries.front().version;
+        if (oldest_version > _version + 1) {
+            return false;
+        }
+
+        for (const auto &entry: entries) {
+            if (entry.version > _version) {
+                regions.emplace_back(entry.region);
+            }
+        }
+        return true;
+    }
+}
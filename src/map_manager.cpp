@@ -1,20 +1,52 @@
 #include "map_manager.hpp"
+#include <metrics_registry.hpp>
+#include <trace.hpp>
 
 namespace DynamicPlanning {
-    MapManager::MapManager(const ros::NodeHandle& _nh, const Param& _param, const Mission& _mission, int agent_id)
-        : param(_param), mission(_mission), nh(_nh) {
+    MapManager::MapManager(const ros::NodeHandle& _nh, const Param& _param,
+                           const std::shared_ptr<const Mission>& _mission, int agent_id)
+        : param(_param), mission(_mission), nh(_nh), has_sensor_position(false), sensor_yaw(0), map_seq(0) {
         agent_frame_id = "mav" + std::to_string(agent_id);
         world_frame_id = param.world_frame_id;
 
         has_global_map = false;
         count_global_map_publish = 0;
 
-        octree_ptr = std::make_shared<octomap::OcTree>(param.world_resolution);
-        distmap_ptr = std::make_shared<DynamicEDTOctomap>(1.0, octree_ptr.get(),
-                                                          mission.world_min, mission.world_max, false);
+        map_change_log_ptr = std::make_shared<MapChangeLog>();
+
+        // The global map is shared by the agents, so the agents do not allocate their own maps
+        setGlobalMap();
+        if (not has_global_map) {
+            octree_ptr = std::make_shared<octomap::OcTree>(param.world_resolution);
+            if (param.world_rolling_window_size > 0) {
+                // The memory of the local map is bounded by the window, so the world-sized index is not built
+                rolling_distmap_ptr = std::make_shared<RollingDistmap>(*octree_ptr, mission->world_min,
+                                                                       mission->world_max,
+                                                                       param.world_rolling_window_size,
+                                                                       param.world_max_dist);
+            } else {
+                if (param.world_sparse_distmap) {
+                    sparse_distmap_ptr = std::make_shared<SparseVoxelMap>(*octree_ptr, mission->world_min,
+                                                                          mission->world_max, param.world_max_dist);
+                } else {
+                    distmap_ptr = std::make_shared<BatchDistmap>(param.world_max_dist, octree_ptr.get(),
+                                                                 mission->world_min, mission->world_max, false);
+                }
+                if (param.world_occupancy_index) {
+                    occupancy_index_ptr = std::make_shared<OccupancyIndex>(mission->world_min, mission->world_max,
+                                                                           param.world_resolution);
+                }
+            }
+        }
+        publishSnapshot();
+
+        if (param.multisim_headless) {
+            return;
+        }
 
         std::string prefix = "/mav" + std::to_string(agent_id);
-        pub_sensor_map = nh.advertise<octomap_msgs::Octomap>(prefix + "/local_octomap", 1);
+        pub_sensor_map.initialize<octomap_msgs::Octomap>(nh, prefix + "/local_octomap", 1,
+                                                         param.multisim_lazy_publishers);
 
         if(agent_id == 0){
             service_get_octomap = nh.advertiseService("/octomap_binary", &MapManager::getOctomapCallback, this);
@@ -27,33 +59,109 @@ namespace DynamicPlanning {
         }
 
         if(param.world_use_octomap and param.world_use_global_map){
-            if(agent_frame_id == "mav0" and count_global_map_publish < 20){
-                octomap_msgs::Octomap msg_global_octomap;
-                octomap_msgs::fullMapToMsg(*octree_ptr, msg_global_octomap);
+            if(agent_frame_id == "mav0" and count_global_map_publish < 20 and
+               (not param.multisim_lazy_publishers or pub_sensor_map.getNumSubscribers() > 0)){
+                octomap_msgs::Octomap msg_global_octomap = getSnapshotOctomapMsg();
                 msg_global_octomap.header.frame_id = world_frame_id;
                 msg_global_octomap.header.stamp = ros::Time::now();
                 count_global_map_publish++;
                 pub_sensor_map.publish(msg_global_octomap);
             }
-        } else if(not param.world_use_global_map){
+        } else if(not param.world_use_global_map and pub_sensor_map.getNumSubscribers() > 0){
+            // Serializing the octomap is skipped if no one listens
             pub_sensor_map.publish(getLocalOctomapMsg());
         }
     }
 
     octomap_msgs::Octomap MapManager::getLocalOctomapMsg() const{
-        octomap_msgs::Octomap msg_local_octomap;
-        octomap_msgs::fullMapToMsg(*octree_ptr, msg_local_octomap);
+        octomap_msgs::Octomap msg_local_octomap = getSnapshotOctomapMsg();
         msg_local_octomap.header.frame_id = world_frame_id;
         msg_local_octomap.header.stamp = ros::Time::now();
         return msg_local_octomap;
     }
 
+    octomap_msgs::Octomap MapManager::getSnapshotOctomapMsg() const {
+        // A version is published only if the map is changed, so the version identifies the octree. The service
+        // thread pins the snapshot, then the writer copies the octree instead of changing it during the serialization.
+        std::shared_ptr<const MapSnapshot> current_snapshot = getSnapshot();
+        std::lock_guard<std::mutex> lock(octomap_msg_cache.mtx);
+        if (not octomap_msg_cache.is_valid or octomap_msg_cache.version != current_snapshot->version) {
+            static MetricCounter &serializations = MetricsRegistry::getInstance().getCounter(
+                    "lsc_octomap_serializations_total", "Octomap messages serialized from a new version of the map");
+            serializations.increment();
+            octomap_msg_cache.msg = octomap_msgs::Octomap();
+            octomap_msgs::fullMapToMsg(*current_snapshot->octree, octomap_msg_cache.msg);
+            octomap_msg_cache.version = current_snapshot->version;
+            octomap_msg_cache.is_valid = true;
+        } else {
+            static MetricCounter &cache_hits = MetricsRegistry::getInstance().getCounter(
+                    "lsc_octomap_serialization_cache_hits_total", "Octomap messages reused since the map is unchanged");
+            cache_hits.increment();
+        }
+        return octomap_msg_cache.msg;
+    }
+
+    std::shared_ptr<const MapSnapshot> MapManager::getSnapshot() const {
+        return std::atomic_load(&snapshot);
+    }
+
     std::shared_ptr<octomap::OcTree> MapManager::getOctomap() const {
-        return octree_ptr;
+        return getSnapshot()->octree;
+    }
+
+    std::shared_ptr<DistanceMap> MapManager::getDistmap() const {
+        return getSnapshot()->distmap;
+    }
+
+    std::shared_ptr<OccupancyIndex> MapManager::getOccupancyIndex() const {
+        return getSnapshot()->occupancy_index;
+    }
+
+    std::shared_ptr<MapChangeLog> MapManager::getMapChangeLog() const {
+        return getSnapshot()->map_change_log;
     }
 
-    std::shared_ptr<DynamicEDTOctomap> MapManager::getDistmap() const {
-        return distmap_ptr;
+    void MapManager::prepareMapWrite() {
+        // Only the writer replaces the snapshot, so the count can not grow from 1 while it writes
+        if (snapshot == nullptr or snapshot.use_count() <= 1 or octree_ptr != snapshot->octree) {
+            return; // not pinned, or the components are already copied for the next version
+        }
+
+        static MetricCounter &snapshot_copies = MetricsRegistry::getInstance().getCounter(
+                "lsc_map_snapshot_copies_total", "Map components copied since a reader pinned the last version");
+        snapshot_copies.increment();
+        octree_ptr = std::make_shared<octomap::OcTree>(*octree_ptr);
+        if (rolling_distmap_ptr != nullptr) {
+            rolling_distmap_ptr = std::make_shared<RollingDistmap>(*rolling_distmap_ptr);
+        } else if (sparse_distmap_ptr != nullptr) {
+            sparse_distmap_ptr = std::make_shared<SparseVoxelMap>(*sparse_distmap_ptr);
+        } else {
+            // The distmap refers to the octree, so it is built again on the copy
+            distmap_ptr = std::make_shared<BatchDistmap>(param.world_max_dist, octree_ptr.get(),
+                                                         mission->world_min, mission->world_max, false);
+            distmap_ptr->updateParallel();
+        }
+        if (occupancy_index_ptr != nullptr) {
+            occupancy_index_ptr = std::make_shared<OccupancyIndex>(*occupancy_index_ptr);
+        }
+    }
+
+    void MapManager::publishSnapshot() {
+        auto next_snapshot = std::make_shared<MapSnapshot>();
+        next_snapshot->version = snapshot != nullptr ? snapshot->version + 1 : 0;
+        next_snapshot->octree = octree_ptr;
+        if (primitive_world_ptr != nullptr) {
+            next_snapshot->distmap = primitive_world_ptr;
+        } else if (rolling_distmap_ptr != nullptr) {
+            next_snapshot->distmap = rolling_distmap_ptr;
+        } else if (sparse_distmap_ptr != nullptr) {
+            next_snapshot->distmap = sparse_distmap_ptr;
+        } else {
+            next_snapshot->distmap = distmap_ptr;
+        }
+        next_snapshot->occupancy_index = occupancy_index_ptr;
+        next_snapshot->map_change_log = map_change_log_ptr;
+        std::atomic_store(&snapshot, std::shared_ptr<const MapSnapshot>(std::move(next_snapshot)));
     }
 
     void MapManager::setGlobalMap() {
@@ -61,86 +169,271 @@ namespace DynamicPlanning {
             return;
         }
 
-        std::string mission_extension = mission.current_world_file_name.substr(
-                mission.current_world_file_name.find_last_of(".") + 1);
-        if (mission_extension == "csv") {
-            updateOctreeFromCSV();
-        } else if (not octree_ptr->readBinary(mission.current_world_file_name)) {
-            ROS_ERROR_STREAM("[MapManager] Fail to read world file: " << mission.current_world_file_name);
+        // The maps of the same world file, resolution and boundary are the same
+        std::ostringstream key;
+        key << mission->current_world_file_name << "," << param.world_resolution << ","
+            << mission->world_min << "," << mission->world_max << "," << param.world_occupancy_index << ","
+            << param.world_distmap_cache << "," << param.world_analytic;
+        global_map = GlobalMapRegistry::getInstance().acquire(key.str(), [this]() {
+            return loadGlobalMap(mission->current_world_file_name, param.world_resolution,
+                                 mission->world_min, mission->world_max,
+                                 param.world_occupancy_index, param.world_distmap_cache, param.world_analytic);
+        });
+        if (global_map == nullptr) {
             return;
         }
 
-        octree_ptr->expand();
-        distmap_ptr = std::make_shared<DynamicEDTOctomap>(1.0, octree_ptr.get(),
-                                                          mission.world_min, mission.world_max,
-                                                          false);
-        distmap_ptr->update();
+        // The pointers share the ownership of the whole map
+        octree_ptr = std::shared_ptr<octomap::OcTree>(global_map, global_map->octree.get());
+        if (global_map->primitive_world != nullptr) {
+            primitive_world_ptr = std::shared_ptr<PrimitiveWorld>(global_map, global_map->primitive_world.get());
+        } else {
+            distmap_ptr = std::shared_ptr<BatchDistmap>(global_map, global_map->distmap.get());
+        }
+        if (global_map->occupancy_index != nullptr) {
+            occupancy_index_ptr = std::shared_ptr<OccupancyIndex>(global_map, global_map->occupancy_index.get());
+        }
+        map_change_log_ptr->markAll();
 
         has_global_map = true;
+        publishSnapshot();
     }
 
-    void MapManager::setGlobalMap(const sensor_msgs::PointCloud2& msg_global_map) {
-        if(has_global_map or (param.world_use_octomap and param.world_use_global_map)){
-            return;
+    void MapManager::resetMission(const std::shared_ptr<const Mission>& _mission) {
+        if (global_map == nullptr) {
+            throw std::logic_error("[MapManager] Only the global octomap is kept between the missions");
         }
 
-        pcl::PointCloud<pcl::PointXYZ> cloud_input;
-        pcl::fromROSMsg(msg_global_map, cloud_input);
-
-        pcl::VoxelGrid<pcl::PointXYZ> voxel_sampler;
-        voxel_sampler.setLeafSize(0.1f, 0.1f, 0.1f);
-        voxel_sampler.setInputCloud(cloud_input.makeShared());
-        voxel_sampler.filter(cloud_all_map);
+        mission = _mission;
+        has_sensor_position = false;
+        sensor_yaw = 0;
+        sensor_statistics = SensorStatistics();
+        count_global_map_publish = 0;
+    }
 
-        kdtreeGlobalMap.setInputCloud(cloud_all_map.makeShared());
+    void MapManager::setGlobalMap(const std::shared_ptr<const GlobalPointCloud>& _global_cloud) {
+        if(has_global_map or (param.world_use_octomap and param.world_use_global_map) or _global_cloud == nullptr){
+            return;
+        }
 
+        global_cloud = _global_cloud;
+        if (param.sensor_mode == SensorMode::RAYCAST) {
+            raycast_sensor = std::make_unique<RaycastSensor>(mission->world_min, mission->world_max,
+                                                             param.world_resolution, param.sensor_range,
+                                                             param.sensor_horizontal_fov, param.sensor_vertical_fov,
+                                                             param.sensor_angular_resolution);
+            for (const auto& point : global_cloud->getCloud().points) {
+                if (point.z < -1.0) {
+                    continue;
+                }
+                raycast_sensor->markOccupied(point3d(point.x, point.y, point.z));
+            }
+        }
         has_global_map = true;
     }
 
     void MapManager::updateGlobalMap(const sensor_msgs::PointCloud2& msg_global_map){
-        pcl::PointCloud<pcl::PointXYZ> global_map;
-        pcl::fromROSMsg(msg_global_map, global_map);
-        octomap::Pointcloud octomap_pointcloud;
-        for (const auto& point : global_map.points) {
-            octomap_pointcloud.push_back(point3d(point.x, point.y, point.z));
+        // The global map is known, so the voxels are marked occupied without the ray insertion
+        std::vector<octomap::OcTreeKey> keys;
+        PointCloudIngestionReport report;
+        if (not ingestPointCloud2(msg_global_map, *octree_ptr, keys, report)) {
+            ROS_ERROR("[MapManager] Fail to parse the global map, the x, y and z fields must be float32 or float64");
+            return;
         }
-
-        octree_ptr->insertPointCloud(octomap_pointcloud, point3d(0,0,0));
+        prepareMapWrite();
+        insertOccupiedVoxels(*octree_ptr, keys);
+        if (sparse_distmap_ptr != nullptr) {
+            // Filled in bulk, then the changed keys of the octree leave the blocks unchanged
+            sparse_distmap_ptr->insertOccupied(keys);
+            sparse_distmap_ptr->update();
+        }
+        buildOccupancyIndex();
+        map_change_log_ptr->markAll();
+        publishSnapshot();
     }
 
     void MapManager::updateVirtualLocalMap(const point3d& agent_position){
+        insertVirtualSensorInput(agent_position);
+        updateLocalDistmap();
+    }
+
+    void MapManager::insertVirtualSensorInput(const point3d& agent_position){
         if(not has_global_map){
             return;
         }
 
-        //sensor intput
+        // The version is published by updateLocalDistmap, after the distmap follows the octree
+        prepareMapWrite();
+        moveRollingWindow(agent_position);
         updateVirtualSensorInput(agent_position);
-        distmap_ptr->update();
     }
 
-    void MapManager::updateVirtualSensorInput(const point3d& agent_position){
-        sensor_msgs::PointCloud2 msg_sensor_map = getVirtualSensorInput(agent_position);
+    void MapManager::updateLocalDistmap(){
+        TRACE_SCOPE("MapManager::updateLocalDistmap");
+        // The sensor input changes the voxels in the sensor range only, so the changed voxels bound the dirty region.
+        // The distmap propagates the changes within its maximum distance from them, and the users of the change log
+        // inflate the region by the distance they depend on.
+        if(octree_ptr->numChangesDetected() == 0){
+            return;
+        }
 
-        pcl::PointCloud<pcl::PointXYZ> local_sensor_map;
-        pcl::fromROSMsg(msg_sensor_map, local_sensor_map);
+        point3d region_min(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+                           std::numeric_limits<float>::max());
+        point3d region_max = -region_min;
+        for (auto it = octree_ptr->changedKeysBegin(); it != octree_ptr->changedKeysEnd(); ++it) {
+            point3d point = octree_ptr->keyToCoord(it->first);
+            for (int k = 0; k < 3; k++) {
+                region_min(k) = std::min(region_min(k), point(k));
+                region_max(k) = std::max(region_max(k), point(k));
+            }
+        }
 
-        pcl::PointCloud<pcl::PointXYZ> sensor_map;
-        Eigen::Affine3f transform = Eigen::Affine3f::Identity();
-        transform.translation() << agent_position.x(), agent_position.y(), agent_position.z();
-        pcl::transformPointCloud(local_sensor_map, sensor_map, transform);
+        prepareMapWrite();
+        updateDistmap();
+        point3d margin(param.world_resolution, param.world_resolution, param.world_resolution);
+        if (occupancy_index_ptr != nullptr) {
+            occupancy_index_ptr->update(*octree_ptr, region_min - margin, region_max + margin);
+        }
+        map_change_log_ptr->markRegion(region_min - margin, region_max + margin);
+        publishSnapshot();
+    }
 
-        octomap::Pointcloud sensor_octomap;
-        for (const auto& point : sensor_map.points) {
-            if(isnan(point.x)){
-                continue;
+    void MapManager::updateVirtualSensorInput(const point3d& agent_position){
+        TRACE_SCOPE("MapManager::updateVirtualSensorInput");
+        Timer timer;
+        size_t n_free_voxels, n_occupied_voxels;
+        if (raycast_sensor != nullptr) {
+            // The sensor faces the moving direction, it keeps the last direction while the agent stops
+            point3d motion = agent_position - last_sensor_position;
+            if (has_sensor_position and std::hypot(motion.x(), motion.y()) > SP_EPSILON) {
+                sensor_yaw = std::atan2(motion.y(), motion.x());
             }
-            if(point.z < -1.0){
-                continue;
+            last_sensor_position = agent_position;
+            has_sensor_position = true;
+
+            raycast_sensor->sense(*octree_ptr, agent_position, sensor_yaw, sensor_free_keys, sensor_occupied_keys);
+            for (const auto& key : sensor_free_keys) {
+                octree_ptr->updateNode(key, false);
+            }
+            for (const auto& key : sensor_occupied_keys) {
+                octree_ptr->updateNode(key, true);
             }
-            sensor_octomap.push_back(point3d(point.x, point.y, point.z));
+            n_free_voxels = sensor_free_keys.size();
+            n_occupied_voxels = sensor_occupied_keys.size();
+        } else {
+            // The points of the global map are inserted in the global frame directly, the buffers are reused
+            sensor_octomap.clear();
+            const std::vector<int>& indices = global_cloud->radiusSearch(agent_position, param.sensor_range);
+            sensor_octomap.reserve(indices.size());
+            for (int idx : indices) {
+                const pcl::PointXYZ& point = global_cloud->getPoint(idx);
+                if(isnan(point.x)){
+                    continue;
+                }
+                if(point.z < -1.0){
+                    continue;
+                }
+                sensor_octomap.push_back(point.x, point.y, point.z);
+            }
+
+            std::tie(n_free_voxels, n_occupied_voxels) = insertSensorPoints(agent_position);
         }
+        timer.stop();
 
-        octree_ptr->insertPointCloud(sensor_octomap, agent_position, param.sensor_range);
+        sensor_statistics.n_updates++;
+        sensor_statistics.n_free_voxels += n_free_voxels;
+        sensor_statistics.n_occupied_voxels += n_occupied_voxels;
+        sensor_statistics.total_time += timer.elapsedSeconds();
+        sensor_statistics.time_histogram.record(timer.elapsedSeconds());
+    }
+
+    std::pair<size_t, size_t> MapManager::insertSensorPoints(const point3d& sensor_origin) {
+        TRACE_SCOPE("MapManager::insertSensorPoints");
+        static constexpr size_t POINT_BATCH_SIZE = 256; // points per task of the worker pool
+        WorkerPool& pool = WorkerPool::getInstance();
+        auto n_buckets = static_cast<size_t>(pool.getNumWorkers());
+        size_t n_batches = (sensor_octomap.size() + POINT_BATCH_SIZE - 1) / POINT_BATCH_SIZE;
+        if (sensor_ray_batches.size() < n_batches) {
+            sensor_ray_batches.resize(n_batches);
+        }
+
+        // The rays of the batches, as in OcTree::computeUpdate a point beyond the range only frees its ray
+        const octomap::OcTree& octree = *octree_ptr;
+        double max_range = param.sensor_range;
+        pool.run(n_batches, [&](size_t batch_idx) {
+            SensorRayBatch& batch = sensor_ray_batches[batch_idx];
+            batch.free_keys.resize(n_buckets);
+            batch.occupied_keys.resize(n_buckets);
+            for (size_t bi = 0; bi < n_buckets; bi++) {
+                batch.free_keys[bi].clear();
+                batch.occupied_keys[bi].clear();
+            }
+
+            octomap::OcTreeKey::KeyHash hash;
+            size_t end = std::min((batch_idx + 1) * POINT_BATCH_SIZE, sensor_octomap.size());
+            for (size_t i = batch_idx * POINT_BATCH_SIZE; i < end; i++) {
+                const octomap::point3d& point = sensor_octomap.getPoint(i);
+                octomap::point3d ray_end = point;
+                bool is_hit = max_range < 0 or (point - sensor_origin).norm() <= max_range;
+                if (not is_hit) {
+                    ray_end = sensor_origin + (point - sensor_origin).normalized() * static_cast<float>(max_range);
+                }
+                if (octree.computeRayKeys(sensor_origin, ray_end, batch.key_ray)) {
+                    for (const auto& key : batch.key_ray) {
+                        batch.free_keys[hash(key) % n_buckets].emplace_back(key);
+                    }
+                }
+                octomap::OcTreeKey key;
+                if (is_hit and octree.coordToKeyChecked(point, key)) {
+                    batch.occupied_keys[hash(key) % n_buckets].emplace_back(key);
+                }
+            }
+        });
+
+        auto isKeyLess = [](const octomap::OcTreeKey& a, const octomap::OcTreeKey& b) {
+            return std::tie(a[0], a[1], a[2]) < std::tie(b[0], b[1], b[2]);
+        };
+        sensor_free_buckets.resize(n_buckets);
+        sensor_occupied_buckets.resize(n_buckets);
+        pool.run(n_buckets, [&](size_t bi) {
+            std::vector<octomap::OcTreeKey>& occupied_keys = sensor_occupied_buckets[bi];
+            occupied_keys.clear();
+            for (size_t batch_idx = 0; batch_idx < n_batches; batch_idx++) {
+                const auto& keys = sensor_ray_batches[batch_idx].occupied_keys[bi];
+                occupied_keys.insert(occupied_keys.end(), keys.begin(), keys.end());
+            }
+            std::sort(occupied_keys.begin(), occupied_keys.end(), isKeyLess);
+            occupied_keys.erase(std::unique(occupied_keys.begin(), occupied_keys.end()), occupied_keys.end());
+
+            std::vector<octomap::OcTreeKey>& free_keys = sensor_free_buckets[bi];
+            free_keys.clear();
+            for (size_t batch_idx = 0; batch_idx < n_batches; batch_idx++) {
+                const auto& keys = sensor_ray_batches[batch_idx].free_keys[bi];
+                free_keys.insert(free_keys.end(), keys.begin(), keys.end());
+            }
+            std::sort(free_keys.begin(), free_keys.end(), isKeyLess);
+            free_keys.erase(std::unique(free_keys.begin(), free_keys.end()), free_keys.end());
+
+            // The free keys hit by a point, both are sorted
+            auto free_end = std::remove_if(free_keys.begin(), free_keys.end(), [&](const octomap::OcTreeKey& key) {
+                return std::binary_search(occupied_keys.begin(), occupied_keys.end(), key, isKeyLess);
+            });
+            free_keys.erase(free_end, free_keys.end());
+        });
+
+        // The octree is updated in the order of the buckets, the changed keys bound the update of the distmap
+        size_t n_free_voxels = 0, n_occupied_voxels = 0;
+        for (size_t bi = 0; bi < n_buckets; bi++) {
+            for (const auto& key : sensor_free_buckets[bi]) {
+                octree_ptr->updateNode(key, false);
+            }
+            for (const auto& key : sensor_occupied_buckets[bi]) {
+                octree_ptr->updateNode(key, true);
+            }
+            n_free_voxels += sensor_free_buckets[bi].size();
+            n_occupied_voxels += sensor_occupied_buckets[bi].size();
+        }
+        return {n_free_voxels, n_occupied_voxels};
     }
 
     // global frame
@@ -194,21 +487,9 @@ namespace DynamicPlanning {
         sensor_map.points.clear();
 
         // Radius search
-        std::vector<int> pointIdxRadiusSearch;
-        std::vector<float> pointRadiusSquaredDistance;
-        pointIdxRadiusSearch.clear();
-        pointRadiusSquaredDistance.clear();
-        pcl::PointXYZ searchPoint(agent_position.x(),
-                                  agent_position.y(),
-                                  agent_position.z());
-
-        pcl::PointXYZ pt;
-        if (kdtreeGlobalMap.radiusSearch(searchPoint, param.sensor_range,
-                                         pointIdxRadiusSearch,
-                                         pointRadiusSquaredDistance) > 0) {
-            for (int idx: pointIdxRadiusSearch) {
-                pt = cloud_all_map.points[idx];
-                sensor_map.points.push_back(pt);
+        if (global_cloud != nullptr) {
+            for (int idx: global_cloud->radiusSearch(agent_position, param.sensor_range)) {
+                sensor_map.points.push_back(global_cloud->getPoint(idx));
             }
         }
 
@@ -234,84 +515,230 @@ namespace DynamicPlanning {
         }
 
         auto* merge_octree_ptr = dynamic_cast<octomap::OcTree*>(octomap_msgs::fullMsgToMap(msg_merge_map));
+        if (merge_octree_ptr == nullptr) {
+            return;
+        }
 
-        // Expand tree2 so we search all nodes
+        // Expand tree2 so that every leaf is a voxel, then merge the leaves as a delta
         merge_octree_ptr->expand();
-
-        // traverse nodes in tree2 to add them to tree1
+        MapDelta delta;
         for (octomap::OcTree::leaf_iterator it = merge_octree_ptr->begin_leafs();
              it != merge_octree_ptr->end_leafs(); ++it) {
+            delta.append(it.getKey(), it->getLogOdds());
+        }
+        delete merge_octree_ptr;
 
-            // find if the current node maps a point in map1
-            point3d point = it.getCoordinate();
-            octomap::OcTreeNode *nodeIn1 = octree_ptr->search(point);
-            if (nodeIn1 != nullptr) {
-                // Add the probability of tree2 node to the found node
-                octomap::OcTreeKey nodeKey = octree_ptr->coordToKey(point);
-                octree_ptr->updateNode(nodeKey, it->getLogOdds());
-            } else {
-                // Create a new node and set the probability from tree2
-                octomap::OcTreeNode *newNode = octree_ptr->updateNode(point, true);
-                newNode->setLogOdds(it->getLogOdds());
+        std::vector<PreparedMapMerge> merges;
+        merges.emplace_back(prepareMapMerge(*octree_ptr, delta));
+        applyMapMerges(merges);
+    }
+
+    MapDelta MapManager::getMapDelta(uint64_t since_seq) const {
+        MapDelta delta;
+        delta.seq = map_seq;
+        auto it = std::upper_bound(voxel_journal.begin(), voxel_journal.end(), since_seq,
+                                   [](uint64_t seq, const std::pair<uint64_t, octomap::OcTreeKey> &entry) {
+                                       return seq < entry.first;
+                                   });
+        for (; it != voxel_journal.end(); ++it) {
+            const octomap::OcTreeKey &key = it->second;
+            auto seq_it = voxel_seqs.find(key);
+            if (seq_it == voxel_seqs.end() or seq_it->second != it->first) {
+                continue; // changed again later, or dropped from the rolling window
+            }
+            const octomap::OcTreeNode *node = octree_ptr->search(key);
+            if (node != nullptr) {
+                delta.append(key, node->getLogOdds());
             }
         }
+        return delta;
+    }
 
-        delete merge_octree_ptr;
+    uint64_t MapManager::getPeerMapSeq(int peer_id) const {
+        auto it = peer_map_seqs.find(peer_id);
+        return it == peer_map_seqs.end() ? 0 : it->second;
+    }
+
+    void MapManager::mergeMapDelta(int peer_id, const MapDelta& delta) {
+        if(param.world_use_global_map){
+            return;
+        }
+        peer_map_seqs[peer_id] = delta.seq;
+        if (delta.size() == 0) {
+            return;
+        }
+
+        std::vector<PreparedMapMerge> merges;
+        merges.emplace_back(prepareMapMerge(*octree_ptr, delta));
+        applyMapMerges(merges);
+    }
+
+    void MapManager::mergeMapDeltaAsync(int peer_id, MapDelta delta) {
+        if(param.world_use_global_map){
+            return;
+        }
+        peer_map_seqs[peer_id] = delta.seq;
+        if (delta.size() == 0) {
+            return;
+        }
+
+        auto merge = std::make_shared<PreparedMapMerge>();
+        pending_map_merges.emplace_back(merge);
+        std::shared_ptr<const octomap::OcTree> octree = octree_ptr;
+        MapMergeWorker::getInstance().submit([octree, merge, delta = std::move(delta)]() {
+            *merge = prepareMapMerge(*octree, delta);
+        });
     }
 
-    void MapManager::updateOctreeFromCSV(){
-        octomap::Pointcloud octomap_pointcloud;
+    void MapManager::commitMapMerges() {
+        if (pending_map_merges.empty()) {
+            return;
+        }
 
-        std::ifstream obstacle_csv(mission.current_world_file_name);
-        for(auto& row: CSVRange(obstacle_csv))
-        {
-            if(row.size() < 2){
-                break;
+        MapMergeWorker::getInstance().wait();
+        std::vector<PreparedMapMerge> merges;
+        merges.reserve(pending_map_merges.size());
+        for (const auto& merge : pending_map_merges) {
+            merges.emplace_back(std::move(*merge));
+        }
+        pending_map_merges.clear();
+        applyMapMerges(merges);
+    }
+
+    void MapManager::applyMapMerges(const std::vector<PreparedMapMerge>& merges) {
+        // The log-odds of the peer are added to the existing voxels, the identical voxels are skipped
+        prepareMapWrite();
+        point3d region_min(SP_INFINITY, SP_INFINITY, SP_INFINITY);
+        point3d region_max(-SP_INFINITY, -SP_INFINITY, -SP_INFINITY);
+        bool has_change = false;
+        for (const auto& merge : merges) {
+            if (merge.keys.empty()) {
+                continue;
+            }
+            applyMapMerge(*octree_ptr, merge);
+            for (int k = 0; k < 3; k++) {
+                region_min(k) = std::min(region_min(k), merge.region_min(k));
+                region_max(k) = std::max(region_max(k), merge.region_max(k));
             }
+            has_change = true;
+        }
+        if (not has_change) {
+            return;
+        }
 
-            points_t points;
-            points.resize(2); // center of mass, size
-            for(int i = 0; i < 2; i++){
-                for(int k = 0; k < 3; k++){
-                    std::string token = std::string(row[i * 3 + k]);
-                    points[i](k) = std::stod(token);
-                }
+        updateDistmap();
+        point3d margin(param.world_resolution, param.world_resolution, param.world_resolution);
+        if (occupancy_index_ptr != nullptr) {
+            occupancy_index_ptr->update(*octree_ptr, region_min - margin, region_max + margin);
+        }
+        map_change_log_ptr->markRegion(region_min - margin, region_max + margin);
+        publishSnapshot();
+    }
+
+    void MapManager::updateDistmap() {
+        TRACE_SCOPE("MapManager::updateDistmap");
+        recordMapChanges();
+        if (rolling_distmap_ptr == nullptr and sparse_distmap_ptr == nullptr) {
+            distmap_ptr->updateParallel();
+            return;
+        }
+
+        for (auto it = octree_ptr->changedKeysBegin(); it != octree_ptr->changedKeysEnd(); ++it) {
+            const octomap::OcTreeNode *node = octree_ptr->search(it->first);
+            bool occupied = node != nullptr and octree_ptr->isNodeOccupied(node);
+            if (rolling_distmap_ptr != nullptr) {
+                rolling_distmap_ptr->setOccupied(it->first, occupied);
+            } else {
+                sparse_distmap_ptr->setOccupied(it->first, occupied);
             }
+        }
+        if (rolling_distmap_ptr != nullptr) {
+            rolling_distmap_ptr->update();
+        } else {
+            sparse_distmap_ptr->update();
+        }
+        octree_ptr->resetChangeDetection();
+    }
 
-            point3d com = points[0]; // center of mass
-            point3d size = points[1]; // size
+    void MapManager::moveRollingWindow(const point3d& agent_position) {
+        std::vector<RollingDistmap::Region> changed_regions;
+        if (rolling_distmap_ptr == nullptr or
+            not rolling_distmap_ptr->moveTo(*octree_ptr, agent_position, changed_regions)) {
+            return;
+        }
 
-            int i_start = (int)round((com.x() - 0.5 * size.x()) / param.world_resolution);
-            int i_end = (int)round((com.x() + 0.5 * size.x()) / param.world_resolution);
-            int j_start = (int)round((com.y() - 0.5 * size.y()) / param.world_resolution);
-            int j_end = (int)round((com.y() + 0.5 * size.y()) / param.world_resolution);
-            int k_start = (int)round((com.z() - 0.5 * size.z()) / param.world_resolution);
-            int k_end = (int)round((com.z() + 0.5 * size.z()) / param.world_resolution);
+        // A pruned leaf may cover several voxels, it is kept if any of them is in the window
+        std::vector<std::pair<octomap::OcTreeKey, unsigned int>> dropped_nodes;
+        for (auto it = octree_ptr->begin_leafs(), end = octree_ptr->end_leafs(); it != end; ++it) {
+            auto half_size = static_cast<float>(0.5 * it.getSize());
+            point3d half_extent(half_size, half_size, half_size);
+            if (not rolling_distmap_ptr->intersectsWindow(it.getCoordinate() - half_extent,
+                                                          it.getCoordinate() + half_extent)) {
+                dropped_nodes.emplace_back(it.getKey(), it.getDepth());
+            }
+        }
+        for (const auto& node : dropped_nodes) {
+            octree_ptr->deleteNode(node.first, node.second);
+        }
+        for (auto it = voxel_seqs.begin(); it != voxel_seqs.end();) {
+            it = rolling_distmap_ptr->isInWindow(it->first) ? std::next(it) : voxel_seqs.erase(it);
+        }
 
-            for(int i = i_start; i < i_end; i++){
-                for(int j = j_start; j < j_end; j++){
-                    for(int k = k_start; k < k_end; k++){
-                        point3d point((i + 0.5) * param.world_resolution,
-                                      (j + 0.5) * param.world_resolution,
-                                      (k + 0.5) * param.world_resolution);
+        for (const auto& region : changed_regions) {
+            map_change_log_ptr->markRegion(region.first, region.second);
+        }
+    }
 
-                        octomap_pointcloud.push_back(point);
-                    }
+    void MapManager::recordMapChanges() {
+        if (param.world_use_global_map) {
+            return;
+        }
+
+        bool has_change = false;
+        for (auto it = octree_ptr->changedKeysBegin(); it != octree_ptr->changedKeysEnd(); ++it) {
+            if (not has_change) {
+                map_seq++;
+                has_change = true;
+            }
+            voxel_seqs[it->first] = map_seq;
+            voxel_journal.emplace_back(map_seq, it->first);
+        }
+
+        // Drop the stale entries once they outnumber the live ones
+        if (voxel_journal.size() > 2 * voxel_seqs.size() + 1024) {
+            std::deque<std::pair<uint64_t, octomap::OcTreeKey>> compacted;
+            for (const auto &entry: voxel_journal) {
+                auto seq_it = voxel_seqs.find(entry.second);
+                if (seq_it != voxel_seqs.end() and seq_it->second == entry.first) {
+                    compacted.emplace_back(entry);
                 }
             }
+            voxel_journal.swap(compacted);
         }
+    }
 
-        octree_ptr->insertPointCloud(octomap_pointcloud, point3d(0,0,0));
+    void MapManager::buildOccupancyIndex() {
+        if (occupancy_index_ptr != nullptr) {
+            occupancy_index_ptr->build(*octree_ptr);
+        }
     }
 
     bool MapManager::getOctomapCallback(octomap_msgs::GetOctomapRequest &req,
                                         octomap_msgs::GetOctomapResponse &res){
-        octomap_msgs::Octomap msg_global_octomap;
-        octomap_msgs::fullMapToMsg(*octree_ptr, msg_global_octomap);
-        msg_global_octomap.header.frame_id = world_frame_id;
-        msg_global_octomap.header.stamp = ros::Time::now();
-        res.map = msg_global_octomap;
-
+        // The request has no fields, so the response is the full map. The peers get the changes since their last
+        // merge as map deltas instead, see getMapDelta.
+        Timer timer;
+        res.map = getLocalOctomapMsg();
+        timer.stop();
+
+        static MetricHistogram &service_latency = MetricsRegistry::getInstance().getHistogram(
+                "lsc_octomap_service_seconds", "Latency of the octomap service");
+        static MetricCounter &service_bytes = MetricsRegistry::getInstance().getCounter(
+                "lsc_octomap_service_bytes_total", "Bytes of the maps sent by the octomap service");
+        service_latency.record(timer.elapsedSeconds());
+        service_bytes.increment(res.map.data.size());
+        ROS_INFO_STREAM("[MapManager] octomap service: " << res.map.data.size() << " bytes in "
+                        << timer.elapsedSeconds() << " s");
         return true;
     }
 }
\ No newline at end of file
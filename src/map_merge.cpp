@@ -0,0 +1,296 @@
+#include <map_merge.hpp>
+#include <metrics_registry.hpp>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace DynamicPlanning {
+    // The child index of octomap at each depth is x + 2y + 4z, so the interleaved bits sort the keys depth-first
+    static uint64_t mortonCode(const octomap::OcTreeKey &key, unsigned int tree_depth) {
+        uint64_t code = 0;
+        for (int bit = static_cast<int>(tree_depth) - 1; bit >= 0; bit--) {
+            code = (code << 3) | (static_cast<uint64_t>((key[2] >> bit) & 1) << 2) |
+                   (static_cast<uint64_t>((key[1] >> bit) & 1) << 1) | static_cast<uint64_t>((key[0] >> bit) & 1);
+        }
+        return code;
+    }
+
+    static octomap::OcTreeKey mortonKey(uint64_t code, unsigned int tree_depth) {
+        octomap::OcTreeKey key(0, 0, 0);
+        for (unsigned int bit = 0; bit < tree_depth; bit++) {
+            for (int k = 0; k < 3; k++) {
+                key[k] |= static_cast<octomap::key_type>(((code >> (3 * bit + k)) & 1) << bit);
+            }
+        }
+        return key;
+    }
+
+    void MapDelta::append(const octomap::OcTreeKey &key, float log_odds) {
+        size_t offset = data.size();
+        data.resize(offset + VOXEL_SIZE);
+        for (int k = 0; k < 3; k++) {
+            uint16_t key_k = key.k[k];
+            std::memcpy(data.data() + offset + k * sizeof(uint16_t), &key_k, sizeof(uint16_t));
+        }
+        std::memcpy(data.data() + offset + 3 * sizeof(uint16_t), &log_odds, sizeof(float));
+    }
+
+    void MapDelta::get(size_t i, octomap::OcTreeKey &key, float &log_odds) const {
+        size_t offset = i * VOXEL_SIZE;
+        for (int k = 0; k < 3; k++) {
+            uint16_t key_k;
+            std::memcpy(&key_k, data.data() + offset + k * sizeof(uint16_t), sizeof(uint16_t));
+            key.k[k] = key_k;
+        }
+        std::memcpy(&log_odds, data.data() + offset + 3 * sizeof(uint16_t), sizeof(float));
+    }
+
+    namespace MapDeltaCodec {
+        // The keys of a delta have 16 bits, the depth of octomap
+        static constexpr unsigned int KEY_BITS = 16;
+        static constexpr uint8_t LITERAL = 255; // the tag of a log-odds which is not in the table
+
+        static void appendVarint(std::vector<uint8_t> &out, uint64_t value) {
+            while (value >= 0x80) {
+                out.emplace_back(static_cast<uint8_t>(value | 0x80));
+                value >>= 7;
+            }
+            out.emplace_back(static_cast<uint8_t>(value));
+        }
+
+        static bool readVarint(const uint8_t *&ptr, const uint8_t *end, uint64_t &value) {
+            value = 0;
+            for (int shift = 0; shift < 64 and ptr < end; shift += 7) {
+                uint8_t byte = *ptr++;
+                value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void compress(const MapDelta &delta, std::vector<uint8_t> &out) {
+            std::vector<std::pair<uint64_t, float>> voxels(delta.size()); // (code, log-odds)
+            for (size_t i = 0; i < voxels.size(); i++) {
+                octomap::OcTreeKey key;
+                delta.get(i, key, voxels[i].second);
+                voxels[i].first = mortonCode(key, KEY_BITS);
+            }
+            std::sort(voxels.begin(), voxels.end(),
+                      [](const std::pair<uint64_t, float> &a, const std::pair<uint64_t, float> &b) {
+                          return a.first < b.first;
+                      });
+
+            out.clear();
+            out.reserve(voxels.size() * 3 + 8);
+            appendVarint(out, voxels.size());
+            std::vector<float> table;
+            uint64_t prev_code = 0;
+            for (const auto &voxel: voxels) {
+                appendVarint(out, voxel.first - prev_code);
+                prev_code = voxel.first;
+
+                // The bits are compared, so that the decoded value is the same float
+                auto it = std::find_if(table.begin(), table.end(), [&](float value) {
+                    return std::memcmp(&value, &voxel.second, sizeof(float)) == 0;
+                });
+                if (it != table.end()) {
+                    out.emplace_back(static_cast<uint8_t>(it - table.begin()));
+                    continue;
+                }
+                out.emplace_back(LITERAL);
+                size_t offset = out.size();
+                out.resize(offset + sizeof(float));
+                std::memcpy(out.data() + offset, &voxel.second, sizeof(float));
+                if (table.size() < LITERAL) {
+                    table.emplace_back(voxel.second);
+                }
+            }
+
+            static MetricCounter &raw_bytes = MetricsRegistry::getInstance().getCounter(
+                    "lsc_map_delta_raw_bytes_total", "Bytes of the map deltas before the compression");
+            static MetricCounter &compressed_bytes = MetricsRegistry::getInstance().getCounter(
+                    "lsc_map_delta_compressed_bytes_total", "Bytes of the compressed map deltas");
+            raw_bytes.increment(delta.data.size());
+            compressed_bytes.increment(out.size());
+        }
+
+        bool decompress(const uint8_t *data, size_t size, MapDelta &delta) {
+            const uint8_t *ptr = data;
+            const uint8_t *end = data + size;
+            uint64_t n_voxels;
+            if (not readVarint(ptr, end, n_voxels) or n_voxels > size) {
+                return false;
+            }
+
+            delta.data.reserve(delta.data.size() + n_voxels * MapDelta::VOXEL_SIZE);
+            std::vector<float> table;
+            uint64_t code = 0;
+            for (uint64_t i = 0; i < n_voxels; i++) {
+                uint64_t gap;
+                if (not readVarint(ptr, end, gap) or ptr >= end) {
+                    return false;
+                }
+                code += gap;
+
+                uint8_t tag = *ptr++;
+                float log_odds;
+                if (tag == LITERAL) {
+                    if (end - ptr < static_cast<std::ptrdiff_t>(sizeof(float))) {
+                        return false;
+                    }
+                    std::memcpy(&log_odds, ptr, sizeof(float));
+                    ptr += sizeof(float);
+                    if (table.size() < LITERAL) {
+                        table.emplace_back(log_odds);
+                    }
+                } else if (tag < table.size()) {
+                    log_odds = table[tag];
+                } else {
+                    return false;
+                }
+                delta.append(mortonKey(code, KEY_BITS), log_odds);
+            }
+            return ptr == end;
+        }
+    }
+
+    PreparedMapMerge prepareMapMerge(const octomap::OcTree &octree, const MapDelta &delta) {
+        struct Voxel {
+            uint64_t code;
+            octomap::OcTreeKey key;
+            float log_odds;
+        };
+
+        unsigned int tree_depth = octree.getTreeDepth();
+        std::vector<Voxel> voxels(delta.size());
+        for (size_t i = 0; i < voxels.size(); i++) {
+            delta.get(i, voxels[i].key, voxels[i].log_odds);
+            voxels[i].code = mortonCode(voxels[i].key, tree_depth);
+        }
+        std::sort(voxels.begin(), voxels.end(), [](const Voxel &a, const Voxel &b) { return a.code < b.code; });
+
+        PreparedMapMerge merge;
+        const float infinity = std::numeric_limits<float>::infinity();
+        merge.region_min = octomap::point3d(infinity, infinity, infinity);
+        merge.region_max = octomap::point3d(-infinity, -infinity, -infinity);
+
+        // path[d] is the node at the depth d on the path of the previous voxel, valid up to path_depth
+        std::vector<const octomap::OcTreeNode *> path(tree_depth + 1, nullptr);
+        path[0] = octree.getRoot();
+        unsigned int path_depth = 0;
+        for (size_t i = 0; i < voxels.size(); i++) {
+            const Voxel &voxel = voxels[i];
+            unsigned int depth = 0;
+            if (i > 0) {
+                uint64_t diff = voxel.code ^ voxels[i - 1].code;
+                unsigned int common_depth = tree_depth;
+                if (diff != 0) {
+                    auto highest_bit = static_cast<unsigned int>(63 - __builtin_clzll(diff));
+                    common_depth = (3 * tree_depth - 1 - highest_bit) / 3;
+                }
+                depth = std::min(common_depth, path_depth);
+            }
+
+            // Descend to the voxel or to the pruned leaf that covers it, nullptr if the voxel is unknown
+            const octomap::OcTreeNode *node = path[depth];
+            while (node != nullptr and depth < tree_depth and octree.nodeHasChildren(node)) {
+                unsigned int child_idx = octomap::computeChildIdx(voxel.key, static_cast<int>(tree_depth - 1 - depth));
+                if (not octree.nodeChildExists(node, child_idx)) {
+                    node = nullptr;
+                    break;
+                }
+                node = octree.getNodeChild(node, child_idx);
+                depth++;
+                path[depth] = node;
+            }
+            path_depth = depth;
+
+            if (node != nullptr and node->getLogOdds() == voxel.log_odds) {
+                merge.n_skipped_voxels++;
+                continue;
+            }
+
+            merge.keys.emplace_back(voxel.key);
+            merge.log_odds.emplace_back(voxel.log_odds);
+            octomap::point3d point = octree.keyToCoord(voxel.key);
+            for (int k = 0; k < 3; k++) {
+                merge.region_min(k) = std::min(merge.region_min(k), point(k));
+                merge.region_max(k) = std::max(merge.region_max(k), point(k));
+            }
+        }
+        return merge;
+    }
+
+    void applyMapMerge(octomap::OcTree &octree, const PreparedMapMerge &merge) {
+        for (size_t i = 0; i < merge.keys.size(); i++) {
+            const octomap::OcTreeKey &key = merge.keys[i];
+            if (octree.search(key) != nullptr) {
+                octree.updateNode(key, merge.log_odds[i], true);
+            } else {
+                octomap::OcTreeNode *new_node = octree.updateNode(key, true, true);
+                new_node->setLogOdds(merge.log_odds[i]);
+            }
+        }
+        if (not merge.keys.empty()) {
+            octree.updateInnerOccupancy();
+        }
+    }
+
+    MapMergeWorker &MapMergeWorker::getInstance() {
+        static MapMergeWorker map_merge_worker;
+        return map_merge_worker;
+    }
+
+    MapMergeWorker::MapMergeWorker() : is_running_job(false), stop(false) {
+        worker = std::thread(&MapMergeWorker::workerLoop, this);
+    }
+
+    MapMergeWorker::~MapMergeWorker() {
+        wait();
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stop = true;
+        }
+        cv_job.notify_all();
+        worker.join();
+    }
+
+    void MapMergeWorker::submit(Job job) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            pending_jobs.emplace_back(std::move(job));
+        }
+        cv_job.notify_one();
+    }
+
+    void MapMergeWorker::wait() {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv_idle.wait(lock, [this] { return pending_jobs.empty() and not is_running_job; });
+    }
+
+    void MapMergeWorker::workerLoop() {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv_job.wait(lock, [this] { return stop or not pending_jobs.empty(); });
+                if (stop) {
+                    return;
+                }
+                job = std::move(pending_jobs.front());
+                pending_jobs.pop_front();
+                is_running_job = true;
+            }
+
+            job();
+
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                is_running_job = false;
+            }
+            cv_idle.notify_all();
+        }
+    }
+}
@@ -1,4 +1,6 @@
-#include "../include/cbs.hpp"
+#include "../include/mapf/cbs.hpp"
+
+namespace MAPF {
 
 const std::string CBS::SOLVER_NAME = "CBS";
 
@@ -43,7 +45,7 @@ void CBS::run()
          ", soc:", n->soc);
 
     // check conflict
-    LibCBS::Constraints constraints = LibCBS::getFirstConstraints(n->paths);
+    LibCBS::Constraints constraints = n->conflicts.getFirstConstraints();
     if (constraints.empty()) {
       solved = true;
       break;
@@ -56,6 +58,7 @@ void CBS::run()
       HighLevelNode_p m = std::make_shared<HighLevelNode>(
           h_node_num,       // id
           n->paths,         // (old) paths, updated by invoke
+          n->conflicts,     // (old) conflicts, updated by invoke
           new_constraints,  // new constraints
           n->makespan,      // (old) makespan
           n->soc,           // (old) sum of costs
@@ -78,6 +81,11 @@ void CBS::setInitialHighLevelNode(HighLevelNode_p n)
     Paths paths(P->getNum());
     for (int i = 0; i < P->getNum(); ++i) {
       Path path = getInitialPath(i);
+      // the greedy path does not see the time-dependent obstacles
+      if (isBlockedPath(path)) {
+        Path free_path = getSpaceTimeObstacleFreePath(i, getRemainedTime());
+        if (!free_path.empty()) path = free_path;
+      }
       if (path.empty()) {
         n->valid = false;
         return;
@@ -91,20 +99,22 @@ void CBS::setInitialHighLevelNode(HighLevelNode_p n)
   n->constraints = {};  // constraints
   n->makespan = n->paths.getMakespan();
   n->soc = n->paths.getSOC();
-  n->f = n->paths.countConflict();
+  n->conflicts = LibCBS::ConflictIndex(n->paths);
+  n->f = n->conflicts.countConflict();
   n->valid = true;  // valid
 }
 
 Path CBS::getInitialPath(int id)
 {
-  Node* s = P->getStart(id);
+  Node* s = P->getCurrent(id);
   Node* g = P->getGoal(id);
   Nodes config_g = P->getConfigGoal();
 
   Path path = {s};
   Node* p = s;
   while (p != g) {
-    p = *std::min_element(p->neighbor.begin(), p->neighbor.end(),
+    Nodes C = G->getNeighbors(p);
+    p = *std::min_element(C.begin(), C.end(),
                           [&](Node* a, Node* b) {
                             if (pathDist(id, a) != pathDist(id, b))
                               return pathDist(id, a) < pathDist(id, b);
@@ -125,23 +135,21 @@ void CBS::invoke(HighLevelNode_p h_node, int id)
     h_node->valid = false;
     return;
   }
-  Paths paths = h_node->paths;
-  paths.insert(id, path);
   /*
    * update f-value (#conflicts)
-   * it takes too much time for compute without the previous value
+   * the conflicts of the agent are replaced in the index
    */
-  h_node->f = h_node->f -
-              h_node->paths.countConflict(id, h_node->paths.get(id)) +
-              h_node->paths.countConflict(id, paths.get(id));
-  h_node->paths = paths;
+  h_node->f -= h_node->conflicts.countConflict(id);
+  h_node->paths.insert(id, path);
+  h_node->conflicts.update(id, path);
+  h_node->f += h_node->conflicts.countConflict(id);
   h_node->makespan = h_node->paths.getMakespan();
   h_node->soc = h_node->paths.getSOC();
 }
 
 Path CBS::getConstrainedPath(HighLevelNode_p h_node, int id)
 {
-  Node* s = P->getStart(id);
+  Node* s = P->getCurrent(id);
   Node* g = P->getGoal(id);
 
   // pre processing
@@ -185,6 +193,7 @@ Path CBS::getConstrainedPath(HighLevelNode_p h_node, int id)
   };
 
   CheckInvalidAstarNode checkInvalidAstarNode = [&](AstarNode* m) {
+    if (P->isBlocked(m->v, m->g)) return true;
     for (auto c : constraints) {
       if (m->g == c->t && m->v == c->v) {
         // vertex or swap conflict
@@ -195,10 +204,11 @@ Path CBS::getConstrainedPath(HighLevelNode_p h_node, int id)
   };
 
   return getPathBySpaceTimeAstar
-    (s, g, fValue, compare, checkAstarFin, checkInvalidAstarNode, getRemainedTime());
+    (G, s, g, fValue, compare, checkAstarFin, checkInvalidAstarNode, getRemainedTime());
 }
 
 void CBS::printHelp()
 {
   printHelpWithoutOption(SOLVER_NAME);
 }
+}
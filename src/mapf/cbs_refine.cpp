@@ -1,4 +1,6 @@
-#include "../include/cbs_refine.hpp"
+#include "../include/mapf/cbs_refine.hpp"
+
+namespace MAPF {
 
 CBS_REFINE::CBS_REFINE(Problem* _P, const Plan& _old_plan,
                        const std::vector<int>& _modif_list)
@@ -48,7 +50,7 @@ void CBS_REFINE::setInitialHighLevelNode(HighLevelNode_p n)
 
 Path CBS_REFINE::getInitialPath(int id)
 {
-  Node* s = P->getStart(id);
+  Node* s = P->getCurrent(id);
   Node* g = P->getGoal(id);
   Nodes config_g = P->getConfigGoal();
 
@@ -91,6 +93,7 @@ Path CBS_REFINE::getInitialPath(int id)
       if (inArray(m->v, config_g) && m->v != g) return true;
       return false;
     }
+    if (P->isBlocked(m->v, m->g)) return true;
     // see conflicts with fixed agents
     for (auto i : fixed_agents) {
       // vertex conflicts
@@ -104,7 +107,7 @@ Path CBS_REFINE::getInitialPath(int id)
   };
 
   return getPathBySpaceTimeAstar
-    (s, g, fValue, compare, checkAstarFin, checkInvalidAstarNode, getRemainedTime());
+    (G, s, g, fValue, compare, checkAstarFin, checkInvalidAstarNode, getRemainedTime());
 }
 
 CBS::CompareHighLevelNodes CBS_REFINE::getObjective()
@@ -121,7 +124,7 @@ CBS::CompareHighLevelNodes CBS_REFINE::getObjective()
 
 Path CBS_REFINE::getConstrainedPath(HighLevelNode_p h_node, int id)
 {
-  Node* s = P->getStart(id);
+  Node* s = P->getCurrent(id);
   Node* g = P->getGoal(id);
 
   // pre processing
@@ -169,6 +172,7 @@ Path CBS_REFINE::getConstrainedPath(HighLevelNode_p h_node, int id)
 
   CheckInvalidAstarNode checkInvalidAstarNode = [&](AstarNode* m) {
     if (m->f > cost_limit) return true;
+    if (P->isBlocked(m->v, m->g)) return true;
     // check constraints
     for (auto c : constraints) {
       if (m->g == c->t && m->v == c->v) {
@@ -190,7 +194,7 @@ Path CBS_REFINE::getConstrainedPath(HighLevelNode_p h_node, int id)
   };
 
   return getPathBySpaceTimeAstar
-    (s, g, fValue, compare, checkAstarFin, checkInvalidAstarNode, getRemainedTime());
+    (G, s, g, fValue, compare, checkAstarFin, checkInvalidAstarNode, getRemainedTime());
 }
 
 void CBS_REFINE::setParams(int argc, char* argv[])
@@ -213,3 +217,4 @@ void CBS_REFINE::setParams(int argc, char* argv[])
     }
   }
 }
+}
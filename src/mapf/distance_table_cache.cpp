@@ -0,0 +1,261 @@
+#include "../include/mapf/distance_table_cache.hpp"
+
+using namespace MAPF;
+
+DistanceTableCache::Table::Table(DistanceTableCache* _cache, int _goal_cell)
+    : cache(_cache),
+      goal_cell(_goal_cell),
+      last_used_round(_cache->round),
+      n_expanded(0),
+      dist(_cache->occupied.size(), INF),
+      settled(_cache->occupied.size(), 0)
+{
+  dist[goal_cell] = 0;
+  open.emplace(0, goal_cell);
+}
+
+int DistanceTableCache::Table::getDistance(const Node* const v)
+{
+  const int cell = cache->getCellIndex(v->pos);
+  while (!settled[cell]) {
+    if (open.empty()) return -1;
+    expand();
+  }
+  return dist[cell];
+}
+
+void DistanceTableCache::Table::expandAll()
+{
+  while (!open.empty()) expand();
+}
+
+void DistanceTableCache::Table::expand()
+{
+  const auto [d, cell] = open.top();
+  open.pop();
+  if (settled[cell] || d != dist[cell]) return;  // outdated
+  Node* v = cache->getNode(cell);
+  if (v == nullptr) return;  // blocked
+
+  settled[cell] = 1;
+  n_expanded++;
+  for (auto u : cache->G->getNeighbors(v)) {
+    const int u_cell = cache->getCellIndex(u->pos);
+    if (settled[u_cell] || d + 1 >= dist[u_cell]) continue;
+    dist[u_cell] = d + 1;
+    open.emplace(d + 1, u_cell);
+  }
+}
+
+bool DistanceTableCache::Table::hasSupport(int cell) const
+{
+  if (cell == goal_cell) return true;
+  Node* v = cache->getNode(cell);
+  if (v == nullptr) return false;
+  for (auto u : cache->G->getNeighbors(v)) {
+    const int u_cell = cache->getCellIndex(u->pos);
+    if (settled[u_cell] && dist[u_cell] == dist[cell] - 1) return true;
+  }
+  return false;
+}
+
+void DistanceTableCache::Table::reopen(int cell)
+{
+  Node* v = cache->getNode(cell);
+  if (v == nullptr || settled[cell]) return;
+  int d = INF;
+  for (auto u : cache->G->getNeighbors(v)) {
+    const int u_cell = cache->getCellIndex(u->pos);
+    if (settled[u_cell]) d = std::min(d, dist[u_cell] + 1);
+  }
+  dist[cell] = d;
+  if (d != INF) open.emplace(d, cell);
+}
+
+bool DistanceTableCache::Table::repair(const std::vector<int>& blocked_cells)
+{
+  // A blocked cell also removes the diagonal edges that sweep it, and such edges connect the cells adjacent to it.
+  // So the settled cells adjacent to the blocked cells are checked, in the order of distance.
+  Open check;
+  std::vector<int> reopened, adjacent_cells;
+  for (int cell : blocked_cells) {
+    if (cell == goal_cell) return false;
+    settled[cell] = 0;
+    dist[cell] = INF;
+    cache->getAdjacentCells(cell, adjacent_cells);
+    for (int w : adjacent_cells) {
+      if (settled[w]) check.emplace(dist[w], w);
+    }
+    reopened.push_back(cell);
+  }
+
+  // a settled cell without a neighbor one step closer to the goal is reopened, and so are its dependents
+  while (!check.empty()) {
+    const auto [d, cell] = check.top();
+    check.pop();
+    if (!settled[cell] || d != dist[cell] || hasSupport(cell)) continue;
+    settled[cell] = 0;
+    reopened.push_back(cell);
+    for (auto w : cache->G->getNeighbors(cache->getNode(cell))) {
+      const int w_cell = cache->getCellIndex(w->pos);
+      if (settled[w_cell] && dist[w_cell] == d + 1) check.emplace(d + 1, w_cell);
+    }
+  }
+
+  // the open cells next to the reopened cells may have lost their tentative distance
+  for (int cell : reopened) {
+    cache->getAdjacentCells(cell, adjacent_cells);
+    adjacent_cells.push_back(cell);
+    for (int w : adjacent_cells) reopen(w);
+  }
+  return true;
+}
+
+DistanceTableCache::DistanceTableCache(size_t _capacity)
+    : capacity(_capacity), G(nullptr), width(0), height(0), depth(0), version(0), round(0)
+{
+}
+
+void DistanceTableCache::update(const GridView& grid, Graph* _G)
+{
+  G = _G;
+  round++;
+
+  // the tables are cell-indexed, so a new size invalidates everything
+  if (grid.width != width || grid.height != height || grid.depth != depth) {
+    width = grid.width;
+    height = grid.height;
+    depth = grid.depth;
+    occupied.assign(width * height * depth, 0);
+    for (int z = 0; z < depth; ++z) {
+      for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+          occupied[getCellIndex(Pos(x, y, z))] = grid.isOccupied(x, y, z);
+        }
+      }
+    }
+    version++;
+    statistics.n_invalidated += tables.size();
+    clearTables();
+    return;
+  }
+
+  std::vector<int> blocked_cells;
+  bool has_freed_cell = false;
+  for (int z = 0; z < depth; ++z) {
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        const int cell = getCellIndex(Pos(x, y, z));
+        const uint8_t is_occupied = grid.isOccupied(x, y, z);
+        if (is_occupied == occupied[cell]) continue;
+        occupied[cell] = is_occupied;
+        if (is_occupied) {
+          blocked_cells.push_back(cell);
+        } else {
+          has_freed_cell = true;
+        }
+      }
+    }
+  }
+  if (blocked_cells.empty() && !has_freed_cell) return;
+
+  version++;
+  if (has_freed_cell) {
+    statistics.n_invalidated += tables.size();
+    clearTables();
+    return;
+  }
+
+  for (auto it = tables.begin(); it != tables.end();) {
+    if (it->second->repair(blocked_cells)) {
+      statistics.n_repaired++;
+      ++it;
+    } else {
+      statistics.n_invalidated++;
+      eraseTable(it++);
+    }
+  }
+}
+
+DistanceTableCache::Table* DistanceTableCache::getTable(const Node* const goal)
+{
+  statistics.n_query++;
+  const int goal_cell = getCellIndex(goal->pos);
+  auto it = tables.find(goal_cell);
+  if (it != tables.end()) {
+    statistics.n_hit++;
+    it->second->last_used_round = round;
+    return it->second.get();
+  }
+
+  evict();
+  auto table = std::unique_ptr<Table>(new Table(this, goal_cell));
+  Table* table_ptr = table.get();
+  tables.emplace(goal_cell, std::move(table));
+  return table_ptr;
+}
+
+void DistanceTableCache::clear()
+{
+  clearTables();
+  version++;
+}
+
+DistanceTableStatistics DistanceTableCache::getStatistics() const
+{
+  DistanceTableStatistics current = statistics;
+  for (const auto& table : tables) current.n_expanded += table.second->n_expanded;
+  return current;
+}
+
+void DistanceTableCache::eraseTable(std::map<int, std::unique_ptr<Table>>::iterator it)
+{
+  statistics.n_expanded += it->second->n_expanded;
+  tables.erase(it);
+}
+
+void DistanceTableCache::clearTables()
+{
+  for (const auto& table : tables) statistics.n_expanded += table.second->n_expanded;
+  tables.clear();
+}
+
+Node* DistanceTableCache::getNode(int cell) const
+{
+  const int x = cell % width;
+  const int y = (cell / width) % height;
+  const int z = cell / (width * height);
+  return G->getNode(x, y, z);
+}
+
+void DistanceTableCache::getAdjacentCells(int cell, std::vector<int>& cells) const
+{
+  cells.clear();
+  const int x = cell % width;
+  const int y = (cell / width) % height;
+  const int z = cell / (width * height);
+  for (int dz = -1; dz <= 1; ++dz) {
+    for (int dy = -1; dy <= 1; ++dy) {
+      for (int dx = -1; dx <= 1; ++dx) {
+        if (dx == 0 && dy == 0 && dz == 0) continue;
+        const Pos p(x + dx, y + dy, z + dz);
+        if (p.x < 0 || p.x >= width || p.y < 0 || p.y >= height || p.z < 0 || p.z >= depth) continue;
+        cells.push_back(getCellIndex(p));
+      }
+    }
+  }
+}
+
+void DistanceTableCache::evict()
+{
+  // the least recently used table that is not used in the current round
+  while (tables.size() >= capacity) {
+    auto oldest = tables.end();
+    for (auto it = tables.begin(); it != tables.end(); ++it) {
+      if (it->second->last_used_round == round) continue;
+      if (oldest == tables.end() || it->second->last_used_round < oldest->second->last_used_round) oldest = it;
+    }
+    if (oldest == tables.end()) return;
+    eraseTable(oldest);
+  }
+}
@@ -6,6 +6,7 @@ namespace MAPF {
 
     ECBS::ECBS(Problem *_P) : Solver(_P) {
         sub_optimality = DEFAULT_SUB_OPTIMALITY;
+        batch_size = 1;
         solver_name = ECBS::SOLVER_NAME + "-" + std::to_string(sub_optimality);
     }
 
@@ -23,9 +24,14 @@ namespace MAPF {
                 CompareHighLevelNode>;
         FocalList FOCAL(compareFOCAL);
 
+        // arena of the high-level nodes, deque keeps the addresses
+        std::deque<HighLevelNode> high_level_nodes;
+
         // initial node
-        HighLevelNode_p n = std::make_shared<HighLevelNode>();
+        high_level_nodes.emplace_back();
+        HighLevelNode_p n = &high_level_nodes.back();
         setInitialHighLevelNode(n);
+        Paths n_paths;
         OPEN.push(n);
         FOCAL.push(n);
         int LB_min = n->LB;
@@ -74,40 +80,81 @@ namespace MAPF {
                 for (auto ele: tmp) OPEN.push(ele);
             }
 
-            // pickup one node
-            n = FOCAL.top();
-            FOCAL.pop();
-            n->valid = false;  // closed
-
-            info(" ", "elapsed:", getSolverElapsedTime(),
-                 ", explored_node_num:", iteration, ", nodes_num:", h_node_num,
-                 ", conflicts:", n->f, ", constraints:", n->constraints.size(),
-                 ", soc:", n->soc);
+            // pickup nodes, several nodes are expanded at once if batch_size > 1
+            // The nodes are in FOCAL, so that any conflict-free node among them satisfies the sub-optimality.
+            std::vector<HighLevelNode_p> batch;
+            while (!FOCAL.empty() && (int) batch.size() < batch_size) {
+                batch.push_back(FOCAL.top());
+                FOCAL.pop();
+                batch.back()->valid = false;  // closed
+            }
+            if (batch.empty()) break;
 
             // check conflict
-            LibCBS::Constraints constraints = LibCBS::getFirstConstraints(n->paths);
-            if (constraints.empty()) {
-                solved = true;
-                break;
+            std::vector<Paths> batch_paths(batch.size());
+            std::vector<LibCBS::ConflictIndex> batch_conflicts(batch.size());
+            std::vector<LibCBS::Constraints> batch_constraints(batch.size());
+            parallelFor(batch.size(), [&](size_t k) {
+                batch_paths[k] = getPaths(batch[k]);
+                batch_conflicts[k] = LibCBS::ConflictIndex(batch_paths[k]);
+                batch_constraints[k] = batch_conflicts[k].getFirstConstraints();
+            });
+            for (size_t k = 0; k < batch.size(); ++k) {
+                n = batch[k];
+                info(" ", "elapsed:", getSolverElapsedTime(),
+                     ", explored_node_num:", iteration, ", nodes_num:", h_node_num,
+                     ", conflicts:", n->f, ", constraints:", n->getConstraintsSize(),
+                     ", soc:", n->soc);
+                if (batch_constraints[k].empty()) {
+                    n_paths = std::move(batch_paths[k]);
+                    solved = true;
+                    break;
+                }
             }
+            if (solved) break;
 
-            // create new nodes
-            for (auto c: constraints) {
-                LibCBS::Constraints new_constraints = n->constraints;
-                new_constraints.push_back(c);
-                HighLevelNode_p m = std::make_shared<HighLevelNode>(
-                        n->paths, new_constraints, n->makespan, n->soc, n->f, n->LB,
-                        n->f_mins, true);
-                invoke(m, c->id);
-                if (!m->valid) continue;
+            // create new nodes, the low-level searches of the children run concurrently
+            struct Child {
+                HighLevelNode_p node;
+                size_t parent;  // index in batch
+                int id;         // replanned agent
+            };
+            std::vector<Child> children;
+            for (size_t k = 0; k < batch.size(); ++k) {
+                n = batch[k];
+                for (auto c: batch_constraints[k]) {
+                    ConstraintChain_p new_constraints = std::make_shared<const ConstraintChain>(
+                            ConstraintChain{c, n->constraints, n->getConstraintsSize() + 1});
+                    high_level_nodes.emplace_back(
+                            n->paths, new_constraints, n->makespan, n->soc, n->f, n->LB,
+                            n->f_mins, true);
+                    children.push_back({&high_level_nodes.back(), k, c->id});
+                }
+            }
+            parallelFor(children.size(), [&](size_t j) {
+                const auto &child = children[j];
+                invoke(child.node, batch_paths[child.parent], batch_conflicts[child.parent], child.id);
+            });
+            for (const auto &child: children) {
+                HighLevelNode_p m = child.node;
+                if (!m->valid) {
+                    m->paths.clear();
+                    m->f_mins.clear();
+                    continue;
+                }
                 OPEN.push(m);
                 if (m->LB <= LB_min * sub_optimality) FOCAL.push(m);
                 ++h_node_num;
             }
+            // closed nodes, release the paths that are not shared by the children
+            for (auto closed: batch) {
+                closed->paths.clear();
+                closed->f_mins.clear();
+            }
         }
 
         // success
-        if (solved) solution = pathsToPlan(n->paths);
+        if (solved) solution = pathsToPlan(n_paths);
     }
 
     ECBS::CompareHighLevelNode ECBS::getMainObjective() {
@@ -132,14 +179,22 @@ namespace MAPF {
         std::vector<int> f_mins;  // vector of costs for respective paths
         for (int i = 0; i < P->getNum(); ++i) {
             Path path = getInitialPath(i, paths);
+            // the greedy path does not see the time-dependent obstacles
+            if (isBlockedPath(path)) {
+                Path free_path = getSpaceTimeObstacleFreePath(i, getRemainedTime());
+                if (!free_path.empty()) path = free_path;
+            }
             paths.insert(i, path);
             f_mins.push_back(path.size() - 1);
         }
-        n->paths = paths;
-        n->constraints = {};
+        n->paths.clear();
+        for (int i = 0; i < P->getNum(); ++i) {
+            n->paths.push_back(std::make_shared<const Path>(paths.get(i)));
+        }
+        n->constraints = nullptr;
         n->makespan = paths.getMakespan();
         n->soc = paths.getSOC();
-        n->f = paths.countConflict();
+        n->f = LibCBS::ConflictIndex(paths).countConflict();
         n->valid = true;
         n->f_mins = f_mins;
         n->LB = n->soc;  // initial lower bound
@@ -156,7 +211,8 @@ namespace MAPF {
         const int makespan = paths.getMakespan();
         const int num_agents = P->getNum();
         while (p != g) {
-            p = *std::min_element(p->neighbor.begin(), p->neighbor.end(),
+            Nodes C = G->getNeighbors(p);
+            p = *std::min_element(C.begin(), C.end(),
                                   [&](Node *a, Node *b) {
                                       if (pathDist(id, a) != pathDist(id, b))
                                           return pathDist(id, a) < pathDist(id, b);
@@ -180,8 +236,15 @@ namespace MAPF {
         return path;
     }
 
-    void ECBS::invoke(HighLevelNode_p h_node, int id) {
-        auto res = getFocalPath(h_node, id);
+    Paths ECBS::getPaths(HighLevelNode_p h_node) const {
+        std::vector<Path> paths;
+        paths.reserve(h_node->paths.size());
+        for (const auto &path: h_node->paths) paths.push_back(*path);
+        return Paths(std::move(paths));
+    }
+
+    void ECBS::invoke(HighLevelNode_p h_node, const Paths &paths, const LibCBS::ConflictIndex &conflicts, int id) {
+        auto res = getFocalPath(h_node, conflicts, id);
         Path path = std::get<0>(res);
         int f_min = std::get<1>(res);  // lower bound
 
@@ -191,28 +254,29 @@ namespace MAPF {
             return;
         }
 
-        Paths paths = h_node->paths;
-        paths.insert(id, path);
+        Paths new_paths = paths;
+        new_paths.insert(id, path);
         // it is efficient to reuse past data
-        h_node->f = h_node->f -
-                    h_node->paths.countConflict(id, h_node->paths.get(id)) +
-                    h_node->paths.countConflict(id, paths.get(id));
-        h_node->paths = paths;
-        h_node->makespan = h_node->paths.getMakespan();
-        h_node->soc = h_node->paths.getSOC();
+        h_node->f = h_node->f - conflicts.countConflict(id) + conflicts.countConflict(id, path);
+        // copy on write, the other agents keep sharing the paths of the parent
+        h_node->paths[id] = std::make_shared<const Path>(std::move(path));
+        h_node->makespan = new_paths.getMakespan();
+        h_node->soc = new_paths.getSOC();
         // update lower bound and f_min
         h_node->LB = h_node->LB - h_node->f_mins[id] + f_min;
         h_node->f_mins[id] = f_min;
     }
 
-    std::tuple<Path, int> ECBS::getFocalPath(HighLevelNode_p h_node, int id) {
+    std::tuple<Path, int> ECBS::getFocalPath(HighLevelNode_p h_node, const LibCBS::ConflictIndex &conflicts,
+                                             int id) {
         Node *s = P->getCurrent(id);
         Node *g = P->getGoal(id);
 
         // pre processing
         LibCBS::Constraints constraints;
         int max_constraint_time = 0;
-        for (auto c: h_node->constraints) {
+        for (auto chain = h_node->constraints.get(); chain != nullptr; chain = chain->parent.get()) {
+            const auto &c = chain->constraint;
             if (c->id == id) {
                 constraints.push_back(c);
                 if (c->v == g && c->u == nullptr) {
@@ -231,28 +295,14 @@ namespace MAPF {
             };
         }
 
-        const auto paths = h_node->paths;
-        const int makespan = paths.getMakespan();
-
-        // update PATH_TABLE
-        updatePathTable(paths, id);
+        // conflicts with the other agents, which stay at their last nodes after their paths
         FocalHeuristics f2Value = [&](FocalNode *n) {
             if (n->g == 0) return 0;
-            // last node
-            if (n->g > makespan) {
-                if (PATH_TABLE[makespan][n->v->id] != Solver::NIL) return n->p->f2 + 1;
-            } else {
-                // vertex conflict
-                if (PATH_TABLE[n->g][n->v->id] != Solver::NIL) {
-                    return n->p->f2 + 1;
-
-                    // swap conflict
-                } else if (PATH_TABLE[n->g][n->p->v->id] != Solver::NIL &&
-                           PATH_TABLE[n->g - 1][n->v->id] ==
-                           PATH_TABLE[n->g][n->p->v->id]) {
-                    return n->p->f2 + 1;
-                }
-            }
+            // vertex conflict
+            if (conflicts.getAgent(n->v, n->g, id) != -1) return n->p->f2 + 1;
+            // swap conflict
+            int other = conflicts.getAgent(n->p->v, n->g, id);
+            if (other != -1 && conflicts.get(other, n->g - 1) == n->v) return n->p->f2 + 1;
             return n->p->f2;
         };
 
@@ -273,6 +323,7 @@ namespace MAPF {
         };
 
         CheckInvalidFocalNode checkInvalidFocalNode = [&](FocalNode *m) {
+            if (P->isBlocked(m->v, m->g)) return true;
             for (auto c: constraints) {
                 if (m->g == c->t && m->v == c->v) {
                     // vertex or swap conflict
@@ -282,13 +333,9 @@ namespace MAPF {
             return false;
         };
 
-        auto p = getTimedPathByFocalSearch(s, g, sub_optimality, f1Value, f2Value,
-                                           compareOPEN, compareFOCAL, checkFocalFin,
-                                           checkInvalidFocalNode);
-        // clear used path table
-        clearPathTable(paths);
-
-        return p;
+        return getTimedPathByFocalSearch(s, g, sub_optimality, f1Value, f2Value,
+                                         compareOPEN, compareFOCAL, checkFocalFin,
+                                         checkInvalidFocalNode);
     }
 
 // return path and f_min
@@ -298,21 +345,19 @@ namespace MAPF {
             FocalHeuristics &f1Value, FocalHeuristics &f2Value,
             CompareFocalNode &compareOPEN, CompareFocalNode &compareFOCAL,
             CheckFocalFin &checkFocalFin, CheckInvalidFocalNode &checkInvalidFocalNode) {
-        auto getNodeName = [](FocalNode *n) {
-            return std::to_string(n->v->id) + "-" + std::to_string(n->g);
+        // arena of the focal nodes and the closed list, per thread since the low-level searches run in parallel
+        static thread_local NodePool<FocalNode> GC;
+        static thread_local SpaceTimeClosedList CLOSE;
+        GC.reset();
+        CLOSE.reset(G->getNodesSize());
+        auto isClosed = [](FocalNode *n) { return CLOSE.contains(n->v->id, n->g); };
+        auto createNewNode = [](Node *v, int g, int f1, int f2, FocalNode *p) {
+            return GC.create(v, g, f1, f2, p);
         };
 
-        std::vector<FocalNode *> GC;  // garbage collection
-        auto createNewNode = [&](Node *v, int g, int f1, int f2, FocalNode *p) {
-            FocalNode *new_node = new FocalNode{v, g, f1, f2, p};
-            GC.push_back(new_node);
-            return new_node;
-        };
-
-        // OPEN, FOCAL, CLOSE
+        // OPEN, FOCAL
         std::priority_queue<FocalNode *, std::vector<FocalNode *>, CompareFocalNode>
                 OPEN(compareOPEN);
-        std::unordered_map<std::string, bool> CLOSE;
         using FocalList = std::priority_queue<FocalNode *, std::vector<FocalNode *>,
                 CompareFocalNode>;
         FocalList FOCAL(compareFOCAL);
@@ -336,7 +381,7 @@ namespace MAPF {
              * update FOCAL list
              * see the high-level search
              */
-            while (!OPEN.empty() && CLOSE.find(getNodeName(OPEN.top())) != CLOSE.end())
+            while (!OPEN.empty() && isClosed(OPEN.top()))
                 OPEN.pop();
             if (OPEN.empty()) break;  // failed
             if (f1_min != OPEN.top()->f1) {
@@ -349,7 +394,7 @@ namespace MAPF {
                     FocalNode *top = OPEN.top();
                     OPEN.pop();
                     // already searched by focal
-                    if (CLOSE.find(getNodeName(top)) != CLOSE.end()) continue;
+                    if (isClosed(top)) continue;
                     tmp.push_back(top);                    // escape
                     if ((float) top->f1 > f1_bound) break;  // higher than f1_bound
                     FOCAL.push(top);                       // lower than f1_bound
@@ -360,8 +405,8 @@ namespace MAPF {
             // focal minimum node
             n = FOCAL.top();
             FOCAL.pop();
-            if (CLOSE.find(getNodeName(n)) != CLOSE.end()) continue;
-            CLOSE[getNodeName(n)] = true;
+            if (isClosed(n)) continue;
+            CLOSE.insert(n->v->id, n->g);
 
             // check goal condition
             if (checkFocalFin(n)) {
@@ -369,17 +414,17 @@ namespace MAPF {
                 break;
             }
 
-            // expand
-            Nodes C = n->v->neighbor;
-            C.push_back(n->v);
-            for (auto u: C) {
+            // expand, the neighbors and staying at the location
+            const Graph::NeighborIds ids = G->getNeighborIds(n->v);
+            for (size_t k = 0; k <= ids.size(); ++k) {
+                Node *u = k < ids.size() ? G->getNodeUnchecked(ids.first[k]) : n->v;
                 int g_cost = n->g + 1;
+                // already searched?
+                if (CLOSE.contains(u->id, g_cost)) continue;
                 FocalNode *m = createNewNode(u, g_cost, 0, 0, n);
                 // set heuristics
                 m->f1 = f1Value(m);
                 m->f2 = f2Value(m);
-                // already searched?
-                if (CLOSE.find(getNodeName(m)) != CLOSE.end()) continue;
                 // check constraints
                 if (checkInvalidFocalNode(m)) continue;
                 // update open list
@@ -391,12 +436,7 @@ namespace MAPF {
         Path path;
         // success
         if (!invalid) path = getPathFromFocalNode(n);
-        std::tuple<Path, int> ret = std::make_tuple(path, f1_min);
-
-        // free
-        for (auto p: GC) delete p;
-
-        return ret;
+        return std::make_tuple(path, f1_min);
     }
 
 // reconstruct a path from focal node in the low-level node
@@ -414,17 +454,21 @@ namespace MAPF {
     void ECBS::setParams(int argc, char *argv[]) {
         struct option longopts[] = {
                 {"sub-optimality", required_argument, 0, 'w'},
+                {"batch-size",     required_argument, 0, 'b'},
                 {0, 0,                                0, 0},
         };
         optind = 1;  // reset
         int opt, longindex;
-        while ((opt = getopt_long(argc, argv, "w:", longopts, &longindex)) != -1) {
+        while ((opt = getopt_long(argc, argv, "w:b:", longopts, &longindex)) != -1) {
             switch (opt) {
                 case 'w':
                     sub_optimality = std::atof(optarg);
                     if (sub_optimality < 1) halt("sub-optimality should be >= 1");
                     solver_name = ECBS::SOLVER_NAME + "-" + std::to_string(sub_optimality);
                     break;
+                case 'b':
+                    setBatchSize(std::atoi(optarg));
+                    break;
                 default:
                     break;
             }
@@ -435,6 +479,10 @@ namespace MAPF {
         std::cout << ECBS::SOLVER_NAME << "\n"
                   << "  -w --sub-optimality [NUMBER]"
                   << "  "
-                  << "sub-optimality >= 1" << std::endl;
+                  << "sub-optimality >= 1"
+                  << "\n"
+                  << "  -b --batch-size [NUMBER]"
+                  << "      "
+                  << "focal nodes expanded at once >= 1" << std::endl;
     }
 }
\ No newline at end of file
@@ -1,4 +1,6 @@
-#include "../include/hca.hpp"
+#include "../include/mapf/hca.hpp"
+
+namespace MAPF {
 
 const std::string HCA::SOLVER_NAME = "HCA";
 
@@ -16,7 +18,7 @@ void HCA::run()
 
   // create tables for tie-break
   for (int i = 0; i < P->getNum(); ++i) {
-    table_starts[P->getStart(i)->id] = true;
+    table_starts[P->getCurrent(i)->id] = true;
     table_goals[P->getGoal(i)->id] = true;
   }
 
@@ -63,7 +65,7 @@ void HCA::run()
 // failed -> return {}
 Path HCA::getPrioritizedPath(int id, const Paths& paths)
 {
-  Node* s = P->getStart(id);
+  Node* s = P->getCurrent(id);
   Node* g = P->getGoal(id);
 
   Nodes config_s = P->getConfigStart();
@@ -117,3 +119,4 @@ void HCA::printHelp()
             << "disable initialization of priorities "
             << "using distance from starts to goals" << std::endl;
 }
+}
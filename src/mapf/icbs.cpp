@@ -1,4 +1,6 @@
-#include "../include/icbs.hpp"
+#include "../include/mapf/icbs.hpp"
+
+namespace MAPF {
 
 const std::string ICBS::SOLVER_NAME = "ICBS";
 
@@ -67,13 +69,14 @@ void ICBS::run()
       LibCBS::Constraints new_constraints = n->constraints;
       new_constraints.push_back(c);
       HighLevelNode_p m = std::make_shared<HighLevelNode>(
-          ++h_node_num, n->paths, new_constraints, n->makespan, n->soc, n->f,
-          true);
-      MDDTable[m->id] = MDDTable[n->id];  // copy MDD
+          ++h_node_num, n->paths, n->conflicts, new_constraints, n->makespan,
+          n->soc, n->f, true);
+      MDDTable[m->id] = MDDTable[n->id];  // share MDDs
       invoke(m, c->id);
       if (!m->valid) continue;
       HighLevelTree.push(m);
     }
+    MDDTable.erase(n->id);  // the children keep the shared MDDs
 
     // check lazy table
     if (HighLevelTree.empty() ||
@@ -97,38 +100,44 @@ void ICBS::setInitialHighLevelNode(HighLevelNode_p n)
   LibCBS::MDDs mdds;
   for (int i = 0; i < P->getNum(); ++i) {
     int c = n->paths.costOfPath(i);
-    LibCBS::MDD_p mdd = std::make_shared<LibCBS::MDD>(c, i, this);
-    mdds.push_back(mdd);
+    mdds.push_back(getMDD(c, i, {}));
   }
   MDDTable[n->id] = mdds;
 }
 
 LibCBS::Constraints ICBS::getPrioritizedConflict(HighLevelNode_p h_node)
 {
-  return LibCBS::getPrioritizedConflict(h_node->paths, MDDTable[h_node->id]);
+  return LibCBS::getPrioritizedConflict(h_node->paths, h_node->conflicts,
+                                        MDDTable[h_node->id]);
 }
 
 // find path with MDD, not using A* based search
 // failed -> return {}
 Path ICBS::getConstrainedPath(HighLevelNode_p h_node, int id)
 {
-  LibCBS::MDD mdd = *(MDDTable[h_node->id][id]);
+  const LibCBS::MDD& parent_mdd = *(MDDTable[h_node->id][id]);
   LibCBS::Constraint_p last_constraint = *(h_node->constraints.end() - 1);
-  mdd.update({last_constraint});  // check only last
+  LibCBS::MDD_p mdd =
+      MDD_CACHE.find(id, parent_mdd.c, h_node->constraints);
+  if (mdd == nullptr) {
+    mdd = std::make_shared<LibCBS::MDD>(parent_mdd);
+    mdd->update({last_constraint});  // check only last
+    MDD_CACHE.insert(h_node->constraints, mdd);
+  }
 
-  if (mdd.valid) {  // use mdd as much as possible
+  if (mdd->valid) {  // use mdd as much as possible
     // update table
-    MDDTable[h_node->id][id] = std::make_shared<LibCBS::MDD>(mdd);
-    return mdd.getPath(MT);
+    MDDTable[h_node->id][id] = mdd;
+    return mdd->getPath(MT);
   } else {
     // lazy evaluation
-    if (last_constraint->t > mdd.c) {
-      int LB_SOC = h_node->soc - mdd.c + last_constraint->t + 1;
+    if (last_constraint->t > mdd->c) {
+      int LB_SOC = h_node->soc - mdd->c + last_constraint->t + 1;
       registerLazyEval(LB_SOC, h_node);
       return {};
     }
 
-    int c = mdd.c;
+    int c = mdd->c;
 
     constexpr int THRESHOLD = 20;
     while (true) {
@@ -147,9 +156,9 @@ Path ICBS::getConstrainedPath(HighLevelNode_p h_node, int id)
        * Note, this is not complete,
        * but I never have met with a bad example.
        */
-      if (c > mdd.c + THRESHOLD) break;
+      if (c > mdd->c + THRESHOLD) break;
 
-      LibCBS::MDD_p new_mdd = std::make_shared<LibCBS::MDD>(c, id, this, h_node->constraints);
+      LibCBS::MDD_p new_mdd = getMDD(c, id, h_node->constraints);
       if (new_mdd->valid) {
         MDDTable[h_node->id][id] = new_mdd;
         return new_mdd->getPath(MT);
@@ -160,6 +169,17 @@ Path ICBS::getConstrainedPath(HighLevelNode_p h_node, int id)
   return {};
 }
 
+LibCBS::MDD_p ICBS::getMDD(int c, int i,
+                           const LibCBS::Constraints& constraints)
+{
+  LibCBS::MDD_p mdd = MDD_CACHE.find(i, c, constraints);
+  if (mdd == nullptr) {
+    mdd = std::make_shared<LibCBS::MDD>(c, i, this, constraints);
+    MDD_CACHE.insert(constraints, mdd);
+  }
+  return mdd;
+}
+
 void ICBS::registerLazyEval(const int LB_SOC, HighLevelNode_p h_node)
 {
   auto itr = LAZY_EVAL_TABLE.find(LB_SOC);
@@ -192,16 +212,14 @@ CBS::HighLevelNodes ICBS::lazyEval()
     while (true) {
       ++c;
       if (overCompTime()) break;
-      LibCBS::MDD_p new_mdd = std::make_shared<LibCBS::MDD>(c, id, this, h_node->constraints);
+      LibCBS::MDD_p new_mdd = getMDD(c, id, h_node->constraints);
       if (new_mdd->valid) {
         MDDTable[h_node->id][id] = new_mdd;
         Path path = new_mdd->getPath(MT);
-        Paths paths = h_node->paths;
-        paths.insert(id, path);
-        h_node->f = h_node->f -
-                    h_node->paths.countConflict(id, h_node->paths.get(id)) +
-                    h_node->paths.countConflict(id, paths.get(id));
-        h_node->paths = paths;
+        h_node->f -= h_node->conflicts.countConflict(id);
+        h_node->paths.insert(id, path);
+        h_node->conflicts.update(id, path);
+        h_node->f += h_node->conflicts.countConflict(id);
         h_node->makespan = h_node->paths.getMakespan();
         h_node->soc = h_node->paths.getSOC();
         break;
@@ -240,12 +258,13 @@ bool ICBS::findBypass(HighLevelNode_p h_node,
       ++path_size;
     }
     // number of conflicts
-    int cnum_old = h_node->paths.countConflict(c->id, h_node->paths.get(c->id));
-    int cnum_new = h_node->paths.countConflict(c->id, path);
+    int cnum_old = h_node->conflicts.countConflict(c->id);
+    int cnum_new = h_node->conflicts.countConflict(c->id, path);
     if (cnum_old <= cnum_new) continue;
 
     // helpful bypass found
     h_node->paths.insert(c->id, path);
+    h_node->conflicts.update(c->id, path);
     h_node->f = h_node->f - cnum_old + cnum_new;
     return true;
   }
@@ -256,3 +275,4 @@ void ICBS::printHelp()
 {
   printHelpWithoutOption(SOLVER_NAME);
 }
+}
@@ -1,4 +1,6 @@
-#include "../include/icbs_refine.hpp"
+#include "../include/mapf/icbs_refine.hpp"
+
+namespace MAPF {
 
 ICBS_REFINE::ICBS_REFINE(Problem* _P, const Plan& _old_plan,
                          const std::vector<int>& _modif_list)
@@ -61,7 +63,8 @@ void ICBS_REFINE::setInitialHighLevelNode(HighLevelNode_p n)
   n->constraints = constraints;
   n->makespan = paths.getMakespan();
   n->soc = paths.getSOC();
-  n->f = paths.countConflict(modif_list);
+  n->conflicts = LibCBS::ConflictIndex(paths);
+  n->f = n->conflicts.countConflict(modif_list);
   n->valid = true;  // valid
   MDDTable[n->id] = mdds;
 }
@@ -69,10 +72,11 @@ void ICBS_REFINE::setInitialHighLevelNode(HighLevelNode_p n)
 LibCBS::Constraints ICBS_REFINE::getPrioritizedConflict(HighLevelNode_p h_node)
 {
   if (modif_list.empty()) {
-    return LibCBS::getPrioritizedConflict(h_node->paths, MDDTable[h_node->id]);
+    return LibCBS::getPrioritizedConflict(h_node->paths, h_node->conflicts,
+                                          MDDTable[h_node->id]);
   }
-  return LibCBS::getPrioritizedConflict(h_node->paths, MDDTable[h_node->id],
-                                        modif_list);
+  return LibCBS::getPrioritizedConflict(h_node->paths, h_node->conflicts,
+                                        MDDTable[h_node->id], modif_list);
 }
 
 // using MDD
@@ -85,3 +89,4 @@ Path ICBS_REFINE::getConstrainedPath(HighLevelNode_p h_node, int id)
   }
   return path;
 }
+}
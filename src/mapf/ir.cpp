@@ -1,17 +1,19 @@
-#include "../include/ir.hpp"
+#include "../include/mapf/ir.hpp"
 
 #include <fstream>
 #include <set>
-#include "../include/cbs_refine.hpp"
-#include "../include/ecbs.hpp"
-#include "../include/hca.hpp"
-#include "../include/winpibt.hpp"
-#include "../include/icbs_refine.hpp"
-#include "../include/pibt.hpp"
-#include "../include/pibt_complete.hpp"
-#include "../include/push_and_swap.hpp"
-#include "../include/revisit_pp.hpp"
-#include "../include/whca.hpp"
+#include "../include/mapf/cbs_refine.hpp"
+#include "../include/mapf/ecbs.hpp"
+#include "../include/mapf/hca.hpp"
+#include "../include/mapf/winpibt.hpp"
+#include "../include/mapf/icbs_refine.hpp"
+#include "../include/mapf/pibt.hpp"
+#include "../include/mapf/pibt_complete.hpp"
+#include "../include/mapf/push_and_swap.hpp"
+#include "../include/mapf/revisit_pp.hpp"
+#include "../include/mapf/whca.hpp"
+
+namespace MAPF {
 
 
 // solver name
@@ -141,7 +143,8 @@ Plan IR::getInitialPlan()
   // set solver options
   setSolverOption(solver, option_init_solver);
   solver->setVerbose(verbose_underlying_solver);
-  solver->setDistanceTable(&distance_table);
+  solver->setDistanceTable((distance_table_p == nullptr) ? &distance_table
+                                                        : distance_table_p);
 
   // solve
   solver->solve();
@@ -179,7 +182,8 @@ std::tuple<bool, Plan> IR::getOptimalPlan(Problem* _P, const Plan& current_plan,
   // set solver option
   setSolverOption(solver, option_optimal_solver);
   solver->setVerbose(verbose_underlying_solver);
-  solver->setDistanceTable(&distance_table);
+  solver->setDistanceTable((distance_table_p == nullptr) ? &distance_table
+                                                        : distance_table_p);
 
   // solve
   solver->solve();
@@ -628,3 +632,4 @@ void IR_HYBRID::refinePlan()
   info("", "update by RANDOM");
   updateByRandom();
 }
+}
@@ -1,7 +1,7 @@
 #include "../include/mapf/lib_cbs.hpp"
 
 // cache
-std::unordered_map<std::string, LibCBS::MDD_p> LibCBS::MDD::PURE_MDD_TABLE;
+thread_local std::unordered_map<std::string, LibCBS::MDD_p> LibCBS::MDD::PURE_MDD_TABLE;
 
 void LibCBS::Constraint::println()
 {
@@ -14,38 +14,201 @@ void LibCBS::Constraint::println()
   }
 }
 
+LibCBS::ConflictIndex::ConflictIndex(const Paths& _paths)
+    : paths(_paths.size()), n_conflicts(_paths.size(), 0)
+{
+  const int num_agents = _paths.size();
+  for (int i = 0; i < num_agents; ++i) {
+    if (_paths.empty(i)) continue;
+    paths[i] = _paths.get(i);
+    while (paths[i].size() > 1 && paths[i].back() == *(paths[i].end() - 2)) {
+      paths[i].pop_back();
+    }
+    insertVisits(i);
+  }
+  // each conflict is found from both agents, the map keeps one
+  for (int i = 0; i < num_agents; ++i) {
+    forEachConflict(i, paths[i], [&](int t, int j, bool is_swap) {
+      insertConflict(t, i, j, is_swap);
+    });
+  }
+}
+
+void LibCBS::ConflictIndex::update(int id, const Path& path)
+{
+  eraseConflicts(id);
+  eraseVisits(id);
+  paths[id] = path;
+  while (paths[id].size() > 1 && paths[id].back() == *(paths[id].end() - 2)) {
+    paths[id].pop_back();
+  }
+  insertVisits(id);
+  forEachConflict(id, paths[id], [&](int t, int j, bool is_swap) {
+    insertConflict(t, id, j, is_swap);
+  });
+}
+
+int LibCBS::ConflictIndex::countConflict(const std::vector<int>& sample) const
+{
+  std::vector<bool> is_sampled(paths.size(), false);
+  for (int i : sample) is_sampled[i] = true;
+  int cnt = 0;
+  for (const auto& conflict : conflicts) {
+    if (is_sampled[std::get<1>(conflict.first)] &&
+        is_sampled[std::get<2>(conflict.first)]) {
+      ++cnt;
+    }
+  }
+  return cnt;
+}
+
+int LibCBS::ConflictIndex::countConflict(int id, const Path& path) const
+{
+  Path trimmed_path = path;
+  while (trimmed_path.size() > 1 &&
+         trimmed_path.back() == *(trimmed_path.end() - 2)) {
+    trimmed_path.pop_back();
+  }
+  int cnt = 0;
+  forEachConflict(id, trimmed_path, [&](int, int, bool) { ++cnt; });
+  return cnt;
+}
+
+int LibCBS::ConflictIndex::getAgent(const MAPF::Node* v, int t, int id) const
+{
+  auto itr = visits.find(v->id);
+  if (itr == visits.end()) return -1;
+  for (const auto& visit : itr->second) {
+    if (visit.agent != id && (visit.stay ? visit.t <= t : visit.t == t)) {
+      return visit.agent;
+    }
+  }
+  return -1;
+}
+
+MAPF::Node* LibCBS::ConflictIndex::get(int i, int t) const
+{
+  const Path& path = paths[i];
+  return path[std::min(t, (int)path.size() - 1)];
+}
+
 // not found -> return {}
-LibCBS::Constraints LibCBS::getFirstConstraints(const Paths& paths)
+LibCBS::Constraints LibCBS::ConflictIndex::getFirstConstraints() const
 {
-  Constraints constraints = {};
-  int num_agents = paths.size();
-  int makespan = paths.getMakespan();
-  for (int t = 1; t <= makespan; ++t) {
-    for (int i = 0; i < num_agents; ++i) {
-      for (int j = i + 1; j < num_agents; ++j) {
-        // vertex conflict
-        if (paths.get(i, t) == paths.get(j, t)) {
-          Constraint_p c_i =
-              std::make_shared<Constraint>(i, t, paths.get(i, t), nullptr);
-          Constraint_p c_j =
-              std::make_shared<Constraint>(j, t, paths.get(j, t), nullptr);
-          Constraints constraints = {c_i, c_j};
-          return constraints;
-        }
-        // swap conflict
-        if (paths.get(i, t) == paths.get(j, t - 1) &&
-            paths.get(j, t) == paths.get(i, t - 1)) {
-          Constraint_p c_i = std::make_shared<Constraint>(i, t, paths.get(i, t),
-                                                          paths.get(i, t - 1));
-          Constraint_p c_j = std::make_shared<Constraint>(j, t, paths.get(j, t),
-                                                          paths.get(j, t - 1));
-          Constraints constraints = {c_i, c_j};
-          return constraints;
-        }
+  if (conflicts.empty()) return {};
+  const auto& conflict = *conflicts.begin();
+  const int t = std::get<0>(conflict.first);
+  const int i = std::get<1>(conflict.first);
+  const int j = std::get<2>(conflict.first);
+  // swap conflict
+  if (conflict.second) {
+    Constraint_p c_i =
+        std::make_shared<Constraint>(i, t, get(i, t), get(i, t - 1));
+    Constraint_p c_j =
+        std::make_shared<Constraint>(j, t, get(j, t), get(j, t - 1));
+    return {c_i, c_j};
+  }
+  // vertex conflict
+  Constraint_p c_i = std::make_shared<Constraint>(i, t, get(i, t), nullptr);
+  Constraint_p c_j = std::make_shared<Constraint>(j, t, get(j, t), nullptr);
+  return {c_i, c_j};
+}
+
+void LibCBS::ConflictIndex::insertVisits(int id)
+{
+  const Path& path = paths[id];
+  const int last = path.size() - 1;
+  for (int t = 0; t < last; ++t) {
+    visits[path[t]->id].push_back({id, t, false});
+  }
+  visits[path[last]->id].push_back({id, last, true});
+}
+
+void LibCBS::ConflictIndex::eraseVisits(int id)
+{
+  for (auto v : paths[id]) {
+    auto itr = visits.find(v->id);
+    if (itr == visits.end()) continue;  // already erased, the node is visited again
+    auto& node_visits = itr->second;
+    node_visits.erase(std::remove_if(node_visits.begin(), node_visits.end(),
+                                     [id](const Visit& visit) {
+                                       return visit.agent == id;
+                                     }),
+                      node_visits.end());
+    if (node_visits.empty()) visits.erase(itr);
+  }
+}
+
+void LibCBS::ConflictIndex::insertConflict(int t, int i, int j, bool is_swap)
+{
+  auto key = std::make_tuple(t, std::min(i, j), std::max(i, j));
+  auto res = conflicts.emplace(key, is_swap);
+  if (res.second) {
+    ++n_conflicts[i];
+    ++n_conflicts[j];
+  } else if (!is_swap) {
+    res.first->second = false;  // the vertex conflict is reported first
+  }
+}
+
+void LibCBS::ConflictIndex::eraseConflicts(int id)
+{
+  if (n_conflicts[id] == 0) return;
+  for (auto itr = conflicts.begin(); itr != conflicts.end();) {
+    const int i = std::get<1>(itr->first);
+    const int j = std::get<2>(itr->first);
+    if (i == id || j == id) {
+      --n_conflicts[i];
+      --n_conflicts[j];
+      itr = conflicts.erase(itr);
+    } else {
+      ++itr;
+    }
+  }
+}
+
+template <typename F>
+void LibCBS::ConflictIndex::forEachConflict(int id, const Path& path,
+                                            F fn) const
+{
+  if (path.empty()) return;
+  const int last = path.size() - 1;
+  auto findVisits = [&](const MAPF::Node* v) -> const std::vector<Visit>* {
+    auto itr = visits.find(v->id);
+    return itr == visits.end() ? nullptr : &itr->second;
+  };
+
+  for (int t = 1; t <= last; ++t) {
+    // vertex conflict
+    if (auto node_visits = findVisits(path[t])) {
+      for (const auto& visit : *node_visits) {
+        if (visit.agent == id) continue;
+        if (visit.stay ? visit.t <= t : visit.t == t) fn(t, visit.agent, false);
+      }
+    }
+    // swap conflict, the other agent moves from path[t] to path[t - 1]
+    if (path[t - 1] == path[t]) continue;
+    if (auto node_visits = findVisits(path[t - 1])) {
+      for (const auto& visit : *node_visits) {
+        if (visit.agent == id || visit.t != t) continue;
+        if (get(visit.agent, t - 1) == path[t]) fn(t, visit.agent, true);
       }
     }
   }
-  return {};
+
+  // the agent stays at the last node, the others arriving later
+  if (auto node_visits = findVisits(path[last])) {
+    for (const auto& visit : *node_visits) {
+      if (visit.agent == id || visit.t <= last) continue;
+      fn(visit.t, visit.agent, false);
+    }
+  }
+}
+
+// not found -> return {}
+LibCBS::Constraints LibCBS::getFirstConstraints(const Paths& paths)
+{
+  return ConflictIndex(paths).getFirstConstraints();
 }
 
 // used for ICBS
@@ -115,20 +278,24 @@ void LibCBS::getPrioritizedConflict(const int t, const int i, const int j,
 // detect prioritized constraints
 LibCBS::Constraints LibCBS::getPrioritizedConflict(const Paths& paths,
                                                    const MDDs& mdds)
+{
+  return getPrioritizedConflict(paths, ConflictIndex(paths), mdds);
+}
+
+LibCBS::Constraints LibCBS::getPrioritizedConflict(
+    const Paths& paths, const ConflictIndex& conflicts, const MDDs& mdds)
 {
   Constraints cardinal_constraints = {};
   Constraints semi_cardinal_constraints = {};
   Constraints non_cardinal_constraints = {};
-  int num_agents = paths.size();
-  for (int t = 1; t <= paths.getMakespan(); ++t) {
-    for (int i = 0; i < num_agents; ++i) {
-      for (int j = i + 1; j < num_agents; ++j) {
-        getPrioritizedConflict(t, i, j, paths, mdds, cardinal_constraints,
-                               semi_cardinal_constraints,
-                               non_cardinal_constraints);
-        if (!cardinal_constraints.empty()) return cardinal_constraints;
-      }
-    }
+  // in the order of the scan of all pairs, the pairs without a conflict add nothing
+  for (const auto& conflict : conflicts.getConflicts()) {
+    getPrioritizedConflict(std::get<0>(conflict.first),
+                           std::get<1>(conflict.first),
+                           std::get<2>(conflict.first), paths, mdds,
+                           cardinal_constraints, semi_cardinal_constraints,
+                           non_cardinal_constraints);
+    if (!cardinal_constraints.empty()) return cardinal_constraints;
   }
   if (!semi_cardinal_constraints.empty()) {
     return semi_cardinal_constraints;
@@ -142,19 +309,40 @@ LibCBS::Constraints LibCBS::getPrioritizedConflict(const Paths& paths,
 // detect prioritized conflicts only for a part of agents
 LibCBS::Constraints LibCBS::getPrioritizedConflict(
     const Paths& paths, const MDDs& mdds, const std::vector<int>& sample)
+{
+  return getPrioritizedConflict(paths, ConflictIndex(paths), mdds, sample);
+}
+
+LibCBS::Constraints LibCBS::getPrioritizedConflict(
+    const Paths& paths, const ConflictIndex& conflicts, const MDDs& mdds,
+    const std::vector<int>& sample)
 {
   Constraints cardinal_constraints = {};
   Constraints semi_cardinal_constraints = {};
   Constraints non_cardinal_constraints = {};
+  std::vector<int> sample_index(paths.size(), -1);
   const int sample_size = sample.size();
-  for (int t = 1; t <= paths.getMakespan(); ++t) {
-    for (int i = 0; i < sample_size; ++i) {
-      for (int j = i + 1; j < sample_size; ++j) {
-        getPrioritizedConflict(t, sample[i], sample[j], paths, mdds,
-                               cardinal_constraints, semi_cardinal_constraints,
-                               non_cardinal_constraints);
-        if (!cardinal_constraints.empty()) return cardinal_constraints;
-      }
+  for (int k = 0; k < sample_size; ++k) sample_index[sample[k]] = k;
+
+  // the pairs of a timestep in the order of the sample
+  const auto& all_conflicts = conflicts.getConflicts();
+  std::vector<std::pair<int, int>> pairs;
+  for (auto itr = all_conflicts.begin(); itr != all_conflicts.end();) {
+    const int t = std::get<0>(itr->first);
+    pairs.clear();
+    for (; itr != all_conflicts.end() && std::get<0>(itr->first) == t; ++itr) {
+      int k_i = sample_index[std::get<1>(itr->first)];
+      int k_j = sample_index[std::get<2>(itr->first)];
+      if (k_i < 0 || k_j < 0) continue;
+      pairs.emplace_back(std::min(k_i, k_j), std::max(k_i, k_j));
+    }
+    std::sort(pairs.begin(), pairs.end());
+    for (const auto& pair : pairs) {
+      getPrioritizedConflict(t, sample[pair.first], sample[pair.second], paths,
+                             mdds, cardinal_constraints,
+                             semi_cardinal_constraints,
+                             non_cardinal_constraints);
+      if (!cardinal_constraints.empty()) return cardinal_constraints;
     }
   }
   if (!semi_cardinal_constraints.empty()) {
@@ -303,7 +491,7 @@ void LibCBS::MDD::build(int time_limit)
         return;
       }
 
-      Nodes cands = node->v->neighbor;
+      Nodes cands = solver->getG()->getNeighbors(node->v);
       cands.push_back(node->v);
       for (auto v : cands) {
         // valid
@@ -588,3 +776,57 @@ void LibCBS::MDD::halt(const std::string& msg) const
   this->~MDD();
   std::exit(1);
 }
+
+LibCBS::MDDCache::MDDCache(size_t _max_nodes)
+    : n_nodes(0), max_nodes(_max_nodes)
+{
+}
+
+LibCBS::MDD_p LibCBS::MDDCache::find(int i, int c,
+                                     const Constraints& constraints)
+{
+  auto itr = table.find(getKey(i, c, constraints));
+  if (itr == table.end()) return nullptr;
+  LRU.splice(LRU.begin(), LRU, itr->second.lru);
+  return itr->second.mdd;
+}
+
+void LibCBS::MDDCache::insert(const Constraints& constraints, const MDD_p& mdd)
+{
+  Key key = getKey(mdd->i, mdd->c, constraints);
+  if (table.find(key) != table.end()) return;
+  LRU.push_front(key);
+  table.emplace(std::move(key), Entry{mdd, LRU.begin()});
+  n_nodes += mdd->GC.size();
+
+  // keep the new one even if it exceeds the limit alone
+  while (n_nodes > max_nodes && table.size() > 1) {
+    auto itr = table.find(LRU.back());
+    n_nodes -= itr->second.mdd->GC.size();
+    table.erase(itr);
+    LRU.pop_back();
+  }
+}
+
+void LibCBS::MDDCache::clear()
+{
+  table.clear();
+  LRU.clear();
+  n_nodes = 0;
+}
+
+LibCBS::MDDCache::Key LibCBS::MDDCache::getKey(int i, int c,
+                                               const Constraints& constraints)
+{
+  std::vector<std::array<int, 4>> fingerprint;
+  for (auto constraint : constraints) {
+    if (constraint->id != i && constraint->id != -1) continue;
+    fingerprint.push_back({constraint->t, constraint->v->id,
+                           constraint->u == nullptr ? -1 : constraint->u->id,
+                           (int)constraint->stay});
+  }
+  std::sort(fingerprint.begin(), fingerprint.end());
+  fingerprint.erase(std::unique(fingerprint.begin(), fingerprint.end()),
+                    fingerprint.end());
+  return Key(i, c, std::move(fingerprint));
+}
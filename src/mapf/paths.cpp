@@ -8,6 +8,13 @@ Paths::Paths(int num_agents)
   makespan = 0;
 }
 
+Paths::Paths(std::vector<Path> _paths) : paths(std::move(_paths))
+{
+  format();
+  shrink();
+  makespan = getMaxLengthPaths();
+}
+
 Path Paths::get(int i) const
 {
   const int paths_size = paths.size();
@@ -25,26 +25,29 @@ namespace MAPF {
         std::vector<Agent *> decided;
 
         // initialize
+        agents.clear();
+        agents.reserve(P->getNum());  // keeps the addresses of the agents
         for (int i = 0; i < P->getNum(); ++i) {
             Node *start = P->getStart(i);
             Node *s = P->getCurrent(i);
             Node *g = P->getGoal(i);
             int d = disable_dist_init ? 0 : pathDist(i);
-            Agent *a = new Agent{i,                          // id
-                                 s,                          // current location
-                                 nullptr,                    // next location
-                                 g,                          // goal
-                                 0,                          // elapsed
-                                 d,                          // dist from s -> g
-                                 (float)i / (float)P->getNum()};  // tie-breaker
-//                                 getRandomFloat(0, 1, MT)};  // tie-breaker
+            agents.push_back(Agent{i,                          // id
+                                   s,                          // current location
+                                   nullptr,                    // next location
+                                   g,                          // goal
+                                   0,                          // elapsed
+                                   d,                          // dist from s -> g
+                                   (float)i / (float)P->getNum()});  // tie-breaker
+//                                 getRandomFloat(0, 1, MT)});  // tie-breaker
+            Agent *a = &agents.back();
             undecided.push(a);
             occupied_now[s->id] = a;
         }
         solution.add(P->getConfigStart());
 
         // main loop
-        int timestep = 0;
+        timestep = 0;
         while (true) {
             info(" ", "elapsed:", getSolverElapsedTime(), ", timestep:", timestep);
 
@@ -100,12 +103,11 @@ namespace MAPF {
             if (timestep >= max_timestep || overCompTime()) {
                 break;
             }
-        }
 
-        // memory clear
-        while (!undecided.empty()) {
-            delete undecided.top();
-            undecided.pop();
+            // window
+            if (window > 0 && timestep >= window) {
+                break;
+            }
         }
     }
 
@@ -149,8 +151,10 @@ namespace MAPF {
 
 // no candidate node -> return nullptr
     Node *PIBT::chooseNode(Agent *a) {
-        // candidates
-        Nodes C = a->v_now->neighbor;
+        // candidates, the buffer is reused since chooseNode returns before the priority inheritance
+        Nodes &C = candidates;
+        C.clear();
+        for (int32_t id: G->getNeighborIds(a->v_now)) C.push_back(G->getNodeUnchecked(id));
         C.push_back(a->v_now);
 
         // randomize
@@ -164,6 +168,8 @@ namespace MAPF {
         for (auto u: C) {
             // avoid vertex conflict
             if (occupied_next[u->id] != nullptr) continue;
+            // avoid time-dependent obstacles
+            if (P->isBlocked(u, timestep + 1)) continue;
             // avoid swap conflict
             auto a_j = occupied_now[u->id];
             if (a_j != nullptr && a_j->v_next == a->v_now) continue;
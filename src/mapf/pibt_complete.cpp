@@ -1,12 +1,14 @@
-#include "../include/pibt_complete.hpp"
+#include "../include/mapf/pibt_complete.hpp"
 
 #include <fstream>
 #include <memory>
 
-#include "../include/ecbs.hpp"
-#include "../include/icbs.hpp"
-#include "../include/pibt.hpp"
-#include "../include/push_and_swap.hpp"
+#include "../include/mapf/ecbs.hpp"
+#include "../include/mapf/icbs.hpp"
+#include "../include/mapf/pibt.hpp"
+#include "../include/mapf/push_and_swap.hpp"
+
+namespace MAPF {
 
 const std::string PIBT_COMPLETE::SOLVER_NAME = "PIBT_COMPLETE";
 
@@ -145,3 +147,4 @@ void PIBT_COMPLETE::makeLog(const std::string& logfile)
   makeLogSolution(log);
   log.close();
 }
+}
@@ -93,10 +93,10 @@ namespace MAPF {
     }
 
     bool Plan::validate(Problem *P) const {
-        return validate(P->getConfigStart(), P->getConfigGoal());
+        return validate(P->getConfigStart(), P->getConfigGoal(), P->getG());
     }
 
-    bool Plan::validate(const Config &starts, const Config &goals) const {
+    bool Plan::validate(const Config &starts, const Config &goals, Graph *G) const {
         if (configs.empty()) return false;
 
         // start and goal
@@ -119,7 +119,7 @@ namespace MAPF {
             for (int i = 0; i < num_agents; ++i) {
                 Node *v_i_t = get(t, i);
                 Node *v_i_t_1 = get(t - 1, i);
-                Nodes cands = v_i_t_1->neighbor;
+                Nodes cands = G->getNeighbors(v_i_t_1);
                 cands.push_back(v_i_t_1);
                 if (!inArray(v_i_t, cands)) {
                     warn("validation, invalid move");
@@ -0,0 +1,93 @@
+#include "../include/mapf/portfolio.hpp"
+
+#include <thread>
+
+namespace MAPF {
+    const std::string Portfolio::SOLVER_NAME = "Portfolio";
+
+    Portfolio::Portfolio(Problem *_P, std::vector<SolverFactory> _factories, bool _anytime)
+            : Solver(_P), factories(std::move(_factories)), anytime(_anytime), cancel(false) {
+        solver_name = Portfolio::SOLVER_NAME;
+    }
+
+    void Portfolio::run() {
+        // distance table shared by the members, read-only while they run
+        DistanceTable *table = distance_table_p != nullptr ? distance_table_p : &distance_table;
+        if (!goal_tables.empty()) {
+            // the tables of the cache are expanded lazily, so they are not thread-safe
+            distance_table.assign(P->getNum(), std::vector<int>(G->getNodesSize(), max_timestep));
+            for (int i = 0; i < P->getNum(); ++i) {
+                for (auto v: G->getV()) distance_table[i][v->id] = pathDist(i, v);
+            }
+            table = &distance_table;
+        }
+
+        // set members
+        std::vector<Member> members(factories.size());
+        for (size_t k = 0; k < members.size(); ++k) {
+            auto &member = members[k];
+            member.problem = std::make_unique<Problem>(P, getRemainedTime());
+            member.problem->setDistanceTableCache(nullptr);
+            member.problem->setCancelFlag(&cancel);
+            member.mt.seed((*MT)());
+            member.problem->setMT(&member.mt);
+            member.solver = factories[k](member.problem.get());
+            member.solver->setDistanceTable(table);
+            member.solver->setParallelFor(parallel_for);
+        }
+
+        // solve concurrently
+        std::vector<int> finish_order;  // member index
+        std::vector<std::thread> threads;
+        for (size_t k = 0; k < members.size(); ++k) {
+            threads.emplace_back([this, &members, &finish_order, k] {
+                auto &member = members[k];
+                member.solver->solve();
+                const bool valid = member.solver->succeed() and
+                                   member.solver->getSolution().validate(member.problem.get());
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    member.finished = true;
+                    member.valid = valid;
+                    finish_order.emplace_back(k);
+                    if (valid and not anytime) cancel = true;
+                }
+                cv.notify_all();
+            });
+        }
+
+        // wait until the first valid plan, all members finish, or the deadline
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            while (finish_order.size() < members.size()) {
+                if (cancel or overCompTime()) break;
+                cv.wait_for(lock, std::chrono::milliseconds(1));
+            }
+            cancel = true;
+        }
+        for (auto &thread: threads) thread.join();
+
+        // pick up the first valid plan, or the plan with the minimum SOC in the anytime mode
+        int best = -1;
+        for (int k: finish_order) {
+            if (not members[k].valid) continue;
+            if (best < 0 or (anytime and members[k].solver->getSolution().getSOC() <
+                                         members[best].solver->getSolution().getSOC())) {
+                best = k;
+            }
+        }
+        for (int k: finish_order) {
+            info(" ", members[k].solver->getSolverName(), ", valid:", members[k].valid,
+                 ", comp_time:", members[k].solver->getCompTime());
+        }
+        if (best < 0) return;
+
+        solution = members[best].solver->getSolution();
+        solved = true;
+        winner_name = members[best].solver->getSolverName();
+    }
+
+    void Portfolio::printHelp() {
+        printHelpWithoutOption(SOLVER_NAME);
+    }
+}
@@ -7,7 +7,7 @@
 
 using namespace MAPF;
 Problem::Problem(const std::string& _instance)
-    : instance(_instance), instance_initialized(true)
+    : instance(_instance), instance_initialized(true), owns_graph(true)
 {
   // read instance file
   std::ifstream file(instance);
@@ -124,64 +124,92 @@ Problem::Problem(Problem* P, Config _config_s, Config _config_g,
                  int _max_comp_time, int _max_timestep)
     : G(P->getG()),
       MT(P->getMT()),
+      config_start(_config_s),
       config_s(_config_s),
       config_g(_config_g),
       num_agents(P->getNum()),
       max_timestep(_max_timestep),
       max_comp_time(_max_comp_time),
-      instance_initialized(false)
+      instance_initialized(false),
+      owns_graph(false),
+      distance_table_cache(P->getDistanceTableCache()),
+      cancel_flag(P->cancel_flag),
+      space_time_obstacles(P->space_time_obstacles)
 {
 }
 
 Problem::Problem(Problem* P, int _max_comp_time)
     : G(P->getG()),
       MT(P->getMT()),
+      config_start(P->config_start),
       config_s(P->getConfigStart()),
       config_g(P->getConfigGoal()),
       num_agents(P->getNum()),
       max_timestep(P->getMaxTimestep()),
       max_comp_time(_max_comp_time),
-      instance_initialized(false)
+      instance_initialized(false),
+      owns_graph(false),
+      distance_table_cache(P->getDistanceTableCache()),
+      cancel_flag(P->cancel_flag),
+      space_time_obstacles(P->space_time_obstacles)
 {
 }
 
-Problem::Problem(const std::vector<std::vector<std::vector<int>>>& grid,
+Problem::Problem(const GridView& grid,
+                 int connectivity,
                  int _num_agents,
                  const std::vector<std::array<int, 3>>& start_points,
                  const std::vector<std::array<int, 3>>& current_points,
                  const std::vector<std::array<int, 3>>& goal_points)
-                 : num_agents(_num_agents), instance_initialized(true)
+                 : num_agents(_num_agents), instance_initialized(true), owns_graph(true)
 {
     // read map
-    G = new Grid(grid);
+    G = new Grid(grid, connectivity);
+    MT = new std::mt19937(DEFAULT_SEED);
+    setConfigs(start_points, current_points, goal_points);
+}
+
+Problem::Problem(Graph* _G,
+                 std::mt19937* _MT,
+                 int _num_agents,
+                 const std::vector<std::array<int, 3>>& start_points,
+                 const std::vector<std::array<int, 3>>& current_points,
+                 const std::vector<std::array<int, 3>>& goal_points)
+                 : G(_G), MT(_MT), num_agents(_num_agents), instance_initialized(true), owns_graph(false)
+{
+    setConfigs(start_points, current_points, goal_points);
+}
 
+void Problem::setConfigs(const std::vector<std::array<int, 3>>& start_points,
+                         const std::vector<std::array<int, 3>>& current_points,
+                         const std::vector<std::array<int, 3>>& goal_points)
+{
     // read initial/goal nodes
+    config_start.reserve(num_agents);
+    config_s.reserve(num_agents);
+    config_g.reserve(num_agents);
     for (size_t i = 0; i < num_agents; i++) {
-        int x_start = start_points[i][0];
-        int y_start = start_points[i][1];
-        int x_s = current_points[i][0];
-        int y_s = current_points[i][1];
-        int x_g = goal_points[i][0];
-        int y_g = goal_points[i][1];
-        if (!G->existNode(x_s, y_s)) {
-            halt("start node (" + std::to_string(x_s) + ", " + std::to_string(y_s) +
-                 ") does not exist, invalid scenario");
+        const auto& p_start = start_points[i];
+        const auto& p_s = current_points[i];
+        const auto& p_g = goal_points[i];
+        if (!G->existNode(p_s[0], p_s[1], p_s[2])) {
+            halt("start node (" + std::to_string(p_s[0]) + ", " + std::to_string(p_s[1]) + ", " +
+                 std::to_string(p_s[2]) + ") does not exist, invalid scenario");
         }
-        if (!G->existNode(x_g, y_g)) {
-            halt("goal node (" + std::to_string(x_g) + ", " + std::to_string(y_g) +
-                 ") does not exist, invalid scenario");
+        if (!G->existNode(p_g[0], p_g[1], p_g[2])) {
+            halt("goal node (" + std::to_string(p_g[0]) + ", " + std::to_string(p_g[1]) + ", " +
+                 std::to_string(p_g[2]) + ") does not exist, invalid scenario");
         }
 
-        Node* start = G->getNode(x_start, y_start);
-        Node* s = G->getNode(x_s, y_s);
-        Node* g = G->getNode(x_g, y_g);
+        Node* start = G->getNode(p_start[0], p_start[1], p_start[2]);
+        Node* s = G->getNode(p_s[0], p_s[1], p_s[2]);
+        Node* g = G->getNode(p_g[0], p_g[1], p_g[2]);
         config_start.push_back(start);
         config_s.push_back(s);
         config_g.push_back(g);
     }
 
     // set default values
-    MT = new std::mt19937(DEFAULT_SEED);
     max_timestep = DEFAULT_MAX_TIMESTEP;
     max_comp_time = DEFAULT_MAX_COMP_TIME;
 
@@ -202,7 +230,7 @@ Problem::Problem(const std::vector<std::vector<std::vector<int>>>& grid,
 
 Problem::~Problem()
 {
-  if (instance_initialized) {
+  if (owns_graph) {
     if (G != nullptr) delete G;
     if (MT != nullptr) delete MT;
   }
@@ -232,9 +260,8 @@ void Problem::setRandomStartsGoals()
   config_s.clear();
   config_g.clear();
 
-  // get grid size
-  Grid* grid = reinterpret_cast<Grid*>(G);
-  const int N = grid->getWidth() * grid->getHeight();
+  // get the number of nodes, node ids are compact
+  const int N = G->getNodesSize();
 
   // set starts
   std::vector<int> starts(N);
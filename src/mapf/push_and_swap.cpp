@@ -1,7 +1,9 @@
-#include "../include/push_and_swap.hpp"
+#include "../include/mapf/push_and_swap.hpp"
 
 #include <queue>
 
+namespace MAPF {
+
 const std::string PushAndSwap::SOLVER_NAME = "PushAndSwap";
 
 PushAndSwap::PushAndSwap(Problem* _P)
@@ -183,7 +185,7 @@ bool PushAndSwap::resolve(Plan& plan, const int r, const int s, Nodes& U,
 {
   info("      resolve operation for", r);
   // error check
-  if (!inArray(plan.last(r), plan.last(s)->neighbor))
+  if (!inArray(plan.last(r), G->getNeighbors(plan.last(s))))
     halt("invalid resolve operation");
 
   Node* ideal_loc_s = plan.last(r);
@@ -276,7 +278,7 @@ bool PushAndSwap::clear(Plan& plan, Node* v, const int r, const int s,
   info("      clear operation for", r, "at v=", v->id);
   auto getUnoccupiedNodes = [&]() {
     Nodes nodes;
-    for (auto u : v->neighbor) {
+    for (auto u : G->getNeighbors(v)) {
       if (occupied_now[u->id] == NIL) nodes.push_back(u);
     }
     return nodes;
@@ -287,7 +289,7 @@ bool PushAndSwap::clear(Plan& plan, Node* v, const int r, const int s,
   if (unoccupied_nodes.size() >= 2) return true;
 
   // case 1
-  for (auto u : v->neighbor) {
+  for (auto u : G->getNeighbors(v)) {
     unoccupied_nodes = getUnoccupiedNodes();
     if (inArray(u, unoccupied_nodes)) continue;
     auto obs = unoccupied_nodes;
@@ -301,7 +303,7 @@ bool PushAndSwap::clear(Plan& plan, Node* v, const int r, const int s,
 
   // case 2
   auto last_loc_s = plan.last(s);
-  for (auto u : v->neighbor) {
+  for (auto u : G->getNeighbors(v)) {
     unoccupied_nodes = getUnoccupiedNodes();
     if (inArray(u, unoccupied_nodes)) continue;
     const int disturbing_agent = occupied_now[u->id];
@@ -345,7 +347,7 @@ void PushAndSwap::executeSwap(Plan& plan, const int r, const int s,
   Node* empty2 = nullptr;
   Node* v = plan.last(r);
   Node* last_loc_s = plan.last(s);
-  for (auto u : v->neighbor) {
+  for (auto u : G->getNeighbors(v)) {
     if (occupied_now[u->id] == NIL) {
       if (empty1 == nullptr) {
         empty1 = u;
@@ -406,7 +408,8 @@ Path PushAndSwap::getShortestPath(const int id, Node* s,
   Node* g = P->getGoal(id);
   while (*(p.end() - 1) != g) {
     Node* v = *(p.end() - 1);
-    p.push_back(*std::min_element(v->neighbor.begin(), v->neighbor.end(),
+    Nodes C = G->getNeighbors(v);
+    p.push_back(*std::min_element(C.begin(), C.end(),
                                   [&](Node* a, Node* b) {
                                     // path distance
                                     int c_a = pathDist(id, a);
@@ -442,7 +445,7 @@ Node* PushAndSwap::getNearestEmptyNode(Node* v, std::vector<int>& occupied_now,
       break;
     }
     Nodes C;
-    for (auto w : u->neighbor) {
+    for (auto w : G->getNeighbors(u)) {
       if (CLOSE[w->id]) continue;
       C.push_back(w);
     }
@@ -460,7 +463,7 @@ void PushAndSwap::findNodesWithManyNeighbors()
   nodes_with_many_neighbors.clear();
   auto V = G->getV();
   for (auto v : V)
-    if (v->getDegree() >= 3) nodes_with_many_neighbors.push_back(v);
+    if (G->getDegree(v) >= 3) nodes_with_many_neighbors.push_back(v);
 }
 
 /*
@@ -551,3 +554,4 @@ void PushAndSwap::printHelp()
             << "disable initialization of priorities "
             << "using distance from starts to goals" << std::endl;
 }
+}
@@ -1,4 +1,6 @@
-#include "../include/revisit_pp.hpp"
+#include "../include/mapf/revisit_pp.hpp"
+
+namespace MAPF {
 
 const std::string RevisitPP::SOLVER_NAME = "RevisitPP";
 
@@ -21,7 +23,7 @@ void RevisitPP::run()
 
   // constraints of starts
   std::vector<std::tuple<Node*, int>> constraints;
-  for (auto i : ids) constraints.push_back(std::make_tuple(P->getStart(i), -1));
+  for (auto i : ids) constraints.push_back(std::make_tuple(P->getCurrent(i), -1));
 
   // start planning
   bool invalid = false;
@@ -100,3 +102,4 @@ void RevisitPP::printHelp()
             << "disable initialization of priorities "
             << "using distance from starts to goals" << std::endl;
 }
+}
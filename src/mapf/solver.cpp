@@ -1,5 +1,6 @@
 #include "../include/mapf/solver.hpp"
 
+#include <algorithm>
 #include <fstream>
 #include <iomanip>
 
@@ -46,7 +47,7 @@ Solver::Solver(Problem* _P)
     verbose(false),
     LB_soc(0),
     LB_makespan(0),
-    distance_table(P->getNum(),
+    distance_table(P->getDistanceTableCache() == nullptr ? P->getNum() : 0,
                    std::vector<int>(G->getNodesSize(), max_timestep)),
     distance_table_p(nullptr)
 {
@@ -62,8 +63,20 @@ Solver::~Solver()
 // -------------------------------
 void Solver::exec()
 {
-  // create distance table
-  if (distance_table_p == nullptr) {
+  // the distance tables of the cache are computed lazily
+  if (P->getDistanceTableCache() != nullptr) {
+    goal_tables.clear();
+    for (int i = 0; i < P->getNum(); ++i) {
+      goal_tables.push_back(P->getDistanceTableCache()->getTable(P->getGoal(i)));
+    }
+    // a lazy table is not thread-safe, so the tables are completed before the parallel searches
+    if (parallel_for) {
+      std::vector<DistanceTableCache::Table*> tables = goal_tables;
+      std::sort(tables.begin(), tables.end());
+      tables.erase(std::unique(tables.begin(), tables.end()), tables.end());
+      parallelFor(tables.size(), [&](size_t k) { tables[k]->expandAll(); });
+    }
+  } else if (distance_table_p == nullptr) {
     info("  pre-processing, create distance table by BFS");
     createDistanceTable();
     info("  done, elapsed: ", getSolverElapsedTime());
@@ -82,7 +95,7 @@ int Solver::getRemainedTime() const
 
 bool Solver::overCompTime() const
 {
-  return getSolverElapsedTime() >= max_comp_time;
+  return P->isCanceled() || getSolverElapsedTime() >= max_comp_time;
 }
 
 // -------------------------------
@@ -259,6 +272,10 @@ void Solver::printHelpWithoutOption(const std::string& solver_name)
 // -------------------------------
 int Solver::pathDist(const int i, Node* const s) const
 {
+  if (!goal_tables.empty()) {
+    const int d = goal_tables[i]->getDistance(s);
+    return d < 0 ? max_timestep : d;
+  }
   if (distance_table_p != nullptr) {
     return distance_table_p->operator[](i)[s->id];
   }
@@ -269,7 +286,7 @@ int Solver::pathDist(const int i) const { return pathDist(i, P->getStart(i)); }
 
 void Solver::createDistanceTable()
 {
-  for (int i = 0; i < P->getNum(); ++i) {
+  parallelFor(P->getNum(), [&](size_t i) {
     // breadth first search
     std::queue<Node*> OPEN;
     Node* n = P->getGoal(i);
@@ -279,31 +296,36 @@ void Solver::createDistanceTable()
       n = OPEN.front();
       OPEN.pop();
       const int d_n = distance_table[i][n->id];
-      for (auto m : n->neighbor) {
-        const int d_m = distance_table[i][m->id];
+      for (int32_t m : G->getNeighborIds(n)) {
+        const int d_m = distance_table[i][m];
         if (d_n + 1 >= d_m) continue;
-        distance_table[i][m->id] = d_n + 1;
-        OPEN.push(m);
+        distance_table[i][m] = d_n + 1;
+        OPEN.push(G->getNodeUnchecked(m));
       }
     }
+  });
+}
+
+void Solver::parallelFor(size_t n_tasks, const std::function<void(size_t)>& task) const
+{
+  if (parallel_for) {
+    parallel_for(n_tasks, task);
+    return;
   }
+  for (size_t i = 0; i < n_tasks; ++i) task(i);
 }
 
 // -------------------------------
 // utilities for getting path
 // -------------------------------
 Solver::AstarNode::AstarNode(Node* _v, int _g, int _f, AstarNode* _p)
-  : v(_v), g(_g), f(_f), p(_p), name(getName(_v, _g))
-{
-}
-
-std::string Solver::AstarNode::getName(Node* _v, int _g)
+  : v(_v), g(_g), f(_f), p(_p)
 {
-  return std::to_string(_v->id) + "-" + std::to_string(_g);
 }
 
 Path Solver::getPathBySpaceTimeAstar
-(Node* const s,
+(Graph* const G,
+ Node* const s,
  Node* const g,
  AstarHeuristics& fValue,
  CompareAstarNode& compare,
@@ -313,16 +335,17 @@ Path Solver::getPathBySpaceTimeAstar
 {
   auto t_start = Time::now();
 
-  AstarNodes GC;  // garbage collection
-  auto createNewNode = [&GC](Node* v, int g, int f, AstarNode* p) {
-    AstarNode* new_node = new AstarNode(v, g, f, p);
-    GC.push_back(new_node);
-    return new_node;
+  // the low-level searches of a solver run in parallel, so the pools are per thread
+  static thread_local NodePool<AstarNode> GC;
+  static thread_local SpaceTimeClosedList CLOSE;
+  GC.reset();
+  CLOSE.reset(G->getNodesSize());
+  auto createNewNode = [](Node* v, int g, int f, AstarNode* p) {
+    return GC.create(v, g, f, p);
   };
 
-  // OPEN and CLOSE list
+  // OPEN list
   std::priority_queue<AstarNode*, AstarNodes, CompareAstarNode> OPEN(compare);
-  std::unordered_map<std::string, bool> CLOSE;
 
   // initial node
   AstarNode* n = createNewNode(s, 0, 0, nullptr);
@@ -340,8 +363,8 @@ Path Solver::getPathBySpaceTimeAstar
     OPEN.pop();
 
     // check CLOSE list
-    if (CLOSE.find(n->name) != CLOSE.end()) continue;
-    CLOSE[n->name] = true;
+    if (CLOSE.contains(n->v->id, n->g)) continue;
+    CLOSE.insert(n->v->id, n->g);
 
     // check goal condition
     if (checkAstarFin(n)) {
@@ -349,15 +372,15 @@ Path Solver::getPathBySpaceTimeAstar
       break;
     }
 
-    // expand
-    Nodes C = n->v->neighbor;
-    C.push_back(n->v);
-    for (auto u : C) {
+    // expand, the neighbors and staying at the location
+    const Graph::NeighborIds ids = G->getNeighborIds(n->v);
+    for (size_t k = 0; k <= ids.size(); ++k) {
+      Node* u = k < ids.size() ? G->getNodeUnchecked(ids.first[k]) : n->v;
       int g_cost = n->g + 1;
+      // already searched?
+      if (CLOSE.contains(u->id, g_cost)) continue;
       AstarNode* m = createNewNode(u, g_cost, 0, n);
       m->f = fValue(m);
-      // already searched?
-      if (CLOSE.find(m->name) != CLOSE.end()) continue;
       // check constraints
       if (checkInvalidAstarNode(m)) continue;
       OPEN.push(m);
@@ -373,9 +396,6 @@ Path Solver::getPathBySpaceTimeAstar
     std::reverse(path.begin(), path.end());
   }
 
-  // free
-  for (auto p : GC) delete p;
-
   return path;
 }
 
@@ -442,6 +462,7 @@ Path Solver::getPrioritizedPath
   // fast collision checking
   CheckInvalidAstarNode checkInvalidAstarNode = [&](AstarNode* m) {
     if (upper_bound != -1 && m->g > upper_bound) return true;
+    if (P->isBlocked(m->v, m->g)) return true;
 
     if (makespan > 0) {
       if (m->g > makespan) {
@@ -464,7 +485,7 @@ Path Solver::getPrioritizedPath
     return false;
   };
 
-  auto p = getPathBySpaceTimeAstar(s, g, fValue, compare, checkAstarFin,
+  auto p = getPathBySpaceTimeAstar(G, s, g, fValue, compare, checkAstarFin,
                                    checkInvalidAstarNode, time_limit);
 
   // clear used path table
@@ -473,30 +494,67 @@ Path Solver::getPrioritizedPath
   return p;
 }
 
+bool Solver::isBlockedPath(const Path& path) const
+{
+  for (int t = 1; t < (int)path.size(); ++t) {
+    if (P->isBlocked(path[t], t)) return true;
+  }
+  return false;
+}
+
+Path Solver::getSpaceTimeObstacleFreePath(const int id, const int time_limit) const
+{
+  Node* s = P->getCurrent(id);
+  Node* g = P->getGoal(id);
+
+  AstarHeuristics fValue = [&](AstarNode* n) {
+    return n->g + pathDist(id, n->v);
+  };
+  CompareAstarNode compare = compareAstarNodeBasic;
+  CheckAstarFin checkAstarFin = [&](AstarNode* n) { return n->v == g; };
+  CheckInvalidAstarNode checkInvalidAstarNode = [&](AstarNode* m) {
+    return P->isBlocked(m->v, m->g);
+  };
+
+  return getPathBySpaceTimeAstar(G, s, g, fValue, compare, checkAstarFin,
+                                 checkInvalidAstarNode, time_limit);
+}
+
 void Solver::updatePathTable(const Paths& paths, const int id)
+{
+  updatePathTable(PATH_TABLE, paths, id);
+}
+
+void Solver::clearPathTable(const Paths& paths)
+{
+  clearPathTable(PATH_TABLE, paths);
+}
+
+void Solver::updatePathTable(PathTable& path_table, const Paths& paths,
+                             const int id) const
 {
   const int makespan = paths.getMakespan();
   const int num_agents = paths.size();
   const int nodes_size = G->getNodesSize();
-  // extend PATH_TABLE
-  while ((int)PATH_TABLE.size() < makespan + 1)
-    PATH_TABLE.push_back(std::vector<int>(nodes_size, NIL));
+  // extend the path table
+  while ((int)path_table.size() < makespan + 1)
+    path_table.push_back(std::vector<int>(nodes_size, NIL));
   // update locations
   for (int i = 0; i < num_agents; ++i) {
     if (i == id || paths.empty(i)) continue;
     auto p = paths.get(i);
-    for (int t = 0; t <= makespan; ++t) PATH_TABLE[t][p[t]->id] = i;
+    for (int t = 0; t <= makespan; ++t) path_table[t][p[t]->id] = i;
   }
 }
 
-void Solver::clearPathTable(const Paths& paths)
+void Solver::clearPathTable(PathTable& path_table, const Paths& paths)
 {
   const int makespan = paths.getMakespan();
   const int num_agents = paths.size();
   for (int i = 0; i < num_agents; ++i) {
     if (paths.empty(i)) continue;
     auto p = paths.get(i);
-    for (int t = 0; t <= makespan; ++t) PATH_TABLE[t][p[t]->id] = NIL;
+    for (int t = 0; t <= makespan; ++t) path_table[t][p[t]->id] = NIL;
   }
 }
 
@@ -1,4 +1,6 @@
-#include "../include/whca.hpp"
+#include "../include/mapf/whca.hpp"
+
+namespace MAPF {
 
 const std::string WHCA::SOLVER_NAME = "WHCA";
 const int WHCA::DEFAULT_WINDOW = 10;
@@ -14,7 +16,7 @@ void WHCA::run()
   // initialize
   Paths paths(P->getNum());
   for (int i = 0; i < P->getNum(); ++i) {
-    paths.insert(i, {P->getStart(i)});
+    paths.insert(i, {P->getCurrent(i)});
     table_goals[P->getGoal(i)->id] = true;
   }
 
@@ -111,6 +113,7 @@ Path WHCA::getPrioritizedPartialPath(int id, Node* s, Node* g,
   // fast collision checking
   CheckInvalidAstarNode checkInvalidAstarNode = [&](AstarNode* m) {
     if (m->g > window) return true;
+    if (P->isBlocked(m->v, m->g)) return true;
     // last node
     if (makespan > 0) {
       if (m->g > makespan) {
@@ -128,7 +131,7 @@ Path WHCA::getPrioritizedPartialPath(int id, Node* s, Node* g,
   };
 
   Path path = getPathBySpaceTimeAstar
-    (s, g, fValue, compare, checkAstarFin, checkInvalidAstarNode, getRemainedTime());
+    (G, s, g, fValue, compare, checkAstarFin, checkInvalidAstarNode, getRemainedTime());
   const int path_size = path.size();
   // format
   if (!path.empty() && path_size - 1 > window) path.resize(window + 1);
@@ -173,3 +176,4 @@ void WHCA::printHelp()
             << "disable initialization of priorities "
             << "using distance from starts to goals" << std::endl;
 }
+}
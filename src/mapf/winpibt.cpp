@@ -1,4 +1,6 @@
-#include "../include/winpibt.hpp"
+#include "../include/mapf/winpibt.hpp"
+
+namespace MAPF {
 
 const std::string winPIBT::SOLVER_NAME = "winPIBT";
 
@@ -18,7 +20,7 @@ void winPIBT::run()
   std::iota(ids.begin(), ids.end(), 0);
   std::vector<Path> paths;
   for (int i = 0; i < P->getNum(); ++i) {
-    Node* s = P->getStart(i);
+    Node* s = P->getCurrent(i);
     paths.push_back({s});
     occupied_t[s->id] = 0;
     occupied_a[s->id] = i;
@@ -175,7 +177,7 @@ Node* winPIBT::chooseNode(const int id, std::vector<Path>& paths,
 {
   const int t = paths[id].size() - 1;
   Node* v_now = paths[id][t];
-  Nodes C = v_now->neighbor;
+  Nodes C = G->getNeighbors(v_now);
   C.push_back(v_now);
 
   // randomize
@@ -231,10 +233,11 @@ Path winPIBT::getSinglePath(const int id, std::vector<Path>& paths)
   CheckInvalidAstarNode checkInvalidAstarNode = [&](AstarNode* m) {
     // future and vertex conflict
     if (occupied_t[m->v->id] >= m->g + buf) return true;
+    if (P->isBlocked(m->v, m->g + buf)) return true;
     return false;
   };
   return getPathBySpaceTimeAstar
-    (s, g, fValue, compare, checkAstarFin, checkInvalidAstarNode, getRemainedTime());
+    (G, s, g, fValue, compare, checkAstarFin, checkInvalidAstarNode, getRemainedTime());
 }
 
 void winPIBT::setParams(int argc, char* argv[])
@@ -264,3 +267,4 @@ void winPIBT::printHelp()
             << "  -w --window [INT]             "
             << "window size, default: 5, no window: -1" << std::endl;
 }
+}
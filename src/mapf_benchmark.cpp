@@ -0,0 +1,311 @@
+// MAPF solvers on the MovingAI benchmark instances, without ROS and the simulator.
+// The map is a MovingAI .map file, and each .scen file is an instance per number of agents: the first n agents of
+// the scenario. For each solver and number of agents, the success rate, the percentiles of the runtime, the solution
+// cost of the solved instances and the memory are saved to --output as JSON. A solver stops at the number of agents
+// where it solves no instance. The graph is built once per map, and the path cache is cleared before each run.
+// The peak heap of a run is counted only if the package is built with ENABLE_ALLOC_STATS.
+// rosrun lsc_dr_planner mapf_benchmark --map map/lak105d.map --scen lak105d-random-1.scen,lak105d-random-2.scen
+//     --solvers pibt,ecbs,pibt_complete --agents 10,20,50,100 --time_limit 10000
+#include <mapf/cbs.hpp>
+#include <mapf/ecbs.hpp>
+#include <mapf/hca.hpp>
+#include <mapf/icbs.hpp>
+#include <mapf/ir.hpp>
+#include <mapf/pibt.hpp>
+#include <mapf/pibt_complete.hpp>
+#include <mapf/push_and_swap.hpp>
+#include <mapf/revisit_pp.hpp>
+#include <mapf/whca.hpp>
+#include <mapf/winpibt.hpp>
+#include <alloc_stats.hpp>
+#include <timer.hpp>
+#include <rapidjson/document.h>
+#include <rapidjson/ostreamwrapper.h>
+#include <rapidjson/prettywriter.h>
+#include <boost/program_options.hpp>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/resource.h>
+
+namespace po = boost::program_options;
+using namespace rapidjson;
+
+namespace {
+    struct Scenario {
+        std::string file_name;
+        std::vector<std::array<int, 3>> start_points;
+        std::vector<std::array<int, 3>> goal_points;
+    };
+
+    struct RunResult {
+        bool success = false;
+        double runtime = 0; // [s]
+        int soc = 0;
+        int makespan = 0;
+        int64_t peak_heap_bytes = 0;
+    };
+
+    bool parseList(const std::string &str, std::vector<std::string> &values) {
+        values.clear();
+        std::stringstream ss(str);
+        std::string value;
+        while (std::getline(ss, value, ',')) {
+            values.emplace_back(value);
+        }
+        return not values.empty();
+    }
+
+    bool parseList(const std::string &str, std::vector<int> &values) {
+        std::vector<std::string> value_strs;
+        if (not parseList(str, value_strs)) {
+            return false;
+        }
+        values.clear();
+        for (const auto &value_str: value_strs) {
+            try {
+                values.emplace_back(std::stoi(value_str));
+            } catch (const std::exception &e) {
+                return false;
+            }
+            if (values.back() <= 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The MovingAI scenario format: "version 1", then bucket, map, width, height, start x, start y, goal x, goal y
+    // and the optimal length per line
+    bool readScenario(const std::string &file_name, const MAPF::Grid &G, Scenario &scenario) {
+        std::ifstream file(file_name);
+        if (not file.is_open()) {
+            std::cout << "[MAPFBenchmark] Failed to open " << file_name << std::endl;
+            return false;
+        }
+
+        scenario.file_name = file_name;
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.empty() or line.rfind("version", 0) == 0) {
+                continue;
+            }
+            std::stringstream ss(line);
+            std::string bucket, map_name;
+            int width, height, sx, sy, gx, gy;
+            if (not(ss >> bucket >> map_name >> width >> height >> sx >> sy >> gx >> gy)) {
+                std::cout << "[MAPFBenchmark] Invalid line of " << file_name << ": " << line << std::endl;
+                return false;
+            }
+            if (width != G.getWidth() or height != G.getHeight() or not G.existNode(sx, sy) or
+                not G.existNode(gx, gy)) {
+                std::cout << "[MAPFBenchmark] The scenario " << file_name << " does not match the map" << std::endl;
+                return false;
+            }
+            scenario.start_points.push_back({sx, sy, 0});
+            scenario.goal_points.push_back({gx, gy, 0});
+        }
+        return true;
+    }
+
+    const std::vector<std::string> SOLVER_NAMES = {"pibt", "ecbs", "cbs", "icbs", "hca", "whca", "winpibt",
+                                                   "pibt_complete", "push_and_swap", "revisit_pp", "ir"};
+
+    std::unique_ptr<MAPF::Solver> createSolver(const std::string &solver_name, MAPF::Problem *P) {
+        if (solver_name == "pibt") {
+            return std::make_unique<MAPF::PIBT>(P);
+        } else if (solver_name == "ecbs") {
+            return std::make_unique<MAPF::ECBS>(P);
+        } else if (solver_name == "cbs") {
+            return std::make_unique<MAPF::CBS>(P);
+        } else if (solver_name == "icbs") {
+            return std::make_unique<MAPF::ICBS>(P);
+        } else if (solver_name == "hca") {
+            return std::make_unique<MAPF::HCA>(P);
+        } else if (solver_name == "whca") {
+            return std::make_unique<MAPF::WHCA>(P);
+        } else if (solver_name == "winpibt") {
+            return std::make_unique<MAPF::winPIBT>(P);
+        } else if (solver_name == "pibt_complete") {
+            return std::make_unique<MAPF::PIBT_COMPLETE>(P);
+        } else if (solver_name == "push_and_swap") {
+            return std::make_unique<MAPF::PushAndSwap>(P);
+        } else if (solver_name == "revisit_pp") {
+            return std::make_unique<MAPF::RevisitPP>(P);
+        } else if (solver_name == "ir") {
+            return std::make_unique<MAPF::IR>(P);
+        }
+        return nullptr;
+    }
+
+    RunResult run(const std::string &solver_name, MAPF::Grid &G, const Scenario &scenario, int n_agents,
+                  int time_limit) {
+        RunResult result;
+        std::vector<std::array<int, 3>> start_points(scenario.start_points.begin(),
+                                                     scenario.start_points.begin() + n_agents);
+        std::vector<std::array<int, 3>> goal_points(scenario.goal_points.begin(),
+                                                    scenario.goal_points.begin() + n_agents);
+        G.clearPathCache();
+        std::mt19937 MT(DEFAULT_SEED);
+
+        DynamicPlanning::AllocScope alloc_scope;
+        Timer timer;
+        MAPF::Problem P(&G, &MT, n_agents, start_points, start_points, goal_points);
+        P.setMaxCompTime(time_limit);
+        std::unique_ptr<MAPF::Solver> solver = createSolver(solver_name, &P);
+        solver->solve();
+        timer.stop();
+
+        result.runtime = timer.elapsedSeconds();
+        result.peak_heap_bytes = alloc_scope.getCounts().peak_live_bytes;
+        const MAPF::Plan &plan = solver->getSolution();
+        result.success = solver->succeed() and plan.validate(&P);
+        if (result.success) {
+            result.soc = plan.getSOC();
+            result.makespan = plan.getMakespan();
+        }
+        return result;
+    }
+
+    double getPercentile(const std::vector<double> &sorted_values, double percentile) {
+        if (sorted_values.empty()) {
+            return 0;
+        }
+        auto index = static_cast<size_t>(percentile * static_cast<double>(sorted_values.size() - 1) + 0.5);
+        return sorted_values[std::min(index, sorted_values.size() - 1)];
+    }
+
+    double getPeakRSSMB() {
+        struct rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return static_cast<double>(usage.ru_maxrss) / 1024; // ru_maxrss is in KB
+    }
+}
+
+int main(int argc, char *argv[]) {
+    po::options_description desc("Options");
+    desc.add_options()
+            ("help,h", "print this message")
+            ("map", po::value<std::string>(), "MovingAI map file")
+            ("scen", po::value<std::string>(), "comma separated MovingAI scenario files of the map")
+            ("solvers", po::value<std::string>()->default_value("pibt,ecbs"),
+             "pibt, ecbs, cbs, icbs, hca, whca, winpibt, pibt_complete, push_and_swap, revisit_pp, ir")
+            ("agents,a", po::value<std::string>()->default_value("10,20,50,100,200"), "numbers of agents")
+            ("time_limit,t", po::value<int>()->default_value(10000), "time limit of a run [ms]")
+            ("output,o", po::value<std::string>()->default_value("mapf_benchmark.json"), "result file");
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+    } catch (const po::error &e) {
+        std::cout << "[MAPFBenchmark] " << e.what() << std::endl;
+        return -1;
+    }
+    if (vm.count("help") or not vm.count("map") or not vm.count("scen")) {
+        std::cout << desc << std::endl;
+        return vm.count("help") ? 0 : -1;
+    }
+
+    std::vector<std::string> scenario_file_names, solver_names;
+    std::vector<int> agent_counts;
+    if (not parseList(vm["scen"].as<std::string>(), scenario_file_names) or
+        not parseList(vm["solvers"].as<std::string>(), solver_names) or
+        not parseList(vm["agents"].as<std::string>(), agent_counts) or vm["time_limit"].as<int>() <= 0) {
+        std::cout << "[MAPFBenchmark] Invalid option, the lists are comma separated and the numbers are positive"
+                  << std::endl;
+        return -1;
+    }
+    for (const auto &solver_name: solver_names) {
+        if (std::find(SOLVER_NAMES.begin(), SOLVER_NAMES.end(), solver_name) == SOLVER_NAMES.end()) {
+            std::cout << "[MAPFBenchmark] Invalid solver " << solver_name << std::endl;
+            return -1;
+        }
+    }
+    std::sort(agent_counts.begin(), agent_counts.end());
+
+    Timer timer;
+    MAPF::Grid G(vm["map"].as<std::string>());
+    timer.stop();
+    double graph_build_time = timer.elapsedSeconds();
+    std::vector<Scenario> scenarios(scenario_file_names.size());
+    for (size_t si = 0; si < scenarios.size(); si++) {
+        if (not readScenario(scenario_file_names[si], G, scenarios[si])) {
+            return -1;
+        }
+    }
+
+    Document result;
+    result.SetObject();
+    Document::AllocatorType &allocator = result.GetAllocator();
+    result.AddMember("map", Value(vm["map"].as<std::string>().c_str(), allocator), allocator);
+    result.AddMember("nodes", G.getNodesSize(), allocator);
+    result.AddMember("graph_build_time", graph_build_time, allocator);
+    result.AddMember("time_limit", vm["time_limit"].as<int>(), allocator);
+    result.AddMember("scenarios", static_cast<int>(scenarios.size()), allocator);
+    result.AddMember("alloc_stats", DynamicPlanning::AllocStats::isCompiled(), allocator);
+
+    Value configs(kArrayType);
+    for (const auto &solver_name: solver_names) {
+        for (int n_agents: agent_counts) {
+            std::vector<double> runtimes;
+            double soc_sum = 0, makespan_sum = 0;
+            int n_instances = 0, n_succeeded = 0;
+            int64_t peak_heap_bytes = 0;
+            for (const auto &scenario: scenarios) {
+                if (scenario.start_points.size() < static_cast<size_t>(n_agents)) {
+                    continue;
+                }
+                RunResult run_result = run(solver_name, G, scenario, n_agents, vm["time_limit"].as<int>());
+                n_instances++;
+                runtimes.emplace_back(run_result.runtime);
+                peak_heap_bytes = std::max(peak_heap_bytes, run_result.peak_heap_bytes);
+                if (run_result.success) {
+                    n_succeeded++;
+                    soc_sum += run_result.soc;
+                    makespan_sum += run_result.makespan;
+                }
+            }
+            if (n_instances == 0) {
+                break;
+            }
+
+            // The failed runs are counted in the runtime, a run that hits the time limit is as slow as the limit
+            std::sort(runtimes.begin(), runtimes.end());
+            Value config(kObjectType);
+            config.AddMember("solver", Value(solver_name.c_str(), allocator), allocator);
+            config.AddMember("agents", n_agents, allocator);
+            config.AddMember("instances", n_instances, allocator);
+            config.AddMember("succeeded", n_succeeded, allocator);
+            config.AddMember("success_rate", static_cast<double>(n_succeeded) / n_instances, allocator);
+            config.AddMember("runtime_p50", getPercentile(runtimes, 0.5), allocator);
+            config.AddMember("runtime_p90", getPercentile(runtimes, 0.9), allocator);
+            config.AddMember("runtime_p99", getPercentile(runtimes, 0.99), allocator);
+            config.AddMember("runtime_max", runtimes.back(), allocator);
+            config.AddMember("soc_mean", n_succeeded > 0 ? soc_sum / n_succeeded : 0.0, allocator);
+            config.AddMember("makespan_mean", n_succeeded > 0 ? makespan_sum / n_succeeded : 0.0, allocator);
+            config.AddMember("peak_heap_mb", static_cast<double>(peak_heap_bytes) / (1 << 20), allocator);
+            config.AddMember("peak_rss_mb", getPeakRSSMB(), allocator);
+            configs.PushBack(config, allocator);
+            std::cout << "[MAPFBenchmark] " << solver_name << ", " << n_agents << " agents: success rate "
+                      << static_cast<double>(n_succeeded) / n_instances << ", p50 "
+                      << getPercentile(runtimes, 0.5) * 1e3 << " ms" << std::endl;
+
+            // More agents are harder, so the solver stops here
+            if (n_succeeded == 0) {
+                break;
+            }
+        }
+    }
+    result.AddMember("configs", configs, allocator);
+
+    const std::string output_file_name = vm["output"].as<std::string>();
+    std::ofstream ofs(output_file_name);
+    OStreamWrapper osw(ofs);
+    PrettyWriter<OStreamWrapper> writer(osw);
+    result.Accept(writer);
+    ofs << "\n";
+    ofs.close();
+    std::cout << "[MAPFBenchmark] Results saved: " << output_file_name << std::endl;
+    return 0;
+}
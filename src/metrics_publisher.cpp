@@ -0,0 +1,74 @@
+#include <metrics_publisher.hpp>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <cstdio>
+#include <fstream>
+
+namespace DynamicPlanning {
+    MetricsPublisher::MetricsPublisher(const ros::NodeHandle &_nh, double rate, std::string _file_name)
+            : nh(_nh), period(1.0 / rate), file_name(std::move(_file_name)) {
+        pub_diagnostics = nh.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+        worker = std::thread(&MetricsPublisher::workerLoop, this);
+    }
+
+    MetricsPublisher::~MetricsPublisher() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stop = true;
+        }
+        cv.notify_all();
+        worker.join();
+
+        // The final values of the run
+        publish();
+    }
+
+    void MetricsPublisher::workerLoop() {
+        auto next_time = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(mtx);
+        while (not stop) {
+            next_time += std::chrono::duration_cast<std::chrono::steady_clock::duration>(period);
+            if (cv.wait_until(lock, next_time, [this] { return stop; })) {
+                break;
+            }
+            lock.unlock();
+            publish();
+            lock.lock();
+        }
+    }
+
+    void MetricsPublisher::publish() {
+        const auto &registry = MetricsRegistry::getInstance();
+
+        diagnostic_msgs::DiagnosticArray msg_diagnostics;
+        msg_diagnostics.header.stamp = ros::Time::now();
+        diagnostic_msgs::DiagnosticStatus status;
+        status.level = diagnostic_msgs::DiagnosticStatus::OK;
+        status.name = "lsc_dr_planner";
+        status.message = "planner metrics";
+        status.hardware_id = ros::this_node::getName();
+        for (const auto &key_value: registry.getKeyValues()) {
+            diagnostic_msgs::KeyValue msg_key_value;
+            msg_key_value.key = key_value.first;
+            msg_key_value.value = key_value.second;
+            status.values.emplace_back(msg_key_value);
+        }
+        msg_diagnostics.status.emplace_back(status);
+        pub_diagnostics.publish(msg_diagnostics);
+
+        // The scraper must not read a partial file, so the new one replaces it
+        if (not file_name.empty()) {
+            std::string tmp_file_name = file_name + ".tmp";
+            {
+                std::ofstream file(tmp_file_name);
+                file << registry.toPrometheusText();
+                if (not file) {
+                    ROS_WARN_STREAM_THROTTLE(10, "[MetricsPublisher] Fail to write " << tmp_file_name);
+                    return;
+                }
+            }
+            if (std::rename(tmp_file_name.c_str(), file_name.c_str()) != 0) {
+                ROS_WARN_STREAM_THROTTLE(10, "[MetricsPublisher] Fail to replace " << file_name);
+            }
+        }
+    }
+}
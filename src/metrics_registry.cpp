@@ -0,0 +1,131 @@
+#include <metrics_registry.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+namespace DynamicPlanning {
+    void MetricHistogram::record(double seconds) {
+        if (not std::isfinite(seconds)) {
+            return;
+        }
+        seconds = std::max(seconds, 0.0);
+
+        int bucket_idx = 0;
+        while (bucket_idx < N_BOUNDS and seconds > getBound(bucket_idx)) {
+            bucket_idx++;
+        }
+        buckets[bucket_idx].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum_ns.fetch_add(static_cast<uint64_t>(seconds * 1e9), std::memory_order_relaxed);
+    }
+
+    double MetricHistogram::getBound(int bucket_idx) {
+        if (bucket_idx >= N_BOUNDS) {
+            return std::numeric_limits<double>::infinity();
+        }
+        return MIN_BOUND * static_cast<double>(uint64_t(1) << bucket_idx);
+    }
+
+    double MetricHistogram::getSum() const {
+        return static_cast<double>(sum_ns.load(std::memory_order_relaxed)) * 1e-9;
+    }
+
+    double MetricHistogram::getPercentileBound(double percentile) const {
+        uint64_t n_samples = getCount();
+        if (n_samples == 0) {
+            return 0;
+        }
+
+        auto rank = static_cast<uint64_t>(std::ceil(percentile / 100.0 * static_cast<double>(n_samples)));
+        uint64_t cumulative_count = 0;
+        for (int bi = 0; bi <= N_BOUNDS; bi++) {
+            cumulative_count += getBucketCount(bi);
+            if (cumulative_count >= rank) {
+                return getBound(bi);
+            }
+        }
+        return getBound(N_BOUNDS);
+    }
+
+    MetricsRegistry &MetricsRegistry::getInstance() {
+        static MetricsRegistry registry;
+        return registry;
+    }
+
+    template<typename Metric>
+    Metric &MetricsRegistry::getMetric(std::deque<Entry<Metric>> &entries, const std::string &name,
+                                       const std::string &help) {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (auto &entry: entries) {
+            if (entry.name == name) {
+                return entry.metric;
+            }
+        }
+        entries.emplace_back(name, help);
+        return entries.back().metric;
+    }
+
+    MetricCounter &MetricsRegistry::getCounter(const std::string &name, const std::string &help) {
+        return getMetric(counters, name, help);
+    }
+
+    MetricGauge &MetricsRegistry::getGauge(const std::string &name, const std::string &help) {
+        return getMetric(gauges, name, help);
+    }
+
+    MetricHistogram &MetricsRegistry::getHistogram(const std::string &name, const std::string &help) {
+        return getMetric(histograms, name, help);
+    }
+
+    std::string MetricsRegistry::toPrometheusText() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        std::stringstream ss;
+        for (const auto &entry: counters) {
+            ss << "# HELP " << entry.name << " " << entry.help << "\n"
+               << "# TYPE " << entry.name << " counter\n"
+               << entry.name << " " << entry.metric.get() << "\n";
+        }
+        for (const auto &entry: gauges) {
+            ss << "# HELP " << entry.name << " " << entry.help << "\n"
+               << "# TYPE " << entry.name << " gauge\n"
+               << entry.name << " " << entry.metric.get() << "\n";
+        }
+        for (const auto &entry: histograms) {
+            ss << "# HELP " << entry.name << " " << entry.help << "\n"
+               << "# TYPE " << entry.name << " histogram\n";
+
+            // The buckets of Prometheus are cumulative, and +Inf is the count
+            uint64_t cumulative_count = 0;
+            for (int bi = 0; bi < MetricHistogram::N_BOUNDS; bi++) {
+                cumulative_count += entry.metric.getBucketCount(bi);
+                ss << entry.name << "_bucket{le=\"" << MetricHistogram::getBound(bi) << "\"} " << cumulative_count
+                   << "\n";
+            }
+            cumulative_count += entry.metric.getBucketCount(MetricHistogram::N_BOUNDS);
+            ss << entry.name << "_bucket{le=\"+Inf\"} " << cumulative_count << "\n"
+               << entry.name << "_sum " << entry.metric.getSum() << "\n"
+               << entry.name << "_count " << cumulative_count << "\n";
+        }
+        return ss.str();
+    }
+
+    std::vector<std::pair<std::string, std::string>> MetricsRegistry::getKeyValues() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        std::vector<std::pair<std::string, std::string>> key_values;
+        for (const auto &entry: counters) {
+            key_values.emplace_back(entry.name, std::to_string(entry.metric.get()));
+        }
+        for (const auto &entry: gauges) {
+            key_values.emplace_back(entry.name, std::to_string(entry.metric.get()));
+        }
+        for (const auto &entry: histograms) {
+            uint64_t n_samples = entry.metric.getCount();
+            double mean = n_samples > 0 ? entry.metric.getSum() / static_cast<double>(n_samples) : 0;
+            key_values.emplace_back(entry.name + "_count", std::to_string(n_samples));
+            key_values.emplace_back(entry.name + "_mean", std::to_string(mean));
+            key_values.emplace_back(entry.name + "_p99_bound", std::to_string(entry.metric.getPercentileBound(99)));
+        }
+        return key_values;
+    }
+}
@@ -1,14 +1,18 @@
 #include <mission.hpp>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace DynamicPlanning {
-    Mission::Mission(const ros::NodeHandle &nh) {
+    Mission::Mission(const ros::NodeHandle &nh)
+            : Mission(nh.param<std::string>("mission", "default.json"),
+                      nh.param<std::string>("world/file_name", "default.bt")) {}
+
+    Mission::Mission(const std::string &mission_file_name, const std::string &world_file_name) {
         qn = 0;
         on = 0;
 
-        std::string mission_file_name, world_file_name;
-        nh.param<std::string>("mission", mission_file_name, "default.json");
-        nh.param<std::string>("world/file_name", world_file_name, "default.bt");
-
         std::string package_path = ros::package::getPath("lsc_dr_planner");
         if (mission_file_name.find(".json") != std::string::npos) {
             mission_file_names.emplace_back(package_path + "/missions/" + mission_file_name);
@@ -45,10 +49,27 @@ namespace DynamicPlanning {
     }
 
     Document Mission::parseMissionFile(const std::string& file_name) {
-        std::ifstream ifs(file_name);
-        IStreamWrapper isw(ifs);
+        // Parse the mapped file directly instead of reading it through a stream. The strings are copied to the
+        // document, so the document does not refer to the mapping.
+        int fd = open(file_name.c_str(), O_RDONLY);
+        struct stat file_stat{};
+        if (fd < 0 or fstat(fd, &file_stat) != 0 or file_stat.st_size == 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw std::invalid_argument("There is no such mission file " + file_name + "\n");
+        }
+        auto size = static_cast<size_t>(file_stat.st_size);
+        void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            throw std::invalid_argument("There is no such mission file " + file_name + "\n");
+        }
+
         Document document;
-        if (document.ParseStream(isw).HasParseError()) {
+        bool has_parse_error = document.Parse(static_cast<const char *>(data), size).HasParseError();
+        munmap(data, size);
+        if (has_parse_error) {
             throw std::invalid_argument("There is no such mission file " + file_name + "\n");
         }
 
@@ -91,6 +112,19 @@ namespace DynamicPlanning {
         return readMissionFile(max_noise, world_dimension, world_z_2d);
     }
 
+    bool Mission::loadMission(const Document& document, double max_noise, int world_dimension, double world_z_2d,
+                              int mission_idx) {
+        current_mission_file_name = mission_file_names[mission_idx];
+        if(mission_file_names.size() == world_file_names.size()){
+            current_world_file_name = world_file_names[mission_idx];
+        }
+        else{
+            current_world_file_name = world_file_names[0];
+        }
+
+        return readMission(document, max_noise, world_dimension, world_z_2d);
+    }
+
     bool Mission::readMissionFile(double max_noise, int world_dimension, double world_z_2d){
         Document document;
         try{
@@ -101,6 +135,14 @@ namespace DynamicPlanning {
             return false;
         }
 
+        return readMission(document, max_noise, world_dimension, world_z_2d);
+    }
+
+    bool Mission::readMission(const Document& document, double max_noise, int world_dimension, double world_z_2d){
+
+        // Random seed, optional
+        random_seed = document.HasMember("random_seed") ? document["random_seed"].GetUint64() : 0;
+
         // World
         const Value &world_list = document["world"];
         if(world_list.Size() != 1){
@@ -132,6 +174,9 @@ namespace DynamicPlanning {
             quadrotor.radius = itr->value.GetObject()["radius"].GetDouble();
             quadrotor.downwash = itr->value.GetObject()["downwash"].GetDouble();
             quadrotor.nominal_velocity = itr->value.GetObject()["nominal_velocity"].GetDouble();
+            if (itr->value.HasMember("replanning_period")) {
+                quadrotor.replanning_period = itr->value.GetObject()["replanning_period"].GetInt();
+            }
 
             quadrotor_map.insert({quad_name, quadrotor});
         }
@@ -208,6 +253,15 @@ namespace DynamicPlanning {
             if(not agents_list[qi].GetObject()["nominal_velocity"].Empty()){
                 agents[qi].nominal_velocity = agents_list[qi].GetObject()["nominal_velocity"].GetDouble();
             }
+
+            // replanning period, in simulation steps
+            if (agents_list[qi].HasMember("replanning_period")) {
+                agents[qi].replanning_period = agents_list[qi].GetObject()["replanning_period"].GetInt();
+            }
+            if (agents[qi].replanning_period < 1) {
+                ROS_ERROR("[Mission] Replanning period must be a positive integer");
+                return false;
+            }
         }
 
         initializeAgentColor();
@@ -215,6 +269,7 @@ namespace DynamicPlanning {
         const Value &obstacle_list = document["obstacles"];
         on = obstacle_list.Size();
         obstacles.resize(on);
+        size_t n_real_obstacles = 0;
         for (SizeType oi = 0; oi < on; oi++) {
             std::string type = obstacle_list[oi].GetObject()["type"].GetString();
 
@@ -340,7 +395,10 @@ namespace DynamicPlanning {
                 }
                 obstacles[oi] = std::make_shared<GaussianObstacle>(obs_start, obs_size, obs_initial_vel, obs_max_vel,
                                                                    obs_stddev_acc, obs_max_acc, obs_acc_update_cycle,
-                                                                   obs_downwash);
+                                                                   obs_downwash,
+                                                                   RandomStream(random_seed,
+                                                                                RandomStream::GAUSSIAN_OBSTACLE,
+                                                                                static_cast<uint32_t>(oi)));
             }
 //            else if(type == "bernstein"){
 //                std::string traj_csv_path = obstacle_list[oi].GetObject()["traj_csv_path"].GetString();
@@ -383,7 +441,14 @@ namespace DynamicPlanning {
                     obs_downwash = 1;
                 }
 
-                obstacles[oi] = std::make_shared<RealObstacle>(obs_size, obs_max_acc, obs_downwash);
+                // The frame of the k-th real obstacle is /obs<k> unless it is given
+                std::string obs_frame_id = "/obs" + std::to_string(n_real_obstacles);
+                if (obstacle_list[oi].GetObject().HasMember("frame_id")) {
+                    obs_frame_id = obstacle_list[oi].GetObject()["frame_id"].GetString();
+                }
+                obstacles[oi] = std::make_shared<RealObstacle>(obs_size, obs_max_acc, obs_downwash, obs_frame_id,
+                                                               n_real_obstacles);
+                n_real_obstacles++;
             }
             else {
                 return false;
@@ -409,12 +474,10 @@ namespace DynamicPlanning {
 
     void Mission::addNoise(double max_noise, int dimension) {
         ROS_INFO_STREAM("[Mission] Add noise " << max_noise);
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_real_distribution<float> dis(0, 1);
+        RandomStream random_stream(random_seed, RandomStream::GOAL_NOISE, 0);
         for (size_t qi = 0; qi < qn; qi++) {
             for (int k = 0; k < dimension; k++) {
-                agents[qi].desired_goal_point(k) += (float)(dis(gen) * max_noise);
+                agents[qi].desired_goal_point(k) += (float)(random_stream.nextUniform() * max_noise);
             }
         }
     }
@@ -0,0 +1,400 @@
+// Generate random missions for the scaling tests, the native replacement of matlab/mission_generator.m.
+// The starts and the goals are Poisson-disk samples, at least --spacing apart, found by dart throwing over a grid
+// hash. They keep --clearance from the obstacles of the world file given by --world, or from a forest of box or
+// cylinder pillars sampled the same way and saved as the world of each mission.
+// Each mission draws from its own random stream of (--seed, mission index), so the missions do not depend on the
+// number of threads and the same seed gives the same files.
+// rosrun lsc_dr_planner mission_generator --name forest500 --agents 500 --missions 100 --pillars 400
+//     --pillar_shape cylinder --dimension "-20,-20,0,20,20,2.5"
+// rosrun lsc_dr_planner mission_generator --name maze200 --agents 200 --world maze/dense/maze1.csv
+//     --dimension "-2,0,0,10,7.2,2.5"
+#include <global_map_registry.hpp>
+#include <random_stream.hpp>
+#include <worker_pool.hpp>
+#include <timer.hpp>
+#include <ros/package.h>
+#include <boost/program_options.hpp>
+#include <atomic>
+#include <cmath>
+#include <experimental/filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+using namespace DynamicPlanning;
+namespace po = boost::program_options;
+namespace fs = std::experimental::filesystem;
+
+namespace {
+    // Dart throwing for Poisson-disk samples. The cells of the grid hash are spacing wide, so a candidate is compared
+    // with the samples of the neighboring cells only.
+    class PoissonDiskSampler {
+    public:
+        // planar: sample on the plane z = z_2d
+        PoissonDiskSampler(const point3d &_sample_min, const point3d &_sample_max, double _spacing, bool _planar,
+                           double _z_2d)
+                : sample_min(_sample_min), sample_max(_sample_max), spacing(_spacing), planar(_planar), z_2d(_z_2d) {
+            for (int k = 0; k < 3; k++) {
+                n_cells[k] = std::max(static_cast<int>(std::ceil((sample_max(k) - sample_min(k)) / spacing)), 1);
+            }
+            if (planar) {
+                n_cells[2] = 1;
+            }
+            cells.resize(static_cast<size_t>(n_cells[0]) * n_cells[1] * n_cells[2]);
+        }
+
+        // Try up to max_attempts uniform candidates, the first one that is farther than the spacing from the samples
+        // and is_valid is added. false if there is none.
+        template<typename Validator>
+        bool sample(RandomStream &stream, const Validator &is_valid, int max_attempts, point3d &point) {
+            for (int attempt = 0; attempt < max_attempts; attempt++) {
+                point3d candidate;
+                for (int k = 0; k < 3; k++) {
+                    candidate(k) = static_cast<float>(sample_min(k) +
+                                                      (sample_max(k) - sample_min(k)) * stream.nextUniform());
+                }
+                if (planar) {
+                    candidate.z() = static_cast<float>(z_2d);
+                }
+                if (isFarFromSamples(candidate) and is_valid(candidate)) {
+                    cells[cellIndex(candidate)].emplace_back(samples.size());
+                    samples.emplace_back(candidate);
+                    point = candidate;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        [[nodiscard]] const points_t &getSamples() const { return samples; }
+
+    private:
+        point3d sample_min, sample_max;
+        double spacing;
+        bool planar;
+        double z_2d;
+        int n_cells[3] = {1, 1, 1};
+        std::vector<std::vector<size_t>> cells; // sample indices of each cell
+        points_t samples;
+
+        [[nodiscard]] int cellCoord(const point3d &point, int k) const {
+            int coord = static_cast<int>(std::floor((point(k) - sample_min(k)) / spacing));
+            return std::min(std::max(coord, 0), n_cells[k] - 1);
+        }
+
+        [[nodiscard]] size_t cellIndex(const point3d &point) const {
+            return (static_cast<size_t>(cellCoord(point, 2)) * n_cells[1] + cellCoord(point, 1)) * n_cells[0] +
+                   cellCoord(point, 0);
+        }
+
+        [[nodiscard]] bool isFarFromSamples(const point3d &point) const {
+            int coord[3] = {cellCoord(point, 0), cellCoord(point, 1), cellCoord(point, 2)};
+            for (int z = std::max(coord[2] - 1, 0); z <= std::min(coord[2] + 1, n_cells[2] - 1); z++) {
+                for (int y = std::max(coord[1] - 1, 0); y <= std::min(coord[1] + 1, n_cells[1] - 1); y++) {
+                    for (int x = std::max(coord[0] - 1, 0); x <= std::min(coord[0] + 1, n_cells[0] - 1); x++) {
+                        size_t cell_idx = (static_cast<size_t>(z) * n_cells[1] + y) * n_cells[0] + x;
+                        for (size_t si: cells[cell_idx]) {
+                            if ((samples[si] - point).norm() < spacing) {
+                                return false;
+                            }
+                        }
+                    }
+                }
+            }
+            return true;
+        }
+    };
+
+    struct GeneratorOption {
+        std::string name;
+        int n_agents = 0;
+        int n_pillars = 0;
+        uint64_t seed = 0;
+        int dimension = 2;
+        double z_2d = 1.0;
+        point3d world_min, world_max;
+        double radius = 0.15;
+        double downwash = 2.0;
+        double max_vel = 1.0;
+        double max_acc = 2.0;
+        double spacing = 0.5; // between the starts, and between the goals
+        double clearance = 0.3; // from the agent position to the obstacles
+        double pillar_size = 0.5;
+        PrimitiveShape pillar_shape = PrimitiveShape::BOX;
+        double pillar_spacing = 1.0;
+        int max_attempts = 1000;
+    };
+
+    struct GeneratedMission {
+        points_t start_points, goal_points;
+        std::vector<WorldPrimitive> pillars;
+    };
+
+    // The agent positions keep the clearance from the world boundary too
+    bool generateMission(const GeneratorOption &option, const GlobalMap *global_map, RandomStream &stream,
+                         GeneratedMission &generated) {
+        point3d margin(option.clearance, option.clearance, option.clearance);
+        point3d agent_min = option.world_min + margin, agent_max = option.world_max - margin;
+        bool planar = option.dimension == 2;
+
+        if (option.n_pillars > 0) {
+            point3d pillar_half_size(0.5 * option.pillar_size, 0.5 * option.pillar_size, 0);
+            PoissonDiskSampler pillar_sampler(option.world_min + pillar_half_size, option.world_max - pillar_half_size,
+                                              option.pillar_spacing, true, 0.5 * (option.world_min.z() +
+                                                                                  option.world_max.z()));
+            auto any_position = [](const point3d &) { return true; };
+            for (int pi = 0; pi < option.n_pillars; pi++) {
+                point3d center;
+                if (not pillar_sampler.sample(stream, any_position, option.max_attempts, center)) {
+                    std::cout << "Failed to place the pillar " << pi << ", decrease --pillars or --pillar_spacing"
+                              << std::endl;
+                    return false;
+                }
+                WorldPrimitive pillar;
+                pillar.shape = option.pillar_shape;
+                pillar.center = center;
+                pillar.size = point3d(option.pillar_size, option.pillar_size,
+                                      option.world_max.z() - option.world_min.z());
+                generated.pillars.emplace_back(pillar);
+            }
+        }
+
+        // The pillars are few compared with the attempts, so they are checked one by one
+        DistmapQueryBatch batch;
+        auto is_collision_free = [&](const point3d &point) {
+            for (const auto &pillar: generated.pillars) {
+                if (pillar.distance(point) < option.clearance) {
+                    return false;
+                }
+            }
+            if (global_map != nullptr) {
+                batch.clear();
+                batch.push(point);
+                global_map->distmap->query(batch);
+                if (batch.obstacle_l_inf_distance[0] < option.clearance) {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        PoissonDiskSampler start_sampler(agent_min, agent_max, option.spacing, planar, option.z_2d);
+        PoissonDiskSampler goal_sampler(agent_min, agent_max, option.spacing, planar, option.z_2d);
+        for (int qi = 0; qi < option.n_agents; qi++) {
+            point3d start_point, goal_point;
+            if (not start_sampler.sample(stream, is_collision_free, option.max_attempts, start_point) or
+                not goal_sampler.sample(stream, is_collision_free, option.max_attempts, goal_point)) {
+                std::cout << "Failed to place the agent " << qi << ", decrease --agents or --spacing" << std::endl;
+                return false;
+            }
+        }
+        generated.start_points = start_sampler.getSamples();
+        generated.goal_points = goal_sampler.getSamples();
+
+        // The goals are sampled independently of the starts, shuffle them so that the agents cross the world
+        for (int qi = option.n_agents - 1; qi > 0; qi--) {
+            auto qj = static_cast<int>(stream.nextUInt() % static_cast<uint32_t>(qi + 1));
+            std::swap(generated.goal_points[qi], generated.goal_points[qj]);
+        }
+        return true;
+    }
+
+    std::string toJsonArray(const point3d &point) {
+        std::ostringstream ss;
+        ss << std::setprecision(6) << "[" << point.x() << ", " << point.y() << ", " << point.z() << "]";
+        return ss.str();
+    }
+
+    // The same layout as the missions of matlab/mission_generator.m
+    bool saveMission(const std::string &file_name, const GeneratorOption &option, uint64_t random_seed,
+                     const GeneratedMission &generated) {
+        std::ofstream file(file_name);
+        if (not file.is_open()) {
+            return false;
+        }
+
+        point3d max_vel(option.max_vel, option.max_vel, option.max_vel);
+        point3d max_acc(option.max_acc, option.max_acc, option.max_acc);
+        file << std::setprecision(6);
+        file << "{\n"
+             << "  \"quadrotors\": {\n"
+             << "    \"crazyflie\": {\n"
+             << "    \"max_vel\": " << toJsonArray(max_vel) << ",\n"
+             << "    \"max_acc\": " << toJsonArray(max_acc) << ",\n"
+             << "    \"radius\": " << option.radius << ",\n"
+             << "    \"nominal_velocity\": " << option.max_vel << ",\n"
+             << "    \"downwash\": " << option.downwash << "},\n"
+             << "  \"default\": {\n"
+             << "    \"max_vel\": [1.0, 1.0, 1.0],\n"
+             << "    \"max_acc\": [2.0, 2.0, 1.0],\n"
+             << "    \"radius\": 0.15,\n"
+             << "    \"nominal_velocity\": 1.0,\n"
+             << "    \"downwash\": 2.0}\n"
+             << "  },\n\n"
+             << "  \"random_seed\": " << random_seed << ",\n\n"
+             << "  \"world\": [\n"
+             << "    {\"dimension\": ["
+             << option.world_min.x() << ", " << option.world_min.y() << ", " << option.world_min.z() << ", "
+             << option.world_max.x() << ", " << option.world_max.y() << ", " << option.world_max.z() << "]}\n"
+             << "  ],\n\n"
+             << "  \"agents\": [\n";
+        for (size_t qi = 0; qi < generated.start_points.size(); qi++) {
+            file << "    {\"type\": \"crazyflie\", \"cid\": " << qi + 1
+                 << ", \"start\": " << toJsonArray(generated.start_points[qi])
+                 << ", \"goal\": " << toJsonArray(generated.goal_points[qi]) << "}"
+                 << (qi + 1 < generated.start_points.size() ? ",\n" : "\n");
+        }
+        file << "  ],\n\n"
+             << "  \"obstacles\": [\n"
+             << "  ]\n"
+             << "}\n";
+        return file.good();
+    }
+
+    bool parseDimension(const std::string &str, point3d &world_min, point3d &world_max) {
+        std::vector<double> values;
+        std::stringstream ss(str);
+        std::string token;
+        while (std::getline(ss, token, ',')) {
+            try {
+                values.emplace_back(std::stod(token));
+            }
+            catch (const std::exception &) {
+                return false;
+            }
+        }
+        if (values.size() != 6) {
+            return false;
+        }
+        world_min = point3d(values[0], values[1], values[2]);
+        world_max = point3d(values[3], values[4], values[5]);
+        return world_min.x() < world_max.x() and world_min.y() < world_max.y() and world_min.z() < world_max.z();
+    }
+}
+
+int main(int argc, char *argv[]) {
+    GeneratorOption option;
+    po::options_description desc("Options");
+    desc.add_options()
+            ("help,h", "print this message")
+            ("name,n", po::value<std::string>(&option.name)->required(),
+             "the missions are saved in missions/<name>/<name>_<index>.json")
+            ("agents,a", po::value<int>(&option.n_agents)->required(), "number of agents")
+            ("missions,m", po::value<int>()->default_value(1), "number of missions")
+            ("seed,s", po::value<uint64_t>(&option.seed)->default_value(0), "base seed of the missions")
+            ("dimension,d", po::value<std::string>()->default_value("-5,-5,0,5,5,2.5"),
+             "world boundary x_min,y_min,z_min,x_max,y_max,z_max [m]")
+            ("world,w", po::value<std::string>(), "world file in world/ whose obstacles the agents avoid")
+            ("world_resolution", po::value<double>()->default_value(0.1), "resolution of the distance field [m]")
+            ("pillars,p", po::value<int>(&option.n_pillars)->default_value(0),
+             "number of pillars saved in world/<name>/<name>_<index>.csv")
+            ("pillar_size", po::value<double>(&option.pillar_size)->default_value(0.5),
+             "width or diameter of the pillars [m]")
+            ("pillar_shape", po::value<std::string>()->default_value("box"), "shape of the pillars, box or cylinder")
+            ("pillar_spacing", po::value<double>(&option.pillar_spacing)->default_value(1.0),
+             "minimum distance between the centers of the pillars [m]")
+            ("world_dimension", po::value<int>(&option.dimension)->default_value(2), "2: planar missions, 3: 3D")
+            ("z_2d", po::value<double>(&option.z_2d)->default_value(1.0), "height of the planar missions [m]")
+            ("radius", po::value<double>(&option.radius)->default_value(0.15), "radius of the agents [m]")
+            ("downwash", po::value<double>(&option.downwash)->default_value(2.0), "downwash of the agents")
+            ("max_vel", po::value<double>(&option.max_vel)->default_value(1.0), "maximum velocity [m/s]")
+            ("max_acc", po::value<double>(&option.max_acc)->default_value(2.0), "maximum acceleration [m/s^2]")
+            ("spacing", po::value<double>(&option.spacing)->default_value(0.5),
+             "minimum distance between the starts, and between the goals [m]")
+            ("clearance", po::value<double>(&option.clearance)->default_value(0.3),
+             "minimum distance from the starts and the goals to the obstacles [m]")
+            ("max_attempts", po::value<int>(&option.max_attempts)->default_value(1000),
+             "number of candidates for each sample before the mission fails")
+            ("threads,j", po::value<int>()->default_value(0), "number of threads, 0: number of cores");
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        if (vm.count("help")) {
+            std::cout << desc << std::endl;
+            return 0;
+        }
+        po::notify(vm);
+    } catch (const po::error &e) {
+        std::cout << "[MissionGenerator] " << e.what() << std::endl << desc << std::endl;
+        return -1;
+    }
+
+    int n_missions = vm["missions"].as<int>();
+    if (not parseDimension(vm["dimension"].as<std::string>(), option.world_min, option.world_max)) {
+        std::cout << "[MissionGenerator] Invalid dimension, it must be x_min,y_min,z_min,x_max,y_max,z_max"
+                  << std::endl;
+        return -1;
+    }
+    if (option.n_agents <= 0 or n_missions <= 0 or option.n_pillars < 0 or option.max_attempts <= 0 or
+        (option.dimension != 2 and option.dimension != 3)) {
+        std::cout << "[MissionGenerator] Invalid option, check agents, missions, pillars, max_attempts and "
+                     "world_dimension" << std::endl;
+        return -1;
+    }
+    if (option.spacing < 2 * option.radius or option.clearance < option.radius or option.pillar_size <= 0 or
+        option.pillar_spacing <= 0) {
+        std::cout << "[MissionGenerator] Invalid option, spacing must be at least the diameter of the agents and "
+                     "clearance at least the radius" << std::endl;
+        return -1;
+    }
+    std::string pillar_shape = vm["pillar_shape"].as<std::string>();
+    if (pillar_shape == "cylinder") {
+        option.pillar_shape = PrimitiveShape::CYLINDER;
+    } else if (pillar_shape != "box") {
+        std::cout << "[MissionGenerator] Invalid pillar_shape, it must be box or cylinder" << std::endl;
+        return -1;
+    }
+    if (option.dimension == 2 and (option.z_2d < option.world_min.z() or option.z_2d > option.world_max.z())) {
+        std::cout << "[MissionGenerator] Invalid option, z_2d is outside the world boundary" << std::endl;
+        return -1;
+    }
+
+    std::string package_path = ros::package::getPath("lsc_dr_planner");
+    std::shared_ptr<GlobalMap> global_map;
+    if (vm.count("world")) {
+        global_map = loadGlobalMap(package_path + "/world/" + vm["world"].as<std::string>(),
+                                   vm["world_resolution"].as<double>(), option.world_min, option.world_max,
+                                   false, true);
+        if (global_map == nullptr) {
+            return -1;
+        }
+    }
+
+    std::string mission_dir = package_path + "/missions/" + option.name;
+    std::string world_dir = package_path + "/world/" + option.name;
+    fs::create_directories(mission_dir);
+    if (option.n_pillars > 0) {
+        fs::create_directories(world_dir);
+    }
+
+    // Zero padded indices, so that the missions and the worlds are sorted in the same order by the file names
+    size_t index_width = std::to_string(n_missions).size();
+    auto indexedName = [&](int mission_idx) {
+        std::ostringstream ss;
+        ss << option.name << "_" << std::setw(static_cast<int>(index_width)) << std::setfill('0') << mission_idx;
+        return ss.str();
+    };
+
+    Timer timer;
+    std::atomic<int> n_failed{0};
+    WorkerPool worker_pool(vm["threads"].as<int>());
+    worker_pool.run(static_cast<size_t>(n_missions), [&](size_t mi) {
+        int mission_idx = static_cast<int>(mi) + 1;
+        uint64_t random_seed = option.seed + mi;
+        RandomStream stream(option.seed, RandomStream::MISSION_GENERATOR, static_cast<uint32_t>(mi));
+        GeneratedMission generated;
+        std::string file_name = indexedName(mission_idx);
+        if (not generateMission(option, global_map.get(), stream, generated) or
+            not saveMission(mission_dir + "/" + file_name + ".json", option, random_seed, generated) or
+            (option.n_pillars > 0 and not saveWorldPrimitives(world_dir + "/" + file_name + ".csv", generated.pillars))) {
+            std::cout << "[MissionGenerator] Failed to generate " << file_name << std::endl;
+            n_failed++;
+        }
+    });
+    timer.stop();
+
+    std::cout << "[MissionGenerator] " << n_missions - n_failed << "/" << n_missions << " missions in "
+              << mission_dir << ", " << timer.elapsedSeconds() << " s" << std::endl;
+    return n_failed == 0 ? 0 : -1;
+}
@@ -0,0 +1,71 @@
+#include <mission_preloader.hpp>
+
+namespace DynamicPlanning {
+    MissionPreloader::MissionPreloader(std::vector<std::string> _file_names, size_t _n_ahead)
+            : file_names(std::move(_file_names)), n_ahead(_n_ahead) {
+        if (n_ahead > 0 and not file_names.empty()) {
+            thread = std::thread(&MissionPreloader::preloadLoop, this);
+        }
+    }
+
+    MissionPreloader::~MissionPreloader() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stop = true;
+        }
+        cv.notify_all();
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    std::unique_ptr<Document> MissionPreloader::next() {
+        if (n_taken >= file_names.size()) {
+            return nullptr;
+        }
+        if (not thread.joinable()) {
+            return parse(file_names[n_taken++]);
+        }
+
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [this] { return not documents.empty(); });
+        std::unique_ptr<Document> document = std::move(documents.front());
+        documents.pop_front();
+        n_taken++;
+        lock.unlock();
+        cv.notify_all();
+        return document;
+    }
+
+    void MissionPreloader::preloadLoop() {
+        while (true) {
+            size_t file_idx;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [this] { return stop or n_parsed >= file_names.size() or documents.size() < n_ahead; });
+                if (stop or n_parsed >= file_names.size()) {
+                    return;
+                }
+                file_idx = n_parsed;
+            }
+
+            // Parse outside the lock, the consumer takes the documents parsed before
+            std::unique_ptr<Document> document = parse(file_names[file_idx]);
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                documents.emplace_back(std::move(document));
+                n_parsed++;
+            }
+            cv.notify_all();
+        }
+    }
+
+    std::unique_ptr<Document> MissionPreloader::parse(const std::string &file_name) {
+        try {
+            return std::make_unique<Document>(Mission::parseMissionFile(file_name));
+        }
+        catch (const std::invalid_argument &) {
+            return nullptr;
+        }
+    }
+}
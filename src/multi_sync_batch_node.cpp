@@ -0,0 +1,258 @@
+#include <multi_sync_simulator.hpp>
+#include <mission_preloader.hpp>
+#include <boost/program_options.hpp>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+using namespace DynamicPlanning;
+namespace po = boost::program_options;
+
+// Headless batch simulation
+// The parameters are read once, then the missions run back-to-back in this process without the publishers and the
+// visualization. The summaries are appended to log/summary_*.csv, one file per shard.
+// Several processes can share the missions of a sweep with --num_shards and --shard_index. They can read the same
+// parameters with --param_ns, e.g. the namespace of multi_sync_simulator_node set by a launch file.
+// The agents of each mission can be planned by several processes with --num_processes and --process_index, which
+// run the same missions and exchange the agents at every step.
+// With --result_file, the success and the latency percentiles of the shard are saved as JSON for scaling_benchmark.
+// With --tenants, the missions of the shard run at the same time on the threads of the tenants. The tenants share
+// the global maps of the worlds, the worker pools and the solver threads, so a tenant in a serial phase of its step
+// leaves the pools to the others. A mission that fails or throws is counted as failed without stopping the others.
+int main(int argc, char* argv[]){
+    ros::init(argc, argv, "multi_sync_batch_node", ros::init_options::AnonymousName);
+    ros::NodeHandle nh("~");
+
+    po::options_description desc("Options");
+    desc.add_options()
+            ("help,h", "print this message")
+            ("param_ns,p", po::value<std::string>()->default_value("~"), "namespace of the parameters")
+            ("mission,m", po::value<std::string>(), "mission file or directory in missions/, overrides mission")
+            ("world,w", po::value<std::string>(), "world file or directory in world/, overrides world/file_name")
+            ("shard_index,i", po::value<int>(), "index of this process, overrides multisim/shard_index")
+            ("num_shards,n", po::value<int>(), "number of processes, overrides multisim/num_shards")
+            ("process_index", po::value<int>(), "index of this process in a mission, overrides multisim/process_index")
+            ("num_processes", po::value<int>(),
+             "number of processes that plan a mission together, overrides multisim/num_processes")
+            ("workers", po::value<int>(), "number of planning threads, overrides multisim/batch_workers")
+            ("placement", po::value<std::string>(),
+             "none, compact or spread, overrides multisim/thread_placement")
+            ("sticky_agents", po::value<bool>(), "overrides multisim/sticky_agents")
+            ("tenants", po::value<int>(), "number of missions run at the same time, overrides multisim/batch_tenants")
+            ("result_file,r", po::value<std::string>(),
+             "save the success and the latency percentiles of the missions to this JSON file");
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+    } catch (const po::error &e) {
+        ROS_ERROR_STREAM("[MultiSyncBatch] " << e.what());
+        return -1;
+    }
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+
+    // Load ROS parameters once, the options override them without writing to the shared parameter server
+    ros::NodeHandle nh_param(vm["param_ns"].as<std::string>());
+    Param param;
+    if (not param.initialize(nh_param)) {
+        ROS_ERROR("[MultiSyncBatch] Invalid parameter");
+        return -1;
+    }
+    param.multisim_headless = true;
+    if (vm.count("shard_index")) {
+        param.multisim_shard_index = vm["shard_index"].as<int>();
+    }
+    if (vm.count("num_shards")) {
+        param.multisim_num_shards = vm["num_shards"].as<int>();
+    }
+    if (vm.count("process_index")) {
+        param.multisim_process_index = vm["process_index"].as<int>();
+    }
+    if (vm.count("num_processes")) {
+        param.multisim_num_processes = vm["num_processes"].as<int>();
+    }
+    if (vm.count("workers")) {
+        param.multisim_batch_workers = vm["workers"].as<int>();
+    }
+    if (vm.count("placement") and
+        not CPUTopology::parsePlacementMode(vm["placement"].as<std::string>(), param.multisim_thread_placement)) {
+        ROS_ERROR("[MultiSyncBatch] Invalid thread placement mode");
+        return -1;
+    }
+    if (vm.count("sticky_agents")) {
+        param.multisim_sticky_agents = vm["sticky_agents"].as<bool>();
+    }
+    if (vm.count("tenants")) {
+        param.multisim_batch_tenants = vm["tenants"].as<int>();
+    }
+    if (not param.validateMultisim() or param.multisim_batch_tenants < 1) {
+        ROS_ERROR("[MultiSyncBatch] Invalid option");
+        return -1;
+    }
+    if (param.multisim_batch_tenants > 1 and param.multisim_num_processes > 1) {
+        ROS_ERROR("[MultiSyncBatch] The tenants are not supported with several processes per mission");
+        return -1;
+    }
+    if (param.multisim_batch_tenants > 1 and param.multisim_trace) {
+        // The trace of a mission would have the events of the other tenants
+        ROS_WARN("[MultiSyncBatch] The trace is disabled with several tenants");
+        param.multisim_trace = false;
+    }
+    if (param.multisim_replay) {
+        ROS_ERROR("[MultiSyncBatch] Replay mode is not supported, use multi_sync_simulator_node");
+        return -1;
+    }
+
+    Mission mission(vm.count("mission") ? vm["mission"].as<std::string>() :
+                    nh_param.param<std::string>("mission", "default.json"),
+                    vm.count("world") ? vm["world"].as<std::string>() :
+                    nh_param.param<std::string>("world/file_name", "default.bt"));
+
+    // The mission files of the shard are parsed ahead while the current mission runs
+    std::vector<size_t> mission_indices;
+    std::vector<std::string> shard_file_names;
+    for (size_t si = 0; si < mission.mission_file_names.size(); si++) {
+        if (param.isMissionInShard(si)) {
+            mission_indices.emplace_back(si);
+            shard_file_names.emplace_back(mission.mission_file_names[si]);
+        }
+    }
+    MissionPreloader mission_preloader(shard_file_names, param.multisim_preload_missions);
+
+    // The tenants take the missions in the order of the shard, the counters and the histograms are merged under the
+    // lock. The missions of a world run on the same simulator of a tenant, see MultiSyncSimulator::resetMission
+    std::mutex batch_mtx;
+    size_t next_mission = 0;
+    size_t n_finished = 0, n_failed = 0, n_succeeded = 0, n_reset = 0;
+    PlanningTimeStatistics batch_planning_time; // the histograms of all missions of the shard
+    auto run_tenant = [&](int tenant_idx) {
+        Mission tenant_mission = mission;
+        std::unique_ptr<MultiSyncSimulator> multi_sync_simulator;
+        while (ros::ok()) {
+            size_t si;
+            std::unique_ptr<Document> document;
+            {
+                std::lock_guard<std::mutex> lock(batch_mtx);
+                if (next_mission >= mission_indices.size()) {
+                    break;
+                }
+                si = mission_indices[next_mission++];
+                document = mission_preloader.next();
+            }
+
+            // A broken mission does not stop the batch
+            if (document == nullptr or
+                not tenant_mission.loadMission(*document, param.multisim_max_noise, param.world_dimension,
+                                               param.world_z_2d, si)) {
+                ROS_ERROR_STREAM("[MultiSyncBatch] Invalid mission " << tenant_mission.mission_file_names[si]);
+                std::lock_guard<std::mutex> lock(batch_mtx);
+                n_failed++;
+                continue;
+            }
+            if (tenant_mission.qn == 0) {
+                ROS_ERROR_STREAM("[MultiSyncBatch] Invalid mission, there is no agent "
+                                 << tenant_mission.mission_file_names[si]);
+                std::lock_guard<std::mutex> lock(batch_mtx);
+                n_failed++;
+                continue;
+            }
+
+            Timer mission_timer;
+            bool is_reset = false, is_succeeded;
+            try {
+                if (multi_sync_simulator != nullptr and multi_sync_simulator->resetMission(tenant_mission)) {
+                    is_reset = true;
+                } else {
+                    // The maps of the previous simulator are released before the next one loads them
+                    multi_sync_simulator.reset();
+                    multi_sync_simulator = std::make_unique<MultiSyncSimulator>(nh, param, tenant_mission);
+                }
+                multi_sync_simulator->run();
+                is_succeeded = multi_sync_simulator->isMissionSucceeded();
+            } catch (const std::exception &e) {
+                // The state of the simulator is unknown, the next mission of the tenant builds a new one
+                ROS_ERROR_STREAM("[MultiSyncBatch] mission " << si << " failed on the tenant " << tenant_idx << ": "
+                                 << e.what());
+                multi_sync_simulator.reset();
+                std::lock_guard<std::mutex> lock(batch_mtx);
+                n_failed++;
+                continue;
+            }
+            mission_timer.stop();
+
+            std::lock_guard<std::mutex> lock(batch_mtx);
+            batch_planning_time.mergeHistograms(multi_sync_simulator->getPlanningTimeStatistics());
+            n_finished++;
+            n_succeeded += is_succeeded ? 1 : 0;
+            n_reset += is_reset ? 1 : 0;
+            ROS_INFO_STREAM("[MultiSyncBatch] mission " << si << "/" << tenant_mission.mission_file_names.size()
+                            << " finished in " << mission_timer.elapsedSeconds() << " s"
+                            << (param.multisim_batch_tenants > 1 ? " on the tenant " + std::to_string(tenant_idx) : "")
+                            << ": " << tenant_mission.current_mission_file_name);
+        }
+    };
+
+    Timer batch_timer;
+    if (param.multisim_batch_tenants == 1) {
+        run_tenant(0);
+    } else {
+        std::vector<std::thread> tenants;
+        for (int ti = 0; ti < param.multisim_batch_tenants; ti++) {
+            tenants.emplace_back(run_tenant, ti);
+        }
+        for (auto &tenant: tenants) {
+            tenant.join();
+        }
+    }
+    batch_timer.stop();
+    double missions_per_hour = batch_timer.elapsedSeconds() > 0 ?
+                               3600.0 * static_cast<double>(n_finished) / batch_timer.elapsedSeconds() : 0;
+
+    ROS_INFO_STREAM("[MultiSyncBatch] shard " << param.multisim_shard_index << "/" << param.multisim_num_shards
+                    << ", finished: " << n_finished << " (succeeded: " << n_succeeded << ", reused simulator: "
+                    << n_reset << "), failed: " << n_failed
+                    << ", time: " << batch_timer.elapsedSeconds() << " s, " << param.multisim_batch_tenants
+                    << " tenants, " << missions_per_hour << " missions/h");
+    for (const auto &histogram: batch_planning_time.getHistograms()) {
+        if (histogram.second->getCount() == 0) {
+            continue;
+        }
+        std::stringstream percentiles_ss;
+        for (double percentile: param.multisim_latency_percentiles) {
+            percentiles_ss << " p" << percentile << ": " << histogram.second->getPercentile(percentile);
+        }
+        ROS_INFO_STREAM("[MultiSyncBatch] " << histogram.first << " percentiles:" << percentiles_ss.str());
+    }
+
+    // The results of the shard for the scaling benchmark, the percentiles are in seconds
+    if (vm.count("result_file")) {
+        std::ofstream result_file(vm["result_file"].as<std::string>());
+        result_file << "{\"missions\": " << mission_indices.size()
+                    << ", \"finished\": " << n_finished
+                    << ", \"succeeded\": " << n_succeeded
+                    << ", \"failed\": " << n_failed
+                    << ", \"wall_time\": " << batch_timer.elapsedSeconds()
+                    << ", \"tenants\": " << param.multisim_batch_tenants
+                    << ", \"missions_per_hour\": " << missions_per_hour
+                    << ", \"latency\": {";
+        bool is_first = true;
+        for (const auto &histogram: batch_planning_time.getHistograms()) {
+            result_file << (is_first ? "" : ", ") << "\"" << histogram.first << "\": {\"count\": "
+                        << histogram.second->getCount();
+            for (double percentile: param.multisim_latency_percentiles) {
+                result_file << ", \"p" << percentile << "\": " << histogram.second->getPercentile(percentile);
+            }
+            result_file << "}";
+            is_first = false;
+        }
+        result_file << "}}\n";
+        if (not result_file) {
+            ROS_ERROR_STREAM("[MultiSyncBatch] Fail to save the result file " << vm["result_file"].as<std::string>());
+            return -1;
+        }
+    }
+    return n_failed == 0 ? 0 : -1;
+}
@@ -1,11 +1,14 @@
 #include <multi_sync_replayer.hpp>
+#include <geometry_kernels.hpp>
+#include <algorithm>
 #include <utility>
 
 namespace DynamicPlanning{
     MultiSyncReplayer::MultiSyncReplayer(const ros::NodeHandle& _nh,
                                          const Param& _param,
                                          const Mission& _mission)
-                : nh(_nh), param(_param), mission(_mission), obstacle_generator(_nh, _mission)
+                : nh(_nh), param(_param), mission(_mission),
+                  obstacle_generator(_nh, std::make_shared<const Mission>(_mission), false)
     {
         pub_agent_trajectories = nh.advertise<visualization_msgs::MarkerArray>("/agent_trajectories_history", 1);
         pub_obstacle_trajectories = nh.advertise<visualization_msgs::MarkerArray>("/obstacle_trajectories_history", 1);
@@ -22,13 +25,16 @@ namespace DynamicPlanning{
         pub_world_boundary = nh.advertise<visualization_msgs::MarkerArray>("/world_boundary", 1);
         pub_collision_alert = nh.advertise<visualization_msgs::MarkerArray>("/collision_alert", 1);
         pub_communication_group = nh.advertise<visualization_msgs::MarkerArray>("/communication_group", 1);
+        sub_seek = nh.subscribe<std_msgs::Float64>("/replay_seek", 1, [this](const std_msgs::Float64::ConstPtr &msg) {
+            seek(msg->data);
+        });
 
         timeStep = param.multisim_save_time_step;
         makeSpan = SP_INFINITY;
 
 
         if(param.world_use_octomap and param.world_use_global_map){
-            fake_agent = std::make_unique<AgentManager>(nh, param, mission, 0);
+            fake_agent = std::make_unique<AgentManager>(nh, param, std::make_shared<const Mission>(mission), 0);
             fake_agent->setGlobalMap();
             has_global_map = true;
         }
@@ -40,17 +46,62 @@ namespace DynamicPlanning{
         msg_agent_trajectories_replay.markers.clear();
         msg_agent_trajectories_replay.markers.resize(mission.qn);
         msg_obstacle_trajectories_replay.markers.clear();
-        msg_obstacle_trajectories_replay.markers.resize(mission.qn);
+        msg_obstacle_trajectories_replay.markers.resize(mission.on);
+        n_history_frames = 0;
+
+        for (size_t qi = 0; qi < mission.qn; qi++) {
+            visualization_msgs::Marker &marker = msg_agent_trajectories_replay.markers[qi];
+            marker.header.frame_id = param.world_frame_id;
+            marker.type = visualization_msgs::Marker::LINE_STRIP;
+            marker.action = visualization_msgs::Marker::ADD;
+            marker.pose.orientation = defaultQuaternion();
+            marker.scale.x = 0.07;
+            marker.id = static_cast<int>(qi);
+            marker.color = mission.color[qi];
+            marker.color.a = 0.75;
+        }
+
+        for (size_t oi = 0; oi < mission.on; oi++) {
+            visualization_msgs::Marker &marker = msg_obstacle_trajectories_replay.markers[oi];
+            marker.header.frame_id = param.world_frame_id;
+            marker.type = visualization_msgs::Marker::LINE_STRIP;
+            marker.action = visualization_msgs::Marker::ADD;
+            marker.pose.orientation = defaultQuaternion();
+            marker.scale.x = 0.07;
+            marker.id = static_cast<int>(oi);
+            marker.color.a = 0.75;
+            marker.color.r = 0;
+            marker.color.g = 0;
+            marker.color.b = 0;
+        }
+    }
+
+    void MultiSyncReplayer::startReplay() {
+        seek(0);
+    }
 
-        agent_state_history.resize(mission.qn);
-        obstacle_state_history.resize(mission.on);
+    void MultiSyncReplayer::replay() {
+        doReplay(playback_start + param.multisim_replay_speed * (ros::Time::now() - playback_start_time).toSec());
     }
 
     void MultiSyncReplayer::replay(double t) {
         doReplay(t);
     }
 
-    // read CSV and update history member variable
+    void MultiSyncReplayer::seek(double t) {
+        playback_start_time = ros::Time::now();
+        playback_start = std::max(t, 0.0);
+    }
+
+    void MultiSyncReplayer::readResultFile(const std::string &file_name) {
+        if (file_name.size() >= 7 and file_name.compare(file_name.size() - 7, 7, ".lsclog") == 0) {
+            readBinaryFile(file_name);
+        } else {
+            readCSVFile(file_name);
+        }
+    }
+
+    // read CSV and convert it to the frames of the trajectory log
     void MultiSyncReplayer::readCSVFile(const std::string &file_name) {
         std::string full_file_name = param.package_path + "/log/" + file_name;
         std::ifstream file(full_file_name);
@@ -62,6 +113,8 @@ namespace DynamicPlanning{
         int offset_agent = 12;
         int offset_obs = 6;
         int row_idx = 0;
+        size_t qn = 0, on = 0;
+        std::vector<float> frames;
         while (file.good()) {
             std::vector<std::string> row = csv_read_row(file, ',');
 
@@ -69,52 +122,81 @@ namespace DynamicPlanning{
                 break;
             } else if (row_idx == 0) {
                 // get qn, on
-                mission.qn = 0;
-                mission.on = 0;
-
                 for (size_t i = 0; i < row.size() - 2; i++) {
                     if (row[i] == "id") {
-                        mission.qn++;
+                        qn++;
                     } else if (row[i] == "obs_id") {
-                        mission.on++;
+                        on++;
                     }
                 }
-                initializeReplay();
             } else {
-                for (int qi = 0; qi < mission.qn; qi++) {
-                    State state;
-                    state.position = point3d(std::stod(row[offset_agent * qi + 2]),
-                                             std::stod(row[offset_agent * qi + 3]),
-                                             std::stod(row[offset_agent * qi + 4]));
-                    state.velocity = point3d(std::stod(row[offset_agent * qi + 5]),
-                                             std::stod(row[offset_agent * qi + 6]),
-                                             std::stod(row[offset_agent * qi + 7]));
-                    state.acceleration = point3d(std::stod(row[offset_agent * qi + 8]),
-                                                 std::stod(row[offset_agent * qi + 9]),
-                                                 std::stod(row[offset_agent * qi + 10]));
-                    agent_state_history[qi].emplace_back(state);
-                    mission.agents[qi].radius = 0.15;
+                frames.emplace_back(std::stof(row[1]));
+                for (size_t qi = 0; qi < qn; qi++) {
+                    for (int field = 0; field < TrajectoryLog::AGENT_STRIDE; field++) {
+                        frames.emplace_back(std::stof(row[offset_agent * qi + 2 + field]));
+                    }
                 }
-                for (int oi = 0; oi < mission.on; oi++) {
-                    State state;
-                    state.position.x() = std::stod(row[offset_agent * mission.qn + offset_obs * oi + 2]);
-                    state.position.y() = std::stod(row[offset_agent * mission.qn + offset_obs * oi + 3]);
-                    state.position.z() = std::stod(row[offset_agent * mission.qn + offset_obs * oi + 4]);
-                    obstacle_state_history[oi].emplace_back(state);
-                    mission.obstacles[oi]->setRadius(std::stod(row[offset_agent * mission.qn + offset_obs * oi + 5]));
+                for (size_t oi = 0; oi < on; oi++) {
+                    for (int field = 0; field < TrajectoryLog::OBSTACLE_STRIDE; field++) {
+                        frames.emplace_back(std::stof(row[offset_agent * qn + offset_obs * oi + 2 + field]));
+                    }
                 }
-                makeSpan = std::stod(row[1]);
             }
             row_idx++;
         }
+
+        trajectory_log.assign(qn, on, timeStep, std::move(frames));
+        loadTrajectoryLog();
+    }
+
+    void MultiSyncReplayer::readBinaryFile(const std::string &file_name) {
+        trajectory_log.open(param.package_path + "/log/" + file_name);
+        loadTrajectoryLog();
+    }
+
+    void MultiSyncReplayer::loadTrajectoryLog() {
+        mission.qn = trajectory_log.getNumAgents();
+        mission.on = trajectory_log.getNumObstacles();
+        timeStep = trajectory_log.getTimeStep();
+        initializeReplay();
+        if (trajectory_log.empty()) {
+            return;
+        }
+
+        for (size_t qi = 0; qi < mission.qn; qi++) {
+            mission.agents[qi].radius = 0.15;
+        }
+        size_t last_frame = trajectory_log.size() - 1;
+        for (size_t oi = 0; oi < mission.on; oi++) {
+            mission.obstacles[oi]->setRadius(trajectory_log.getObstacle(last_frame, oi)[TrajectoryLog::OBSTACLE_RADIUS]);
+        }
+        makeSpan = trajectory_log.getTime(last_frame);
+    }
+
+    State MultiSyncReplayer::getAgentState(size_t frame_idx, size_t qi) const {
+        const float *agent = trajectory_log.getAgent(frame_idx, qi);
+        State state;
+        state.position = point3d(agent[TrajectoryLog::AGENT_PX], agent[TrajectoryLog::AGENT_PY],
+                                 agent[TrajectoryLog::AGENT_PZ]);
+        state.velocity = point3d(agent[TrajectoryLog::AGENT_VX], agent[TrajectoryLog::AGENT_VY],
+                                 agent[TrajectoryLog::AGENT_VZ]);
+        state.acceleration = point3d(agent[TrajectoryLog::AGENT_AX], agent[TrajectoryLog::AGENT_AY],
+                                     agent[TrajectoryLog::AGENT_AZ]);
+        return state;
+    }
+
+    point3d MultiSyncReplayer::getObstaclePosition(size_t frame_idx, size_t oi) const {
+        const float *obstacle = trajectory_log.getObstacle(frame_idx, oi);
+        return {obstacle[TrajectoryLog::OBSTACLE_PX], obstacle[TrajectoryLog::OBSTACLE_PY],
+                obstacle[TrajectoryLog::OBSTACLE_PZ]};
     }
 
     void MultiSyncReplayer::setOctomap(std::string file_name) {
         octomap::OcTree octree(file_name);
         auto* octree_ptr = &octree;
-        distmap_obj = std::make_shared<DynamicEDTOctomap>(param.world_max_dist, octree_ptr,
-                                                          mission.world_min, mission.world_max,
-                                                          false);
+        distmap_obj = std::make_shared<BatchDistmap>(param.world_max_dist, octree_ptr,
+                                                     mission.world_min, mission.world_max,
+                                                     false);
         distmap_obj->update();
     }
 
@@ -122,15 +204,28 @@ namespace DynamicPlanning{
         if(param.multisim_replay_time_limit > 0 and t > param.multisim_replay_time_limit){
             return;
         }
+        if (trajectory_log.empty()) {
+            return;
+        }
+
+        // O(1) by the time index of the log, so a seek costs the same as the next step
+        size_t frame_idx = trajectory_log.findFrame(t);
+        double alpha = 0;
+        if (frame_idx + 1 < trajectory_log.size()) {
+            double t_frame = trajectory_log.getTime(frame_idx);
+            double dt = trajectory_log.getTime(frame_idx + 1) - t_frame;
+            alpha = dt > 0 ? std::min(std::max((t - t_frame) / dt, 0.0), 1.0) : 0;
+        }
 
         obstacle_generator.update(t, 0);
-        publish_agent_trajectories(t);
-        publish_obstacle_trajectories(t);
+        publish_agent_trajectories(frame_idx, alpha);
+        publish_obstacle_trajectories(frame_idx, alpha);
+        n_history_frames = frame_idx + 1;
         publish_collision_model();
         publish_start_goal_points(); //TODO: save goal point and replay it
 //        publish_safety_margin(t);
         publish_collision_alert();
-        publish_agent_vel_acc(t);
+        publish_agent_vel_acc(frame_idx, alpha, t);
         publish_communication_group();
 
         if(has_global_map and t > 0.05){
@@ -138,68 +233,38 @@ namespace DynamicPlanning{
         }
     }
 
-    void MultiSyncReplayer::publish_agent_trajectories(double t){
-        if(t > makeSpan){
-            pub_agent_trajectories.publish(msg_agent_trajectories_replay);
-            return;
+    void MultiSyncReplayer::updateTrajectoryHistory(visualization_msgs::Marker &marker, size_t frame_idx,
+                                                    const std::function<point3d(size_t)> &position,
+                                                    const point3d &head) const {
+        // Only the frames since the previous replay are appended, all but the kept ones after a seek backward
+        size_t n_frames = frame_idx + 1;
+        marker.points.resize(std::min({marker.points.size(), n_history_frames, n_frames}));
+        for (size_t fi = marker.points.size(); fi < n_frames; fi++) {
+            marker.points.emplace_back(point3DToPointMsg(position(fi)));
         }
+        marker.points.emplace_back(point3DToPointMsg(head));
+    }
 
-        for(int qi = 0; qi < mission.qn; qi++) {
-            int idx = static_cast<int>(t / timeStep);
-            double alpha = t/timeStep - idx;
-            geometry_msgs::Point current_point;
-            if(idx < agent_state_history[qi].size() - 1){
-                point3d p1 = agent_state_history[qi][idx].position;
-                point3d p2 = agent_state_history[qi][idx + 1].position;
-                point3d p_new = p1 * (1.0 - alpha) + p2 * alpha;
-                current_point = point3DToPointMsg(p_new);
-            }
-            else{
-                current_point = point3DToPointMsg(agent_state_history[qi].back().position);
+    void MultiSyncReplayer::publish_agent_trajectories(size_t frame_idx, double alpha){
+        for(size_t qi = 0; qi < mission.qn; qi++) {
+            auto position = [this, qi](size_t fi) { return getAgentState(fi, qi).position; };
+            point3d head = position(frame_idx);
+            if(frame_idx + 1 < trajectory_log.size()){
+                head = head * (1.0 - alpha) + position(frame_idx + 1) * alpha;
             }
-
-            msg_agent_trajectories_replay.markers[qi].header.frame_id = param.world_frame_id;
-            msg_agent_trajectories_replay.markers[qi].type = visualization_msgs::Marker::LINE_STRIP;
-            msg_agent_trajectories_replay.markers[qi].action = visualization_msgs::Marker::ADD;
-            msg_agent_trajectories_replay.markers[qi].pose.orientation = defaultQuaternion();
-            msg_agent_trajectories_replay.markers[qi].scale.x = 0.07;
-            msg_agent_trajectories_replay.markers[qi].id = qi;
-
-            msg_agent_trajectories_replay.markers[qi].color = mission.color[qi];
-            msg_agent_trajectories_replay.markers[qi].color.a = 0.75;
-            msg_agent_trajectories_replay.markers[qi].points.emplace_back(current_point);
+            updateTrajectoryHistory(msg_agent_trajectories_replay.markers[qi], frame_idx, position, head);
         }
         pub_agent_trajectories.publish(msg_agent_trajectories_replay);
     }
 
-    void MultiSyncReplayer::publish_obstacle_trajectories(double t) {
-        if(t > makeSpan) {
-            pub_obstacle_trajectories.publish(msg_obstacle_trajectories_replay);
-            return;
-        }
-
+    void MultiSyncReplayer::publish_obstacle_trajectories(size_t frame_idx, double alpha) {
         for(size_t oi = 0; oi < mission.on; oi++){
-            int idx = static_cast<int>(t / timeStep);
-            double alpha = t/timeStep - idx;
-            geometry_msgs::Point current_point;
-            if(idx < obstacle_state_history[oi].size() - 1){
-                point3d p1 = obstacle_state_history[oi][idx].position;
-                point3d p2 = obstacle_state_history[oi][idx + 1].position;
-                point3d p_new = p1 * (1.0 - alpha) + p2 * alpha;
-                current_point = point3DToPointMsg(p_new);
+            auto position = [this, oi](size_t fi) { return getObstaclePosition(fi, oi); };
+            point3d head = position(frame_idx);
+            if(frame_idx + 1 < trajectory_log.size()){
+                head = head * (1.0 - alpha) + position(frame_idx + 1) * alpha;
             }
-
-            msg_obstacle_trajectories_replay.markers[oi].header.frame_id = param.world_frame_id;
-            msg_obstacle_trajectories_replay.markers[oi].type = visualization_msgs::Marker::LINE_STRIP;
-            msg_obstacle_trajectories_replay.markers[oi].action = visualization_msgs::Marker::ADD;
-            msg_obstacle_trajectories_replay.markers[oi].scale.x = 0.07;
-            msg_obstacle_trajectories_replay.markers[oi].id = oi;
-
-            msg_obstacle_trajectories_replay.markers[oi].color.a = 0.75;
-            msg_obstacle_trajectories_replay.markers[oi].color.r = 0;
-            msg_obstacle_trajectories_replay.markers[oi].color.g = 0;
-            msg_obstacle_trajectories_replay.markers[oi].color.b = 0;
-            msg_obstacle_trajectories_replay.markers[oi].points.emplace_back(current_point);
+            updateTrajectoryHistory(msg_obstacle_trajectories_replay.markers[oi], frame_idx, position, head);
         }
         pub_obstacle_trajectories.publish(msg_obstacle_trajectories_replay);
     }
@@ -281,7 +346,7 @@ namespace DynamicPlanning{
             marker.scale.z = goal_size;
 
             marker.type = visualization_msgs::Marker::CUBE;
-            marker.pose.position = point3DToPointMsg(agent_state_history[qi].back().position);
+            marker.pose.position = point3DToPointMsg(getAgentState(trajectory_log.size() - 1, qi).position);
             marker.pose.orientation = defaultQuaternion();
 
             msg_start_goal_points.markers.emplace_back(marker);
@@ -382,7 +447,7 @@ namespace DynamicPlanning{
         pub_world_boundary.publish(msg_world_boundary);
     }
 
-    void MultiSyncReplayer::publish_agent_vel_acc(double t) {
+    void MultiSyncReplayer::publish_agent_vel_acc(size_t frame_idx, double alpha, double t) {
         if(t > makeSpan) {
             return;
         }
@@ -407,14 +472,11 @@ namespace DynamicPlanning{
         msg_agent_acc_limits.data.resize(2);
 
         for(size_t qi = 0; qi < mission.qn; qi++) {
-            int idx = static_cast<int>(t / timeStep);
-            double alpha = t/timeStep - idx;
-            geometry_msgs::Point current_point;
-            if(idx < agent_state_history[qi].size() - 1){
-                point3d current_velocity = agent_state_history[qi][idx].velocity * (1.0 - alpha)
-                                           + agent_state_history[qi][idx + 1].velocity * alpha;
-                point3d current_acceleration = agent_state_history[qi][idx].acceleration * (1.0 - alpha)
-                                               + agent_state_history[qi][idx + 1].acceleration * alpha;
+            if(frame_idx + 1 < trajectory_log.size()){
+                State state1 = getAgentState(frame_idx, qi);
+                State state2 = getAgentState(frame_idx + 1, qi);
+                point3d current_velocity = state1.velocity * (1.0 - alpha) + state2.velocity * alpha;
+                point3d current_acceleration = state1.acceleration * (1.0 - alpha) + state2.acceleration * alpha;
 
                 msg_agent_velocities_x.data[qi] = current_velocity.x();
                 msg_agent_velocities_y.data[qi] = current_velocity.y();
@@ -460,14 +522,19 @@ namespace DynamicPlanning{
         marker.color.a = 0.2;
         marker.scale.x = 0.03;
 
+        PointsSoA positions;
+        positions.reserve(mission.qn);
+        for(size_t qi = 0; qi < mission.qn; qi++) {
+            positions.emplace_back(pointMsgToPoint3d(msg_agent_trajectories_replay.markers[qi].points.back()));
+        }
+        std::vector<double> dists(mission.qn);
         for(size_t qi = 0; qi < mission.qn; qi++) {
-            point3d position_i = pointMsgToPoint3d(msg_agent_trajectories_replay.markers[qi].points.back());
+            point3d position_i = positions[qi];
+            GeometryKernels::lInfinityDistances(position_i, positions, dists.data());
             for(size_t qj = qi + 1; qj < mission.qn; qj++) {
-                point3d position_j = pointMsgToPoint3d(msg_agent_trajectories_replay.markers[qj].points.back());
-                double dist = LInfinityDistance(position_i, position_j);
-                if(dist < param.communication_range){
+                if(dists[qj] < param.communication_range){
                     marker.points.emplace_back(point3DToPointMsg(position_i));
-                    marker.points.emplace_back(point3DToPointMsg(position_j));
+                    marker.points.emplace_back(point3DToPointMsg(positions[qj]));
                 }
             }
         }
@@ -1,37 +1,241 @@
 #include <multi_sync_simulator.hpp>
+#include <capture_archive.hpp>
+#include <geometry_kernels.hpp>
 
 namespace DynamicPlanning {
+    namespace {
+        // The health of the planner in a long run, registered once per process, see MetricsRegistry
+        struct SimulatorMetrics {
+            MetricsRegistry &registry = MetricsRegistry::getInstance();
+            MetricCounter &steps = registry.getCounter("lsc_planning_steps_total", "Simulation steps planned");
+            MetricCounter &replans = registry.getCounter("lsc_replans_total", "Agents replanned");
+            MetricCounter &planning_failures = registry.getCounter("lsc_planning_failures_total",
+                                                                   "Steps stopped by PlanningReport::QPFAILED");
+            MetricCounter &mapf_failures = registry.getCounter("lsc_mapf_failures_total",
+                                                               "Communication groups without a MAPF solution");
+            MetricCounter &mapf_skipped = registry.getCounter("lsc_deadline_mapf_skipped_total",
+                                                              "Communication groups skipped by the MAPF deadline");
+            MetricGauge &replanning_agents = registry.getGauge("lsc_replanning_agents",
+                                                               "Agents replanned at the last step");
+            MetricGauge &result_writer_queue = registry.getGauge("lsc_result_writer_queue_depth",
+                                                                 "Frames waiting for the result writer");
+            MetricGauge &qp_diagnoser_queue = registry.getGauge("lsc_qp_diagnoser_queue_depth",
+                                                                "QP failure reports waiting for the diagnosis");
+            MetricGauge &visualization_queue = registry.getGauge("lsc_visualization_queue_depth",
+                                                                 "Visualization jobs waiting for the worker");
+            MetricHistogram &step_wall = registry.getHistogram("lsc_step_wall_seconds",
+                                                               "Planning of all agents in a step");
+            MetricHistogram &mapf = registry.getHistogram("lsc_mapf_seconds", "MAPF of a communication group");
+            MetricHistogram &obstacle_prediction = registry.getHistogram("lsc_obstacle_prediction_seconds",
+                                                                         "Obstacle prediction of an agent");
+            MetricHistogram &initial_traj_planning = registry.getHistogram("lsc_initial_traj_planning_seconds",
+                                                                           "Initial trajectory of an agent");
+            MetricHistogram &goal_planning = registry.getHistogram("lsc_goal_planning_seconds",
+                                                                   "Goal planning of an agent");
+            MetricHistogram &lsc_generation = registry.getHistogram("lsc_lsc_generation_seconds",
+                                                                    "LSC construction of an agent");
+            MetricHistogram &sfc_generation = registry.getHistogram("lsc_sfc_generation_seconds",
+                                                                    "SFC construction of an agent");
+            MetricHistogram &traj_optimization = registry.getHistogram("lsc_traj_optimization_seconds",
+                                                                       "Trajectory optimization of an agent");
+            MetricHistogram &planning = registry.getHistogram("lsc_planning_seconds", "Planning of an agent");
+        };
+
+        SimulatorMetrics &getMetrics() {
+            static SimulatorMetrics metrics;
+            return metrics;
+        }
+    }
+
     MultiSyncSimulator::MultiSyncSimulator(const ros::NodeHandle &_nh, Param _param, Mission _mission)
-            : nh(_nh), param(_param), mission(_mission), obstacle_generator(_nh, _mission) {
-        pub_agent_trajectories = nh.advertise<visualization_msgs::MarkerArray>("/agent_trajectories_history", 1);
-        pub_obstacle_trajectories = nh.advertise<visualization_msgs::MarkerArray>("/obstacle_trajectories_history", 1);
-        pub_collision_model = nh.advertise<visualization_msgs::MarkerArray>("/collision_model", 1);
-        pub_agent_velocities_x = nh.advertise<std_msgs::Float64MultiArray>("/agent_velocities_x", 1);
-        pub_agent_velocities_y = nh.advertise<std_msgs::Float64MultiArray>("/agent_velocities_y", 1);
-        pub_agent_velocities_z = nh.advertise<std_msgs::Float64MultiArray>("/agent_velocities_z", 1);
-        pub_agent_accelerations_x = nh.advertise<std_msgs::Float64MultiArray>("/agent_accelerations_x", 1);
-        pub_agent_accelerations_y = nh.advertise<std_msgs::Float64MultiArray>("/agent_accelerations_y", 1);
-        pub_agent_accelerations_z = nh.advertise<std_msgs::Float64MultiArray>("/agent_accelerations_z", 1);
-        pub_agent_vel_limits = nh.advertise<std_msgs::Float64MultiArray>("/agent_vel_limits", 1);
-        pub_agent_acc_limits = nh.advertise<std_msgs::Float64MultiArray>("/agent_acc_limits", 1);
-        pub_start_goal_points_vis = nh.advertise<visualization_msgs::MarkerArray>("/start_goal_points", 1);
-        pub_world_boundary = nh.advertise<visualization_msgs::MarkerArray>("/world_boundary", 1);
-        pub_collision_alert = nh.advertise<visualization_msgs::MarkerArray>("/collision_alert", 1);
-        pub_desired_trajs_vis = nh.advertise<visualization_msgs::MarkerArray>("/desired_trajs_vis", 1);
-        pub_grid_map = nh.advertise<visualization_msgs::MarkerArray>("/grid_map", 1);
-        pub_communication_range = nh.advertise<visualization_msgs::MarkerArray>("/communication_range", 1);
-        pub_communication_group = nh.advertise<visualization_msgs::MarkerArray>("/communication_group", 1);
-        sub_global_map = nh.subscribe("/octomap_point_cloud_centers", 1, &MultiSyncSimulator::globalMapCallback, this);
-        service_start_planning = nh.advertiseService("/start_planning", &MultiSyncSimulator::startPlanningCallback,
-                                                     this);
-        service_land = nh.advertiseService("/stop_planning", &MultiSyncSimulator::landCallback, this);
-        service_patrol = nh.advertiseService("/start_patrol", &MultiSyncSimulator::patrolCallback, this);
-        service_stop_patrol = nh.advertiseService("/stop_patrol", &MultiSyncSimulator::stopPatrolCallback, this);
-
-        msg_agent_trajectories.markers.clear();
-        msg_agent_trajectories.markers.resize(mission.qn);
-        msg_obstacle_trajectories.markers.clear();
-        msg_obstacle_trajectories.markers.resize(mission.on);
+            : nh(_nh), param(_param), mission(std::make_shared<const Mission>(std::move(_mission))),
+              obstacle_generator(_nh, mission, _param.multisim_headless) {
+        if (not param.multisim_headless) {
+            pub_agent_trajectories = nh.advertise<visualization_msgs::MarkerArray>(
+                    "/agent_trajectories_history", 1);
+            pub_obstacle_trajectories = nh.advertise<visualization_msgs::MarkerArray>(
+                    "/obstacle_trajectories_history", 1);
+            pub_collision_model = nh.advertise<visualization_msgs::MarkerArray>("/collision_model", 1);
+            pub_agent_velocities_x = nh.advertise<std_msgs::Float64MultiArray>("/agent_velocities_x", 1);
+            pub_agent_velocities_y = nh.advertise<std_msgs::Float64MultiArray>("/agent_velocities_y", 1);
+            pub_agent_velocities_z = nh.advertise<std_msgs::Float64MultiArray>("/agent_velocities_z", 1);
+            pub_agent_accelerations_x = nh.advertise<std_msgs::Float64MultiArray>("/agent_accelerations_x", 1);
+            pub_agent_accelerations_y = nh.advertise<std_msgs::Float64MultiArray>("/agent_accelerations_y", 1);
+            pub_agent_accelerations_z = nh.advertise<std_msgs::Float64MultiArray>("/agent_accelerations_z", 1);
+            pub_agent_vel_limits = nh.advertise<std_msgs::Float64MultiArray>("/agent_vel_limits", 1);
+            pub_agent_acc_limits = nh.advertise<std_msgs::Float64MultiArray>("/agent_acc_limits", 1);
+            pub_start_goal_points_vis = nh.advertise<visualization_msgs::MarkerArray>("/start_goal_points", 1);
+            pub_world_boundary = nh.advertise<visualization_msgs::MarkerArray>("/world_boundary", 1, true);
+            pub_collision_alert = nh.advertise<visualization_msgs::MarkerArray>("/collision_alert", 1);
+            pub_desired_trajs_vis = nh.advertise<visualization_msgs::MarkerArray>("/desired_trajs_vis", 1);
+            pub_grid_map = nh.advertise<visualization_msgs::MarkerArray>("/grid_map", 1);
+            pub_communication_range = nh.advertise<visualization_msgs::MarkerArray>("/communication_range", 1);
+            pub_communication_group = nh.advertise<visualization_msgs::MarkerArray>("/communication_group", 1);
+            sub_global_map = nh.subscribe("/octomap_point_cloud_centers", 1,
+                                          &MultiSyncSimulator::globalMapCallback, this);
+            service_start_planning = nh.advertiseService("/start_planning", &MultiSyncSimulator::startPlanningCallback,
+                                                         this);
+            service_land = nh.advertiseService("/stop_planning", &MultiSyncSimulator::landCallback, this);
+            service_patrol = nh.advertiseService("/start_patrol", &MultiSyncSimulator::patrolCallback, this);
+            service_stop_patrol = nh.advertiseService("/stop_patrol", &MultiSyncSimulator::stopPatrolCallback, this);
+            service_update_param = nh.advertiseService("/update_param", &MultiSyncSimulator::updateParamCallback,
+                                                       this);
+        }
+
+        // Solver threads shared by all agents
+        SolverThreadScheduler::getInstance().setTotalThreads(param.opt_solver_threads);
+        SolverThreadScheduler::getInstance().resetStatistics();
+        SFCLibrary::getInstance().setCapacity(param.world_sfc_library_size);
+        SFCLibrary::getInstance().resetStatistics();
+        // The boxes of a step are shared from the next step, so that the result does not depend on the planning order
+        SFCLibrary::getInstance().setDeferred(true);
+        if (param.multisim_batch_optimization or param.multisim_parallel_planning) {
+            batch_worker_pool = std::make_unique<WorkerPool>(param.multisim_batch_workers);
+        }
+        if (param.multisim_thread_placement != ThreadPlacementMode::NONE) {
+            bool is_pinned = WorkerPool::getInstance().setPlacement(param.multisim_thread_placement);
+            if (batch_worker_pool != nullptr) {
+                is_pinned = batch_worker_pool->setPlacement(param.multisim_thread_placement) and is_pinned;
+            }
+            if (not is_pinned) {
+                ROS_WARN("[MultiSyncSimulator] Fail to pin the workers, they are not pinned");
+            }
+            ROS_INFO_STREAM("[MultiSyncSimulator] workers placed by " << param.getThreadPlacementModeStr() << " on "
+                            << CPUTopology::getInstance().getNumCPUs() << " CPUs of "
+                            << CPUTopology::getInstance().getNumNodes() << " NUMA nodes");
+        }
+        if (param.multisim_metrics_rate > 0) {
+            metrics_publisher = std::make_unique<MetricsPublisher>(nh, param.multisim_metrics_rate,
+                                                                   param.multisim_metrics_file);
+        }
+
+        initializeMission();
+
+        // Distributed simulation, every process simulates all agents and plans its own ones
+        if (param.multisim_num_processes > 1) {
+            size_t n_local_agents = 0;
+            for (size_t qi = 0; qi < mission->qn; qi++) {
+                bool is_local = param.isAgentInProcess(qi);
+                agents[qi]->setRemote(not is_local);
+                n_local_agents += is_local ? 1 : 0;
+            }
+            size_t n_max_local_agents = (mission->qn + param.multisim_num_processes - 1) / param.multisim_num_processes;
+            agent_exchange = AgentExchange::create(param.multisim_exchange_mode, param.multisim_exchange_address,
+                                                   param.multisim_num_processes, param.multisim_process_index,
+                                                   AgentExchangeBlock::getCapacity(n_max_local_agents, param.M,
+                                                                                   param.n));
+            if (agent_exchange == nullptr) {
+                ROS_ERROR_STREAM("[MultiSyncSimulator] Fail to set up the " << param.getExchangeModeStr()
+                                 << " exchange at " << param.multisim_exchange_address);
+            } else {
+                ROS_INFO_STREAM("[MultiSyncSimulator] process " << param.multisim_process_index << "/"
+                                << param.multisim_num_processes << " plans " << n_local_agents << " agents");
+            }
+        }
+
+    }
+
+    bool MultiSyncSimulator::resetMission(Mission new_mission) {
+        // The maps known before the mission and the structures of the agents must be the same
+        std::string reason;
+        if (new_mission.current_world_file_name != mission->current_world_file_name or
+            new_mission.world_min != mission->world_min or new_mission.world_max != mission->world_max) {
+            reason = "the world is changed";
+        } else if (new_mission.qn != mission->qn) {
+            reason = "the number of agents is changed";
+        } else if (not param.world_use_octomap or not param.world_use_global_map) {
+            reason = "the maps of the agents are sensed during the mission";
+        } else if (param.multisim_num_processes > 1) {
+            reason = "the agents are exchanged with the other processes";
+        } else {
+            for (const auto *obstacles: {&mission->obstacles, &new_mission.obstacles}) {
+                for (const auto &obstacle: *obstacles) {
+                    if (obstacle->getType() == "real") {
+                        reason = "the real obstacles are tracked by the ingestion thread";
+                    }
+                }
+            }
+        }
+        if (not reason.empty()) {
+            ROS_INFO_STREAM("[MultiSyncSimulator] The simulator is not reset, " << reason);
+            return false;
+        }
+
+        mission = std::make_shared<const Mission>(std::move(new_mission));
+        obstacle_generator.resetMission(mission);
+
+        // The state of the previous mission, the members sized by the mission are built again at the first step
+        planning_time = PlanningTimeStatistics();
+        alloc_statistics = AllocStatistics();
+        n_mapf_skipped = 0;
+        vel_excess_ratio = point3d(0, 0, 0);
+        acc_excess_ratio = point3d(0, 0, 0);
+        groups.clear();
+        replanning_agents.clear();
+        last_sampled_positions.clear();
+        trajectory_encoders.clear();
+        trajectory_decoders.clear();
+        network.reset();
+        sent_agents.clear();
+        received_agents.clear();
+        obstacle_snapshot.clear();
+        obstacle_prediction_table.reset();
+        SolverThreadScheduler::getInstance().resetStatistics();
+        SFCLibrary::getInstance().resetStatistics(); // the boxes are in the same world, so they are kept
+
+        initializeMission();
+        return true;
+    }
+
+    void MultiSyncSimulator::initializeMission() {
+        if (not param.multisim_headless) {
+            VisualizationWorker::getInstance().setMaxRate(param.multisim_visualization_rate);
+            agent_trajectory_history = std::make_shared<TrajectoryHistoryMarkers>(param.multisim_history_downsample);
+            for (size_t qi = 0; qi < mission->qn; qi++) {
+                visualization_msgs::Marker style;
+                style.header.frame_id = param.world_frame_id;
+                style.ns = std::to_string(qi);
+                style.scale.x = 0.07;
+                style.pose.position = defaultPoint();
+                style.pose.orientation = defaultQuaternion();
+                style.color = mission->color[qi];
+                style.color.a = 0.75;
+                agent_trajectory_history->addTrack(style);
+            }
+
+            obstacle_trajectory_history = std::make_shared<TrajectoryHistoryMarkers>(
+                    param.multisim_history_downsample);
+            for (size_t oi = 0; oi < mission->on; oi++) {
+                visualization_msgs::Marker style;
+                style.header.frame_id = param.world_frame_id;
+                style.ns = "obstacle_" + std::to_string(oi);
+                style.scale.x = 0.05;
+                style.pose.position = defaultPoint();
+                style.pose.orientation = defaultQuaternion();
+                style.color.r = 0;
+                style.color.g = 0;
+                style.color.b = 0;
+                style.color.a = 1;
+                obstacle_trajectory_history->addTrack(style);
+            }
+            publishStaticMarkers();
+        }
+
+        // The real obstacles are tracked by the ingestion thread, the frames are ordered by the ingestion index
+        std::vector<std::string> real_obstacle_frame_ids;
+        std::vector<double> real_obstacle_radii;
+        for (size_t oi = 0; oi < mission->on; oi++) {
+            if (mission->obstacles[oi]->getType() == "real") {
+                auto real_obstacle_ptr = std::static_pointer_cast<RealObstacle>(mission->obstacles[oi]);
+                real_obstacle_frame_ids.emplace_back(real_obstacle_ptr->getFrameId());
+                real_obstacle_radii.emplace_back(real_obstacle_ptr->getRadius());
+            }
+        }
+        if (not real_obstacle_frame_ids.empty()) {
+            ObstacleIngestion::getInstance().start(param.world_frame_id, real_obstacle_frame_ids, real_obstacle_radii,
+                                                   param.filter_ingestion_rate, param.filter_sigma_y_sq,
+                                                   param.filter_sigma_a_sq);
+        }
 
         sim_start_time = ros::Time::now();
         sim_current_time = sim_start_time;
@@ -41,15 +245,19 @@ namespace DynamicPlanning {
         has_global_map = false;
         initial_update = true;
         mission_changed = true;
+        param_update_requested = false;
+        is_finished = false;
         safety_ratio_agent = SP_INFINITY;
         safety_ratio_obs = SP_INFINITY;
         total_flight_time = SP_INFINITY;
         total_distance = 0;
+        real_time_factor = 0;
 
         mission_start_time = std::to_string(sim_start_time.toSec());
-        file_name_param = param.getPlannerModeStr() + "_" + std::to_string(mission.qn) + "agents";
+        file_name_param = param.getPlannerModeStr() + "_" + std::to_string(mission->qn) + "agents";
         if (param.multisim_save_mission) {
-            mission.saveMission(param.package_path + "/missions/previous_missions/mission_" + mission_start_time + ".json");
+            mission->saveMission(param.package_path + "/missions/previous_missions/mission_" + mission_start_time +
+                                 ".json");
         }
 
         // Planner state initialization
@@ -59,13 +267,21 @@ namespace DynamicPlanning {
         } else {
             planner_state = PlannerState::GOTO;
         }
-
-        // Agent
-        agents.resize(mission.qn);
-        for (size_t qi = 0; qi < mission.qn; qi++) {
-            agents[qi] = std::make_unique<AgentManager>(nh, param, mission, qi);
+        finish_check_state = planner_state;
+        finish_check_idx = 0;
+
+        // Agent, the startup time grows with the topics advertised by the agents, see multisim/lazy_publishers
+        Timer startup_timer;
+        bool is_reset = not agents.empty();
+        agents.resize(mission->qn);
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            if (is_reset) {
+                agents[qi]->resetMission(mission);
+            } else {
+                agents[qi] = std::make_unique<AgentManager>(nh, param, mission, qi);
+            }
             State initial_state;
-            initial_state.position = mission.agents[qi].start_point;
+            initial_state.position = mission->agents[qi].start_point;
             agents[qi]->setCurrentState(initial_state);
 
             if(param.world_use_octomap and param.world_use_global_map){
@@ -73,59 +289,418 @@ namespace DynamicPlanning {
                 has_global_map = true;
             }
         }
+        startup_timer.stop();
+        ROS_INFO_STREAM("[MultiSyncSimulator] " << mission->qn << " agents " << (is_reset ? "reset" : "initialized")
+                        << " in " << startup_timer.elapsedSeconds() << " s");
+
+        // Capture of the planning problems for planning_replay
+        if (param.multisim_capture) {
+            capture = std::make_unique<PlanningCaptureWriter>();
+            std::string capture_file_name = not param.multisim_capture_file.empty()
+                                            ? param.multisim_capture_file
+                                            : param.package_path + "/log/capture_" + file_name_param + "_" +
+                                              mission_start_time + ".bin";
+            if (capture->open(capture_file_name, *mission, param)) {
+                for (const auto &agent: agents) {
+                    agent->setCapture(capture.get());
+                }
+            } else {
+                ROS_ERROR_STREAM("[MultiSyncSimulator] Fail to create the capture: " << capture_file_name);
+                capture.reset();
+            }
+        }
 
         // Grid based planner
-        grid_based_planner = std::make_unique<GridBasedPlanner>(param, mission);
+        if (grid_based_planner == nullptr) {
+            grid_based_planner = std::make_unique<GridBasedPlanner>(param, mission);
+        } else {
+            grid_based_planner->resetMission(mission);
+        }
+
+        // Pacing for the visualization
+        if (param.multisim_planning_rate > 0 and not param.multisim_fast_forward and not param.multisim_headless) {
+            planning_rate = std::make_unique<ros::Rate>(param.multisim_planning_rate);
+        }
+
+        // Replanning events
+        std::vector<int> replanning_periods(mission->qn);
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            replanning_periods[qi] = mission->agents[qi].replanning_period;
+        }
+        replan_scheduler.reset(replanning_periods);
+        progress_monitor.reset(mission->qn, param.deadlock_progress_window);
+        sim_step = 0;
+        n_iterations = 0;
+        n_replanned = 0;
+        n_held = 0;
+        n_hovered = 0;
+        n_mapf_reused = 0;
+        syncAgents();
     }
 
     void MultiSyncSimulator::run() {
-        // Main Loop
-        for (int iter = 0; iter < param.multisim_max_planner_iteration and ros::ok(); iter++) {
-            ros::spinOnce();
+        Tracer &tracer = Tracer::getInstance();
+        if (param.multisim_trace) {
+            if (not Tracer::isCompiled()) {
+                ROS_WARN("[MultiSyncSimulator] Tracing is not compiled, build with -DENABLE_TRACE=ON");
+            }
+            tracer.enable(TRACE_CAPACITY_PER_THREAD);
+        }
+
+        if (param.multisim_num_processes > 1 and agent_exchange == nullptr) {
+            ROS_ERROR("[MultiSyncSimulator] The other processes are not connected");
+            return;
+        }
+
+        if (not restoreCheckpointFile()) {
+            return;
+        }
+
+        // Main Loop, a restored mission continues the iterations of the checkpoint
+        for (int iter = n_iterations; iter < param.multisim_max_planner_iteration and ros::ok(); iter++) {
+            if (not param.multisim_headless) {
+                ros::spinOnce();
+            }
+
+            // The callback only requests the update, so the parameters are never changed during a step
+            if (param_update_requested) {
+                param_update_requested = false;
+                Param new_param;
+                if (new_param.initialize(nh) and new_param.validateMultisim()) {
+                    updateParam(new_param);
+                } else {
+                    ROS_ERROR("[MultiSyncSimulator] Invalid parameter, keep the current parameters");
+                }
+            }
 
             // Wait until map is loaded and start signal is arrived
             if (not isPlannerReady()) {
+                if (param.multisim_headless) {
+                    // There is no callback to change the state
+                    ROS_ERROR("[MultiSyncSimulator] Headless simulator is not ready");
+                    break;
+                }
                 ros::Rate(10).sleep();
                 iter--;
                 continue;
             }
 
-            // Check mission finished
-            if (isFinished() or iter == param.multisim_max_planner_iteration - 1) {
-                // Save result in csv file
-                summarizeResult();
-
-                // Planning finished
+            if (not runIteration(iter == param.multisim_max_planner_iteration - 1)) {
                 break;
             }
 
-            if (initial_update) {
-                initializeSimTime();
-                initial_update = false;
+            if (param.multisim_headless) {
+                continue;
+            }
+
+            // Publish planning result, the trajectory history is accumulated at every step
+            if ((sim_step - 1) % param.multisim_publish_period == 0) {
+                publish();
+            }
+
+            // (For simulation) Slow down iteration speed for visualization, the rate includes the planning time
+            if (planning_rate != nullptr) {
+                planning_rate->sleep();
+            }
+        }
+
+        if (capture != nullptr) {
+            capture->close();
+            ROS_INFO_STREAM("[MultiSyncSimulator] Capture saved: " << capture->getNumRecords() << " records");
+        }
+
+        if (param.multisim_trace and Tracer::isCompiled()) {
+            tracer.disable();
+            std::string trace_file_name = param.package_path + "/log/trace_" + file_name_param + "_" +
+                                          mission_start_time + ".json";
+            if (tracer.save(trace_file_name)) {
+                ROS_INFO_STREAM("[MultiSyncSimulator] Trace saved: " << trace_file_name);
             } else {
+                ROS_ERROR_STREAM("[MultiSyncSimulator] Fail to save the trace: " << trace_file_name);
+            }
+        }
+    }
+
+    bool MultiSyncSimulator::runIteration(bool is_last_iteration) {
+        // Check mission finished
+        is_finished = isFinished();
+        if (is_finished or is_last_iteration) {
+            // Save result in csv file
+            summarizeResult();
+
+            // Planning finished
+            return false;
+        }
+
+        bool is_initial_step = initial_update;
+        if (initial_update) {
+            initializeSimTime();
+            initial_update = false;
+        }
+        if (param.multisim_pipelined_step) {
+            runStepGraph(not is_initial_step);
+        } else {
+            if (not is_initial_step) {
                 doStep();
             }
+            updateCommunicationGrid();
+
+            // Dynamic obstacle states and predictions at this step, shared by the MAPF and the agents
+            predictObstacles();
 
             // Waypoint planning
             decentralizedMAPP();
+        }
 
-            // Update and broadcast agent and obstacle state
-            broadcastMsgs();
+        // Update and broadcast agent and obstacle state
+        broadcastMsgs();
 
-            // Trajectory planning
-            bool success = plan();
-            if (not success) {
-                break;
+        // Trajectory planning
+        if (not plan()) {
+            return false;
+        }
+
+        if (sim_step == param.multisim_checkpoint_step) {
+            saveCheckpointFile();
+        }
+        return true;
+    }
+
+    bool MultiSyncSimulator::step() {
+        if (not param.multisim_headless) {
+            ROS_ERROR("[MultiSyncSimulator] Only the headless simulator is stepped from outside");
+            return false;
+        }
+        if (is_finished or n_iterations >= param.multisim_max_planner_iteration) {
+            return false;
+        }
+        if (not isPlannerReady()) {
+            ROS_ERROR("[MultiSyncSimulator] Headless simulator is not ready");
+            return false;
+        }
+        if (n_iterations == 0 and initial_update and not restoreCheckpointFile()) {
+            return false;
+        }
+
+        bool is_running = runIteration(n_iterations == param.multisim_max_planner_iteration - 1);
+        n_iterations = is_running ? n_iterations + 1 : param.multisim_max_planner_iteration;
+        return is_running;
+    }
+
+    std::string MultiSyncSimulator::getCheckpointUnsupportedReason() const {
+        if (not param.world_use_octomap or not param.world_use_global_map) {
+            return "the maps are sensed, only the static global map is referred to by the checkpoint";
+        }
+        if (param.multisim_num_processes > 1) {
+            return "the agents are planned by several processes";
+        }
+        if (param.isNetworkSimulated()) {
+            return "the messages in the simulated links are not saved";
+        }
+        for (size_t oi = 0; oi < mission->on; oi++) {
+            const std::string type = mission->obstacles[oi]->getType();
+            if (type == "real" or type == "chasing") {
+                return "the " + type + " obstacles are driven by the outside of the mission";
             }
+        }
+        return "";
+    }
+
+    bool MultiSyncSimulator::saveCheckpoint(SimulationCheckpoint &checkpoint) const {
+        std::string reason = getCheckpointUnsupportedReason();
+        if (not reason.empty()) {
+            ROS_ERROR_STREAM("[MultiSyncSimulator] The mission can not be checkpointed, " << reason);
+            return false;
+        }
+        if (initial_update) {
+            ROS_ERROR("[MultiSyncSimulator] The mission is checkpointed after the first step");
+            return false;
+        }
 
-            // Publish planning result
-            publish();
+        checkpoint.mission_file_name = CaptureArchive::getPackageRelativePath(param.package_path,
+                                                                             mission->current_mission_file_name);
+        checkpoint.world_file_name = CaptureArchive::getPackageRelativePath(param.package_path,
+                                                                           mission->current_world_file_name);
+        checkpoint.n_agents = static_cast<uint32_t>(mission->qn);
+        checkpoint.M = param.M;
+        checkpoint.n = param.n;
+        checkpoint.dt = param.dt;
+
+        checkpoint.sim_step = sim_step;
+        checkpoint.sim_time = (sim_current_time - sim_start_time).toSec();
+        checkpoint.planner_state = planner_state;
+        checkpoint.finish_check_state = finish_check_state;
+        checkpoint.finish_check_idx = finish_check_idx;
+        checkpoint.is_collided = is_collided;
+        checkpoint.safety_ratio_agent = safety_ratio_agent;
+        checkpoint.safety_ratio_obs = safety_ratio_obs;
+        checkpoint.total_distance = total_distance;
+        checkpoint.vel_excess_ratio = vel_excess_ratio;
+        checkpoint.acc_excess_ratio = acc_excess_ratio;
+        checkpoint.last_sampled_positions = last_sampled_positions;
+        checkpoint.n_replanned = n_replanned;
+        checkpoint.n_held = n_held;
+        checkpoint.n_hovered = n_hovered;
+        checkpoint.observer_noise_stream = obstacle_generator.getObserverNoiseStream();
+
+        checkpoint.agents.resize(mission->qn);
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            agents[qi]->saveCheckpoint(checkpoint.agents[qi]);
+        }
+        return true;
+    }
 
-            // (For simulation) Slow down iteration speed for visualization
-            if (param.multisim_planning_rate > 0) {
-                ros::Rate(param.multisim_planning_rate).sleep();
+    bool MultiSyncSimulator::restoreCheckpoint(const SimulationCheckpoint &checkpoint) {
+        std::string reason = getCheckpointUnsupportedReason();
+        if (not reason.empty()) {
+            ROS_ERROR_STREAM("[MultiSyncSimulator] The mission can not be restored, " << reason);
+            return false;
+        }
+        if (checkpoint.n_agents != mission->qn or checkpoint.agents.size() != mission->qn or
+            checkpoint.mission_file_name != CaptureArchive::getPackageRelativePath(
+                    param.package_path, mission->current_mission_file_name) or
+            checkpoint.world_file_name != CaptureArchive::getPackageRelativePath(
+                    param.package_path, mission->current_world_file_name)) {
+            ROS_ERROR_STREAM("[MultiSyncSimulator] The checkpoint is of another mission: "
+                             << checkpoint.mission_file_name << " in " << checkpoint.world_file_name);
+            return false;
+        }
+        if (checkpoint.M != param.M or checkpoint.n != param.n or checkpoint.dt != param.dt) {
+            ROS_ERROR("[MultiSyncSimulator] The trajectories of the checkpoint have another structure");
+            return false;
+        }
+
+        // The simulation time continues from the checkpoint, the wall time and the statistics start again
+        sim_start_time = ros::Time::now();
+        sim_current_time = sim_start_time + ros::Duration(checkpoint.sim_time);
+        wall_timer.reset();
+        initial_update = false;
+        mission_changed = false;
+        is_finished = false;
+
+        sim_step = checkpoint.sim_step;
+        n_iterations = checkpoint.sim_step;
+        planner_state = checkpoint.planner_state;
+        finish_check_state = checkpoint.finish_check_state;
+        finish_check_idx = checkpoint.finish_check_idx;
+        is_collided = checkpoint.is_collided;
+        safety_ratio_agent = checkpoint.safety_ratio_agent;
+        safety_ratio_obs = checkpoint.safety_ratio_obs;
+        total_distance = checkpoint.total_distance;
+        vel_excess_ratio = checkpoint.vel_excess_ratio;
+        acc_excess_ratio = checkpoint.acc_excess_ratio;
+        last_sampled_positions = checkpoint.last_sampled_positions;
+        n_replanned = checkpoint.n_replanned;
+        n_held = checkpoint.n_held;
+        n_hovered = checkpoint.n_hovered;
+        obstacle_generator.setObserverNoiseStream(checkpoint.observer_noise_stream);
+        obstacle_generator.update(checkpoint.sim_time, 0.0);
+
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            const AgentManager::Checkpoint &agent_checkpoint = checkpoint.agents[qi];
+            agents[qi]->restoreCheckpoint(agent_checkpoint);
+            agents[qi]->setCurrentState(agent_checkpoint.agent.current_state);
+        }
+
+        std::vector<int> replanning_periods(mission->qn);
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            replanning_periods[qi] = mission->agents[qi].replanning_period;
+        }
+        replan_scheduler.reset(replanning_periods, sim_step);
+        progress_monitor.reset(mission->qn, param.deadlock_progress_window);
+
+        // Rebuilt by the next step
+        planning_time = PlanningTimeStatistics();
+        groups.clear();
+        replanning_agents.clear();
+        trajectory_encoders.clear();
+        trajectory_decoders.clear();
+        sent_agents.clear();
+        received_agents.clear();
+        obstacle_snapshot.clear();
+        obstacle_prediction_table.reset();
+        syncAgents();
+
+        ROS_INFO_STREAM("[MultiSyncSimulator] Restored the checkpoint at step " << sim_step);
+        return true;
+    }
+
+    bool MultiSyncSimulator::restoreCheckpointFile() {
+        if (param.multisim_restore_file.empty()) {
+            return true;
+        }
+
+        std::string file_name = param.multisim_restore_file;
+        if (file_name.front() != '/') {
+            file_name = param.package_path + "/" + file_name;
+        }
+        SimulationCheckpoint checkpoint;
+        if (not checkpoint.load(file_name)) {
+            ROS_ERROR_STREAM("[MultiSyncSimulator] Fail to read the checkpoint: " << file_name);
+            return false;
+        }
+        return restoreCheckpoint(checkpoint);
+    }
+
+    void MultiSyncSimulator::saveCheckpointFile() {
+        SimulationCheckpoint checkpoint;
+        if (not saveCheckpoint(checkpoint)) {
+            return;
+        }
+
+        std::string file_name = param.package_path + "/log/checkpoint_" + file_name_param + "_" +
+                                mission_start_time + "_step" + std::to_string(sim_step) + ".bin";
+        if (checkpoint.save(file_name)) {
+            ROS_INFO_STREAM("[MultiSyncSimulator] Checkpoint saved: " << file_name);
+        } else {
+            ROS_ERROR_STREAM("[MultiSyncSimulator] Fail to save the checkpoint: " << file_name);
+        }
+    }
+
+    void MultiSyncSimulator::syncAgents() {
+        // The buffers of the Python bindings are exported only for the headless simulator
+        agents.syncStates();
+        agents.syncPlans(param.M, param.n, param.multisim_headless);
+    }
+
+    bool MultiSyncSimulator::updateParam(const Param &new_param) {
+        if (param.isRestartRequired(new_param)) {
+            ROS_ERROR("[MultiSyncSimulator] The world, the agents or the threads are changed, restart the simulator");
+            return false;
+        }
+
+        // The agents get the same parameters, so they accept or reject them together
+        Param checked_param = new_param;
+        try {
+            TrajPlanner::validatePlannerMode(checked_param);
+            if (checked_param.phi > checked_param.n) {
+                throw std::invalid_argument("phi must not be larger than n");
             }
+        } catch (const std::invalid_argument &e) {
+            ROS_ERROR_STREAM("[MultiSyncSimulator] Invalid parameter, keep the current parameters: " << e.what());
+            return false;
         }
+
+        bool is_structure_changed = param.isTrajectoryStructureChanged(new_param);
+        for (const auto &agent: agents) {
+            agent->updateParam(new_param);
+        }
+        grid_based_planner->updateParam(new_param);
+        if (capture != nullptr) {
+            capture->writeParam(new_param);
+        }
+        VisualizationWorker::getInstance().setMaxRate(new_param.multisim_visualization_rate);
+        if (new_param.deadlock_progress_window != param.deadlock_progress_window) {
+            progress_monitor.reset(mission->qn, new_param.deadlock_progress_window);
+        }
+        param = new_param;
+        ROS_INFO_STREAM("[MultiSyncSimulator] Parameters updated"
+                        << (is_structure_changed ? ", the planners start again from the current states" : ""));
+        return true;
+    }
+
+    bool MultiSyncSimulator::isMissionSucceeded() const {
+        return is_finished and safety_ratio_agent >= 1 and safety_ratio_obs >= 1;
     }
 
     bool MultiSyncSimulator::isPlannerReady() {
@@ -147,75 +722,178 @@ namespace DynamicPlanning {
         // To match the simulation time and real world time, add one time step to simulation time.
         sim_start_time = ros::Time::now() + ros::Duration(param.multisim_time_step);
         sim_current_time = sim_start_time;
+        wall_timer.reset();
     }
 
     void MultiSyncSimulator::doStep() {
+        TRACE_SCOPE("MultiSyncSimulator::doStep");
         sim_current_time += ros::Duration(param.multisim_time_step);
 
-        for (const auto &agent: agents) {
-            agent->doStep(param.multisim_time_step);
+        if (param.world_use_global_map or agents.size() < 2) {
+            for (const auto &agent: agents) {
+                agent->doStep(param.multisim_time_step);
+            }
+            return;
         }
-    }
 
-    void MultiSyncSimulator::decentralizedMAPP() {
-        if(param.goal_mode == GoalMode::GRIDBASEDPLANNER) {
-            // Ad-hoc network configuration
-            groups.clear();
-            std::set<size_t> initial_group = {0};
-            groups.emplace_back(initial_group);
-
-            for (size_t qi = 1; qi < mission.qn; qi++) {
-                int group_cand_idx = -1;
-                int gi = 0;
-                while (gi < groups.size()) {
-                    for (const auto &qj: groups[gi]) {
-                        double dist = LInfinityDistance(agents[qi]->getCurrentPosition(),
-                                                        agents[qj]->getCurrentPosition());
-                        if (param.communication_range < 0 or dist < param.communication_range) {
-                            if (group_cand_idx == -1) {
-                                groups[gi].insert(qi);
-                                group_cand_idx = gi;
-                            } else {
-                                groups[group_cand_idx].merge(groups[gi]);
-                                groups.erase(groups.begin() + gi);
-                                gi--;
-                            }
-                            break;
-                        }
+        // Pipeline the local map updates, the distmap of an agent is updated while the next agent inserts its sensor
+        // input. The agents have their own maps, so the stages of different agents do not share data.
+        WorkerPool &pool = batch_worker_pool != nullptr ? *batch_worker_pool : WorkerPool::getInstance();
+        std::atomic<size_t> n_sensed{0};
+        pool.run(2, [&](size_t stage) {
+            for (size_t qi = 0; qi < agents.size(); qi++) {
+                if (stage == 0) {
+                    agents[qi]->moveAndSense(param.multisim_time_step);
+                    n_sensed.store(qi + 1, std::memory_order_release);
+                } else {
+                    while (n_sensed.load(std::memory_order_acquire) <= qi) {
+                        std::this_thread::yield();
                     }
-                    gi++;
+                    agents[qi]->updateLocalMap();
                 }
+            }
+        });
+    }
 
-                if (group_cand_idx == -1) {
-                    std::set<size_t> new_group = {qi};
-                    groups.emplace_back(new_group);
+    void MultiSyncSimulator::runStepGraph(bool move_agents) {
+        TRACE_SCOPE("MultiSyncSimulator::runStepGraph");
+        // The sensor inputs are inserted in the order of the agents as in doStep, and the local map of an agent is
+        // updated as soon as its input is inserted. The obstacle prediction does not depend on the agents, and the
+        // MAPF needs the positions of all agents but only the map of the agent 0, so it overlaps the map updates of
+        // the others. Each task writes its own data, so the step has the same result as the sequential order.
+        // A task is queued as soon as its dependencies are finished.
+        TaskGraph graph;
+        int prediction_task = graph.addTask("MultiSyncSimulator::predictObstacles", [this] { predictObstacles(); });
+
+        std::vector<int> map_tasks, grid_dependencies;
+        if (move_agents) {
+            sim_current_time += ros::Duration(param.multisim_time_step);
+            int sense_task = -1;
+            for (size_t qi = 0; qi < agents.size(); qi++) {
+                std::vector<int> sense_dependencies;
+                if (sense_task >= 0) {
+                    sense_dependencies.emplace_back(sense_task);
                 }
+                sense_task = graph.addTask("AgentManager::moveAndSense", [this, qi] {
+                    agents[qi]->moveAndSense(param.multisim_time_step);
+                }, sense_dependencies);
+                map_tasks.emplace_back(graph.addTask("AgentManager::updateLocalMap", [this, qi] {
+                    agents[qi]->updateLocalMap();
+                }, {sense_task}));
+            }
+            if (sense_task >= 0) {
+                grid_dependencies.emplace_back(sense_task);
             }
+        }
+        int grid_task = graph.addTask("MultiSyncSimulator::updateCommunicationGrid",
+                                      [this] { updateCommunicationGrid(); }, grid_dependencies);
+
+        // The MAPF of the groups in parallel needs the whole pool, then it runs after the map updates
+        if (not param.multisim_parallel_mapf) {
+            std::vector<int> mapf_dependencies = {prediction_task, grid_task};
+            if (not map_tasks.empty()) {
+                mapf_dependencies.emplace_back(map_tasks[0]);
+            }
+            graph.addTask("MultiSyncSimulator::decentralizedMAPP", [this] { decentralizedMAPP(); },
+                          mapf_dependencies);
+        }
 
-            // Find next_waypoint using grid based planner
-            for (const auto &group: groups) {
-                ros::Time mapf_start_time = ros::Time::now();
-                std::vector<size_t> group_vector(group.begin(), group.end()); // For index search
+        WorkerPool &pool = batch_worker_pool != nullptr ? *batch_worker_pool : WorkerPool::getInstance();
+        graph.run(pool);
+        if (param.multisim_parallel_mapf) {
+            decentralizedMAPP();
+        }
+    }
 
-                // Initialize grid_based_planner
-                size_t group_size = group.size();
-                points_t start_points, current_points, goal_points;
-                for (size_t qi: group) {
-                    start_points.emplace_back(agents[qi]->getStartPoint());
-                    current_points.emplace_back(agents[qi]->getNextWaypoint());
-                    goal_points.emplace_back(agents[qi]->getDesiredGoalPoint());
+    void MultiSyncSimulator::updateCommunicationGrid() {
+        TRACE_SCOPE("MultiSyncSimulator::updateCommunicationGrid");
+        // The agents have moved, the grouping and the progress read the store from here
+        agents.syncStates();
+        communication_grid.build(agents.getPositions(), param.communication_range);
+    }
+
+    void MultiSyncSimulator::monitorProgress() {
+        static MetricCounter &stalled_groups = MetricsRegistry::getInstance().getCounter(
+                "lsc_stalled_groups_total", "Communication groups stalled over the progress window at a step");
+        std::vector<double> dists_to_goal(mission->qn);
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            dists_to_goal[qi] = agents.getPosition(qi).distance(agents.getDesiredGoalPoint(qi));
+        }
+        progress_monitor.update(dists_to_goal, groups, param.multisim_time_step,
+                                param.deadlock_progress_rate_threshold, param.goal_threshold);
+        stalled_groups.increment(progress_monitor.getNumStalledGroups());
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            agents[qi]->setProgressStalled(progress_monitor.isStalled(qi));
+        }
+    }
+
+    void MultiSyncSimulator::decentralizedMAPP() {
+        TRACE_SCOPE("MultiSyncSimulator::decentralizedMAPP");
+        // Ad-hoc network configuration: the connected components of the agents within the communication range
+        if (param.goal_mode == GoalMode::GRIDBASEDPLANNER or progress_monitor.isEnabled()) {
+            groups = communication_grid.getComponents();
+        }
+        // The agents of a stalled group resolve the deadlock at this step, the MAPF solves their group again
+        if (progress_monitor.isEnabled()) {
+            monitorProgress();
+        }
+
+        if(param.goal_mode == GoalMode::GRIDBASEDPLANNER) {
+
+            // Find next_waypoint using grid based planner, the groups are independent
+            ros::Time mapf_start_time = ros::Time::now();
+            PlanningDeadline mapf_deadline(param.deadline_mapf_budget);
+            std::vector<MAPFGroupMission> group_missions(groups.size());
+            for (size_t gi = 0; gi < groups.size(); gi++) {
+                for (size_t qi: groups[gi]) {
+                    group_missions[gi].is_stalled = group_missions[gi].is_stalled or progress_monitor.isStalled(qi);
+                    group_missions[gi].start_points.emplace_back(agents[qi]->getStartPoint());
+                    group_missions[gi].current_points.emplace_back(agents.getNextWaypoint(qi));
+                    group_missions[gi].goal_points.emplace_back(agents.getDesiredGoalPoint(qi));
                 }
+            }
+            grid_based_planner->setOccupancyIndex(agents[0]->getOccupancyIndex());
+            grid_based_planner->setObstaclePredictionTable(obstacle_prediction_table);
+            std::vector<MAPFGroupResult> group_results =
+                    grid_based_planner->planMAPFGroups(group_missions,
+                                                       agents[0]->getDistmap(),
+                                                       agents[0]->getMapChangeLog(),
+                                                       mission->agents[0].radius,
+                                                       mission->agents[0].downwash,
+                                                       param.multisim_parallel_mapf,
+                                                       mapf_deadline);
+            const GridMapUpdateReport &grid_map_update_report = grid_based_planner->getGridMapUpdateReport();
+            planning_time.mapf_grid_update_time.update(grid_map_update_report.update_time);
+            planning_time.mapf_grid_time_saved.update(grid_map_update_report.time_saved);
+            planning_time.mapf_grid_dirty_ratio.update(grid_map_update_report.getDirtyRatio());
+
+            // Load imbalance of the groups: the slowest group over the average group
+            double group_time_sum = 0, group_time_max = 0;
+            for (const auto &group_result: group_results) {
+                planning_time.mapf_time.update(group_result.planning_time);
+                planning_time.mapf_histogram.record(group_result.planning_time);
+                getMetrics().mapf.record(group_result.planning_time);
+                group_time_sum += group_result.planning_time;
+                group_time_max = std::max(group_time_max, group_result.planning_time);
+            }
+            if (group_results.size() > 1 and group_time_sum > 0) {
+                planning_time.mapf_group_imbalance.update(group_time_max * group_results.size() / group_time_sum);
+            }
 
-                // Run grid_based_planner
-                bool success = grid_based_planner->planMAPF(start_points, current_points, goal_points,
-                                                            agents[0]->getDistmap(),
-                                                            mission.agents[0].radius,
-                                                            mission.agents[0].downwash);
-                if (success) {
+            // Update next_waypoint in the order of the groups
+            for (size_t gi = 0; gi < groups.size(); gi++) {
+                const std::set<size_t> &group = groups[gi];
+                const MAPFGroupResult &group_result = group_results[gi];
+                if (group_result.reused) {
+                    n_mapf_reused++;
+                }
+                std::vector<size_t> group_vector(group.begin(), group.end()); // For index search
+                size_t group_size = group.size();
+                if (group_result.success) {
                     std::vector<point3d> desired_waypoints;
                     desired_waypoints.resize(group_size);
                     for (size_t qgi = 0; qgi < group_size; qgi++) {
-                        points_t path = grid_based_planner->getPath(qgi);
+                        const points_t &path = group_result.paths[qgi];
                         int next_waypoint_idx = std::min(1, (int) path.size() - 1);
                         desired_waypoints[qgi] = path[next_waypoint_idx];
                     }
@@ -226,18 +904,17 @@ namespace DynamicPlanning {
 
                         bool is_in_communication_range = true;
                         if (param.communication_range > 0) {
-                            traj_t traj = agents[qi]->getTraj();
+                            const traj_t &traj = agents.getTraj(qi);
+                            // The size of the trajectory is used since it has the old M after a parameter update
+                            int traj_M = static_cast<int>(traj.size());
                             double dist;
-                            for (int m = 0; m < param.M + 1; m++) {
+                            for (int m = 0; m < traj_M + 1; m++) {
                                 if(traj.empty()){
-                                    dist = LInfinityDistance(desired_waypoints[qgi],
-                                                             agents[qi]->getCurrentPosition());
-                                } else if (m < param.M) {
-                                    dist = LInfinityDistance(desired_waypoints[qgi],
-                                                             agents[qi]->getTraj()[m].startPoint());
+                                    dist = LInfinityDistance(desired_waypoints[qgi], agents.getPosition(qi));
+                                } else if (m < traj_M) {
+                                    dist = LInfinityDistance(desired_waypoints[qgi], traj[m].startPoint());
                                 } else {
-                                    dist = LInfinityDistance(desired_waypoints[qgi],
-                                                             agents[qi]->getTraj().lastPoint());
+                                    dist = LInfinityDistance(desired_waypoints[qgi], traj.lastPoint());
                                 }
 
                                 if (dist > 0.5 * param.communication_range - SP_EPSILON_FLOAT) {
@@ -248,8 +925,8 @@ namespace DynamicPlanning {
                         }
 
                         if (is_in_communication_range and
-                            (desired_waypoints[qgi] - agents[qi]->getNextWaypoint()).norm() > SP_EPSILON_FLOAT and
-                            (agents[qi]->getCurrentGoalPoint() - agents[qi]->getNextWaypoint()).norm() <
+                            (desired_waypoints[qgi] - agents.getNextWaypoint(qi)).norm() > SP_EPSILON_FLOAT and
+                            (agents.getCurrentGoalPoint(qi) - agents.getNextWaypoint(qi)).norm() <
                             SP_EPSILON_FLOAT) {
                             update_cand_set.insert(qi);
                         }
@@ -266,7 +943,7 @@ namespace DynamicPlanning {
                                 if (qi == qj) {
                                     continue;
                                 } else if (update_cand_set.find(qj) == update_cand_set.end()) {
-                                    next_waypoint_j = agents[qj]->getNextWaypoint();
+                                    next_waypoint_j = agents.getNextWaypoint(qj);
                                 } else {
                                     next_waypoint_j = desired_waypoints[qgj];
                                 }
@@ -292,110 +969,700 @@ namespace DynamicPlanning {
                         int qgi = getIndex(group_vector, qi);
                         agents[qi]->setNextWaypoint(desired_waypoints[qgi]);
                     }
+                } else if (group_result.skipped) {
+                    // Degraded mode of the deadline, the agents keep their next waypoints
+                    getMetrics().mapf_skipped.increment();
+                    n_mapf_skipped++;
                 } else {
                     ROS_ERROR("[MultiSyncSimulator] MAPF failed");
+                    getMetrics().mapf_failures.increment();
                 }
-
-                ros::Time mapf_end_time = ros::Time::now();
-                planning_time.mapf_time.update((mapf_end_time - mapf_start_time).toSec());
             }
+
+            ros::Time mapf_end_time = ros::Time::now();
+            planning_time.mapf_round_time.update((mapf_end_time - mapf_start_time).toSec());
+        }
+    }
+
+    void MultiSyncSimulator::predictObstacles() {
+        TRACE_SCOPE("MultiSyncSimulator::predictObstacles");
+        // Snapshot of the dynamic obstacles at this step, shared by the messages of all agents
+        obstacle_generator.update((sim_current_time - sim_start_time).toSec(), 0.0);
+        obstacle_snapshot.resize(mission->on);
+        for (size_t oi = 0; oi < mission->on; oi++) {
+            obstacle_snapshot[oi] = obstacle_generator.getObstacle(oi);
+            obstacle_snapshot[oi].start_time = sim_start_time;
+        }
+
+        // All agents receive the same dynamic obstacles, so their predictions are computed once for this step.
+        // A new table is made at every step, the planners keep the table of their last prediction.
+        obstacle_prediction_table.reset();
+        if (mission->on > 0) {
+            auto table = std::make_shared<ObstaclePredictionTable>();
+            table->update(param, obstacle_snapshot);
+            obstacle_prediction_table = std::move(table);
         }
     }
 
     void MultiSyncSimulator::broadcastMsgs() {
-        // Update obstacle's states for each agent
-        for (size_t qi = 0; qi < mission.qn; qi++) {
-            std::vector<Obstacle> msg_obstacles;
+        TRACE_SCOPE("MultiSyncSimulator::broadcastMsgs");
+        // Snapshot of the agents at this step, the obstacles are taken by predictObstacles. The trajectories are
+        // published once per sender, and the receivers refer to them until the planning of this step is done.
+        // The predictions of the next step are shifted once per sender as well, see predictShiftedTraj.
+        if (trajectory_mailbox.size() != mission->qn) {
+            trajectory_mailbox.resize(mission->qn);
+            shifted_traj_mailbox.resize(mission->qn);
+        }
+        std::vector<Obstacle> agent_snapshot(mission->qn);
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            agent_snapshot[qi] = agents[qi]->getAgent(false);
+            agent_snapshot[qi].start_time = sim_start_time;
+            const traj_t &traj = agents.getTraj(qi);
+            trajectory_mailbox.publish(qi, traj);
+            if (traj.size() >= param.M) {
+                predictShiftedTraj(param, traj, shifted_traj);
+            } else {
+                shifted_traj = traj_t(); // predicted by the receivers
+            }
+            shifted_traj_mailbox.publish(qi, shifted_traj);
+        }
 
-            // Dynamic obstacles
-            obstacle_generator.update((sim_current_time - sim_start_time).toSec(), 0.0);
-            for (size_t oi = 0; oi < mission.on; oi++) {
-                Obstacle obstacle = obstacle_generator.getObstacle(oi);
-                obstacle.start_time = sim_start_time;
-                msg_obstacles.emplace_back(obstacle);
+        // The trajectories are encoded once per sender, each receiver decodes the frame for itself
+        bool use_trajectory_codec = param.communication_quantization_step > 0;
+        if (use_trajectory_codec) {
+            if (trajectory_encoders.size() != mission->qn) {
+                trajectory_encoders.assign(mission->qn, TrajectoryEncoder(param.communication_quantization_step));
+                trajectory_decoders.assign(mission->qn, {});
+                key_frames.resize(mission->qn);
+                delta_frames.resize(mission->qn);
             }
+            Timer encode_timer;
+            for (size_t qi = 0; qi < mission->qn; qi++) {
+                trajectory_encoders[qi].encode(trajectory_mailbox.read(qi), key_frames[qi], delta_frames[qi]);
+            }
+            encode_timer.stop();
+            if (mission->qn > 0) {
+                planning_time.trajectory_encode_time.update(encode_timer.elapsedSeconds() / mission->qn);
+            }
+        }
+        size_t broadcast_bytes = 0;
 
-            // Other agents
-            for (size_t qj = 0; qj < mission.qn; qj++) {
-                // communication range
-                double dist = LInfinityDistance(agents[qi]->getCurrentPosition(), agents[qj]->getCurrentPosition());
-                if (qi == qj) {
-                    continue;
+        // Over the simulated links, the agents plan with the newest packets delivered from their neighbors
+        if (param.isNetworkSimulated()) {
+            if (network == nullptr) {
+                network = std::make_unique<CommunicationNetwork>(param, mission->qn, mission->random_seed);
+            }
+            sendMsgs(agent_snapshot, use_trajectory_codec);
+            network->deliver(sim_step);
+            broadcast_bytes = receiveMsgs(use_trajectory_codec);
+        }
+
+        // Update obstacle's states for each agent
+        std::vector<size_t> neighbors;
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            // The agents of the other processes receive their messages there
+            if (agent_exchange != nullptr and not param.isAgentInProcess(qi)) {
+                continue;
+            }
+
+            // Dynamic obstacles and the other agents in the communication range
+            std::vector<Obstacle> msg_obstacles;
+            if (network != nullptr) {
+                msg_obstacles.reserve(mission->on + received_agents[qi].size());
+                msg_obstacles.insert(msg_obstacles.end(), obstacle_snapshot.begin(), obstacle_snapshot.end());
+                for (const ReceivedAgent &received_agent: received_agents[qi]) {
+                    msg_obstacles.emplace_back(received_agent.agent);
                 }
+                neighbors.clear();
+            } else {
+                communication_grid.getNeighbors(qi, true, neighbors);
+                msg_obstacles.reserve(mission->on + neighbors.size());
+                msg_obstacles.insert(msg_obstacles.end(), obstacle_snapshot.begin(), obstacle_snapshot.end());
+            }
+            for (size_t qj: neighbors) {
+                msg_obstacles.emplace_back(agent_snapshot[qj]);
+                size_t received_bytes = use_trajectory_codec ?
+                                        receiveTrajectory(qi, qj, msg_obstacles.back().prev_traj) : 0;
+                if (received_bytes == 0) {
+                    msg_obstacles.back().shared_prev_traj = &trajectory_mailbox.read(qj);
+                    msg_obstacles.back().shared_shifted_traj = &shifted_traj_mailbox.read(qj);
+                }
+                broadcast_bytes += received_bytes;
 
-                if (param.communication_range > 0 and dist > param.communication_range) {
+                // Map merging, only the voxels changed since the last exchange with the peer. The maps are not sent
+                // between the processes, so only the peers in the same process are merged.
+                if (param.world_use_global_map or (agent_exchange != nullptr and not param.isAgentInProcess(qj))) {
                     continue;
                 }
-
-                Obstacle obstacle = agents[qj]->getAgent();
-                obstacle.start_time = sim_start_time;
-                msg_obstacles.emplace_back(obstacle);
-
-                // Map merging
-                if (not param.world_use_global_map) {
-                    agents[qi]->mergeMapCallback(agents[qj]->getOctomapMsg());
+                MapDelta delta = agents[qj]->getMapDelta(agents[qi]->getPeerMapSeq(qj));
+                if (param.world_async_map_merge) {
+                    agents[qi]->mergeMapDeltaAsync(qj, std::move(delta));
+                } else {
+                    agents[qi]->mergeMapDelta(qj, delta);
                 }
             }
 
             agents[qi]->setPlannerState(planner_state);
-            agents[qi]->obstacleCallback(msg_obstacles);
+            agents[qi]->setObstaclePredictionTable(obstacle_prediction_table);
+            agents[qi]->obstacleCallback(std::move(msg_obstacles));
 
             if (mission_changed) {
-                agents[qi]->setStartPosition(mission.agents[qi].start_point);
-                agents[qi]->setDesiredGoal(mission.agents[qi].desired_goal_point);
+                agents[qi]->setStartPosition(mission->agents[qi].start_point);
+                agents[qi]->setDesiredGoal(mission->agents[qi].desired_goal_point);
             }
         }
 
+        if ((use_trajectory_codec or network != nullptr) and mission->qn > 0) {
+            planning_time.trajectory_broadcast_bytes.update(static_cast<double>(broadcast_bytes) / mission->qn);
+        }
+
         if (mission_changed) {
             mission_changed = false;
         }
     }
 
+    size_t MultiSyncSimulator::receiveTrajectory(size_t receiver, size_t sender, traj_t &traj) {
+        const std::vector<uint8_t> &key_frame = key_frames[sender];
+        const std::vector<uint8_t> &delta_frame = delta_frames[sender];
+        if (key_frame.empty()) {
+            // The trajectory does not fit the wire format, it is received as it is from the mailbox
+            return 0;
+        }
+
+        // A receiver that missed the previous frame of the sender gets the key frame
+        TrajectoryDecoder &decoder = trajectory_decoders[receiver][sender];
+        uint16_t reference_seq = trajectory_encoders[sender].getSeq() - 1;
+        const std::vector<uint8_t> &frame =
+                not delta_frame.empty() and decoder.hasReference(reference_seq) ? delta_frame : key_frame;
+        Timer decode_timer;
+        bool decoded = decoder.decode(frame.data(), frame.size(), traj);
+        decode_timer.stop();
+        if (not decoded) {
+            ROS_WARN_STREAM("[MultiSyncSimulator] failed to decode the trajectory of agent " << sender);
+            return 0;
+        }
+        planning_time.trajectory_decode_time.update(decode_timer.elapsedSeconds());
+        return frame.size();
+    }
+
+    void MultiSyncSimulator::sendMsgs(const std::vector<Obstacle> &agent_snapshot, bool use_trajectory_codec) {
+        TRACE_SCOPE("MultiSyncSimulator::sendMsgs");
+        size_t ring_size = network->getMaxDelaySteps() + 1;
+        if (sent_agents.size() != mission->qn) {
+            sent_agents.assign(mission->qn, std::vector<SentAgent>(ring_size));
+            received_agents.assign(mission->qn, {});
+        }
+
+        // The payload is kept by the sender until all packets of it are delivered
+        uint64_t version = sim_step;
+        for (size_t qj = 0; qj < mission->qn; qj++) {
+            SentAgent &sent_agent = sent_agents[qj][version % ring_size];
+            sent_agent.agent = agent_snapshot[qj];
+            sent_agent.agent.prev_traj = trajectory_mailbox.read(qj);
+            if (use_trajectory_codec) {
+                sent_agent.key_frame = key_frames[qj];
+                sent_agent.delta_frame = delta_frames[qj];
+                sent_agent.frame_seq = trajectory_encoders[qj].getSeq();
+            }
+        }
+
+        std::vector<size_t> neighbors;
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            if (agent_exchange != nullptr and not param.isAgentInProcess(qi)) {
+                continue;
+            }
+
+            communication_grid.getNeighbors(qi, true, neighbors);
+            for (size_t qj: neighbors) {
+                const SentAgent &sent_agent = sent_agents[qj][version % ring_size];
+                CommunicationNetwork::Packet packet;
+                packet.sender = static_cast<uint32_t>(qj);
+                packet.receiver = static_cast<uint32_t>(qi);
+                packet.version = version;
+                if (use_trajectory_codec and not sent_agent.key_frame.empty()) {
+                    // The sender knows the last frame decoded by the receiver, as if it were acknowledged
+                    const TrajectoryDecoder &decoder = trajectory_decoders[qi][qj];
+                    packet.is_key_frame = sent_agent.delta_frame.empty() or
+                                          not decoder.hasReference(sent_agent.frame_seq - 1);
+                    packet.bytes = packet.is_key_frame ? sent_agent.key_frame.size() : sent_agent.delta_frame.size();
+                } else {
+                    const traj_t &traj = sent_agent.agent.prev_traj;
+                    for (int m = 0; m < traj.size(); m++) {
+                        packet.bytes += traj[m].control_points.size() * sizeof(point3d) + sizeof(float);
+                    }
+                }
+
+                // The map delta is sent again until the receiver merges it, as in the instant exchange
+                if (not param.world_use_global_map and
+                    (agent_exchange == nullptr or param.isAgentInProcess(qj))) {
+                    packet.has_map_delta = true;
+                    packet.map_delta = agents[qj]->getMapDelta(agents[qi]->getPeerMapSeq(qj));
+                    if (param.communication_map_delta_compression) {
+                        MapDeltaCodec::compress(packet.map_delta, packet.compressed_map_delta);
+                        packet.map_delta.data.clear();
+                        packet.bytes += packet.compressed_map_delta.size();
+                    } else {
+                        packet.bytes += packet.map_delta.data.size();
+                    }
+                }
+                network->send(sim_step, std::move(packet));
+            }
+        }
+    }
+
+    size_t MultiSyncSimulator::receiveMsgs(bool use_trajectory_codec) {
+        TRACE_SCOPE("MultiSyncSimulator::receiveMsgs");
+        size_t ring_size = network->getMaxDelaySteps() + 1;
+        size_t delivered_bytes = 0;
+        double total_delay = 0;
+        size_t n_delivered = 0;
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            if (agent_exchange != nullptr and not param.isAgentInProcess(qi)) {
+                continue;
+            }
+
+            std::vector<ReceivedAgent> &received = received_agents[qi];
+            for (CommunicationNetwork::Packet &packet: network->getInbox(qi)) {
+                delivered_bytes += packet.bytes;
+                total_delay += (sim_step - packet.send_step) * param.multisim_time_step;
+                n_delivered++;
+                if (packet.has_map_delta and not packet.compressed_map_delta.empty() and
+                    not MapDeltaCodec::decompress(packet.compressed_map_delta.data(),
+                                                  packet.compressed_map_delta.size(), packet.map_delta)) {
+                    ROS_ERROR_STREAM("[MultiSyncSimulator] Invalid compressed map delta of agent " << packet.sender);
+                    packet.has_map_delta = false;
+                }
+                if (packet.has_map_delta) {
+                    if (param.world_async_map_merge) {
+                        agents[qi]->mergeMapDeltaAsync(static_cast<int>(packet.sender), std::move(packet.map_delta));
+                    } else {
+                        agents[qi]->mergeMapDelta(static_cast<int>(packet.sender), packet.map_delta);
+                    }
+                }
+
+                // A packet older than the one delivered before it is dropped
+                auto it = std::find_if(received.begin(), received.end(), [&](const ReceivedAgent &received_agent) {
+                    return received_agent.sender == packet.sender;
+                });
+                if (it != received.end() and it->version >= packet.version) {
+                    continue;
+                }
+                const SentAgent &sent_agent = sent_agents[packet.sender][packet.version % ring_size];
+                Obstacle agent = sent_agent.agent;
+                if (use_trajectory_codec and not sent_agent.key_frame.empty()) {
+                    // A delta frame against a lost frame is dropped, the previous trajectory is kept
+                    const std::vector<uint8_t> &frame = packet.is_key_frame ? sent_agent.key_frame :
+                                                        sent_agent.delta_frame;
+                    TrajectoryDecoder &decoder = trajectory_decoders[qi][packet.sender];
+                    if (not decoder.decode(frame.data(), frame.size(), agent.prev_traj)) {
+                        continue;
+                    }
+                }
+                if (it == received.end()) {
+                    received.push_back({packet.sender, packet.version, std::move(agent)});
+                } else {
+                    it->version = packet.version;
+                    it->agent = std::move(agent);
+                }
+            }
+
+            // The neighbors without a packet for communication/timeout are forgotten
+            received.erase(std::remove_if(received.begin(), received.end(), [&](const ReceivedAgent &received_agent) {
+                return (sim_step - static_cast<double>(received_agent.version)) * param.multisim_time_step >
+                       param.communication_timeout;
+            }), received.end());
+        }
+        if (n_delivered > 0) {
+            planning_time.network_delay.update(total_delay / n_delivered);
+        }
+        return delivered_bytes;
+    }
+
     bool MultiSyncSimulator::plan() {
-        // Sequential planning
+        TRACE_SCOPE("MultiSyncSimulator::plan");
+        Timer step_timer;
+        scheduleReplanning();
         PlanningReport result;
-        for (size_t qi = 0; qi < mission.qn; qi++) {
-            result = agents[qi]->plan(sim_current_time);
-            if (result == PlanningReport::QPFAILED) {
-                return false;
+        if (param.multisim_parallel_planning) {
+            result = planParallel();
+        } else if (batch_worker_pool != nullptr) {
+            result = planBatch();
+        } else {
+            result = planSequential();
+        }
+        // The agents of the other processes are exchanged only once per step
+        if (param.multisim_admm_iterations > 0 and result == PlanningReport::SUCCESS and agent_exchange == nullptr) {
+            planConsensus();
+        }
+        if (agent_exchange != nullptr and not exchangeAgents(result == PlanningReport::QPFAILED)) {
+            result = PlanningReport::QPFAILED;
+        }
+        SFCLibrary::getInstance().commit();
+
+        // The merges prepared during the planning take effect from the next step
+        if (param.world_async_map_merge and not param.world_use_global_map) {
+            for (const auto& agent: agents) {
+                agent->commitMapMerges();
             }
         }
+        step_timer.stop();
+        planning_time.step_wall_time.update(step_timer.elapsedSeconds());
+        planning_time.step_wall_histogram.record(step_timer.elapsedSeconds());
+        getMetrics().step_wall.record(step_timer.elapsedSeconds());
+        updateMetrics(result);
+        // The exchange sets the states of the remote agents as well
+        syncAgents();
+        if (result == PlanningReport::QPFAILED) {
+            return false;
+        }
 
         // save planning result
         if (planner_state != PlannerState::LAND) {
+            sampleStates();
             saveSimulationResult();
 
-            if (param.multisim_save_result) {
-                saveSimulationResultAsCSV();
+            // All processes have the same states, the process 0 writes them
+            if (param.multisim_save_result and param.multisim_process_index == 0) {
+                saveSimulationResultAsLog();
+            }
+        }
+
+        return true;
+    }
+
+    bool MultiSyncSimulator::exchangeAgents(bool has_failed) {
+        TRACE_SCOPE("MultiSyncSimulator::exchangeAgents");
+        Timer exchange_timer;
+        std::vector<ExchangedAgent> local_agents;
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            if (param.isAgentInProcess(qi)) {
+                local_agents.emplace_back(agents[qi]->getExchangedAgent());
+            }
+        }
+        AgentExchangeBlock::write(has_failed, local_agents, exchange_block);
+        if (not agent_exchange->exchange(exchange_block, exchange_blocks)) {
+            return false;
+        }
+
+        // A planning failure in any process stops all of them at the same step
+        bool has_any_failed = false;
+        for (int pi = 0; pi < param.multisim_num_processes; pi++) {
+            if (pi == param.multisim_process_index) {
+                has_any_failed = has_any_failed or has_failed;
+                continue;
+            }
+            bool has_process_failed = false;
+            std::vector<ExchangedAgent> remote_agents;
+            if (not AgentExchangeBlock::read(exchange_blocks[pi], has_process_failed, remote_agents)) {
+                ROS_ERROR_STREAM("[MultiSyncSimulator] Invalid agents from the process " << pi);
+                return false;
+            }
+            has_any_failed = has_any_failed or has_process_failed;
+            for (const auto &remote_agent: remote_agents) {
+                if (remote_agent.id < 0 or static_cast<size_t>(remote_agent.id) >= mission->qn or
+                    param.isAgentInProcess(remote_agent.id)) {
+                    ROS_ERROR_STREAM("[MultiSyncSimulator] Invalid agent " << remote_agent.id << " from the process "
+                                     << pi);
+                    return false;
+                }
+                agents[remote_agent.id]->setExchangedAgent(remote_agent);
+            }
+        }
+        exchange_timer.stop();
+        size_t exchange_bytes = 0;
+        for (const auto &block: exchange_blocks) {
+            exchange_bytes += block.size();
+        }
+        planning_time.agent_exchange_time.update(exchange_timer.elapsedSeconds());
+        planning_time.agent_exchange_bytes.update(static_cast<double>(exchange_bytes));
+        return not has_any_failed;
+    }
+
+    void MultiSyncSimulator::updateMetrics(PlanningReport result) {
+        SimulatorMetrics &metrics = getMetrics();
+        metrics.steps.increment();
+        metrics.replans.increment(replanning_agents.size());
+        metrics.replanning_agents.set(static_cast<double>(replanning_agents.size()));
+        if (result == PlanningReport::QPFAILED) {
+            metrics.planning_failures.increment();
+        }
+
+        // The queues of the background threads, read only if someone reads the metrics since two of them lock
+        if (metrics_publisher != nullptr) {
+            metrics.result_writer_queue.set(static_cast<double>(result_writer.getQueueSize()));
+            metrics.qp_diagnoser_queue.set(static_cast<double>(QPFailureDiagnoser::getInstance().getQueueSize()));
+            metrics.visualization_queue.set(
+                    static_cast<double>(VisualizationWorker::getInstance().getNumPendingJobs()));
+        }
+    }
+
+    void MultiSyncSimulator::scheduleReplanning() {
+        replan_scheduler.popDueAgents(sim_step, replanning_agents);
+        sim_step++;
+        if (replanning_agents.size() == mission->qn and agent_exchange == nullptr and not param.hover_mode) {
+            n_replanned += mission->qn;
+            return;
+        }
+
+        // The agents not due follow their previous trajectories. The shifted trajectory is the initial trajectory
+        // of the LSC, and the other agents predict it from the trajectory broadcast at the previous step, so the
+        // LSCs of the replanning agents remain valid. An agent without a trajectory replans anyway. The converged
+        // agents hover by the same hold while their certificates are valid, even if they are due.
+        std::vector<bool> is_due(mission->qn, false);
+        for (size_t qi: replanning_agents) {
+            is_due[qi] = true;
+        }
+        replanning_agents.clear();
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            // The other processes plan or hold their agents, and send the results by exchangeAgents
+            if (agent_exchange != nullptr and not param.isAgentInProcess(qi)) {
+                continue;
+            }
+            bool is_hovering = is_due[qi] and agents[qi]->canHover();
+            if ((is_due[qi] and not is_hovering) or not agents[qi]->canHold()) {
+                replanning_agents.emplace_back(qi);
+            } else {
+                agents[qi]->hold();
+                n_held++;
+                if (is_hovering) {
+                    n_hovered++;
+                }
+            }
+        }
+        n_replanned += replanning_agents.size();
+    }
+
+    PlanningReport MultiSyncSimulator::planSequential() {
+        ThreadCPUTimer cpu_timer;
+        PlanningReport result = PlanningReport::SUCCESS;
+        for (size_t qi: replanning_agents) {
+            result = agents[qi]->plan(sim_current_time);
+            if (result == PlanningReport::QPFAILED) {
+                break;
+            }
+        }
+        cpu_timer.stop();
+        planning_time.step_cpu_time.update(cpu_timer.elapsedSeconds());
+        return result;
+    }
+
+    PlanningReport MultiSyncSimulator::planBatch() {
+        // Build the QP of every agent first. Agents only use the obstacles broadcast at the previous step,
+        // so the QPs of a simulation step are independent of each other.
+        ThreadCPUTimer cpu_timer;
+        size_t n_agents = replanning_agents.size();
+        std::vector<PlanningReport> results(n_agents);
+        for (size_t i = 0; i < n_agents; i++) {
+            results[i] = agents[replanning_agents[i]]->planBeforeOptimization(sim_current_time);
+        }
+        cpu_timer.stop();
+        if (param.multisim_batch_qp) {
+            solveBatchQPs(results);
+        }
+
+        // Solve them in the worker pool. Each agent keeps its own solver workspace (persistent QP model),
+        // and the solver threads are distributed by SolverThreadScheduler.
+        std::vector<double> cpu_times(n_agents, 0);
+        runAgents([&](size_t i) {
+            ThreadCPUTimer agent_cpu_timer;
+            if (results[i] == PlanningReport::SUCCESS) {
+                results[i] = agents[replanning_agents[i]]->planOptimization();
+            }
+            agent_cpu_timer.stop();
+            cpu_times[i] = agent_cpu_timer.elapsedSeconds();
+        });
+        planning_time.step_cpu_time.update(cpu_timer.elapsedSeconds() +
+                                           std::accumulate(cpu_times.begin(), cpu_times.end(), 0.0));
+
+        for (const auto &result: results) {
+            if (result == PlanningReport::QPFAILED) {
+                return PlanningReport::QPFAILED;
+            }
+        }
+        return PlanningReport::SUCCESS;
+    }
+
+    void MultiSyncSimulator::solveBatchQPs(const std::vector<PlanningReport> &results) {
+        TRACE_SCOPE("MultiSyncSimulator::solveBatchQPs");
+        static MetricCounter &batch_solved = MetricsRegistry::getInstance().getCounter(
+                "lsc_batch_qp_solved_total", "Trajectory QPs solved by the batched solver");
+        static MetricCounter &batch_fallbacks = MetricsRegistry::getInstance().getCounter(
+                "lsc_batch_qp_fallbacks_total", "Trajectory QPs not converged in the batch and solved by the QP solver");
+        size_t n_agents = replanning_agents.size();
+        std::vector<QPProblem> problems(n_agents);
+        runAgents([&](size_t i) {
+            if (results[i] == PlanningReport::SUCCESS) {
+                problems[i] = agents[replanning_agents[i]]->prepareBatchQP();
+            }
+        });
+
+        Timer timer;
+        std::vector<const QPProblem *> problem_ptrs(n_agents, nullptr);
+        for (size_t i = 0; i < n_agents; i++) {
+            if (results[i] == PlanningReport::SUCCESS) {
+                problem_ptrs[i] = &problems[i];
+            }
+        }
+        std::vector<QPSolution> solutions;
+        std::vector<uint8_t> successes;
+        batch_qp_solver.solve(problem_ptrs, solutions, successes);
+        timer.stop();
+        planning_time.batch_qp_time.update(timer.elapsedSeconds());
+
+        // The agents without the solution solve their QPs by themselves in planOptimization
+        for (size_t i = 0; i < n_agents; i++) {
+            if (problem_ptrs[i] == nullptr) {
+                continue;
+            }
+            if (successes[i]) {
+                agents[replanning_agents[i]]->setBatchQPSolution(solutions[i]);
+                batch_solved.increment();
+            } else {
+                batch_fallbacks.increment();
+            }
+        }
+    }
+
+    void MultiSyncSimulator::runAgents(const std::function<void(size_t)> &task) {
+        // The agent ids are the keys, so an agent stays on a worker while the replanning agents change
+        if (param.multisim_sticky_agents) {
+            batch_worker_pool->runAffine(replanning_agents, task);
+        } else {
+            batch_worker_pool->run(replanning_agents.size(), task);
+        }
+    }
+
+    PlanningReport MultiSyncSimulator::planParallel() {
+        // The whole planning of the agents runs concurrently. An agent reads only its own state and the obstacles
+        // broadcast at the previous step, the shared SFC library is deferred until the end of the step,
+        // and the messages are published after the step, so the result matches the sequential planning.
+        size_t n_agents = replanning_agents.size();
+        std::vector<PlanningReport> results(n_agents);
+        std::vector<double> cpu_times(n_agents, 0);
+        runAgents([&](size_t i) {
+            ThreadCPUTimer agent_cpu_timer;
+            results[i] = agents[replanning_agents[i]]->plan(sim_current_time);
+            agent_cpu_timer.stop();
+            cpu_times[i] = agent_cpu_timer.elapsedSeconds();
+        });
+        planning_time.step_cpu_time.update(std::accumulate(cpu_times.begin(), cpu_times.end(), 0.0));
+
+        for (const auto &result: results) {
+            if (result == PlanningReport::QPFAILED) {
+                return PlanningReport::QPFAILED;
+            }
+        }
+        return PlanningReport::SUCCESS;
+    }
+
+    void MultiSyncSimulator::planConsensus() {
+        TRACE_SCOPE("MultiSyncSimulator::planConsensus");
+        // The agents not replanning keep their trajectories, their neighbors use the predictions as before
+        std::vector<ConsensusMessage> messages(mission->qn);
+        std::vector<double> changes(replanning_agents.size(), 0);
+        auto runConsensusTask = [&](const std::function<void(size_t)> &task) {
+            if (batch_worker_pool != nullptr) {
+                runAgents(task);
+            } else {
+                for (size_t i = 0; i < replanning_agents.size(); i++) {
+                    task(i);
+                }
+            }
+        };
+        for (int iter = 0; iter < param.multisim_admm_iterations; iter++) {
+            runConsensusTask([&](size_t i) {
+                messages[replanning_agents[i]] = agents[replanning_agents[i]]->getConsensusMessage();
+            });
+            runConsensusTask([&](size_t i) {
+                changes[i] = agents[replanning_agents[i]]->planConsensusIteration(messages);
+            });
+            if (std::all_of(changes.begin(), changes.end(), [](double change) { return change < ADMM_TOLERANCE; })) {
+                break;
             }
         }
-
-        return true;
     }
 
     void MultiSyncSimulator::publish() {
+        TRACE_SCOPE("MultiSyncSimulator::publish");
         if(param.log_vis){
 //            publishGridMap();
         }
 
+        // The markers are built and published by the visualization worker from the snapshot of this step
+        auto snapshot = std::make_shared<const VisualizationSnapshot>(makeVisualizationSnapshot());
         if (param.communication_range > 0) {
-            publishCommunicationRange();
-            publishCommunicationGroup();
+            submitVisualization(pub_communication_range, snapshot, communicationRangeToMsg);
+            submitVisualization(pub_communication_group, snapshot, communicationGroupToMsg);
         }
         publishAgentTrajectories();
         publishObstacleTrajectories();
-        if (planner_state != PlannerState::LAND) {
-            publishDesiredTrajs();
+        if (not snapshot->desired_trajs.empty()) {
+            submitVisualization(pub_desired_trajs_vis, snapshot, desiredTrajsToMsg);
         }
-        publishCollisionModel();
-        publishStartGoalPoints();
-        publishWorldBoundary();
-        publishCollisionAlert();
-        for (size_t qi = 0; qi < mission.qn; qi++) {
+        submitVisualization(pub_collision_model, snapshot, collisionModelToMsg);
+        submitVisualization(pub_start_goal_points_vis, snapshot, startGoalPointsToMsg);
+        submitVisualization(pub_collision_alert, snapshot, collisionAlertToMsg);
+        for (size_t qi = 0; qi < mission->qn; qi++) {
             agents[qi]->publish();
         }
         obstacle_generator.publish(param.world_frame_id);
-        publishAgentState();
+        publishAgentState(snapshot);
+    }
+
+    MultiSyncSimulator::VisualizationSnapshot MultiSyncSimulator::makeVisualizationSnapshot() const {
+        VisualizationSnapshot snapshot;
+        snapshot.mission = mission;
+        snapshot.param = std::make_shared<const Param>(param);
+        snapshot.current_states.resize(mission->qn);
+        snapshot.desired_goal_points.resize(mission->qn);
+        snapshot.current_goal_points.resize(mission->qn);
+        snapshot.next_waypoints.resize(mission->qn);
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            snapshot.current_states[qi] = agents.getState(qi);
+            snapshot.desired_goal_points[qi] = agents.getDesiredGoalPoint(qi);
+            snapshot.current_goal_points[qi] = agents.getCurrentGoalPoint(qi);
+            snapshot.next_waypoints[qi] = agents.getNextWaypoint(qi);
+        }
+        if (planner_state != PlannerState::LAND) {
+            snapshot.desired_trajs.reserve(mission->qn);
+            for (size_t qi = 0; qi < mission->qn; qi++) {
+                snapshot.desired_trajs.emplace_back(agents.getTraj(qi));
+            }
+        }
+        if (param.communication_range > 0) {
+            std::vector<size_t> neighbors;
+            for (size_t qi = 0; qi < mission->qn; qi++) {
+                communication_grid.getNeighbors(qi, false, neighbors);
+                for (size_t qj: neighbors) {
+                    if (qj > qi) {
+                        snapshot.communication_links.emplace_back(qi, qj);
+                    }
+                }
+            }
+        }
+        snapshot.is_collided = is_collided;
+        return snapshot;
+    }
+
+    void MultiSyncSimulator::submitVisualization(const ros::Publisher &pub,
+                                                 const std::shared_ptr<const VisualizationSnapshot> &snapshot,
+                                                 MarkerBuilder build) {
+        // The jobs of a topic run one at a time on the worker, so they share the message without a lock
+        std::shared_ptr<visualization_msgs::MarkerArray> &msg = marker_pools[pub.getTopic()];
+        if (msg == nullptr) {
+            msg = std::make_shared<visualization_msgs::MarkerArray>();
+        }
+        VisualizationWorker::getInstance().submit(pub.getTopic(), [pub, snapshot, build, msg]() {
+            build(*snapshot, *msg);
+            pub.publish(*msg);
+        });
+    }
+
+    void MultiSyncSimulator::publishStaticMarkers() {
+        auto snapshot = std::make_shared<VisualizationSnapshot>();
+        snapshot->mission = mission;
+        snapshot->param = std::make_shared<const Param>(param);
+        submitVisualization(pub_world_boundary, snapshot, worldBoundaryToMsg);
     }
 
     bool MultiSyncSimulator::isFinished() {
@@ -403,18 +1670,32 @@ namespace DynamicPlanning {
             return false;
         }
 
-        for (size_t qi = 0; qi < mission.qn; qi++) {
-            point3d current_position = agents[qi]->getCurrentPosition();
-            double dist_to_goal;
+        auto isAtGoal = [&](size_t qi) {
+            const point3d &current_position = agents.getPosition(qi);
+            double dist_to_goal = 0;
             if (planner_state == PlannerState::GOTO) {
-                dist_to_goal = current_position.distance(mission.agents[qi].desired_goal_point);
+                dist_to_goal = current_position.distance(mission->agents[qi].desired_goal_point);
             } else if (planner_state == PlannerState::GOBACK) {
-                dist_to_goal = current_position.distance(mission.agents[qi].start_point);
+                dist_to_goal = current_position.distance(mission->agents[qi].start_point);
             }
-
-//            ROS_INFO_STREAM("agent:" << qi << ",dist:"<< dist_to_goal << ",thres:" << param.goal_threshold);
-
-            if (dist_to_goal > param.goal_threshold) {
+            return dist_to_goal <= param.goal_threshold;
+        };
+
+        // Resume from the first agent that was not at the goal, so a step usually checks one agent.
+        // The agents before it may have left the goal, so all agents are checked again before finishing.
+        if (planner_state != finish_check_state) {
+            finish_check_state = planner_state;
+            finish_check_idx = 0;
+        }
+        while (finish_check_idx < mission->qn and isAtGoal(finish_check_idx)) {
+            finish_check_idx++;
+        }
+        if (finish_check_idx < mission->qn) {
+            return false;
+        }
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            if (not isAtGoal(qi)) {
+                finish_check_idx = qi;
                 return false;
             }
         }
@@ -428,11 +1709,36 @@ namespace DynamicPlanning {
         ROS_INFO_STREAM("[MultiSyncSimulator] total flight time: " << total_flight_time);
 
         // total flight distance
-        total_distance = getTotalDistance();
         ROS_INFO_STREAM("[MultiSyncSimulator] total distance: " << total_distance);
 
         // average planning time
         ROS_INFO_STREAM("[MultiSyncSimulator] planning time per agent: " << planning_time.total_planning_time.average);
+        if (planning_time.total_planning_histogram.getCount() > 0) {
+            std::stringstream percentiles_ss;
+            for (double percentile: param.multisim_latency_percentiles) {
+                percentiles_ss << " p" << percentile << ": "
+                               << planning_time.total_planning_histogram.getPercentile(percentile);
+            }
+            ROS_INFO_STREAM("[MultiSyncSimulator] planning time percentiles per agent:" << percentiles_ss.str());
+        }
+        // CPU time over wall time, below 1 if the stage waits (locks, workers, preemption), above 1 if it runs on
+        // the worker pool
+        for (const auto &stage: planning_time.getCPUStages()) {
+            const StageCPUTime &cpu = *std::get<1>(stage);
+            const PlanningTime &wall = *std::get<2>(stage);
+            if (cpu.cpu_time.N_sample == 0) {
+                continue;
+            }
+            ROS_INFO_STREAM("[MultiSyncSimulator] " << std::get<0>(stage) << " CPU time per agent: "
+                            << cpu.cpu_time.average << ", wait time: " << cpu.wait_time.average
+                            << ", CPU/wall: " << (wall.average > 0 ? cpu.cpu_time.average / wall.average : 0));
+        }
+
+        // real time factor, the simulated time over the wall time of the steps
+        wall_timer.stop();
+        real_time_factor = (sim_current_time - sim_start_time).toSec() /
+                           std::max(wall_timer.elapsedSeconds(), SP_EPSILON);
+        ROS_INFO_STREAM("[MultiSyncSimulator] real time factor: " << real_time_factor);
 
         // safety_ratio_agent
         ROS_INFO_STREAM("[MultiSyncSimulator] safety ratio between agent: " << safety_ratio_agent);
@@ -440,79 +1746,372 @@ namespace DynamicPlanning {
         // safety_ratio_obs
         ROS_INFO_STREAM("[MultiSyncSimulator] safety ratio obstacle: " << safety_ratio_obs);
 
-        if (param.multisim_save_result) {
+        // replanning events
+        if (n_held > 0) {
+            ROS_INFO_STREAM("[MultiSyncSimulator] replanning ratio: "
+                            << (double) n_replanned / (double) (n_replanned + n_held)
+                            << ", held agent steps: " << n_held << " (hovering: " << n_hovered << ")");
+        }
+
+        // MAPF grid map
+        if (planning_time.mapf_grid_update_time.N_sample > 0) {
+            ROS_INFO_STREAM("[MultiSyncSimulator] MAPF grid map update time: "
+                            << planning_time.mapf_grid_update_time.average
+                            << ", time saved: " << planning_time.mapf_grid_time_saved.average
+                            << ", dirty ratio: " << planning_time.mapf_grid_dirty_ratio.average);
+        }
+        if (planning_time.step_wall_time.N_sample > 0) {
+            ROS_INFO_STREAM("[MultiSyncSimulator] planning time per step, wall: " << planning_time.step_wall_time.average
+                            << ", CPU: " << planning_time.step_cpu_time.average
+                            << ", speedup: " << planning_time.step_cpu_time.average /
+                                                std::max(planning_time.step_wall_time.average, SP_EPSILON));
+        }
+        if (planning_time.trajectory_broadcast_bytes.N_sample > 0) {
+            ROS_INFO_STREAM("[MultiSyncSimulator] trajectory broadcast bytes per agent per step: "
+                            << planning_time.trajectory_broadcast_bytes.average
+                            << ", encode time per agent: " << planning_time.trajectory_encode_time.average
+                            << ", decode time per frame: " << planning_time.trajectory_decode_time.average);
+        }
+        if (network != nullptr) {
+            const CommunicationNetwork::Statistics &network_statistics = network->getStatistics();
+            ROS_INFO_STREAM("[MultiSyncSimulator] simulated network packets sent: " << network_statistics.n_sent
+                            << ", delivered: " << network_statistics.n_delivered
+                            << ", lost: " << network_statistics.n_lost
+                            << ", congested: " << network_statistics.n_congested
+                            << ", delay per packet: " << planning_time.network_delay.average);
+        }
+        if (planning_time.agent_exchange_time.N_sample > 0) {
+            ROS_INFO_STREAM("[MultiSyncSimulator] agent exchange time per step: "
+                            << planning_time.agent_exchange_time.average
+                            << ", max: " << planning_time.agent_exchange_time.max
+                            << ", bytes per step: " << planning_time.agent_exchange_bytes.average);
+        }
+        if (planning_time.batch_qp_time.N_sample > 0) {
+            ROS_INFO_STREAM("[MultiSyncSimulator] batched QP time per step: " << planning_time.batch_qp_time.average
+                            << ", max: " << planning_time.batch_qp_time.max);
+        }
+                PlanningTime ingestion_latency = ObstacleIngestion::getInstance().getLatency();
+        if (ingestion_latency.N_sample > 0) {
+            ROS_INFO_STREAM("[MultiSyncSimulator] real obstacle latency from the measurement to the planner, average: "
+                            << ingestion_latency.average << ", max: " << ingestion_latency.max);
+        }
+        if (planning_time.obstacle_prediction_time.N_sample > 0) {
+            ROS_INFO_STREAM("[MultiSyncSimulator] obstacle prediction time: "
+                            << planning_time.obstacle_prediction_time.average
+                            << ", trajectory: " << planning_time.obstacle_traj_prediction_time.average
+                            << ", size: " << planning_time.obstacle_size_prediction_time.average);
+        }
+        if (planning_time.mapf_round_time.N_sample > 0) {
+            ROS_INFO_STREAM("[MultiSyncSimulator] MAPF time per step: " << planning_time.mapf_round_time.average
+                            << ", per group: " << planning_time.mapf_time.average
+                            << ", group imbalance: " << planning_time.mapf_group_imbalance.average
+                            << " (max " << planning_time.mapf_group_imbalance.max << ")");
+            if (param.grid_mapf_window > 0) {
+                ROS_INFO_STREAM("[MultiSyncSimulator] MAPF rolling plans reused: " << n_mapf_reused
+                                << " of " << planning_time.mapf_time.N_sample << " groups");
+            }
+        }
+        MAPF::DistanceTableStatistics distance_table_statistics = grid_based_planner->getDistanceTableStatistics();
+        if (distance_table_statistics.n_query > 0) {
+            ROS_INFO_STREAM("[MultiSyncSimulator] MAPF distance table hit rate: "
+                            << distance_table_statistics.getHitRate()
+                            << ", repaired: " << distance_table_statistics.n_repaired
+                            << ", invalidated: " << distance_table_statistics.n_invalidated
+                            << ", expanded cells: " << distance_table_statistics.n_expanded);
+        }
+
+        // solver thread scheduler
+        SolverThreadScheduler &scheduler = SolverThreadScheduler::getInstance();
+        SolverThreadStatistics solver_thread_statistics = scheduler.getTotalStatistics();
+        ROS_INFO_STREAM("[MultiSyncSimulator] solver threads: " << scheduler.getTotalThreads()
+                        << ", utilization: " << scheduler.getUtilization()
+                        << ", avg threads: " << solver_thread_statistics.getAverageThreads()
+                        << ", avg wait time: " << solver_thread_statistics.getAverageWaitTime()
+                        << ", max wait time: " << solver_thread_statistics.max_wait_time);
+
+        // QP failures diagnosed in the background
+        QPFailureDiagnoser::getInstance().flush();
+        if (QPFailureDiagnoser::getInstance().getNumDropped() > 0) {
+            ROS_WARN_STREAM("[MultiSyncSimulator] QP failure reports dropped: "
+                            << QPFailureDiagnoser::getInstance().getNumDropped());
+        }
+
+        // warm start
+        QPStatistics qp_statistics;
+        LSCCacheStatistics lsc_cache_statistics;
+        NeighborStatistics neighbor_statistics;
+        HorizonStatistics horizon_statistics;
+        FallbackStatistics fallback_statistics;
+        DeadlineStatistics deadline_statistics;
+        alloc_statistics = AllocStatistics();
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            qp_statistics.merge(agents[qi]->getPlanningStatistics().qp);
+            lsc_cache_statistics.merge(agents[qi]->getPlanningStatistics().lsc_cache);
+            neighbor_statistics.merge(agents[qi]->getPlanningStatistics().neighbor);
+            horizon_statistics.merge(agents[qi]->getPlanningStatistics().horizon);
+            fallback_statistics.merge(agents[qi]->getPlanningStatistics().fallback);
+            alloc_statistics.merge(agents[qi]->getPlanningStatistics().alloc);
+            deadline_statistics.merge(agents[qi]->getPlanningStatistics().deadline);
+        }
+        ROS_INFO_STREAM("[MultiSyncSimulator] QP iterations warm/cold: " << qp_statistics.warm_iterations.average
+                        << "/" << qp_statistics.cold_iterations.average
+                        << ", reduction: " << qp_statistics.getIterationReduction()
+                        << ", traj optimization time warm/cold: " << qp_statistics.warm_solve_time.average
+                        << "/" << qp_statistics.cold_solve_time.average
+                        << ", reduction: " << qp_statistics.getLatencyReduction());
+        ROS_INFO_STREAM("[MultiSyncSimulator] LSC rows per QP: " << qp_statistics.collision_rows.average
+                        << ", pruned: " << qp_statistics.pruned_rows.average
+                        << " (redundant: " << qp_statistics.redundant_rows.average << ")"
+                        << ", ratio: " << qp_statistics.getPruningRatio());
+        ROS_INFO_STREAM("[MultiSyncSimulator] LSC normal vector cache hit rate: " << lsc_cache_statistics.getHitRate()
+                        << " (" << lsc_cache_statistics.n_hit << "/" << lsc_cache_statistics.n_query << ")");
+        ROS_INFO_STREAM("[MultiSyncSimulator] obstacles per planning: " << neighbor_statistics.candidates.average
+                        << ", unreachable: " << neighbor_statistics.unreachable.average
+                        << ", over max_neighbors: " << neighbor_statistics.capped.average
+                        << ", pruning ratio: " << neighbor_statistics.getPruningRatio());
+        if (param.adaptive_horizon) {
+            ROS_INFO_STREAM("[MultiSyncSimulator] segments per planning: " << horizon_statistics.segments.average
+                            << " (min: " << horizon_statistics.segments.min << ", max: "
+                            << horizon_statistics.segments.max << " of " << param.M << ")"
+                            << ", horizon switches: " << horizon_statistics.n_switches);
+        }
+        if (fallback_statistics.n_fallbacks > 0) {
+            ROS_INFO_STREAM("[MultiSyncSimulator] QP failures: " << fallback_statistics.n_fallbacks
+                            << ", replaced by a sampled trajectory: " << fallback_statistics.n_feasible
+                            << ", candidates checked: " << fallback_statistics.candidates.average
+                            << ", fallback time: " << fallback_statistics.planning_time.average);
+        }
+        if (param.deadline_budget > 0 or param.deadline_mapf_budget > 0) {
+            ROS_INFO_STREAM("[MultiSyncSimulator] deadline misses: " << deadline_statistics.getNumMisses()
+                            << "/" << deadline_statistics.n_cycles << " cycles, SFC reused: "
+                            << deadline_statistics.n_sfc_reused
+                            << ", QP anytime/fallback: " << deadline_statistics.n_qp_anytime
+                            << "/" << deadline_statistics.n_qp_fallback
+                            << ", MAPF groups skipped: " << n_mapf_skipped
+                            << ", over budget: " << deadline_statistics.n_cycles_over_budget);
+        }
+
+        // heap allocations per agent per planning cycle
+        if (AllocStats::isCompiled()) {
+            for (const auto &stage: alloc_statistics.getStages()) {
+                ROS_INFO_STREAM("[MultiSyncSimulator] " << stage.first << " allocations: "
+                                << stage.second->n_allocations.average
+                                << ", bytes: " << stage.second->bytes.average
+                                << ", peak live bytes: " << stage.second->peak_live_bytes.average
+                                << " (max " << stage.second->peak_live_bytes.max << ")");
+            }
+        }
+
+        if (param.world_sfc_library) {
+            SFCLibraryStatistics sfc_library_statistics = SFCLibrary::getInstance().getStatistics();
+            ROS_INFO_STREAM("[MultiSyncSimulator] SFC library hit rate: " << sfc_library_statistics.getHitRate()
+                            << ", hit/query: " << sfc_library_statistics.n_hit
+                            << "/" << sfc_library_statistics.n_query
+                            << ", invalidated: " << sfc_library_statistics.n_invalidated
+                            << ", boxes: " << SFCLibrary::getInstance().size()
+                            << ", time saved: " << sfc_library_statistics.getTimeSaved());
+        }
+
+        if (not param.world_use_global_map) {
+            SensorStatistics sensor_statistics;
+            for (size_t qi = 0; qi < mission->qn; qi++) {
+                sensor_statistics.merge(agents[qi]->getSensorStatistics());
+            }
+            ROS_INFO_STREAM("[MultiSyncSimulator] virtual sensor (" << param.getSensorModeStr()
+                            << ") time: " << sensor_statistics.getAverageTime()
+                            << ", voxels per update: " << sensor_statistics.getAverageVoxels()
+                            << ", occupied/free: " << sensor_statistics.n_occupied_voxels
+                            << "/" << sensor_statistics.n_free_voxels
+                            << ", max time: " << sensor_statistics.time_histogram.getMax());
+            std::stringstream percentiles_ss;
+            for (double percentile: param.multisim_latency_percentiles) {
+                percentiles_ss << " p" << percentile << ": "
+                               << sensor_statistics.time_histogram.getPercentile(percentile);
+            }
+            ROS_INFO_STREAM("[MultiSyncSimulator] virtual sensor time per agent and step percentiles:"
+                            << percentiles_ss.str());
+        }
+
+        // The trajectory log is written before the summary
+        result_writer.close();
+        if (result_writer.getNumStalls() > 0) {
+            ROS_INFO_STREAM("[MultiSyncSimulator] result writer stalls: " << result_writer.getNumStalls());
+        }
+
+        // The summary is the only output of the headless simulator. The planning times of the distributed simulation
+        // are the ones of the agents of the process 0.
+        if ((param.multisim_save_result or param.multisim_headless) and param.multisim_process_index == 0) {
             saveSummarizedResultAsCSV();
         }
     }
 
+    void MultiSyncSimulator::sampleStates() {
+        // The same sample times as the accumulation of the save time step over a simulation step
+        size_t n_samples = 0;
+        for (double future_time = 0; future_time < param.multisim_time_step - SP_EPSILON_FLOAT;
+             future_time += param.multisim_save_time_step) {
+            n_samples++;
+        }
+        sampleTrajectories(param.multisim_save_time_step, n_samples, step_states);
+    }
+
+    void MultiSyncSimulator::sampleTrajectories(double time_step, size_t n_samples,
+                                                SampledStates &sampled_states) const {
+        // All agents at once if the trajectories share the segment times, otherwise one agent per task
+        std::vector<const traj_t *> trajs(mission->qn);
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            trajs[qi] = &agents.getTraj(qi);
+        }
+        TrajectoryBundle bundle;
+        if (bundle.build(trajs)) {
+            bundle.sample(time_step, n_samples, sampled_states);
+            return;
+        }
+
+        sampled_states.resize(mission->qn, time_step, n_samples);
+        auto sample_agent = [&](size_t qi) { sampled_states.sampleAgent(qi, agents.getTraj(qi)); };
+        if (batch_worker_pool != nullptr) {
+            batch_worker_pool->run(mission->qn, sample_agent);
+        } else {
+            for (size_t qi = 0; qi < mission->qn; qi++) {
+                sample_agent(qi);
+            }
+        }
+    }
+
     void MultiSyncSimulator::saveSimulationResult() {
-        double record_time_step = param.multisim_save_time_step;
-        double future_time = 0;
-        while (future_time < param.multisim_time_step - SP_EPSILON_FLOAT) {
-            for (size_t qi = 0; qi < mission.qn; qi++) {
-                msg_agent_trajectories.markers[qi].header.frame_id = param.world_frame_id;
-                msg_agent_trajectories.markers[qi].type = visualization_msgs::Marker::LINE_STRIP;
-                msg_agent_trajectories.markers[qi].action = visualization_msgs::Marker::ADD;
-                msg_agent_trajectories.markers[qi].ns = std::to_string(qi);
-                msg_agent_trajectories.markers[qi].id = qi;
-                msg_agent_trajectories.markers[qi].scale.x = 0.07;
-                msg_agent_trajectories.markers[qi].pose.position = defaultPoint();
-                msg_agent_trajectories.markers[qi].pose.orientation = defaultQuaternion();
-                msg_agent_trajectories.markers[qi].color = mission.color[qi];
-                msg_agent_trajectories.markers[qi].color.a = 0.75;
-                State future_state = agents[qi]->getFutureState(future_time);
-                msg_agent_trajectories.markers[qi].points.emplace_back(point3DToPointMsg(future_state.position));
-            }
-
-            for (size_t oi = 0; oi < mission.on; oi++) {
-                msg_obstacle_trajectories.markers[oi].header.frame_id = param.world_frame_id;
-                msg_obstacle_trajectories.markers[oi].type = visualization_msgs::Marker::LINE_STRIP;
-                msg_obstacle_trajectories.markers[oi].action = visualization_msgs::Marker::ADD;
-                msg_obstacle_trajectories.markers[oi].scale.x = 0.05;
-                msg_obstacle_trajectories.markers[oi].id = oi;
-
-                msg_obstacle_trajectories.markers[oi].color.r = 0;
-                msg_obstacle_trajectories.markers[oi].color.g = 0;
-                msg_obstacle_trajectories.markers[oi].color.b = 0;
-                msg_obstacle_trajectories.markers[oi].color.a = 1;
+        // The states of the agents are sampled once in step_states, for the trajectory history and the statistics
+        size_t n_samples = step_states.getNumSamples();
+
+        // The obstacle generator is not updated during the step
+        std::vector<Obstacle> sim_obstacles; // except the real obstacles
+        points_t obstacle_positions;
+        for (size_t oi = 0; oi < mission->on; oi++) {
+            if (mission->obstacles[oi]->getType() != "real") {
+                sim_obstacles.emplace_back(obstacle_generator.getObstacle(oi));
+                obstacle_positions.emplace_back(sim_obstacles.back().position);
+            }
+        }
 
-                Obstacle obstacle = obstacle_generator.getObstacle(oi);
-                msg_obstacle_trajectories.markers[oi].points.emplace_back(point3DToPointMsg(obstacle.position));
+        for (size_t sample = 0; sample < n_samples; sample++) {
+            // total flight distance
+            if (not last_sampled_positions.empty()) {
+                for (size_t qi = 0; qi < mission->qn; qi++) {
+                    total_distance += (step_states.getPosition(sample, qi) - last_sampled_positions[qi]).norm();
+                }
+            }
+            last_sampled_positions.resize(mission->qn);
+            for (size_t qi = 0; qi < mission->qn; qi++) {
+                last_sampled_positions[qi] = step_states.getPosition(sample, qi);
+            }
+
+            if (param.multisim_headless) {
+                continue;
+            }
+
+            for (size_t qi = 0; qi < mission->qn; qi++) {
+                agent_trajectory_history->addPoint(qi, point3DToPointMsg(step_states.getPosition(sample, qi)));
             }
 
-            future_time += record_time_step;
+            for (size_t oi = 0; oi < mission->on; oi++) {
+                Obstacle obstacle = obstacle_generator.getObstacle(oi);
+                obstacle_trajectory_history->addPoint(oi, point3DToPointMsg(obstacle.position));
+            }
         }
 
         // minimum distance
+        // A pair can lower the safety ratio or collide only if its safety ratio is below max(1, safety ratio),
+        // so only the pairs within the corresponding L-infinity range are checked.
+        double max_radius = 0, max_downwash = 1;
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            max_radius = std::max(max_radius, mission->agents[qi].radius);
+            max_downwash = std::max(max_downwash, mission->agents[qi].downwash);
+        }
+        double max_obs_radius = 0, max_obs_downwash = 1;
+        for (const auto &obstacle: sim_obstacles) {
+            max_obs_radius = std::max(max_obs_radius, obstacle.radius);
+            max_obs_downwash = std::max(max_obs_downwash, obstacle.downwash);
+        }
+        // The obstacles do not move in the samples, and safety_ratio_obs only decreases, so one grid is enough.
+        // With the offline metrics, the safety ratios are not tracked and only the collisions are checked.
+        bool offline_metrics = param.multisim_offline_metrics;
+        NeighborGrid obstacle_grid;
+        obstacle_grid.build(obstacle_positions,
+                            getCollisionRange(offline_metrics ? 1.0 : safety_ratio_obs, max_radius + max_obs_radius,
+                                              std::max(max_downwash, max_obs_downwash)));
+
         is_collided = false;
-        future_time = 0;
-        while (future_time < param.multisim_time_step - SP_EPSILON_FLOAT) {
-            for (size_t qi = 0; qi < mission.qn; qi++) {
-                State agent_state_i = agents[qi]->getFutureState(future_time);
-                point3d agent_position_i = agent_state_i.position;
-                point3d agent_velocity = agent_state_i.velocity;
-                point3d agent_acceleration = agent_state_i.acceleration;
+        if (param.multisim_continuous_collision_check) {
+            certifySafetyRatios(sim_obstacles);
+        }
+
+        points_t agent_positions(mission->qn);
+        NeighborGrid collision_grid;
+        std::vector<size_t> neighbors;
+        // The neighbors of an agent are gathered for the batch distance kernel
+        PointsSoA neighbor_positions;
+        std::vector<double> neighbor_downwashes, neighbor_distances;
+        for (size_t sample = 0; sample < n_samples; sample++) {
+            for (size_t qi = 0; qi < mission->qn; qi++) {
+                agent_positions[qi] = step_states.getPosition(sample, qi);
+            }
+            if (not param.multisim_continuous_collision_check) {
+                collision_grid.build(agent_positions,
+                                     getCollisionRange(offline_metrics ? 1.0 : safety_ratio_agent, 2 * max_radius,
+                                                       max_downwash));
+            }
+
+            for (size_t qi = 0; qi < mission->qn; qi++) {
+                point3d agent_position_i = agent_positions[qi];
+                State agent_state = step_states.getState(sample, qi);
+                point3d agent_velocity = agent_state.velocity;
+                point3d agent_acceleration = agent_state.acceleration;
+
+                // vel_excess_ratio, acc_excess_ratio
+                for (int i = 0; i < param.world_dimension and not offline_metrics; i++) {
+                    double curr_vel_excess_ratio =
+                            (agent_velocity(i) - mission->agents[qi].max_vel[i]) / mission->agents[qi].max_vel[i];
+                    if (curr_vel_excess_ratio > 0 and curr_vel_excess_ratio > vel_excess_ratio(i)) {
+                        vel_excess_ratio(i) = curr_vel_excess_ratio;
+                    }
+
+                    double curr_acc_excess_ratio =
+                            (agent_acceleration(i) - mission->agents[qi].max_acc[i]) / mission->agents[qi].max_acc[i];
+                    if (curr_acc_excess_ratio > 0 and curr_acc_excess_ratio > acc_excess_ratio(i)) {
+                        acc_excess_ratio(i) = curr_acc_excess_ratio;
+                    }
+                }
+
+                // The safety ratios are certified over the whole step instead of the samples
+                if (param.multisim_continuous_collision_check) {
+                    continue;
+                }
 
                 // safety_ratio_agent
                 double current_safety_ratio_agent = SP_INFINITY;
                 int min_qj = -1;
-                for (size_t qj = 0; qj < mission.qn; qj++) {
-                    if (qi == qj) {
-                        continue;
-                    }
-
-                    double downwash = (mission.agents[qi].downwash * mission.agents[qi].radius +
-                                       mission.agents[qj].downwash * mission.agents[qj].radius) /
-                                      (mission.agents[qi].radius + mission.agents[qj].radius);
-                    State agent_state_j = agents[qj]->getFutureState(future_time);
-                    point3d agent_position_j = agent_state_j.position;
-                    double dist_to_agent = ellipsoidalDistance(agent_position_i, agent_position_j, downwash);
-                    double safety_ratio = dist_to_agent / (mission.agents[qi].radius + mission.agents[qj].radius);
+                collision_grid.getNeighbors(qi, true, neighbors);
+                neighbor_positions.clear();
+                neighbor_downwashes.clear();
+                for (size_t qj: neighbors) {
+                    neighbor_positions.emplace_back(agent_positions[qj]);
+                    neighbor_downwashes.emplace_back(
+                            (mission->agents[qi].downwash * mission->agents[qi].radius +
+                             mission->agents[qj].downwash * mission->agents[qj].radius) /
+                            (mission->agents[qi].radius + mission->agents[qj].radius));
+                }
+                neighbor_distances.resize(neighbors.size());
+                GeometryKernels::ellipsoidalDistances(agent_position_i, neighbor_positions,
+                                                      neighbor_downwashes.data(), neighbor_distances.data());
+                for (size_t ni = 0; ni < neighbors.size(); ni++) {
+                    size_t qj = neighbors[ni];
+                    double dist_to_agent = neighbor_distances[ni];
+                    double safety_ratio = dist_to_agent / (mission->agents[qi].radius + mission->agents[qj].radius);
                     if (safety_ratio < current_safety_ratio_agent) {
                         current_safety_ratio_agent = safety_ratio;
                         min_qj = qj;
                     }
-                    if (safety_ratio < safety_ratio_agent) {
+                    if (not offline_metrics and safety_ratio < safety_ratio_agent) {
                         safety_ratio_agent = safety_ratio;
                     }
                 }
@@ -525,25 +2124,27 @@ namespace DynamicPlanning {
 
                 // safety_ratio_obs
                 double current_safety_ratio_obs = SP_INFINITY;
-                for (size_t oi = 0; oi < mission.on; oi++) {
-                    Obstacle obstacle;
-
-                    if (mission.obstacles[oi]->getType() == "real") {
-                        continue;
-                    } else {
-                        obstacle = obstacle_generator.getObstacle(oi);
-                    }
-
-                    point3d obs_position = obstacle.position;
-                    double downwash = (obstacle.radius * obstacle.downwash +
-                                       mission.agents[qi].radius * mission.agents[qi].downwash) /
-                                      (mission.agents[qi].radius + obstacle.radius);
-                    double dist_to_obs = ellipsoidalDistance(agent_position_i, obs_position, downwash);
-                    double safety_ratio = dist_to_obs / (mission.agents[qi].radius + obstacle.radius);
+                obstacle_grid.getNeighbors(agent_position_i, true, neighbors);
+                neighbor_positions.clear();
+                neighbor_downwashes.clear();
+                for (size_t si: neighbors) {
+                    const Obstacle &obstacle = sim_obstacles[si];
+                    neighbor_positions.emplace_back(obstacle.position);
+                    neighbor_downwashes.emplace_back((obstacle.radius * obstacle.downwash +
+                                                      mission->agents[qi].radius * mission->agents[qi].downwash) /
+                                                     (mission->agents[qi].radius + obstacle.radius));
+                }
+                neighbor_distances.resize(neighbors.size());
+                GeometryKernels::ellipsoidalDistances(agent_position_i, neighbor_positions,
+                                                      neighbor_downwashes.data(), neighbor_distances.data());
+                for (size_t ni = 0; ni < neighbors.size(); ni++) {
+                    const Obstacle &obstacle = sim_obstacles[neighbors[ni]];
+                    double dist_to_obs = neighbor_distances[ni];
+                    double safety_ratio = dist_to_obs / (mission->agents[qi].radius + obstacle.radius);
                     if (safety_ratio < current_safety_ratio_obs) {
                         current_safety_ratio_obs = safety_ratio;
                     }
-                    if (safety_ratio < safety_ratio_obs) {
+                    if (not offline_metrics and safety_ratio < safety_ratio_obs) {
                         safety_ratio_obs = safety_ratio;
                     }
                 }
@@ -556,167 +2157,353 @@ namespace DynamicPlanning {
                                                                                        << agents[qi]->getPlannerSeq());
                     is_collided = true;
                 }
-
-                // vel_excess_ratio, acc_excess_ratio
-                for (int i = 0; i < param.world_dimension; i++) {
-                    double curr_vel_excess_ratio =
-                            (agent_velocity(i) - mission.agents[qi].max_vel[i]) / mission.agents[qi].max_vel[i];
-                    if (curr_vel_excess_ratio > 0 and curr_vel_excess_ratio > vel_excess_ratio(i)) {
-                        vel_excess_ratio(i) = curr_vel_excess_ratio;
-                    }
-
-                    double curr_acc_excess_ratio =
-                            (agent_acceleration(i) - mission.agents[qi].max_acc[i]) / mission.agents[qi].max_acc[i];
-                    if (curr_acc_excess_ratio > 0 and curr_acc_excess_ratio > acc_excess_ratio(i)) {
-                        acc_excess_ratio(i) = curr_acc_excess_ratio;
-                    }
-                }
             }
-
-            future_time += record_time_step;
         }
 
-        // planning time
-        for (size_t qi = 0; qi < mission.qn; qi++) {
+        // planning time, the agents following their previous trajectories did not plan
+        for (size_t qi: replanning_agents) {
             PlanningTimeStatistics agent_planning_time = agents[qi]->getPlanningStatistics().planning_time;
             planning_time.update(agent_planning_time);
+
+            SimulatorMetrics &metrics = getMetrics();
+            metrics.obstacle_prediction.record(agent_planning_time.obstacle_prediction_time.current);
+            metrics.initial_traj_planning.record(agent_planning_time.initial_traj_planning_time.current);
+            metrics.goal_planning.record(agent_planning_time.goal_planning_time.current);
+            metrics.lsc_generation.record(agent_planning_time.lsc_generation_time.current);
+            metrics.sfc_generation.record(agent_planning_time.sfc_generation_time.current);
+            metrics.traj_optimization.record(agent_planning_time.traj_optimization_time.current);
+            metrics.planning.record(agent_planning_time.total_planning_time.current);
         }
     }
 
-    void MultiSyncSimulator::saveSimulationResultAsCSV() {
-        std::string file_name = param.package_path + "/log/simulation_" + mission_start_time + "_" + file_name_param + ".csv";
-        std::ofstream result_csv;
-        result_csv.open(file_name, std::ios_base::app);
-        if (sim_current_time == sim_start_time) {
-            for (size_t qi = 0; qi < mission.qn; qi++) {
-                result_csv << "id,t,px,py,pz,vx,vy,vz,ax,ay,az,planning_time";
-                if (qi < mission.qn - 1 or mission.on != 0) {
-                    result_csv << ",";
-                } else {
-                    result_csv << "\n";
+    double MultiSyncSimulator::getCollisionRange(double safety_ratio, double radius_sum, double downwash) {
+        double safety_ratio_bound = std::max(1.0, safety_ratio);
+        return safety_ratio_bound < SP_INFINITY ? safety_ratio_bound * radius_sum * downwash : -1;
+    }
+
+    void MultiSyncSimulator::certifySafetyRatios(const std::vector<Obstacle> &sim_obstacles) {
+        // The executed part of the trajectories, [0, multisim_time_step], split at the segment boundaries of all
+        // agents so that the pieces of two agents are on the same time interval
+        double step_time = param.multisim_time_step;
+        std::vector<double> breakpoints = {0, step_time};
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            const traj_t &traj = agents[qi]->getTraj();
+            double segment_end_time = 0;
+            for (int m = 0; m < traj.size(); m++) {
+                segment_end_time += traj[m].segment_time;
+                if (segment_end_time < step_time - SP_EPSILON_FLOAT) {
+                    breakpoints.emplace_back(segment_end_time);
+                }
+            }
+        }
+        std::sort(breakpoints.begin(), breakpoints.end());
+        breakpoints.erase(std::unique(breakpoints.begin(), breakpoints.end(),
+                                      [](double a, double b) { return b - a < SP_EPSILON_FLOAT; }),
+                          breakpoints.end());
+        size_t n_pieces = breakpoints.size() - 1;
+
+        // pieces[qi * n_pieces + p]: the agent qi on [breakpoints[p], breakpoints[p + 1]]
+        std::vector<Segment<point3d>> pieces(mission->qn * n_pieces);
+        points_t box_centers(mission->qn), box_mins(mission->qn), box_maxs(mission->qn);
+        double max_half_extent = 0;
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            const traj_t &traj = agents[qi]->getTraj();
+            int m = 0;
+            double segment_start_time = 0;
+            for (size_t p = 0; p < n_pieces; p++) {
+                while (m + 1 < traj.size() and
+                       breakpoints[p] > segment_start_time + traj[m].segment_time - SP_EPSILON_FLOAT) {
+                    segment_start_time += traj[m].segment_time;
+                    m++;
                 }
+                double t_normalized_0 = (breakpoints[p] - segment_start_time) / traj[m].segment_time;
+                double t_normalized_f = (breakpoints[p + 1] - segment_start_time) / traj[m].segment_time;
+                pieces[qi * n_pieces + p] = traj[m].subSegment(std::min(t_normalized_0, 1.0),
+                                                               std::min(t_normalized_f, 1.0));
             }
 
-            for (size_t oi = 0; oi < mission.on; oi++) {
-                result_csv << "obs_id,t,px,py,pz,size";
-                if (oi < mission.on - 1) {
-                    result_csv << ",";
-                } else {
-                    result_csv << "\n";
+            // The bounding box of the control points contains the agent during the step
+            point3d box_min = pieces[qi * n_pieces].startPoint(), box_max = box_min;
+            for (size_t p = 0; p < n_pieces; p++) {
+                for (const auto &control_point: pieces[qi * n_pieces + p].control_points) {
+                    for (int k = 0; k < 3; k++) {
+                        box_min(k) = std::min(box_min(k), control_point(k));
+                        box_max(k) = std::max(box_max(k), control_point(k));
+                    }
                 }
             }
+            box_centers[qi] = (box_min + box_max) * 0.5;
+            box_mins[qi] = box_min;
+            box_maxs[qi] = box_max;
+            for (int k = 0; k < 3; k++) {
+                max_half_extent = std::max(max_half_extent, 0.5 * (box_max(k) - box_min(k)));
+            }
         }
 
-        double record_time_step = param.multisim_save_time_step;
-        double future_time = 0;
-        double t = (sim_current_time - sim_start_time).toSec();
-        while (future_time < param.multisim_time_step) {
-            for (size_t qi = 0; qi < mission.qn; qi++) {
-                State future_state = agents[qi]->getFutureState(future_time);
-                PlanningStatistics statistics = agents[qi]->getPlanningStatistics();
-                result_csv << qi << "," << t << ","
-                           << future_state.position.x() << ","
-                           << future_state.position.y() << ","
-                           << future_state.position.z() << ","
-                           << future_state.velocity.x() << ","
-                           << future_state.velocity.y() << ","
-                           << future_state.velocity.z() << ","
-                           << future_state.acceleration.x() << ","
-                           << future_state.acceleration.y() << ","
-                           << future_state.acceleration.z() << ","
-                           << statistics.planning_time.total_planning_time.current;
-
-                if (qi < mission.qn - 1 or mission.on != 0) {
-                    result_csv << ",";
-                } else {
-                    result_csv << "\n";
+        // The bounds of the minimum distance of the relative trajectories over the step. Only the distances
+        // below the current safety ratio are refined, and the reported safety ratio is a lower bound within the
+        // tolerance, so a violation between the samples is not missed. The other is an agent if other_pieces is
+        // given, otherwise a static obstacle at other_position.
+        static constexpr double SAFETY_RATIO_TOLERANCE = 1e-3;
+        auto getMinimumDistance = [&](size_t qi, const Segment<point3d> *other_pieces, const point3d &other_position,
+                                      double downwash, double radius_sum, double safety_ratio) {
+            double cutoff = std::max(1.0, safety_ratio) * radius_sum;
+            double min_dist = SP_INFINITY;
+            std::array<point3d, MAX_BERNSTEIN_DEGREE + 1> control_points_rel;
+            for (size_t p = 0; p < n_pieces; p++) {
+                const ControlPoints<point3d> &control_points = pieces[qi * n_pieces + p].control_points;
+                int n = (int)control_points.size() - 1;
+                for (int i = 0; i < n + 1; i++) {
+                    control_points_rel[i] = control_points[i] -
+                                            (other_pieces != nullptr ? other_pieces[p][i] : other_position);
+                    control_points_rel[i].z() = control_points_rel[i].z() / downwash;
                 }
+                double lower, upper;
+                minimumDistanceBounds(control_points_rel.data(), n, SAFETY_RATIO_TOLERANCE * radius_sum,
+                                      std::min(cutoff, min_dist), lower, upper);
+                min_dist = std::min(min_dist, lower);
             }
+            return min_dist;
+        };
 
+        double max_radius = 0, max_downwash = 1;
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            max_radius = std::max(max_radius, mission->agents[qi].radius);
+            max_downwash = std::max(max_downwash, mission->agents[qi].downwash);
+        }
+        double agent_range = getCollisionRange(safety_ratio_agent, 2 * max_radius, max_downwash);
+        NeighborGrid collision_grid;
+        collision_grid.build(box_centers, agent_range < 0 ? -1 : agent_range + 2 * max_half_extent);
+
+        // A pair is refined only if the gap of the boxes of its control points is below the cutoff, the boxes
+        // contain the agents during the step. The lower bound of the distance of the boxes with the downwash:
+        auto getBoxDistance = [&](size_t qi, const point3d &other_min, const point3d &other_max, double downwash) {
+            double dist_sq = 0;
+            for (int k = 0; k < 3; k++) {
+                double gap = std::max({0.0, box_mins[qi](k) - other_max(k), other_min(k) - box_maxs[qi](k)});
+                if (k == 2) {
+                    gap /= downwash;
+                }
+                dist_sq += gap * gap;
+            }
+            return std::sqrt(dist_sq);
+        };
+
+        // The pairs of each agent are refined in parallel with the safety ratios at the start as the cutoffs, so
+        // the result does not depend on the schedule, and the results are merged in the order of the agents
+        struct PairCollision {
+            size_t other;
+            double safety_ratio;
+        };
+        std::vector<double> agent_safety_ratios(mission->qn, SP_INFINITY), obs_safety_ratios(mission->qn, SP_INFINITY);
+        std::vector<std::vector<PairCollision>> agent_collisions(mission->qn);
+        double initial_safety_ratio_agent = safety_ratio_agent;
+        WorkerPool::getInstance().run(mission->qn, [&](size_t qi) {
+            std::vector<size_t> neighbors;
+            collision_grid.getNeighbors(qi, true, neighbors);
+            for (size_t qj: neighbors) {
+                if (qj < qi) {
+                    continue;
+                }
+                double radius_sum = mission->agents[qi].radius + mission->agents[qj].radius;
+                double downwash = (mission->agents[qi].downwash * mission->agents[qi].radius +
+                                   mission->agents[qj].downwash * mission->agents[qj].radius) / radius_sum;
+                if (getBoxDistance(qi, box_mins[qj], box_maxs[qj], downwash) >=
+                    std::max(1.0, initial_safety_ratio_agent) * radius_sum) {
+                    continue;
+                }
+                double safety_ratio = getMinimumDistance(qi, &pieces[qj * n_pieces], point3d(0, 0, 0), downwash,
+                                                         radius_sum, initial_safety_ratio_agent) / radius_sum;
+                agent_safety_ratios[qi] = std::min(agent_safety_ratios[qi], safety_ratio);
+                if (safety_ratio < 1) {
+                    agent_collisions[qi].push_back({qj, safety_ratio});
+                }
+            }
+        });
 
-            for (size_t oi = 0; oi < mission.on; oi++) {
-                Obstacle obstacle = obstacle_generator.getObstacle(oi);
-                result_csv << oi << "," << t << ","
-                           << obstacle.position.x() << ","
-                           << obstacle.position.y() << ","
-                           << obstacle.position.z() << ","
-                           << obstacle.radius;
-                if (oi < mission.on - 1) {
-                    result_csv << ",";
-                } else {
-                    result_csv << "\n";
+        // safety_ratio_agent
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            if (agent_safety_ratios[qi] < safety_ratio_agent) {
+                safety_ratio_agent = agent_safety_ratios[qi];
+            }
+            for (const PairCollision &collision: agent_collisions[qi]) {
+                ROS_ERROR_STREAM("[MultiSyncSimulator] collision with agents, agent_id: (" << qi << ","
+                                                                                           << collision.other
+                                                                                           << "), safety_ratio:"
+                                                                                           << collision.safety_ratio);
+                is_collided = true;
+            }
+        }
+
+        // safety_ratio_obs, the obstacles do not move during the step
+        double max_obs_radius = 0, max_obs_downwash = 1;
+        points_t obstacle_positions;
+        for (const auto &obstacle: sim_obstacles) {
+            max_obs_radius = std::max(max_obs_radius, obstacle.radius);
+            max_obs_downwash = std::max(max_obs_downwash, obstacle.downwash);
+            obstacle_positions.emplace_back(obstacle.position);
+        }
+        double obs_range = getCollisionRange(safety_ratio_obs, max_radius + max_obs_radius,
+                                             std::max(max_downwash, max_obs_downwash));
+        NeighborGrid obstacle_grid;
+        obstacle_grid.build(obstacle_positions, obs_range < 0 ? -1 : obs_range + max_half_extent);
+        double initial_safety_ratio_obs = safety_ratio_obs;
+        WorkerPool::getInstance().run(mission->qn, [&](size_t qi) {
+            std::vector<size_t> neighbors;
+            obstacle_grid.getNeighbors(box_centers[qi], true, neighbors);
+            for (size_t si: neighbors) {
+                const Obstacle &obstacle = sim_obstacles[si];
+                double radius_sum = mission->agents[qi].radius + obstacle.radius;
+                double downwash = (obstacle.radius * obstacle.downwash +
+                                   mission->agents[qi].radius * mission->agents[qi].downwash) / radius_sum;
+                if (getBoxDistance(qi, obstacle.position, obstacle.position, downwash) >=
+                    std::max(1.0, initial_safety_ratio_obs) * radius_sum) {
+                    continue;
                 }
+                double safety_ratio = getMinimumDistance(qi, nullptr, obstacle.position, downwash, radius_sum,
+                                                         initial_safety_ratio_obs) / radius_sum;
+                obs_safety_ratios[qi] = std::min(obs_safety_ratios[qi], safety_ratio);
+            }
+        });
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            double current_safety_ratio_obs = obs_safety_ratios[qi];
+            if (current_safety_ratio_obs < safety_ratio_obs) {
+                safety_ratio_obs = current_safety_ratio_obs;
             }
+            if (current_safety_ratio_obs < 1) {
+                ROS_ERROR_STREAM(
+                        "[MultiSyncSimulator] collision with obstacles, agent_id:" << qi
+                                                                                   << ", current_safety_ratio:"
+                                                                                   << current_safety_ratio_obs
+                                                                                   << ", planner_seq:"
+                                                                                   << agents[qi]->getPlannerSeq());
+                is_collided = true;
+            }
+        }
+    }
+
+    void MultiSyncSimulator::saveSimulationResultAsLog() {
+        if (not result_writer.isOpen()) {
+            std::string file_name = param.package_path + "/log/simulation_" + mission_start_time + "_" +
+                                    file_name_param + (param.multisim_save_binary ? ".lsclog" : ".csv");
+            result_writer.open(file_name, param.multisim_save_binary ? AsyncResultWriter::Format::BINARY
+                                                                     : AsyncResultWriter::Format::CSV,
+                               mission->qn, mission->on, param.multisim_save_time_step);
+        }
 
-            future_time += record_time_step;
-            t += record_time_step;
+        // Copy the frames from the sampled states, the writer thread formats and writes them
+        std::vector<float> planning_times(mission->qn);
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            planning_times[qi] =
+                    (float) agents[qi]->getPlanningStatistics().planning_time.total_planning_time.current;
         }
+        double t = (sim_current_time - sim_start_time).toSec();
+        for (size_t sample = 0; sample < step_states.getNumSamples(); sample++) {
+            std::vector<float> frame = result_writer.acquireFrame();
+            frame[0] = (float) t;
+            for (size_t qi = 0; qi < mission->qn; qi++) {
+                float *agent = frame.data() + TrajectoryLog::getAgentOffset(qi);
+                for (int field = SampledStates::PX; field < SampledStates::N_FIELDS; field++) {
+                    // The fields of a state are in the same order in both layouts
+                    agent[TrajectoryLog::AGENT_PX + field] =
+                            step_states.getField(static_cast<SampledStates::Field>(field), qi)[sample];
+                }
+                agent[TrajectoryLog::AGENT_PLANNING_TIME] = planning_times[qi];
+            }
 
-        result_csv.close();
+            for (size_t oi = 0; oi < mission->on; oi++) {
+                Obstacle obstacle = obstacle_generator.getObstacle(oi);
+                float *obstacle_values = frame.data() + TrajectoryLog::getObstacleOffset(mission->qn, oi);
+                for (int i = 0; i < 3; i++) {
+                    obstacle_values[TrajectoryLog::OBSTACLE_PX + i] = (float) obstacle.position(i);
+                }
+                obstacle_values[TrajectoryLog::OBSTACLE_RADIUS] = (float) obstacle.radius;
+            }
+
+            result_writer.push(std::move(frame));
+            t += step_states.getTimeStep();
+        }
     }
 
     void MultiSyncSimulator::saveSummarizedResultAsCSV() {
-        std::string file_name = param.package_path + "/log/summary_" + file_name_param + ".csv";
-        std::ifstream result_csv_in(file_name);
-        bool print_description = false;
-        if (not result_csv_in or result_csv_in.peek() == std::ifstream::traits_type::eof()) {
-            print_description = true;
-        }
-
-        std::ofstream result_csv_out;
-        result_csv_out.open(file_name, std::ios_base::app);
-        if (print_description) {
-            result_csv_out << "start_time,total_flight_time,total_flight_distance,"
-                           << "safety_ratio_agent,safety_ratio_obs,"
-                           << "vel_excess_ratio,acc_excess_ratio,"
-                           << "mapf_time_average,mapf_time_min,mapf_time_max,"
-                           << "planning_time_average,planning_time_min,planning_time_max,"
-                           << "initial_traj_planning_time,obstacle_prediction_time,goal_planning_time,"
-                           << "lsc_generation_time,sfc_generation_time,traj_optimization_time,"
-                           << "mission_file_name,world_file_name,"
-                           << "planner_mode,goal_mode,mapf_mode,"
-                           << "communication_range,world_dimension,M,dt\n";
-        }
-        result_csv_out << mission_start_time << ","
-                       << total_flight_time << ","
-                       << total_distance << ","
-                       << safety_ratio_agent << ","
-                       << safety_ratio_obs << ","
-                       << vel_excess_ratio.norm() << ","
-                       << acc_excess_ratio.norm() << ","
-                       << planning_time.mapf_time.average << ","
-                       << planning_time.mapf_time.min << ","
-                       << planning_time.mapf_time.max << ","
-                       << planning_time.total_planning_time.average << ","
-                       << planning_time.total_planning_time.min << ","
-                       << planning_time.total_planning_time.max << ","
-                       << planning_time.initial_traj_planning_time.average << ","
-                       << planning_time.obstacle_prediction_time.average << ","
-                       << planning_time.goal_planning_time.average << ","
-                       << planning_time.lsc_generation_time.average << ","
-                       << planning_time.sfc_generation_time.average << ","
-                       << planning_time.traj_optimization_time.average << ","
-                       << mission.current_mission_file_name << ","
-                       << mission.current_world_file_name << ","
-                       << param.getPlannerModeStr() << ","
-                       << param.getGoalModeStr() << ","
-                       << param.getMAPFModeStr() << ","
-                       << param.communication_range << ","
-                       << param.world_dimension << ","
-                       << param.M << ","
-                       << param.dt << "\n";
-        result_csv_out.close();
-    }
-
-    double MultiSyncSimulator::getTotalDistance() {
-        double dist_total = 0;
-        for (size_t qi = 0; qi < mission.qn; qi++) {
-            for (int i = 0; i < (int) msg_agent_trajectories.markers[qi].points.size() - 1; i++) {
-                dist_total += (pointMsgToPoint3d(msg_agent_trajectories.markers[qi].points[i + 1]) -
-                               pointMsgToPoint3d(msg_agent_trajectories.markers[qi].points[i])).norm();
-            }
-        }
-        return dist_total;
+        // The processes of the shards do not share the summary file
+        std::string shard_suffix = param.multisim_num_shards > 1 ?
+                                   "_shard" + std::to_string(param.multisim_shard_index) : "";
+        std::string file_name = param.package_path + "/log/summary_" + file_name_param + shard_suffix + ".csv";
+        // The header and the row are appended together under the lock of the file, see SummaryLog
+        std::ostringstream header;
+        header << "start_time,total_flight_time,total_flight_distance,"
+               << "safety_ratio_agent,safety_ratio_obs,"
+               << "vel_excess_ratio,acc_excess_ratio,"
+               << "mapf_time_average,mapf_time_min,mapf_time_max,"
+               << "planning_time_average,planning_time_min,planning_time_max,"
+               << "initial_traj_planning_time,obstacle_prediction_time,goal_planning_time,"
+               << "lsc_generation_time,sfc_generation_time,traj_optimization_time,"
+               << "mission_file_name,world_file_name,"
+               << "planner_mode,goal_mode,mapf_mode,"
+               << "communication_range,world_dimension,M,dt,real_time_factor";
+        for (const auto &histogram: planning_time.getHistograms()) {
+            for (double percentile: param.multisim_latency_percentiles) {
+                header << "," << histogram.first << "_p" << percentile;
+            }
+        }
+        for (const auto &stage: planning_time.getCPUStages()) {
+            header << "," << std::get<0>(stage) << "_cpu_time," << std::get<0>(stage) << "_wait_time";
+        }
+        if (AllocStats::isCompiled()) {
+            for (const auto &stage: alloc_statistics.getStages()) {
+                header << "," << stage.first << "_allocations,"
+                       << stage.first << "_alloc_bytes,"
+                       << stage.first << "_peak_live_bytes";
+            }
+        }
+
+        std::ostringstream row;
+        row << mission_start_time << ","
+            << total_flight_time << ","
+            << total_distance << ","
+            << safety_ratio_agent << ","
+            << safety_ratio_obs << ","
+            << vel_excess_ratio.norm() << ","
+            << acc_excess_ratio.norm() << ","
+            << planning_time.mapf_time.average << ","
+            << planning_time.mapf_time.min << ","
+            << planning_time.mapf_time.max << ","
+            << planning_time.total_planning_time.average << ","
+            << planning_time.total_planning_time.min << ","
+            << planning_time.total_planning_time.max << ","
+            << planning_time.initial_traj_planning_time.average << ","
+            << planning_time.obstacle_prediction_time.average << ","
+            << planning_time.goal_planning_time.average << ","
+            << planning_time.lsc_generation_time.average << ","
+            << planning_time.sfc_generation_time.average << ","
+            << planning_time.traj_optimization_time.average << ","
+            << mission->current_mission_file_name << ","
+            << mission->current_world_file_name << ","
+            << param.getPlannerModeStr() << ","
+            << param.getGoalModeStr() << ","
+            << param.getMAPFModeStr() << ","
+            << param.communication_range << ","
+            << param.world_dimension << ","
+            << param.M << ","
+            << param.dt << ","
+            << real_time_factor;
+        for (const auto &histogram: planning_time.getHistograms()) {
+            for (double percentile: param.multisim_latency_percentiles) {
+                row << "," << histogram.second->getPercentile(percentile);
+            }
+        }
+        for (const auto &stage: planning_time.getCPUStages()) {
+            row << "," << std::get<1>(stage)->cpu_time.average << "," << std::get<1>(stage)->wait_time.average;
+        }
+        if (AllocStats::isCompiled()) {
+            for (const auto &stage: alloc_statistics.getStages()) {
+                row << "," << stage.second->n_allocations.average
+                    << "," << stage.second->bytes.average
+                    << "," << stage.second->peak_live_bytes.average;
+            }
+        }
+        SummaryLog::append(file_name, header.str(), row.str());
     }
 
     void MultiSyncSimulator::globalMapCallback(const sensor_msgs::PointCloud2 &global_map) {
@@ -724,8 +2511,23 @@ namespace DynamicPlanning {
             return;
         }
 
-        for (size_t qi = 0; qi < mission.qn; qi++) {
-            agents[qi]->setGlobalMap(global_map);
+        // One point cloud and kd-tree for all agents, the virtual sensors query it concurrently
+        PointCloudIngestionReport report;
+        std::shared_ptr<const GlobalPointCloud> global_cloud = GlobalPointCloud::build(global_map,
+                                                                                       param.world_resolution,
+                                                                                       report);
+        if (global_cloud == nullptr) {
+            ROS_ERROR("[MultiSyncSimulator] Fail to parse the global map, the x, y and z fields must be float32 or "
+                      "float64");
+            return;
+        }
+        ROS_INFO_STREAM("[MultiSyncSimulator] Global map: " << report.n_input_points << " points, "
+                        << report.n_valid_points << " valid, " << report.n_voxels << " voxels, parse "
+                        << report.parse_time << " s, voxel hashing " << report.hash_time << " s, kd-tree "
+                        << global_cloud->getBuildTime() << " s");
+
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            agents[qi]->setGlobalMap(global_cloud);
         }
         has_global_map = true;
     }
@@ -754,103 +2556,101 @@ namespace DynamicPlanning {
         return true;
     }
 
-    void MultiSyncSimulator::publishCollisionModel() {
-        visualization_msgs::MarkerArray msg_collision_model;
-        msg_collision_model.markers.clear();
-
-        visualization_msgs::Marker marker;
-        marker.header.frame_id = param.world_frame_id;
-        marker.type = visualization_msgs::Marker::SPHERE;
-        marker.action = visualization_msgs::Marker::ADD;
+    bool MultiSyncSimulator::updateParamCallback(std_srvs::Empty::Request &req, std_srvs::Empty::Response &res) {
+        param_update_requested = true;
+        ROS_INFO("[MultiSyncSimulator] Update parameters before the next step");
+        return true;
+    }
 
-        for (size_t qi = 0; qi < mission.qn; qi++) {
-            marker.color = mission.color[qi];
+    void MultiSyncSimulator::collisionModelToMsg(const VisualizationSnapshot &snapshot,
+                                                 visualization_msgs::MarkerArray &msg) {
+        const Param &param = *snapshot.param;
+        const std::shared_ptr<const Mission> &mission = snapshot.mission;
+        msg.markers.resize(mission->qn);
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            visualization_msgs::Marker &marker = msg.markers[qi];
+            marker.header.frame_id = param.world_frame_id;
+            marker.type = visualization_msgs::Marker::SPHERE;
+            marker.action = visualization_msgs::Marker::ADD;
+            marker.color = mission->color[qi];
             marker.color.a = 0.6;
 
-            marker.scale.x = 2 * mission.agents[qi].radius;
-            marker.scale.y = 2 * mission.agents[qi].radius;
-            marker.scale.z = 2 * mission.agents[qi].radius * mission.agents[qi].downwash;
+            marker.scale.x = 2 * mission->agents[qi].radius;
+            marker.scale.y = 2 * mission->agents[qi].radius;
+            marker.scale.z = 2 * mission->agents[qi].radius * mission->agents[qi].downwash;
 
             marker.id = qi;
-            State current_state = agents[qi]->getCurrentState();
-            marker.pose.position = point3DToPointMsg(current_state.position);
+            marker.pose.position = point3DToPointMsg(snapshot.current_states[qi].position);
             marker.pose.orientation = defaultQuaternion();
-
-            msg_collision_model.markers.emplace_back(marker);
         }
-        pub_collision_model.publish(msg_collision_model);
     }
 
-    void MultiSyncSimulator::publishStartGoalPoints() {
-        visualization_msgs::MarkerArray msg_start_goal_points_vis;
+    void MultiSyncSimulator::startGoalPointsToMsg(const VisualizationSnapshot &snapshot,
+                                                  visualization_msgs::MarkerArray &msg) {
+        const Param &param = *snapshot.param;
+        const std::shared_ptr<const Mission> &mission = snapshot.mission;
+        size_t n_markers_per_agent = param.goal_mode == GoalMode::GRIDBASEDPLANNER ? 4 : 3;
+        msg.markers.resize(n_markers_per_agent * mission->qn);
 
-        for (int qi = 0; qi < mission.qn; qi++) {
-            visualization_msgs::Marker marker;
+        size_t marker_idx = 0;
+        auto nextMarker = [&](const std::string &ns, int qi, int type) -> visualization_msgs::Marker & {
+            visualization_msgs::Marker &marker = msg.markers[marker_idx++];
             marker.header.frame_id = param.world_frame_id;
             marker.action = visualization_msgs::Marker::ADD;
-            marker.color = mission.color[qi];
+            marker.color = mission->color[qi];
             marker.color.a = 0.7;
-
-            marker.ns = "start";
-            marker.id = qi;
-            marker.type = visualization_msgs::Marker::SPHERE;
-            marker.scale.x = 0.1;
-            marker.scale.y = 0.1;
-            marker.scale.z = 0.1;
-            marker.pose.position = point3DToPointMsg(mission.agents[qi].start_point);
-            marker.pose.orientation = point3DToQuaternionMsg(point3d(0, 0, 0));
-            msg_start_goal_points_vis.markers.emplace_back(marker);
-
-            point3d agent_desired_goal = agents[qi]->getDesiredGoalPoint();
-            marker.ns = "desired_goal";
-            marker.id = qi;
-            marker.type = visualization_msgs::Marker::CUBE;
-            marker.scale.x = 0.1;
-            marker.scale.y = 0.1;
-            marker.scale.z = 0.1;
-            marker.pose.position = point3DToPointMsg(agent_desired_goal);
-            marker.pose.orientation = defaultQuaternion();
-            msg_start_goal_points_vis.markers.emplace_back(marker);
-
-            point3d agent_current_goal = agents[qi]->getCurrentGoalPoint();
-            marker.ns = "current_goal";
+            marker.ns = ns;
             marker.id = qi;
-            marker.type = visualization_msgs::Marker::SPHERE;
+            marker.type = type;
             marker.scale.x = 0.1;
             marker.scale.y = 0.1;
             marker.scale.z = 0.1;
-            marker.pose.position = point3DToPointMsg(agent_current_goal);
-            marker.pose.orientation = point3DToQuaternionMsg(point3d(0, 0, 0));
-            msg_start_goal_points_vis.markers.emplace_back(marker);
+            marker.points.clear();
+            return marker;
+        };
+        for (int qi = 0; qi < mission->qn; qi++) {
+            visualization_msgs::Marker &start_marker = nextMarker("start", qi, visualization_msgs::Marker::SPHERE);
+            start_marker.pose.position = point3DToPointMsg(mission->agents[qi].start_point);
+            start_marker.pose.orientation = point3DToQuaternionMsg(point3d(0, 0, 0));
+
+            visualization_msgs::Marker &desired_goal_marker = nextMarker("desired_goal", qi,
+                                                                         visualization_msgs::Marker::CUBE);
+            desired_goal_marker.pose.position = point3DToPointMsg(snapshot.desired_goal_points[qi]);
+            desired_goal_marker.pose.orientation = defaultQuaternion();
+
+            point3d agent_current_goal = snapshot.current_goal_points[qi];
+            visualization_msgs::Marker &current_goal_marker = nextMarker("current_goal", qi,
+                                                                         visualization_msgs::Marker::SPHERE);
+            current_goal_marker.pose.position = point3DToPointMsg(agent_current_goal);
+            current_goal_marker.pose.orientation = point3DToQuaternionMsg(point3d(0, 0, 0));
 
             if(param.goal_mode == GoalMode::GRIDBASEDPLANNER) {
-                point3d agent_next_waypoint = agents[qi]->getNextWaypoint();
-                marker.ns = "next_waypoint";
-                marker.id = qi;
-                marker.type = visualization_msgs::Marker::ARROW;
-                marker.scale.x = 0.05;
-                marker.scale.y = 0.08;
-                marker.scale.z = 0.0;
-                marker.points.clear();
-                marker.points.emplace_back(point3DToPointMsg(agent_current_goal));
-                marker.points.emplace_back(point3DToPointMsg(agent_next_waypoint));
-                marker.pose.position = defaultPoint();
-                marker.pose.orientation = point3DToQuaternionMsg(point3d(0, 0, 0));
-                msg_start_goal_points_vis.markers.emplace_back(marker);
-            }
-        }
-        pub_start_goal_points_vis.publish(msg_start_goal_points_vis);
-    }
-
-    void MultiSyncSimulator::publishWorldBoundary() {
-        visualization_msgs::MarkerArray msg_world_boundary;
-        visualization_msgs::Marker marker;
+                visualization_msgs::Marker &waypoint_marker = nextMarker("next_waypoint", qi,
+                                                                         visualization_msgs::Marker::ARROW);
+                waypoint_marker.scale.x = 0.05;
+                waypoint_marker.scale.y = 0.08;
+                waypoint_marker.scale.z = 0.0;
+                waypoint_marker.points.resize(2);
+                waypoint_marker.points[0] = point3DToPointMsg(agent_current_goal);
+                waypoint_marker.points[1] = point3DToPointMsg(snapshot.next_waypoints[qi]);
+                waypoint_marker.pose.position = defaultPoint();
+                waypoint_marker.pose.orientation = point3DToQuaternionMsg(point3d(0, 0, 0));
+            }
+        }
+    }
+
+    void MultiSyncSimulator::worldBoundaryToMsg(const VisualizationSnapshot &snapshot,
+                                                visualization_msgs::MarkerArray &msg) {
+        const Param &param = *snapshot.param;
+        const std::shared_ptr<const Mission> &mission = snapshot.mission;
+        msg.markers.resize(1);
+        visualization_msgs::Marker &marker = msg.markers[0];
         marker.header.frame_id = param.world_frame_id;
         marker.type = visualization_msgs::Marker::LINE_LIST;
         marker.action = visualization_msgs::Marker::ADD;
 
-        std::vector<double> world_boundary{mission.world_min.x(), mission.world_min.y(), mission.world_min.z(),
-                                           mission.world_max.x(), mission.world_max.y(), mission.world_max.z()};
+        std::vector<double> world_boundary{mission->world_min.x(), mission->world_min.y(), mission->world_min.z(),
+                                           mission->world_max.x(), mission->world_max.y(), mission->world_max.z()};
 
         marker.pose.position = defaultPoint();
         marker.pose.orientation = defaultQuaternion();
@@ -867,6 +2667,7 @@ namespace DynamicPlanning {
                                   3, 1, 5,
                                   0, 4, 5};
         int offset = 0;
+        marker.points.clear();
         for (int iter = 0; iter < 4; iter++) {
             point_i.x = world_boundary[index[offset + 0]];
             point_i.y = world_boundary[index[offset + 1]];
@@ -882,109 +2683,133 @@ namespace DynamicPlanning {
             }
             offset += 3;
         }
-        msg_world_boundary.markers.emplace_back(marker);
-        pub_world_boundary.publish(msg_world_boundary);
     }
 
     void MultiSyncSimulator::publishAgentTrajectories() {
-        pub_agent_trajectories.publish(msg_agent_trajectories);
+        // The points not taken by a dropped job are taken by the next one
+        VisualizationWorker::getInstance().submit(
+                pub_agent_trajectories.getTopic(),
+                [pub = pub_agent_trajectories, history = agent_trajectory_history]() {
+                    visualization_msgs::MarkerArray msg = history->takeMarkers(pub.getNumSubscribers());
+                    if (not msg.markers.empty()) {
+                        pub.publish(msg);
+                    }
+                });
     }
 
     void MultiSyncSimulator::publishObstacleTrajectories() {
-        pub_obstacle_trajectories.publish(msg_obstacle_trajectories);
+        VisualizationWorker::getInstance().submit(
+                pub_obstacle_trajectories.getTopic(),
+                [pub = pub_obstacle_trajectories, history = obstacle_trajectory_history]() {
+                    visualization_msgs::MarkerArray msg = history->takeMarkers(pub.getNumSubscribers());
+                    if (not msg.markers.empty()) {
+                        pub.publish(msg);
+                    }
+                });
     }
 
-    void MultiSyncSimulator::publishCollisionAlert() {
-        visualization_msgs::MarkerArray msg_collision_alert;
-        visualization_msgs::Marker marker;
+    void MultiSyncSimulator::collisionAlertToMsg(const VisualizationSnapshot &snapshot,
+                                                 visualization_msgs::MarkerArray &msg) {
+        const Param &param = *snapshot.param;
+        const std::shared_ptr<const Mission> &mission = snapshot.mission;
+        msg.markers.resize(1);
+        visualization_msgs::Marker &marker = msg.markers[0];
         marker.header.frame_id = param.world_frame_id;
         marker.type = visualization_msgs::Marker::CUBE;
         marker.action = visualization_msgs::Marker::ADD;
 
-        marker.pose.position = point3DToPointMsg((mission.world_max + mission.world_min) * 0.5);
+        marker.pose.position = point3DToPointMsg((mission->world_max + mission->world_min) * 0.5);
         marker.pose.orientation = defaultQuaternion();
 
-        marker.scale.x = mission.world_max.x() - mission.world_min.x();
-        marker.scale.y = mission.world_max.y() - mission.world_min.y();
-        marker.scale.z = mission.world_max.z() - mission.world_min.z();
+        marker.scale.x = mission->world_max.x() - mission->world_min.x();
+        marker.scale.y = mission->world_max.y() - mission->world_min.y();
+        marker.scale.z = mission->world_max.z() - mission->world_min.z();
 
         marker.color.a = 0.0;
-        if (is_collided) {
+        if (snapshot.is_collided) {
             marker.color.a = 0.3;
         }
         marker.color.r = 1;
         marker.color.g = 0;
         marker.color.b = 0;
+    }
+
+    void MultiSyncSimulator::publishAgentState(const std::shared_ptr<const VisualizationSnapshot> &snapshot) {
+        VisualizationWorker::getInstance().submit(
+                pub_agent_velocities_x.getTopic(),
+                [pubs = std::array<ros::Publisher, 8>{pub_agent_velocities_x, pub_agent_velocities_y,
+                                                      pub_agent_velocities_z, pub_agent_accelerations_x,
+                                                      pub_agent_accelerations_y, pub_agent_accelerations_z,
+                                                      pub_agent_vel_limits, pub_agent_acc_limits}, snapshot]() {
+                    const std::shared_ptr<const Mission> &mission = snapshot->mission;
+                    std::array<std_msgs::Float64MultiArray, 8> msgs; // vx, vy, vz, ax, ay, az, vel and acc limits
+                    for (const auto &current_state: snapshot->current_states) {
+                        msgs[0].data.emplace_back(current_state.velocity.x());
+                        msgs[1].data.emplace_back(current_state.velocity.y());
+                        msgs[2].data.emplace_back(current_state.velocity.z());
+                        msgs[3].data.emplace_back(current_state.acceleration.x());
+                        msgs[4].data.emplace_back(current_state.acceleration.y());
+                        msgs[5].data.emplace_back(current_state.acceleration.z());
+                    }
+                    msgs[6].data.emplace_back(mission->agents[0].max_vel[0]);
+                    msgs[6].data.emplace_back(-mission->agents[0].max_vel[0]);
+                    msgs[7].data.emplace_back(mission->agents[0].max_acc[0]);
+                    msgs[7].data.emplace_back(-mission->agents[0].max_acc[0]);
+
+                    for (size_t i = 0; i < pubs.size(); i++) {
+                        pubs[i].publish(msgs[i]);
+                    }
+                });
+    }
+
+    void MultiSyncSimulator::desiredTrajsToMsg(const VisualizationSnapshot &snapshot,
+                                               visualization_msgs::MarkerArray &msg) {
+        const Param &param = *snapshot.param;
+        const std::shared_ptr<const Mission> &mission = snapshot.mission;
 
-        msg_collision_alert.markers.emplace_back(marker);
-        pub_collision_alert.publish(msg_collision_alert);
-    }
-
-    void MultiSyncSimulator::publishAgentState() {
-        std_msgs::Float64MultiArray msg_agent_velocities_x;
-        std_msgs::Float64MultiArray msg_agent_velocities_y;
-        std_msgs::Float64MultiArray msg_agent_velocities_z;
-        std_msgs::Float64MultiArray msg_agent_acceleration_x;
-        std_msgs::Float64MultiArray msg_agent_acceleration_y;
-        std_msgs::Float64MultiArray msg_agent_acceleration_z;
-        std_msgs::Float64MultiArray msg_agent_vel_limits;
-        std_msgs::Float64MultiArray msg_agent_acc_limits;
-
-        for (size_t qi = 0; qi < mission.qn; qi++) {
-            State msg_current_state = agents[qi]->getCurrentState();
-            msg_agent_velocities_x.data.emplace_back(msg_current_state.velocity.x());
-            msg_agent_velocities_y.data.emplace_back(msg_current_state.velocity.y());
-            msg_agent_velocities_z.data.emplace_back(msg_current_state.velocity.z());
-            msg_agent_acceleration_x.data.emplace_back(msg_current_state.acceleration.x());
-            msg_agent_acceleration_y.data.emplace_back(msg_current_state.acceleration.y());
-            msg_agent_acceleration_z.data.emplace_back(msg_current_state.acceleration.z());
-        }
-        msg_agent_vel_limits.data.emplace_back(mission.agents[0].max_vel[0]);
-        msg_agent_vel_limits.data.emplace_back(-mission.agents[0].max_vel[0]);
-        msg_agent_acc_limits.data.emplace_back(mission.agents[0].max_acc[0]);
-        msg_agent_acc_limits.data.emplace_back(-mission.agents[0].max_acc[0]);
-
-        pub_agent_velocities_x.publish(msg_agent_velocities_x);
-        pub_agent_velocities_y.publish(msg_agent_velocities_y);
-        pub_agent_velocities_z.publish(msg_agent_velocities_z);
-        pub_agent_accelerations_x.publish(msg_agent_acceleration_x);
-        pub_agent_accelerations_y.publish(msg_agent_acceleration_y);
-        pub_agent_accelerations_z.publish(msg_agent_acceleration_z);
-        pub_agent_vel_limits.publish(msg_agent_vel_limits);
-        pub_agent_acc_limits.publish(msg_agent_acc_limits);
-    }
-
-    void MultiSyncSimulator::publishDesiredTrajs() {
         // Vis
-        visualization_msgs::MarkerArray msg_desired_trajs_vis;
-        for (size_t qi = 0; qi < mission.qn; qi++) {
-            visualization_msgs::Marker marker;
+        double dt = 0.1;
+        int n_interval = floor((param.M * param.dt + SP_EPSILON) / dt);
+        SampledStates desired_traj_states;
+        std::vector<const traj_t *> trajs(mission->qn);
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            trajs[qi] = &snapshot.desired_trajs[qi];
+        }
+        TrajectoryBundle bundle;
+        if (bundle.build(trajs)) {
+            bundle.sample(dt, n_interval, desired_traj_states);
+        } else {
+            desired_traj_states.resize(mission->qn, dt, n_interval);
+            for (size_t qi = 0; qi < mission->qn; qi++) {
+                desired_traj_states.sampleAgent(qi, snapshot.desired_trajs[qi]);
+            }
+        }
+
+        msg.markers.resize(mission->qn);
+        for (size_t qi = 0; qi < mission->qn; qi++) {
+            visualization_msgs::Marker &marker = msg.markers[qi];
             marker.header.frame_id = param.world_frame_id;
             marker.type = visualization_msgs::Marker::LINE_STRIP;
             marker.action = visualization_msgs::Marker::ADD;
             marker.ns = "traj";
             marker.id = qi;
             marker.scale.x = 0.05;
-            marker.color = mission.color[qi];
+            marker.color = mission->color[qi];
             marker.color.a = 0.5;
             marker.pose.orientation = defaultQuaternion();
 
-            double dt = 0.1;
-            int n_interval = floor((param.M * param.dt + SP_EPSILON) / dt);
+            marker.points.resize(n_interval);
             for (int i = 0; i < n_interval; i++) {
-                double future_time = i * dt;
-                State traj_point = agents[qi]->getFutureState(future_time);
-                marker.points.emplace_back(point3DToPointMsg(traj_point.position));
+                marker.points[i] = point3DToPointMsg(desired_traj_states.getPosition(i, qi));
             }
-            msg_desired_trajs_vis.markers.emplace_back(marker);
 
 //            // Last point
 //            marker.points.clear();
 //            marker.type = visualization_msgs::Marker::SPHERE;
 //            marker.color.a = 0.3;
-//            marker.scale.x = 2 * mission.agents[qi].radius;
-//            marker.scale.y = 2 * mission.agents[qi].radius;
-//            marker.scale.z = 2 * mission.agents[qi].radius * mission.agents[qi].downwash;
+//            marker.scale.x = 2 * mission->agents[qi].radius;
+//            marker.scale.y = 2 * mission->agents[qi].radius;
+//            marker.scale.z = 2 * mission->agents[qi].radius * mission->agents[qi].downwash;
 //            for(int m = 0; m < param.M + 1; m++){
 //                if(m < param.M){
 //                    marker.ns = std::to_string(m);
@@ -999,8 +2824,6 @@ namespace DynamicPlanning {
 //                msg_desired_trajs_vis.markers.emplace_back(marker);
 //            }
         }
-
-        pub_desired_trajs_vis.publish(msg_desired_trajs_vis);
     }
 
 //    void MultiSyncSimulator::publishGridMap() {
@@ -1013,8 +2836,8 @@ namespace DynamicPlanning {
 //        }
 //
 //        GridBasedPlanner grid_based_planner(distmap_ptr, mission, param);
-//        grid_based_planner.plan(mission.agents[0].start_position, mission.agents[0].start_position, 0,
-//                                mission.agents[0].radius, mission.agents[0].downwash);
+//        grid_based_planner.plan(mission->agents[0].start_position, mission->agents[0].start_position, 0,
+//                                mission->agents[0].radius, mission->agents[0].downwash);
 //        points_t free_grid_points = grid_based_planner.getFreeGridPoints();
 //
 //        visualization_msgs::MarkerArray msg_grid_map;
@@ -1044,57 +2867,40 @@ namespace DynamicPlanning {
 //        pub_grid_map.publish(msg_grid_map);
 //    }
 
-    void MultiSyncSimulator::publishCommunicationRange() {
-        visualization_msgs::MarkerArray msg_communication_range;
-        msg_communication_range.markers.clear();
-
-        visualization_msgs::Marker marker;
-        marker.header.frame_id = param.world_frame_id;
-        marker.type = visualization_msgs::Marker::SPHERE;
-        marker.action = visualization_msgs::Marker::ADD;
-        marker.ns = "communication_range";
-
-        for (size_t qi = 0; qi < mission.qn; qi++) {
-            marker.color = mission.color[qi];
-            marker.color.a = 0.1;
-
-            marker.scale.x = 2 * param.communication_range;
-            marker.scale.y = 2 * param.communication_range;
-            marker.scale.z = 2 * param.communication_range;
-
-            marker.id = qi;
-            State current_state = agents[qi]->getCurrentState();
-            marker.pose.position = point3DToPointMsg(current_state.position);
-            marker.pose.orientation = defaultQuaternion();
-
-            msg_communication_range.markers.emplace_back(marker);
-        }
+    void MultiSyncSimulator::communicationRangeToMsg(const VisualizationSnapshot &snapshot,
+                                                     visualization_msgs::MarkerArray &msg) {
+        const Param &param = *snapshot.param;
+        const std::shared_ptr<const Mission> &mission = snapshot.mission;
+        msg.markers.resize(2 * mission->qn);
+
+        // The communication range, then the trajectory bound of half the range
+        for (size_t mi = 0; mi < msg.markers.size(); mi++) {
+            size_t qi = mi % mission->qn;
+            double scale = mi < mission->qn ? 2 * param.communication_range : param.communication_range;
+            visualization_msgs::Marker &marker = msg.markers[mi];
+            marker.header.frame_id = param.world_frame_id;
+            marker.type = visualization_msgs::Marker::SPHERE;
+            marker.action = visualization_msgs::Marker::ADD;
+            marker.ns = mi < mission->qn ? "communication_range" : "trajectory_bound";
 
-        marker.ns = "trajectory_bound";
-        for (size_t qi = 0; qi < mission.qn; qi++) {
-            marker.color = mission.color[qi];
+            marker.color = mission->color[qi];
             marker.color.a = 0.1;
 
-            marker.scale.x = param.communication_range;
-            marker.scale.y = param.communication_range;
-            marker.scale.z = param.communication_range;
+            marker.scale.x = scale;
+            marker.scale.y = scale;
+            marker.scale.z = scale;
 
             marker.id = qi;
-            State current_state = agents[qi]->getCurrentState();
-            marker.pose.position = point3DToPointMsg(current_state.position);
+            marker.pose.position = point3DToPointMsg(snapshot.current_states[qi].position);
             marker.pose.orientation = defaultQuaternion();
-
-            msg_communication_range.markers.emplace_back(marker);
         }
-
-        pub_communication_range.publish(msg_communication_range);
     }
 
-    void MultiSyncSimulator::publishCommunicationGroup() {
-        visualization_msgs::MarkerArray msg_communication_group;
-        msg_communication_group.markers.clear();
-
-        visualization_msgs::Marker marker;
+    void MultiSyncSimulator::communicationGroupToMsg(const VisualizationSnapshot &snapshot,
+                                                     visualization_msgs::MarkerArray &msg) {
+        const Param &param = *snapshot.param;
+        msg.markers.resize(1);
+        visualization_msgs::Marker &marker = msg.markers[0];
         marker.header.frame_id = param.world_frame_id;
         marker.type = visualization_msgs::Marker::LINE_LIST;
         marker.action = visualization_msgs::Marker::ADD;
@@ -1107,16 +2913,11 @@ namespace DynamicPlanning {
         marker.color.a = 0.3;
         marker.scale.x = 0.03;
 
-        for (size_t qi = 0; qi < mission.qn; qi++) {
-            for(size_t qj = qi + 1; qj < mission.qn; qj++) {
-                double dist = LInfinityDistance(agents[qi]->getCurrentPosition(), agents[qj]->getCurrentPosition());
-                if(dist < param.communication_range){
-                    marker.points.emplace_back(point3DToPointMsg(agents[qi]->getCurrentPosition()));
-                    marker.points.emplace_back(point3DToPointMsg(agents[qj]->getCurrentPosition()));
-                }
-            }
+        marker.points.clear();
+        for (const auto &link: snapshot.communication_links) {
+            marker.points.emplace_back(point3DToPointMsg(snapshot.current_states[link.first].position));
+            marker.points.emplace_back(point3DToPointMsg(snapshot.current_states[link.second].position));
         }
-        msg_communication_group.markers.emplace_back(marker);
 
 
 //        marker.type = visualization_msgs::Marker::SPHERE;
@@ -1134,12 +2935,11 @@ namespace DynamicPlanning {
 //                marker.id = count++;
 //                marker.pose.position = point3DToPointMsg(agents[qi]->getCurrentPosition());
 //                marker.pose.orientation = defaultQuaternion();
-//                marker.scale.x = 2 * mission.agents[qi].radius;
-//                marker.scale.y = 2 * mission.agents[qi].radius;
-//                marker.scale.z = 2 * mission.agents[qi].radius * mission.agents[qi].downwash;
+//                marker.scale.x = 2 * mission->agents[qi].radius;
+//                marker.scale.y = 2 * mission->agents[qi].radius;
+//                marker.scale.z = 2 * mission->agents[qi].radius * mission->agents[qi].downwash;
 //                msg_communication_group.markers.emplace_back(marker);
 //            }
 //        }
-        pub_communication_group.publish(msg_communication_group);
     }
 }
\ No newline at end of file
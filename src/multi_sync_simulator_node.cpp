@@ -27,10 +27,10 @@ int main(int argc, char* argv[]){
 
         MultiSyncReplayer multi_sync_replayer(nh, param, mission);
         ros::Rate rate(50);
-        ros::Time replay_start_time = ros::Time::now();
-        multi_sync_replayer.readCSVFile(param.multisim_replay_file_name);
+        multi_sync_replayer.readResultFile(param.multisim_replay_file_name);
+        multi_sync_replayer.startReplay();
         while (ros::ok()) {
-            multi_sync_replayer.replay((ros::Time::now() - replay_start_time).toSec());
+            multi_sync_replayer.replay();
             ros::spinOnce();
             rate.sleep();
         }
@@ -42,6 +42,10 @@ int main(int argc, char* argv[]){
     // Activated when the argument of launch file is <arg name="replay" default="false" />
     Mission mission(nh);
     for(size_t si = 0; si < mission.mission_file_names.size(); si++){
+        if (not param.isMissionInShard(si)) {
+            continue;
+        }
+
         // Load world from octomap
         std::string world_file_name = "default";
         if(param.world_use_octomap){
@@ -0,0 +1,134 @@
+#include <neighbor_grid.hpp>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace DynamicPlanning {
+    // The cells are slightly larger than the range, so that two points within the range are in adjacent cells
+    // despite the rounding error of the cell index
+    static constexpr double CELL_MARGIN = 1e-6;
+
+    template<typename F>
+    void NeighborGrid::forEachNeighbor(const point3d &point, const std::array<int, 3> &cell, bool inclusive,
+                                       F &&f) const {
+        if (range <= 0) {
+            for (size_t j = 0; j < points.size(); j++) {
+                f(j);
+            }
+            return;
+        }
+
+        thread_local std::vector<double> distances;
+        for (int di = -1; di <= 1; di++) {
+            for (int dj = -1; dj <= 1; dj++) {
+                for (int dk = -1; dk <= 1; dk++) {
+                    auto it = cells.find(getCellKey(cell[0] + di, cell[1] + dj, cell[2] + dk));
+                    if (it == cells.end()) {
+                        continue;
+                    }
+                    const Cell &candidates = it->second;
+                    distances.resize(candidates.indices.size());
+                    GeometryKernels::lInfinityDistances(point, candidates.points, distances.data());
+                    for (size_t ci = 0; ci < candidates.indices.size(); ci++) {
+                        if (inclusive ? distances[ci] <= range : distances[ci] < range) {
+                            f(candidates.indices[ci]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void NeighborGrid::build(const points_t &_points, double _range) {
+        points = _points;
+        range = _range;
+        cell_size = range * (1 + CELL_MARGIN);
+        cells.clear();
+        point_cells.clear();
+        if (range <= 0) {
+            return;
+        }
+
+        point_cells.resize(points.size());
+        for (size_t i = 0; i < points.size(); i++) {
+            point_cells[i] = getCell(points[i]);
+            Cell &cell = cells[getCellKey(point_cells[i][0], point_cells[i][1], point_cells[i][2])];
+            cell.indices.emplace_back(i);
+            cell.points.emplace_back(points[i]);
+        }
+    }
+
+    void NeighborGrid::getNeighbors(size_t i, bool inclusive, std::vector<size_t> &neighbors) const {
+        neighbors.clear();
+        forEachNeighbor(points[i], range > 0 ? point_cells[i] : std::array<int, 3>{}, inclusive, [&](size_t j) {
+            if (j != i) {
+                neighbors.emplace_back(j);
+            }
+        });
+        if (range > 0) {
+            std::sort(neighbors.begin(), neighbors.end());
+        }
+    }
+
+    void NeighborGrid::getNeighbors(const point3d &point, bool inclusive, std::vector<size_t> &neighbors) const {
+        neighbors.clear();
+        forEachNeighbor(point, range > 0 ? getCell(point) : std::array<int, 3>{}, inclusive, [&](size_t j) {
+            neighbors.emplace_back(j);
+        });
+        if (range > 0) {
+            std::sort(neighbors.begin(), neighbors.end());
+        }
+    }
+
+    std::vector<std::set<size_t>> NeighborGrid::getComponents() const {
+        // Union-find, the root of a component is its smallest member
+        std::vector<size_t> parents(points.size());
+        std::iota(parents.begin(), parents.end(), 0);
+        auto find = [&](size_t i) {
+            while (parents[i] != i) {
+                parents[i] = parents[parents[i]];
+                i = parents[i];
+            }
+            return i;
+        };
+
+        for (size_t i = 0; i < points.size(); i++) {
+            forEachNeighbor(points[i], range > 0 ? point_cells[i] : std::array<int, 3>{}, false, [&](size_t j) {
+                if (j <= i) {
+                    return;
+                }
+                size_t root_i = find(i);
+                size_t root_j = find(j);
+                if (root_i != root_j) {
+                    parents[std::max(root_i, root_j)] = std::min(root_i, root_j);
+                }
+            });
+        }
+
+        std::vector<std::set<size_t>> components;
+        std::vector<int> component_indices(points.size(), -1); // [root]
+        for (size_t i = 0; i < points.size(); i++) {
+            size_t root = find(i);
+            if (component_indices[root] < 0) {
+                component_indices[root] = static_cast<int>(components.size());
+                components.emplace_back();
+            }
+            components[component_indices[root]].insert(i);
+        }
+        return components;
+    }
+
+    std::array<int, 3> NeighborGrid::getCell(const point3d &point) const {
+        std::array<int, 3> cell{};
+        for (int k = 0; k < 3; k++) {
+            cell[k] = static_cast<int>(std::floor(point(k) / cell_size));
+        }
+        return cell;
+    }
+
+    uint64_t NeighborGrid::getCellKey(int i, int j, int k) {
+        // 21 bits per axis
+        auto pack = [](int index) { return static_cast<uint64_t>(index + (1 << 20)) & ((uint64_t(1) << 21) - 1); };
+        return (pack(i) << 42) | (pack(j) << 21) | pack(k);
+    }
+}
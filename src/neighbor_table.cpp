@@ -0,0 +1,63 @@
+#include <neighbor_table.hpp>
+
+namespace DynamicPlanning {
+    void NeighborTable::assign(std::vector<Obstacle> &obstacles) {
+        size_t N_obs = obstacles.size();
+        ids.resize(N_obs);
+        types.resize(N_obs);
+        radii.resize(N_obs);
+        downwashes.resize(N_obs);
+        max_accs.resize(N_obs);
+        positions.resize(N_obs);
+        goal_points.resize(N_obs);
+        velocities.resize(N_obs);
+        prev_trajs.resize(N_obs);
+        shifted_trajs.resize(N_obs);
+        if (traj_pool.size() < N_obs) {
+            traj_pool.resize(N_obs);
+        }
+
+        for (size_t oi = 0; oi < N_obs; oi++) {
+            Obstacle &obstacle = obstacles[oi];
+            ids[oi] = obstacle.id;
+            types[oi] = obstacle.type;
+            radii[oi] = obstacle.radius;
+            downwashes[oi] = obstacle.downwash;
+            max_accs[oi] = obstacle.max_acc;
+            positions[oi] = obstacle.position;
+            goal_points[oi] = obstacle.goal_point;
+            velocities[oi] = obstacle.velocity;
+            if (obstacle.shared_prev_traj == nullptr) {
+                traj_pool[oi] = std::move(obstacle.prev_traj);
+                obstacle.prev_traj = traj_t();
+                obstacle.shared_prev_traj = &traj_pool[oi];
+            }
+            prev_trajs[oi] = obstacle.shared_prev_traj;
+            shifted_trajs[oi] = obstacle.shared_shifted_traj;
+        }
+    }
+
+    void NeighborTable::select(const std::vector<size_t> &indices) {
+        compact(ids, indices);
+        compact(types, indices);
+        compact(radii, indices);
+        compact(downwashes, indices);
+        compact(max_accs, indices);
+        compact(positions, indices);
+        compact(goal_points, indices);
+        compact(velocities, indices);
+        compact(prev_trajs, indices);
+        compact(shifted_trajs, indices);
+    }
+
+    template<typename T>
+    void NeighborTable::compact(std::vector<T> &values, const std::vector<size_t> &indices) {
+        // The indices are ascending, so a value is moved only to the front
+        for (size_t k = 0; k < indices.size(); k++) {
+            if (indices[k] != k) {
+                values[k] = values[indices[k]];
+            }
+        }
+        values.resize(indices.size());
+    }
+}
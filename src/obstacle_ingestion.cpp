@@ -0,0 +1,135 @@
+#include <obstacle_ingestion.hpp>
+#include <tf/transform_listener.h>
+
+namespace DynamicPlanning {
+    ObstacleIngestion &ObstacleIngestion::getInstance() {
+        static ObstacleIngestion ingestion;
+        return ingestion;
+    }
+
+    ObstacleIngestion::~ObstacleIngestion() {
+        stop();
+    }
+
+    void ObstacleIngestion::start(const std::string &_world_frame_id, const std::vector<std::string> &_frame_ids,
+                                  const std::vector<double> &_radii, double _rate, double _sigma_y_sq,
+                                  double _sigma_a_sq) {
+        if (_frame_ids.size() != _radii.size() or _rate <= 0) {
+            throw std::invalid_argument("[ObstacleIngestion] Invalid frames or rate");
+        }
+        if (is_running and world_frame_id == _world_frame_id and frame_ids == _frame_ids and radii == _radii and
+            rate == _rate and sigma_y_sq == _sigma_y_sq and sigma_a_sq == _sigma_a_sq) {
+            return;
+        }
+
+        stop();
+        world_frame_id = _world_frame_id;
+        frame_ids = _frame_ids;
+        radii = _radii;
+        rate = _rate;
+        sigma_y_sq = _sigma_y_sq;
+        sigma_a_sq = _sigma_a_sq;
+        is_running = true;
+        thread = std::thread(&ObstacleIngestion::ingestionLoop, this);
+    }
+
+    void ObstacleIngestion::stop() {
+        is_running = false;
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    bool ObstacleIngestion::update() {
+        if (not snapshot_buffer.update()) {
+            return false;
+        }
+
+        const Snapshot &snapshot = snapshot_buffer.getFrontBuffer();
+        bool has_measurement = false;
+        ros::Time newest_measurement_time;
+        for (size_t fi = 0; fi < snapshot.obstacles.size(); fi++) {
+            if (snapshot.is_observed[fi] and
+                (not has_measurement or snapshot.obstacles[fi].update_time > newest_measurement_time)) {
+                newest_measurement_time = snapshot.obstacles[fi].update_time;
+                has_measurement = true;
+            }
+        }
+        if (has_measurement) {
+            latency.update((ros::Time::now() - newest_measurement_time).toSec());
+        }
+        return true;
+    }
+
+    void ObstacleIngestion::ingestionLoop() {
+        // The listener receives tf in its own thread, the lookups below only read its buffer
+        tf::TransformListener listener;
+        KalmanFilterBank filter_bank;
+        filter_bank.initialize(sigma_y_sq, sigma_a_sq);
+
+        size_t n_frames = frame_ids.size();
+        std::vector<Obstacle> measurements(n_frames);
+        std::vector<bool> is_observed(n_frames, false);
+        for (size_t fi = 0; fi < n_frames; fi++) {
+            measurements[fi].type = ObstacleType::DYNAMICOBSTACLE;
+            measurements[fi].id = static_cast<int>(fi);
+            measurements[fi].radius = radii[fi];
+            measurements[fi].downwash = 1;
+            measurements[fi].max_acc = 0;
+            measurements[fi].position = point3d(0, 0, 0);
+            measurements[fi].velocity = point3d(0, 0, 0);
+            measurements[fi].goal_point = point3d(0, 0, 0);
+            measurements[fi].collision_alert = false;
+        }
+
+        std::vector<Obstacle> observed_measurements, filtered;
+        std::vector<size_t> observed_frames;
+        ros::Rate loop_rate(rate);
+        while (is_running and ros::ok()) {
+            bool has_new_measurement = false;
+            for (size_t fi = 0; fi < n_frames; fi++) {
+                tf::StampedTransform transform;
+                try {
+                    listener.lookupTransform(world_frame_id, frame_ids[fi], ros::Time(0), transform);
+                }
+                catch (const tf::TransformException &) {
+                    // The frame is not available yet, it is looked up again in the next cycle
+                    continue;
+                }
+                if (is_observed[fi] and transform.stamp_ <= measurements[fi].update_time) {
+                    continue;
+                }
+
+                measurements[fi].position = point3d(transform.getOrigin().x(), transform.getOrigin().y(),
+                                                    transform.getOrigin().z());
+                measurements[fi].observed_position = measurements[fi].position;
+                measurements[fi].update_time = transform.stamp_;
+                is_observed[fi] = true;
+                has_new_measurement = true;
+            }
+
+            if (has_new_measurement) {
+                // The tracks of the frames without a new measurement are kept by the filter bank
+                observed_measurements.clear();
+                observed_frames.clear();
+                for (size_t fi = 0; fi < n_frames; fi++) {
+                    if (is_observed[fi]) {
+                        observed_measurements.emplace_back(measurements[fi]);
+                        observed_frames.emplace_back(fi);
+                    }
+                }
+                filter_bank.filter(observed_measurements, filtered);
+
+                Snapshot &snapshot = snapshot_buffer.getBackBuffer();
+                snapshot.obstacles = measurements;
+                snapshot.is_observed = is_observed;
+                for (size_t ki = 0; ki < observed_frames.size(); ki++) {
+                    snapshot.obstacles[observed_frames[ki]] = filtered[ki];
+                }
+                snapshot_buffer.publish();
+            }
+
+            loop_rate.sleep();
+        }
+    }
+}
@@ -0,0 +1,99 @@
+#include <obstacle_prediction.hpp>
+
+namespace DynamicPlanning {
+    void predictObstacleTraj(const Param &param, const Obstacle &obstacle, bool use_velocity, traj_t &obs_pred_traj) {
+        obs_pred_traj.reset(param.M, param.n, param.dt);
+        obs_pred_traj.planConstVelTraj(obstacle.position, use_velocity ? obstacle.velocity : point3d(0, 0, 0));
+    }
+
+    void predictObstacleSize(const Param &param, const Obstacle &obstacle, double velocity_guard, bool grow_size,
+                             Trajectory<double> &obs_pred_size) {
+        obs_pred_size.reset(param.M, param.n, param.dt);
+        if (not grow_size) {
+            obs_pred_size.planConstVelTraj(obstacle.radius, 0);
+            return;
+        }
+
+        int M_uncertainty = static_cast<int>((param.obs_uncertainty_horizon + SP_EPSILON) / param.dt);
+        double obs_size = obstacle.radius + velocity_guard;
+        double max_acc = obstacle.max_acc;
+        obs_pred_size.planConstAccTraj(obs_size, 0, max_acc);
+        for (int m = M_uncertainty; m < param.M; m++) {
+            for (int i = 0; i < param.n + 1; i++) {
+                obs_pred_size[m][i] = obs_size + 0.5 * max_acc * pow(M_uncertainty * param.dt, 2);
+            }
+        }
+    }
+
+    void predictShiftedTraj(const Param &param, const traj_t &prev_traj, traj_t &pred_traj) {
+        pred_traj.reset(param.M, param.n, param.dt);
+        if (param.multisim_time_step == param.dt) {
+            // feasible LSC: generate C^n-continuous LSC
+            for (int m = 0; m < param.M; m++) {
+                if (m + 1 >= prev_traj.size()) {
+                    for (int i = 0; i < param.n + 1; i++) {
+                        pred_traj[m][i] = prev_traj[m][param.n];
+                    }
+                } else {
+                    pred_traj[m] = prev_traj[m + 1];
+                }
+            }
+        } else {
+            // relaxed LSC: generate C^0-continuous LSC
+            pred_traj[0] = prev_traj[0].subSegment(param.multisim_time_step / param.dt, 1);
+            for (int m = 1; m < param.M; m++) {
+                pred_traj[m] = prev_traj[m];
+            }
+        }
+    }
+
+    void ObstaclePredictionTable::update(const Param &param, const std::vector<Obstacle> &obstacles) {
+        states.clear();
+        indices.clear();
+        for (const auto &obstacle: obstacles) {
+            if (obstacle.type == ObstacleType::DYNAMICOBSTACLE) {
+                indices[obstacle.id] = states.size();
+                states.emplace_back(obstacle);
+            }
+        }
+
+        // The buffers of the previous step are reused. A dynamic obstacle is predicted by the current velocity in
+        // both VELOCITY and PREVIOUSSOLUTION mode.
+        obs_pred_trajs.resize(states.size());
+        obs_pred_sizes.resize(states.size());
+        bool use_velocity = param.prediction_mode != PredictionMode::POSITION;
+        for (size_t idx = 0; idx < states.size(); idx++) {
+            predictObstacleTraj(param, states[idx], use_velocity, obs_pred_trajs[idx]);
+            predictObstacleSize(param, states[idx], 0, param.obs_size_prediction, obs_pred_sizes[idx]);
+        }
+    }
+
+    const traj_t *ObstaclePredictionTable::findTraj(const Obstacle &obstacle) const {
+        size_t idx;
+        return findIndex(obstacle, idx) ? &obs_pred_trajs[idx] : nullptr;
+    }
+
+    const Trajectory<double> *ObstaclePredictionTable::findSize(const Obstacle &obstacle) const {
+        size_t idx;
+        return findIndex(obstacle, idx) ? &obs_pred_sizes[idx] : nullptr;
+    }
+
+    bool ObstaclePredictionTable::findIndex(const Obstacle &obstacle, size_t &idx) const {
+        if (obstacle.type != ObstacleType::DYNAMICOBSTACLE) {
+            return false;
+        }
+        auto it = indices.find(obstacle.id);
+        if (it == indices.end()) {
+            return false;
+        }
+
+        // The agent may observe the obstacle differently, e.g. by a filter or a noise
+        const Obstacle &state = states[it->second];
+        if (not(state.position == obstacle.position) or not(state.velocity == obstacle.velocity) or
+            state.radius != obstacle.radius or state.max_acc != obstacle.max_acc) {
+            return false;
+        }
+        idx = it->second;
+        return true;
+    }
+}
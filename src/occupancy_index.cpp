@@ -0,0 +1,228 @@
+#include <occupancy_index.hpp>
+#include <worker_pool.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace DynamicPlanning {
+    static constexpr double VOXEL_EPSILON = 1e-6; // tolerance of the voxel index conversion [voxel]
+    static constexpr unsigned int LEAF_TASK_DEPTH = 3; // the subtrees of this depth are traversed by the tasks
+    static constexpr size_t LEAF_CHUNK_SIZE = 4096; // leaves per task of the occupancy marking
+
+    namespace {
+        struct Subtree {
+            const octomap::OcTreeNode *node;
+            octomap::OcTreeKey key;
+            unsigned int depth;
+            size_t leaf_position; // the number of the leaves collected before the subtree
+        };
+
+        // Depth-first in the child order, same as the leaf iterator. The subtrees at stop_depth are appended to
+        // subtrees instead of being traversed, unless subtrees is nullptr.
+        void collectSubtree(const octomap::OcTree &octree, const Subtree &subtree, unsigned int stop_depth,
+                            std::vector<OccupiedLeaf> &leaves, std::vector<Subtree> *subtrees) {
+            if (not octree.nodeHasChildren(subtree.node)) {
+                if (octree.isNodeOccupied(subtree.node)) {
+                    leaves.push_back({octree.keyToCoord(subtree.key, subtree.depth),
+                                      octree.getNodeSize(subtree.depth)});
+                }
+                return;
+            }
+            if (subtrees != nullptr and subtree.depth == stop_depth) {
+                subtrees->push_back({subtree.node, subtree.key, subtree.depth, leaves.size()});
+                return;
+            }
+
+            // Same as the key computation of the octree iterators
+            auto center_offset_key = static_cast<octomap::key_type>(
+                    (1 << (octree.getTreeDepth() - 1)) >> (subtree.depth + 1));
+            for (unsigned int i = 0; i < 8; i++) {
+                if (not octree.nodeChildExists(subtree.node, i)) {
+                    continue;
+                }
+                Subtree child{octree.getNodeChild(subtree.node, i), {}, subtree.depth + 1, 0};
+                octomap::computeChildKey(i, center_offset_key, subtree.key, child.key);
+                collectSubtree(octree, child, stop_depth, leaves, subtrees);
+            }
+        }
+    }
+
+    void collectOccupiedLeaves(const octomap::OcTree &octree, std::vector<OccupiedLeaf> &leaves) {
+        leaves.clear();
+        const octomap::OcTreeNode *root = octree.getRoot();
+        if (root == nullptr) {
+            return;
+        }
+
+        // The leaves above the task depth are collected serially, the subtrees below it by the tasks
+        auto root_key_value = static_cast<octomap::key_type>(1 << (octree.getTreeDepth() - 1));
+        Subtree root_subtree{root, octomap::OcTreeKey(root_key_value, root_key_value, root_key_value), 0, 0};
+        std::vector<Subtree> subtrees;
+        std::vector<OccupiedLeaf> top_leaves;
+        collectSubtree(octree, root_subtree, LEAF_TASK_DEPTH, top_leaves, &subtrees);
+        if (subtrees.empty()) {
+            leaves = std::move(top_leaves);
+            return;
+        }
+
+        std::vector<std::vector<OccupiedLeaf>> subtree_leaves(subtrees.size());
+        WorkerPool::getInstance().run(subtrees.size(), [&](size_t i) {
+            collectSubtree(octree, subtrees[i], LEAF_TASK_DEPTH, subtree_leaves[i], nullptr);
+        });
+
+        size_t n_leaves = top_leaves.size();
+        for (const auto &subtree_leaf: subtree_leaves) {
+            n_leaves += subtree_leaf.size();
+        }
+        // Merged at the positions of the subtrees, so the order does not depend on the schedule
+        leaves.reserve(n_leaves);
+        size_t n_top_leaves = 0;
+        for (size_t i = 0; i < subtrees.size(); i++) {
+            leaves.insert(leaves.end(), top_leaves.begin() + n_top_leaves,
+                          top_leaves.begin() + subtrees[i].leaf_position);
+            n_top_leaves = subtrees[i].leaf_position;
+            leaves.insert(leaves.end(), subtree_leaves[i].begin(), subtree_leaves[i].end());
+        }
+        leaves.insert(leaves.end(), top_leaves.begin() + n_top_leaves, top_leaves.end());
+    }
+
+    OccupancyIndex::OccupancyIndex(const octomap::point3d &world_min, const octomap::point3d &world_max,
+                                   double _resolution) : resolution(_resolution) {
+        for (int k = 0; k < 3; k++) {
+            origin(k) = static_cast<float>(std::floor(world_min(k) / resolution + VOXEL_EPSILON) * resolution);
+            size[k] = std::max(static_cast<int>(std::ceil((world_max(k) - origin(k)) / resolution - VOXEL_EPSILON)),
+                               1);
+        }
+
+        occupancy.assign(static_cast<size_t>(size[0]) * size[1] * size[2], 0);
+        table.assign(static_cast<size_t>(size[0] + 1) * (size[1] + 1) * (size[2] + 1), 0);
+    }
+
+    void OccupancyIndex::build(const octomap::OcTree &octree) {
+        std::vector<OccupiedLeaf> leaves;
+        collectOccupiedLeaves(octree, leaves);
+        build(leaves);
+    }
+
+    void OccupancyIndex::build(const std::vector<OccupiedLeaf> &leaves) {
+        std::fill(occupancy.begin(), occupancy.end(), 0);
+
+        // A pruned leaf covers several voxels, the leaves do not overlap, so the tasks write disjoint voxels
+        WorkerPool::getInstance().run((leaves.size() + LEAF_CHUNK_SIZE - 1) / LEAF_CHUNK_SIZE, [&](size_t chunk_idx) {
+            size_t end = std::min((chunk_idx + 1) * LEAF_CHUNK_SIZE, leaves.size());
+            for (size_t l = chunk_idx * LEAF_CHUNK_SIZE; l < end; l++) {
+                const OccupiedLeaf &leaf = leaves[l];
+                double half_size = 0.5 * leaf.size;
+                std::array<int, 3> start{}, end_idx{};
+                bool is_inside = true;
+                for (int k = 0; k < 3; k++) {
+                    is_inside = is_inside and voxelRange(k, leaf.center(k) - half_size, leaf.center(k) + half_size,
+                                                         start[k], end_idx[k]);
+                }
+                if (not is_inside) {
+                    continue;
+                }
+
+                for (int i = start[0]; i <= end_idx[0]; i++) {
+                    for (int j = start[1]; j <= end_idx[1]; j++) {
+                        for (int k = start[2]; k <= end_idx[2]; k++) {
+                            occupancy[voxelIndex(i, j, k)] = 1;
+                        }
+                    }
+                }
+            }
+        });
+
+        updateTable({0, 0, 0});
+    }
+
+    size_t OccupancyIndex::getMemoryUsage() const {
+        return occupancy.size() * sizeof(uint8_t) + table.size() * sizeof(uint32_t);
+    }
+
+    void OccupancyIndex::update(const octomap::OcTree &octree,
+                                const octomap::point3d &region_min,
+                                const octomap::point3d &region_max) {
+        std::array<int, 3> start{}, end{};
+        for (int k = 0; k < 3; k++) {
+            if (not voxelRange(k, region_min(k), region_max(k), start[k], end[k])) {
+                return;
+            }
+        }
+
+        updateOccupancy(octree, start, end);
+        updateTable(start);
+    }
+
+    uint32_t OccupancyIndex::countOccupied(const octomap::point3d &box_min, const octomap::point3d &box_max) const {
+        std::array<int, 3> start{}, end{};
+        for (int k = 0; k < 3; k++) {
+            if (not voxelRange(k, box_min(k), box_max(k), start[k], end[k])) {
+                return 0;
+            }
+        }
+
+        int i0 = start[0], j0 = start[1], k0 = start[2];
+        int i1 = end[0] + 1, j1 = end[1] + 1, k1 = end[2] + 1;
+        return table[tableIndex(i1, j1, k1)]
+               - table[tableIndex(i0, j1, k1)] - table[tableIndex(i1, j0, k1)] - table[tableIndex(i1, j1, k0)]
+               + table[tableIndex(i0, j0, k1)] + table[tableIndex(i0, j1, k0)] + table[tableIndex(i1, j0, k0)]
+               - table[tableIndex(i0, j0, k0)];
+    }
+
+    bool OccupancyIndex::isOccupied(const octomap::point3d &box_min, const octomap::point3d &box_max,
+                                    double margin) const {
+        octomap::point3d inflation(margin, margin, margin);
+        return countOccupied(box_min - inflation, box_max + inflation) > 0;
+    }
+
+    size_t OccupancyIndex::voxelIndex(int i, int j, int k) const {
+        return (static_cast<size_t>(i) * size[1] + j) * size[2] + k;
+    }
+
+    size_t OccupancyIndex::tableIndex(int i, int j, int k) const {
+        return (static_cast<size_t>(i) * (size[1] + 1) + j) * (size[2] + 1) + k;
+    }
+
+    bool OccupancyIndex::voxelRange(int axis, double lower, double upper, int &start, int &end) const {
+        // The center of the voxel i is origin + (i + 0.5) * resolution
+        start = static_cast<int>(std::ceil((lower - origin(axis)) / resolution - 0.5 - VOXEL_EPSILON));
+        end = static_cast<int>(std::floor((upper - origin(axis)) / resolution - 0.5 + VOXEL_EPSILON));
+        start = std::max(start, 0);
+        end = std::min(end, size[axis] - 1);
+        return start <= end;
+    }
+
+    void OccupancyIndex::updateOccupancy(const octomap::OcTree &octree, const std::array<int, 3> &start,
+                                         const std::array<int, 3> &end) {
+        for (int i = start[0]; i <= end[0]; i++) {
+            for (int j = start[1]; j <= end[1]; j++) {
+                for (int k = start[2]; k <= end[2]; k++) {
+                    octomap::point3d center(static_cast<float>(origin(0) + (i + 0.5) * resolution),
+                                            static_cast<float>(origin(1) + (j + 0.5) * resolution),
+                                            static_cast<float>(origin(2) + (k + 0.5) * resolution));
+                    octomap::OcTreeNode *node = octree.search(center);
+                    occupancy[voxelIndex(i, j, k)] = node != nullptr and octree.isNodeOccupied(node);
+                }
+            }
+        }
+    }
+
+    void OccupancyIndex::updateTable(const std::array<int, 3> &start) {
+        // Each entry depends on the entries with smaller indices only,
+        // so the entries before the start are still valid
+        for (int i = start[0]; i < size[0]; i++) {
+            for (int j = start[1]; j < size[1]; j++) {
+                for (int k = start[2]; k < size[2]; k++) {
+                    table[tableIndex(i + 1, j + 1, k + 1)] = occupancy[voxelIndex(i, j, k)]
+                                                             + table[tableIndex(i, j + 1, k + 1)]
+                                                             + table[tableIndex(i + 1, j, k + 1)]
+                                                             + table[tableIndex(i + 1, j + 1, k)]
+                                                             - table[tableIndex(i, j, k + 1)]
+                                                             - table[tableIndex(i, j + 1, k)]
+                                                             - table[tableIndex(i + 1, j, k)]
+                                                             + table[tableIndex(i, j, k)];
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,520 @@
+#include <cstring>
+#include <deque>
+#include <future>
+#include <map>
+#include <ros/ros.h>
+#include <nav_msgs/Odometry.h>
+#include <nav_msgs/Path.h>
+#include <std_msgs/UInt8MultiArray.h>
+#include <agent_manager.hpp>
+#include <latency_histogram.hpp>
+#include <metrics_registry.hpp>
+#include <timer.hpp>
+#include <trajectory_codec.hpp>
+#include <trajectory_server.hpp>
+
+using namespace DynamicPlanning;
+
+// Planner of one vehicle, one process per vehicle. The neighbors exchange their trajectories and map deltas on
+// /onboard/trajectory and /onboard/map_delta as packed byte arrays, see TrajectoryPacket and MapDeltaPacket.
+// The trajectory is planned at every multisim/time_step and published as a sampled path on ~desired_path.
+// The messages are published and received as shared pointers, so a subscriber in the same process, e.g. a
+// controller nodelet, gets the message without serialization or copy. Only the links between the processes and
+// over the radio carry the packed bytes.
+
+namespace TrajectoryPacket {
+    // Header (68 bytes) in the host byte order: sender (uint16), trajectory start time (2 x uint32), send time
+    // (2 x uint32), position, velocity, goal (9 x float32), radius, downwash, max acc (3 x float32),
+    // collision alert (uint8), frame type (uint8). Then a frame of TrajectoryEncoder.
+    static constexpr size_t HEADER_SIZE = sizeof(uint16_t) + 4 * sizeof(uint32_t) + 12 * sizeof(float) +
+                                          2 * sizeof(uint8_t);
+}
+
+namespace MapDeltaPacket {
+    // Header (11 bytes): sender (uint16), seq (uint64), encoding (uint8). Then the voxels of MapDelta, raw or in the
+    // encoding of MapDeltaCodec, see communication/map_delta_compression.
+    enum Encoding : uint8_t {
+        RAW = 0,
+        COMPRESSED = 1,
+    };
+
+    static constexpr size_t HEADER_SIZE = sizeof(uint16_t) + sizeof(uint64_t) + sizeof(uint8_t);
+}
+
+template<typename T>
+static void appendValue(std::vector<uint8_t> &data, T value) {
+    size_t offset = data.size();
+    data.resize(offset + sizeof(T));
+    std::memcpy(data.data() + offset, &value, sizeof(T));
+}
+
+template<typename T>
+static T readValue(const uint8_t *&ptr) {
+    T value;
+    std::memcpy(&value, ptr, sizeof(T));
+    ptr += sizeof(T);
+    return value;
+}
+
+static void appendPoint(std::vector<uint8_t> &data, const point3d &point) {
+    for (int k = 0; k < 3; k++) {
+        appendValue<float>(data, point(k));
+    }
+}
+
+static point3d readPoint(const uint8_t *&ptr) {
+    point3d point;
+    for (int k = 0; k < 3; k++) {
+        point(k) = readValue<float>(ptr);
+    }
+    return point;
+}
+
+class OnboardPlanner {
+public:
+    OnboardPlanner(const ros::NodeHandle &_nh, const Param &_param, const Mission &_mission, int _agent_id,
+                   int _key_frame_interval, double _neighbor_timeout, bool _speculative_planning,
+                   double _speculation_tolerance)
+            : nh(_nh), param(_param), mission(std::make_shared<const Mission>(_mission)), agent_id(_agent_id),
+              key_frame_interval(std::max(_key_frame_interval, 1)), neighbor_timeout(_neighbor_timeout),
+              speculative_planning(_speculative_planning), speculation_tolerance(_speculation_tolerance),
+              encoder(param.communication_quantization_step > 0 ? param.communication_quantization_step : 0.001) {
+        agent_manager = std::make_unique<AgentManager>(nh, param, mission, agent_id);
+        State initial_state;
+        initial_state.position = mission->agents[agent_id].start_point;
+        agent_manager->setCurrentState(initial_state);
+        if (param.world_use_octomap and param.world_use_global_map) {
+            agent_manager->setGlobalMap();
+        }
+        agent_manager->setPlannerState(param.multisim_patrol ? PlannerState::PATROL : PlannerState::GOTO);
+
+        // Large queues, the packets of all neighbors arrive between two planning steps
+        pub_trajectory = nh.advertise<std_msgs::UInt8MultiArray>("/onboard/trajectory", 16);
+        pub_map_delta = nh.advertise<std_msgs::UInt8MultiArray>("/onboard/map_delta", 16);
+        pub_desired_path = nh.advertise<nav_msgs::Path>("desired_path", 1);
+        sub_trajectory = nh.subscribe("/onboard/trajectory", 64, &OnboardPlanner::trajectoryCallback, this,
+                                      ros::TransportHints().tcpNoDelay());
+        sub_map_delta = nh.subscribe("/onboard/map_delta", 64, &OnboardPlanner::mapDeltaCallback, this,
+                                     ros::TransportHints().tcpNoDelay());
+        sub_odometry = nh.subscribe("odometry", 1, &OnboardPlanner::odometryCallback, this,
+                                    ros::TransportHints().tcpNoDelay());
+
+        planning_timer = nh.createTimer(ros::Duration(param.multisim_time_step), &OnboardPlanner::planningCallback,
+                                        this);
+    }
+
+    void printLatency() const {
+        if (reaction_latency.getCount() == 0) {
+            ROS_INFO("[OnboardPlanner] No neighbor message is received");
+            return;
+        }
+        ROS_INFO_STREAM("[OnboardPlanner] agent " << agent_id << ", " << reaction_latency.getCount()
+                                                  << " neighbor messages, latency from the receive to the new "
+                                                     "trajectory p50: " << reaction_latency.getPercentile(50)
+                                                  << ", p99: " << reaction_latency.getPercentile(99)
+                                                  << ", from the send p50: " << end_to_end_latency.getPercentile(50)
+                                                  << ", p99: " << end_to_end_latency.getPercentile(99));
+        if (speculative_planning) {
+            int n_speculations = n_speculation_hits + n_speculation_misses;
+            ROS_INFO_STREAM("[OnboardPlanner] agent " << agent_id << ", " << n_speculations
+                                                      << " speculative cycles, hit rate: "
+                                                      << (n_speculations > 0 ? 100.0 * n_speculation_hits /
+                                                                               n_speculations : 0.0)
+                                                      << "%, planning time saved: " << speculation_saved_time
+                                                      << " s");
+        }
+    }
+
+private:
+    struct Neighbor {
+        Obstacle obstacle;
+        TrajectoryDecoder decoder;
+        ros::Time send_time;
+        ros::WallTime receive_time;
+        bool has_traj = false;
+        bool is_consumed = true;
+    };
+
+    ros::NodeHandle nh;
+    Param param;
+    std::shared_ptr<const Mission> mission;
+    int agent_id;
+    int key_frame_interval;
+    double neighbor_timeout;
+    bool speculative_planning; // plan the next cycle from the predicted state while waiting for the timer
+    double speculation_tolerance; // [m], the largest prediction error of the state to keep the speculative cycle
+
+    std::unique_ptr<AgentManager> agent_manager;
+    ros::Publisher pub_trajectory, pub_map_delta, pub_desired_path;
+    ros::Subscriber sub_trajectory, sub_map_delta, sub_odometry;
+    ros::Timer planning_timer;
+
+    std::map<int, Neighbor> neighbors;
+    TrajectoryEncoder encoder;
+    std::vector<uint8_t> key_frame, delta_frame;
+    uint64_t map_delta_seq = 0;
+    bool has_odometry = false;
+    ros::Time last_plan_time; // the start time of the desired trajectory
+    TrajectoryServer trajectory_server; // the desired state for the odometry rate
+    LatencyHistogram reaction_latency, end_to_end_latency; // [s], from the receive and the send of a neighbor message
+
+    // Speculative cycle, the agent manager belongs to the planning thread until the result is taken. The odometry
+    // and the map deltas received meanwhile are deferred to the next planning callback.
+    struct Speculation {
+        std::future<PlanningReport> result;
+        ros::Time start_time; // the start time of the speculative trajectory
+        State predicted_state;
+        double planning_time = 0; // [s]
+        AgentManager::Checkpoint checkpoint;
+    };
+    Speculation speculation;
+    bool has_deferred_state = false;
+    State deferred_state;
+    std::deque<std::pair<int, MapDelta>> deferred_map_deltas; // (sender, delta)
+    int n_speculation_hits = 0, n_speculation_misses = 0;
+    double speculation_saved_time = 0; // [s], the planning time of the committed speculative cycles
+
+    [[nodiscard]] bool isSpeculating() const {
+        return speculation.result.valid();
+    }
+
+    void odometryCallback(const nav_msgs::Odometry::ConstPtr &msg) {
+        State state;
+        state.position = point3d(msg->pose.pose.position.x, msg->pose.pose.position.y, msg->pose.pose.position.z);
+        state.velocity = point3d(msg->twist.twist.linear.x, msg->twist.twist.linear.y, msg->twist.twist.linear.z);
+        // The odometry has no acceleration, it is taken from the desired trajectory
+        State desired_state;
+        if (trajectory_server.getState(msg->header.stamp.toSec(), desired_state)) {
+            state.acceleration = desired_state.acceleration;
+        }
+        if (isSpeculating()) {
+            deferred_state = state;
+            has_deferred_state = true;
+        } else {
+            agent_manager->setCurrentState(state);
+        }
+        has_odometry = true;
+    }
+
+    void trajectoryCallback(const std_msgs::UInt8MultiArray::ConstPtr &msg) {
+        ros::WallTime receive_time = ros::WallTime::now();
+        if (msg->data.size() < TrajectoryPacket::HEADER_SIZE) {
+            ROS_WARN_THROTTLE(1.0, "[OnboardPlanner] Invalid trajectory packet");
+            return;
+        }
+
+        const uint8_t *ptr = msg->data.data();
+        int sender = readValue<uint16_t>(ptr);
+        if (sender == agent_id) {
+            return;
+        }
+        Neighbor &neighbor = neighbors[sender];
+        Obstacle &obstacle = neighbor.obstacle;
+        uint32_t start_sec = readValue<uint32_t>(ptr);
+        uint32_t start_nsec = readValue<uint32_t>(ptr);
+        obstacle.start_time = ros::Time(start_sec, start_nsec);
+        uint32_t send_sec = readValue<uint32_t>(ptr);
+        uint32_t send_nsec = readValue<uint32_t>(ptr);
+        neighbor.send_time = ros::Time(send_sec, send_nsec);
+        obstacle.id = sender;
+        obstacle.type = ObstacleType::AGENT;
+        obstacle.position = readPoint(ptr);
+        obstacle.velocity = readPoint(ptr);
+        obstacle.goal_point = readPoint(ptr);
+        obstacle.radius = readValue<float>(ptr);
+        obstacle.downwash = readValue<float>(ptr);
+        obstacle.max_acc = readValue<float>(ptr);
+        obstacle.collision_alert = readValue<uint8_t>(ptr) != 0;
+        readValue<uint8_t>(ptr); // frame type, the decoder reads it from the frame
+        obstacle.update_time = ros::Time::now();
+
+        // A delta frame against a missed frame is dropped, the previous trajectory is kept until the next key frame
+        size_t frame_size = msg->data.size() - TrajectoryPacket::HEADER_SIZE;
+        if (frame_size > 0 and neighbor.decoder.decode(ptr, frame_size, obstacle.prev_traj)) {
+            neighbor.has_traj = true;
+        } else if (frame_size > 0) {
+            ROS_WARN_STREAM_THROTTLE(1.0, "[OnboardPlanner] Missed the reference frame of agent " << sender);
+        }
+        neighbor.receive_time = receive_time;
+        neighbor.is_consumed = false;
+    }
+
+    void mapDeltaCallback(const std_msgs::UInt8MultiArray::ConstPtr &msg) {
+        if (param.world_use_global_map or msg->data.size() < MapDeltaPacket::HEADER_SIZE) {
+            return;
+        }
+
+        const uint8_t *ptr = msg->data.data();
+        int sender = readValue<uint16_t>(ptr);
+        if (sender == agent_id) {
+            return;
+        }
+        MapDelta delta;
+        delta.seq = readValue<uint64_t>(ptr);
+        auto encoding = readValue<uint8_t>(ptr);
+        const uint8_t *end = msg->data.data() + msg->data.size();
+        if (encoding == MapDeltaPacket::COMPRESSED) {
+            if (not MapDeltaCodec::decompress(ptr, end - ptr, delta)) {
+                ROS_WARN_STREAM_THROTTLE(1.0, "[OnboardPlanner] Invalid map delta of agent " << sender);
+                return;
+            }
+        } else {
+            delta.data.assign(ptr, end);
+        }
+        if (isSpeculating()) {
+            deferred_map_deltas.emplace_back(sender, std::move(delta));
+        } else {
+            agent_manager->mergeMapDelta(sender, delta);
+        }
+    }
+
+    void planningCallback(const ros::TimerEvent &event) {
+        bool is_speculation_committed = false;
+        if (isSpeculating()) {
+            is_speculation_committed = finishSpeculation();
+        }
+
+        // Without the odometry, the vehicle is assumed to follow the desired trajectory
+        if (has_odometry or agent_manager->getTraj().empty()) {
+            agent_manager->updateLocalMap();
+        } else {
+            agent_manager->doStep((ros::Time::now() - last_plan_time).toSec());
+        }
+
+        ros::Time current_time = ros::Time::now();
+        std::vector<Obstacle> msg_obstacles;
+        std::vector<int> new_senders;
+        for (auto it = neighbors.begin(); it != neighbors.end();) {
+            Neighbor &neighbor = it->second;
+            if ((current_time - neighbor.obstacle.update_time).toSec() > neighbor_timeout) {
+                it = neighbors.erase(it);
+                continue;
+            }
+            msg_obstacles.emplace_back(neighbor.obstacle);
+            if (not neighbor.has_traj) {
+                msg_obstacles.back().prev_traj = traj_t();
+            }
+            if (not neighbor.is_consumed) {
+                new_senders.emplace_back(it->first);
+                neighbor.is_consumed = true;
+            }
+            ++it;
+        }
+
+        if (is_speculation_committed) {
+            // The trajectory starts at the predicted time, the neighbor messages since then go to the next cycle
+            current_time = speculation.start_time;
+            for (int sender: new_senders) {
+                neighbors[sender].is_consumed = false;
+            }
+            new_senders.clear();
+        } else {
+            agent_manager->obstacleCallback(msg_obstacles);
+            PlanningReport result = agent_manager->plan(current_time);
+            if (result != PlanningReport::SUCCESS) {
+                ROS_WARN_STREAM_THROTTLE(1.0, "[OnboardPlanner] agent " << agent_id << " planning failed: "
+                                                                        << result);
+                return;
+            }
+        }
+
+        last_plan_time = current_time;
+        trajectory_server.setTrajectory(agent_manager->getTraj(), current_time.toSec());
+        publishDesiredPath(current_time);
+        publishTrajectory(current_time);
+        publishMapDelta();
+        agent_manager->publish();
+
+        ros::WallTime publish_time = ros::WallTime::now();
+        ros::Time publish_stamp = ros::Time::now();
+        for (int sender: new_senders) {
+            const Neighbor &neighbor = neighbors[sender];
+            reaction_latency.record((publish_time - neighbor.receive_time).toSec());
+            end_to_end_latency.record((publish_stamp - neighbor.send_time).toSec());
+        }
+        if (not new_senders.empty()) {
+            ROS_INFO_STREAM_THROTTLE(10.0, "[OnboardPlanner] agent " << agent_id
+                    << " latency from the receive to the new trajectory p50: " << reaction_latency.getPercentile(50)
+                    << ", p99: " << reaction_latency.getPercentile(99));
+        }
+
+        if (speculative_planning and has_odometry) {
+            startSpeculation(std::move(msg_obstacles));
+        }
+    }
+
+    // Plan the next cycle in the background from the state predicted by the desired trajectory at the next timer
+    // event, with the obstacles of this cycle. The planner shifts the predictions of the neighbors to that time.
+    void startSpeculation(std::vector<Obstacle> obstacles) {
+        speculation.start_time = last_plan_time + ros::Duration(param.multisim_time_step);
+        speculation.predicted_state = agent_manager->getFutureState(param.multisim_time_step);
+        agent_manager->saveCheckpoint(speculation.checkpoint);
+        agent_manager->setCurrentState(speculation.predicted_state);
+        agent_manager->obstacleCallback(std::move(obstacles));
+        ros::Time start_time = speculation.start_time;
+        speculation.result = std::async(std::launch::async, [this, start_time]() {
+            Timer timer;
+            PlanningReport result = agent_manager->plan(start_time);
+            timer.stop();
+            speculation.planning_time = timer.elapsedSeconds();
+            return result;
+        });
+    }
+
+    // Wait for the speculative cycle, and keep it if the state is within the tolerance of the predicted state.
+    // Otherwise the agent manager goes back to the checkpoint and the cycle is planned again from the actual state.
+    // The position error and the velocity error over a time step are checked. The deferred inputs are applied.
+    bool finishSpeculation() {
+        PlanningReport result = speculation.result.get();
+        State actual_state = has_deferred_state ? deferred_state : speculation.predicted_state;
+        double position_error = actual_state.position.distance(speculation.predicted_state.position);
+        double velocity_error = actual_state.velocity.distance(speculation.predicted_state.velocity) *
+                                param.multisim_time_step;
+        bool is_hit = result == PlanningReport::SUCCESS and position_error < speculation_tolerance and
+                      velocity_error < speculation_tolerance;
+        if (is_hit) {
+            static MetricCounter &speculation_hits = MetricsRegistry::getInstance().getCounter(
+                    "lsc_speculation_hits_total", "Speculative planning cycles committed");
+            speculation_hits.increment();
+            n_speculation_hits++;
+            speculation_saved_time += speculation.planning_time;
+        } else {
+            static MetricCounter &speculation_misses = MetricsRegistry::getInstance().getCounter(
+                    "lsc_speculation_misses_total", "Speculative planning cycles discarded and planned again");
+            speculation_misses.increment();
+            n_speculation_misses++;
+            agent_manager->restoreCheckpoint(speculation.checkpoint);
+        }
+
+        if (has_deferred_state) {
+            agent_manager->setCurrentState(deferred_state);
+            has_deferred_state = false;
+        } else if (not is_hit) {
+            agent_manager->setCurrentState(speculation.predicted_state);
+        }
+        for (const auto &deferred_map_delta: deferred_map_deltas) {
+            agent_manager->mergeMapDelta(deferred_map_delta.first, deferred_map_delta.second);
+        }
+        deferred_map_deltas.clear();
+        return is_hit;
+    }
+
+    void publishDesiredPath(const ros::Time &current_time) {
+        const traj_t &traj = agent_manager->getTraj();
+        nav_msgs::Path::Ptr msg = boost::make_shared<nav_msgs::Path>();
+        msg->header.frame_id = "world";
+        msg->header.stamp = current_time;
+        int n_samples = param.M * 10;
+        msg->poses.resize(n_samples + 1);
+        for (int si = 0; si <= n_samples; si++) {
+            double t = param.M * param.dt * si / n_samples;
+            point3d point = traj.getPointAt(t);
+            geometry_msgs::PoseStamped &pose = msg->poses[si];
+            pose.header.frame_id = "world";
+            pose.header.stamp = current_time + ros::Duration(t);
+            pose.pose.position.x = point.x();
+            pose.pose.position.y = point.y();
+            pose.pose.position.z = point.z();
+            pose.pose.orientation.w = 1;
+        }
+        pub_desired_path.publish(msg);
+    }
+
+    void publishTrajectory(const ros::Time &current_time) {
+        Obstacle agent = agent_manager->getAgent();
+        if (not encoder.encode(agent.prev_traj, key_frame, delta_frame)) {
+            ROS_WARN_THROTTLE(1.0, "[OnboardPlanner] The trajectory does not fit the wire format");
+            return;
+        }
+
+        // The receivers that missed a frame decode again from the next key frame
+        bool is_key_frame = delta_frame.empty() or encoder.getSeq() % key_frame_interval == 1;
+        const std::vector<uint8_t> &frame = is_key_frame ? key_frame : delta_frame;
+
+        std_msgs::UInt8MultiArray::Ptr msg = boost::make_shared<std_msgs::UInt8MultiArray>();
+        msg->data.reserve(TrajectoryPacket::HEADER_SIZE + frame.size());
+        ros::Time send_time = ros::Time::now();
+        appendValue<uint16_t>(msg->data, static_cast<uint16_t>(agent_id));
+        appendValue<uint32_t>(msg->data, current_time.sec);
+        appendValue<uint32_t>(msg->data, current_time.nsec);
+        appendValue<uint32_t>(msg->data, send_time.sec);
+        appendValue<uint32_t>(msg->data, send_time.nsec);
+        appendPoint(msg->data, agent.position);
+        appendPoint(msg->data, agent.velocity);
+        appendPoint(msg->data, agent.goal_point);
+        appendValue<float>(msg->data, static_cast<float>(agent.radius));
+        appendValue<float>(msg->data, static_cast<float>(agent.downwash));
+        appendValue<float>(msg->data, static_cast<float>(agent.max_acc));
+        appendValue<uint8_t>(msg->data, agent.collision_alert ? 1 : 0);
+        appendValue<uint8_t>(msg->data, is_key_frame ? TrajectoryFrame::KEY : TrajectoryFrame::DELTA);
+        msg->data.insert(msg->data.end(), frame.begin(), frame.end());
+        pub_trajectory.publish(msg);
+    }
+
+    void publishMapDelta() {
+        if (param.world_use_global_map) {
+            return;
+        }
+
+        // Only the voxels changed since the last delta, a receiver that missed it keeps the older voxels
+        MapDelta delta = agent_manager->getMapDelta(map_delta_seq);
+        map_delta_seq = delta.seq;
+        if (delta.size() == 0) {
+            return;
+        }
+
+        std_msgs::UInt8MultiArray::Ptr msg = boost::make_shared<std_msgs::UInt8MultiArray>();
+        const std::vector<uint8_t> *payload = &delta.data;
+        std::vector<uint8_t> compressed;
+        if (param.communication_map_delta_compression) {
+            MapDeltaCodec::compress(delta, compressed);
+            payload = &compressed;
+        }
+        msg->data.reserve(MapDeltaPacket::HEADER_SIZE + payload->size());
+        appendValue<uint16_t>(msg->data, static_cast<uint16_t>(agent_id));
+        appendValue<uint64_t>(msg->data, delta.seq);
+        appendValue<uint8_t>(msg->data, param.communication_map_delta_compression ? MapDeltaPacket::COMPRESSED
+                                                                                  : MapDeltaPacket::RAW);
+        msg->data.insert(msg->data.end(), payload->begin(), payload->end());
+        pub_map_delta.publish(msg);
+    }
+};
+
+int main(int argc, char* argv[]){
+    ros::init(argc, argv, "onboard_planner_node");
+    ros::NodeHandle nh("~");
+
+    Param param;
+    if (not param.initialize(nh)) {
+        ROS_ERROR("[OnboardPlanner] Invalid parameter in launch file");
+        return -1;
+    }
+
+    int agent_id, key_frame_interval, mission_idx;
+    double neighbor_timeout;
+    nh.param<int>("agent_id", agent_id, 0);
+    nh.param<int>("mission_idx", mission_idx, 0);
+    nh.param<int>("key_frame_interval", key_frame_interval, 10);
+    nh.param<double>("neighbor_timeout", neighbor_timeout, 1.0);
+    bool speculative_planning;
+    double speculation_tolerance;
+    nh.param<bool>("speculative_planning", speculative_planning, false);
+    nh.param<double>("speculation_tolerance", speculation_tolerance, 0.05);
+
+    Mission mission(nh);
+    if (not mission.loadMission(param.multisim_max_noise, param.world_dimension, param.world_z_2d, mission_idx)) {
+        ROS_ERROR("[OnboardPlanner] Invalid mission");
+        return -1;
+    }
+    if (agent_id < 0 or static_cast<size_t>(agent_id) >= mission.qn) {
+        ROS_ERROR_STREAM("[OnboardPlanner] Invalid agent_id " << agent_id << ", the mission has " << mission.qn
+                                                              << " agents");
+        return -1;
+    }
+
+    OnboardPlanner onboard_planner(nh, param, mission, agent_id, key_frame_interval, neighbor_timeout,
+                                   speculative_planning, speculation_tolerance);
+    ros::spin();
+    onboard_planner.printLatency();
+    return 0;
+}
@@ -671,7 +671,7 @@ inline static void subalgorithm(struct simplex *s, double *v) {
   }
 }
 
-double gjk(struct bd bd1, struct bd bd2, struct simplex *s, double* v) {
+double gjk(struct bd *bd1, struct bd *bd2, struct simplex *s, double* v, const double *v_init) {
 
   int k = 0;                /**< Iteration counter            */
   int i;                    /**< General purpose counter      */
@@ -689,39 +689,47 @@ double gjk(struct bd bd1, struct bd bd2, struct simplex *s, double* v) {
   int nullV = 0;
 
 #ifdef DEBUG
-  mexPrintf("Num points A = %i \n", bd1.numpoints);
-  mexPrintf("Num points B = %i \n", bd2.numpoints);
-  for (i = 0; i < bd1.numpoints; ++i) {
+  mexPrintf("Num points A = %i \n", bd1->numpoints);
+  mexPrintf("Num points B = %i \n", bd2->numpoints);
+  for (i = 0; i < bd1->numpoints; ++i) {
     for (int j = 0; j < 3; j++) {
-      mexPrintf("%.4f ", bd1.coord[i][j]);
+      mexPrintf("%.4f ", bd1->coord[i][j]);
     }
     mexPrintf("\n");
   }
 
-  for (i = 0; i < bd2.numpoints; ++i) {
+  for (i = 0; i < bd2->numpoints; ++i) {
     for (int j = 0; j < 3; j++) {
-      mexPrintf("%.4f ", bd2.coord[i][j]);
+      mexPrintf("%.4f ", bd2->coord[i][j]);
     }
     mexPrintf("\n");
   }
 #endif
 
+  for (int t = 0; t < 3; ++t)
+    bd1->s[t] = bd1->coord[0][t];
+
+  for (int t = 0; t < 3; ++t)
+    bd2->s[t] = bd2->coord[0][t];
+
+  /* Warm start: the first vertex is the support point in the direction of the previous query */
+  if (v_init != nullptr && norm2(v_init) > eps_tot22) {
+    for (int t = 0; t < 3; ++t)
+      vminus[t] = -v_init[t];
+    support(bd1, vminus);
+    support(bd2, v_init);
+  }
+
   /* Initialise search direction */
-  v[0] = bd1.coord[0][0] - bd2.coord[0][0];
-  v[1] = bd1.coord[0][1] - bd2.coord[0][1];
-  v[2] = bd1.coord[0][2] - bd2.coord[0][2];
+  v[0] = bd1->s[0] - bd2->s[0];
+  v[1] = bd1->s[1] - bd2->s[1];
+  v[2] = bd1->s[2] - bd2->s[2];
 
   /* Intialise simplex */
   s->nvrtx = 1;
   for (int t = 0; t < 3; ++t)
     s->vrtx[0][t] = v[t];
 
-  for (int t = 0; t < 3; ++t)
-    bd1.s[t] = bd1.coord[0][t];
-
-  for (int t = 0; t < 3; ++t)
-    bd2.s[t] = bd2.coord[0][t];
-
   /* Begin GJK iteration */
   do {
 
@@ -732,10 +740,10 @@ double gjk(struct bd bd1, struct bd bd2, struct simplex *s, double* v) {
       vminus[t] = -v[t];
 
     /* Support function */
-    support(&bd1, vminus);
-    support(&bd2, v);
+    support(bd1, vminus);
+    support(bd2, v);
     for (int t = 0; t < 3; ++t)
-      w[t] = bd1.s[t] - bd2.s[t];
+      w[t] = bd1->s[t] - bd2->s[t];
 
     /* Test first exit condition (new point already in simplex/can't move further) */
     exeedtol_rel = (norm2(v) - dotProduct(v, w));
@@ -878,7 +886,8 @@ void mexFunction(int nlhs, mxArray *plhs[],
   s.nvrtx = 0;
 
   /* Compute squared distance using GJK algorithm */
-  distance[0] = gjk(bd1, bd2, &s);
+  double v[3];
+  distance[0] = gjk(&bd1, &bd2, &s, v);
 
   mxFree(arr1);
   mxFree(arr2);
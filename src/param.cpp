@@ -1,10 +1,13 @@
 #include <param.hpp>
+#include <polynomial.hpp>
+#include <sstream>
 #define GET_VARIABLE_NAME(Variable) (#Variable)
 
 namespace DynamicPlanning {
     bool Param::initialize(const ros::NodeHandle &nh) {
         nh.param<bool>("log_solver", log_solver, false);
         nh.param<bool>("log_vis", log_vis, true);
+        nh.param<bool>("log_qp_failure", log_qp_failure, true);
 
         // World
         nh.param<std::string>("world/frame_id", world_frame_id, "world");
@@ -14,20 +17,122 @@ namespace DynamicPlanning {
         nh.param<double>("world/z_2d", world_z_2d, 1.0);
         nh.param<bool>("world/use_global_map", world_use_global_map, true);
         nh.param<double>("world/max_dist", world_max_dist, 1.0);
+        nh.param<bool>("world/occupancy_index", world_occupancy_index, true);
+        nh.param<bool>("world/sfc_library", world_sfc_library, true);
+        nh.param<int>("world/sfc_library_size", world_sfc_library_size, 10000);
+        nh.param<bool>("world/sfc_parallel_candidates", world_sfc_parallel_candidates, false);
+        nh.param<bool>("world/swept_clearance_check", world_swept_clearance_check, false);
+        nh.param<bool>("world/distmap_cache", world_distmap_cache, false);
+        nh.param<bool>("world/analytic", world_analytic, false);
+        nh.param<double>("world/rolling_window_size", world_rolling_window_size, 0);
+        if (world_rolling_window_size < 0) {
+            ROS_ERROR("[Param] Invalid rolling window size, use 0");
+            world_rolling_window_size = 0;
+        }
+        nh.param<bool>("world/sparse_distmap", world_sparse_distmap, false);
+        nh.param<bool>("world/async_map_merge", world_async_map_merge, false);
 
         // Multisim setting
         nh.param<int>("multisim/planning_rate", multisim_planning_rate, -1);
+        nh.param<bool>("multisim/fast_forward", multisim_fast_forward, false);
+        nh.param<int>("multisim/publish_period", multisim_publish_period, 1);
+        nh.param<int>("multisim/history_downsample", multisim_history_downsample, 4);
+        nh.param<double>("multisim/visualization_rate", multisim_visualization_rate, 0.0);
         nh.param<int>("multisim/qn", multisim_qn, 2);
         nh.param<double>("multisim/time_step", multisim_time_step, 0.1);
         nh.param<bool>("multisim/patrol", multisim_patrol, false);
         nh.param<double>("multisim/max_noise", multisim_max_noise, 0.0);
         nh.param<int>("multisim/max_planner_iteration", multisim_max_planner_iteration, 1000);
         nh.param<bool>("multisim/save_result", multisim_save_result, false);
+        nh.param<bool>("multisim/save_binary", multisim_save_binary, false);
         nh.param<bool>("multisim/save_mission", multisim_save_mission, false);
         nh.param<bool>("multisim/replay", multisim_replay, false);
         nh.param<std::string>("multisim/replay_file_name", multisim_replay_file_name, "default.csv");
         nh.param<double>("multisim/replay_time_limit", multisim_replay_time_limit, -1);
+        nh.param<double>("multisim/replay_speed", multisim_replay_speed, 1.0);
+        if (multisim_replay_speed <= 0) {
+            ROS_ERROR("[Param] Invalid replay speed, use 1");
+            multisim_replay_speed = 1.0;
+        }
         nh.param<double>("multisim/record_time_step", multisim_save_time_step, 0.1);
+        nh.param<bool>("multisim/continuous_collision_check", multisim_continuous_collision_check, false);
+        nh.param<bool>("multisim/offline_metrics", multisim_offline_metrics, false);
+        nh.param<bool>("multisim/batch_optimization", multisim_batch_optimization, true);
+        nh.param<int>("multisim/batch_workers", multisim_batch_workers, 0);
+        nh.param<bool>("multisim/batch_qp", multisim_batch_qp, false);
+        nh.param<bool>("multisim/parallel_planning", multisim_parallel_planning, false);
+        nh.param<bool>("multisim/parallel_mapf", multisim_parallel_mapf, true);
+        nh.param<bool>("multisim/pipelined_step", multisim_pipelined_step, true);
+        std::string thread_placement_str;
+        nh.param<std::string>("multisim/thread_placement", thread_placement_str, "none");
+        if (not CPUTopology::parsePlacementMode(thread_placement_str, multisim_thread_placement)) {
+            ROS_ERROR("[Param] Invalid thread placement mode");
+            return false;
+        }
+        nh.param<bool>("multisim/sticky_agents", multisim_sticky_agents, false);
+        nh.param<int>("multisim/admm_iterations", multisim_admm_iterations, 0);
+        nh.param<double>("multisim/admm_rho", multisim_admm_rho, 0.05);
+        nh.param<bool>("multisim/headless", multisim_headless, false);
+        nh.param<bool>("multisim/lazy_publishers", multisim_lazy_publishers, false);
+        nh.param<int>("multisim/shard_index", multisim_shard_index, 0);
+        nh.param<int>("multisim/num_shards", multisim_num_shards, 1);
+        nh.param<int>("multisim/num_processes", multisim_num_processes, 1);
+        nh.param<int>("multisim/process_index", multisim_process_index, 0);
+        std::string exchange_mode_str;
+        nh.param<std::string>("multisim/exchange_mode", exchange_mode_str, "shared_memory");
+        if (not AgentExchange::parseMode(exchange_mode_str, multisim_exchange_mode)) {
+            ROS_ERROR("[Param] Invalid exchange mode");
+            return false;
+        }
+        nh.param<std::string>("multisim/exchange_address", multisim_exchange_address, "lsc_agent_exchange");
+        nh.param<int>("multisim/preload_missions", multisim_preload_missions, 2);
+        if (multisim_preload_missions < 0) {
+            ROS_ERROR("[Param] Invalid number of preloaded missions, use 0");
+            multisim_preload_missions = 0;
+        }
+        nh.param<bool>("multisim/trace", multisim_trace, false);
+        nh.param<double>("multisim/metrics_rate", multisim_metrics_rate, 0.0);
+        if (multisim_metrics_rate < 0) {
+            ROS_ERROR("[Param] Invalid metrics rate, use 0");
+            multisim_metrics_rate = 0;
+        }
+        nh.param<std::string>("multisim/metrics_file", multisim_metrics_file, "");
+        nh.param<bool>("multisim/capture", multisim_capture, false);
+        nh.param<std::string>("multisim/capture_file", multisim_capture_file, "");
+        nh.param<int>("multisim/recorder_size", multisim_recorder_size, 0);
+        nh.param<double>("multisim/recorder_threshold", multisim_recorder_threshold, 0);
+        nh.param<int>("multisim/checkpoint_step", multisim_checkpoint_step, -1);
+        nh.param<std::string>("multisim/restore_file", multisim_restore_file, "");
+        nh.param<int>("multisim/batch_tenants", multisim_batch_tenants, 1);
+        if (multisim_batch_tenants < 1) {
+            ROS_ERROR("[Param] Invalid number of batch tenants, use 1");
+            multisim_batch_tenants = 1;
+        }
+        if (multisim_recorder_size < 0) {
+            ROS_ERROR("[Param] Invalid recorder size, the recorder is disabled");
+            multisim_recorder_size = 0;
+        }
+        std::string latency_percentiles_str;
+        nh.param<std::string>("multisim/latency_percentiles", latency_percentiles_str, "50,95,99");
+        multisim_latency_percentiles.clear();
+        std::stringstream latency_percentiles_stream(latency_percentiles_str);
+        std::string percentile_str;
+        while (std::getline(latency_percentiles_stream, percentile_str, ',')) {
+            double percentile;
+            try {
+                percentile = std::stod(percentile_str);
+            } catch (const std::exception &) {
+                percentile = -1;
+            }
+            if (percentile < 0 or percentile > 100) {
+                ROS_ERROR_STREAM("[Param] Invalid latency percentile: " << percentile_str);
+                return false;
+            }
+            multisim_latency_percentiles.emplace_back(percentile);
+        }
+        if (not validateMultisim()) {
+            return false;
+        }
 
         // Goal mode
         std::string goal_mode_str;
@@ -50,14 +155,40 @@ namespace DynamicPlanning {
         // MAPF mode
         std::string mapf_mode_str;
         nh.param<std::string>("mode/mapf", mapf_mode_str, "pibt");
-        if (mapf_mode_str == "pibt") {
-            mapf_mode = MAPFMode::PIBT;
-        } else if (mapf_mode_str == "ecbs") {
-            mapf_mode = MAPFMode::ECBS;
-        } else {
+        if (not getMAPFMode(mapf_mode_str, mapf_mode)) {
             ROS_ERROR("[Param] Invalid mapf mode");
             return false;
         }
+        std::string mapf_portfolio_str;
+        nh.param<std::string>("mode/mapf_portfolio", mapf_portfolio_str, "pibt,ecbs,icbs,pibt_complete");
+        mapf_portfolio_modes.clear();
+        std::stringstream mapf_portfolio_stream(mapf_portfolio_str);
+        std::string member_str;
+        while (std::getline(mapf_portfolio_stream, member_str, ',')) {
+            MAPFMode member;
+            if (not getMAPFMode(member_str, member) or member == MAPFMode::PORTFOLIO) {
+                ROS_ERROR_STREAM("[Param] Invalid mapf portfolio member: " << member_str);
+                return false;
+            }
+            mapf_portfolio_modes.emplace_back(member);
+        }
+        if (mapf_mode == MAPFMode::PORTFOLIO and mapf_portfolio_modes.empty()) {
+            ROS_ERROR("[Param] Empty mapf portfolio");
+            return false;
+        }
+        nh.param<bool>("mode/mapf_portfolio_anytime", mapf_portfolio_anytime, false);
+
+        // QP solver mode
+        std::string qp_solver_mode_str;
+        nh.param<std::string>("mode/qp_solver", qp_solver_mode_str, "cplex");
+        if (qp_solver_mode_str == "cplex") {
+            qp_solver_mode = QPSolverMode::CPLEX;
+        } else if (qp_solver_mode_str == "osqp") {
+            qp_solver_mode = QPSolverMode::OSQP;
+        } else {
+            ROS_ERROR("[Param] Invalid qp solver mode");
+            return false;
+        }
 
         // Obstacle prediction
         nh.param<bool>("obs/size_prediction", obs_size_prediction, true);
@@ -70,6 +201,10 @@ namespace DynamicPlanning {
         nh.param<double>("traj/dt", dt, 0.2);
         nh.param<int>("traj/M", M, 5);
         nh.param<int>("traj/n", n, 5);
+        if (n < 2 or n > MAX_BERNSTEIN_DEGREE) {
+            ROS_ERROR("[Param] Invalid polynomial degree, use 5");
+            n = 5;
+        }
         nh.param<int>("traj/phi", phi, 3);
         nh.param<int>("traj/phi_n", phi_n, 1);
 
@@ -78,15 +213,55 @@ namespace DynamicPlanning {
         nh.param<double>("opt/terminal_weight", terminal_weight, 1);
         nh.param<double>("opt/slack_collision_weight", slack_collision_weight, 1);
         nh.param<double>("opt/slack_dynamic_weight", slack_dynamic_weight, 1);
+        nh.param<bool>("opt/persistent_model", opt_persistent_model, true);
+        nh.param<bool>("opt/sparse_assembly", opt_sparse_assembly, true);
+        nh.param<bool>("opt/condensed_qp", opt_condensed_qp, false);
+        nh.param<bool>("opt/axis_decoupled_qp", opt_axis_decoupled_qp, true);
+        nh.param<bool>("opt/record_qp", opt_record_qp, false);
+        nh.param<bool>("opt/warm_start", opt_warm_start, true);
+        nh.param<bool>("opt/goal_analytic", opt_goal_analytic, true);
+        nh.param<bool>("opt/prune_constraints", opt_prune_constraints, true);
+        nh.param<bool>("opt/reduce_constraints", opt_reduce_constraints, true);
+        nh.param<bool>("opt/reduce_constraints_lp", opt_reduce_constraints_lp, false);
+        nh.param<int>("opt/solver_threads", opt_solver_threads, 0);
+        nh.param<bool>("opt/soft_collision", opt_soft_collision, false);
+        nh.param<double>("opt/soft_collision_weight", opt_soft_collision_weight, 1e4);
+        if (opt_soft_collision_weight <= 0) {
+            ROS_ERROR("[Param] Invalid soft collision weight, use 1e4");
+            opt_soft_collision_weight = 1e4;
+        }
+
+        // Deadline
+        nh.param<double>("deadline/budget", deadline_budget, 0.0);
+        if (deadline_budget < 0) {
+            ROS_ERROR("[Param] Invalid deadline budget, use 0");
+            deadline_budget = 0;
+        }
+        nh.param<double>("deadline/mapf_budget", deadline_mapf_budget, 0.0);
+        if (deadline_mapf_budget < 0) {
+            ROS_ERROR("[Param] Invalid MAPF deadline budget, use 0");
+            deadline_mapf_budget = 0;
+        }
 
         // Deadlock
         nh.param<double>("deadlock/velocity_threshold", deadlock_velocity_threshold, 0.1);
         nh.param<int>("deadlock/seq_threshold", deadlock_seq_threshold, 5);
+        nh.param<int>("deadlock/progress_window", deadlock_progress_window, 0);
+        if (deadlock_progress_window < 0) {
+            ROS_ERROR("[Param] Invalid progress window, use 0");
+            deadlock_progress_window = 0;
+        }
+        nh.param<double>("deadlock/progress_rate_threshold", deadlock_progress_rate_threshold, 0.1);
 
         // Filter
         nh.param<double>("filter/sigma_y_sq", filter_sigma_y_sq, 0.0036);
         nh.param<double>("filter/sigma_v_sq", filter_sigma_v_sq, 0.01);
         nh.param<double>("filter/sigma_a_sq", filter_sigma_a_sq, 1.0);
+        nh.param<double>("filter/ingestion_rate", filter_ingestion_rate, 100.0);
+        if (filter_ingestion_rate <= 0) {
+            ROS_ERROR("[Param] Invalid ingestion rate, use 100 Hz");
+            filter_ingestion_rate = 100.0;
+        }
 
         // ORCA
         nh.param<double>("orca/horizon", orca_horizon, 2.0);
@@ -96,6 +271,39 @@ namespace DynamicPlanning {
         // Grid-based planner
         nh.param<double>("grid/resolution", grid_resolution, 0.3);
         nh.param<double>("grid/margin", grid_margin, 0.1);
+        nh.param<int>("grid/connectivity", grid_connectivity, 6);
+        if (grid_connectivity != 6 and grid_connectivity != 26) {
+            ROS_ERROR("[Param] Invalid grid connectivity, use 6");
+            grid_connectivity = 6;
+        }
+        nh.param<int>("grid/distance_table_capacity", grid_distance_table_capacity, 256);
+        nh.param<int>("grid/mapf_time_limit", grid_mapf_time_limit, 60000);
+        nh.param<bool>("grid/mapf_parallel", grid_mapf_parallel, false);
+        nh.param<int>("grid/mapf_window", grid_mapf_window, 0);
+        if (grid_mapf_window < 0) {
+            ROS_ERROR("[Param] Invalid MAPF window, use 0");
+            grid_mapf_window = 0;
+        }
+        nh.param<int>("grid/mapf_refine_time_limit", grid_mapf_refine_time_limit, 0);
+        if (grid_mapf_refine_time_limit < 0) {
+            ROS_ERROR("[Param] Invalid MAPF refinement time limit, use 0");
+            grid_mapf_refine_time_limit = 0;
+        }
+        nh.param<int>("grid/mapf_cluster_size", grid_mapf_cluster_size, 0);
+        if (grid_mapf_cluster_size < 0) {
+            ROS_ERROR("[Param] Invalid MAPF cluster size, use 0");
+            grid_mapf_cluster_size = 0;
+        }
+        nh.param<int>("grid/ecbs_batch_size", grid_ecbs_batch_size, 1);
+        if (grid_ecbs_batch_size < 1) {
+            ROS_ERROR("[Param] Invalid ECBS batch size, use 1");
+            grid_ecbs_batch_size = 1;
+        }
+        nh.param<double>("grid/space_time_step", grid_space_time_step, 0.0);
+        if (grid_space_time_step < 0) {
+            ROS_ERROR("[Param] Invalid space-time step, use 0");
+            grid_space_time_step = 0;
+        }
 
         // Goal
         nh.param<double>("plan/goal_threshold", goal_threshold, 0.1);
@@ -109,15 +317,68 @@ namespace DynamicPlanning {
         nh.param<double>("plan/collision_alert_threshold", collision_alert_threshold, 1.0);
         nh.param<double>("plan/density_alert_threshold", density_alert_threshold, 0.001);
         nh.param<double>("plan/closest_agent_threshold", closest_agent_threshold, 0.1);
+        nh.param<int>("plan/parallel_lsc_threshold", parallel_lsc_threshold, 8);
+        nh.param<double>("plan/lsc_cache_tolerance", lsc_cache_tolerance, 0.001);
+        nh.param<double>("plan/lsc_lod_near_range", lsc_lod_near_range, 0);
+        nh.param<double>("plan/lsc_lod_far_range", lsc_lod_far_range, 0);
+        if (lsc_lod_far_range > 0 and lsc_lod_far_range < lsc_lod_near_range) {
+            ROS_ERROR("[Param] lsc_lod_far_range is smaller than lsc_lod_near_range, use lsc_lod_near_range");
+            lsc_lod_far_range = lsc_lod_near_range;
+        }
+        nh.param<bool>("plan/neighbor_pruning", neighbor_pruning, true);
+        nh.param<int>("plan/max_neighbors", max_neighbors, 0);
+        nh.param<bool>("plan/adaptive_horizon", adaptive_horizon, false);
+        nh.param<int>("plan/adaptive_horizon_min_M", adaptive_horizon_min_M, 3);
+        nh.param<int>("plan/adaptive_horizon_neighbors", adaptive_horizon_neighbors, 4);
+        nh.param<bool>("plan/hover_mode", hover_mode, false);
+        nh.param<double>("plan/hover_tolerance", hover_tolerance, 0.01);
+        nh.param<bool>("plan/fallback_planner", fallback_planner, true);
+        nh.param<double>("plan/fallback_budget", fallback_budget, 0.005);
 
         // SFC
         nh.param<double>("plan/numerical_error_threshold", numerical_error_threshold, 0.01);
 
         // Communication
         nh.param<double>("communication/range", communication_range, 3.0);
+        nh.param<double>("communication/quantization_step", communication_quantization_step, 0);
+        if (communication_quantization_step < 0) {
+            ROS_ERROR("[Param] Invalid communication quantization step, use 0");
+            communication_quantization_step = 0;
+        }
+        nh.param<double>("communication/latency", communication_latency, 0);
+        nh.param<double>("communication/latency_jitter", communication_latency_jitter, 0);
+        nh.param<double>("communication/bandwidth", communication_bandwidth, 0);
+        nh.param<double>("communication/packet_loss", communication_packet_loss, 0);
+        nh.param<double>("communication/timeout", communication_timeout, 1.0);
+        nh.param<bool>("communication/map_delta_compression", communication_map_delta_compression, false);
+        if (communication_latency < 0 or communication_latency_jitter < 0 or communication_bandwidth < 0 or
+            communication_packet_loss < 0 or communication_packet_loss >= 1) {
+            ROS_ERROR("[Param] Invalid communication network, use the instant exchange");
+            communication_latency = 0;
+            communication_latency_jitter = 0;
+            communication_bandwidth = 0;
+            communication_packet_loss = 0;
+        }
 
         // Exploration
         nh.param<double>("sensor/range", sensor_range, 3.0);
+        nh.param<double>("sensor/horizontal_fov", sensor_horizontal_fov, 360.0);
+        nh.param<double>("sensor/vertical_fov", sensor_vertical_fov, 60.0);
+        nh.param<double>("sensor/angular_resolution", sensor_angular_resolution, 2.0);
+        std::string sensor_mode_str;
+        nh.param<std::string>("sensor/mode", sensor_mode_str, "sphere");
+        if (sensor_mode_str == "sphere") {
+            sensor_mode = SensorMode::SPHERE;
+        } else if (sensor_mode_str == "raycast") {
+            sensor_mode = SensorMode::RAYCAST;
+        } else {
+            ROS_ERROR("[Param] Invalid sensor mode");
+            return false;
+        }
+        if (sensor_angular_resolution <= 0) {
+            ROS_ERROR("[Param] Invalid sensor angular resolution, use 2 deg");
+            sensor_angular_resolution = 2.0;
+        }
 
         // Debug
         nh.param<int>("debug/planner_seq", debug_planner_seq, 0);
@@ -168,10 +429,125 @@ namespace DynamicPlanning {
             ROS_ERROR("[Param] Invalid planner mode");
             return false;
         }
+        if (multisim_admm_iterations > 0 and planner_mode != PlannerMode::DLSC and planner_mode != PlannerMode::LSC) {
+            // The margins of the shared constraints are split only by LSC
+            ROS_ERROR("[Param] ADMM iterations support only LSC, DLSC, use 0");
+            multisim_admm_iterations = 0;
+        }
 
         return true;
     }
 
+    bool Param::validateMultisim() {
+        if (multisim_num_shards < 1 or multisim_shard_index < 0 or multisim_shard_index >= multisim_num_shards) {
+            ROS_ERROR_STREAM("[Param] Invalid shard, index: " << multisim_shard_index
+                             << ", num_shards: " << multisim_num_shards);
+            return false;
+        }
+        if (multisim_num_processes < 1 or multisim_process_index < 0 or
+            multisim_process_index >= multisim_num_processes) {
+            ROS_ERROR_STREAM("[Param] Invalid process, index: " << multisim_process_index
+                             << ", num_processes: " << multisim_num_processes);
+            return false;
+        }
+        if (multisim_publish_period < 1) {
+            ROS_ERROR("[Param] Invalid publish period, use 1");
+            multisim_publish_period = 1;
+        }
+        if (multisim_history_downsample < 1) {
+            ROS_ERROR("[Param] Invalid history downsample, use 1");
+            multisim_history_downsample = 1;
+        }
+        if (multisim_visualization_rate < 0) {
+            ROS_ERROR("[Param] Invalid visualization rate, use 0");
+            multisim_visualization_rate = 0;
+        }
+        if (multisim_admm_iterations < 0) {
+            ROS_ERROR("[Param] Invalid ADMM iterations, use 0");
+            multisim_admm_iterations = 0;
+        }
+        if (multisim_admm_rho <= 0) {
+            ROS_ERROR("[Param] Invalid ADMM rho, use 0.05");
+            multisim_admm_rho = 0.05;
+        }
+        if (multisim_headless and world_use_octomap and not world_use_global_map) {
+            ROS_ERROR("[Param] The headless simulator can not subscribe the global map, use the global map");
+            world_use_global_map = true;
+        }
+        return true;
+    }
+
+    bool Param::isMissionInShard(size_t mission_idx) const {
+        return mission_idx % multisim_num_shards == (size_t) multisim_shard_index;
+    }
+
+    bool Param::isAgentInProcess(size_t agent_idx) const {
+        return agent_idx % multisim_num_processes == (size_t) multisim_process_index;
+    }
+
+    bool Param::isNetworkSimulated() const {
+        return communication_latency > 0 or communication_latency_jitter > 0 or communication_bandwidth > 0 or
+               communication_packet_loss > 0;
+    }
+
+    bool Param::isTrajectoryStructureChanged(const Param &other) const {
+        return dt != other.dt or M != other.M or n != other.n or phi != other.phi or phi_n != other.phi_n;
+    }
+
+    bool Param::isRestartRequired(const Param &other) const {
+        // The maps, the sensors and the worlds are built from these
+        bool is_world_changed =
+                world_frame_id != other.world_frame_id or world_dimension != other.world_dimension or
+                world_use_octomap != other.world_use_octomap or world_resolution != other.world_resolution or
+                world_z_2d != other.world_z_2d or world_use_global_map != other.world_use_global_map or
+                world_max_dist != other.world_max_dist or world_occupancy_index != other.world_occupancy_index or
+                world_sfc_library != other.world_sfc_library or
+                world_sfc_library_size != other.world_sfc_library_size or
+                world_distmap_cache != other.world_distmap_cache or world_analytic != other.world_analytic or
+                world_rolling_window_size != other.world_rolling_window_size or
+                world_sparse_distmap != other.world_sparse_distmap or
+                world_async_map_merge != other.world_async_map_merge or sensor_range != other.sensor_range or
+                sensor_mode != other.sensor_mode or sensor_horizontal_fov != other.sensor_horizontal_fov or
+                sensor_vertical_fov != other.sensor_vertical_fov or
+                sensor_angular_resolution != other.sensor_angular_resolution;
+
+        // The simulator, its workers and the filters are set up from these
+        bool is_simulator_changed =
+                multisim_qn != other.multisim_qn or multisim_time_step != other.multisim_time_step or
+                multisim_planning_rate != other.multisim_planning_rate or
+                multisim_fast_forward != other.multisim_fast_forward or multisim_headless != other.multisim_headless or
+                multisim_lazy_publishers != other.multisim_lazy_publishers or
+                multisim_history_downsample != other.multisim_history_downsample or
+                multisim_save_result != other.multisim_save_result or
+                multisim_save_binary != other.multisim_save_binary or multisim_replay != other.multisim_replay or
+                multisim_batch_optimization != other.multisim_batch_optimization or
+                multisim_batch_workers != other.multisim_batch_workers or
+                multisim_parallel_planning != other.multisim_parallel_planning or
+                multisim_thread_placement != other.multisim_thread_placement or
+                multisim_num_processes != other.multisim_num_processes or
+                multisim_process_index != other.multisim_process_index or
+                multisim_exchange_mode != other.multisim_exchange_mode or
+                multisim_exchange_address != other.multisim_exchange_address or
+                opt_solver_threads != other.opt_solver_threads or filter_sigma_y_sq != other.filter_sigma_y_sq or
+                filter_sigma_v_sq != other.filter_sigma_v_sq or filter_sigma_a_sq != other.filter_sigma_a_sq or
+                filter_ingestion_rate != other.filter_ingestion_rate or
+                communication_quantization_step != other.communication_quantization_step or
+                communication_latency != other.communication_latency or
+                communication_latency_jitter != other.communication_latency_jitter or
+                communication_bandwidth != other.communication_bandwidth or
+                communication_packet_loss != other.communication_packet_loss or
+                communication_timeout != other.communication_timeout or
+                communication_map_delta_compression != other.communication_map_delta_compression or
+                multisim_metrics_rate != other.multisim_metrics_rate or
+                multisim_metrics_file != other.multisim_metrics_file or multisim_capture != other.multisim_capture or
+                multisim_capture_file != other.multisim_capture_file or
+                multisim_recorder_size != other.multisim_recorder_size or
+                multisim_recorder_threshold != other.multisim_recorder_threshold;
+
+        // The SFCs are initialized by the planner mode
+        return is_world_changed or is_simulator_changed or planner_mode != other.planner_mode;
+    }
+
     std::string Param::getPlannerModeStr() const {
         const std::string planner_mode_strs[] = {"DLSC", "LSC", "BVC", "ORCA", "ReciprocalRSFC", "CircleTest"};
         return planner_mode_strs[static_cast<int>(planner_mode)];
@@ -202,7 +578,40 @@ namespace DynamicPlanning {
     }
 
     std::string Param::getMAPFModeStr() const {
-        const std::string planner_mode_strs[] = {"pibt", "ecbs"};
-        return planner_mode_strs[static_cast<int>(mapf_mode)];
+        return getMAPFModeStr(mapf_mode);
+    }
+
+    std::string Param::getMAPFModeStr(MAPFMode mode) {
+        const std::string mapf_mode_strs[] = {"pibt", "ecbs", "cbs", "icbs", "hca", "whca", "winpibt",
+                                              "pibt_complete", "push_and_swap", "revisit_pp", "ir", "portfolio"};
+        return mapf_mode_strs[static_cast<int>(mode)];
+    }
+
+    bool Param::getMAPFMode(const std::string &mapf_mode_str, MAPFMode &mode) {
+        for (int i = 0; i <= static_cast<int>(MAPFMode::PORTFOLIO); i++) {
+            if (mapf_mode_str == getMAPFModeStr(static_cast<MAPFMode>(i))) {
+                mode = static_cast<MAPFMode>(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::string Param::getQPSolverModeStr() const {
+        const std::string qp_solver_mode_strs[] = {"cplex", "osqp"};
+        return qp_solver_mode_strs[static_cast<int>(qp_solver_mode)];
+    }
+
+    std::string Param::getSensorModeStr() const {
+        const std::string sensor_mode_strs[] = {"sphere", "raycast"};
+        return sensor_mode_strs[static_cast<int>(sensor_mode)];
+    }
+
+    std::string Param::getThreadPlacementModeStr() const {
+        return CPUTopology::getPlacementModeStr(multisim_thread_placement);
+    }
+
+    std::string Param::getExchangeModeStr() const {
+        return AgentExchange::getModeStr(multisim_exchange_mode);
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,398 @@
+#include <planning_capture.hpp>
+#include <capture_archive.hpp>
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+namespace DynamicPlanning {
+    using namespace CaptureArchive;
+
+    const char PlanningCapture::MAGIC[8] = {'L', 'S', 'C', 'C', 'A', 'P', 'T', '\0'};
+
+    namespace {
+        // Every field of Param in the order of the declaration. A new parameter is added here as well, and
+        // PlanningCapture::VERSION is incremented.
+        template<typename Archive, typename P>
+        void serializeParam(Archive &ar, P &param) {
+            ar(param.log_solver);
+            ar(param.log_vis);
+            ar(param.log_qp_failure);
+            ar(param.package_path);
+
+            ar(param.world_frame_id);
+            ar(param.world_dimension);
+            ar(param.world_use_octomap);
+            ar(param.world_resolution);
+            ar(param.world_z_2d);
+            ar(param.world_use_global_map);
+            ar(param.world_max_dist);
+            ar(param.world_occupancy_index);
+            ar(param.world_sfc_library);
+            ar(param.world_sfc_library_size);
+            ar(param.world_sfc_parallel_candidates);
+            ar(param.world_swept_clearance_check);
+            ar(param.world_distmap_cache);
+            ar(param.world_analytic);
+            ar(param.world_rolling_window_size);
+            ar(param.world_sparse_distmap);
+            ar(param.world_async_map_merge);
+
+            ar(param.multisim_patrol);
+            ar(param.multisim_qn);
+            ar(param.multisim_time_step);
+            ar(param.multisim_planning_rate);
+            ar(param.multisim_fast_forward);
+            ar(param.multisim_publish_period);
+            ar(param.multisim_history_downsample);
+            ar(param.multisim_visualization_rate);
+            ar(param.multisim_max_noise);
+            ar(param.multisim_max_planner_iteration);
+            ar(param.multisim_save_result);
+            ar(param.multisim_save_binary);
+            ar(param.multisim_save_mission);
+            ar(param.multisim_save_time_step);
+            ar(param.multisim_continuous_collision_check);
+            ar(param.multisim_offline_metrics);
+            ar(param.multisim_replay);
+            ar(param.multisim_replay_file_name);
+            ar(param.multisim_replay_time_limit);
+            ar(param.multisim_replay_speed);
+            ar(param.multisim_batch_optimization);
+            ar(param.multisim_batch_workers);
+            ar(param.multisim_batch_qp);
+            ar(param.multisim_parallel_planning);
+            ar(param.multisim_parallel_mapf);
+            ar(param.multisim_pipelined_step);
+            ar(param.multisim_thread_placement);
+            ar(param.multisim_sticky_agents);
+            ar(param.multisim_admm_iterations);
+            ar(param.multisim_admm_rho);
+            ar(param.multisim_headless);
+            ar(param.multisim_lazy_publishers);
+            ar(param.multisim_shard_index);
+            ar(param.multisim_num_shards);
+            ar(param.multisim_num_processes);
+            ar(param.multisim_process_index);
+            ar(param.multisim_exchange_mode);
+            ar(param.multisim_exchange_address);
+            ar(param.multisim_preload_missions);
+            ar(param.multisim_latency_percentiles);
+            ar(param.multisim_trace);
+            ar(param.multisim_metrics_rate);
+            ar(param.multisim_metrics_file);
+            ar(param.multisim_capture);
+            ar(param.multisim_recorder_size);
+            ar(param.multisim_recorder_threshold);
+            ar(param.multisim_checkpoint_step);
+            ar(param.multisim_restore_file);
+            ar(param.multisim_batch_tenants);
+
+            ar(param.planner_mode);
+            ar(param.prediction_mode);
+            ar(param.initial_traj_mode);
+            ar(param.slack_mode);
+            ar(param.goal_mode);
+            ar(param.mapf_mode);
+            ar(param.mapf_portfolio_modes);
+            ar(param.mapf_portfolio_anytime);
+            ar(param.qp_solver_mode);
+
+            ar(param.obs_size_prediction);
+            ar(param.obs_uncertainty_horizon);
+            ar(param.obs_agent_clustering);
+            ar(param.use_velocity_guard);
+            ar(param.velocity_guard_ratio);
+
+            ar(param.dt);
+            ar(param.M);
+            ar(param.n);
+            ar(param.phi);
+            ar(param.phi_n);
+
+            ar(param.control_input_weight);
+            ar(param.terminal_weight);
+            ar(param.slack_collision_weight);
+            ar(param.slack_dynamic_weight);
+            ar(param.opt_persistent_model);
+            ar(param.opt_sparse_assembly);
+            ar(param.opt_condensed_qp);
+            ar(param.opt_axis_decoupled_qp);
+            ar(param.opt_record_qp);
+            ar(param.opt_warm_start);
+            ar(param.opt_goal_analytic);
+            ar(param.opt_prune_constraints);
+            ar(param.opt_reduce_constraints);
+            ar(param.opt_reduce_constraints_lp);
+            ar(param.opt_solver_threads);
+            ar(param.opt_soft_collision);
+            ar(param.opt_soft_collision_weight);
+
+            ar(param.deadline_budget);
+            ar(param.deadline_mapf_budget);
+
+            ar(param.deadlock_velocity_threshold);
+            ar(param.deadlock_seq_threshold);
+            ar(param.deadlock_progress_window);
+            ar(param.deadlock_progress_rate_threshold);
+
+            ar(param.filter_sigma_y_sq);
+            ar(param.filter_sigma_v_sq);
+            ar(param.filter_sigma_a_sq);
+            ar(param.filter_ingestion_rate);
+
+            ar(param.orca_horizon);
+            ar(param.orca_inflation_ratio);
+            ar(param.ocra_pref_velocity_ratio);
+
+            ar(param.grid_resolution);
+            ar(param.grid_margin);
+            ar(param.grid_connectivity);
+            ar(param.grid_distance_table_capacity);
+            ar(param.grid_mapf_time_limit);
+            ar(param.grid_mapf_parallel);
+            ar(param.grid_mapf_window);
+            ar(param.grid_mapf_refine_time_limit);
+            ar(param.grid_mapf_cluster_size);
+            ar(param.grid_ecbs_batch_size);
+            ar(param.grid_space_time_step);
+
+            ar(param.goal_threshold);
+            ar(param.goal_radius);
+            ar(param.priority_agent_distance);
+            ar(param.priority_obs_distance);
+            ar(param.priority_goal_threshold);
+            ar(param.reset_threshold);
+            ar(param.slack_threshold);
+            ar(param.obs_downwash_threshold);
+            ar(param.collision_alert_threshold);
+            ar(param.density_alert_threshold);
+            ar(param.closest_agent_threshold);
+            ar(param.parallel_lsc_threshold);
+            ar(param.lsc_cache_tolerance);
+            ar(param.lsc_lod_near_range);
+            ar(param.lsc_lod_far_range);
+            ar(param.neighbor_pruning);
+            ar(param.max_neighbors);
+            ar(param.adaptive_horizon);
+            ar(param.adaptive_horizon_min_M);
+            ar(param.adaptive_horizon_neighbors);
+            ar(param.hover_mode);
+            ar(param.hover_tolerance);
+            ar(param.fallback_planner);
+            ar(param.fallback_budget);
+
+            ar(param.numerical_error_threshold);
+
+            ar(param.communication_range);
+            ar(param.communication_quantization_step);
+            ar(param.communication_latency);
+            ar(param.communication_latency_jitter);
+            ar(param.communication_bandwidth);
+            ar(param.communication_packet_loss);
+            ar(param.communication_timeout);
+            ar(param.communication_map_delta_compression);
+
+            ar(param.sensor_range);
+            ar(param.sensor_mode);
+            ar(param.sensor_horizontal_fov);
+            ar(param.sensor_vertical_fov);
+            ar(param.sensor_angular_resolution);
+
+            ar(param.debug_planner_seq);
+        }
+
+        // The mission is saved next to the capture with the noise applied, so the replay loads it without noise
+        void writeHeader(std::ostream &out, const std::string &file_name, const Mission &mission, const Param &param) {
+            std::string mission_file_name = file_name.substr(0, file_name.rfind('.')) + "_mission.json";
+            mission.saveMission(mission_file_name);
+
+            CaptureOut ar(out);
+            out.write(PlanningCapture::MAGIC, sizeof(PlanningCapture::MAGIC));
+            ar(PlanningCapture::VERSION);
+            ar(getPackageRelativePath(param.package_path, mission_file_name));
+            ar(getPackageRelativePath(param.package_path, mission.current_world_file_name));
+            serializeParam(ar, param);
+        }
+
+        template<typename Archive>
+        void serializePlanRecord(Archive &ar, const ros::Time &sim_time, bool is_disturbed, const Agent &agent,
+                                 const std::vector<Obstacle> &obstacles, const traj_t &traj,
+                                 const PlanningTimeStatistics &planning_time) {
+            PlanningCapture::StageTimes stage_times;
+            stage_times.initial_traj_planning = planning_time.initial_traj_planning_time.current;
+            stage_times.obstacle_prediction = planning_time.obstacle_prediction_time.current;
+            stage_times.goal_planning = planning_time.goal_planning_time.current;
+            stage_times.lsc_generation = planning_time.lsc_generation_time.current;
+            stage_times.sfc_generation = planning_time.sfc_generation_time.current;
+            stage_times.traj_optimization = planning_time.traj_optimization_time.current;
+
+            ar(PlanningCapture::RecordType::PLAN);
+            ar(sim_time);
+            ar(is_disturbed);
+            ar(agent);
+            ar(obstacles);
+            ar(traj);
+            ar(planning_time.total_planning_time.current);
+            ar(stage_times);
+        }
+
+        template<typename Archive>
+        void serializeHoldRecord(Archive &ar, const Agent &agent, const std::vector<Obstacle> &obstacles,
+                                 const traj_t &traj) {
+            ar(PlanningCapture::RecordType::HOLD);
+            ar(ros::Time());
+            ar(false);
+            ar(agent);
+            ar(obstacles);
+            ar(traj);
+            ar(0.0);
+            ar(PlanningCapture::StageTimes());
+        }
+    }
+
+    bool PlanningCaptureWriter::open(const std::string &file_name, const Mission &mission, const Param &param) {
+        std::lock_guard<std::mutex> lock(mtx);
+        out.open(file_name, std::ios::binary | std::ios::trunc);
+        if (not out.is_open()) {
+            return false;
+        }
+
+        writeHeader(out, file_name, mission, param);
+        n_records = 0;
+        return static_cast<bool>(out);
+    }
+
+    void PlanningCaptureWriter::close() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (out.is_open()) {
+            out.close();
+        }
+    }
+
+    void PlanningCaptureWriter::writeParam(const Param &param) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (not out.is_open()) {
+            return;
+        }
+        CaptureOut ar(out);
+        ar(PlanningCapture::RecordType::PARAM);
+        serializeParam(ar, param);
+        n_records++;
+    }
+
+    void PlanningCaptureWriter::writePlan(const ros::Time &sim_time, bool is_disturbed, const Agent &agent,
+                                          const std::vector<Obstacle> &obstacles, const traj_t &traj,
+                                          const PlanningTimeStatistics &planning_time) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (not out.is_open()) {
+            return;
+        }
+        CaptureOut ar(out);
+        serializePlanRecord(ar, sim_time, is_disturbed, agent, obstacles, traj, planning_time);
+        n_records++;
+    }
+
+    void PlanningCaptureWriter::writeHold(const Agent &agent, const std::vector<Obstacle> &obstacles,
+                                          const traj_t &traj) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (not out.is_open()) {
+            return;
+        }
+        CaptureOut ar(out);
+        serializeHoldRecord(ar, agent, obstacles, traj);
+        n_records++;
+    }
+
+    size_t PlanningCaptureWriter::getNumRecords() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return n_records;
+    }
+
+    void PlanningFlightRecorder::initialize(size_t capacity) {
+        records.assign(capacity, {});
+        n_records = 0;
+        n_records_since_dump = 0;
+    }
+
+    std::vector<char> &PlanningFlightRecorder::nextRecord() {
+        std::vector<char> &record = records[n_records % records.size()];
+        record.clear(); // the capacity is kept
+        n_records++;
+        n_records_since_dump++;
+        return record;
+    }
+
+    void PlanningFlightRecorder::recordPlan(const ros::Time &sim_time, bool is_disturbed, const Agent &agent,
+                                            const std::vector<Obstacle> &obstacles, const traj_t &traj,
+                                            const PlanningTimeStatistics &planning_time) {
+        ByteSink sink{nextRecord()};
+        CaptureOut ar(sink);
+        serializePlanRecord(ar, sim_time, is_disturbed, agent, obstacles, traj, planning_time);
+    }
+
+    void PlanningFlightRecorder::recordHold(const Agent &agent, const std::vector<Obstacle> &obstacles,
+                                            const traj_t &traj) {
+        ByteSink sink{nextRecord()};
+        CaptureOut ar(sink);
+        serializeHoldRecord(ar, agent, obstacles, traj);
+    }
+
+    bool PlanningFlightRecorder::dump(const std::string &file_name, const Mission &mission, const Param &param) {
+        std::ofstream out(file_name, std::ios::binary | std::ios::trunc);
+        if (not out.is_open()) {
+            return false;
+        }
+        writeHeader(out, file_name, mission, param);
+        size_t n_kept = std::min(n_records, records.size());
+        for (size_t k = n_records - n_kept; k < n_records; k++) {
+            const std::vector<char> &record = records[k % records.size()];
+            out.write(record.data(), static_cast<std::streamsize>(record.size()));
+        }
+        n_records_since_dump = 0;
+        return static_cast<bool>(out);
+    }
+
+    bool PlanningCaptureReader::open(const std::string &file_name) {
+        in.open(file_name, std::ios::binary);
+        if (not in.is_open()) {
+            return false;
+        }
+
+        char magic[sizeof(PlanningCapture::MAGIC)];
+        uint32_t version = 0;
+        CaptureIn ar(in);
+        in.read(magic, sizeof(magic));
+        ar(version);
+        if (not in or std::memcmp(magic, PlanningCapture::MAGIC, sizeof(magic)) != 0 or
+            version != PlanningCapture::VERSION) {
+            return false;
+        }
+        ar(mission_file_name);
+        ar(world_file_name);
+        serializeParam(ar, param);
+        return static_cast<bool>(in);
+    }
+
+    bool PlanningCaptureReader::readRecord(PlanningCapture::Record &record) {
+        CaptureIn ar(in);
+        ar(record.type);
+        if (not in) {
+            return false;
+        }
+        if (record.type == PlanningCapture::RecordType::PARAM) {
+            serializeParam(ar, record.param);
+            return static_cast<bool>(in);
+        }
+        if (record.type != PlanningCapture::RecordType::PLAN and record.type != PlanningCapture::RecordType::HOLD) {
+            return false;
+        }
+        ar(record.sim_time);
+        ar(record.is_disturbed);
+        ar(record.agent);
+        ar(record.obstacles);
+        ar(record.traj);
+        ar(record.planning_time);
+        ar(record.stage_times);
+        return static_cast<bool>(in);
+    }
+}
@@ -0,0 +1,212 @@
+#include <traj_planner.hpp>
+#include <map_manager.hpp>
+#include <planning_capture.hpp>
+#include <latency_histogram.hpp>
+#include <solver_thread_scheduler.hpp>
+#include <boost/program_options.hpp>
+#include <algorithm>
+#include <iostream>
+
+using namespace DynamicPlanning;
+namespace po = boost::program_options;
+
+// Replay of the planning problems captured by multisim/capture, without the simulator and the ROS master.
+// The records of an agent run in their order through a TrajPlanner of its own, so the planner goes through the same
+// states as in the capture. The agents are independent of each other and run in parallel with --threads.
+// The planning times are reported with the captured ones, and the outputs are compared with the captured outputs,
+// so the same corpus serves for the profiling, the benchmarks and the regression tests of the planner.
+// The map is the global map of the captured world, the local maps of the agents are not captured.
+// rosrun lsc_dr_planner planning_replay ~/catkin_ws/src/lsc_dr_planner/log/capture_<name>.bin --threads 4
+struct AgentReplay {
+    std::vector<std::shared_ptr<const PlanningCapture::Record>> records; // the PARAM records are shared by the agents
+    LatencyHistogram planning_times;
+    double max_deviation = 0; // [m], the largest distance from the control points of the captured output
+    size_t n_deviated = 0;
+};
+
+// The largest distance between the control points, infinity if the structures differ
+static double getTrajDeviation(const traj_t &traj, const traj_t &captured_traj) {
+    if (traj.size() != captured_traj.size()) {
+        return SP_INFINITY;
+    }
+    double deviation = 0;
+    for (int m = 0; m < traj.size(); m++) {
+        if (traj[m].control_points.size() != captured_traj[m].control_points.size()) {
+            return SP_INFINITY;
+        }
+        for (size_t i = 0; i < traj[m].control_points.size(); i++) {
+            deviation = std::max(deviation,
+                                 static_cast<double>((traj[m][i] - captured_traj[m][i]).norm()));
+        }
+    }
+    return deviation;
+}
+
+// The planners run without publishers and without writing the logs of the capture again
+static void setReplayParam(const std::string &package_path, Param &param) {
+    param.package_path = package_path;
+    param.multisim_headless = true;
+    param.opt_record_qp = false;
+    param.log_qp_failure = false;
+    if (param.world_use_octomap) {
+        param.world_use_global_map = true;
+    }
+    // The agents do not run in the order of the captured steps, so the SFC boxes are not shared between them
+    param.world_sfc_library = false;
+}
+
+static void replayAgent(const ros::NodeHandle &nh, const Param &param, const std::shared_ptr<const Mission> &mission,
+                        size_t qi, const MapManager &map_manager, double tolerance, AgentReplay &replay) {
+    // The initial state of AgentManager
+    Agent agent = mission->agents[qi];
+    agent.current_state.position = mission->agents[qi].start_point;
+    agent.current_goal_point = agent.current_state.position;
+    agent.next_waypoint = agent.current_state.position;
+
+    TrajPlanner traj_planner(nh, param, mission, agent);
+    for (const auto &record: replay.records) {
+        if (record->type == PlanningCapture::RecordType::PARAM) {
+            try {
+                traj_planner.updateParam(record->param);
+            } catch (const std::invalid_argument &e) {
+                ROS_WARN_STREAM("[PlanningReplay] agent " << qi << " rejects the parameters: " << e.what());
+            }
+            continue;
+        }
+
+        traj_planner.setObstacles(record->obstacles);
+        traj_t traj;
+        if (record->type == PlanningCapture::RecordType::PLAN) {
+            traj = traj_planner.plan(record->agent, map_manager.getOctomap(), map_manager.getDistmap(),
+                                     map_manager.getOccupancyIndex(), map_manager.getMapChangeLog(),
+                                     record->sim_time, record->is_disturbed);
+            replay.planning_times.record(
+                    traj_planner.getPlanningStatistics().planning_time.total_planning_time.current);
+        } else {
+            traj = traj_planner.planHold(record->agent);
+        }
+
+        double deviation = getTrajDeviation(traj, record->traj);
+        replay.max_deviation = std::max(replay.max_deviation, deviation);
+        if (deviation > tolerance) {
+            replay.n_deviated++;
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    // The parameters are in the capture, so the master is not needed
+    ros::init(argc, argv, "planning_replay", ros::init_options::AnonymousName | ros::init_options::NoRosout);
+
+    po::options_description desc("Options");
+    desc.add_options()
+            ("help,h", "print this message")
+            ("capture,c", po::value<std::string>(), "capture file saved by multisim/capture")
+            ("threads,j", po::value<int>()->default_value(1), "number of agents replayed in parallel, 0: cores")
+            ("repeat,r", po::value<int>()->default_value(1), "number of replays of the corpus")
+            ("tolerance,t", po::value<double>()->default_value(1e-3),
+             "[m], count the outputs farther than this from the captured ones");
+    po::positional_options_description positional;
+    positional.add("capture", 1);
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
+        po::notify(vm);
+    } catch (const po::error &e) {
+        std::cout << e.what() << std::endl;
+        return -1;
+    }
+    if (vm.count("help") or not vm.count("capture")) {
+        std::cout << "Usage: planning_replay <capture file> [options]\n" << desc << std::endl;
+        return vm.count("help") ? 0 : -1;
+    }
+    int n_repeats = std::max(vm["repeat"].as<int>(), 1);
+    double tolerance = vm["tolerance"].as<double>();
+
+    PlanningCaptureReader reader;
+    if (not reader.open(vm["capture"].as<std::string>())) {
+        std::cout << "Invalid capture file: " << vm["capture"].as<std::string>() << std::endl;
+        return -1;
+    }
+
+    Param param = reader.getParam();
+    if (param.world_use_octomap and not param.world_use_global_map) {
+        std::cout << "The local maps are not captured, the agents use the global map" << std::endl;
+    }
+    std::string package_path = ros::package::getPath("lsc_dr_planner");
+    setReplayParam(package_path, param);
+    SolverThreadScheduler::getInstance().setTotalThreads(param.opt_solver_threads);
+
+    // The file names are relative to the package, and the mission is loaded without noise as it is saved with it
+    Mission mission("../" + reader.getMissionFileName(), "../" + reader.getWorldFileName());
+    if (not mission.loadMission(0, param.world_dimension, param.world_z_2d, 0) or mission.qn == 0) {
+        std::cout << "Invalid mission: " << reader.getMissionFileName() << std::endl;
+        return -1;
+    }
+
+    std::vector<AgentReplay> replays(mission.qn);
+    size_t n_records = 0;
+    LatencyHistogram captured_planning_times;
+    while (true) {
+        auto record = std::make_shared<PlanningCapture::Record>();
+        if (not reader.readRecord(*record)) {
+            break;
+        }
+        if (record->type == PlanningCapture::RecordType::PARAM) {
+            setReplayParam(package_path, record->param);
+            for (auto &replay: replays) {
+                replay.records.emplace_back(record);
+            }
+        } else if (record->agent.id >= 0 and static_cast<size_t>(record->agent.id) < mission.qn) {
+            if (record->type == PlanningCapture::RecordType::PLAN) {
+                captured_planning_times.record(record->planning_time);
+            }
+            replays[record->agent.id].records.emplace_back(record);
+            n_records++;
+        }
+    }
+    std::cout << "Capture: " << n_records << " records of " << mission.qn << " agents, "
+              << mission.current_world_file_name << ", captured planning time [ms] p50: "
+              << captured_planning_times.getPercentile(50) * 1e3
+              << ", p99: " << captured_planning_times.getPercentile(99) * 1e3 << std::endl;
+
+    // The map managers hold the global map, so it is loaded once for all replays
+    ros::NodeHandle nh("~");
+    auto shared_mission = std::make_shared<const Mission>(mission);
+    std::vector<std::unique_ptr<MapManager>> map_managers(mission.qn);
+    for (size_t qi = 0; qi < mission.qn; qi++) {
+        map_managers[qi] = std::make_unique<MapManager>(nh, param, shared_mission, static_cast<int>(qi));
+    }
+
+    WorkerPool worker_pool(vm["threads"].as<int>());
+    for (int ri = 0; ri < n_repeats; ri++) {
+        for (auto &replay: replays) {
+            replay.planning_times.clear();
+            replay.max_deviation = 0;
+            replay.n_deviated = 0;
+        }
+
+        Timer timer;
+        worker_pool.run(mission.qn, [&](size_t qi) {
+            replayAgent(nh, param, shared_mission, qi, *map_managers[qi], tolerance, replays[qi]);
+        });
+        timer.stop();
+
+        LatencyHistogram planning_times;
+        double max_deviation = 0;
+        size_t n_deviated = 0;
+        for (const auto &replay: replays) {
+            planning_times.merge(replay.planning_times);
+            max_deviation = std::max(max_deviation, replay.max_deviation);
+            n_deviated += replay.n_deviated;
+        }
+        std::cout << "Replay " << ri << ": " << timer.elapsedSeconds() << " s with " << worker_pool.getNumWorkers()
+                  << " threads, planning time [ms] p50: " << planning_times.getPercentile(50) * 1e3
+                  << ", p99: " << planning_times.getPercentile(99) * 1e3
+                  << ", max: " << planning_times.getMax() * 1e3
+                  << ", deviated outputs: " << n_deviated << "/" << n_records
+                  << ", max deviation [m]: " << max_deviation << std::endl;
+    }
+
+    return 0;
+}
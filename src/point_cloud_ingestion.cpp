@@ -0,0 +1,220 @@
+#include <point_cloud_ingestion.hpp>
+#include <worker_pool.hpp>
+#include <timer.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace DynamicPlanning {
+    static constexpr size_t POINT_CHUNK_SIZE = 65536; // points per task of the worker pool
+    static constexpr size_t PARTITIONS_PER_WORKER = 4; // key ranges per worker, to balance the dense ranges
+    static constexpr uint64_t INVALID_PACKED_KEY = std::numeric_limits<uint64_t>::max();
+
+    // x is the most significant, so the packed keys are sorted by x first
+    static uint64_t packKey(const octomap::OcTreeKey &key) {
+        return (static_cast<uint64_t>(key[0]) << 32) | (static_cast<uint64_t>(key[1]) << 16) | key[2];
+    }
+
+    static octomap::OcTreeKey unpackKey(uint64_t packed_key) {
+        return {static_cast<octomap::key_type>(packed_key >> 32),
+                static_cast<octomap::key_type>((packed_key >> 16) & 0xFFFF),
+                static_cast<octomap::key_type>(packed_key & 0xFFFF)};
+    }
+
+    static double readField(const uint8_t *ptr, uint8_t datatype) {
+        if (datatype == sensor_msgs::PointField::FLOAT32) {
+            float value;
+            std::memcpy(&value, ptr, sizeof(float));
+            return value;
+        } else {
+            double value;
+            std::memcpy(&value, ptr, sizeof(double));
+            return value;
+        }
+    }
+
+    bool parsePointCloud2(const sensor_msgs::PointCloud2 &msg, std::vector<octomap::point3d> &points) {
+        points.clear();
+
+        const uint16_t endian_check = 1;
+        bool is_host_bigendian = *reinterpret_cast<const uint8_t *>(&endian_check) == 0;
+        if (static_cast<bool>(msg.is_bigendian) != is_host_bigendian) {
+            return false;
+        }
+
+        const char *field_names[3] = {"x", "y", "z"};
+        uint32_t offsets[3];
+        uint8_t datatypes[3];
+        for (int k = 0; k < 3; k++) {
+            auto field = std::find_if(msg.fields.begin(), msg.fields.end(),
+                                      [&](const sensor_msgs::PointField &f) { return f.name == field_names[k]; });
+            if (field == msg.fields.end() or (field->datatype != sensor_msgs::PointField::FLOAT32 and
+                                              field->datatype != sensor_msgs::PointField::FLOAT64)) {
+                return false;
+            }
+
+            size_t field_size = field->datatype == sensor_msgs::PointField::FLOAT32 ? sizeof(float) : sizeof(double);
+            if (field->offset + field_size > msg.point_step) {
+                return false;
+            }
+            offsets[k] = field->offset;
+            datatypes[k] = field->datatype;
+        }
+
+        size_t n_points = static_cast<size_t>(msg.width) * msg.height;
+        if (static_cast<size_t>(msg.width) * msg.point_step > msg.row_step or
+            static_cast<size_t>(msg.row_step) * msg.height > msg.data.size()) {
+            return false;
+        }
+        if (n_points == 0) {
+            return true;
+        }
+
+        // Each chunk writes its valid points at the beginning of its own range, then the ranges are compacted
+        points.resize(n_points);
+        size_t n_chunks = (n_points + POINT_CHUNK_SIZE - 1) / POINT_CHUNK_SIZE;
+        std::vector<size_t> chunk_counts(n_chunks, 0);
+        WorkerPool::getInstance().run(n_chunks, [&](size_t chunk_idx) {
+            size_t begin = chunk_idx * POINT_CHUNK_SIZE;
+            size_t end = std::min(begin + POINT_CHUNK_SIZE, n_points);
+            size_t count = 0;
+            for (size_t i = begin; i < end; i++) {
+                const uint8_t *ptr = msg.data.data() + (i / msg.width) * msg.row_step +
+                                     (i % msg.width) * msg.point_step;
+                double x = readField(ptr + offsets[0], datatypes[0]);
+                double y = readField(ptr + offsets[1], datatypes[1]);
+                double z = readField(ptr + offsets[2], datatypes[2]);
+                if (std::isfinite(x) and std::isfinite(y) and std::isfinite(z)) {
+                    points[begin + count++] = octomap::point3d(static_cast<float>(x), static_cast<float>(y),
+                                                               static_cast<float>(z));
+                }
+            }
+            chunk_counts[chunk_idx] = count;
+        });
+
+        size_t n_valid_points = chunk_counts[0];
+        for (size_t chunk_idx = 1; chunk_idx < n_chunks; chunk_idx++) {
+            auto begin = points.begin() + static_cast<std::ptrdiff_t>(chunk_idx * POINT_CHUNK_SIZE);
+            std::copy(begin, begin + static_cast<std::ptrdiff_t>(chunk_counts[chunk_idx]),
+                      points.begin() + static_cast<std::ptrdiff_t>(n_valid_points));
+            n_valid_points += chunk_counts[chunk_idx];
+        }
+        points.resize(n_valid_points);
+        return true;
+    }
+
+    void computeVoxelKeys(const octomap::OcTree &octree, const std::vector<octomap::point3d> &points,
+                          std::vector<octomap::OcTreeKey> &keys) {
+        keys.clear();
+        size_t n_points = points.size();
+        if (n_points == 0) {
+            return;
+        }
+
+        // Hash the points to the packed keys, and find the range of the x keys
+        WorkerPool &worker_pool = WorkerPool::getInstance();
+        size_t n_chunks = (n_points + POINT_CHUNK_SIZE - 1) / POINT_CHUNK_SIZE;
+        std::vector<uint64_t> packed_keys(n_points);
+        std::vector<int> chunk_min_x(n_chunks, std::numeric_limits<int>::max());
+        std::vector<int> chunk_max_x(n_chunks, std::numeric_limits<int>::min());
+        worker_pool.run(n_chunks, [&](size_t chunk_idx) {
+            size_t end = std::min((chunk_idx + 1) * POINT_CHUNK_SIZE, n_points);
+            for (size_t i = chunk_idx * POINT_CHUNK_SIZE; i < end; i++) {
+                octomap::OcTreeKey key;
+                if (not octree.coordToKeyChecked(points[i], key)) {
+                    packed_keys[i] = INVALID_PACKED_KEY;
+                    continue;
+                }
+                packed_keys[i] = packKey(key);
+                chunk_min_x[chunk_idx] = std::min(chunk_min_x[chunk_idx], static_cast<int>(key[0]));
+                chunk_max_x[chunk_idx] = std::max(chunk_max_x[chunk_idx], static_cast<int>(key[0]));
+            }
+        });
+        int min_x = *std::min_element(chunk_min_x.begin(), chunk_min_x.end());
+        int max_x = *std::max_element(chunk_max_x.begin(), chunk_max_x.end());
+        if (min_x > max_x) {
+            return;
+        }
+
+        // Split the x keys into ranges, then each range is sorted and deduplicated independently
+        size_t n_x_keys = static_cast<size_t>(max_x - min_x) + 1;
+        size_t n_partitions = std::min(PARTITIONS_PER_WORKER * static_cast<size_t>(worker_pool.getNumWorkers()),
+                                       n_x_keys);
+        std::vector<std::vector<std::vector<uint64_t>>> buckets(n_chunks,
+                                                                std::vector<std::vector<uint64_t>>(n_partitions));
+        worker_pool.run(n_chunks, [&](size_t chunk_idx) {
+            size_t end = std::min((chunk_idx + 1) * POINT_CHUNK_SIZE, n_points);
+            for (size_t i = chunk_idx * POINT_CHUNK_SIZE; i < end; i++) {
+                if (packed_keys[i] == INVALID_PACKED_KEY) {
+                    continue;
+                }
+                size_t x = static_cast<size_t>(packed_keys[i] >> 32) - min_x;
+                buckets[chunk_idx][x * n_partitions / n_x_keys].emplace_back(packed_keys[i]);
+            }
+        });
+
+        std::vector<std::vector<uint64_t>> partition_keys(n_partitions);
+        worker_pool.run(n_partitions, [&](size_t partition_idx) {
+            std::vector<uint64_t> &partition = partition_keys[partition_idx];
+            size_t n_partition_keys = 0;
+            for (const auto &chunk_buckets: buckets) {
+                n_partition_keys += chunk_buckets[partition_idx].size();
+            }
+            partition.reserve(n_partition_keys);
+            for (auto &chunk_buckets: buckets) {
+                partition.insert(partition.end(), chunk_buckets[partition_idx].begin(),
+                                 chunk_buckets[partition_idx].end());
+                std::vector<uint64_t>().swap(chunk_buckets[partition_idx]);
+            }
+            std::sort(partition.begin(), partition.end());
+            partition.erase(std::unique(partition.begin(), partition.end()), partition.end());
+        });
+
+        // The ranges are ordered by x, so the concatenation is sorted
+        std::vector<size_t> partition_offsets(n_partitions + 1, 0);
+        for (size_t partition_idx = 0; partition_idx < n_partitions; partition_idx++) {
+            partition_offsets[partition_idx + 1] = partition_offsets[partition_idx] +
+                                                   partition_keys[partition_idx].size();
+        }
+        keys.resize(partition_offsets[n_partitions]);
+        worker_pool.run(n_partitions, [&](size_t partition_idx) {
+            const std::vector<uint64_t> &partition = partition_keys[partition_idx];
+            for (size_t i = 0; i < partition.size(); i++) {
+                keys[partition_offsets[partition_idx] + i] = unpackKey(partition[i]);
+            }
+        });
+    }
+
+    void insertOccupiedVoxels(octomap::OcTree &octree, const std::vector<octomap::OcTreeKey> &keys) {
+        // The inner nodes are updated once after all leaves
+        for (const auto &key: keys) {
+            octree.updateNode(key, true, true);
+        }
+        octree.updateInnerOccupancy();
+    }
+
+    bool ingestPointCloud2(const sensor_msgs::PointCloud2 &msg, const octomap::OcTree &octree,
+                           std::vector<octomap::OcTreeKey> &keys, PointCloudIngestionReport &report) {
+        report = PointCloudIngestionReport();
+        report.n_input_points = static_cast<size_t>(msg.width) * msg.height;
+
+        Timer timer;
+        std::vector<octomap::point3d> points;
+        if (not parsePointCloud2(msg, points)) {
+            keys.clear();
+            return false;
+        }
+        timer.stop();
+        report.parse_time = timer.elapsedSeconds();
+
+        timer.reset();
+        computeVoxelKeys(octree, points, keys);
+        timer.stop();
+        report.hash_time = timer.elapsedSeconds();
+
+        report.n_valid_points = points.size();
+        report.n_voxels = keys.size();
+        return true;
+    }
+}
@@ -0,0 +1,479 @@
+#include <primitive_world.hpp>
+#include <csv_reader.hpp>
+#include <dynamicEDT3D/dynamicEDTOctomap.h>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+
+namespace DynamicPlanning {
+    namespace {
+        constexpr double RAY_EPSILON = 1e-9;
+
+        // [m], the gap between [a_min, a_max] and [b_min, b_max], 0 if they overlap
+        double intervalGap(double a_min, double a_max, double b_min, double b_max) {
+            return std::max(std::max(b_min - a_max, a_min - b_max), 0.0);
+        }
+
+        double boxSquaredDistance(const octomap::point3d &point, const octomap::point3d &box_min,
+                                  const octomap::point3d &box_max) {
+            double dist_sq = 0;
+            for (int k = 0; k < 3; k++) {
+                double gap = intervalGap(point(k), point(k), box_min(k), box_max(k));
+                dist_sq += gap * gap;
+            }
+            return dist_sq;
+        }
+
+        double boxLInfDistance(const octomap::point3d &a_min, const octomap::point3d &a_max,
+                               const octomap::point3d &b_min, const octomap::point3d &b_max) {
+            double dist = 0;
+            for (int k = 0; k < 3; k++) {
+                dist = std::max(dist, intervalGap(a_min(k), a_max(k), b_min(k), b_max(k)));
+            }
+            return dist;
+        }
+
+        // The sweep of the face of [a_min, a_max] on the axis until the box is within margin of [b_min, b_max],
+        // infinity if the sweep never gets closer than margin
+        double boxSweepDistance(const octomap::point3d &a_min, const octomap::point3d &a_max,
+                                const octomap::point3d &b_min, const octomap::point3d &b_max,
+                                int axis, bool positive, double margin) {
+            for (int k = 0; k < 3; k++) {
+                if (k != axis and intervalGap(a_min(k), a_max(k), b_min(k), b_max(k)) >= margin) {
+                    return std::numeric_limits<double>::infinity();
+                }
+            }
+            double gap = positive ? b_min(axis) - a_max(axis) : a_min(axis) - b_max(axis);
+            double gap_behind = positive ? a_min(axis) - b_max(axis) : b_min(axis) - a_max(axis);
+            if (gap_behind >= margin) {
+                return std::numeric_limits<double>::infinity();
+            }
+            return std::max(gap - margin, 0.0);
+        }
+
+        // The smallest t such that the square of half size t around the offset (dx, dy) >= 0 from the center of
+        // the disk touches the disk
+        double diskLInfDistance(double dx, double dy, double radius) {
+            double a = std::max(dx, dy), b = std::min(dx, dy);
+            if (a * a + b * b <= radius * radius) {
+                return 0;
+            }
+            if (a - b >= radius) {
+                return a - radius; // the square touches the disk by its edge
+            }
+            // The square touches the disk by its corner, (a - t)^2 + (b - t)^2 = radius^2
+            return std::max(0.5 * (a + b - std::sqrt(2 * radius * radius - (a - b) * (a - b))), 0.0);
+        }
+
+        // Entry and exit of the ray through the slab [lower, upper] along an axis, false if it misses
+        bool clipSlab(double origin, double direction, double lower, double upper, double &t_enter, double &t_exit) {
+            if (std::abs(direction) < RAY_EPSILON) {
+                return origin >= lower and origin <= upper;
+            }
+            double t1 = (lower - origin) / direction, t2 = (upper - origin) / direction;
+            if (t1 > t2) {
+                std::swap(t1, t2);
+            }
+            t_enter = std::max(t_enter, t1);
+            t_exit = std::min(t_exit, t2);
+            return t_enter <= t_exit;
+        }
+
+        bool clipBox(const octomap::point3d &origin, const octomap::point3d &direction,
+                     const octomap::point3d &box_min, const octomap::point3d &box_max,
+                     double &t_enter, double &t_exit) {
+            for (int k = 0; k < 3; k++) {
+                if (not clipSlab(origin(k), direction(k), box_min(k), box_max(k), t_enter, t_exit)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    double WorldPrimitive::distance(const octomap::point3d &point, octomap::point3d &closest) const {
+        octomap::point3d p_min = getMin(), p_max = getMax();
+        closest = point;
+        closest.z() = std::min(std::max(point.z(), p_min.z()), p_max.z());
+        if (shape == PrimitiveShape::BOX) {
+            closest.x() = std::min(std::max(point.x(), p_min.x()), p_max.x());
+            closest.y() = std::min(std::max(point.y(), p_min.y()), p_max.y());
+        } else {
+            double radius = 0.5 * size.x();
+            double dx = point.x() - center.x(), dy = point.y() - center.y();
+            double rho = std::sqrt(dx * dx + dy * dy);
+            if (rho > radius) {
+                closest.x() = center.x() + dx * radius / rho;
+                closest.y() = center.y() + dy * radius / rho;
+            }
+        }
+        return (point - closest).norm();
+    }
+
+    double WorldPrimitive::distance(const octomap::point3d &point) const {
+        octomap::point3d closest;
+        return distance(point, closest);
+    }
+
+    double WorldPrimitive::lInfDistance(const octomap::point3d &box_min, const octomap::point3d &box_max) const {
+        octomap::point3d p_min = getMin(), p_max = getMax();
+        if (shape == PrimitiveShape::BOX) {
+            return boxLInfDistance(box_min, box_max, p_min, p_max);
+        }
+
+        double dz = intervalGap(box_min.z(), box_max.z(), p_min.z(), p_max.z());
+        double dx = intervalGap(box_min.x(), box_max.x(), center.x(), center.x());
+        double dy = intervalGap(box_min.y(), box_max.y(), center.y(), center.y());
+        return std::max(diskLInfDistance(dx, dy, 0.5 * size.x()), dz);
+    }
+
+    bool WorldPrimitive::raycast(const octomap::point3d &origin, const octomap::point3d &direction,
+                                 double max_range, double &range) const {
+        octomap::point3d p_min = getMin(), p_max = getMax();
+        double t_enter = 0, t_exit = max_range;
+        if (shape == PrimitiveShape::BOX) {
+            if (not clipBox(origin, direction, p_min, p_max, t_enter, t_exit)) {
+                return false;
+            }
+        } else {
+            if (not clipSlab(origin.z(), direction.z(), p_min.z(), p_max.z(), t_enter, t_exit)) {
+                return false;
+            }
+
+            // |origin + t * direction - center|^2 = radius^2 on the xy plane
+            double radius = 0.5 * size.x();
+            double ox = origin.x() - center.x(), oy = origin.y() - center.y();
+            double a = direction.x() * direction.x() + direction.y() * direction.y();
+            double b = ox * direction.x() + oy * direction.y();
+            double c = ox * ox + oy * oy - radius * radius;
+            if (a < RAY_EPSILON) {
+                if (c > 0) {
+                    return false; // vertical ray outside the disk
+                }
+            } else {
+                double discriminant = b * b - a * c;
+                if (discriminant < 0) {
+                    return false;
+                }
+                double sqrt_discriminant = std::sqrt(discriminant);
+                t_enter = std::max(t_enter, (-b - sqrt_discriminant) / a);
+                t_exit = std::min(t_exit, (-b + sqrt_discriminant) / a);
+                if (t_enter > t_exit) {
+                    return false;
+                }
+            }
+        }
+
+        range = t_enter;
+        return true;
+    }
+
+    bool readWorldPrimitives(const std::string &file_name, std::vector<WorldPrimitive> &primitives) {
+        std::ifstream file(file_name);
+        if (not file.is_open()) {
+            return false;
+        }
+
+        for (auto &row: CSVRange(file)) {
+            if (row.size() < 2) {
+                break;
+            }
+            if (row.size() < 6) {
+                return false;
+            }
+
+            WorldPrimitive primitive;
+            try {
+                for (int k = 0; k < 3; k++) {
+                    primitive.center(k) = std::stod(std::string(row[k]));
+                    primitive.size(k) = std::stod(std::string(row[3 + k]));
+                }
+            }
+            catch (const std::exception &) {
+                return false;
+            }
+            if (row.size() > 6) {
+                std::string shape(row[6]);
+                shape.erase(std::remove_if(shape.begin(), shape.end(), ::isspace), shape.end());
+                if (shape == "cylinder") {
+                    primitive.shape = PrimitiveShape::CYLINDER;
+                } else if (not shape.empty() and shape != "box") {
+                    return false;
+                }
+            }
+            primitives.emplace_back(primitive);
+        }
+        return true;
+    }
+
+    bool saveWorldPrimitives(const std::string &file_name, const std::vector<WorldPrimitive> &primitives) {
+        std::ofstream file(file_name);
+        if (not file.is_open()) {
+            return false;
+        }
+        file << std::setprecision(17);
+        for (const auto &primitive: primitives) {
+            file << primitive.center.x() << "," << primitive.center.y() << "," << primitive.center.z() << ","
+                 << primitive.size.x() << "," << primitive.size.y() << "," << primitive.size.z();
+            // The boxes keep the 6 columns of world/forest, so the older readers load them
+            if (primitive.shape == PrimitiveShape::CYLINDER) {
+                file << ",cylinder";
+            }
+            file << "\n";
+        }
+        return file.good();
+    }
+
+    PrimitiveWorld::PrimitiveWorld(const std::vector<WorldPrimitive> &_primitives,
+                                   const octomap::point3d &_world_min, const octomap::point3d &_world_max,
+                                   double _max_dist)
+            : world_min(_world_min), world_max(_world_max), max_dist(_max_dist) {
+        for (const auto &primitive: _primitives) {
+            if (boxLInfDistance(primitive.getMin(), primitive.getMax(), world_min, world_max) <= 0) {
+                primitives.emplace_back(primitive);
+            }
+        }
+        if (not primitives.empty()) {
+            nodes.reserve(2 * primitives.size() / LEAF_SIZE + 1);
+            build(0, static_cast<int>(primitives.size()), 0);
+        }
+    }
+
+    int PrimitiveWorld::build(int start, int end, int depth) {
+        int id = static_cast<int>(nodes.size());
+        nodes.emplace_back();
+        octomap::point3d box_min = primitives[start].getMin(), box_max = primitives[start].getMax();
+        octomap::point3d center_min = primitives[start].center, center_max = primitives[start].center;
+        for (int i = start + 1; i < end; i++) {
+            for (int k = 0; k < 3; k++) {
+                box_min(k) = std::min(box_min(k), primitives[i].getMin()(k));
+                box_max(k) = std::max(box_max(k), primitives[i].getMax()(k));
+                center_min(k) = std::min(center_min(k), primitives[i].center(k));
+                center_max(k) = std::max(center_max(k), primitives[i].center(k));
+            }
+        }
+        nodes[id].box_min = box_min;
+        nodes[id].box_max = box_max;
+
+        // The traversal pushes the right child before the left one, so a path of depth d uses d + 1 slots
+        if (end - start <= LEAF_SIZE or depth >= MAX_DEPTH - 2) {
+            nodes[id].start = start;
+            nodes[id].count = end - start;
+            return id;
+        }
+
+        int axis = 0;
+        for (int k = 1; k < 3; k++) {
+            if (center_max(k) - center_min(k) > center_max(axis) - center_min(axis)) {
+                axis = k;
+            }
+        }
+        int mid = (start + end) / 2;
+        std::nth_element(primitives.begin() + start, primitives.begin() + mid, primitives.begin() + end,
+                         [axis](const WorldPrimitive &a, const WorldPrimitive &b) {
+                             return a.center(axis) < b.center(axis);
+                         });
+        build(start, mid, depth + 1);
+        int right = build(mid, end, depth + 1);
+        nodes[id].right = right;
+        return id;
+    }
+
+    double PrimitiveWorld::findClosest(const octomap::point3d &point, octomap::point3d &closest) const {
+        double best_sq = max_dist * max_dist;
+        bool found = false;
+        int stack[MAX_DEPTH];
+        int stack_size = 0;
+        if (not nodes.empty()) {
+            stack[stack_size++] = 0;
+        }
+        while (stack_size > 0) {
+            const Node &node = nodes[stack[--stack_size]];
+            if (boxSquaredDistance(point, node.box_min, node.box_max) >= best_sq) {
+                continue;
+            }
+            if (node.count > 0) {
+                for (int i = node.start; i < node.start + node.count; i++) {
+                    octomap::point3d candidate;
+                    double dist = primitives[i].distance(point, candidate);
+                    if (dist * dist < best_sq) {
+                        best_sq = dist * dist;
+                        closest = candidate;
+                        found = true;
+                    }
+                }
+                continue;
+            }
+
+            // The nearer child is popped first
+            int left = static_cast<int>(&node - nodes.data()) + 1;
+            double left_sq = boxSquaredDistance(point, nodes[left].box_min, nodes[left].box_max);
+            double right_sq = boxSquaredDistance(point, nodes[node.right].box_min, nodes[node.right].box_max);
+            if (left_sq < right_sq) {
+                stack[stack_size++] = node.right;
+                stack[stack_size++] = left;
+            } else {
+                stack[stack_size++] = left;
+                stack[stack_size++] = node.right;
+            }
+        }
+        return found ? std::sqrt(best_sq) : max_dist;
+    }
+
+    void PrimitiveWorld::query(DistmapQueryBatch &batch) const {
+        size_t n = batch.size();
+        batch.distance.resize(n);
+        batch.obstacle_x.resize(n);
+        batch.obstacle_y.resize(n);
+        batch.obstacle_z.resize(n);
+        batch.obstacle_l_inf_distance.resize(n);
+
+        const float infinity = std::numeric_limits<float>::infinity();
+        for (size_t i = 0; i < n; i++) {
+            octomap::point3d point(batch.x[i], batch.y[i], batch.z[i]);
+            bool is_in_world = true;
+            for (int k = 0; k < 3; k++) {
+                is_in_world = is_in_world and point(k) >= world_min(k) and point(k) <= world_max(k);
+            }
+            if (not is_in_world) {
+                batch.distance[i] = DynamicEDTOctomap::distanceValue_Error;
+                batch.obstacle_x[i] = batch.obstacle_y[i] = batch.obstacle_z[i] = infinity;
+                batch.obstacle_l_inf_distance[i] = infinity;
+                continue;
+            }
+
+            octomap::point3d closest;
+            double dist = findClosest(point, closest);
+            batch.distance[i] = static_cast<float>(dist);
+            if (dist < max_dist) {
+                batch.obstacle_x[i] = closest.x();
+                batch.obstacle_y[i] = closest.y();
+                batch.obstacle_z[i] = closest.z();
+            } else {
+                batch.obstacle_x[i] = batch.obstacle_y[i] = batch.obstacle_z[i] = infinity;
+            }
+
+            // The L-infinity distance may be within max_dist even if the Euclidean one is not
+            double l_inf = computeLInfDistance(point, point);
+            batch.obstacle_l_inf_distance[i] = l_inf < max_dist ? static_cast<float>(l_inf) : infinity;
+        }
+    }
+
+    double PrimitiveWorld::computeLInfDistance(const octomap::point3d &box_min,
+                                               const octomap::point3d &box_max) const {
+        double best = max_dist;
+        int stack[MAX_DEPTH];
+        int stack_size = 0;
+        if (not nodes.empty()) {
+            stack[stack_size++] = 0;
+        }
+        while (stack_size > 0 and best > 0) {
+            const Node &node = nodes[stack[--stack_size]];
+            if (boxLInfDistance(box_min, box_max, node.box_min, node.box_max) >= best) {
+                continue;
+            }
+            if (node.count > 0) {
+                for (int i = node.start; i < node.start + node.count; i++) {
+                    best = std::min(best, primitives[i].lInfDistance(box_min, box_max));
+                }
+                continue;
+            }
+            stack[stack_size++] = node.right;
+            stack[stack_size++] = static_cast<int>(&node - nodes.data()) + 1;
+        }
+        return best;
+    }
+
+    bool PrimitiveWorld::isOccupied(const octomap::point3d &box_min, const octomap::point3d &box_max,
+                                    double margin) const {
+        int stack[MAX_DEPTH];
+        int stack_size = 0;
+        if (not nodes.empty()) {
+            stack[stack_size++] = 0;
+        }
+        while (stack_size > 0) {
+            const Node &node = nodes[stack[--stack_size]];
+            if (boxLInfDistance(box_min, box_max, node.box_min, node.box_max) >= margin) {
+                continue;
+            }
+            if (node.count > 0) {
+                for (int i = node.start; i < node.start + node.count; i++) {
+                    if (primitives[i].lInfDistance(box_min, box_max) < margin) {
+                        return true;
+                    }
+                }
+                continue;
+            }
+            stack[stack_size++] = node.right;
+            stack[stack_size++] = static_cast<int>(&node - nodes.data()) + 1;
+        }
+        return false;
+    }
+
+    double PrimitiveWorld::computeSweepDistance(const octomap::point3d &box_min, const octomap::point3d &box_max,
+                                                int axis, bool positive, double margin, double max_range) const {
+        double best = max_range;
+        int stack[MAX_DEPTH];
+        int stack_size = 0;
+        if (not nodes.empty()) {
+            stack[stack_size++] = 0;
+        }
+        while (stack_size > 0 and best > 0) {
+            const Node &node = nodes[stack[--stack_size]];
+            if (boxSweepDistance(box_min, box_max, node.box_min, node.box_max, axis, positive, margin) >= best) {
+                continue;
+            }
+            if (node.count > 0) {
+                for (int i = node.start; i < node.start + node.count; i++) {
+                    best = std::min(best, boxSweepDistance(box_min, box_max, primitives[i].getMin(),
+                                                           primitives[i].getMax(), axis, positive, margin));
+                }
+                continue;
+            }
+            stack[stack_size++] = node.right;
+            stack[stack_size++] = static_cast<int>(&node - nodes.data()) + 1;
+        }
+        return best;
+    }
+
+    bool PrimitiveWorld::raycast(const octomap::point3d &origin, const octomap::point3d &direction,
+                                 double max_range, octomap::point3d &hit) const {
+        double best = max_range;
+        bool found = false;
+        int stack[MAX_DEPTH];
+        int stack_size = 0;
+        if (not nodes.empty()) {
+            stack[stack_size++] = 0;
+        }
+        while (stack_size > 0) {
+            const Node &node = nodes[stack[--stack_size]];
+            double t_enter = 0, t_exit = best;
+            if (not clipBox(origin, direction, node.box_min, node.box_max, t_enter, t_exit)) {
+                continue;
+            }
+            if (node.count > 0) {
+                for (int i = node.start; i < node.start + node.count; i++) {
+                    double range;
+                    if (primitives[i].raycast(origin, direction, best, range)) {
+                        best = range;
+                        found = true;
+                    }
+                }
+                continue;
+            }
+            stack[stack_size++] = node.right;
+            stack[stack_size++] = static_cast<int>(&node - nodes.data()) + 1;
+        }
+        if (found) {
+            hit = origin + direction * best;
+        }
+        return found;
+    }
+
+    size_t PrimitiveWorld::getMemoryUsage() const {
+        return primitives.capacity() * sizeof(WorldPrimitive) + nodes.capacity() * sizeof(Node);
+    }
+}
@@ -0,0 +1,54 @@
+#include <progress_monitor.hpp>
+#include <algorithm>
+
+namespace DynamicPlanning {
+    void ProgressMonitor::reset(size_t _n_agents, int _window) {
+        window = std::max(_window, 0);
+        n_agents = _n_agents;
+        n_updates = 0;
+        dist_history.assign(window > 0 ? (window + 1) * n_agents : 0, 0);
+        stalled.assign(n_agents, 0);
+        n_stalled_groups = 0;
+    }
+
+    void ProgressMonitor::update(const std::vector<double> &dists_to_goal, const std::vector<std::set<size_t>> &groups,
+                                 double time_step, double rate_threshold, double goal_threshold) {
+        if (window <= 0 or dists_to_goal.size() != n_agents) {
+            return;
+        }
+
+        auto ring_size = static_cast<size_t>(window + 1);
+        double *current = dist_history.data() + (n_updates % ring_size) * n_agents;
+        std::copy(dists_to_goal.begin(), dists_to_goal.end(), current);
+        n_updates++;
+
+        std::fill(stalled.begin(), stalled.end(), 0);
+        n_stalled_groups = 0;
+        if (n_updates < ring_size) {
+            return;
+        }
+
+        // The oldest entry of the ring is the window before the current one
+        const double *oldest = dist_history.data() + (n_updates % ring_size) * n_agents;
+        double window_time = window * time_step;
+        for (const auto &group: groups) {
+            double progress_sum = 0;
+            size_t n_moving = 0;
+            for (size_t qi: group) {
+                if (current[qi] < goal_threshold) {
+                    continue;
+                }
+                progress_sum += oldest[qi] - current[qi];
+                n_moving++;
+            }
+            if (n_moving == 0 or progress_sum / (n_moving * window_time) >= rate_threshold) {
+                continue;
+            }
+
+            n_stalled_groups++;
+            for (size_t qi: group) {
+                stalled[qi] = current[qi] >= goal_threshold;
+            }
+        }
+    }
+}
@@ -0,0 +1,226 @@
+#include <multi_sync_simulator.hpp>
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
+#include <mutex>
+
+using namespace DynamicPlanning;
+namespace py = pybind11;
+
+// Python bindings of the headless simulator for the parameter sweeps and the learning pipelines.
+// An Environment reads the parameters once from a namespace of the parameter server, like multi_sync_batch_node,
+// and is stepped from Python. The GIL is released during the steps, so several environments run in parallel
+// threads. They share the worker pools and the caches of the process, e.g. the global maps and the SFC library.
+// The state of the agents is returned as read-only NumPy views of the buffers of the simulator without a copy.
+// The views are valid until the next reset or the destruction of the environment.
+namespace {
+    // The environments of the process share the node
+    void initializeROS() {
+        static std::once_flag once;
+        std::call_once(once, [] {
+            ros::init(ros::M_string(), "lsc_planner_py",
+                      ros::init_options::AnonymousName | ros::init_options::NoSigintHandler);
+        });
+    }
+
+    class Environment {
+    public:
+        Environment(const std::string &_param_ns, const std::string &mission_file_name,
+                    const std::string &_world_file_name)
+                : param_ns(_param_ns), world_file_name(_world_file_name) {
+            initializeROS();
+            nh = std::make_unique<ros::NodeHandle>("~");
+            readParam(param);
+            reset(mission_file_name);
+        }
+
+        // Load the mission and reset the simulator. The simulator is kept if only the mission is changed, see
+        // MultiSyncSimulator::resetMission, otherwise a new one is built.
+        void reset(const std::string &mission_file_name) {
+            Mission mission(mission_file_name, world_file_name);
+            if (not mission.loadMission(param.multisim_max_noise, param.world_dimension, param.world_z_2d) or
+                mission.qn == 0) {
+                throw std::invalid_argument("Invalid mission " + mission_file_name);
+            }
+
+            py::gil_scoped_release release;
+            if (simulator == nullptr or not simulator->resetMission(mission)) {
+                // The maps of the previous simulator are released before the next one loads them
+                simulator.reset();
+                simulator = std::make_unique<MultiSyncSimulator>(*nh, param, mission);
+            }
+        }
+
+        // Read the parameters again from the namespace, false if they are rejected by the simulator
+        bool updateParam() {
+            Param new_param;
+            readParam(new_param);
+            py::gil_scoped_release release;
+            if (not simulator->updateParam(new_param)) {
+                return false;
+            }
+            param = new_param;
+            return true;
+        }
+
+        bool step() {
+            py::gil_scoped_release release;
+            return simulator->step();
+        }
+
+        // Up to n_steps steps, returns the number of the steps run, less than n_steps if the mission ends
+        int stepMany(int n_steps) {
+            py::gil_scoped_release release;
+            int n_run = 0;
+            while (n_run < n_steps and simulator->step()) {
+                n_run++;
+            }
+            return n_run;
+        }
+
+        // The state between the steps in memory, restored by the same environment or another one with the same
+        // mission to branch it
+        std::shared_ptr<SimulationCheckpoint> checkpoint() const {
+            auto checkpoint = std::make_shared<SimulationCheckpoint>();
+            if (not simulator->saveCheckpoint(*checkpoint)) {
+                throw std::runtime_error("The mission can not be checkpointed");
+            }
+            return checkpoint;
+        }
+
+        void restore(const SimulationCheckpoint &checkpoint) {
+            py::gil_scoped_release release;
+            if (not simulator->restoreCheckpoint(checkpoint)) {
+                throw std::invalid_argument("The checkpoint can not be restored");
+            }
+        }
+
+        void saveCheckpoint(const std::string &file_name) const {
+            if (not checkpoint()->save(file_name)) {
+                throw std::runtime_error("Fail to save the checkpoint " + file_name);
+            }
+        }
+
+        void loadCheckpoint(const std::string &file_name) {
+            SimulationCheckpoint checkpoint;
+            if (not checkpoint.load(file_name)) {
+                throw std::invalid_argument("Invalid checkpoint " + file_name);
+            }
+            restore(checkpoint);
+        }
+
+        [[nodiscard]] int getSimStep() const { return simulator->getSimStep(); }
+
+        [[nodiscard]] bool isSucceeded() const { return simulator->isMissionSucceeded(); }
+
+        [[nodiscard]] size_t getNumAgents() const { return simulator->getAgentStateBuffers().n_agents; }
+
+        // [agent, axis]
+        py::array getAgentVectors(const std::vector<double> AgentStateBuffers::*field) {
+            const AgentStateBuffers &buffers = simulator->getAgentStateBuffers();
+            return makeView(buffers.*field, {buffers.n_agents, 3});
+        }
+
+        // [agent, point, axis], the control points of the segments in order
+        py::array getControlPoints() {
+            const AgentStateBuffers &buffers = simulator->getAgentStateBuffers();
+            return makeView(buffers.control_points, {buffers.n_agents, buffers.n_control_points, 3});
+        }
+
+        py::array getPlannerSeqs() {
+            const AgentStateBuffers &buffers = simulator->getAgentStateBuffers();
+            return makeView(buffers.planner_seqs, {buffers.n_agents});
+        }
+
+        // The averages of the planning time of the agents and the MAPF in seconds
+        [[nodiscard]] py::dict getPlanningTime() const {
+            const PlanningTimeStatistics &planning_time = simulator->getPlanningTimeStatistics();
+            py::dict result;
+            result["planning"] = planning_time.total_planning_time.average;
+            result["mapf"] = planning_time.mapf_time.average;
+            result["initial_traj_planning"] = planning_time.initial_traj_planning_time.average;
+            result["obstacle_prediction"] = planning_time.obstacle_prediction_time.average;
+            result["goal_planning"] = planning_time.goal_planning_time.average;
+            result["lsc_generation"] = planning_time.lsc_generation_time.average;
+            result["sfc_generation"] = planning_time.sfc_generation_time.average;
+            result["traj_optimization"] = planning_time.traj_optimization_time.average;
+            return result;
+        }
+
+    private:
+        std::string param_ns, world_file_name;
+        std::unique_ptr<ros::NodeHandle> nh;
+        Param param;
+        std::unique_ptr<MultiSyncSimulator> simulator;
+
+        void readParam(Param &new_param) const {
+            ros::NodeHandle nh_param(param_ns);
+            if (not new_param.initialize(nh_param)) {
+                throw std::invalid_argument("Invalid parameter in " + param_ns);
+            }
+            new_param.multisim_headless = true;
+            if (not new_param.validateMultisim()) {
+                throw std::invalid_argument("Invalid multisim parameter in " + param_ns);
+            }
+            if (new_param.multisim_replay or new_param.multisim_num_processes > 1) {
+                throw std::invalid_argument("The replay and the distributed simulation are not supported");
+            }
+        }
+
+        // The environment is the base of the view, so the buffer is kept while the view is alive
+        template<typename T>
+        py::array makeView(const std::vector<T> &buffer, const std::vector<size_t> &shape) {
+            std::vector<size_t> strides(shape.size());
+            size_t stride = sizeof(T);
+            for (size_t i = shape.size(); i-- > 0;) {
+                strides[i] = stride;
+                stride *= shape[i];
+            }
+            py::array view(py::dtype::of<T>(), shape, strides, buffer.data(), py::cast(this));
+            py::detail::array_proxy(view.ptr())->flags &= ~py::detail::npy_api::NPY_ARRAY_WRITEABLE_;
+            return view;
+        }
+    };
+}
+
+PYBIND11_MODULE(lsc_planner_py, m) {
+    m.doc() = "Headless multi-agent simulator of the LSC planner";
+
+    py::class_<SimulationCheckpoint, std::shared_ptr<SimulationCheckpoint>>(m, "Checkpoint")
+            .def_readonly("sim_step", &SimulationCheckpoint::sim_step)
+            .def_readonly("sim_time", &SimulationCheckpoint::sim_time);
+
+    py::class_<Environment>(m, "Environment")
+            .def(py::init<const std::string &, const std::string &, const std::string &>(),
+                 py::arg("param_ns"), py::arg("mission"), py::arg("world"),
+                 "Read the parameters from the namespace and load the mission and the world in missions/ and world/")
+            .def("reset", &Environment::reset, py::arg("mission"), "Start the mission in missions/")
+            .def("update_param", &Environment::updateParam,
+                 "Read the parameters again from the namespace between the steps")
+            .def("step", &Environment::step, "One planning step, False if the mission ended")
+            .def("step_many", &Environment::stepMany, py::arg("n_steps"),
+                 "Up to n_steps steps without returning to Python, returns the number of the steps run")
+            .def("checkpoint", &Environment::checkpoint, "The state between the steps in memory")
+            .def("restore", &Environment::restore, py::arg("checkpoint"),
+                 "Continue from a checkpoint of the same mission, e.g. to branch it with other parameters")
+            .def("save_checkpoint", &Environment::saveCheckpoint, py::arg("file"))
+            .def("load_checkpoint", &Environment::loadCheckpoint, py::arg("file"))
+            .def_property_readonly("sim_step", &Environment::getSimStep)
+            .def_property_readonly("num_agents", &Environment::getNumAgents)
+            .def_property_readonly("succeeded", &Environment::isSucceeded)
+            .def_property_readonly("positions", [](Environment &env) {
+                return env.getAgentVectors(&AgentStateBuffers::positions);
+            })
+            .def_property_readonly("velocities", [](Environment &env) {
+                return env.getAgentVectors(&AgentStateBuffers::velocities);
+            })
+            .def_property_readonly("accelerations", [](Environment &env) {
+                return env.getAgentVectors(&AgentStateBuffers::accelerations);
+            })
+            .def_property_readonly("goal_points", [](Environment &env) {
+                return env.getAgentVectors(&AgentStateBuffers::goal_points);
+            })
+            .def_property_readonly("control_points", &Environment::getControlPoints)
+            .def_property_readonly("planner_seqs", &Environment::getPlannerSeqs)
+            .def_property_readonly("planning_time", &Environment::getPlanningTime);
+}
@@ -0,0 +1,146 @@
+// Solve recorded QP problems with each available backend and compare latency and cost.
+// The batched solver solves all problems together, its time is the batch time per problem.
+// Record problems with <param name="opt/record_qp" value="true" />, then run
+// rosrun lsc_dr_planner qp_benchmark <package_path>/log/qp [repeat]
+#include <qp_solver.hpp>
+#include <batch_qp_solver.hpp>
+#include <timer.hpp>
+#include <experimental/filesystem>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+namespace fs = std::experimental::filesystem;
+using namespace DynamicPlanning;
+
+struct BenchmarkResult {
+    std::string solver_name;
+    std::vector<double> solve_times;
+    double cost_error_max = 0;
+    int n_solved = 0;
+    int n_failed = 0;
+};
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cout << "Usage: qp_benchmark <qp file or directory> [repeat]" << std::endl;
+        return -1;
+    }
+
+    int repeat = argc > 2 ? std::stoi(argv[2]) : 1;
+    std::vector<std::string> file_names;
+    if (fs::is_directory(argv[1])) {
+        for (const auto &entry: fs::directory_iterator(argv[1])) {
+            if (entry.path().extension() == ".qp") {
+                file_names.emplace_back(entry.path().string());
+            }
+        }
+        std::sort(file_names.begin(), file_names.end());
+    } else {
+        file_names.emplace_back(argv[1]);
+    }
+
+    std::vector<std::unique_ptr<QPSolver>> solvers;
+    solvers.emplace_back(createQPSolver(QPSolverMode::CPLEX));
+#ifdef USE_OSQP
+    solvers.emplace_back(createQPSolver(QPSolverMode::OSQP));
+#endif
+
+    std::vector<BenchmarkResult> results(solvers.size());
+    for (size_t si = 0; si < solvers.size(); si++) {
+        results[si].solver_name = solvers[si]->getName();
+    }
+
+    std::vector<QPProblem> problems;
+    std::vector<double> reference_costs;
+    std::vector<bool> has_references;
+    for (const auto &file_name: file_names) {
+        QPProblem problem;
+        if (not readQPProblem(file_name, problem)) {
+            std::cout << "Failed to read " << file_name << std::endl;
+            continue;
+        }
+
+        // The first solver (CPLEX) is the reference of the cost
+        double reference_cost = 0;
+        bool has_reference = false;
+        for (size_t si = 0; si < solvers.size(); si++) {
+            for (int r = 0; r < repeat; r++) {
+                QPSolution solution;
+                bool success = solvers[si]->solve(problem, solution);
+                if (not success) {
+                    results[si].n_failed++;
+                    continue;
+                }
+
+                results[si].n_solved++;
+                results[si].solve_times.emplace_back(solution.solve_time);
+                if (si == 0) {
+                    reference_cost = solution.cost;
+                    has_reference = true;
+                } else if (has_reference) {
+                    double cost_error = std::abs(solution.cost - reference_cost) /
+                                        std::max(1.0, std::abs(reference_cost));
+                    results[si].cost_error_max = std::max(results[si].cost_error_max, cost_error);
+                }
+            }
+        }
+        problems.emplace_back(std::move(problem));
+        reference_costs.emplace_back(reference_cost);
+        has_references.emplace_back(has_reference);
+    }
+
+    BatchQPSolver batch_solver;
+    BenchmarkResult batch_result;
+    batch_result.solver_name = "batch";
+    std::vector<const QPProblem *> problem_ptrs;
+    for (const auto &problem: problems) {
+        problem_ptrs.emplace_back(&problem);
+    }
+    for (int r = 0; r < repeat and not problems.empty(); r++) {
+        std::vector<QPSolution> solutions;
+        std::vector<uint8_t> successes;
+        Timer timer;
+        timer.reset();
+        batch_solver.solve(problem_ptrs, solutions, successes);
+        timer.stop();
+        for (size_t k = 0; k < problems.size(); k++) {
+            if (not successes[k]) {
+                batch_result.n_failed++;
+                continue;
+            }
+            batch_result.n_solved++;
+            batch_result.solve_times.emplace_back(timer.elapsedSeconds() / problems.size());
+            if (has_references[k]) {
+                double cost_error = std::abs(solutions[k].cost - reference_costs[k]) /
+                                    std::max(1.0, std::abs(reference_costs[k]));
+                batch_result.cost_error_max = std::max(batch_result.cost_error_max, cost_error);
+            }
+        }
+    }
+    results.emplace_back(batch_result);
+
+    std::cout << "problems: " << file_names.size() << ", repeat: " << repeat << std::endl;
+    std::cout << std::setw(8) << "solver" << std::setw(8) << "solved" << std::setw(8) << "failed"
+              << std::setw(12) << "avg [ms]" << std::setw(12) << "p50 [ms]" << std::setw(12) << "max [ms]"
+              << std::setw(16) << "max cost err" << std::endl;
+    for (auto &result: results) {
+        std::vector<double> &times = result.solve_times;
+        double avg = 0, p50 = 0, max = 0;
+        if (not times.empty()) {
+            std::sort(times.begin(), times.end());
+            for (double time: times) {
+                avg += time;
+            }
+            avg /= times.size();
+            p50 = times[times.size() / 2];
+            max = times.back();
+        }
+
+        std::cout << std::setw(8) << result.solver_name << std::setw(8) << result.n_solved
+                  << std::setw(8) << result.n_failed << std::setw(12) << avg * 1e3 << std::setw(12) << p50 * 1e3
+                  << std::setw(12) << max * 1e3 << std::setw(16) << result.cost_error_max << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,225 @@
+#include <qp_condenser.hpp>
+#include <cmath>
+
+namespace DynamicPlanning {
+    static constexpr double PIVOT_TOLERANCE = 1e-9;
+
+    // Row bound shifted by the offset of the row, the infinite bounds stay infinite
+    static double shiftBound(double bound, double shift) {
+        return std::abs(bound) >= QP_INFINITY ? bound : bound - shift;
+    }
+
+    void QPCondenser::build(const QPProblem &problem, const std::vector<int> &preferred) {
+        n_var = problem.getNumVariables();
+        eq_rows.clear();
+        ineq_rows.clear();
+        for (int row = 0; row < problem.getNumConstraints(); row++) {
+            if (problem.l(row) == problem.u(row)) {
+                eq_rows.emplace_back(row);
+            } else {
+                ineq_rows.emplace_back(row);
+            }
+        }
+        E = selectRows(problem.A, eq_rows);
+
+        // Reduced row echelon form of [E | I], the columns are pivoted in the preferred order
+        int n_eq = static_cast<int>(eq_rows.size());
+        Eigen::MatrixXd R = Eigen::MatrixXd(E);
+        Eigen::MatrixXd R_e = Eigen::MatrixXd::Identity(n_eq, n_eq);
+        std::vector<int> order;
+        std::vector<bool> is_ordered(n_var, false);
+        for (int var: preferred) {
+            if (var >= 0 and var < n_var and not is_ordered[var]) {
+                order.emplace_back(var);
+                is_ordered[var] = true;
+            }
+        }
+        for (int var = 0; var < n_var; var++) {
+            if (not is_ordered[var]) {
+                order.emplace_back(var);
+            }
+        }
+
+        dep_vars.clear();
+        std::vector<bool> is_dep(n_var, false);
+        int n_pivot = 0;
+        for (int col: order) {
+            if (n_pivot == n_eq) {
+                break;
+            }
+            Eigen::Index pivot_row;
+            double pivot = R.col(col).tail(n_eq - n_pivot).cwiseAbs().maxCoeff(&pivot_row);
+            if (pivot < PIVOT_TOLERANCE) {
+                continue;
+            }
+            pivot_row += n_pivot;
+            R.row(pivot_row).swap(R.row(n_pivot));
+            R_e.row(pivot_row).swap(R_e.row(n_pivot));
+
+            double scale = 1 / R(n_pivot, col);
+            R.row(n_pivot) *= scale;
+            R_e.row(n_pivot) *= scale;
+            for (int row = 0; row < n_eq; row++) {
+                if (row == n_pivot or R(row, col) == 0) {
+                    continue;
+                }
+                double factor = R(row, col);
+                R.row(row) -= factor * R.row(n_pivot);
+                R_e.row(row) -= factor * R_e.row(n_pivot);
+            }
+            dep_vars.emplace_back(col);
+            is_dep[col] = true;
+            n_pivot++;
+        }
+        // The rows after n_pivot are redundant, 0 = 0 if the right-hand side is consistent
+
+        free_vars.clear();
+        for (int var = 0; var < n_var; var++) {
+            if (not is_dep[var]) {
+                free_vars.emplace_back(var);
+            }
+        }
+
+        T = R_e.topRows(n_pivot);
+        std::vector<Triplet> N_triplets;
+        for (size_t j = 0; j < free_vars.size(); j++) {
+            N_triplets.emplace_back(free_vars[j], j, 1);
+            for (int p = 0; p < n_pivot; p++) {
+                double value = R(p, free_vars[j]);
+                if (std::abs(value) > PIVOT_TOLERANCE) {
+                    N_triplets.emplace_back(dep_vars[p], j, -value);
+                }
+            }
+        }
+        N.resize(n_var, static_cast<int>(free_vars.size()));
+        N.setFromTriplets(N_triplets.begin(), N_triplets.end());
+        N.makeCompressed();
+
+        P_last.resize(0, 0);
+    }
+
+    bool QPCondenser::isCompatible(const QPProblem &problem) const {
+        if (not isBuilt() or problem.getNumVariables() != n_var) {
+            return false;
+        }
+
+        size_t n_eq = 0;
+        for (int row = 0; row < problem.getNumConstraints(); row++) {
+            if (problem.l(row) != problem.u(row)) {
+                continue;
+            }
+            if (n_eq >= eq_rows.size() or eq_rows[n_eq] != row) {
+                return false;
+            }
+            n_eq++;
+        }
+        if (n_eq != eq_rows.size()) {
+            return false;
+        }
+
+        SparseMatrix E_new = selectRows(problem.A, eq_rows);
+        return E_new.nonZeros() == E.nonZeros() and (E_new - E).norm() == 0;
+    }
+
+    QPProblem QPCondenser::condense(const QPProblem &problem, Eigen::VectorXd &x_0) {
+        Eigen::VectorXd e(eq_rows.size());
+        for (size_t i = 0; i < eq_rows.size(); i++) {
+            e(i) = problem.l(eq_rows[i]);
+        }
+        x_0 = Eigen::VectorXd::Zero(n_var);
+        Eigen::VectorXd x_dep = T * e;
+        for (size_t p = 0; p < dep_vars.size(); p++) {
+            x_0(dep_vars[p]) = x_dep(p);
+        }
+
+        QPProblem reduced;
+        SparseMatrix P_full = problem.P.selfadjointView<Eigen::Upper>();
+        bool is_P_changed = P_last.rows() != problem.P.rows() or P_last.nonZeros() != problem.P.nonZeros() or
+                            (problem.P - P_last).norm() != 0;
+        if (is_P_changed) {
+            SparseMatrix P_z = N.transpose() * P_full * N;
+            P_reduced = P_z.triangularView<Eigen::Upper>();
+            P_reduced.makeCompressed();
+            P_last = problem.P;
+        }
+        reduced.P = P_reduced;
+        Eigen::VectorXd Px_0 = P_full * x_0;
+        reduced.q = N.transpose() * (Px_0 + problem.q);
+        reduced.constant = problem.constant + 0.5 * x_0.dot(Px_0) + problem.q.dot(x_0);
+
+        // Inequality rows, then the bounds of the dependent variables
+        SparseMatrix A_ineq = selectRows(problem.A, ineq_rows);
+        Eigen::VectorXd A_x_0 = A_ineq * x_0;
+        std::vector<int> bounded_deps;
+        for (int var: dep_vars) {
+            if (problem.x_min(var) > -QP_INFINITY or problem.x_max(var) < QP_INFINITY) {
+                bounded_deps.emplace_back(var);
+            }
+        }
+        int n_ineq = static_cast<int>(ineq_rows.size());
+        int n_con = n_ineq + static_cast<int>(bounded_deps.size());
+        SparseMatrix A_z_ineq = A_ineq * N;
+        SparseMatrix A_z_bound = selectRows(N, bounded_deps);
+        std::vector<Triplet> A_triplets;
+        A_triplets.reserve(A_z_ineq.nonZeros() + A_z_bound.nonZeros());
+        for (int col = 0; col < A_z_ineq.outerSize(); col++) {
+            for (SparseMatrix::InnerIterator it(A_z_ineq, col); it; ++it) {
+                A_triplets.emplace_back(it.row(), it.col(), it.value());
+            }
+            for (SparseMatrix::InnerIterator it(A_z_bound, col); it; ++it) {
+                A_triplets.emplace_back(n_ineq + it.row(), it.col(), it.value());
+            }
+        }
+        reduced.A.resize(n_con, static_cast<int>(free_vars.size()));
+        reduced.A.setFromTriplets(A_triplets.begin(), A_triplets.end());
+        reduced.A.makeCompressed();
+
+        reduced.l.resize(n_con);
+        reduced.u.resize(n_con);
+        for (int i = 0; i < n_ineq; i++) {
+            reduced.l(i) = shiftBound(problem.l(ineq_rows[i]), A_x_0(i));
+            reduced.u(i) = shiftBound(problem.u(ineq_rows[i]), A_x_0(i));
+        }
+        for (size_t i = 0; i < bounded_deps.size(); i++) {
+            int var = bounded_deps[i];
+            reduced.l(n_ineq + i) = shiftBound(problem.x_min(var), x_0(var));
+            reduced.u(n_ineq + i) = shiftBound(problem.x_max(var), x_0(var));
+        }
+
+        int n_free = static_cast<int>(free_vars.size());
+        reduced.x_min.resize(n_free);
+        reduced.x_max.resize(n_free);
+        reduced.var_names.resize(n_free);
+        for (int j = 0; j < n_free; j++) {
+            reduced.x_min(j) = problem.x_min(free_vars[j]);
+            reduced.x_max(j) = problem.x_max(free_vars[j]);
+            if (static_cast<size_t>(free_vars[j]) < problem.var_names.size()) {
+                reduced.var_names[j] = problem.var_names[free_vars[j]];
+            }
+        }
+        if (problem.hasStart()) {
+            reduced.x_start.resize(n_free);
+            for (int j = 0; j < n_free; j++) {
+                reduced.x_start(j) = problem.x_start(free_vars[j]);
+            }
+        }
+        return reduced;
+    }
+
+    Eigen::VectorXd QPCondenser::expand(const Eigen::VectorXd &z, const Eigen::VectorXd &x_0) const {
+        return N * z + x_0;
+    }
+
+    SparseMatrix QPCondenser::selectRows(const SparseMatrix &A, const std::vector<int> &rows) const {
+        SparseMatrix S(static_cast<int>(rows.size()), A.rows());
+        std::vector<Triplet> S_triplets;
+        S_triplets.reserve(rows.size());
+        for (size_t i = 0; i < rows.size(); i++) {
+            S_triplets.emplace_back(i, rows[i], 1);
+        }
+        S.setFromTriplets(S_triplets.begin(), S_triplets.end());
+        SparseMatrix A_rows = S * A;
+        A_rows.makeCompressed();
+        return A_rows;
+    }
+}
@@ -0,0 +1,157 @@
+#include <qp_failure_diagnoser.hpp>
+#include <qp_solver.hpp>
+#include <experimental/filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::experimental::filesystem;
+
+namespace DynamicPlanning {
+    QPFailureDiagnoser &QPFailureDiagnoser::getInstance() {
+        static QPFailureDiagnoser diagnoser;
+        return diagnoser;
+    }
+
+    QPFailureDiagnoser::~QPFailureDiagnoser() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stop = true;
+        }
+        cv_submit.notify_all();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    void QPFailureDiagnoser::submit(QPFailureReport report) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (queue.size() >= MAX_QUEUE_SIZE) {
+                n_dropped++;
+                return;
+            }
+            queue.emplace_back(std::move(report));
+            if (not worker.joinable()) {
+                worker = std::thread(&QPFailureDiagnoser::workerLoop, this);
+            }
+        }
+        cv_submit.notify_one();
+    }
+
+    void QPFailureDiagnoser::flush() {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv_done.wait(lock, [this] { return queue.empty() and not is_busy; });
+    }
+
+    int QPFailureDiagnoser::getNumDropped() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return n_dropped;
+    }
+
+    size_t QPFailureDiagnoser::getQueueSize() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return queue.size();
+    }
+
+    void QPFailureDiagnoser::workerLoop() {
+        while (true) {
+            QPFailureReport report;
+            int seq;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv_submit.wait(lock, [this] { return stop or not queue.empty(); });
+                if (queue.empty()) {
+                    return; // stop after the remaining reports are diagnosed
+                }
+                report = std::move(queue.front());
+                queue.pop_front();
+                seq = n_diagnosed++;
+                is_busy = true;
+            }
+
+            diagnose(report, seq);
+
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                is_busy = false;
+            }
+            cv_done.notify_all();
+        }
+    }
+
+    void QPFailureDiagnoser::diagnose(const QPFailureReport &report, int seq) const {
+        fs::create_directories(report.log_dir);
+        std::string prefix = report.log_dir + "/" + report.problem_name + "_" +
+                             std::to_string(report.agent_id) + "_" + std::to_string(seq);
+        std::string model_path = prefix + ".lp";
+        std::string conflict_path = prefix + "_conflict.lp";
+        std::string result;
+
+        IloEnv env;
+        try {
+            IloCplex cplex(env);
+            IloModel model(env);
+            IloNumVarArray var(env);
+            IloRangeArray con(env);
+            cplex.setParam(IloCplex::Param::Threads, 1);
+            cplex.setOut(env.getNullStream());
+            cplex.setWarning(env.getNullStream());
+
+            loadQPProblemToCplex(model, var, con, report.problem);
+            cplex.extract(model);
+            cplex.exportModel(model_path.c_str());
+
+            if (cplex.solve()) {
+                result = "solved in the background, numerical failure";
+            } else if (cplex.getStatus() == IloAlgorithm::Infeasible or
+                       cplex.getStatus() == IloAlgorithm::InfeasibleOrUnbounded) {
+                IloConstraintArray infeas(env);
+                IloNumArray preferences(env);
+
+                infeas.add(con);
+                for (IloInt i = 0; i < var.getSize(); i++) {
+                    infeas.add(IloBound(var[i], IloBound::Lower));
+                    infeas.add(IloBound(var[i], IloBound::Upper));
+                }
+
+                for (IloInt i = 0; i < infeas.getSize(); i++) {
+                    preferences.add(1.0);
+                }
+
+                if (cplex.refineConflict(infeas, preferences)) {
+                    IloCplex::ConflictStatusArray conflict = cplex.getConflict(infeas);
+                    int n_proved = 0, n_possible = 0;
+                    for (IloInt i = 0; i < infeas.getSize(); i++) {
+                        if (conflict[i] == IloCplex::ConflictMember) {
+                            n_proved++;
+                        } else if (conflict[i] == IloCplex::ConflictPossibleMember) {
+                            n_possible++;
+                        }
+                    }
+                    cplex.writeConflict(conflict_path.c_str());
+                    result = "infeasible, conflict: " + std::to_string(n_proved) + " proved, " +
+                             std::to_string(n_possible) + " possible, " + conflict_path;
+                } else {
+                    result = "infeasible, conflict could not be refined";
+                }
+            } else {
+                std::ostringstream status;
+                status << cplex.getStatus();
+                result = "not solved in the background, status: " + status.str();
+            }
+        }
+        catch (IloException &e) {
+            std::ostringstream message;
+            message << e;
+            result = "CPLEX Concert exception caught: " + message.str();
+        }
+        env.end();
+
+        ROS_WARN_STREAM("[QPFailureDiagnoser] " << report.problem_name << " of mav " << report.agent_id
+                        << ": " << result);
+
+        std::ofstream report_file(report.log_dir + "/report.txt", std::ios_base::app);
+        report_file << report.problem_name << "," << report.agent_id << "," << seq << ","
+                    << report.status << "," << model_path << "," << result << "\n";
+    }
+}
@@ -0,0 +1,295 @@
+#include <qp_problem.hpp>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+namespace DynamicPlanning {
+    double QPProblem::getCost(const Eigen::VectorXd &x) const {
+        // P stores the upper triangular part only
+        Eigen::VectorXd Px = P.selfadjointView<Eigen::Upper>() * x;
+        return 0.5 * x.dot(Px) + q.dot(x) + constant;
+    }
+
+    int QPBuilder::addVariable(double lower_bound, double upper_bound, const std::string &name) {
+        x_min.emplace_back(lower_bound);
+        x_max.emplace_back(upper_bound);
+        q.emplace_back(0);
+        var_names.emplace_back(name);
+        return static_cast<int>(x_min.size()) - 1;
+    }
+
+    void QPBuilder::addQuadCost(int i, int j, double value) {
+        if (i > j) {
+            std::swap(i, j);
+        }
+
+        // 0.5 * P_ii * x_i^2 and P_ij * x_i * x_j (i < j)
+        if (i == j) {
+            P_triplets.emplace_back(i, i, 2 * value);
+        } else {
+            P_triplets.emplace_back(i, j, value);
+        }
+    }
+
+    void QPBuilder::addLinearCost(int i, double value) {
+        q[i] += value;
+    }
+
+    void QPBuilder::addConstant(double value) {
+        constant += value;
+    }
+
+    void QPBuilder::addSquaredError(int i, double target, double weight) {
+        addQuadCost(i, i, weight);
+        addLinearCost(i, -2 * weight * target);
+        addConstant(weight * target * target);
+    }
+
+    int QPBuilder::addRow(const std::vector<std::pair<int, double>> &coefs, double lower, double upper) {
+        int row = static_cast<int>(l.size());
+        for (const auto &coef: coefs) {
+            if (coef.second != 0) {
+                A_triplets.emplace_back(row, coef.first, coef.second);
+            }
+        }
+        l.emplace_back(lower);
+        u.emplace_back(upper);
+        return row;
+    }
+
+    QPProblem QPBuilder::build() const {
+        int n_var = getNumVariables();
+        int n_con = getNumConstraints();
+
+        QPProblem problem;
+        problem.P.resize(n_var, n_var);
+        problem.P.setFromTriplets(P_triplets.begin(), P_triplets.end()); // duplicated entries are summed
+        problem.P.makeCompressed();
+        problem.A.resize(n_con, n_var);
+        problem.A.setFromTriplets(A_triplets.begin(), A_triplets.end());
+        problem.A.makeCompressed();
+
+        problem.q = Eigen::Map<const Eigen::VectorXd>(q.data(), n_var);
+        problem.l = Eigen::Map<const Eigen::VectorXd>(l.data(), n_con);
+        problem.u = Eigen::Map<const Eigen::VectorXd>(u.data(), n_con);
+        problem.x_min = Eigen::Map<const Eigen::VectorXd>(x_min.data(), n_var);
+        problem.x_max = Eigen::Map<const Eigen::VectorXd>(x_max.data(), n_var);
+        problem.constant = constant;
+        problem.var_names = var_names;
+
+        return problem;
+    }
+
+    static int findRoot(std::vector<int> &parents, int var) {
+        while (parents[var] != var) {
+            parents[var] = parents[parents[var]];
+            var = parents[var];
+        }
+        return var;
+    }
+
+    std::vector<QPProblem> splitQPProblem(const QPProblem &problem, std::vector<std::vector<int>> &block_vars) {
+        int n_var = problem.getNumVariables();
+        int n_con = problem.getNumConstraints();
+
+        // Union of the variables coupled by the hessian or by a row
+        std::vector<int> parents(n_var);
+        for (int var = 0; var < n_var; var++) {
+            parents[var] = var;
+        }
+        auto merge = [&](int a, int b) {
+            a = findRoot(parents, a);
+            b = findRoot(parents, b);
+            if (a != b) {
+                parents[std::max(a, b)] = std::min(a, b);
+            }
+        };
+        for (int col = 0; col < problem.P.outerSize(); col++) {
+            for (SparseMatrix::InnerIterator it(problem.P, col); it; ++it) {
+                merge(static_cast<int>(it.row()), col);
+            }
+        }
+        std::vector<int> row_vars(n_con, -1); // a variable of the row
+        for (int col = 0; col < problem.A.outerSize(); col++) {
+            for (SparseMatrix::InnerIterator it(problem.A, col); it; ++it) {
+                if (row_vars[it.row()] < 0) {
+                    row_vars[it.row()] = col;
+                } else {
+                    merge(row_vars[it.row()], col);
+                }
+            }
+        }
+
+        // Blocks in the order of their first variable
+        std::vector<int> var_blocks(n_var), var_locals(n_var);
+        std::vector<int> root_blocks(n_var, -1);
+        block_vars.clear();
+        for (int var = 0; var < n_var; var++) {
+            int root = findRoot(parents, var);
+            if (root_blocks[root] < 0) {
+                root_blocks[root] = static_cast<int>(block_vars.size());
+                block_vars.emplace_back();
+            }
+            var_blocks[var] = root_blocks[root];
+            var_locals[var] = static_cast<int>(block_vars[var_blocks[var]].size());
+            block_vars[var_blocks[var]].emplace_back(var);
+        }
+        size_t n_blocks = block_vars.size();
+        if (n_blocks <= 1) {
+            block_vars.assign(1, std::vector<int>(n_var));
+            for (int var = 0; var < n_var; var++) {
+                block_vars[0][var] = var;
+            }
+            return {problem};
+        }
+
+        // Rows without a variable go to the first block
+        std::vector<int> row_blocks(n_con), row_locals(n_con);
+        std::vector<int> n_block_rows(n_blocks, 0);
+        for (int row = 0; row < n_con; row++) {
+            row_blocks[row] = row_vars[row] < 0 ? 0 : var_blocks[row_vars[row]];
+            row_locals[row] = n_block_rows[row_blocks[row]]++;
+        }
+
+        std::vector<std::vector<Triplet>> P_triplets(n_blocks), A_triplets(n_blocks);
+        for (int col = 0; col < problem.P.outerSize(); col++) {
+            for (SparseMatrix::InnerIterator it(problem.P, col); it; ++it) {
+                P_triplets[var_blocks[col]].emplace_back(var_locals[it.row()], var_locals[col], it.value());
+            }
+        }
+        for (int col = 0; col < problem.A.outerSize(); col++) {
+            for (SparseMatrix::InnerIterator it(problem.A, col); it; ++it) {
+                A_triplets[var_blocks[col]].emplace_back(row_locals[it.row()], var_locals[col], it.value());
+            }
+        }
+
+        std::vector<QPProblem> blocks(n_blocks);
+        for (size_t b = 0; b < n_blocks; b++) {
+            QPProblem &block = blocks[b];
+            int n_block_var = static_cast<int>(block_vars[b].size());
+            block.P.resize(n_block_var, n_block_var);
+            block.P.setFromTriplets(P_triplets[b].begin(), P_triplets[b].end());
+            block.P.makeCompressed();
+            block.A.resize(n_block_rows[b], n_block_var);
+            block.A.setFromTriplets(A_triplets[b].begin(), A_triplets[b].end());
+            block.A.makeCompressed();
+            block.q.resize(n_block_var);
+            block.x_min.resize(n_block_var);
+            block.x_max.resize(n_block_var);
+            block.var_names.resize(n_block_var);
+            block.l.resize(n_block_rows[b]);
+            block.u.resize(n_block_rows[b]);
+            if (problem.hasStart()) {
+                block.x_start.resize(n_block_var);
+            }
+        }
+        blocks[0].constant = problem.constant;
+        for (int var = 0; var < n_var; var++) {
+            QPProblem &block = blocks[var_blocks[var]];
+            int local = var_locals[var];
+            block.q(local) = problem.q(var);
+            block.x_min(local) = problem.x_min(var);
+            block.x_max(local) = problem.x_max(var);
+            if (static_cast<size_t>(var) < problem.var_names.size()) {
+                block.var_names[local] = problem.var_names[var];
+            }
+            if (problem.hasStart()) {
+                block.x_start(local) = problem.x_start(var);
+            }
+        }
+        for (int row = 0; row < n_con; row++) {
+            QPProblem &block = blocks[row_blocks[row]];
+            block.l(row_locals[row]) = problem.l(row);
+            block.u(row_locals[row]) = problem.u(row);
+        }
+        return blocks;
+    }
+
+    static void writeVector(std::ofstream &file, const Eigen::VectorXd &vector) {
+        for (int i = 0; i < vector.size(); i++) {
+            file << vector(i) << " ";
+        }
+        file << "\n";
+    }
+
+    static void writeSparseMatrix(std::ofstream &file, const SparseMatrix &matrix) {
+        file << matrix.nonZeros() << "\n";
+        for (int col = 0; col < matrix.outerSize(); col++) {
+            for (SparseMatrix::InnerIterator it(matrix, col); it; ++it) {
+                file << it.row() << " " << it.col() << " " << it.value() << "\n";
+            }
+        }
+    }
+
+    static bool readVector(std::ifstream &file, Eigen::VectorXd &vector, int size) {
+        vector.resize(size);
+        for (int i = 0; i < size; i++) {
+            if (not(file >> vector(i))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool readSparseMatrix(std::ifstream &file, SparseMatrix &matrix, int rows, int cols) {
+        int nnz;
+        if (not(file >> nnz)) {
+            return false;
+        }
+
+        std::vector<Triplet> triplets;
+        triplets.reserve(nnz);
+        for (int k = 0; k < nnz; k++) {
+            int row, col;
+            double value;
+            if (not(file >> row >> col >> value)) {
+                return false;
+            }
+            triplets.emplace_back(row, col, value);
+        }
+        matrix.resize(rows, cols);
+        matrix.setFromTriplets(triplets.begin(), triplets.end());
+        matrix.makeCompressed();
+        return true;
+    }
+
+    bool writeQPProblem(const std::string &file_name, const QPProblem &problem) {
+        std::ofstream file(file_name);
+        if (not file.is_open()) {
+            return false;
+        }
+
+        int n_var = problem.getNumVariables();
+        int n_con = problem.getNumConstraints();
+        file << std::setprecision(17);
+        file << "qp_problem " << n_var << " " << n_con << "\n";
+        file << problem.constant << "\n";
+        writeVector(file, problem.q);
+        writeVector(file, problem.x_min);
+        writeVector(file, problem.x_max);
+        writeVector(file, problem.l);
+        writeVector(file, problem.u);
+        writeSparseMatrix(file, problem.P);
+        writeSparseMatrix(file, problem.A);
+        return file.good();
+    }
+
+    bool readQPProblem(const std::string &file_name, QPProblem &problem) {
+        std::ifstream file(file_name);
+        std::string header;
+        int n_var, n_con;
+        if (not(file >> header >> n_var >> n_con) or header != "qp_problem") {
+            return false;
+        }
+
+        problem.var_names.assign(n_var, "");
+        return static_cast<bool>(file >> problem.constant) and
+               readVector(file, problem.q, n_var) and
+               readVector(file, problem.x_min, n_var) and
+               readVector(file, problem.x_max, n_var) and
+               readVector(file, problem.l, n_con) and
+               readVector(file, problem.u, n_con) and
+               readSparseMatrix(file, problem.P, n_var, n_var) and
+               readSparseMatrix(file, problem.A, n_con, n_var);
+    }
+}
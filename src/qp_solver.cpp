@@ -0,0 +1,250 @@
+#include <qp_solver.hpp>
+#include <timer.hpp>
+#include <trace.hpp>
+
+namespace DynamicPlanning {
+    void loadQPProblemToCplex(IloModel model, IloNumVarArray x, IloRangeArray c, const QPProblem &problem) {
+        IloEnv env = model.getEnv();
+        int n_var = problem.getNumVariables();
+        for (int i = 0; i < n_var; i++) {
+            x.add(IloNumVar(env, problem.x_min(i), problem.x_max(i)));
+            if (not problem.var_names[i].empty()) {
+                x[i].setName(problem.var_names[i].c_str());
+            }
+        }
+
+        // Objective, Concert uses the coefficient of x_i * x_j instead of the hessian
+        IloObjective objective = IloMinimize(env);
+        IloNumArray q(env, n_var);
+        for (int i = 0; i < n_var; i++) {
+            q[i] = problem.q(i);
+        }
+        objective.setLinearCoefs(x, q);
+        objective.setConstant(problem.constant);
+        for (int col = 0; col < problem.P.outerSize(); col++) {
+            for (SparseMatrix::InnerIterator it(problem.P, col); it; ++it) {
+                double value = it.row() == it.col() ? 0.5 * it.value() : it.value();
+                objective.setQuadCoef(x[static_cast<IloInt>(it.row())], x[static_cast<IloInt>(it.col())], value);
+            }
+        }
+        model.add(objective);
+
+        // Constraints
+        Eigen::SparseMatrix<double, Eigen::RowMajor> A = problem.A;
+        for (int row = 0; row < A.outerSize(); row++) {
+            IloRange range(env, problem.l(row), problem.u(row));
+            for (Eigen::SparseMatrix<double, Eigen::RowMajor>::InnerIterator it(A, row); it; ++it) {
+                range.setLinearCoef(x[static_cast<IloInt>(it.col())], it.value());
+            }
+            c.add(range);
+        }
+        model.add(c);
+    }
+
+    CplexQPSolver::CplexQPSolver(int _threads) : threads(_threads) {}
+
+    bool CplexQPSolver::solve(const QPProblem &problem, QPSolution &solution) {
+        TRACE_SCOPE("CplexQPSolver::solve");
+        Timer timer;
+        timer.reset();
+
+        IloEnv env;
+        bool success = false;
+        try {
+            IloCplex cplex(env);
+            IloModel model(env);
+            IloNumVarArray var(env);
+            IloRangeArray con(env);
+            cplex.setParam(IloCplex::Param::Threads, threads);
+            if (time_limit > 0) {
+                cplex.setParam(IloCplex::Param::TimeLimit, time_limit);
+            }
+            cplex.setOut(env.getNullStream());
+            cplex.setWarning(env.getNullStream());
+
+            loadQPProblemToCplex(model, var, con, problem);
+            cplex.extract(model);
+            if (problem.hasStart()) {
+                IloNumArray start_vals(env, problem.getNumVariables());
+                for (int i = 0; i < problem.getNumVariables(); i++) {
+                    start_vals[i] = problem.x_start(i);
+                }
+                cplex.setStart(start_vals, 0, var, 0, 0, 0);
+            }
+            success = cplex.solve();
+            solution.n_iteration = static_cast<int>(cplex.getNiterations() + cplex.getNbarrierIterations());
+            solution.time_limit_reached = cplex.getCplexStatus() == IloCplex::AbortTimeLim;
+            if (success) {
+                IloNumArray vals(env);
+                cplex.getValues(vals, var);
+                solution.x.resize(problem.getNumVariables());
+                for (int i = 0; i < problem.getNumVariables(); i++) {
+                    solution.x(i) = vals[i];
+                }
+                solution.cost = cplex.getObjValue();
+            }
+        }
+        catch (IloException &e) {
+            ROS_ERROR_STREAM("[CplexQPSolver] CPLEX Concert exception caught: " << e);
+            success = false;
+        }
+        env.end();
+
+        timer.stop();
+        solution.solve_time = timer.elapsedSeconds();
+        return success;
+    }
+
+#ifdef USE_OSQP
+    OSQPSolver::OSQPSolver() {
+        osqp_set_default_settings(&settings);
+        settings.verbose = false;
+        settings.warm_start = true;
+        settings.polish = true;
+        settings.eps_abs = 1e-6;
+        settings.eps_rel = 1e-6;
+    }
+
+    OSQPSolver::~OSQPSolver() {
+        reset();
+    }
+
+    void OSQPSolver::reset() {
+        if (work != nullptr) {
+            osqp_cleanup(work);
+            work = nullptr;
+        }
+    }
+
+    bool OSQPSolver::solve(const QPProblem &problem, QPSolution &solution) {
+        TRACE_SCOPE("OSQPSolver::solve");
+        Timer timer;
+        timer.reset();
+
+        int n_var = problem.getNumVariables();
+        int n_con = problem.getNumConstraints();
+
+        // Append variable bounds to A so that the pattern does not depend on the bounds
+        std::vector<Triplet> triplets;
+        triplets.reserve(problem.A.nonZeros() + n_var);
+        for (int col = 0; col < problem.A.outerSize(); col++) {
+            for (SparseMatrix::InnerIterator it(problem.A, col); it; ++it) {
+                triplets.emplace_back(it.row(), it.col(), it.value());
+            }
+        }
+        for (int i = 0; i < n_var; i++) {
+            triplets.emplace_back(n_con + i, i, 1.0);
+        }
+        SparseMatrix A_ext(n_con + n_var, n_var);
+        A_ext.setFromTriplets(triplets.begin(), triplets.end());
+        A_ext.makeCompressed();
+
+        CSC P_new = toCSC(problem.P);
+        CSC A_new = toCSC(A_ext);
+        q.assign(problem.q.data(), problem.q.data() + n_var);
+        l.resize(n_con + n_var);
+        u.resize(n_con + n_var);
+        for (int j = 0; j < n_con; j++) {
+            l[j] = std::max(problem.l(j), -OSQP_INFTY);
+            u[j] = std::min(problem.u(j), OSQP_INFTY);
+        }
+        for (int i = 0; i < n_var; i++) {
+            l[n_con + i] = std::max(problem.x_min(i), -OSQP_INFTY);
+            u[n_con + i] = std::min(problem.x_max(i), OSQP_INFTY);
+        }
+
+        bool reuse = work != nullptr and isPatternEqual(P_new, P_cache) and isPatternEqual(A_new, A_cache);
+        P_cache = std::move(P_new);
+        A_cache = std::move(A_new);
+        if (reuse) {
+            // Keep the factorization structure and the previous solution as a warm start
+            osqp_update_P_A(work, P_cache.x.data(), OSQP_NULL, static_cast<c_int>(P_cache.x.size()),
+                            A_cache.x.data(), OSQP_NULL, static_cast<c_int>(A_cache.x.size()));
+            osqp_update_lin_cost(work, q.data());
+            osqp_update_bounds(work, l.data(), u.data());
+        } else if (not setup(problem)) {
+            ROS_ERROR("[OSQPSolver] Failed to setup OSQP");
+            return false;
+        }
+
+        if (problem.hasStart()) {
+            osqp_warm_start_x(work, problem.x_start.data());
+        }
+#ifdef PROFILING
+        osqp_update_time_limit(work, time_limit);
+#endif
+        osqp_solve(work);
+        solution.n_iteration = static_cast<int>(work->info->iter);
+        // The iterate at the time limit is the incumbent, the caller checks its feasibility
+        solution.time_limit_reached = work->info->status_val == OSQP_TIME_LIMIT_REACHED;
+        bool success = work->info->status_val == OSQP_SOLVED or
+                       work->info->status_val == OSQP_SOLVED_INACCURATE or solution.time_limit_reached;
+        if (success) {
+            solution.x = Eigen::Map<const Eigen::VectorXd>(work->solution->x, n_var);
+            solution.cost = problem.getCost(solution.x);
+        } else {
+            // Infeasibility certificate breaks the next warm start
+            reset();
+        }
+
+        timer.stop();
+        solution.solve_time = timer.elapsedSeconds();
+        return success;
+    }
+
+    OSQPSolver::CSC OSQPSolver::toCSC(const SparseMatrix &matrix) {
+        CSC csc;
+        csc.p.assign(matrix.outerIndexPtr(), matrix.outerIndexPtr() + matrix.outerSize() + 1);
+        csc.i.assign(matrix.innerIndexPtr(), matrix.innerIndexPtr() + matrix.nonZeros());
+        csc.x.assign(matrix.valuePtr(), matrix.valuePtr() + matrix.nonZeros());
+        return csc;
+    }
+
+    bool OSQPSolver::isPatternEqual(const CSC &a, const CSC &b) {
+        return a.p == b.p and a.i == b.i;
+    }
+
+    bool OSQPSolver::setup(const QPProblem &problem) {
+        reset();
+
+        c_int n = problem.getNumVariables();
+        c_int m = static_cast<c_int>(l.size());
+        OSQPData data;
+        data.n = n;
+        data.m = m;
+        data.P = csc_matrix(n, n, static_cast<c_int>(P_cache.x.size()),
+                            P_cache.x.data(), P_cache.i.data(), P_cache.p.data());
+        data.A = csc_matrix(m, n, static_cast<c_int>(A_cache.x.size()),
+                            A_cache.x.data(), A_cache.i.data(), A_cache.p.data());
+        data.q = q.data();
+        data.l = l.data();
+        data.u = u.data();
+
+        // OSQP copies the data
+        c_int exitflag = osqp_setup(&work, &data, &settings);
+        c_free(data.P);
+        c_free(data.A);
+        if (exitflag != 0) {
+            work = nullptr;
+            return false;
+        }
+
+        return true;
+    }
+#endif
+
+    std::unique_ptr<QPSolver> createQPSolver(QPSolverMode mode) {
+        switch (mode) {
+            case QPSolverMode::CPLEX:
+                return std::make_unique<CplexQPSolver>();
+            case QPSolverMode::OSQP:
+#ifdef USE_OSQP
+                return std::make_unique<OSQPSolver>();
+#else
+                throw std::invalid_argument("[QPSolver] OSQP is not available, build with USE_OSQP");
+#endif
+        }
+
+        throw std::invalid_argument("[QPSolver] Invalid QP solver mode");
+    }
+}
@@ -0,0 +1,66 @@
+#include <random_stream.hpp>
+#include <cmath>
+
+namespace DynamicPlanning {
+    RandomStream::RandomStream(uint64_t seed, Domain domain, uint32_t index)
+            : key({static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)}),
+              stream((static_cast<uint64_t>(domain) << 32) | index) {}
+
+    uint32_t RandomStream::nextUInt() {
+        if (block_idx == 4) {
+            block = philox({static_cast<uint32_t>(block_counter), static_cast<uint32_t>(block_counter >> 32),
+                            static_cast<uint32_t>(stream), static_cast<uint32_t>(stream >> 32)}, key);
+            block_counter++;
+            block_idx = 0;
+        }
+        return block[block_idx++];
+    }
+
+    double RandomStream::nextUniform() {
+        uint64_t high = nextUInt() >> 5; // 27 bits
+        uint64_t low = nextUInt() >> 6; // 26 bits
+        return static_cast<double>((high << 26) | low) * 0x1.0p-53;
+    }
+
+    double RandomStream::nextNormal(double mean, double stddev) {
+        if (has_spare_normal) {
+            has_spare_normal = false;
+            return mean + stddev * spare_normal;
+        }
+
+        // u1 in (0, 1] for the logarithm
+        double u1 = 1.0 - nextUniform();
+        double u2 = nextUniform();
+        double radius = std::sqrt(-2.0 * std::log(u1));
+        double angle = 2.0 * M_PI * u2;
+        spare_normal = radius * std::sin(angle);
+        has_spare_normal = true;
+        return mean + stddev * radius * std::cos(angle);
+    }
+
+    void RandomStream::fillUniform(double *values, size_t size) {
+        for (size_t idx = 0; idx < size; idx++) {
+            values[idx] = nextUniform();
+        }
+    }
+
+    void RandomStream::fillNormal(double mean, double stddev, double *values, size_t size) {
+        for (size_t idx = 0; idx < size; idx++) {
+            values[idx] = nextNormal(mean, stddev);
+        }
+    }
+
+    std::array<uint32_t, 4> RandomStream::philox(std::array<uint32_t, 4> counter, std::array<uint32_t, 2> key) {
+        static constexpr uint32_t MULTIPLIER0 = 0xD2511F53, MULTIPLIER1 = 0xCD9E8D57;
+        static constexpr uint32_t WEYL0 = 0x9E3779B9, WEYL1 = 0xBB67AE85;
+        for (int round = 0; round < 10; round++) {
+            uint64_t product0 = static_cast<uint64_t>(MULTIPLIER0) * counter[0];
+            uint64_t product1 = static_cast<uint64_t>(MULTIPLIER1) * counter[2];
+            counter = {static_cast<uint32_t>(product1 >> 32) ^ counter[1] ^ key[0], static_cast<uint32_t>(product1),
+                       static_cast<uint32_t>(product0 >> 32) ^ counter[3] ^ key[1], static_cast<uint32_t>(product0)};
+            key[0] += WEYL0;
+            key[1] += WEYL1;
+        }
+        return counter;
+    }
+}
@@ -0,0 +1,212 @@
+#include <raycast_sensor.hpp>
+#include <worker_pool.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace DynamicPlanning {
+    static constexpr double VOXEL_EPSILON = 1e-6; // tolerance of the voxel index conversion [voxel]
+    static constexpr size_t BEAM_BATCH_SIZE = 64; // beams per task of the worker pool
+
+    RaycastSensor::RaycastSensor(const octomap::point3d &world_min, const octomap::point3d &world_max,
+                                 double _resolution, double _range, double horizontal_fov, double vertical_fov,
+                                 double angular_resolution)
+            : resolution(_resolution), range(_range), stamp(0) {
+        if (resolution <= 0 or range <= 0 or angular_resolution <= 0) {
+            throw std::invalid_argument("[RaycastSensor] Resolution, range and angular resolution must be positive");
+        }
+
+        for (int k = 0; k < 3; k++) {
+            origin(k) = static_cast<float>(std::floor(world_min(k) / resolution + VOXEL_EPSILON) * resolution);
+            size[k] = std::max(static_cast<int>(std::ceil((world_max(k) - origin(k)) / resolution - VOXEL_EPSILON)),
+                               1);
+        }
+        occupancy.assign((static_cast<size_t>(size[0]) * size[1] * size[2] + 63) / 64, 0);
+
+        // Beams are evenly spaced in azimuth and elevation, an omnidirectional sensor does not repeat -180 and 180
+        std::vector<double> azimuths, elevations;
+        if (horizontal_fov >= 360) {
+            int n_azimuth = std::max(static_cast<int>(std::round(360 / angular_resolution)), 1);
+            for (int i = 0; i < n_azimuth; i++) {
+                azimuths.emplace_back(-180 + i * 360.0 / n_azimuth);
+            }
+        } else {
+            int n_azimuth = static_cast<int>(std::floor(std::max(horizontal_fov, 0.0) / angular_resolution)) + 1;
+            for (int i = 0; i < n_azimuth; i++) {
+                azimuths.emplace_back(n_azimuth > 1 ? -0.5 * horizontal_fov + i * horizontal_fov / (n_azimuth - 1) : 0);
+            }
+        }
+        double fov_v = std::min(std::max(vertical_fov, 0.0), 180.0);
+        int n_elevation = static_cast<int>(std::floor(fov_v / angular_resolution)) + 1;
+        for (int i = 0; i < n_elevation; i++) {
+            elevations.emplace_back(n_elevation > 1 ? -0.5 * fov_v + i * fov_v / (n_elevation - 1) : 0);
+        }
+
+        for (double elevation: elevations) {
+            for (double azimuth: azimuths) {
+                double el = elevation * M_PI / 180, az = azimuth * M_PI / 180;
+                beam_x.emplace_back(static_cast<float>(std::cos(el) * std::cos(az)));
+                beam_y.emplace_back(static_cast<float>(std::cos(el) * std::sin(az)));
+                beam_z.emplace_back(static_cast<float>(std::sin(el)));
+            }
+        }
+        rotated_x.resize(beam_x.size());
+        rotated_y.resize(beam_y.size());
+        batches.resize((beam_x.size() + BEAM_BATCH_SIZE - 1) / BEAM_BATCH_SIZE);
+
+        // A beam stays within range / resolution voxels from the voxel of the origin
+        stamp_half_size = static_cast<int>(std::ceil(range / resolution)) + 1;
+        size_t stamp_size = 2 * stamp_half_size + 1;
+        stamps.assign(stamp_size * stamp_size * stamp_size, 0);
+    }
+
+    void RaycastSensor::markOccupied(const octomap::point3d &point) {
+        std::array<int, 3> voxel{};
+        for (int k = 0; k < 3; k++) {
+            voxel[k] = static_cast<int>(std::floor((point(k) - origin(k)) / resolution));
+        }
+        if (not isInside(voxel)) {
+            return;
+        }
+
+        size_t idx = voxelIndex(voxel[0], voxel[1], voxel[2]);
+        occupancy[idx / 64] |= uint64_t(1) << (idx % 64);
+    }
+
+    void RaycastSensor::sense(const octomap::OcTree &octree, const octomap::point3d &sensor_origin, double yaw,
+                              std::vector<octomap::OcTreeKey> &free_keys,
+                              std::vector<octomap::OcTreeKey> &occupied_keys) {
+        free_keys.clear();
+        occupied_keys.clear();
+
+        std::array<double, 3> start{};
+        std::array<int, 3> center{};
+        for (int k = 0; k < 3; k++) {
+            start[k] = (sensor_origin(k) - origin(k)) / resolution;
+            center[k] = static_cast<int>(std::floor(start[k]));
+        }
+        if (not isInside(center)) {
+            return;
+        }
+
+        // Rotate all beams at once, the loop over the arrays is vectorized
+        auto c = static_cast<float>(std::cos(yaw)), s = static_cast<float>(std::sin(yaw));
+        size_t n_beams = beam_x.size();
+        const float *bx = beam_x.data(), *by = beam_y.data();
+        float *rx = rotated_x.data(), *ry = rotated_y.data();
+        for (size_t b = 0; b < n_beams; b++) {
+            rx[b] = c * bx[b] - s * by[b];
+            ry[b] = s * bx[b] + c * by[b];
+        }
+
+        WorkerPool::getInstance().run(batches.size(), [&](size_t batch_idx) {
+            BeamBatch &batch = batches[batch_idx];
+            batch.free_voxels.clear();
+            batch.hit_voxels.clear();
+            size_t end = std::min((batch_idx + 1) * BEAM_BATCH_SIZE, n_beams);
+            for (size_t b = batch_idx * BEAM_BATCH_SIZE; b < end; b++) {
+                castBeam(b, start, batch);
+            }
+        });
+
+        stamp++;
+        if (stamp == 0) {
+            std::fill(stamps.begin(), stamps.end(), 0);
+            stamp = 1;
+        }
+
+        // The occupied voxels are merged first, so a voxel hit by any beam is not free, as in OcTree::computeUpdate
+        octomap::OcTreeKey origin_key = octree.coordToKey(origin + octomap::point3d(0.5f, 0.5f, 0.5f) *
+                                                                   static_cast<float>(resolution));
+        auto toKey = [&](const std::array<int, 3> &voxel) {
+            return octomap::OcTreeKey(static_cast<octomap::key_type>(origin_key[0] + voxel[0]),
+                                      static_cast<octomap::key_type>(origin_key[1] + voxel[1]),
+                                      static_cast<octomap::key_type>(origin_key[2] + voxel[2]));
+        };
+        for (const auto &batch: batches) {
+            for (const auto &voxel: batch.hit_voxels) {
+                if (markMerged(voxel, center)) {
+                    occupied_keys.emplace_back(toKey(voxel));
+                }
+            }
+        }
+        for (const auto &batch: batches) {
+            for (const auto &voxel: batch.free_voxels) {
+                if (markMerged(voxel, center)) {
+                    free_keys.emplace_back(toKey(voxel));
+                }
+            }
+        }
+    }
+
+    size_t RaycastSensor::voxelIndex(int i, int j, int k) const {
+        return (static_cast<size_t>(i) * size[1] + j) * size[2] + k;
+    }
+
+    bool RaycastSensor::isInside(const std::array<int, 3> &voxel) const {
+        return voxel[0] >= 0 and voxel[0] < size[0] and
+               voxel[1] >= 0 and voxel[1] < size[1] and
+               voxel[2] >= 0 and voxel[2] < size[2];
+    }
+
+    bool RaycastSensor::isOccupied(const std::array<int, 3> &voxel) const {
+        size_t idx = voxelIndex(voxel[0], voxel[1], voxel[2]);
+        return (occupancy[idx / 64] >> (idx % 64)) & 1;
+    }
+
+    // Amanatides and Woo, t is the distance along the beam in voxels
+    void RaycastSensor::castBeam(size_t beam_idx, const std::array<double, 3> &start, BeamBatch &batch) const {
+        const double direction[3] = {rotated_x[beam_idx], rotated_y[beam_idx], beam_z[beam_idx]};
+        std::array<int, 3> voxel{}, step{};
+        double t_max[3], t_delta[3];
+        for (int k = 0; k < 3; k++) {
+            voxel[k] = static_cast<int>(std::floor(start[k]));
+            if (direction[k] > 0) {
+                step[k] = 1;
+                t_max[k] = (voxel[k] + 1 - start[k]) / direction[k];
+                t_delta[k] = 1 / direction[k];
+            } else if (direction[k] < 0) {
+                step[k] = -1;
+                t_max[k] = (voxel[k] - start[k]) / direction[k];
+                t_delta[k] = -1 / direction[k];
+            } else {
+                step[k] = 0;
+                t_max[k] = std::numeric_limits<double>::infinity();
+                t_delta[k] = std::numeric_limits<double>::infinity();
+            }
+        }
+
+        double t_range = range / resolution;
+        while (true) {
+            if (isOccupied(voxel)) {
+                batch.hit_voxels.emplace_back(voxel);
+                return;
+            }
+            batch.free_voxels.emplace_back(voxel);
+
+            int axis = t_max[0] < t_max[1] ? (t_max[0] < t_max[2] ? 0 : 2) : (t_max[1] < t_max[2] ? 1 : 2);
+            if (t_max[axis] > t_range) {
+                return;
+            }
+            voxel[axis] += step[axis];
+            t_max[axis] += t_delta[axis];
+            if (not isInside(voxel)) {
+                return;
+            }
+        }
+    }
+
+    bool RaycastSensor::markMerged(const std::array<int, 3> &voxel, const std::array<int, 3> &center) {
+        size_t stamp_size = 2 * stamp_half_size + 1;
+        size_t idx = 0;
+        for (int k = 0; k < 3; k++) {
+            idx = idx * stamp_size + (voxel[k] - center[k] + stamp_half_size);
+        }
+        if (stamps[idx] == stamp) {
+            return false;
+        }
+        stamps[idx] = stamp;
+        return true;
+    }
+}
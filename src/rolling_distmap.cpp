@@ -0,0 +1,345 @@
+#include <rolling_distmap.hpp>
+#include <dynamicEDT3D/dynamicEDTOctomap.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace DynamicPlanning {
+    static constexpr double VOXEL_EPSILON = 1e-6; // tolerance of the voxel index conversion [voxel]
+    static constexpr int INFINITE_SQ_DIST = DistanceTransformLine::INFINITE_SQ_DIST;
+
+    RollingDistmap::RollingDistmap(const octomap::OcTree &octree, const octomap::point3d &world_min,
+                                   const octomap::point3d &world_max, double window_size, double max_dist)
+            : resolution(octree.getResolution()), has_dirty_region(false), dirty_min(), dirty_max() {
+        if (window_size <= 0 or max_dist <= 0) {
+            throw std::invalid_argument("[RollingDistmap] Window size and maximum distance must be positive");
+        }
+
+        octomap::OcTreeKey zero_key = octree.coordToKey(octomap::point3d(0, 0, 0));
+        int n_window_voxels = std::max(static_cast<int>(std::ceil(window_size / resolution - VOXEL_EPSILON)), 1);
+        size_t n_cells = 1;
+        for (int k = 0; k < 3; k++) {
+            origin_key[k] = zero_key[k];
+            world_min_key[k] = origin_key[k] + static_cast<int>(std::floor(world_min(k) / resolution + VOXEL_EPSILON));
+            world_max_key[k] = std::max(origin_key[k] +
+                                        static_cast<int>(std::ceil(world_max(k) / resolution - VOXEL_EPSILON)) - 1,
+                                        world_min_key[k]);
+            size[k] = std::min(n_window_voxels, world_max_key[k] - world_min_key[k] + 1);
+            window_min[k] = world_min_key[k];
+            shift_threshold[k] = std::max(size[k] / 4, 1);
+            n_cells *= size[k];
+        }
+
+        // Same truncation as DynamicEDTOctomap
+        max_sq_dist = static_cast<int>(max_dist / resolution * max_dist / resolution);
+        max_dist_voxels = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(max_sq_dist))));
+
+        occupancy.assign(n_cells, 0);
+        sq_dists.assign(n_cells, INFINITE_SQ_DIST);
+        closest_keys.resize(n_cells);
+
+        int max_size = std::max(std::max(size[0], size[1]), size[2]);
+        line.resize(max_size);
+        line_features.resize(max_size);
+    }
+
+    bool RollingDistmap::moveTo(const octomap::OcTree &octree, const octomap::point3d &center,
+                                std::vector<Region> &changed_regions) {
+        changed_regions.clear();
+        std::vector<std::pair<Index, Index>> dirty_regions;
+        for (int axis = 0; axis < 3; axis++) {
+            int center_key = origin_key[axis] + static_cast<int>(std::floor(center(axis) / resolution));
+            int desired_min = std::min(std::max(center_key - size[axis] / 2, world_min_key[axis]),
+                                       world_max_key[axis] - size[axis] + 1);
+            int shift = desired_min - window_min[axis];
+            if (std::abs(shift) < shift_threshold[axis]) {
+                continue;
+            }
+
+            Index old_min = window_min, old_max{}, new_max{};
+            for (int k = 0; k < 3; k++) {
+                old_max[k] = old_min[k] + size[k] - 1;
+            }
+            window_min[axis] = desired_min;
+            for (int k = 0; k < 3; k++) {
+                new_max[k] = window_min[k] + size[k] - 1;
+            }
+
+            // All cells are reused
+            if (std::abs(shift) >= size[axis]) {
+                changed_regions.emplace_back(keyToCoord(old_min, 0), keyToCoord(old_max, 1));
+                changed_regions.emplace_back(keyToCoord(window_min, 0), keyToCoord(new_max, 1));
+                resetBox(octree, window_min, new_max);
+                dirty_regions.emplace_back(window_min, new_max);
+                continue;
+            }
+
+            // The voxels scrolled in reuse the cells of the voxels scrolled out. The voxels read from the octree
+            // affect the cells within max_dist of the slab, and the cells within max_dist of the opposite face may
+            // have had their closest obstacle in the voxels scrolled out.
+            Index enter_min = window_min, enter_max = new_max;
+            Index trail_min = window_min, trail_max = new_max;
+            if (shift > 0) {
+                enter_min[axis] = old_max[axis] + 1;
+                trail_max[axis] = window_min[axis] + max_dist_voxels - 1;
+                trail_min[axis] = old_min[axis];
+            } else {
+                enter_max[axis] = old_min[axis] - 1;
+                trail_min[axis] = new_max[axis] - max_dist_voxels + 1;
+                trail_max[axis] = old_max[axis];
+            }
+            resetBox(octree, enter_min, enter_max);
+
+            enter_min[axis] -= max_dist_voxels;
+            enter_max[axis] += max_dist_voxels;
+            dirty_regions.emplace_back(enter_min, enter_max);
+            dirty_regions.emplace_back(trail_min, trail_max);
+            changed_regions.emplace_back(keyToCoord(enter_min, 0), keyToCoord(enter_max, 1));
+            changed_regions.emplace_back(keyToCoord(trail_min, 0), keyToCoord(trail_max, 1));
+        }
+
+        // The regions are clamped to the final window
+        for (const auto &region: dirty_regions) {
+            recompute(region.first, region.second);
+        }
+        return not changed_regions.empty();
+    }
+
+    void RollingDistmap::setOccupied(const octomap::OcTreeKey &key, bool occupied) {
+        if (not isInWindow(key)) {
+            return;
+        }
+
+        Index index = toIndex(key);
+        size_t cell = cellIndex(index);
+        if (static_cast<bool>(occupancy[cell]) == occupied) {
+            return;
+        }
+        occupancy[cell] = occupied;
+
+        if (not has_dirty_region) {
+            dirty_min = index;
+            dirty_max = index;
+            has_dirty_region = true;
+        } else {
+            for (int k = 0; k < 3; k++) {
+                dirty_min[k] = std::min(dirty_min[k], index[k]);
+                dirty_max[k] = std::max(dirty_max[k], index[k]);
+            }
+        }
+    }
+
+    void RollingDistmap::update() {
+        if (not has_dirty_region) {
+            return;
+        }
+
+        Index region_min{}, region_max{};
+        for (int k = 0; k < 3; k++) {
+            region_min[k] = dirty_min[k] - max_dist_voxels;
+            region_max[k] = dirty_max[k] + max_dist_voxels;
+        }
+        has_dirty_region = false;
+        recompute(region_min, region_max);
+    }
+
+    void RollingDistmap::query(DistmapQueryBatch &batch) const {
+        size_t n = batch.size();
+        batch.distance.resize(n);
+        batch.obstacle_x.resize(n);
+        batch.obstacle_y.resize(n);
+        batch.obstacle_z.resize(n);
+        batch.obstacle_l_inf_distance.resize(n);
+        batch.idx_x.resize(n);
+        batch.idx_y.resize(n);
+        batch.idx_z.resize(n);
+        if (n == 0) {
+            return;
+        }
+
+        // The keys relative to the window
+        const double inv_resolution = 1.0 / resolution;
+        const int base_x = origin_key[0] - window_min[0], base_y = origin_key[1] - window_min[1];
+        const int base_z = origin_key[2] - window_min[2];
+        const float *x = batch.x.data(), *y = batch.y.data(), *z = batch.z.data();
+        int *idx_x = batch.idx_x.data(), *idx_y = batch.idx_y.data(), *idx_z = batch.idx_z.data();
+        for (size_t i = 0; i < n; i++) {
+            idx_x[i] = static_cast<int>(std::floor(x[i] * inv_resolution)) + base_x;
+            idx_y[i] = static_cast<int>(std::floor(y[i] * inv_resolution)) + base_y;
+            idx_z[i] = static_cast<int>(std::floor(z[i] * inv_resolution)) + base_z;
+        }
+
+        const auto res = static_cast<float>(resolution);
+        const float max_distance = std::sqrt(static_cast<float>(max_sq_dist)) * res;
+        const float infinity = std::numeric_limits<float>::infinity();
+        float *distance = batch.distance.data();
+        float *obstacle_x = batch.obstacle_x.data(), *obstacle_y = batch.obstacle_y.data();
+        float *obstacle_z = batch.obstacle_z.data();
+        for (size_t i = 0; i < n; i++) {
+            Index offset = {idx_x[i], idx_y[i], idx_z[i]};
+            if (offset[0] < 0 or offset[0] >= size[0] or offset[1] < 0 or offset[1] >= size[1] or
+                offset[2] < 0 or offset[2] >= size[2]) {
+                distance[i] = DynamicEDTOctomap::distanceValue_Error;
+                obstacle_x[i] = obstacle_y[i] = obstacle_z[i] = infinity;
+                continue;
+            }
+
+            size_t cell = cellIndex({offset[0] + window_min[0], offset[1] + window_min[1], offset[2] + window_min[2]});
+            int sq_dist = sq_dists[cell];
+            if (sq_dist == INFINITE_SQ_DIST) {
+                distance[i] = max_distance;
+                obstacle_x[i] = obstacle_y[i] = obstacle_z[i] = infinity;
+            } else {
+                distance[i] = std::sqrt(static_cast<float>(sq_dist)) * res;
+                const Index &closest_key = closest_keys[cell];
+                obstacle_x[i] = (static_cast<float>(closest_key[0] - origin_key[0]) + 0.5f) * res;
+                obstacle_y[i] = (static_cast<float>(closest_key[1] - origin_key[1]) + 0.5f) * res;
+                obstacle_z[i] = (static_cast<float>(closest_key[2] - origin_key[2]) + 0.5f) * res;
+            }
+        }
+
+        const float half_resolution = 0.5f * res;
+        float *l_inf = batch.obstacle_l_inf_distance.data();
+        for (size_t i = 0; i < n; i++) {
+            float dx = std::max(std::abs(x[i] - obstacle_x[i]) - half_resolution, 0.0f);
+            float dy = std::max(std::abs(y[i] - obstacle_y[i]) - half_resolution, 0.0f);
+            float dz = std::max(std::abs(z[i] - obstacle_z[i]) - half_resolution, 0.0f);
+            l_inf[i] = std::max(std::max(dx, dy), dz);
+        }
+    }
+
+    bool RollingDistmap::isInWindow(const octomap::OcTreeKey &key) const {
+        for (int k = 0; k < 3; k++) {
+            int offset = static_cast<int>(key[k]) - window_min[k];
+            if (offset < 0 or offset >= size[k]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool RollingDistmap::intersectsWindow(const octomap::point3d &box_min, const octomap::point3d &box_max) const {
+        octomap::point3d window_min_point = getWindowMin(), window_max_point = getWindowMax();
+        for (int k = 0; k < 3; k++) {
+            if (box_max(k) <= window_min_point(k) or box_min(k) >= window_max_point(k)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    octomap::point3d RollingDistmap::getWindowMin() const {
+        return keyToCoord(window_min, 0);
+    }
+
+    octomap::point3d RollingDistmap::getWindowMax() const {
+        return keyToCoord({window_min[0] + size[0] - 1, window_min[1] + size[1] - 1, window_min[2] + size[2] - 1}, 1);
+    }
+
+    size_t RollingDistmap::cellIndex(const Index &key) const {
+        return (static_cast<size_t>(key[0] % size[0]) * size[1] + key[1] % size[1]) * size[2] + key[2] % size[2];
+    }
+
+    RollingDistmap::Index RollingDistmap::toIndex(const octomap::OcTreeKey &key) const {
+        return {key[0], key[1], key[2]};
+    }
+
+    octomap::point3d RollingDistmap::keyToCoord(const Index &key, double offset) const {
+        return {static_cast<float>((key[0] - origin_key[0] + offset) * resolution),
+                static_cast<float>((key[1] - origin_key[1] + offset) * resolution),
+                static_cast<float>((key[2] - origin_key[2] + offset) * resolution)};
+    }
+
+    void RollingDistmap::resetBox(const octomap::OcTree &octree, const Index &box_min, const Index &box_max) {
+        Index key{};
+        for (key[0] = box_min[0]; key[0] <= box_max[0]; key[0]++) {
+            for (key[1] = box_min[1]; key[1] <= box_max[1]; key[1]++) {
+                for (key[2] = box_min[2]; key[2] <= box_max[2]; key[2]++) {
+                    octomap::OcTreeKey octree_key(static_cast<octomap::key_type>(key[0]),
+                                                  static_cast<octomap::key_type>(key[1]),
+                                                  static_cast<octomap::key_type>(key[2]));
+                    const octomap::OcTreeNode *node = octree.search(octree_key);
+                    size_t cell = cellIndex(key);
+                    occupancy[cell] = node != nullptr and octree.isNodeOccupied(node);
+                    sq_dists[cell] = INFINITE_SQ_DIST;
+                }
+            }
+        }
+    }
+
+    void RollingDistmap::recompute(Index region_min, Index region_max) {
+        // A cell of the region depends on the obstacles within max_dist, so the transform runs on the inflated box
+        Index box_min{}, dims{};
+        size_t n_box_cells = 1;
+        for (int k = 0; k < 3; k++) {
+            int window_max = window_min[k] + size[k] - 1;
+            region_min[k] = std::max(region_min[k], window_min[k]);
+            region_max[k] = std::min(region_max[k], window_max);
+            if (region_min[k] > region_max[k]) {
+                return;
+            }
+            box_min[k] = std::max(region_min[k] - max_dist_voxels, window_min[k]);
+            dims[k] = std::min(region_max[k] + max_dist_voxels, window_max) - box_min[k] + 1;
+            n_box_cells *= dims[k];
+        }
+        auto boxIndex = [&](int i, int j, int l) {
+            return (static_cast<size_t>(i) * dims[1] + j) * dims[2] + l;
+        };
+
+        box_sq_dists.resize(n_box_cells);
+        box_features.resize(n_box_cells);
+        for (int i = 0; i < dims[0]; i++) {
+            for (int j = 0; j < dims[1]; j++) {
+                for (int l = 0; l < dims[2]; l++) {
+                    size_t b = boxIndex(i, j, l);
+                    bool occupied = occupancy[cellIndex({box_min[0] + i, box_min[1] + j, box_min[2] + l})];
+                    box_sq_dists[b] = occupied ? 0 : INFINITE_SQ_DIST;
+                    box_features[b] = occupied ? static_cast<int>(b) : -1;
+                }
+            }
+        }
+
+        // One pass of the 1D transform per axis, the feature is the box index of the closest obstacle
+        for (int axis = 2; axis >= 0; axis--) {
+            int axis_a = (axis + 1) % 3, axis_b = (axis + 2) % 3;
+            Index index{};
+            for (index[axis_a] = 0; index[axis_a] < dims[axis_a]; index[axis_a]++) {
+                for (index[axis_b] = 0; index[axis_b] < dims[axis_b]; index[axis_b]++) {
+                    for (index[axis] = 0; index[axis] < dims[axis]; index[axis]++) {
+                        size_t b = boxIndex(index[0], index[1], index[2]);
+                        line.f[index[axis]] = box_sq_dists[b];
+                        line_features[index[axis]] = box_features[b];
+                    }
+                    line.transform(dims[axis]);
+                    for (index[axis] = 0; index[axis] < dims[axis]; index[axis]++) {
+                        size_t b = boxIndex(index[0], index[1], index[2]);
+                        int arg = line.args[index[axis]];
+                        box_sq_dists[b] = arg < 0 ? INFINITE_SQ_DIST : line.sq_dists[index[axis]];
+                        box_features[b] = arg < 0 ? -1 : line_features[arg];
+                    }
+                }
+            }
+        }
+
+        Index key{};
+        for (key[0] = region_min[0]; key[0] <= region_max[0]; key[0]++) {
+            for (key[1] = region_min[1]; key[1] <= region_max[1]; key[1]++) {
+                for (key[2] = region_min[2]; key[2] <= region_max[2]; key[2]++) {
+                    size_t b = boxIndex(key[0] - box_min[0], key[1] - box_min[1], key[2] - box_min[2]);
+                    size_t cell = cellIndex(key);
+                    if (box_sq_dists[b] > max_sq_dist) {
+                        sq_dists[cell] = INFINITE_SQ_DIST;
+                        continue;
+                    }
+
+                    auto feature = static_cast<size_t>(box_features[b]);
+                    sq_dists[cell] = box_sq_dists[b];
+                    closest_keys[cell] = {box_min[0] + static_cast<int>(feature / (dims[1] * dims[2])),
+                                          box_min[1] + static_cast<int>((feature / dims[2]) % dims[1]),
+                                          box_min[2] + static_cast<int>(feature % dims[2])};
+                }
+            }
+        }
+    }
+}
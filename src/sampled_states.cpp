@@ -0,0 +1,44 @@
+#include <sampled_states.hpp>
+
+namespace DynamicPlanning {
+    void SampledStates::resize(size_t _qn, double _time_step, size_t _n_samples) {
+        qn = _qn;
+        time_step = _time_step;
+        n_samples = _n_samples;
+        data.resize(N_FIELDS * qn * n_samples);
+    }
+
+    void SampledStates::sampleAgent(size_t qi, const traj_t &traj) {
+        // The derivatives are computed once for all samples
+        traj_t dtraj, ddtraj;
+        traj.derivative(dtraj);
+        dtraj.derivative(ddtraj);
+        const traj_t *field_trajs[3] = {&traj, &dtraj, &ddtraj};
+        points_t points;
+        for (int order = 0; order < 3; order++) {
+            float *x = getMutableField(static_cast<Field>(PX + 3 * order), qi);
+            float *y = getMutableField(static_cast<Field>(PY + 3 * order), qi);
+            float *z = getMutableField(static_cast<Field>(PZ + 3 * order), qi);
+            field_trajs[order]->samplePoints(time_step, n_samples, points);
+            for (size_t k = 0; k < n_samples; k++) {
+                x[k] = points[k].x();
+                y[k] = points[k].y();
+                z[k] = points[k].z();
+            }
+        }
+    }
+
+    State SampledStates::getState(size_t sample, size_t qi) const {
+        State state;
+        state.position = getPoint(PX, sample, qi);
+        state.velocity = getPoint(VX, sample, qi);
+        state.acceleration = getPoint(AX, sample, qi);
+        return state;
+    }
+
+    point3d SampledStates::getPoint(Field field_x, size_t sample, size_t qi) const {
+        return {getField(field_x, qi)[sample],
+                getField(static_cast<Field>(field_x + 1), qi)[sample],
+                getField(static_cast<Field>(field_x + 2), qi)[sample]};
+    }
+}
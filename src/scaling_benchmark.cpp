@@ -0,0 +1,343 @@
+// End-to-end scaling benchmark over generated missions.
+// For each number of agents and number of pillars, mission_generator writes the missions to
+// missions/scaling_<agents>a_<pillars>p, then multi_sync_batch_node runs them once per number of planning threads,
+// thread placement mode and sticky agent setting, see multisim/thread_placement and multisim/sticky_agents.
+// Each run is a separate process, so its peak RSS is the one of the configuration. The success rate, the wall time,
+// the peak RSS and the latency percentiles of the steps and the planning stages are saved to --output as JSON.
+// With --baseline, the configurations in both files are compared, and the latency or the memory increase larger than
+// --threshold, or a success rate drop larger than --threshold, is reported as a regression and the exit code is -1.
+// rosrun lsc_dr_planner scaling_benchmark --agents 10,50,100,250,500 --pillars 0,200 --threads 1,8 --missions 3
+//     --dimension "-20,-20,0,20,20,2.5" --param_ns /multi_sync_simulator_node --baseline log/scaling_baseline.json
+// rosrun lsc_dr_planner scaling_benchmark --agents 500 --threads 64 --placements none,compact,spread --sticky 0,1
+#include <cpu_topology.hpp>
+#include <ros/package.h>
+#include <rapidjson/document.h>
+#include <rapidjson/istreamwrapper.h>
+#include <rapidjson/ostreamwrapper.h>
+#include <rapidjson/prettywriter.h>
+#include <boost/program_options.hpp>
+#include <experimental/filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace po = boost::program_options;
+namespace fs = std::experimental::filesystem;
+using namespace rapidjson;
+
+extern char **environ;
+
+namespace {
+    struct ProcessResult {
+        int exit_status = -1;
+        double peak_rss_mb = 0;
+    };
+
+    // The settings of multi_sync_batch_node compared for the same missions
+    struct RunConfig {
+        int n_threads = 1;
+        std::string placement = "none";
+        bool sticky_agents = false;
+    };
+
+    bool parseList(const std::string &str, std::vector<std::string> &values) {
+        values.clear();
+        std::stringstream ss(str);
+        std::string value;
+        while (std::getline(ss, value, ',')) {
+            values.emplace_back(value);
+        }
+        return not values.empty();
+    }
+
+    bool parseList(const std::string &str, std::vector<int> &values) {
+        values.clear();
+        std::stringstream ss(str);
+        std::string value_str;
+        while (std::getline(ss, value_str, ',')) {
+            try {
+                values.emplace_back(std::stoi(value_str));
+            } catch (const std::exception &) {
+                return false;
+            }
+            if (values.back() < 0) {
+                return false;
+            }
+        }
+        return not values.empty();
+    }
+
+    // Run the executable in a child process and wait for it, the peak RSS is the one of the child only
+    ProcessResult runProcess(const std::vector<std::string> &args) {
+        ProcessResult result;
+        std::vector<char *> argv;
+        for (const auto &arg: args) {
+            argv.emplace_back(const_cast<char *>(arg.c_str()));
+        }
+        argv.emplace_back(nullptr);
+
+        pid_t pid;
+        if (posix_spawn(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0) {
+            std::cout << "[ScalingBenchmark] Fail to run " << args[0] << std::endl;
+            return result;
+        }
+
+        int status = 0;
+        rusage usage{};
+        if (wait4(pid, &status, 0, &usage) < 0) {
+            return result;
+        }
+        result.exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        result.peak_rss_mb = static_cast<double>(usage.ru_maxrss) / 1024.0; // ru_maxrss is in kB on Linux
+        return result;
+    }
+
+    bool readJSON(const std::string &file_name, Document &document) {
+        std::ifstream ifs(file_name);
+        if (not ifs) {
+            return false;
+        }
+        IStreamWrapper isw(ifs);
+        document.ParseStream(isw);
+        return not document.HasParseError() and document.IsObject();
+    }
+
+    // The results saved before the placement options ran without them
+    std::string getConfigKey(const Value &config) {
+        std::string placement = config.HasMember("placement") ? config["placement"].GetString() : "none";
+        bool sticky_agents = config.HasMember("sticky_agents") and config["sticky_agents"].GetBool();
+        return std::to_string(config["agents"].GetInt()) + " agents, " +
+               std::to_string(config["pillars"].GetInt()) + " pillars, " +
+               std::to_string(config["threads"].GetInt()) + " threads, " + placement + " placement" +
+               (sticky_agents ? ", sticky agents" : "");
+    }
+
+    // Larger values of the latency and the memory are worse, a metric below min_value is too small to compare
+    bool isIncreased(double value, double baseline_value, double threshold, double min_value) {
+        return baseline_value > min_value and value > baseline_value * (1 + threshold);
+    }
+
+    int compareWithBaseline(const Value &configs, const Value &baseline_configs, double threshold) {
+        int n_regressions = 0, n_compared = 0;
+        for (const auto &config: configs.GetArray()) {
+            std::string key = getConfigKey(config);
+            const Value *baseline = nullptr;
+            for (const auto &baseline_config: baseline_configs.GetArray()) {
+                if (getConfigKey(baseline_config) == key) {
+                    baseline = &baseline_config;
+                    break;
+                }
+            }
+            if (baseline == nullptr) {
+                continue;
+            }
+            n_compared++;
+
+            auto report = [&](const std::string &metric, double value, double baseline_value) {
+                std::cout << "[ScalingBenchmark] Regression, " << key << ", " << metric << ": " << value
+                          << " (baseline " << baseline_value << ")" << std::endl;
+                n_regressions++;
+            };
+            double success_rate = config["success_rate"].GetDouble();
+            double baseline_success_rate = (*baseline)["success_rate"].GetDouble();
+            if (success_rate < baseline_success_rate - threshold) {
+                report("success_rate", success_rate, baseline_success_rate);
+            }
+            double peak_rss_mb = config["peak_rss_mb"].GetDouble();
+            double baseline_peak_rss_mb = (*baseline)["peak_rss_mb"].GetDouble();
+            if (isIncreased(peak_rss_mb, baseline_peak_rss_mb, threshold, 0)) {
+                report("peak_rss_mb", peak_rss_mb, baseline_peak_rss_mb);
+            }
+
+            // The percentiles recorded in both runs, the stages below 10 us are dominated by the timer
+            if (not config.HasMember("latency") or not baseline->HasMember("latency")) {
+                continue;
+            }
+            const Value &baseline_latency = (*baseline)["latency"];
+            for (const auto &stage: config["latency"].GetObject()) {
+                if (not baseline_latency.HasMember(stage.name)) {
+                    continue;
+                }
+                const Value &baseline_stage = baseline_latency[stage.name];
+                for (const auto &metric: stage.value.GetObject()) {
+                    std::string metric_name = metric.name.GetString();
+                    if (metric_name.empty() or metric_name[0] != 'p' or not baseline_stage.HasMember(metric.name)) {
+                        continue;
+                    }
+                    double value = metric.value.GetDouble();
+                    double baseline_value = baseline_stage[metric.name].GetDouble();
+                    if (isIncreased(value, baseline_value, threshold, 1e-5)) {
+                        report(std::string(stage.name.GetString()) + "_" + metric_name, value, baseline_value);
+                    }
+                }
+            }
+        }
+
+        std::cout << "[ScalingBenchmark] " << n_compared << " configurations compared with the baseline, "
+                  << n_regressions << " regressions" << std::endl;
+        return n_regressions;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    po::options_description desc("Options");
+    desc.add_options()
+            ("help,h", "print this message")
+            ("agents,a", po::value<std::string>()->default_value("10,50,100,250,500"), "numbers of agents")
+            ("pillars,p", po::value<std::string>()->default_value("0,200"), "numbers of pillars, the obstacle density")
+            ("threads,t", po::value<std::string>()->default_value("1"), "numbers of planning threads, 0: all cores")
+            ("placements", po::value<std::string>()->default_value("none"),
+             "thread placement modes of the workers: none, compact, spread")
+            ("sticky", po::value<std::string>()->default_value("0"), "sticky agent settings: 0, 1")
+            ("missions,m", po::value<int>()->default_value(3), "number of missions per configuration")
+            ("seed,s", po::value<uint64_t>()->default_value(0), "base seed of the missions")
+            ("dimension,d", po::value<std::string>()->default_value("-20,-20,0,20,20,2.5"),
+             "world boundary x_min,y_min,z_min,x_max,y_max,z_max [m]")
+            ("param_ns", po::value<std::string>(), "namespace of the parameters of multi_sync_batch_node")
+            ("output,o", po::value<std::string>(), "result file, log/scaling_<time>.json by default")
+            ("baseline,b", po::value<std::string>(), "result file of a previous run to compare with")
+            ("threshold", po::value<double>()->default_value(0.1), "relative increase reported as a regression");
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+    } catch (const po::error &e) {
+        std::cout << "[ScalingBenchmark] " << e.what() << std::endl;
+        return -1;
+    }
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+
+    std::vector<int> agent_counts, pillar_counts, thread_counts, sticky_settings;
+    std::vector<std::string> placements;
+    if (not parseList(vm["agents"].as<std::string>(), agent_counts) or
+        not parseList(vm["pillars"].as<std::string>(), pillar_counts) or
+        not parseList(vm["threads"].as<std::string>(), thread_counts) or
+        not parseList(vm["sticky"].as<std::string>(), sticky_settings) or vm["missions"].as<int>() < 1) {
+        std::cout << "[ScalingBenchmark] Invalid option, the lists are comma separated non-negative numbers"
+                  << std::endl;
+        return -1;
+    }
+    parseList(vm["placements"].as<std::string>(), placements);
+    std::vector<RunConfig> run_configs;
+    for (int n_threads: thread_counts) {
+        for (const auto &placement: placements) {
+            DynamicPlanning::ThreadPlacementMode mode;
+            if (not DynamicPlanning::CPUTopology::parsePlacementMode(placement, mode)) {
+                std::cout << "[ScalingBenchmark] Invalid placement mode " << placement << std::endl;
+                return -1;
+            }
+            for (int sticky_setting: sticky_settings) {
+                run_configs.push_back({n_threads, placement, sticky_setting > 0});
+            }
+        }
+    }
+
+    // The other executables of the package are next to this one
+    std::string package_path = ros::package::getPath("lsc_dr_planner");
+    fs::path bin_dir = fs::read_symlink("/proc/self/exe").parent_path();
+    std::string mission_generator = (bin_dir / "mission_generator").string();
+    std::string batch_node = (bin_dir / "multi_sync_batch_node").string();
+    std::string output_file_name = vm.count("output") ? vm["output"].as<std::string>() :
+                                   package_path + "/log/scaling_" + std::to_string(time(nullptr)) + ".json";
+
+    // The missions without pillars run in an empty world
+    std::string empty_world = "scaling/empty.csv";
+    fs::create_directories(package_path + "/world/scaling");
+    std::ofstream(package_path + "/world/" + empty_world).close();
+
+    Document result;
+    result.SetObject();
+    Document::AllocatorType &allocator = result.GetAllocator();
+    Value configs(kArrayType);
+    for (int n_agents: agent_counts) {
+        for (int n_pillars: pillar_counts) {
+            std::string name = "scaling_" + std::to_string(n_agents) + "a_" + std::to_string(n_pillars) + "p";
+            ProcessResult generation = runProcess({mission_generator,
+                                                   "--name", name,
+                                                   "--agents", std::to_string(n_agents),
+                                                   "--missions", std::to_string(vm["missions"].as<int>()),
+                                                   "--seed", std::to_string(vm["seed"].as<uint64_t>()),
+                                                   "--dimension", vm["dimension"].as<std::string>(),
+                                                   "--pillars", std::to_string(n_pillars)});
+            if (generation.exit_status != 0) {
+                std::cout << "[ScalingBenchmark] Fail to generate the missions " << name << std::endl;
+                continue;
+            }
+
+            for (const auto &run_config: run_configs) {
+                int n_threads = run_config.n_threads;
+                std::string batch_result_file_name = package_path + "/log/" + name + "_" +
+                                                     std::to_string(n_threads) + "t_" + run_config.placement +
+                                                     (run_config.sticky_agents ? "_sticky" : "") + ".json";
+                std::vector<std::string> args = {batch_node,
+                                                 "--mission", name,
+                                                 "--world", n_pillars > 0 ? name : empty_world,
+                                                 "--workers", std::to_string(n_threads),
+                                                 "--placement", run_config.placement,
+                                                 "--sticky_agents", run_config.sticky_agents ? "1" : "0",
+                                                 "--result_file", batch_result_file_name};
+                if (vm.count("param_ns")) {
+                    args.emplace_back("--param_ns");
+                    args.emplace_back(vm["param_ns"].as<std::string>());
+                }
+                std::cout << "[ScalingBenchmark] " << name << ", " << n_threads << " threads, " << run_config.placement
+                          << " placement" << (run_config.sticky_agents ? ", sticky agents" : "") << std::endl;
+                ProcessResult run = runProcess(args);
+
+                Value config(kObjectType);
+                config.AddMember("agents", n_agents, allocator);
+                config.AddMember("pillars", n_pillars, allocator);
+                config.AddMember("threads", n_threads, allocator);
+                config.AddMember("placement", Value(run_config.placement.c_str(), allocator), allocator);
+                config.AddMember("sticky_agents", run_config.sticky_agents, allocator);
+                config.AddMember("exit_status", run.exit_status, allocator);
+                config.AddMember("peak_rss_mb", run.peak_rss_mb, allocator);
+
+                // A run that crashed has no result file, then all of its missions failed
+                Document batch_result;
+                bool has_batch_result = readJSON(batch_result_file_name, batch_result);
+                int n_missions = has_batch_result ? batch_result["missions"].GetInt() : vm["missions"].as<int>();
+                int n_succeeded = has_batch_result ? batch_result["succeeded"].GetInt() : 0;
+                config.AddMember("missions", n_missions, allocator);
+                config.AddMember("succeeded", n_succeeded, allocator);
+                config.AddMember("success_rate", n_missions > 0 ? static_cast<double>(n_succeeded) / n_missions : 0.0,
+                                 allocator);
+                if (has_batch_result) {
+                    config.AddMember("wall_time", batch_result["wall_time"].GetDouble(), allocator);
+                    config.AddMember("latency", Value(batch_result["latency"], allocator), allocator);
+                }
+                std::cout << "[ScalingBenchmark] success rate: " << config["success_rate"].GetDouble()
+                          << ", peak RSS: " << run.peak_rss_mb << " MB" << std::endl;
+                configs.PushBack(config, allocator);
+            }
+        }
+    }
+    result.AddMember("configs", configs, allocator);
+
+    std::ofstream ofs(output_file_name);
+    OStreamWrapper osw(ofs);
+    PrettyWriter<OStreamWrapper> writer(osw);
+    result.Accept(writer);
+    ofs << "\n";
+    ofs.close();
+    std::cout << "[ScalingBenchmark] Results saved: " << output_file_name << std::endl;
+
+    if (vm.count("baseline")) {
+        Document baseline;
+        if (not readJSON(vm["baseline"].as<std::string>(), baseline) or not baseline.HasMember("configs")) {
+            std::cout << "[ScalingBenchmark] Invalid baseline " << vm["baseline"].as<std::string>() << std::endl;
+            return -1;
+        }
+        if (compareWithBaseline(result["configs"], baseline["configs"], vm["threshold"].as<double>()) > 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
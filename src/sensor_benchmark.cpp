@@ -0,0 +1,153 @@
+// Compare the virtual sensors of the local map on random poses in a world: the points of the global map within the
+// sensor range (kd-tree, sensor/mode sphere) and the ray-cast sensor with occlusion (sensor/mode raycast).
+// rosrun lsc_dr_planner sensor_benchmark <mission file> <world file or directory> [resolution] [samples] [range]
+#include <global_map_registry.hpp>
+#include <mission.hpp>
+#include <raycast_sensor.hpp>
+#include <timer.hpp>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/search/kdtree.h>
+#include <pcl/search/impl/kdtree.hpp>
+#include <iostream>
+#include <random>
+
+using namespace DynamicPlanning;
+
+struct BenchmarkResult {
+    std::string sensor_name;
+    double total_time = 0;
+    size_t n_free_voxels = 0;
+    size_t n_occupied_voxels = 0;
+};
+
+static void printResult(const BenchmarkResult &result, size_t n_samples) {
+    std::cout << result.sensor_name
+              << ": time " << 1000 * result.total_time / n_samples << " ms"
+              << ", occupied voxels " << static_cast<double>(result.n_occupied_voxels) / n_samples
+              << ", free voxels " << static_cast<double>(result.n_free_voxels) / n_samples
+              << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        std::cout << "Usage: sensor_benchmark <mission file> <world file or directory> [resolution] [samples] [range]"
+                  << std::endl;
+        return -1;
+    }
+
+    double resolution = argc > 3 ? std::stod(argv[3]) : 0.1;
+    size_t n_samples = argc > 4 ? std::stoul(argv[4]) : 1000;
+    double range = argc > 5 ? std::stod(argv[5]) : 3.0;
+    Mission mission(argv[1], argv[2]);
+    if (not mission.loadMission(0, 3, 1.0, 0)) {
+        std::cout << "Invalid mission: " << argv[1] << std::endl;
+        return -1;
+    }
+    std::shared_ptr<GlobalMap> global_map = loadGlobalMap(mission.current_world_file_name, resolution,
+                                                          mission.world_min, mission.world_max, false, false);
+    if (global_map == nullptr) {
+        return -1;
+    }
+    const octomap::OcTree &octree = *global_map->octree;
+
+    // Ground truth of both sensors, a pruned leaf covers several voxels
+    pcl::PointCloud<pcl::PointXYZ> cloud;
+    RaycastSensor raycast_sensor(mission.world_min, mission.world_max, resolution, range, 360, 60, 2);
+    for (auto it = octree.begin_leafs(), end = octree.end_leafs(); it != end; ++it) {
+        if (not octree.isNodeOccupied(*it)) {
+            continue;
+        }
+        int n_voxels = std::max(static_cast<int>(std::round(it.getSize() / resolution)), 1);
+        auto half_size = static_cast<float>(0.5 * it.getSize());
+        octomap::point3d corner = it.getCoordinate() - octomap::point3d(half_size, half_size, half_size);
+        for (int i = 0; i < n_voxels; i++) {
+            for (int j = 0; j < n_voxels; j++) {
+                for (int k = 0; k < n_voxels; k++) {
+                    octomap::point3d point = corner + octomap::point3d(i + 0.5f, j + 0.5f, k + 0.5f) *
+                                                      static_cast<float>(resolution);
+                    cloud.points.emplace_back(point.x(), point.y(), point.z());
+                    raycast_sensor.markOccupied(point);
+                }
+            }
+        }
+    }
+    cloud.width = cloud.points.size();
+    cloud.height = 1;
+    pcl::search::KdTree<pcl::PointXYZ> kdtree;
+    kdtree.setInputCloud(cloud.makeShared());
+
+    // Random collision-free poses
+    std::mt19937 generator(0);
+    std::uniform_real_distribution<float> x_dist(mission.world_min.x(), mission.world_max.x());
+    std::uniform_real_distribution<float> y_dist(mission.world_min.y(), mission.world_max.y());
+    std::uniform_real_distribution<float> z_dist(mission.world_min.z(), mission.world_max.z());
+    std::uniform_real_distribution<double> yaw_dist(-M_PI, M_PI);
+    std::vector<std::pair<octomap::point3d, double>> poses;
+    while (poses.size() < n_samples) {
+        octomap::point3d position(x_dist(generator), y_dist(generator), z_dist(generator));
+        const octomap::OcTreeNode *node = octree.search(position);
+        if (node == nullptr or not octree.isNodeOccupied(node)) {
+            poses.emplace_back(position, yaw_dist(generator));
+        }
+    }
+    std::cout << "world: " << mission.current_world_file_name << ", ground truth voxels: " << cloud.size()
+              << ", beams: " << raycast_sensor.getNumBeams() << ", poses: " << n_samples << std::endl;
+
+    // The local maps start empty and accumulate the sensor inputs as in the simulator
+    BenchmarkResult kdtree_result{"sphere (kd-tree)"};
+    {
+        octomap::OcTree local_octree(resolution);
+        std::vector<int> indices;
+        std::vector<float> sq_dists;
+        octomap::Pointcloud scan;
+        octomap::KeySet free_cells, occupied_cells;
+        for (const auto &pose: poses) {
+            Timer timer;
+            scan.clear();
+            pcl::PointXYZ search_point(pose.first.x(), pose.first.y(), pose.first.z());
+            if (kdtree.radiusSearch(search_point, range, indices, sq_dists) > 0) {
+                for (int idx: indices) {
+                    scan.push_back(cloud.points[idx].x, cloud.points[idx].y, cloud.points[idx].z);
+                }
+            }
+            free_cells.clear();
+            occupied_cells.clear();
+            local_octree.computeUpdate(scan, pose.first, free_cells, occupied_cells, range);
+            for (const auto &key: free_cells) {
+                local_octree.updateNode(key, false);
+            }
+            for (const auto &key: occupied_cells) {
+                local_octree.updateNode(key, true);
+            }
+            timer.stop();
+            kdtree_result.total_time += timer.elapsedSeconds();
+            kdtree_result.n_free_voxels += free_cells.size();
+            kdtree_result.n_occupied_voxels += occupied_cells.size();
+        }
+    }
+
+    BenchmarkResult raycast_result{"raycast"};
+    {
+        octomap::OcTree local_octree(resolution);
+        std::vector<octomap::OcTreeKey> free_keys, occupied_keys;
+        for (const auto &pose: poses) {
+            Timer timer;
+            raycast_sensor.sense(local_octree, pose.first, pose.second, free_keys, occupied_keys);
+            for (const auto &key: free_keys) {
+                local_octree.updateNode(key, false);
+            }
+            for (const auto &key: occupied_keys) {
+                local_octree.updateNode(key, true);
+            }
+            timer.stop();
+            raycast_result.total_time += timer.elapsedSeconds();
+            raycast_result.n_free_voxels += free_keys.size();
+            raycast_result.n_occupied_voxels += occupied_keys.size();
+        }
+    }
+
+    printResult(kdtree_result, n_samples);
+    printResult(raycast_result, n_samples);
+    return 0;
+}
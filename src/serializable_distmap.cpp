@@ -0,0 +1,131 @@
+#include <serializable_distmap.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace DynamicPlanning {
+    namespace {
+        const char MAGIC[8] = {'L', 'S', 'C', 'E', 'D', 'T', '\0', '\0'};
+        constexpr uint32_t VERSION = 2;
+
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            uint32_t cell_size; // sizeof(dataCell), the cells are stored as they are in memory
+            uint32_t size_x, size_y, size_z;
+            uint32_t padding;
+            uint64_t map_hash;
+        };
+
+        constexpr uint64_t FNV_OFFSET = 14695981039346656037ULL;
+        constexpr uint64_t FNV_PRIME = 1099511628211ULL;
+
+        void hashBytes(uint64_t &hash, const void *bytes, size_t size) {
+            const auto *p = static_cast<const unsigned char *>(bytes);
+            for (size_t i = 0; i < size; i++) {
+                hash = (hash ^ p[i]) * FNV_PRIME;
+            }
+        }
+    }
+
+    bool SerializableDistmap::load(const std::string &file_name, uint64_t map_hash) {
+        int fd = ::open(file_name.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat file_stat{};
+        if (fstat(fd, &file_stat) != 0 or (size_t) file_stat.st_size < sizeof(Header)) {
+            ::close(fd);
+            return false;
+        }
+        size_t file_size = file_stat.st_size;
+        void *mapped = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // the mapping keeps the file
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+
+        Header header{};
+        std::memcpy(&header, mapped, sizeof(header));
+        size_t row_size = (size_t) sizeZ * sizeof(dataCell);
+        bool is_valid = std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 and header.version == VERSION and
+                        header.cell_size == sizeof(dataCell) and header.map_hash == map_hash and
+                        header.size_x == (uint32_t) sizeX and header.size_y == (uint32_t) sizeY and
+                        header.size_z == (uint32_t) sizeZ and
+                        file_size == sizeof(header) + (size_t) sizeX * sizeY * row_size;
+        if (is_valid) {
+            // The rows along z are contiguous in memory
+            const char *cells = static_cast<const char *>(mapped) + sizeof(header);
+            for (int x = 0; x < sizeX; x++) {
+                for (int y = 0; y < sizeY; y++) {
+                    std::memcpy(data[x][y], cells + ((size_t) x * sizeY + y) * row_size, row_size);
+                }
+            }
+
+            // The obstacles queued at the construction are already propagated in the loaded cells
+            while (not open_queue.empty()) {
+                open_queue.pop();
+            }
+            octree->resetChangeDetection();
+        }
+        munmap(mapped, file_size);
+        return is_valid;
+    }
+
+    bool SerializableDistmap::save(const std::string &file_name, uint64_t map_hash) const {
+        // Write to a temporary file and rename it, so the agents of other processes never read a partial file
+        std::string tmp_file_name = file_name + ".tmp" + std::to_string(getpid());
+        std::ofstream file(tmp_file_name, std::ios_base::binary | std::ios_base::trunc);
+        if (not file) {
+            return false;
+        }
+
+        Header header{};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.cell_size = sizeof(dataCell);
+        header.size_x = sizeX;
+        header.size_y = sizeY;
+        header.size_z = sizeZ;
+        header.map_hash = map_hash;
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        for (int x = 0; x < sizeX; x++) {
+            for (int y = 0; y < sizeY; y++) {
+                file.write(reinterpret_cast<const char *>(data[x][y]),
+                           (std::streamsize) (sizeZ * sizeof(dataCell)));
+            }
+        }
+        file.close();
+        if (not file or std::rename(tmp_file_name.c_str(), file_name.c_str()) != 0) {
+            std::remove(tmp_file_name.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    uint64_t SerializableDistmap::computeMapHash(const std::string &world_file_name, double resolution,
+                                                 const octomap::point3d &bbx_min, const octomap::point3d &bbx_max,
+                                                 float max_dist) {
+        uint64_t hash = FNV_OFFSET;
+        std::ifstream world_file(world_file_name, std::ios_base::binary);
+        std::vector<char> buffer(1 << 16);
+        while (world_file.read(buffer.data(), (std::streamsize) buffer.size()) or world_file.gcount() > 0) {
+            hashBytes(hash, buffer.data(), world_file.gcount());
+        }
+
+        hashBytes(hash, &resolution, sizeof(resolution));
+        for (int k = 0; k < 3; k++) {
+            float min_k = bbx_min(k), max_k = bbx_max(k);
+            hashBytes(hash, &min_k, sizeof(min_k));
+            hashBytes(hash, &max_k, sizeof(max_k));
+        }
+        hashBytes(hash, &max_dist, sizeof(max_dist));
+        return hash;
+    }
+}
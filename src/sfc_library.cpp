@@ -0,0 +1,183 @@
+#include <sfc_library.hpp>
+#include <sp_const.hpp>
+#include <algorithm>
+#include <chrono>
+#include <tuple>
+
+namespace bgi = boost::geometry::index;
+
+namespace DynamicPlanning {
+    SFCLibrary &SFCLibrary::getInstance() {
+        static SFCLibrary library;
+        return library;
+    }
+
+    SFCLibrary::SFCLibrary() : next_id(0), capacity(0), is_deferred(false) {}
+
+    void SFCLibrary::setCapacity(int _capacity) {
+        std::lock_guard<std::mutex> lock(mtx);
+        capacity = _capacity;
+        while (capacity > 0 and entries.size() > static_cast<size_t>(capacity)) {
+            remove(entries.begin()->first);
+        }
+    }
+
+    bool SFCLibrary::find(const octomap::point3d &seed_min, const octomap::point3d &seed_max, double margin,
+                          const Validator &is_valid, octomap::point3d &box_min, octomap::point3d &box_max) {
+        auto start_time = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(mtx);
+        statistics.n_query++;
+
+        // Shrink the seed to be robust to the rounding error of the grid aligned boxes
+        octomap::point3d epsilon(SP_EPSILON_FLOAT, SP_EPSILON_FLOAT, SP_EPSILON_FLOAT);
+        std::vector<IndexValue> candidates;
+        rtree.query(bgi::covers(toIndexBox(seed_min + epsilon, seed_max - epsilon)), std::back_inserter(candidates));
+
+        // Largest box first
+        std::vector<std::pair<double, uint64_t>> volume_ids;
+        for (const auto &candidate: candidates) {
+            const Entry &entry = entries.at(candidate.second);
+            if (std::abs(entry.margin - margin) < SP_EPSILON_FLOAT) {
+                double volume = (entry.box.max_corner().get<0>() - entry.box.min_corner().get<0>()) *
+                                (entry.box.max_corner().get<1>() - entry.box.min_corner().get<1>()) *
+                                (entry.box.max_corner().get<2>() - entry.box.min_corner().get<2>());
+                volume_ids.emplace_back(volume, candidate.second);
+            }
+        }
+        std::sort(volume_ids.begin(), volume_ids.end(), std::greater<>());
+
+        for (const auto &volume_id: volume_ids) {
+            const IndexBox &box = entries.at(volume_id.second).box;
+            octomap::point3d candidate_min(static_cast<float>(box.min_corner().get<0>()),
+                                           static_cast<float>(box.min_corner().get<1>()),
+                                           static_cast<float>(box.min_corner().get<2>()));
+            octomap::point3d candidate_max(static_cast<float>(box.max_corner().get<0>()),
+                                           static_cast<float>(box.max_corner().get<1>()),
+                                           static_cast<float>(box.max_corner().get<2>()));
+            if (not is_valid(candidate_min, candidate_max)) {
+                if (is_deferred) {
+                    // Each box is counted once as it could be invalid for several callers
+                    if (pending_removals.insert(volume_id.second).second) {
+                        statistics.n_invalidated++;
+                    }
+                } else {
+                    remove(volume_id.second);
+                    statistics.n_invalidated++;
+                }
+                continue;
+            }
+
+            box_min = candidate_min;
+            box_max = candidate_max;
+            statistics.n_hit++;
+            statistics.hit_time += std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                                 start_time).count();
+            return true;
+        }
+
+        return false;
+    }
+
+    void SFCLibrary::insert(const octomap::point3d &box_min, const octomap::point3d &box_max, double margin,
+                            double expansion_time) {
+        std::lock_guard<std::mutex> lock(mtx);
+        statistics.n_expansion++;
+        statistics.expansion_time += expansion_time;
+
+        IndexBox index_box = toIndexBox(box_min, box_max);
+        if (is_deferred) {
+            pending_inserts.emplace_back(Entry{index_box, margin});
+            return;
+        }
+        insertImpl(index_box, margin);
+    }
+
+    void SFCLibrary::setDeferred(bool deferred) {
+        std::lock_guard<std::mutex> lock(mtx);
+        is_deferred = deferred;
+        if (not is_deferred) {
+            commitImpl();
+        }
+    }
+
+    void SFCLibrary::commit() {
+        std::lock_guard<std::mutex> lock(mtx);
+        commitImpl();
+    }
+
+    void SFCLibrary::insertImpl(const IndexBox &index_box, double margin) {
+        // Skip if the box is already covered by a cached one
+        std::vector<IndexValue> covering;
+        rtree.query(bgi::covers(index_box), std::back_inserter(covering));
+        for (const auto &value: covering) {
+            if (std::abs(entries.at(value.second).margin - margin) < SP_EPSILON_FLOAT) {
+                return;
+            }
+        }
+
+        if (capacity > 0 and entries.size() >= static_cast<size_t>(capacity)) {
+            remove(entries.begin()->first);
+        }
+
+        uint64_t id = next_id++;
+        entries.emplace(id, Entry{index_box, margin});
+        rtree.insert(IndexValue(index_box, id));
+    }
+
+    void SFCLibrary::commitImpl() {
+        for (uint64_t id: pending_removals) {
+            remove(id);
+        }
+        pending_removals.clear();
+
+        // The order of the insertions decides the coverage checks and the eviction, so they are sorted by the box
+        auto key = [](const Entry &entry) {
+            return std::make_tuple(entry.box.min_corner().get<0>(), entry.box.min_corner().get<1>(),
+                                   entry.box.min_corner().get<2>(), entry.box.max_corner().get<0>(),
+                                   entry.box.max_corner().get<1>(), entry.box.max_corner().get<2>(), entry.margin);
+        };
+        std::sort(pending_inserts.begin(), pending_inserts.end(),
+                  [&](const Entry &a, const Entry &b) { return key(a) < key(b); });
+        for (const auto &entry: pending_inserts) {
+            insertImpl(entry.box, entry.margin);
+        }
+        pending_inserts.clear();
+    }
+
+    void SFCLibrary::clear() {
+        std::lock_guard<std::mutex> lock(mtx);
+        rtree.clear();
+        entries.clear();
+        pending_inserts.clear();
+        pending_removals.clear();
+    }
+
+    size_t SFCLibrary::size() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return entries.size();
+    }
+
+    SFCLibraryStatistics SFCLibrary::getStatistics() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return statistics;
+    }
+
+    void SFCLibrary::resetStatistics() {
+        std::lock_guard<std::mutex> lock(mtx);
+        statistics = SFCLibraryStatistics();
+    }
+
+    void SFCLibrary::remove(uint64_t id) {
+        auto it = entries.find(id);
+        if (it == entries.end()) {
+            return;
+        }
+        rtree.remove(IndexValue(it->second.box, id));
+        entries.erase(it);
+    }
+
+    SFCLibrary::IndexBox SFCLibrary::toIndexBox(const octomap::point3d &box_min, const octomap::point3d &box_max) {
+        return {IndexPoint(box_min.x(), box_min.y(), box_min.z()),
+                IndexPoint(box_max.x(), box_max.y(), box_max.z())};
+    }
+}
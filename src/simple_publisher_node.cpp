@@ -1,6 +1,8 @@
 #include <ros/ros.h>
-#include <tf/transform_listener.h>
 #include <visualization_msgs/MarkerArray.h>
+#include <obstacle_ingestion.hpp>
+
+using namespace DynamicPlanning;
 
 int main(int argc, char* argv[]){
     ROS_INFO("Multi Sync Simulator");
@@ -8,11 +10,21 @@ int main(int argc, char* argv[]){
     ros::NodeHandle nh( "~" );
 
     ros::Publisher pub_collision_model = nh.advertise<visualization_msgs::MarkerArray>("/obstacle_collision_model", 1);
-    tf::TransformListener listener;
+
+    // The poses are looked up by the ingestion thread, the loop publishes the newest ones without waiting for tf
+    double radius = 0.35;
+    size_t n_obs = 2;
+    std::vector<std::string> frame_ids;
+    for (size_t oi = 0; oi < n_obs; oi++) {
+        frame_ids.emplace_back("/obs" + std::to_string(oi));
+    }
+    ObstacleIngestion &ingestion = ObstacleIngestion::getInstance();
+    ingestion.start("/world", frame_ids, std::vector<double>(n_obs, radius), 100.0, 0.0036, 1.0);
 
     ros::Rate rate(100.0);
     while (ros::ok()){
-        double radius = 0.35;
+        ingestion.update();
+        const ObstacleIngestion::Snapshot &snapshot = ingestion.getSnapshot();
 
         visualization_msgs::MarkerArray msg_obs_collision_model;
         visualization_msgs::Marker marker;
@@ -20,14 +32,10 @@ int main(int argc, char* argv[]){
         marker.type = visualization_msgs::Marker::SPHERE;
         marker.action = visualization_msgs::Marker::ADD;
 
-        for (int oi = 0; oi < 2; oi++) {
-            tf::StampedTransform transform;
-            try{
-                listener.lookupTransform("/world", "/obs" + std::to_string(oi), ros::Time(0), transform);
-            }
-            catch (tf::TransformException ex){
-                ROS_ERROR("%s",ex.what());
-                ros::Duration(0.5).sleep();
+        for (size_t oi = 0; oi < snapshot.obstacles.size(); oi++) {
+            if (not snapshot.is_observed[oi]) {
+                ROS_WARN_THROTTLE(1.0, "[SimplePublisher] waiting for the frame %s", frame_ids[oi].c_str());
+                continue;
             }
 
             marker.color.r = 0;
@@ -39,10 +47,10 @@ int main(int argc, char* argv[]){
             marker.scale.y = 2 * radius;
             marker.scale.z = 2 * radius * 4;
 
-            marker.id = oi;
-            marker.pose.position.x = transform.getOrigin().x();
-            marker.pose.position.y = transform.getOrigin().y();
-            marker.pose.position.z = transform.getOrigin().z();
+            marker.id = static_cast<int>(oi);
+            marker.pose.position.x = snapshot.obstacles[oi].observed_position.x();
+            marker.pose.position.y = snapshot.obstacles[oi].observed_position.y();
+            marker.pose.position.z = snapshot.obstacles[oi].observed_position.z();
 
             msg_obs_collision_model.markers.emplace_back(marker);
         }
@@ -51,4 +59,4 @@ int main(int argc, char* argv[]){
         rate.sleep();
     }
     return 0;
-}
\ No newline at end of file
+}
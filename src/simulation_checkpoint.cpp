@@ -0,0 +1,156 @@
+#include <simulation_checkpoint.hpp>
+#include <capture_archive.hpp>
+#include <cstring>
+#include <fstream>
+
+namespace DynamicPlanning {
+    using namespace CaptureArchive;
+
+    const char SimulationCheckpoint::MAGIC[8] = {'L', 'S', 'C', 'C', 'K', 'P', 'T', '\0'};
+
+    namespace {
+        template<typename Archive, typename P>
+        void serializeBox(Archive &ar, P &box) {
+            ar(box.box_min);
+            ar(box.box_max);
+        }
+
+        template<typename Archive>
+        void serializeSFCs(Archive &ar, const SFCs &sfcs) {
+            ar(static_cast<uint32_t>(sfcs.size()));
+            for (const auto &sfc: sfcs) {
+                serializeBox(ar, sfc);
+            }
+        }
+
+        template<typename Archive>
+        void serializeSFCs(Archive &ar, SFCs &sfcs) {
+            uint32_t size = 0;
+            ar(size);
+            sfcs.clear();
+            for (uint32_t i = 0; i < size and ar.isGood(); i++) {
+                sfcs.emplace_back();
+                serializeBox(ar, sfcs.back());
+            }
+        }
+
+        template<typename Archive, typename P>
+        void serializePlannerCheckpoint(Archive &ar, P &checkpoint) {
+            ar(checkpoint.agent);
+            ar(checkpoint.planner_seq);
+            ar(checkpoint.initialize_sfc);
+            ar(checkpoint.is_sol_converged_by_sfc);
+            ar(checkpoint.is_hover_ready);
+            ar(checkpoint.goal_planner_state);
+            ar(checkpoint.desired_segment_idx);
+            ar(checkpoint.full_M);
+            serializeBox(ar, checkpoint.sfc_converged);
+            ar(checkpoint.planned_map_version);
+            ar(checkpoint.initial_traj);
+            ar(checkpoint.prev_traj);
+            serializeSFCs(ar, checkpoint.sfcs);
+        }
+
+        template<typename Archive, typename P>
+        void serializeAgentCheckpoint(Archive &ar, P &checkpoint) {
+            ar(checkpoint.agent);
+            ar(checkpoint.planner_state);
+            ar(checkpoint.desired_traj);
+            ar(checkpoint.collision_alert);
+            serializePlannerCheckpoint(ar, checkpoint.planner);
+        }
+
+        template<typename Archive, typename P>
+        void serializeCheckpoint(Archive &ar, P &checkpoint) {
+            ar(checkpoint.mission_file_name);
+            ar(checkpoint.world_file_name);
+            ar(checkpoint.n_agents);
+            ar(checkpoint.M);
+            ar(checkpoint.n);
+            ar(checkpoint.dt);
+
+            ar(checkpoint.sim_step);
+            ar(checkpoint.sim_time);
+            ar(checkpoint.planner_state);
+            ar(checkpoint.finish_check_state);
+            ar(checkpoint.finish_check_idx);
+            ar(checkpoint.is_collided);
+            ar(checkpoint.safety_ratio_agent);
+            ar(checkpoint.safety_ratio_obs);
+            ar(checkpoint.total_distance);
+            ar(checkpoint.vel_excess_ratio);
+            ar(checkpoint.acc_excess_ratio);
+            ar(checkpoint.last_sampled_positions);
+            ar(checkpoint.n_replanned);
+            ar(checkpoint.n_held);
+            ar(checkpoint.n_hovered);
+            ar(checkpoint.observer_noise_stream);
+        }
+
+        // The archives with the state of the stream, so that a truncated file stops the loops over the sizes
+        struct CheckpointOut : public CaptureOut<std::ostream> {
+            explicit CheckpointOut(std::ostream &_out) : CaptureOut<std::ostream>(_out), stream(_out) {}
+
+            using CaptureOut<std::ostream>::operator();
+
+            [[nodiscard]] bool isGood() const { return static_cast<bool>(stream); }
+
+            std::ostream &stream;
+        };
+
+        struct CheckpointIn : public CaptureIn {
+            explicit CheckpointIn(std::istream &_in) : CaptureIn(_in), stream(_in) {}
+
+            using CaptureIn::operator();
+
+            [[nodiscard]] bool isGood() const { return static_cast<bool>(stream); }
+
+            std::istream &stream;
+        };
+    }
+
+    bool SimulationCheckpoint::save(const std::string &file_name) const {
+        std::ofstream out(file_name, std::ios::binary | std::ios::trunc);
+        if (not out.is_open()) {
+            return false;
+        }
+
+        CheckpointOut ar(out);
+        out.write(MAGIC, sizeof(MAGIC));
+        ar(VERSION);
+        serializeCheckpoint(ar, *this);
+        ar(static_cast<uint32_t>(agents.size()));
+        for (const auto &agent: agents) {
+            serializeAgentCheckpoint(ar, agent);
+        }
+        return static_cast<bool>(out);
+    }
+
+    bool SimulationCheckpoint::load(const std::string &file_name) {
+        std::ifstream in(file_name, std::ios::binary);
+        if (not in.is_open()) {
+            return false;
+        }
+
+        char magic[sizeof(MAGIC)] = {};
+        uint32_t version = 0;
+        CheckpointIn ar(in);
+        in.read(magic, sizeof(magic));
+        ar(version);
+        if (not in or std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 or version != VERSION) {
+            return false;
+        }
+
+        serializeCheckpoint(ar, *this);
+        uint32_t n_agent_checkpoints = 0;
+        ar(n_agent_checkpoints);
+        if (not in or n_agent_checkpoints != n_agents) {
+            return false;
+        }
+        agents.assign(n_agent_checkpoints, AgentManager::Checkpoint());
+        for (auto &agent: agents) {
+            serializeAgentCheckpoint(ar, agent);
+        }
+        return static_cast<bool>(in);
+    }
+}
@@ -0,0 +1,130 @@
+#include <solver_thread_scheduler.hpp>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace DynamicPlanning {
+    SolverThreadLease::SolverThreadLease(SolverThreadScheduler *_scheduler, size_t _problem_size, int _threads)
+            : scheduler(_scheduler), problem_size(_problem_size), threads(_threads),
+              start_time(std::chrono::steady_clock::now()) {}
+
+    SolverThreadLease::SolverThreadLease(SolverThreadLease &&other) noexcept
+            : scheduler(other.scheduler), problem_size(other.problem_size), threads(other.threads),
+              start_time(other.start_time) {
+        other.scheduler = nullptr;
+    }
+
+    SolverThreadLease::~SolverThreadLease() {
+        if (scheduler != nullptr) {
+            double busy_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+            scheduler->release(problem_size, threads, busy_time);
+        }
+    }
+
+    SolverThreadScheduler &SolverThreadScheduler::getInstance() {
+        static SolverThreadScheduler scheduler;
+        return scheduler;
+    }
+
+    SolverThreadScheduler::SolverThreadScheduler()
+            : n_waiting(0), n_running(0), waiting_size_sum(0), running_size_sum(0), busy_thread_time(0) {
+        total_threads = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+        available_threads = total_threads;
+        statistics_start_time = std::chrono::steady_clock::now();
+    }
+
+    void SolverThreadScheduler::setTotalThreads(int _total_threads) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (_total_threads <= 0) {
+            _total_threads = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+        }
+        available_threads += _total_threads - total_threads;
+        total_threads = _total_threads;
+        cv.notify_all();
+    }
+
+    SolverThreadLease SolverThreadScheduler::acquire(int agent_id, size_t problem_size) {
+        problem_size = std::max(problem_size, static_cast<size_t>(1));
+        auto wait_start_time = std::chrono::steady_clock::now();
+
+        std::unique_lock<std::mutex> lock(mtx);
+        n_waiting++;
+        waiting_size_sum += problem_size;
+        cv.wait(lock, [this] { return available_threads > 0; });
+        n_waiting--;
+        waiting_size_sum -= problem_size;
+
+        // Fair share of the agents planning now, weighted by the problem size
+        int n_active = n_waiting + n_running + 1;
+        double mean_size = static_cast<double>(waiting_size_sum + running_size_sum + problem_size) / n_active;
+        double share = static_cast<double>(total_threads) / n_active * problem_size / mean_size;
+        int threads = std::min(std::max(static_cast<int>(std::round(share)), 1), available_threads);
+
+        available_threads -= threads;
+        n_running++;
+        running_size_sum += problem_size;
+
+        double wait_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - wait_start_time).count();
+        SolverThreadStatistics &agent_statistics = statistics[agent_id];
+        agent_statistics.n_request++;
+        agent_statistics.total_wait_time += wait_time;
+        agent_statistics.max_wait_time = std::max(agent_statistics.max_wait_time, wait_time);
+        agent_statistics.total_threads += threads;
+
+        return {this, problem_size, threads};
+    }
+
+    void SolverThreadScheduler::release(size_t problem_size, int threads, double busy_time) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            available_threads += threads;
+            n_running--;
+            running_size_sum -= problem_size;
+            busy_thread_time += threads * busy_time;
+        }
+        cv.notify_all();
+    }
+
+    int SolverThreadScheduler::getTotalThreads() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return total_threads;
+    }
+
+    SolverThreadStatistics SolverThreadScheduler::getStatistics(int agent_id) const {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = statistics.find(agent_id);
+        if (it == statistics.end()) {
+            return {};
+        }
+        return it->second;
+    }
+
+    SolverThreadStatistics SolverThreadScheduler::getTotalStatistics() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        SolverThreadStatistics total;
+        for (const auto &item: statistics) {
+            total.n_request += item.second.n_request;
+            total.total_wait_time += item.second.total_wait_time;
+            total.max_wait_time = std::max(total.max_wait_time, item.second.max_wait_time);
+            total.total_threads += item.second.total_threads;
+        }
+        return total;
+    }
+
+    double SolverThreadScheduler::getUtilization() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                       statistics_start_time).count();
+        if (elapsed <= 0) {
+            return 0;
+        }
+        return busy_thread_time / (total_threads * elapsed);
+    }
+
+    void SolverThreadScheduler::resetStatistics() {
+        std::lock_guard<std::mutex> lock(mtx);
+        statistics.clear();
+        busy_thread_time = 0;
+        statistics_start_time = std::chrono::steady_clock::now();
+    }
+}
@@ -0,0 +1,479 @@
+#include <sparse_voxel_map.hpp>
+#include <distance_transform.hpp>
+#include <dynamicEDT3D/dynamicEDTOctomap.h>
+#include <worker_pool.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace DynamicPlanning {
+    static constexpr double VOXEL_EPSILON = 1e-6; // tolerance of the voxel index conversion [voxel]
+    static constexpr int INFINITE_SQ_DIST = DistanceTransformLine::INFINITE_SQ_DIST;
+    static constexpr int BLOCK_MASK = SparseVoxelMap::BLOCK_SIZE - 1;
+
+    // Buffers of the distance transform of a block, one set per thread of the worker pool
+    struct BlockTransformBuffers {
+        std::vector<int> box_sq_dists, box_features;
+        DistanceTransformLine line;
+        std::vector<int> line_features;
+    };
+
+    const SparseVoxelMap::Block *SparseVoxelMap::Accessor::getBlock(const Index &key) {
+        uint64_t block_key = blockKey(key);
+        if (block_key != cached_block_key) {
+            cached_block_key = block_key;
+            cached_block = map.findBlock(block_key);
+        }
+        return cached_block;
+    }
+
+    bool SparseVoxelMap::Accessor::isOccupied(const Index &key) {
+        const Block *block = getBlock(key);
+        return block != nullptr and block->occupancy[voxelIndex(key)];
+    }
+
+    SparseVoxelMap::SparseVoxelMap(const octomap::OcTree &octree, const octomap::point3d &world_min,
+                                   const octomap::point3d &world_max, double max_dist)
+            : resolution(octree.getResolution()) {
+        if (max_dist <= 0) {
+            throw std::invalid_argument("[SparseVoxelMap] Maximum distance must be positive");
+        }
+
+        octomap::OcTreeKey zero_key = octree.coordToKey(octomap::point3d(0, 0, 0));
+        for (int k = 0; k < 3; k++) {
+            origin_key[k] = zero_key[k];
+            world_min_key[k] = origin_key[k] + static_cast<int>(std::floor(world_min(k) / resolution + VOXEL_EPSILON));
+            world_max_key[k] = std::max(origin_key[k] +
+                                        static_cast<int>(std::ceil(world_max(k) / resolution - VOXEL_EPSILON)) - 1,
+                                        world_min_key[k]);
+        }
+
+        // Same truncation as DynamicEDTOctomap
+        max_sq_dist = static_cast<int>(max_dist / resolution * max_dist / resolution);
+        max_dist_voxels = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(max_sq_dist))));
+        block_radius = (max_dist_voxels + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    }
+
+    void SparseVoxelMap::setOccupied(const octomap::OcTreeKey &key, bool occupied) {
+        Index index = {key[0], key[1], key[2]};
+        if (not isInWorld(index)) {
+            return;
+        }
+
+        uint64_t block_key = blockKey(index);
+        const Block *found = findBlock(block_key);
+        if (found == nullptr and not occupied) {
+            return;
+        }
+
+        Block &block = getOrCreateBlock(block_key);
+        uint8_t &cell = block.occupancy[voxelIndex(index)];
+        if (static_cast<bool>(cell) == occupied) {
+            return;
+        }
+        cell = occupied;
+        block.n_occupied += occupied ? 1 : -1;
+        markDirty(block_key);
+    }
+
+    void SparseVoxelMap::insertOccupied(const std::vector<octomap::OcTreeKey> &keys) {
+        // (block key, voxel index) of the voxels in the world, sorted to group the voxels of a block
+        std::vector<std::pair<uint64_t, int>> voxels;
+        voxels.reserve(keys.size());
+        for (const auto &key: keys) {
+            Index index = {key[0], key[1], key[2]};
+            if (isInWorld(index)) {
+                voxels.emplace_back(blockKey(index), voxelIndex(index));
+            }
+        }
+        std::sort(voxels.begin(), voxels.end());
+
+        // The blocks are allocated serially, then each task fills the voxels of one block
+        std::vector<std::pair<size_t, int>> groups; // (the first voxel, block id)
+        for (size_t i = 0; i < voxels.size(); i++) {
+            if (i > 0 and voxels[i].first == voxels[i - 1].first) {
+                continue;
+            }
+            getOrCreateBlock(voxels[i].first);
+            groups.emplace_back(i, block_ids.at(voxels[i].first));
+        }
+
+        std::vector<uint8_t> is_changed(groups.size(), 0);
+        WorkerPool::getInstance().run(groups.size(), [&](size_t group_idx) {
+            size_t end = group_idx + 1 < groups.size() ? groups[group_idx + 1].first : voxels.size();
+            Block &block = blocks[groups[group_idx].second];
+            for (size_t i = groups[group_idx].first; i < end; i++) {
+                uint8_t &cell = block.occupancy[voxels[i].second];
+                if (not cell) {
+                    cell = 1;
+                    block.n_occupied++;
+                    is_changed[group_idx] = 1;
+                }
+            }
+        });
+        for (size_t group_idx = 0; group_idx < groups.size(); group_idx++) {
+            if (is_changed[group_idx]) {
+                markDirty(voxels[groups[group_idx].first].first);
+            }
+        }
+    }
+
+    void SparseVoxelMap::update() {
+        if (dirty_block_keys.empty()) {
+            return;
+        }
+
+        // The blocks within max_dist of a changed block may change their distances
+        std::vector<uint64_t> affected_block_keys;
+        for (uint64_t dirty_block_key: dirty_block_keys) {
+            Index dirty_origin = blockOrigin(dirty_block_key);
+            Index origin{};
+            for (int i = -block_radius; i <= block_radius; i++) {
+                origin[0] = dirty_origin[0] + i * BLOCK_SIZE;
+                for (int j = -block_radius; j <= block_radius; j++) {
+                    origin[1] = dirty_origin[1] + j * BLOCK_SIZE;
+                    for (int l = -block_radius; l <= block_radius; l++) {
+                        origin[2] = dirty_origin[2] + l * BLOCK_SIZE;
+                        bool is_in_world = true;
+                        for (int k = 0; k < 3; k++) {
+                            is_in_world = is_in_world and origin[k] + BLOCK_MASK >= world_min_key[k] and
+                                          origin[k] <= world_max_key[k];
+                        }
+                        if (is_in_world) {
+                            affected_block_keys.emplace_back(blockKey(origin));
+                        }
+                    }
+                }
+            }
+        }
+        dirty_block_keys.clear();
+        std::sort(affected_block_keys.begin(), affected_block_keys.end());
+        affected_block_keys.erase(std::unique(affected_block_keys.begin(), affected_block_keys.end()),
+                                  affected_block_keys.end());
+
+        // A missing block is allocated if an obstacle is near, all allocations are done before the parallel part
+        std::vector<int> affected_block_ids;
+        affected_block_ids.reserve(affected_block_keys.size());
+        for (uint64_t block_key: affected_block_keys) {
+            bool is_needed = findBlock(block_key) != nullptr;
+            Index block_origin = blockOrigin(block_key);
+            for (int i = -block_radius; i <= block_radius and not is_needed; i++) {
+                for (int j = -block_radius; j <= block_radius and not is_needed; j++) {
+                    for (int l = -block_radius; l <= block_radius and not is_needed; l++) {
+                        const Block *block = findBlock(blockKey({block_origin[0] + i * BLOCK_SIZE,
+                                                                 block_origin[1] + j * BLOCK_SIZE,
+                                                                 block_origin[2] + l * BLOCK_SIZE}));
+                        is_needed = block != nullptr and block->n_occupied > 0;
+                    }
+                }
+            }
+            if (is_needed) {
+                getOrCreateBlock(block_key);
+                affected_block_ids.emplace_back(block_ids.at(block_key));
+            }
+        }
+
+        // A block writes its own distances and reads the occupancy of the others only
+        WorkerPool::getInstance().run(affected_block_ids.size(), [&](size_t i) {
+            recomputeBlock(blocks[affected_block_ids[i]]);
+        });
+
+        // The blocks without an obstacle within max_dist are released
+        for (int block_id: affected_block_ids) {
+            const Block &block = blocks[block_id];
+            if (block.n_occupied > 0 or std::any_of(block.sq_dists.begin(), block.sq_dists.end(),
+                                                    [](int sq_dist) { return sq_dist != INFINITE_SQ_DIST; })) {
+                continue;
+            }
+            block_ids.erase(blockKey(block.origin));
+            free_block_ids.emplace_back(block_id);
+        }
+    }
+
+    void SparseVoxelMap::query(DistmapQueryBatch &batch) const {
+        size_t n = batch.size();
+        batch.distance.resize(n);
+        batch.obstacle_x.resize(n);
+        batch.obstacle_y.resize(n);
+        batch.obstacle_z.resize(n);
+        batch.obstacle_l_inf_distance.resize(n);
+        batch.idx_x.resize(n);
+        batch.idx_y.resize(n);
+        batch.idx_z.resize(n);
+        if (n == 0) {
+            return;
+        }
+
+        const double inv_resolution = 1.0 / resolution;
+        const float *x = batch.x.data(), *y = batch.y.data(), *z = batch.z.data();
+        int *idx_x = batch.idx_x.data(), *idx_y = batch.idx_y.data(), *idx_z = batch.idx_z.data();
+        for (size_t i = 0; i < n; i++) {
+            idx_x[i] = static_cast<int>(std::floor(x[i] * inv_resolution)) + origin_key[0];
+            idx_y[i] = static_cast<int>(std::floor(y[i] * inv_resolution)) + origin_key[1];
+            idx_z[i] = static_cast<int>(std::floor(z[i] * inv_resolution)) + origin_key[2];
+        }
+
+        // The points of a batch are usually close to each other, so the accessor skips most of the lookups
+        Accessor accessor(*this);
+        const auto res = static_cast<float>(resolution);
+        const float max_distance = std::sqrt(static_cast<float>(max_sq_dist)) * res;
+        const float infinity = std::numeric_limits<float>::infinity();
+        float *distance = batch.distance.data();
+        float *obstacle_x = batch.obstacle_x.data(), *obstacle_y = batch.obstacle_y.data();
+        float *obstacle_z = batch.obstacle_z.data();
+        for (size_t i = 0; i < n; i++) {
+            Index key = {idx_x[i], idx_y[i], idx_z[i]};
+            if (not isInWorld(key)) {
+                distance[i] = DynamicEDTOctomap::distanceValue_Error;
+                obstacle_x[i] = obstacle_y[i] = obstacle_z[i] = infinity;
+                continue;
+            }
+
+            const Block *block = accessor.getBlock(key);
+            int voxel = voxelIndex(key);
+            if (block == nullptr or block->sq_dists[voxel] == INFINITE_SQ_DIST) {
+                distance[i] = max_distance;
+                obstacle_x[i] = obstacle_y[i] = obstacle_z[i] = infinity;
+            } else {
+                distance[i] = std::sqrt(static_cast<float>(block->sq_dists[voxel])) * res;
+                const Index &closest_key = block->closest_keys[voxel];
+                obstacle_x[i] = (static_cast<float>(closest_key[0] - origin_key[0]) + 0.5f) * res;
+                obstacle_y[i] = (static_cast<float>(closest_key[1] - origin_key[1]) + 0.5f) * res;
+                obstacle_z[i] = (static_cast<float>(closest_key[2] - origin_key[2]) + 0.5f) * res;
+            }
+        }
+
+        const float half_resolution = 0.5f * res;
+        float *l_inf = batch.obstacle_l_inf_distance.data();
+        for (size_t i = 0; i < n; i++) {
+            float dx = std::max(std::abs(x[i] - obstacle_x[i]) - half_resolution, 0.0f);
+            float dy = std::max(std::abs(y[i] - obstacle_y[i]) - half_resolution, 0.0f);
+            float dz = std::max(std::abs(z[i] - obstacle_z[i]) - half_resolution, 0.0f);
+            l_inf[i] = std::max(std::max(dx, dy), dz);
+        }
+    }
+
+    bool SparseVoxelMap::isOccupied(const octomap::point3d &point) const {
+        Index key = toIndex(point);
+        if (not isInWorld(key)) {
+            return false;
+        }
+        const Block *block = findBlock(blockKey(key));
+        return block != nullptr and block->occupancy[voxelIndex(key)];
+    }
+
+    uint32_t SparseVoxelMap::countOccupied(const octomap::point3d &box_min, const octomap::point3d &box_max) const {
+        Index range_min{}, range_max{};
+        if (not voxelRange(box_min, box_max, range_min, range_max)) {
+            return 0;
+        }
+
+        // The blocks inside the range are counted at once, the others voxel by voxel
+        uint32_t count = 0;
+        Index origin{};
+        for (origin[0] = range_min[0] & ~BLOCK_MASK; origin[0] <= range_max[0]; origin[0] += BLOCK_SIZE) {
+            for (origin[1] = range_min[1] & ~BLOCK_MASK; origin[1] <= range_max[1]; origin[1] += BLOCK_SIZE) {
+                for (origin[2] = range_min[2] & ~BLOCK_MASK; origin[2] <= range_max[2]; origin[2] += BLOCK_SIZE) {
+                    const Block *block = findBlock(blockKey(origin));
+                    if (block == nullptr or block->n_occupied == 0) {
+                        continue;
+                    }
+
+                    Index start{}, end{};
+                    bool is_inside = true;
+                    for (int k = 0; k < 3; k++) {
+                        start[k] = std::max(range_min[k], origin[k]);
+                        end[k] = std::min(range_max[k], origin[k] + BLOCK_MASK);
+                        is_inside = is_inside and start[k] == origin[k] and end[k] == origin[k] + BLOCK_MASK;
+                    }
+                    if (is_inside) {
+                        count += block->n_occupied;
+                        continue;
+                    }
+
+                    Index key{};
+                    for (key[0] = start[0]; key[0] <= end[0]; key[0]++) {
+                        for (key[1] = start[1]; key[1] <= end[1]; key[1]++) {
+                            for (key[2] = start[2]; key[2] <= end[2]; key[2]++) {
+                                count += block->occupancy[voxelIndex(key)];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        return count;
+    }
+
+    bool SparseVoxelMap::isOccupied(const octomap::point3d &box_min, const octomap::point3d &box_max,
+                                    double margin) const {
+        auto margin_f = static_cast<float>(margin);
+        octomap::point3d margin_vector(margin_f, margin_f, margin_f);
+        return countOccupied(box_min - margin_vector, box_max + margin_vector) > 0;
+    }
+
+    uint64_t SparseVoxelMap::blockKey(const Index &key) {
+        // The octree keys are 16 bits, so the block indices fit in 16 bits each
+        return (static_cast<uint64_t>(key[0] >> BLOCK_BITS) << 32) |
+               (static_cast<uint64_t>(key[1] >> BLOCK_BITS) << 16) |
+               static_cast<uint64_t>(key[2] >> BLOCK_BITS);
+    }
+
+    SparseVoxelMap::Index SparseVoxelMap::blockOrigin(uint64_t block_key) {
+        return {static_cast<int>((block_key >> 32) & 0xFFFF) << BLOCK_BITS,
+                static_cast<int>((block_key >> 16) & 0xFFFF) << BLOCK_BITS,
+                static_cast<int>(block_key & 0xFFFF) << BLOCK_BITS};
+    }
+
+    int SparseVoxelMap::voxelIndex(const Index &key) {
+        return (((key[0] & BLOCK_MASK) << BLOCK_BITS) + (key[1] & BLOCK_MASK)) * BLOCK_SIZE + (key[2] & BLOCK_MASK);
+    }
+
+    bool SparseVoxelMap::isInWorld(const Index &key) const {
+        for (int k = 0; k < 3; k++) {
+            if (key[k] < world_min_key[k] or key[k] > world_max_key[k]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    SparseVoxelMap::Index SparseVoxelMap::toIndex(const octomap::point3d &point) const {
+        return {static_cast<int>(std::floor(point.x() / resolution)) + origin_key[0],
+                static_cast<int>(std::floor(point.y() / resolution)) + origin_key[1],
+                static_cast<int>(std::floor(point.z() / resolution)) + origin_key[2]};
+    }
+
+    const SparseVoxelMap::Block *SparseVoxelMap::findBlock(uint64_t block_key) const {
+        auto it = block_ids.find(block_key);
+        return it == block_ids.end() ? nullptr : &blocks[it->second];
+    }
+
+    SparseVoxelMap::Block &SparseVoxelMap::getOrCreateBlock(uint64_t block_key) {
+        auto it = block_ids.find(block_key);
+        if (it != block_ids.end()) {
+            return blocks[it->second];
+        }
+
+        int block_id;
+        if (free_block_ids.empty()) {
+            block_id = static_cast<int>(blocks.size());
+            blocks.emplace_back();
+        } else {
+            block_id = free_block_ids.back();
+            free_block_ids.pop_back();
+        }
+        Block &block = blocks[block_id];
+        block.origin = blockOrigin(block_key);
+        block.n_occupied = 0;
+        block.occupancy.fill(0);
+        block.sq_dists.fill(INFINITE_SQ_DIST);
+        block_ids.emplace(block_key, block_id);
+        return block;
+    }
+
+    void SparseVoxelMap::markDirty(uint64_t block_key) {
+        // The duplicates are removed by update
+        dirty_block_keys.emplace_back(block_key);
+    }
+
+    void SparseVoxelMap::recomputeBlock(Block &block) const {
+        static thread_local BlockTransformBuffers buffers;
+
+        // A voxel of the block depends on the obstacles within max_dist, so the transform runs on the inflated box
+        Index box_min{}, dims{};
+        size_t n_box_cells = 1;
+        int max_dim = 0;
+        for (int k = 0; k < 3; k++) {
+            box_min[k] = std::max(block.origin[k] - max_dist_voxels, world_min_key[k]);
+            dims[k] = std::min(block.origin[k] + BLOCK_MASK + max_dist_voxels, world_max_key[k]) - box_min[k] + 1;
+            n_box_cells *= dims[k];
+            max_dim = std::max(max_dim, dims[k]);
+        }
+        auto boxIndex = [&](int i, int j, int l) {
+            return (static_cast<size_t>(i) * dims[1] + j) * dims[2] + l;
+        };
+
+        buffers.box_sq_dists.resize(n_box_cells);
+        buffers.box_features.resize(n_box_cells);
+        buffers.line.resize(max_dim);
+        buffers.line_features.resize(max_dim);
+
+        Accessor accessor(*this);
+        for (int i = 0; i < dims[0]; i++) {
+            for (int j = 0; j < dims[1]; j++) {
+                for (int l = 0; l < dims[2]; l++) {
+                    size_t b = boxIndex(i, j, l);
+                    bool occupied = accessor.isOccupied({box_min[0] + i, box_min[1] + j, box_min[2] + l});
+                    buffers.box_sq_dists[b] = occupied ? 0 : INFINITE_SQ_DIST;
+                    buffers.box_features[b] = occupied ? static_cast<int>(b) : -1;
+                }
+            }
+        }
+
+        // One pass of the 1D transform per axis, the feature is the box index of the closest obstacle
+        for (int axis = 2; axis >= 0; axis--) {
+            int axis_a = (axis + 1) % 3, axis_b = (axis + 2) % 3;
+            Index index{};
+            for (index[axis_a] = 0; index[axis_a] < dims[axis_a]; index[axis_a]++) {
+                for (index[axis_b] = 0; index[axis_b] < dims[axis_b]; index[axis_b]++) {
+                    for (index[axis] = 0; index[axis] < dims[axis]; index[axis]++) {
+                        size_t b = boxIndex(index[0], index[1], index[2]);
+                        buffers.line.f[index[axis]] = buffers.box_sq_dists[b];
+                        buffers.line_features[index[axis]] = buffers.box_features[b];
+                    }
+                    buffers.line.transform(dims[axis]);
+                    for (index[axis] = 0; index[axis] < dims[axis]; index[axis]++) {
+                        size_t b = boxIndex(index[0], index[1], index[2]);
+                        int arg = buffers.line.args[index[axis]];
+                        buffers.box_sq_dists[b] = arg < 0 ? INFINITE_SQ_DIST : buffers.line.sq_dists[index[axis]];
+                        buffers.box_features[b] = arg < 0 ? -1 : buffers.line_features[arg];
+                    }
+                }
+            }
+        }
+
+        Index key{};
+        for (key[0] = block.origin[0]; key[0] <= block.origin[0] + BLOCK_MASK; key[0]++) {
+            for (key[1] = block.origin[1]; key[1] <= block.origin[1] + BLOCK_MASK; key[1]++) {
+                for (key[2] = block.origin[2]; key[2] <= block.origin[2] + BLOCK_MASK; key[2]++) {
+                    int voxel = voxelIndex(key);
+                    if (not isInWorld(key)) {
+                        block.sq_dists[voxel] = INFINITE_SQ_DIST;
+                        continue;
+                    }
+
+                    size_t b = boxIndex(key[0] - box_min[0], key[1] - box_min[1], key[2] - box_min[2]);
+                    if (buffers.box_sq_dists[b] > max_sq_dist) {
+                        block.sq_dists[voxel] = INFINITE_SQ_DIST;
+                        continue;
+                    }
+
+                    auto feature = static_cast<size_t>(buffers.box_features[b]);
+                    block.sq_dists[voxel] = buffers.box_sq_dists[b];
+                    block.closest_keys[voxel] = {box_min[0] + static_cast<int>(feature / (dims[1] * dims[2])),
+                                                 box_min[1] + static_cast<int>((feature / dims[2]) % dims[1]),
+                                                 box_min[2] + static_cast<int>(feature % dims[2])};
+                }
+            }
+        }
+    }
+
+    bool SparseVoxelMap::voxelRange(const octomap::point3d &box_min, const octomap::point3d &box_max,
+                                    Index &range_min, Index &range_max) const {
+        // The center of the voxel of key i is (i - origin_key + 0.5) * resolution
+        for (int k = 0; k < 3; k++) {
+            range_min[k] = std::max(origin_key[k] + static_cast<int>(std::ceil(box_min(k) / resolution - 0.5 -
+                                                                              VOXEL_EPSILON)),
+                                    world_min_key[k]);
+            range_max[k] = std::min(origin_key[k] + static_cast<int>(std::floor(box_max(k) / resolution - 0.5 +
+                                                                               VOXEL_EPSILON)),
+                                    world_max_key[k]);
+            if (range_min[k] > range_max[k]) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
@@ -0,0 +1,77 @@
+#include <summary_log.hpp>
+#include <cerrno>
+#include <cstring>
+#include <ros/ros.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace DynamicPlanning {
+    namespace SummaryLog {
+        static bool writeAll(int fd, const std::string &data) {
+            size_t offset = 0;
+            while (offset < data.size()) {
+                ssize_t written = ::write(fd, data.data() + offset, data.size() - offset);
+                if (written < 0 and errno == EINTR) {
+                    continue;
+                }
+                if (written <= 0) {
+                    return false;
+                }
+                offset += static_cast<size_t>(written);
+            }
+            return true;
+        }
+
+        static bool lockFile(int fd, short type) {
+            struct flock lock{};
+            lock.l_type = type;
+            lock.l_whence = SEEK_SET;
+            lock.l_start = 0;
+            lock.l_len = 0; // the whole file
+            while (fcntl(fd, F_SETLKW, &lock) != 0) {
+                if (errno != EINTR) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool append(const std::string &file_name, const std::string &header, const std::string &row) {
+            int fd = ::open(file_name.c_str(), O_RDWR | O_APPEND | O_CREAT, 0644);
+            if (fd < 0) {
+                ROS_ERROR_STREAM("[SummaryLog] Failed to open " << file_name << ": " << std::strerror(errno));
+                return false;
+            }
+            if (not lockFile(fd, F_WRLCK)) {
+                ROS_ERROR_STREAM("[SummaryLog] Failed to lock " << file_name << ": " << std::strerror(errno));
+                ::close(fd);
+                return false;
+            }
+
+            struct stat file_stat{};
+            bool is_empty = fstat(fd, &file_stat) == 0 and file_stat.st_size == 0;
+            std::string data;
+            data.reserve(header.size() + row.size() + 2);
+            if (is_empty) {
+                data.append(header).append("\n");
+            } else {
+                std::string file_header(header.size() + 1, '\0');
+                ssize_t n_read = pread(fd, &file_header[0], file_header.size(), 0);
+                if (n_read != static_cast<ssize_t>(file_header.size()) or
+                    file_header.compare(0, header.size(), header) != 0 or file_header.back() != '\n') {
+                    ROS_WARN_STREAM("[SummaryLog] The columns differ from the header of " << file_name);
+                }
+            }
+            data.append(row).append("\n");
+            bool success = writeAll(fd, data);
+            if (not success) {
+                ROS_ERROR_STREAM("[SummaryLog] Failed to write " << file_name << ": " << std::strerror(errno));
+            }
+
+            lockFile(fd, F_UNLCK);
+            ::close(fd);
+            return success;
+        }
+    }
+}
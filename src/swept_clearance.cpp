@@ -0,0 +1,137 @@
+#include <swept_clearance.hpp>
+#include <algorithm>
+
+namespace DynamicPlanning {
+    SweptClearance::SweptClearance(const DistanceMap &_distmap, int _max_depth)
+            : distmap(_distmap), max_depth(_max_depth) {}
+
+    double SweptClearance::computeClearance(const Segment<point3d> &segment, double radius, double tolerance) const {
+        // The start points of the pieces are on the segment, so their distances bound the minimum from above.
+        // A piece is not split if its lower bound is within tolerance of the upper bound.
+        double upper = SP_INFINITY;
+        double lower = SP_INFINITY;
+        std::vector<Piece> pieces = {makePiece(segment, 0, 1, 0)}, next_pieces;
+        DistmapQueryBatch batch;
+        std::vector<double> center_distances, start_distances;
+        while (not pieces.empty()) {
+            queryPieces(pieces, batch, center_distances, start_distances);
+            for (double start_distance: start_distances) {
+                upper = std::min(upper, start_distance);
+            }
+
+            next_pieces.clear();
+            for (size_t i = 0; i < pieces.size(); i++) {
+                double bound = center_distances[i] - pieces[i].bound_radius;
+                if (bound > upper - tolerance or pieces[i].depth >= max_depth) {
+                    lower = std::min(lower, bound);
+                } else {
+                    splitPiece(pieces[i], next_pieces);
+                }
+            }
+            std::swap(pieces, next_pieces);
+        }
+
+        return lower - radius;
+    }
+
+    bool SweptClearance::isSegmentFree(const Segment<point3d> &segment, double radius) const {
+        std::vector<Piece> pieces = {makePiece(segment, 0, 1, 0)}, next_pieces;
+        DistmapQueryBatch batch;
+        std::vector<double> center_distances, start_distances;
+        while (not pieces.empty()) {
+            queryPieces(pieces, batch, center_distances, start_distances);
+            next_pieces.clear();
+            for (size_t i = 0; i < pieces.size(); i++) {
+                if (center_distances[i] - pieces[i].bound_radius >= radius) {
+                    continue;
+                }
+                if (start_distances[i] < radius or pieces[i].depth >= max_depth) {
+                    return false;
+                }
+                splitPiece(pieces[i], next_pieces);
+            }
+            std::swap(pieces, next_pieces);
+        }
+
+        // All pieces are proven free, the last point is in the ball of the last piece
+        return true;
+    }
+
+    double SweptClearance::computeCollisionTime(const Segment<point3d> &segment, double radius,
+                                                double time_resolution) const {
+        // Depth-first in the order of time, so the first piece which is not proven free is the earliest one
+        std::vector<Piece> stack = {makePiece(segment, 0, 1, 0)}, halves;
+        DistmapQueryBatch batch;
+        while (not stack.empty()) {
+            Piece piece = stack.back();
+            stack.pop_back();
+
+            batch.clear();
+            batch.push(piece.center);
+            distmap.query(batch);
+            if (batch.distance[0] - piece.bound_radius >= radius) {
+                continue;
+            }
+            if ((piece.t1 - piece.t0) * segment.segment_time <= time_resolution or piece.depth >= max_depth) {
+                return piece.t0 * segment.segment_time;
+            }
+
+            halves.clear();
+            splitPiece(piece, halves);
+            stack.emplace_back(halves[1]);
+            stack.emplace_back(halves[0]);
+        }
+
+        return SP_INFINITY;
+    }
+
+    SweptClearance::Piece SweptClearance::makePiece(const Segment<point3d> &segment, double t0, double t1,
+                                                    int depth) {
+        Piece piece;
+        piece.segment = segment;
+        piece.t0 = t0;
+        piece.t1 = t1;
+        piece.depth = depth;
+        // The center of the bounding box of the control points, the ball covers their convex hull
+        point3d box_min = segment.control_points[0];
+        point3d box_max = segment.control_points[0];
+        for (const auto &control_point: segment.control_points) {
+            for (int k = 0; k < 3; k++) {
+                box_min(k) = std::min(box_min(k), control_point(k));
+                box_max(k) = std::max(box_max(k), control_point(k));
+            }
+        }
+        piece.center = (box_min + box_max) * 0.5;
+        piece.bound_radius = 0;
+        for (const auto &control_point: segment.control_points) {
+            piece.bound_radius = std::max(piece.bound_radius,
+                                          static_cast<double>(control_point.distance(piece.center)));
+        }
+        return piece;
+    }
+
+    void SweptClearance::splitPiece(const Piece &piece, std::vector<Piece> &pieces) {
+        double t_mid = 0.5 * (piece.t0 + piece.t1);
+        pieces.emplace_back(makePiece(piece.segment.subSegment(0, 0.5), piece.t0, t_mid, piece.depth + 1));
+        pieces.emplace_back(makePiece(piece.segment.subSegment(0.5, 1), t_mid, piece.t1, piece.depth + 1));
+    }
+
+    void SweptClearance::queryPieces(const std::vector<Piece> &pieces, DistmapQueryBatch &batch,
+                                     std::vector<double> &center_distances,
+                                     std::vector<double> &start_distances) const {
+        batch.clear();
+        batch.reserve(2 * pieces.size());
+        for (const auto &piece: pieces) {
+            batch.push(piece.center);
+            batch.push(piece.segment.startPoint());
+        }
+        distmap.query(batch);
+
+        center_distances.resize(pieces.size());
+        start_distances.resize(pieces.size());
+        for (size_t i = 0; i < pieces.size(); i++) {
+            center_distances[i] = batch.distance[2 * i];
+            start_distances[i] = batch.distance[2 * i + 1];
+        }
+    }
+}
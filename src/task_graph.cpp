@@ -0,0 +1,51 @@
+#include <task_graph.hpp>
+#include <atomic>
+#include <stdexcept>
+#include <trace.hpp>
+
+namespace DynamicPlanning {
+    int TaskGraph::addTask(const char *name, std::function<void()> task, const std::vector<int> &dependencies) {
+        int id = static_cast<int>(nodes.size());
+        for (int dependency: dependencies) {
+            if (dependency < 0 or dependency >= id) {
+                throw std::invalid_argument("[TaskGraph] The dependency must be added before the task");
+            }
+        }
+        nodes.push_back({name, std::move(task), dependencies});
+        return id;
+    }
+
+    void TaskGraph::run(WorkerPool &pool, TaskPriority priority) const {
+        // The number of the unfinished dependencies, a task is queued by the last one of them
+        std::vector<std::vector<int>> dependents(nodes.size());
+        std::unique_ptr<std::atomic<size_t>[]> n_waiting = std::make_unique<std::atomic<size_t>[]>(nodes.size());
+        for (size_t id = 0; id < nodes.size(); id++) {
+            n_waiting[id] = nodes[id].dependencies.size();
+            for (int dependency: nodes[id].dependencies) {
+                dependents[dependency].emplace_back(static_cast<int>(id));
+            }
+        }
+
+        TaskGroup group(pool, priority);
+        std::function<void(int)> queue_task = [&](int id) {
+            group.run([&, id] {
+                const Node &node = nodes[id];
+                {
+                    TRACE_SCOPE(node.name);
+                    node.task();
+                }
+                for (int dependent: dependents[id]) {
+                    if (n_waiting[dependent].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                        queue_task(dependent);
+                    }
+                }
+            });
+        };
+        for (size_t id = 0; id < nodes.size(); id++) {
+            if (nodes[id].dependencies.empty()) {
+                queue_task(static_cast<int>(id));
+            }
+        }
+        group.wait();
+    }
+}
@@ -0,0 +1,142 @@
+#include <trace.hpp>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <set>
+
+namespace DynamicPlanning {
+    namespace {
+        thread_local int current_track = Tracer::THREAD_TRACK;
+        thread_local std::shared_ptr<void> thread_buffer; // Tracer::ThreadBuffer, kept alive by the tracer as well
+    }
+
+    Tracer &Tracer::getInstance() {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    void Tracer::enable(size_t capacity_per_thread) {
+        std::lock_guard<std::mutex> lock(buffers_mtx);
+        is_enabled = false;
+        buffers.clear();
+        capacity = std::max(capacity_per_thread, size_t(1));
+        origin_ns = now();
+        generation++;
+        is_enabled = true;
+    }
+
+    void Tracer::disable() {
+        is_enabled = false;
+    }
+
+    void Tracer::record(const char *name, int64_t start_ns, int64_t end_ns, int64_t cpu_duration_ns,
+                        const AllocCounts &alloc_counts) {
+        if (not is_enabled) {
+            return;
+        }
+
+        ThreadBuffer &buffer = getThreadBuffer();
+        std::lock_guard<std::mutex> lock(buffer.mtx);
+        buffer.events[buffer.next] = {name, start_ns, end_ns - start_ns, cpu_duration_ns, current_track,
+                                       alloc_counts};
+        buffer.next++;
+        if (buffer.next == buffer.events.size()) {
+            buffer.next = 0;
+            buffer.is_full = true;
+        }
+    }
+
+    bool Tracer::save(const std::string &file_name) const {
+        std::ofstream trace_file(file_name);
+        if (not trace_file) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(buffers_mtx);
+        std::set<int> agent_tracks;
+        bool is_first = true;
+        trace_file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        for (const auto &buffer: buffers) {
+            std::lock_guard<std::mutex> buffer_lock(buffer->mtx);
+            size_t n_events = buffer->is_full ? buffer->events.size() : buffer->next;
+            size_t begin = buffer->is_full ? buffer->next : 0;
+            for (size_t ei = 0; ei < n_events; ei++) {
+                const Event &event = buffer->events[(begin + ei) % buffer->events.size()];
+                if (event.start_ns < origin_ns) {
+                    continue;
+                }
+
+                // The agents are the threads of process 0, the threads without an agent are the ones of process 1
+                bool is_agent = event.track != THREAD_TRACK;
+                if (is_agent) {
+                    agent_tracks.emplace(event.track);
+                }
+                trace_file << (is_first ? "" : ",\n")
+                           << "{\"name\":\"" << event.name << "\",\"ph\":\"X\""
+                           << ",\"ts\":" << static_cast<double>(event.start_ns - origin_ns) * 1e-3
+                           << ",\"dur\":" << static_cast<double>(event.duration_ns) * 1e-3
+                           << ",\"tdur\":" << static_cast<double>(event.cpu_duration_ns) * 1e-3
+                           << ",\"pid\":" << (is_agent ? 0 : 1)
+                           << ",\"tid\":" << (is_agent ? event.track : buffer->thread_idx);
+                if (AllocStats::isCompiled()) {
+                    trace_file << ",\"args\":{\"allocations\":" << event.alloc_counts.n_allocations
+                               << ",\"bytes\":" << event.alloc_counts.bytes
+                               << ",\"peak_live_bytes\":" << event.alloc_counts.peak_live_bytes << "}";
+                }
+                trace_file << "}";
+                is_first = false;
+            }
+        }
+
+        // Names of the tracks
+        trace_file << (is_first ? "" : ",\n")
+                   << R"({"name":"process_name","ph":"M","pid":0,"args":{"name":"agents"}},)" << "\n"
+                   << R"({"name":"process_name","ph":"M","pid":1,"args":{"name":"threads"}})";
+        for (int track: agent_tracks) {
+            trace_file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << track
+                       << ",\"args\":{\"name\":\"agent " << track << "\"}}";
+        }
+        for (const auto &buffer: buffers) {
+            trace_file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->thread_idx
+                       << ",\"args\":{\"name\":\"thread " << buffer->thread_idx << "\"}}";
+        }
+        trace_file << "\n]}\n";
+        return static_cast<bool>(trace_file);
+    }
+
+    int64_t Tracer::now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    int64_t Tracer::threadCPUNow() {
+        timespec ts{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    int Tracer::getTrack() {
+        return current_track;
+    }
+
+    void Tracer::setTrack(int track) {
+        current_track = track;
+    }
+
+    Tracer::ThreadBuffer &Tracer::getThreadBuffer() {
+        auto *buffer = static_cast<ThreadBuffer *>(thread_buffer.get());
+        if (buffer != nullptr and buffer->generation == generation) {
+            return *buffer;
+        }
+
+        // The first record of the thread after enable(), the buffers of the previous recording are dropped
+        auto new_buffer = std::make_shared<ThreadBuffer>();
+        std::lock_guard<std::mutex> lock(buffers_mtx);
+        new_buffer->events.resize(capacity);
+        new_buffer->thread_idx = static_cast<int>(buffers.size());
+        new_buffer->generation = generation;
+        buffers.emplace_back(new_buffer);
+        thread_buffer = new_buffer;
+        return *new_buffer;
+    }
+}
@@ -1,8 +1,11 @@
 #include "traj_optimizer.hpp"
+#include <trace.hpp>
+#include <metrics_registry.hpp>
+#include <worker_pool.hpp>
 
 namespace DynamicPlanning {
-    TrajOptimizer::TrajOptimizer(const Param &_param, const Mission &_mission, const Eigen::MatrixXd &_B)
-            : param(_param), mission(_mission), B(_B) {
+    TrajOptimizer::TrajOptimizer(const Param &_param, const std::shared_ptr<const Mission> &_mission)
+            : param(_param), mission(_mission) {
         // Initialize trajectory param, offsets
         dim = param.world_dimension;
         M = param.M;
@@ -10,17 +13,69 @@ namespace DynamicPlanning {
         phi = param.phi;
         dt = param.dt;
 
-        // Build constraint matrices
-        buildQBase();
-        buildAeqBase();
+        // Cost and constraint matrices shared by all optimizers
+        loadAlgebra();
+
+        if (param.qp_solver_mode != QPSolverMode::CPLEX) {
+            qp_solver = createQPSolver(param.qp_solver_mode);
+        }
     }
 
     TrajOptResult TrajOptimizer::solve(const Agent& agent,
                                        const CollisionConstraints& constraints,
                                        const traj_t& initial_traj,
-                                       bool use_primal_algorithm) {
+                                       bool use_primal_algorithm,
+                                       bool use_warm_start,
+                                       double time_limit) {
+        TRACE_SCOPE("TrajOptimizer::solve");
+        // The problem was solved in the batch of the step, the entry serves only this solve
+        BatchEntry entry = std::move(batch_entry);
+        batch_entry = BatchEntry();
+        if (entry.is_solved) {
+            TrajOptResult result;
+            result.n_collision_rows = n_collision_rows;
+            result.n_pruned_rows = n_pruned_rows;
+            result.n_redundant_rows = n_redundant_rows;
+            const QPSolution &solution = entry.solution;
+            setSolution(entry.condenser != nullptr ? entry.condenser->expand(solution.x, entry.x_0) : solution.x,
+                        result);
+            result.total_qp_cost = solution.cost;
+            result.n_iteration = solution.n_iteration;
+            result.warm_started = entry.use_warm_start;
+            return result;
+        }
+
+        // Leave out LSCs that cannot be active for any reachable trajectory
+        pruneCollisionConstraints(agent, constraints);
+
+        if (param.opt_record_qp) {
+            recordQPProblem(agent, constraints);
+        }
+
+        // Solver threads are shared by all agents in the process
+        SolverThreadLease lease = SolverThreadScheduler::getInstance().acquire(agent.id,
+                                                                               getProblemSize(constraints));
+        if (param.opt_axis_decoupled_qp and not hasCoupledCollisionConstraints(constraints)) {
+            TrajOptResult result;
+            if (solveDecoupled(agent, constraints, initial_traj, use_warm_start, lease.getThreads(), time_limit,
+                               result)) {
+                return result;
+            }
+        }
+        if (qp_solver != nullptr) {
+            qp_solver->setThreads(lease.getThreads());
+            qp_solver->setTimeLimit(time_limit);
+            return solveWithQPSolver(agent, constraints, initial_traj, use_warm_start, time_limit);
+        }
+        if (param.opt_persistent_model) {
+            return solvePersistent(agent, constraints, initial_traj, use_primal_algorithm, use_warm_start,
+                                   lease.getThreads(), time_limit);
+        }
+
         TrajOptResult result;
-        result.desired_traj = Trajectory<point3d>(M, n, dt);
+        result.n_collision_rows = n_collision_rows;
+        result.n_pruned_rows = n_pruned_rows;
+        result.n_redundant_rows = n_redundant_rows;
 
         IloEnv env;
         IloCplex cplex(env);
@@ -29,8 +84,10 @@ namespace DynamicPlanning {
         IloRangeArray con(env);
 
         // Set CPLEX parameters
-        cplex.setParam(IloCplex::Param::Threads, 6);
-//        cplex.setParam(IloCplex::Param::TimeLimit, 0.1); // For time limit
+        cplex.setParam(IloCplex::Param::Threads, lease.getThreads());
+        if (time_limit > 0) {
+            cplex.setParam(IloCplex::Param::TimeLimit, time_limit);
+        }
 
         // Set CPLEX algorithm
         if(use_primal_algorithm){
@@ -39,11 +96,39 @@ namespace DynamicPlanning {
         }
 
         // Initialize QP model
-        populatebyrow(model, var, con, agent, constraints, initial_traj);
-        cplex.extract(model);
+        QPCondenser *condenser = nullptr;
+        Eigen::VectorXd x_0;
+        if (param.opt_sparse_assembly) {
+            QPProblem problem = buildQPProblem(agent, constraints);
+            if (param.opt_condensed_qp) {
+                if (use_warm_start) {
+                    problem.x_start = getStartValues(constraints, initial_traj, problem.getNumVariables());
+                }
+                condenser = &getQPCondenser(problem);
+                problem = condenser->condense(problem, x_0);
+            }
+            loadQPProblemToCplex(model, var, con, problem);
+            cplex.extract(model);
+            if (use_warm_start and condenser != nullptr) {
+                IloNumArray start_vals(env, var.getSize());
+                for (IloInt i = 0; i < var.getSize(); i++) {
+                    start_vals[i] = problem.x_start(i);
+                }
+                cplex.setStart(start_vals, 0, var, 0, 0, 0);
+                start_vals.end();
+            }
+        } else {
+            populatebyrow(model, var, con, agent, constraints, initial_traj);
+            cplex.extract(model);
+        }
+        if (use_warm_start) {
+            if (condenser == nullptr) {
+                setStart(cplex, var, constraints, initial_traj);
+            }
+            result.warm_started = true;
+        }
 
         std::string QPmodel_path = param.package_path + "/log/QPmodel_trajOpt.lp";
-        std::string conflict_path = param.package_path + "/log/conflict_trajOpt.lp";
         if (param.log_solver) {
             cplex.exportModel(QPmodel_path.c_str());
         } else {
@@ -52,186 +137,722 @@ namespace DynamicPlanning {
         }
 
         // Solve QP
-        int offset_seg = n + 1;
-        int offset_dim = M * (n + 1);
-        int offset_slack_cont = dim * M * (n + 1);
-        int offset_slack_col;
-        if (param.slack_mode == SlackMode::CONTINUITY) {
-            offset_slack_col = dim * M * (n + 1) + dim * 4;
-        } else {
-            offset_slack_col = offset_slack_cont;
-        }
-
         try {
             IloBool success = cplex.solve();
 
             // Desired trajectory
             IloNumArray vals(env);
             cplex.getValues(vals, var);
+            Eigen::VectorXd z = valuesToVector(vals);
+            setSolution(condenser != nullptr ? condenser->expand(z, x_0) : z, result);
+
+            // Total QP cost
+            result.total_qp_cost = cplex.getObjValue();
+            result.n_iteration = static_cast<int>(cplex.getNiterations() + cplex.getNbarrierIterations());
+            result.time_limit_reached = cplex.getCplexStatus() == IloCplex::AbortTimeLim;
+            env.end();
+        }
+        catch (IloException &e) {
+            // No incumbent at the time limit, the planner falls back without a QP failure
+            if (cplex.getCplexStatus() == IloCplex::AbortTimeLim) {
+                env.end();
+                throw PlanningReport::QPTIMEOUT;
+            }
+            std::ostringstream status;
+            status << cplex.getStatus() << ": " << e;
+            env.end();
+            reportQPFailure(agent, constraints, status.str());
+
+            //TODO: find better exception
+            throw PlanningReport::QPFAILED;
+        }
+        catch (...) {
+            env.end();
+            reportQPFailure(agent, constraints, "unknown exception");
+
+            //TODO: find better exception
+            throw PlanningReport::QPFAILED;
+        }
+
+        return result;
+    }
+
+    TrajOptResult TrajOptimizer::solveWithQPSolver(const Agent& agent, const CollisionConstraints& constraints,
+                                                   const traj_t& initial_traj, bool use_warm_start,
+                                                   double time_limit) {
+        TRACE_SCOPE("TrajOptimizer::solveWithQPSolver");
+        QPCondenser *condenser = nullptr;
+        Eigen::VectorXd x_0;
+        QPProblem problem = buildSolverProblem(agent, constraints, initial_traj, use_warm_start, condenser, x_0);
+        QPSolution solution;
+        if (not qp_solver->solve(problem, solution)) {
+            if (time_limit > 0 and solution.time_limit_reached) {
+                throw PlanningReport::QPTIMEOUT;
+            }
+            reportQPFailure(agent, constraints, qp_solver->getName() + " failed");
+            throw PlanningReport::QPFAILED;
+        }
+
+        TrajOptResult result;
+        result.n_collision_rows = n_collision_rows;
+        result.n_pruned_rows = n_pruned_rows;
+        result.n_redundant_rows = n_redundant_rows;
+        setSolution(condenser != nullptr ? condenser->expand(solution.x, x_0) : solution.x, result);
+        result.total_qp_cost = solution.cost;
+        result.n_iteration = solution.n_iteration;
+        result.warm_started = use_warm_start;
+        result.time_limit_reached = solution.time_limit_reached;
+        return result;
+    }
+
+    QPProblem TrajOptimizer::buildSolverProblem(const Agent &agent, const CollisionConstraints &constraints,
+                                                const traj_t &initial_traj, bool use_warm_start,
+                                                QPCondenser *&condenser, Eigen::VectorXd &x_0) {
+        QPProblem problem = buildQPProblem(agent, constraints);
+        if (use_warm_start) {
+            problem.x_start = getStartValues(constraints, initial_traj, problem.getNumVariables());
+        }
+        condenser = nullptr;
+        if (param.opt_condensed_qp) {
+            condenser = &getQPCondenser(problem);
+            problem = condenser->condense(problem, x_0);
+        }
+        return problem;
+    }
+
+    QPProblem TrajOptimizer::prepareBatchProblem(const Agent &agent, const CollisionConstraints &constraints,
+                                                 const traj_t &initial_traj, bool use_warm_start) {
+        TRACE_SCOPE("TrajOptimizer::prepareBatchProblem");
+        pruneCollisionConstraints(agent, constraints);
+        batch_entry = BatchEntry();
+        batch_entry.use_warm_start = use_warm_start;
+        return buildSolverProblem(agent, constraints, initial_traj, use_warm_start, batch_entry.condenser,
+                                  batch_entry.x_0);
+    }
+
+    void TrajOptimizer::setBatchSolution(const QPSolution &solution) {
+        batch_entry.solution = solution;
+        batch_entry.is_solved = true;
+    }
+
+    bool TrajOptimizer::solveDecoupled(const Agent &agent, const CollisionConstraints &constraints,
+                                       const traj_t &initial_traj, bool use_warm_start, int threads,
+                                       double time_limit, TrajOptResult &result) {
+        TRACE_SCOPE("TrajOptimizer::solveDecoupled");
+        static MetricCounter &decoupled_solves = MetricsRegistry::getInstance().getCounter(
+                "lsc_qp_decoupled_solves_total", "Trajectory QPs solved as independent axis blocks");
+        QPCondenser *condenser = nullptr;
+        Eigen::VectorXd x_0;
+        QPProblem problem = buildSolverProblem(agent, constraints, initial_traj, use_warm_start, condenser, x_0);
+
+        std::vector<std::vector<int>> block_vars;
+        std::vector<QPProblem> blocks = splitQPProblem(problem, block_vars);
+        if (blocks.size() <= 1) {
+            return false;
+        }
+
+        // One solver per block, so that each keeps the factorization of its own block
+        size_t n_blocks = blocks.size();
+        while (block_solvers.size() < n_blocks) {
+            block_solvers.emplace_back(createQPSolver(param.qp_solver_mode));
+        }
+        std::vector<QPSolution> solutions(n_blocks);
+        std::vector<uint8_t> successes(n_blocks, 0);
+        int block_threads = std::max(threads / static_cast<int>(n_blocks), 1);
+        WorkerPool::getInstance().run(n_blocks, [&](size_t b) {
+            block_solvers[b]->setThreads(block_threads);
+            block_solvers[b]->setTimeLimit(time_limit);
+            successes[b] = block_solvers[b]->solve(blocks[b], solutions[b]);
+        });
+
+        Eigen::VectorXd x(problem.getNumVariables());
+        result.n_collision_rows = n_collision_rows;
+        result.n_pruned_rows = n_pruned_rows;
+        result.n_redundant_rows = n_redundant_rows;
+        result.warm_started = use_warm_start;
+        for (size_t b = 0; b < n_blocks; b++) {
+            if (not successes[b]) {
+                if (time_limit > 0 and solutions[b].time_limit_reached) {
+                    throw PlanningReport::QPTIMEOUT;
+                }
+                reportQPFailure(agent, constraints, block_solvers[b]->getName() + " failed at the axis block " +
+                                                    std::to_string(b));
+                throw PlanningReport::QPFAILED;
+            }
+            for (size_t j = 0; j < block_vars[b].size(); j++) {
+                x(block_vars[b][j]) = solutions[b].x(j);
+            }
+            result.total_qp_cost += solutions[b].cost;
+            result.n_iteration = std::max(result.n_iteration, solutions[b].n_iteration);
+            result.time_limit_reached = result.time_limit_reached or solutions[b].time_limit_reached;
+        }
+        setSolution(condenser != nullptr ? condenser->expand(x, x_0) : x, result);
+        decoupled_solves.increment();
+        return true;
+    }
+
+    bool TrajOptimizer::hasCoupledCollisionConstraints(const CollisionConstraints &constraints) const {
+        const RSFCs &lscs = constraints.getLSCs();
+        size_t N_obs = constraints.getObsSize();
+        for (size_t oi = 0; oi < N_obs; oi++) {
             for (int m = 0; m < M; m++) {
                 for (int i = 0; i < n + 1; i++) {
-                    if (dim == 3) {
-                        result.desired_traj[m][i] = point3d(vals[0 * offset_dim + m * offset_seg + i],
-                                                            vals[1 * offset_dim + m * offset_seg + i],
-                                                            vals[2 * offset_dim + m * offset_seg + i]);
-                    } else {
-                        result.desired_traj[m][i] = point3d(vals[0 * offset_dim + m * offset_seg + i],
-                                                            vals[1 * offset_dim + m * offset_seg + i],
-                                                            param.world_z_2d);
+                    size_t lsc_idx = lscs.index(oi, m, i);
+                    if (lscs.getNormalNorm(lsc_idx) < SP_EPSILON_FLOAT or isLSCPruned(lsc_idx)) {
+                        continue;
+                    }
+
+                    int n_nonzero = 0;
+                    for (int k = 0; k < dim; k++) {
+                        if (lscs.getNormals(k)[lsc_idx] != 0) {
+                            n_nonzero++;
+                        }
+                    }
+                    if (n_nonzero > 1) {
+                        return true;
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    void TrajOptimizer::recordQPProblem(const Agent& agent, const CollisionConstraints& constraints) {
+        std::string dir_path = param.package_path + "/log/qp";
+        fs::create_directories(dir_path);
+        std::string file_name = dir_path + "/trajOpt_" + std::to_string(agent.id) + "_" +
+                                std::to_string(qp_record_seq++) + ".qp";
+        if (not writeQPProblem(file_name, buildQPProblem(agent, constraints))) {
+            ROS_WARN_STREAM("[TrajOptimizer] Failed to record QP problem to " << file_name);
+        }
+    }
+
+    TrajOptResult TrajOptimizer::solvePersistent(const Agent& agent,
+                                                 const CollisionConstraints& constraints,
+                                                 const traj_t& initial_traj,
+                                                 bool use_primal_algorithm,
+                                                 bool use_warm_start, int threads, double time_limit) {
+        TRACE_SCOPE("TrajOptimizer::solvePersistent");
+        TrajOptResult result;
+        result.n_collision_rows = n_collision_rows;
+        result.n_pruned_rows = n_pruned_rows;
+        result.n_redundant_rows = n_redundant_rows;
+
+        // Build the model only when its structure is changed, otherwise update it in place
+        if (not isModelReusable(agent, constraints)) {
+            buildPersistentModel(agent, constraints);
+        }
+        updatePersistentModel(agent, constraints);
+
+        IloCplex cplex = qp_model->cplex;
+        cplex.setParam(IloCplex::Param::Threads, threads);
+        // The parameters persist with the model, so the limit is also set back to unbounded (1e+75)
+        cplex.setParam(IloCplex::Param::TimeLimit, time_limit > 0 ? time_limit : 1e+75);
+        if (use_primal_algorithm) {
+            cplex.setParam(IloCplex::Param::RootAlgorithm, IloCplex::Algorithm::Primal);
+        } else {
+            cplex.setParam(IloCplex::Param::RootAlgorithm, IloCplex::Algorithm::Auto);
+        }
+
+        // Without the warm start, CPLEX starts from the basis of the previous solve (Advance = 1)
+        if (use_warm_start) {
+            setStart(cplex, qp_model->var, constraints, initial_traj);
+            result.warm_started = true;
+        }
+
+        std::string QPmodel_path = param.package_path + "/log/QPmodel_trajOpt.lp";
+        if (param.log_solver) {
+            cplex.exportModel(QPmodel_path.c_str());
+        }
+
+        try {
+            IloBool success = cplex.solve();
+
+            IloNumArray vals(qp_model->env);
+            cplex.getValues(vals, qp_model->var);
+            setSolution(valuesToVector(vals), result);
+            result.total_qp_cost = cplex.getObjValue();
+            result.n_iteration = static_cast<int>(cplex.getNiterations() + cplex.getNbarrierIterations());
+            result.time_limit_reached = cplex.getCplexStatus() == IloCplex::AbortTimeLim;
+            vals.end();
+        }
+        catch (IloException &e) {
+            bool is_timeout = cplex.getCplexStatus() == IloCplex::AbortTimeLim;
+            std::ostringstream status;
+            status << cplex.getStatus() << ": " << e;
+
+            // Failed model may keep a bad basis, build it again at the next step
+            qp_model.reset();
+            if (is_timeout) {
+                throw PlanningReport::QPTIMEOUT;
+            }
+            reportQPFailure(agent, constraints, status.str());
+            throw PlanningReport::QPFAILED;
+        }
+        catch (...) {
+            qp_model.reset();
+            reportQPFailure(agent, constraints, "unknown exception");
+            throw PlanningReport::QPFAILED;
+        }
+
+        return result;
+    }
+
+    void TrajOptimizer::resetMission(const std::shared_ptr<const Mission> &_mission) {
+        mission = _mission;
+        batch_entry = BatchEntry();
+    }
+
+    void TrajOptimizer::updateParam(const Param &_param) {
+        if (_param.phi > _param.n) {
+            throw std::invalid_argument("[TrajOptimizer] phi must not be larger than n");
+        }
+        if (_param.n > MAX_BERNSTEIN_DEGREE) {
+            throw std::invalid_argument("[TrajOptimizer] n must not be larger than " +
+                                        std::to_string(MAX_BERNSTEIN_DEGREE));
+        }
+
+        bool is_structure_changed = param.isTrajectoryStructureChanged(_param);
+        param = _param;
+        if (is_structure_changed) {
+            dim = param.world_dimension;
+            M = param.M;
+            n = param.n;
+            phi = param.phi;
+            dt = param.dt;
+            loadAlgebra();
+            qp_condensers.clear();
+            lsc_pruned.clear();
+        }
+
+        // The weights are in the objective of the model, so the model is built again
+        qp_model.reset();
+        block_solvers.clear();
+        batch_entry = BatchEntry();
+        if (param.qp_solver_mode != QPSolverMode::CPLEX) {
+            qp_solver = createQPSolver(param.qp_solver_mode);
+        } else {
+            qp_solver.reset();
+        }
+    }
+
+    void TrajOptimizer::setHorizon(int _M) {
+        if (_M == M) {
+            return;
+        }
+
+        // The constraint bases of all horizons are in the shared cache
+        M = _M;
+        param.M = M;
+        Aeq_base = TrajectoryAlgebraCache::getInstance().getContinuityMatrix(n, phi, M, dt);
+
+        // The model has the variables of the old horizon
+        qp_model.reset();
+        lsc_pruned.clear();
+    }
+
+    void TrajOptimizer::loadAlgebra() {
+        TrajectoryAlgebraCache &cache = TrajectoryAlgebraCache::getInstance();
+        algebra = cache.getSegmentAlgebra(n, phi, param.phi_n, dt);
+        Aeq_base = cache.getContinuityMatrix(n, phi, M, dt);
+    }
+
+    void TrajOptimizer::populatebyrow(IloModel model, IloNumVarArray x, IloRangeArray c,
+                                      const Agent &agent, const CollisionConstraints &constraints,
+                                      const traj_t &initial_traj) {
+        IloEnv env = model.getEnv();
+        int offset_seg = n + 1;
+        int offset_dim = M * (n + 1);
+
+        // Initialize control points and slack variables
+        addVariables(env, x, constraints);
+
+        // Cost function - 1. jerk
+        IloNumExpr cost = buildJerkCost(env, x);
+        addSlackPenalty(x, cost);
+
+        // Cost function - 2. error to goal
+        int terminal_segments = getTerminalSegments_old(agent);
+        for (int m = M - terminal_segments; m < M; m++) {
+            cost += param.terminal_weight *
+                    (x[0 * offset_dim + m * offset_seg + n] - agent.current_goal_point.x()) *
+                    (x[0 * offset_dim + m * offset_seg + n] - agent.current_goal_point.x());
+            cost += param.terminal_weight *
+                    (x[1 * offset_dim + m * offset_seg + n] - agent.current_goal_point.y()) *
+                    (x[1 * offset_dim + m * offset_seg + n] - agent.current_goal_point.y());
+            if (dim == 3) {
+                cost += param.terminal_weight *
+                        (x[2 * offset_dim + m * offset_seg + n] - agent.current_goal_point.z()) *
+                        (x[2 * offset_dim + m * offset_seg + n] - agent.current_goal_point.z());
+            }
+        }
+        model.add(IloMinimize(env, cost));
+
+        // Equality constraints
+        addInitialStateConstraints(x, c, agent);
+        addContinuityConstraints(env, x, c);
+
+        // Inequality Constraints
+        addCollisionConstraints(env, x, c, constraints);
+        addDynamicalLimitConstraints(x, c, agent);
+        addCommunicationRangeConstraints(x, c, agent);
+        addWaypointConstraints(x, c, agent);
+        addStopConstraints(x, c);
+
+        model.add(c);
+    }
+
+    QPProblem TrajOptimizer::buildQPProblem(const Agent &agent, const CollisionConstraints &constraints) const {
+        QPBuilder builder;
+        size_t N_obs = constraints.getObsSize();
+        int offset_seg = n + 1;
+        int offset_dim = M * (n + 1);
+        auto idx = [&](int k, int m, int i) { return k * offset_dim + m * offset_seg + i; };
+
+        // Control points variables
+        const std::string axis_names[] = {"x_", "y_", "z_"};
+        if (dim > 3) {
+            throw std::invalid_argument("[TrajOptimizer] Invalid output dimension, output_dim > 3");
+        }
+        for (int k = 0; k < dim; k++) {
+            for (int m = 0; m < M; m++) {
+                for (int i = 0; i < n + 1; i++) {
+                    double lower_bound = mission->world_min(k);
+                    double upper_bound = mission->world_max(k);
+                    if (k == 2 and m == 0 and param.planner_mode == PlannerMode::RECIPROCALRSFC) { // To avoid numerical error
+                        lower_bound = -100;
+                        upper_bound = 100;
+                    }
+                    if (m == 0 and i < 3) {
+                        // Do not adjust the constraint at the initial state
+                        lower_bound = -QP_INFINITY;
+                        upper_bound = QP_INFINITY;
+                    }
+
+                    builder.addVariable(lower_bound, upper_bound,
+                                        axis_names[k] + std::to_string(m) + "_" + std::to_string(i));
+                }
+            }
+        }
+
+        // Slack variables, slack_indices[oi][m] = -1 if there is no slack
+        std::vector<std::vector<int>> slack_indices(N_obs, std::vector<int>(M, -1));
+        for (size_t oi = 0; oi < N_obs; oi++) {
+            if (hasSlack(constraints, oi)) {
+                for (int m = 0; m < M; m++) {
+                    slack_indices[oi][m] = builder.addVariable(-QP_INFINITY, 0, "epsilon_slack_col_" +
+                                                               std::to_string(oi) + "_" + std::to_string(m));
+                    if (param.opt_soft_collision) {
+                        // Exact penalty, the slack is zero whenever the hard LSCs are feasible
+                        builder.addLinearCost(slack_indices[oi][m], -param.opt_soft_collision_weight);
+                    }
+                }
+            }
+        }
+
+        // Cost function - 1. jerk
+        if (param.control_input_weight != 0) {
+            for (int k = 0; k < dim; k++) {
+                for (int m = 0; m < M; m++) {
+                    for (int i = 0; i < n + 1; i++) {
+                        for (int j = 0; j < n + 1; j++) {
+                            if (algebra->Q_base(i, j) != 0) {
+                                builder.addQuadCost(idx(k, m, i), idx(k, m, j),
+                                                    param.control_input_weight * algebra->Q_base(i, j));
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        // Cost function - 2. error to goal
+        int terminal_segments = getTerminalSegments_old(agent);
+        for (int m = M - terminal_segments; m < M; m++) {
+            for (int k = 0; k < dim; k++) {
+                builder.addSquaredError(idx(k, m, n), agent.current_goal_point(k), param.terminal_weight);
+            }
+        }
+
+        // Initial state. The rows of the derivatives are divided by their powers of dt, n / dt and
+        // n (n - 1) / dt^2, so that all the rows have coefficients of order 1 for any dt.
+        double c_vel = n / dt;
+        double c_acc = n * (n - 1) / (dt * dt);
+        for (int k = 0; k < dim; k++) {
+            double position = agent.current_state.position(k);
+            double velocity = agent.current_state.velocity(k) / c_vel;
+            double acceleration = agent.current_state.acceleration(k) / c_acc;
+            builder.addRow({{idx(k, 0, 0), 1}}, position, position);
+            builder.addRow({{idx(k, 0, 1), 1}, {idx(k, 0, 0), -1}}, velocity, velocity);
+            builder.addRow({{idx(k, 0, 2), 1}, {idx(k, 0, 1), -2}, {idx(k, 0, 0), 1}}, acceleration, acceleration);
+        }
+
+        // Continuity constraints
+        for (int k = 0; k < dim; k++) {
+            if (M < 2) {
+                break;
+            }
+
+            // Both segments have the same duration, so the time scale of each derivative cancels out
+            for (int j = 0; j < phi; j++) {
+                std::vector<std::pair<int, double>> coefs;
+                for (int i = 0; i < n + 1; i++) {
+                    coefs.emplace_back(idx(k, 0, i), algebra->A_T(j, i));
+                    coefs.emplace_back(idx(k, 1, i), -algebra->A_0(j, i));
+                }
+                builder.addRow(coefs, 0, 0);
+            }
+        }
+        for (int k = 0; k < dim; k++) {
+            for (int i = 0; i < (M - 2) * phi; i++) {
+                std::vector<std::pair<int, double>> coefs;
+                for (int j = 0; j < offset_dim; j++) {
+                    if ((*Aeq_base)(i, j) != 0) {
+                        coefs.emplace_back(k * offset_dim + j, (*Aeq_base)(i, j));
+                    }
+                }
+                builder.addRow(coefs, 0, 0);
+            }
+        }
+
+        // SFC
+        if (param.world_use_octomap) {
+            for (int m = 0; m < M; m++) {
+                std::vector<LSC> lscs = constraints.getSFC(m).convertToLSCs(param.world_dimension);
+                for (const auto &lsc: lscs) {
+                    for (int j = 0; j < n + 1; j++) {
+                        if (m == 0 and j < phi) {
+                            continue; // Do not adjust constraint at initial state
+                        }
+
+                        std::vector<std::pair<int, double>> coefs;
+                        double lower = lsc.d;
+                        for (int k = 0; k < dim; k++) {
+                            coefs.emplace_back(idx(k, m, j), lsc.normal_vector(k));
+                            lower += lsc.normal_vector(k) * lsc.obs_control_point(k);
+                        }
+                        builder.addRow(coefs, lower, QP_INFINITY);
+                    }
+                }
+            }
+        }
+
+        // LSC or BVC
+        const RSFCs &lscs = constraints.getLSCs();
+        for (size_t oi = 0; oi < N_obs; oi++) {
+            for (int m = 0; m < M; m++) {
+                for (int i = 0; i < n + 1; i++) {
+                    if (m == 0 and i < phi) {
+                        continue; // Do not adjust constraint at initial state
+                    }
+
+                    size_t lsc_idx = lscs.index(oi, m, i);
+                    if (lscs.getNormalNorm(lsc_idx) < SP_EPSILON_FLOAT or isLSCPruned(lsc_idx)) {
+                        continue;
+                    }
+
+                    std::vector<std::pair<int, double>> coefs;
+                    for (int k = 0; k < dim; k++) {
+                        coefs.emplace_back(idx(k, m, i), lscs.getNormals(k)[lsc_idx]);
+                    }
+                    double lower = lscs.getLowerBound(lsc_idx, dim);
+                    if (slack_indices[oi][m] >= 0) {
+                        coefs.emplace_back(slack_indices[oi][m], -1);
+                    }
+                    builder.addRow(coefs, lower, QP_INFINITY);
+                }
+            }
+        }
+
+        // Dynamic feasibility, lower and upper limits are merged into one row, scaled as the initial state
+        for (int k = 0; k < dim; k++) {
+            double vel_limit = agent.max_vel[k] / c_vel;
+            double acc_limit = agent.max_acc[k] / c_acc;
+            for (int m = 0; m < M; m++) {
+                for (int i = 0; i < n; i++) {
+                    if (m == 0 and (i == 0 or i == 1)) {
+                        continue; //Do not adjust constraint at the initial state
+                    }
+                    builder.addRow({{idx(k, m, i + 1), 1}, {idx(k, m, i), -1}}, -vel_limit, vel_limit);
+                }
+
+                for (int i = 0; i < n - 1; i++) {
+                    if (m == 0 and i == 0) {
+                        continue; //Do not adjust constraint at initial state
+                    }
+                    builder.addRow({{idx(k, m, i + 2), 1}, {idx(k, m, i + 1), -2}, {idx(k, m, i), 1}},
+                                   -acc_limit, acc_limit);
+                }
+            }
+        }
+
+        // Communication range
+        if (param.communication_range > 0) {
+            double range = 0.5 * param.communication_range - agent.radius;
+            double range_waypoint = 0.5 * param.communication_range - SP_EPSILON_FLOAT;
+            for (int k = 0; k < dim; k++) {
+                for (int mi = 0; mi < M; mi++) {
+                    for (int m = mi; m < M; m++) {
+                        builder.addRow({{idx(k, m, n), 1}, {idx(k, mi, 0), -1}}, -range, range);
                     }
                 }
             }
 
-            // Collision predicted obstacles
-            int obs_slack_idx = 0;
-            size_t N_obs = constraints.getObsSize();
-            for (size_t oi = 0; oi < N_obs; oi++) {
-                if (param.slack_mode == SlackMode::COLLISIONCONSTRAINT or constraints.isDynamicObstacle(oi)) {
-                    double slack_cost = 0;
-                    for (int m = 0; m < M; m++) {
-                        slack_cost += abs(vals[offset_slack_col + M * obs_slack_idx + m]);
-                    }
-
-                    obs_slack_idx++;
+            for (int k = 0; k < dim; k++) {
+                for (int m = 0; m < M; m++) {
+                    builder.addRow({{idx(k, m, n), 1}}, agent.next_waypoint(k) - range_waypoint,
+                                   agent.next_waypoint(k) + range_waypoint);
                 }
             }
-
-            // Total QP cost
-            result.total_qp_cost = cplex.getObjValue();
-            env.end();
         }
-        catch (IloException &e) {
-            cplex.exportModel(QPmodel_path.c_str());
-            if ((cplex.getStatus() == IloAlgorithm::Infeasible) ||
-                (cplex.getStatus() == IloAlgorithm::InfeasibleOrUnbounded)) {
-                ROS_ERROR_STREAM(
-                        "[TrajOptimizer] CPLEX No solution at mav " << agent.id << ", starting Conflict refinement");
-                IloConstraintArray infeas(env);
-                IloNumArray preferences(env);
-
-                infeas.add(con);
-                for (IloInt i = 0; i < var.getSize(); i++) {
-                    if (var[i].getType() != IloNumVar::Bool) {
-                        infeas.add(IloBound(var[i], IloBound::Lower));
-                        infeas.add(IloBound(var[i], IloBound::Upper));
-                    }
-                }
 
-                for (IloInt i = 0; i < infeas.getSize(); i++) {
-                    preferences.add(1.0);  // User may wish to assign unique preferences
+        // Stop at the end of planning horizon
+        if (param.planner_mode == PlannerMode::LSC) {
+            for (int k = 0; k < dim; k++) {
+                for (int i = 1; i < phi; i++) {
+                    builder.addRow({{idx(k, M - 1, n), 1}, {idx(k, M - 1, n - i), -1}}, 0, 0);
                 }
+            }
+        }
 
-                if (cplex.refineConflict(infeas, preferences)) {
-                    IloCplex::ConflictStatusArray conflict = cplex.getConflict(infeas);
-                    env.getImpl()->useDetailedDisplay(IloTrue);
-                    std::cout << "Conflict :" << std::endl;
-                    for (IloInt i = 0; i < infeas.getSize(); i++) {
-                        if (conflict[i] == IloCplex::ConflictMember)
-                            std::cout << "Proved  : c" << i << infeas[i] << std::endl;
-                        if (conflict[i] == IloCplex::ConflictPossibleMember)
-                            std::cout << "Possible: c" << i << infeas[i] << std::endl;
-                    }
-                    cplex.writeConflict(conflict_path.c_str());
-                } else {
-                    ROS_ERROR_STREAM("[TrajOptimizer] CPLEX Conflict could not be refined");
+        return builder.build();
+    }
+
+    QPCondenser &TrajOptimizer::getQPCondenser(const QPProblem &problem) {
+        QPCondenser &condenser = qp_condensers[M];
+        if (condenser.isCompatible(problem)) {
+            return condenser;
+        }
+
+        // Eliminate the control points fixed by the initial state, the first ones of each segment given by the
+        // continuity and the last ones given by the stop constraints
+        int offset_seg = n + 1;
+        int offset_dim = M * (n + 1);
+        std::vector<int> preferred;
+        for (int k = 0; k < dim; k++) {
+            for (int m = 0; m < M; m++) {
+                for (int i = 0; i < (m == 0 ? 3 : phi); i++) {
+                    preferred.emplace_back(k * offset_dim + m * offset_seg + i);
                 }
-            } else {
-                ROS_ERROR_STREAM("[TrajOptimizer] CPLEX Concert exception caught: " << e);
             }
+            for (int i = 1; i < phi; i++) {
+                preferred.emplace_back(k * offset_dim + (M - 1) * offset_seg + n - i);
+            }
+        }
+        condenser.build(problem, preferred);
+        return condenser;
+    }
 
-            //TODO: find better exception
-            throw PlanningReport::QPFAILED;
+    bool TrajOptimizer::isModelReusable(const Agent &agent, const CollisionConstraints &constraints) const {
+        if (qp_model == nullptr) {
+            return false;
         }
-        catch (...) {
-            ROS_ERROR_STREAM("[TrajOptimizer] CPLEX Unknown exception caught at iteration ");
-            if (not param.log_solver) {
-                cplex.exportModel(QPmodel_path.c_str());
-            }
 
-            //TODO: find better exception
-            throw PlanningReport::QPFAILED;
+        size_t N_obs = constraints.getObsSize();
+        if (qp_model->obs_slack.size() != N_obs) {
+            return false;
+        }
+        for (size_t oi = 0; oi < N_obs; oi++) {
+            bool has_slack = hasSlack(constraints, oi);
+            if (qp_model->obs_slack[oi] != has_slack) {
+                return false;
+            }
         }
 
-        return result;
+        return qp_model->max_vel == agent.max_vel and qp_model->max_acc == agent.max_acc and
+               qp_model->radius == agent.radius;
     }
 
-    void TrajOptimizer::updateParam(const Param &_param) {
-        param = _param;
+    void TrajOptimizer::buildPersistentModel(const Agent &agent, const CollisionConstraints &constraints) {
+        qp_model = std::make_unique<PersistentQPModel>();
+        IloEnv env = qp_model->env;
+
+        size_t N_obs = constraints.getObsSize();
+        qp_model->obs_slack.resize(N_obs);
+        for (size_t oi = 0; oi < N_obs; oi++) {
+            qp_model->obs_slack[oi] = hasSlack(constraints, oi);
+        }
+        qp_model->max_vel = agent.max_vel;
+        qp_model->max_acc = agent.max_acc;
+        qp_model->radius = agent.radius;
+
+        // Variables and the jerk cost do not change between steps
+        addVariables(env, qp_model->var, constraints);
+        IloNumExpr cost = buildJerkCost(env, qp_model->var);
+        addSlackPenalty(qp_model->var, cost);
+        qp_model->objective = IloMinimize(env, cost);
+        qp_model->model.add(qp_model->objective);
+
+        addInitialStateConstraints(qp_model->var, qp_model->con_init, agent);
+        addContinuityConstraints(env, qp_model->var, qp_model->con_static);
+        addDynamicalLimitConstraints(qp_model->var, qp_model->con_static, agent);
+        addCommunicationRangeConstraints(qp_model->var, qp_model->con_static, agent);
+        addStopConstraints(qp_model->var, qp_model->con_static);
+        qp_model->model.add(qp_model->con_init);
+        qp_model->model.add(qp_model->con_static);
+
+        IloCplex cplex = qp_model->cplex;
+        cplex.setParam(IloCplex::Param::Advance, 1);
+        if (not param.log_solver) {
+            cplex.setOut(env.getNullStream());
+            cplex.setWarning(env.getNullStream());
+        }
+        cplex.extract(qp_model->model);
     }
 
-    // Cost matrix Q
-    void TrajOptimizer::buildQBase() {
-        Q_base = Eigen::MatrixXd::Zero(n + 1, n + 1);
-        for (int k = phi; k > phi - param.phi_n; k--) {
-            Eigen::MatrixXd Z = Eigen::MatrixXd::Zero(n + 1, n + 1);
-            for (int i = 0; i < n + 1; i++) {
-                for (int j = 0; j < n + 1; j++) {
-                    if (i + j - 2 * k + 1 > 0)
-                        Z(i, j) =
-                                (double) coef_derivative(i, k) * coef_derivative(j, k) / (i + j - 2 * k + 1);
-                }
-            }
-            Z = B * Z * B.transpose();
-            Z = Z * pow(dt, -2 * k + 1);
-            Q_base += Z;
-        }
-    }
-
-    void TrajOptimizer::buildAeqBase() {
-        // Build A_0, A_T
-        Eigen::MatrixXd A_0 = Eigen::MatrixXd::Zero(n + 1, n + 1);
-        Eigen::MatrixXd A_T = Eigen::MatrixXd::Zero(n + 1, n + 1);
-        if (n == 5 and phi == 3) {
-            A_0 << 1, 0, 0, 0, 0, 0,
-                    -1, 1, 0, 0, 0, 0,
-                    1, -2, 1, 0, 0, 0,
-                    -1, 3, -3, 1, 0, 0,
-                    1, -4, 6, -4, 1, 0,
-                    -1, 5, -10, 10, -5, 1;
-
-            A_T << 0, 0, 0, 0, 0, 1,
-                    0, 0, 0, 0, -1, 1,
-                    0, 0, 0, 1, -2, 1,
-                    0, 0, -1, 3, -3, 1,
-                    0, 1, -4, 6, -4, 1,
-                    -1, 5, -10, 10, -5, 1;
-        } else {
-            //TODO: Compute A_0, A_T when n is not 5
-            throw std::invalid_argument("[TrajOptimizer] Currently, only n=5, phi=3 is available");
+    void TrajOptimizer::updatePersistentModel(const Agent &agent, const CollisionConstraints &constraints) {
+        IloEnv env = qp_model->env;
+        IloNumVarArray x = qp_model->var;
+        int offset_seg = n + 1;
+        int offset_dim = M * (n + 1);
+
+        // Initial state, the order of rows follows addInitialStateConstraints
+        for (int k = 0; k < dim; k++) {
+            IloNum position = agent.current_state.position(k);
+            IloNum velocity = agent.current_state.velocity(k);
+            IloNum acceleration = agent.current_state.acceleration(k);
+            qp_model->con_init[3 * k + 0].setBounds(position, position);
+            qp_model->con_init[3 * k + 1].setBounds(velocity, velocity);
+            qp_model->con_init[3 * k + 2].setBounds(acceleration, acceleration);
         }
 
-        Aeq_base = Eigen::MatrixXd::Zero((M - 2) * phi, M * (n + 1));
-        for (int m = 2; m < M; m++) {
-            int nn = 1;
-            for (int j = 0; j < phi; j++) {
-                Aeq_base.block(phi * (m - 2) + j, (n + 1) * (m - 1), 1, n + 1) =
-                        pow(dt, -j) * nn * A_T.row(j);
-                Aeq_base.block(phi * (m - 2) + j, (n + 1) * m, 1, n + 1) =
-                        -pow(dt, -j) * nn * A_0.row(j);
-                nn = nn * (n - j);
+        // Error to goal, (x - g)^2 = x^2 - 2gx + g^2 at the last control point of terminal segments
+        int terminal_segments = getTerminalSegments_old(agent);
+        double constant = 0;
+        for (int k = 0; k < dim; k++) {
+            for (int m = 0; m < M; m++) {
+                IloNumVar x_end = x[k * offset_dim + m * offset_seg + n];
+                double quad_coef = param.control_input_weight * algebra->Q_base(n, n);
+                double linear_coef = 0;
+                if (m >= M - terminal_segments) {
+                    double goal = agent.current_goal_point(k);
+                    quad_coef += param.terminal_weight;
+                    linear_coef = -2 * param.terminal_weight * goal;
+                    constant += param.terminal_weight * goal * goal;
+                }
+                qp_model->objective.setQuadCoef(x_end, x_end, quad_coef);
+                qp_model->objective.setLinearCoef(x_end, linear_coef);
             }
         }
+        qp_model->objective.setConstant(constant);
+
+        // Collision constraints and waypoint are rebuilt
+        if (qp_model->con_dynamic.getSize() > 0) {
+            qp_model->model.remove(qp_model->con_dynamic);
+            qp_model->con_dynamic.endElements();
+            qp_model->con_dynamic.clear();
+        }
+        addCollisionConstraints(env, x, qp_model->con_dynamic, constraints);
+        addWaypointConstraints(x, qp_model->con_dynamic, agent);
+        qp_model->model.add(qp_model->con_dynamic);
     }
 
-    void TrajOptimizer::populatebyrow(IloModel model, IloNumVarArray x, IloRangeArray c,
-                                      const Agent &agent, const CollisionConstraints &constraints,
-                                      const traj_t &initial_traj) {
+    void TrajOptimizer::addVariables(IloEnv env, IloNumVarArray x, const CollisionConstraints &constraints) {
         size_t N_obs = constraints.getObsSize();
         int offset_seg = n + 1;
         int offset_dim = M * (n + 1);
-        int offset_slack_cont_front_vel = dim * M * (n + 1);
-        int offset_slack_cont_front_acc = dim * M * (n + 1) + dim * 1;
-        int offset_slack_cont_back_vel = dim * M * (n + 1) + dim * 2;
-        int offset_slack_cont_back_acc = dim * M * (n + 1) + dim * 3;
-        int offset_slack_col;
-        if (param.slack_mode == SlackMode::CONTINUITY) {
-            offset_slack_col = dim * M * (n + 1) + dim * 4;
-        } else {
-            offset_slack_col = dim * M * (n + 1);
-        }
-
+        int offset_slack_col = getSlackOffset();
 
-        IloEnv env = model.getEnv();
         // Initialize control points variables
         std::string name;
         double lower_bound, upper_bound;
@@ -249,8 +870,8 @@ namespace DynamicPlanning {
                         throw std::invalid_argument("[TrajOptimizer] Invalid output dimension, output_dim > 3");
                     }
 
-                    lower_bound = mission.world_min(k);
-                    upper_bound = mission.world_max(k);
+                    lower_bound = mission->world_min(k);
+                    upper_bound = mission->world_max(k);
 
                     if(k == 2 and m == 0 and param.planner_mode == PlannerMode::RECIPROCALRSFC){ // To avoid numerical error
                         lower_bound = -100;
@@ -271,7 +892,7 @@ namespace DynamicPlanning {
 
         int obs_slack_idx = 0;
         for (size_t oi = 0; oi < N_obs; oi++) {
-            if (param.slack_mode == SlackMode::COLLISIONCONSTRAINT or constraints.isDynamicObstacle(oi)) {
+            if (hasSlack(constraints, oi)) {
                 for (int m = 0; m < M; m++) {
                     x.add(IloNumVar(env, -IloInfinity, 0));
                     int row = offset_slack_col + M * obs_slack_idx + m;
@@ -281,8 +902,12 @@ namespace DynamicPlanning {
                 obs_slack_idx++;
             }
         }
+    }
+
+    IloNumExpr TrajOptimizer::buildJerkCost(IloEnv env, IloNumVarArray x) const {
+        int offset_seg = n + 1;
+        int offset_dim = M * (n + 1);
 
-        // Cost function - 1. jerk
         IloNumExpr cost(env);
         for (int k = 0; k < dim; k++) {
             for (int m = 0; m < M; m++) {
@@ -290,42 +915,37 @@ namespace DynamicPlanning {
                     int row = k * offset_dim + m * offset_seg + i;
                     for (int j = 0; j < n + 1; j++) {
                         int col = k * offset_dim + m * offset_seg + j;
-                        if (Q_base(i, j) != 0 and param.control_input_weight != 0) {
-                            cost += param.control_input_weight * Q_base(i, j) * x[row] * x[col];
+                        if (algebra->Q_base(i, j) != 0 and param.control_input_weight != 0) {
+                            cost += param.control_input_weight * algebra->Q_base(i, j) * x[row] * x[col];
                         }
                     }
                 }
             }
         }
 
-        // Cost function - 2. error to goal
-        int terminal_segments = getTerminalSegments_old(agent);
-        for (int m = M - terminal_segments; m < M; m++) {
-            cost += param.terminal_weight *
-                    (x[0 * offset_dim + m * offset_seg + n] - agent.current_goal_point.x()) *
-                    (x[0 * offset_dim + m * offset_seg + n] - agent.current_goal_point.x());
-            cost += param.terminal_weight *
-                    (x[1 * offset_dim + m * offset_seg + n] - agent.current_goal_point.y()) *
-                    (x[1 * offset_dim + m * offset_seg + n] - agent.current_goal_point.y());
-            if (dim == 3) {
-                cost += param.terminal_weight *
-                        (x[2 * offset_dim + m * offset_seg + n] - agent.current_goal_point.z()) *
-                        (x[2 * offset_dim + m * offset_seg + n] - agent.current_goal_point.z());
-            }
+        return cost;
+    }
+
+    void TrajOptimizer::addSlackPenalty(IloNumVarArray x, IloNumExpr &cost) const {
+        if (not param.opt_soft_collision) {
+            return;
         }
-        model.add(IloMinimize(env, cost));
 
-        // Continuity constraints
+        // Exact penalty, the slack variables are non-positive
+        for (IloInt j = getSlackOffset(); j < x.getSize(); j++) {
+            cost += -param.opt_soft_collision_weight * x[j];
+        }
+    }
+
+    // Rows are added in the order of position, velocity, acceleration for each axis
+    void TrajOptimizer::addInitialStateConstraints(IloNumVarArray x, IloRangeArray c, const Agent &agent) const {
+        int offset_seg = n + 1;
+        int offset_dim = M * (n + 1);
+
         for (int k = 0; k < dim; k++) {
             // Front position
             c.add(x[k * offset_dim + 0 * offset_seg + 0] == agent.current_state.position(k));
 
-            // Back position
-            if(M > 1){
-                c.add(x[k * offset_dim + 0 * offset_seg + n] - x[k * offset_dim + 1 * offset_seg + 0] == 0);
-            }
-
-
             // Front velocity
             c.add(pow(dt, -1) * n *
                   (x[k * offset_dim + 0 * offset_seg + 1] - x[k * offset_dim + 0 * offset_seg + 0])
@@ -336,38 +956,56 @@ namespace DynamicPlanning {
                   (x[k * offset_dim + 0 * offset_seg + 2] -
                    2 * x[k * offset_dim + 0 * offset_seg + 1] +
                    x[k * offset_dim + 0 * offset_seg + 0]) == agent.current_state.acceleration(k));
+        }
+    }
+
+    void TrajOptimizer::addContinuityConstraints(IloEnv env, IloNumVarArray x, IloRangeArray c) const {
+        int offset_seg = n + 1;
+        int offset_dim = M * (n + 1);
 
-            // Back velocity
-            c.add((x[k * offset_dim + 1 * offset_seg + 1] -
-                   x[k * offset_dim + 1 * offset_seg + 0]) -
-                  (x[k * offset_dim + 0 * offset_seg + n] -
-                   x[k * offset_dim + 0 * offset_seg + n - 1]) == 0);
+        for (int k = 0; k < dim; k++) {
+            if (M < 2) {
+                break;
+            }
 
-            // Back acceleration
-            c.add((x[k * offset_dim + 1 * offset_seg + 2] -
-                   2 * x[k * offset_dim + 1 * offset_seg + 1] +
-                   x[k * offset_dim + 1 * offset_seg + 0]) -
-                  (x[k * offset_dim + 0 * offset_seg + n] -
-                   2 * x[k * offset_dim + 0 * offset_seg + n - 1] +
-                   x[k * offset_dim + 0 * offset_seg + n - 2]) == 0);
+            // Back position, velocity, acceleration, ... up to the (phi - 1)-th derivative
+            // Both segments have the same duration, so the time scale of each derivative cancels out
+            for (int j = 0; j < phi; j++) {
+                IloNumExpr expr(env);
+                for (int i = 0; i < n + 1; i++) {
+                    if (algebra->A_T(j, i) != 0) {
+                        expr += algebra->A_T(j, i) * x[k * offset_dim + 0 * offset_seg + i];
+                    }
+                    if (algebra->A_0(j, i) != 0) {
+                        expr -= algebra->A_0(j, i) * x[k * offset_dim + 1 * offset_seg + i];
+                    }
+                }
+                c.add(expr == 0);
+                expr.end();
+            }
         }
 
-
-        // Continuity constraints
         for (int k = 0; k < dim; k++) {
             for (int i = 0; i < (M - 2) * phi; i++) {
                 IloNumExpr expr(env);
                 for (int j = 0; j < offset_dim; j++) {
-                    if (Aeq_base(i, j) != 0) {
-                        expr += Aeq_base(i, j) * x[k * offset_dim + j];
+                    if ((*Aeq_base)(i, j) != 0) {
+                        expr += (*Aeq_base)(i, j) * x[k * offset_dim + j];
                     }
                 }
                 c.add(expr == 0);
                 expr.end();
             }
         }
+    }
+
+    void TrajOptimizer::addCollisionConstraints(IloEnv env, IloNumVarArray x, IloRangeArray c,
+                                                const CollisionConstraints &constraints) const {
+        size_t N_obs = constraints.getObsSize();
+        int offset_seg = n + 1;
+        int offset_dim = M * (n + 1);
+        int offset_slack_col = getSlackOffset();
 
-        // Inequality Constraints
         // SFC
         if (param.world_use_octomap) {
             for (int m = 0; m < M; m++) {
@@ -397,7 +1035,8 @@ namespace DynamicPlanning {
         }
 
         // LSC or BVC
-        obs_slack_idx = 0;
+        const RSFCs &lscs = constraints.getLSCs();
+        int obs_slack_idx = 0;
         for (int oi = 0; oi < N_obs; oi++) {
             for (int m = 0; m < M; m++) {
                 for (int i = 0; i < n + 1; i++) {
@@ -405,25 +1044,21 @@ namespace DynamicPlanning {
                         continue; // Do not adjust constraint at initial state
                     }
 
-                    LSC lsc = constraints.getLSC(oi, m, i);
-                    if(lsc.normal_vector.norm() < SP_EPSILON_FLOAT){
+                    size_t lsc_idx = lscs.index(oi, m, i);
+                    if(lscs.getNormalNorm(lsc_idx) < SP_EPSILON_FLOAT or isLSCPruned(lsc_idx)){
                         continue;
                     }
 
                     IloNumExpr expr(env);
-                    expr += lsc.normal_vector.x() *
-                            (x[0 * offset_dim + m * offset_seg + i] - lsc.obs_control_point.x());
-                    expr += lsc.normal_vector.y() *
-                            (x[1 * offset_dim + m * offset_seg + i] - lsc.obs_control_point.y());
-                    if (dim == 3) {
-                        expr += lsc.normal_vector.z() *
-                                (x[2 * offset_dim + m * offset_seg + i] - lsc.obs_control_point.z());
+                    for (int k = 0; k < dim; k++) {
+                        expr += lscs.getNormals(k)[lsc_idx] *
+                                (x[k * offset_dim + m * offset_seg + i] - lscs.getPoints(k)[lsc_idx]);
                     }
 
-                    if (param.slack_mode == SlackMode::COLLISIONCONSTRAINT or constraints.isDynamicObstacle(oi)) {
-                        expr += -(lsc.d + x[offset_slack_col + M * obs_slack_idx + m]);
+                    if (hasSlack(constraints, oi)) {
+                        expr += -(lscs.getOffsets()[lsc_idx] + x[offset_slack_col + M * obs_slack_idx + m]);
                     } else {
-                        expr += -lsc.d;
+                        expr += -lscs.getOffsets()[lsc_idx];
                     }
 
                     c.add(expr >= 0);
@@ -431,12 +1066,16 @@ namespace DynamicPlanning {
                 }
             }
 
-            if (param.slack_mode == SlackMode::COLLISIONCONSTRAINT or constraints.isDynamicObstacle(oi)) {
+            if (hasSlack(constraints, oi)) {
                 obs_slack_idx++;
             }
         }
+    }
+
+    void TrajOptimizer::addDynamicalLimitConstraints(IloNumVarArray x, IloRangeArray c, const Agent &agent) const {
+        int offset_seg = n + 1;
+        int offset_dim = M * (n + 1);
 
-        // Dynamic feasibility
         for (int k = 0; k < dim; k++) {
             for (int m = 0; m < M; m++) {
                 // Maximum velocity
@@ -472,45 +1111,285 @@ namespace DynamicPlanning {
                 }
             }
         }
+    }
 
+    void TrajOptimizer::addCommunicationRangeConstraints(IloNumVarArray x, IloRangeArray c,
+                                                         const Agent &agent) const {
+        if (param.communication_range <= 0) {
+            return;
+        }
 
-        // Communication range
-        if (param.communication_range > 0) {
-            for(int k = 0; k < dim; k++) {
-                for (int mi = 0; mi < M; mi++) {
-                    for (int m = mi; m < M; m++) {
-                        c.add(x[k * offset_dim + m * offset_seg + n] -
-                              x[k * offset_dim + mi * offset_seg + 0] <=
-                              0.5 * param.communication_range - agent.radius);
-                        c.add(-x[k * offset_dim + m * offset_seg + n] +
-                              x[k * offset_dim + mi * offset_seg + 0] <=
-                              0.5 * param.communication_range - agent.radius);
+        int offset_seg = n + 1;
+        int offset_dim = M * (n + 1);
+        for(int k = 0; k < dim; k++) {
+            for (int mi = 0; mi < M; mi++) {
+                for (int m = mi; m < M; m++) {
+                    c.add(x[k * offset_dim + m * offset_seg + n] -
+                          x[k * offset_dim + mi * offset_seg + 0] <=
+                          0.5 * param.communication_range - agent.radius);
+                    c.add(-x[k * offset_dim + m * offset_seg + n] +
+                          x[k * offset_dim + mi * offset_seg + 0] <=
+                          0.5 * param.communication_range - agent.radius);
+                }
+            }
+        }
+    }
+
+    void TrajOptimizer::addWaypointConstraints(IloNumVarArray x, IloRangeArray c, const Agent &agent) const {
+        if (param.communication_range <= 0) {
+            return;
+        }
+
+        int offset_seg = n + 1;
+        int offset_dim = M * (n + 1);
+        for(int k = 0; k < dim; k++) {
+            for (int m = 0; m < M; m++) {
+                c.add(x[k * offset_dim + m * offset_seg + n] - agent.next_waypoint(k) <=
+                      0.5 * param.communication_range - SP_EPSILON_FLOAT);
+                c.add(-x[k * offset_dim + m * offset_seg + n] + agent.next_waypoint(k) <=
+                      0.5 * param.communication_range - SP_EPSILON_FLOAT);
+            }
+        }
+    }
+
+    // Additional constraints for feasible LSC
+    // Stop at the end of planning horizon
+    void TrajOptimizer::addStopConstraints(IloNumVarArray x, IloRangeArray c) const {
+        if (param.planner_mode != PlannerMode::LSC) {
+            return;
+        }
+
+        int offset_seg = n + 1;
+        int offset_dim = M * (n + 1);
+        for (int k = 0; k < dim; k++) {
+            int m = M - 1;
+            for (int i = 1; i < phi; i++) {
+                c.add(x[k * offset_dim + m * offset_seg + n] - x[k * offset_dim + m * offset_seg + n - i] == 0);
+            }
+        }
+    }
+
+    Eigen::VectorXd TrajOptimizer::getStartValues(const CollisionConstraints &constraints, const traj_t &initial_traj,
+                                                  int n_var) const {
+        int offset_seg = n + 1;
+        int offset_dim = M * (n + 1);
+
+        Eigen::VectorXd start_vals = Eigen::VectorXd::Zero(n_var);
+        for (int k = 0; k < dim; k++) {
+            for (int m = 0; m < M; m++) {
+                for (int i = 0; i < n + 1; i++) {
+                    start_vals(k * offset_dim + m * offset_seg + i) = initial_traj[m][i](k);
+                }
+            }
+        }
+
+        // The slack variables take the largest violation of initial_traj, so that the start satisfies the relaxed
+        // LSCs and keeps the active set of the previous solution
+        const RSFCs &lscs = constraints.getLSCs();
+        int slack_idx = dim * offset_dim;
+        for (size_t oi = 0; oi < constraints.getObsSize(); oi++) {
+            if (not hasSlack(constraints, static_cast<int>(oi))) {
+                continue;
+            }
+            for (int m = 0; m < M and slack_idx < n_var; m++, slack_idx++) {
+                double slack = 0;
+                for (int i = (m == 0 ? phi : 0); i < n + 1; i++) {
+                    size_t lsc_idx = lscs.index(oi, m, i);
+                    if (lscs.getNormalNorm(lsc_idx) < SP_EPSILON_FLOAT or isLSCPruned(lsc_idx)) {
+                        continue;
                     }
+                    double margin = -lscs.getOffsets()[lsc_idx];
+                    for (int k = 0; k < dim; k++) {
+                        margin += lscs.getNormals(k)[lsc_idx] * (initial_traj[m][i](k) - lscs.getPoints(k)[lsc_idx]);
+                    }
+                    slack = std::min(slack, margin);
                 }
+                start_vals(slack_idx) = slack;
             }
+        }
 
-            for(int k = 0; k < dim; k++) {
-                for (int m = 0; m < M; m++) {
-                    c.add(x[k * offset_dim + m * offset_seg + n] - agent.next_waypoint(k) <=
-                          0.5 * param.communication_range - SP_EPSILON_FLOAT);
-                    c.add(-x[k * offset_dim + m * offset_seg + n] + agent.next_waypoint(k) <=
-                          0.5 * param.communication_range - SP_EPSILON_FLOAT);
+        return start_vals;
+    }
+
+    void TrajOptimizer::setStart(IloCplex cplex, IloNumVarArray var, const CollisionConstraints &constraints,
+                                 const traj_t &initial_traj) const {
+        IloEnv env = cplex.getEnv();
+        Eigen::VectorXd start_vals = getStartValues(constraints, initial_traj, static_cast<int>(var.getSize()));
+        IloNumArray vals(env, var.getSize());
+        for (IloInt i = 0; i < var.getSize(); i++) {
+            vals[i] = start_vals(i);
+        }
+        cplex.setStart(vals, 0, var, 0, 0, 0);
+        vals.end();
+    }
+
+    Eigen::VectorXd TrajOptimizer::valuesToVector(const IloNumArray &vals) {
+        Eigen::VectorXd x(vals.getSize());
+        for (IloInt i = 0; i < vals.getSize(); i++) {
+            x(i) = vals[i];
+        }
+        return x;
+    }
+
+    void TrajOptimizer::setSolution(Eigen::VectorXd x, TrajOptResult &result) const {
+        result.desired_traj = valuesToTraj(x);
+        result.solution = std::move(x);
+    }
+
+    traj_t TrajOptimizer::valuesToTraj(const Eigen::VectorXd &vals) const {
+        int offset_seg = n + 1;
+        int offset_dim = M * (n + 1);
+
+        traj_t traj(M, n, dt);
+        for (int m = 0; m < M; m++) {
+            for (int i = 0; i < n + 1; i++) {
+                point3d control_point(0, 0, param.world_z_2d);
+                for (int k = 0; k < dim; k++) {
+                    control_point(k) = vals(k * offset_dim + m * offset_seg + i);
                 }
+                traj[m][i] = control_point;
             }
         }
 
-        // Additional constraints for feasible LSC
-        // Stop at the end of planning horizon
-        if (param.planner_mode == PlannerMode::LSC) {
-            for (int k = 0; k < dim; k++) {
-                int m = M - 1;
-                for (int i = 1; i < phi; i++) {
-                    c.add(x[k * offset_dim + m * offset_seg + n] - x[k * offset_dim + m * offset_seg + n - i] == 0);
+        return traj;
+    }
+
+    void TrajOptimizer::reportQPFailure(const Agent &agent, const CollisionConstraints &constraints,
+                                        const std::string &status) const {
+        ROS_ERROR_STREAM("[TrajOptimizer] QP failed at mav " << agent.id << ", " << status);
+        if (not param.log_qp_failure) {
+            return;
+        }
+
+        // Snapshot the problem and diagnose it off the planning thread
+        QPFailureReport report;
+        report.problem_name = "trajOpt";
+        report.agent_id = agent.id;
+        report.status = status;
+        report.log_dir = param.package_path + "/log/qp_failure";
+        report.problem = buildQPProblem(agent, constraints);
+        QPFailureDiagnoser::getInstance().submit(std::move(report));
+    }
+
+    std::vector<std::vector<Box>> TrajOptimizer::computeReachableBoxes(const Agent &agent,
+                                                                       const CollisionConstraints &constraints) const {
+        // The first three control points are fixed by the initial state
+        point3d c_0 = agent.current_state.position;
+        point3d c_1 = c_0 + agent.current_state.velocity * (dt / n);
+        point3d c_2 = c_1 * 2 - c_0 + agent.current_state.acceleration * (dt * dt / (n * (n - 1)));
+
+        std::vector<std::vector<Box>> reachable_boxes(M, std::vector<Box>(n + 1));
+        for (int m = 0; m < M; m++) {
+            for (int i = 0; i < n + 1; i++) {
+                // c_{m,0} = c_{m-1,n}, and the velocity limit bounds the difference between adjacent control points
+                int ctrl_idx = m * n + i;
+                if (ctrl_idx < 2) {
+                    point3d c = ctrl_idx == 0 ? c_0 : c_1;
+                    reachable_boxes[m][i] = Box(c, c);
+                    continue;
+                }
+
+                point3d box_min, box_max;
+                for (int k = 0; k < 3; k++) {
+                    double max_step = k < dim ? agent.max_vel[k] * dt / n : 0;
+                    box_min(k) = c_2(k) - (ctrl_idx - 2) * max_step;
+                    box_max(k) = c_2(k) + (ctrl_idx - 2) * max_step;
+                }
+
+                // SFC is a hard constraint
+                if (param.world_use_octomap and not(m == 0 and i < phi)) {
+                    for (const auto &lsc: constraints.getSFC(m).convertToLSCs(dim)) {
+                        for (int k = 0; k < dim; k++) {
+                            if (lsc.normal_vector(k) > 1 - SP_EPSILON_FLOAT) {
+                                box_min(k) = std::max(box_min(k), lsc.obs_control_point(k) + (float) lsc.d);
+                            } else if (lsc.normal_vector(k) < -1 + SP_EPSILON_FLOAT) {
+                                box_max(k) = std::min(box_max(k), lsc.obs_control_point(k) - (float) lsc.d);
+                            }
+                        }
+                    }
                 }
+                reachable_boxes[m][i] = Box(box_min, box_max);
             }
         }
 
-        model.add(c);
+        return reachable_boxes;
+    }
+
+    void TrajOptimizer::pruneCollisionConstraints(const Agent &agent, const CollisionConstraints &constraints) {
+        size_t N_obs = constraints.getObsSize();
+        const RSFCs &lscs = constraints.getLSCs();
+        lsc_pruned.assign(lscs.getNumLSCs(), false);
+        n_collision_rows = 0;
+        n_pruned_rows = 0;
+        n_redundant_rows = 0;
+
+        std::vector<std::vector<Box>> reachable_boxes;
+        if (param.opt_prune_constraints) {
+            reachable_boxes = computeReachableBoxes(agent, constraints);
+        }
+
+        for (size_t oi = 0; oi < N_obs; oi++) {
+            for (int m = 0; m < M; m++) {
+                for (int i = 0; i < n + 1; i++) {
+                    if (m == 0 and i < phi) {
+                        continue; // Do not adjust constraint at initial state
+                    }
+
+                    size_t lsc_idx = lscs.index(oi, m, i);
+                    if (lscs.getNormalNorm(lsc_idx) < SP_EPSILON_FLOAT) {
+                        continue;
+                    }
+
+                    n_collision_rows++;
+                    if (constraints.isLSCRedundant(lsc_idx)) {
+                        lsc_pruned[lsc_idx] = true;
+                        n_pruned_rows++;
+                        n_redundant_rows++;
+                    } else if (param.opt_prune_constraints and
+                               isLSCSatisfiedInBox(lscs, lsc_idx, reachable_boxes[m][i])) {
+                        lsc_pruned[lsc_idx] = true;
+                        n_pruned_rows++;
+                    }
+                }
+            }
+        }
+    }
+
+    bool TrajOptimizer::isLSCPruned(size_t lsc_idx) const {
+        return lsc_idx < lsc_pruned.size() and lsc_pruned[lsc_idx];
+    }
+
+    bool TrajOptimizer::isLSCSatisfiedInBox(const RSFCs &lscs, size_t lsc_idx, const Box &box) const {
+        // Minimum of n^T (c - c_obs) - d in the box
+        double margin_min = -lscs.getOffsets()[lsc_idx];
+        for (int k = 0; k < dim; k++) {
+            double normal_k = lscs.getNormals(k)[lsc_idx];
+            double c_k = normal_k > 0 ? box.box_min(k) : box.box_max(k);
+            margin_min += normal_k * (c_k - lscs.getPoints(k)[lsc_idx]);
+        }
+        return margin_min > SP_EPSILON_FLOAT;
+    }
+
+    bool TrajOptimizer::hasSlack(const CollisionConstraints &constraints, int oi) const {
+        return param.opt_soft_collision or param.slack_mode == SlackMode::COLLISIONCONSTRAINT or
+               constraints.isDynamicObstacle(oi);
+    }
+
+    size_t TrajOptimizer::getProblemSize(const CollisionConstraints &constraints) const {
+        size_t N_rows_per_obs = M * (n + 1) - phi;
+        size_t N_rows = constraints.getObsSize() * N_rows_per_obs;
+        if (param.world_use_octomap) {
+            N_rows += 2 * dim * N_rows_per_obs;
+        }
+        return N_rows - std::min(N_rows, static_cast<size_t>(n_pruned_rows));
+    }
+
+    int TrajOptimizer::getSlackOffset() const {
+        if (param.slack_mode == SlackMode::CONTINUITY) {
+            return dim * M * (n + 1) + dim * 4;
+        } else {
+            return dim * M * (n + 1);
+        }
     }
 
     int TrajOptimizer::getTerminalSegments(const Agent &agent, const traj_t &initial_traj) const {
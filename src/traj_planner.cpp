@@ -1,21 +1,30 @@
 #include <traj_planner.hpp>
+#include <trace.hpp>
+#include <alloc_stats.hpp>
+#include <metrics_registry.hpp>
+#include <tuple>
 
 namespace DynamicPlanning {
     TrajPlanner::TrajPlanner(const ros::NodeHandle &_nh,
                              const Param &_param,
-                             const Mission &_mission,
+                             const std::shared_ptr<const Mission> &_mission,
                              const Agent &_agent)
-            : nh(_nh), param(_param), mission(_mission), constraints(_param, _mission), agent(_agent) {
-        // Initialize useful constants
-        buildBernsteinBasis(param.n, B, B_inv);
-
+            : nh(_nh), param(_param), mission(_mission), constraints(_param, _mission), fallback_planner(_param),
+              agent(_agent) {
         // Initialize planner state
         planner_seq = 0;
+        preparation_time = 0;
+        preparation_cpu_time = 0;
+        preparation_wait_time = 0;
         is_disturbed = false;
         is_sol_converged_by_sfc = false;
+        is_hover_ready = false;
+        is_progress_stalled = false;
+        planned_map_version = 0;
         goal_planner_state = GoalPlannerState::FORWARD;
         initialize_sfc = false;
         desired_segment_idx = param.M - 1;
+        full_M = param.M;
         if(param.planner_mode == PlannerMode::LSC){
             initialize_sfc = true;
         }
@@ -24,46 +33,265 @@ namespace DynamicPlanning {
         grid_based_planner = std::make_unique<GridBasedPlanner>(param, mission);
 
         // Initialize trajectory optimization module
-        traj_optimizer = std::make_unique<TrajOptimizer>(param, mission, B);
+        traj_optimizer = std::make_unique<TrajOptimizer>(param, mission);
+
+        // Initialize goal optimization module
+        goal_optimizer = std::make_unique<GoalOptimizer>(param, mission);
 
         // Initialize ROS
-        initializeROS();
+        if (not param.multisim_headless) {
+            initializeROS();
+        }
     }
 
     traj_t TrajPlanner::plan(const Agent &_agent,
                              const std::shared_ptr <octomap::OcTree> &_octree_ptr,
-                             const std::shared_ptr <DynamicEDTOctomap> &_distmap_ptr,
+                             const std::shared_ptr <DistanceMap> &_distmap_ptr,
+                             const std::shared_ptr <OccupancyIndex> &_occupancy_index_ptr,
+                             const std::shared_ptr <MapChangeLog> &_map_change_log_ptr,
                              ros::Time _sim_current_time,
                              bool _is_disburbed) {
+        planBeforeOptimization(_agent, _octree_ptr, _distmap_ptr, _occupancy_index_ptr, _map_change_log_ptr,
+                               _sim_current_time, _is_disburbed);
+        return planOptimization();
+    }
+
+    void TrajPlanner::planBeforeOptimization(const Agent &_agent,
+                                             const std::shared_ptr <octomap::OcTree> &_octree_ptr,
+                                             const std::shared_ptr <DistanceMap> &_distmap_ptr,
+                                             const std::shared_ptr <OccupancyIndex> &_occupancy_index_ptr,
+                                             const std::shared_ptr <MapChangeLog> &_map_change_log_ptr,
+                                             ros::Time _sim_current_time,
+                                             bool _is_disburbed) {
         // Initialize planner
         ros::Time planning_start_time = ros::Time::now();
+        StageTimer stage_timer;
+        deadline = PlanningDeadline(param.deadline_budget);
+        AllocScope alloc_scope;
         agent = _agent;
         sim_current_time = _sim_current_time;
         octree_ptr = _octree_ptr;
         distmap_ptr = _distmap_ptr;
+        map_change_log_ptr = _map_change_log_ptr;
+        planned_map_version = map_change_log_ptr != nullptr ? map_change_log_ptr->getVersion() : 0;
         constraints.setDistmap(distmap_ptr);
         constraints.setOctomap(octree_ptr);
+        constraints.setOccupancyIndex(_occupancy_index_ptr);
+        grid_based_planner->setOccupancyIndex(_occupancy_index_ptr);
         is_disturbed = _is_disburbed;
 
         // Start planning
+        traj_memo.clear();
+        consensus_offsets.clear();
         planner_seq++;
         statistics.planning_seq = planner_seq;
-        traj_t desired_traj = planImpl();
+        planImpl();
+
+        preparation_time = (ros::Time::now() - planning_start_time).toSec();
+        stage_timer.stop();
+        preparation_cpu_time = stage_timer.getCPUSeconds();
+        preparation_wait_time = stage_timer.getWaitSeconds();
+        preparation_alloc = alloc_scope.getCounts();
+    }
+
+    traj_t TrajPlanner::planOptimization() {
+        ros::Time optimization_start_time = ros::Time::now();
+        StageTimer stage_timer;
+        AllocScope alloc_scope;
+
+        // The deadline continues after the preparation, without the wait for the other agents in the batch
+        deadline = PlanningDeadline(param.deadline_budget, preparation_time);
+
+        // Trajectory optimization
+        traj_t desired_traj = extendToFullHorizon(trajOptimization());
 
         // Re-initialization for replanning
         prev_traj = desired_traj;
+        is_hover_ready = param.hover_mode and isHoverReady();
+
+        // Print terminal message, the waiting time for the other agents in the batch is excluded
+        double total_planning_time = preparation_time + (ros::Time::now() - optimization_start_time).toSec();
+        statistics.planning_time.total_planning_time.update(total_planning_time);
+        stage_timer.stop();
+        statistics.planning_time.total_planning_cpu.update(preparation_cpu_time + stage_timer.getCPUSeconds(),
+                                                           preparation_wait_time + stage_timer.getWaitSeconds());
+        if (deadline.isBounded()) {
+            statistics.deadline.n_cycles++;
+            if (total_planning_time > deadline.getBudget()) {
+                static MetricCounter &cycles_over_budget = MetricsRegistry::getInstance().getCounter(
+                        "lsc_deadline_cycles_over_budget_total",
+                        "Planning cycles over deadline/budget despite the degraded modes");
+                cycles_over_budget.increment();
+                statistics.deadline.n_cycles_over_budget++;
+            }
+        }
+        AllocCounts optimization_alloc = alloc_scope.getCounts();
+        AllocCounts planning_alloc = preparation_alloc;
+        planning_alloc.n_allocations += optimization_alloc.n_allocations;
+        planning_alloc.bytes += optimization_alloc.bytes;
+        planning_alloc.peak_live_bytes = std::max(preparation_alloc.peak_live_bytes,
+                                                  preparation_alloc.live_bytes + optimization_alloc.peak_live_bytes);
+        planning_alloc.live_bytes += optimization_alloc.live_bytes;
+        statistics.alloc.total_planning.update(planning_alloc);
 
-        // Print terminal message
-        statistics.planning_time.total_planning_time.update((ros::Time::now() - planning_start_time).toSec());
+        return desired_traj;
+    }
 
+    traj_t TrajPlanner::planConsensusIteration(const std::vector<ConsensusMessage> &messages, double &max_change) {
+        TRACE_SCOPE("TrajPlanner::planConsensusIteration");
+        // Dual update, the margin moves to the agent whose LSC binds more than the one of its neighbor
+        ConsensusMessage message = getConsensusMessage();
+        for (const auto &neighbor_prices: message.prices) {
+            int neighbor_id = neighbor_prices.first;
+            const std::vector<double> &prices = neighbor_prices.second;
+            if (neighbor_id < 0 or static_cast<size_t>(neighbor_id) >= messages.size() or
+                messages[neighbor_id].traj.empty()) {
+                continue;
+            }
+            auto it = messages[neighbor_id].prices.find(agent.id);
+            if (it == messages[neighbor_id].prices.end() or it->second.size() != prices.size()) {
+                continue;
+            }
+            std::vector<double> &offsets = consensus_offsets[neighbor_id];
+            offsets.resize(prices.size(), 0);
+            for (size_t k = 0; k < prices.size(); k++) {
+                offsets[k] += param.multisim_admm_rho * (it->second[k] - prices[k]);
+            }
+        }
+
+        // The iterates start at the current states, so they are used without the time shift
+        for (int m = 0; m < param.M; m++) {
+            initial_traj[m] = prev_traj[m];
+        }
+        for (size_t oi = 0; oi < obstacles.size(); oi++) {
+            int obs_id = neighbors.getId(oi);
+            if (neighbors.getType(oi) != ObstacleType::AGENT or obs_id < 0 or
+                static_cast<size_t>(obs_id) >= messages.size() or messages[obs_id].traj.empty()) {
+                continue;
+            }
+            const traj_t &estimate = messages[obs_id].traj;
+            obs_pred_trajs[oi].reset(param.M, param.n, param.dt);
+            for (int m = 0; m < param.M; m++) {
+                if (m >= estimate.size()) {
+                    for (int i = 0; i < param.n + 1; i++) {
+                        obs_pred_trajs[oi][m][i] = estimate.lastPoint();
+                    }
+                } else {
+                    obs_pred_trajs[oi][m] = estimate[m];
+                }
+            }
+            obs_pred_traj_ptrs[oi] = &obs_pred_trajs[oi];
+        }
+
+        // The SFCs contain the iterate, only the LSCs are built again
+        traj_memo.clear();
+        constructLSC();
+        reduceCollisionConstraints();
+
+        deadline = PlanningDeadline(param.deadline_budget);
+        is_consensus_iteration = true;
+        traj_t desired_traj = extendToFullHorizon(trajOptimization());
+        is_consensus_iteration = false;
+
+        max_change = 0;
+        for (int m = 0; m < desired_traj.size() and m < prev_traj.size(); m++) {
+            for (int i = 0; i < param.n + 1; i++) {
+                max_change = std::max(max_change, (desired_traj[m][i] - prev_traj[m][i]).norm());
+            }
+        }
+        prev_traj = desired_traj;
+        is_hover_ready = param.hover_mode and isHoverReady();
+
+        static MetricCounter &admm_iterations = MetricsRegistry::getInstance().getCounter(
+                "lsc_admm_iterations_total", "ADMM iterations of the agents on their shared LSCs");
+        admm_iterations.increment();
         return desired_traj;
     }
 
+    ConsensusMessage TrajPlanner::getConsensusMessage() const {
+        ConsensusMessage message;
+        message.traj = prev_traj;
+        if (prev_traj.size() < param.M) {
+            return message;
+        }
+
+        // The price grows as the iterate gets closer to the LSC than the radius of the agent
+        for (size_t oi = 0; oi < obstacles.size(); oi++) {
+            if (neighbors.getType(oi) != ObstacleType::AGENT or constraints.isDynamicObstacle(static_cast<int>(oi))) {
+                continue;
+            }
+            std::vector<double> &prices = message.prices[neighbors.getId(oi)];
+            prices.resize(param.M * (param.n + 1));
+            for (int m = 0; m < param.M; m++) {
+                for (int i = 0; i < param.n + 1; i++) {
+                    LSC lsc = constraints.getLSC(static_cast<int>(oi), m, i);
+                    double margin = (prev_traj[m][i] - lsc.obs_control_point).dot(lsc.normal_vector) - lsc.d;
+                    prices[m * (param.n + 1) + i] = std::min(std::max(1 - margin / agent.radius, 0.0), 1.0);
+                }
+            }
+        }
+        return message;
+    }
+
+    traj_t TrajPlanner::planHold(const Agent &_agent) {
+        agent = _agent;
+        planner_seq++;
+        statistics.planning_seq = planner_seq;
+        initialTrajPlanningPrevSol();
+        prev_traj = extendToFullHorizon(initial_traj);
+
+        return prev_traj;
+    }
+
+    bool TrajPlanner::isHoverCertified(const Agent &_agent, uint64_t map_version) const {
+        if (not is_hover_ready or map_version != planned_map_version or
+            _agent.current_state.position.distance(prev_traj.startPoint()) > param.hover_tolerance) {
+            return false;
+        }
+
+        // The agents are bounded by their previous trajectories, which they follow or replan within the LSCs, and
+        // the dynamic obstacles by their max acceleration. The distances are compared in the coordinates scaled by
+        // the downwash.
+        double horizon = full_M * param.dt;
+        for (size_t oi = 0; oi < neighbors.size(); oi++) {
+            double downwash = downwashBetween(static_cast<int>(oi));
+            double collision_dist = agent.radius + neighbors.getRadius(oi);
+            point3d hover_point = coordinateTransform(prev_traj.startPoint(), downwash);
+            const traj_t &obs_prev_traj = neighbors.getPrevTraj(oi);
+            if (neighbors.getType(oi) == ObstacleType::AGENT and not obs_prev_traj.empty()) {
+                for (int m = 0; m < obs_prev_traj.size(); m++) {
+                    point3d box_min = coordinateTransform(obs_prev_traj[m][0], downwash);
+                    point3d box_max = box_min;
+                    for (const auto &control_point: obs_prev_traj[m].control_points) {
+                        point3d point = coordinateTransform(control_point, downwash);
+                        for (int k = 0; k < 3; k++) {
+                            box_min(k) = std::min(box_min(k), point(k));
+                            box_max(k) = std::max(box_max(k), point(k));
+                        }
+                    }
+                    if (Box(box_min, box_max).distanceToPoint(hover_point) < collision_dist) {
+                        return false;
+                    }
+                }
+            } else {
+                double scale = 1 / std::min(downwash, 1.0);
+                double obs_reach = scale * (neighbors.getVelocity(oi).norm() * horizon +
+                                            0.5 * neighbors.getMaxAcc(oi) * horizon * horizon);
+                double dist = (coordinateTransform(neighbors.getPosition(oi), downwash) - hover_point).norm();
+                if (dist < collision_dist + obs_reach) {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
     void TrajPlanner::publish() {
         if(param.log_vis){
 //            publishInitialTraj();
 //            publishCollisionConstraints();
-//            publishGridOccupiedPoints();
+            publishGridOccupiedPoints();
             publishFeasibleRegion();
             publishGridPath();
         }
@@ -72,8 +300,17 @@ namespace DynamicPlanning {
         publishLSC();
     }
 
-    void TrajPlanner::setObstacles(const std::vector<Obstacle> &msg_obstacles) {
-        obstacles = msg_obstacles;
+    void TrajPlanner::setObstacles(std::vector<Obstacle> msg_obstacles) {
+        obstacles = std::move(msg_obstacles);
+        neighbors.assign(obstacles);
+    }
+
+    void TrajPlanner::setObstaclePredictionTable(std::shared_ptr<const ObstaclePredictionTable> table) {
+        next_obstacle_prediction_table = std::move(table);
+    }
+
+    void TrajPlanner::setProgressStalled(bool is_stalled) {
+        is_progress_stalled = is_stalled;
     }
 
     int TrajPlanner::getPlannerSeq() const {
@@ -103,21 +340,27 @@ namespace DynamicPlanning {
     void TrajPlanner::initializeROS() {
         // Initialize ros publisher and subscriber
         std::string prefix = "/mav" + std::to_string(agent.id);
-        pub_sfc = nh.advertise<visualization_msgs::MarkerArray>(prefix + "/sfc", 1);
-        pub_lsc = nh.advertise<visualization_msgs::MarkerArray>(prefix + "/lsc", 1);
-        pub_feasible_region = nh.advertise<visualization_msgs::MarkerArray>("/feasible_region", 1);
-        pub_initial_traj_vis = nh.advertise<visualization_msgs::MarkerArray>(
-                prefix + "/initial_traj_vis", 1);
-        pub_obs_pred_traj_vis = nh.advertise<visualization_msgs::MarkerArray>("/obs_pred_traj_vis", 1);
-        pub_grid_path = nh.advertise<visualization_msgs::MarkerArray>("/grid_path_vis", 1);
-        pub_grid_occupied_points = nh.advertise<visualization_msgs::MarkerArray>(
-                prefix + "/grid_occupied_points", 1);
-    }
-
-    traj_t TrajPlanner::planImpl() {
+        bool lazy = param.multisim_lazy_publishers;
+        typedef visualization_msgs::MarkerArray MarkerArray;
+        pub_sfc.initialize<MarkerArray>(nh, prefix + "/sfc", 1, lazy);
+        pub_lsc.initialize<MarkerArray>(nh, prefix + "/lsc", 1, lazy);
+        pub_feasible_region.initialize<MarkerArray>(nh, "/feasible_region", 1, lazy);
+        pub_initial_traj_vis.initialize<MarkerArray>(nh, prefix + "/initial_traj_vis", 1, lazy);
+        pub_obs_pred_traj_vis.initialize<MarkerArray>(nh, "/obs_pred_traj_vis", 1, lazy);
+        pub_grid_path.initialize<MarkerArray>(nh, "/grid_path_vis", 1, lazy);
+        pub_grid_occupied_points.initialize<MarkerArray>(nh, prefix + "/grid_occupied_points", 1, lazy);
+    }
+
+    void TrajPlanner::planImpl() {
         // Check the current planner mode is valid.
         checkPlannerMode();
 
+        // Leave out the obstacles that can not interact with the agent
+        selectNeighbors();
+
+        // Plan fewer segments if there are few neighbors
+        adaptHorizon();
+
         // Plan initial trajectory of the other agents
         obstaclePrediction();
 
@@ -130,12 +373,11 @@ namespace DynamicPlanning {
         // construct SFC
         constructSFC();
 
+        // Remove redundant LSCs
+        reduceCollisionConstraints();
+
         // Goal planning
         goalPlanning();
-
-        // Trajectory optimization
-        traj_t desired_traj = trajOptimization();
-        return desired_traj;
     }
 
     void TrajPlanner::checkPlannerMode() {
@@ -144,6 +386,103 @@ namespace DynamicPlanning {
             return;
         }
 
+        SlackMode slack_mode = param.slack_mode;
+        validatePlannerMode(param);
+        if (param.slack_mode != slack_mode) {
+            traj_optimizer->updateParam(param);
+        }
+
+        if (param.world_use_octomap and distmap_ptr == nullptr) {
+            throw std::invalid_argument("[TrajPlanner] Distmap is not ready");
+        }
+    }
+
+    void TrajPlanner::updateParam(const Param &_param) {
+        // Validate first, the planner is unchanged if the parameters are invalid
+        Param new_param = _param;
+        validatePlannerMode(new_param);
+        Param current_param = param;
+        current_param.M = full_M; // the adaptive horizon does not change the structure
+        bool is_structure_changed = current_param.isTrajectoryStructureChanged(new_param);
+        traj_optimizer->updateParam(new_param);
+        param = new_param;
+        full_M = param.M;
+        is_hover_ready = false; // the agent plans once with the new parameters before hovering
+        constraints.setParam(param);
+        grid_based_planner->updateParam(param);
+        goal_optimizer->updateParam(param);
+        fallback_planner.updateParam(param);
+
+        // The previous solution has the old segments, start again from the current state as at the first step
+        if (is_structure_changed) {
+            planner_seq = 0;
+            initialize_sfc = true;
+            desired_segment_idx = param.M - 1;
+            lsc_normal_caches.clear();
+        }
+    }
+
+    void TrajPlanner::resetMission(const std::shared_ptr<const Mission> &_mission, const Agent &_agent) {
+        mission = _mission;
+        agent = _agent;
+        if (param.M != full_M) {
+            setHorizon(full_M);
+        }
+        constraints = CollisionConstraints(param, mission);
+        grid_based_planner->resetMission(mission);
+        traj_optimizer->resetMission(mission);
+        goal_optimizer->resetMission(mission);
+
+        // Same as the constructor
+        planner_seq = 0;
+        statistics = PlanningStatistics();
+        preparation_time = 0;
+        preparation_cpu_time = 0;
+        preparation_wait_time = 0;
+        is_disturbed = false;
+        is_sol_converged_by_sfc = false;
+        is_hover_ready = false;
+        is_progress_stalled = false;
+        is_consensus_iteration = false;
+        planned_map_version = 0;
+        goal_planner_state = GoalPlannerState::FORWARD;
+        initialize_sfc = param.planner_mode == PlannerMode::LSC;
+        desired_segment_idx = param.M - 1;
+        sfc_converged = Box();
+
+        initial_traj = traj_t();
+        prev_traj = traj_t();
+        octree_ptr.reset();
+        distmap_ptr.reset();
+        map_change_log_ptr.reset();
+        obstacles.clear();
+        neighbor_indices.clear();
+        obs_pred_trajs.clear();
+        obs_pred_sizes.clear();
+        obs_pred_traj_ptrs.clear();
+        obs_pred_size_ptrs.clear();
+        obstacle_prediction_table.reset();
+        next_obstacle_prediction_table.reset();
+        col_pred_obs_indices.clear();
+        consensus_offsets.clear();
+        lsc_normal_caches.clear();
+        traj_memo.clear();
+        obstacle_filter_bank = KalmanFilterBank();
+    }
+
+    void TrajPlanner::validatePlannerMode(Param &param) {
+        if (param.adaptive_horizon and
+            (param.adaptive_horizon_min_M < 2 or param.adaptive_horizon_min_M > param.M or
+             param.adaptive_horizon_neighbors < 1)) {
+            throw std::invalid_argument("[TrajPlanner] adaptive_horizon_min_M must be in [2, M], and "
+                                        "adaptive_horizon_neighbors must be positive");
+        }
+        if (param.adaptive_horizon and param.planner_mode != PlannerMode::LSC) {
+            // The trajectory is held at its last point, which needs the stop constraint of LSC
+            ROS_WARN("[TrajPlanner] adaptive_horizon supports only LSC, fix to false");
+            param.adaptive_horizon = false;
+        }
+
         switch (param.planner_mode) {
             case PlannerMode::DLSC:
                 if (param.multisim_time_step > param.dt) {
@@ -152,12 +491,10 @@ namespace DynamicPlanning {
                 else if(param.multisim_time_step == param.dt and param.slack_mode != SlackMode::NONE){
                     ROS_WARN("[TrajPlanner] DLSC does not need slack variables when multisim_time_step == segment time, fix SlackMode to none");
                     param.slack_mode = SlackMode::NONE;
-                    traj_optimizer->updateParam(param);
                 }
                 else if(param.multisim_time_step < param.dt and param.slack_mode != SlackMode::CONTINUITY){
                     ROS_WARN("[TrajPlanner] DLSC requires slack variables when multisim_time_step < segment time, fix SlackMode to dynamical_limit");
                     param.slack_mode = SlackMode::CONTINUITY;
-                    traj_optimizer->updateParam(param);
                 }
 
                 if (param.prediction_mode != PredictionMode::PREVIOUSSOLUTION) {
@@ -184,7 +521,6 @@ namespace DynamicPlanning {
                 if(param.slack_mode != SlackMode::NONE){
                     ROS_WARN("[TrajPlanner] LSC does not need slack variables, fix to none");
                     param.slack_mode = SlackMode::NONE;
-                    traj_optimizer->updateParam(param);
                 }
                 break;
             case PlannerMode::BVC:
@@ -211,157 +547,273 @@ namespace DynamicPlanning {
                 if (param.slack_mode != SlackMode::COLLISIONCONSTRAINT) {
                     ROS_WARN("[TrajPlanner] Reciprocal RSFC needs slack variables at collision constraints");
                     param.slack_mode = SlackMode::COLLISIONCONSTRAINT;
-                    traj_optimizer->updateParam(param);
                 }
                 break;
         }
+    }
 
-        if (param.world_use_octomap and distmap_ptr == nullptr) {
-            throw std::invalid_argument("[TrajPlanner] Distmap is not ready");
+    void TrajPlanner::selectNeighbors() {
+        size_t n_candidates = obstacles.size();
+        if (not param.neighbor_pruning and param.max_neighbors <= 0) {
+            statistics.neighbor.update(static_cast<int>(n_candidates), 0, 0);
+            return;
+        }
+
+        // The agent moves at most by its current velocity and the max acceleration within the horizon, bounded by the
+        // max velocity, and its initial trajectory is the previous one. The obstacles are bounded in the same way
+        // by their own max acceleration and their previous trajectories. The full horizon is used even if the
+        // adaptive horizon is shortened, since the neighbors decide the horizon.
+        double horizon = full_M * param.dt;
+        double agent_reach = std::min(agent.current_state.velocity.norm() * horizon +
+                                      0.5 * agent.max_acc[0] * horizon * horizon,
+                                      agent.max_vel[0] * horizon);
+        if (param.use_velocity_guard) {
+            agent_reach += param.velocity_guard_ratio * agent.current_state.velocity.norm_sq() / agent.max_acc[0];
+        }
+
+        neighbor_gaps.resize(n_candidates);
+        neighbor_indices.clear();
+        for (size_t oi = 0; oi < n_candidates; oi++) {
+            // The distances are compared in the coordinates scaled by the downwash, which stretch z if it is below 1
+            const point3d &obs_position = neighbors.getPosition(oi);
+            double downwash = downwashBetween(static_cast<int>(oi));
+            double scale = 1 / std::min(downwash, 1.0);
+            double obs_reach = getObstacleReach(oi, horizon);
+            double reach = std::max(scale * agent_reach, getTrajectoryExtent(prev_traj, agent.current_state.position,
+                                                                             downwash)) + obs_reach;
+            double dist = coordinateTransform(obs_position - agent.current_state.position, downwash).norm();
+            neighbor_gaps[oi] = dist - agent.radius - neighbors.getRadius(oi) - reach;
+            if (not param.neighbor_pruning or neighbor_gaps[oi] < 0) {
+                neighbor_indices.emplace_back(oi);
+            }
         }
+        size_t n_reachable = neighbor_indices.size();
+
+        // The obstacles closest to contact first, the kept obstacles stay in their order
+        if (param.max_neighbors > 0 and neighbor_indices.size() > static_cast<size_t>(param.max_neighbors)) {
+            auto nth = neighbor_indices.begin() + param.max_neighbors;
+            std::nth_element(neighbor_indices.begin(), nth, neighbor_indices.end(), [this](size_t oi, size_t oj) {
+                return neighbor_gaps[oi] < neighbor_gaps[oj] or (neighbor_gaps[oi] == neighbor_gaps[oj] and oi < oj);
+            });
+            neighbor_indices.erase(nth, neighbor_indices.end());
+            std::sort(neighbor_indices.begin(), neighbor_indices.end());
+        }
+
+        // The indices are ascending, so an obstacle is moved only to the front
+        for (size_t k = 0; k < neighbor_indices.size(); k++) {
+            if (neighbor_indices[k] != k) {
+                obstacles[k] = std::move(obstacles[neighbor_indices[k]]);
+            }
+        }
+        obstacles.erase(obstacles.begin() + static_cast<long>(neighbor_indices.size()), obstacles.end());
+        neighbors.select(neighbor_indices);
+
+        statistics.neighbor.update(static_cast<int>(n_candidates), static_cast<int>(n_candidates - n_reachable),
+                                   static_cast<int>(n_reachable - neighbor_indices.size()));
+    }
+
+    void TrajPlanner::adaptHorizon() {
+        if (not param.adaptive_horizon) {
+            return;
+        }
+
+        // All segments are planned with an agent nearby, since the LSCs of both agents are built up to the end of
+        // their horizons, and near the goal, so that the arrival is planned as with the fixed horizon
+        int horizon_M = full_M;
+        bool has_agent_neighbor = false;
+        for (size_t oi = 0; oi < neighbors.size(); oi++) {
+            has_agent_neighbor = has_agent_neighbor or neighbors.getType(oi) == ObstacleType::AGENT;
+        }
+        double dist_to_goal = (agent.current_state.position - agent.desired_goal_point).norm();
+        if (not has_agent_neighbor and dist_to_goal > agent.max_vel[0] * full_M * param.dt) {
+            // The segments grow with the dynamic obstacles left after the neighbor selection
+            int n_neighbors = std::min(static_cast<int>(obstacles.size()), param.adaptive_horizon_neighbors);
+            horizon_M = param.adaptive_horizon_min_M +
+                        (full_M - param.adaptive_horizon_min_M) * n_neighbors / param.adaptive_horizon_neighbors;
+        }
+
+        bool is_switched = horizon_M != param.M;
+        if (is_switched) {
+            setHorizon(horizon_M);
+        }
+        statistics.horizon.update(horizon_M, is_switched);
     }
 
+    void TrajPlanner::setHorizon(int horizon_M) {
+        param.M = horizon_M;
+        constraints.setParam(param);
+        grid_based_planner->updateParam(param);
+        goal_optimizer->updateParam(param);
+        traj_optimizer->setHorizon(horizon_M);
+    }
+
+    traj_t TrajPlanner::extendToFullHorizon(const traj_t &traj) const {
+        if (traj.size() >= full_M) {
+            return traj;
+        }
+
+        // The trajectory ends at rest by the stop constraint, so the last point is held to the end of the horizon
+        traj_t full_traj(full_M, param.n, param.dt);
+        for (int m = 0; m < traj.size(); m++) {
+            full_traj[m] = traj[m];
+        }
+        point3d last_point = traj.lastPoint();
+        for (int m = traj.size(); m < full_M; m++) {
+            for (int i = 0; i < param.n + 1; i++) {
+                full_traj[m][i] = last_point;
+            }
+        }
+        return full_traj;
+    }
+
+    double TrajPlanner::getTrajectoryExtent(const traj_t &traj, const point3d &position, double downwash) {
+        double extent = 0;
+        for (int m = 0; m < traj.size(); m++) {
+            for (const auto &control_point: traj[m].control_points) {
+                extent = std::max(extent, coordinateTransform(control_point - position, downwash).norm());
+            }
+        }
+        return extent;
+    }
+
+    double TrajPlanner::getObstacleReach(size_t oi, double horizon) const {
+        double downwash = downwashBetween(static_cast<int>(oi));
+        double scale = 1 / std::min(downwash, 1.0);
+        return std::max(scale * (neighbors.getVelocity(oi).norm() * horizon +
+                                 0.5 * neighbors.getMaxAcc(oi) * horizon * horizon),
+                        getTrajectoryExtent(neighbors.getPrevTraj(oi), neighbors.getPosition(oi), downwash));
+    }
 
     void TrajPlanner::obstaclePrediction() {
+        TRACE_SCOPE("TrajPlanner::obstaclePrediction");
         // Timer start
         ros::Time obs_pred_start_time = ros::Time::now();
+        StageTimer stage_timer;
+        AllocScope alloc_scope;
 
-        // Initialize obstacle predicted trajectory
+        // Initialize obstacle predicted trajectory, the buffers of the previous step are reused
         size_t N_obs = obstacles.size();
         obs_pred_trajs.resize(N_obs);
         obs_pred_sizes.resize(N_obs);
-
-        switch (param.prediction_mode) {
-            case PredictionMode::POSITION:
-                obstaclePredictionWithCurrPos();
-                break;
-            case PredictionMode::VELOCITY:
-                obstaclePredictionWithCurrVel();
-                break;
-            case PredictionMode::PREVIOUSSOLUTION:
-                obstaclePredictionWithPrevSol();
-                break;
-            default:
-                throw std::invalid_argument("[TrajPlanner] Invalid obstacle prediction mode");
+        if (param.prediction_mode != PredictionMode::POSITION and param.prediction_mode != PredictionMode::VELOCITY and
+            param.prediction_mode != PredictionMode::PREVIOUSSOLUTION) {
+            throw std::invalid_argument("[TrajPlanner] Invalid obstacle prediction mode");
+        }
+        if (param.prediction_mode == PredictionMode::PREVIOUSSOLUTION and planner_seq >= 2 and
+            param.multisim_time_step > param.dt and
+            std::any_of(obstacles.begin(), obstacles.end(),
+                        [](const Obstacle &obstacle) { return obstacle.type == ObstacleType::AGENT; })) {
+            throw std::invalid_argument("[TrajPlanner] obs_pred_prev_sol supports only LSC, LSC2");
         }
 
-        checkObstacleDisturbance();
-        obstacleSizePredictionWithConstAcc();
+        // The predictions of the obstacles are independent, each task writes only to the buffers of its obstacle.
+        // The dynamic obstacles found in the shared table are read from it, the table is kept until the next
+        // prediction so that the pointers stay valid.
+        obstacle_prediction_table = next_obstacle_prediction_table;
+        obs_pred_traj_ptrs.assign(N_obs, nullptr);
+        obs_pred_size_ptrs.assign(N_obs, nullptr);
+        runObstacleTasks([this](size_t oi) {
+            if (obstacle_prediction_table != nullptr) {
+                obs_pred_traj_ptrs[oi] = obstacle_prediction_table->findTraj(obstacles[oi]);
+                if (obs_pred_traj_ptrs[oi] != nullptr) {
+                    return;
+                }
+            }
+            switch (param.prediction_mode) {
+                case PredictionMode::POSITION:
+                    obstaclePredictionWithCurrPos(oi);
+                    break;
+                case PredictionMode::VELOCITY:
+                    obstaclePredictionWithCurrVel(oi);
+                    break;
+                default:
+                    obstaclePredictionWithPrevSol(oi);
+                    break;
+            }
+            checkObstacleDisturbance(oi);
+            obs_pred_traj_ptrs[oi] = &obs_pred_trajs[oi];
+        });
+        ros::Time obs_traj_pred_end_time = ros::Time::now();
+
+        double velocity_guard = 0;
+        if (param.use_velocity_guard) {
+            velocity_guard =
+                    param.velocity_guard_ratio * (agent.current_state.velocity.norm_sq()) / agent.max_acc[0];
+        }
+        runObstacleTasks([this, velocity_guard](size_t oi) {
+            // The shared sizes do not include the velocity guard of this agent
+            if (obstacle_prediction_table != nullptr and velocity_guard == 0) {
+                obs_pred_size_ptrs[oi] = obstacle_prediction_table->findSize(obstacles[oi]);
+                if (obs_pred_size_ptrs[oi] != nullptr) {
+                    return;
+                }
+            }
+            obstacleSizePredictionWithConstAcc(oi, velocity_guard);
+            obs_pred_size_ptrs[oi] = &obs_pred_sizes[oi];
+        });
 
         // Timer end
         ros::Time obs_pred_end_time = ros::Time::now();
+        statistics.planning_time.obstacle_traj_prediction_time.update(
+                (obs_traj_pred_end_time - obs_pred_start_time).toSec());
+        statistics.planning_time.obstacle_size_prediction_time.update(
+                (obs_pred_end_time - obs_traj_pred_end_time).toSec());
         statistics.planning_time.obstacle_prediction_time.update((obs_pred_end_time - obs_pred_start_time).toSec());
+        stage_timer.stop();
+        statistics.planning_time.obstacle_prediction_cpu.update(stage_timer.getCPUSeconds(),
+                                                                stage_timer.getWaitSeconds());
+        statistics.alloc.obstacle_prediction.update(alloc_scope.getCounts());
     }
 
-    void TrajPlanner::obstaclePredictionWithCurrPos() {
-        for (size_t oi = 0; oi < obstacles.size(); oi++) {
-            obs_pred_trajs[oi] = Trajectory<point3d>(param.M, param.n, param.dt);
-            obs_pred_trajs[oi].planConstVelTraj(obstacles[oi].position, point3d(0, 0, 0));
-        }
+    void TrajPlanner::obstaclePredictionWithCurrPos(size_t oi) {
+        predictObstacleTraj(param, obstacles[oi], false, obs_pred_trajs[oi]);
     }
 
-    void TrajPlanner::obstaclePredictionWithCurrVel() {
+    void TrajPlanner::obstaclePredictionWithCurrVel(size_t oi) {
         // Obstacle prediction with constant velocity assumption
         // It assumes that correct position and velocity are given
-        size_t N_obs = obstacles.size();
-        for (size_t oi = 0; oi < N_obs; oi++) {
-            obs_pred_trajs[oi] = Trajectory<point3d>(param.M, param.n, param.dt);
-            obs_pred_trajs[oi].planConstVelTraj(obstacles[oi].position, obstacles[oi].velocity);
-        }
+        predictObstacleTraj(param, obstacles[oi], true, obs_pred_trajs[oi]);
     }
 
-    void TrajPlanner::obstaclePredictionWithPrevSol() {
+    void TrajPlanner::obstaclePredictionWithPrevSol(size_t oi) {
         // Dynamic obstacle -> constant velocity, Agent -> prev sol
         // Use current velocity to predict the obstacle while the first iteration
-        if (planner_seq < 2) {
-            obstaclePredictionWithCurrVel();
+        if (planner_seq < 2 or neighbors.getType(oi) != ObstacleType::AGENT) {
+            // if the obstacle is not agent, use current velocity to predict trajectory
+            obstaclePredictionWithCurrVel(oi);
             return;
         }
 
-        for (size_t oi = 0; oi < obstacles.size(); oi++) {
-            obs_pred_trajs[oi] = Trajectory<point3d>(param.M, param.n, param.dt);
-
-            if (obstacles[oi].type != ObstacleType::AGENT) {
-                // if the obstacle is not agent, use current velocity to predict trajectory
-                obs_pred_trajs[oi].planConstVelTraj(obstacles[oi].position, obstacles[oi].velocity);
-            } else if (param.multisim_time_step == param.dt) {
-                // feasible LSC: generate C^n-continuous LSC
-                for (int m = 0; m < param.M; m++) {
-                    if (m == param.M - 1) {
-                        for (int i = 0; i < param.n + 1; i++) {
-                            obs_pred_trajs[oi][m][i] = obstacles[oi].prev_traj[m][param.n];
-                        }
-                    } else {
-                        obs_pred_trajs[oi][m] = obstacles[oi].prev_traj[m + 1];
-                    }
-                }
-            } else if (param.multisim_time_step < param.dt) {
-                // relaxed LSC: generate C^0-continuous LSC
-                for (int m = 0; m < param.M; m++) {
-                    obs_pred_trajs[oi][m] = obstacles[oi].prev_traj[m];
-                    if (m == 0) {
-                        obs_pred_trajs[oi][m] = obstacles[oi].prev_traj[m].subSegment(param.multisim_time_step / param.dt, 1, B, B_inv);
-                    }
-                }
-            } else {
-                throw std::invalid_argument("[TrajPlanner] obs_pred_prev_sol supports only LSC, LSC2");
-            }
+        // The sender shifts its trajectory once for all receivers if it is shared, see predictShiftedTraj
+        const traj_t *obs_shifted_traj = neighbors.getShiftedTraj(oi);
+        if (obs_shifted_traj != nullptr and obs_shifted_traj->size() == param.M) {
+            obs_pred_trajs[oi] = *obs_shifted_traj;
+        } else {
+            predictShiftedTraj(param, neighbors.getPrevTraj(oi), obs_pred_trajs[oi]);
         }
     }
 
-    void TrajPlanner::checkObstacleDisturbance() {
-        for (size_t oi = 0; oi < obstacles.size(); oi++) {
-            point3d obs_position = obstacles[oi].position;
-            if ((obs_pred_trajs[oi].startPoint() - obs_position).norm() > param.reset_threshold) {
-                obs_pred_trajs[oi].planConstVelTraj(obs_position, point3d(0, 0, 0));
-            }
+    void TrajPlanner::checkObstacleDisturbance(size_t oi) {
+        point3d obs_position = neighbors.getPosition(oi);
+        if ((obs_pred_trajs[oi].startPoint() - obs_position).norm() > param.reset_threshold) {
+            obs_pred_trajs[oi].planConstVelTraj(obs_position, point3d(0, 0, 0));
         }
     }
 
-    void TrajPlanner::obstacleSizePredictionWithConstAcc() {
-        int M_uncertainty = static_cast<int>((param.obs_uncertainty_horizon + SP_EPSILON) / param.dt);
-        double velocity_guard = 0;
-        if (param.use_velocity_guard) {
-            velocity_guard =
-                    param.velocity_guard_ratio * (agent.current_state.velocity.norm_sq()) / agent.max_acc[0];
-        }
-
-        for (size_t oi = 0; oi < obstacles.size(); oi++) {
-            obs_pred_sizes[oi] = Trajectory<double>(param.M, param.n, param.dt);
-            if (param.obs_size_prediction and (param.planner_mode == PlannerMode::RECIPROCALRSFC or
-                                               obstacles[oi].type == ObstacleType::DYNAMICOBSTACLE)) {
-                // Predict obstacle size using max acc
-                double max_acc;
-                max_acc = obstacles[oi].max_acc;
-                for (int m = 0; m < M_uncertainty; m++) {
-                    Eigen::MatrixXd coef = Eigen::MatrixXd::Zero(1, param.n + 1);
-                    coef(0, 0) = 0.5 * max_acc * pow(m * param.dt, 2);
-                    coef(0, 1) = max_acc * m * param.dt * param.dt;
-                    coef(0, 2) = 0.5 * max_acc * pow(param.dt, 2);
-
-                    Eigen::MatrixXd control_points = coef * B_inv;
-                    for (int i = 0; i < param.n + 1; i++) {
-                        obs_pred_sizes[oi][m][i] = obstacles[oi].radius + velocity_guard + control_points(0, i);
-                    }
-                }
-                for (int m = M_uncertainty; m < param.M; m++) {
-                    for (int i = 0; i < param.n + 1; i++) {
-                        obs_pred_sizes[oi][m][i] = obstacles[oi].radius +
-                                                   velocity_guard +
-                                                   0.5 * max_acc * pow(M_uncertainty * param.dt, 2);
-                    }
-                }
-            } else {
-                obs_pred_sizes[oi].planConstVelTraj(obstacles[oi].radius, 0);
-            }
-        }
+    void TrajPlanner::obstacleSizePredictionWithConstAcc(size_t oi, double velocity_guard) {
+        bool grow_size = param.obs_size_prediction and (param.planner_mode == PlannerMode::RECIPROCALRSFC or
+                                                        neighbors.getType(oi) == ObstacleType::DYNAMICOBSTACLE);
+        predictObstacleSize(param, obstacles[oi], velocity_guard, grow_size, obs_pred_sizes[oi]);
     }
 
     void TrajPlanner::initialTrajPlanning() {
+        TRACE_SCOPE("TrajPlanner::initialTrajPlanning");
         // Timer start
         ros::Time init_traj_planning_start_time = ros::Time::now();
+        StageTimer stage_timer;
+        AllocScope alloc_scope;
 
-        initial_traj = Trajectory<point3d>(param.M, param.n, param.dt);
+        initial_traj.reset(param.M, param.n, param.dt);
         switch (param.initial_traj_mode) {
             case InitialTrajMode::POSITION:
                 initialTrajPlanningCurrPos();
@@ -384,8 +836,12 @@ namespace DynamicPlanning {
 
         // Timer end
         ros::Time init_traj_planning_end_time = ros::Time::now();
+        stage_timer.stop();
+        statistics.planning_time.initial_traj_planning_cpu.update(stage_timer.getCPUSeconds(),
+                                                                  stage_timer.getWaitSeconds());
         statistics.planning_time.initial_traj_planning_time.update(
                 (init_traj_planning_end_time - init_traj_planning_start_time).toSec());
+        statistics.alloc.initial_traj_planning.update(alloc_scope.getCounts());
     }
 
     void TrajPlanner::initialTrajPlanningCurrPos() {
@@ -399,26 +855,10 @@ namespace DynamicPlanning {
     void TrajPlanner::initialTrajPlanningPrevSol() {
         if (planner_seq < 2) {
             initialTrajPlanningCurrVel();
-        } else if (param.multisim_time_step == param.dt) {
-            for (int m = 0; m < param.M; m++) {
-                if (m == param.M - 1) {
-                    for (int i = 0; i < param.n + 1; i++) {
-                        initial_traj[m][i] = prev_traj[m][param.n];
-                    }
-                } else {
-                    initial_traj[m] = prev_traj[m + 1];
-                }
-            }
-        } else if (param.multisim_time_step < param.dt) {
-            for (int m = 0; m < param.M; m++) {
-                if (m == 0) {
-                    initial_traj[m] = prev_traj[m].subSegment(param.multisim_time_step / param.dt, 1, B, B_inv);
-                    initial_traj[m].segment_time = param.dt;
-                }
-                else{
-                    initial_traj[m] = prev_traj[m];
-                }
-            }
+        } else if (param.multisim_time_step <= param.dt) {
+            // The previous solution is longer than the horizon if the adaptive horizon is shortened
+            predictShiftedTraj(param, prev_traj, initial_traj);
+            initial_traj[0].segment_time = param.dt;
         }
     }
 
@@ -431,8 +871,11 @@ namespace DynamicPlanning {
     }
 
     void TrajPlanner::goalPlanning() {
+        TRACE_SCOPE("TrajPlanner::goalPlanning");
         // Timer start
         ros::Time goal_planning_start_time = ros::Time::now();
+        StageTimer stage_timer;
+        AllocScope alloc_scope;
 
         if (is_disturbed) {
             agent.current_goal_point = agent.current_state.position;
@@ -460,6 +903,9 @@ namespace DynamicPlanning {
         // Timer end
         ros::Time goal_planning_end_time = ros::Time::now();
         statistics.planning_time.goal_planning_time.update((goal_planning_end_time - goal_planning_start_time).toSec());
+        stage_timer.stop();
+        statistics.planning_time.goal_planning_cpu.update(stage_timer.getCPUSeconds(), stage_timer.getWaitSeconds());
+        statistics.alloc.goal_planning.update(alloc_scope.getCounts());
     }
 
     void TrajPlanner::goalPlanningWithStaticGoal() {
@@ -469,6 +915,9 @@ namespace DynamicPlanning {
     void TrajPlanner::goalPlanningWithRightHandRule() {
         // If the agent detect deadlock, then change the goal point to the right.
         if (isDeadlock()) {
+            static MetricCounter &deadlocks = MetricsRegistry::getInstance().getCounter(
+                    "lsc_deadlocks_total", "Goal planning steps of the agents in a deadlock");
+            deadlocks.increment();
             point3d z_axis(0, 0, 1);
             agent.current_goal_point = agent.current_state.position +
                                        (agent.desired_goal_point - agent.current_state.position).cross(z_axis);
@@ -478,21 +927,22 @@ namespace DynamicPlanning {
     }
 
     void TrajPlanner::goalPlanningWithPriority() {
-        // Find higher priority agents
-        std::set<int> high_priority_obstacle_ids;
-        high_priority_obstacle_ids.clear();
+        // Find higher priority agents, the indices of the obstacles in the ascending order for planSAPF. The fields
+        // are read from the neighbor table, and the footprints of the obstacles are shared by the agents of the step.
+        std::vector<size_t> high_priority_obstacle_indices;
+        high_priority_obstacle_indices.reserve(neighbors.size());
         int closest_obs_id = -1;
         double dist_to_goal = (agent.current_state.position - agent.desired_goal_point).norm();
         double min_dist_to_obs = SP_INFINITY;
-        for (size_t oi = 0; oi < obstacles.size(); oi++) {
+        for (size_t oi = 0; oi < neighbors.size(); oi++) {
             if (constraints.isDynamicObstacle(oi)) {
-                high_priority_obstacle_ids.emplace(obstacles[oi].id);
+                high_priority_obstacle_indices.emplace_back(oi);
                 continue;
             }
 
-            if (obstacles[oi].type == ObstacleType::AGENT) {
-                point3d obs_goal_position = obstacles[oi].goal_point;
-                point3d obs_curr_position = obstacles[oi].position;
+            if (neighbors.getType(oi) == ObstacleType::AGENT) {
+                point3d obs_goal_position = neighbors.getGoalPoint(oi);
+                point3d obs_curr_position = neighbors.getPosition(oi);
                 double obs_dist_to_goal = (obs_curr_position - obs_goal_position).norm();
                 double dist_to_obs = (obs_curr_position - agent.current_state.position).norm();
 
@@ -502,8 +952,8 @@ namespace DynamicPlanning {
                 }
                 // Do not consider the agents have the same direction
                 if (dist_to_goal > param.goal_threshold and
-                    (obs_pred_trajs[oi].lastPoint() - obs_pred_trajs[oi].startPoint()).dot(
-                            obs_pred_trajs[oi].startPoint() - agent.current_state.position) > 0) {
+                    (obsPredTraj(oi).lastPoint() - obsPredTraj(oi).startPoint()).dot(
+                            obsPredTraj(oi).startPoint() - agent.current_state.position) > 0) {
                     continue;
                 }
                 // If the agent is near goal, all other agents have higher priority
@@ -513,7 +963,7 @@ namespace DynamicPlanning {
                         min_dist_to_obs = dist_to_obs;
                         closest_obs_id = oi;
                     }
-                    high_priority_obstacle_ids.emplace(obstacles[oi].id);
+                    high_priority_obstacle_indices.emplace_back(oi);
                 }
             }
         }
@@ -522,17 +972,18 @@ namespace DynamicPlanning {
         double priority_dist_threshold = 0.4;
         double dist_keep = priority_dist_threshold + 0.1; //TODO: param need to consider radius of agents!
         if (min_dist_to_obs < priority_dist_threshold) {
-            point3d obs_curr_position = obstacles[closest_obs_id].position;
+            point3d obs_curr_position = neighbors.getPosition(closest_obs_id);
             agent.current_goal_point = agent.current_state.position -
                                           (obs_curr_position - agent.current_state.position).normalized() * dist_keep;
             return;
         }
 
         // A* considering priority
-        bool success = grid_based_planner->planSAPF(agent, distmap_ptr, obstacles, high_priority_obstacle_ids);
+        bool success = grid_based_planner->planSAPF(agent, distmap_ptr, map_change_log_ptr, obstacles,
+                                                    high_priority_obstacle_indices);
         if (not success) {
             // A* without priority
-            grid_based_planner->planSAPF(agent, distmap_ptr, obstacles);
+            grid_based_planner->planSAPF(agent, distmap_ptr, map_change_log_ptr, obstacles);
         }
 
         // Find los-free goal from end of the initial trajectory
@@ -544,14 +995,16 @@ namespace DynamicPlanning {
 
     void TrajPlanner::goalPlanningWithGridBasedPlanner() {
         //update current_goal_point
-        GoalOptimizer goal_optimizer(param, mission);
-        agent.current_goal_point = goal_optimizer.solve(agent, constraints,
-                                                        agent.current_goal_point, agent.next_waypoint);
+        agent.current_goal_point = goal_optimizer->solve(agent, constraints,
+                                                         agent.current_goal_point, agent.next_waypoint);
     }
 
     void TrajPlanner::constructLSC() {
+        TRACE_SCOPE("TrajPlanner::constructLSC");
         // LSC (or BVC) construction
         ros::Time lsc_start_time = ros::Time::now();
+        StageTimer stage_timer;
+        AllocScope alloc_scope;
         constraints.initializeLSC(obstacles.size());
         if (param.planner_mode == PlannerMode::LSC and param.goal_mode == GoalMode::GRIDBASEDPLANNER){
             generateCLSC();
@@ -566,15 +1019,33 @@ namespace DynamicPlanning {
         }
         ros::Time lsc_end_time = ros::Time::now();
         statistics.planning_time.lsc_generation_time.update((lsc_end_time - lsc_start_time).toSec());
+        stage_timer.stop();
+        statistics.planning_time.lsc_generation_cpu.update(stage_timer.getCPUSeconds(), stage_timer.getWaitSeconds());
+        statistics.alloc.lsc_generation.update(alloc_scope.getCounts());
     }
 
     void TrajPlanner::constructSFC() {
+        TRACE_SCOPE("TrajPlanner::constructSFC");
         // SFC construction
         if (param.world_use_octomap) {
             ros::Time sfc_start_time = ros::Time::now();
+            StageTimer stage_timer;
+            AllocScope alloc_scope;
             generateSFC();
             ros::Time sfc_end_time = ros::Time::now();
+            stage_timer.stop();
             statistics.planning_time.sfc_generation_time.update((sfc_end_time - sfc_start_time).toSec());
+            statistics.planning_time.sfc_generation_cpu.update(stage_timer.getCPUSeconds(),
+                                                               stage_timer.getWaitSeconds());
+            statistics.alloc.sfc_generation.update(alloc_scope.getCounts());
+        }
+    }
+
+    void TrajPlanner::reduceCollisionConstraints() {
+        TRACE_SCOPE("TrajPlanner::reduceCollisionConstraints");
+        if (param.opt_reduce_constraints) {
+            bool use_slack_for_all = param.slack_mode == SlackMode::COLLISIONCONSTRAINT or param.opt_soft_collision;
+            constraints.reduceLSCs(param.world_dimension, use_slack_for_all, param.opt_reduce_constraints_lp);
         }
     }
 
@@ -584,18 +1055,18 @@ namespace DynamicPlanning {
 
         for (size_t oi = 0; oi < obstacles.size(); oi++) {
             for (int m = 0; m < param.M; m++) {
-                Line obs_path(obs_pred_trajs[oi][m][0], obs_pred_trajs[oi][m][param.n]);
+                Line obs_path(obsPredTraj(oi)[m][0], obsPredTraj(oi)[m][param.n]);
                 Line agent_path(initial_traj[m][0], initial_traj[m][param.n]);
                 normal_vector = normalVectorBetweenLines(obs_path, agent_path, closest_dist);
 
                 std::vector<double> d;
                 d.resize(param.n + 1);
                 for (int i = 0; i < param.n + 1; i++) {
-                    if (obstacles[oi].type == ObstacleType::AGENT and
-                        closest_dist < obs_pred_sizes[oi][m][i] + agent.radius) {
-                        d[i] = 0.5 * (obs_pred_sizes[oi][m][i] + agent.radius + closest_dist);
+                    if (neighbors.getType(oi) == ObstacleType::AGENT and
+                        closest_dist < obsPredSize(oi)[m][i] + agent.radius) {
+                        d[i] = 0.5 * (obsPredSize(oi)[m][i] + agent.radius + closest_dist);
                     } else {
-                        d[i] = obs_pred_sizes[oi][m][i] + agent.radius;
+                        d[i] = obsPredSize(oi)[m][i] + agent.radius;
                     }
                 }
 
@@ -603,106 +1074,403 @@ namespace DynamicPlanning {
                 double downwash = downwashBetween(oi);
                 normal_vector.z() = normal_vector.z() / (downwash * downwash);
 
-                constraints.setLSC(oi, m, obs_pred_trajs[oi][m].control_points, normal_vector, d);
+                constraints.setLSC(oi, m, obsPredTraj(oi)[m].control_points, normal_vector, d);
             }
         }
     }
 
-    void TrajPlanner::generateLSC() {
+    // Buffers reused by the LSC and BVC generation of each thread
+    struct LSCScratch {
+        traj_t initial_traj_trans, obs_pred_traj_trans;
+        std::vector<double> d;
+    };
+
+    static thread_local LSCScratch lsc_scratch;
+
+    void TrajPlanner::runObstacleTasks(const std::function<void(size_t)> &task) {
+        if (param.parallel_lsc_threshold > 0 and
+            obstacles.size() >= static_cast<size_t>(param.parallel_lsc_threshold)) {
+            WorkerPool::getInstance().run(obstacles.size(), task);
+        } else {
+            for (size_t oi = 0; oi < obstacles.size(); oi++) {
+                task(oi);
+            }
+        }
+    }
+
+    void TrajPlanner::prepareInitialTrajTransforms() {
         for (size_t oi = 0; oi < obstacles.size(); oi++) {
-            // Coordinate transformation
-            double downwash = downwashBetween(oi);
-            traj_t initial_traj_trans = initial_traj.coordinateTransform(downwash);
-            traj_t obs_pred_traj_trans = obs_pred_trajs[oi].coordinateTransform(downwash);
+            traj_memo.coordinateTransform(initial_traj, downwashBetween((int)oi));
+        }
+    }
 
-            // Normal vector planning
-            // Compute normal vector of LSC
-            for (int m = 0; m < param.M; m++) {
-                point3d normal_vector;
-                if (col_pred_obs_indices.find(oi) != col_pred_obs_indices.end()) {
-                    normal_vector = normalVectorDynamicObs(oi, m, downwash);
-                } else {
-                    normal_vector = normalVectorBetweenPolys(oi, m, initial_traj_trans, obs_pred_traj_trans);
-                    if (normal_vector.norm() < SP_EPSILON_FLOAT) {
-                        if (obstacles[oi].type == ObstacleType::AGENT) {
-                            ROS_WARN("[TrajPlanner] normal_vector is 0");
-                        }
+    const traj_t &TrajPlanner::transformedInitialTraj(double downwash) const {
+        const traj_t *initial_traj_trans = traj_memo.findCoordinateTransform(initial_traj, downwash);
+        if (initial_traj_trans != nullptr) {
+            return *initial_traj_trans;
+        }
+
+        initial_traj.coordinateTransform(downwash, lsc_scratch.initial_traj_trans);
+        return lsc_scratch.initial_traj_trans;
+    }
+
+    void TrajPlanner::generateLSC() {
+        // The LSCs of each obstacle are independent
+        prepareInitialTrajTransforms();
+        prepareLSCNormalCaches();
+        assignLSCDetails();
+        runObstacleTasks([this](size_t oi) { generateLSC(oi); });
+        updateLSCNormalCaches();
+    }
+
+    void TrajPlanner::generateLSC(size_t oi) {
+        if (setLSCDetail(oi)) {
+            return;
+        }
 
-                        point3d vector_obs_to_agent = coordinateTransform(
-                                agent.current_goal_point - obstacles[oi].position, downwash);
-                        normal_vector = vector_obs_to_agent.normalized();
+        // Coordinate transformation
+        double downwash = downwashBetween(oi);
+        const traj_t &initial_traj_trans = transformedInitialTraj(downwash);
+        traj_t &obs_pred_traj_trans = lsc_scratch.obs_pred_traj_trans;
+        obsPredTraj(oi).coordinateTransform(downwash, obs_pred_traj_trans);
+
+        // Normal vector planning
+        // Compute normal vector of LSC
+        for (int m = 0; m < param.M; m++) {
+            point3d normal_vector;
+            if (col_pred_obs_indices.find(oi) != col_pred_obs_indices.end()) {
+                normal_vector = normalVectorDynamicObs(oi, m, downwash);
+            } else {
+                normal_vector = normalVectorBetweenPolys(oi, m, initial_traj_trans, obs_pred_traj_trans);
+                if (normal_vector.norm() < SP_EPSILON_FLOAT) {
+                    if (neighbors.getType(oi) == ObstacleType::AGENT) {
+                        ROS_WARN("[TrajPlanner] normal_vector is 0");
                     }
+
+                    point3d vector_obs_to_agent = coordinateTransform(
+                            agent.current_goal_point - neighbors.getPosition(oi), downwash);
+                    normal_vector = vector_obs_to_agent.normalized();
+                }
+            }
+
+            // Compute safety margin
+            std::vector<double> &d = lsc_scratch.d;
+            d.resize(param.n + 1);
+            if (neighbors.getType(oi) == ObstacleType::AGENT and not constraints.isDynamicObstacle(oi)) {
+                for (int i = 0; i < param.n + 1; i++) {
+                    double collision_dist = neighbors.getRadius(oi) + agent.radius;
+                    double gap = (initial_traj_trans[m][i] - obs_pred_traj_trans[m][i]).dot(normal_vector);
+                    d[i] = 0.5 * (collision_dist + gap) + getConsensusOffset(oi, m, i, gap - collision_dist);
+                }
+            } else {
+                for (int i = 0; i < param.n + 1; i++) {
+                    d[i] = obsPredSize(oi)[m][i] + agent.radius;
                 }
+            }
+
+            // Return to original coordination
+            normal_vector.z() = normal_vector.z() / downwash;
+            constraints.setLSC(oi, m, obsPredTraj(oi)[m].control_points, normal_vector, d);
+        }
+    }
+
+    void TrajPlanner::generateCLSC() {
+        if (param.world_dimension != 2) {
+            prepareInitialTrajTransforms();
+        }
+        prepareLSCNormalCaches();
+        assignLSCDetails();
+        runObstacleTasks([this](size_t oi) { generateCLSC(oi); });
+        updateLSCNormalCaches();
+    }
+
+    void TrajPlanner::generateCLSC(size_t oi) {
+        if (setLSCDetail(oi)) {
+            return;
+        }
+
+        double collision_dist = neighbors.getRadius(oi) + agent.radius;
+
+        // Coordinate transformation
+        double downwash = downwashBetween(oi);
+        const traj_t &initial_traj_trans = param.world_dimension == 2 ? initial_traj : transformedInitialTraj(downwash);
+        traj_t &obs_pred_traj_trans = lsc_scratch.obs_pred_traj_trans;
+        if(param.world_dimension == 2){
+            obs_pred_traj_trans = obsPredTraj(oi);
+        } else {
+            obsPredTraj(oi).coordinateTransform(downwash, obs_pred_traj_trans);
+        }
+
+        // Normal vector planning
+        // Compute normal vector of LSC
+        for (int m = 0; m < param.M; m++) {
+            if(m < param.M - 1){
+                point3d normal_vector = normalVectorBetweenPolys(oi, m, initial_traj_trans, obs_pred_traj_trans);
 
                 // Compute safety margin
-                std::vector<double> d;
+                std::vector<double> &d = lsc_scratch.d;
                 d.resize(param.n + 1);
-                if (obstacles[oi].type == ObstacleType::AGENT and not constraints.isDynamicObstacle(oi)) {
-                    for (int i = 0; i < param.n + 1; i++) {
-                        double collision_dist = obstacles[oi].radius + agent.radius;
-                        d[i] = 0.5 * (collision_dist +
-                                      (initial_traj_trans[m][i] - obs_pred_traj_trans[m][i]).dot(normal_vector));
-                    }
-                } else {
-                    for (int i = 0; i < param.n + 1; i++) {
-                        d[i] = obs_pred_sizes[oi][m][i] + agent.radius;
-                    }
+                for (int i = 0; i < param.n + 1; i++) {
+                    double gap = (initial_traj_trans[m][i] - obs_pred_traj_trans[m][i]).dot(normal_vector);
+                    d[i] = 0.5 * (collision_dist + gap) + getConsensusOffset(oi, m, i, gap - collision_dist);
                 }
 
                 // Return to original coordination
                 normal_vector.z() = normal_vector.z() / downwash;
-                constraints.setLSC(oi, m, obs_pred_trajs[oi][m].control_points, normal_vector, d);
+                constraints.setLSC(oi, m, obsPredTraj(oi)[m].control_points, normal_vector, d);
+            } else {
+                Line line1(obs_pred_traj_trans.lastPoint(), neighbors.getGoalPoint(oi));
+                Line line2(initial_traj_trans.lastPoint(), agent.current_goal_point);
+                ClosestPoints closest_points = closestPointsBetweenLineSegments(line1, line2);
+                point3d normal_vector = (closest_points.closest_point2 - closest_points.closest_point1).normalized();
+
+                // Compute safety margin
+                double d = 0.5 * (collision_dist + closest_points.dist);
+
+                // Return to original coordination
+                normal_vector.z() = normal_vector.z() / downwash;
+                constraints.setLSC(oi, m, closest_points.closest_point1, normal_vector, d);
             }
         }
     }
 
-    void TrajPlanner::generateCLSC() {
+    void TrajPlanner::assignLSCDetails() {
+        lsc_details.assign(obstacles.size(), LSCDetail());
+        if (param.lsc_lod_near_range <= 0) {
+            return;
+        }
+
+        // Both agents of a pair see the same initial trajectories, so they choose the same level and the mirrored
+        // half-spaces of PLANE, whose sum keeps the collision distance like the exact LSCs. A merged half-space
+        // keeps the agent out of the reach of the group whatever the other agents plan, so it is safe even if the
+        // other agent chooses another level.
+        struct FarAgent {
+            size_t oi;
+            double downwash;
+            double azimuth;
+        };
+        std::vector<FarAgent> far_agents;
         for (size_t oi = 0; oi < obstacles.size(); oi++) {
-            double collision_dist = obstacles[oi].radius + agent.radius;
+            if (neighbors.getType(oi) != ObstacleType::AGENT or constraints.isDynamicObstacle(static_cast<int>(oi)) or
+                col_pred_obs_indices.find(static_cast<int>(oi)) != col_pred_obs_indices.end()) {
+                continue;
+            }
 
-            // Coordinate transformation
-            double downwash = downwashBetween(oi);
-            traj_t initial_traj_trans, obs_pred_traj_trans;
-            if(param.world_dimension == 2){
-                initial_traj_trans = initial_traj;
-                obs_pred_traj_trans = obs_pred_trajs[oi];
+            double downwash = downwashBetween(static_cast<int>(oi));
+            point3d start_rel = coordinateTransform(obsPredTraj(oi).startPoint() - initial_traj.startPoint(),
+                                                    downwash);
+            double dist = start_rel.norm();
+            if (dist < param.lsc_lod_near_range) {
+                continue;
+            }
+            if (param.lsc_lod_far_range > 0 and dist >= param.lsc_lod_far_range) {
+                far_agents.push_back({oi, downwash, std::atan2(start_rel.y(), start_rel.x())});
             } else {
-                initial_traj_trans = initial_traj.coordinateTransform(downwash);
-                obs_pred_traj_trans = obs_pred_trajs[oi].coordinateTransform(downwash);
+                computeLSCPlane(oi, lsc_details[oi]);
             }
+        }
 
-            // Normal vector planning
-            // Compute normal vector of LSC
-            for (int m = 0; m < param.M; m++) {
-                if(m < param.M - 1){
-                    point3d normal_vector = normalVectorBetweenPolys(oi, m, initial_traj_trans, obs_pred_traj_trans);
+        // The far agents in adjacent directions are merged greedily while the agent stays out of their reach
+        std::sort(far_agents.begin(), far_agents.end(), [](const FarAgent &a, const FarAgent &b) {
+            return std::tie(a.downwash, a.azimuth, a.oi) < std::tie(b.downwash, b.azimuth, b.oi);
+        });
+        std::vector<size_t> group, group_cand;
+        size_t k = 0;
+        while (k < far_agents.size()) {
+            LSCDetail group_detail;
+            group.assign(1, far_agents[k].oi);
+            if (not computeMergedLSC(group, group_detail)) {
+                computeLSCPlane(far_agents[k].oi, lsc_details[far_agents[k].oi]);
+                k++;
+                continue;
+            }
 
-                    // Compute safety margin
-                    std::vector<double> d;
-                    d.resize(param.n + 1);
-                    for (int i = 0; i < param.n + 1; i++) {
-                        d[i] = 0.5 * (collision_dist +
-                                      (initial_traj_trans[m][i] - obs_pred_traj_trans[m][i]).dot(normal_vector));
-                    }
+            size_t end = k + 1;
+            while (end < far_agents.size() and far_agents[end].downwash == far_agents[k].downwash) {
+                group_cand = group;
+                group_cand.emplace_back(far_agents[end].oi);
+                LSCDetail detail_cand;
+                if (not computeMergedLSC(group_cand, detail_cand)) {
+                    break;
+                }
+                group.swap(group_cand);
+                group_detail = detail_cand;
+                end++;
+            }
 
-                    // Return to original coordination
-                    normal_vector.z() = normal_vector.z() / downwash;
-                    constraints.setLSC(oi, m, obs_pred_trajs[oi][m].control_points, normal_vector, d);
-                } else {
-                    Line line1(obs_pred_traj_trans.lastPoint(), obstacles[oi].goal_point);
-                    Line line2(initial_traj_trans.lastPoint(), agent.current_goal_point);
-                    ClosestPoints closest_points = closestPointsBetweenLineSegments(line1, line2);
-                    point3d normal_vector = (closest_points.closest_point2 - closest_points.closest_point1).normalized();
+            lsc_details[group[0]] = group_detail;
+            for (size_t gi = 1; gi < group.size(); gi++) {
+                lsc_details[group[gi]].level = LSCLevel::MERGED_MEMBER;
+            }
+            k = end;
+        }
+
+        static MetricCounter &lod_planes = MetricsRegistry::getInstance().getCounter(
+                "lsc_lod_plane_total", "Agents constrained by one half-space over the horizon");
+        static MetricCounter &lod_merged = MetricsRegistry::getInstance().getCounter(
+                "lsc_lod_merged_total", "Far agents constrained by the half-space of their group");
+        for (const auto &detail: lsc_details) {
+            if (detail.level == LSCLevel::PLANE) {
+                lod_planes.increment();
+            } else if (detail.level == LSCLevel::MERGED or detail.level == LSCLevel::MERGED_MEMBER) {
+                lod_merged.increment();
+            }
+        }
+    }
+
+    bool TrajPlanner::computeLSCPlane(size_t oi, LSCDetail &detail) const {
+        double downwash = downwashBetween(static_cast<int>(oi));
+        const traj_t &obs_pred_traj = obsPredTraj(oi);
+        point3d agent_centroid(0, 0, 0), obs_centroid(0, 0, 0);
+        for (int m = 0; m < param.M; m++) {
+            for (int i = 0; i < param.n + 1; i++) {
+                agent_centroid += coordinateTransform(initial_traj[m][i], downwash);
+                obs_centroid += coordinateTransform(obs_pred_traj[m][i], downwash);
+            }
+        }
 
-                    // Compute safety margin
-                    double d = 0.5 * (collision_dist + closest_points.dist);
+        point3d normal_vector = agent_centroid - obs_centroid;
+        if (param.world_dimension == 2) {
+            normal_vector.z() = 0;
+        }
+        if (normal_vector.norm() < SP_EPSILON_FLOAT) {
+            return false;
+        }
+        normal_vector.normalize();
 
-                    // Return to original coordination
-                    normal_vector.z() = normal_vector.z() / downwash;
-                    constraints.setLSC(oi, m, closest_points.closest_point1, normal_vector, d);
+        double agent_min = SP_INFINITY, obs_max = -SP_INFINITY;
+        for (int m = 0; m < param.M; m++) {
+            for (int i = 0; i < param.n + 1; i++) {
+                agent_min = std::min(agent_min,
+                                     static_cast<double>(normal_vector.dot(coordinateTransform(initial_traj[m][i],
+                                                                                               downwash))));
+                obs_max = std::max(obs_max,
+                                   static_cast<double>(normal_vector.dot(coordinateTransform(obs_pred_traj[m][i],
+                                                                                             downwash))));
+            }
+        }
+        double collision_dist = neighbors.getRadius(oi) + agent.radius;
+        if (agent_min - obs_max < collision_dist) {
+            return false;
+        }
+
+        // n^T c >= (agent_min + obs_max + collision_dist) / 2, and the other agent takes the mirrored half-space
+        detail.level = LSCLevel::PLANE;
+        detail.obs_point = obs_pred_traj.startPoint();
+        detail.d = 0.5 * (agent_min + obs_max + collision_dist) -
+                   normal_vector.dot(coordinateTransform(detail.obs_point, downwash));
+        normal_vector.z() = normal_vector.z() / downwash;
+        detail.normal_vector = normal_vector;
+        return true;
+    }
+
+    bool TrajPlanner::computeMergedLSC(const std::vector<size_t> &group, LSCDetail &detail) const {
+        double downwash = downwashBetween(static_cast<int>(group[0]));
+        double horizon = full_M * param.dt;
+        point3d agent_centroid(0, 0, 0), obs_centroid(0, 0, 0);
+        for (int m = 0; m < param.M; m++) {
+            for (int i = 0; i < param.n + 1; i++) {
+                agent_centroid += coordinateTransform(initial_traj[m][i], downwash) * (1.0 / (param.M * (param.n + 1)));
+            }
+        }
+        for (size_t oi: group) {
+            obs_centroid += coordinateTransform(neighbors.getPosition(oi), downwash) * (1.0 / group.size());
+        }
+
+        point3d normal_vector = agent_centroid - obs_centroid;
+        if (param.world_dimension == 2) {
+            normal_vector.z() = 0;
+        }
+        if (normal_vector.norm() < SP_EPSILON_FLOAT) {
+            return false;
+        }
+        normal_vector.normalize();
+
+        // The support of the balls that the obstacles can reach, inflated by the collision distance
+        double support = -SP_INFINITY;
+        for (size_t oi: group) {
+            double radius = getObstacleReach(oi, horizon) + neighbors.getRadius(oi) + agent.radius;
+            support = std::max(support, normal_vector.dot(coordinateTransform(neighbors.getPosition(oi), downwash)) +
+                                        radius);
+        }
+        for (int m = 0; m < param.M; m++) {
+            for (int i = 0; i < param.n + 1; i++) {
+                if (normal_vector.dot(coordinateTransform(initial_traj[m][i], downwash)) < support) {
+                    return false;
                 }
             }
         }
+
+        detail.level = LSCLevel::MERGED;
+        detail.obs_point = neighbors.getPosition(group[0]);
+        detail.d = support - normal_vector.dot(coordinateTransform(detail.obs_point, downwash));
+        normal_vector.z() = normal_vector.z() / downwash;
+        detail.normal_vector = normal_vector;
+        return true;
+    }
+
+    bool TrajPlanner::setLSCDetail(size_t oi) {
+        if (oi >= lsc_details.size()) {
+            return false;
+        }
+
+        const LSCDetail &detail = lsc_details[oi];
+        switch (detail.level) {
+            case LSCLevel::EXACT:
+                return false;
+            case LSCLevel::MERGED_MEMBER:
+                return true; // the normal vectors stay 0, so the optimizer leaves the LSCs out
+            default:
+                for (int m = 0; m < param.M; m++) {
+                    constraints.setLSC(static_cast<int>(oi), m, detail.obs_point, detail.normal_vector, detail.d);
+                }
+                return true;
+        }
+    }
+
+    double TrajPlanner::getConsensusOffset(size_t oi, int m, int i, double excess) const {
+        if (consensus_offsets.empty() or neighbors.getType(oi) != ObstacleType::AGENT) {
+            return 0;
+        }
+        auto it = consensus_offsets.find(neighbors.getId(oi));
+        size_t idx = static_cast<size_t>(m * (param.n + 1) + i);
+        if (it == consensus_offsets.end() or idx >= it->second.size()) {
+            return 0;
+        }
+
+        // Both agents clip by the same excess, so the offsets of the pair stay opposite
+        double bound = 0.5 * std::max(excess, 0.0);
+        return std::min(std::max(it->second[idx], -bound), bound);
+    }
+
+    void TrajPlanner::prepareLSCNormalCaches() {
+        std::set<std::pair<int, int>> keys;
+        for (size_t oi = 0; oi < neighbors.size(); oi++) {
+            std::pair<int, int> key(neighbors.getType(oi), neighbors.getId(oi));
+            keys.emplace(key);
+            LSCNormalCache &cache = lsc_normal_caches[key];
+            cache.control_points_rel_next.assign(param.M, points_t());
+            cache.normal_vectors_next.assign(param.M, point3d(0, 0, 0));
+        }
+
+        for (auto it = lsc_normal_caches.begin(); it != lsc_normal_caches.end();) {
+            if (keys.find(it->first) == keys.end()) {
+                it = lsc_normal_caches.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void TrajPlanner::updateLSCNormalCaches() {
+        for (auto &key_cache: lsc_normal_caches) {
+            LSCNormalCache &cache = key_cache.second;
+            cache.control_points_rel.swap(cache.control_points_rel_next);
+            cache.normal_vectors.swap(cache.normal_vectors_next);
+            statistics.lsc_cache.update(cache.n_query, cache.n_hit);
+            cache.n_query = 0;
+            cache.n_hit = 0;
+        }
     }
 
     void TrajPlanner::generateBVC() {
@@ -711,17 +1479,18 @@ namespace DynamicPlanning {
         for (size_t oi = 0; oi < obstacles.size(); oi++) {
             // Coordinate transformation
             double downwash = downwashBetween(oi);
-            traj_t initial_traj_trans = initial_traj.coordinateTransform(downwash);
-            traj_t obs_pred_traj_trans = obs_pred_trajs[oi].coordinateTransform(downwash);
+            const traj_t &initial_traj_trans = traj_memo.coordinateTransform(initial_traj, downwash);
+            traj_t &obs_pred_traj_trans = lsc_scratch.obs_pred_traj_trans;
+            obsPredTraj(oi).coordinateTransform(downwash, obs_pred_traj_trans);
 
             // normal vector
             normal_vector = (initial_traj_trans.startPoint() - obs_pred_traj_trans.startPoint()).normalized();
 
             // safety margin
-            std::vector<double> d;
+            std::vector<double> &d = lsc_scratch.d;
             d.resize(param.n + 1);
             for (int i = 0; i < param.n + 1; i++) {
-                double collision_dist = obstacles[oi].radius + agent.radius;
+                double collision_dist = neighbors.getRadius(oi) + agent.radius;
                 d[i] = 0.5 * (collision_dist +
                               (initial_traj_trans.startPoint() - obs_pred_traj_trans.startPoint()).dot(normal_vector));
             }
@@ -730,7 +1499,7 @@ namespace DynamicPlanning {
             normal_vector.z() = normal_vector.z() / downwash;
 
             for (int m = 0; m < param.M; m++) {
-                constraints.setLSC(oi, m, obs_pred_trajs[oi][m].control_points, normal_vector, d);
+                constraints.setLSC(oi, m, obsPredTraj(oi)[m].control_points, normal_vector, d);
             }
         }
     }
@@ -739,6 +1508,16 @@ namespace DynamicPlanning {
         if (initialize_sfc) {
             constraints.initializeSFC(agent.current_state.position, agent.radius);
             initialize_sfc = false;
+        } else if (deadline.isExpired(PlanningDeadline::SFC_SHARE)) {
+            // Degraded mode, the expansion is skipped to leave the rest of the budget to the QP
+            static MetricCounter &sfc_reused = MetricsRegistry::getInstance().getCounter(
+                    "lsc_deadline_sfc_reused_total", "SFC expansions skipped by the deadline and the SFCs reused");
+            sfc_reused.increment();
+            statistics.deadline.n_sfc_reused++;
+            constraints.shiftSFC();
+            if(param.goal_mode == GoalMode::GRIDBASEDPLANNER) {
+                constraints.constructCommunicationRange(agent.next_waypoint);
+            }
         } else {
             if(param.goal_mode == GoalMode::GRIDBASEDPLANNER) {
                 std::vector<point3d> convex_hull;
@@ -753,108 +1532,263 @@ namespace DynamicPlanning {
     }
 
     traj_t TrajPlanner::trajOptimization() {
-        Timer timer;
+        TRACE_SCOPE("TrajPlanner::trajOptimization");
+        StageTimer timer;
+        AllocScope alloc_scope;
         TrajOptResult result;
 
-        // Solve QP problem using CPLEX
+        bool use_warm_start = isWarmStartUsed();
+
+        // Solve QP problem using CPLEX, within the rest of the deadline
+        auto getQPTimeLimit = [this]() {
+            return deadline.isBounded() ? std::max(deadline.getRemainingSeconds(), PlanningDeadline::MIN_QP_TIME) : 0;
+        };
+        bool qp_success = false, qp_timeout = false;
         timer.reset();
         try {
-            result = traj_optimizer->solve(agent, constraints, initial_traj, true);
-            if (param.planner_mode == PlannerMode::DLSC and not isSolValid(result)) {
+            if (deadline.isBounded() and deadline.getRemainingSeconds() < PlanningDeadline::MIN_QP_TIME) {
+                throw PlanningReport::QPTIMEOUT;
+            }
+            result = traj_optimizer->solve(agent, constraints, initial_traj, true, use_warm_start, getQPTimeLimit());
+            if (param.planner_mode == PlannerMode::DLSC and not result.time_limit_reached and
+                not isSolValid(result)) {
                 ROS_WARN("[TrajPlanner] Rerun the solver with default algorithm");
-                result = traj_optimizer->solve(agent, constraints, initial_traj, false);
+                result = traj_optimizer->solve(agent, constraints, initial_traj, false, use_warm_start,
+                                               getQPTimeLimit());
+            }
+            if (result.time_limit_reached and not isAnytimeSolValid(result)) {
+                throw PlanningReport::QPTIMEOUT;
+            }
+            qp_success = true;
+        } catch (const PlanningReport &report) {
+            if (report == PlanningReport::QPTIMEOUT) {
+                qp_timeout = true;
+                //Failsafe
+                result.desired_traj = initial_traj;
+            } else {
+                reportQPFailure();
+                result.desired_traj = planFallback();
             }
         } catch (...) {
-            // Debug
-            for (int m = 0; m < param.M; m++) {
-                if(param.world_use_octomap) {
-                    Box sfc = constraints.getSFC(m);
-                    for (const auto &control_point: initial_traj[m].control_points) {
-                        bool sfc_check = sfc.isPointInBox(control_point);
-                        if (not sfc_check) {
-                            ROS_ERROR_STREAM("[TrajPlanner] SFC constraint is not feasible. m: " << m);
-                        }
+            reportQPFailure();
+            result.desired_traj = planFallback();
+        }
+        if (not qp_success) {
+            result.solution.resize(0); // desired_traj is not a QP solution
+        }
+
+        // Degraded modes of the deadline
+        if (qp_timeout) {
+            static MetricCounter &qp_fallbacks = MetricsRegistry::getInstance().getCounter(
+                    "lsc_deadline_qp_fallback_total",
+                    "QPs without a valid solution before the deadline and replaced by the initial trajectory");
+            qp_fallbacks.increment();
+            statistics.deadline.n_qp_fallback++;
+        } else if (qp_success and result.time_limit_reached) {
+            static MetricCounter &qp_anytime = MetricsRegistry::getInstance().getCounter(
+                    "lsc_deadline_qp_anytime_total", "QPs stopped by the deadline and their incumbents used");
+            qp_anytime.increment();
+            statistics.deadline.n_qp_anytime++;
+        }
+
+        timer.stop();
+        statistics.planning_time.traj_optimization_time.update(timer.getWallSeconds());
+        statistics.planning_time.traj_optimization_cpu.update(timer.getCPUSeconds(), timer.getWaitSeconds());
+        statistics.alloc.traj_optimization.update(alloc_scope.getCounts());
+        if (qp_success) {
+            statistics.qp.update(result.n_iteration, timer.elapsedSeconds(), result.warm_started);
+            statistics.qp.updatePruning(result.n_collision_rows, result.n_pruned_rows, result.n_redundant_rows);
+        }
+
+        return result.desired_traj;
+    }
+
+    bool TrajPlanner::isWarmStartUsed() const {
+        // The initial trajectory is the time-shifted previous solution after the first step.
+        // The initial trajectory of an ADMM iteration is the iterate of the agent.
+        return param.opt_warm_start and
+               (is_consensus_iteration or
+                (param.initial_traj_mode == InitialTrajMode::PREVIOUSSOLUTION and planner_seq >= 2 and
+                 not is_disturbed));
+    }
+
+    QPProblem TrajPlanner::prepareBatchQP() {
+        return traj_optimizer->prepareBatchProblem(agent, constraints, initial_traj, isWarmStartUsed());
+    }
+
+    void TrajPlanner::setBatchQPSolution(const QPSolution &solution) {
+        traj_optimizer->setBatchSolution(solution);
+    }
+
+    void TrajPlanner::saveCheckpoint(Checkpoint &checkpoint) const {
+        checkpoint.agent = agent;
+        checkpoint.planner_seq = planner_seq;
+        checkpoint.statistics = statistics;
+        checkpoint.initialize_sfc = initialize_sfc;
+        checkpoint.is_sol_converged_by_sfc = is_sol_converged_by_sfc;
+        checkpoint.is_hover_ready = is_hover_ready;
+        checkpoint.goal_planner_state = goal_planner_state;
+        checkpoint.desired_segment_idx = desired_segment_idx;
+        checkpoint.full_M = full_M;
+        checkpoint.sfc_converged = sfc_converged;
+        checkpoint.planned_map_version = planned_map_version;
+        checkpoint.initial_traj = initial_traj;
+        checkpoint.prev_traj = prev_traj;
+        checkpoint.constraints = std::make_shared<const CollisionConstraints>(constraints);
+        checkpoint.obstacle_filter_bank = obstacle_filter_bank;
+        checkpoint.sfcs = constraints.getSFCs();
+    }
+
+    void TrajPlanner::restoreCheckpoint(const Checkpoint &checkpoint) {
+        agent = checkpoint.agent;
+        planner_seq = checkpoint.planner_seq;
+        statistics = checkpoint.statistics;
+        initialize_sfc = checkpoint.initialize_sfc;
+        is_sol_converged_by_sfc = checkpoint.is_sol_converged_by_sfc;
+        is_hover_ready = checkpoint.is_hover_ready;
+        goal_planner_state = checkpoint.goal_planner_state;
+        desired_segment_idx = checkpoint.desired_segment_idx;
+        full_M = checkpoint.full_M;
+        sfc_converged = checkpoint.sfc_converged;
+        planned_map_version = checkpoint.planned_map_version;
+        initial_traj = checkpoint.initial_traj;
+        prev_traj = checkpoint.prev_traj;
+        if (checkpoint.constraints != nullptr) {
+            constraints = *checkpoint.constraints;
+            obstacle_filter_bank = checkpoint.obstacle_filter_bank;
+        } else {
+            constraints.setSFCs(checkpoint.sfcs);
+            obstacle_filter_bank = KalmanFilterBank();
+        }
+    }
+
+    void TrajPlanner::reportQPFailure() {
+        static MetricCounter &qp_failures = MetricsRegistry::getInstance().getCounter(
+                "lsc_qp_failures_total", "Trajectory optimizations failed and replaced by the initial trajectory");
+        qp_failures.increment();
+
+        // Debug
+        for (int m = 0; m < param.M; m++) {
+            if(param.world_use_octomap) {
+                Box sfc = constraints.getSFC(m);
+                for (const auto &control_point: initial_traj[m].control_points) {
+                    bool sfc_check = sfc.isPointInBox(control_point);
+                    if (not sfc_check) {
+                        ROS_ERROR_STREAM("[TrajPlanner] SFC constraint is not feasible. m: " << m);
                     }
                 }
-                for (size_t oi = 0; oi < obstacles.size(); oi++) {
-                    for (int i = 0; i < param.n + 1; i++) {
-                        LSC lsc = constraints.getLSC(oi, m, i);
-                        double margin = (initial_traj[m][i] - lsc.obs_control_point).dot(lsc.normal_vector) - lsc.d;
-                        bool lsc_check = margin > 0;
-                        if (not lsc_check) {
-                            ROS_ERROR_STREAM("[TrajPlanner] LSC constraint is not feasible." <<
-                                                                                             " oi: " << oi <<
-                                                                                             ", m: " << m <<
-                                                                                             ", i: " << i <<
-                                                                                             ", margin:" << margin);
-                        }
+            }
+            for (size_t oi = 0; oi < obstacles.size(); oi++) {
+                for (int i = 0; i < param.n + 1; i++) {
+                    LSC lsc = constraints.getLSC(oi, m, i);
+                    double margin = (initial_traj[m][i] - lsc.obs_control_point).dot(lsc.normal_vector) - lsc.d;
+                    bool lsc_check = margin > 0;
+                    if (not lsc_check) {
+                        ROS_ERROR_STREAM("[TrajPlanner] LSC constraint is not feasible." <<
+                                                                                         " oi: " << oi <<
+                                                                                         ", m: " << m <<
+                                                                                         ", i: " << i <<
+                                                                                         ", margin:" << margin);
                     }
                 }
             }
+        }
+    }
 
+    traj_t TrajPlanner::planFallback() {
+        if (not param.fallback_planner) {
             //Failsafe
-            result.desired_traj = initial_traj;
+            return initial_traj;
         }
 
+        Timer timer;
+        traj_t fallback_traj;
+        FallbackResult fallback_result = fallback_planner.plan(agent, constraints, initial_traj, param.fallback_budget,
+                                                               fallback_traj);
         timer.stop();
-        statistics.planning_time.traj_optimization_time.update(timer.elapsedSeconds());
+        statistics.fallback.update(fallback_result.is_feasible, fallback_result.n_checked, timer.elapsedSeconds());
+        if (not fallback_result.is_feasible) {
+            ROS_WARN_STREAM("[TrajPlanner] No feasible fallback trajectory among " << fallback_result.n_checked
+                            << " candidates, use the initial trajectory, agent " << agent.id);
+            return initial_traj;
+        }
 
-        return result.desired_traj;
+        static MetricCounter &fallbacks = MetricsRegistry::getInstance().getCounter(
+                "lsc_fallback_trajectories_total", "Failed QPs replaced by a feasible sampled trajectory");
+        fallbacks.increment();
+        return fallback_traj;
     }
 
     void TrajPlanner::publishSFC(){
-        visualization_msgs::MarkerArray msg_sfc;
-        msg_sfc = constraints.convertSFCsToMarkerArrayMsg(mission.color[agent.id], agent.radius);
-        pub_sfc.publish(msg_sfc);
+        if(pub_sfc.getNumSubscribers() == 0) {
+            return;
+        }
+
+        // Build the markers in the background from a snapshot of the constraints
+        auto constraints_snapshot = std::make_shared<const CollisionConstraints>(constraints);
+        VisualizationWorker::getInstance().submit(
+                pub_sfc.getTopic(),
+                [pub = pub_sfc.getPublisher(), constraints_snapshot, color = mission->color[agent.id], radius = agent.radius]() {
+                    pub.publish(constraints_snapshot->convertSFCsToMarkerArrayMsg(color, radius));
+                });
     }
 
     void TrajPlanner::publishLSC(){
-        visualization_msgs::MarkerArray msg_lsc;
-        msg_lsc = constraints.convertLSCsToMarkerArrayMsg(obstacles, mission.color, agent.radius);
-        pub_lsc.publish(msg_lsc);
+        if(pub_lsc.getNumSubscribers() == 0) {
+            return;
+        }
+
+        auto constraints_snapshot = std::make_shared<const CollisionConstraints>(constraints);
+        VisualizationWorker::getInstance().submit(
+                pub_lsc.getTopic(),
+                [pub = pub_lsc.getPublisher(), constraints_snapshot, obstacles = obstacles, colors = mission->color,
+                 radius = agent.radius]() {
+                    pub.publish(constraints_snapshot->convertLSCsToMarkerArrayMsg(obstacles, colors, radius));
+                });
     }
 
     void TrajPlanner::publishFeasibleRegion(){
-        visualization_msgs::MarkerArray msg_feasible_region;
-//        ros::Time start_time = ros::Time::now();
-        msg_feasible_region = constraints.feasibleRegionToMarkerArrayMsg(agent.id,
-                                                                         mission.color[agent.id]);
-//        ros::Time end_time = ros::Time::now();
+        if(pub_feasible_region.getNumSubscribers() == 0) {
+            return;
+        }
 
-//        ROS_INFO_STREAM("[TrajPlanner] feasible region gen time: " << (end_time - start_time).toSec());
-        pub_feasible_region.publish(msg_feasible_region);
+        // The convex hulls are the most expensive markers, and the topic is shared by all agents
+        auto constraints_snapshot = std::make_shared<const CollisionConstraints>(constraints);
+        VisualizationWorker::getInstance().submit(
+                pub_feasible_region.getTopic() + "/" + std::to_string(agent.id),
+                [pub = pub_feasible_region.getPublisher(), constraints_snapshot, id = agent.id, color = mission->color[agent.id]]() {
+                    pub.publish(constraints_snapshot->feasibleRegionToMarkerArrayMsg(id, color));
+                });
     }
 
     void TrajPlanner::publishGridPath() {
-        visualization_msgs::MarkerArray msg_delete_all = msgDeleteAll();
-        pub_grid_path.publish(msg_delete_all);
+        if(pub_grid_path.getNumSubscribers() == 0) {
+            return;
+        }
 
-        visualization_msgs::MarkerArray msg_grid_path_vis =
-                grid_based_planner->pathToMarkerMsg(agent.id,
-                                                    param.world_frame_id,
-                                                    mission.color[agent.id]);
-        pub_grid_path.publish(msg_grid_path_vis);
+        VisualizationWorker::getInstance().submit(
+                pub_grid_path.getTopic() + "/" + std::to_string(agent.id),
+                [pub = pub_grid_path.getPublisher(), path = grid_based_planner->getPath(0), id = agent.id,
+                 frame_id = param.world_frame_id, color = mission->color[agent.id]]() {
+                    pub.publish(msgDeleteAll());
+                    pub.publish(GridBasedPlanner::pathToMarkerMsg(path, id, frame_id, color));
+                });
     }
 
     void TrajPlanner::publishObstaclePrediction() {
-        // obstacle prediction vis
-        visualization_msgs::MarkerArray msg_obs_pred_traj_vis;
-        msg_obs_pred_traj_vis.markers.clear();
-
-        visualization_msgs::Marker marker;
-        marker.header.frame_id = param.world_frame_id;
-        marker.type = visualization_msgs::Marker::SPHERE;
-        marker.action = visualization_msgs::Marker::ADD;
-        marker.ns = std::to_string(agent.id);
-
-        marker.color.a = 0.07;
-        marker.color.r = 0.0;
-        marker.color.g = 0.0;
-        marker.color.b = 0.0;
-
-        int count = 0;
+        if(pub_obs_pred_traj_vis.getNumSubscribers() == 0) {
+            return;
+        }
+
+        // The predictions are sampled here, the markers are built in the background from the samples
+        struct PredictionSample {
+            point3d position;
+            double size;
+            double downwash;
+        };
+        std::vector<PredictionSample> samples;
         for (size_t oi = 0; oi < obstacles.size(); oi++) {
-            if (obstacles[oi].type == ObstacleType::AGENT) {
+            if (neighbors.getType(oi) == ObstacleType::AGENT) {
                 continue;
             }
 
@@ -864,38 +1798,57 @@ namespace DynamicPlanning {
                 double sample_time = i * sample_dt;
                 double obs_pred_size;
                 if(i == 0){
-                    obs_pred_size = obs_pred_sizes[oi].startPoint();
+                    obs_pred_size = obsPredSize(oi).startPoint();
                 }
                 else{
-                    obs_pred_size = obs_pred_sizes[oi].getPointAt(sample_time);
+                    obs_pred_size = obsPredSize(oi).getPointAt(sample_time);
                 }
 
-                marker.scale.x = 2 * obs_pred_size;
-                marker.scale.y = 2 * obs_pred_size;
-                marker.scale.z = 2 * obs_pred_size * obstacles[oi].downwash;
-
                 if(isnan(obs_pred_size)){
                     ROS_ERROR_STREAM("nan!" << sample_time);
                 }
 
-                marker.id = count;
-                marker.pose.position = point3DToPointMsg(obs_pred_trajs[oi].getPointAt(sample_time));
-                marker.pose.orientation = defaultQuaternion();
-                msg_obs_pred_traj_vis.markers.emplace_back(marker);
-                count++;
+                samples.push_back({obsPredTraj(oi).getPointAt(sample_time), obs_pred_size, neighbors.getDownwash(oi)});
             }
         }
-        pub_obs_pred_traj_vis.publish(msg_obs_pred_traj_vis);
+
+        VisualizationWorker::getInstance().submit(
+                pub_obs_pred_traj_vis.getTopic() + "/" + std::to_string(agent.id),
+                [pub = pub_obs_pred_traj_vis.getPublisher(), samples = std::move(samples), id = agent.id,
+                 frame_id = param.world_frame_id]() {
+                    visualization_msgs::MarkerArray msg_obs_pred_traj_vis;
+                    visualization_msgs::Marker marker;
+                    marker.header.frame_id = frame_id;
+                    marker.type = visualization_msgs::Marker::SPHERE;
+                    marker.action = visualization_msgs::Marker::ADD;
+                    marker.ns = std::to_string(id);
+
+                    marker.color.a = 0.07;
+                    marker.color.r = 0.0;
+                    marker.color.g = 0.0;
+                    marker.color.b = 0.0;
+
+                    int count = 0;
+                    for (const auto &sample: samples) {
+                        marker.scale.x = 2 * sample.size;
+                        marker.scale.y = 2 * sample.size;
+                        marker.scale.z = 2 * sample.size * sample.downwash;
+
+                        marker.id = count++;
+                        marker.pose.position = point3DToPointMsg(sample.position);
+                        marker.pose.orientation = defaultQuaternion();
+                        msg_obs_pred_traj_vis.markers.emplace_back(marker);
+                    }
+                    pub.publish(msg_obs_pred_traj_vis);
+                });
     }
 
     void TrajPlanner::publishGridOccupiedPoints() {
-        if (not param.world_use_octomap) {
+        if (not param.world_use_octomap or pub_grid_occupied_points.getNumSubscribers() == 0) {
             return;
         }
 
-        visualization_msgs::MarkerArray msg_delete_all = msgDeleteAll();
-        pub_grid_occupied_points.publish(msg_delete_all);
-
+        // One marker of cubes replaces the previous one, so the old markers are not deleted
         visualization_msgs::MarkerArray msg_occupied_points =
                 grid_based_planner->occupiedPointsToMsg(param.world_frame_id);
         pub_grid_occupied_points.publish(msg_occupied_points);
@@ -916,6 +1869,9 @@ namespace DynamicPlanning {
 
         //If agent's velocity is lower than some threshold, then it determines agent is in deadlock
         double dist_to_goal = (agent.current_state.position - agent.desired_goal_point).norm();
+        if (is_progress_stalled) {
+            return dist_to_goal > 0.2;
+        }
         return planner_seq > param.deadlock_seq_threshold and
                agent.current_state.velocity.norm() < param.deadlock_velocity_threshold and
                dist_to_goal > 0.2;
@@ -947,9 +1903,10 @@ namespace DynamicPlanning {
             return false;
         }
 
-        point3d obs_start_point = obstacles[closest_agent_idx].prev_traj.startPoint();
+        const traj_t &obs_prev_traj = neighbors.getPrevTraj(closest_agent_idx);
+        point3d obs_start_point = obs_prev_traj.startPoint();
         for(int i = 1; i < 3; i++){
-            point3d obs_control_point = obstacles[closest_agent_idx].prev_traj[0].control_points[i];
+            point3d obs_control_point = obs_prev_traj[0].control_points[i];
             double dist = obs_start_point.distance(obs_control_point);
             if(dist > 0.01){ //TODO: param
                 return false;
@@ -958,11 +1915,11 @@ namespace DynamicPlanning {
 
         double downwash = downwashBetween(closest_agent_idx);
         point3d agent_position_trans = coordinateTransform(agent.current_state.position, downwash);
-        point3d obs_position_trans = coordinateTransform(obstacles[closest_agent_idx].position, downwash);
-        point3d obs_goal_trans = coordinateTransform(obstacles[closest_agent_idx].goal_point, downwash);
+        point3d obs_position_trans = coordinateTransform(neighbors.getPosition(closest_agent_idx), downwash);
+        point3d obs_goal_trans = coordinateTransform(neighbors.getGoalPoint(closest_agent_idx), downwash);
         Line obs_line(obs_position_trans, obs_goal_trans);
         ClosestPoints closest_points = closestPointsBetweenPointAndLineSegment(agent_position_trans, obs_line);
-        if(closest_points.dist > agent.radius + obstacles[closest_agent_idx].radius){
+        if(closest_points.dist > agent.radius + neighbors.getRadius(closest_agent_idx)){
             return false;
         }
 
@@ -987,45 +1944,56 @@ namespace DynamicPlanning {
         return false;
     }
 
+    bool TrajPlanner::isHoverReady() const {
+        point3d start_point = prev_traj.startPoint();
+        for (int m = 0; m < prev_traj.size(); m++) {
+            for (const auto &control_point: prev_traj[m].control_points) {
+                if (start_point.distance(control_point) > param.hover_tolerance) {
+                    return false;
+                }
+            }
+        }
+
+        double dist_to_goal = (agent.current_state.position - agent.desired_goal_point).norm();
+        return dist_to_goal < param.goal_threshold or isSolConv() or is_sol_converged_by_sfc;
+    }
+
+    // The checks read the double QP solution, so the float rounding of desired_traj is not mistaken for a violation
+    static void setCheckedSolution(FeasibilityChecker& feasibility_checker, const TrajOptResult& result,
+                                   const Param& param) {
+        if (result.solution.size() > 0) {
+            feasibility_checker.setSolution(result.solution, param.world_dimension, param.world_z_2d);
+        } else {
+            feasibility_checker.setTrajectory(result.desired_traj);
+        }
+    }
+
     bool TrajPlanner::isSolValid(const TrajOptResult& result) const {
         // Check SFC
         if(param.world_use_octomap){
-            for(int m = 0; m < param.M; m++){
-                Box sfc = constraints.getSFC(m);
-                if(m == 0){
-                    for(int i = param.phi; i < param.n + 1; i++){
-                        if(not sfc.isPointInBox(result.desired_traj[m][i])) {
-                            ROS_WARN("[TrajPlanner] solution is not valid due to SFC");
-                            return false;
-                        }
-                    }
-                } else {
-                    if(not sfc.isSegmentInBox(result.desired_traj[m])) {
-                        ROS_WARN("[TrajPlanner] solution not valid due to SFC");
-                        return false;
-                    }
+            FeasibilityChecker feasibility_checker(param.M, param.n);
+            setCheckedSolution(feasibility_checker, result, param);
+            ConstraintViolation violation = feasibility_checker.checkSFCs(constraints, param.phi);
+            if(violation.isViolated()) {
+                ROS_WARN_STREAM("[TrajPlanner] solution is not valid due to SFC, m: " << violation.m
+                                << ", i: " << violation.i);
+                return false;
+            }
+        }
+
+        // Check the clearance of the swept agent to the distance field, e.g. if the map changed after the SFC
+        if (param.world_use_octomap and param.world_swept_clearance_check and distmap_ptr != nullptr) {
+            SweptClearance swept_clearance(*distmap_ptr);
+            for (int m = 0; m < result.desired_traj.size(); m++) {
+                if (not swept_clearance.isSegmentFree(result.desired_traj[m], agent.radius)) {
+                    ROS_WARN_STREAM("[TrajPlanner] solution is not valid due to the clearance, m: " << m);
+                    return false;
                 }
             }
         }
 
-
-        // Check LSC
-//        for(int oi = 0; oi < obstacles.size(); oi++) {
-//            for (int m = 0; m < param.M; m++) {
-//                for (int i = 0; i < param.n + 1; i++) {
-//                    if (m == 0 and i < param.phi) {
-//                        continue;
-//                    }
-//
-//                    LSC lsc = constraints.getLSC(oi, m, i);
-//                    if (lsc.normal_vector.dot(result.desired_traj[m][i] - lsc.obs_control_point) - lsc.d <
-//                        -SP_EPSILON_FLOAT) {
-//                        ROS_WARN("[TrajPlanner] solution is not valid due to LSC");
-//                        return false;
-//                    }
-//                }
-//            }
-//        }
+        // The LSCs are not checked here, the solution satisfies them up to the tolerance of the solver.
+        // Use FeasibilityChecker::checkLSCs to find the violated LSC if needed.
 
         // Check dynamical limit
         double dyn_err_tol_ratio = 0.01;
@@ -1044,10 +2012,29 @@ namespace DynamicPlanning {
         return true;
     }
 
+    bool TrajPlanner::isAnytimeSolValid(const TrajOptResult& result) const {
+        if (not isSolValid(result)) {
+            return false;
+        }
+
+        // Unlike the optimum, the incumbent may be out of the tolerance of the solver
+        FeasibilityChecker feasibility_checker(param.M, param.n);
+        setCheckedSolution(feasibility_checker, result, param);
+        bool skip_slack = param.slack_mode == SlackMode::COLLISIONCONSTRAINT or param.opt_soft_collision;
+        ConstraintViolation violation = feasibility_checker.checkLSCs(
+                constraints, param.world_dimension, param.phi, skip_slack, SP_EPSILON_FLOAT);
+        if (violation.isViolated()) {
+            ROS_WARN_STREAM("[TrajPlanner] solution at the time limit is not valid due to LSC, m: " << violation.m
+                            << ", i: " << violation.i);
+            return false;
+        }
+        return true;
+    }
+
     int TrajPlanner::findObstacleIdxByObsId(int obs_id) const {
         int oi = -1;
         for (size_t i = 0; i < obstacles.size(); i++) {
-            if (obstacles[i].id == obs_id) {
+            if (neighbors.getId(i) == obs_id) {
                 oi = i;
             }
         }
@@ -1060,40 +2047,21 @@ namespace DynamicPlanning {
     }
 
     double TrajPlanner::distanceToGoalByObsIdx(int obs_idx) const {
-        return obstacles[obs_idx].goal_point.distance(obstacles[obs_idx].position);
+        return neighbors.getGoalPoint(obs_idx).distance(neighbors.getPosition(obs_idx));
     }
 
     double TrajPlanner::computeCollisionTimeToDistmap(const point3d &start_position,
                                                       const point3d &goal_position,
                                                       double agent_radius,
                                                       double time_horizon) {
-        double collision_time = 0;
-        bool isCollided = distmap_ptr->getDistance(start_position) < agent_radius;
-        if (goal_position == start_position) {
-            if (isCollided) {
-                collision_time = 0;
-            } else {
-                collision_time = SP_INFINITY;
-            }
-            return collision_time;
-        }
-
+        // The straight motion is a segment of degree 1, the swept ball is checked to the search time step
         double search_time_step = 0.1;
-        double current_time = 0;
-        point3d current_search_point;
-        while (!isCollided and current_time < time_horizon) {
-            current_time += search_time_step;
-            current_search_point = start_position + (goal_position - start_position) * (current_time / time_horizon);
-            isCollided = distmap_ptr->getDistance(current_search_point) < agent_radius;
-        }
-
-        if (isCollided) {
-            collision_time = current_time;
-        } else {
-            collision_time = SP_INFINITY;
-        }
-
-        return collision_time;
+        Segment<point3d> segment;
+        segment.segment_time = time_horizon;
+        segment.control_points.resize(2);
+        segment.control_points[0] = start_position;
+        segment.control_points[1] = goal_position;
+        return SweptClearance(*distmap_ptr).computeCollisionTime(segment, agent_radius, search_time_step);
     }
 
 //    double TrajPlanner::computeMinCollisionTime() {
@@ -1185,40 +2153,88 @@ namespace DynamicPlanning {
         for (size_t i = 0; i < n_control_points; i++) {
             control_points_rel[i] = initial_traj_trans[m][i] - obs_pred_traj_trans[m][i];
 
-            if (obstacles[oi].type == ObstacleType::DYNAMICOBSTACLE and
-                obstacles[oi].downwash > param.obs_downwash_threshold) {
+            if (neighbors.getType(oi) == ObstacleType::DYNAMICOBSTACLE and
+                neighbors.getDownwash(oi) > param.obs_downwash_threshold) {
                 control_points_rel[i].z() = 0;
             }
         }
 
+        // The caches are made by prepareLSCNormalCaches, and each task accesses the cache of its obstacle only
+        auto cache_it = lsc_normal_caches.find(std::make_pair(static_cast<int>(neighbors.getType(oi)),
+                                                              neighbors.getId(oi)));
+        if (param.lsc_cache_tolerance > 0 and cache_it != lsc_normal_caches.end()) {
+            LSCNormalCache &cache = cache_it->second;
+            cache.n_query++;
+            point3d normal_vector;
+            if (findCachedNormalVector(cache, control_points_rel, cache.control_points_rel_next[m], normal_vector)) {
+                cache.n_hit++;
+                cache.normal_vectors_next[m] = normal_vector;
+                return normal_vector;
+            }
+        }
+
+        // The segment m was the segment m + 1 of the previous step, so GJK starts from its normal vector
+        point3d warm_start(0, 0, 0);
+        if (cache_it != lsc_normal_caches.end() and not cache_it->second.normal_vectors.empty()) {
+            const std::vector<point3d> &normal_vectors_prev = cache_it->second.normal_vectors;
+            warm_start = normal_vectors_prev[std::min(static_cast<size_t>(m) + 1, normal_vectors_prev.size() - 1)];
+        }
         ClosestPoints closest_points = closestPointsBetweenPointAndConvexHull(point3d(0, 0, 0),
-                                                                              control_points_rel);
+                                                                              control_points_rel, warm_start);
         point3d normal_vector = closest_points.closest_point2.normalized();
+        if (cache_it != lsc_normal_caches.end() and normal_vector.norm() > SP_EPSILON_FLOAT) {
+            cache_it->second.control_points_rel_next[m] = control_points_rel;
+            cache_it->second.normal_vectors_next[m] = normal_vector;
+        }
 
-        if (obstacles[oi].type == AGENT and closest_points.dist < agent.radius + obstacles[oi].radius - 0.001) {
+        if (neighbors.getType(oi) == AGENT and closest_points.dist < agent.radius + neighbors.getRadius(oi) - 0.001) {
             ROS_WARN_STREAM("[TrajPlanner] invalid normal_vector: " << normal_vector
                                                                     << ", dist: " << closest_points.dist
                                                                     << ", agent_id: " << agent.id << ", obs_id: "
-                                                                    << obstacles[oi].id);
+                                                                    << neighbors.getId(oi));
         }
         return normal_vector;
     }
 
-    point3d TrajPlanner::normalVectorDynamicObs(int oi, int m, double downwash) {
+    bool TrajPlanner::findCachedNormalVector(const LSCNormalCache &cache, const points_t &control_points_rel,
+                                             points_t &control_points_rel_cached, point3d &normal_vector) const {
+        // The trajectories are shifted in time between the steps, so compare with all segments of the previous step.
+        // The cached control points are kept, so the error does not accumulate over the steps.
+        for (size_t m = 0; m < cache.control_points_rel.size(); m++) {
+            const points_t &candidate = cache.control_points_rel[m];
+            if (candidate.size() != control_points_rel.size()) {
+                continue;
+            }
+
+            bool is_unchanged = true;
+            for (size_t i = 0; i < candidate.size() and is_unchanged; i++) {
+                is_unchanged = LInfinityDistance(candidate[i], control_points_rel[i]) < param.lsc_cache_tolerance;
+            }
+            if (is_unchanged) {
+                control_points_rel_cached = candidate;
+                normal_vector = cache.normal_vectors[m];
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    point3d TrajPlanner::normalVectorDynamicObs(int oi, int m, double downwash) const {
         point3d normal_vector;
 
         //Coordinate transformation
-        point3d vector_obs_to_goal = coordinateTransform(agent.current_goal_point - obstacles[oi].position,
+        point3d vector_obs_to_goal = coordinateTransform(agent.current_goal_point - neighbors.getPosition(oi),
                                                          downwash);
-        point3d vector_obs_to_agent = coordinateTransform(agent.current_state.position - obstacles[oi].position,
+        point3d vector_obs_to_agent = coordinateTransform(agent.current_state.position - neighbors.getPosition(oi),
                                                           downwash);
-        if (obstacles[oi].type == ObstacleType::DYNAMICOBSTACLE and
-            obstacles[oi].downwash > param.obs_downwash_threshold) {
+        if (neighbors.getType(oi) == ObstacleType::DYNAMICOBSTACLE and
+            neighbors.getDownwash(oi) > param.obs_downwash_threshold) {
             vector_obs_to_goal.z() = 0;
             vector_obs_to_agent.z() = 0;
         }
 
-        Line obs_path(obs_pred_trajs[oi][m][0], obs_pred_trajs[oi][m][param.n]);
+        Line obs_path(obsPredTraj(oi)[m][0], obsPredTraj(oi)[m][param.n]);
         Line agent_path(initial_traj[m][0], initial_traj[m][param.n]);
         double closest_dist = 0;
         normal_vector = normalVectorBetweenLines(obs_path, agent_path, closest_dist);
@@ -1228,12 +2244,12 @@ namespace DynamicPlanning {
 
     double TrajPlanner::downwashBetween(int oi) const {
         double downwash = 1;
-        if (obstacles[oi].type == ObstacleType::AGENT) {
-            downwash = (agent.downwash * agent.radius + obstacles[oi].downwash * obstacles[oi].radius) /
-                       (agent.radius + obstacles[oi].radius);
+        if (neighbors.getType(oi) == ObstacleType::AGENT) {
+            downwash = (agent.downwash * agent.radius + neighbors.getDownwash(oi) * neighbors.getRadius(oi)) /
+                       (agent.radius + neighbors.getRadius(oi));
         } else {
-            downwash = (agent.radius + obstacles[oi].downwash * obstacles[oi].radius) /
-                       (agent.radius + obstacles[oi].radius);
+            downwash = (agent.radius + neighbors.getDownwash(oi) * neighbors.getRadius(oi)) /
+                       (agent.radius + neighbors.getRadius(oi));
         }
 
         return downwash;
@@ -1242,18 +2258,18 @@ namespace DynamicPlanning {
     double TrajPlanner::downwashBetween(int oi, int oj) const {
         double downwash = 1;
 
-        if (obstacles[oi].type != obstacles[oj].type) {
-            if (obstacles[oi].type == ObstacleType::AGENT) {
-                downwash = (obstacles[oi].radius + obstacles[oj].downwash * obstacles[oj].radius) /
-                           (obstacles[oi].radius + obstacles[oj].radius);
-            } else if (obstacles[oj].type == ObstacleType::AGENT) {
-                downwash = (obstacles[oi].downwash * obstacles[oi].radius + obstacles[oj].radius) /
-                           (obstacles[oi].radius + obstacles[oj].radius);
+        if (neighbors.getType(oi) != neighbors.getType(oj)) {
+            if (neighbors.getType(oi) == ObstacleType::AGENT) {
+                downwash = (neighbors.getRadius(oi) + neighbors.getDownwash(oj) * neighbors.getRadius(oj)) /
+                           (neighbors.getRadius(oi) + neighbors.getRadius(oj));
+            } else if (neighbors.getType(oj) == ObstacleType::AGENT) {
+                downwash = (neighbors.getDownwash(oi) * neighbors.getRadius(oi) + neighbors.getRadius(oj)) /
+                           (neighbors.getRadius(oi) + neighbors.getRadius(oj));
             }
         } else {
-            downwash = (obstacles[oi].downwash * obstacles[oi].radius +
-                        obstacles[oj].downwash * obstacles[oj].radius) /
-                       (obstacles[oi].radius + obstacles[oj].radius);
+            downwash = (neighbors.getDownwash(oi) * neighbors.getRadius(oi) +
+                        neighbors.getDownwash(oj) * neighbors.getRadius(oj)) /
+                       (neighbors.getRadius(oi) + neighbors.getRadius(oj));
         }
 
         return downwash;
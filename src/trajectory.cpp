@@ -6,44 +6,28 @@
 
 namespace DynamicPlanning {
     template<typename T>
-    Segment<T> Segment<T>::subSegment(double t_normalized_0, double t_normalized_f, const Eigen::MatrixXd& B,
-                                      const Eigen::MatrixXd& B_inv){
-        ROS_ERROR("Wrong usage");
-    }
-
-    template<>
-    Segment<point3d> Segment<point3d>::subSegment(double t_normalized_0, double t_normalized_f,
-                                                  const Eigen::MatrixXd& B,
-                                                  const Eigen::MatrixXd& B_inv){
-        // t -> at + b
-        double a, b;
-        b = t_normalized_0;
-        a = t_normalized_f - t_normalized_0;
+    Segment<T> Segment<T>::subSegment(double t_normalized_0, double t_normalized_f) const {
+        Segment<T> sub_segment;
+        sub_segment.segment_time = segment_time * (t_normalized_f - t_normalized_0);
+        sub_segment.control_points = control_points;
 
+        // The split at t_normalized_f keeps [0, t_normalized_f] in place, c[i] is final after the level i
         int n = (int)control_points.size() - 1;
-        Eigen::MatrixXd A = Eigen::MatrixXd::Zero(n + 1, n + 1);
-        for(int i = 0; i < n + 1; i++){
-            for(int j = 0; j < i + 1; j++){
-                A(i, j) = nChoosek(i, j) * pow(a, j) * pow(b, i - j);
+        T *c = sub_segment.control_points.data();
+        double t = t_normalized_f;
+        for (int r = 1; r < n + 1; r++) {
+            for (int i = n; i >= r; i--) {
+                c[i] = c[i - 1] * (1 - t) + c[i] * t;
             }
         }
 
-        Eigen::MatrixXd c_tr = Eigen::MatrixXd::Zero(3, n + 1);
-        for(int k = 0; k < 3; k++){
-            for(int i = 0; i < n + 1; i++){
-                c_tr(k, i) = control_points[i](k);
+        // The split of [0, t_normalized_f] at t_normalized_0 keeps the right part, c[n - r] is final after the level r
+        t = t_normalized_f > 0 ? t_normalized_0 / t_normalized_f : 0;
+        for (int r = 1; r < n + 1; r++) {
+            for (int i = 0; i < n - r + 1; i++) {
+                c[i] = c[i] * (1 - t) + c[i + 1] * t;
             }
         }
-        c_tr = c_tr * B * A * B_inv;
-
-        Segment<point3d> sub_segment;
-        sub_segment.segment_time = segment_time * a;
-        sub_segment.control_points.resize(n + 1);
-        for(int i = 0; i < n + 1; i++){
-            sub_segment.control_points[i] = point3d(c_tr(0, i),
-                                                    c_tr(1, i),
-                                                    c_tr(2, i));
-        }
 
         return sub_segment;
     }
@@ -66,10 +50,17 @@ namespace DynamicPlanning {
 
     template<typename T>
     Trajectory<T>::Trajectory(size_t _M, size_t _n, double dt) {
+        reset(_M, _n, dt);
+    }
+
+    template<typename T>
+    void Trajectory<T>::reset(size_t _M, size_t _n, double dt) {
+        revision = 0;
         M = _M;
         n = _n;
         segments.resize(M);
         for (int m = 0; m < M; m++) {
+            segments[m].control_points.resize(0);
             segments[m].control_points.resize(n + 1);
             segments[m].segment_time = dt;
         }
@@ -80,13 +71,40 @@ namespace DynamicPlanning {
         if(n == 0 or segments.empty()){
             throw std::invalid_argument("[Trajectory] n = 0");
         }
+        revision = 0;
+
+        // p(t_m + s * T_m) = p + v * t_m + v * T_m * s, and s = sum_i (i / n) B_i^n(s)
+        double segment_start_time = 0;
+        for (int m = 0; m < M; m++) {
+            double segment_time = segments[m].segment_time;
+            for (int i = 0; i < n + 1; i++) {
+                segments[m][i] = current_state + velocity * (segment_start_time + segment_time * i / n);
+            }
+            segment_start_time += segment_time;
+        }
+    }
+
+    template<typename T>
+    void Trajectory<T>::planConstAccTraj(T current_state, T velocity, T acceleration){
+        if(n < 2 or segments.empty()){
+            throw std::invalid_argument("[Trajectory] n < 2, the constant acceleration needs degree 2");
+        }
+        revision = 0;
 
-        double time = 0;
+        // p(t_m + s * T_m) = p(t_m) + p'(t_m) * T_m * s + a / 2 * T_m^2 * s^2, and the degree elevation of the
+        // monomials is s = sum_i (i / n) B_i^n(s), s^2 = sum_i (i (i - 1) / (n (n - 1))) B_i^n(s)
+        double segment_start_time = 0;
         for (int m = 0; m < M; m++) {
+            double segment_time = segments[m].segment_time;
+            T start_state = current_state + velocity * segment_start_time +
+                            acceleration * (0.5 * segment_start_time * segment_start_time);
+            T linear = (velocity + acceleration * segment_start_time) * segment_time;
+            T quadratic = acceleration * (0.5 * segment_time * segment_time);
             for (int i = 0; i < n + 1; i++) {
-                segments[m][i] = current_state + velocity * time;
-                time +=  segments[m].segment_time / n;
+                segments[m][i] = start_state + linear * ((double)i / n) +
+                                 quadratic * ((double)(i * (i - 1)) / (n * (n - 1)));
             }
+            segment_start_time += segment_time;
         }
     }
 
@@ -97,11 +115,23 @@ namespace DynamicPlanning {
 
     template<typename T>
     void Trajectory<T>::clear() {
+        revision = 0;
         M = 0;
         n = 0;
         segments.clear();
     }
 
+    // Revisions are unique over all trajectories, 0 is reserved for unknown
+    static std::atomic<uint64_t> next_trajectory_revision{1};
+
+    template<typename T>
+    uint64_t Trajectory<T>::getRevision() const {
+        if (revision == 0) {
+            revision = next_trajectory_revision.fetch_add(1, std::memory_order_relaxed);
+        }
+        return revision;
+    }
+
     template<typename T>
     int Trajectory<T>::size() const {
         return segments.size();
@@ -109,15 +139,122 @@ namespace DynamicPlanning {
 
     template<typename T>
     T Trajectory<T>::getPointAt(double time) const {
-        T point;
+        int m;
+        double t_normalized;
+        if (not findSegment(time, m, t_normalized)) {
+            return T();
+        }
+
+        return deCasteljau(segments[m].control_points.data(), (int)n, t_normalized);
+    }
+
+    template<typename T>
+    State Trajectory<T>::getStateAt(double time) const {
+        ROS_ERROR("Wrong usage");
+    }
+
+    template<>
+    State Trajectory<point3d>::getStateAt(double time) const {
+        State state;
+        if (n > MAX_BERNSTEIN_DEGREE) {
+            state.position = getPointAt(time);
+
+            traj_t dtraj = derivative();
+            state.velocity = dtraj.getPointAt(time);
+
+            traj_t ddtraj = dtraj.derivative();
+            state.acceleration = ddtraj.getPointAt(time);
+
+            return state;
+        }
+
+        int m;
+        double t_normalized;
+        if (not findSegment(time, m, t_normalized)) {
+            return state;
+        }
+
+        // Control points of the derivatives of the segment only
+        const Segment<point3d> &segment = segments[m];
+        std::array<point3d, MAX_BERNSTEIN_DEGREE + 1> vel_control_points, acc_control_points;
+        for (int i = 0; i < (int)n; i++) {
+            vel_control_points[i] = (segment.control_points[i + 1] - segment.control_points[i]) *
+                                    (n / segment.segment_time);
+        }
+        for (int i = 0; i < (int)n - 1; i++) {
+            acc_control_points[i] = (vel_control_points[i + 1] - vel_control_points[i]) *
+                                    ((n - 1) / segment.segment_time);
+        }
+
+        state.position = deCasteljau(segment.control_points.data(), (int)n, t_normalized);
+        state.velocity = deCasteljau(vel_control_points.data(), (int)n - 1, t_normalized);
+        state.acceleration = deCasteljau(acc_control_points.data(), (int)n - 2, t_normalized);
+        return state;
+    }
+
+    template<typename T>
+    void Trajectory<T>::samplePoints(double time_step, size_t n_samples, std::vector<T> &points) const {
+        points.assign(n_samples, T());
+        if (M == 0 or n_samples == 0) {
+            return;
+        }
+
+        // Uniform grid: the sample k is at the normalized time (k % steps) / steps of the segment k / steps
+        int steps = 0;
+        double segment_time = segments[0].segment_time;
+        bool is_uniform = time_step > 0;
+        for (const auto &segment: segments) {
+            is_uniform = is_uniform and std::abs(segment.segment_time - segment_time) < SP_EPSILON_FLOAT;
+        }
+        if (is_uniform) {
+            steps = (int)std::round(segment_time / time_step);
+            is_uniform = steps > 0 and std::abs(steps * time_step - segment_time) < SP_EPSILON_FLOAT;
+        }
+
+        size_t n_bases = n + 1;
+        static thread_local std::vector<double> bases;
+        if (is_uniform) {
+            bases.resize(steps * n_bases);
+            for (int j = 0; j < steps; j++) {
+                getBernsteinBases((int)n, (double)j / steps, bases.data() + j * n_bases);
+            }
+        } else {
+            bases.resize(n_bases);
+        }
+
+        for (size_t k = 0; k < n_samples; k++) {
+            if (is_uniform and k < M * steps) {
+                size_t m = k / steps;
+                const double *basis_row = bases.data() + (k % steps) * n_bases;
+                points[k] = combineControlPoints(segments[m].control_points.data(), (int)n, basis_row);
+                continue;
+            }
+
+            int m;
+            double t_normalized;
+            if (not findSegment((double)k * time_step, m, t_normalized)) {
+                continue;
+            }
+            if (is_uniform) {
+                // Past the uniform grid, only the end point is within the tolerance of the horizon
+                points[k] = segments[m].control_points[n];
+            } else {
+                getBernsteinBases((int)n, t_normalized, bases.data());
+                points[k] = combineControlPoints(segments[m].control_points.data(), (int)n, bases.data());
+            }
+        }
+    }
+
+    template<typename T>
+    bool Trajectory<T>::findSegment(double time, int &m, double &t_normalized) const {
         if (time < 0) {
             ROS_ERROR("[Trajectory] trajectory getPoint time < 0");
-            return point;
+            return false;
 //            throw std::invalid_argument("[Trajectory] trajectory getPoint time < 0");
         }
 
-        int m = -1;
-        double t_normalized, segment_end_time = 0;
+        m = -1;
+        double segment_end_time = 0;
         for (int idx = 0; idx < M; idx++) {
             segment_end_time += segments[idx].segment_time;
             if (time < segment_end_time) {
@@ -134,39 +271,12 @@ namespace DynamicPlanning {
             }
             else{
                 ROS_ERROR("[Trajectory] trajectory getPoint time is out of bound");
-                return point;
+                return false;
 //                throw std::invalid_argument("[Trajectory] trajectory getPoint time is out of bound");
             }
         }
 
-        for (int i = 0; i < n + 1; i++) {
-            double b_i_n = getBernsteinBasis(n, i, t_normalized);
-            point = point + segments[m].control_points[i] * b_i_n;
-        }
-
-        return point;
-    }
-
-    template<typename T>
-    State Trajectory<T>::getStateAt(double time) const {
-        ROS_ERROR("Wrong usage");
-    }
-
-    template<>
-    State Trajectory<point3d>::getStateAt(double time) const {
-        State state;
-        state.position = getPointAt(time);
-
-        traj_t dtraj = derivative();
-        state.velocity = dtraj.getPointAt(time);
-
-        traj_t ddtraj = dtraj.derivative();
-        state.acceleration = ddtraj.getPointAt(time);
-
-        traj_t dddtraj = ddtraj.derivative();
-        point3d jerk = dddtraj.getPointAt(time);
-
-        return state;
+        return true;
     }
 
     template<typename T>
@@ -182,11 +292,19 @@ namespace DynamicPlanning {
     template<typename T>
     Trajectory<T> Trajectory<T>::derivative() const {
         Trajectory<T> dtraj;
+        derivative(dtraj);
+        return dtraj;
+    }
+
+    template<typename T>
+    void Trajectory<T>::derivative(Trajectory<T> &dtraj) const {
+        dtraj.revision = 0;
         dtraj.M = M;
         dtraj.n = n - 1;
         dtraj.segments.resize(M);
         for (int m = 0; m < M; m++) {
             dtraj.segments[m].segment_time = segments[m].segment_time;
+            dtraj.segments[m].control_points.resize(0);
             dtraj.segments[m].control_points.resize(n + 1);
             for (int i = 0; i < n; i++) {
                 dtraj.segments[m].control_points[i] =
@@ -194,8 +312,6 @@ namespace DynamicPlanning {
                         (n / segments[m].segment_time);
             }
         }
-
-        return dtraj;
     }
 
     template<typename T>
@@ -203,9 +319,14 @@ namespace DynamicPlanning {
         ROS_ERROR("Wrong usage");
     }
 
+    template<typename T>
+    void Trajectory<T>::coordinateTransform(double downwash, Trajectory<T> &traj_trans) const {
+        ROS_ERROR("Wrong usage");
+    }
+
     template<>
-    Trajectory<point3d> Trajectory<point3d>::coordinateTransform(double downwash) {
-        traj_t traj_trans;
+    void Trajectory<point3d>::coordinateTransform(double downwash, traj_t &traj_trans) const {
+        traj_trans.revision = 0;
         traj_trans.M = M;
         traj_trans.n = n;
         traj_trans.segments = segments;
@@ -214,7 +335,12 @@ namespace DynamicPlanning {
                 traj_trans.segments[m].control_points[i].z() /= (float)downwash;
             }
         }
+    }
 
+    template<>
+    Trajectory<point3d> Trajectory<point3d>::coordinateTransform(double downwash) {
+        traj_t traj_trans;
+        coordinateTransform(downwash, traj_trans);
         return traj_trans;
     }
 
@@ -241,14 +367,19 @@ namespace DynamicPlanning {
         marker.color = color;
         marker.pose.orientation = defaultQuaternion();
 
-        double horizon = 0, dt = 0.05, time = 0;
+        double horizon = 0, dt = 0.05;
         for(const auto& segment : segments){
             horizon += segment.segment_time;
         }
-        while(time < horizon){
-            point3d point = getPointAt(time);
+        size_t n_samples = 0;
+        while(n_samples * dt < horizon){
+            n_samples++;
+        }
+        points_t points;
+        samplePoints(dt, n_samples, points);
+        marker.points.reserve(n_samples + 1);
+        for(const auto& point : points){
             marker.points.emplace_back(point3DToPointMsg(point));
-            time += dt;
         }
         point3d point = getPointAt(horizon);
         marker.points.emplace_back(point3DToPointMsg(point));
@@ -257,15 +388,76 @@ namespace DynamicPlanning {
     }
 
     template<typename T>
-    Segment<T> Trajectory<T>::operator[] (int idx) const {
+    const Segment<T>& Trajectory<T>::operator[] (int idx) const {
         return segments[idx];
     }
 
     template<typename T>
     Segment<T>& Trajectory<T>::operator[] (int idx){
+        revision = 0;
         return segments[idx];
     }
 
+    void TrajectoryMemo::clear() {
+        n_entries = 0;
+    }
+
+    const traj_t &TrajectoryMemo::coordinateTransform(const traj_t &traj, double downwash) {
+        uint64_t revision = traj.getRevision();
+        const Entry *entry = find(revision, TRANSFORM, downwash);
+        if (entry != nullptr) {
+            return entry->traj;
+        }
+
+        Entry &new_entry = addEntry(revision, TRANSFORM, downwash);
+        traj.coordinateTransform(downwash, new_entry.traj);
+        return new_entry.traj;
+    }
+
+    const traj_t &TrajectoryMemo::derivative(const traj_t &traj, int order) {
+        if (order <= 0) {
+            return traj;
+        }
+        uint64_t revision = traj.getRevision();
+        const Entry *entry = find(revision, DERIVATIVE, order);
+        if (entry != nullptr) {
+            return entry->traj;
+        }
+
+        // The lower orders are memoized too
+        const traj_t &lower_traj = derivative(traj, order - 1);
+        Entry &new_entry = addEntry(revision, DERIVATIVE, order);
+        lower_traj.derivative(new_entry.traj);
+        return new_entry.traj;
+    }
+
+    const traj_t *TrajectoryMemo::findCoordinateTransform(const traj_t &traj, double downwash) const {
+        const Entry *entry = find(traj.getRevision(), TRANSFORM, downwash);
+        return entry == nullptr ? nullptr : &entry->traj;
+    }
+
+    const TrajectoryMemo::Entry *TrajectoryMemo::find(uint64_t revision, Kind kind, double parameter) const {
+        // A few entries per cycle, linear search
+        for (size_t idx = 0; idx < n_entries; idx++) {
+            const Entry &entry = entries[idx];
+            if (entry.revision == revision and entry.kind == kind and entry.parameter == parameter) {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    TrajectoryMemo::Entry &TrajectoryMemo::addEntry(uint64_t revision, Kind kind, double parameter) {
+        if (n_entries == entries.size()) {
+            entries.emplace_back();
+        }
+        Entry &entry = entries[n_entries++];
+        entry.revision = revision;
+        entry.kind = kind;
+        entry.parameter = parameter;
+        return entry;
+    }
+
 //    template class Segment<point3d>;
 //    template class Segment<double>;
 //    template class Trajectory<point3d>;
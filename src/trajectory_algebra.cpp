@@ -0,0 +1,98 @@
+#include <trajectory_algebra.hpp>
+#include <metrics_registry.hpp>
+
+namespace DynamicPlanning {
+    TrajectoryAlgebraCache &TrajectoryAlgebraCache::getInstance() {
+        static TrajectoryAlgebraCache cache;
+        return cache;
+    }
+
+    std::shared_ptr<const SegmentAlgebra> TrajectoryAlgebraCache::getSegmentAlgebra(int n, int phi, int phi_n,
+                                                                                   double dt) {
+        if (phi > n) {
+            throw std::invalid_argument("[TrajectoryAlgebraCache] phi must not be larger than n");
+        }
+        if (n > MAX_BERNSTEIN_DEGREE) {
+            throw std::invalid_argument("[TrajectoryAlgebraCache] n must not be larger than " +
+                                        std::to_string(MAX_BERNSTEIN_DEGREE));
+        }
+
+        std::lock_guard<std::mutex> lock(mtx);
+        auto &entry = segment_algebras[Key(n, phi, phi_n, dt)];
+        if (entry == nullptr) {
+            static MetricCounter &algebra_builds = MetricsRegistry::getInstance().getCounter(
+                    "lsc_trajectory_algebra_builds_total", "Number of the trajectory algebra entries built");
+            algebra_builds.increment();
+            entry = buildSegmentAlgebra(n, phi, phi_n, dt);
+        }
+        return entry;
+    }
+
+    std::shared_ptr<const Eigen::MatrixXd> TrajectoryAlgebraCache::getContinuityMatrix(int n, int phi, int M,
+                                                                                     double dt) {
+        // The continuity matrix does not depend on the cost, phi_n = 0 is the smallest entry
+        std::shared_ptr<const SegmentAlgebra> segment_algebra = getSegmentAlgebra(n, phi, 0, dt);
+
+        std::lock_guard<std::mutex> lock(mtx);
+        auto &entry = continuity_matrices[Key(n, phi, M, dt)];
+        if (entry == nullptr) {
+            entry = buildContinuityMatrix(*segment_algebra, M);
+        }
+        return entry;
+    }
+
+    std::shared_ptr<const SegmentAlgebra> TrajectoryAlgebraCache::buildSegmentAlgebra(int n, int phi, int phi_n,
+                                                                                     double dt) {
+        auto algebra = std::make_shared<SegmentAlgebra>();
+        algebra->n = n;
+        algebra->phi = phi;
+        algebra->phi_n = phi_n;
+        algebra->dt = dt;
+
+        fillBernsteinBasis(n, algebra->B);
+        algebra->B_inv = algebra->B.inverse();
+        fillEndpointDerivativeMatrices(n, algebra->A_0, algebra->A_T);
+
+        // Cost matrix Q
+        const SegmentAlgebra::Matrix &B = algebra->B;
+        algebra->Q_base.setZero(n + 1, n + 1);
+        for (int k = phi; k > phi - phi_n; k--) {
+            SegmentAlgebra::Matrix Z = SegmentAlgebra::Matrix::Zero(n + 1, n + 1);
+            for (int i = 0; i < n + 1; i++) {
+                for (int j = 0; j < n + 1; j++) {
+                    if (i + j - 2 * k + 1 > 0)
+                        Z(i, j) =
+                                (double) coef_derivative(i, k) * coef_derivative(j, k) / (i + j - 2 * k + 1);
+                }
+            }
+            Z = B * Z * B.transpose();
+            Z = Z * pow(dt, -2 * k + 1);
+            algebra->Q_base += Z;
+        }
+
+        return algebra;
+    }
+
+    std::shared_ptr<const Eigen::MatrixXd> TrajectoryAlgebraCache::buildContinuityMatrix(
+            const SegmentAlgebra &segment_algebra, int M) {
+        int n = segment_algebra.n;
+        int phi = segment_algebra.phi;
+        double dt = segment_algebra.dt;
+        const SegmentAlgebra::Matrix &A_0 = segment_algebra.A_0;
+        const SegmentAlgebra::Matrix &A_T = segment_algebra.A_T;
+
+        auto Aeq_base = std::make_shared<Eigen::MatrixXd>(
+                Eigen::MatrixXd::Zero(std::max(M - 2, 0) * phi, M * (n + 1)));
+        for (int m = 2; m < M; m++) {
+            int nn = 1;
+            for (int j = 0; j < phi; j++) {
+                Aeq_base->block(phi * (m - 2) + j, (n + 1) * (m - 1), 1, n + 1) =
+                        pow(dt, -j) * nn * A_T.row(j);
+                Aeq_base->block(phi * (m - 2) + j, (n + 1) * m, 1, n + 1) =
+                        -pow(dt, -j) * nn * A_0.row(j);
+                nn = nn * (n - j);
+            }
+        }
+        return Aeq_base;
+    }
+}
@@ -0,0 +1,155 @@
+// Measure the time and the heap allocations of the trajectory operations of a planning step: obstacle prediction,
+// coordinate transformation, derivatives, state queries and uniform sampling, with the buffers reused across steps.
+// Then compare the states of all agents by traj_t::getStateAt per agent and by TrajectoryBundle.
+// rosrun lsc_dr_planner trajectory_benchmark [M] [n] [obstacles] [steps] [agents]
+#include <trajectory.hpp>
+#include <trajectory_bundle.hpp>
+#include <timer.hpp>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <random>
+
+static std::atomic<size_t> n_allocations(0);
+
+void *operator new(size_t size) {
+    n_allocations++;
+    void *ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+using namespace DynamicPlanning;
+
+struct StepBuffers {
+    std::vector<traj_t> obs_pred_trajs;
+    traj_t initial_traj, initial_traj_trans, obs_pred_traj_trans, dtraj;
+    points_t points;
+};
+
+// One planning step, returns a checksum so that the work is not optimized out
+static double runStep(const std::vector<traj_t> &prev_trajs, size_t M, size_t n, double dt, StepBuffers &buffers) {
+    double checksum = 0;
+    buffers.initial_traj.reset(M, n, dt);
+    buffers.initial_traj.planConstVelTraj(point3d(0, 0, 1), point3d(1, 0, 0));
+    for (size_t oi = 0; oi < prev_trajs.size(); oi++) {
+        traj_t &obs_pred_traj = buffers.obs_pred_trajs[oi];
+        obs_pred_traj.reset(M, n, dt);
+        for (size_t m = 0; m + 1 < M; m++) {
+            obs_pred_traj[m] = prev_trajs[oi][m + 1];
+        }
+
+        buffers.initial_traj.coordinateTransform(2.0, buffers.initial_traj_trans);
+        obs_pred_traj.coordinateTransform(2.0, buffers.obs_pred_traj_trans);
+        for (size_t m = 0; m < M; m++) {
+            const Segment<point3d> &segment = buffers.obs_pred_traj_trans[m];
+            for (const auto &control_point: segment.control_points) {
+                checksum += (control_point - buffers.initial_traj_trans[m].startPoint()).norm();
+            }
+        }
+
+        State state = obs_pred_traj.getStateAt(0.5 * dt);
+        checksum += state.position.norm() + state.velocity.norm() + state.acceleration.norm();
+    }
+
+    buffers.initial_traj.derivative(buffers.dtraj);
+    buffers.dtraj.samplePoints(0.5 * dt, 2 * M, buffers.points);
+    for (const auto &point: buffers.points) {
+        checksum += point.norm();
+    }
+    return checksum;
+}
+
+int main(int argc, char *argv[]) {
+    size_t M = argc > 1 ? std::stoul(argv[1]) : 5;
+    size_t n = argc > 2 ? std::stoul(argv[2]) : 5;
+    size_t n_obstacles = argc > 3 ? std::stoul(argv[3]) : 20;
+    size_t n_steps = argc > 4 ? std::stoul(argv[4]) : 10000;
+    size_t n_agents = argc > 5 ? std::stoul(argv[5]) : 100;
+    double dt = 0.2;
+
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-5, 5);
+    std::vector<traj_t> prev_trajs(n_obstacles, traj_t(M, n, dt));
+    for (auto &prev_traj: prev_trajs) {
+        for (size_t m = 0; m < M; m++) {
+            for (size_t i = 0; i < n + 1; i++) {
+                prev_traj[m][i] = point3d(dist(rng), dist(rng), dist(rng));
+            }
+        }
+    }
+
+    // The first step sizes the buffers
+    StepBuffers buffers;
+    buffers.obs_pred_trajs.resize(n_obstacles);
+    double checksum = runStep(prev_trajs, M, n, dt, buffers);
+
+    size_t n_allocations_start = n_allocations;
+    Timer timer;
+    for (size_t step = 0; step < n_steps; step++) {
+        checksum += runStep(prev_trajs, M, n, dt, buffers);
+    }
+    timer.stop();
+    size_t n_step_allocations = n_allocations - n_allocations_start;
+
+    std::cout << "M " << M << ", n " << n << ", obstacles " << n_obstacles << ", steps " << n_steps << std::endl
+              << "time per step: " << 1e6 * timer.elapsedSeconds() / n_steps << " us" << std::endl
+              << "allocations per step: " << static_cast<double>(n_step_allocations) / n_steps << std::endl
+              << "checksum: " << checksum << std::endl;
+
+    // States of all agents at the sample times of a horizon
+    std::vector<traj_t> agent_trajs(n_agents, traj_t(M, n, dt));
+    std::vector<const traj_t *> agent_traj_ptrs;
+    for (auto &agent_traj: agent_trajs) {
+        for (size_t m = 0; m < M; m++) {
+            for (size_t i = 0; i < n + 1; i++) {
+                agent_traj[m][i] = point3d(dist(rng), dist(rng), dist(rng));
+            }
+        }
+        agent_traj_ptrs.emplace_back(&agent_traj);
+    }
+    size_t n_times = 10 * M;
+    double time_step = M * dt / n_times;
+
+    double checksum_per_agent = 0;
+    Timer timer_per_agent;
+    for (size_t k = 0; k < n_times; k++) {
+        for (const auto &agent_traj: agent_trajs) {
+            State state = agent_traj.getStateAt(k * time_step);
+            checksum_per_agent += state.position.x() + state.velocity.x() + state.acceleration.x();
+        }
+    }
+    timer_per_agent.stop();
+
+    double checksum_bundle = 0;
+    std::vector<State> states;
+    TrajectoryBundle bundle;
+    Timer timer_bundle;
+    bundle.build(agent_traj_ptrs);
+    for (size_t k = 0; k < n_times; k++) {
+        bundle.evaluate(k * time_step, states);
+        for (const auto &state: states) {
+            checksum_bundle += state.position.x() + state.velocity.x() + state.acceleration.x();
+        }
+    }
+    timer_bundle.stop();
+
+    std::cout << "agents " << n_agents << ", times " << n_times
+              << ", AVX2 " << (TrajectoryBundle::isAVX2Available() ? "on" : "off") << std::endl
+              << "getStateAt per agent: " << 1e6 * timer_per_agent.elapsedSeconds() / n_times << " us per time"
+              << ", checksum " << checksum_per_agent << std::endl
+              << "TrajectoryBundle: " << 1e6 * timer_bundle.elapsedSeconds() / n_times << " us per time"
+              << ", checksum " << checksum_bundle << std::endl;
+    return 0;
+}
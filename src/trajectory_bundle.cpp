@@ -0,0 +1,207 @@
+#include <trajectory_bundle.hpp>
+
+#if defined(__GNUC__) and (defined(__x86_64__) or defined(__i386__))
+#define LSC_PLANNER_AVX2_KERNEL
+#include <immintrin.h>
+#endif
+
+namespace DynamicPlanning {
+    // fields[order * 3 + k][lane] = sum_i weights[order][i] * coef[m][i][k][lane]
+    static void evaluateLanesScalar(const double *coef, const double *weights, size_t n, size_t n_lanes,
+                                    double *fields) {
+        for (size_t k = 0; k < 3; k++) {
+            for (size_t lane = 0; lane < n_lanes; lane++) {
+                double values[3] = {0, 0, 0};
+                for (size_t i = 0; i < n + 1; i++) {
+                    double c = coef[(i * 3 + k) * n_lanes + lane];
+                    for (size_t order = 0; order < 3; order++) {
+                        values[order] += weights[order * (n + 1) + i] * c;
+                    }
+                }
+                for (size_t order = 0; order < 3; order++) {
+                    fields[(order * 3 + k) * n_lanes + lane] = values[order];
+                }
+            }
+        }
+    }
+
+#ifdef LSC_PLANNER_AVX2_KERNEL
+    __attribute__((target("avx2")))
+    static void evaluateLanesAVX2(const double *coef, const double *weights, size_t n, size_t n_lanes,
+                                  double *fields) {
+        for (size_t k = 0; k < 3; k++) {
+            for (size_t lane = 0; lane < n_lanes; lane += 4) {
+                __m256d values[3] = {_mm256_setzero_pd(), _mm256_setzero_pd(), _mm256_setzero_pd()};
+                for (size_t i = 0; i < n + 1; i++) {
+                    __m256d c = _mm256_loadu_pd(coef + (i * 3 + k) * n_lanes + lane);
+                    for (size_t order = 0; order < 3; order++) {
+                        __m256d weight = _mm256_set1_pd(weights[order * (n + 1) + i]);
+                        values[order] = _mm256_add_pd(values[order], _mm256_mul_pd(weight, c));
+                    }
+                }
+                for (size_t order = 0; order < 3; order++) {
+                    _mm256_storeu_pd(fields + (order * 3 + k) * n_lanes + lane, values[order]);
+                }
+            }
+        }
+    }
+#endif
+
+    bool TrajectoryBundle::build(const std::vector<const traj_t *> &trajs) {
+        qn = 0;
+        n_lanes = 0;
+        if (trajs.empty() or trajs[0]->empty()) {
+            return false;
+        }
+
+        const traj_t &traj0 = *trajs[0];
+        M = traj0.size();
+        n = traj0[0].control_points.size() - 1;
+        segment_times.resize(M);
+        for (size_t m = 0; m < M; m++) {
+            segment_times[m] = traj0[m].segment_time;
+        }
+        for (const auto *traj: trajs) {
+            if (traj->size() != (int)M) {
+                return false;
+            }
+            for (size_t m = 0; m < M; m++) {
+                const Segment<point3d> &segment = (*traj)[m];
+                if (segment.control_points.size() != n + 1 or
+                    std::abs(segment.segment_time - segment_times[m]) > SP_EPSILON_FLOAT) {
+                    return false;
+                }
+            }
+        }
+
+        qn = trajs.size();
+        n_lanes = (qn + 3) / 4 * 4;
+        coef.assign(M * (n + 1) * 3 * n_lanes, 0);
+        for (size_t qi = 0; qi < qn; qi++) {
+            for (size_t m = 0; m < M; m++) {
+                for (size_t i = 0; i < n + 1; i++) {
+                    const point3d &control_point = (*trajs[qi])[m].control_points[i];
+                    for (size_t k = 0; k < 3; k++) {
+                        coef[((m * (n + 1) + i) * 3 + k) * n_lanes + qi] = control_point(k);
+                    }
+                }
+            }
+        }
+        weights.resize(3 * (n + 1));
+        fields.resize(SampledStates::N_FIELDS * n_lanes);
+        return true;
+    }
+
+    void TrajectoryBundle::evaluate(double time, std::vector<State> &states) const {
+        states.assign(qn, State());
+        int m = computeWeights(time);
+        if (m < 0) {
+            return;
+        }
+
+        evaluateFields(m);
+        for (size_t qi = 0; qi < qn; qi++) {
+            for (int k = 0; k < 3; k++) {
+                states[qi].position(k) = (float)fields[(SampledStates::PX + k) * n_lanes + qi];
+                states[qi].velocity(k) = (float)fields[(SampledStates::VX + k) * n_lanes + qi];
+                states[qi].acceleration(k) = (float)fields[(SampledStates::AX + k) * n_lanes + qi];
+            }
+        }
+    }
+
+    void TrajectoryBundle::sample(double time_step, size_t n_samples, SampledStates &sampled_states) const {
+        sampled_states.resize(qn, time_step, n_samples);
+        for (size_t sample = 0; sample < n_samples; sample++) {
+            int m = computeWeights((double)sample * time_step);
+            if (m >= 0) {
+                evaluateFields(m);
+            } else {
+                std::fill(fields.begin(), fields.end(), 0);
+            }
+            for (int field = 0; field < SampledStates::N_FIELDS; field++) {
+                for (size_t qi = 0; qi < qn; qi++) {
+                    sampled_states.getMutableField(static_cast<SampledStates::Field>(field), qi)[sample] =
+                            (float)fields[field * n_lanes + qi];
+                }
+            }
+        }
+    }
+
+    bool TrajectoryBundle::isAVX2Available() {
+#ifdef LSC_PLANNER_AVX2_KERNEL
+        static const bool avx2_available = __builtin_cpu_supports("avx2");
+        return avx2_available;
+#else
+        return false;
+#endif
+    }
+
+    int TrajectoryBundle::computeWeights(double time) const {
+        // Same segment search as traj_t::findSegment
+        if (time < 0) {
+            ROS_ERROR("[TrajectoryBundle] trajectory getPoint time < 0");
+            return -1;
+        }
+        int m = -1;
+        double t_normalized = 0, segment_end_time = 0;
+        for (size_t idx = 0; idx < M; idx++) {
+            segment_end_time += segment_times[idx];
+            if (time < segment_end_time) {
+                m = (int)idx;
+                t_normalized = 1 - (segment_end_time - time) / segment_times[idx];
+                break;
+            }
+        }
+        if (m == -1) {
+            if (time < segment_end_time + SP_EPSILON_FLOAT) {
+                m = (int)M - 1;
+                t_normalized = 1.0;
+            } else {
+                ROS_ERROR("[TrajectoryBundle] trajectory getPoint time is out of bound");
+                return -1;
+            }
+        }
+
+        // p = sum c_i B_i^n, p' = n / T * sum (c_(i+1) - c_i) B_i^(n-1),
+        // p'' = n (n - 1) / T^2 * sum (c_(i+2) - 2 c_(i+1) + c_i) B_i^(n-2)
+        std::array<double, MAX_BERNSTEIN_DEGREE + 1> bases;
+        int degree = (int)n;
+        double segment_time = segment_times[m];
+        double *position_weights = weights.data();
+        double *velocity_weights = weights.data() + (n + 1);
+        double *acceleration_weights = weights.data() + 2 * (n + 1);
+        std::fill(weights.begin(), weights.end(), 0);
+
+        getBernsteinBases(degree, t_normalized, bases.data());
+        std::copy(bases.begin(), bases.begin() + degree + 1, position_weights);
+        if (degree >= 1) {
+            getBernsteinBases(degree - 1, t_normalized, bases.data());
+            double scale = degree / segment_time;
+            for (int j = 0; j < degree; j++) {
+                velocity_weights[j + 1] += scale * bases[j];
+                velocity_weights[j] -= scale * bases[j];
+            }
+        }
+        if (degree >= 2) {
+            getBernsteinBases(degree - 2, t_normalized, bases.data());
+            double scale = degree * (degree - 1) / (segment_time * segment_time);
+            for (int j = 0; j < degree - 1; j++) {
+                acceleration_weights[j + 2] += scale * bases[j];
+                acceleration_weights[j + 1] -= 2 * scale * bases[j];
+                acceleration_weights[j] += scale * bases[j];
+            }
+        }
+        return m;
+    }
+
+    void TrajectoryBundle::evaluateFields(int m) const {
+        const double *segment_coef = coef.data() + m * (n + 1) * 3 * n_lanes;
+#ifdef LSC_PLANNER_AVX2_KERNEL
+        if (isAVX2Available()) {
+            evaluateLanesAVX2(segment_coef, weights.data(), n, n_lanes, fields.data());
+            return;
+        }
+#endif
+        evaluateLanesScalar(segment_coef, weights.data(), n, n_lanes, fields.data());
+    }
+}
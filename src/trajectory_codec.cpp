@@ -0,0 +1,264 @@
+#include <trajectory_codec.hpp>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace DynamicPlanning {
+    struct FrameHeader {
+        uint8_t version;
+        uint8_t type;
+        uint8_t M;
+        uint8_t n;
+        uint16_t seq;
+        uint16_t reference_seq;
+        uint8_t reference_shift;
+        float step;
+        float segment_time;
+        float start_point[3];
+    };
+
+    template<typename T>
+    static void writeField(uint8_t *&ptr, const T &value) {
+        std::memcpy(ptr, &value, sizeof(T));
+        ptr += sizeof(T);
+    }
+
+    template<typename T>
+    static void readField(const uint8_t *&ptr, T &value) {
+        std::memcpy(&value, ptr, sizeof(T));
+        ptr += sizeof(T);
+    }
+
+    static void writeHeader(const FrameHeader &header, std::vector<uint8_t> &frame) {
+        frame.resize(TrajectoryFrame::HEADER_SIZE);
+        uint8_t *ptr = frame.data();
+        uint8_t reserved = 0;
+        writeField(ptr, header.version);
+        writeField(ptr, header.type);
+        writeField(ptr, header.M);
+        writeField(ptr, header.n);
+        writeField(ptr, header.seq);
+        writeField(ptr, header.reference_seq);
+        writeField(ptr, header.reference_shift);
+        writeField(ptr, reserved);
+        writeField(ptr, header.step);
+        writeField(ptr, header.segment_time);
+        for (float value: header.start_point) {
+            writeField(ptr, value);
+        }
+    }
+
+    static void readHeader(const uint8_t *data, FrameHeader &header) {
+        const uint8_t *ptr = data;
+        uint8_t reserved;
+        readField(ptr, header.version);
+        readField(ptr, header.type);
+        readField(ptr, header.M);
+        readField(ptr, header.n);
+        readField(ptr, header.seq);
+        readField(ptr, header.reference_seq);
+        readField(ptr, header.reference_shift);
+        readField(ptr, reserved);
+        readField(ptr, header.step);
+        readField(ptr, header.segment_time);
+        for (float &value: header.start_point) {
+            readField(ptr, value);
+        }
+    }
+
+    static void writeVarint(int32_t value, std::vector<uint8_t> &frame) {
+        auto zigzag = (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+        while (zigzag >= 0x80) {
+            frame.emplace_back(static_cast<uint8_t>(zigzag | 0x80));
+            zigzag >>= 7;
+        }
+        frame.emplace_back(static_cast<uint8_t>(zigzag));
+    }
+
+    static bool readVarint(const uint8_t *&ptr, const uint8_t *end, int32_t &value) {
+        uint32_t zigzag = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (ptr == end) {
+                return false;
+            }
+            uint8_t byte = *ptr++;
+            zigzag |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) {
+                value = static_cast<int32_t>(zigzag >> 1) ^ -static_cast<int32_t>(zigzag & 1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // The prediction of q from the reference shifted by the segments, relative to the first control point of the
+    // shifted reference. Past the end of the reference, the last control point where the agent stops.
+    static int32_t predictOffset(const std::vector<int32_t> &reference, size_t M, size_t n, size_t shift,
+                                 size_t idx) {
+        size_t segment_size = 3 * (n + 1);
+        size_t m = idx / segment_size + shift;
+        int32_t q_ref = m >= M ? reference[(M - 1) * segment_size + 3 * n + idx % 3]
+                               : reference[m * segment_size + idx % segment_size];
+        return q_ref - reference[shift * segment_size + idx % 3];
+    }
+
+    TrajectoryEncoder::TrajectoryEncoder(double _quantization_step) : quantization_step(_quantization_step) {
+        if (quantization_step <= 0) {
+            throw std::invalid_argument("[TrajectoryEncoder] quantization step must be positive");
+        }
+    }
+
+    bool TrajectoryEncoder::encode(const traj_t &traj, std::vector<uint8_t> &key_frame,
+                                   std::vector<uint8_t> &delta_frame) {
+        key_frame.clear();
+        delta_frame.clear();
+        if (traj.empty() or traj.size() > std::numeric_limits<uint8_t>::max() or
+            traj[0].control_points.size() > std::numeric_limits<uint8_t>::max()) {
+            return false;
+        }
+        size_t traj_M = traj.size();
+        size_t traj_n = traj[0].control_points.size() - 1;
+        double segment_time = traj[0].segment_time;
+        for (size_t m = 0; m < traj_M; m++) {
+            if (traj[m].control_points.size() != traj_n + 1 or
+                std::abs(traj[m].segment_time - segment_time) > SP_EPSILON_FLOAT) {
+                return false;
+            }
+        }
+
+        // The quantization step doubled until the offsets fit int16, so that the step of the consecutive
+        // trajectories is usually the same for the delta frames
+        point3d start_point = traj.startPoint();
+        double max_offset = 0;
+        for (size_t m = 0; m < traj_M; m++) {
+            for (const auto &control_point: traj[m].control_points) {
+                for (int k = 0; k < 3; k++) {
+                    max_offset = std::max(max_offset, (double)std::abs(control_point(k) - start_point(k)));
+                }
+            }
+        }
+        double step_candidate = quantization_step;
+        while (max_offset / step_candidate > std::numeric_limits<int16_t>::max() - 1) {
+            step_candidate *= 2;
+        }
+        auto traj_step = static_cast<float>(step_candidate);
+
+        offsets.resize(traj_M * (traj_n + 1) * 3);
+        size_t idx = 0;
+        for (size_t m = 0; m < traj_M; m++) {
+            for (const auto &control_point: traj[m].control_points) {
+                for (int k = 0; k < 3; k++) {
+                    offsets[idx++] = static_cast<int32_t>(
+                            std::lround((control_point(k) - start_point(k)) / traj_step));
+                }
+            }
+        }
+
+        FrameHeader header{};
+        header.version = TrajectoryFrame::VERSION;
+        header.M = static_cast<uint8_t>(traj_M);
+        header.n = static_cast<uint8_t>(traj_n);
+        header.seq = static_cast<uint16_t>(seq + 1);
+        header.step = traj_step;
+        header.segment_time = static_cast<float>(segment_time);
+        for (int k = 0; k < 3; k++) {
+            header.start_point[k] = start_point(k);
+        }
+
+        header.type = TrajectoryFrame::KEY;
+        writeHeader(header, key_frame);
+        key_frame.resize(TrajectoryFrame::HEADER_SIZE + offsets.size() * sizeof(int16_t));
+        uint8_t *ptr = key_frame.data() + TrajectoryFrame::HEADER_SIZE;
+        for (int32_t offset: offsets) {
+            writeField(ptr, static_cast<int16_t>(offset));
+        }
+
+        // The delta against the shift of the previous trajectory with the fewest bytes
+        if (has_reference and M == traj_M and n == traj_n and step == traj_step) {
+            header.type = TrajectoryFrame::DELTA;
+            header.reference_seq = seq;
+            for (size_t shift = 0; shift < std::min<size_t>(traj_M, 2); shift++) {
+                header.reference_shift = static_cast<uint8_t>(shift);
+                writeHeader(header, delta_candidate);
+                for (idx = 0; idx < offsets.size(); idx++) {
+                    writeVarint(offsets[idx] - predictOffset(reference, M, n, shift, idx), delta_candidate);
+                }
+                if (delta_frame.empty() or delta_candidate.size() < delta_frame.size()) {
+                    std::swap(delta_frame, delta_candidate);
+                }
+            }
+        }
+
+        seq = header.seq;
+        has_reference = true;
+        M = traj_M;
+        n = traj_n;
+        step = traj_step;
+        std::swap(reference, offsets);
+        return true;
+    }
+
+    bool TrajectoryDecoder::decode(const uint8_t *data, size_t size, traj_t &traj) {
+        if (size < TrajectoryFrame::HEADER_SIZE) {
+            return false;
+        }
+        FrameHeader header{};
+        readHeader(data, header);
+        if (header.version != TrajectoryFrame::VERSION or header.M == 0 or header.n > MAX_BERNSTEIN_DEGREE) {
+            return false;
+        }
+
+        size_t frame_M = header.M, frame_n = header.n;
+        offsets.resize(frame_M * (frame_n + 1) * 3);
+        const uint8_t *ptr = data + TrajectoryFrame::HEADER_SIZE;
+        const uint8_t *end = data + size;
+        if (header.type == TrajectoryFrame::KEY) {
+            if (static_cast<size_t>(end - ptr) != offsets.size() * sizeof(int16_t)) {
+                return false;
+            }
+            for (auto &offset: offsets) {
+                int16_t value;
+                readField(ptr, value);
+                offset = value;
+            }
+        } else if (header.type == TrajectoryFrame::DELTA) {
+            if (not hasReference(header.reference_seq) or M != frame_M or n != frame_n or step != header.step or
+                header.reference_shift >= frame_M) {
+                return false;
+            }
+            for (size_t idx = 0; idx < offsets.size(); idx++) {
+                int32_t delta;
+                if (not readVarint(ptr, end, delta)) {
+                    return false;
+                }
+                offsets[idx] = predictOffset(reference, M, n, header.reference_shift, idx) + delta;
+            }
+            if (ptr != end) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+
+        // Write the control points directly to the buffers of the trajectory
+        point3d start_point(header.start_point[0], header.start_point[1], header.start_point[2]);
+        traj.reset(frame_M, frame_n, header.segment_time);
+        size_t idx = 0;
+        for (size_t m = 0; m < frame_M; m++) {
+            for (size_t i = 0; i < frame_n + 1; i++) {
+                point3d &control_point = traj[(int)m][(int)i];
+                for (int k = 0; k < 3; k++) {
+                    control_point(k) = start_point(k) + static_cast<float>(offsets[idx++]) * header.step;
+                }
+            }
+        }
+
+        has_reference = true;
+        reference_seq = header.seq;
+        M = frame_M;
+        n = frame_n;
+        step = header.step;
+        std::swap(reference, offsets);
+        return true;
+    }
+}
@@ -0,0 +1,75 @@
+#include <trajectory_history_markers.hpp>
+#include <algorithm>
+
+namespace DynamicPlanning {
+    TrajectoryHistoryMarkers::TrajectoryHistoryMarkers(int _downsample) : downsample(std::max(_downsample, 1)) {}
+
+    size_t TrajectoryHistoryMarkers::addTrack(const visualization_msgs::Marker &style) {
+        std::lock_guard<std::mutex> lock(mtx);
+        Track track;
+        track.style = style;
+        track.style.type = visualization_msgs::Marker::LINE_STRIP;
+        track.style.action = visualization_msgs::Marker::ADD;
+        track.style.points.clear();
+        tracks.emplace_back(std::move(track));
+        return tracks.size() - 1;
+    }
+
+    void TrajectoryHistoryMarkers::addPoint(size_t track_idx, const geometry_msgs::Point &point) {
+        std::lock_guard<std::mutex> lock(mtx);
+        Track &track = tracks[track_idx];
+        track.open_points.emplace_back(point);
+        track.is_open_changed = true;
+        if (track.open_points.size() < CHUNK_SIZE) {
+            return;
+        }
+
+        std::vector<geometry_msgs::Point> points;
+        points.reserve(track.open_points.size() / downsample + 2);
+        for (size_t i = 0; i < track.open_points.size(); i += downsample) {
+            points.emplace_back(track.open_points[i]);
+        }
+        if ((track.open_points.size() - 1) % downsample != 0) {
+            points.emplace_back(track.open_points.back());
+        }
+        track.sealed_chunks.emplace_back(makeChunk(track, track.sealed_chunks.size(), points));
+
+        track.open_points.erase(track.open_points.begin(), track.open_points.end() - 1);
+    }
+
+    visualization_msgs::MarkerArray TrajectoryHistoryMarkers::takeMarkers(size_t n_subscribers) {
+        std::lock_guard<std::mutex> lock(mtx);
+        visualization_msgs::MarkerArray msg;
+        bool resend_all = n_subscribers > last_n_subscribers;
+        last_n_subscribers = n_subscribers;
+
+        if (is_first_take) {
+            visualization_msgs::Marker marker_delete_all;
+            marker_delete_all.action = visualization_msgs::Marker::DELETEALL;
+            msg.markers.emplace_back(marker_delete_all);
+            is_first_take = false;
+        }
+
+        for (auto &track: tracks) {
+            for (size_t ci = resend_all ? 0 : track.n_sent_chunks; ci < track.sealed_chunks.size(); ci++) {
+                msg.markers.emplace_back(track.sealed_chunks[ci]);
+            }
+            track.n_sent_chunks = track.sealed_chunks.size();
+
+            // A LINE_STRIP needs two points
+            if ((track.is_open_changed or resend_all) and track.open_points.size() > 1) {
+                msg.markers.emplace_back(makeChunk(track, track.sealed_chunks.size(), track.open_points));
+                track.is_open_changed = false;
+            }
+        }
+        return msg;
+    }
+
+    visualization_msgs::Marker TrajectoryHistoryMarkers::makeChunk(
+            const Track &track, size_t chunk_id, const std::vector<geometry_msgs::Point> &points) const {
+        visualization_msgs::Marker marker = track.style;
+        marker.id = static_cast<int>(chunk_id);
+        marker.points = points;
+        return marker;
+    }
+}
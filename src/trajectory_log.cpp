@@ -0,0 +1,212 @@
+#include <trajectory_log.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace DynamicPlanning {
+    namespace TrajectoryLog {
+        const char *const SCHEMA = "t;agent:px,py,pz,vx,vy,vz,ax,ay,az,planning_time;obstacle:px,py,pz,radius";
+        const char MAGIC[8] = {'L', 'S', 'C', 'T', 'L', 'O', 'G', '\0'};
+
+        void writeHeader(std::ostream &out, size_t qn, size_t on, double time_step) {
+            size_t schema_size = std::strlen(SCHEMA) + 1;
+            Header header{};
+            std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+            header.version = VERSION;
+            header.qn = qn;
+            header.on = on;
+            header.agent_stride = AGENT_STRIDE;
+            header.obstacle_stride = OBSTACLE_STRIDE;
+            header.data_offset = (sizeof(header) + schema_size + 7) / 8 * 8;
+            header.time_step = time_step;
+
+            std::vector<char> schema(header.data_offset - sizeof(header), '\0');
+            std::memcpy(schema.data(), SCHEMA, schema_size);
+            out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            out.write(schema.data(), (std::streamsize) schema.size());
+        }
+
+        void appendCSVHeader(std::string &out, size_t qn, size_t on) {
+            for (size_t qi = 0; qi < qn; qi++) {
+                out += "id,t,px,py,pz,vx,vy,vz,ax,ay,az,planning_time";
+                out += qi < qn - 1 or on != 0 ? "," : "\n";
+            }
+            for (size_t oi = 0; oi < on; oi++) {
+                out += "obs_id,t,px,py,pz,size";
+                out += oi < on - 1 ? "," : "\n";
+            }
+        }
+
+        // %g matches the default format of std::ostream
+        static void appendCSVValue(std::string &out, double value) {
+            char value_str[32];
+            int n = std::snprintf(value_str, sizeof(value_str), "%g", value);
+            out.append(value_str, n);
+        }
+
+        void appendCSVFrame(std::string &out, const float *frame, size_t qn, size_t on) {
+            double t = frame[0];
+            for (size_t qi = 0; qi < qn; qi++) {
+                const float *agent = frame + getAgentOffset(qi);
+                out += std::to_string(qi);
+                out += ',';
+                appendCSVValue(out, t);
+                for (int field = 0; field < AGENT_STRIDE; field++) {
+                    out += ',';
+                    appendCSVValue(out, agent[field]);
+                }
+                out += qi < qn - 1 or on != 0 ? "," : "\n";
+            }
+            for (size_t oi = 0; oi < on; oi++) {
+                const float *obstacle = frame + getObstacleOffset(qn, oi);
+                out += std::to_string(oi);
+                out += ',';
+                appendCSVValue(out, t);
+                for (int field = 0; field < OBSTACLE_STRIDE; field++) {
+                    out += ',';
+                    appendCSVValue(out, obstacle[field]);
+                }
+                out += oi < on - 1 ? "," : "\n";
+            }
+        }
+    }
+
+    TrajectoryLogReader::~TrajectoryLogReader() {
+        close();
+    }
+
+    void TrajectoryLogReader::open(const std::string &file_name) {
+        close();
+        int fd = ::open(file_name.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::invalid_argument("[TrajectoryLog] Failed to open the log file " + file_name);
+        }
+        struct stat file_stat{};
+        if (fstat(fd, &file_stat) != 0 or (size_t) file_stat.st_size < sizeof(TrajectoryLog::Header)) {
+            ::close(fd);
+            throw std::invalid_argument("[TrajectoryLog] Invalid log file " + file_name);
+        }
+        mapped_size = file_stat.st_size;
+        mapped = mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // the mapping keeps the file
+        if (mapped == MAP_FAILED) {
+            mapped = nullptr;
+            mapped_size = 0;
+            throw std::invalid_argument("[TrajectoryLog] Failed to map the log file " + file_name);
+        }
+
+        TrajectoryLog::Header header{};
+        std::memcpy(&header, mapped, sizeof(header));
+        if (std::memcmp(header.magic, TrajectoryLog::MAGIC, sizeof(header.magic)) != 0 or
+            header.version != TrajectoryLog::VERSION or
+            header.agent_stride != TrajectoryLog::AGENT_STRIDE or
+            header.obstacle_stride != TrajectoryLog::OBSTACLE_STRIDE or
+            header.data_offset % sizeof(float) != 0 or header.data_offset > mapped_size) {
+            close();
+            throw std::invalid_argument("[TrajectoryLog] Invalid header of the log file " + file_name);
+        }
+
+        qn = header.qn;
+        on = header.on;
+        time_step = header.time_step;
+        frame_stride = TrajectoryLog::getFrameStride(qn, on);
+        frames = reinterpret_cast<const float *>(static_cast<const char *>(mapped) + header.data_offset);
+        n_frames = (mapped_size - header.data_offset) / (frame_stride * sizeof(float));
+        buildTimeIndex();
+    }
+
+    void TrajectoryLogReader::assign(size_t _qn, size_t _on, double _time_step, std::vector<float> _frames) {
+        close();
+        qn = _qn;
+        on = _on;
+        time_step = _time_step;
+        frame_stride = TrajectoryLog::getFrameStride(qn, on);
+        owned_frames = std::move(_frames);
+        frames = owned_frames.data();
+        n_frames = owned_frames.size() / frame_stride;
+        buildTimeIndex();
+    }
+
+    void TrajectoryLogReader::close() {
+        if (mapped != nullptr) {
+            munmap(mapped, mapped_size);
+            mapped = nullptr;
+            mapped_size = 0;
+        }
+        owned_frames.clear();
+        frames = nullptr;
+        qn = 0;
+        on = 0;
+        frame_stride = 0;
+        n_frames = 0;
+        time_step = 0;
+        time_index.clear();
+        bucket_width = 0;
+    }
+
+    size_t TrajectoryLogReader::findFrame(double t) const {
+        double t_first = getTime(0);
+        if (t <= t_first or time_index.empty()) {
+            return 0;
+        }
+
+        double bucket = std::min((t - t_first) / bucket_width, static_cast<double>(time_index.size() - 1));
+        size_t frame_idx = time_index[static_cast<size_t>(bucket)];
+        while (frame_idx + 1 < n_frames and getTime(frame_idx + 1) <= t) {
+            frame_idx++;
+        }
+        return frame_idx;
+    }
+
+    void TrajectoryLogReader::buildTimeIndex() {
+        time_index.clear();
+        if (n_frames < 2) {
+            return;
+        }
+
+        // A bucket per save step, at most a few per frame if the time step of the header does not match the frames
+        double duration = getTime(n_frames - 1) - getTime(0);
+        if (not(duration > 0)) {
+            return;
+        }
+        bucket_width = std::max(time_step > 0 ? time_step : duration / static_cast<double>(n_frames - 1),
+                                duration / static_cast<double>(4 * n_frames));
+        size_t n_buckets = static_cast<size_t>(std::floor(duration / bucket_width)) + 1;
+
+        time_index.resize(n_buckets);
+        size_t frame_idx = 0;
+        for (size_t bucket = 0; bucket < n_buckets; bucket++) {
+            double t_bucket = getTime(0) + static_cast<double>(bucket) * bucket_width;
+            while (frame_idx + 1 < n_frames and getTime(frame_idx + 1) <= t_bucket) {
+                frame_idx++;
+            }
+            time_index[bucket] = static_cast<uint32_t>(frame_idx);
+        }
+    }
+
+    void TrajectoryLogReader::exportCSV(const std::string &file_name) const {
+        std::ofstream result_csv(file_name);
+        if (not result_csv) {
+            throw std::invalid_argument("[TrajectoryLog] Failed to create the csv file " + file_name);
+        }
+
+        std::string buffer;
+        TrajectoryLog::appendCSVHeader(buffer, qn, on);
+        for (size_t frame_idx = 0; frame_idx < n_frames; frame_idx++) {
+            TrajectoryLog::appendCSVFrame(buffer, getFrame(frame_idx), qn, on);
+            if (buffer.size() > (1 << 20)) {
+                result_csv << buffer;
+                buffer.clear();
+            }
+        }
+        result_csv << buffer;
+    }
+}
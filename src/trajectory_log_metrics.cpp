@@ -0,0 +1,151 @@
+#include <trajectory_metrics.hpp>
+#include <summary_log.hpp>
+#include <param.hpp>
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <sstream>
+
+using namespace DynamicPlanning;
+namespace po = boost::program_options;
+
+// Computation of the summary of a simulation from its binary trajectory log, without the simulator.
+// Save the log with <param name="multisim/save_binary" value="true" />. With multisim/offline_metrics the simulator
+// only alerts the collisions of the samples, and this tool computes the statistics of the summary in parallel over the
+// windows of the frames and the agents. The minimum distances are exact for the straight lines between the frames,
+// so a contact between two samples is also found. The row has the columns of the summary of the simulator up to
+// real_time_factor, and the fields which are not in the log are nan. The radii and the downwashes are the ones of the
+// mission, which must be the mission of the log.
+// rosrun lsc_dr_planner trajectory_log_metrics --param_ns /multi_sync_simulator_node --mission default.json
+//     <package_path>/log/simulation_*.lsclog
+int main(int argc, char *argv[]) {
+    ros::init(argc, argv, "trajectory_log_metrics", ros::init_options::AnonymousName);
+
+    po::options_description desc("Options");
+    desc.add_options()
+            ("help,h", "print this message")
+            ("log,l", po::value<std::string>(), "binary trajectory log")
+            ("param_ns,p", po::value<std::string>()->default_value("~"), "namespace of the parameters")
+            ("mission,m", po::value<std::string>(), "mission file in missions/, overrides mission")
+            ("mission_idx,i", po::value<int>()->default_value(0), "index of the mission if mission is a directory")
+            ("windows,n", po::value<int>()->default_value(0), "number of the windows of the frames, 0: automatic")
+            ("threads,j", po::value<int>()->default_value(0), "number of the threads, 0: one per core")
+            ("samples_only,s", "check the distances at the frames only, as the simulator does")
+            ("summary,o", po::value<std::string>(),
+             "summary csv file, default: <package_path>/log/summary_offline_<planner>_<n>agents.csv");
+    po::positional_options_description positional;
+    positional.add("log", 1);
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
+        po::notify(vm);
+    } catch (const po::error &e) {
+        ROS_ERROR_STREAM("[TrajectoryLogMetrics] " << e.what());
+        return -1;
+    }
+    if (vm.count("help") or not vm.count("log")) {
+        std::cout << "Usage: trajectory_log_metrics [options] <log file>" << std::endl << desc << std::endl;
+        return vm.count("help") ? 0 : -1;
+    }
+
+    ros::NodeHandle nh_param(vm["param_ns"].as<std::string>());
+    Param param;
+    if (not param.initialize(nh_param)) {
+        ROS_ERROR("[TrajectoryLogMetrics] Invalid parameter");
+        return -1;
+    }
+
+    std::string log_file_name = vm["log"].as<std::string>();
+    TrajectoryLogReader trajectory_log;
+    try {
+        trajectory_log.open(log_file_name);
+    } catch (const std::invalid_argument &e) {
+        ROS_ERROR_STREAM("[TrajectoryLogMetrics] " << e.what());
+        return -1;
+    }
+
+    Mission mission(vm.count("mission") ? vm["mission"].as<std::string>() :
+                    nh_param.param<std::string>("mission", "default.json"),
+                    nh_param.param<std::string>("world/file_name", "default.bt"));
+    if (not mission.loadMission(0, param.world_dimension, param.world_z_2d, vm["mission_idx"].as<int>())) {
+        ROS_ERROR("[TrajectoryLogMetrics] Invalid mission");
+        return -1;
+    }
+
+    TrajectoryMetrics metrics;
+    ros::WallTime compute_start = ros::WallTime::now();
+    try {
+        WorkerPool pool(vm["threads"].as<int>());
+        TrajectoryMetricsEngine engine(trajectory_log, mission, param.world_dimension);
+        metrics = engine.compute(pool, vm["windows"].as<int>(), not vm.count("samples_only"));
+    } catch (const std::invalid_argument &e) {
+        ROS_ERROR_STREAM("[TrajectoryLogMetrics] " << e.what());
+        return -1;
+    }
+    double compute_time = (ros::WallTime::now() - compute_start).toSec();
+
+    if (metrics.isCollided()) {
+        ROS_ERROR_STREAM("[TrajectoryLogMetrics] collisions, agents: " << metrics.n_agent_collisions
+                         << ", obstacles: " << metrics.n_obstacle_collisions << ", first collision time: "
+                         << metrics.first_collision_time);
+    }
+    ROS_INFO_STREAM("[TrajectoryLogMetrics] " << trajectory_log.size() << " frames of " << mission.qn << " agents in "
+                    << compute_time << " s, safety_ratio_agent: " << metrics.safety_ratio_agent
+                    << ", safety_ratio_obs: " << metrics.safety_ratio_obs);
+
+    // The log is log/simulation_<start_time>_<planner>_<n>agents.lsclog, see saveSimulationResultAsLog
+    std::string stem = log_file_name.substr(log_file_name.rfind('/') + 1);
+    stem = stem.substr(0, stem.rfind('.'));
+    std::string prefix = "simulation_";
+    std::string start_time = "nan";
+    std::string file_name_param = param.getPlannerModeStr() + "_" + std::to_string(mission.qn) + "agents";
+    if (stem.rfind(prefix, 0) == 0 and stem.find('_', prefix.size()) != std::string::npos) {
+        size_t start_time_end = stem.find('_', prefix.size());
+        start_time = stem.substr(prefix.size(), start_time_end - prefix.size());
+        file_name_param = stem.substr(start_time_end + 1);
+    }
+    std::string summary_file_name = vm.count("summary") ? vm["summary"].as<std::string>() :
+                                    param.package_path + "/log/summary_offline_" + file_name_param + ".csv";
+
+    std::ostringstream header;
+    header << "start_time,total_flight_time,total_flight_distance,"
+           << "safety_ratio_agent,safety_ratio_obs,"
+           << "vel_excess_ratio,acc_excess_ratio,"
+           << "mapf_time_average,mapf_time_min,mapf_time_max,"
+           << "planning_time_average,planning_time_min,planning_time_max,"
+           << "initial_traj_planning_time,obstacle_prediction_time,goal_planning_time,"
+           << "lsc_generation_time,sfc_generation_time,traj_optimization_time,"
+           << "mission_file_name,world_file_name,"
+           << "planner_mode,goal_mode,mapf_mode,"
+           << "communication_range,world_dimension,M,dt,real_time_factor";
+
+    // The planning times of the stages and the MAPF are not in the log
+    std::ostringstream row;
+    row << start_time << ","
+        << metrics.total_flight_time << ","
+        << metrics.total_distance << ","
+        << metrics.safety_ratio_agent << ","
+        << metrics.safety_ratio_obs << ","
+        << metrics.vel_excess_ratio.norm() << ","
+        << metrics.acc_excess_ratio.norm() << ","
+        << "nan,nan,nan,"
+        << metrics.planning_time.average << ","
+        << metrics.planning_time.min << ","
+        << metrics.planning_time.max << ","
+        << "nan,nan,nan,nan,nan,nan,"
+        << mission.current_mission_file_name << ","
+        << mission.current_world_file_name << ","
+        << param.getPlannerModeStr() << ","
+        << param.getGoalModeStr() << ","
+        << param.getMAPFModeStr() << ","
+        << param.communication_range << ","
+        << param.world_dimension << ","
+        << param.M << ","
+        << param.dt << ","
+        << "nan";
+    if (not SummaryLog::append(summary_file_name, header.str(), row.str())) {
+        ROS_ERROR_STREAM("[TrajectoryLogMetrics] Fail to write the summary " << summary_file_name);
+        return -1;
+    }
+    ROS_INFO_STREAM("[TrajectoryLogMetrics] Summary: " << summary_file_name);
+    return 0;
+}
@@ -0,0 +1,30 @@
+// Export a binary trajectory log to the csv format of the simulator.
+// Save logs with <param name="multisim/save_binary" value="true" />, then run
+// rosrun lsc_dr_planner trajectory_log_to_csv <package_path>/log/simulation_*.lsclog [csv file]
+#include <trajectory_log.hpp>
+#include <iostream>
+#include <stdexcept>
+
+using namespace DynamicPlanning;
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cout << "Usage: trajectory_log_to_csv <log file> [csv file]" << std::endl;
+        return -1;
+    }
+
+    std::string log_file_name = argv[1];
+    std::string csv_file_name = argc > 2 ? argv[2] : log_file_name.substr(0, log_file_name.rfind('.')) + ".csv";
+    try {
+        TrajectoryLogReader trajectory_log;
+        trajectory_log.open(log_file_name);
+        trajectory_log.exportCSV(csv_file_name);
+        std::cout << "Exported " << trajectory_log.size() << " frames of " << trajectory_log.getNumAgents()
+                  << " agents and " << trajectory_log.getNumObstacles() << " obstacles to " << csv_file_name
+                  << std::endl;
+    } catch (const std::invalid_argument &e) {
+        std::cout << e.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}
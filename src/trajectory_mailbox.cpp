@@ -0,0 +1,25 @@
+#include <trajectory_mailbox.hpp>
+
+namespace DynamicPlanning {
+    void TrajectoryMailbox::resize(size_t _n_slots) {
+        n_slots = _n_slots;
+        slots = std::make_unique<Slot[]>(n_slots);
+    }
+
+    void TrajectoryMailbox::publish(size_t slot_idx, const traj_t &traj) {
+        Slot &slot = slots[slot_idx];
+        // The owner is the only writer of the version
+        uint64_t version = slot.version.load(std::memory_order_relaxed) + 1;
+        slot.trajs[version % SLOT_DEPTH] = traj;
+        slot.version.store(version, std::memory_order_release);
+    }
+
+    const traj_t &TrajectoryMailbox::read(size_t slot_idx) const {
+        const Slot &slot = slots[slot_idx];
+        return slot.trajs[slot.version.load(std::memory_order_acquire) % SLOT_DEPTH];
+    }
+
+    uint64_t TrajectoryMailbox::getVersion(size_t slot_idx) const {
+        return slots[slot_idx].version.load(std::memory_order_acquire);
+    }
+}
@@ -0,0 +1,170 @@
+#include <trajectory_metrics.hpp>
+#include <geometry.hpp>
+#include <algorithm>
+#include <stdexcept>
+
+namespace DynamicPlanning {
+    void TrajectoryMetrics::merge(const TrajectoryMetrics &other) {
+        total_flight_time = std::max(total_flight_time, other.total_flight_time);
+        total_distance += other.total_distance;
+        safety_ratio_agent = std::min(safety_ratio_agent, other.safety_ratio_agent);
+        safety_ratio_obs = std::min(safety_ratio_obs, other.safety_ratio_obs);
+        for (int i = 0; i < 3; i++) {
+            vel_excess_ratio(i) = std::max(vel_excess_ratio(i), other.vel_excess_ratio(i));
+            acc_excess_ratio(i) = std::max(acc_excess_ratio(i), other.acc_excess_ratio(i));
+        }
+        n_agent_collisions += other.n_agent_collisions;
+        n_obstacle_collisions += other.n_obstacle_collisions;
+        first_collision_time = std::min(first_collision_time, other.first_collision_time);
+        planning_time.merge(other.planning_time);
+    }
+
+    TrajectoryMetricsEngine::TrajectoryMetricsEngine(const TrajectoryLogReader &_log, const Mission &_mission,
+                                                     int _world_dimension)
+            : log(_log), mission(_mission), world_dimension(_world_dimension) {
+        if (log.getNumAgents() != mission.qn or log.getNumObstacles() != mission.on) {
+            throw std::invalid_argument("[TrajectoryMetrics] The log is not a log of the mission, " +
+                                        std::to_string(log.getNumAgents()) + " agents and " +
+                                        std::to_string(log.getNumObstacles()) + " obstacles");
+        }
+        for (size_t oi = 0; oi < mission.on; oi++) {
+            if (mission.obstacles[oi]->getType() != "real") {
+                sim_obstacles.emplace_back(oi);
+            }
+        }
+    }
+
+    TrajectoryMetrics TrajectoryMetricsEngine::compute(WorkerPool &pool, int n_windows, bool continuous) const {
+        TrajectoryMetrics metrics;
+        size_t n_frames = log.size();
+        size_t qn = log.getNumAgents();
+        if (n_frames == 0 or qn == 0) {
+            return metrics;
+        }
+
+        if (n_windows <= 0) {
+            n_windows = 4 * pool.getNumWorkers();
+        }
+        size_t window_size = (n_frames + n_windows - 1) / n_windows;
+        size_t n_window_tasks = (n_frames + window_size - 1) / window_size;
+
+        // results[window * qn + qi], merged in this order
+        std::vector<TrajectoryMetrics> results(n_window_tasks * qn);
+        pool.run(results.size(), [&](size_t task) {
+            size_t window = task / qn;
+            size_t qi = task % qn;
+            size_t frame_begin = window * window_size;
+            size_t frame_end = std::min(frame_begin + window_size, n_frames);
+            computeAgentWindow(qi, frame_begin, frame_end, continuous, results[task]);
+        });
+
+        for (const auto &result: results) {
+            metrics.merge(result);
+        }
+        metrics.total_flight_time = log.getTime(n_frames - 1);
+        return metrics;
+    }
+
+    void TrajectoryMetricsEngine::computeAgentWindow(size_t qi, size_t frame_begin, size_t frame_end, bool continuous,
+                                                     TrajectoryMetrics &metrics) const {
+        using namespace TrajectoryLog;
+        const Agent &agent_i = mission.agents[qi];
+        size_t qn = log.getNumAgents();
+        size_t last_frame = log.size() - 1;
+        for (size_t frame = frame_begin; frame < frame_end; frame++) {
+            // The interval to the next frame, the last one is empty
+            size_t next_frame = std::min(frame + 1, last_frame);
+            point3d start_i = getAgentPosition(frame, qi);
+            point3d end_i = getAgentPosition(next_frame, qi);
+            metrics.total_distance += (end_i - start_i).norm();
+
+            // vel_excess_ratio, acc_excess_ratio, in the same way as the simulator
+            const float *values = log.getAgent(frame, qi);
+            for (int i = 0; i < world_dimension; i++) {
+                double curr_vel_excess_ratio = (values[AGENT_VX + i] - agent_i.max_vel[i]) / agent_i.max_vel[i];
+                if (curr_vel_excess_ratio > 0 and curr_vel_excess_ratio > metrics.vel_excess_ratio(i)) {
+                    metrics.vel_excess_ratio(i) = curr_vel_excess_ratio;
+                }
+
+                double curr_acc_excess_ratio = (values[AGENT_AX + i] - agent_i.max_acc[i]) / agent_i.max_acc[i];
+                if (curr_acc_excess_ratio > 0 and curr_acc_excess_ratio > metrics.acc_excess_ratio(i)) {
+                    metrics.acc_excess_ratio(i) = curr_acc_excess_ratio;
+                }
+            }
+
+            // The planning time of the agent is repeated in the frames until it plans again
+            float planning_time = values[AGENT_PLANNING_TIME];
+            if (planning_time > 0 and
+                (frame == 0 or log.getAgent(frame - 1, qi)[AGENT_PLANNING_TIME] != planning_time)) {
+                metrics.planning_time.update(planning_time);
+            }
+
+            // The last frame is the end of the previous interval
+            if (continuous and frame == last_frame and frame > 0) {
+                continue;
+            }
+
+            // safety_ratio_agent, each pair once
+            bool is_collided = false;
+            for (size_t qj = qi + 1; qj < qn; qj++) {
+                const Agent &agent_j = mission.agents[qj];
+                double radius_sum = agent_i.radius + agent_j.radius;
+                double downwash = (agent_i.downwash * agent_i.radius + agent_j.downwash * agent_j.radius) / radius_sum;
+                double safety_ratio = computeSafetyRatio(start_i, end_i, getAgentPosition(frame, qj),
+                                                         getAgentPosition(next_frame, qj), radius_sum, downwash,
+                                                         continuous);
+                metrics.safety_ratio_agent = std::min(metrics.safety_ratio_agent, safety_ratio);
+                if (safety_ratio < 1) {
+                    metrics.n_agent_collisions++;
+                    is_collided = true;
+                }
+            }
+
+            // safety_ratio_obs
+            for (size_t oi: sim_obstacles) {
+                const auto &obstacle = mission.obstacles[oi];
+                double obstacle_radius = log.getObstacle(frame, oi)[OBSTACLE_RADIUS];
+                double radius_sum = agent_i.radius + obstacle_radius;
+                double downwash = (obstacle_radius * obstacle->getDownwash() + agent_i.radius * agent_i.downwash) /
+                                  radius_sum;
+                double safety_ratio = computeSafetyRatio(start_i, end_i, getObstaclePosition(frame, oi),
+                                                         getObstaclePosition(next_frame, oi), radius_sum, downwash,
+                                                         continuous);
+                metrics.safety_ratio_obs = std::min(metrics.safety_ratio_obs, safety_ratio);
+                if (safety_ratio < 1) {
+                    metrics.n_obstacle_collisions++;
+                    is_collided = true;
+                }
+            }
+
+            if (is_collided) {
+                metrics.first_collision_time = std::min(metrics.first_collision_time,
+                                                        static_cast<double>(log.getTime(frame)));
+            }
+        }
+    }
+
+    point3d TrajectoryMetricsEngine::getAgentPosition(size_t frame_idx, size_t qi) const {
+        const float *values = log.getAgent(frame_idx, qi);
+        return {values[TrajectoryLog::AGENT_PX], values[TrajectoryLog::AGENT_PY], values[TrajectoryLog::AGENT_PZ]};
+    }
+
+    point3d TrajectoryMetricsEngine::getObstaclePosition(size_t frame_idx, size_t oi) const {
+        const float *values = log.getObstacle(frame_idx, oi);
+        return {values[TrajectoryLog::OBSTACLE_PX], values[TrajectoryLog::OBSTACLE_PY],
+                values[TrajectoryLog::OBSTACLE_PZ]};
+    }
+
+    double TrajectoryMetricsEngine::computeSafetyRatio(const point3d &start1, const point3d &end1,
+                                                       const point3d &start2, const point3d &end2,
+                                                       double radius_sum, double downwash, bool continuous) {
+        // The ellipsoid of the downwash is a ball after z is divided by the downwash, and the scaled motions are
+        // still linear
+        auto scale = [downwash](const point3d &point) { return point3d(point.x(), point.y(), point.z() / downwash); };
+        Line path1(scale(start1), scale(end1));
+        Line path2(scale(start2), scale(end2));
+        double dist = continuous ? closestPointsBetweenLinePaths(path1, path2).dist
+                                 : (path2.start_point - path1.start_point).norm();
+        return dist / radius_sum;
+    }
+}
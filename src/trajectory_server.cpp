@@ -0,0 +1,81 @@
+#include <trajectory_server.hpp>
+
+namespace DynamicPlanning {
+    void TrajectoryServer::setTrajectory(const traj_t &traj, double start_time) {
+        Table &table = tables.getBackBuffer();
+        table.is_valid = not traj.empty();
+        table.start_time = start_time;
+        table.duration = 0;
+        table.segments.resize(traj.size());
+        for (int m = 0; m < traj.size(); m++) {
+            const Segment<point3d> &segment = traj[m];
+            SegmentTable &segment_table = table.segments[m];
+            int n = static_cast<int>(segment.control_points.size()) - 1;
+            segment_table.start_time = table.duration;
+            segment_table.degree = n;
+            table.duration += segment.segment_time;
+
+            // p(t) = sum_i P_i * C(n, i) * s^i * (1 - s)^(n - i) with s = t / T, and the coefficient of t^j is
+            // sum_{i <= j} P_i * C(n, i) * C(n - i, j - i) * (-1)^(j - i) / T^j
+            double time_scale = 1;
+            for (int j = 0; j <= n; j++) {
+                std::array<double, 3> coefficient = {0, 0, 0};
+                for (int i = 0; i <= j; i++) {
+                    double weight = binomial(n, i) * binomial(n - i, j - i) * ((j - i) % 2 == 0 ? 1 : -1);
+                    for (int k = 0; k < 3; k++) {
+                        coefficient[k] += weight * segment.control_points[i](k);
+                    }
+                }
+                for (int k = 0; k < 3; k++) {
+                    segment_table.position[j][k] = coefficient[k] * time_scale;
+                }
+                time_scale /= segment.segment_time;
+            }
+            for (int j = 0; j < n; j++) {
+                for (int k = 0; k < 3; k++) {
+                    segment_table.velocity[j][k] = (j + 1) * segment_table.position[j + 1][k];
+                }
+            }
+            for (int j = 0; j < n - 1; j++) {
+                for (int k = 0; k < 3; k++) {
+                    segment_table.acceleration[j][k] = (j + 1) * segment_table.velocity[j + 1][k];
+                }
+            }
+        }
+        tables.publish();
+    }
+
+    static inline point3d evaluatePolynomial(const std::array<std::array<double, 3>, MAX_BERNSTEIN_DEGREE + 1> &coeffs,
+                                             int degree, double t) {
+        if (degree < 0) {
+            return {0, 0, 0};
+        }
+        double x = coeffs[degree][0], y = coeffs[degree][1], z = coeffs[degree][2];
+        for (int j = degree - 1; j >= 0; j--) {
+            x = x * t + coeffs[j][0];
+            y = y * t + coeffs[j][1];
+            z = z * t + coeffs[j][2];
+        }
+        return {static_cast<float>(x), static_cast<float>(y), static_cast<float>(z)};
+    }
+
+    bool TrajectoryServer::getState(double time, State &state) {
+        tables.update();
+        const Table &table = tables.getFrontBuffer();
+        if (not table.is_valid) {
+            return false;
+        }
+
+        double t = std::min(std::max(time - table.start_time, 0.0), table.duration);
+        size_t m = 0;
+        while (m + 1 < table.segments.size() and t >= table.segments[m + 1].start_time) {
+            m++;
+        }
+        const SegmentTable &segment_table = table.segments[m];
+        double t_segment = t - segment_table.start_time;
+        state.position = evaluatePolynomial(segment_table.position, segment_table.degree, t_segment);
+        state.velocity = evaluatePolynomial(segment_table.velocity, segment_table.degree - 1, t_segment);
+        state.acceleration = evaluatePolynomial(segment_table.acceleration, segment_table.degree - 2, t_segment);
+        return true;
+    }
+}
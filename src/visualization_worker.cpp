@@ -0,0 +1,106 @@
+#include <visualization_worker.hpp>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace DynamicPlanning {
+    VisualizationWorker &VisualizationWorker::getInstance() {
+        static VisualizationWorker visualization_worker;
+        return visualization_worker;
+    }
+
+    VisualizationWorker::VisualizationWorker() : n_dropped_jobs(0), stop(false) {
+        worker = std::thread(&VisualizationWorker::workerLoop, this);
+    }
+
+    VisualizationWorker::~VisualizationWorker() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stop = true;
+            pending_jobs.clear();
+        }
+        cv.notify_all();
+        worker.join();
+    }
+
+    void VisualizationWorker::submit(const std::string &key, Job job) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            auto it = pending_jobs.find(key);
+            if (it != pending_jobs.end()) {
+                it->second = std::move(job);
+                n_dropped_jobs++;
+            } else {
+                pending_jobs.emplace(key, std::move(job));
+            }
+        }
+        cv.notify_one();
+    }
+
+    void VisualizationWorker::setMaxRate(double max_rate) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            min_interval = max_rate > 0 ? std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(1.0 / max_rate)) : std::chrono::steady_clock::duration(0);
+        }
+        cv.notify_one();
+    }
+
+    size_t VisualizationWorker::getNumDroppedJobs() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return n_dropped_jobs;
+    }
+
+    size_t VisualizationWorker::getNumPendingJobs() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return pending_jobs.size();
+    }
+
+    void VisualizationWorker::workerLoop() {
+#ifdef __linux__
+        // Run only when the planner leaves a core idle
+        sched_param sched{};
+        sched.sched_priority = 0;
+        pthread_setschedparam(pthread_self(), SCHED_IDLE, &sched);
+#endif
+
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                while (true) {
+                    cv.wait(lock, [this] { return stop or not pending_jobs.empty(); });
+                    if (stop) {
+                        return;
+                    }
+
+                    // The pending key that ran the longest ago, waiting until its interval passes
+                    auto next = pending_jobs.begin();
+                    auto next_time = std::chrono::steady_clock::time_point::min();
+                    for (auto it = pending_jobs.begin(); it != pending_jobs.end(); it++) {
+                        auto last_run = last_run_times.find(it->first);
+                        auto ready_time = last_run == last_run_times.end() ?
+                                          std::chrono::steady_clock::time_point::min() :
+                                          last_run->second + min_interval;
+                        if (it == pending_jobs.begin() or ready_time < next_time) {
+                            next = it;
+                            next_time = ready_time;
+                        }
+                    }
+                    auto now = std::chrono::steady_clock::now();
+                    if (next_time <= now) {
+                        last_run_times[next->first] = now;
+                        job = std::move(next->second);
+                        pending_jobs.erase(next);
+                        break;
+                    }
+                    cv.wait_until(lock, next_time);
+                }
+            }
+
+            job();
+        }
+    }
+}
@@ -0,0 +1,379 @@
+#include <worker_pool.hpp>
+#include <metrics_registry.hpp>
+#include <timer.hpp>
+#include <trace.hpp>
+#include <algorithm>
+#include <chrono>
+
+namespace DynamicPlanning {
+    // True in the worker threads and in the calling thread while it runs a batch or a queued task
+    static thread_local bool in_parallel_region = false;
+
+    // The pool of the worker thread and its index, the slot of its task queue
+    static thread_local const WorkerPool *worker_owner = nullptr;
+    static thread_local int worker_slot = 0;
+
+    namespace {
+        struct PoolMetrics {
+            MetricCounter &batches;
+            MetricCounter &serial_batches;
+            MetricHistogram &batch_time;
+            MetricGauge &queued_tasks;
+            std::array<MetricCounter *, 2> tasks; // [priority]
+            std::array<MetricCounter *, 2> canceled_tasks;
+            std::array<MetricHistogram *, 2> task_time;
+            std::array<MetricHistogram *, 2> queue_time;
+        };
+
+        PoolMetrics &getMetrics() {
+            static PoolMetrics metrics = [] {
+                MetricsRegistry &registry = MetricsRegistry::getInstance();
+                return PoolMetrics{
+                        registry.getCounter("lsc_worker_pool_batches_total", "Parallel loops run by the workers"),
+                        registry.getCounter("lsc_worker_pool_serial_batches_total",
+                                            "Parallel loops run serially since they were nested or the pool was busy"),
+                        registry.getHistogram("lsc_worker_pool_batch_seconds", "Time of the parallel loops"),
+                        registry.getGauge("lsc_worker_pool_queued_tasks", "Tasks of the task groups not started"),
+                        {&registry.getCounter("lsc_worker_pool_high_tasks_total", "High priority tasks run"),
+                         &registry.getCounter("lsc_worker_pool_low_tasks_total", "Low priority tasks run")},
+                        {&registry.getCounter("lsc_worker_pool_high_canceled_tasks_total",
+                                              "High priority tasks dropped by the cancel of their group"),
+                         &registry.getCounter("lsc_worker_pool_low_canceled_tasks_total",
+                                              "Low priority tasks dropped by the cancel of their group")},
+                        {&registry.getHistogram("lsc_worker_pool_high_task_seconds",
+                                                "Busy time of the workers in the high priority tasks"),
+                         &registry.getHistogram("lsc_worker_pool_low_task_seconds",
+                                                "Busy time of the workers in the low priority tasks")},
+                        {&registry.getHistogram("lsc_worker_pool_high_queue_seconds",
+                                                "Time from the queueing to the start of the high priority tasks"),
+                         &registry.getHistogram("lsc_worker_pool_low_queue_seconds",
+                                                "Time from the queueing to the start of the low priority tasks")}};
+            }();
+            return metrics;
+        }
+
+        int64_t steadyNow() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+    }
+
+    TaskGroup::TaskGroup(WorkerPool &_pool, TaskPriority priority) : pool(_pool), state(std::make_shared<State>()) {
+        state->priority = priority;
+    }
+
+    TaskGroup::~TaskGroup() {
+        wait();
+    }
+
+    void TaskGroup::run(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(state->mtx);
+            state->tasks.push_back({std::move(task), steadyNow()});
+            state->n_unfinished++;
+        }
+        // A waiting thread of the group runs it if no worker takes it
+        state->cv.notify_all();
+        if (not pool.workers.empty()) {
+            pool.enqueue(state);
+        }
+    }
+
+    void TaskGroup::wait() {
+        std::unique_lock<std::mutex> lock(state->mtx);
+        while (state->n_unfinished > 0) {
+            if (state->tasks.empty()) {
+                // The other tasks are running, the waiting thread helps if one of them adds a task
+                state->cv.wait(lock, [this] { return state->n_unfinished == 0 or not state->tasks.empty(); });
+                continue;
+            }
+            lock.unlock();
+            bool was_in_parallel_region = in_parallel_region;
+            in_parallel_region = true;
+            runQueuedTask(*state);
+            in_parallel_region = was_in_parallel_region;
+            lock.lock();
+        }
+    }
+
+    void TaskGroup::cancel() {
+        state->is_cancelled = true;
+    }
+
+    bool TaskGroup::isCancelled() const {
+        return state->is_cancelled;
+    }
+
+    bool TaskGroup::runQueuedTask(State &state) {
+        QueuedTask queued_task;
+        {
+            std::lock_guard<std::mutex> lock(state.mtx);
+            if (state.tasks.empty()) {
+                return false;
+            }
+            queued_task = std::move(state.tasks.front());
+            state.tasks.pop_front();
+        }
+
+        PoolMetrics &metrics = getMetrics();
+        auto priority = static_cast<size_t>(state.priority);
+        if (state.is_cancelled) {
+            metrics.canceled_tasks[priority]->increment();
+        } else {
+            int64_t start_ns = steadyNow();
+            metrics.queue_time[priority]->record(static_cast<double>(start_ns - queued_task.queued_ns) * 1e-9);
+            {
+                TRACE_SCOPE(state.priority == TaskPriority::HIGH ? "WorkerPool::highPriorityTask" :
+                            "WorkerPool::lowPriorityTask");
+                queued_task.task();
+            }
+            metrics.task_time[priority]->record(static_cast<double>(steadyNow() - start_ns) * 1e-9);
+            metrics.tasks[priority]->increment();
+        }
+
+        bool is_finished;
+        {
+            std::lock_guard<std::mutex> lock(state.mtx);
+            is_finished = --state.n_unfinished == 0;
+        }
+        if (is_finished) {
+            state.cv.notify_all();
+        }
+        return true;
+    }
+
+    // [s], see getHelperCPUSeconds
+    static thread_local double helper_cpu_seconds = 0;
+
+    WorkerPool &WorkerPool::getInstance() {
+        static WorkerPool pool(0);
+        return pool;
+    }
+
+    WorkerPool::WorkerPool(int n_workers) {
+        if (n_workers <= 0) {
+            n_workers = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+        }
+
+        // The calling thread is one of the workers, the worker 0
+        affine_next_tasks = std::make_unique<std::atomic<size_t>[]>(n_workers);
+        for (auto &task_queues_p: task_queues) {
+            task_queues_p = std::make_unique<TaskQueue[]>(n_workers);
+        }
+        for (int i = 1; i < n_workers; i++) {
+            workers.emplace_back(&WorkerPool::workerLoop, this, i);
+        }
+    }
+
+    WorkerPool::~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stop = true;
+        }
+        cv_start.notify_all();
+        for (auto &worker: workers) {
+            worker.join();
+        }
+    }
+
+    void WorkerPool::run(size_t n_tasks, const std::function<void(size_t)> &task) {
+        runBatch(n_tasks, task, nullptr);
+    }
+
+    void WorkerPool::runAffine(const std::vector<size_t> &keys, const std::function<void(size_t)> &task) {
+        runBatch(keys.size(), task, &keys);
+    }
+
+    double WorkerPool::getHelperCPUSeconds() {
+        return helper_cpu_seconds;
+    }
+
+    bool WorkerPool::setPlacement(ThreadPlacementMode mode) {
+        // The worker i gets the CPU i, the CPU 0 of the placement is left to the calling thread
+        std::vector<int> placement = CPUTopology::getInstance().getPlacement(mode, workers.size() + 1);
+        bool success = true;
+        for (size_t i = 0; i < workers.size(); i++) {
+            int cpu = placement.empty() ? -1 : placement[i + 1];
+            success = CPUTopology::pinThread(workers[i].native_handle(), cpu) and success;
+        }
+        return success;
+    }
+
+    void WorkerPool::runBatch(size_t n_tasks, const std::function<void(size_t)> &task,
+                              const std::vector<size_t> *keys) {
+        if (n_tasks == 0) {
+            return;
+        }
+
+        std::unique_lock<std::mutex> run_lock(run_mtx, std::try_to_lock);
+        if (n_tasks == 1 or workers.empty() or in_parallel_region or not run_lock.owns_lock()) {
+            if (n_tasks > 1 and not workers.empty()) {
+                getMetrics().serial_batches.increment();
+            }
+            for (size_t i = 0; i < n_tasks; i++) {
+                task(i);
+            }
+            return;
+        }
+        int64_t start_ns = steadyNow();
+
+        {
+            // Workers must not take tasks of the previous batch
+            std::unique_lock<std::mutex> lock(mtx);
+            cv_finish.wait(lock, [this] { return n_busy_workers == 0; });
+            current_task = &task;
+            n_tasks_total = n_tasks;
+            next_task = 0;
+            n_tasks_finished = 0;
+            batch_helper_cpu_ns = 0;
+            affine_tasks.clear();
+            if (keys != nullptr) {
+                affine_tasks.resize(getNumWorkers());
+                for (size_t i = 0; i < n_tasks; i++) {
+                    affine_tasks[(*keys)[i] % affine_tasks.size()].emplace_back(i);
+                }
+                for (size_t wi = 0; wi < affine_tasks.size(); wi++) {
+                    affine_next_tasks[wi] = 0;
+                }
+            }
+            batch_seq++;
+        }
+        cv_start.notify_all();
+
+        in_parallel_region = true;
+        runTasks(task, n_tasks, 0);
+        in_parallel_region = false;
+
+        // Wait for the workers as well, since they refer to task
+        std::unique_lock<std::mutex> lock(mtx);
+        cv_finish.wait(lock, [this] { return n_tasks_finished == n_tasks_total and n_busy_workers == 0; });
+        current_task = nullptr;
+        helper_cpu_seconds += static_cast<double>(batch_helper_cpu_ns.load()) * 1e-9;
+        lock.unlock();
+
+        PoolMetrics &metrics = getMetrics();
+        metrics.batches.increment();
+        metrics.batch_time.record(static_cast<double>(steadyNow() - start_ns) * 1e-9);
+    }
+
+    void WorkerPool::workerLoop(int worker_idx) {
+        in_parallel_region = true;
+        worker_owner = this;
+        worker_slot = worker_idx;
+        int last_batch_seq = 0;
+        while (true) {
+            const std::function<void(size_t)> *task = nullptr;
+            size_t n_tasks = 0;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv_start.wait(lock, [this, last_batch_seq] {
+                    return stop or batch_seq != last_batch_seq or n_queued > 0;
+                });
+                if (stop) {
+                    return;
+                }
+                // A new batch comes before the queued tasks
+                if (batch_seq != last_batch_seq) {
+                    last_batch_seq = batch_seq;
+                    if (current_task != nullptr) {
+                        task = current_task;
+                        n_tasks = n_tasks_total;
+                        n_busy_workers++;
+                    }
+                }
+            }
+
+            if (task == nullptr) {
+                std::shared_ptr<TaskGroup::State> group = dequeue(worker_idx);
+                if (group != nullptr) {
+                    TaskGroup::runQueuedTask(*group);
+                }
+                continue;
+            }
+
+            ThreadCPUTimer cpu_timer;
+            runTasks(*task, n_tasks, worker_idx);
+            cpu_timer.stop();
+
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                batch_helper_cpu_ns += static_cast<int64_t>(cpu_timer.elapsedSeconds() * 1e9);
+                n_busy_workers--;
+            }
+            cv_finish.notify_all();
+        }
+    }
+
+    void WorkerPool::runTasks(const std::function<void(size_t)> &task, size_t n_tasks, int worker_idx) {
+        size_t n_finished = 0;
+        if (affine_tasks.empty()) {
+            for (size_t i = next_task++; i < n_tasks; i = next_task++) {
+                task(i);
+                n_finished++;
+            }
+        } else {
+            // Its own tasks first, then the rest of the others
+            size_t n_workers = affine_tasks.size();
+            for (size_t k = 0; k < n_workers; k++) {
+                size_t wi = (worker_idx + k) % n_workers;
+                const std::vector<size_t> &tasks = affine_tasks[wi];
+                for (size_t j = affine_next_tasks[wi]++; j < tasks.size(); j = affine_next_tasks[wi]++) {
+                    task(tasks[j]);
+                    n_finished++;
+                }
+            }
+        }
+
+        if (n_finished > 0) {
+            std::lock_guard<std::mutex> lock(mtx);
+            n_tasks_finished += n_finished;
+        }
+        cv_finish.notify_all();
+    }
+
+    void WorkerPool::enqueue(const std::shared_ptr<TaskGroup::State> &group) {
+        int slot = worker_owner == this ? worker_slot : 0;
+        TaskQueue &queue = task_queues[static_cast<size_t>(group->priority)][slot];
+        {
+            std::lock_guard<std::mutex> lock(queue.mtx);
+            queue.groups.push_back(group);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            n_queued++;
+            getMetrics().queued_tasks.set(static_cast<double>(n_queued));
+        }
+        cv_start.notify_one();
+    }
+
+    std::shared_ptr<TaskGroup::State> WorkerPool::dequeue(int slot) {
+        auto n_slots = static_cast<int>(workers.size()) + 1;
+        std::shared_ptr<TaskGroup::State> group;
+        for (auto &task_queues_p: task_queues) {
+            for (int k = 0; k < n_slots and group == nullptr; k++) {
+                TaskQueue &queue = task_queues_p[(slot + k) % n_slots];
+                std::lock_guard<std::mutex> lock(queue.mtx);
+                if (queue.groups.empty()) {
+                    continue;
+                }
+                if (k == 0) {
+                    group = std::move(queue.groups.back());
+                    queue.groups.pop_back();
+                } else {
+                    group = std::move(queue.groups.front());
+                    queue.groups.pop_front();
+                }
+            }
+            if (group != nullptr) {
+                break;
+            }
+        }
+
+        if (group != nullptr) {
+            std::lock_guard<std::mutex> lock(mtx);
+            n_queued--;
+            getMetrics().queued_tasks.set(static_cast<double>(n_queued));
+        }
+        return group;
+    }
+}
@@ -1,5 +1,10 @@
 #pragma once
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <random>
+#include <string>
 #include <unordered_map>
 
 #include "node.hpp"
@@ -7,6 +12,24 @@
 namespace MAPF {
     using Path = std::vector<Node *>;    // < loc_i[0], loc_i[1], ... >
 
+    // Read-only view of a bit-packed occupancy grid owned by the caller.
+    // The cell (x, y, z) is the bit offset + x * stride_x + y * stride_y + z * stride_z of words.
+    struct GridView {
+        const uint64_t *words = nullptr;
+        int width = 0;
+        int height = 0;
+        int depth = 1;
+        size_t offset = 0;
+        size_t stride_x = 0;
+        size_t stride_y = 0;
+        size_t stride_z = 0;
+
+        bool isOccupied(int x, int y, int z = 0) const {
+            size_t bit = offset + x * stride_x + y * stride_y + z * stride_z;
+            return (words[bit >> 6] >> (bit & 63)) & 1;
+        }
+    };
+
 // Pure graph. Base class of Grid class.
     class Graph {
     private:
@@ -26,41 +49,103 @@ namespace MAPF {
                               std::mt19937 *MT = nullptr);
 
         // helpers for cache
-        std::unordered_map<std::string, Path> PATH_TABLE;
+        // The suffixes of a registered path share one array of node ids, an entry is (array, offset).
+        struct PathTableEntry {
+            std::shared_ptr<const std::vector<int32_t>> ids;
+            int offset;
+            std::list<uint64_t>::iterator lru;  // position in PATH_TABLE_LRU
+        };
+
+        // approximated memory of an entry, hash node and LRU node included
+        static constexpr size_t PATH_TABLE_ENTRY_BYTES = sizeof(uint64_t) + sizeof(PathTableEntry) + 6 * sizeof(void *);
+
+        static constexpr size_t DEFAULT_PATH_TABLE_CAPACITY = 64 << 20;
+
+        std::unordered_map<uint64_t, PathTableEntry> PATH_TABLE;
+        std::list<uint64_t> PATH_TABLE_LRU;  // most recently used first
+        size_t path_table_capacity;          // [bytes]
+        size_t path_table_memory;            // [bytes]
+        size_t path_table_hits;
+        size_t path_table_misses;
+        mutable std::mutex PATH_TABLE_MTX;   // the solvers running concurrently share the graph
+
+        // get key for cache, (start id, goal id) packed in 64 bits
+        static uint64_t getPathTableKey(const Node *const s, const Node *const g) {
+            return (static_cast<uint64_t>(static_cast<uint32_t>(s->id)) << 32) | static_cast<uint32_t>(g->id);
+        }
+
+        // returns nullptr if not found, touch: mark the entry as recently used
+        const PathTableEntry *findPath(const Node *const s, const Node *const g, bool touch);
 
-        // get key name for cache
-        static std::string getPathTableKey(const Node *const s, const Node *const g);
+        // length of the cached path in nodes
+        static int getPathSize(const PathTableEntry &entry) { return entry.ids->size() - entry.offset; }
+
+        Path getPathFromEntry(const PathTableEntry &entry) const;
 
         // register already searched path to cache
         void registerPath(const Path &path);
 
+        void erasePath(std::unordered_map<uint64_t, PathTableEntry>::iterator itr);
+
+        // evict the least recently used paths until the memory usage is below the capacity
+        void evictPaths();
+
         // body
     protected:
-        // V[y * width + x] = Node with position (x, y)
-        // if (x, y) is occupied then V[y * width + x] = nullptr
+        // V[id] = &node_storage[id], the ids of the free cells are compact in [0, V.size())
+        std::vector<Node> node_storage;
         Nodes V;
 
+        // compressed adjacency, the neighbors of the node id are adjacency[adjacency_offsets[id]]
+        // to adjacency[adjacency_ends[id] - 1]. The range up to adjacency_offsets[id + 1] holds the neighbors
+        // without blocked nodes, so blocking a node only shortens the ranges around it.
+        std::vector<int32_t> adjacency_offsets;
+        std::vector<int32_t> adjacency_ends;
+        std::vector<int32_t> adjacency;
+
         // something strange
         void halt(const std::string &msg);
 
     public:
+        // view of the neighbor ids of a node in the compressed adjacency, valid while the graph lives
+        struct NeighborIds {
+            const int32_t *first;
+            const int32_t *last;
+
+            const int32_t *begin() const { return first; }
+
+            const int32_t *end() const { return last; }
+
+            size_t size() const { return last - first; }
+        };
+
         Graph();
 
         virtual ~Graph();
 
-        // in grid, id = y * width + x
+        // id is the compact node id, not the cell index
         virtual bool existNode(int id) const { return false; };
 
-        virtual bool existNode(int x, int y) const { return false; };
+        virtual bool existNode(int x, int y, int z = 0) const { return false; };
 
-        // in grid, id = y * width + x
-        virtual Node *getNode(int x, int y) const { return nullptr; };
+        virtual Node *getNode(int x, int y, int z = 0) const { return nullptr; };
 
         virtual Node *getNode(int id) const { return nullptr; };
 
-        // in grid, Manhattan distance
+        // in grid, the length of the shortest path without obstacles
         virtual int dist(const Node *const v, const Node *const u) const { return 0; }
 
+        // neighbors without allocation, the hot loops of the solvers use this
+        NeighborIds getNeighborIds(const Node *const v) const {
+            if (adjacency_offsets.empty()) return {nullptr, nullptr};
+            return {adjacency.data() + adjacency_offsets[v->id], adjacency.data() + adjacency_ends[v->id]};
+        }
+
+        // adapter of the compressed adjacency for the solvers using node lists
+        Nodes getNeighbors(const Node *const v) const;
+
+        int getDegree(const Node *const v) const { return getNeighborIds(v).size(); }
+
         // get path between two nodes
         Path getPath(Node *const s, Node *const g, const bool cache = true,
                      std::mt19937 *MT = nullptr, const Nodes &prohibited_nodes = {});
@@ -71,38 +156,90 @@ namespace MAPF {
         int pathDist(Node *const s, Node *const g, const bool cache = true,
                      std::mt19937 *MT = nullptr, const Nodes &prohibited_nodes = {});
 
+        // memory cap of the path cache in bytes, the least recently used paths are evicted
+        void setPathCacheCapacity(size_t capacity);
+
+        void clearPathCache();
+
+        size_t getPathCacheHits() const;
+
+        size_t getPathCacheMisses() const;
+
+        size_t getPathCacheMemory() const;
+
         // get all nodes without nullptr
         Nodes getV() const;
 
-        // get width*height
+        // the number of nodes, ids are in [0, getNodesSize())
         int getNodesSize() const { return V.size(); }
+
+        // without the range check of getNode, for the ids of getNeighborIds
+        Node *getNodeUnchecked(int id) const { return V[id]; }
     };
 
+    // 4-connected 2D grid, or 6- or 26-connected 3D grid with unit cost edges.
+    // A diagonal move of the 26-connected grid requires all cells it sweeps to be free.
     class Grid : public Graph {
     private:
+        struct Move {
+            Pos delta;
+            std::vector<Pos> sweep; // cells passed by the diagonal move, relative to the source
+        };
+
         std::string map_file;
         int width;
         int height;
+        int depth;
+        int connectivity;
+        std::vector<int> cell_ids; // cell index (z * height + y) * width + x -> node id, -1 if occupied
+        std::vector<Move> moves;
+        std::vector<uint8_t> blocked; // [node id], see setBlocked
+        std::vector<int> changed_ids; // buffers of setBlocked
+        std::vector<uint8_t> touched;
+
+        void setMoves();
+
+        int getCellIndex(int x, int y, int z) const { return (z * height + y) * width + x; }
+
+        bool isInside(int x, int y, int z) const {
+            return 0 <= x && x < width && 0 <= y && y < height && 0 <= z && z < depth;
+        }
+
+        // create nodes of the cells where free[cell index] is true
+        void createNodes(const std::vector<bool> &free);
+
+        // build the compressed adjacency from the moves
+        void createAdjacency();
+
+        // the neighbors of v without the blocked nodes, in its range of the adjacency
+        void updateAdjacency(const Node *const v);
+
+        bool isFree(int x, int y, int z) const {
+            if (!isInside(x, y, z)) return false;
+            const int id = cell_ids[getCellIndex(x, y, z)];
+            return id >= 0 && !blocked[id];
+        }
 
     public:
         Grid() {};
 
         Grid(const std::string &_map_file);
 
-        Grid(const std::vector<std::vector<std::vector<int>>> &grid);
+        // connectivity: 6 or 26, a grid with depth 1 is 4- or 8-connected
+        Grid(const GridView &grid, int _connectivity = 6);
 
         ~Grid() {};
 
         bool existNode(int id) const;
 
-        bool existNode(int x, int y) const;
+        bool existNode(int x, int y, int z = 0) const;
 
         Node *getNode(int id) const;
 
-        Node *getNode(int x, int y) const;
+        Node *getNode(int x, int y, int z = 0) const;
 
         int dist(const Node *const v, const Node *const u) const {
-            return v->manhattanDist(u);
+            return connectivity == 26 ? v->chebyshevDist(u) : v->manhattanDist(u);
         }
 
         std::string getMapFileName() const { return map_file; };
@@ -110,5 +247,18 @@ namespace MAPF {
         int getWidth() const { return width; }
 
         int getHeight() const { return height; }
+
+        int getDepth() const { return depth; }
+
+        int getConnectivity() const { return connectivity; }
+
+        // Block the nodes of the cells occupied in grid, which has the size of this grid, and unblock the others.
+        // The nodes are kept, so a graph built once for the static map serves the problems with the changing
+        // obstacles. A blocked node does not exist for existNode and getNode(x, y, z) and has no edge, only the
+        // adjacency around the changed nodes is updated. The path cache is cleared if any node changed.
+        // Returns the number of the changed nodes.
+        int setBlocked(const GridView &grid);
+
+        bool isBlocked(const Node *const v) const { return blocked[v->id]; }
     };
 }
\ No newline at end of file
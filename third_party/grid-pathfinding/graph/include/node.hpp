@@ -7,21 +7,23 @@ namespace MAPF {
     struct Node;
     using Nodes = std::vector<Node*>;
 
+    // Neighbors are not stored in the node, they are generated by Graph::getNeighbors
     struct Node {
         const int id;
         const Pos pos;
-        Nodes neighbor;
 
-        Node(int _id, int x, int y);
+        Node(int _id, int x, int y, int z = 0);
 
         ~Node();
 
-        int getDegree() const;
-
         int manhattanDist(const Node &node) const;
 
         int manhattanDist(const Node *const node) const;
 
+        int chebyshevDist(const Node &node) const;
+
+        int chebyshevDist(const Node *const node) const;
+
         float euclideanDist(const Node &node) const;
 
         float euclideanDist(const Node *const node) const;
@@ -38,4 +40,4 @@ namespace MAPF {
 
         bool operator!=(const Node *const v) const;
     };
-}
\ No newline at end of file
+}
@@ -4,8 +4,9 @@ namespace MAPF {
     struct Pos {
         int x;
         int y;
+        int z;
 
-        Pos(int _x, int _y);
+        Pos(int _x, int _y, int _z = 0);
 
         ~Pos();
 
@@ -15,6 +16,8 @@ namespace MAPF {
 
         int manhattanDist(const Pos &pos) const;
 
+        int chebyshevDist(const Pos &pos) const;
+
         float euclideanDist(const Pos &pos) const;
 
         bool operator==(const Pos &other) const;
@@ -1,6 +1,8 @@
 #include "../include/graph.hpp"
 
+#include <algorithm>
 #include <chrono>
+#include <deque>
 #include <fstream>
 #include <iostream>
 #include <queue>
@@ -8,13 +10,16 @@
 using namespace MAPF;
 using Time = std::chrono::steady_clock;
 
-Graph::Graph() {}
-
-Graph::~Graph()
+Graph::Graph()
+    : path_table_capacity(DEFAULT_PATH_TABLE_CAPACITY),
+      path_table_memory(0),
+      path_table_hits(0),
+      path_table_misses(0)
 {
-  for (auto v : V) delete v;
 }
 
+Graph::~Graph() {}
+
 Path Graph::getPathWithoutCache(Node* s, Node* g, std::mt19937* MT,
                                 const Nodes& prohibited_nodes) const
 {
@@ -60,7 +65,7 @@ Path Graph::getPathWithoutCache(Node* s, Node* g, std::mt19937* MT,
     }
 
     // expand
-    Nodes C = n_v->neighbor;
+    Nodes C = getNeighbors(n_v);
     if (MT != nullptr) std::shuffle(C.begin(), C.end(), *MT);  // randomize
     for (auto u : C) {
       int g_cost = n_g + 1;
@@ -80,7 +85,7 @@ Path Graph::getPathWithoutCache(Node* s, Node* g, std::mt19937* MT,
   Path path = {g};
   auto n = g;
   while (n != s) {
-    for (auto m : n->neighbor) {
+    for (auto m : getNeighbors(n)) {
       if (CLOSE[m->id] == CLOSE[n->id] - 1) {
         n = m;
         path.push_back(n);
@@ -108,7 +113,6 @@ Path Graph::getPathWithCache(Node* const s, Node* const g, std::mt19937* MT)
     if (a->g != b->g) return a->g < b->g;
     return false;
   };
-  std::function<AstarNode*(Node*, int, int, AstarNode*)> createNewNode;
   std::function<bool(Node*)> isClosed;
   std::function<void(Node*)> setClosed;
 
@@ -116,39 +120,24 @@ Path Graph::getPathWithCache(Node* const s, Node* const g, std::mt19937* MT)
   constexpr int huge_graph_size = 300000;
   bool is_small_graph = (V.size() <= huge_graph_size);
 
-  // for allocating memory, for small field
-  const int MEMORY_SIZE = is_small_graph ? V.size() : 0;
-  AstarNode GC_S[MEMORY_SIZE];
-  int node_total_cnt = 0;
-
-  // garbage collection, for large field
-  AstarNodes GC_L;
+  // for allocating memory, for both fields
+  // a node can be pushed once per neighbor, so the memory is not bounded by the number of nodes.
+  // deque keeps the addresses of the created nodes
+  std::deque<AstarNode> GC;
+  auto createNewNode = [&](Node* v, int g, int f, AstarNode* p) {
+    GC.push_back(AstarNode{v, g, f, p});
+    return &GC.back();
+  };
 
   // closed list
-  bool CLOSE_S[MEMORY_SIZE];  // for small field
-  std::memset(CLOSE_S, false, sizeof(CLOSE_S));
+  std::vector<bool> CLOSE_S(is_small_graph ? V.size() : 0, false);  // for small field
   std::unordered_map<int, bool> CLOSE_L;  // for large field
 
   if (is_small_graph) {
-    createNewNode = [&](Node* v, int g, int f, AstarNode* p) {
-      if (node_total_cnt >= MEMORY_SIZE)
-        halt("memory over, increase MEMORY_SIZE...");
-      auto q = &(GC_S[node_total_cnt++]);
-      q->v = v;
-      q->g = g;
-      q->f = f;
-      q->p = p;
-      return q;
-    };
     isClosed = [&](Node* v) { return CLOSE_S[v->id]; };
     setClosed = [&](Node* v) { CLOSE_S[v->id] = true; };
 
   } else {
-    createNewNode = [&](Node* v, int g, int f, AstarNode* p) {
-      AstarNode* new_node = new AstarNode{v, g, f, p};
-      GC_L.push_back(new_node);
-      return new_node;
-    };
     isClosed = [&](Node* v) { return CLOSE_L.find(v->id) != CLOSE_L.end(); };
     setClosed = [&](Node* v) { CLOSE_L[v->id] = true; };
   }
@@ -180,19 +169,19 @@ Path Graph::getPathWithCache(Node* const s, Node* const g, std::mt19937* MT)
     }
 
     // check whether the remained path has already known
-    auto itr = PATH_TABLE.find(getPathTableKey(n->v, g));
-    if (itr != PATH_TABLE.end()) {
+    const PathTableEntry* entry = findPath(n->v, g, true);
+    if (entry != nullptr) {
       // if found then complement the rest
-      Path path = itr->second;
-      for (auto k = path.begin() + 1; k != path.end(); ++k) {
-        n = createNewNode(*k, 0, 0, n);
+      const auto& ids = *entry->ids;
+      for (size_t k = entry->offset + 1; k < ids.size(); ++k) {
+        n = createNewNode(V[ids[k]], 0, 0, n);
       }
       invalid = false;
       break;
     }
 
     // expand
-    Nodes C = n->v->neighbor;
+    Nodes C = getNeighbors(n->v);
     if (MT != nullptr) std::shuffle(C.begin(), C.end(), *MT);  // randomize
 
     for (auto u : C) {
@@ -201,8 +190,8 @@ Path Graph::getPathWithCache(Node* const s, Node* const g, std::mt19937* MT)
       int g_value = n->g + 1;
       int h_value = g_value + dist(u, g);
       // use real cost whenever available
-      auto itr = PATH_TABLE.find(getPathTableKey(u, g));
-      if (itr != PATH_TABLE.end()) h_value = g_value + itr->second.size() - 1;
+      const PathTableEntry* u_entry = findPath(u, g, false);
+      if (u_entry != nullptr) h_value = g_value + getPathSize(*u_entry) - 1;
       // create new node
       AstarNode* m = createNewNode(u, g_value, h_value, n);
       OPEN.push(m);
@@ -220,9 +209,6 @@ Path Graph::getPathWithCache(Node* const s, Node* const g, std::mt19937* MT)
   }
   std::reverse(path.begin(), path.end());
 
-  // free
-  for (auto p : GC_L) delete p;
-
   return path;
 }
 
@@ -234,28 +220,103 @@ void Graph::halt(const std::string& msg)
   std::exit(1);
 }
 
-// static
-std::string Graph::getPathTableKey(const Node* const s, const Node* const g)
+const Graph::PathTableEntry* Graph::findPath(const Node* const s,
+                                             const Node* const g, bool touch)
+{
+  auto itr = PATH_TABLE.find(getPathTableKey(s, g));
+  if (itr == PATH_TABLE.end()) return nullptr;
+  if (touch) {
+    PATH_TABLE_LRU.splice(PATH_TABLE_LRU.begin(), PATH_TABLE_LRU,
+                          itr->second.lru);
+  }
+  return &itr->second;
+}
+
+Path Graph::getPathFromEntry(const PathTableEntry& entry) const
 {
-  return std::to_string(s->id) + "-" + std::to_string(g->id);
+  Path path;
+  path.reserve(getPathSize(entry));
+  const auto& ids = *entry.ids;
+  for (size_t k = entry.offset; k < ids.size(); ++k) path.push_back(V[ids[k]]);
+  return path;
 }
 
 /*
  * Given a path < v_1, ..., v_k >,
- * < v_1, ..., v_k >, < v_2, ..., v_k >, ..., < v_{k-1}, ..., v_k >
- * are registered.
+ * < v_1, ..., v_k >, < v_2, ..., v_k >, ..., < v_{k-2}, ..., v_k >
+ * are registered. All of them share one array of node ids.
  */
 void Graph::registerPath(const Path& path)
 {
   if (path.empty()) return;
-  Nodes tmp = path;
-  Node* v;
+  auto ids = std::make_shared<std::vector<int32_t>>();
+  ids->reserve(path.size());
+  for (auto v : path) ids->push_back(v->id);
+  path_table_memory += ids->size() * sizeof(int32_t);
+
   Node* g = *(path.end() - 1);
-  do {
-    v = tmp[0];
-    PATH_TABLE[getPathTableKey(v, g)] = tmp;
-    tmp.erase(tmp.begin());
-  } while (tmp.size() > 2);
+  const int last = std::max(0, (int)path.size() - 3);
+  for (int i = 0; i <= last; ++i) {
+    const uint64_t key = getPathTableKey(path[i], g);
+    auto itr = PATH_TABLE.find(key);
+    if (itr != PATH_TABLE.end()) erasePath(itr);
+    PATH_TABLE_LRU.push_front(key);
+    PATH_TABLE.emplace(key, PathTableEntry{ids, i, PATH_TABLE_LRU.begin()});
+    path_table_memory += PATH_TABLE_ENTRY_BYTES;
+  }
+  ids.reset();  // the entries own the array from here
+  evictPaths();
+}
+
+void Graph::erasePath(std::unordered_map<uint64_t, PathTableEntry>::iterator itr)
+{
+  // the last entry that refers to the array releases it
+  if (itr->second.ids.use_count() == 1) {
+    path_table_memory -= itr->second.ids->size() * sizeof(int32_t);
+  }
+  path_table_memory -= PATH_TABLE_ENTRY_BYTES;
+  PATH_TABLE_LRU.erase(itr->second.lru);
+  PATH_TABLE.erase(itr);
+}
+
+void Graph::evictPaths()
+{
+  while (path_table_memory > path_table_capacity && !PATH_TABLE_LRU.empty()) {
+    erasePath(PATH_TABLE.find(PATH_TABLE_LRU.back()));
+  }
+}
+
+void Graph::setPathCacheCapacity(size_t capacity)
+{
+  std::lock_guard<std::mutex> lock(PATH_TABLE_MTX);
+  path_table_capacity = capacity;
+  evictPaths();
+}
+
+void Graph::clearPathCache()
+{
+  std::lock_guard<std::mutex> lock(PATH_TABLE_MTX);
+  PATH_TABLE.clear();
+  PATH_TABLE_LRU.clear();
+  path_table_memory = 0;
+}
+
+size_t Graph::getPathCacheHits() const
+{
+  std::lock_guard<std::mutex> lock(PATH_TABLE_MTX);
+  return path_table_hits;
+}
+
+size_t Graph::getPathCacheMisses() const
+{
+  std::lock_guard<std::mutex> lock(PATH_TABLE_MTX);
+  return path_table_misses;
+}
+
+size_t Graph::getPathCacheMemory() const
+{
+  std::lock_guard<std::mutex> lock(PATH_TABLE_MTX);
+  return path_table_memory;
 }
 
 Path Graph::getPath(Node* const s, Node* const g, const bool cache,
@@ -265,9 +326,15 @@ Path Graph::getPath(Node* const s, Node* const g, const bool cache,
   if (!cache || !prohibited_nodes.empty())
     return getPathWithoutCache(s, g, MT, prohibited_nodes);
 
+  std::lock_guard<std::mutex> lock(PATH_TABLE_MTX);
+
   // check cache
-  auto itr = PATH_TABLE.find(getPathTableKey(s, g));
-  if (itr != PATH_TABLE.end()) return itr->second;
+  const PathTableEntry* entry = findPath(s, g, true);
+  if (entry != nullptr) {
+    ++path_table_hits;
+    return getPathFromEntry(*entry);
+  }
+  ++path_table_misses;
 
   // failed -> use A* search
   Path path = getPathWithCache(s, g, MT);
@@ -290,16 +357,19 @@ int Graph::pathDist(Node* const s, Node* const g, const bool cache,
   return getPath(s, g, cache, MT, prohibited_nodes).size() - 1;
 }
 
-Nodes Graph::getV() const
+Nodes Graph::getV() const { return V; }
+
+Nodes Graph::getNeighbors(const Node* const v) const
 {
-  Nodes _V;
-  for (auto v : V) {
-    if (v != nullptr) _V.push_back(v);
-  }
-  return _V;
+  NeighborIds ids = getNeighborIds(v);
+  Nodes C;
+  C.reserve(ids.size());
+  for (int32_t id : ids) C.push_back(V[id]);
+  return C;
 }
 
-Grid::Grid(const std::string& _map_file) : Graph(), map_file(_map_file)
+Grid::Grid(const std::string& _map_file)
+    : Graph(), map_file(_map_file), depth(1), connectivity(6)
 {
   // read map file
 #ifdef _MAPDIR_
@@ -331,9 +401,9 @@ Grid::Grid(const std::string& _map_file) : Graph(), map_file(_map_file)
   }
   if (!(width > 0 && height > 0)) halt("failed to load width/height.");
 
-  // create nodes
+  // read cells
   int y = 0;
-  V = Nodes(width * height, nullptr);
+  std::vector<bool> free(width * height, false);
   while (getline(file, line)) {
     // for CRLF coding
     if (*(line.end() - 1) == 0x0d) line.pop_back();
@@ -342,76 +412,198 @@ Grid::Grid(const std::string& _map_file) : Graph(), map_file(_map_file)
     for (int x = 0; x < width; ++x) {
       char s = line[x];
       if (s == 'T' or s == '@') continue;  // object
-      int id = width * y + x;
-      Node* v = new Node(id, x, y);
-      V[id] = v;
+      free[getCellIndex(x, y, 0)] = true;
     }
     ++y;
   }
   if (y != height) halt("map format is invalid");
   file.close();
 
-  // create edges
-  for (int y = 0; y < height; ++y) {
-    for (int x = 0; x < width; ++x) {
-      if (!existNode(x, y)) continue;
-      Node* v = getNode(x, y);
-      // left
-      if (existNode(x - 1, y)) v->neighbor.push_back(getNode(x - 1, y));
-      // right
-      if (existNode(x + 1, y)) v->neighbor.push_back(getNode(x + 1, y));
-      // up
-      if (existNode(x, y - 1)) v->neighbor.push_back(getNode(x, y - 1));
-      // down
-      if (existNode(x, y + 1)) v->neighbor.push_back(getNode(x, y + 1));
+  setMoves();
+  createNodes(free);
+}
+
+Grid::Grid(const GridView& grid, int _connectivity)
+    : Graph(), width(grid.width), height(grid.height), depth(grid.depth), connectivity(_connectivity)
+{
+  std::vector<bool> free(width * height * depth, false);
+  for (int z = 0; z < depth; ++z) {
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        free[getCellIndex(x, y, z)] = !grid.isOccupied(x, y, z);
+      }
     }
   }
+
+  setMoves();
+  createNodes(free);
 }
 
-Grid::Grid(const std::vector<std::vector<std::vector<int>>>& grid) : Graph()
+void Grid::setMoves()
 {
-    width = grid.size();
-    height = grid[0].size();
-
-    // create nodes
-    V = Nodes(width * height, nullptr);
-    for(int x = 0; x < width; x++){
-        for(int y = 0; y < height; y++){
-            if(grid[x][y][0] == 1) continue;  // object
-            int id = width * y + x;
-            Node* v = new Node(id, x, y);
-            V[id] = v;
+  if (connectivity != 6 && connectivity != 26) halt("invalid connectivity.");
+
+  // face neighbors first, in the order of left, right, up, down, below, above
+  moves.clear();
+  for (int axis = 0; axis < 3; ++axis) {
+    for (int sign : {-1, 1}) {
+      int d[3] = {0, 0, 0};
+      d[axis] = sign;
+      if (depth == 1 && axis == 2) continue;
+      moves.push_back({Pos(d[0], d[1], d[2]), {}});
+    }
+  }
+  if (connectivity == 6) return;
+
+  for (int dz = -1; dz <= 1; ++dz) {
+    for (int dy = -1; dy <= 1; ++dy) {
+      for (int dx = -1; dx <= 1; ++dx) {
+        if (depth == 1 && dz != 0) continue;
+        const int d[3] = {dx, dy, dz};
+        int nonzero_mask = 0;
+        for (int axis = 0; axis < 3; ++axis) {
+          if (d[axis] != 0) nonzero_mask |= 1 << axis;
+        }
+        // skip the face neighbors and the source itself
+        if (__builtin_popcount(nonzero_mask) < 2) continue;
+
+        Move move{Pos(dx, dy, dz), {}};
+        for (int mask = 1; mask < nonzero_mask; ++mask) {
+          if ((mask & nonzero_mask) != mask) continue;
+          move.sweep.emplace_back((mask & 1) ? dx : 0, (mask & 2) ? dy : 0, (mask & 4) ? dz : 0);
         }
+        moves.push_back(move);
+      }
     }
+  }
+}
+
+void Grid::createNodes(const std::vector<bool>& free)
+{
+  const int n_cells = width * height * depth;
+  int n_nodes = 0;
+  for (int c = 0; c < n_cells; ++c) {
+    if (free[c]) ++n_nodes;
+  }
 
-    // create edges
+  // node_storage is not reallocated after this, so the pointers in V stay valid
+  node_storage.clear();
+  node_storage.reserve(n_nodes);
+  V.clear();
+  V.reserve(n_nodes);
+  cell_ids.assign(n_cells, -1);
+  for (int z = 0; z < depth; ++z) {
     for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            if (!existNode(x, y)) continue;
-            Node* v = getNode(x, y);
-            // left
-            if (existNode(x - 1, y)) v->neighbor.push_back(getNode(x - 1, y));
-            // right
-            if (existNode(x + 1, y)) v->neighbor.push_back(getNode(x + 1, y));
-            // up
-            if (existNode(x, y - 1)) v->neighbor.push_back(getNode(x, y - 1));
-            // down
-            if (existNode(x, y + 1)) v->neighbor.push_back(getNode(x, y + 1));
+      for (int x = 0; x < width; ++x) {
+        const int c = getCellIndex(x, y, z);
+        if (!free[c]) continue;
+        const int id = V.size();
+        node_storage.emplace_back(id, x, y, z);
+        V.push_back(&node_storage.back());
+        cell_ids[c] = id;
+      }
+    }
+  }
+  createAdjacency();
+}
+
+void Grid::createAdjacency()
+{
+  // no node is blocked yet, so the ranges are the neighbors in the static map
+  blocked.assign(V.size(), 0);
+  adjacency_offsets.assign(V.size() + 1, 0);
+  adjacency_ends.assign(V.size(), 0);
+  adjacency.clear();
+  adjacency.reserve(V.size() * moves.size());
+  for (const Node* v : V) {
+    for (const auto& move : moves) {
+      const Pos p = v->pos + move.delta;
+      if (!isFree(p.x, p.y, p.z)) continue;
+      bool swept_free = true;
+      for (const auto& sweep : move.sweep) {
+        const Pos q = v->pos + sweep;
+        if (!isFree(q.x, q.y, q.z)) {
+          swept_free = false;
+          break;
         }
+      }
+      if (swept_free) adjacency.push_back(cell_ids[getCellIndex(p.x, p.y, p.z)]);
     }
+    adjacency_offsets[v->id + 1] = adjacency.size();
+    adjacency_ends[v->id] = adjacency.size();
+  }
+  adjacency.shrink_to_fit();
+}
+
+void Grid::updateAdjacency(const Node* const v)
+{
+  int end = adjacency_offsets[v->id];
+  if (!blocked[v->id]) {
+    for (const auto& move : moves) {
+      const Pos p = v->pos + move.delta;
+      if (!isFree(p.x, p.y, p.z)) continue;
+      bool swept_free = true;
+      for (const auto& sweep : move.sweep) {
+        const Pos q = v->pos + sweep;
+        if (!isFree(q.x, q.y, q.z)) {
+          swept_free = false;
+          break;
+        }
+      }
+      // the free neighbors are a subset of the static ones, so they fit in the range
+      if (swept_free) adjacency[end++] = cell_ids[getCellIndex(p.x, p.y, p.z)];
+    }
+  }
+  adjacency_ends[v->id] = end;
+}
+
+int Grid::setBlocked(const GridView& grid)
+{
+  changed_ids.clear();
+  for (Node* v : V) {
+    const uint8_t is_blocked = grid.isOccupied(v->pos.x, v->pos.y, v->pos.z) ? 1 : 0;
+    if (is_blocked != blocked[v->id]) {
+      blocked[v->id] = is_blocked;
+      changed_ids.push_back(v->id);
+    }
+  }
+  if (changed_ids.empty()) return 0;
+
+  // the moves and their sweeps are within the Chebyshev distance 1, so only the nodes around a changed node
+  // lose or regain edges
+  touched.assign(V.size(), 0);
+  for (int id : changed_ids) {
+    const Pos& pos = V[id]->pos;
+    for (int dz = -1; dz <= 1; ++dz) {
+      for (int dy = -1; dy <= 1; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+          const int x = pos.x + dx, y = pos.y + dy, z = pos.z + dz;
+          if (!isInside(x, y, z)) continue;
+          const int u = cell_ids[getCellIndex(x, y, z)];
+          if (u < 0 || touched[u]) continue;
+          touched[u] = 1;
+          updateAdjacency(V[u]);
+        }
+      }
+    }
+  }
+  clearPathCache();
+  return changed_ids.size();
 }
 
 bool Grid::existNode(int id) const
 {
-  return 0 <= id && id < width * height && V[id] != nullptr;
+  return 0 <= id && id < (int)V.size();
 }
 
-bool Grid::existNode(int x, int y) const
+bool Grid::existNode(int x, int y, int z) const
 {
-  return 0 <= x && x < width && 0 <= y && y < height &&
-         existNode(y * width + x);
+  return isFree(x, y, z);
 }
 
-Node* Grid::getNode(int id) const { return V[id]; }
+Node* Grid::getNode(int id) const { return existNode(id) ? V[id] : nullptr; }
 
-Node* Grid::getNode(int x, int y) const { return getNode(y * width + x); }
+Node* Grid::getNode(int x, int y, int z) const
+{
+  return existNode(x, y, z) ? V[cell_ids[getCellIndex(x, y, z)]] : nullptr;
+}
@@ -4,13 +4,11 @@
 #include <iostream>
 
 namespace MAPF {
-    Node::Node(int _id, int x, int y)
-            : id(_id), pos(Pos(x, y)) {}
+    Node::Node(int _id, int x, int y, int z)
+            : id(_id), pos(Pos(x, y, z)) {}
 
     Node::~Node() {}
 
-    int Node::getDegree() const { return neighbor.size(); }
-
     int Node::manhattanDist(const Node &node) const {
         return pos.manhattanDist(node.pos);
     }
@@ -19,6 +17,14 @@ namespace MAPF {
         return pos.manhattanDist(node->pos);
     }
 
+    int Node::chebyshevDist(const Node &node) const {
+        return pos.chebyshevDist(node.pos);
+    }
+
+    int Node::chebyshevDist(const Node *const node) const {
+        return pos.chebyshevDist(node->pos);
+    }
+
     float Node::euclideanDist(const Node &node) const {
         return pos.euclideanDist(node.pos);
     }
@@ -30,11 +36,6 @@ namespace MAPF {
     void Node::print() const {
         std::cout << "node[" << std::right << std::setw(6) << id << "]=<pos:";
         pos.print();
-        std::cout << ", neigh: d=" << std::setw(1) << getDegree() << ", ";
-        for (auto v: neighbor) {
-            v->pos.print();
-            std::cout << ", ";
-        }
         std::cout << ">";
     }
 
@@ -6,21 +6,22 @@ TEST(Graph, loading)
 {
   Grid G("../map/lak105d.map");
   ASSERT_TRUE(G.existNode(0));
-  ASSERT_TRUE(G.existNode(455));
+  ASSERT_TRUE(G.existNode(21, 14));
   ASSERT_TRUE(G.existNode(0, 0));
-  ASSERT_FALSE(G.existNode(5));
-  ASSERT_EQ(G.getNode(0)->getDegree(), 2);
+  ASSERT_FALSE(G.existNode(5, 0));
+  ASSERT_FALSE(G.existNode(443));
+  ASSERT_EQ(G.getDegree(G.getNode(0, 0)), 2);
   ASSERT_EQ(G.getV().size(), 443);
   ASSERT_EQ(G.getWidth(), 31);
   ASSERT_EQ(G.getHeight(), 25);
-  ASSERT_EQ(G.getNodesSize(), 775);
+  ASSERT_EQ(G.getNodesSize(), 443);
 }
 
 TEST(Graph, small_filed)
 {
   Grid G("../map/lak105d.map");
-  Node* v = G.getNode(0);
-  Node* u = G.getNode(455);
+  Node* v = G.getNode(0, 0);
+  Node* u = G.getNode(21, 14);
   ASSERT_EQ(v->manhattanDist(u), 35);
   ASSERT_TRUE(25 < v->euclideanDist(u) && v->euclideanDist(u) < 26);
   ASSERT_EQ(G.pathDist(v, u, false), 39);
@@ -58,3 +59,93 @@ TEST(Graph, huge_field_with_cache)
   Node* u = G.getNode(84, 461);
   ASSERT_EQ(G.pathDist(v, u, true), 863);
 }
+
+TEST(Graph, grid_3d)
+{
+  // 3 x 3 x 2 grid, the center column (1, 1, z) is occupied
+  std::vector<uint64_t> words(1, 0);
+  GridView view;
+  view.words = words.data();
+  view.width = 3;
+  view.height = 3;
+  view.depth = 2;
+  view.stride_x = 1;
+  view.stride_y = 3;
+  view.stride_z = 9;
+  words[0] |= uint64_t(1) << (1 + 1 * 3 + 0 * 9);
+  words[0] |= uint64_t(1) << (1 + 1 * 3 + 1 * 9);
+
+  Grid G6(view, 6);
+  ASSERT_EQ(G6.getNodesSize(), 16);
+  ASSERT_EQ(G6.getNode(0, 0, 0)->id, 0);
+  ASSERT_EQ(G6.getNode(0, 0, 1)->id, 8);
+  ASSERT_EQ(G6.getDegree(G6.getNode(0, 0, 0)), 3);
+  ASSERT_EQ(G6.pathDist(G6.getNode(0, 0, 0), G6.getNode(2, 2, 1), false), 5);
+
+  Grid G26(view, 26);
+  // the diagonal moves to (1, 1, 0) and (1, 1, 1) are blocked by the occupied column
+  ASSERT_EQ(G26.getDegree(G26.getNode(0, 0, 0)), 5);
+  ASSERT_EQ(G26.pathDist(G26.getNode(0, 0, 0), G26.getNode(2, 2, 1), false), 4);
+  ASSERT_EQ(G26.pathDist(G26.getNode(0, 0, 0), G26.getNode(2, 0, 1), false), 2);
+}
+
+TEST(Graph, compressed_adjacency)
+{
+  Grid G("../map/lak105d.map");
+  for (Node* v : G.getV()) {
+    Nodes C = G.getNeighbors(v);
+    ASSERT_EQ(C.size(), G.getNeighborIds(v).size());
+    for (Node* u : C) {
+      ASSERT_EQ(v->manhattanDist(u), 1);
+      ASSERT_EQ(G.getNodeUnchecked(u->id), u);
+    }
+  }
+}
+
+TEST(Graph, blocked_nodes)
+{
+  // 3 x 3 x 2 grid, the center column (1, 1, z) is blocked after the construction
+  std::vector<uint64_t> words(1, 0);
+  GridView view;
+  view.words = words.data();
+  view.width = 3;
+  view.height = 3;
+  view.depth = 2;
+  view.stride_x = 1;
+  view.stride_y = 3;
+  view.stride_z = 9;
+
+  Grid G26(view, 26);
+  Node* corner = G26.getNode(0, 0, 0);
+  ASSERT_EQ(G26.getNodesSize(), 18);
+  ASSERT_EQ(G26.getDegree(corner), 7);
+  ASSERT_EQ(G26.setBlocked(view), 0);
+
+  words[0] |= uint64_t(1) << (1 + 1 * 3 + 0 * 9);
+  words[0] |= uint64_t(1) << (1 + 1 * 3 + 1 * 9);
+  Node* center = G26.getNodeUnchecked(4);
+  ASSERT_EQ(G26.setBlocked(view), 2);
+  ASSERT_TRUE(G26.isBlocked(center));
+  ASSERT_FALSE(G26.existNode(1, 1, 0));
+  ASSERT_EQ(G26.getNode(1, 1, 1), nullptr);
+  ASSERT_EQ(G26.getDegree(center), 0);
+
+  // the same adjacency as the graph built with the column occupied
+  Grid G26_occupied(view, 26);
+  for (Node* v : G26_occupied.getV()) {
+    Node* u = G26.getNode(v->pos.x, v->pos.y, v->pos.z);
+    ASSERT_NE(u, nullptr);
+    Nodes C = G26.getNeighbors(u);
+    Nodes C_occupied = G26_occupied.getNeighbors(v);
+    ASSERT_EQ(C.size(), C_occupied.size());
+    for (size_t i = 0; i < C.size(); ++i) ASSERT_TRUE(C[i]->pos == C_occupied[i]->pos);
+  }
+  ASSERT_EQ(G26.pathDist(corner, G26.getNode(2, 2, 1), false), 4);
+
+  // unblocking restores the edges and the node pointers stay valid
+  words[0] = 0;
+  ASSERT_EQ(G26.setBlocked(view), 2);
+  ASSERT_EQ(G26.getNode(1, 1, 0), center);
+  ASSERT_EQ(G26.getDegree(corner), 7);
+  ASSERT_EQ(G26.pathDist(corner, G26.getNode(2, 2, 1), false), 2);
+}